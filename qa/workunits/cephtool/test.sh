@@ -397,9 +397,13 @@ ceph osd pool set data hashpspool 0
 ceph osd pool set data hashpspool 1
 expect_false ceph osd pool set data hashpspool asdf
 expect_false ceph osd pool set data hashpspool 2
+expect_false ceph osd pool set data fast_read 1
 
 ceph osd pool set rbd hit_set_type explicit_hash
 ceph osd pool set rbd hit_set_type explicit_object
+ceph osd pool set rbd hit_set_type decay_bloom
+ceph osd pool set rbd hit_set_type blocked_bloom
+ceph osd pool set rbd hit_set_fpp .01
 ceph osd pool set rbd hit_set_type bloom
 expect_false ceph osd pool set rbd hit_set_type i_dont_exist
 ceph osd pool set rbd hit_set_period 123
@@ -417,6 +421,8 @@ ceph osd pool set rbd cache_target_full_ratio 0
 expect_false ceph osd pool set rbd cache_target_full_ratio 1.1
 ceph osd pool set rbd cache_min_flush_age 123
 ceph osd pool set rbd cache_min_evict_age 234
+ceph osd pool set rbd min_read_recency_for_promote 2
+ceph osd pool set rbd min_read_frequency_for_promote 1
 
 ceph osd pool get rbd crush_ruleset | grep 'crush_ruleset: 0'
 
@@ -22,11 +22,17 @@ export PATH=/sbin:$PATH
 : ${CEPH_ERASURE_CODE_BENCHMARK:=ceph_erasure_code_benchmark}
 : ${PLUGIN_DIRECTORY:=/usr/lib/ceph/erasure-code}
 : ${PLUGINS:=example jerasure}
+# e.g. "encode decode ecutil-encode ecutil-decode" to include the OSD code path
+: ${WORKLOADS:=encode decode}
+# e.g. "data" for the worst case of MDS codes, or "exhaustive"
+: ${ERASURES_GENERATION:=random}
 : ${ITERATIONS:=1024}
 : ${SIZE:=1048576}
+# e.g. "none ssse3 avx2" to compare the jerasure w=8 kernels
+: ${JERASURE_SIMD:=}
 
 function bench_header() {
-    echo -e "seconds\tKB\tplugin\tk\tm\twork.\titer.\tsize\teras.\tcommand."
+    echo -e "seconds\tKB\tGB/s\tplugin\tk\tm\twork.\titer.\tsize\teras.\tcommand."
 }
 
 function bench() {
@@ -50,11 +56,22 @@ function bench() {
         --iterations $iterations \
         --size $size \
         --erasures $erasures \
+        --erasures-generation $ERASURES_GENERATION \
         --parameter erasure-code-k=$k \
         --parameter erasure-code-m=$m \
         --parameter erasure-code-directory=$PLUGIN_DIRECTORY)
-    result=$($command "$@")
-    echo -e "$result\t$plugin\t$k\t$m\t$workload\t$iterations\t$size\t$erasures\t$command ""$@"
+    # a line per erasure pattern with --erasures-generation exhaustive,
+    # the erased chunks being appended to eras.
+    $command "$@" | while read seconds kb gbps erased ; do
+        echo -e "$seconds\t$kb\t$gbps\t$plugin\t$k\t$m\t$workload\t$iterations\t$size\t$erasures${erased:+:$erased}\t$command ""$@"
+    done
+}
+
+function is_encode() {
+    case $1 in
+        encode|ecutil-encode) return 0 ;;
+        *) return 1 ;;
+    esac
 }
 
 function example_test() {
@@ -72,14 +89,26 @@ function jerasure_test() {
     local plugin=jerasure
 
     for technique in reed_sol_van ; do
-        for k in 4 6 10 ; do
-            for m in $(seq 1 4) ; do
-                bench $plugin $k $m encode $ITERATIONS $SIZE 0 \
-                    --parameter erasure-code-technique=$technique
-
-                for erasures in $(seq 1 $m) ; do
-                    bench $plugin $k $m decode $ITERATIONS $SIZE $erasures \
-                        --parameter erasure-code-technique=$technique
+        for simd in ${JERASURE_SIMD:-auto} ; do
+            local simd_parameter=
+            if [ -n "$JERASURE_SIMD" ] ; then
+                simd_parameter="--parameter jerasure-simd=$simd"
+            fi
+            for k in 4 6 10 ; do
+                for m in $(seq 1 4) ; do
+                    for workload in $WORKLOADS ; do
+                        if is_encode $workload ; then
+                            bench $plugin $k $m $workload $ITERATIONS $SIZE 0 \
+                                --parameter erasure-code-technique=$technique \
+                                $simd_parameter
+                            continue
+                        fi
+                        for erasures in $(seq 1 $m) ; do
+                            bench $plugin $k $m $workload $ITERATIONS $SIZE $erasures \
+                                --parameter erasure-code-technique=$technique \
+                                $simd_parameter
+                        done
+                    done
                 done
             done
         done
@@ -89,14 +118,45 @@ function jerasure_test() {
         for packetsize in $(seq 512 512 4096) ; do
             for k in 4 6 10 ; do
                 for m in $(seq 1 4) ; do
-                    bench $plugin $k $m encode $ITERATIONS $SIZE 0 \
-                        --parameter erasure-code-packetsize=$packetsize \
-                        --parameter erasure-code-technique=$technique
+                    for workload in $WORKLOADS ; do
+                        if is_encode $workload ; then
+                            bench $plugin $k $m $workload $ITERATIONS $SIZE 0 \
+                                --parameter erasure-code-packetsize=$packetsize \
+                                --parameter erasure-code-technique=$technique
+                            continue
+                        fi
+                        for erasures in $(seq 1 $m) ; do
+                            bench $plugin $k $m $workload $ITERATIONS $SIZE $erasures \
+                                --parameter erasure-code-packetsize=$packetsize \
+                                --parameter erasure-code-technique=$technique
+                        done
+                    done
+                done
+            done
+        done
+    done
+}
+
+#
+# Same k and m as jerasure reed_sol_van, plus one local parity chunk
+# per l data chunks, to compare the cost and the cheaper repair of a
+# single erasure side by side.
+#
+function lrc_test() {
+    local plugin=lrc
 
+    for k in 4 6 10 ; do
+        for m in $(seq 1 4) ; do
+            for l in 2 $k ; do
+                for workload in $WORKLOADS ; do
+                    if is_encode $workload ; then
+                        bench $plugin $k $m $workload $ITERATIONS $SIZE 0 \
+                            --parameter erasure-code-l=$l
+                        continue
+                    fi
                     for erasures in $(seq 1 $m) ; do
-                        bench $plugin $k $m decode $ITERATIONS $SIZE $erasures \
-                            --parameter erasure-code-packetsize=$packetsize \
-                            --parameter erasure-code-technique=$technique
+                        bench $plugin $k $m $workload $ITERATIONS $SIZE $erasures \
+                            --parameter erasure-code-l=$l
                     done
                 done
             done
@@ -219,7 +279,7 @@ jerasure	10	4	decode	1	1024	3
 jerasure	10	4	decode	1	1024	4
 EOF
 )
-        test "$(main | cut --fields=3-9 )" = "$expected" || return 1
+        test "$(main | cut --fields=4-10 )" = "$expected" || return 1
     }
 
     run_test
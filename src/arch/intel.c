@@ -3,6 +3,9 @@
 /* flags we export */
 int ceph_arch_intel_sse42 = 0;
 int ceph_arch_intel_sse2 = 0;
+int ceph_arch_intel_pclmul = 0;
+int ceph_arch_intel_ssse3 = 0;
+int ceph_arch_intel_avx2 = 0;
 
 #ifdef __x86_64__
 
@@ -23,6 +26,27 @@ static void do_cpuid(unsigned int *eax, unsigned int *ebx, unsigned int *ecx,
                 : "eax", "ebx", "ecx", "edx");
 }
 
+/* cpuid leaves with a sub-leaf in ecx */
+static void do_cpuid_count(unsigned int leaf, unsigned int subleaf,
+			   unsigned int *eax, unsigned int *ebx,
+			   unsigned int *ecx, unsigned int *edx)
+{
+	asm("cpuid"
+	    : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+	    : "a" (leaf), "c" (subleaf));
+}
+
+/* true if the os saves and restores the xmm and ymm registers */
+static int os_saves_ymm(void)
+{
+	unsigned int lo, hi;
+
+	asm(".byte 0x0f, 0x01, 0xd0"  /* xgetbv, for old assemblers */
+	    : "=a" (lo), "=d" (hi)
+	    : "c" (0));
+	return (lo & 6) == 6;
+}
+
 int ceph_arch_intel_probe(void)
 {
 	/* i know how to check this on x86_64... */
@@ -34,6 +58,21 @@ int ceph_arch_intel_probe(void)
 	if ((edx & (1 << 26)) != 0) {
 	        ceph_arch_intel_sse2 = 1;
 	}
+	if ((ecx & (1 << 1)) != 0) {
+		ceph_arch_intel_pclmul = 1;
+	}
+	if ((ecx & (1 << 9)) != 0) {
+		ceph_arch_intel_ssse3 = 1;
+	}
+	/* avx2 needs osxsave (bit 27) to check that ymm state is saved */
+	if ((ecx & (1 << 27)) != 0 && os_saves_ymm()) {
+		do_cpuid_count(0, 0, &eax, &ebx, &ecx, &edx);  /* max leaf */
+		if (eax >= 7) {
+			do_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+			if ((ebx & (1 << 5)) != 0)
+				ceph_arch_intel_avx2 = 1;
+		}
+	}
 
 	return 0;
 }
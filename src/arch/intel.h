@@ -7,6 +7,9 @@ extern "C" {
 
 extern int ceph_arch_intel_sse42;  /* true if we have sse 4.2 features */
 extern int ceph_arch_intel_sse2;   /* true if we have sse 2 features */
+extern int ceph_arch_intel_pclmul; /* true if we have pclmulqdq */
+extern int ceph_arch_intel_ssse3;  /* true if we have ssse 3 features */
+extern int ceph_arch_intel_avx2;   /* true if we have avx 2 and the os saves ymm state */
 extern int ceph_arch_intel_probe(void);
 
 #ifdef __cplusplus
@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 extern int ceph_arch_neon;  /* true if we have ARM NEON abilities */
+extern int ceph_arch_aarch64_crc32;  /* true if we have the ARMv8 crc32 instructions */
 
 extern int ceph_arch_neon_probe(void);
 
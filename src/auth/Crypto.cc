@@ -86,69 +86,105 @@ void CryptoNone::decrypt(const bufferptr& secret, const bufferlist& in,
   out = in;
 }
 
+class CryptoNoneKeyHandler : public CryptoKeyHandler {
+public:
+  void encrypt(const bufferlist& in,
+	       bufferlist& out, std::string &error) const {
+    out = in;
+  }
+  void decrypt(const bufferlist& in,
+	       bufferlist& out, std::string &error) const {
+    out = in;
+  }
+};
+
+CryptoKeyHandler *CryptoNone::get_key_handler(const bufferptr& secret,
+					      std::string &error) const
+{
+  return new CryptoNoneKeyHandler;
+}
+
 
 // ---------------------------------------------------
 #ifdef USE_CRYPTOPP
 # define AES_KEY_LEN     ((size_t)CryptoPP::AES::DEFAULT_KEYLENGTH)
 # define AES_BLOCK_LEN   ((size_t)CryptoPP::AES::BLOCKSIZE)
-#elif USE_NSS
-// when we say AES, we mean AES-128
-# define AES_KEY_LEN	16
-# define AES_BLOCK_LEN   16
 
-static void nss_aes_operation(CK_ATTRIBUTE_TYPE op, const bufferptr& secret,
-			     const bufferlist& in, bufferlist& out, std::string &error)
-{
-  const CK_MECHANISM_TYPE mechanism = CKM_AES_CBC_PAD;
-
-  // sample source said this has to be at least size of input + 8,
-  // but i see 15 still fail with SEC_ERROR_OUTPUT_LEN
-  bufferptr out_tmp(in.length()+16);
+class CryptoAESKeyHandler : public CryptoKeyHandler {
+  // the key schedules, expanded once.  CryptoPP only reads them to
+  // process blocks, but wants them non-const for the mode wrappers.
+  mutable CryptoPP::AES::Encryption enc_key;
+  mutable CryptoPP::AES::Decryption dec_key;
+
+public:
+  int init(const bufferptr& s, std::string &error) {
+    enc_key.SetKey((const byte*)s.c_str(), AES_KEY_LEN);
+    dec_key.SetKey((const byte*)s.c_str(), AES_KEY_LEN);
+    return 0;
+  }
 
-  PK11SlotInfo *slot;
+  void encrypt(const bufferlist& in,
+	       bufferlist& out, std::string &error) const {
+    string ciphertext;
+    CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption( enc_key, (const byte*)CEPH_AES_IV );
+    CryptoPP::StringSink *sink = new CryptoPP::StringSink(ciphertext);
+    CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, sink);
 
-  slot = PK11_GetBestSlot(mechanism, NULL);
-  if (!slot) {
-    ostringstream oss;
-    oss << "cannot find NSS slot to use: " << PR_GetError();
-    error = oss.str();
-    goto err;
+    for (std::list<bufferptr>::const_iterator it = in.buffers().begin();
+	 it != in.buffers().end(); ++it) {
+      const unsigned char *in_buf = (const unsigned char *)it->c_str();
+      stfEncryptor.Put(in_buf, it->length());
+    }
+    try {
+      stfEncryptor.MessageEnd();
+    } catch (CryptoPP::Exception& e) {
+      ostringstream oss;
+      oss << "encryptor.MessageEnd::Exception: " << e.GetWhat();
+      error = oss.str();
+      return;
+    }
+    out.append((const char *)ciphertext.c_str(), ciphertext.length());
   }
 
-  SECItem keyItem;
-
-  keyItem.type = siBuffer;
-  keyItem.data = (unsigned char*)secret.c_str();
-  keyItem.len = secret.length();
+  void decrypt(const bufferlist& in,
+	       bufferlist& out, std::string &error) const {
+    string decryptedtext;
+    CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption( dec_key, (const byte*)CEPH_AES_IV );
+    CryptoPP::StringSink *sink = new CryptoPP::StringSink(decryptedtext);
+    CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, sink);
+    for (std::list<bufferptr>::const_iterator it = in.buffers().begin(); 
+	 it != in.buffers().end(); ++it) {
+      const unsigned char *in_buf = (const unsigned char *)it->c_str();
+      stfDecryptor.Put(in_buf, it->length());
+    }
 
-  PK11SymKey *key;
+    try {
+      stfDecryptor.MessageEnd();
+    } catch (CryptoPP::Exception& e) {
+      ostringstream oss;
+      oss << "decryptor.MessageEnd::Exception: " << e.GetWhat();
+      error = oss.str();
+      return;
+    }
 
-  key = PK11_ImportSymKey(slot, mechanism, PK11_OriginUnwrap, CKA_ENCRYPT,
-			  &keyItem, NULL);
-  if (!key) {
-    ostringstream oss;
-    oss << "cannot convert AES key for NSS: " << PR_GetError();
-    error = oss.str();
-    goto err_slot;
+    out.append((const char *)decryptedtext.c_str(), decryptedtext.length());
   }
+};
 
-  SECItem ivItem;
-
-  ivItem.type = siBuffer;
-  // losing constness due to SECItem.data; IV should never be
-  // modified, regardless
-  ivItem.data = (unsigned char*)CEPH_AES_IV;
-  ivItem.len = sizeof(CEPH_AES_IV);
+#elif USE_NSS
+// when we say AES, we mean AES-128
+# define AES_KEY_LEN	16
+# define AES_BLOCK_LEN   16
 
-  SECItem *param;
+static void nss_aes_operation(CK_ATTRIBUTE_TYPE op,
+			      PK11SymKey *key, SECItem *param,
+			      const bufferlist& in, bufferlist& out, std::string &error)
+{
+  const CK_MECHANISM_TYPE mechanism = CKM_AES_CBC_PAD;
 
-  param = PK11_ParamFromIV(mechanism, &ivItem);
-  if (!param) {
-    ostringstream oss;
-    oss << "cannot set NSS IV param: " << PR_GetError();
-    error = oss.str();
-    goto err_key;
-  }
+  // sample source said this has to be at least size of input + 8,
+  // but i see 15 still fail with SEC_ERROR_OUTPUT_LEN
+  bufferptr out_tmp(in.length()+16);
 
   PK11Context *ctx;
 
@@ -157,7 +193,7 @@ static void nss_aes_operation(CK_ATTRIBUTE_TYPE op, const bufferptr& secret,
     ostringstream oss;
     oss << "cannot create NSS context: " << PR_GetError();
     error = oss.str();
-    goto err_param;
+    return;
   }
 
   SECStatus ret;
@@ -194,24 +230,80 @@ static void nss_aes_operation(CK_ATTRIBUTE_TYPE op, const bufferptr& secret,
   out_tmp.set_length(written + written2);
   out.append(out_tmp);
 
-  PK11_DestroyContext(ctx, PR_TRUE);
-  SECITEM_FreeItem(param, PR_TRUE);
-  PK11_FreeSymKey(key);
-  PK11_FreeSlot(slot);
-  return;
-
  err_op:
   PK11_DestroyContext(ctx, PR_TRUE);
- err_param:
-  SECITEM_FreeItem(param, PR_TRUE);
- err_key:
-  PK11_FreeSymKey(key);
- err_slot:
-  PK11_FreeSlot(slot);
- err:
-  ;
 }
 
+class CryptoAESKeyHandler : public CryptoKeyHandler {
+  // the slot, imported key and IV param, set up once; only the cipher
+  // context is created per operation
+  PK11SlotInfo *slot;
+  PK11SymKey *key;
+  SECItem *param;
+
+public:
+  CryptoAESKeyHandler() : slot(NULL), key(NULL), param(NULL) {}
+  ~CryptoAESKeyHandler() {
+    if (param)
+      SECITEM_FreeItem(param, PR_TRUE);
+    if (key)
+      PK11_FreeSymKey(key);
+    if (slot)
+      PK11_FreeSlot(slot);
+  }
+
+  int init(const bufferptr& s, std::string &error) {
+    const CK_MECHANISM_TYPE mechanism = CKM_AES_CBC_PAD;
+
+    slot = PK11_GetBestSlot(mechanism, NULL);
+    if (!slot) {
+      ostringstream oss;
+      oss << "cannot find NSS slot to use: " << PR_GetError();
+      error = oss.str();
+      return -EINVAL;
+    }
+
+    SECItem keyItem;
+    keyItem.type = siBuffer;
+    keyItem.data = (unsigned char*)s.c_str();
+    keyItem.len = s.length();
+
+    key = PK11_ImportSymKey(slot, mechanism, PK11_OriginUnwrap, CKA_ENCRYPT,
+			    &keyItem, NULL);
+    if (!key) {
+      ostringstream oss;
+      oss << "cannot convert AES key for NSS: " << PR_GetError();
+      error = oss.str();
+      return -EINVAL;
+    }
+
+    SECItem ivItem;
+    ivItem.type = siBuffer;
+    // losing constness due to SECItem.data; IV should never be
+    // modified, regardless
+    ivItem.data = (unsigned char*)CEPH_AES_IV;
+    ivItem.len = sizeof(CEPH_AES_IV);
+
+    param = PK11_ParamFromIV(mechanism, &ivItem);
+    if (!param) {
+      ostringstream oss;
+      oss << "cannot set NSS IV param: " << PR_GetError();
+      error = oss.str();
+      return -EINVAL;
+    }
+    return 0;
+  }
+
+  void encrypt(const bufferlist& in,
+	       bufferlist& out, std::string &error) const {
+    nss_aes_operation(CKA_ENCRYPT, key, param, in, out, error);
+  }
+  void decrypt(const bufferlist& in,
+	       bufferlist& out, std::string &error) const {
+    nss_aes_operation(CKA_DECRYPT, key, param, in, out, error);
+  }
+};
+
 #else
 # error "No supported crypto implementation found."
 #endif
@@ -238,75 +330,42 @@ int CryptoAES::validate_secret(bufferptr& secret)
 void CryptoAES::encrypt(const bufferptr& secret, const bufferlist& in, bufferlist& out,
 			std::string &error) const
 {
+  CryptoAESKeyHandler ckh;
   if (secret.length() < AES_KEY_LEN) {
     error = "key is too short";
     return;
   }
-#ifdef USE_CRYPTOPP
-  {
-    const unsigned char *key = (const unsigned char *)secret.c_str();
-
-    string ciphertext;
-    CryptoPP::AES::Encryption aesEncryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
-    CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption( aesEncryption, (const byte*)CEPH_AES_IV );
-    CryptoPP::StringSink *sink = new CryptoPP::StringSink(ciphertext);
-    CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, sink);
-
-    for (std::list<bufferptr>::const_iterator it = in.buffers().begin();
-	 it != in.buffers().end(); ++it) {
-      const unsigned char *in_buf = (const unsigned char *)it->c_str();
-      stfEncryptor.Put(in_buf, it->length());
-    }
-    try {
-      stfEncryptor.MessageEnd();
-    } catch (CryptoPP::Exception& e) {
-      ostringstream oss;
-      oss << "encryptor.MessageEnd::Exception: " << e.GetWhat();
-      error = oss.str();
-      return;
-    }
-    out.append((const char *)ciphertext.c_str(), ciphertext.length());
-  }
-#elif USE_NSS
-  nss_aes_operation(CKA_ENCRYPT, secret, in, out, error);
-#else
-# error "No supported crypto implementation found."
-#endif
+  if (ckh.init(secret, error) < 0)
+    return;
+  ckh.encrypt(in, out, error);
 }
 
 void CryptoAES::decrypt(const bufferptr& secret, const bufferlist& in, 
 			bufferlist& out, std::string &error) const
 {
-#ifdef USE_CRYPTOPP
-  const unsigned char *key = (const unsigned char *)secret.c_str();
-
-  CryptoPP::AES::Decryption aesDecryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
-  CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption( aesDecryption, (const byte*)CEPH_AES_IV );
-
-  string decryptedtext;
-  CryptoPP::StringSink *sink = new CryptoPP::StringSink(decryptedtext);
-  CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, sink);
-  for (std::list<bufferptr>::const_iterator it = in.buffers().begin(); 
-       it != in.buffers().end(); ++it) {
-      const unsigned char *in_buf = (const unsigned char *)it->c_str();
-      stfDecryptor.Put(in_buf, it->length());
-  }
-
-  try {
-    stfDecryptor.MessageEnd();
-  } catch (CryptoPP::Exception& e) {
-    ostringstream oss;
-    oss << "decryptor.MessageEnd::Exception: " << e.GetWhat();
-    error = oss.str();
+  CryptoAESKeyHandler ckh;
+  if (secret.length() < AES_KEY_LEN) {
+    error = "key is too short";
     return;
   }
+  if (ckh.init(secret, error) < 0)
+    return;
+  ckh.decrypt(in, out, error);
+}
 
-  out.append((const char *)decryptedtext.c_str(), decryptedtext.length());
-#elif USE_NSS
-  nss_aes_operation(CKA_DECRYPT, secret, in, out, error);
-#else
-# error "No supported crypto implementation found."
-#endif
+CryptoKeyHandler *CryptoAES::get_key_handler(const bufferptr& secret,
+					     std::string &error) const
+{
+  if (secret.length() < AES_KEY_LEN) {
+    error = "key is too short";
+    return NULL;
+  }
+  CryptoAESKeyHandler *ckh = new CryptoAESKeyHandler;
+  if (ckh->init(secret, error) < 0) {
+    delete ckh;
+    return NULL;
+  }
+  return ckh;
 }
 
 
@@ -371,6 +430,18 @@ void CryptoKey::decrypt(CephContext *cct, const bufferlist& in, bufferlist& out,
   ch->decrypt(this->secret, in, out, error);
 }
 
+CryptoKeyHandler *CryptoKey::get_key_handler(CephContext *cct, std::string &error) const
+{
+  CryptoHandler *h = cct->get_crypto_handler(type);
+  if (!h) {
+    ostringstream oss;
+    oss << "CryptoKey::get_key_handler: key type " << type << " not supported.";
+    error = oss.str();
+    return NULL;
+  }
+  return h->get_key_handler(secret, error);
+}
+
 void CryptoKey::print(std::ostream &out) const
 {
   out << encode_base64();
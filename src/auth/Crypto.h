@@ -25,6 +25,7 @@
 
 class CephContext;
 class CryptoHandler;
+class CryptoKeyHandler;
 
 /*
  * match encoding of struct ceph_secret
@@ -97,6 +98,9 @@ public:
   void encrypt(CephContext *cct, const bufferlist& in, bufferlist& out, std::string &error) const;
   void decrypt(CephContext *cct, const bufferlist& in, bufferlist& out, std::string &error) const;
 
+  /// set up a handler for repeated use of this key; caller must delete it
+  CryptoKeyHandler *get_key_handler(CephContext *cct, std::string &error) const;
+
   void to_str(std::string& s) const;
 };
 WRITE_CLASS_ENCODER(CryptoKey);
@@ -108,6 +112,21 @@ static inline ostream& operator<<(ostream& out, const CryptoKey& k)
 }
 
 
+/*
+ * A secret together with whatever the algorithm can prepare for it
+ * ahead of time (key schedule, imported key), for callers that use
+ * the same key over and over, like message signing.  Can be used from
+ * several threads at once.
+ */
+class CryptoKeyHandler {
+public:
+  virtual ~CryptoKeyHandler() {}
+  virtual void encrypt(const bufferlist& in,
+		       bufferlist& out, std::string &error) const = 0;
+  virtual void decrypt(const bufferlist& in,
+		       bufferlist& out, std::string &error) const = 0;
+};
+
 /*
  * Driver for a particular algorithm
  *
@@ -124,6 +143,9 @@ public:
 		      bufferlist& out, std::string &error) const = 0;
   virtual void decrypt(const bufferptr& secret, const bufferlist& in,
 		      bufferlist& out, std::string &error) const = 0;
+  /// returns NULL and sets error if the secret can't be used
+  virtual CryptoKeyHandler *get_key_handler(const bufferptr& secret,
+					    std::string &error) const = 0;
 };
 
 extern int get_random_bytes(char *buf, int len);
@@ -142,6 +164,8 @@ public:
 	      bufferlist& out, std::string &error) const;
   void decrypt(const bufferptr& secret, const bufferlist& in,
 	      bufferlist& out, std::string &error) const;
+  CryptoKeyHandler *get_key_handler(const bufferptr& secret,
+				    std::string &error) const;
 };
 
 class CryptoAES : public CryptoHandler {
@@ -157,6 +181,8 @@ public:
 	       bufferlist& out, std::string &error) const;
   void decrypt(const bufferptr& secret, const bufferlist& in, 
 	      bufferlist& out, std::string &error) const;
+  CryptoKeyHandler *get_key_handler(const bufferptr& secret,
+				    std::string &error) const;
 };
 
 #endif
@@ -21,11 +21,21 @@ class CephContext;
 class CephxSessionHandler  : public AuthSessionHandler {
   uint64_t features;
 
+  // the session key, set up once for signing every message
+  CryptoKeyHandler *key_handler;
+
+  int _calc_signature(Message *m, uint64_t *psig);
+
 public:
   CephxSessionHandler(CephContext *cct_, CryptoKey session_key, uint64_t features)
     : AuthSessionHandler(cct_, CEPH_AUTH_CEPHX, session_key),
-      features(features) {}
-  ~CephxSessionHandler() {}
+      features(features), key_handler(NULL) {
+    std::string error;
+    key_handler = key.get_key_handler(cct, error);
+  }
+  ~CephxSessionHandler() {
+    delete key_handler;
+  }
   
   bool no_security() {
     return false;
@@ -43,6 +43,7 @@ using namespace std;
 #include "include/color.h"
 #include "common/errno.h"
 #include "common/pick_address.h"
+#include "common/numa.h"
 
 #include "perfglue/heap_profiler.h"
 
@@ -66,6 +67,59 @@ void usage()
   generic_server_usage();
 }
 
+/*
+ * The numa node our I/O comes through: that of the interface with the
+ * public address, else that of the journal's device.  -1 if unknown.
+ */
+static int pick_numa_node()
+{
+  int node = -1;
+  entity_addr_t addr = g_conf->public_addr;
+  std::string iface;
+  if (!addr.is_blank_ip() &&
+      get_iface_for_addr((struct sockaddr*)&addr.ss_addr(), &iface) == 0 &&
+      get_iface_numa_node(iface, &node) == 0) {
+    dout(0) << "public interface " << iface << " is on numa node " << node
+	    << dendl;
+  }
+
+  int jnode = -1;
+  if (!g_conf->osd_journal.empty() &&
+      get_path_numa_node(g_conf->osd_journal, &jnode) == 0) {
+    dout(0) << "journal " << g_conf->osd_journal << " is on numa node "
+	    << jnode << dendl;
+    if (node < 0)
+      node = jnode;
+    else if (node != jnode)
+      derr << "public interface and journal are on different numa nodes ("
+	   << node << " and " << jnode << "); using " << node << dendl;
+  }
+  return node;
+}
+
+static void bind_numa_node(int node)
+{
+  set<int> cpus;
+  int r = get_numa_node_cpus(node, &cpus);
+  if (r < 0) {
+    derr << "unable to get cpus of numa node " << node << ": "
+	 << cpp_strerror(r) << dendl;
+    return;
+  }
+  r = set_process_cpu_affinity(cpus);
+  if (r < 0) {
+    derr << "unable to bind to numa node " << node << " cpus " << cpus << ": "
+	 << cpp_strerror(r) << dendl;
+    return;
+  }
+  // threads started from here on allocate locally
+  r = set_numa_preferred_node(node);
+  if (r < 0)
+    derr << "unable to prefer memory on numa node " << node << ": "
+	 << cpp_strerror(r) << dendl;
+  dout(0) << "bound to numa node " << node << " cpus " << cpus << dendl;
+}
+
 int main(int argc, const char **argv) 
 {
   vector<const char*> args;
@@ -322,6 +376,12 @@ int main(int argc, const char **argv)
   pick_addresses(g_ceph_context, CEPH_PICK_ADDRESS_PUBLIC
                                 |CEPH_PICK_ADDRESS_CLUSTER);
 
+  int numa_node = g_conf->osd_numa_node;
+  if (numa_node < 0 && g_conf->osd_numa_auto_affinity)
+    numa_node = pick_numa_node();
+  if (numa_node >= 0)
+    bind_numa_node(numa_node);
+
   if (g_conf->public_addr.is_blank_ip() && !g_conf->cluster_addr.is_blank_ip()) {
     derr << TEXT_YELLOW
 	 << " ** WARNING: specified cluster addr but not public addr; we recommend **\n"
@@ -377,6 +437,9 @@ int main(int argc, const char **argv)
   ms_public->set_policy_throttlers(entity_name_t::TYPE_CLIENT,
 				   client_byte_throttler.get(),
 				   client_msg_throttler.get());
+  ms_public->set_policy_conn_throttle(entity_name_t::TYPE_CLIENT,
+				      g_conf->osd_client_message_size_cap_per_client,
+				      g_conf->osd_client_message_cap_per_client);
   ms_public->set_policy(entity_name_t::TYPE_MON,
                                Messenger::Policy::lossy_client(supported,
 							       CEPH_FEATURE_UID |
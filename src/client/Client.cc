@@ -43,6 +43,7 @@ using namespace std;
 #include "messages/MClientRequestForward.h"
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientCapRelease.h"
 #include "messages/MClientLease.h"
 #include "messages/MClientSnap.h"
@@ -171,6 +172,7 @@ Client::Client(Messenger *m, MonClient *mc)
 
   //
   root = 0;
+  dentry_bytes = 0;
 
   num_flushing_caps = 0;
 
@@ -456,14 +458,32 @@ void Client::shutdown()
 // ===================
 // metadata cache stuff
 
+/*
+ * A rough estimate: names and the structs themselves, but not the
+ * map nodes or allocator overhead around them.
+ */
+uint64_t Client::cache_bytes() const
+{
+  return dentry_bytes + inode_map.size() * sizeof(Inode);
+}
+
+bool Client::cache_over_limit()
+{
+  if (lru.lru_get_size() > lru.lru_get_max())
+    return true;
+  uint64_t max_bytes = cct->_conf->client_cache_bytes;
+  return max_bytes && cache_bytes() > max_bytes;
+}
+
 void Client::trim_cache()
 {
-  ldout(cct, 20) << "trim_cache size " << lru.lru_get_size() << " max " << lru.lru_get_max() << dendl;
+  ldout(cct, 20) << "trim_cache size " << lru.lru_get_size() << " max " << lru.lru_get_max()
+		 << " bytes " << cache_bytes() << " max " << cct->_conf->client_cache_bytes << dendl;
   unsigned last = 0;
   while (lru.lru_get_size() != last) {
     last = lru.lru_get_size();
 
-    if (lru.lru_get_size() <= lru.lru_get_max())  break;
+    if (!cache_over_limit())  break;
 
     // trim!
     Dentry *dn = static_cast<Dentry*>(lru.lru_expire());
@@ -1889,6 +1909,9 @@ bool Client::ms_dispatch(Message *m)
   case CEPH_MSG_CLIENT_CAPS:
     handle_caps(static_cast<MClientCaps*>(m));
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    handle_caps_batch(static_cast<MClientCapsBatch*>(m));
+    break;
   case CEPH_MSG_CLIENT_LEASE:
     handle_lease(static_cast<MClientLease*>(m));
     break;
@@ -2191,6 +2214,7 @@ Dentry* Client::link(Dir *dir, const string& name, Inode *in, Dentry *dn)
     dir->dentries[dn->name] = dn;
     dir->dentry_map[dn->name] = dn;
     lru.lru_insert_mid(dn);    // mid or top?
+    dentry_bytes += sizeof(Dentry) + 3 * name.length();  // name is kept as both map keys too
 
     ldout(cct, 15) << "link dir " << dir->parent_inode << " '" << name << "' to inode " << in
 		   << " dn " << dn << " (new dn)" << dendl;
@@ -2248,6 +2272,7 @@ void Client::unlink(Dentry *dn, bool keepdir)
 
   // delete den
   lru.lru_remove(dn);
+  dentry_bytes -= sizeof(Dentry) + 3 * dn->name.length();
   dn->put();
 }
 
@@ -2956,6 +2981,16 @@ void Client::remove_cap(Cap *cap)
   i.migrate_seq = cap->mseq;
   session->release->caps.push_back(i);
 
+  // don't let a big trim build up one huge release for the next tick
+  unsigned batch = cct->_conf->client_cap_release_batch;
+  if (batch && session->release->caps.size() >= batch &&
+      mdsmap->is_clientreplay_or_active_or_stopping(mds)) {
+    ldout(cct, 10) << "remove_cap sending " << session->release->caps.size()
+		   << " cap releases to mds." << mds << dendl;
+    messenger->send_message(session->release, session->con);
+    session->release = 0;
+  }
+
   if (in->auth_cap == cap) {
     if (in->flushing_cap_item.is_on_list()) {
       ldout(cct, 10) << " removing myself from flushing_cap list" << dendl;
@@ -3403,6 +3438,21 @@ void Client::handle_snap(MClientSnap *m)
   m->put();
 }
 
+void Client::handle_caps_batch(MClientCapsBatch *m)
+{
+  ldout(cct, 10) << "handle_caps_batch " << m->caps.size() << " caps from "
+		 << m->get_source() << dendl;
+  vector<MClientCaps*> caps;
+  caps.swap(m->caps);
+  for (vector<MClientCaps*>::iterator p = caps.begin(); p != caps.end(); ++p) {
+    MClientCaps *c = *p;
+    c->get_header().src = m->get_header().src;
+    c->set_connection(m->get_connection());
+    handle_caps(c);
+  }
+  m->put();
+}
+
 void Client::handle_caps(MClientCaps *m)
 {
   int mds = m->get_source().num();
@@ -4735,9 +4785,20 @@ int Client::fill_stat(Inode *in, struct stat *st, frag_info_t *dirstat, nest_inf
   return in->caps_issued();
 }
 
+/*
+ * New dentries go in at the lru midpoint, and the first use after
+ * that only moves them to the head of the bottom half.  Only a second
+ * use promotes to the top, so a single pass over a big tree (readdir +
+ * stat) cycles through the bottom without pushing out the hot set.
+ */
 void Client::touch_dn(Dentry *dn)
 {
-  lru.lru_touch(dn);
+  if (dn->touched) {
+    lru.lru_touch(dn);
+  } else {
+    dn->touched = true;
+    lru.lru_midtouch(dn);
+  }
 }
 
 int Client::chmod(const char *relpath, mode_t mode)
@@ -5069,6 +5130,7 @@ int Client::_readdir_get_frag(dir_result_t *dirp)
   req->set_filepath(path); 
   req->set_inode(diri);
   req->head.args.readdir.frag = fg;
+  req->head.args.readdir.max_bytes = cct->_conf->client_readdir_max_bytes;
   if (dirp->last_name.length()) {
     req->path2.set_path(dirp->last_name.c_str());
     req->readdir_start = dirp->last_name;
@@ -5127,7 +5189,8 @@ int Client::_readdir_get_frag(dir_result_t *dirp)
   return res;
 }
 
-int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
+int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p,
+			      bool getref)
 {
   assert(client_lock.is_locked());
   ldout(cct, 10) << "_readdir_cache_cb " << dirp << " on " << dirp->inode->ino
@@ -5170,6 +5233,10 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
     if (pd == dir->dentry_map.end())
       next_off = dir_result_t::END;
 
+    Inode *in = dn->inode;
+    if (getref)
+      _ll_get(in);
+
     client_lock.Unlock();
     int r = cb(p, &de, &st, stmask, next_off);  // _next_ offset
     client_lock.Lock();
@@ -5177,6 +5244,8 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
 	     << " = " << r
 	     << dendl;
     if (r < 0) {
+      if (getref)
+	_ll_put(in, 1);
       dirp->next_offset = dn->offset;
       dirp->at_cache_name = prev_name;
       return r;
@@ -5193,7 +5262,8 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
   return 0;
 }
 
-int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
+int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p,
+			 bool getref)
 {
   Mutex::Locker lock(client_lock);
 
@@ -5271,7 +5341,7 @@ int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
       dirp->inode->snapid != CEPH_SNAPDIR &&
       (dirp->inode->flags & I_COMPLETE) &&
       dirp->inode->caps_issued_mask(CEPH_CAP_FILE_SHARED)) {
-    int err = _readdir_cache_cb(dirp, cb, p);
+    int err = _readdir_cache_cb(dirp, cb, p, getref);
     if (err != -EAGAIN)
       return err;
   }
@@ -5304,15 +5374,22 @@ int Client::readdir_r_cb(dir_result_t *d, add_dirent_cb_t cb, void *p)
 
       int stmask = fill_stat(ent.second, &st);  
       fill_dirent(&de, ent.first.c_str(), st.st_mode, st.st_ino, dirp->offset + 1);
-      
+
+      Inode *in = ent.second;
+      if (getref)
+	_ll_get(in);
+
       client_lock.Unlock();
       int r = cb(p, &de, &st, stmask, dirp->offset + 1);  // _next_ offset
       client_lock.Lock();
       ldout(cct, 15) << " de " << de.d_name << " off " << hex << dirp->offset << dec
 	       << " = " << r
 	       << dendl;
-      if (r < 0)
+      if (r < 0) {
+	if (getref)
+	  _ll_put(in, 1);
 	return r;
+      }
       
       off++;
       dirp->offset++;
@@ -5641,6 +5718,22 @@ Fh *Client::_create_fh(Inode *in, int flags, int cmode)
   f->inode = in;
   f->inode->get();
 
+  // readahead ramps up from client_readahead_min to the smaller of
+  // client_readahead_max_bytes and client_readahead_max_periods, and is
+  // aligned to the layout period so whole objects are fetched
+  const md_config_t *conf = cct->_conf;
+  uint64_t period = (uint64_t)in->layout.fl_stripe_count * in->layout.fl_object_size;
+  uint64_t max_readahead = conf->client_readahead_max_bytes;
+  if (conf->client_readahead_max_periods) {
+    uint64_t by_periods = conf->client_readahead_max_periods * period;
+    if (!max_readahead || by_periods < max_readahead)
+      max_readahead = by_periods;
+  }
+  f->readahead.set_trigger_requests(1);
+  f->readahead.set_min_readahead_size(conf->client_readahead_min);
+  f->readahead.set_max_readahead_size(max_readahead);
+  f->readahead.set_alignment(period);
+
   ldout(cct, 10) << "_create_fh " << in->ino << " mode " << cmode << dendl;
 
   if (in->snapid != CEPH_NOSNAP) {
@@ -5861,18 +5954,23 @@ int Client::uninline_data(Inode *in, Context *onfinish)
 
 int Client::read(int fd, char *buf, loff_t size, loff_t offset)
 {
-  Mutex::Locker lock(client_lock);
-  tout(cct) << "read" << std::endl;
-  tout(cct) << fd << std::endl;
-  tout(cct) << size << std::endl;
-  tout(cct) << offset << std::endl;
-
-  Fh *f = get_filehandle(fd);
-  if (!f)
-    return -EBADF;
   bufferlist bl;
-  int r = _read(f, offset, size, &bl);
-  ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+  int r;
+  {
+    Mutex::Locker lock(client_lock);
+    tout(cct) << "read" << std::endl;
+    tout(cct) << fd << std::endl;
+    tout(cct) << size << std::endl;
+    tout(cct) << offset << std::endl;
+
+    Fh *f = get_filehandle(fd);
+    if (!f)
+      return -EBADF;
+    r = _read(f, offset, size, &bl);
+    ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+  }
+
+  // copy out without client_lock; bl holds its own refs on the data
   if (r >= 0) {
     bl.copy(0, bl.length(), buf);
     r = bl.length();
@@ -5880,6 +5978,63 @@ int Client::read(int fd, char *buf, loff_t size, loff_t offset)
   return r;
 }
 
+static loff_t iov_length(const struct iovec *iov, int iovcnt)
+{
+  loff_t len = 0;
+  for (int i = 0; i < iovcnt; i++)
+    len += iov[i].iov_len;
+  return len;
+}
+
+// copies each iov once; the data may outlive the call in the cache
+static void iov_to_bufferlist(const struct iovec *iov, int iovcnt,
+			      bufferlist& bl)
+{
+  for (int i = 0; i < iovcnt; i++)
+    if (iov[i].iov_len)
+      bl.append(buffer::copy((const char *)iov[i].iov_base, iov[i].iov_len));
+}
+
+static void bufferlist_to_iov(bufferlist& bl, const struct iovec *iov,
+			      int iovcnt)
+{
+  unsigned off = 0;
+  for (int i = 0; i < iovcnt && off < bl.length(); i++) {
+    unsigned len = MIN(iov[i].iov_len, bl.length() - off);
+    bl.copy(off, len, (char *)iov[i].iov_base);
+    off += len;
+  }
+}
+
+int Client::preadv(int fd, const struct iovec *iov, int iovcnt, loff_t offset)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+  loff_t size = iov_length(iov, iovcnt);
+
+  bufferlist bl;
+  int r;
+  {
+    Mutex::Locker lock(client_lock);
+    tout(cct) << "preadv" << std::endl;
+    tout(cct) << fd << std::endl;
+    tout(cct) << size << std::endl;
+    tout(cct) << offset << std::endl;
+
+    Fh *f = get_filehandle(fd);
+    if (!f)
+      return -EBADF;
+    r = _read(f, offset, size, &bl);
+    ldout(cct, 3) << "preadv(" << fd << ", " << iovcnt << " iovs, " << size << ", " << offset << ") = " << r << dendl;
+  }
+
+  if (r >= 0) {
+    bufferlist_to_iov(bl, iov, iovcnt);
+    r = bl.length();
+  }
+  return r;
+}
+
 int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
 {
   const md_config_t *conf = cct->_conf;
@@ -5935,6 +6090,7 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
   }
 
   if (!conf->client_debug_force_sync_read &&
+      !(f->flags & O_DIRECT) &&
       (cct->_conf->client_oc && (have & CEPH_CAP_FILE_CACHE))) {
 
     if (f->flags & O_RSYNC) {
@@ -5942,6 +6098,10 @@ int Client::_read(Fh *f, int64_t offset, uint64_t size, bufferlist *bl)
     }
     r = _read_async(f, offset, size, bl);
   } else {
+    // O_DIRECT reads come from the OSDs, but must still see our own
+    // buffered writes
+    if ((f->flags & O_DIRECT) && cct->_conf->client_oc)
+      _flush_range(in, offset, size);
     r = _read_sync(f, offset, size, bl);
   }
 
@@ -5958,19 +6118,6 @@ success:
     unlock_fh_pos(f);
   }
 
-  // adjust readahead state
-  if (f->last_pos != offset) {
-    f->nr_consec_read = f->consec_read_bytes = 0;
-  } else {
-    f->nr_consec_read++;
-  }
-  f->consec_read_bytes += bl->length();
-  ldout(cct, 10) << "readahead nr_consec_read " << f->nr_consec_read
-	   << " for " << f->consec_read_bytes << " bytes" 
-	   << " .. last_pos " << f->last_pos << " .. offset " << offset
-	   << dendl;
-  f->last_pos = offset+bl->length();
-
 done:
   // done!
 
@@ -5997,70 +6144,19 @@ done:
 
 int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
 {
-  const md_config_t *conf = cct->_conf;
   Inode *in = f->inode;
-  bool readahead = true;
 
   ldout(cct, 10) << "_read_async " << *in << " " << off << "~" << len << dendl;
 
   // trim read based on file size?
   if (off >= in->size)
     return 0;
-  if (off + len > in->size) {
-    len = in->size - off;    
-    readahead = false;
-  }
+  if (off + len > in->size)
+    len = in->size - off;
 
   // we will populate the cache here
   if (in->cap_refs[CEPH_CAP_FILE_CACHE] == 0)
     in->get_cap_ref(CEPH_CAP_FILE_CACHE);
-  
-  ldout(cct, 10) << "readahead=" << readahead << " nr_consec=" << f->nr_consec_read
-	   << " max_byes=" << conf->client_readahead_max_bytes
-	   << " max_periods=" << conf->client_readahead_max_periods << dendl;
-
-  // readahead?
-  if (readahead &&
-      f->nr_consec_read &&
-      (conf->client_readahead_max_bytes ||
-       conf->client_readahead_max_periods)) {
-    loff_t l = f->consec_read_bytes * 2;
-    if (conf->client_readahead_min)
-      l = MAX(l, conf->client_readahead_min);
-    if (conf->client_readahead_max_bytes)
-      l = MIN(l, conf->client_readahead_max_bytes);
-    loff_t p = in->layout.fl_stripe_count * in->layout.fl_object_size;
-    if (conf->client_readahead_max_periods)
-      l = MIN(l, conf->client_readahead_max_periods * p);
-
-    if (l >= 2*p)
-      // align large readahead with period
-      l -= (off+l) % p;
-    else {
-      // align readahead with stripe unit if we cross su boundary
-      int su = in->layout.fl_stripe_unit;
-      if ((off+l)/su != off/su) l -= (off+l) % su;
-    }
-    
-    // don't read past end of file
-    if (off+l > in->size)
-      l = in->size - off;
-    
-    loff_t min = MIN((loff_t)len, l/2);
-
-    ldout(cct, 20) << "readahead " << f->nr_consec_read << " reads " 
-	     << f->consec_read_bytes << " bytes ... readahead " << off << "~" << l
-	     << " min " << min
-	     << " (caller wants " << off << "~" << len << ")" << dendl;
-    if (l > (loff_t)len) {
-      if (objectcacher->file_is_cached(&in->oset, &in->layout, in->snapid, off, min))
-	ldout(cct, 20) << "readahead already have min" << dendl;
-      else {
-	objectcacher->file_read(&in->oset, &in->layout, in->snapid, off, l, NULL, 0, 0);
-	ldout(cct, 20) << "readahead initiated" << dendl;
-      }
-    }
-  }
 
   // read (and possibly block)
   int r, rvalue = 0;
@@ -6070,6 +6166,16 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
   Context *onfinish = new C_SafeCond(&flock, &cond, &done, &rvalue);
   r = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
 			      off, len, bl, 0, onfinish);
+
+  // readahead?  issued after the read itself, but before we wait for it
+  pair<uint64_t, uint64_t> ra = f->readahead.update(off, len, in->size);
+  if (ra.second) {
+    ldout(cct, 20) << "readahead " << ra.first << "~" << ra.second
+		   << " (caller wants " << off << "~" << len << ")" << dendl;
+    objectcacher->file_read(&in->oset, &in->layout, in->snapid,
+			    ra.first, ra.second, NULL, 0, 0);
+  }
+
   if (r == 0) {
     client_lock.Unlock();
     flock.Lock();
@@ -6190,8 +6296,69 @@ void Client::sync_write_commit(Inode *in)
   put_inode(in);
 }
 
+/*
+ * Large writes made while we hold Fb skip the object cache and go to
+ * the osds at once; _write returns without waiting for them, up to
+ * client_direct_write_max_inflight bytes per file.  The Fb cap ref
+ * taken for each is dropped on commit, so the mds cannot revoke Fb
+ * (e.g. to truncate or to let another client write) until they are
+ * stable, and fsync waits for them and returns the first error.
+ */
+class C_Client_DirectWriteAck : public Context {
+  Client *cl;
+  Inode *in;
+  uint64_t len;
+public:
+  C_Client_DirectWriteAck(Client *c, Inode *i, uint64_t l) : cl(c), in(i), len(l) {
+    in->get();
+  }
+  void finish(int r) {
+    cl->direct_write_ack(in, len, r);
+  }
+};
+
+class C_Client_DirectWriteCommit : public Context {
+  Client *cl;
+  Inode *in;
+public:
+  C_Client_DirectWriteCommit(Client *c, Inode *i) : cl(c), in(i) {
+    in->get();
+  }
+  void finish(int r) {
+    cl->direct_write_commit(in, r);
+  }
+};
+
+void Client::direct_write_ack(Inode *in, uint64_t len, int r)
+{
+  assert(in->direct_write_inflight >= len);
+  in->direct_write_inflight -= len;
+  if (r < 0 && !in->direct_write_err)
+    in->direct_write_err = r;
+  ldout(cct, 15) << "direct_write_ack " << *in << " " << len << " = " << r
+		 << ", " << in->direct_write_inflight << " bytes in flight" << dendl;
+  signal_cond_list(in->waitfor_direct_write);
+  put_inode(in);
+}
+
+void Client::direct_write_commit(Inode *in, int r)
+{
+  assert(in->direct_write_unsafe > 0);
+  in->direct_write_unsafe--;
+  if (r < 0 && !in->direct_write_err)
+    in->direct_write_err = r;
+  signal_cond_list(in->waitfor_direct_write);
+  sync_write_commit(in);  // drops the Fb ref and our inode ref
+}
+
 int Client::write(int fd, const char *buf, loff_t size, loff_t offset) 
 {
+  // copy into a fresh buffer (since our write may be resub, async)
+  // before taking client_lock
+  bufferlist bl;
+  if (size > 0)
+    bl.append(buffer::copy(buf, size));
+
   Mutex::Locker lock(client_lock);
   tout(cct) << "write" << std::endl;
   tout(cct) << fd << std::endl;
@@ -6201,14 +6368,36 @@ int Client::write(int fd, const char *buf, loff_t size, loff_t offset)
   Fh *fh = get_filehandle(fd);
   if (!fh)
     return -EBADF;
-  int r = _write(fh, offset, size, buf);
+  int r = _write(fh, offset, bl);
   ldout(cct, 3) << "write(" << fd << ", \"...\", " << size << ", " << offset << ") = " << r << dendl;
   return r;
 }
 
 
-int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
+int Client::pwritev(int fd, const struct iovec *iov, int iovcnt, loff_t offset)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+  bufferlist bl;
+  iov_to_bufferlist(iov, iovcnt, bl);
+
+  Mutex::Locker lock(client_lock);
+  tout(cct) << "pwritev" << std::endl;
+  tout(cct) << fd << std::endl;
+  tout(cct) << bl.length() << std::endl;
+  tout(cct) << offset << std::endl;
+
+  Fh *fh = get_filehandle(fd);
+  if (!fh)
+    return -EBADF;
+  int r = _write(fh, offset, bl);
+  ldout(cct, 3) << "pwritev(" << fd << ", " << iovcnt << " iovs, " << bl.length() << ", " << offset << ") = " << r << dendl;
+  return r;
+}
+
+int Client::_write(Fh *f, int64_t offset, bufferlist& bl)
 {
+  uint64_t size = bl.length();
   if ((uint64_t)(offset+size) > mdsmap->get_max_filesize()) //too large!
     return -EFBIG;
 
@@ -6245,12 +6434,6 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
   // time it.
   utime_t start = ceph_clock_now(cct);
 
-  // copy into fresh buffer (since our write may be resub, async)
-  bufferptr bp;
-  if (size > 0) bp = buffer::copy(buf, size);
-  bufferlist bl;
-  bl.push_back( bp );
-
   utime_t lat;
   uint64_t totalwritten;
   uint64_t endoff = offset + size;
@@ -6298,7 +6481,43 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
     }
   }
 
-  if (cct->_conf->client_oc && (have & CEPH_CAP_FILE_BUFFER)) {
+  if (cct->_conf->client_oc && (have & CEPH_CAP_FILE_BUFFER) &&
+      !(f->flags & (O_DIRECT | O_SYNC | O_DSYNC)) &&
+      cct->_conf->client_direct_write_min &&
+      size >= cct->_conf->client_direct_write_min) {
+    // big write: we are the only writer, so send it straight to the
+    // osds, and let size and mtime go back to the mds with our caps
+    _flush_range(in, offset, size);
+    if (!in->oset.objects.empty()) {
+      vector<ObjectExtent> ls;
+      Striper::file_to_extents(cct, in->ino, &in->layout, offset, size,
+			       in->truncate_size, ls);
+      objectcacher->discard_set(&in->oset, ls);
+    }
+
+    uint64_t max = cct->_conf->client_direct_write_max_inflight;
+    while (in->direct_write_inflight > 0 &&
+	   in->direct_write_inflight + size > max) {
+      ldout(cct, 10) << "_write waiting on " << in->direct_write_inflight
+		     << " bytes of direct writes in flight" << dendl;
+      wait_on_list(in->waitfor_direct_write);
+    }
+
+    Context *onack = new C_Client_DirectWriteAck(this, in, size);
+    Context *onsafe = new C_Client_DirectWriteCommit(this, in);
+    in->direct_write_inflight += size;
+    in->direct_write_unsafe++;
+    unsafe_sync_write++;
+    get_cap_ref(in, CEPH_CAP_FILE_BUFFER);  // released by onsafe callback
+
+    r = filer->write_trunc(in->ino, &in->layout, in->snaprealm->get_snap_context(),
+			   offset, size, bl, ceph_clock_now(cct), 0,
+			   in->truncate_size, in->truncate_seq,
+			   onack, onsafe);
+    if (r < 0)
+      goto done;
+  } else if (cct->_conf->client_oc && (have & CEPH_CAP_FILE_BUFFER) &&
+	     !(f->flags & O_DIRECT)) {
     // do buffered write
     if (!in->oset.dirty_or_tx)
       get_cap_ref(in, CEPH_CAP_FILE_BUFFER);
@@ -6322,6 +6541,13 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf)
       _flush_range(in, offset, size);
     }
   } else {
+    // O_DIRECT bypasses the cache: write back anything dirty in the
+    // range first, and drop what is cached so later reads see this data
+    if ((f->flags & O_DIRECT) && cct->_conf->client_oc) {
+      _flush_range(in, offset, size);
+      _invalidate_inode_cache(in, offset, size, true);
+    }
+
     // simple, non-atomic sync write
     Mutex flock("Client::_write flock");
     Cond cond;
@@ -6494,6 +6720,16 @@ int Client::_fsync(Fh *f, bool syncdataonly)
     }
   }
 
+  while (in->direct_write_unsafe > 0) {
+    ldout(cct, 10) << "ino " << in->ino << " has " << in->direct_write_unsafe
+		   << " uncommitted direct writes, waiting" << dendl;
+    wait_on_list(in->waitfor_direct_write);
+  }
+  if (!r && in->direct_write_err) {
+    r = in->direct_write_err;
+    in->direct_write_err = 0;
+  }
+
   if (!r) {
     if (flushed_metadata) wait_sync_caps(wait_on_flush);
     // this could wait longer than strictly necessary,
@@ -8167,6 +8403,32 @@ int Client::ll_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl)
   return _read(fh, off, len, bl);
 }
 
+int Client::ll_readv(Fh *fh, const struct iovec *iov, int iovcnt, loff_t off)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+  loff_t len = iov_length(iov, iovcnt);
+
+  bufferlist bl;
+  int r;
+  {
+    Mutex::Locker lock(client_lock);
+    ldout(cct, 3) << "ll_readv " << fh << " " << fh->inode->ino << " " << off << "~" << len << dendl;
+    tout(cct) << "ll_readv" << std::endl;
+    tout(cct) << (unsigned long)fh << std::endl;
+    tout(cct) << off << std::endl;
+    tout(cct) << len << std::endl;
+
+    r = _read(fh, off, len, &bl);
+  }
+
+  if (r >= 0) {
+    bufferlist_to_iov(bl, iov, iovcnt);
+    r = bl.length();
+  }
+  return r;
+}
+
 int Client::ll_read_block(Inode *in, uint64_t blockid,
 			  char *buf,
 			  uint64_t offset,
@@ -8306,6 +8568,10 @@ int Client::ll_commit_blocks(Inode *in,
 
 int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
 {
+  bufferlist bl;
+  if (len > 0)
+    bl.append(buffer::copy(data, len));
+
   Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "ll_write " << fh << " " << fh->inode->ino << " " << off <<
     "~" << len << dendl;
@@ -8314,12 +8580,33 @@ int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
   tout(cct) << off << std::endl;
   tout(cct) << len << std::endl;
 
-  int r = _write(fh, off, len, data);
+  int r = _write(fh, off, bl);
   ldout(cct, 3) << "ll_write " << fh << " " << off << "~" << len << " = " << r
 		<< dendl;
   return r;
 }
 
+int Client::ll_writev(Fh *fh, const struct iovec *iov, int iovcnt, loff_t off)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+  bufferlist bl;
+  iov_to_bufferlist(iov, iovcnt, bl);
+
+  Mutex::Locker lock(client_lock);
+  ldout(cct, 3) << "ll_writev " << fh << " " << fh->inode->ino << " " << off <<
+    "~" << bl.length() << dendl;
+  tout(cct) << "ll_writev" << std::endl;
+  tout(cct) << (unsigned long)fh << std::endl;
+  tout(cct) << off << std::endl;
+  tout(cct) << bl.length() << std::endl;
+
+  int r = _write(fh, off, bl);
+  ldout(cct, 3) << "ll_writev " << fh << " " << off << "~" << bl.length()
+		<< " = " << r << dendl;
+  return r;
+}
+
 int Client::ll_flush(Fh *fh)
 {
   Mutex::Locker lock(client_lock);
@@ -64,6 +64,7 @@ class MClientRequest;
 class MClientRequestForward;
 struct MClientLease;
 class MClientCaps;
+class MClientCapsBatch;
 class MClientCapRelease;
 
 struct DirStat;
@@ -297,6 +298,8 @@ public:
 public:
   entity_name_t get_myname() { return messenger->get_myname(); } 
   void sync_write_commit(Inode *in);
+  void direct_write_ack(Inode *in, uint64_t len, int r);
+  void direct_write_commit(Inode *in, int r);
 
 protected:
   Filer                 *filer;     
@@ -308,6 +311,7 @@ protected:
   ceph::unordered_map<vinodeno_t, Inode*> inode_map;
   Inode*                 root;
   LRU                    lru;    // lru list of Dentry's in our local metadata cache.
+  uint64_t               dentry_bytes;  // estimated memory held by the Dentry's in lru
 
   // all inodes with caps sit on either cap_list or delayed_caps.
   xlist<Inode*> delayed_caps, cap_list;
@@ -392,6 +396,8 @@ protected:
   void touch_dn(Dentry *dn);
 
   // trim cache.
+  uint64_t cache_bytes() const;
+  bool cache_over_limit();
   void trim_cache();
   void trim_dentry(Dentry *dn);
   void trim_caps(MetaSession *s, int max);
@@ -461,6 +467,7 @@ protected:
 
   void handle_snap(struct MClientSnap *m);
   void handle_caps(class MClientCaps *m);
+  void handle_caps_batch(MClientCapsBatch *m);
   void handle_cap_import(MetaSession *session, Inode *in, class MClientCaps *m);
   void handle_cap_export(MetaSession *session, Inode *in, class MClientCaps *m);
   void handle_cap_trunc(MetaSession *session, Inode *in, class MClientCaps *m);
@@ -543,7 +550,8 @@ private:
   void _readdir_next_frag(dir_result_t *dirp);
   void _readdir_rechoose_frag(dir_result_t *dirp);
   int _readdir_get_frag(dir_result_t *dirp);
-  int _readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p);
+  int _readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p,
+			bool getref);
   void _closedir(dir_result_t *dirp);
 
   // other helpers
@@ -582,7 +590,7 @@ private:
 	      bool *created = NULL, int uid=-1, int gid=-1);
   loff_t _lseek(Fh *fh, loff_t offset, int whence);
   int _read(Fh *fh, int64_t offset, uint64_t size, bufferlist *bl);
-  int _write(Fh *fh, int64_t offset, uint64_t size, const char *buf);
+  int _write(Fh *fh, int64_t offset, bufferlist& bl);
   int _flush(Fh *fh);
   int _fsync(Fh *fh, bool syncdataonly);
   int _sync_fs();
@@ -619,7 +627,14 @@ public:
    * Returns 0 if it reached the end of the directory.
    * If @a cb returns a negative error code, stop and return that.
    */
-  int readdir_r_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p);
+  /**
+   * Returns entries with the attributes the MDS sent along with the
+   * readdir reply.  If getref is set, the client takes an ll ref on
+   * each inode (but not on . and ..) that cb accepts, as a
+   * lookup would, for callers that hand the inodes to the kernel.
+   */
+  int readdir_r_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p,
+		   bool getref=false);
 
   struct dirent * readdir(dir_result_t *d);
   int readdir_r(dir_result_t *dirp, struct dirent *de);
@@ -685,6 +700,8 @@ public:
   loff_t lseek(int fd, loff_t offset, int whence);
   int read(int fd, char *buf, loff_t size, loff_t offset=-1);
   int write(int fd, const char *buf, loff_t size, loff_t offset=-1);
+  int preadv(int fd, const struct iovec *iov, int iovcnt, loff_t offset=-1);
+  int pwritev(int fd, const struct iovec *iov, int iovcnt, loff_t offset=-1);
   int fake_write_size(int fd, loff_t size);
   int ftruncate(int fd, loff_t size);
   int fsync(int fd, bool syncdataonly);
@@ -794,6 +811,8 @@ public:
 
   int ll_read(Fh *fh, loff_t off, loff_t len, bufferlist *bl);
   int ll_write(Fh *fh, loff_t off, loff_t len, const char *data);
+  int ll_readv(Fh *fh, const struct iovec *iov, int iovcnt, loff_t off);
+  int ll_writev(Fh *fh, const struct iovec *iov, int iovcnt, loff_t off);
   loff_t ll_lseek(Fh *fh, loff_t offset, int whence);
   int ll_flush(Fh *fh);
   int ll_fsync(Fh *fh, bool syncdataonly);
@@ -19,6 +19,7 @@ class Dentry : public LRUObject {
   uint64_t lease_gen;
   ceph_seq_t lease_seq;
   int cap_shared_gen;
+  bool touched;                      // used since it was linked; next use moves it to the top of the lru
 
   /*
    * ref==1 -> cached, unused
@@ -41,7 +42,7 @@ class Dentry : public LRUObject {
 
   void dump(Formatter *f) const;
 
-  Dentry() : dir(0), inode(0), ref(1), offset(0), lease_mds(-1), lease_gen(0), lease_seq(0), cap_shared_gen(0) { }
+  Dentry() : dir(0), inode(0), ref(1), offset(0), lease_mds(-1), lease_gen(0), lease_seq(0), cap_shared_gen(0), touched(false) { }
 private:
   ~Dentry() {
     assert(ref == 0);
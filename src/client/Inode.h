@@ -160,6 +160,12 @@ class Inode {
 
   uint64_t     reported_size, wanted_max_size, requested_max_size;
 
+  // large writes sent straight to the osds (see Client::_write)
+  uint64_t direct_write_inflight;  // bytes not yet acked
+  int direct_write_unsafe;         // writes not yet committed
+  int direct_write_err;            // first failure, returned by fsync
+  list<Cond*> waitfor_direct_write;
+
   int       _ref;      // ref count. 1 for each dentry, fh that links to me.
   int       ll_ref;   // separate ref count for ll client
   Dir       *dir;     // if i'm a dir.
@@ -221,6 +227,7 @@ class Inode {
       snaprealm(0), snaprealm_item(this), snapdir_parent(0),
       oset((void *)this, newlayout->fl_pg_pool, ino),
       reported_size(0), wanted_max_size(0), requested_max_size(0),
+      direct_write_inflight(0), direct_write_unsafe(0), direct_write_err(0),
       _ref(0), ll_ref(0), 
       dir(0), dn_set()
   {
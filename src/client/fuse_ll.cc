@@ -582,6 +582,68 @@ static void fuse_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
   delete[] rc.buf;
 }
 
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 0)
+/*
+ * Like fuse_ll_add_dirent, but also hands the kernel the attributes we
+ * got with the readdir reply, so that a following stat of each entry
+ * (ls -l) needs neither a lookup nor a getattr.  Every entry but . and
+ * .. counts as a lookup, balanced by a later forget.
+ */
+static int fuse_ll_add_dirent_plus(void *p, struct dirent *de, struct stat *st,
+				   int stmask, off_t next_off)
+{
+  struct readdir_context *c = (struct readdir_context *)p;
+  CephFuse::Handle *cfuse = (CephFuse::Handle *)fuse_req_userdata(c->req);
+  struct fuse_entry_param fe;
+
+  memset(&fe, 0, sizeof(fe));
+  fe.attr = *st;
+  fe.attr.st_rdev = new_encode_dev(st->st_rdev);
+  bool dot = strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0;
+  if (dot) {
+    fe.attr.st_ino = cfuse->make_fake_ino(de->d_ino, c->snap);
+    fe.attr.st_mode = DTTOIF(de->d_type);
+  } else {
+    fe.ino = cfuse->make_fake_ino(st->st_ino, st->st_dev);
+    fe.attr.st_ino = fe.ino;
+  }
+
+  size_t room = c->size - c->pos;
+  size_t entrysize = fuse_add_direntry_plus(c->req, c->buf + c->pos, room,
+					    de->d_name, &fe, next_off);
+  if (entrysize > room)
+    return -ENOSPC;
+
+  /* success */
+  c->pos += entrysize;
+  return 0;
+}
+
+static void fuse_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size,
+				off_t off, struct fuse_file_info *fi)
+{
+  CephFuse::Handle *cfuse = (CephFuse::Handle *)fuse_req_userdata(req);
+
+  dir_result_t *dirp = (dir_result_t*)fi->fh;
+  cfuse->client->seekdir(dirp, off);
+
+  struct readdir_context rc;
+  rc.req = req;
+  rc.buf = new char[size];
+  rc.size = size;
+  rc.pos = 0;
+  rc.snap = cfuse->fino_snap(ino);
+
+  int r = cfuse->client->readdir_r_cb(dirp, fuse_ll_add_dirent_plus, &rc,
+				      true);
+  if (r == 0 || r == -ENOSPC)  /* ignore ENOSPC from our callback */
+    fuse_reply_buf(req, rc.buf, rc.pos);
+  else
+    fuse_reply_err(req, -r);
+  delete[] rc.buf;
+}
+#endif
+
 static void fuse_ll_releasedir(fuse_req_t req, fuse_ino_t ino,
 			       struct fuse_file_info *fi)
 {
@@ -685,6 +747,10 @@ static void dentry_invalidate_cb(void *handle, vinodeno_t dirino,
 static void do_init(void *data, fuse_conn_info *bar)
 {
   CephFuse::Handle *cfuse = (CephFuse::Handle *)data;
+#ifdef FUSE_CAP_READDIRPLUS
+  if (!cfuse->client->cct->_conf->fuse_use_readdirplus)
+    bar->want &= ~FUSE_CAP_READDIRPLUS;
+#endif
   if (cfuse->fd_on_success) {
     //cout << "fuse init signaling on fd " << fd_on_success << std::endl;
     uint32_t r = 0;
@@ -750,7 +816,10 @@ const static struct fuse_lowlevel_ops fuse_ll_oper = {
  retrieve_reply: 0,
  forget_multi: 0,
  flock: 0,
- fallocate: fuse_ll_fallocate
+ fallocate: fuse_ll_fallocate,
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 0)
+ readdirplus: fuse_ll_readdirplus,
 #endif
 #endif
 };
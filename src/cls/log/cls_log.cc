@@ -11,6 +11,8 @@
 #include "include/utime.h"
 #include "objclass/objclass.h"
 
+#include "common/Clock.h"
+
 #include "cls_log_types.h"
 #include "cls_log_ops.h"
 
@@ -28,18 +30,6 @@ cls_method_handle_t h_log_info;
 static string log_index_prefix = "1_";
 
 
-static int write_log_entry(cls_method_context_t hctx, string& index, cls_log_entry& entry)
-{
-  bufferlist bl;
-  ::encode(entry, bl);
-
-  int ret = cls_cxx_map_set_val(hctx, index, &bl);
-  if (ret < 0)
-    return ret;
-
-  return 0;
-}
-
 static void get_index_time_prefix(utime_t& ts, string& index)
 {
   char buf[32];
@@ -112,12 +102,25 @@ static int cls_log_add(cls_method_context_t hctx, bufferlist *in, bufferlist *ou
   if (ret < 0)
     return ret;
 
+  utime_t now;
+  if (op.server_time)
+    now = ceph_clock_now(g_ceph_context);
+
+  /*
+   * all the entries of a call share the subop version, entries that
+   * end up with the same timestamp are told apart by their position
+   */
+  map<string, bufferlist> entries;
+  unsigned pos = 0;
   for (list<cls_log_entry>::iterator iter = op.entries.begin();
-       iter != op.entries.end(); ++iter) {
+       iter != op.entries.end(); ++iter, ++pos) {
     cls_log_entry& entry = *iter;
 
     string index;
 
+    if (op.server_time)
+      entry.timestamp = now;
+
     utime_t timestamp = entry.timestamp;
     if (timestamp < header.max_time)
       timestamp = header.max_time;
@@ -125,19 +128,26 @@ static int cls_log_add(cls_method_context_t hctx, bufferlist *in, bufferlist *ou
       header.max_time = timestamp;
 
     get_index(hctx, timestamp, index);
+    if (op.entries.size() > 1) {
+      char buf[16];
+      snprintf(buf, sizeof(buf), ".%06u", pos);
+      index.append(buf);
+    }
 
-    CLS_LOG(0, "storing entry at %s", index.c_str());
+    CLS_LOG(20, "storing entry at %s", index.c_str());
 
     entry.id = index;
 
     if (index > header.max_marker)
       header.max_marker = index;
 
-    ret = write_log_entry(hctx, index, entry);
-    if (ret < 0)
-      return ret;
+    ::encode(entry, entries[index]);
   }
 
+  ret = cls_cxx_map_set_vals(hctx, &entries);
+  if (ret < 0)
+    return ret;
+
   ret = write_header(hctx, header);
   if (ret < 0)
     return ret;
@@ -233,8 +243,6 @@ static int cls_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *o
     return -EINVAL;
   }
 
-  map<string, bufferlist> keys;
-
   string from_index;
   string to_index;
 
@@ -250,37 +258,41 @@ static int cls_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *o
   }
 
 #define MAX_TRIM_ENTRIES 1000
-  size_t max_entries = MAX_TRIM_ENTRIES;
+  size_t max_entries = op.max_entries;
+  if (!max_entries || max_entries > MAX_TRIM_ENTRIES)
+    max_entries = MAX_TRIM_ENTRIES;
 
-  int rc = cls_cxx_map_get_vals(hctx, from_index, log_index_prefix, max_entries, &keys);
+  /* the header is not an omap key, only log entries are listed */
+  set<string> keys;
+  int rc = cls_cxx_map_get_keys(hctx, from_index, max_entries, &keys);
   if (rc < 0)
     return rc;
 
-  map<string, bufferlist>::iterator iter = keys.begin();
-
-  size_t i;
-  bool removed = false;
-  for (i = 0; i < max_entries && iter != keys.end(); ++i, ++iter) {
-    const string& index = iter->first;
+  set<string> to_remove;
+  for (set<string>::iterator iter = keys.begin(); iter != keys.end(); ++iter) {
+    const string& index = *iter;
 
     CLS_LOG(20, "index=%s to_index=%s", index.c_str(), to_index.c_str());
 
-    if (index.compare(0, to_index.size(), to_index) > 0)
+    if (index.compare(0, log_index_prefix.size(), log_index_prefix) != 0 ||
+        index.compare(0, to_index.size(), to_index) > 0)
       break;
 
-    CLS_LOG(20, "removing key: index=%s", index.c_str());
-
-    int rc = cls_cxx_map_remove_key(hctx, index);
-    if (rc < 0) {
-      CLS_LOG(1, "ERROR: cls_cxx_map_remove_key failed rc=%d", rc);
-      return -EINVAL;
-    }
-    removed = true;
+    to_remove.insert(to_remove.end(), index);
   }
 
-  if (!removed)
+  if (to_remove.empty())
     return -ENODATA;
 
+  CLS_LOG(20, "removing %d keys: %s..%s", (int)to_remove.size(),
+          to_remove.begin()->c_str(), to_remove.rbegin()->c_str());
+
+  rc = cls_cxx_map_remove_keys(hctx, to_remove);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: cls_cxx_map_remove_keys failed rc=%d", rc);
+    return -EINVAL;
+  }
+
   return 0;
 }
 
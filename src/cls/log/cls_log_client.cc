@@ -2,6 +2,7 @@
 
 #include "include/types.h"
 #include "cls/log/cls_log_ops.h"
+#include "cls/log/cls_log_client.h"
 #include "include/rados/librados.hpp"
 
 
@@ -9,11 +10,13 @@ using namespace librados;
 
 
 
-void cls_log_add(librados::ObjectWriteOperation& op, list<cls_log_entry>& entries)
+void cls_log_add(librados::ObjectWriteOperation& op, list<cls_log_entry>& entries,
+                 bool server_time)
 {
   bufferlist in;
   cls_log_add_op call;
   call.entries = entries;
+  call.server_time = server_time;
   ::encode(call, in);
   op.exec("log", "add", in);
 }
@@ -46,7 +49,8 @@ void cls_log_add(librados::ObjectWriteOperation& op, const utime_t& timestamp,
 }
 
 void cls_log_trim(librados::ObjectWriteOperation& op, const utime_t& from_time, const utime_t& to_time,
-                  const string& from_marker, const string& to_marker)
+                  const string& from_marker, const string& to_marker,
+                  uint32_t max_entries)
 {
   bufferlist in;
   cls_log_trim_op call;
@@ -54,6 +58,7 @@ void cls_log_trim(librados::ObjectWriteOperation& op, const utime_t& from_time,
   call.to_time = to_time;
   call.from_marker = from_marker;
   call.to_marker = to_marker;
+  call.max_entries = max_entries;
   ::encode(call, in);
   op.exec("log", "trim", in);
 }
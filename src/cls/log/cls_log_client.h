@@ -12,7 +12,12 @@
 void cls_log_add_prepare_entry(cls_log_entry& entry, const utime_t& timestamp,
                  const string& section, const string& name, bufferlist& bl);
 
-void cls_log_add(librados::ObjectWriteOperation& op, list<cls_log_entry>& entry);
+/*
+ * with server_time, the entries are timestamped by the osd rather than
+ * with their timestamp field
+ */
+void cls_log_add(librados::ObjectWriteOperation& op, list<cls_log_entry>& entries,
+                 bool server_time = false);
 void cls_log_add(librados::ObjectWriteOperation& op, cls_log_entry& entry);
 void cls_log_add(librados::ObjectWriteOperation& op, const utime_t& timestamp,
                  const string& section, const string& name, bufferlist& bl);
@@ -22,8 +27,13 @@ void cls_log_list(librados::ObjectReadOperation& op, utime_t& from, utime_t& to,
 		  list<cls_log_entry>& entries,
                   string *out_marker, bool *truncated);
 
+/*
+ * removes up to max_entries entries of the range (0 for the osd's default),
+ * the op returns -ENODATA once the range is empty
+ */
 void cls_log_trim(librados::ObjectWriteOperation& op, const utime_t& from_time, const utime_t& to_time,
-                  const string& from_marker, const string& to_marker);
+                  const string& from_marker, const string& to_marker,
+                  uint32_t max_entries = 0);
 int cls_log_trim(librados::IoCtx& io_ctx, const string& oid, const utime_t& from_time, const utime_t& to_time,
                  const string& from_marker, const string& to_marker);
 
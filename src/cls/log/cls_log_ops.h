@@ -9,18 +9,24 @@
 
 struct cls_log_add_op {
   list<cls_log_entry> entries;
+  bool server_time; /* timestamp the entries with the osd's clock */
 
-  cls_log_add_op() {}
+  cls_log_add_op() : server_time(false) {}
 
   void encode(bufferlist& bl) const {
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(2, 1, bl);
     ::encode(entries, bl);
+    ::encode(server_time, bl);
     ENCODE_FINISH(bl);
   }
 
   void decode(bufferlist::iterator& bl) {
-    DECODE_START(1, bl);
+    DECODE_START(2, bl);
     ::decode(entries, bl);
+    if (struct_v >= 2)
+      ::decode(server_time, bl);
+    else
+      server_time = false;
     DECODE_FINISH(bl);
   }
 };
@@ -84,32 +90,40 @@ WRITE_CLASS_ENCODER(cls_log_list_ret)
 /*
  * operation will return 0 when successfully removed but not done. Will return
  * -ENODATA when done, so caller needs to repeat sending request until that.
+ * Each call removes at most max_entries entries (0 for the osd's default), in
+ * a single omap update.
  */
 struct cls_log_trim_op {
   utime_t from_time;
   utime_t to_time; /* inclusive */
   string from_marker;
   string to_marker;
+  uint32_t max_entries;
 
-  cls_log_trim_op() {}
+  cls_log_trim_op() : max_entries(0) {}
 
   void encode(bufferlist& bl) const {
-    ENCODE_START(2, 1, bl);
+    ENCODE_START(3, 1, bl);
     ::encode(from_time, bl);
     ::encode(to_time, bl);
     ::encode(from_marker, bl);
     ::encode(to_marker, bl);
+    ::encode(max_entries, bl);
     ENCODE_FINISH(bl);
   }
 
   void decode(bufferlist::iterator& bl) {
-    DECODE_START(2, bl);
+    DECODE_START(3, bl);
     ::decode(from_time, bl);
     ::decode(to_time, bl);
     if (struct_v >= 2) {
     ::decode(from_marker, bl);
     ::decode(to_marker, bl);
     }
+    if (struct_v >= 3)
+      ::decode(max_entries, bl);
+    else
+      max_entries = 0;
     DECODE_FINISH(bl);
   }
 };
@@ -89,6 +89,10 @@ cls_method_handle_t h_dir_list;
 cls_method_handle_t h_dir_add_image;
 cls_method_handle_t h_dir_remove_image;
 cls_method_handle_t h_dir_rename_image;
+cls_method_handle_t h_object_map_load;
+cls_method_handle_t h_object_map_save;
+cls_method_handle_t h_object_map_resize;
+cls_method_handle_t h_object_map_update;
 cls_method_handle_t h_old_snapshots_list;
 cls_method_handle_t h_old_snapshot_add;
 cls_method_handle_t h_old_snapshot_remove;
@@ -97,6 +101,7 @@ cls_method_handle_t h_old_snapshot_remove;
 #define RBD_SNAP_KEY_PREFIX "snapshot_"
 #define RBD_DIR_ID_KEY_PREFIX "id_"
 #define RBD_DIR_NAME_KEY_PREFIX "name_"
+#define RBD_OBJECT_MAP_HEADER_LEN 8
 
 static int snap_read_header(cls_method_context_t hctx, bufferlist& bl)
 {
@@ -1785,6 +1790,253 @@ int dir_remove_image(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
   return dir_remove_image_helper(hctx, name, id);
 }
 
+/************************ rbd_object_map object methods ******************/
+
+/*
+ * An object map is a plain (non-omap) object: the number of data
+ * objects it covers, encoded as a uint64_t, followed by one bit per
+ * data object, least significant bit first.  A set bit means the data
+ * object may exist; a clear bit means it definitely does not.
+ */
+
+static int object_map_read_count(cls_method_context_t hctx, uint64_t *count)
+{
+  bufferlist bl;
+  int r = cls_cxx_read(hctx, 0, RBD_OBJECT_MAP_HEADER_LEN, &bl);
+  if (r < 0)
+    return r;
+  if (bl.length() < RBD_OBJECT_MAP_HEADER_LEN) {
+    CLS_ERR("object map is too short: %u bytes", bl.length());
+    return -EIO;
+  }
+
+  try {
+    bufferlist::iterator iter = bl.begin();
+    ::decode(*count, iter);
+  } catch (const buffer::error &err) {
+    CLS_ERR("could not decode object map header");
+    return -EIO;
+  }
+  return 0;
+}
+
+static int object_map_read(cls_method_context_t hctx, uint64_t *count,
+			   bufferlist *bits)
+{
+  uint64_t size;
+  int r = cls_cxx_stat(hctx, &size, NULL);
+  if (r < 0)
+    return r;
+
+  bufferlist bl;
+  r = cls_cxx_read(hctx, 0, size, &bl);
+  if (r < 0)
+    return r;
+
+  try {
+    bufferlist::iterator iter = bl.begin();
+    ::decode(*count, iter);
+  } catch (const buffer::error &err) {
+    CLS_ERR("could not decode object map header");
+    return -EIO;
+  }
+
+  if (bl.length() - RBD_OBJECT_MAP_HEADER_LEN != (*count + 7) / 8) {
+    CLS_ERR("object map holds %u bytes for %llu objects",
+	    bl.length() - RBD_OBJECT_MAP_HEADER_LEN,
+	    (unsigned long long)*count);
+    return -EIO;
+  }
+  bits->substr_of(bl, RBD_OBJECT_MAP_HEADER_LEN,
+		  bl.length() - RBD_OBJECT_MAP_HEADER_LEN);
+  return 0;
+}
+
+static int object_map_write(cls_method_context_t hctx, uint64_t count,
+			    const bufferlist &bits)
+{
+  bufferlist bl;
+  ::encode(count, bl);
+  bl.append(bits);
+  return cls_cxx_write_full(hctx, &bl);
+}
+
+/**
+ * Read an object map.
+ *
+ * Input:
+ * none
+ *
+ * Output:
+ * @param object_count number of data objects covered (uint64_t)
+ * @param bits one bit per data object (bufferlist)
+ * @returns 0 on success, -ENOENT if there is no object map
+ */
+int object_map_load(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t count;
+  bufferlist bits;
+  int r = object_map_read(hctx, &count, &bits);
+  if (r < 0)
+    return r;
+
+  ::encode(count, *out);
+  ::encode(bits, *out);
+  return 0;
+}
+
+/**
+ * Replace an object map, creating it if necessary.
+ *
+ * Input:
+ * @param object_count number of data objects covered (uint64_t)
+ * @param bits one bit per data object (bufferlist)
+ *
+ * Output:
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_save(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t count;
+  bufferlist bits;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(count, iter);
+    ::decode(bits, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  if (bits.length() != (count + 7) / 8)
+    return -EINVAL;
+
+  CLS_LOG(20, "object_map_save object_count=%llu", (unsigned long long)count);
+  return object_map_write(hctx, count, bits);
+}
+
+/**
+ * Change the number of data objects an object map covers, creating it
+ * if necessary.  Objects added by growing the map do not exist.
+ *
+ * Input:
+ * @param object_count new number of data objects (uint64_t)
+ *
+ * Output:
+ * @returns 0 on success, negative error code on failure
+ */
+int object_map_resize(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t new_count;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(new_count, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  uint64_t count = 0;
+  bufferlist bits;
+  int r = object_map_read(hctx, &count, &bits);
+  if (r < 0 && r != -ENOENT)
+    return r;
+  if (r == 0 && count == new_count)
+    return 0;
+
+  CLS_LOG(20, "object_map_resize %llu -> %llu", (unsigned long long)count,
+	  (unsigned long long)new_count);
+
+  uint64_t new_len = (new_count + 7) / 8;
+  bufferptr bp(new_len);
+  bp.zero();
+  bits.copy(0, MIN(bits.length(), new_len), bp.c_str());
+  if (new_count < count && new_count % 8) {
+    // objects past the end must read as nonexistent if the map grows again
+    bp.c_str()[new_len - 1] &= (1 << (new_count % 8)) - 1;
+  }
+
+  bufferlist new_bits;
+  new_bits.push_back(bp);
+  return object_map_write(hctx, new_count, new_bits);
+}
+
+/**
+ * Set the state of a range of data objects in an object map.  The
+ * object map is only rewritten if a bit actually changes.
+ *
+ * Input:
+ * @param start_object_no first data object to update (uint64_t)
+ * @param end_object_no one past the last data object to update (uint64_t)
+ * @param new_state RBD_OBJECT_EXISTS or RBD_OBJECT_NONEXISTENT (uint8_t)
+ *
+ * Output:
+ * @returns 0 on success, -ENOENT if there is no object map,
+ *          -EINVAL if the range is past the end of the map
+ */
+int object_map_update(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  uint64_t start_object_no, end_object_no;
+  uint8_t new_state;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(start_object_no, iter);
+    ::decode(end_object_no, iter);
+    ::decode(new_state, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  if (start_object_no > end_object_no ||
+      (new_state != RBD_OBJECT_EXISTS && new_state != RBD_OBJECT_NONEXISTENT))
+    return -EINVAL;
+
+  uint64_t count;
+  int r = object_map_read_count(hctx, &count);
+  if (r < 0)
+    return r;
+  if (end_object_no > count) {
+    CLS_ERR("object_map_update: objects %llu~%llu past end of map (%llu)",
+	    (unsigned long long)start_object_no,
+	    (unsigned long long)(end_object_no - start_object_no),
+	    (unsigned long long)count);
+    return -EINVAL;
+  }
+  if (start_object_no == end_object_no)
+    return 0;
+
+  uint64_t first_byte = start_object_no / 8;
+  uint64_t len = (end_object_no - 1) / 8 + 1 - first_byte;
+  bufferlist bl;
+  r = cls_cxx_read(hctx, RBD_OBJECT_MAP_HEADER_LEN + first_byte, len, &bl);
+  if (r < 0)
+    return r;
+  if (bl.length() != len) {
+    CLS_ERR("object map is truncated");
+    return -EIO;
+  }
+
+  bufferptr bp(len);
+  bl.copy(0, len, bp.c_str());
+  bool changed = false;
+  for (uint64_t i = start_object_no; i < end_object_no; ++i) {
+    char *byte = bp.c_str() + (i / 8 - first_byte);
+    char bit = 1 << (i % 8);
+    if (new_state == RBD_OBJECT_EXISTS && !(*byte & bit)) {
+      *byte |= bit;
+      changed = true;
+    } else if (new_state == RBD_OBJECT_NONEXISTENT && (*byte & bit)) {
+      *byte &= ~bit;
+      changed = true;
+    }
+  }
+  if (!changed)
+    return 0;
+
+  bufferlist new_bl;
+  new_bl.push_back(bp);
+  return cls_cxx_write(hctx, RBD_OBJECT_MAP_HEADER_LEN + first_byte, len,
+		       &new_bl);
+}
+
 /****************************** Old format *******************************/
 
 int old_snapshots_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
@@ -2080,6 +2332,20 @@ void __cls_init()
 			  CLS_METHOD_RD | CLS_METHOD_WR,
 			  dir_rename_image, &h_dir_rename_image);
 
+  /* methods for the rbd_object_map.$image_id objects */
+  cls_register_cxx_method(h_class, "object_map_load",
+			  CLS_METHOD_RD,
+			  object_map_load, &h_object_map_load);
+  cls_register_cxx_method(h_class, "object_map_save",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_save, &h_object_map_save);
+  cls_register_cxx_method(h_class, "object_map_resize",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_resize, &h_object_map_resize);
+  cls_register_cxx_method(h_class, "object_map_update",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  object_map_update, &h_object_map_update);
+
   /* methods for the old format */
   cls_register_cxx_method(h_class, "snap_list",
 			  CLS_METHOD_RD,
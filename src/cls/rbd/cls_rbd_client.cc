@@ -631,5 +631,81 @@ namespace librbd {
       ::encode(id, in);
       return ioctx->exec(oid, "rbd", "dir_rename_image", in, out);
     }
+
+    /******************** rbd_object_map object methods ********************/
+
+    int object_map_load(librados::IoCtx *ioctx, const std::string &oid,
+			std::vector<bool> *object_map)
+    {
+      bufferlist in, out;
+      int r = ioctx->exec(oid, "rbd", "object_map_load", in, out);
+      if (r < 0)
+	return r;
+
+      uint64_t count;
+      bufferlist bits;
+      try {
+	bufferlist::iterator iter = out.begin();
+	::decode(count, iter);
+	::decode(bits, iter);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+      if (bits.length() != (count + 7) / 8)
+	return -EBADMSG;
+
+      const char *p = bits.c_str();
+      object_map->resize(count);
+      for (uint64_t i = 0; i < count; ++i)
+	(*object_map)[i] = p[i / 8] & (1 << (i % 8));
+      return 0;
+    }
+
+    int object_map_save(librados::IoCtx *ioctx, const std::string &oid,
+			const std::vector<bool> &object_map)
+    {
+      uint64_t count = object_map.size();
+      bufferptr bp((count + 7) / 8);
+      bp.zero();
+      for (uint64_t i = 0; i < count; ++i) {
+	if (object_map[i])
+	  bp.c_str()[i / 8] |= 1 << (i % 8);
+      }
+      bufferlist bits;
+      bits.push_back(bp);
+
+      bufferlist in, out;
+      ::encode(count, in);
+      ::encode(bits, in);
+      return ioctx->exec(oid, "rbd", "object_map_save", in, out);
+    }
+
+    int object_map_resize(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t object_count)
+    {
+      bufferlist in, out;
+      ::encode(object_count, in);
+      return ioctx->exec(oid, "rbd", "object_map_resize", in, out);
+    }
+
+    void object_map_update(librados::ObjectWriteOperation *op,
+			   uint64_t start_object_no, uint64_t end_object_no,
+			   uint8_t new_state)
+    {
+      bufferlist in;
+      ::encode(start_object_no, in);
+      ::encode(end_object_no, in);
+      ::encode(new_state, in);
+      op->exec("rbd", "object_map_update", in);
+    }
+
+    int object_map_update(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t start_object_no, uint64_t end_object_no,
+			  uint8_t new_state)
+    {
+      librados::ObjectWriteOperation op;
+      object_map_update(&op, start_object_no, end_object_no, new_state);
+      return ioctx->operate(oid, &op);
+    }
   } // namespace cls_client
 } // namespace librbd
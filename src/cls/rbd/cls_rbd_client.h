@@ -99,6 +99,20 @@ namespace librbd {
 			 const std::string &src, const std::string &dest,
 			 const std::string &id);
 
+    // operations on rbd_object_map objects
+    int object_map_load(librados::IoCtx *ioctx, const std::string &oid,
+			std::vector<bool> *object_map);
+    int object_map_save(librados::IoCtx *ioctx, const std::string &oid,
+			const std::vector<bool> &object_map);
+    int object_map_resize(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t object_count);
+    void object_map_update(librados::ObjectWriteOperation *op,
+			   uint64_t start_object_no, uint64_t end_object_no,
+			   uint8_t new_state);
+    int object_map_update(librados::IoCtx *ioctx, const std::string &oid,
+			  uint64_t start_object_no, uint64_t end_object_no,
+			  uint8_t new_state);
+
     // class operations on the old format, kept for
     // backwards compatability
     int old_snapshot_add(librados::IoCtx *ioctx, const std::string &oid,
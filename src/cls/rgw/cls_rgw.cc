@@ -213,40 +213,72 @@ int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     return -EINVAL;
   }
 
-  bufferlist bl;
+  std::map<string, struct rgw_bucket_dir_entry>& m = new_dir.m;
+  string start_key = op.start_obj;
+  uint32_t count = 0; /* entries and common prefixes */
+  bool done = false;
+  bool more = true;
+
+  /*
+   * with a delimiter, a name that has it past the prefix is reported as
+   * its common prefix, and the listing seeks past every other name
+   * under that prefix instead of reading them
+   */
+  while (count < op.num_entries && more && !done) {
+    map<string, bufferlist> keys;
+    uint32_t max = op.num_entries - count + 1;
+    rc = get_obj_vals(hctx, start_key, op.filter_prefix, max, &keys);
+    if (rc < 0)
+      return rc;
 
-  map<string, bufferlist> keys;
-  rc = get_obj_vals(hctx, op.start_obj, op.filter_prefix, op.num_entries + 1, &keys);
-  if (rc < 0)
-    return rc;
+    more = (keys.size() >= max);
 
-  std::map<string, struct rgw_bucket_dir_entry>& m = new_dir.m;
-  std::map<string, bufferlist>::iterator kiter = keys.begin();
-  uint32_t i;
+    std::map<string, bufferlist>::iterator kiter;
+    for (kiter = keys.begin(); count < op.num_entries && kiter != keys.end(); ++kiter) {
+      const string& key = kiter->first;
 
-  bool done = false;
+      if (!bi_is_objs_index(key)) {
+        done = true;
+        break;
+      }
 
-  for (i = 0; i < op.num_entries && kiter != keys.end(); ++i, ++kiter) {
-    struct rgw_bucket_dir_entry entry;
+      start_key = key;
+
+      if (!op.delimiter.empty()) {
+        size_t pos = key.find(op.delimiter, op.filter_prefix.size());
+        if (pos != string::npos) {
+          string prefix = key.substr(0, pos + op.delimiter.size());
+          ret.common_prefixes.insert(prefix);
+          ++count;
+          /* names under the prefix are all greater than it, and less than this */
+          start_key = prefix;
+          start_key.append(1, (char)0xFF);
+          more = true;
+          break;
+        }
+      }
 
-    if (!bi_is_objs_index(kiter->first)) {
-      done = true;
-      break;
+      struct rgw_bucket_dir_entry entry;
+      bufferlist& entrybl = kiter->second;
+      bufferlist::iterator eiter = entrybl.begin();
+      try {
+        ::decode(entry, eiter);
+      } catch (buffer::error& err) {
+        CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", key.c_str());
+        return -EINVAL;
+      }
+
+      m[key] = entry;
+      ++count;
     }
 
-    bufferlist& entrybl = kiter->second;
-    bufferlist::iterator eiter = entrybl.begin();
-    try {
-      ::decode(entry, eiter);
-    } catch (buffer::error& err) {
-      CLS_LOG(1, "ERROR: rgw_bucket_list(): failed to decode entry, key=%s\n", kiter->first.c_str());
-      return -EINVAL;
+    if (count >= op.num_entries && kiter != keys.end() && !done) {
+      /* there is at least one more name after what we return */
+      more = true;
     }
-    
-    m[kiter->first] = entry;
   }
 
-  ret.is_truncated = (kiter != keys.end() && !done);
+  ret.is_truncated = (more && !done);
 
   ::encode(ret, *out);
   return 0;
@@ -88,6 +88,61 @@ int cls_rgw_list_op(IoCtx& io_ctx, string& oid, string& start_obj,
  return r;
 }
 
+int cls_rgw_list_op_multi(IoCtx& io_ctx, vector<string>& oids, string& start_obj,
+                          string& filter_prefix, const string& delimiter, uint32_t num_entries,
+                          vector<rgw_cls_list_ret>& results)
+{
+  bufferlist in;
+  struct rgw_cls_list_op call;
+  call.start_obj = start_obj;
+  call.filter_prefix = filter_prefix;
+  call.delimiter = delimiter;
+  call.num_entries = num_entries;
+  ::encode(call, in);
+
+  size_t n = oids.size();
+  vector<bufferlist> outs(n);
+  vector<int> rvals(n, 0);
+  vector<AioCompletion *> completions(n, (AioCompletion *)NULL);
+  int r = 0;
+  for (size_t i = 0; i < n; i++) {
+    ObjectReadOperation op;
+    op.exec("rgw", "bucket_list", in, &outs[i], &rvals[i]);
+    completions[i] = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int ret = io_ctx.aio_operate(oids[i], completions[i], &op, NULL);
+    if (ret < 0) {
+      completions[i]->release();
+      completions[i] = NULL;
+      r = ret;
+      break;
+    }
+  }
+
+  results.clear();
+  results.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    if (!completions[i])
+      break;
+    completions[i]->wait_for_complete();
+    int ret = completions[i]->get_return_value();
+    completions[i]->release();
+    if (ret < 0) {
+      if (r >= 0)
+        r = ret;
+      continue;
+    }
+    try {
+      bufferlist::iterator iter = outs[i].begin();
+      ::decode(results[i], iter);
+    } catch (buffer::error& err) {
+      if (r >= 0)
+        r = -EIO;
+    }
+  }
+
+  return r;
+}
+
 int cls_rgw_bucket_check_index_op(IoCtx& io_ctx, string& oid,
 				  rgw_bucket_dir_header *existing_header,
 				  rgw_bucket_dir_header *calculated_header)
@@ -4,6 +4,7 @@
 #include "include/types.h"
 #include "include/rados/librados.hpp"
 #include "cls_rgw_types.h"
+#include "cls_rgw_ops.h"
 #include "common/RefCountedObj.h"
 
 class RGWGetDirHeader_CB : public RefCountedObject {
@@ -27,6 +28,13 @@ void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, RGWModifyOp o
 int cls_rgw_list_op(librados::IoCtx& io_ctx, string& oid, string& start_obj,
                     string& filter_prefix, uint32_t num_entries,
                     rgw_bucket_dir *dir, bool *is_truncated);
+/*
+ * list several index objects in parallel, results[i] is the listing of oids[i];
+ * with a delimiter, names are collapsed into results[i].common_prefixes
+ */
+int cls_rgw_list_op_multi(librados::IoCtx& io_ctx, vector<string>& oids, string& start_obj,
+                          string& filter_prefix, const string& delimiter, uint32_t num_entries,
+                          vector<rgw_cls_list_ret>& results);
 
 int cls_rgw_bucket_check_index_op(librados::IoCtx& io_ctx, string& oid,
 				  rgw_bucket_dir_header *existing_header,
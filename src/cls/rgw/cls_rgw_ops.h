@@ -130,22 +130,26 @@ struct rgw_cls_list_op
   string start_obj;
   uint32_t num_entries;
   string filter_prefix;
+  string delimiter; /* if set, names sharing a prefix up to it are collapsed */
 
   rgw_cls_list_op() : num_entries(0) {}
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(3, 2, bl);
+    ENCODE_START(4, 2, bl);
     ::encode(start_obj, bl);
     ::encode(num_entries, bl);
     ::encode(filter_prefix, bl);
+    ::encode(delimiter, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(4, 2, 2, bl);
     ::decode(start_obj, bl);
     ::decode(num_entries, bl);
     if (struct_v >= 3)
       ::decode(filter_prefix, bl);
+    if (struct_v >= 4)
+      ::decode(delimiter, bl);
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -157,19 +161,23 @@ struct rgw_cls_list_ret
 {
   rgw_bucket_dir dir;
   bool is_truncated;
+  set<string> common_prefixes; /* prefixes collapsed by the delimiter, each ends with it */
 
   rgw_cls_list_ret() : is_truncated(false) {}
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(2, 2, bl);
+    ENCODE_START(3, 2, bl);
     ::encode(dir, bl);
     ::encode(is_truncated, bl);
+    ::encode(common_prefixes, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(2, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
     ::decode(dir, bl);
     ::decode(is_truncated, bl);
+    if (struct_v >= 3)
+      ::decode(common_prefixes, bl);
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
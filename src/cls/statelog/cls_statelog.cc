@@ -29,18 +29,6 @@ static string statelog_index_by_client_prefix = "1_";
 static string statelog_index_by_object_prefix = "2_";
 
 
-static int write_statelog_entry(cls_method_context_t hctx, const string& index, const cls_statelog_entry& entry)
-{
-  bufferlist bl;
-  ::encode(entry, bl);
-
-  int ret = cls_cxx_map_set_val(hctx, index, &bl);
-  if (ret < 0)
-    return ret;
-
-  return 0;
-}
-
 static void get_index_by_client(const string& client_id, const string& op_id, string& index)
 {
   index = statelog_index_by_client_prefix;
@@ -118,31 +106,35 @@ static int cls_statelog_add(cls_method_context_t hctx, bufferlist *in, bufferlis
     return -EINVAL;
   }
 
+  /* both indexes of all the entries go in a single omap update */
+  map<string, bufferlist> entries;
   for (list<cls_statelog_entry>::iterator iter = op.entries.begin();
        iter != op.entries.end(); ++iter) {
     cls_statelog_entry& entry = *iter;
 
+    bufferlist bl;
+    ::encode(entry, bl);
+
     string index_by_client;
 
     get_index_by_client(entry, index_by_client);
 
-    CLS_LOG(0, "storing entry by client/op at %s", index_by_client.c_str());
+    CLS_LOG(20, "storing entry by client/op at %s", index_by_client.c_str());
 
-    int ret = write_statelog_entry(hctx, index_by_client, entry);
-    if (ret < 0)
-      return ret;
+    entries[index_by_client] = bl;
 
     string index_by_obj;
 
     get_index_by_object(entry, index_by_obj);
 
-    CLS_LOG(0, "storing entry by object at %s", index_by_obj.c_str());
-    ret = write_statelog_entry(hctx, index_by_obj, entry);
-    if (ret < 0)
-      return ret;
-
+    CLS_LOG(20, "storing entry by object at %s", index_by_obj.c_str());
+    entries[index_by_obj] = bl;
   }
-  
+
+  int ret = cls_cxx_map_set_vals(hctx, &entries);
+  if (ret < 0)
+    return ret;
+
   return 0;
 }
 
@@ -244,18 +236,16 @@ static int cls_statelog_remove(cls_method_context_t hctx, bufferlist *in, buffer
   string obj_index;
   get_index_by_object(entry.object, entry.op_id, obj_index);
 
-  rc = cls_cxx_map_remove_key(hctx, obj_index);
-  if (rc < 0) {
-    CLS_LOG(0, "ERROR: failed to remove key");
-    return rc;
-  }
-
   string client_index;
   get_index_by_client(entry.client_id, entry.op_id, client_index);
 
-  rc = cls_cxx_map_remove_key(hctx, client_index);
+  set<string> keys;
+  keys.insert(obj_index);
+  keys.insert(client_index);
+
+  rc = cls_cxx_map_remove_keys(hctx, keys);
   if (rc < 0) {
-    CLS_LOG(0, "ERROR: failed to remove key");
+    CLS_LOG(0, "ERROR: failed to remove keys");
     return rc;
   }
 
@@ -21,6 +21,8 @@
 
 #include "common/Mutex.h"
 #include "common/Finisher.h"
+#include "common/perf_counters.h"
+#include "common/Clock.h"
 
 /**
  * Manages a configurable number of asyncronous reservations.
@@ -28,6 +30,12 @@
  * Memory usage is linear with the number of items queued and
  * linear with respect to the total number of priorities used
  * over all time.
+ *
+ * A reservation requested with an on_preempt callback may be taken
+ * back while it is held: when every slot is in use and a request of
+ * strictly higher priority is waiting, the lowest priority preemptible
+ * reservation is revoked, its on_preempt called, and its slot granted
+ * to the waiter.
  */
 template <typename T>
 class AsyncReserver {
@@ -35,22 +43,58 @@ class AsyncReserver {
   unsigned max_allowed;
   Mutex lock;
 
-  map<unsigned, list<pair<T, Context*> > > queues;
-  map<T, pair<unsigned, typename list<pair<T, Context*> >::iterator > > queue_pointers;
-  set<T> in_progress;
+  struct Reservation {
+    T item;
+    unsigned prio;
+    Context *grant;
+    Context *preempt;
+    utime_t start;
+    Reservation(T i, unsigned p, Context *g, Context *pre, utime_t s)
+      : item(i), prio(p), grant(g), preempt(pre), start(s) {}
+  };
+
+  map<unsigned, list<Reservation> > queues;
+  map<T, pair<unsigned, typename list<Reservation>::iterator > > queue_pointers;
+  map<T, Reservation> in_progress;
+  set<pair<unsigned, T> > preempt_by_prio;  ///< in_progress we may preempt
+
+  PerfCounters *logger;
+  int l_preempt, l_wait;
+
+  /// revoke the lowest preemptible grant below prio, if there is one
+  bool preempt_one(unsigned prio) {
+    if (preempt_by_prio.empty() ||
+	preempt_by_prio.begin()->first >= prio)
+      return false;
+    T item = preempt_by_prio.begin()->second;
+    preempt_by_prio.erase(preempt_by_prio.begin());
+    typename map<T, Reservation>::iterator p = in_progress.find(item);
+    assert(p != in_progress.end());
+    f->queue(p->second.preempt);
+    in_progress.erase(p);
+    if (logger)
+      logger->inc(l_preempt);
+    return true;
+  }
 
   void do_queues() {
-    typename map<unsigned, list<pair<T, Context*> > >::reverse_iterator it;
-    for (it = queues.rbegin();
-         it != queues.rend() && in_progress.size() < max_allowed;
-         ++it) {
-      while (in_progress.size() < max_allowed &&
-             !it->second.empty()) {
-        pair<T, Context*> p = it->second.front();
-        queue_pointers.erase(p.first);
+    typename map<unsigned, list<Reservation> >::reverse_iterator it;
+    for (it = queues.rbegin(); it != queues.rend(); ++it) {
+      while (!it->second.empty()) {
+	// never preempt to make up for a lowered max
+	if (in_progress.size() >= max_allowed &&
+	    (in_progress.size() > max_allowed || !preempt_one(it->first)))
+	  return;
+        Reservation p = it->second.front();
+        queue_pointers.erase(p.item);
         it->second.pop_front();
-        f->queue(p.second);
-        in_progress.insert(p.first);
+        f->queue(p.grant);
+	p.grant = NULL;
+	if (logger)
+	  logger->tinc(l_wait, ceph_clock_now(NULL) - p.start);
+	if (p.preempt)
+	  preempt_by_prio.insert(make_pair(p.prio, p.item));
+        in_progress.insert(make_pair(p.item, p));
       }
     }
   }
@@ -58,7 +102,22 @@ public:
   AsyncReserver(
     Finisher *f,
     unsigned max_allowed)
-    : f(f), max_allowed(max_allowed), lock("AsyncReserver::lock") {}
+    : f(f), max_allowed(max_allowed), lock("AsyncReserver::lock"),
+      logger(NULL), l_preempt(0), l_wait(0) {}
+
+  /**
+   * Count preemptions and time spent waiting for a reservation
+   *
+   * @param l logger to update, NULL to stop
+   * @param preempt u64 counter index bumped per preemption
+   * @param wait time counter index fed each grant's wait
+   */
+  void set_perf_counters(PerfCounters *l, int preempt, int wait) {
+    Mutex::Locker locker(lock);
+    logger = l;
+    l_preempt = preempt;
+    l_wait = wait;
+  }
 
   void set_max(unsigned max) {
     Mutex::Locker l(lock);
@@ -73,16 +132,23 @@ public:
    * the callback must be safe in that case.  Callback will be called
    * with no locks held.  cancel_reservation must be called to release the
    * reservation slot.
+   *
+   * If on_preempt is given, the reservation may be revoked after it is
+   * granted; on_preempt is then called with no locks held, and the slot
+   * is already free (cancel_reservation is harmless but not needed).
+   * Like on_reserved, it may be called following cancel_reservation.
    */
   void request_reservation(
     T item,                   ///< [in] reservation key
     Context *on_reserved,     ///< [in] callback to be called on reservation
-    unsigned prio
+    unsigned prio,
+    Context *on_preempt = NULL ///< [in] callback if preempted, or NULL
     ) {
     Mutex::Locker l(lock);
     assert(!queue_pointers.count(item) &&
 	   !in_progress.count(item));
-    queues[prio].push_back(make_pair(item, on_reserved));
+    queues[prio].push_back(Reservation(item, prio, on_reserved, on_preempt,
+				       ceph_clock_now(NULL)));
     queue_pointers.insert(make_pair(item, make_pair(prio,--(queues[prio]).end())));
     do_queues();
   }
@@ -100,11 +166,19 @@ public:
     Mutex::Locker l(lock);
     if (queue_pointers.count(item)) {
       unsigned prio = queue_pointers[item].first;
-      delete queue_pointers[item].second->second;
+      delete queue_pointers[item].second->grant;
+      delete queue_pointers[item].second->preempt;
       queues[prio].erase(queue_pointers[item].second);
       queue_pointers.erase(item);
     } else {
-      in_progress.erase(item);
+      typename map<T, Reservation>::iterator p = in_progress.find(item);
+      if (p != in_progress.end()) {
+	if (p->second.preempt) {
+	  preempt_by_prio.erase(make_pair(p->second.prio, item));
+	  delete p->second.preempt;
+	}
+	in_progress.erase(p);
+      }
     }
     do_queues();
   }
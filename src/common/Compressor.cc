@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <snappy-c.h>
+#include <zlib.h>
+
+#include "common/Compressor.h"
+
+class SnappyCompressor : public Compressor {
+public:
+  int get_type() const { return COMP_ALG_SNAPPY; }
+  const char *get_type_name() const { return "snappy"; }
+
+  int compress(const bufferlist &in, bufferlist &out) {
+    // snappy wants contiguous input
+    bufferlist src(in);
+    size_t len = snappy_max_compressed_length(src.length());
+    bufferptr bp = buffer::create(len);
+    if (snappy_compress(src.c_str(), src.length(), bp.c_str(), &len) != SNAPPY_OK)
+      return -EIO;
+    bp.set_length(len);
+    out.append(bp);
+    return 0;
+  }
+
+  int decompress(const bufferlist &in, bufferlist &out) {
+    bufferlist src(in);
+    size_t len;
+    if (snappy_uncompressed_length(src.c_str(), src.length(), &len) != SNAPPY_OK)
+      return -EINVAL;
+    bufferptr bp = buffer::create_page_aligned(len);
+    if (snappy_uncompress(src.c_str(), src.length(), bp.c_str(), &len) != SNAPPY_OK)
+      return -EINVAL;
+    bp.set_length(len);
+    out.append(bp);
+    return 0;
+  }
+};
+
+class ZlibCompressor : public Compressor {
+  // output is produced in chunks of this size when we can't bound it
+  static const unsigned CHUNK = 64 << 10;
+
+public:
+  int get_type() const { return COMP_ALG_ZLIB; }
+  const char *get_type_name() const { return "zlib"; }
+
+  int compress(const bufferlist &in, bufferlist &out) {
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    // favour speed; we are usually racing the network
+    if (deflateInit(&s, Z_BEST_SPEED) != Z_OK)
+      return -EIO;
+    bufferptr bp = buffer::create(deflateBound(&s, in.length()));
+    s.next_out = (Bytef*)bp.c_str();
+    s.avail_out = bp.length();
+
+    int r = Z_OK;
+    unsigned left = in.buffers().size();
+    for (std::list<bufferptr>::const_iterator p = in.buffers().begin();
+	 p != in.buffers().end();
+	 ++p) {
+      s.next_in = (Bytef*)p->c_str();
+      s.avail_in = p->length();
+      r = deflate(&s, --left ? Z_NO_FLUSH : Z_FINISH);
+      if (r == Z_STREAM_ERROR)
+	break;
+    }
+    if (in.buffers().empty())
+      r = deflate(&s, Z_FINISH);
+    unsigned len = bp.length() - s.avail_out;
+    deflateEnd(&s);
+    if (r != Z_STREAM_END)
+      return -EIO;
+    bp.set_length(len);
+    out.append(bp);
+    return 0;
+  }
+
+  int decompress(const bufferlist &in, bufferlist &out) {
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    if (inflateInit(&s) != Z_OK)
+      return -EIO;
+
+    int r = Z_OK;
+    for (std::list<bufferptr>::const_iterator p = in.buffers().begin();
+	 p != in.buffers().end() && r != Z_STREAM_END;
+	 ++p) {
+      if (!p->length())
+	continue;
+      s.next_in = (Bytef*)p->c_str();
+      s.avail_in = p->length();
+      // a full output chunk may leave more pending, even with no input left
+      do {
+	bufferptr bp = buffer::create_page_aligned(CHUNK);
+	s.next_out = (Bytef*)bp.c_str();
+	s.avail_out = bp.length();
+	r = inflate(&s, Z_NO_FLUSH);
+	if (r == Z_BUF_ERROR)
+	  r = Z_OK;  // no progress possible until we feed more input
+	if (r != Z_OK && r != Z_STREAM_END) {
+	  inflateEnd(&s);
+	  return -EINVAL;
+	}
+	bp.set_length(bp.length() - s.avail_out);
+	out.append(bp);
+      } while (s.avail_out == 0 && r != Z_STREAM_END);
+    }
+    inflateEnd(&s);
+    if (r != Z_STREAM_END)
+      return -EINVAL;
+    return 0;
+  }
+};
+
+static SnappyCompressor snappy_compressor;
+static ZlibCompressor zlib_compressor;
+
+Compressor *Compressor::get(int type)
+{
+  switch (type) {
+  case COMP_ALG_SNAPPY:
+    return &snappy_compressor;
+  case COMP_ALG_ZLIB:
+    return &zlib_compressor;
+  default:
+    return NULL;
+  }
+}
+
+Compressor *Compressor::get(const std::string &name)
+{
+  if (name == snappy_compressor.get_type_name())
+    return &snappy_compressor;
+  if (name == zlib_compressor.get_type_name())
+    return &zlib_compressor;
+  return NULL;
+}
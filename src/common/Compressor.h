@@ -0,0 +1,62 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMPRESSOR_H
+#define CEPH_COMPRESSOR_H
+
+#include <string>
+#include "include/buffer.h"
+
+/**
+ * A lossless compression algorithm operating on bufferlists.
+ *
+ * Implementations are stateless; one shared instance per algorithm is
+ * handed out by get().  The type ids go on the wire and must never be
+ * renumbered.
+ */
+class Compressor {
+public:
+  enum {
+    COMP_ALG_NONE = 0,
+    COMP_ALG_SNAPPY = 1,
+    COMP_ALG_ZLIB = 2,
+  };
+
+  virtual ~Compressor() {}
+
+  virtual int get_type() const = 0;
+  virtual const char *get_type_name() const = 0;
+
+  /**
+   * Compress a buffer.
+   *
+   * @param in The data to compress
+   * @param out [out] The compressed data is appended here
+   * @return 0 on success, negative error code on failure
+   */
+  virtual int compress(const bufferlist &in, bufferlist &out) = 0;
+  /**
+   * Undo compress().
+   *
+   * @param in The compressed data
+   * @param out [out] The original data is appended here
+   * @return 0 on success, negative error code if in is corrupt
+   */
+  virtual int decompress(const bufferlist &in, bufferlist &out) = 0;
+
+  /// look up an algorithm by type id; NULL if unknown or COMP_ALG_NONE
+  static Compressor *get(int type);
+  /// look up an algorithm by name; NULL if unknown or "none"
+  static Compressor *get(const std::string &name);
+};
+
+#endif
@@ -45,10 +45,17 @@ void *Finisher::finisher_thread_entry()
       list<pair<Context*,int> > ls_rval;
       ls.swap(finisher_queue);
       ls_rval.swap(finisher_queue_rval);
+      utime_t start = finisher_queue_start;
+      finisher_queue_start = utime_t();
       finisher_running = true;
       finisher_lock.Unlock();
       ldout(cct, 10) << "finisher_thread doing " << ls << dendl;
 
+      if (logger) {
+	utime_t now = ceph_clock_now(cct);
+	logger->tinc(l_finisher_queue_wait, now - start);
+	start = now;
+      }
       for (vector<Context*>::iterator p = ls.begin();
 	   p != ls.end();
 	   ++p) {
@@ -60,8 +67,12 @@ void *Finisher::finisher_thread_entry()
 	  c->complete(ls_rval.front().second);
 	  ls_rval.pop_front();
 	}
-	if (logger)
+	if (logger) {
 	  logger->dec(l_finisher_queue_len);
+	  utime_t now = ceph_clock_now(cct);
+	  logger->tinc(l_finisher_complete, now - start);
+	  start = now;
+	}
       }
       ldout(cct, 10) << "finisher_thread done with " << ls << dendl;
       ls.clear();
@@ -15,10 +15,13 @@
 #ifndef CEPH_FINISHER_H
 #define CEPH_FINISHER_H
 
+#include <sstream>
+
 #include "include/atomic.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
+#include "common/Clock.h"
 #include "common/perf_counters.h"
 
 class CephContext;
@@ -26,6 +29,8 @@ class CephContext;
 enum {
   l_finisher_first = 997082,
   l_finisher_queue_len,
+  l_finisher_queue_wait,
+  l_finisher_complete,
   l_finisher_last
 };
 
@@ -36,7 +41,13 @@ class Finisher {
   bool           finisher_stop, finisher_running;
   vector<Context*> finisher_queue;
   list<pair<Context*,int> > finisher_queue_rval;
+  utime_t        finisher_queue_start;  ///< when the oldest queued item came in
   PerfCounters *logger;
+
+  void _note_queued() {
+    if (logger && finisher_queue_start == utime_t() && !finisher_queue.empty())
+      finisher_queue_start = ceph_clock_now(cct);
+  }
   
   void *finisher_thread_entry();
 
@@ -54,6 +65,7 @@ class Finisher {
       finisher_queue.push_back(NULL);
     } else
       finisher_queue.push_back(c);
+    _note_queued();
     finisher_cond.Signal();
     finisher_lock.Unlock();
     if (logger)
@@ -62,6 +74,7 @@ class Finisher {
   void queue(vector<Context*>& ls) {
     finisher_lock.Lock();
     finisher_queue.insert(finisher_queue.end(), ls.begin(), ls.end());
+    _note_queued();
     finisher_cond.Signal();
     finisher_lock.Unlock();
     ls.clear();
@@ -71,6 +84,7 @@ class Finisher {
   void queue(deque<Context*>& ls) {
     finisher_lock.Lock();
     finisher_queue.insert(finisher_queue.end(), ls.begin(), ls.end());
+    _note_queued();
     finisher_cond.Signal();
     finisher_lock.Unlock();
     ls.clear();
@@ -96,6 +110,8 @@ class Finisher {
     PerfCountersBuilder b(cct, string("finisher-") + name,
 			  l_finisher_first, l_finisher_last);
     b.add_time_avg(l_finisher_queue_len, "queue_len");
+    b.add_time_avg(l_finisher_queue_wait, "queue_wait");  // oldest item of each batch
+    b.add_time_avg(l_finisher_complete, "complete");  // running each item
     logger = b.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
     logger->set(l_finisher_queue_len, 0);
@@ -109,6 +125,58 @@ class Finisher {
   }
 };
 
+/**
+ * A set of finishers, one thread each.  Completions queued with the
+ * same key run in the order queued, on the same thread; those with
+ * different keys (say, different pgs or sequencers) can run in
+ * parallel.
+ */
+class ShardedFinisher {
+  vector<Finisher*> finishers;
+
+public:
+  ShardedFinisher(CephContext *cct, string name, int n) {
+    if (n < 1)
+      n = 1;
+    for (int i = 0; i < n; ++i) {
+      if (name.length()) {
+	ostringstream ss;
+	ss << name << "-" << i;
+	finishers.push_back(new Finisher(cct, ss.str()));
+      } else {
+	finishers.push_back(new Finisher(cct));
+      }
+    }
+  }
+  ~ShardedFinisher() {
+    for (unsigned i = 0; i < finishers.size(); ++i)
+      delete finishers[i];
+  }
+
+  unsigned get_num_shards() const {
+    return finishers.size();
+  }
+  Finisher *get_shard(uint64_t key) {
+    return finishers[key % finishers.size()];
+  }
+  void queue(uint64_t key, Context *c, int r = 0) {
+    get_shard(key)->queue(c, r);
+  }
+
+  void start() {
+    for (unsigned i = 0; i < finishers.size(); ++i)
+      finishers[i]->start();
+  }
+  void stop() {
+    for (unsigned i = 0; i < finishers.size(); ++i)
+      finishers[i]->stop();
+  }
+  void wait_for_empty() {
+    for (unsigned i = 0; i < finishers.size(); ++i)
+      finishers[i]->wait_for_empty();
+  }
+};
+
 class C_OnFinisher : public Context {
   Context *con;
   Finisher *fin;
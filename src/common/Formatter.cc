@@ -55,6 +55,7 @@ FormatterAttrs::FormatterAttrs(const char *attr, ...)
 }
 
 Formatter::Formatter()
+  : m_sink(NULL), m_sink_threshold(0)
 {
 }
 
@@ -62,6 +63,19 @@ Formatter::~Formatter()
 {
 }
 
+void Formatter::maybe_flush_to_sink(std::stringstream& ss)
+{
+  if (!m_sink)
+    return;
+  std::streampos len = ss.tellp();
+  if (len <= 0 || (size_t)len < m_sink_threshold)
+    return;
+  std::string s = ss.str();
+  m_sink->write_formatted(s.data(), s.size());
+  ss.clear();
+  ss.str("");
+}
+
 Formatter *
 new_formatter(const std::string type)
 {
@@ -200,6 +214,7 @@ void JSONFormatter::close_section()
   struct json_formatter_stack_entry_d& entry = m_stack.back();
   m_ss << (entry.is_array ? ']' : '}');
   m_stack.pop_back();
+  maybe_flush_to_sink(m_ss);
 }
 
 void JSONFormatter::finish_pending_string()
@@ -345,6 +360,7 @@ void XMLFormatter::close_section()
   m_ss << "</" << section << ">";
   if (m_pretty)
     m_ss << "\n";
+  maybe_flush_to_sink(m_ss);
 }
 
 void XMLFormatter::dump_unsigned(const char *name, uint64_t u)
@@ -22,11 +22,28 @@ struct FormatterAttrs {
   FormatterAttrs(const char *attr, ...);
 };
 
+class FormatterSink {
+ public:
+  virtual ~FormatterSink() {}
+  virtual void write_formatted(const char *data, size_t len) = 0;
+};
+
 class Formatter {
  public:
   Formatter();
   virtual ~Formatter();
 
+  /**
+   * Pass output to sink as each section closes once more than threshold
+   * bytes are buffered, instead of holding all of it until flush().
+   * get_len() then only counts what is still buffered.  A NULL sink
+   * turns this off.
+   */
+  void set_sink(FormatterSink *sink, size_t threshold) {
+    m_sink = sink;
+    m_sink_threshold = threshold;
+  }
+
   virtual void flush(std::ostream& os) = 0;
   void flush(bufferlist &bl) {
     std::stringstream os;
@@ -63,6 +80,12 @@ class Formatter {
   virtual void dump_string_with_attrs(const char *name, std::string s, const FormatterAttrs& attrs) {
     dump_string(name, s);
   }
+
+ protected:
+  void maybe_flush_to_sink(std::stringstream& ss);
+
+  FormatterSink *m_sink;
+  size_t m_sink_threshold;
 };
 
 Formatter *new_formatter(const std::string type);
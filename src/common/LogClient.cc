@@ -42,7 +42,9 @@
 LogClient::LogClient(CephContext *cct, Messenger *m, MonMap *mm,
 		     enum logclient_flag_t flags)
   : cct(cct), messenger(m), monmap(mm), is_mon(flags & FLAG_MON),
-    log_lock("LogClient::log_lock"), last_log_sent(0), last_log(0)
+    log_lock("LogClient::log_lock"), last_log_sent(0), last_log(0),
+    last_type(CLOG_DEBUG), num_repeated(0),
+    rate_tokens(cct->_conf->clog_rate_burst), num_suppressed(0)
 {
 }
 
@@ -73,13 +75,69 @@ void LogClient::do_log(clog_type type, std::stringstream& ss)
   }
 }
 
+/*
+ * When something goes wrong, every daemon tends to say so over and over
+ * at once, and each line costs the monitors a paxos update.  So the
+ * same line is sent at most once per clog_dedup_interval, followed by
+ * how many times it was repeated, and below CLOG_ERROR we send no more
+ * than clog_rate_limit lines a second (with bursts of clog_rate_burst),
+ * followed by how many we dropped.
+ */
 void LogClient::do_log(clog_type type, const std::string& s)
 {
   Mutex::Locker l(log_lock);
   ldout(cct,0) << "log " << type << " : " << s << dendl;
+  utime_t now = ceph_clock_now(cct);
+
+  if (type == last_type && s == last_msg &&
+      (double)(now - last_stamp) < cct->_conf->clog_dedup_interval) {
+    num_repeated++;
+    return;
+  }
+  if (num_repeated) {
+    ostringstream ss;
+    ss << "last message repeated " << num_repeated << " times";
+    _log(last_type, ss.str(), now);
+    num_repeated = 0;
+  }
+
+  if (!_rate_allow(type, now)) {
+    num_suppressed++;
+    return;
+  }
+  if (num_suppressed) {
+    ostringstream ss;
+    ss << num_suppressed << " log entries suppressed by clog_rate_limit";
+    _log(CLOG_WARN, ss.str(), now);
+    num_suppressed = 0;
+  }
+
+  last_type = type;
+  last_msg = s;
+  last_stamp = now;
+  _log(type, s, now);
+}
+
+bool LogClient::_rate_allow(clog_type type, utime_t now)
+{
+  double rate = cct->_conf->clog_rate_limit;
+  if (rate <= 0 || type == CLOG_SEC || type >= CLOG_ERROR)
+    return true;
+  double burst = MAX(cct->_conf->clog_rate_burst, 1);
+  rate_tokens = MIN(burst, rate_tokens + (double)(now - rate_stamp) * rate);
+  rate_stamp = now;
+  if (rate_tokens < 1)
+    return false;
+  rate_tokens -= 1;
+  return true;
+}
+
+void LogClient::_log(clog_type type, const std::string& s, utime_t stamp)
+{
+  assert(log_lock.is_locked());
   LogEntry e;
   e.who = messenger->get_myinst();
-  e.stamp = ceph_clock_now(cct);
+  e.stamp = stamp;
   e.seq = ++last_log;
   e.type = type;
   e.msg = s;
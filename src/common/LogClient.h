@@ -99,6 +99,8 @@ public:
 private:
   void do_log(clog_type type, std::stringstream& ss);
   void do_log(clog_type type, const std::string& s);
+  void _log(clog_type type, const std::string& s, utime_t stamp);
+  bool _rate_allow(clog_type type, utime_t now);
   Message *_get_mon_log_message();
 
   CephContext *cct;
@@ -110,6 +112,17 @@ private:
   version_t last_log;
   std::deque<LogEntry> log_queue;
 
+  // the last line we sent, and how often it came again since; see do_log()
+  clog_type last_type;
+  std::string last_msg;
+  utime_t last_stamp;
+  unsigned num_repeated;
+
+  // token bucket for clog_rate_limit
+  double rate_tokens;
+  utime_t rate_stamp;
+  unsigned num_suppressed;
+
   friend class LogClientTemp;
 };
 
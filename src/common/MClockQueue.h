@@ -0,0 +1,396 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MCLOCK_QUEUE_H
+#define MCLOCK_QUEUE_H
+
+#include "common/Formatter.h"
+#include "include/utime.h"
+
+#include <map>
+#include <utility>
+#include <list>
+#include <algorithm>
+
+/**
+ * Queue that shares service between classes of items by reservation,
+ * weight and limit, after mClock (Gulati et al, OSDI 2010).
+ *
+ * Each class has
+ *  - a reservation: items per second it gets regardless of the others,
+ *  - a weight: its share of what is left once reservations are met,
+ *  - a limit: items per second above which it only runs if no other
+ *    class is eligible (0 for none).
+ * Items of unknown classes get weight 1 and neither of the others.
+ *
+ * dequeue() first serves the class furthest behind its reservation,
+ * if any is; otherwise the class with the lowest weight tag among those
+ * under their limit.  Weight tags start from the lowest tag of the busy
+ * classes when a class becomes busy, so an idle class does not build up
+ * credit.  Every item counts the same, whatever its cost.
+ *
+ * enqueue_strict and enqueue_strict_front queue items into queues
+ * which are serviced in strict priority order before all others, as
+ * with PrioritizedQueue.
+ *
+ * Within a class (or strict priority), we schedule round robin based on
+ * the key of type K used to enqueue items.
+ */
+template <typename T, typename K>
+class MClockQueue {
+public:
+  struct ClassInfo {
+    double reservation;
+    double weight;
+    double limit;
+    ClassInfo(double r = 0, double w = 1, double l = 0)
+      : reservation(r), weight(w), limit(l) {}
+  };
+
+private:
+  template <class F>
+  static unsigned filter_list(list<T> *l, F f, list<T> *out) {
+    unsigned ret = 0;
+    if (out) {
+      for (typename list<T>::reverse_iterator i = l->rbegin();
+	   i != l->rend();
+	   ++i) {
+	if (f(*i)) {
+	  out->push_front(*i);
+	}
+      }
+    }
+    for (typename list<T>::iterator i = l->begin(); i != l->end(); ) {
+      if (f(*i)) {
+	l->erase(i++);
+	++ret;
+      } else {
+	++i;
+      }
+    }
+    return ret;
+  }
+
+  /// items of one class or strict priority, round robin by K
+  struct SubQueue {
+  private:
+    map<K, list<T> > q;
+    int64_t size;
+    typename map<K, list<T> >::iterator cur;
+  public:
+    SubQueue(const SubQueue &other)
+      : q(other.q), size(other.size), cur(q.begin()) {}
+    SubQueue() : size(0), cur(q.begin()) {}
+    void enqueue(K cl, T item) {
+      q[cl].push_back(item);
+      if (cur == q.end())
+	cur = q.begin();
+      size++;
+    }
+    void enqueue_front(K cl, T item) {
+      q[cl].push_front(item);
+      if (cur == q.end())
+	cur = q.begin();
+      size++;
+    }
+    T front() const {
+      assert(!(q.empty()));
+      assert(cur != q.end());
+      return cur->second.front();
+    }
+    void pop_front() {
+      assert(!(q.empty()));
+      assert(cur != q.end());
+      cur->second.pop_front();
+      if (cur->second.empty())
+	q.erase(cur++);
+      else
+	++cur;
+      if (cur == q.end())
+	cur = q.begin();
+      size--;
+    }
+    unsigned length() const {
+      assert(size >= 0);
+      return (unsigned)size;
+    }
+    bool empty() const {
+      return q.empty();
+    }
+    template <class F>
+    void remove_by_filter(F f, list<T> *out) {
+      for (typename map<K, list<T> >::iterator i = q.begin();
+	   i != q.end();
+	   ) {
+	size -= filter_list(&(i->second), f, out);
+	if (i->second.empty()) {
+	  if (cur == i)
+	    ++cur;
+	  q.erase(i++);
+	} else {
+	  ++i;
+	}
+      }
+      if (cur == q.end())
+	cur = q.begin();
+    }
+    void remove_by_class(K k, list<T> *out) {
+      typename map<K, list<T> >::iterator i = q.find(k);
+      if (i == q.end())
+	return;
+      size -= i->second.size();
+      if (i == cur) {
+	++cur;
+	if (cur == q.end())
+	  cur = q.begin();
+      }
+      if (out) {
+	for (typename list<T>::reverse_iterator j = i->second.rbegin();
+	     j != i->second.rend();
+	     ++j) {
+	  out->push_front(*j);
+	}
+      }
+      q.erase(i);
+    }
+    void dump(Formatter *f) const {
+      f->dump_int("size", size);
+      f->dump_int("num_keys", q.size());
+    }
+  };
+
+  /// a class, with the tags of the next item to go
+  struct ClassQueue {
+    ClassInfo info;
+    double r_tag, p_tag, l_tag;
+    SubQueue q;
+    ClassQueue() : r_tag(0), p_tag(0), l_tag(0) {}
+  };
+
+  map<unsigned, SubQueue> high_queue;
+  map<unsigned, ClassInfo> class_info;
+  map<unsigned, ClassQueue> classes;  // those we have seen; tags persist
+
+  static double next_tag(double prev, double rate) {
+    return rate > 0 ? prev + 1.0 / rate : 0;
+  }
+
+  ClassQueue *get_class(unsigned op_class) {
+    typename map<unsigned, ClassQueue>::iterator p = classes.find(op_class);
+    if (p != classes.end())
+      return &p->second;
+    ClassQueue *cq = &classes[op_class];
+    typename map<unsigned, ClassInfo>::iterator i = class_info.find(op_class);
+    if (i != class_info.end())
+      cq->info = i->second;
+    return cq;
+  }
+
+  /// an idle class is becoming busy: don't let it make up for lost time
+  void activate(ClassQueue *cq, double now) {
+    double min_p = now;
+    bool any = false;
+    for (typename map<unsigned, ClassQueue>::iterator i = classes.begin();
+	 i != classes.end();
+	 ++i) {
+      if (i->second.q.empty() || &i->second == cq)
+	continue;
+      if (!any || i->second.p_tag < min_p)
+	min_p = i->second.p_tag;
+      any = true;
+    }
+    cq->r_tag = std::max(cq->r_tag, now);
+    cq->p_tag = std::max(cq->p_tag, min_p);
+    cq->l_tag = std::max(cq->l_tag, now);
+  }
+
+  T pop(ClassQueue *cq, bool reserved) {
+    T ret = cq->q.front();
+    cq->q.pop_front();
+    cq->r_tag = next_tag(cq->r_tag, cq->info.reservation);
+    if (!reserved)
+      cq->p_tag = next_tag(cq->p_tag, cq->info.weight);
+    cq->l_tag = next_tag(cq->l_tag, cq->info.limit);
+    return ret;
+  }
+
+public:
+  MClockQueue() {}
+
+  /// applies to items enqueued from now on, and to classes not yet seen
+  void set_class_info(unsigned op_class, const ClassInfo& info) {
+    class_info[op_class] = info;
+    typename map<unsigned, ClassQueue>::iterator p = classes.find(op_class);
+    if (p != classes.end())
+      p->second.info = info;
+  }
+
+  unsigned length() {
+    unsigned total = 0;
+    for (typename map<unsigned, ClassQueue>::iterator i = classes.begin();
+	 i != classes.end();
+	 ++i)
+      total += i->second.q.length();
+    for (typename map<unsigned, SubQueue>::iterator i = high_queue.begin();
+	 i != high_queue.end();
+	 ++i) {
+      assert(i->second.length());
+      total += i->second.length();
+    }
+    return total;
+  }
+
+  template <class F>
+  void remove_by_filter(F f, list<T> *removed = 0) {
+    for (typename map<unsigned, ClassQueue>::iterator i = classes.begin();
+	 i != classes.end();
+	 ++i)
+      i->second.q.remove_by_filter(f, removed);
+    for (typename map<unsigned, SubQueue>::iterator i = high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      i->second.remove_by_filter(f, removed);
+      if (i->second.empty()) {
+	high_queue.erase(i++);
+      } else {
+	++i;
+      }
+    }
+  }
+
+  void remove_by_class(K k, list<T> *out = 0) {
+    for (typename map<unsigned, ClassQueue>::iterator i = classes.begin();
+	 i != classes.end();
+	 ++i)
+      i->second.q.remove_by_class(k, out);
+    for (typename map<unsigned, SubQueue>::iterator i = high_queue.begin();
+	 i != high_queue.end();
+	 ) {
+      i->second.remove_by_class(k, out);
+      if (i->second.empty()) {
+	high_queue.erase(i++);
+      } else {
+	++i;
+      }
+    }
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) {
+    high_queue[priority].enqueue(cl, item);
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) {
+    high_queue[priority].enqueue_front(cl, item);
+  }
+
+  void enqueue(K cl, unsigned op_class, T item, utime_t now) {
+    ClassQueue *cq = get_class(op_class);
+    if (cq->q.empty())
+      activate(cq, now);
+    cq->q.enqueue(cl, item);
+  }
+
+  void enqueue_front(K cl, unsigned op_class, T item, utime_t now) {
+    ClassQueue *cq = get_class(op_class);
+    if (cq->q.empty())
+      activate(cq, now);
+    cq->q.enqueue_front(cl, item);
+  }
+
+  bool empty() {
+    if (!high_queue.empty())
+      return false;
+    for (typename map<unsigned, ClassQueue>::iterator i = classes.begin();
+	 i != classes.end();
+	 ++i)
+      if (!i->second.q.empty())
+	return false;
+    return true;
+  }
+
+  T dequeue(utime_t now_t) {
+    assert(!empty());
+
+    if (!(high_queue.empty())) {
+      T ret = high_queue.rbegin()->second.front();
+      high_queue.rbegin()->second.pop_front();
+      if (high_queue.rbegin()->second.empty())
+	high_queue.erase(high_queue.rbegin()->first);
+      return ret;
+    }
+
+    double now = now_t;
+    ClassQueue *reserved = NULL, *weighted = NULL, *limited = NULL;
+    for (typename map<unsigned, ClassQueue>::iterator i = classes.begin();
+	 i != classes.end();
+	 ++i) {
+      ClassQueue *cq = &i->second;
+      if (cq->q.empty())
+	continue;
+      if (cq->info.reservation > 0 && cq->r_tag <= now &&
+	  (!reserved || cq->r_tag < reserved->r_tag))
+	reserved = cq;
+      if (cq->info.limit > 0 && cq->l_tag > now) {
+	if (!limited || cq->l_tag < limited->l_tag)
+	  limited = cq;
+      } else if (!weighted || cq->p_tag < weighted->p_tag) {
+	weighted = cq;
+      }
+    }
+
+    // behind on a reservation?
+    if (reserved)
+      return pop(reserved, true);
+
+    // share by weight among those under their limit
+    if (weighted)
+      return pop(weighted, false);
+
+    // everyone is over their limit; rather than idle, serve whoever
+    // gets under it first
+    assert(limited);
+    return pop(limited, false);
+  }
+
+  void dump(Formatter *f) const {
+    f->open_array_section("high_queues");
+    for (typename map<unsigned, SubQueue>::const_iterator p = high_queue.begin();
+	 p != high_queue.end();
+	 ++p) {
+      f->open_object_section("subqueue");
+      f->dump_int("priority", p->first);
+      p->second.dump(f);
+      f->close_section();
+    }
+    f->close_section();
+    f->open_array_section("classes");
+    for (typename map<unsigned, ClassQueue>::const_iterator p = classes.begin();
+	 p != classes.end();
+	 ++p) {
+      f->open_object_section("class");
+      f->dump_int("class", p->first);
+      f->dump_float("reservation", p->second.info.reservation);
+      f->dump_float("weight", p->second.info.weight);
+      f->dump_float("limit", p->second.info.limit);
+      f->dump_float("r_tag", p->second.r_tag);
+      f->dump_float("p_tag", p->second.p_tag);
+      f->dump_float("l_tag", p->second.l_tag);
+      p->second.q.dump(f);
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
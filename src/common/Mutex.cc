@@ -19,12 +19,75 @@
 #include "common/config.h"
 #include "include/utime.h"
 #include "common/Clock.h"
+#include "common/Formatter.h"
+#include "common/histogram.h"
+#include "common/simple_spin.h"
+
+int g_mutex_spin_max = 0;
+bool g_mutex_profile = false;
+
+struct mutex_stats_t {
+  simple_spinlock_t lock;
+  uint64_t contended;    // Lock() calls that found it taken
+  uint64_t spun;         // ... and got it while spinning
+  utime_t total_wait, max_wait;
+  pow2_hist_t wait_us;   // log2 histogram of wait in usec
+
+  mutex_stats_t() : lock(SIMPLE_SPINLOCK_INITIALIZER), contended(0), spun(0) {}
+};
+
+// entries live as long as the process, like lockdep's lock names
+static pthread_mutex_t mutex_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static map<string, mutex_stats_t*> mutex_stats;
+
+static mutex_stats_t *mutex_stats_get(const char *name)
+{
+  pthread_mutex_lock(&mutex_stats_lock);
+  mutex_stats_t *&s = mutex_stats[name];
+  if (!s)
+    s = new mutex_stats_t;
+  pthread_mutex_unlock(&mutex_stats_lock);
+  return s;
+}
+
+void mutex_stats_dump(Formatter *f)
+{
+  f->dump_bool("enabled", g_mutex_profile);
+  f->open_array_section("locks");
+  pthread_mutex_lock(&mutex_stats_lock);
+  for (map<string, mutex_stats_t*>::iterator p = mutex_stats.begin();
+       p != mutex_stats.end();
+       ++p) {
+    mutex_stats_t *s = p->second;
+    simple_spin_lock(&s->lock);
+    f->open_object_section("lock");
+    f->dump_string("name", p->first);
+    f->dump_unsigned("contended", s->contended);
+    f->dump_unsigned("spun", s->spun);
+    f->dump_stream("total_wait") << s->total_wait;
+    f->dump_stream("max_wait") << s->max_wait;
+    f->open_object_section("wait_us");
+    s->wait_us.dump(f);
+    f->close_section();
+    f->close_section();
+    simple_spin_unlock(&s->lock);
+  }
+  pthread_mutex_unlock(&mutex_stats_lock);
+  f->close_section();
+}
+
+static inline void spin_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+  asm volatile("pause");
+#endif
+}
 
 Mutex::Mutex(const char *n, bool r, bool ld,
 	     bool bt,
 	     CephContext *cct) :
   name(n), id(-1), recursive(r), lockdep(ld), backtrace(bt),
-  nlock(0), locked_by(0), cct(cct), logger(0)
+  nlock(0), locked_by(0), cct(cct), logger(0), spins(0), stats(NULL)
 {
   if (cct) {
     PerfCountersBuilder b(cct, string("mutex-") + name,
@@ -83,14 +146,64 @@ void Mutex::Lock(bool no_lockdep) {
     return;
   }
 
+  bool perf = logger && cct && cct->_conf->mutex_perf_counter;
+  bool profile = g_mutex_profile;
   utime_t start;
-  if (logger && cct && cct->_conf->mutex_perf_counter)
+  if (perf || profile)
     start = ceph_clock_now(cct);
-  int r = pthread_mutex_lock(&_m);
-  if (logger && cct && cct->_conf->mutex_perf_counter)
-    logger->tinc(l_mutex_wait,
-		 ceph_clock_now(cct) - start);
-  assert(r == 0);
+
+  bool spun = g_mutex_spin_max > 0 && _spin();
+  if (!spun) {
+    int r = pthread_mutex_lock(&_m);
+    assert(r == 0);
+  }
+
+  if (perf || profile) {
+    utime_t wait = ceph_clock_now(cct) - start;
+    if (perf)
+      logger->tinc(l_mutex_wait, wait);
+    if (profile)
+      _note_wait(wait, spun);
+  }
   if (lockdep && g_lockdep) _locked();
   _post_lock();
 }
+
+/**
+ * Retry the lock for a while before going to sleep on it, for locks
+ * held over short critical sections, where a futex wait and wakeup
+ * costs more than the wait itself.  As with glibc's adaptive mutexes,
+ * spin about as long as it took to get the lock the last few times,
+ * up to g_mutex_spin_max tries.
+ */
+bool Mutex::_spin()
+{
+  int max = MIN(spins * 2 + 10, g_mutex_spin_max);
+  int n = 0;
+  bool got = false;
+  while (n++ < max) {
+    spin_relax();
+    if (pthread_mutex_trylock(&_m) == 0) {
+      got = true;
+      break;
+    }
+  }
+  spins += (n - spins) / 8;  // racy, but it is only a hint
+  return got;
+}
+
+void Mutex::_note_wait(utime_t wait, bool spun)
+{
+  if (!stats)
+    stats = mutex_stats_get(name);
+  uint64_t us = wait.to_nsec() / 1000;
+  simple_spin_lock(&stats->lock);
+  stats->contended++;
+  if (spun)
+    stats->spun++;
+  stats->total_wait += wait;
+  if (wait > stats->max_wait)
+    stats->max_wait = wait;
+  stats->wait_us.add(MIN(us, (uint64_t)INT_MAX));
+  simple_spin_unlock(&stats->lock);
+}
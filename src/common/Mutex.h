@@ -16,6 +16,7 @@
 #define CEPH_MUTEX_H
 
 #include "include/assert.h"
+#include "include/utime.h"
 #include "lockdep.h"
 #include "common/ceph_context.h"
 
@@ -24,6 +25,18 @@
 using namespace ceph;
 
 class PerfCounters;
+namespace ceph {
+  class Formatter;
+}
+struct mutex_stats_t;
+
+/// spin up to this many times before sleeping on a contended mutex
+extern int g_mutex_spin_max;
+/// record per-name wait times of contended mutexes
+extern bool g_mutex_profile;
+
+/// dump the wait times recorded while g_mutex_profile was set
+void mutex_stats_dump(Formatter *f);
 
 enum {
   l_mutex_first = 999082,
@@ -44,6 +57,8 @@ private:
   pthread_t locked_by;
   CephContext *cct;
   PerfCounters *logger;
+  int spins;              // running estimate of trylocks before we get it
+  mutex_stats_t *stats;   // shared by all mutexes of the same name
 
   // don't allow copying.
   void operator=(Mutex &M);
@@ -62,6 +77,9 @@ private:
     id = lockdep_will_unlock(name, id);
   }
 
+  bool _spin();
+  void _note_wait(utime_t wait, bool spun);
+
 public:
   Mutex(const char *n, bool r = false, bool ld=true, bool bt=false,
 	CephContext *cct = 0);
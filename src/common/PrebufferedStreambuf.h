@@ -37,6 +37,9 @@ public:
 
   /// return a string copy (inefficiently)
   std::string get_str() const;
+
+  /// forget what we hold, so we can be reused
+  void reset();
 };    
 
 #endif
@@ -17,6 +17,8 @@
 
 #include "common/Mutex.h"
 #include "common/Formatter.h"
+#include "include/unordered_map.h"
+#include "include/xlist.h"
 
 #include <map>
 #include <utility>
@@ -26,36 +28,44 @@
 /**
  * Manages queue for normal and strict priority items
  *
- * On dequeue, the queue will select the lowest priority queue
- * such that the q has bucket > cost of front queue item.
+ * Items queued with enqueue and enqueue_front are shared out by
+ * deficit round robin (DRR), by cost, at two levels:
  *
- * If there is no such queue, we choose the next queue item for
- * the highest priority queue.
+ *  - between priorities: each time a priority's turn comes up it gets
+ *    priority * min_cost of credit, and it sends items as long as its
+ *    credit covers their cost.  So over time each priority gets a
+ *    share of the total cost proportional to its priority.
+ *  - within a priority, between the classes of type K used to enqueue
+ *    items (e.g. entity_inst_t, for fairness between clients): each
+ *    class gets min_cost of credit per turn, so clients get the same
+ *    bytes, not the same number of ops.
  *
- * Before returning a dequeued item, we place into each bucket
- * cost * (priority/total_priority) tokens.
+ * Costs are clamped to [min_cost, max_tokens_per_subqueue], which
+ * bounds how many turns a large item may have to wait for.  Enqueue
+ * and dequeue are O(1) amortized, save for finding the priority (a map
+ * of the few priorities in use).
  *
  * enqueue_strict and enqueue_strict_front queue items into queues
  * which are serviced in strict priority order before items queued
- * with enqueue and enqueue_front
- *
- * Within a priority class, we schedule round robin based on the class
- * of type K used to enqueue items.  e.g. you could use entity_inst_t
- * to provide fairness for different clients.
+ * with enqueue and enqueue_front.  Within a strict priority, classes
+ * are served round robin, one item each.
  */
 template <typename T, typename K>
 class PrioritizedQueue {
   int64_t total_priority;
   int64_t max_tokens_per_subqueue;
   int64_t min_cost;
+  unsigned size;
+
+  typedef list<pair<unsigned, T> > ItemList;
 
   template <class F>
   static unsigned filter_list_pairs(
-    list<pair<unsigned, T> > *l, F f,
+    ItemList *l, F f,
     list<T> *out) {
     unsigned ret = 0;
     if (out) {
-      for (typename list<pair<unsigned, T> >::reverse_iterator i = l->rbegin();
+      for (typename ItemList::reverse_iterator i = l->rbegin();
 	   i != l->rend();
 	   ++i) {
 	if (f(i->second)) {
@@ -63,7 +73,7 @@ class PrioritizedQueue {
 	}
       }
     }
-    for (typename list<pair<unsigned, T> >::iterator i = l->begin();
+    for (typename ItemList::iterator i = l->begin();
 	 i != l->end();
       ) {
       if (f(i->second)) {
@@ -76,295 +86,299 @@ class PrioritizedQueue {
     return ret;
   }
 
+  /// the items of one class within a priority
+  struct Class {
+    K key;
+    ItemList items;
+    int64_t deficit;
+    typename xlist<Class*>::item rr_item;
+    Class(K k) : key(k), deficit(0), rr_item(this) {}
+  };
+
+  /// one priority: its classes, in round robin order
   struct SubQueue {
   private:
-    map<K, list<pair<unsigned, T> > > q;
-    unsigned tokens, max_tokens;
-    int64_t size;
-    typename map<K, list<pair<unsigned, T> > >::iterator cur;
-  public:
-    SubQueue(const SubQueue &other)
-      : q(other.q),
-	tokens(other.tokens),
-	max_tokens(other.max_tokens),
-	size(other.size),
-	cur(q.begin()) {}
-    SubQueue()
-      : tokens(0),
-	max_tokens(0),
-	size(0), cur(q.begin()) {}
-    void set_max_tokens(unsigned mt) {
-      max_tokens = mt;
-    }
-    unsigned get_max_tokens() const {
-      return max_tokens;
-    }
-    unsigned num_tokens() const {
-      return tokens;
+    typedef ceph::unordered_map<K, Class*> class_map_t;
+    class_map_t classes;
+    xlist<Class*> rr;
+    int64_t quantum;   // credit per turn of a class
+    unsigned size;
+
+    // don't allow copying.
+    SubQueue(const SubQueue &other);
+    void operator=(const SubQueue &other);
+
+    void remove_class(typename class_map_t::iterator i) {
+      i->second->rr_item.remove_myself();
+      delete i->second;
+      classes.erase(i);
     }
-    void put_tokens(unsigned t) {
-      tokens += t;
-      if (tokens > max_tokens)
-	tokens = max_tokens;
+
+  public:
+    unsigned priority;
+    int64_t deficit;   // our credit, among the other priorities
+    typename xlist<SubQueue*>::item rr_item;
+
+    SubQueue(unsigned p, int64_t q)
+      : quantum(q), size(0), priority(p), deficit(0), rr_item(this) {}
+    ~SubQueue() {
+      while (!classes.empty())
+	remove_class(classes.begin());
     }
-    void take_tokens(unsigned t) {
-      if (tokens > t)
-	tokens -= t;
+
+    void enqueue(K cl, unsigned cost, T item, bool front) {
+      Class *&c = classes[cl];
+      if (!c) {
+	c = new Class(cl);
+	rr.push_back(&c->rr_item);
+      }
+      if (front)
+	c->items.push_front(make_pair(cost, item));
       else
-	tokens = 0;
-    }
-    void enqueue(K cl, unsigned cost, T item) {
-      q[cl].push_back(make_pair(cost, item));
-      if (cur == q.end())
-	cur = q.begin();
-      size++;
-    }
-    void enqueue_front(K cl, unsigned cost, T item) {
-      q[cl].push_front(make_pair(cost, item));
-      if (cur == q.end())
-	cur = q.begin();
+	c->items.push_back(make_pair(cost, item));
       size++;
     }
-    pair<unsigned, T> front() const {
-      assert(!(q.empty()));
-      assert(cur != q.end());
-      return cur->second.front();
+
+    /// the class to serve next, if this priority gets to send
+    Class *next_class() {
+      while (true) {
+	Class *c = rr.front();
+	if (c->deficit >= (int64_t)c->items.front().first)
+	  return c;
+	c->deficit += quantum;
+	rr.push_back(&c->rr_item);
+      }
     }
-    void pop_front() {
-      assert(!(q.empty()));
-      assert(cur != q.end());
-      cur->second.pop_front();
-      if (cur->second.empty())
-	q.erase(cur++);
-      else
-	++cur;
-      if (cur == q.end())
-	cur = q.begin();
+
+    T pop(Class *c) {
+      unsigned cost = c->items.front().first;
+      T ret = c->items.front().second;
+      c->items.pop_front();
+      c->deficit -= cost;
       size--;
+      if (c->items.empty())
+	remove_class(classes.find(c->key));  // an idle class keeps no credit
+      return ret;
     }
+
     unsigned length() const {
-      assert(size >= 0);
-      return (unsigned)size;
+      return size;
     }
     bool empty() const {
-      return q.empty();
+      return size == 0;
     }
+
     template <class F>
-    void remove_by_filter(F f, list<T> *out) {
-      for (typename map<K, list<pair<unsigned, T> > >::iterator i = q.begin();
-	   i != q.end();
+    unsigned remove_by_filter(F f, list<T> *out) {
+      unsigned removed = 0;
+      for (typename class_map_t::iterator i = classes.begin();
+	   i != classes.end();
 	   ) {
-	size -= filter_list_pairs(&(i->second), f, out);
-	if (i->second.empty()) {
-	  if (cur == i)
-	    ++cur;
-	  q.erase(i++);
-	} else {
+	removed += filter_list_pairs(&i->second->items, f, out);
+	if (i->second->items.empty())
+	  remove_class(i++);
+	else
 	  ++i;
-	}
       }
-      if (cur == q.end())
-	cur = q.begin();
+      size -= removed;
+      return removed;
     }
-    void remove_by_class(K k, list<T> *out) {
-      typename map<K, list<pair<unsigned, T> > >::iterator i = q.find(k);
-      if (i == q.end())
-	return;
-      size -= i->second.size();
-      if (i == cur) {
-	++cur;
-	if (cur == q.end())
-	  cur = q.begin();
-      }
+    unsigned remove_by_class(K k, list<T> *out) {
+      typename class_map_t::iterator i = classes.find(k);
+      if (i == classes.end())
+	return 0;
+      unsigned removed = i->second->items.size();
       if (out) {
-	for (typename list<pair<unsigned, T> >::reverse_iterator j =
-	       i->second.rbegin();
-	     j != i->second.rend();
+	for (typename ItemList::reverse_iterator j =
+	       i->second->items.rbegin();
+	     j != i->second->items.rend();
 	     ++j) {
 	  out->push_front(j->second);
 	}
       }
-      q.erase(i);
+      remove_class(i);
+      size -= removed;
+      return removed;
     }
 
     void dump(Formatter *f) const {
-      f->dump_int("tokens", tokens);
-      f->dump_int("max_tokens", max_tokens);
+      f->dump_int("deficit", deficit);
       f->dump_int("size", size);
-      f->dump_int("num_keys", q.size());
+      f->dump_int("num_keys", classes.size());
     }
   };
-  map<unsigned, SubQueue> high_queue;
-  map<unsigned, SubQueue> queue;
+  map<unsigned, SubQueue*> high_queue;
+  map<unsigned, SubQueue*> queue;
+  xlist<SubQueue*> rr;   // the queues, in round robin order
+
+  int64_t clamp_cost(unsigned cost) const {
+    int64_t c = cost;
+    if (c < min_cost)
+      c = min_cost;
+    if (max_tokens_per_subqueue > 0 && c > max_tokens_per_subqueue)
+      c = max_tokens_per_subqueue;
+    return c;
+  }
 
   SubQueue *create_queue(unsigned priority) {
-    typename map<unsigned, SubQueue>::iterator p = queue.find(priority);
+    typename map<unsigned, SubQueue*>::iterator p = queue.find(priority);
     if (p != queue.end())
-      return &p->second;
+      return p->second;
     total_priority += priority;
-    SubQueue *sq = &queue[priority];
-    sq->set_max_tokens(max_tokens_per_subqueue);
+    SubQueue *sq = new SubQueue(priority, std::max<int64_t>(min_cost, 1));
+    queue[priority] = sq;
+    rr.push_back(&sq->rr_item);
     return sq;
   }
 
   void remove_queue(unsigned priority) {
-    assert(queue.count(priority));
-    queue.erase(priority);
+    typename map<unsigned, SubQueue*>::iterator p = queue.find(priority);
+    assert(p != queue.end());
+    p->second->rr_item.remove_myself();
+    delete p->second;
+    queue.erase(p);
     total_priority -= priority;
     assert(total_priority >= 0);
   }
 
-  void distribute_tokens(unsigned cost) {
-    if (total_priority == 0)
-      return;
-    for (typename map<unsigned, SubQueue>::iterator i = queue.begin();
-	 i != queue.end();
-	 ++i) {
-      i->second.put_tokens(((i->first * cost) / total_priority) + 1);
+  SubQueue *create_high_queue(unsigned priority) {
+    SubQueue *&sq = high_queue[priority];
+    if (!sq)
+      sq = new SubQueue(priority, 1);  // one item per turn
+    return sq;
+  }
+
+  template <class F>
+  void filter_queues(map<unsigned, SubQueue*> *m, bool normal, F f) {
+    for (typename map<unsigned, SubQueue*>::iterator i = m->begin();
+	 i != m->end();
+	 ) {
+      SubQueue *sq = i->second;
+      size -= f(sq);
+      if (sq->empty()) {
+	unsigned priority = i->first;
+	++i;
+	if (normal) {
+	  remove_queue(priority);
+	} else {
+	  delete sq;
+	  m->erase(priority);
+	}
+      } else {
+	++i;
+      }
     }
   }
 
+  template <class F>
+  struct FilterBy {
+    F f;
+    list<T> *out;
+    FilterBy(F f, list<T> *out) : f(f), out(out) {}
+    unsigned operator()(SubQueue *sq) {
+      return sq->remove_by_filter(f, out);
+    }
+  };
+  struct FilterClass {
+    K k;
+    list<T> *out;
+    FilterClass(K k, list<T> *out) : k(k), out(out) {}
+    unsigned operator()(SubQueue *sq) {
+      return sq->remove_by_class(k, out);
+    }
+  };
+
+  // don't allow copying.
+  PrioritizedQueue(const PrioritizedQueue &other);
+  void operator=(const PrioritizedQueue &other);
+
 public:
   PrioritizedQueue(unsigned max_per, unsigned min_c)
     : total_priority(0),
       max_tokens_per_subqueue(max_per),
-      min_cost(min_c)
+      min_cost(min_c),
+      size(0)
   {}
+  ~PrioritizedQueue() {
+    while (!queue.empty())
+      remove_queue(queue.begin()->first);
+    for (typename map<unsigned, SubQueue*>::iterator i = high_queue.begin();
+	 i != high_queue.end();
+	 ++i)
+      delete i->second;
+  }
 
   unsigned length() {
-    unsigned total = 0;
-    for (typename map<unsigned, SubQueue>::iterator i = queue.begin();
-	 i != queue.end();
-	 ++i) {
-      assert(i->second.length());
-      total += i->second.length();
-    }
-    for (typename map<unsigned, SubQueue>::iterator i = high_queue.begin();
-	 i != high_queue.end();
-	 ++i) {
-      assert(i->second.length());
-      total += i->second.length();
-    }
-    return total;
+    return size;
   }
 
   template <class F>
   void remove_by_filter(F f, list<T> *removed = 0) {
-    for (typename map<unsigned, SubQueue>::iterator i = queue.begin();
-	 i != queue.end();
-	 ) {
-      unsigned priority = i->first;
-      
-      i->second.remove_by_filter(f, removed);
-      if (i->second.empty()) {
-	++i;
-	remove_queue(priority);
-      } else {
-	++i;
-      }
-    }
-    for (typename map<unsigned, SubQueue>::iterator i = high_queue.begin();
-	 i != high_queue.end();
-	 ) {
-      i->second.remove_by_filter(f, removed);
-      if (i->second.empty()) {
-	high_queue.erase(i++);
-      } else {
-	++i;
-      }
-    }
+    filter_queues(&queue, true, FilterBy<F>(f, removed));
+    filter_queues(&high_queue, false, FilterBy<F>(f, removed));
   }
 
   void remove_by_class(K k, list<T> *out = 0) {
-    for (typename map<unsigned, SubQueue>::iterator i = queue.begin();
-	 i != queue.end();
-	 ) {
-      i->second.remove_by_class(k, out);
-      if (i->second.empty()) {
-	unsigned priority = i->first;
-	++i;
-	remove_queue(priority);
-      } else {
-	++i;
-      }
-    }
-    for (typename map<unsigned, SubQueue>::iterator i = high_queue.begin();
-	 i != high_queue.end();
-	 ) {
-      i->second.remove_by_class(k, out);
-      if (i->second.empty()) {
-	high_queue.erase(i++);
-      } else {
-	++i;
-      }
-    }
+    filter_queues(&queue, true, FilterClass(k, out));
+    filter_queues(&high_queue, false, FilterClass(k, out));
   }
 
   void enqueue_strict(K cl, unsigned priority, T item) {
-    high_queue[priority].enqueue(cl, 0, item);
+    create_high_queue(priority)->enqueue(cl, 1, item, false);
+    size++;
   }
 
   void enqueue_strict_front(K cl, unsigned priority, T item) {
-    high_queue[priority].enqueue_front(cl, 0, item);
+    create_high_queue(priority)->enqueue(cl, 1, item, true);
+    size++;
   }
 
   void enqueue(K cl, unsigned priority, unsigned cost, T item) {
-    if (cost < min_cost)
-      cost = min_cost;
-    create_queue(priority)->enqueue(cl, cost, item);
+    create_queue(priority)->enqueue(cl, clamp_cost(cost), item, false);
+    size++;
   }
 
   void enqueue_front(K cl, unsigned priority, unsigned cost, T item) {
-    if (cost < min_cost)
-      cost = min_cost;
-    create_queue(priority)->enqueue_front(cl, cost, item);
+    create_queue(priority)->enqueue(cl, clamp_cost(cost), item, true);
+    size++;
   }
 
   bool empty() {
     assert(total_priority >= 0);
     assert((total_priority == 0) || !(queue.empty()));
-    return queue.empty() && high_queue.empty();
+    return size == 0;
   }
 
   T dequeue() {
     assert(!empty());
+    size--;
 
     if (!(high_queue.empty())) {
-      T ret = high_queue.rbegin()->second.front().second;
-      high_queue.rbegin()->second.pop_front();
-      if (high_queue.rbegin()->second.empty())
+      SubQueue *sq = high_queue.rbegin()->second;
+      T ret = sq->pop(sq->next_class());
+      if (sq->empty()) {
+	delete sq;
 	high_queue.erase(high_queue.rbegin()->first);
+      }
       return ret;
     }
 
-    // if there are multiple buckets/subqueues with sufficient tokens,
-    // we behave like a strict priority queue among all subqueues that
-    // are eligible to run.
-    for (typename map<unsigned, SubQueue>::iterator i = queue.begin();
-	 i != queue.end();
-	 ++i) {
-      assert(!(i->second.empty()));
-      if (i->second.front().first < i->second.num_tokens()) {
-	T ret = i->second.front().second;
-	unsigned cost = i->second.front().first;
-	i->second.take_tokens(cost);
-	i->second.pop_front();
-	if (i->second.empty())
-	  remove_queue(i->first);
-	distribute_tokens(cost);
-	return ret;
+    while (true) {
+      SubQueue *sq = rr.front();
+      Class *c = sq->next_class();
+      unsigned cost = c->items.front().first;
+      if (sq->deficit < (int64_t)cost) {
+	sq->deficit += std::max<int64_t>(sq->priority, 1) *
+	  std::max<int64_t>(min_cost, 1);
+	rr.push_back(&sq->rr_item);
+	continue;
       }
+      sq->deficit -= cost;
+      T ret = sq->pop(c);
+      if (sq->empty())
+	remove_queue(sq->priority);
+      return ret;
     }
-
-    // if no subqueues have sufficient tokens, we behave like a strict
-    // priority queue.
-    T ret = queue.rbegin()->second.front().second;
-    unsigned cost = queue.rbegin()->second.front().first;
-    queue.rbegin()->second.pop_front();
-    if (queue.rbegin()->second.empty())
-      remove_queue(queue.rbegin()->first);
-    distribute_tokens(cost);
-    return ret;
   }
 
   void dump(Formatter *f) const {
@@ -372,22 +386,22 @@ public:
     f->dump_int("max_tokens_per_subqueue", max_tokens_per_subqueue);
     f->dump_int("min_cost", min_cost);
     f->open_array_section("high_queues");
-    for (typename map<unsigned, SubQueue>::const_iterator p = high_queue.begin();
+    for (typename map<unsigned, SubQueue*>::const_iterator p = high_queue.begin();
 	 p != high_queue.end();
 	 ++p) {
       f->open_object_section("subqueue");
       f->dump_int("priority", p->first);
-      p->second.dump(f);
+      p->second->dump(f);
       f->close_section();
     }
     f->close_section();
     f->open_array_section("queues");
-    for (typename map<unsigned, SubQueue>::const_iterator p = queue.begin();
+    for (typename map<unsigned, SubQueue*>::const_iterator p = queue.begin();
 	 p != queue.end();
 	 ++p) {
       f->open_object_section("subqueue");
       f->dump_int("priority", p->first);
-      p->second.dump(f);
+      p->second->dump(f);
       f->close_section();
     }
     f->close_section();
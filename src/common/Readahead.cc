@@ -0,0 +1,132 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <algorithm>
+
+#include "common/Readahead.h"
+#include "include/assert.h"
+
+using std::vector;
+
+Readahead::Readahead()
+  : m_lock("Readahead::m_lock"),
+    m_trigger_requests(10),
+    m_max_readahead_size(512 * 1024),
+    m_min_readahead_size(0),
+    m_alignment(0),
+    m_last_pos(0),
+    m_nr_consec_read(0),
+    m_consec_read_bytes(0),
+    m_readahead_size(0),
+    m_readahead_pos(0),
+    m_readahead_trigger_pos(0),
+    m_pending_lock("Readahead::m_pending_lock"),
+    m_pending(0)
+{
+}
+
+Readahead::extent_t Readahead::update(const vector<extent_t>& extents,
+				      uint64_t limit)
+{
+  Mutex::Locker l(m_lock);
+  for (vector<extent_t>::const_iterator p = extents.begin();
+       p != extents.end();
+       ++p) {
+    if (p->first == m_last_pos) {
+      m_nr_consec_read++;
+      m_consec_read_bytes += p->second;
+    } else {
+      m_nr_consec_read = 0;
+      m_consec_read_bytes = 0;
+      m_readahead_size = 0;
+      m_readahead_pos = 0;
+      m_readahead_trigger_pos = 0;
+    }
+    m_last_pos = p->first + p->second;
+  }
+  return _compute(limit);
+}
+
+Readahead::extent_t Readahead::update(uint64_t offset, uint64_t length,
+				      uint64_t limit)
+{
+  vector<extent_t> extents(1, extent_t(offset, length));
+  return update(extents, limit);
+}
+
+Readahead::extent_t Readahead::_compute(uint64_t limit)
+{
+  assert(m_lock.is_locked());
+  if (m_max_readahead_size == 0 ||
+      m_nr_consec_read < m_trigger_requests ||
+      m_last_pos < m_readahead_trigger_pos)
+    return extent_t(0, 0);
+
+  if (m_readahead_size == 0)
+    m_readahead_size = m_consec_read_bytes;
+  else
+    m_readahead_size *= 2;
+  if (m_readahead_size < m_min_readahead_size)
+    m_readahead_size = m_min_readahead_size;
+  if (m_readahead_size > m_max_readahead_size)
+    m_readahead_size = m_max_readahead_size;
+
+  uint64_t start = std::max(m_last_pos, m_readahead_pos);
+  uint64_t end = m_last_pos + m_readahead_size;
+  if (m_alignment && end % m_alignment)
+    end += m_alignment - end % m_alignment;
+  if (end > limit)
+    end = limit;
+  if (start >= end)
+    return extent_t(0, 0);
+
+  m_readahead_pos = end;
+  m_readahead_trigger_pos = m_last_pos + (end - m_last_pos) / 2;
+  return extent_t(start, end - start);
+}
+
+void Readahead::inc_pending(int count)
+{
+  Mutex::Locker l(m_pending_lock);
+  m_pending += count;
+}
+
+void Readahead::dec_pending(int count)
+{
+  Mutex::Locker l(m_pending_lock);
+  assert(m_pending >= count);
+  m_pending -= count;
+  if (m_pending == 0)
+    m_pending_cond.Signal();
+}
+
+void Readahead::wait_for_pending()
+{
+  Mutex::Locker l(m_pending_lock);
+  while (m_pending > 0)
+    m_pending_cond.Wait(m_pending_lock);
+}
+
+void Readahead::set_trigger_requests(int trigger_requests)
+{
+  Mutex::Locker l(m_lock);
+  m_trigger_requests = trigger_requests;
+}
+
+void Readahead::set_max_readahead_size(uint64_t max_readahead)
+{
+  Mutex::Locker l(m_lock);
+  m_max_readahead_size = max_readahead;
+}
+
+void Readahead::set_min_readahead_size(uint64_t min_readahead)
+{
+  Mutex::Locker l(m_lock);
+  m_min_readahead_size = min_readahead;
+}
+
+void Readahead::set_alignment(uint64_t alignment)
+{
+  Mutex::Locker l(m_lock);
+  m_alignment = alignment;
+}
@@ -0,0 +1,90 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_READAHEAD_H
+#define CEPH_READAHEAD_H
+
+#include <utility>
+#include <vector>
+
+#include "include/int_types.h"
+#include "Mutex.h"
+#include "Cond.h"
+
+/**
+ * Sequential read detection for a single stream of reads.
+ *
+ * Callers pass every read to update().  Once trigger_requests reads in a
+ * row have each started where the previous one ended, update() returns
+ * an extent to prefetch just past the read.  The window starts at the
+ * number of sequential bytes read so far (or min_bytes, if that is
+ * more) and doubles with every readahead, up to max_bytes; its end is
+ * rounded up to the alignment
+ * so whole objects get fetched.  The next readahead is only issued once
+ * the reader has consumed half of the current one.  A read that breaks
+ * the sequence resets all of this.
+ *
+ * The caller issues the returned extent itself, bracketing each request
+ * with inc_pending()/dec_pending() so wait_for_pending() can drain them
+ * before teardown.
+ */
+class Readahead {
+public:
+  typedef std::pair<uint64_t, uint64_t> extent_t;
+
+  Readahead();
+
+  /**
+   * account for a read and decide what, if anything, to prefetch
+   *
+   * @param extents extents of the read, in the order they were read
+   * @param limit no readahead at or past this offset, e.g. the image size
+   * @return extent to prefetch; zero length if none
+   */
+  extent_t update(const std::vector<extent_t>& extents, uint64_t limit);
+  extent_t update(uint64_t offset, uint64_t length, uint64_t limit);
+
+  void inc_pending(int count = 1);
+  void dec_pending(int count = 1);
+  void wait_for_pending();
+
+  /// sequential reads needed before readahead starts
+  void set_trigger_requests(int trigger_requests);
+  /// largest readahead window in bytes, 0 disables readahead
+  void set_max_readahead_size(uint64_t max_readahead);
+  /// smallest readahead window in bytes
+  void set_min_readahead_size(uint64_t min_readahead);
+  /// round the end of each readahead up to a multiple of this
+  void set_alignment(uint64_t alignment);
+
+private:
+  extent_t _compute(uint64_t limit);
+
+  Mutex m_lock;
+  int m_trigger_requests;
+  uint64_t m_max_readahead_size;
+  uint64_t m_min_readahead_size;
+  uint64_t m_alignment;
+
+  uint64_t m_last_pos;           ///< end of the last read
+  int m_nr_consec_read;          ///< reads in a row that were sequential
+  uint64_t m_consec_read_bytes;  ///< bytes read by those reads
+  uint64_t m_readahead_size;     ///< size of the last readahead window
+  uint64_t m_readahead_pos;      ///< end of everything prefetched so far
+  uint64_t m_readahead_trigger_pos; ///< read past this to prefetch more
+
+  Mutex m_pending_lock;
+  Cond m_pending_cond;
+  int m_pending;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <iostream>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <sstream>
 #include <stdlib.h>
@@ -37,6 +38,19 @@ Thread::~Thread()
 {
 }
 
+#if defined(__linux__)
+static int _make_cpu_set(const std::set<int> &cpus, cpu_set_t *set)
+{
+  CPU_ZERO(set);
+  for (std::set<int>::const_iterator p = cpus.begin(); p != cpus.end(); ++p) {
+    if (*p < 0 || *p >= CPU_SETSIZE)
+      return -EINVAL;
+    CPU_SET(*p, set);
+  }
+  return 0;
+}
+#endif
+
 void *Thread::_entry_func(void *arg) {
   void *r = ((Thread*)arg)->entry();
   return r;
@@ -69,12 +83,18 @@ int Thread::try_create(size_t stacksize)
 {
   pthread_attr_t *thread_attr = NULL;
   stacksize &= CEPH_PAGE_MASK;  // must be multiple of page
-  if (stacksize) {
+  if (stacksize || !cpus.empty()) {
     thread_attr = (pthread_attr_t*) malloc(sizeof(pthread_attr_t));
     if (!thread_attr)
       return -ENOMEM;
     pthread_attr_init(thread_attr);
-    pthread_attr_setstacksize(thread_attr, stacksize);
+    if (stacksize)
+      pthread_attr_setstacksize(thread_attr, stacksize);
+#if defined(__linux__)
+    cpu_set_t set;
+    if (!cpus.empty() && _make_cpu_set(cpus, &set) == 0)
+      pthread_attr_setaffinity_np(thread_attr, sizeof(set), &set);
+#endif
   }
 
   int r;
@@ -94,8 +114,10 @@ int Thread::try_create(size_t stacksize)
   r = pthread_create(&thread_id, thread_attr, _entry_func, (void*)this);
   restore_sigset(&old_sigset);
 
-  if (thread_attr)
+  if (thread_attr) {
+    pthread_attr_destroy(thread_attr);
     free(thread_attr);
+  }
   return r;
 }
 
@@ -128,3 +150,19 @@ int Thread::detach()
 {
   return pthread_detach(thread_id);
 }
+
+int Thread::set_affinity(const std::set<int> &c)
+{
+#if defined(__linux__)
+  cpu_set_t set;
+  int r = _make_cpu_set(c, &set);
+  if (r < 0)
+    return r;
+  cpus = c;
+  if (thread_id && !cpus.empty())
+    return -pthread_setaffinity_np(thread_id, sizeof(set), &set);
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
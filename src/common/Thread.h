@@ -17,10 +17,12 @@
 #define CEPH_THREAD_H
 
 #include <pthread.h>
+#include <set>
 
 class Thread {
  private:
   pthread_t thread_id;
+  std::set<int> cpus;  ///< affinity; empty to inherit the creator's
 
  public:
   Thread(const Thread& other);
@@ -44,6 +46,12 @@ class Thread {
   void create(size_t stacksize = 0);
   int join(void **prval = 0);
   int detach();
+  /**
+   * Restrict the thread to some cpus.  This takes effect when the
+   * thread is created, or at once if it is running.  An empty set
+   * leaves it with its creator's affinity.
+   */
+  int set_affinity(const std::set<int> &c);
 };
 
 #endif
@@ -26,6 +26,11 @@ enum {
   l_throttle_put,
   l_throttle_put_sum,
   l_throttle_wait,
+  l_throttle_wait_1ms,
+  l_throttle_wait_10ms,
+  l_throttle_wait_100ms,
+  l_throttle_wait_1s,
+  l_throttle_wait_long,
   l_throttle_last,
 };
 
@@ -53,6 +58,12 @@ Throttle::Throttle(CephContext *cct, std::string n, int64_t m, bool _use_perf)
     b.add_u64_counter(l_throttle_put, "put");
     b.add_u64_counter(l_throttle_put_sum, "put_sum");
     b.add_time_avg(l_throttle_wait, "wait");
+    // how long the waits were: up to 1ms, 10ms, 100ms, 1s, or longer
+    b.add_u64_counter(l_throttle_wait_1ms, "wait_1ms");
+    b.add_u64_counter(l_throttle_wait_10ms, "wait_10ms");
+    b.add_u64_counter(l_throttle_wait_100ms, "wait_100ms");
+    b.add_u64_counter(l_throttle_wait_1s, "wait_1s");
+    b.add_u64_counter(l_throttle_wait_long, "wait_long");
 
     logger = b.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
@@ -87,39 +98,55 @@ void Throttle::_reset_max(int64_t m)
   max.set((size_t)m);
 }
 
+/*
+ * Get c, waiting behind any other waiters.  We count ourselves in
+ * waiters before looking at count: a put() that lands after our look
+ * then sees us and signals (under the lock, so after we sleep).
+ */
 bool Throttle::_wait(int64_t c)
 {
-  utime_t start;
-  bool waited = false;
-  if (_should_wait(c) || !cond.empty()) { // always wait behind other waiters.
-    Cond *cv = new Cond;
-    cond.push_back(cv);
-    do {
-      if (!waited) {
-	ldout(cct, 2) << "_wait waiting..." << dendl;
-	if (logger)
-	  start = ceph_clock_now(cct);
-      }
-      waited = true;
-      cv->Wait(lock);
-    } while (_should_wait(c) || cv != cond.front());
-
-    if (waited) {
-      ldout(cct, 3) << "_wait finished waiting" << dendl;
-      if (logger) {
-	utime_t dur = ceph_clock_now(cct) - start;
-        logger->tinc(l_throttle_wait, dur);
-      }
-    }
+  assert(lock.is_locked());
+  waiters.inc();
+  if (cond.empty() && _try_get(c)) {
+    waiters.dec();
+    return false;
+  }
 
-    delete cv;
-    cond.pop_front();
+  ldout(cct, 2) << "_wait waiting..." << dendl;
+  utime_t start;
+  if (logger)
+    start = ceph_clock_now(cct);
+  Cond *cv = new Cond;
+  cond.push_back(cv);
+  do {
+    cv->Wait(lock);
+  } while (cv != cond.front() || !_try_get(c));
 
-    // wake up the next guy
-    if (!cond.empty())
-      cond.front()->SignalOne();
+  ldout(cct, 3) << "_wait finished waiting" << dendl;
+  if (logger) {
+    utime_t dur = ceph_clock_now(cct) - start;
+    logger->tinc(l_throttle_wait, dur);
+    double d = dur;
+    if (d <= .001)
+      logger->inc(l_throttle_wait_1ms);
+    else if (d <= .01)
+      logger->inc(l_throttle_wait_10ms);
+    else if (d <= .1)
+      logger->inc(l_throttle_wait_100ms);
+    else if (d <= 1)
+      logger->inc(l_throttle_wait_1s);
+    else
+      logger->inc(l_throttle_wait_long);
   }
-  return waited;
+
+  delete cv;
+  cond.pop_front();
+  waiters.dec();
+
+  // wake up the next guy
+  if (!cond.empty())
+    cond.front()->SignalOne();
+  return true;
 }
 
 bool Throttle::wait(int64_t m)
@@ -144,10 +171,7 @@ int64_t Throttle::take(int64_t c)
   }
   assert(c >= 0);
   ldout(cct, 10) << "take " << c << dendl;
-  {
-    Mutex::Locker l(lock);
-    count.add(c);
-  }
+  count.add(c);
   if (logger) {
     logger->inc(l_throttle_take);
     logger->inc(l_throttle_take_sum, c);
@@ -165,14 +189,13 @@ bool Throttle::get(int64_t c, int64_t m)
   assert(c >= 0);
   ldout(cct, 10) << "get " << c << " (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
   bool waited = false;
-  {
+  if (m || waiters.read() || !_try_get(c)) {
     Mutex::Locker l(lock);
     if (m) {
       assert(m > 0);
       _reset_max(m);
     }
     waited = _wait(c);
-    count.add(c);
   }
   if (logger) {
     logger->inc(l_throttle_get);
@@ -192,16 +215,14 @@ bool Throttle::get_or_fail(int64_t c)
   }
 
   assert (c >= 0);
-  Mutex::Locker l(lock);
-  if (_should_wait(c) || !cond.empty()) {
+  if (waiters.read() || !_try_get(c)) {
     ldout(cct, 10) << "get_or_fail " << c << " failed" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_fail);
     }
     return false;
   } else {
-    ldout(cct, 10) << "get_or_fail " << c << " success (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
-    count.add(c);
+    ldout(cct, 10) << "get_or_fail " << c << " success (" << (count.read() - c) << " -> " << count.read() << ")" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_success);
       logger->inc(l_throttle_get);
@@ -220,12 +241,14 @@ int64_t Throttle::put(int64_t c)
 
   assert(c >= 0);
   ldout(cct, 10) << "put " << c << " (" << count.read() << " -> " << (count.read()-c) << ")" << dendl;
-  Mutex::Locker l(lock);
   if (c) {
-    if (!cond.empty())
-      cond.front()->SignalOne();
     assert(((int64_t)count.read()) >= c); //if count goes negative, we failed somewhere!
     count.sub(c);
+    if (waiters.read()) {
+      Mutex::Locker l(lock);
+      if (!cond.empty())
+	cond.front()->SignalOne();
+    }
     if (logger) {
       logger->inc(l_throttle_put);
       logger->inc(l_throttle_put_sum, c);
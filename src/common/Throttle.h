@@ -12,11 +12,22 @@
 class CephContext;
 class PerfCounters;
 
+/**
+ * Throttle
+ *
+ * Callers get() and put() amounts against a maximum.  While nobody is
+ * waiting, get() and put() only touch the atomic count; the lock is
+ * taken once a caller has to wait.  Waiters are served strictly in
+ * arrival order: a get() that would fit still queues behind earlier
+ * waiters, so a large request is not starved by a stream of small
+ * ones.
+ */
 class Throttle {
   CephContext *cct;
   std::string name;
   PerfCounters *logger;
 	ceph::atomic_t count, max;
+  ceph::atomic_t waiters;  ///< callers in (or entering) the wait queue
   Mutex lock;
   list<Cond*> cond;
   bool use_perf;
@@ -27,15 +38,25 @@ public:
 
 private:
   void _reset_max(int64_t m);
-  bool _should_wait(int64_t c) {
+  bool _should_wait(int64_t c, int64_t cur) {
     int64_t m = max.read();
-    int64_t cur = count.read();
     return
       m &&
       ((c <= m && cur + c > m) || // normally stay under max
        (c >= m && cur > m));     // except for large c
   }
 
+  /// add c to count unless we should wait for it
+  bool _try_get(int64_t c) {
+    while (true) {
+      int64_t cur = count.read();
+      if (_should_wait(c, cur))
+	return false;
+      if (count.compare_and_swap(cur, cur + c))
+	return true;
+    }
+  }
+
   bool _wait(int64_t c);
 
 public:
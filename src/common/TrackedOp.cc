@@ -14,6 +14,8 @@
 #include "common/Formatter.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include "common/debug.h"
 #include "common/config.h"
 #include "msg/Message.h"
@@ -84,36 +86,91 @@ void OpHistory::dump_ops(utime_t now, Formatter *f)
   f->close_section();
 }
 
+OpTracker::OpTracker(CephContext *cct_, bool tracking, uint32_t num_shards)
+  : history_lock("OpTracker::history_lock"),
+    complaint_time(0), log_threshold(0), sample_every(0),
+    tracking_enabled(tracking), cct(cct_)
+{
+  for (uint32_t i = 0; i < MAX(1, num_shards); ++i) {
+    ostringstream name;
+    name << "OpTracker::shard " << i;
+    shards.push_back(new ShardedTrackingData(name.str()));
+  }
+}
+
+OpTracker::~OpTracker()
+{
+  while (!shards.empty()) {
+    assert(shards.back()->ops_in_flight.empty());
+    delete shards.back();
+    shards.pop_back();
+  }
+}
+
+OpTracker::ShardedTrackingData *OpTracker::get_shard(const TrackedOp *op)
+{
+  return shards[op->seq % shards.size()];
+}
+
+void OpTracker::lock_shards()
+{
+  for (vector<ShardedTrackingData*>::iterator p = shards.begin();
+       p != shards.end();
+       ++p)
+    (*p)->ops_in_flight_lock.Lock();
+}
+
+void OpTracker::unlock_shards()
+{
+  for (vector<ShardedTrackingData*>::reverse_iterator p = shards.rbegin();
+       p != shards.rend();
+       ++p)
+    (*p)->ops_in_flight_lock.Unlock();
+}
+
 void OpTracker::dump_historic_ops(Formatter *f)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
+  Mutex::Locker locker(history_lock);
   utime_t now = ceph_clock_now(cct);
   history.dump_ops(now, f);
 }
 
 void OpTracker::dump_ops_in_flight(Formatter *f)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
+  lock_shards();
+  uint64_t num_ops = 0;
+  for (vector<ShardedTrackingData*>::iterator p = shards.begin();
+       p != shards.end();
+       ++p)
+    num_ops += (*p)->ops_in_flight.size();
   f->open_object_section("ops_in_flight"); // overall dump
-  f->dump_int("num_ops", ops_in_flight.size());
+  f->dump_int("num_ops", num_ops);
   f->open_array_section("ops"); // list of TrackedOps
   utime_t now = ceph_clock_now(cct);
-  for (xlist<TrackedOp*>::iterator p = ops_in_flight.begin(); !p.end(); ++p) {
-    f->open_object_section("op");
-    (*p)->dump(now, f);
-    f->close_section(); // this TrackedOp
+  for (vector<ShardedTrackingData*>::iterator s = shards.begin();
+       s != shards.end();
+       ++s) {
+    for (xlist<TrackedOp*>::iterator p = (*s)->ops_in_flight.begin(); !p.end(); ++p) {
+      f->open_object_section("op");
+      (*p)->dump(now, f);
+      f->close_section(); // this TrackedOp
+    }
   }
   f->close_section(); // list of TrackedOps
   f->close_section(); // overall dump
+  unlock_shards();
 }
 
 void OpTracker::register_inflight_op(xlist<TrackedOp*>::item *i)
 {
   if (!tracking_enabled)
     return;
-  Mutex::Locker locker(ops_in_flight_lock);
-  ops_in_flight.push_back(i);
-  ops_in_flight.back()->seq = seq++;
+  TrackedOp *op = i->_item;
+  op->seq = seq.inc() - 1;
+  op->sampled = sample_every && op->seq % sample_every == 0;
+  ShardedTrackingData *shard = get_shard(op);
+  Mutex::Locker locker(shard->ops_in_flight_lock);
+  shard->ops_in_flight.push_back(i);
 }
 
 void OpTracker::unregister_inflight_op(TrackedOp *i)
@@ -123,43 +180,59 @@ void OpTracker::unregister_inflight_op(TrackedOp *i)
   if (!tracking_enabled)
     return;
 
-  Mutex::Locker locker(ops_in_flight_lock);
-  assert(i->xitem.get_list() == &ops_in_flight);
+  ShardedTrackingData *shard = get_shard(i);
+  {
+    Mutex::Locker locker(shard->ops_in_flight_lock);
+    assert(i->xitem.get_list() == &shard->ops_in_flight);
+    i->xitem.remove_myself();
+  }
   utime_t now = ceph_clock_now(cct);
-  i->xitem.remove_myself();
+  Mutex::Locker locker(history_lock);
   history.insert(now, TrackedOpRef(i));
 }
 
 bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-  if (!ops_in_flight.size()) // this covers tracking_enabled, too
-    return false;
-
   utime_t now = ceph_clock_now(cct);
   utime_t too_old = now;
   too_old -= complaint_time;
 
-  utime_t oldest_secs = now - ops_in_flight.front()->get_arrived();
+  // each shard is in arrival order; merge the slow ones
+  lock_shards();
+  vector<pair<utime_t, TrackedOp*> > slow_ops;
+  for (vector<ShardedTrackingData*>::iterator s = shards.begin();
+       s != shards.end();
+       ++s) {
+    for (xlist<TrackedOp*>::iterator i = (*s)->ops_in_flight.begin();
+	 !i.end() && (*i)->get_arrived() < too_old;
+	 ++i)
+      slow_ops.push_back(make_pair((*i)->get_arrived(), *i));
+  }
+  if (slow_ops.empty()) { // this covers tracking_enabled, too
+    unlock_shards();
+    return false;
+  }
+  sort(slow_ops.begin(), slow_ops.end());
 
-  dout(10) << "ops_in_flight.size: " << ops_in_flight.size()
+  utime_t oldest_secs = now - slow_ops.front().first;
+
+  dout(10) << slow_ops.size() << " ops in flight past complaint time"
            << "; oldest is " << oldest_secs
            << " seconds old" << dendl;
 
-  if (oldest_secs < complaint_time)
-    return false;
-
-  xlist<TrackedOp*>::iterator i = ops_in_flight.begin();
   warning_vector.reserve(log_threshold + 1);
 
   int slow = 0;     // total slow
   int warned = 0;   // total logged
-  while (!i.end() && (*i)->get_arrived() < too_old) {
+  for (vector<pair<utime_t, TrackedOp*> >::iterator p = slow_ops.begin();
+       p != slow_ops.end();
+       ++p) {
+    TrackedOp *op = p->second;
     slow++;
 
     // exponential backoff of warning intervals
-    if (((*i)->get_arrived() +
-	 (complaint_time * (*i)->warn_interval_multiplier)) < now) {
+    if ((op->get_arrived() +
+	 (complaint_time * op->warn_interval_multiplier)) < now) {
       // will warn
       if (warning_vector.empty())
 	warning_vector.push_back("");
@@ -167,18 +240,18 @@ bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
       if (warned > log_threshold)
         break;
 
-      utime_t age = now - (*i)->get_arrived();
+      utime_t age = now - op->get_arrived();
       stringstream ss;
-      ss << "slow request " << age << " seconds old, received at " << (*i)->get_arrived()
-	 << ": " << *((*i)->request) << " currently "
-	 << ((*i)->current.size() ? (*i)->current : (*i)->state_string());
+      ss << "slow request " << age << " seconds old, received at " << op->get_arrived()
+	 << ": " << *(op->request) << " currently "
+	 << (op->current.size() ? op->current : op->state_string());
       warning_vector.push_back(ss.str());
 
       // only those that have been shown will backoff
-      (*i)->warn_interval_multiplier *= 2;
+      op->warn_interval_multiplier *= 2;
     }
-    ++i;
   }
+  unlock_shards();
 
   // only summarize if we warn about any.  if everything has backed
   // off, we will stay silent.
@@ -194,17 +267,27 @@ bool OpTracker::check_ops_in_flight(std::vector<string> &warning_vector)
 
 void OpTracker::get_age_ms_histogram(pow2_hist_t *h)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
-
   h->clear();
 
   utime_t now = ceph_clock_now(NULL);
+  vector<uint32_t> ages;
+  lock_shards();
+  for (vector<ShardedTrackingData*>::iterator s = shards.begin();
+       s != shards.end();
+       ++s) {
+    for (xlist<TrackedOp*>::iterator i = (*s)->ops_in_flight.begin(); !i.end(); ++i) {
+      utime_t age = now - (*i)->get_arrived();
+      ages.push_back((long)(age * 1000.0));
+    }
+  }
+  unlock_shards();
+  sort(ages.begin(), ages.end(), std::greater<uint32_t>());
+
   unsigned bin = 30;
   uint32_t lb = 1 << (bin-1);  // lower bound for this bin
   int count = 0;
-  for (xlist<TrackedOp*>::iterator i = ops_in_flight.begin(); !i.end(); ++i) {
-    utime_t age = now - (*i)->get_arrived();
-    uint32_t ms = (long)(age * 1000.0);
+  for (vector<uint32_t>::iterator i = ages.begin(); i != ages.end(); ++i) {
+    uint32_t ms = *i;
     if (ms >= lb) {
       count++;
       continue;
@@ -221,21 +304,12 @@ void OpTracker::get_age_ms_histogram(pow2_hist_t *h)
     h->set_bin(bin, count);
 }
 
-void OpTracker::mark_event(TrackedOp *op, const string &dest)
-{
-  if (!tracking_enabled)
-    return;
-  utime_t now = ceph_clock_now(cct);
-  return _mark_event(op, dest, now);
-}
-
-void OpTracker::_mark_event(TrackedOp *op, const string &evt,
+void OpTracker::_mark_event(TrackedOp *op, int evt,
 			    utime_t time)
 {
-  Mutex::Locker locker(ops_in_flight_lock);
   dout(5) << //"reqid: " << op->get_reqid() <<
 	     ", seq: " << op->seq
-	  << ", time: " << time << ", event: " << evt
+	  << ", time: " << time << ", event: " << TrackedOp::get_event_name(evt)
 	  << ", request: " << *op->request << dendl;
 }
 
@@ -245,22 +319,118 @@ void OpTracker::RemoveOnDelete::operator()(TrackedOp *op) {
     delete op;
     return;
   }
-  op->mark_event("done");
+  op->mark_event(TrackedOp::EVENT_DONE);
   tracker->unregister_inflight_op(op);
   // Do not delete op, unregister_inflight_op took control
 }
 
-void TrackedOp::mark_event(const string &event)
+static const char *event_names[] = {
+  "header_read",
+  "throttled",
+  "all_read",
+  "dispatched",
+  "waiting_for_osdmap",
+  "queued_for_pg",
+  "reached_pg",
+  "delayed",
+  "started",
+  "sub_op_sent",
+  "commit_queued_for_journal_write",
+  "write_thread_in_journal_buffer",
+  "journaled_completion_queued",
+  "op_commit",
+  "op_applied",
+  "sub_op_committed",
+  "sub_op_applied",
+  "sub_op_commit_rec",
+  "sub_op_applied_rec",
+  "committed",
+  "commit_sent",
+  "done",
+};
+
+const char *TrackedOp::get_event_name(int evt)
 {
-  utime_t now = ceph_clock_now(g_ceph_context);
-  {
+  if (evt < 0 || evt >= EVENT_MAX)
+    return "no events";
+  return event_names[evt];
+}
+
+void TrackedOp::_mark_event(int evt, utime_t stamp, const string *detail)
+{
+  // no lock: a concurrent dump may see a half written slot, which only
+  // costs it one garbled event
+  unsigned n = num_events.inc() - 1;
+  Event &e = events[n % MAX_EVENTS];
+  e.stamp = stamp;
+  e.evt = evt;
+
+  if (sampled) {
     Mutex::Locker l(lock);
-    events.push_back(make_pair(now, event));
+    detail_events.push_back(make_pair(stamp,
+				      detail && detail->size() ?
+				      *detail : string(get_event_name(evt))));
   }
-  tracker->mark_event(this, event);
+  if (tracker->tracking_enabled)
+    tracker->_mark_event(this, evt, stamp);
+}
+
+void TrackedOp::mark_event(int evt)
+{
+  _mark_event(evt, ceph_clock_now(g_ceph_context), NULL);
+  _event_marked();
+}
+
+void TrackedOp::mark_event(int evt, utime_t stamp)
+{
+  _mark_event(evt, stamp, NULL);
+  _event_marked();
+}
+
+void TrackedOp::mark_event(int evt, const string &detail)
+{
+  _mark_event(evt, ceph_clock_now(g_ceph_context), &detail);
   _event_marked();
 }
 
+int TrackedOp::get_last_event(utime_t *stamp) const
+{
+  unsigned n = num_events.read();
+  if (!n)
+    return EVENT_MAX;
+  const Event &e = events[(n - 1) % MAX_EVENTS];
+  if (stamp)
+    *stamp = e.stamp;
+  return e.evt;
+}
+
+void TrackedOp::dump_events(Formatter *f) const
+{
+  f->open_array_section("events");
+  if (sampled) {
+    Mutex::Locker l(lock);
+    for (list<pair<utime_t, string> >::const_iterator i = detail_events.begin();
+	 i != detail_events.end();
+	 ++i) {
+      f->open_object_section("event");
+      f->dump_stream("time") << i->first;
+      f->dump_string("event", i->second);
+      f->close_section();
+    }
+  } else {
+    unsigned n = num_events.read();
+    unsigned first = n > MAX_EVENTS ? n - MAX_EVENTS : 0;
+    for (unsigned i = first; i < n; ++i) {
+      const Event &e = events[i % MAX_EVENTS];
+      f->open_object_section("event");
+      f->dump_stream("time") << e.stamp;
+      f->dump_string("event", get_event_name(e.evt));
+      f->close_section();
+    }
+  }
+  f->close_section();
+}
+
 void TrackedOp::dump(utime_t now, Formatter *f) const
 {
   Message *m = request;
@@ -21,6 +21,7 @@
 #include "include/xlist.h"
 #include "msg/Message.h"
 #include "include/memory.h"
+#include "include/atomic.h"
 
 class TrackedOp;
 typedef ceph::shared_ptr<TrackedOp> TrackedOpRef;
@@ -59,26 +60,45 @@ class OpTracker {
   };
   friend class RemoveOnDelete;
   friend class OpHistory;
-  uint64_t seq;
-  Mutex ops_in_flight_lock;
-  xlist<TrackedOp *> ops_in_flight;
+
+  /// ops in flight are spread over shards by seq, so that registering
+  /// and unregistering them does not serialize on one lock
+  struct ShardedTrackingData {
+    string lock_name;
+    Mutex ops_in_flight_lock;
+    xlist<TrackedOp *> ops_in_flight;
+    ShardedTrackingData(const string& name)
+      : lock_name(name), ops_in_flight_lock(lock_name.c_str()) {}
+  };
+  vector<ShardedTrackingData*> shards;
+  atomic_t seq;
+  Mutex history_lock;
   OpHistory history;
   float complaint_time;
   int log_threshold;
+  uint32_t sample_every;  ///< keep full event detail for one op in this many; 0 for none
+
+  ShardedTrackingData *get_shard(const TrackedOp *op);
+  void lock_shards();
+  void unlock_shards();
 
 public:
   bool tracking_enabled;
   CephContext *cct;
-  OpTracker(CephContext *cct_, bool tracking) : seq(0), ops_in_flight_lock("OpTracker mutex"),
-						complaint_time(0), log_threshold(0),
-						tracking_enabled(tracking), cct(cct_) {}
+  OpTracker(CephContext *cct_, bool tracking, uint32_t num_shards = 1);
+  ~OpTracker();
+
   void set_complaint_and_threshold(float time, int threshold) {
     complaint_time = time;
     log_threshold = threshold;
   }
   void set_history_size_and_duration(uint32_t new_size, uint32_t new_duration) {
+    Mutex::Locker l(history_lock);
     history.set_size_and_duration(new_size, new_duration);
   }
+  void set_sample_every(uint32_t n) {
+    sample_every = n;
+  }
   void dump_ops_in_flight(Formatter *f);
   void dump_historic_ops(Formatter *f);
   void register_inflight_op(xlist<TrackedOp*>::item *i);
@@ -95,16 +115,12 @@ public:
    * @return True if there are any Ops to warn on, false otherwise.
    */
   bool check_ops_in_flight(std::vector<string> &warning_strings);
-  void mark_event(TrackedOp *op, const string &evt);
-  void _mark_event(TrackedOp *op, const string &evt, utime_t now);
+  void _mark_event(TrackedOp *op, int evt, utime_t now);
 
   void on_shutdown() {
-    Mutex::Locker l(ops_in_flight_lock);
+    Mutex::Locker l(history_lock);
     history.on_shutdown();
   }
-  ~OpTracker() {
-    assert(ops_in_flight.empty());
-  }
 
   template <typename T>
   typename T::Ref create_request(Message *ref)
@@ -112,10 +128,10 @@ public:
     typename T::Ref retval(new T(ref, this),
 			   RemoveOnDelete(this));
     
-    _mark_event(retval.get(), "header_read", ref->get_recv_stamp());
-    _mark_event(retval.get(), "throttled", ref->get_throttle_stamp());
-    _mark_event(retval.get(), "all_read", ref->get_recv_complete_stamp());
-    _mark_event(retval.get(), "dispatched", ref->get_dispatch_stamp());
+    retval->mark_event(T::EVENT_HEADER_READ, ref->get_recv_stamp());
+    retval->mark_event(T::EVENT_THROTTLED, ref->get_throttle_stamp());
+    retval->mark_event(T::EVENT_ALL_READ, ref->get_recv_complete_stamp());
+    retval->mark_event(T::EVENT_DISPATCHED, ref->get_dispatch_stamp());
     
     retval->init_from_message();
     
@@ -124,17 +140,60 @@ public:
 };
 
 class TrackedOp {
+public:
+  /// the events an op may go through; see event_names in TrackedOp.cc
+  enum {
+    EVENT_HEADER_READ,
+    EVENT_THROTTLED,
+    EVENT_ALL_READ,
+    EVENT_DISPATCHED,
+    EVENT_WAITING_FOR_OSDMAP,
+    EVENT_QUEUED_FOR_PG,
+    EVENT_REACHED_PG,
+    EVENT_DELAYED,
+    EVENT_STARTED,
+    EVENT_SUB_OP_SENT,
+    EVENT_COMMIT_QUEUED_FOR_JOURNAL_WRITE,
+    EVENT_WRITE_THREAD_IN_JOURNAL_BUFFER,
+    EVENT_JOURNALED_COMPLETION_QUEUED,
+    EVENT_OP_COMMIT,
+    EVENT_OP_APPLIED,
+    EVENT_SUB_OP_COMMITTED,
+    EVENT_SUB_OP_APPLIED,
+    EVENT_SUB_OP_COMMIT_REC,
+    EVENT_SUB_OP_APPLIED_REC,
+    EVENT_OP_COMMITTED,
+    EVENT_COMMIT_SENT,
+    EVENT_DONE,
+    EVENT_MAX
+  };
+  static const char *get_event_name(int evt);
+
 private:
   friend class OpHistory;
   friend class OpTracker;
   xlist<TrackedOp*>::item xitem;
+
+  /// the last MAX_EVENTS events; older ones are overwritten
+  static const unsigned MAX_EVENTS = 16;
+  struct Event {
+    utime_t stamp;
+    uint8_t evt;
+  };
+  Event events[MAX_EVENTS];
+  atomic_t num_events; /// events marked so far
+
+  void _mark_event(int evt, utime_t stamp, const string *detail);
+
 protected:
   Message *request; /// the logical request we are tracking
   OpTracker *tracker; /// the tracker we are associated with
 
-  list<pair<utime_t, string> > events; /// list of events and their times
-  Mutex lock; /// to protect the events list
-  string current; /// the current state the event is in
+  /// every event, with its detail string; only kept if sampled
+  list<pair<utime_t, string> > detail_events;
+  mutable Mutex lock; /// to protect detail_events
+  bool sampled; /// keeping full detail for this op
+  string current; /// the current state the event is in, if more than the event says
   uint64_t seq; /// a unique value set by the OpTracker
 
   uint32_t warn_interval_multiplier; // limits output of a given op warning
@@ -144,6 +203,7 @@ protected:
     request(req),
     tracker(_tracker),
     lock("TrackedOp::lock"),
+    sampled(false),
     seq(0),
     warn_interval_multiplier(1)
   {
@@ -155,6 +215,10 @@ protected:
   virtual void _dump(utime_t now, Formatter *f) const {}
   /// if you want something else to happen when events are marked, implement
   virtual void _event_marked() {}
+  /// dump the events recorded so far
+  void dump_events(Formatter *f) const;
+  /// the most recent event, or EVENT_MAX if none
+  int get_last_event(utime_t *stamp = NULL) const;
 
 public:
   virtual ~TrackedOp() { assert(request); request->put(); }
@@ -164,15 +228,22 @@ public:
   }
   // This function maybe needs some work; assumes last event is completion time
   double get_duration() const {
-    return events.size() ?
-      (events.rbegin()->first - get_arrived()) :
-      0.0;
+    utime_t last;
+    if (get_last_event(&last) == EVENT_MAX)
+      return 0.0;
+    return last - get_arrived();
   }
   Message *get_req() const { return request; }
-
-  void mark_event(const string &event);
+  uint64_t get_seq() const { return seq; }
+
+  /// whether a detail string for the next event would be kept
+  bool is_sampled() const { return sampled; }
+  void mark_event(int evt);
+  void mark_event(int evt, utime_t stamp);
+  /// with a detail string, which is only kept if we are sampled
+  void mark_event(int evt, const string &detail);
   virtual const char *state_string() const {
-    return events.rbegin()->second.c_str();
+    return get_event_name(get_last_event());
   }
   void dump(utime_t now, Formatter *f) const;
 };
@@ -0,0 +1,286 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "Cond.h"
+#include "Mutex.h"
+#include "Thread.h"
+#include "WheelTimer.h"
+
+#include "common/config.h"
+#include "include/Context.h"
+
+#define dout_subsys ceph_subsys_timer
+#undef dout_prefix
+#define dout_prefix *_dout << "wheel_timer(" << this << ")."
+
+
+class WheelTimerThread : public Thread {
+  WheelTimer *parent;
+public:
+  WheelTimerThread(WheelTimer *s) : parent(s) {}
+  void *entry() {
+    parent->timer_thread();
+    return NULL;
+  }
+};
+
+
+WheelTimer::WheelTimer(CephContext *cct_, Mutex &l, bool safe_callbacks,
+		       double tick)
+  : cct(cct_), lock(l),
+    safe_callbacks(safe_callbacks),
+    tick_ns(tick * 1000000000.0),
+    thread(NULL),
+    cur_tick(0),
+    wake_tick((uint64_t)-1),
+    stopping(false)
+{
+  if (tick_ns == 0)
+    tick_ns = 1;
+}
+
+WheelTimer::~WheelTimer()
+{
+  assert(thread == NULL);
+}
+
+void WheelTimer::init()
+{
+  ldout(cct,10) << "init" << dendl;
+  thread = new WheelTimerThread(this);
+  thread->create();
+}
+
+void WheelTimer::shutdown()
+{
+  ldout(cct,10) << "shutdown" << dendl;
+  if (thread) {
+    assert(lock.is_locked());
+    cancel_all_events();
+    stopping = true;
+    cond.Signal();
+    lock.Unlock();
+    thread->join();
+    lock.Lock();
+    delete thread;
+    thread = NULL;
+  }
+}
+
+uint64_t WheelTimer::time_to_tick(utime_t t) const
+{
+  return (t.to_nsec() + tick_ns - 1) / tick_ns;
+}
+
+utime_t WheelTimer::tick_to_time(uint64_t tick) const
+{
+  uint64_t ns = tick * tick_ns;
+  return utime_t(ns / 1000000000ull, ns % 1000000000ull);
+}
+
+/*
+ * An event due in less than WHEEL_SIZE^(n+1) ticks goes on level n,
+ * in the slot its tick maps to there.  That slot comes around again
+ * no later than the event is due, at which point _cascade() moves the
+ * event down to a finer level.  Events too far out for the top level
+ * are parked in its last slot and re-sorted when it cascades.
+ */
+WheelTimer::slot_t *WheelTimer::_get_slot(uint64_t tick)
+{
+  if (tick < cur_tick)
+    tick = cur_tick;
+  uint64_t delta = tick - cur_tick;
+  unsigned level = 0;
+  while (level < WHEEL_LEVELS - 1 &&
+	 delta >> (WHEEL_BITS * (level + 1)))
+    ++level;
+  if (delta >> (WHEEL_BITS * WHEEL_LEVELS))
+    tick = cur_tick + (1ull << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+  return &wheel[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+}
+
+void WheelTimer::_cascade(unsigned level, uint64_t tick)
+{
+  slot_t ls;
+  ls.swap(wheel[level][(tick >> (WHEEL_BITS * level)) & WHEEL_MASK]);
+  ldout(cct,20) << "cascade level " << level << " tick " << tick
+		<< " " << ls.size() << " events" << dendl;
+  while (!ls.empty()) {
+    slot_t::iterator p = ls.begin();
+    slot_t *to = _get_slot(p->tick);
+    to->splice(to->end(), ls, p);
+    p->slot = to;
+  }
+}
+
+void WheelTimer::_run_tick(uint64_t tick)
+{
+  assert(tick == cur_tick);
+
+  // pull in the coarser levels whose slot boundary this is
+  for (unsigned level = 1;
+       level < WHEEL_LEVELS &&
+	 (tick & ((1ull << (WHEEL_BITS * level)) - 1)) == 0;
+       ++level)
+    _cascade(level, tick);
+
+  // take the whole slot first: callbacks may add events that land in it
+  slot_t batch;
+  batch.swap(wheel[0][tick & WHEEL_MASK]);
+  for (slot_t::iterator p = batch.begin(); p != batch.end(); ++p)
+    p->slot = &batch;
+  cur_tick = tick + 1;
+
+  while (!batch.empty()) {
+    Context *callback = batch.front().callback;
+    events.erase(callback);
+    batch.pop_front();
+    ldout(cct,10) << "timer_thread executing " << callback << dendl;
+
+    if (!safe_callbacks)
+      lock.Unlock();
+    callback->complete(0);
+    if (!safe_callbacks)
+      lock.Lock();
+  }
+}
+
+/*
+ * The first tick with work to do: the earliest occupied level-0 slot,
+ * or the earliest boundary at which a coarser level cascades.
+ */
+uint64_t WheelTimer::_next_tick() const
+{
+  uint64_t next = (uint64_t)-1;
+  for (unsigned k = 0; k < WHEEL_SIZE; ++k) {
+    if (!wheel[0][(cur_tick + k) & WHEEL_MASK].empty()) {
+      next = cur_tick + k;
+      break;
+    }
+  }
+  for (unsigned level = 1; level < WHEEL_LEVELS; ++level) {
+    unsigned shift = WHEEL_BITS * level;
+    uint64_t base = cur_tick >> shift;
+    for (unsigned k = 0; k < WHEEL_SIZE; ++k) {
+      uint64_t t = (base + k) << shift;
+      if (t >= next)
+	break;
+      if (t >= cur_tick && !wheel[level][(base + k) & WHEEL_MASK].empty()) {
+	next = t;
+	break;
+      }
+    }
+  }
+  return next;
+}
+
+void WheelTimer::timer_thread()
+{
+  lock.Lock();
+  ldout(cct,10) << "timer_thread starting" << dendl;
+  while (!stopping) {
+    uint64_t now_tick = ceph_clock_now(cct).to_nsec() / tick_ns;
+
+    while (cur_tick <= now_tick) {
+      if (events.empty()) {
+	// nothing to step through
+	cur_tick = now_tick + 1;
+	break;
+      }
+      _run_tick(cur_tick);
+    }
+
+    ldout(cct,20) << "timer_thread going to sleep" << dendl;
+    if (events.empty()) {
+      wake_tick = (uint64_t)-1;
+      cond.Wait(lock);
+    } else {
+      wake_tick = _next_tick();
+      cond.WaitUntil(lock, tick_to_time(wake_tick));
+    }
+    ldout(cct,20) << "timer_thread awake" << dendl;
+  }
+  ldout(cct,10) << "timer_thread exiting" << dendl;
+  lock.Unlock();
+}
+
+void WheelTimer::add_event_after(double seconds, Context *callback)
+{
+  assert(lock.is_locked());
+
+  utime_t when = ceph_clock_now(cct);
+  when += seconds;
+  add_event_at(when, callback);
+}
+
+void WheelTimer::add_event_at(utime_t when, Context *callback)
+{
+  assert(lock.is_locked());
+  ldout(cct,10) << "add_event_at " << when << " -> " << callback << dendl;
+
+  if (events.empty()) {
+    // the thread stops stepping cur_tick while idle; catch up
+    uint64_t now_tick = ceph_clock_now(cct).to_nsec() / tick_ns;
+    if (cur_tick <= now_tick)
+      cur_tick = now_tick + 1;
+  }
+
+  uint64_t tick = time_to_tick(when);
+  slot_t *slot = _get_slot(tick);
+  slot_t::iterator p = slot->insert(slot->end(), event_t(when, tick, callback));
+  p->slot = slot;
+
+  std::pair<ceph::unordered_map<Context*, slot_t::iterator>::iterator, bool> rval =
+    events.insert(std::make_pair(callback, p));
+
+  /* If you hit this, you tried to insert the same Context* twice. */
+  assert(rval.second);
+
+  /* If the event is due before the thread would next wake up, we need to
+   * adjust its timeout. */
+  if (tick < wake_tick) {
+    wake_tick = tick;
+    cond.Signal();
+  }
+}
+
+bool WheelTimer::cancel_event(Context *callback)
+{
+  assert(lock.is_locked());
+
+  ceph::unordered_map<Context*, slot_t::iterator>::iterator p = events.find(callback);
+  if (p == events.end()) {
+    ldout(cct,10) << "cancel_event " << callback << " not found" << dendl;
+    return false;
+  }
+
+  ldout(cct,10) << "cancel_event " << p->second->when << " -> " << callback << dendl;
+  delete p->first;
+
+  p->second->slot->erase(p->second);
+  events.erase(p);
+  return true;
+}
+
+void WheelTimer::cancel_all_events()
+{
+  ldout(cct,10) << "cancel_all_events" << dendl;
+  assert(lock.is_locked());
+
+  while (!events.empty()) {
+    ceph::unordered_map<Context*, slot_t::iterator>::iterator p = events.begin();
+    ldout(cct,10) << " cancelled " << p->second->when << " -> " << p->first << dendl;
+    delete p->first;
+    p->second->slot->erase(p->second);
+    events.erase(p);
+  }
+}
@@ -0,0 +1,128 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_WHEELTIMER_H
+#define CEPH_WHEELTIMER_H
+
+#include "Cond.h"
+#include "Mutex.h"
+#include "include/unordered_map.h"
+
+#include <list>
+
+class CephContext;
+class Context;
+class WheelTimerThread;
+
+/**
+ * A SafeTimer replacement for callers that add and cancel many events.
+ *
+ * Events live in a hierarchical timing wheel: WHEEL_LEVELS wheels of
+ * WHEEL_SIZE slots, each level's slot covering WHEEL_SIZE of the level
+ * below.  Adding and cancelling an event are O(1); an event is moved
+ * down a level at most WHEEL_LEVELS-1 times before it fires, and all
+ * events due in a tick fire together.  Deadlines are rounded up to the
+ * tick, so an event never fires early but may fire up to one tick late.
+ *
+ * The interface and locking rules are those of SafeTimer.
+ */
+class WheelTimer
+{
+  // This class isn't supposed to be copied
+  WheelTimer(const WheelTimer &rhs);
+  WheelTimer& operator=(const WheelTimer &rhs);
+
+  static const unsigned WHEEL_BITS = 8;
+  static const unsigned WHEEL_SIZE = 1 << WHEEL_BITS;
+  static const unsigned WHEEL_MASK = WHEEL_SIZE - 1;
+  static const unsigned WHEEL_LEVELS = 4;
+
+  struct event_t;
+  typedef std::list<event_t> slot_t;
+  struct event_t {
+    utime_t when;
+    uint64_t tick;   ///< when, rounded up to a tick
+    Context *callback;
+    slot_t *slot;    ///< the list we are on
+    event_t(utime_t w, uint64_t t, Context *c)
+      : when(w), tick(t), callback(c), slot(NULL) {}
+  };
+
+  CephContext *cct;
+  Mutex& lock;
+  Cond cond;
+  bool safe_callbacks;
+  uint64_t tick_ns;
+
+  friend class WheelTimerThread;
+  WheelTimerThread *thread;
+
+  slot_t wheel[WHEEL_LEVELS][WHEEL_SIZE];
+  ceph::unordered_map<Context*, slot_t::iterator> events;
+  uint64_t cur_tick;   ///< the next tick to run
+  uint64_t wake_tick;  ///< when the thread will wake up; -1 if idle
+  bool stopping;
+
+  void timer_thread();
+
+  uint64_t time_to_tick(utime_t t) const;
+  utime_t tick_to_time(uint64_t tick) const;
+  slot_t *_get_slot(uint64_t tick);
+  void _cascade(unsigned level, uint64_t tick);
+  void _run_tick(uint64_t tick);
+  uint64_t _next_tick() const;
+
+public:
+  /* Safe callbacks determines whether callbacks are called with the lock
+   * held; see SafeTimer.
+   *
+   * tick is the resolution of the timer in seconds. */
+  WheelTimer(CephContext *cct, Mutex &l, bool safe_callbacks=true,
+	     double tick=.01);
+  ~WheelTimer();
+
+  /* Call with the event_lock UNLOCKED.
+   *
+   * Cancel all events and stop the timer thread.
+   *
+   * If there are any events that still have to run, they will need to take
+   * the event_lock first. */
+  void init();
+  void shutdown();
+
+  /* Schedule an event in the future
+   * Call with the event_lock LOCKED */
+  void add_event_after(double seconds, Context *callback);
+  void add_event_at(utime_t when, Context *callback);
+
+  /* Cancel an event.
+   * Call with the event_lock LOCKED
+   *
+   * Returns true if the callback was cancelled.
+   * Returns false if you never addded the callback in the first place.
+   */
+  bool cancel_event(Context *callback);
+
+  /* Cancel all events.
+   * Call with the event_lock LOCKED
+   *
+   * When this function returns, all events have been cancelled, and there are no
+   * more in progress.
+   */
+  void cancel_all_events();
+
+  /// number of pending events
+  size_t size() const {
+    return events.size();
+  }
+};
+#endif
@@ -156,6 +156,8 @@ void ThreadPool::start_threads()
     WorkThread *wt = new WorkThread(this);
     ldout(cct, 10) << "start_threads creating and starting " << wt << dendl;
     _threads.insert(wt);
+    if (!_cpus.empty())
+      wt->set_affinity(_cpus);
     wt->create();
   }
 }
@@ -255,3 +257,460 @@ void ThreadPool::drain(WorkQueue_* wq)
   _lock.Unlock();
 }
 
+
+int ThreadPool::set_affinity(const set<int> &cpus)
+{
+  ldout(cct,10) << "set_affinity " << cpus << dendl;
+  Mutex::Locker l(_lock);
+  _cpus = cpus;
+  for (set<WorkThread*>::iterator p = _threads.begin();
+       p != _threads.end();
+       ++p) {
+    int r = (*p)->set_affinity(cpus);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+ShardedThreadPool::ShardedThreadPool(CephContext *pcct_, string nm,
+				     uint32_t pnum_threads)
+  : cct(pcct_),
+    name(nm),
+    lockname(nm + "::lock"),
+    shardedpool_lock(lockname.c_str()),
+    num_threads(pnum_threads),
+    stop_threads(0),
+    pause_threads(0),
+    drain_threads(0),
+    num_paused(0),
+    num_drained(0),
+    wq(NULL)
+{
+}
+
+void ShardedThreadPool::shardedthreadpool_worker(uint32_t thread_index)
+{
+  assert(wq != NULL);
+  ldout(cct,10) << "worker start" << dendl;
+
+  std::stringstream ss;
+  ss << name << " thread " << (void*)pthread_self();
+  heartbeat_handle_d *hb = cct->get_heartbeat_map()->add_worker(ss.str());
+
+  while (!stop_threads.read()) {
+    if (pause_threads.read()) {
+      shardedpool_lock.Lock();
+      ++num_paused;
+      wait_cond.Signal();
+      while (pause_threads.read()) {
+	cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+	shardedpool_cond.WaitInterval(cct, shardedpool_lock, utime_t(2, 0));
+      }
+      --num_paused;
+      shardedpool_lock.Unlock();
+    }
+    if (drain_threads.read()) {
+      shardedpool_lock.Lock();
+      if (wq->is_shard_empty(thread_index)) {
+	++num_drained;
+	wait_cond.Signal();
+	while (drain_threads.read()) {
+	  cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+	  shardedpool_cond.WaitInterval(cct, shardedpool_lock, utime_t(2, 0));
+	}
+	--num_drained;
+      }
+      shardedpool_lock.Unlock();
+    }
+
+    cct->get_heartbeat_map()->reset_timeout(
+      hb, wq->timeout_interval, wq->suicide_interval);
+    wq->_process(thread_index, hb);
+  }
+
+  ldout(cct,10) << "sharded worker finish" << dendl;
+
+  cct->get_heartbeat_map()->remove_worker(hb);
+}
+
+void ShardedThreadPool::start_threads()
+{
+  assert(shardedpool_lock.is_locked());
+  uint32_t thread_index = 0;
+  while (threads_shardedpool.size() < num_threads) {
+    WorkThreadSharded *wt = new WorkThreadSharded(this, thread_index);
+    ldout(cct, 10) << "start_threads creating and starting " << wt << dendl;
+    threads_shardedpool.push_back(wt);
+    if (!cpus.empty())
+      wt->set_affinity(cpus);
+    wt->create();
+    thread_index++;
+  }
+}
+
+void ShardedThreadPool::start()
+{
+  ldout(cct,10) << "start" << dendl;
+
+  shardedpool_lock.Lock();
+  start_threads();
+  shardedpool_lock.Unlock();
+  ldout(cct,15) << "started" << dendl;
+}
+
+void ShardedThreadPool::stop()
+{
+  ldout(cct,10) << "stop" << dendl;
+  stop_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  for (vector<WorkThreadSharded*>::iterator p = threads_shardedpool.begin();
+       p != threads_shardedpool.end();
+       ++p) {
+    (*p)->join();
+    delete *p;
+  }
+  threads_shardedpool.clear();
+  ldout(cct,15) << "stopped" << dendl;
+}
+
+void ShardedThreadPool::pause()
+{
+  ldout(cct,10) << "pause" << dendl;
+  shardedpool_lock.Lock();
+  pause_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  while (num_threads != num_paused) {
+    wait_cond.Wait(shardedpool_lock);
+  }
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "paused" << dendl;
+}
+
+void ShardedThreadPool::pause_new()
+{
+  ldout(cct,10) << "pause_new" << dendl;
+  shardedpool_lock.Lock();
+  pause_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "paused_new" << dendl;
+}
+
+void ShardedThreadPool::unpause()
+{
+  ldout(cct,10) << "unpause" << dendl;
+  shardedpool_lock.Lock();
+  pause_threads.set(0);
+  shardedpool_cond.SignalAll();
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "unpaused" << dendl;
+}
+
+void ShardedThreadPool::drain()
+{
+  ldout(cct,10) << "drain" << dendl;
+  shardedpool_lock.Lock();
+  drain_threads.set(1);
+  assert(wq != NULL);
+  wq->return_waiting_threads();
+  while (num_threads != num_drained) {
+    wait_cond.Wait(shardedpool_lock);
+  }
+  drain_threads.set(0);
+  shardedpool_cond.SignalAll();
+  shardedpool_lock.Unlock();
+  ldout(cct,10) << "drained" << dendl;
+}
+
+
+int ShardedThreadPool::set_affinity(const set<int> &c)
+{
+  ldout(cct,10) << "set_affinity " << c << dendl;
+  Mutex::Locker l(shardedpool_lock);
+  cpus = c;
+  for (vector<WorkThreadSharded*>::iterator p = threads_shardedpool.begin();
+       p != threads_shardedpool.end();
+       ++p) {
+    int r = (*p)->set_affinity(cpus);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+StealingThreadPool::StealingThreadPool(CephContext *pcct_, string nm,
+				       uint32_t pnum_threads)
+  : cct(pcct_),
+    name(nm),
+    lockname(nm + "::lock"),
+    _lock(lockname.c_str()),
+    _stop(0),
+    _pause(0),
+    _draining(0),
+    pending(0),
+    processing(0),
+    idle(0),
+    next_hint(0),
+    num_threads(pnum_threads)
+{
+  assert(num_threads > 0);
+  for (uint32_t i = 0; i < num_threads; ++i) {
+    std::stringstream ss;
+    ss << name << "::worker_lock_" << i;
+    threads.push_back(new WorkThread(this, i, ss.str()));
+  }
+}
+
+StealingThreadPool::~StealingThreadPool()
+{
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p)
+    delete *p;
+}
+
+void StealingThreadPool::queue(WorkQueue_ *wq, void *item, unsigned hint)
+{
+  WorkThread *wt = threads[hint % num_threads];
+  wt->lock.Lock();
+  wt->q.push_back(item_t(wq, item));
+  pending.inc();
+  bool kicked = wt->waiting;
+  if (kicked) {
+    wt->waiting = false;
+    wt->cond.Signal();
+  }
+  // read under wt->lock: a worker that goes idle after this will find
+  // the item when it looks at wt->q
+  bool others_idle = idle.read();
+  wt->lock.Unlock();
+
+  // wt is busy; let someone else take it
+  if (!kicked && others_idle)
+    _wake_idle();
+}
+
+void StealingThreadPool::_wake_idle()
+{
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p) {
+    Mutex::Locker l((*p)->lock);
+    if ((*p)->waiting) {
+      (*p)->waiting = false;
+      (*p)->cond.Signal();
+      return;
+    }
+  }
+}
+
+bool StealingThreadPool::_pop(WorkThread *wt, item_t *out)
+{
+  Mutex::Locker l(wt->lock);
+  if (wt->q.empty())
+    return false;
+  *out = wt->q.front();
+  wt->q.pop_front();
+  return true;
+}
+
+bool StealingThreadPool::_steal(WorkThread *wt, bool block, item_t *out)
+{
+  for (uint32_t i = 1; i < num_threads; ++i) {
+    WorkThread *victim = threads[(wt->index + i) % num_threads];
+    if (block)
+      victim->lock.Lock();
+    else if (!victim->lock.TryLock())
+      continue;
+    if (!victim->q.empty()) {
+      *out = victim->q.back();
+      victim->q.pop_back();
+      victim->lock.Unlock();
+      ldout(cct,15) << "worker " << wt->index << " stole from "
+		    << victim->index << dendl;
+      return true;
+    }
+    victim->lock.Unlock();
+  }
+  return false;
+}
+
+void StealingThreadPool::worker(WorkThread *wt)
+{
+  ldout(cct,10) << "worker " << wt->index << " start" << dendl;
+
+  std::stringstream ss;
+  ss << name << " thread " << (void*)pthread_self();
+  heartbeat_handle_d *hb = cct->get_heartbeat_map()->add_worker(ss.str());
+
+  while (!_stop.read()) {
+    // count ourselves before looking at _pause, so that pause() either
+    // waits for us or we see it
+    processing.inc();
+    if (_pause.read()) {
+      processing.dec();
+      _lock.Lock();
+      _wait_cond.Signal();
+      while (_pause.read() && !_stop.read()) {
+	cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+	_pause_cond.WaitInterval(cct, _lock, utime_t(2, 0));
+      }
+      _lock.Unlock();
+      continue;
+    }
+
+    item_t item;
+    if (!_pop(wt, &item) && !_steal(wt, false, &item)) {
+      // declare ourselves idle before looking again, so that queue()
+      // either sees that or we see its item
+      wt->lock.Lock();
+      wt->waiting = true;
+      wt->lock.Unlock();
+      idle.inc();
+      bool got = _pop(wt, &item) || _steal(wt, true, &item);
+      if (!got) {
+	processing.dec();
+	if (_pause.read() || _draining.read()) {
+	  Mutex::Locker l(_lock);
+	  _wait_cond.Signal();
+	}
+	ldout(cct,20) << "worker " << wt->index << " waiting" << dendl;
+	cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+	wt->lock.Lock();
+	if (wt->waiting && wt->q.empty() && !_stop.read())
+	  wt->cond.WaitInterval(cct, wt->lock, utime_t(2, 0));
+	wt->waiting = false;
+	wt->lock.Unlock();
+	idle.dec();
+	continue;
+      }
+      wt->lock.Lock();
+      wt->waiting = false;
+      wt->lock.Unlock();
+      idle.dec();
+    }
+    pending.dec();
+
+    WorkQueue_ *wq = item.first;
+    ldout(cct,12) << "worker " << wt->index << " wq " << wq->name
+		  << " start processing " << item.second << dendl;
+    ThreadPool::TPHandle tp_handle(cct, hb, wq->timeout_interval,
+				   wq->suicide_interval);
+    tp_handle.reset_tp_timeout();
+    wq->_void_process(item.second, tp_handle);
+    ldout(cct,15) << "worker " << wt->index << " wq " << wq->name
+		  << " done processing " << item.second << dendl;
+    processing.dec();
+    if (_pause.read() || _draining.read()) {
+      Mutex::Locker l(_lock);
+      _wait_cond.Signal();
+    }
+  }
+
+  ldout(cct,10) << "worker " << wt->index << " finish" << dendl;
+
+  cct->get_heartbeat_map()->remove_worker(hb);
+}
+
+void StealingThreadPool::start()
+{
+  ldout(cct,10) << "start" << dendl;
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p) {
+    ldout(cct, 10) << "start creating and starting " << *p << dendl;
+    (*p)->create();
+  }
+  ldout(cct,15) << "started" << dendl;
+}
+
+void StealingThreadPool::stop()
+{
+  ldout(cct,10) << "stop" << dendl;
+  _stop.set(1);
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p) {
+    Mutex::Locker l((*p)->lock);
+    (*p)->waiting = false;
+    (*p)->cond.Signal();
+  }
+  _lock.Lock();
+  _pause_cond.SignalAll();
+  _lock.Unlock();
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p)
+    (*p)->join();
+
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p) {
+    while (!(*p)->q.empty()) {
+      item_t item = (*p)->q.front();
+      (*p)->q.pop_front();
+      pending.dec();
+      item.first->_void_discard(item.second);
+    }
+  }
+  _stop.set(0);
+  ldout(cct,15) << "stopped" << dendl;
+}
+
+void StealingThreadPool::pause()
+{
+  ldout(cct,10) << "pause" << dendl;
+  _lock.Lock();
+  _pause.inc();
+  while (processing.read())
+    _wait_cond.Wait(_lock);
+  _lock.Unlock();
+  ldout(cct,15) << "paused" << dendl;
+}
+
+void StealingThreadPool::pause_new()
+{
+  ldout(cct,10) << "pause_new" << dendl;
+  _lock.Lock();
+  _pause.inc();
+  _lock.Unlock();
+}
+
+void StealingThreadPool::unpause()
+{
+  ldout(cct,10) << "unpause" << dendl;
+  _lock.Lock();
+  assert(_pause.read() > 0);
+  _pause.dec();
+  _pause_cond.SignalAll();
+  _lock.Unlock();
+}
+
+void StealingThreadPool::drain()
+{
+  ldout(cct,10) << "drain" << dendl;
+  _lock.Lock();
+  _draining.inc();
+  while (pending.read() || processing.read())
+    _wait_cond.Wait(_lock);
+  _draining.dec();
+  _lock.Unlock();
+}
+
+int StealingThreadPool::set_affinity(const set<int> &cpus)
+{
+  ldout(cct,10) << "set_affinity " << cpus << dendl;
+  Mutex::Locker l(_lock);
+  for (vector<WorkThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p) {
+    int r = (*p)->set_affinity(cpus);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
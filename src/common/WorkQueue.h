@@ -20,6 +20,9 @@
 #include "Thread.h"
 #include "common/config_obs.h"
 #include "common/HeartbeatMap.h"
+#include "include/atomic.h"
+
+#include <deque>
 
 class CephContext;
 
@@ -41,13 +44,13 @@ public:
     heartbeat_handle_d *hb;
     time_t grace;
     time_t suicide_grace;
+  public:
     TPHandle(
       CephContext *cct,
       heartbeat_handle_d *hb,
       time_t grace,
       time_t suicide_grace)
       : cct(cct), hb(hb), grace(grace), suicide_grace(suicide_grace) {}
-  public:
     void reset_tp_timeout();
     void suspend_tp_timeout();
   };
@@ -322,6 +325,7 @@ private:
   set<WorkThread*> _threads;
   list<WorkThread*> _old_threads;  ///< need to be joined
   int processing;
+  set<int> _cpus;  ///< affinity for our threads; empty for none
 
   void start_threads();
   void join_old_threads();
@@ -388,6 +392,246 @@ public:
   void unpause();
   /// wait for all work to complete
   void drain(WorkQueue_* wq = 0);
+  /// bind our threads, current and future, to some cpus
+  int set_affinity(const set<int> &cpus);
+};
+
+/**
+ * Thread pool whose threads are statically bound to the shards of a
+ * single sharded work queue.
+ *
+ * Thread i only ever services shard (i % num_shards) of the queue, so
+ * each shard is protected by its own lock and there is no pool-wide
+ * lock on the enqueue/dequeue path.  The pool lock is only taken to
+ * coordinate pause/drain/stop.
+ */
+class ShardedThreadPool {
+
+  CephContext *cct;
+  string name;
+  string lockname;
+  Mutex shardedpool_lock;
+  Cond shardedpool_cond;
+  Cond wait_cond;
+  uint32_t num_threads;
+  atomic_t stop_threads;
+  atomic_t pause_threads;
+  atomic_t drain_threads;
+  uint32_t num_paused;
+  uint32_t num_drained;
+
+public:
+
+  class BaseShardedWQ {
+  public:
+    time_t timeout_interval, suicide_interval;
+    BaseShardedWQ(time_t ti, time_t sti)
+      : timeout_interval(ti), suicide_interval(sti) {}
+    virtual ~BaseShardedWQ() {}
+
+    /// process (at most) one item from the shard serviced by thread_index
+    virtual void _process(uint32_t thread_index, heartbeat_handle_d *hb) = 0;
+    /// kick all threads blocked waiting on an empty shard
+    virtual void return_waiting_threads() = 0;
+    virtual bool is_shard_empty(uint32_t thread_index) = 0;
+  };
+
+  template <typename T>
+  class ShardedWQ: public BaseShardedWQ {
+    ShardedThreadPool *sharded_pool;
+
+  protected:
+    virtual void _enqueue(T) = 0;
+    virtual void _enqueue_front(T) = 0;
+
+  public:
+    ShardedWQ(time_t ti, time_t sti, ShardedThreadPool *tp)
+      : BaseShardedWQ(ti, sti), sharded_pool(tp) {
+      tp->set_wq(this);
+    }
+    virtual ~ShardedWQ() {}
+
+    void queue(T item) {
+      _enqueue(item);
+    }
+    void queue_front(T item) {
+      _enqueue_front(item);
+    }
+    void drain() {
+      sharded_pool->drain();
+    }
+  };
+
+private:
+
+  BaseShardedWQ *wq;
+
+  // threads
+  struct WorkThreadSharded : public Thread {
+    ShardedThreadPool *pool;
+    uint32_t thread_index;
+    WorkThreadSharded(ShardedThreadPool *p, uint32_t pthread_index)
+      : pool(p), thread_index(pthread_index) {}
+    void *entry() {
+      pool->shardedthreadpool_worker(thread_index);
+      return 0;
+    }
+  };
+
+  vector<WorkThreadSharded*> threads_shardedpool;
+  set<int> cpus;  ///< affinity for our threads; empty for none
+  void start_threads();
+  void shardedthreadpool_worker(uint32_t thread_index);
+  void set_wq(BaseShardedWQ *swq) {
+    wq = swq;
+  }
+
+public:
+
+  ShardedThreadPool(CephContext *cct_, string nm, uint32_t pnum_threads);
+  ~ShardedThreadPool() {}
+
+  /// start thread pool thread
+  void start();
+  /// stop thread pool thread
+  void stop();
+  /// pause thread pool (if it not already paused)
+  void pause();
+  /// pause initiation of new work
+  void pause_new();
+  /// resume work in thread pool.  must match each pause() call 1:1 to resume.
+  void unpause();
+  /// wait for all work to complete
+  void drain();
+  /// bind our threads, current and future, to some cpus
+  int set_affinity(const set<int> &cpus);
+};
+
+/**
+ * Thread pool in which each worker has its own queue and steals from
+ * the others when that runs dry.
+ *
+ * Items are queued with an affinity hint and go to worker (hint %
+ * num_threads), so work for the same hint (e.g., an OpSequencer) keeps
+ * landing on the same thread and its cache.  A worker serves its own
+ * queue in FIFO order; an idle worker takes the newest item off the
+ * back of a busy worker's queue, so there is no ordering between items,
+ * even with the same hint.  Each queue has its own lock and there is
+ * no pool-wide lock on the enqueue/dequeue path.  The pool lock is only
+ * taken to coordinate pause/drain/stop.
+ */
+class StealingThreadPool {
+  CephContext *cct;
+  string name;
+  string lockname;
+  Mutex _lock;
+  Cond _wait_cond;
+  Cond _pause_cond;
+  atomic_t _stop;
+  atomic_t _pause;
+  atomic_t _draining;
+  atomic_t pending;     ///< items queued and not yet taken
+  atomic_t processing;  ///< items being processed, or about to be
+  atomic_t idle;        ///< workers asleep, or about to be
+  atomic_t next_hint;
+
+public:
+  struct WorkQueue_ {
+    string name;
+    time_t timeout_interval, suicide_interval;
+    WorkQueue_(string n, time_t ti, time_t sti)
+      : name(n), timeout_interval(ti), suicide_interval(sti)
+    { }
+    virtual ~WorkQueue_() {}
+    virtual void _void_process(void *item, ThreadPool::TPHandle &handle) = 0;
+    virtual void _void_discard(void *item) = 0;
+  };
+
+  /**
+   * A queue of T* served by a StealingThreadPool.  It must be drained
+   * before it is destroyed.
+   */
+  template<class T>
+  class WorkQueue : public WorkQueue_ {
+    StealingThreadPool *pool;
+
+    virtual void _process(T *t, ThreadPool::TPHandle &) = 0;
+    virtual void _process_finish(T *) {}
+    /// called for each item still queued when the pool is stopped
+    virtual void _discard(T *) {}
+
+    void _void_process(void *p, ThreadPool::TPHandle &handle) {
+      _process(static_cast<T *>(p), handle);
+      _process_finish(static_cast<T *>(p));
+    }
+    void _void_discard(void *p) {
+      _discard(static_cast<T *>(p));
+    }
+
+  public:
+    WorkQueue(string n, time_t ti, time_t sti, StealingThreadPool *p)
+      : WorkQueue_(n, ti, sti), pool(p) {}
+
+    /// queue item on the worker picked by hint
+    void queue(T *item, unsigned hint) {
+      pool->queue(this, item, hint);
+    }
+    /// queue item on the workers in turn
+    void queue(T *item) {
+      pool->queue(this, item, pool->next_hint.inc());
+    }
+    void drain() {
+      pool->drain();
+    }
+  };
+
+private:
+  typedef pair<WorkQueue_*, void*> item_t;
+
+  struct WorkThread : public Thread {
+    StealingThreadPool *pool;
+    unsigned index;
+    string lockname;
+    Mutex lock;
+    Cond cond;
+    deque<item_t> q;
+    bool waiting;   ///< asleep on cond, and nobody has kicked us yet
+    WorkThread(StealingThreadPool *p, unsigned i, const string &ln)
+      : pool(p), index(i), lockname(ln), lock(lockname.c_str()),
+	waiting(false) {}
+    void *entry() {
+      pool->worker(this);
+      return 0;
+    }
+  };
+
+  uint32_t num_threads;
+  vector<WorkThread*> threads;
+
+  void queue(WorkQueue_ *wq, void *item, unsigned hint);
+  bool _pop(WorkThread *wt, item_t *out);
+  bool _steal(WorkThread *wt, bool block, item_t *out);
+  void _wake_idle();
+  void worker(WorkThread *wt);
+
+public:
+  StealingThreadPool(CephContext *cct_, string nm, uint32_t pnum_threads);
+  ~StealingThreadPool();
+
+  /// start thread pool threads
+  void start();
+  /// stop thread pool threads, discarding anything still queued
+  void stop();
+  /// pause thread pool (if it not already paused)
+  void pause();
+  /// pause initiation of new work
+  void pause_new();
+  /// resume work in thread pool.  must match each pause() call 1:1 to resume.
+  void unpause();
+  /// wait for all work to complete
+  void drain();
+  /// bind our threads to some cpus
+  int set_affinity(const set<int> &cpus);
 };
 
 class GenContextWQ :
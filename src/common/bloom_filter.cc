@@ -135,3 +135,57 @@ void compressible_bloom_filter::generate_test_instances(list<compressible_bloom_
   ls.back()->compress(20);
   ls.back()->insert("boogggg");
 }
+
+
+void blocked_bloom_filter::encode(bufferlist& bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(num_hashes_, bl);
+  ::encode(seed_, bl);
+  ::encode(insert_count_, bl);
+  ::encode(target_element_count_, bl);
+  ::encode(num_blocks_, bl);
+  for (unsigned i = 0; i < num_blocks_ * BLOCK_WORDS; ++i)
+    ::encode(table_[i], bl);
+  ENCODE_FINISH(bl);
+}
+
+void blocked_bloom_filter::decode(bufferlist::iterator& p)
+{
+  DECODE_START(1, p);
+  ::decode(num_hashes_, p);
+  ::decode(seed_, p);
+  ::decode(insert_count_, p);
+  ::decode(target_element_count_, p);
+  if (num_hashes_ < 1 || num_hashes_ > MAX_HASHES)
+    throw buffer::malformed_input("blocked_bloom_filter: bad hash count");
+  uint32_t num_blocks;
+  ::decode(num_blocks, p);
+  ::free(table_);
+  num_blocks_ = num_blocks;
+  alloc_table();
+  for (unsigned i = 0; i < num_blocks_ * BLOCK_WORDS; ++i)
+    ::decode(table_[i], p);
+  DECODE_FINISH(p);
+}
+
+void blocked_bloom_filter::dump(Formatter *f) const
+{
+  f->dump_unsigned("num_hashes", num_hashes_);
+  f->dump_unsigned("seed", seed_);
+  f->dump_unsigned("insert_count", insert_count_);
+  f->dump_unsigned("target_element_count", target_element_count_);
+  f->dump_unsigned("num_blocks", num_blocks_);
+  f->dump_unsigned("bits_set", bits_set());
+}
+
+void blocked_bloom_filter::generate_test_instances(list<blocked_bloom_filter*>& ls)
+{
+  ls.push_back(new blocked_bloom_filter);
+  ls.push_back(new blocked_bloom_filter(10, .5, 1));
+  ls.back()->insert(123);
+  ls.back()->insert(456);
+  ls.push_back(new blocked_bloom_filter(1000, .01, 2));
+  uint32_t v[] = { 1, 2, 3, 0xdeadbeef };
+  ls.back()->insert_many(v, 4);
+}
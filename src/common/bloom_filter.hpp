@@ -25,8 +25,10 @@
 #include <cstddef>
 #include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <limits>
 #include <list>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -692,6 +694,216 @@ public:
 };
 WRITE_CLASS_ENCODER(compressible_bloom_filter)
 
+
+/**
+ * bloom filter that keeps all of a key's bits in one cache line
+ *
+ * The table is an array of 512-bit blocks.  A key picks its block with
+ * one hash and its k bits within the block by double hashing (a + i*b),
+ * so insert and contains touch one cache line however large k is.  The
+ * bits are gathered into a block-sized mask first and applied word by
+ * word without branches, which the compiler turns into vector ops.
+ * This costs ~1.4 bits per element more than bloom_filter for the same fpp.
+ *
+ * Keys are u32s that are already well mixed (e.g., hobject_t::hash).
+ */
+class blocked_bloom_filter
+{
+public:
+  static const unsigned BLOCK_BITS = 512;
+  static const unsigned BLOCK_WORDS = BLOCK_BITS / 64;
+  static const unsigned MAX_HASHES = 16;
+
+private:
+  uint64_t *table_;            ///< num_blocks_ * BLOCK_WORDS, line aligned
+  uint32_t num_blocks_;
+  uint32_t num_hashes_;
+  uint32_t seed_;
+  uint32_t insert_count_;
+  uint32_t target_element_count_;
+
+  void alloc_table() {
+    table_ = NULL;
+    if (num_blocks_) {
+      void *p;
+      if (::posix_memalign(&p, BLOCK_BITS / 8,
+			   num_blocks_ * BLOCK_WORDS * sizeof(uint64_t)))
+	throw std::bad_alloc();
+      table_ = static_cast<uint64_t*>(p);
+      std::fill_n(table_, num_blocks_ * BLOCK_WORDS, 0);
+    }
+  }
+
+  uint64_t mix(uint32_t val) const {
+    // murmur3 fmix64
+    uint64_t h = ((uint64_t)seed_ << 32) | val;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+  uint64_t *block_of(uint64_t h) const {
+    // (low 32 bits * num_blocks) >> 32 spreads like %, without a divide
+    return table_ + (((h & 0xffffffffull) * num_blocks_) >> 32) * BLOCK_WORDS;
+  }
+  void make_mask(uint64_t h, uint64_t *mask) const {
+    for (unsigned w = 0; w < BLOCK_WORDS; ++w)
+      mask[w] = 0;
+    uint32_t a = h >> 32;
+    uint32_t b = (a >> 9) | 1;
+    for (unsigned i = 0; i < num_hashes_; ++i) {
+      uint32_t bit = (a + i * b) & (BLOCK_BITS - 1);
+      mask[bit >> 6] |= 1ull << (bit & 63);
+    }
+  }
+
+public:
+  blocked_bloom_filter()
+    : table_(NULL), num_blocks_(0), num_hashes_(1), seed_(0),
+      insert_count_(0), target_element_count_(0) {}
+
+  blocked_bloom_filter(std::size_t predicted_element_count,
+		       double false_positive_probability,
+		       std::size_t random_seed)
+    : seed_(random_seed),
+      insert_count_(0),
+      target_element_count_(predicted_element_count)
+  {
+    assert(false_positive_probability > 0.0);
+    double n = predicted_element_count ? predicted_element_count : 1;
+    // blocks fill unevenly, which raises the fpp (most at low targets);
+    // size for half
+    double m = std::ceil(-n * std::log(false_positive_probability / 2) /
+			 (M_LN2 * M_LN2));
+    num_blocks_ = (uint32_t)((m + BLOCK_BITS - 1) / BLOCK_BITS);
+    num_hashes_ = std::max(1u, std::min(MAX_HASHES,
+					(unsigned)(M_LN2 * m / n + .5)));
+    alloc_table();
+  }
+
+  blocked_bloom_filter(const blocked_bloom_filter& o)
+    : table_(NULL) {
+    *this = o;
+  }
+
+  blocked_bloom_filter& operator=(const blocked_bloom_filter& o) {
+    if (this != &o) {
+      ::free(table_);
+      num_blocks_ = o.num_blocks_;
+      num_hashes_ = o.num_hashes_;
+      seed_ = o.seed_;
+      insert_count_ = o.insert_count_;
+      target_element_count_ = o.target_element_count_;
+      alloc_table();
+      std::copy(o.table_, o.table_ + num_blocks_ * BLOCK_WORDS, table_);
+    }
+    return *this;
+  }
+
+  ~blocked_bloom_filter() {
+    ::free(table_);
+  }
+
+  void clear() {
+    std::fill_n(table_, num_blocks_ * BLOCK_WORDS, 0);
+    insert_count_ = 0;
+  }
+
+  void insert(uint32_t val) {
+    ++insert_count_;
+    if (!num_blocks_)
+      return;
+    uint64_t h = mix(val);
+    uint64_t *block = block_of(h);
+    uint64_t mask[BLOCK_WORDS];
+    make_mask(h, mask);
+    for (unsigned w = 0; w < BLOCK_WORDS; ++w)
+      block[w] |= mask[w];
+  }
+
+  /**
+   * insert a batch of values
+   *
+   * Prefetch all of the blocks before touching any of them, so the cache
+   * misses overlap instead of being taken one at a time.
+   */
+  void insert_many(const uint32_t *vals, std::size_t count) {
+    static const std::size_t BATCH = 16;
+    uint64_t h[BATCH];
+    for (std::size_t i = 0; i < count; i += BATCH) {
+      std::size_t n = std::min(BATCH, count - i);
+      for (std::size_t j = 0; j < n; ++j) {
+	h[j] = mix(vals[i + j]);
+	if (num_blocks_)
+	  __builtin_prefetch(block_of(h[j]), 1);
+      }
+      for (std::size_t j = 0; j < n; ++j) {
+	++insert_count_;
+	if (!num_blocks_)
+	  continue;
+	uint64_t *block = block_of(h[j]);
+	uint64_t mask[BLOCK_WORDS];
+	make_mask(h[j], mask);
+	for (unsigned w = 0; w < BLOCK_WORDS; ++w)
+	  block[w] |= mask[w];
+      }
+    }
+  }
+
+  bool contains(uint32_t val) const {
+    if (!num_blocks_)
+      return false;
+    uint64_t h = mix(val);
+    const uint64_t *block = block_of(h);
+    uint64_t mask[BLOCK_WORDS];
+    make_mask(h, mask);
+    uint64_t missing = 0;
+    for (unsigned w = 0; w < BLOCK_WORDS; ++w)
+      missing |= mask[w] & ~block[w];
+    return !missing;
+  }
+
+  std::size_t size() const {
+    return (std::size_t)num_blocks_ * BLOCK_BITS;
+  }
+  std::size_t element_count() const {
+    return insert_count_;
+  }
+  std::size_t hash_count() const {
+    return num_hashes_;
+  }
+  bool is_full() const {
+    return insert_count_ >= target_element_count_;
+  }
+
+  std::size_t bits_set() const {
+    std::size_t set = 0;
+    for (std::size_t i = 0; i < num_blocks_ * BLOCK_WORDS; ++i)
+      set += __builtin_popcountll(table_[i]);
+    return set;
+  }
+  double density() const {
+    if (!num_blocks_)
+      return 0;
+    return (double)bits_set() / (double)size();
+  }
+  double approx_unique_element_count() const {
+    double m = size();
+    double set = bits_set();
+    if (set >= m)
+      return insert_count_;
+    return -m / num_hashes_ * std::log(1.0 - set / m);
+  }
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(std::list<blocked_bloom_filter*>& ls);
+};
+WRITE_CLASS_ENCODER(blocked_bloom_filter)
+
 #endif
 
 
@@ -16,6 +16,8 @@
 #include "armor.h"
 #include "common/environment.h"
 #include "common/errno.h"
+#include "common/Formatter.h"
+#include "common/mempool.h"
 #include "common/safe_io.h"
 #include "common/simple_spin.h"
 #include "common/strtol.h"
@@ -29,6 +31,7 @@
 #include <sstream>
 #include <sys/uio.h>
 #include <limits.h>
+#include <pthread.h>
 
 namespace ceph {
 
@@ -44,11 +47,14 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
   atomic_t buffer_total_alloc;
   bool buffer_track_alloc = get_env_bool("CEPH_BUFFER_TRACK");
 
+  // every raw calls these once as it is created and destroyed
   void buffer::inc_total_alloc(unsigned len) {
+    mempool::get_pool(mempool::mempool_buffer_anon).adjust(len, 1);
     if (buffer_track_alloc)
       buffer_total_alloc.add(len);
   }
   void buffer::dec_total_alloc(unsigned len) {
+    mempool::get_pool(mempool::mempool_buffer_anon).adjust(-(ssize_t)len, -1);
     if (buffer_track_alloc)
       buffer_total_alloc.sub(len);
   }
@@ -80,6 +86,26 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     return buffer_c_str_accesses.read();
   }
 
+  atomic_t buffer_rebuilds;
+  atomic_t buffer_rebuild_bytes;
+  bool buffer_track_rebuilds = get_env_bool("CEPH_BUFFER_TRACK");
+
+  void buffer::track_rebuilds(bool b) {
+    buffer_track_rebuilds = b;
+  }
+  int buffer::get_rebuilds() {
+    return buffer_rebuilds.read();
+  }
+  int buffer::get_rebuild_bytes() {
+    return buffer_rebuild_bytes.read();
+  }
+  static void note_rebuild(unsigned len) {
+    if (buffer_track_rebuilds) {
+      buffer_rebuilds.inc();
+      buffer_rebuild_bytes.add(len);
+    }
+  }
+
   atomic_t buffer_max_pipe_size;
   int update_max_pipe_size() {
 #ifdef CEPH_HAVE_SETPIPE_SZ
@@ -172,6 +198,30 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
       Spinlock::Locker l(crc_lock);
       crc_map[fromto] = crc;
     }
+    /*
+     * Extend *crc over the longest run of cached pieces that tile
+     * [from, to) from the start, e.g. the blocks a SloppyCRCMap summed
+     * before the whole range is summed for the journal.  Returns where
+     * the run ends.
+     */
+    size_t get_crc_run(size_t from, size_t to, uint32_t *crc) const {
+      Spinlock::Locker l(crc_lock);
+      size_t pos = from;
+      while (pos < to) {
+	// the longest piece starting at pos that fits: the last key <= (pos, to)
+	map<pair<size_t, size_t>, pair<uint32_t, uint32_t> >::const_iterator i =
+	  crc_map.upper_bound(make_pair(pos, to));
+	if (i == crc_map.begin())
+	  break;
+	--i;
+	if (i->first.first != pos)
+	  break;
+	*crc = i->second.second ^
+	  ceph_crc32c_zeros(i->second.first ^ *crc, i->first.second - pos);
+	pos = i->first.second;
+      }
+      return pos;
+    }
     void invalidate_crc() {
       Spinlock::Locker l(crc_lock);
       crc_map.clear();
@@ -496,12 +546,263 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     }
   };
 
+  /*
+   * pool for small buffers
+   *
+   * A raw_pooled and its data share one block, taken from a size class
+   * of POOL_CLASSES power-of-two sizes.  Freed blocks go on a per-thread
+   * list and move to and from a shared per-class list in batches, so
+   * the common case takes no lock.  Both are capped; beyond that blocks
+   * go back to malloc.  Set CEPH_BUFFER_NO_POOL to allocate every
+   * buffer separately, e.g. for valgrind.
+   *
+   * Everything here is plain data so that it works from global
+   * constructors.
+   */
+  static const unsigned POOL_MIN_SHIFT = 7;  // 128 bytes
+  static const unsigned POOL_CLASSES = 6;    // ... 4096 bytes
+  static const unsigned POOL_HDR = 16;       // class id; keeps data aligned
+  static const unsigned POOL_BATCH = 32;     // blocks moved at once
+  static const unsigned POOL_THREAD_MAX = 2 * POOL_BATCH;  // per class
+  static const unsigned POOL_SHARED_MAX_BYTES = 4 << 20;   // per class
+
+  bool buffer_pool_disabled = get_env_bool("CEPH_BUFFER_NO_POOL");
+
+  struct pool_block_t {
+    pool_block_t *next;
+  };
+
+  struct pool_class_t {
+    simple_spinlock_t lock;
+    pool_block_t *head;
+    unsigned count;     ///< blocks on head
+    uint64_t sys_alloc; ///< blocks from malloc, ever (atomic)
+    uint64_t sys_free;  ///< blocks returned to malloc, ever (atomic)
+  };
+  static pool_class_t pool_classes[POOL_CLASSES];
+
+  struct pool_thread_cache_t {
+    pool_block_t *head[POOL_CLASSES];
+    unsigned count[POOL_CLASSES];
+    pool_thread_cache_t *prev, *next;  ///< on pool_caches
+  };
+  static simple_spinlock_t pool_caches_lock = SIMPLE_SPINLOCK_INITIALIZER;
+  static pool_thread_cache_t *pool_caches;
+  static __thread pool_thread_cache_t *pool_cache;
+  static pthread_key_t pool_cache_key;
+  static pthread_once_t pool_cache_once = PTHREAD_ONCE_INIT;
+
+  static inline unsigned pool_class_size(unsigned c) {
+    return 1u << (POOL_MIN_SHIFT + c);
+  }
+
+  static void pool_push_shared(unsigned c, pool_block_t *b)
+  {
+    pool_class_t &pc = pool_classes[c];
+    if (pc.count * pool_class_size(c) >= POOL_SHARED_MAX_BYTES) {
+      ::free(b);
+      __sync_fetch_and_add(&pc.sys_free, 1);
+      return;
+    }
+    b->next = pc.head;
+    pc.head = b;
+    pc.count++;
+  }
+
+  static void pool_flush(pool_thread_cache_t *tc, unsigned c, unsigned n)
+  {
+    pool_class_t &pc = pool_classes[c];
+    simple_spin_lock(&pc.lock);
+    while (n-- && tc->head[c]) {
+      pool_block_t *b = tc->head[c];
+      tc->head[c] = b->next;
+      tc->count[c]--;
+      pool_push_shared(c, b);
+    }
+    simple_spin_unlock(&pc.lock);
+  }
+
+  static void pool_cache_destroy(void *p)
+  {
+    pool_thread_cache_t *tc = (pool_thread_cache_t *)p;
+    for (unsigned c = 0; c < POOL_CLASSES; ++c)
+      pool_flush(tc, c, tc->count[c]);
+    simple_spin_lock(&pool_caches_lock);
+    if (tc->prev)
+      tc->prev->next = tc->next;
+    else
+      pool_caches = tc->next;
+    if (tc->next)
+      tc->next->prev = tc->prev;
+    simple_spin_unlock(&pool_caches_lock);
+    if (pool_cache == tc)
+      pool_cache = NULL;
+    ::free(tc);
+  }
+
+  static void pool_cache_key_create()
+  {
+    pthread_key_create(&pool_cache_key, pool_cache_destroy);
+  }
+
+  static pool_thread_cache_t *pool_get_cache()
+  {
+    if (pool_cache)
+      return pool_cache;
+    pthread_once(&pool_cache_once, pool_cache_key_create);
+    pool_thread_cache_t *tc =
+      (pool_thread_cache_t *)calloc(1, sizeof(pool_thread_cache_t));
+    if (!tc)
+      return NULL;
+    // flushed back when the thread exits
+    pthread_setspecific(pool_cache_key, tc);
+    simple_spin_lock(&pool_caches_lock);
+    tc->next = pool_caches;
+    if (pool_caches)
+      pool_caches->prev = tc;
+    pool_caches = tc;
+    simple_spin_unlock(&pool_caches_lock);
+    pool_cache = tc;
+    return tc;
+  }
+
+  /// a block for a raw_pooled with len bytes of data, or NULL if too big
+  static char *pool_alloc(unsigned len, unsigned raw_size)
+  {
+    unsigned need = POOL_HDR + raw_size + len;
+    unsigned c = 0;
+    while (c < POOL_CLASSES && pool_class_size(c) < need)
+      ++c;
+    if (c == POOL_CLASSES)
+      return NULL;
+
+    pool_block_t *b = NULL;
+    pool_thread_cache_t *tc = pool_get_cache();
+    if (tc) {
+      if (!tc->head[c]) {
+	pool_class_t &pc = pool_classes[c];
+	simple_spin_lock(&pc.lock);
+	for (unsigned n = 0; n < POOL_BATCH && pc.head; ++n) {
+	  pool_block_t *t = pc.head;
+	  pc.head = t->next;
+	  pc.count--;
+	  t->next = tc->head[c];
+	  tc->head[c] = t;
+	  tc->count[c]++;
+	}
+	simple_spin_unlock(&pc.lock);
+      }
+      if (tc->head[c]) {
+	b = tc->head[c];
+	tc->head[c] = b->next;
+	tc->count[c]--;
+      }
+    }
+    if (!b) {
+      b = (pool_block_t *)malloc(pool_class_size(c));
+      if (!b)
+	throw bad_alloc();
+      __sync_fetch_and_add(&pool_classes[c].sys_alloc, 1);
+    }
+    *(uint32_t *)b = c;
+    return (char *)b + POOL_HDR;
+  }
+
+  static void pool_free(void *p)
+  {
+    pool_block_t *b = (pool_block_t *)((char *)p - POOL_HDR);
+    unsigned c = *(uint32_t *)b;
+    assert(c < POOL_CLASSES);
+    pool_thread_cache_t *tc = pool_get_cache();
+    if (!tc) {
+      pool_class_t &pc = pool_classes[c];
+      simple_spin_lock(&pc.lock);
+      pool_push_shared(c, b);
+      simple_spin_unlock(&pc.lock);
+      return;
+    }
+    b->next = tc->head[c];
+    tc->head[c] = b;
+    if (++tc->count[c] > POOL_THREAD_MAX)
+      pool_flush(tc, c, POOL_BATCH);
+  }
+
+  void buffer::dump_pool(Formatter *f)
+  {
+    unsigned thread_cached[POOL_CLASSES];
+    memset(thread_cached, 0, sizeof(thread_cached));
+    unsigned threads = 0;
+    // racy reads of other threads' counts; good enough for stats
+    simple_spin_lock(&pool_caches_lock);
+    for (pool_thread_cache_t *tc = pool_caches; tc; tc = tc->next) {
+      ++threads;
+      for (unsigned c = 0; c < POOL_CLASSES; ++c)
+	thread_cached[c] += tc->count[c];
+    }
+    simple_spin_unlock(&pool_caches_lock);
+
+    f->dump_bool("enabled", !buffer_pool_disabled);
+    f->dump_unsigned("threads", threads);
+    f->open_array_section("classes");
+    for (unsigned c = 0; c < POOL_CLASSES; ++c) {
+      pool_class_t &pc = pool_classes[c];
+      simple_spin_lock(&pc.lock);
+      unsigned shared = pc.count;
+      simple_spin_unlock(&pc.lock);
+      uint64_t total = pc.sys_alloc - pc.sys_free;
+      uint64_t cached = shared + thread_cached[c];
+      f->open_object_section("class");
+      f->dump_unsigned("block_size", pool_class_size(c));
+      f->dump_unsigned("in_use", total > cached ? total - cached : 0);
+      f->dump_unsigned("cached_shared", shared);
+      f->dump_unsigned("cached_thread", thread_cached[c]);
+      f->dump_unsigned("malloc", pc.sys_alloc);
+      f->dump_unsigned("free", pc.sys_free);
+      f->close_section();
+    }
+    f->close_section();
+  }
+
+  class buffer::raw_pooled : public buffer::raw {
+  public:
+    // data follows the object in the same block
+    static unsigned get_size() {
+      return (sizeof(raw_pooled) + 15) & ~15;
+    }
+    static raw *create(unsigned len) {
+      if (buffer_pool_disabled)
+	return NULL;
+      char *p = pool_alloc(len, get_size());
+      if (!p)
+	return NULL;
+      return ::new (p) raw_pooled(len, p + get_size());
+    }
+
+    raw_pooled(unsigned l, char *d) : raw(d, l) {
+      inc_total_alloc(len);
+      bdout << "raw_pooled " << this << " alloc " << (void *)data << " " << l << " " << buffer::get_total_alloc() << bendl;
+    }
+    ~raw_pooled() {
+      dec_total_alloc(len);
+      bdout << "raw_pooled " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+    static void operator delete(void *p) {
+      pool_free(p);
+    }
+    raw* clone_empty() {
+      return buffer::create(len);
+    }
+  };
+
   buffer::raw* buffer::copy(const char *c, unsigned len) {
-    raw* r = new raw_char(len);
+    raw* r = create(len);
     memcpy(r->data, c, len);
     return r;
   }
   buffer::raw* buffer::create(unsigned len) {
+    raw *r = raw_pooled::create(len);
+    if (r)
+      return r;
     return new raw_char(len);
   }
   buffer::raw* buffer::claim_char(unsigned len, char *buf) {
@@ -715,6 +1016,12 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     memcpy(c_str()+o, src, l);
   }
 
+  void buffer::ptr::invalidate_crc()
+  {
+    if (_raw)
+      _raw->invalidate_crc();
+  }
+
   void buffer::ptr::zero()
   {
     _raw->invalidate_crc();
@@ -820,6 +1127,64 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     return ptr(*p, p_off, p->length() - p_off);
   }
   
+  buffer::ptr buffer::list::iterator::get_contiguous(unsigned len)
+  {
+    if (p == ls->end())
+      seek(off);
+    if (len && p != ls->end() && p->length() - p_off >= len) {
+      ptr r(*p, p_off, len);
+      advance(len);
+      return r;
+    }
+    if (len)
+      note_rebuild(len);
+    ptr r;
+    copy(len, r);
+    return r;
+  }
+
+  unsigned buffer::list::iterator::get_ptr_and_advance(unsigned want,
+						       const char **data)
+  {
+    if (p == ls->end())
+      seek(off);
+    if (want == 0)
+      return 0;
+    if (p == ls->end())
+      throw end_of_buffer();
+    unsigned howmuch = p->length() - p_off;
+    if (want < howmuch)
+      howmuch = want;
+    *data = p->c_str() + p_off;
+    advance(howmuch);
+    return howmuch;
+  }
+
+  uint32_t buffer::list::iterator::crc32c(unsigned len, uint32_t crc)
+  {
+    while (len > 0) {
+      const char *data;
+      unsigned l = get_ptr_and_advance(len, &data);
+      crc = ceph_crc32c(crc, (unsigned char*)data, l);
+      len -= l;
+    }
+    return crc;
+  }
+
+  int buffer::list::iterator::cmp(unsigned len, const char *buf)
+  {
+    while (len > 0) {
+      const char *data;
+      unsigned l = get_ptr_and_advance(len, &data);
+      int r = memcmp(data, buf, l);
+      if (r)
+	return r;
+      buf += l;
+      len -= l;
+    }
+    return 0;
+  }
+
   // copy data out.
   // note that these all _append_ to dest!
   
@@ -954,6 +1319,75 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
     other.last_p = other.begin();
   }
 
+  /*
+   * compare len bytes starting at offset o of segment p; the caller
+   * makes sure they are there.
+   */
+  static int segments_cmp(std::list<buffer::ptr>::const_iterator p, unsigned o,
+			  const char *buf, unsigned len)
+  {
+    while (len > 0) {
+      unsigned l = p->length() - o;
+      if (l > len)
+	l = len;
+      int r = memcmp(p->c_str() + o, buf, l);
+      if (r)
+	return r;
+      buf += l;
+      len -= l;
+      o = 0;
+      ++p;
+    }
+    return 0;
+  }
+
+  bool buffer::list::contents_equal(const char *buf, unsigned len) const
+  {
+    if (len != _len)
+      return false;
+    return len == 0 || segments_cmp(_buffers.begin(), 0, buf, len) == 0;
+  }
+
+  int buffer::list::find(const char *needle, unsigned len, unsigned off) const
+  {
+    if (off > _len || len > _len - off)
+      return -1;
+    if (len == 0)
+      return off;
+
+    std::list<ptr>::const_iterator p = _buffers.begin();
+    unsigned pos = 0;  // of *p in the list
+    while (pos + p->length() <= off) {
+      pos += p->length();
+      ++p;
+    }
+    unsigned last = _len - len;  // last offset a match can start at
+    while (off <= last) {
+      // look for the first byte in this segment, then check the rest
+      unsigned o = off - pos;
+      unsigned n = p->length() - o;
+      if (n > last - off + 1)
+	n = last - off + 1;
+      const char *start = p->c_str() + o;
+      const char *c = (const char *)memchr(start, needle[0], n);
+      if (!c) {
+	off += n;
+	pos += p->length();
+	++p;
+	continue;
+      }
+      off += c - start;
+      if (segments_cmp(p, off - pos, needle, len) == 0)
+	return off;
+      ++off;
+      if (off - pos == p->length()) {
+	pos += p->length();
+	++p;
+      }
+    }
+    return -1;
+  }
+
   bool buffer::list::contents_equal(ceph::buffer::list& other)
   {
     if (length() != other.length())
@@ -1086,6 +1520,7 @@ static uint32_t simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZE
 
   void buffer::list::rebuild(ptr& nb)
   {
+    note_rebuild(_len);
     unsigned pos = 0;
     for (std::list<ptr>::iterator it = _buffers.begin();
 	 it != _buffers.end();
@@ -1291,6 +1726,15 @@ void buffer::list::rebuild_page_aligned()
     append(bp);
   }
 
+  void buffer::list::reserve(unsigned len)
+  {
+    if (append_buffer.unused_tail_length() >= len)
+      return;
+    unsigned alen = CEPH_PAGE_SIZE * (((len-1) / CEPH_PAGE_SIZE) + 1);
+    append_buffer = create_page_aligned(alen);
+    append_buffer.set_length(0);   // unused, so far.
+  }
+
   
   /*
    * get a char
@@ -1650,6 +2094,14 @@ int buffer::list::write_fd_zero_copy(int fd) const
   return 0;
 }
 
+void buffer::list::invalidate_crc()
+{
+  for (std::list<ptr>::iterator it = _buffers.begin();
+       it != _buffers.end();
+       ++it)
+    it->invalidate_crc();
+}
+
 __u32 buffer::list::crc32c(__u32 crc) const
 {
   for (std::list<ptr>::const_iterator it = _buffers.begin();
@@ -1674,13 +2126,18 @@ __u32 buffer::list::crc32c(__u32 crc) const
 	   * http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
 	   * note, u for our crc32c implementation is 0
 	   */
-	  crc = ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, it->length());
+	  crc = ccrc.second ^ ceph_crc32c_zeros(ccrc.first ^ crc, it->length());
 	  if (buffer_track_crc)
 	    buffer_cached_crc_adjusted.inc();
 	}
       } else {
 	uint32_t base = crc;
-	crc = ceph_crc32c(crc, (unsigned char*)it->c_str(), it->length());
+	size_t pos = r->get_crc_run(ofs.first, ofs.second, &crc);
+	if (pos > ofs.first && buffer_track_crc)
+	  buffer_cached_crc_adjusted.inc();
+	if (pos < ofs.second)
+	  crc = ceph_crc32c(crc, (unsigned char*)it->c_str() + (pos - ofs.first),
+			    ofs.second - pos);
 	r->set_crc(ofs, make_pair(base, crc));
       }
     }
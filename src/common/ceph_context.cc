@@ -28,6 +28,7 @@
 #include "auth/Crypto.h"
 #include "include/str_list.h"
 #include "common/Mutex.h"
+#include "common/mempool.h"
 #include "common/Cond.h"
 
 #include <iostream>
@@ -153,6 +154,33 @@ public:
 };
 
 
+/**
+ * observe mutex config changes
+ *
+ * Mutexes are mostly created without a CephContext, so their tunables
+ * are process-wide globals, as with lockdep.
+ */
+class MutexObs : public md_config_obs_t {
+public:
+  const char** get_tracked_conf_keys() const {
+    static const char *KEYS[] = {
+      "mutex_perf_profile",
+      "mutex_spin_max",
+      NULL
+    };
+    return KEYS;
+  }
+
+  void handle_conf_change(const md_config_t *conf,
+                          const std::set <std::string> &changed) {
+    if (changed.count("mutex_perf_profile"))
+      g_mutex_profile = conf->mutex_perf_profile;
+    if (changed.count("mutex_spin_max"))
+      g_mutex_spin_max = conf->mutex_spin_max;
+  }
+};
+
+
 // perfcounter hooks
 
 class CephContextHook : public AdminSocketHook {
@@ -195,6 +223,16 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
     if (command == "config show") {
       _conf->show_config(f);
     }
+    else if (command == "perf reset") {
+      std::string var;
+      if (!cmd_getval(this, cmdmap, "var", var)) {
+	f->dump_string("error", "syntax error: 'perf reset <var>'");
+      } else if (!_perf_counters_collection->reset(var)) {
+	f->dump_stream("error") << "no perf counters named " << var;
+      } else {
+	f->dump_string("success", command + " " + var);
+      }
+    }
     else if (command == "config set") {
       std::string var;
       std::vector<std::string> val;
@@ -238,6 +276,15 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
     else if (command == "log reopen") {
       _log->reopen_log_file();
     }
+    else if (command == "buffer pool dump") {
+      buffer::dump_pool(f);
+    }
+    else if (command == "dump_lock_stats") {
+      mutex_stats_dump(f);
+    }
+    else if (command == "dump_mempools") {
+      mempool::dump(f);
+    }
     else {
       assert(0 == "registered under wrong command?");    
     }
@@ -257,6 +304,7 @@ CephContext::CephContext(uint32_t module_type_)
     _module_type(module_type_),
     _service_thread(NULL),
     _log_obs(NULL),
+    _mutex_obs(NULL),
     _admin_socket(NULL),
     _perf_counters_collection(NULL),
     _perf_counters_conf_obs(NULL),
@@ -272,6 +320,9 @@ CephContext::CephContext(uint32_t module_type_)
   _log_obs = new LogObs(_log);
   _conf->add_observer(_log_obs);
 
+  _mutex_obs = new MutexObs;
+  _conf->add_observer(_mutex_obs);
+
   _perf_counters_collection = new PerfCountersCollection(this);
   _admin_socket = new AdminSocket(this);
   _heartbeat_map = new HeartbeatMap(this);
@@ -283,12 +334,16 @@ CephContext::CephContext(uint32_t module_type_)
   _admin_socket->register_command("perfcounters_schema", "perfcounters_schema", _admin_hook, "");
   _admin_socket->register_command("2", "2", _admin_hook, "");
   _admin_socket->register_command("perf schema", "perf schema", _admin_hook, "dump perfcounters schema");
+  _admin_socket->register_command("perf reset", "perf reset name=var,type=CephString", _admin_hook, "perf reset <name>: zero the counters and histograms of perf counter set <name>, or of all sets for 'all'");
   _admin_socket->register_command("config show", "config show", _admin_hook, "dump current config settings");
   _admin_socket->register_command("config set", "config set name=var,type=CephString name=val,type=CephString,n=N",  _admin_hook, "config set <field> <val> [<val> ...]: set a config variable");
   _admin_socket->register_command("config get", "config get name=var,type=CephString", _admin_hook, "config get <field>: get the config value");
   _admin_socket->register_command("log flush", "log flush", _admin_hook, "flush log entries to log file");
   _admin_socket->register_command("log dump", "log dump", _admin_hook, "dump recent log entries to log file");
   _admin_socket->register_command("log reopen", "log reopen", _admin_hook, "reopen log file");
+  _admin_socket->register_command("buffer pool dump", "buffer pool dump", _admin_hook, "dump usage of the small buffer pool");
+  _admin_socket->register_command("dump_lock_stats", "dump_lock_stats", _admin_hook, "dump wait times of contended mutexes (see mutex_perf_profile)");
+  _admin_socket->register_command("dump_mempools", "dump_mempools", _admin_hook, "dump memory allocated by each subsystem");
 
   _crypto_none = new CryptoNone;
   _crypto_aes = new CryptoAES;
@@ -307,6 +362,7 @@ CephContext::~CephContext()
   _admin_socket->unregister_command("1");
   _admin_socket->unregister_command("perfcounters_schema");
   _admin_socket->unregister_command("perf schema");
+  _admin_socket->unregister_command("perf reset");
   _admin_socket->unregister_command("2");
   _admin_socket->unregister_command("config show");
   _admin_socket->unregister_command("config set");
@@ -314,6 +370,9 @@ CephContext::~CephContext()
   _admin_socket->unregister_command("log flush");
   _admin_socket->unregister_command("log dump");
   _admin_socket->unregister_command("log reopen");
+  _admin_socket->unregister_command("buffer pool dump");
+  _admin_socket->unregister_command("dump_lock_stats");
+  _admin_socket->unregister_command("dump_mempools");
   delete _admin_hook;
   delete _admin_socket;
 
@@ -325,6 +384,10 @@ CephContext::~CephContext()
   delete _perf_counters_conf_obs;
   _perf_counters_conf_obs = NULL;
 
+  _conf->remove_observer(_mutex_obs);
+  delete _mutex_obs;
+  _mutex_obs = NULL;
+
   _conf->remove_observer(_log_obs);
   delete _log_obs;
   _log_obs = NULL;
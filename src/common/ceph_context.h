@@ -122,6 +122,7 @@ private:
   CephContextServiceThread *_service_thread;
 
   md_config_obs_t *_log_obs;
+  md_config_obs_t *_mutex_obs;
 
   /* The admin socket associated with this context */
   AdminSocket *_admin_socket;
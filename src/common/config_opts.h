@@ -48,6 +48,9 @@ OPTION(clog_to_monitors, OPT_BOOL, true)
 OPTION(clog_to_syslog, OPT_BOOL, false)
 OPTION(clog_to_syslog_level, OPT_STR, "info")         // this level and above
 OPTION(clog_to_syslog_facility, OPT_STR, "daemon")
+OPTION(clog_dedup_interval, OPT_DOUBLE, 10) // send an identical cluster log line at most once per this many seconds
+OPTION(clog_rate_limit, OPT_DOUBLE, 10)  // cluster log lines per second below error level, 0 = unlimited
+OPTION(clog_rate_burst, OPT_INT, 100)
 
 OPTION(mon_cluster_log_to_syslog, OPT_BOOL, false)
 OPTION(mon_cluster_log_to_syslog_level, OPT_STR, "info")   // this level and above
@@ -104,6 +107,7 @@ OPTION(heartbeat_file, OPT_STR, "")
 OPTION(heartbeat_inject_failure, OPT_INT, 0)    // force an unhealthy heartbeat for N seconds
 OPTION(perf, OPT_BOOL, true)       // enable internal perf counters
 
+OPTION(ms_type, OPT_STR, "simple")   // messenger backend; "async" is linux only
 OPTION(ms_tcp_nodelay, OPT_BOOL, true)
 OPTION(ms_tcp_rcvbuf, OPT_INT, 0)
 OPTION(ms_initial_backoff, OPT_DOUBLE, .2)
@@ -113,6 +117,11 @@ OPTION(ms_die_on_bad_msg, OPT_BOOL, false)
 OPTION(ms_die_on_unhandled_msg, OPT_BOOL, false)
 OPTION(ms_die_on_old_message, OPT_BOOL, false)     // assert if we get a dup incoming message and shouldn't have (may be triggered by pre-541cd3c64be0dfa04e8a2df39422e0eb9541a428 code)
 OPTION(ms_dispatch_throttle_bytes, OPT_U64, 100 << 20)
+OPTION(ms_writer_batch_bytes, OPT_U64, 64 << 10)  // stop adding messages to a Pipe writer batch past this size
+OPTION(ms_writer_batch_iovs, OPT_INT, 256)   // ... or past this many buffers
+OPTION(ms_compress_algorithm, OPT_STR, "none")  // compress message bodies on the wire: none, snappy or zlib
+OPTION(ms_compress_min_size, OPT_U64, 8192)     // don't bother with smaller message bodies
+OPTION(ms_compress_msg_types, OPT_STR, "MOSDPGPush MOSDECSubOpWrite MOSDECSubOpReadReply mon_sync")  // Message::get_type_name()s to compress; empty for all
 OPTION(ms_bind_ipv6, OPT_BOOL, false)
 OPTION(ms_bind_port_min, OPT_INT, 6800)
 OPTION(ms_bind_port_max, OPT_INT, 7300)
@@ -126,6 +135,7 @@ OPTION(ms_inject_delay_msg_type, OPT_STR, "")      // the type of message to del
 OPTION(ms_inject_delay_max, OPT_DOUBLE, 1)         // seconds
 OPTION(ms_inject_delay_probability, OPT_DOUBLE, 0) // range [0, 1]
 OPTION(ms_inject_internal_delays, OPT_DOUBLE, 0)   // seconds
+OPTION(ms_async_op_threads, OPT_INT, 2)   // event loop threads for the async messenger
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -138,6 +148,7 @@ OPTION(mon_compact_on_trim, OPT_BOOL, true)       // compact (a prefix) when we
 OPTION(mon_tick_interval, OPT_INT, 5)
 OPTION(mon_subscribe_interval, OPT_DOUBLE, 300)
 OPTION(mon_delta_reset_interval, OPT_DOUBLE, 10)   // seconds of inactivity before we reset the pg delta to 0
+OPTION(mon_osd_cache_size, OPT_INT, 10)  // encoded osdmaps (full and incremental, each) kept in memory for subscribers
 OPTION(mon_osd_laggy_halflife, OPT_INT, 60*60)        // (seconds) how quickly our laggy estimations decay
 OPTION(mon_osd_laggy_weight, OPT_DOUBLE, .3)          // weight for new 'samples's in laggy estimations
 OPTION(mon_osd_adjust_heartbeat_grace, OPT_BOOL, true)    // true if we should scale based on laggy estimations
@@ -161,6 +172,8 @@ OPTION(mon_clock_drift_warn_backoff, OPT_FLOAT, 5) // exponential backoff for cl
 OPTION(mon_timecheck_interval, OPT_FLOAT, 300.0) // on leader, timecheck (clock drift check) interval (seconds)
 OPTION(mon_accept_timeout, OPT_FLOAT, 10.0)    // on leader, if paxos update isn't accepted
 OPTION(mon_pg_create_interval, OPT_FLOAT, 30.0) // no more than every 30s
+OPTION(mon_pg_stats_commit_interval, OPT_DOUBLE, 5.0) // commit pg stat reports to the pgmap no more often than this; keep well under osd_mon_ack_timeout
+OPTION(mon_health_cache_ttl, OPT_DOUBLE, 5.0) // reuse the pg health summary for this long if the pgmap and osdmap are unchanged; 0 = never
 OPTION(mon_pg_stuck_threshold, OPT_INT, 300) // number of seconds after which pgs can be considered inactive, unclean, or stale (see doc/control.rst under dump_stuck for more info)
 OPTION(mon_pg_warn_min_per_osd, OPT_INT, 20)  // min # pgs per (in) osd before we warn the admin
 OPTION(mon_pg_warn_max_object_skew, OPT_FLOAT, 10.0) // max skew few average in objects per pg
@@ -184,12 +197,16 @@ OPTION(mon_slurp_bytes, OPT_INT, 256*1024)    // limit size of slurp messages
 OPTION(mon_client_bytes, OPT_U64, 100ul << 20)  // client msg data allowed in memory (in bytes)
 OPTION(mon_daemon_bytes, OPT_U64, 400ul << 20)  // mds, osd message memory cap (in bytes)
 OPTION(mon_max_log_entries_per_event, OPT_INT, 4096)
+OPTION(mon_log_max_entries_per_source, OPT_INT, 100) // below error level, per source and paxos round; 0 = no cap
+OPTION(mon_cluster_log_paxos_level, OPT_STR, "info") // entries below this level are logged by the receiving mon only
 OPTION(mon_health_data_update_interval, OPT_FLOAT, 60.0)
 OPTION(mon_data_avail_crit, OPT_INT, 5)
 OPTION(mon_data_avail_warn, OPT_INT, 30)
 OPTION(mon_config_key_max_entry_size, OPT_INT, 4096) // max num bytes per config-key entry
 OPTION(mon_sync_timeout, OPT_DOUBLE, 60.0)
 OPTION(mon_sync_max_payload_size, OPT_U32, 1048576) // max size for a sync chunk payload (say, 1MB)
+OPTION(mon_sync_max_inflight, OPT_INT, 4) // sync chunk requests a syncing mon keeps outstanding
+OPTION(mon_sync_max_bytes_per_sec, OPT_U64, 0) // limit the rate a syncing mon pulls chunks at; 0 = no limit
 OPTION(mon_sync_debug, OPT_BOOL, false) // enable sync-specific debug
 OPTION(mon_sync_debug_leader, OPT_INT, -1) // monitor to be used as the sync leader
 OPTION(mon_sync_debug_provider, OPT_INT, -1) // monitor to be used as the sync provider
@@ -215,10 +232,12 @@ OPTION(mon_leveldb_max_open_files, OPT_INT, 0) // monitor's leveldb max open fil
 OPTION(mon_leveldb_compression, OPT_BOOL, false) // monitor's leveldb uses compression
 OPTION(mon_leveldb_paranoid, OPT_BOOL, false)   // monitor's leveldb paranoid flag
 OPTION(mon_leveldb_log, OPT_STR, "")
+OPTION(mon_leveldb_compact_range_interval, OPT_DOUBLE, 1) // min seconds between background compactions of trimmed ranges
+OPTION(mon_keyvaluedb, OPT_STR, "leveldb") // backend of new monitor stores: leveldb or rocksdb
 OPTION(mon_leveldb_size_warn, OPT_U64, 40*1024*1024*1024) // issue a warning when the monitor's leveldb goes over 40GB (in bytes)
 OPTION(paxos_stash_full_interval, OPT_INT, 25)   // how often (in commits) to stash a full copy of the PaxosService state
 OPTION(paxos_max_join_drift, OPT_INT, 10) // max paxos iterations before we must first sync the monitor stores
-OPTION(paxos_propose_interval, OPT_DOUBLE, 1.0)  // gather updates for this long before proposing a map update
+OPTION(paxos_propose_interval, OPT_DOUBLE, 0)  // if > 0, gather updates for this long after a commit before proposing a map update; 0 = batch by load
 OPTION(paxos_min_wait, OPT_DOUBLE, 0.05)  // min time to gather updates for after period of inactivity
 OPTION(paxos_min, OPT_INT, 500)       // minimum number of paxos states to keep around
 OPTION(paxos_trim_min, OPT_INT, 250)  // number of extra proposals tolerated before trimming
@@ -248,6 +267,7 @@ OPTION(mon_pool_quota_warn_threshold, OPT_INT, 0) // percent of quota at which t
 OPTION(mon_pool_quota_crit_threshold, OPT_INT, 0) // percent of quota at which to issue errors
 OPTION(client_cache_size, OPT_INT, 16384)
 OPTION(client_cache_mid, OPT_FLOAT, .75)
+OPTION(client_cache_bytes, OPT_U64, 0)  // also trim once cached dentries+inodes take roughly this much memory (0 = no limit)
 OPTION(client_use_random_mds, OPT_BOOL, false)
 OPTION(client_mount_timeout, OPT_DOUBLE, 300.0)
 OPTION(client_tick_interval, OPT_DOUBLE, 1.0)
@@ -260,6 +280,7 @@ OPTION(client_mountpoint, OPT_STR, "/")
 OPTION(client_notify_timeout, OPT_INT, 10) // in seconds
 OPTION(osd_client_watch_timeout, OPT_INT, 30) // in seconds
 OPTION(client_caps_release_delay, OPT_INT, 5) // in seconds
+OPTION(client_cap_release_batch, OPT_INT, 1000) // send cap releases to an mds once this many are queued, instead of waiting for the tick (0 = always wait)
 OPTION(client_oc, OPT_BOOL, true)
 OPTION(client_oc_size, OPT_INT, 1024*1024* 200)    // MB * n
 OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.. bigish)
@@ -269,6 +290,9 @@ OPTION(client_oc_max_objects, OPT_INT, 1000)      // max objects in cache
 OPTION(client_debug_force_sync_read, OPT_BOOL, false)     // always read synchronously (go to osds)
 OPTION(client_debug_inject_tick_delay, OPT_INT, 0) // delay the client tick for a number of seconds
 OPTION(client_max_inline_size, OPT_U64, 4096)
+OPTION(client_direct_write_min, OPT_U64, 4 << 20) // writes this big go around the object cache while we hold Fb, 0 = never
+OPTION(client_direct_write_max_inflight, OPT_U64, 128 << 20) // bytes of such writes in flight per file
+OPTION(client_readdir_max_bytes, OPT_U64, 4 << 20) // size of one readdir reply from the mds, 0 = mds default (512 KB)
 // note: the max amount of "in flight" dirty data is roughly (max - target)
 OPTION(fuse_use_invalidate_cb, OPT_BOOL, false) // use fuse 2.8+ invalidate callback to keep page cache consistent
 OPTION(fuse_allow_other, OPT_BOOL, true)
@@ -277,6 +301,7 @@ OPTION(fuse_big_writes, OPT_BOOL, true)
 OPTION(fuse_atomic_o_trunc, OPT_BOOL, true)
 OPTION(fuse_debug, OPT_BOOL, false)
 OPTION(fuse_multithreaded, OPT_BOOL, false)
+OPTION(fuse_use_readdirplus, OPT_BOOL, true) // hand the kernel attributes with readdir results (fuse 3.0+)
 
 OPTION(crush_location, OPT_STR, "")       // whitespace-separated list of key=value pairs describing crush location
 
@@ -284,18 +309,28 @@ OPTION(objecter_tick_interval, OPT_DOUBLE, 5.0)
 OPTION(objecter_timeout, OPT_DOUBLE, 10.0)    // before we ask for a map
 OPTION(objecter_inflight_op_bytes, OPT_U64, 1024*1024*100) // max in-flight data (both directions)
 OPTION(objecter_inflight_ops, OPT_U64, 1024)               // max in-flight ios
+OPTION(filer_max_purge_ops, OPT_INT, 10)  // object removes in flight per purge_range
+OPTION(filer_probe_max_periods, OPT_INT, 16)  // periods a size probe may stat at once
+
 OPTION(journaler_allow_split_entries, OPT_BOOL, true)
 OPTION(journaler_write_head_interval, OPT_INT, 15)
 OPTION(journaler_prefetch_periods, OPT_INT, 10)   // * journal object size
+OPTION(journaler_prefetch_min_periods, OPT_INT, 2)   // read-ahead to start with; grows to journaler_prefetch_periods while readers wait
 OPTION(journaler_prezero_periods, OPT_INT, 5)     // * journal object size
 OPTION(journaler_batch_interval, OPT_DOUBLE, .001)   // seconds.. max add'l latency we artificially incur
 OPTION(journaler_batch_max, OPT_U64, 0)  // max bytes we'll delay flushing; disable, for now....
+OPTION(journaler_max_inflight_writes, OPT_INT, 2)  // further flushes wait for one to commit and go out together; 0 = no limit
+OPTION(journaler_group_commit_max, OPT_U64, 4 << 20)  // but flush at once when this many bytes are waiting
 OPTION(mds_data, OPT_STR, "/var/lib/ceph/mds/$cluster-$id")
 OPTION(mds_max_file_size, OPT_U64, 1ULL << 40)
 OPTION(mds_cache_size, OPT_INT, 100000)
+OPTION(mds_cache_memory_limit, OPT_U64, 0)  // bytes, 0 = limit by mds_cache_size only
 OPTION(mds_cache_mid, OPT_FLOAT, .7)
+OPTION(mds_recall_max_caps, OPT_U32, 5000)  // most caps asked back from one client at a time
+OPTION(mds_recall_interval, OPT_DOUBLE, 10)  // seconds before asking the same client again
 OPTION(mds_mem_max, OPT_INT, 1048576)        // KB
 OPTION(mds_dir_max_commit_size, OPT_INT, 10) // MB
+OPTION(mds_dir_fetch_max_keys, OPT_INT, 100000) // dentries read from a dirfrag object per op, 0 = all at once
 OPTION(mds_decay_halflife, OPT_FLOAT, 5)
 OPTION(mds_beacon_interval, OPT_FLOAT, 4)
 OPTION(mds_beacon_grace, OPT_FLOAT, 15)
@@ -310,10 +345,12 @@ OPTION(mds_tick_interval, OPT_FLOAT, 5)
 OPTION(mds_dirstat_min_interval, OPT_FLOAT, 1)    // try to avoid propagating more often than this
 OPTION(mds_scatter_nudge_interval, OPT_FLOAT, 5)  // how quickly dirstat changes propagate up the hierarchy
 OPTION(mds_client_prealloc_inos, OPT_INT, 1000)
+OPTION(mds_caps_batch_max, OPT_INT, 1000)  // caps messages sent to a client in one message, 0 = don't batch
 OPTION(mds_early_reply, OPT_BOOL, true)
 OPTION(mds_default_dir_hash, OPT_INT, CEPH_STR_HASH_RJENKINS)
 OPTION(mds_log, OPT_BOOL, true)
 OPTION(mds_log_skip_corrupt_events, OPT_BOOL, false)
+OPTION(mds_log_replay_batch, OPT_INT, 128)  // journal entries read, and decoded without mds_lock, at a time during replay
 OPTION(mds_log_max_events, OPT_INT, -1)
 OPTION(mds_log_segment_size, OPT_INT, 0)  // segment size for mds log,
 	      // defaults to g_default_file_layout.fl_object_size (4MB)
@@ -322,7 +359,7 @@ OPTION(mds_log_max_expiring, OPT_INT, 20)
 OPTION(mds_bal_sample_interval, OPT_FLOAT, 3.0)  // every 5 seconds
 OPTION(mds_bal_replicate_threshold, OPT_FLOAT, 8000)
 OPTION(mds_bal_unreplicate_threshold, OPT_FLOAT, 0)
-OPTION(mds_bal_frag, OPT_BOOL, false)
+OPTION(mds_bal_frag, OPT_BOOL, true)
 OPTION(mds_bal_split_size, OPT_INT, 10000)
 OPTION(mds_bal_split_rd, OPT_FLOAT, 25000)
 OPTION(mds_bal_split_wr, OPT_FLOAT, 10000)
@@ -332,10 +369,18 @@ OPTION(mds_bal_merge_rd, OPT_FLOAT, 1000)
 OPTION(mds_bal_merge_wr, OPT_FLOAT, 1000)
 OPTION(mds_bal_interval, OPT_INT, 10)           // seconds
 OPTION(mds_bal_fragment_interval, OPT_INT, 5)      // seconds
+OPTION(mds_bal_fragment_max_inflight, OPT_INT, 4) // fragment ops in progress at once, 0 = no limit
 OPTION(mds_bal_idle_threshold, OPT_FLOAT, 0)
 OPTION(mds_bal_max, OPT_INT, -1)
 OPTION(mds_bal_max_until, OPT_INT, -1)
 OPTION(mds_bal_mode, OPT_INT, 0)
+OPTION(mds_bal_weight_rd, OPT_FLOAT, 1)     // mds_bal_mode 3: weight of auth reads, readdirs and fetches
+OPTION(mds_bal_weight_wr, OPT_FLOAT, 2)     //  ... of auth writes and stores
+OPTION(mds_bal_weight_req, OPT_FLOAT, 1)    //  ... of the client request rate
+OPTION(mds_bal_weight_queue, OPT_FLOAT, 10) //  ... of the dispatch queue length
+OPTION(mds_bal_weight_caps, OPT_FLOAT, 0)   //  ... of the caps held by clients
+OPTION(mds_bal_weight_cpu, OPT_FLOAT, 0)    //  ... of the cpu load average
+OPTION(mds_bal_import_cooldown, OPT_FLOAT, 60)  // seconds before an imported subtree may be exported again
 OPTION(mds_bal_min_rebalance, OPT_FLOAT, .1)  // must be this much above average before we export anything
 OPTION(mds_bal_min_start, OPT_FLOAT, .2)      // if we need less than this, we don't do anything
 OPTION(mds_bal_need_min, OPT_FLOAT, .8)       // take within this range of what we need
@@ -388,8 +433,16 @@ OPTION(osd_backfill_full_ratio, OPT_FLOAT, 0.85)
 // Seconds to wait before retrying refused backfills
 OPTION(osd_backfill_retry_interval, OPT_DOUBLE, 10.0)
 
-// max agent flush ops
-OPTION(osd_agent_max_ops, OPT_INT, 4)
+// Let recovery and degraded backfill take reservation slots from
+// lower priority backfill, which pauses until a slot frees up
+OPTION(osd_backfill_preempt, OPT_BOOL, true)
+
+// agent flush ops, from min at the dirty/full target to max when full
+OPTION(osd_agent_max_ops, OPT_INT, 8)
+OPTION(osd_agent_min_ops, OPT_INT, 2)
+OPTION(osd_agent_threads, OPT_INT, 2)
+// objects listed per agent pass when full, scaled down with effort (min 10)
+OPTION(osd_agent_max_list, OPT_INT, 100)
 OPTION(osd_agent_min_evict_effort, OPT_FLOAT, .1)
 OPTION(osd_agent_quantize_effort, OPT_FLOAT, .1)
 
@@ -408,6 +461,9 @@ OPTION(osd_max_write_size, OPT_INT, 90)
 OPTION(osd_max_pgls, OPT_U64, 1024) // max number of pgls entries to return
 OPTION(osd_client_message_size_cap, OPT_U64, 500*1024L*1024L) // client data allowed in-memory (in bytes)
 OPTION(osd_client_message_cap, OPT_U64, 100)              // num client messages allowed in-memory
+// how much of the above one client connection may hold, so that it can't stall the others; 0 = no cap
+OPTION(osd_client_message_size_cap_per_client, OPT_U64, 250*1024L*1024L)
+OPTION(osd_client_message_cap_per_client, OPT_U64, 50)
 OPTION(osd_pg_bits, OPT_INT, 6)  // bits per osd
 OPTION(osd_pgp_bits, OPT_INT, 6)  // bits per osd
 OPTION(osd_crush_chooseleaf_type, OPT_INT, 1) // 1 = host
@@ -428,16 +484,41 @@ OPTION(osd_pool_default_erasure_code_properties,
        ) // default properties of osd pool create
 OPTION(osd_pool_default_flags, OPT_INT, 0)   // default flags for new pools
 OPTION(osd_pool_default_flag_hashpspool, OPT_BOOL, true)   // use new pg hashing to prevent pool/pg overlap
+OPTION(osd_pool_default_ec_fast_read, OPT_BOOL, false) // set fast_read on new erasure coded pools
+OPTION(osd_ec_fast_read_extra_shards, OPT_INT, -1) // shards read beyond the minimum by fast_read pools, -1 for all available
 OPTION(osd_hit_set_min_size, OPT_INT, 1000)  // min target size for a HitSet
 OPTION(osd_hit_set_namespace, OPT_STR, ".ceph-internal") // rados namespace for hit_set tracking
 OPTION(osd_map_dedup, OPT_BOOL, true)
 OPTION(osd_map_cache_size, OPT_INT, 500)
+OPTION(osd_pg_object_context_cache_count, OPT_INT, 64) // unused object contexts kept per pg
+OPTION(osd_pg_object_context_cache_shards, OPT_INT, 8) // lock stripes of the per pg object context cache
+OPTION(osd_object_info_cache_bytes, OPT_U64, 32 << 20) // decoded object_info_t/SnapSet kept across all pgs; 0 to disable
+OPTION(osd_map_mapping_cache, OPT_BOOL, false) // precompute the pg mappings of each new osdmap
+OPTION(osd_map_mapping_threads, OPT_INT, 4) // threads computing the precomputed pg mappings
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_map_share_max_epochs, OPT_INT, 100)  // cap on # of inc maps we send to peers, clients
+OPTION(osd_map_gossip_fanout, OPT_INT, 3)  // push each new map to this many peers that may not have it yet; 0 = only share lazily
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
+OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
+OPTION(osd_op_num_shards, OPT_INT, 5)
+OPTION(osd_op_thread_cpus, OPT_STR, "")  // cpu list for op threads, e.g. "0-3,8"; empty to not bind them
+OPTION(osd_numa_node, OPT_INT, -1)  // bind the daemon's threads and memory to this numa node; -1 for none
+OPTION(osd_numa_auto_affinity, OPT_BOOL, false)  // if no osd_numa_node, use the node of the public interface or journal device
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
+OPTION(osd_load_pgs_threads, OPT_INT, 4)  // threads reading pg infos and logs at startup
+OPTION(osd_peering_msg_batch_delay, OPT_DOUBLE, .02)  // seconds to hold peering messages for batching; 0 to send them right away
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
+OPTION(osd_op_queue, OPT_STR, "prioritized")  // or "mclock": share by reservation/weight/limit per class of op
+OPTION(osd_op_queue_mclock_client_res, OPT_DOUBLE, 1000.0)  // ops/sec
+OPTION(osd_op_queue_mclock_client_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_lim, OPT_DOUBLE, 0.0)  // ops/sec, 0 = none
+OPTION(osd_op_queue_mclock_recovery_res, OPT_DOUBLE, 10.0)
+OPTION(osd_op_queue_mclock_recovery_wgt, OPT_DOUBLE, 10.0)
+OPTION(osd_op_queue_mclock_recovery_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_backfill_res, OPT_DOUBLE, 5.0)
+OPTION(osd_op_queue_mclock_backfill_wgt, OPT_DOUBLE, 5.0)
+OPTION(osd_op_queue_mclock_backfill_lim, OPT_DOUBLE, 0.0)
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_recovery_threads, OPT_INT, 1)
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
@@ -445,6 +526,7 @@ OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap du
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
 OPTION(osd_recover_clone_overlap_limit, OPT_INT, 10)
+OPTION(osd_recover_partial, OPT_BOOL, true)   // push only the extents a replica is behind on, when the log says which
 
 OPTION(osd_backfill_scan_min, OPT_INT, 64)
 OPTION(osd_backfill_scan_max, OPT_INT, 512)
@@ -461,6 +543,8 @@ OPTION(osd_heartbeat_addr, OPT_ADDR, entity_addr_t())
 OPTION(osd_heartbeat_interval, OPT_INT, 6)       // (seconds) how often we ping peers
 OPTION(osd_heartbeat_grace, OPT_INT, 20)         // (seconds) how long before we decide a peer has failed
 OPTION(osd_heartbeat_min_peers, OPT_INT, 10)     // minimum number of peers
+OPTION(osd_heartbeat_max_peers, OPT_INT, 0)      // if nonzero, ping at most this many pg peers (but at least min_peers), spread over crush failure domains
+OPTION(osd_heartbeat_use_replication, OPT_BOOL, true)  // replication traffic from a peer stands in for its back ping reply
 
 // minimum number of peers tha tmust be reachable to mark ourselves
 // back up after being wrongly marked down.
@@ -491,9 +575,18 @@ OPTION(osd_scrub_chunk_min, OPT_INT, 5)
 OPTION(osd_scrub_chunk_max, OPT_INT, 25)
 OPTION(osd_deep_scrub_interval, OPT_FLOAT, 60*60*24*7) // once a week
 OPTION(osd_deep_scrub_stride, OPT_INT, 524288)
+OPTION(osd_deep_scrub_max_bytes_per_sec, OPT_U64, 0)  // pace deep scrub reads on this osd; 0 = as fast as we can
+OPTION(osd_snap_trim_batch, OPT_INT, 16)  // clones a pg trims at once before waiting for them to apply
+OPTION(osd_max_trimming_pgs, OPT_INT, 2)  // pgs trimming snaps at once on this osd
+OPTION(osd_snap_trim_cost, OPT_U64, 1<<20)  // cost of trimming a clone, on top of its size
+OPTION(osd_snap_trim_max_cost_per_sec, OPT_U64, 0)  // pace snap trimming on this osd; 0 = as fast as we can
+OPTION(osd_deep_scrub_drop_cache, OPT_BOOL, true)  // keep deep scrub reads out of the page cache
+OPTION(osd_data_digest, OPT_BOOL, true)  // keep a crc32c of object data in object_info when writes let us
+OPTION(osd_read_verify_data_digest, OPT_BOOL, true)  // check it on full object reads; EIO on mismatch
 OPTION(osd_scan_list_ping_tp_interval, OPT_U64, 100)
 OPTION(osd_auto_weight, OPT_BOOL, false)
 OPTION(osd_class_dir, OPT_STR, CEPH_LIBDIR "/rados-classes") // where rados plugins are stored
+OPTION(osd_class_perf_counters, OPT_BOOL, true) // time each class method under cls_<class>
 OPTION(osd_open_classes_on_start, OPT_BOOL, true)
 OPTION(osd_check_for_log_corruption, OPT_BOOL, false)
 OPTION(osd_use_stale_snap, OPT_BOOL, false)
@@ -522,6 +615,8 @@ OPTION(osd_debug_skip_full_check_in_backfill_reservation, OPT_BOOL, false)
 OPTION(osd_enable_op_tracker, OPT_BOOL, true) // enable/disable OSD op tracking
 OPTION(osd_op_history_size, OPT_U32, 20)    // Max number of completed ops to track
 OPTION(osd_op_history_duration, OPT_U32, 600) // Oldest completed op to track
+OPTION(osd_num_op_tracker_shard, OPT_U32, 32) // lists ops in flight are spread over
+OPTION(osd_op_tracker_sample, OPT_U32, 0) // keep detailed events for 1 in this many ops; 0 for none
 OPTION(osd_target_transaction_size, OPT_INT, 30)     // to adjust various transactions that batch smaller items
 OPTION(osd_failsafe_full_ratio, OPT_FLOAT, .97) // what % full makes an OSD "full" (failsafe)
 OPTION(osd_failsafe_nearfull_ratio, OPT_FLOAT, .90) // what % full makes an OSD near full (failsafe)
@@ -533,6 +628,9 @@ OPTION(osd_leveldb_max_open_files, OPT_INT, 0) // OSD's leveldb max open files
 OPTION(osd_leveldb_compression, OPT_BOOL, true) // OSD's leveldb uses compression
 OPTION(osd_leveldb_paranoid, OPT_BOOL, false) // OSD's leveldb paranoid flag
 OPTION(osd_leveldb_log, OPT_STR, "")  // enable OSD leveldb log file
+OPTION(osd_leveldb_compact_range_interval, OPT_DOUBLE, 1) // min seconds between background omap compactions
+OPTION(osd_pg_remove_compact_omap, OPT_BOOL, true) // compact the omap keys of a removed pg in the background
+OPTION(osd_pg_remove_bulk, OPT_BOOL, true) // remove a pg's collections whole, rather than object by object
 
 // determines whether PGLog::check() compares written out log to stored log
 OPTION(osd_debug_pg_log_writeout, OPT_BOOL, false)
@@ -546,6 +644,24 @@ OPTION(leveldb_compression, OPT_BOOL, true) // leveldb uses compression
 OPTION(leveldb_paranoid, OPT_BOOL, false) // leveldb paranoid flag
 OPTION(leveldb_log, OPT_STR, "/dev/null")  // enable leveldb log file
 OPTION(leveldb_compact_on_mount, OPT_BOOL, false)
+OPTION(leveldb_compact_range_interval, OPT_DOUBLE, 0) // min seconds between background range compactions
+OPTION(leveldb_stats_interval, OPT_DOUBLE, 5) // seconds between compaction/memory perf counter refreshes
+
+OPTION(rocksdb_write_buffer_size, OPT_U64, 0) // rocksdb write buffer size
+OPTION(rocksdb_write_buffer_num, OPT_INT, 0) // rocksdb memtables kept before stalling writes
+OPTION(rocksdb_cache_size, OPT_U64, 0) // rocksdb block cache size
+OPTION(rocksdb_block_size, OPT_U64, 0) // rocksdb block size
+OPTION(rocksdb_bloom_size, OPT_INT, 0) // rocksdb bloom bits per entry
+OPTION(rocksdb_max_open_files, OPT_INT, 0) // rocksdb max open files
+OPTION(rocksdb_compression, OPT_BOOL, true) // rocksdb uses compression
+OPTION(rocksdb_paranoid, OPT_BOOL, false) // rocksdb paranoid flag
+OPTION(rocksdb_log, OPT_STR, "/dev/null")  // enable rocksdb log file
+OPTION(rocksdb_background_compactions, OPT_INT, 4) // rocksdb compaction threads
+OPTION(rocksdb_background_flushes, OPT_INT, 1) // rocksdb memtable flush threads
+OPTION(rocksdb_wal_dir, OPT_STR, "") // put the rocksdb write-ahead log here, default next to the data
+OPTION(rocksdb_max_total_wal_size, OPT_U64, 0) // flush memtables once the wal grows past this
+OPTION(rocksdb_disable_wal, OPT_BOOL, false) // do not write the wal; unsynced writes are lost on crash
+OPTION(rocksdb_compact_on_mount, OPT_BOOL, false)
 
 /**
  * osd_client_op_priority and osd_recovery_op_priority adjust the relative
@@ -569,6 +685,7 @@ OPTION(osd_max_object_size, OPT_U64, 100*1024L*1024L*1024L) // OSD's maximum obj
 OPTION(osd_max_attr_size, OPT_U64, 0)
 
 OPTION(osd_objectstore, OPT_STR, "filestore")  // ObjectStore backend type
+OPTION(memstore_page_size, OPT_U64, 64 << 10)  // memstore object data is kept in pages of this size
 // Override maintaining compatibility with older OSDs
 // Set to true for testing.  Users should NOT set this.
 OPTION(osd_debug_override_acting_compat, OPT_BOOL, false)
@@ -592,9 +709,16 @@ OPTION(filestore_wbthrottle_xfs_inodes_start_flusher, OPT_U64, 500)
 OPTION(filestore_wbthrottle_btrfs_inodes_hard_limit, OPT_U64, 5000)
 OPTION(filestore_wbthrottle_xfs_inodes_hard_limit, OPT_U64, 5000)
 
+/// start writeback of dirty objects this often (seconds, 0 to disable)
+/// so that the commit sync finds less to flush
+OPTION(filestore_wbthrottle_writeback_interval, OPT_DOUBLE, 0)
+
 // Tests index failure paths
 OPTION(filestore_index_retry_probability, OPT_DOUBLE, 0)
 
+// lookup() results cached per collection, 0 to disable
+OPTION(filestore_index_lookup_cache_size, OPT_INT, 1024)
+
 // Allow object read error injection
 OPTION(filestore_debug_inject_read_err, OPT_BOOL, false)
 
@@ -608,13 +732,20 @@ OPTION(filestore_max_inline_xattr_size_btrfs, OPT_U32, 2048)
 OPTION(filestore_max_inline_xattr_size_other, OPT_U32, 512)
 
 // for more than filestore_max_inline_xattrs attrs
+OPTION(filestore_omap_header_cache_size, OPT_INT, 1024)  // DBObjectMap leaf headers
+OPTION(filestore_omap_backend, OPT_STR, "leveldb") // omap backend of new stores: leveldb or rocksdb
 OPTION(filestore_max_inline_xattrs, OPT_U32, 0)	//Override
 OPTION(filestore_max_inline_xattrs_xfs, OPT_U32, 10)
 OPTION(filestore_max_inline_xattrs_btrfs, OPT_U32, 10)
 OPTION(filestore_max_inline_xattrs_other, OPT_U32, 2)
+// keep an object's inline xattrs packed in a single fs xattr; objects
+// written this way can not be read by older versions
+OPTION(filestore_xattr_packed, OPT_BOOL, false)
 
 OPTION(filestore_sloppy_crc, OPT_BOOL, false)         // track sloppy crcs
 OPTION(filestore_sloppy_crc_block_size, OPT_INT, 65536)
+OPTION(filestore_aio, OPT_BOOL, false)                // submit page aligned data writes with libaio
+OPTION(filestore_aio_queue_depth, OPT_INT, 128)
 
 OPTION(filestore_max_sync_interval, OPT_DOUBLE, 5)    // seconds
 OPTION(filestore_min_sync_interval, OPT_DOUBLE, .01)  // seconds
@@ -623,6 +754,7 @@ OPTION(filestore_btrfs_clone_range, OPT_BOOL, true)
 OPTION(filestore_zfs_snap, OPT_BOOL, false) // zfsonlinux is still unstable
 OPTION(filestore_fsync_flushes_journal_data, OPT_BOOL, false)
 OPTION(filestore_fiemap, OPT_BOOL, false)     // (try to) use fiemap
+OPTION(filestore_seek_data_hole, OPT_BOOL, true)  // else map extents with SEEK_DATA/SEEK_HOLE, if they work
 OPTION(filestore_journal_parallel, OPT_BOOL, false)
 OPTION(filestore_journal_writeahead, OPT_BOOL, false)
 OPTION(filestore_journal_trailing, OPT_BOOL, false)
@@ -631,21 +763,38 @@ OPTION(filestore_queue_max_bytes, OPT_INT, 100 << 20)
 OPTION(filestore_queue_committing_max_ops, OPT_INT, 500)        // this is ON TOP of filestore_queue_max_*
 OPTION(filestore_queue_committing_max_bytes, OPT_INT, 100 << 20) //  "
 OPTION(filestore_op_threads, OPT_INT, 2)
+OPTION(filestore_ondisk_finisher_threads, OPT_INT, 1)  // completions stay ordered per sequencer
+OPTION(filestore_apply_finisher_threads, OPT_INT, 1)
+OPTION(filestore_op_thread_cpus, OPT_STR, "")  // cpu list for op threads; empty to not bind them
 OPTION(filestore_op_thread_timeout, OPT_INT, 60)
 OPTION(filestore_op_thread_suicide_timeout, OPT_INT, 180)
 OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
+// quiesce for a commit by pausing the op threads, rather than only
+// holding back the applies that have not started yet
+OPTION(filestore_commit_pause_op_threads, OPT_BOOL, false)
 OPTION(filestore_fiemap_threshold, OPT_INT, 4096)
 OPTION(filestore_merge_threshold, OPT_INT, 10)
 OPTION(filestore_split_multiple, OPT_INT, 2)
+OPTION(filestore_split_defer, OPT_BOOL, false)   // split subdirs from a background thread
+OPTION(filestore_split_rate, OPT_DOUBLE, 10)     // deferred splits per second, 0 for no limit
 OPTION(filestore_update_to, OPT_INT, 1000)
 OPTION(filestore_blackhole, OPT_BOOL, false)     // drop any new transactions on the floor
 OPTION(filestore_fd_cache_size, OPT_INT, 128)    // FD lru size
+OPTION(filestore_fd_cache_shards, OPT_INT, 16)   // FD cache shards, by object hash
 OPTION(filestore_dump_file, OPT_STR, "")         // file onto which store transaction dumps
 OPTION(filestore_kill_at, OPT_INT, 0)            // inject a failure at the n'th opportunity
 OPTION(filestore_inject_stall, OPT_INT, 0)       // artificially stall for N seconds in op queue thread
 OPTION(filestore_fail_eio, OPT_BOOL, true)       // fail/crash on EIO
 OPTION(filestore_replica_fadvise, OPT_BOOL, true)
+OPTION(filestore_coalesce_ops, OPT_BOOL, true)   // skip ops later ops in a transaction undo, merge adjacent attr and omap updates
 OPTION(filestore_debug_verify_split, OPT_BOOL, false)
+OPTION(keyvaluestore_backend, OPT_STR, "leveldb") // backend of new keyvaluestores: leveldb or rocksdb
+OPTION(keyvaluestore_leveldb_write_buffer_size, OPT_U64, 0) // KeyValueStore's leveldb write buffer size
+OPTION(keyvaluestore_leveldb_cache_size, OPT_U64, 0) // KeyValueStore's leveldb cache size
+OPTION(keyvaluestore_leveldb_block_size, OPT_U64, 0) // KeyValueStore's leveldb block size
+OPTION(keyvaluestore_leveldb_bloom_size, OPT_INT, 0) // KeyValueStore's leveldb bloom bits per entry
+OPTION(keyvaluestore_default_strip_size, OPT_INT, 4096) // strip size of new objects, existing objects keep theirs
+OPTION(keyvaluestore_header_cache_size, OPT_INT, 4096) // number of object headers cached across transactions
 OPTION(journal_dio, OPT_BOOL, true)
 OPTION(journal_aio, OPT_BOOL, true)
 OPTION(journal_force_aio, OPT_BOOL, false)
@@ -656,6 +805,8 @@ OPTION(journal_block_align, OPT_BOOL, true)
 OPTION(journal_write_header_frequency, OPT_U64, 0)
 OPTION(journal_max_write_bytes, OPT_INT, 10 << 20)
 OPTION(journal_max_write_entries, OPT_INT, 100)
+OPTION(journal_batch_target_latency, OPT_DOUBLE, 0)  // seconds; adapt journal write size to this, 0 to disable
+OPTION(journal_batch_max_hold, OPT_DOUBLE, .0005)   // seconds; longest we hold entries back for a bigger write
 OPTION(journal_queue_max_ops, OPT_INT, 300)
 OPTION(journal_queue_max_bytes, OPT_INT, 32 << 20)
 OPTION(journal_align_min_size, OPT_INT, 64 << 10)  // align data payloads >= this.
@@ -665,6 +816,8 @@ OPTION(journal_ignore_corruption, OPT_BOOL, false) // assume journal is not corr
 
 OPTION(rados_mon_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from the monitor before returning an error from a rados operation. 0 means on limit.
 OPTION(rados_osd_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from osds before returning an error from a rados operation. 0 means no limit.
+OPTION(rados_aio_completion_threads, OPT_INT, 1) // threads running aio completion callbacks
+OPTION(rados_aio_completion_order, OPT_STR, "ioctx") // callbacks run in order per 'ioctx', per 'object', or in no particular order ('none')
 
 OPTION(rbd_cache, OPT_BOOL, false) // whether to enable caching (writeback unless rbd_cache_max_dirty is 0)
 OPTION(rbd_cache_writethrough_until_flush, OPT_BOOL, false) // whether to make writeback caching writethrough until flush is called, to be sure the user of librbd will send flushs so that writeback is safe
@@ -672,12 +825,21 @@ OPTION(rbd_cache_size, OPT_LONGLONG, 32<<20)         // cache size in bytes
 OPTION(rbd_cache_max_dirty, OPT_LONGLONG, 24<<20)    // dirty limit in bytes - set to 0 for write-through caching
 OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in bytes
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
+OPTION(rbd_cache_max_coalesced_write, OPT_LONGLONG, 1<<20) // write back nearby dirty extents of an object together, in ops of up to this many bytes; 0 to disable
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
-OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
+OPTION(rbd_disable_zero_copy_writes, OPT_BOOL, true) // copy the data of aio writes instead of referencing caller memory until they complete (never zero-copy with rbd_cache)
+OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting, resizing, rolling back, copying, flattening or diffing an image
+OPTION(rbd_export_import_concurrent_ops, OPT_INT, 32) // how many reads or writes rbd export, import, export-diff and import-diff keep in flight
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
 OPTION(rbd_balance_parent_reads, OPT_BOOL, false)
 OPTION(rbd_localize_parent_reads, OPT_BOOL, true)
+OPTION(rbd_persistent_cache_path, OPT_STR, "") // local directory to keep objects read from snapshots (e.g. parents of clones) in across restarts; empty to disable
+OPTION(rbd_persistent_cache_size, OPT_U64, 10ULL << 30) // bytes to keep per image in rbd_persistent_cache_path
+OPTION(rbd_clone_copy_on_read, OPT_BOOL, false) // copy whole objects up from the parent when a clone reads them from there
+OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requests necessary to trigger readahead
+OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
+OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled, 0 for never
 
 /*
  * The following options change the behavior for librbd's image creation methods that
@@ -699,7 +861,7 @@ OPTION(rbd_default_format, OPT_INT, 1)
 OPTION(rbd_default_order, OPT_INT, 22)
 OPTION(rbd_default_stripe_count, OPT_U64, 1) // changing requires stripingv2 feature
 OPTION(rbd_default_stripe_unit, OPT_U64, 4194304) // changing to non-object size requires stripingv2 feature
-OPTION(rbd_default_features, OPT_INT, 3) // 1 for layering, 3 for layering+stripingv2. only applies to format 2 images
+OPTION(rbd_default_features, OPT_INT, 3) // 1 for layering, 3 for layering+stripingv2, add 4 for the object map. only applies to format 2 images
 
 OPTION(nss_db_path, OPT_STR, "") // path to nss db
 
@@ -707,6 +869,8 @@ OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_user_info_cache_size, OPT_INT, 10000) // num of decoded user infos kept for authentication
+OPTION(rgw_cache_expiry_interval, OPT_INT, 900) // seconds after which cache entries expire, 0 to keep them until evicted
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -753,6 +917,8 @@ OPTION(rgw_enable_usage_log, OPT_BOOL, false) // enable logging bandwidth usage
 OPTION(rgw_ops_log_rados, OPT_BOOL, true) // whether ops log should go to rados
 OPTION(rgw_ops_log_socket_path, OPT_STR, "") // path to unix domain socket where ops log can go
 OPTION(rgw_ops_log_data_backlog, OPT_INT, 5 << 20) // max data backlog for ops log
+OPTION(rgw_ops_log_flush_threshold, OPT_INT, 64 << 10) // bytes of ops log entries buffered before they are written to rados, 0 to write each as it comes
+OPTION(rgw_ops_log_flush_interval, OPT_INT, 5) // write buffered ops log entries to rados every X seconds
 OPTION(rgw_usage_log_flush_threshold, OPT_INT, 1024) // threshold to flush pending log data
 OPTION(rgw_usage_log_tick_interval, OPT_INT, 30) // flush pending log data every X seconds
 OPTION(rgw_intent_log_object_name, OPT_STR, "%Y-%m-%d-%i-%n")  // man date to see codes (a subset are supported)
@@ -763,20 +929,28 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_processor_threads, OPT_INT, 4)  // num of gc shards processed concurrently
+OPTION(rgw_gc_max_concurrent_io, OPT_INT, 16)  // max tail object removals in flight per gc shard
+OPTION(rgw_gc_max_removals_per_sec, OPT_INT, 0)  // max tail object removals per second across all gc shards, 0 for no limit
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
 OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can be set on objects (beyond the default)
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
-OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request
+OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request, reads in flight plus data not yet sent to the client
 OPTION(rgw_get_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single get obj rados op
+OPTION(rgw_put_obj_min_window_size, OPT_INT, 16 << 20) // min window size in bytes of writes in flight for a single put obj request, grows while writes complete quickly
+OPTION(rgw_put_obj_hash_thread_min_size, OPT_U64, 4 << 20) // compute the etag of uploads at least this large (and of chunked uploads) in a separate thread, 0 to disable
 OPTION(rgw_relaxed_s3_bucket_names, OPT_BOOL, false) // enable relaxed bucket name rules for US region buckets
 OPTION(rgw_defer_to_bucket_acls, OPT_STR, "") // if the user has bucket perms, use those before key perms (recurse and full_control)
 OPTION(rgw_list_buckets_max_chunk, OPT_INT, 1000) // max buckets to retrieve in a single op when listing user buckets
+OPTION(rgw_formatter_flush_threshold, OPT_INT, 64 << 10) // send response body to the client once this much is buffered, 0 to buffer it all
 OPTION(rgw_md_log_max_shards, OPT_INT, 64) // max shards for metadata log
 OPTION(rgw_num_zone_opstate_shards, OPT_INT, 128) // max shards for keeping inter-region copy progress info
 OPTION(rgw_opstate_ratelimit_sec, OPT_INT, 30) // min time between opstate updates on a single upload (0 for disabling ratelimit)
 OPTION(rgw_curl_wait_timeout_ms, OPT_INT, 1000) // timeout for certain curl calls
+OPTION(rgw_copy_obj_max_concurrent_io, OPT_INT, 32) // tail object references taken in parallel when copying an object
+OPTION(rgw_curl_max_idle_handles, OPT_INT, 32) // finished curl handles kept, with their connections, for later requests
 OPTION(rgw_copy_obj_progress, OPT_BOOL, true) // should dump progress during long copy operations?
 OPTION(rgw_copy_obj_progress_every_bytes, OPT_INT, 1024 * 1024) // min bytes between copy progress output
 
@@ -791,6 +965,8 @@ OPTION(rgw_bucket_quota_soft_threshold, OPT_DOUBLE, 0.95) // threshold from whic
 OPTION(rgw_bucket_quota_cache_size, OPT_INT, 10000) // number of entries in bucket quota cache
 
 OPTION(rgw_expose_bucket, OPT_BOOL, false) // Return the bucket name in the 'Bucket' response header
+OPTION(rgw_bucket_index_max_shards, OPT_U32, 0) // number of index objects for new buckets, 0 keeps a single unsharded index object
+OPTION(rgw_bucket_index_max_aio, OPT_U32, 128) // max bucket index completions in flight, writers wait beyond that
 
 OPTION(rgw_frontends, OPT_STR, "") // alternative front ends
 
@@ -800,8 +976,11 @@ OPTION(rgw_user_quota_sync_idle_users, OPT_BOOL, false) // whether stats for idl
 OPTION(rgw_user_quota_sync_wait_time, OPT_INT, 3600 * 24) // min time between two full stats syc for non-idle users
 
 OPTION(rgw_multipart_min_part_size, OPT_INT, 5 * 1024 * 1024) // min size for each part (except for last one) in multipart upload
+OPTION(rgw_multipart_complete_batch_size, OPT_INT, 10000) // num of part entries read from the upload meta object at a time when completing a multipart upload
 
 OPTION(mutex_perf_counter, OPT_BOOL, false) // enable/disable mutex perf counter
+OPTION(mutex_perf_profile, OPT_BOOL, false) // record contended mutex waits by name, see 'dump_lock_stats'
+OPTION(mutex_spin_max, OPT_INT, 0) // max trylocks on a contended mutex before sleeping on it (0 = don't spin)
 OPTION(throttler_perf_counter, OPT_BOOL, true) // enable/disable throttler perf counter
 
 // This will be set to true when it is safe to start threads.
@@ -0,0 +1,68 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_CONFIG_SNAPSHOT_H
+#define CEPH_CONFIG_SNAPSHOT_H
+
+#include "common/simple_spin.h"
+
+/**
+ * A copy of a few config values for readers on hot paths.
+ *
+ * A config observer publishes the values with set(), and readers get()
+ * a consistent copy of them without taking a lock: they never see some
+ * values from before an injectargs and some from after it.
+ *
+ * This is a sequence lock.  A reader retries if a set() ran while it
+ * was copying, so T should be a small struct of plain values, nothing
+ * that owns memory.  (Strings can't change at runtime anyway; see
+ * md_config_t.)  Writers are rare and serialize among themselves.
+ */
+template <typename T>
+class ConfigSnapshot {
+  volatile unsigned seq;         // odd while a set() is in progress
+  T val;
+  simple_spinlock_t write_lock;
+
+  // don't allow copying.
+  void operator=(const ConfigSnapshot &o);
+  ConfigSnapshot(const ConfigSnapshot &o);
+
+public:
+  explicit ConfigSnapshot(const T& v = T())
+    : seq(0), val(v), write_lock(SIMPLE_SPINLOCK_INITIALIZER) {}
+
+  T get() const {
+    while (true) {
+      unsigned s = seq;
+      __sync_synchronize();
+      if (s & 1)
+	continue;
+      T ret = val;
+      __sync_synchronize();
+      if (seq == s)
+	return ret;
+    }
+  }
+
+  void set(const T& v) {
+    simple_spin_lock(&write_lock);
+    seq = seq + 1;
+    __sync_synchronize();
+    val = v;
+    __sync_synchronize();
+    seq = seq + 1;
+    simple_spin_unlock(&write_lock);
+  }
+};
+
+#endif
@@ -8,6 +8,9 @@
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
 #include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_pclmul.h"
+#include "common/crc32c_aarch64.h"
+#include "arch/neon.h"
 
 /*
  * choose best implementation based on the CPU architecture.
@@ -18,8 +21,16 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
   // link order of this file relative to arch/probe.cc.
   ceph_arch_probe();
 
+  if (ceph_arch_aarch64_crc32 && ceph_crc32c_aarch64_exists()) {
+    return ceph_crc32c_aarch64;
+  }
+
   // if the CPU supports it, *and* the fast version is compiled in,
   // use that.
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists()) {
+    return ceph_crc32c_intel_pclmul;
+  }
   if (ceph_arch_intel_sse42 && ceph_crc32c_intel_fast_exists()) {
     return ceph_crc32c_intel_fast;
   }
@@ -39,3 +50,56 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+
+
+/*
+ * ceph_crc32c() has no pre- or post-conditioning, so running it over
+ * zeros just multiplies the crc by x^(8*len) modulo the polynomial.
+ * That is a linear map on the 32 crc bits; crc_zeros_op[k] holds its
+ * matrix for 2^k bytes, one column per input bit, so any length takes
+ * one matrix-vector product per set bit.
+ */
+static uint32_t crc_zeros_op[32][32];
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1)
+      sum ^= *mat;
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+  for (int n = 0; n < 32; n++)
+    square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+static bool init_crc_zeros_op()
+{
+  // the operator for a single zero bit (reflected crc32c polynomial)
+  uint32_t bit[32], tmp[32];
+  bit[0] = 0x82f63b78;
+  for (int n = 1; n < 32; n++)
+    bit[n] = 1u << (n - 1);
+  gf2_matrix_square(tmp, bit);     // 2 bits
+  gf2_matrix_square(bit, tmp);     // 4 bits
+  gf2_matrix_square(crc_zeros_op[0], bit);  // 1 byte
+  for (int k = 1; k < 32; k++)
+    gf2_matrix_square(crc_zeros_op[k], crc_zeros_op[k - 1]);
+  return true;
+}
+
+static bool crc_zeros_op_ready = init_crc_zeros_op();
+
+uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length)
+{
+  for (int k = 0; length; k++, length >>= 1)
+    if (length & 1)
+      crc = gf2_matrix_times(crc_zeros_op[k], crc);
+  return crc;
+}
@@ -0,0 +1,100 @@
+#include "acconfig.h"
+#include "include/int_types.h"
+#include "common/crc32c_aarch64.h"
+
+#if defined(HAVE_ARMV8_CRC) && defined(__aarch64__)
+
+#include <arm_acle.h>
+
+/*
+ * Same scheme as crc32c_intel_pclmul.c: three interleaved streams of
+ * crc32cx, then shift the partial crcs into place.  The shift needs
+ * one 32x32 carry-less multiply per block; that is cheap enough in C
+ * that we don't depend on the crypto extension's pmull.
+ */
+#define LONG_BLOCK	8192
+#define SHORT_BLOCK	256
+
+/* x^(8*block-33) and x^(16*block-33) mod P, bit reflected */
+static const uint32_t long_k1 = 0x54a86326;
+static const uint32_t long_k2 = 0x1dc403cc;
+static const uint32_t short_k1 = 0xb9e02b86;
+static const uint32_t short_k2 = 0xdd7e3b0c;
+
+static inline uint32_t crc_shift(uint32_t crc, uint32_t k)
+{
+	uint64_t p = 0;
+	int i;
+
+	for (i = 0; i < 32; i++)
+		if (k & (1u << i))
+			p ^= (uint64_t)crc << i;
+	return __crc32cd(0, p);
+}
+
+static inline uint32_t crc_by3(uint32_t crc, const uint64_t *w, unsigned block,
+			       uint32_t k1, uint32_t k2)
+{
+	uint32_t c0 = crc, c1 = 0, c2 = 0;
+	unsigned n = block / 8;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		c0 = __crc32cd(c0, w[i]);
+		c1 = __crc32cd(c1, w[i + n]);
+		c2 = __crc32cd(c2, w[i + 2 * n]);
+	}
+	return crc_shift(c0, k2) ^ crc_shift(c1, k1) ^ c2;
+}
+
+uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	if (!buffer) {
+		for (; len >= 8; len -= 8)
+			crc = __crc32cd(crc, 0);
+		while (len--)
+			crc = __crc32cb(crc, 0);
+		return crc;
+	}
+
+	for (; len && ((unsigned long)buffer & 7); len--)
+		crc = __crc32cb(crc, *buffer++);
+
+	for (; len >= 3 * LONG_BLOCK; len -= 3 * LONG_BLOCK) {
+		crc = crc_by3(crc, (const uint64_t *)buffer, LONG_BLOCK,
+			      long_k1, long_k2);
+		buffer += 3 * LONG_BLOCK;
+	}
+	for (; len >= 3 * SHORT_BLOCK; len -= 3 * SHORT_BLOCK) {
+		crc = crc_by3(crc, (const uint64_t *)buffer, SHORT_BLOCK,
+			      short_k1, short_k2);
+		buffer += 3 * SHORT_BLOCK;
+	}
+
+	for (; len >= 8; len -= 8) {
+		crc = __crc32cd(crc, *(const uint64_t *)buffer);
+		buffer += 8;
+	}
+	while (len--)
+		crc = __crc32cb(crc, *buffer++);
+	return crc;
+}
+
+int ceph_crc32c_aarch64_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_crc32c_aarch64_exists(void)
+{
+	return 0;
+}
+
+uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef CEPH_COMMON_CRC32C_AARCH64_H
+#define CEPH_COMMON_CRC32C_AARCH64_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* is the armv8 crc32 version compiled in */
+extern int ceph_crc32c_aarch64_exists(void);
+
+extern uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
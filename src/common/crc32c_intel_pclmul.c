@@ -0,0 +1,107 @@
+#include "acconfig.h"
+#include "include/int_types.h"
+#include "common/crc32c_intel_pclmul.h"
+
+#if defined(HAVE_INTEL_PCLMUL) && defined(__x86_64__)
+
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+/*
+ * The crc32 instruction has a latency of three cycles but can start one
+ * every cycle, so long buffers are summed as three interleaved streams
+ * whose crcs are then shifted into place and added.
+ *
+ * Shifting crc c over n zero bytes, c * x^(8n) mod P, takes a carry-less
+ * multiply by k = x^(8n-33) mod P and a crc32 of the 64-bit product: the
+ * bit-reflected product carries an extra factor of x, and crc32 another
+ * x^32.
+ */
+#define LONG_BLOCK	8192
+#define SHORT_BLOCK	256
+
+/* x^(8*block-33) and x^(16*block-33) mod P, bit reflected */
+static const uint32_t long_k1 = 0x54a86326;
+static const uint32_t long_k2 = 0x1dc403cc;
+static const uint32_t short_k1 = 0xb9e02b86;
+static const uint32_t short_k2 = 0xdd7e3b0c;
+
+static inline uint32_t crc_shift(uint32_t crc, uint32_t k)
+{
+	__m128i p = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc),
+					 _mm_cvtsi32_si128(k), 0);
+	return _mm_crc32_u64(0, _mm_cvtsi128_si64(p));
+}
+
+static inline uint32_t crc_by3(uint32_t crc, const uint64_t *w, unsigned block,
+			       uint32_t k1, uint32_t k2)
+{
+	uint64_t c0 = crc, c1 = 0, c2 = 0;
+	unsigned n = block / 8;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		c0 = _mm_crc32_u64(c0, w[i]);
+		c1 = _mm_crc32_u64(c1, w[i + n]);
+		c2 = _mm_crc32_u64(c2, w[i + 2 * n]);
+	}
+	return crc_shift(c0, k2) ^ crc_shift(c1, k1) ^ c2;
+}
+
+uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	uint64_t c;
+
+	if (!buffer) {
+		c = crc;
+		for (; len >= 8; len -= 8)
+			c = _mm_crc32_u64(c, 0);
+		crc = c;
+		while (len--)
+			crc = _mm_crc32_u8(crc, 0);
+		return crc;
+	}
+
+	for (; len && ((unsigned long)buffer & 7); len--)
+		crc = _mm_crc32_u8(crc, *buffer++);
+
+	for (; len >= 3 * LONG_BLOCK; len -= 3 * LONG_BLOCK) {
+		crc = crc_by3(crc, (const uint64_t *)buffer, LONG_BLOCK,
+			      long_k1, long_k2);
+		buffer += 3 * LONG_BLOCK;
+	}
+	for (; len >= 3 * SHORT_BLOCK; len -= 3 * SHORT_BLOCK) {
+		crc = crc_by3(crc, (const uint64_t *)buffer, SHORT_BLOCK,
+			      short_k1, short_k2);
+		buffer += 3 * SHORT_BLOCK;
+	}
+
+	c = crc;
+	for (; len >= 8; len -= 8) {
+		c = _mm_crc32_u64(c, *(const uint64_t *)buffer);
+		buffer += 8;
+	}
+	crc = c;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *buffer++);
+	return crc;
+}
+
+int ceph_crc32c_intel_pclmul_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_crc32c_intel_pclmul_exists(void)
+{
+	return 0;
+}
+
+uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	return 0;
+}
+
+#endif
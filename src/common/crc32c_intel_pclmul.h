@@ -0,0 +1,17 @@
+#ifndef CEPH_COMMON_CRC32C_INTEL_PCLMUL_H
+#define CEPH_COMMON_CRC32C_INTEL_PCLMUL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* is the pclmul version compiled in */
+extern int ceph_crc32c_intel_pclmul_exists(void);
+
+extern uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
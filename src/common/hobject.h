@@ -197,21 +197,25 @@ public:
   void decode(json_spirit::Value& v);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<hobject_t*>& o);
-  friend bool operator<(const hobject_t&, const hobject_t&);
-  friend bool operator>(const hobject_t&, const hobject_t&);
-  friend bool operator<=(const hobject_t&, const hobject_t&);
-  friend bool operator>=(const hobject_t&, const hobject_t&);
+  friend int cmp(const hobject_t&, const hobject_t&);
   friend bool operator==(const hobject_t&, const hobject_t&);
   friend bool operator!=(const hobject_t&, const hobject_t&);
   friend struct ghobject_t;
 };
 WRITE_CLASS_ENCODER(hobject_t)
 
+/*
+ * The hash field is already a hash of the object's name (or locator
+ * key), so use it rather than hashing the name again.  Objects that
+ * don't have one (temp objects, some tests) fall back to the name.
+ */
 CEPH_HASH_NAMESPACE_START
   template<> struct hash<hobject_t> {
     size_t operator()(const hobject_t &r) const {
-      static hash<object_t> H;
       static rjhash<uint64_t> I;
+      if (r.hash)
+	return I(((uint64_t)r.hash << 32) ^ (uint64_t)r.snap ^ r.pool);
+      static hash<object_t> H;
       return H(r.oid) ^ I(r.snap);
     }
   };
@@ -219,16 +223,54 @@ CEPH_HASH_NAMESPACE_END
 
 ostream& operator<<(ostream& out, const hobject_t& o);
 
-WRITE_EQ_OPERATORS_7(hobject_t, oid, get_key(), snap, hash, max, pool, nspace)
-// sort hobject_t's by <max, get_filestore_key(hash), key, oid, snapid>
-WRITE_CMP_OPERATORS_7(hobject_t,
-		      max,
-		      get_filestore_key(),
-		      nspace,
-		      pool,
-		      get_effective_key(),
-		      oid,
-		      snap)
+// compare the cheap fields first: most unequal objects differ in hash
+WRITE_EQ_OPERATORS_7(hobject_t, hash, snap, pool, max, oid, get_key(), nspace)
+
+/**
+ * sort hobject_t's by <max, get_filestore_key(hash), nspace, pool,
+ * effective key, oid, snapid>
+ *
+ * Each string is compared once, and only when everything before it
+ * is equal; objects in different hash slots never get that far.
+ */
+inline int cmp(const hobject_t& l, const hobject_t& r)
+{
+  if (l.max != r.max)
+    return l.max ? 1 : -1;
+  if (!l.max && l.hash != r.hash)
+    return hobject_t::_reverse_nibbles(l.hash) <
+      hobject_t::_reverse_nibbles(r.hash) ? -1 : 1;
+  int c = l.nspace.compare(r.nspace);
+  if (c)
+    return c;
+  if (l.pool != r.pool)
+    return l.pool < r.pool ? -1 : 1;
+  c = l.get_effective_key().compare(r.get_effective_key());
+  if (c)
+    return c;
+  // without locator keys the effective keys were the names
+  if (l.key.length() || r.key.length()) {
+    c = l.oid.name.compare(r.oid.name);
+    if (c)
+      return c;
+  }
+  if (l.snap != r.snap)
+    return l.snap < r.snap ? -1 : 1;
+  return 0;
+}
+
+inline bool operator<(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) < 0;
+}
+inline bool operator<=(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) <= 0;
+}
+inline bool operator>(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) > 0;
+}
+inline bool operator>=(const hobject_t& l, const hobject_t& r) {
+  return cmp(l, r) >= 0;
+}
 
 typedef version_t gen_t;
 typedef uint8_t shard_t;
@@ -318,23 +360,44 @@ WRITE_CLASS_ENCODER(ghobject_t)
 CEPH_HASH_NAMESPACE_START
   template<> struct hash<ghobject_t> {
     size_t operator()(const ghobject_t &r) const {
-      static hash<object_t> H;
+      static hash<hobject_t> H;
       static rjhash<uint64_t> I;
-      return H(r.hobj.oid) ^ I(r.hobj.snap);
+      return H(r.hobj) ^ I(r.generation ^ ((uint64_t)r.shard_id << 56));
     }
   };
 CEPH_HASH_NAMESPACE_END
 
 ostream& operator<<(ostream& out, const ghobject_t& o);
 
-WRITE_EQ_OPERATORS_3(ghobject_t, hobj, shard_id, generation)
-// sort ghobject_t's by <hobj, shard_id, generation> 
-// 
+WRITE_EQ_OPERATORS_3(ghobject_t, generation, shard_id, hobj)
+
+// sort ghobject_t's by <hobj, shard_id, generation>
+//
 // Two objects which differ by generation are more related than
 // two objects of the same generation which differ by shard.
-// 
-WRITE_CMP_OPERATORS_3(ghobject_t,
-		      hobj,
-		      shard_id,
-		      generation)
+//
+inline int cmp(const ghobject_t& l, const ghobject_t& r)
+{
+  int c = cmp(l.hobj, r.hobj);
+  if (c)
+    return c;
+  if (l.shard_id != r.shard_id)
+    return l.shard_id < r.shard_id ? -1 : 1;
+  if (l.generation != r.generation)
+    return l.generation < r.generation ? -1 : 1;
+  return 0;
+}
+
+inline bool operator<(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) < 0;
+}
+inline bool operator<=(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) <= 0;
+}
+inline bool operator>(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) > 0;
+}
+inline bool operator>=(const ghobject_t& l, const ghobject_t& r) {
+  return cmp(l, r) >= 0;
+}
 #endif
@@ -20,6 +20,7 @@
 #include "include/memory.h"
 #include <set>
 #include <map>
+#include <vector>
 #include <utility>
 #include <string>
 #include <errno.h>
@@ -69,6 +70,26 @@ public:
     pair<K, V> *next    ///< [out] first key after key
     ) = 0; ///< @return 0 on success, -ENOENT if there is no next
 
+  /// Returns up to max keys following key, in order
+  virtual int get_next_n(
+    const K &key,                  ///< [in] key after which to start
+    unsigned max,                  ///< [in] most keys to return
+    std::vector<pair<K, V> > *out  ///< [out] keys found, in order
+    ) {
+    K cur = key;
+    while (out->size() < max) {
+      pair<K, V> next;
+      int r = get_next(cur, &next);
+      if (r == -ENOENT)
+	break;
+      if (r < 0)
+	return r;
+      cur = next.first;
+      out->push_back(next);
+    }
+    return out->empty() ? -ENOENT : 0;
+  } ///< @return 0 on success, -ENOENT if there is no next
+
   virtual ~StoreDriver() {}
 };
 
@@ -130,6 +151,51 @@ public:
     return -EINVAL;
   } ///< @return error value, 0 on success, -ENOENT if no more entries
 
+  /**
+   * Fetch up to max key/value pairs after specified key
+   *
+   * Equivalent to repeated get_next, but reads the store a batch at a
+   * time rather than once per key.
+   */
+  int get_next_n(
+    K key,                         ///< [in] key after which to start
+    unsigned max,                  ///< [in] most keys to return
+    std::vector<pair<K, V> > *out  ///< [out] keys found, in order
+    ) {
+    out->clear();
+    while (out->size() < max) {
+      unsigned want = max - out->size();
+      std::vector<pair<K, V> > store;
+      int r = driver->get_next_n(key, want, &store);
+      if (r < 0 && r != -ENOENT)
+	return r;
+      bool store_done = store.size() < want;
+
+      typename std::vector<pair<K, V> >::iterator s = store.begin();
+      while (out->size() < max) {
+	if (s == store.end() && !store_done)
+	  break; // the store may have more before the next cached key
+	pair<K, boost::optional<V> > cached;
+	bool got_cached = in_progress.get_next(key, &cached);
+	if (got_cached &&
+	    (s == store.end() || s->first >= cached.first)) {
+	  if (s != store.end() && s->first == cached.first)
+	    ++s; // superseded by the in progress write
+	  key = cached.first;
+	  if (cached.second)
+	    out->push_back(make_pair(cached.first, cached.second.get()));
+	} else if (s != store.end()) {
+	  key = s->first;
+	  out->push_back(*s);
+	  ++s;
+	} else {
+	  return out->empty() ? -ENOENT : 0;
+	}
+      }
+    }
+    return 0;
+  } ///< @return error value, 0 on success, -ENOENT if no more entries
+
   /// Adds operation setting keys to Transaction
   void set_keys(
     const map<K, V> &keys,  ///< [in] keys/values to set
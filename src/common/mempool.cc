@@ -0,0 +1,74 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/mempool.h"
+#include "common/Formatter.h"
+
+static mempool::pool_t pools[mempool::num_pools];
+
+mempool::pool_t& mempool::get_pool(pool_index_t ix)
+{
+  return pools[ix];
+}
+
+const char *mempool::get_pool_name(pool_index_t ix)
+{
+#define P(x) #x,
+  static const char *names[] = {
+    DEFINE_MEMORY_POOLS_HELPER(P)
+  };
+#undef P
+  return names[ix];
+}
+
+// shards may go negative when memory is freed by another thread than
+// the one that allocated it; the sum doesn't
+int64_t mempool::pool_t::allocated_bytes() const
+{
+  uint64_t r = 0;
+  for (int i = 0; i < num_shards; ++i)
+    r += shard[i].bytes.read();
+  return (int64_t)r;
+}
+
+int64_t mempool::pool_t::allocated_items() const
+{
+  uint64_t r = 0;
+  for (int i = 0; i < num_shards; ++i)
+    r += shard[i].items.read();
+  return (int64_t)r;
+}
+
+void mempool::pool_t::dump(ceph::Formatter *f) const
+{
+  f->dump_int("items", allocated_items());
+  f->dump_int("bytes", allocated_bytes());
+}
+
+void mempool::dump(ceph::Formatter *f)
+{
+  int64_t bytes = 0, items = 0;
+  f->open_object_section("pools");
+  for (int i = 0; i < num_pools; ++i) {
+    const pool_t &pool = get_pool((pool_index_t)i);
+    f->open_object_section(get_pool_name((pool_index_t)i));
+    pool.dump(f);
+    f->close_section();
+    bytes += pool.allocated_bytes();
+    items += pool.allocated_items();
+  }
+  f->close_section();
+  f->open_object_section("total");
+  f->dump_int("items", items);
+  f->dump_int("bytes", bytes);
+  f->close_section();
+}
@@ -0,0 +1,175 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MEMPOOL_H
+#define CEPH_MEMPOOL_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <new>
+
+#include "include/atomic.h"
+
+namespace ceph {
+  class Formatter;
+}
+
+/**
+ * Memory accounting by subsystem.
+ *
+ * Each pool counts the bytes and items allocated for one kind of thing,
+ * so we can tell where a daemon's memory goes without a heap profiler.
+ * The counters are sharded by thread so that allocating threads don't
+ * all bounce the same cache line; reading a pool sums the shards.
+ *
+ * Memory gets into a pool in one of three ways:
+ *
+ *  - a class declares MEMPOOL_CLASS_HELPERS() and its .cc file
+ *    MEMPOOL_DEFINE_OBJECT_FACTORY(Class, pool): each new/delete of it
+ *    (or of a subclass) is accounted;
+ *  - an STL container is given a mempool::pool_allocator;
+ *  - code that already manages its own memory (bufferptr raws, classes
+ *    with their own operator new) calls get_pool(ix).adjust() itself.
+ *
+ * Only the allocations themselves are counted, so e.g. an OSDMap's
+ * pool accounts for the OSDMap objects but not for the vectors and maps
+ * hanging off them.
+ */
+namespace mempool {
+
+#define DEFINE_MEMORY_POOLS_HELPER(f)	\
+  f(buffer_anon)			\
+  f(msgr)				\
+  f(osdmap)				\
+  f(osd_obc)				\
+  f(mds_co)
+
+#define P(x) mempool_##x,
+enum pool_index_t {
+  DEFINE_MEMORY_POOLS_HELPER(P)
+  num_pools
+};
+#undef P
+
+const char *get_pool_name(pool_index_t ix);
+
+class pool_t {
+  static const int num_shards = 32;
+  struct shard_t {
+    ceph::atomic64_t bytes;
+    ceph::atomic64_t items;
+    char pad[128 - (2 * sizeof(ceph::atomic64_t)) % 128];
+  } shard[num_shards];
+
+  shard_t *pick_a_shard() {
+    // pthread_t is the address of the thread's control block; skip the
+    // low bits, which are the same for every thread
+    size_t me = (size_t)pthread_self();
+    return &shard[(me >> 12) % num_shards];
+  }
+
+public:
+  void adjust(ssize_t bytes, ssize_t items) {
+    shard_t *s = pick_a_shard();
+    s->bytes.add((uint64_t)bytes);
+    s->items.add((uint64_t)items);
+  }
+
+  int64_t allocated_bytes() const;
+  int64_t allocated_items() const;
+  void dump(ceph::Formatter *f) const;
+};
+
+pool_t& get_pool(pool_index_t ix);
+
+/// dump all pools, and their totals
+void dump(ceph::Formatter *f);
+
+
+/// STL allocator accounting into pool pool_ix
+template <pool_index_t pool_ix, typename T>
+class pool_allocator {
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+    typedef pool_allocator<pool_ix, U> other;
+  };
+
+  pool_allocator() {}
+  template <typename U>
+  pool_allocator(const pool_allocator<pool_ix, U>&) {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void * = 0) {
+    size_t bytes = n * sizeof(T);
+    pointer r = static_cast<pointer>(::operator new(bytes));
+    get_pool(pool_ix).adjust(bytes, n);
+    return r;
+  }
+  void deallocate(pointer p, size_type n) {
+    get_pool(pool_ix).adjust(-(ssize_t)(n * sizeof(T)), -(ssize_t)n);
+    ::operator delete(p);
+  }
+
+  size_type max_size() const {
+    return (size_t)-1 / sizeof(T);
+  }
+  void construct(pointer p, const T& val) {
+    new((void *)p) T(val);
+  }
+  void destroy(pointer p) {
+    p->~T();
+  }
+};
+
+template <pool_index_t pool_ix, typename T, typename U>
+inline bool operator==(const pool_allocator<pool_ix, T>&,
+		       const pool_allocator<pool_ix, U>&) {
+  return true;
+}
+
+template <pool_index_t pool_ix, typename T, typename U>
+inline bool operator!=(const pool_allocator<pool_ix, T>&,
+		       const pool_allocator<pool_ix, U>&) {
+  return false;
+}
+
+}
+
+/// declare class-level new/delete; pair with MEMPOOL_DEFINE_OBJECT_FACTORY
+#define MEMPOOL_CLASS_HELPERS()						\
+  static void *operator new(size_t size);				\
+  static void operator delete(void *p, size_t size);
+
+#define MEMPOOL_DEFINE_OBJECT_FACTORY(obj, pool)			\
+  void *obj::operator new(size_t size) {				\
+    void *r = ::operator new(size);					\
+    mempool::get_pool(mempool::mempool_##pool).adjust(size, 1);	\
+    return r;								\
+  }									\
+  void obj::operator delete(void *p, size_t size) {			\
+    mempool::get_pool(mempool::mempool_##pool).adjust(-(ssize_t)size, -1); \
+    ::operator delete(p);						\
+  }
+
+#endif
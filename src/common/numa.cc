@@ -0,0 +1,234 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/numa.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <sys/sysmacros.h>
+#endif
+
+#ifndef CPU_SETSIZE
+#define CPU_SETSIZE 1024
+#endif
+
+int parse_cpu_list(const std::string &s, std::set<int> *cpus)
+{
+  cpus->clear();
+  std::istringstream is(s);
+  std::string item;
+  while (std::getline(is, item, ',')) {
+    size_t b = item.find_first_not_of(" \t\n");
+    if (b == std::string::npos)
+      continue;
+    size_t e = item.find_last_not_of(" \t\n");
+    item = item.substr(b, e - b + 1);
+
+    char *end;
+    long first = strtol(item.c_str(), &end, 10);
+    long last = first;
+    if (end == item.c_str())
+      return -EINVAL;
+    if (*end == '-') {
+      const char *p = end + 1;
+      last = strtol(p, &end, 10);
+      if (end == p)
+	return -EINVAL;
+    }
+    if (*end || first < 0 || last < first || last >= CPU_SETSIZE)
+      return -EINVAL;
+    for (long i = first; i <= last; ++i)
+      cpus->insert(i);
+  }
+  return 0;
+}
+
+#if defined(__linux__)
+
+static int read_numa_node(const std::string &fn, int *node)
+{
+  std::ifstream f(fn.c_str());
+  if (!f.is_open())
+    return -errno;
+  int n;
+  if (!(f >> n))
+    return -EINVAL;
+  if (n < 0)
+    return -ENOENT;  // the platform doesn't know
+  *node = n;
+  return 0;
+}
+
+int get_numa_node_cpus(int node, std::set<int> *cpus)
+{
+  std::ostringstream fn;
+  fn << "/sys/devices/system/node/node" << node << "/cpulist";
+  std::ifstream f(fn.str().c_str());
+  if (!f.is_open())
+    return -errno;
+  std::string s;
+  std::getline(f, s);
+  return parse_cpu_list(s, cpus);
+}
+
+int get_iface_numa_node(const std::string &iface, int *node)
+{
+  return read_numa_node("/sys/class/net/" + iface + "/device/numa_node", node);
+}
+
+int get_path_numa_node(const std::string &path, int *node)
+{
+  struct stat st;
+  if (::stat(path.c_str(), &st) < 0)
+    return -errno;
+  dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+
+  // /sys/dev/block/M:m links into the device tree; a partition sits
+  // below its disk, which sits below the controller that has a node
+  char link[64];
+  snprintf(link, sizeof(link), "/sys/dev/block/%u:%u", major(dev), minor(dev));
+  char buf[PATH_MAX];
+  if (!realpath(link, buf))
+    return -errno;
+  std::string dir(buf);
+  while (dir.length() > strlen("/sys/devices")) {
+    std::string fn = dir + "/numa_node";
+    if (::access(fn.c_str(), R_OK) == 0)
+      return read_numa_node(fn, node);
+    dir.resize(dir.rfind('/'));
+  }
+  return -ENOENT;
+}
+
+int get_iface_for_addr(const struct sockaddr *addr, std::string *iface)
+{
+  struct ifaddrs *ifa;
+  if (getifaddrs(&ifa) < 0)
+    return -errno;
+  int r = -ENOENT;
+  for (struct ifaddrs *p = ifa; p; p = p->ifa_next) {
+    if (!p->ifa_addr || p->ifa_addr->sa_family != addr->sa_family)
+      continue;
+    bool match = false;
+    if (addr->sa_family == AF_INET)
+      match = ((struct sockaddr_in*)p->ifa_addr)->sin_addr.s_addr ==
+	((struct sockaddr_in*)addr)->sin_addr.s_addr;
+    else if (addr->sa_family == AF_INET6)
+      match = memcmp(&((struct sockaddr_in6*)p->ifa_addr)->sin6_addr,
+		     &((struct sockaddr_in6*)addr)->sin6_addr,
+		     sizeof(struct in6_addr)) == 0;
+    if (match) {
+      *iface = p->ifa_name;
+      r = 0;
+      break;
+    }
+  }
+  freeifaddrs(ifa);
+  return r;
+}
+
+int set_process_cpu_affinity(const std::set<int> &cpus)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (std::set<int>::const_iterator p = cpus.begin(); p != cpus.end(); ++p) {
+    if (*p < 0 || *p >= CPU_SETSIZE)
+      return -EINVAL;
+    CPU_SET(*p, &set);
+  }
+
+  DIR *d = opendir("/proc/self/task");
+  if (!d)
+    return -errno;
+  int r = 0;
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    pid_t tid = atoi(de->d_name);
+    if (sched_setaffinity(tid, sizeof(set), &set) < 0 && errno != ESRCH) {
+      r = -errno;
+      break;
+    }
+  }
+  closedir(d);
+  return r;
+}
+
+int set_numa_preferred_node(int node)
+{
+#ifdef SYS_set_mempolicy
+  const int MPOL_PREFERRED = 1;  // from linux/mempolicy.h
+  const unsigned bits = sizeof(unsigned long) * 8;
+  unsigned long mask[1024 / bits];
+  if (node < 0 || node >= (int)(sizeof(mask) * 8))
+    return -EINVAL;
+  memset(mask, 0, sizeof(mask));
+  mask[node / bits] |= 1ul << (node % bits);
+  if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8) < 0)
+    return -errno;
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+#else
+
+int get_numa_node_cpus(int node, std::set<int> *cpus)
+{
+  return -EOPNOTSUPP;
+}
+
+int get_iface_numa_node(const std::string &iface, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
+int get_path_numa_node(const std::string &path, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
+int get_iface_for_addr(const struct sockaddr *addr, std::string *iface)
+{
+  return -EOPNOTSUPP;
+}
+
+int set_process_cpu_affinity(const std::set<int> &cpus)
+{
+  return -EOPNOTSUPP;
+}
+
+int set_numa_preferred_node(int node)
+{
+  return -EOPNOTSUPP;
+}
+
+#endif
@@ -0,0 +1,58 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_NUMA_H
+#define CEPH_COMMON_NUMA_H
+
+#include <set>
+#include <string>
+
+struct sockaddr;
+
+/*
+ * CPU and NUMA placement helpers.  All return 0 or a negative error
+ * code.  The topology comes from sysfs, so off Linux everything but
+ * parse_cpu_list() returns -EOPNOTSUPP; -ENOENT means the platform
+ * does not know which node a device is on.
+ */
+
+/// parse a cpu list in the sysfs/taskset format, e.g. "0-3,8,10-11"
+int parse_cpu_list(const std::string &s, std::set<int> *cpus);
+
+/// the cpus of a numa node
+int get_numa_node_cpus(int node, std::set<int> *cpus);
+
+/// the numa node of the device a network interface is on
+int get_iface_numa_node(const std::string &iface, int *node);
+
+/// the numa node of the device behind path: a block device, or a file on one
+int get_path_numa_node(const std::string &path, int *node);
+
+/// the local interface an address is assigned to
+int get_iface_for_addr(const struct sockaddr *addr, std::string *iface);
+
+/**
+ * Bind the whole process to some cpus.
+ *
+ * This covers the threads that already exist and, since new threads
+ * inherit the mask of their creator, those started later.
+ */
+int set_process_cpu_affinity(const std::set<int> &cpus);
+
+/**
+ * Prefer memory on a numa node for allocations made by the calling
+ * thread and the threads it creates afterwards, falling back to other
+ * nodes when it is full.
+ */
+int set_numa_preferred_node(int node);
+
+#endif
@@ -15,6 +15,7 @@
  * it will just loop forever.
  */
 #include "common/Cond.h"
+#include "common/histogram.h"
 #include "obj_bencher.h"
 
 #include <iostream>
@@ -71,10 +72,12 @@ static void sanitize_object_contents (bench_data *data, int length) {
 
 ostream& ObjBencher::out(ostream& os, utime_t& t)
 {
+  // with a formatter, stdout is for its results only
+  ostream& o = (formatter && &os == &cout) ? cerr : os;
   if (show_time)
-    return t.localtime(os) << " ";
+    return t.localtime(o) << " ";
   else
-    return os << " ";
+    return o << " ";
 }
 
 ostream& ObjBencher::out(ostream& os)
@@ -99,7 +102,8 @@ void *ObjBencher::status_printer(void *_bencher) {
 
     if (i % 20 == 0) {
       if (i > 0)
-	cur_time.localtime(cout) << "min lat: " << data.min_latency
+	cur_time.localtime(bencher->formatter ? cerr : cout)
+	     << "min lat: " << data.min_latency
 	     << " max lat: " << data.max_latency
 	     << " avg lat: " << data.avg_latency << std::endl;
       //I'm naughty and don't reset the fill
@@ -175,7 +179,7 @@ int ObjBencher::aio_bench(
   int prevPid = 0;
 
   //get data from previous write run, if available
-  if (operation != OP_WRITE) {
+  if (operation != OP_WRITE && operation != OP_MIX) {
     r = fetch_bench_metadata(BENCH_LASTRUN_METADATA, &object_size, &num_objects, &prevPid);
     if (r < 0) {
       delete[] contentsChars;
@@ -205,6 +209,9 @@ int ObjBencher::aio_bench(
   //fill in contentsChars deterministically so we can check returns
   sanitize_object_contents(&data, data.object_size);
 
+  if (formatter)
+    formatter->open_array_section("results");
+
   if (OP_WRITE == operation) {
     r = write_bench(secondsToRun, maxObjectsToCreate, concurrentios);
     if (r != 0) goto out;
@@ -217,8 +224,12 @@ int ObjBencher::aio_bench(
     r = rand_read_bench(secondsToRun, num_objects, concurrentios, prevPid);
     if (r != 0) goto out;
   }
+  else if (OP_MIX == operation) {
+    r = mix_bench(secondsToRun, maxObjectsToCreate, concurrentios);
+    if (r != 0) goto out;
+  }
 
-  if (OP_WRITE == operation && cleanup) {
+  if ((OP_WRITE == operation || OP_MIX == operation) && cleanup) {
     r = fetch_bench_metadata(BENCH_LASTRUN_METADATA, &object_size, &num_objects, &prevPid);
     if (r < 0) {
       if (r == -ENOENT)
@@ -238,6 +249,11 @@ int ObjBencher::aio_bench(
   }
 
  out:
+  if (formatter) {
+    formatter->close_section();
+    formatter->flush(cout);
+    cout << std::endl;
+  }
   delete[] contentsChars;
   return r;
 }
@@ -320,7 +336,6 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
   std::vector<utime_t> start_times(concurrentios);
   utime_t stopTime;
   int r = 0;
-  bufferlist b_write;
   lock_cond lc(&lock);
   utime_t runtime;
   utime_t timePassed;
@@ -475,17 +490,10 @@ int ObjBencher::write_bench(int secondsToRun, int maxObjectsToCreate,
        << "Stddev Latency:         " << vec_stddev(data.history.latency) << std::endl
        << "Max latency:            " << data.max_latency << std::endl
        << "Min latency:            " << data.min_latency << std::endl;
+  report("write", timePassed, data.finished,
+	 (uint64_t)data.finished * data.object_size, data.history.latency);
 
-  //write object size/number data for read benchmarks
-  ::encode(data.object_size, b_write);
-  ::encode(data.finished, b_write);
-  ::encode(getpid(), b_write);
-
-  // lastrun file
-  sync_write(BENCH_LASTRUN_METADATA, b_write, sizeof(int)*3);
-
-  // PID-specific run
-  sync_write(generate_metadata_name(), b_write, sizeof(int)*3);
+  write_bench_metadata(data.object_size, data.finished);
 
   completions_done();
 
@@ -591,6 +599,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
       goto ERR;
     }
     data.cur_latency = ceph_clock_now(cct) - start_times[slot];
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if( data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -634,6 +643,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
       goto ERR;
     }
     data.cur_latency = ceph_clock_now(cct) - start_times[slot];
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -670,6 +680,8 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
        << "Average Latency:       " << data.avg_latency << std::endl
        << "Max latency:           " << data.max_latency << std::endl
        << "Min latency:           " << data.min_latency << std::endl;
+  report("seq", runtime, data.finished,
+	 (uint64_t)data.finished * data.object_size, data.history.latency);
 
   completions_done();
 
@@ -778,6 +790,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
       goto ERR;
     }
     data.cur_latency = ceph_clock_now(g_ceph_context) - start_times[slot];
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if( data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -821,6 +834,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
       goto ERR;
     }
     data.cur_latency = ceph_clock_now(g_ceph_context) - start_times[slot];
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -857,6 +871,8 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
        << "Average Latency:       " << data.avg_latency << std::endl
        << "Max latency:           " << data.max_latency << std::endl
        << "Min latency:           " << data.min_latency << std::endl;
+  report("rand", runtime, data.finished,
+	 (uint64_t)data.finished * data.object_size, data.history.latency);
 
   completions_done();
 
@@ -899,6 +915,263 @@ int ObjBencher::clean_up(const std::string& prefix, int concurrentios) {
   return 0;
 }
 
+int ObjBencher::write_bench_metadata(int object_size, int num_objects)
+{
+  //write object size/number data for read benchmarks
+  bufferlist b_write;
+  ::encode(object_size, b_write);
+  ::encode(num_objects, b_write);
+  ::encode(getpid(), b_write);
+
+  // lastrun file
+  int r = sync_write(BENCH_LASTRUN_METADATA, b_write, sizeof(int)*3);
+  if (r < 0)
+    return r;
+
+  // PID-specific run
+  return sync_write(generate_metadata_name(), b_write, sizeof(int)*3);
+}
+
+static double percentile(const vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  return sorted[(size_t)(p * (sorted.size() - 1) + .5)];
+}
+
+void ObjBencher::report(const char *op, double runtime, int ops,
+			uint64_t bytes, vector<double>& latency)
+{
+  vector<double> sorted(latency);
+  sort(sorted.begin(), sorted.end());
+  const double ps[] = { .5, .9, .95, .99, .999 };
+  const char *pnames[] = { "p50", "p90", "p95", "p99", "p99.9" };
+  const int np = sizeof(ps) / sizeof(ps[0]);
+
+  if (!formatter) {
+    out(cout) << "Latency percentiles:   ";
+    for (int i = 0; i < np; ++i)
+      cout << pnames[i] << " " << percentile(sorted, ps[i])
+	   << (i + 1 < np ? ", " : "\n");
+    return;
+  }
+
+  double sum = 0;
+  pow2_hist_t hist;
+  for (vector<double>::iterator p = sorted.begin(); p != sorted.end(); ++p) {
+    sum += *p;
+    hist.add((int32_t)(*p * 1000000.0));
+  }
+  formatter->open_object_section("result");
+  formatter->dump_string("op", op);
+  formatter->dump_float("runtime", runtime);
+  formatter->dump_int("ops", ops);
+  formatter->dump_unsigned("bytes", bytes);
+  formatter->dump_float("iops", runtime > 0 ? ops / runtime : 0);
+  formatter->dump_float("bandwidth_mb_sec",
+			runtime > 0 ? bytes / runtime / (1024*1024) : 0);
+  formatter->open_object_section("latency");
+  formatter->dump_float("avg", sorted.empty() ? 0 : sum / sorted.size());
+  formatter->dump_float("stddev", vec_stddev(sorted));
+  formatter->dump_float("min", sorted.empty() ? 0 : sorted.front());
+  formatter->dump_float("max", sorted.empty() ? 0 : sorted.back());
+  for (int i = 0; i < np; ++i)
+    formatter->dump_float(pnames[i], percentile(sorted, ps[i]));
+  formatter->open_object_section("histogram_usec");
+  hist.dump(formatter);
+  formatter->close_section();
+  formatter->close_section();
+  formatter->close_section();
+}
+
+/*
+ * Reads and writes in one run.  Writes create new objects, of a size
+ * picked uniformly from [min_object_size, max_object_size]; reads
+ * fetch a random object written earlier in the run.
+ *
+ * With target_iops set this is open loop: ops are started on schedule
+ * whether or not earlier ones have completed (up to concurrentios in
+ * flight), and latency counts from when an op was due, so a backed up
+ * cluster shows as latency rather than as a lower rate.
+ */
+int ObjBencher::mix_bench(int secondsToRun, int maxObjectsToCreate,
+			  int concurrentios)
+{
+  int min_size = min_object_size ? min_object_size : data.object_size;
+  int max_size = max_object_size ? max_object_size : data.object_size;
+  if (max_size < min_size)
+    max_size = min_size;
+  out(cout) << "Maintaining " << (target_iops ? "up to " : "")
+	    << concurrentios << " concurrent ops, " << read_percent
+	    << "% reads, objects of " << min_size << "-" << max_size
+	    << " bytes";
+  if (target_iops)
+    cout << ", at " << target_iops << " ops/sec";
+  cout << ", for up to " << secondsToRun << " seconds or "
+       << maxObjectsToCreate << " objects" << std::endl;
+  out(cout) << "Object prefix: " << generate_object_prefix() << std::endl;
+
+  int r = completions_init(concurrentios);
+  if (r < 0)
+    return r;
+
+  bufferptr contents(max_size);
+  memset(contents.c_str(), 'z', max_size);
+
+  vector<bool> busy(concurrentios, false), is_read(concurrentios, false);
+  vector<int> slot_object(concurrentios);
+  vector<utime_t> start_times(concurrentios);
+  vector<bufferlist> bls(concurrentios);
+  vector<int> object_size;  ///< by object number
+  vector<int> readable;     ///< objects whose writes have completed
+  vector<double> read_latency, write_latency;
+  uint64_t read_bytes = 0, write_bytes = 0;
+  int late = 0;             ///< ops started late, for want of a free slot
+  double total_latency = 0;
+  lock_cond lc(&lock);
+
+  utime_t interval;
+  if (target_iops)
+    interval.set_from_double(1.0 / target_iops);
+  utime_t runtime;
+  runtime.set_from_double(secondsToRun);
+
+  pthread_t print_thread;
+  lock.Lock();
+  data.start_time = ceph_clock_now(cct);
+  data.finished = 0;
+  utime_t stop_time = data.start_time + runtime;
+  utime_t next_op = data.start_time;
+  lock.Unlock();
+  pthread_create(&print_thread, NULL, ObjBencher::status_printer, (void *)this);
+
+  lock.Lock();
+  while (true) {
+    utime_t now = ceph_clock_now(cct);
+
+    // reap
+    for (int slot = 0; slot < concurrentios; ++slot) {
+      if (!busy[slot] || !completion_is_done(slot))
+	continue;
+      r = completion_ret(slot);
+      if (r < 0) {
+	cerr << (is_read[slot] ? "read" : "write") << " got " << r << std::endl;
+	lock.Unlock();
+	goto ERR;
+      }
+      data.cur_latency = now - start_times[slot];
+      data.history.latency.push_back(data.cur_latency);
+      total_latency += data.cur_latency;
+      if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
+      if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
+      ++data.finished;
+      data.avg_latency = total_latency / data.finished;
+      --data.in_flight;
+      if (is_read[slot]) {
+	read_latency.push_back(data.cur_latency);
+	read_bytes += object_size[slot_object[slot]];
+      } else {
+	write_latency.push_back(data.cur_latency);
+	write_bytes += object_size[slot_object[slot]];
+	readable.push_back(slot_object[slot]);
+      }
+      release_completion(slot);
+      bls[slot].clear();
+      busy[slot] = false;
+    }
+
+    bool more = now < stop_time &&
+      (!maxObjectsToCreate || (int)object_size.size() < maxObjectsToCreate);
+    if (!more && !data.in_flight)
+      break;
+
+    // start what is due
+    int slot = 0;
+    while (more && (!target_iops || next_op <= now)) {
+      while (slot < concurrentios && busy[slot])
+	++slot;
+      if (slot == concurrentios)
+	break;
+      if (target_iops) {
+	start_times[slot] = next_op;
+	if (now - next_op > interval)
+	  ++late;
+	next_op += interval;
+      } else {
+	start_times[slot] = now;
+      }
+      is_read[slot] = !readable.empty() && rand() % 100 < read_percent;
+      if (is_read[slot]) {
+	slot_object[slot] = readable[rand() % readable.size()];
+      } else {
+	slot_object[slot] = object_size.size();
+	object_size.push_back(min_size + rand() % (max_size - min_size + 1));
+      }
+      busy[slot] = true;
+      ++data.started;
+      ++data.in_flight;
+      lock.Unlock();
+      string oid = generate_object_name(slot_object[slot]);
+      int len = object_size[slot_object[slot]];
+      r = create_completion(slot, _aio_cb, (void *)&lc);
+      if (r >= 0) {
+	if (is_read[slot]) {
+	  r = aio_read(oid, slot, &bls[slot], len);
+	} else {
+	  bls[slot].append(contents, 0, len);
+	  r = aio_write(oid, slot, bls[slot], len);
+	}
+      }
+      if (r < 0)
+	goto ERR;
+      lock.Lock();
+      if (maxObjectsToCreate && (int)object_size.size() >= maxObjectsToCreate)
+	more = false;
+    }
+
+    if (more && target_iops && slot < concurrentios)
+      lc.cond.WaitUntil(lock, next_op);
+    else
+      lc.cond.Wait(lock);
+  }
+  lock.Unlock();
+
+  runtime = ceph_clock_now(cct) - data.start_time;
+  lock.Lock();
+  data.done = true;
+  lock.Unlock();
+  pthread_join(print_thread, NULL);
+
+  out(cout) << "Total time run:         " << runtime << std::endl
+	    << "Total reads made:       " << read_latency.size() << std::endl
+	    << "Total writes made:      " << write_latency.size() << std::endl
+	    << "Bandwidth (MB/sec):     "
+	    << (read_bytes + write_bytes) / (double)runtime / (1024*1024)
+	    << std::endl
+	    << "Average Latency:        " << data.avg_latency << std::endl
+	    << "Max latency:            " << data.max_latency << std::endl
+	    << "Min latency:            " << data.min_latency << std::endl;
+  if (target_iops)
+    out(cout) << "Started late:           " << late << std::endl;
+  out(cout) << "Reads:" << std::endl;
+  report("read", runtime, read_latency.size(), read_bytes, read_latency);
+  out(cout) << "Writes:" << std::endl;
+  report("write", runtime, write_latency.size(), write_bytes, write_latency);
+
+  // so that cleanup can find the objects
+  write_bench_metadata(max_size, object_size.size());
+
+  completions_done();
+  return 0;
+
+ ERR:
+  lock.Lock();
+  data.done = 1;
+  lock.Unlock();
+  pthread_join(print_thread, NULL);
+  return -5;
+}
+
 int ObjBencher::clean_up(int num_objects, int prevPid, int concurrentios) {
   lock_cond lc(&lock);
   std::vector<string> name(concurrentios);
@@ -17,6 +17,7 @@
 #include "common/config.h"
 #include "common/Cond.h"
 #include "common/ceph_context.h"
+#include "common/Formatter.h"
 
 struct bench_interval_data {
   double min_bandwidth;
@@ -49,9 +50,16 @@ struct bench_data {
 const int OP_WRITE     = 1;
 const int OP_SEQ_READ  = 2;
 const int OP_RAND_READ = 3;
+const int OP_MIX       = 4;
 
 class ObjBencher {
   bool show_time;
+  Formatter *formatter;  ///< results go here rather than to stdout, if set
+
+  // for OP_MIX
+  int read_percent;
+  int min_object_size, max_object_size;  ///< 0 for op_size
+  int target_iops;                       ///< open loop at this rate, if set
 public:
   CephContext *cct;
 protected:
@@ -66,6 +74,11 @@ protected:
   int write_bench(int secondsToRun, int maxObjects, int concurrentios);
   int seq_read_bench(int secondsToRun, int concurrentios, int num_objects, int writePid);
   int rand_read_bench(int secondsToRun, int num_objects, int concurrentios, int writePid);
+  int mix_bench(int secondsToRun, int maxObjects, int concurrentios);
+
+  void report(const char *op, double runtime, int ops, uint64_t bytes,
+	      vector<double>& latency);
+  int write_bench_metadata(int object_size, int num_objects);
 
   int clean_up(int num_objects, int prevPid, int concurrentios);
   int clean_up_slow(const std::string& prefix, int concurrentios);
@@ -93,7 +106,10 @@ protected:
   ostream& out(ostream& os);
   ostream& out(ostream& os, utime_t& t);
 public:
-  ObjBencher(CephContext *cct_) : show_time(false), cct(cct_), lock("ObjBencher::lock") {}
+  ObjBencher(CephContext *cct_)
+    : show_time(false), formatter(NULL), read_percent(50),
+      min_object_size(0), max_object_size(0), target_iops(0),
+      cct(cct_), lock("ObjBencher::lock") {}
   virtual ~ObjBencher() {}
   int aio_bench(
     int operation, int secondsToRun, int maxObjectsToCreate,
@@ -103,6 +119,18 @@ public:
   void set_show_time(bool dt) {
     show_time = dt;
   }
+  /// dump results to f rather than printing them; progress goes to stderr
+  void set_formatter(Formatter *f) {
+    formatter = f;
+  }
+  void set_mix(int percent, int min_size, int max_size) {
+    read_percent = percent;
+    min_object_size = min_size;
+    max_object_size = max_size;
+  }
+  void set_target_iops(int iops) {
+    target_iops = iops;
+  }
 };
 
 
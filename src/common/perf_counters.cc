@@ -74,6 +74,21 @@ void PerfCountersCollection::clear()
   }
 }
 
+bool PerfCountersCollection::reset(const std::string &name)
+{
+  Mutex::Locker lck(m_lock);
+  bool found = false;
+  for (perf_counters_set_t::iterator l = m_loggers.begin();
+       l != m_loggers.end();
+       ++l) {
+    if (name == "all" || (*l)->get_name() == name) {
+      (*l)->reset();
+      found = true;
+    }
+  }
+  return found;
+}
+
 void PerfCountersCollection::dump_formatted(Formatter *f, bool schema)
 {
   Mutex::Locker lck(m_lock);
@@ -96,20 +111,20 @@ PerfCounters::~PerfCounters()
 {
 }
 
-void PerfCounters::inc(int idx, uint64_t amt)
+void PerfCounters::inc(int idx, uint64_t amt, uint32_t avgcount)
 {
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 += amt;
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    data.add_avg(amt, avgcount);
+  else
+    data.u64.add(amt);
 }
 
 void PerfCounters::dec(int idx, uint64_t amt)
@@ -117,15 +132,14 @@ void PerfCounters::dec(int idx, uint64_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   assert(!(data.type & PERFCOUNTER_LONGRUNAVG));
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  assert(data.u64 >= amt);
-  data.u64 -= amt;
+  assert(data.u64.read() >= amt);
+  data.u64.sub(amt);
 }
 
 void PerfCounters::set(int idx, uint64_t amt)
@@ -133,15 +147,18 @@ void PerfCounters::set(int idx, uint64_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return;
-  data.u64 = amt;
-  if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+  if (data.type & PERFCOUNTER_LONGRUNAVG) {
+    data.avgcount.inc();
+    data.u64.set(amt);
+    data.avgcount2.inc();
+  } else {
+    data.u64.set(amt);
+  }
 }
 
 uint64_t PerfCounters::get(int idx) const
@@ -149,29 +166,28 @@ uint64_t PerfCounters::get(int idx) const
   if (!m_cct->_conf->perf)
     return 0;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_U64))
     return 0;
-  return data.u64;
+  return data.u64.read();
 }
 
-void PerfCounters::tinc(int idx, utime_t amt)
+void PerfCounters::tinc(int idx, utime_t amt, uint32_t avgcount)
 {
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  data.u64 += amt.to_nsec();
   if (data.type & PERFCOUNTER_LONGRUNAVG)
-    data.avgcount++;
+    data.add_avg(amt.to_nsec(), avgcount);
+  else
+    data.u64.add(amt.to_nsec());
 }
 
 void PerfCounters::tset(int idx, utime_t amt)
@@ -179,13 +195,12 @@ void PerfCounters::tset(int idx, utime_t amt)
   if (!m_cct->_conf->perf)
     return;
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return;
-  data.u64 = amt.to_nsec();
+  data.u64.set(amt.to_nsec());
   if (data.type & PERFCOUNTER_LONGRUNAVG)
     assert(0);
 }
@@ -195,13 +210,43 @@ utime_t PerfCounters::tget(int idx) const
   if (!m_cct->_conf->perf)
     return utime_t();
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
   if (!(data.type & PERFCOUNTER_TIME))
     return utime_t();
-  return utime_t(data.u64 / 1000000000ull, data.u64 % 1000000000ull);
+  uint64_t v = data.u64.read();
+  return utime_t(v / 1000000000ull, v % 1000000000ull);
+}
+
+void PerfCounters::hinc(int idx, int64_t x, int64_t y)
+{
+  if (!m_cct->_conf->perf)
+    return;
+
+  assert(idx > m_lower_bound);
+  assert(idx < m_upper_bound);
+  perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
+  if (!(data.type & PERFCOUNTER_HISTOGRAM))
+    return;
+  data.histogram->inc(x, y);
+}
+
+void PerfCounters::reset()
+{
+  for (perf_counter_data_vec_t::iterator d = m_data.begin();
+       d != m_data.end();
+       ++d) {
+    if (d->type & PERFCOUNTER_HISTOGRAM) {
+      d->histogram->reset();
+    } else if (d->type & PERFCOUNTER_LONGRUNAVG) {
+      d->avgcount.set(0);
+      d->u64.set(0);
+      d->avgcount2.set(0);
+    } else if (d->type & (PERFCOUNTER_COUNTER | PERFCOUNTER_TIME)) {
+      d->u64.set(0);
+    }
+  }
 }
 
 pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
@@ -209,7 +254,6 @@ pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
   if (!m_cct->_conf->perf)
     return make_pair(0, 0);
 
-  Mutex::Locker lck(m_lock);
   assert(idx > m_lower_bound);
   assert(idx < m_upper_bound);
   const perf_counter_data_any_d& data(m_data[idx - m_lower_bound - 1]);
@@ -217,13 +261,12 @@ pair<uint64_t, uint64_t> PerfCounters::get_tavg_ms(int idx) const
     return make_pair(0, 0);
   if (!(data.type & PERFCOUNTER_LONGRUNAVG))
     return make_pair(0, 0);
-  return make_pair(data.avgcount, data.u64/1000000);
+  pair<uint64_t,uint64_t> a = data.read_avg();
+  return make_pair(a.first, a.second/1000000);
 }
 
 void PerfCounters::dump_formatted(Formatter *f, bool schema)
 {
-  Mutex::Locker lck(m_lock);
-
   f->open_object_section(m_name.c_str());
   perf_counter_data_vec_t::const_iterator d = m_data.begin();
   perf_counter_data_vec_t::const_iterator d_end = m_data.end();
@@ -235,29 +278,37 @@ void PerfCounters::dump_formatted(Formatter *f, bool schema)
     if (schema) {
       f->open_object_section(d->name);
       f->dump_int("type", d->type);
+      if (d->type & PERFCOUNTER_HISTOGRAM)
+	d->histogram->dump_axes(f);
       f->close_section();
     } else {
-      if (d->type & PERFCOUNTER_LONGRUNAVG) {
+      if (d->type & PERFCOUNTER_HISTOGRAM) {
 	f->open_object_section(d->name);
+	d->histogram->dump_values(f);
+	f->close_section();
+      } else if (d->type & PERFCOUNTER_LONGRUNAVG) {
+	f->open_object_section(d->name);
+	pair<uint64_t,uint64_t> a = d->read_avg();
 	if (d->type & PERFCOUNTER_U64) {
-	  f->dump_unsigned("avgcount", d->avgcount);
-	  f->dump_unsigned("sum", d->u64);
+	  f->dump_unsigned("avgcount", a.first);
+	  f->dump_unsigned("sum", a.second);
 	} else if (d->type & PERFCOUNTER_TIME) {
-	  f->dump_unsigned("avgcount", d->avgcount);
+	  f->dump_unsigned("avgcount", a.first);
 	  f->dump_format_unquoted("sum", "%"PRId64".%09"PRId64,
-				  d->u64 / 1000000000ull,
-				  d->u64 % 1000000000ull);
+				  a.second / 1000000000ull,
+				  a.second % 1000000000ull);
 	} else {
 	  assert(0);
 	}
 	f->close_section();
       } else {
+	uint64_t v = d->u64.read();
 	if (d->type & PERFCOUNTER_U64) {
-	  f->dump_unsigned(d->name, d->u64);
+	  f->dump_unsigned(d->name, v);
 	} else if (d->type & PERFCOUNTER_TIME) {
 	  f->dump_format_unquoted(d->name, "%"PRId64".%09"PRId64,
-				  d->u64 / 1000000000ull,
-				  d->u64 % 1000000000ull);
+				  v / 1000000000ull,
+				  v % 1000000000ull);
 	} else {
 	  assert(0);
 	}
@@ -280,9 +331,7 @@ PerfCounters::PerfCounters(CephContext *cct, const std::string &name,
   : m_cct(cct),
     m_lower_bound(lower_bound),
     m_upper_bound(upper_bound),
-    m_name(name.c_str()),
-    m_lock_name(std::string("PerfCounters::") + name.c_str()),
-    m_lock(m_lock_name.c_str())
+    m_name(name.c_str())
 {
   m_data.resize(upper_bound - lower_bound - 1);
 }
@@ -291,10 +340,34 @@ PerfCounters::perf_counter_data_any_d::perf_counter_data_any_d()
   : name(NULL),
     type(PERFCOUNTER_NONE),
     u64(0),
-    avgcount(0)
+    avgcount(0),
+    avgcount2(0)
 {
 }
 
+PerfCounters::perf_counter_data_any_d::perf_counter_data_any_d(
+  const perf_counter_data_any_d& other)
+  : name(other.name),
+    type(other.type),
+    u64(other.u64.read()),
+    avgcount(other.avgcount.read()),
+    avgcount2(other.avgcount2.read()),
+    histogram(other.histogram)
+{
+}
+
+PerfCounters::perf_counter_data_any_d&
+PerfCounters::perf_counter_data_any_d::operator=(const perf_counter_data_any_d& rhs)
+{
+  name = rhs.name;
+  type = rhs.type;
+  u64.set(rhs.u64.read());
+  avgcount.set(rhs.avgcount.read());
+  avgcount2.set(rhs.avgcount2.read());
+  histogram = rhs.histogram;
+  return *this;
+}
+
 PerfCountersBuilder::PerfCountersBuilder(CephContext *cct, const std::string &name,
                   int first, int last)
   : m_perf_counters(new PerfCounters(cct, name, first, last))
@@ -333,6 +406,23 @@ void PerfCountersBuilder::add_time_avg(int idx, const char *name)
   add_impl(idx, name, PERFCOUNTER_TIME | PERFCOUNTER_LONGRUNAVG);
 }
 
+void PerfCountersBuilder::add_histogram(int idx, const char *name,
+				       const PerfHistogram::axis_config_d &x)
+{
+  add_impl(idx, name, PERFCOUNTER_HISTOGRAM);
+  m_perf_counters->m_data[idx - m_perf_counters->m_lower_bound - 1].histogram.
+    reset(new PerfHistogram(x));
+}
+
+void PerfCountersBuilder::add_histogram(int idx, const char *name,
+				       const PerfHistogram::axis_config_d &x,
+				       const PerfHistogram::axis_config_d &y)
+{
+  add_impl(idx, name, PERFCOUNTER_HISTOGRAM);
+  m_perf_counters->m_data[idx - m_perf_counters->m_lower_bound - 1].histogram.
+    reset(new PerfHistogram(x, y));
+}
+
 void PerfCountersBuilder::add_impl(int idx, const char *name, int ty)
 {
   assert(idx > m_perf_counters->m_lower_bound);
@@ -18,7 +18,10 @@
 
 #include "common/config_obs.h"
 #include "common/Mutex.h"
+#include "common/perf_histogram.h"
+#include "include/atomic.h"
 #include "include/buffer.h"
+#include "include/memory.h"
 #include "include/utime.h"
 
 #include <stdint.h>
@@ -36,6 +39,7 @@ enum perfcounter_type_d
   PERFCOUNTER_U64 = 0x2,
   PERFCOUNTER_LONGRUNAVG = 0x4,
   PERFCOUNTER_COUNTER = 0x8,
+  PERFCOUNTER_HISTOGRAM = 0x10,
 };
 
 /*
@@ -61,6 +65,15 @@ enum perfcounter_type_d
  * For the time average, it returns the current value and
  * the "avgcount" member when read off. avgcount is incremented when you call
  * tinc. Calling tset on an average is an error and will assert out.
+ *
+ * Updates are lock-free, so they are cheap to make on every op.  To
+ * account for several samples of an average at once (say, a batch of
+ * ops timed together), pass their number as avgcount to inc() or tinc().
+ *
+ * A histogram (see PerfHistogram) counts samples by one or two values,
+ * such as latency and size, to show the spread an average hides.  Use
+ * hinc(idx, x, y) for those.  reset() zeroes everything except plain
+ * values, which describe current state rather than accumulate.
  */
 class PerfCounters
 {
@@ -85,15 +98,18 @@ public:
 
   ~PerfCounters();
 
-  void inc(int idx, uint64_t v = 1);
+  void inc(int idx, uint64_t v = 1, uint32_t avgcount = 1);
   void dec(int idx, uint64_t v = 1);
   void set(int idx, uint64_t v);
   uint64_t get(int idx) const;
 
   void tset(int idx, utime_t v);
-  void tinc(int idx, utime_t v);
+  void tinc(int idx, utime_t v, uint32_t avgcount = 1);
   utime_t tget(int idx) const;
 
+  void hinc(int idx, int64_t x, int64_t y = 0);
+
+  void reset();
   void dump_formatted(ceph::Formatter *f, bool schema);
 
   pair<uint64_t, uint64_t> get_tavg_ms(int idx) const;
@@ -112,13 +128,34 @@ private:
   /** Represents a PerfCounters data element. */
   struct perf_counter_data_any_d {
     perf_counter_data_any_d();
+    /// copy the current values; only for setting up m_data
+    perf_counter_data_any_d(const perf_counter_data_any_d& other);
+    perf_counter_data_any_d& operator=(const perf_counter_data_any_d& rhs);
     void write_schema_json(char *buf, size_t buf_sz) const;
     void  write_json(char *buf, size_t buf_sz) const;
 
+    /// add a sum of avgcount samples to an average
+    void add_avg(uint64_t amt, uint32_t count) {
+      avgcount.add(count);
+      u64.add(amt);
+      avgcount2.add(count);
+    }
+    /// read an average's (avgcount, sum) without tearing
+    pair<uint64_t, uint64_t> read_avg() const {
+      uint64_t sum, count;
+      do {
+	count = avgcount2.read();
+	sum = u64.read();
+      } while (avgcount.read() != count);
+      return make_pair(count, sum);
+    }
+
     const char *name;
     enum perfcounter_type_d type;
-    uint64_t u64;
-    uint64_t avgcount;
+    ceph::atomic64_t u64;
+    ceph::atomic64_t avgcount;
+    ceph::atomic64_t avgcount2;  ///< avgcount, bumped after u64 changes
+    ceph::shared_ptr<PerfHistogram> histogram;
   };
   typedef std::vector<perf_counter_data_any_d> perf_counter_data_vec_t;
 
@@ -126,11 +163,8 @@ private:
   int m_lower_bound;
   int m_upper_bound;
   std::string m_name;
-  const std::string m_lock_name;
-
-  /** Protects m_data */
-  mutable Mutex m_lock;
 
+  /// sized on construction and filled in by PerfCountersBuilder only
   perf_counter_data_vec_t m_data;
 
   friend class PerfCountersBuilder;
@@ -156,6 +190,8 @@ public:
   void add(class PerfCounters *l);
   void remove(class PerfCounters *l);
   void clear();
+  /// reset the named PerfCounters, or all of them for "all"
+  bool reset(const std::string &name);
   void dump_formatted(ceph::Formatter *f, bool schema);
 private:
   CephContext *m_cct;
@@ -187,6 +223,11 @@ public:
   void add_u64_avg(int key, const char *name);
   void add_time(int key, const char *name);
   void add_time_avg(int key, const char *name);
+  void add_histogram(int key, const char *name,
+		     const PerfHistogram::axis_config_d &x);
+  void add_histogram(int key, const char *name,
+		     const PerfHistogram::axis_config_d &x,
+		     const PerfHistogram::axis_config_d &y);
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
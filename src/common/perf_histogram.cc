@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/perf_histogram.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+
+#include <limits>
+
+PerfHistogram::PerfHistogram(const axis_config_d &x)
+  : m_cols(1), m_cells(NULL)
+{
+  m_axes.push_back(x);
+  init();
+}
+
+PerfHistogram::PerfHistogram(const axis_config_d &x, const axis_config_d &y)
+  : m_cols(y.buckets), m_cells(NULL)
+{
+  m_axes.push_back(x);
+  m_axes.push_back(y);
+  init();
+}
+
+void PerfHistogram::init()
+{
+  for (std::vector<axis_config_d>::const_iterator p = m_axes.begin();
+       p != m_axes.end();
+       ++p) {
+    assert(p->scale_type == SCALE_LINEAR || p->scale_type == SCALE_LOG2);
+    assert(p->quant_size > 0);
+    assert(p->buckets >= 3);  // underflow, at least one, overflow
+    if (p->scale_type == SCALE_LOG2)
+      assert(p->buckets <= 64);
+  }
+  m_cells = new ceph::atomic64_t[m_axes[0].buckets * m_cols];
+}
+
+PerfHistogram::~PerfHistogram()
+{
+  delete[] m_cells;
+}
+
+uint64_t PerfHistogram::read(int32_t bx, int32_t by) const
+{
+  assert(bx >= 0 && bx < m_axes[0].buckets);
+  assert(by >= 0 && by < m_cols);
+  return m_cells[bx * m_cols + by].read();
+}
+
+void PerfHistogram::reset()
+{
+  int32_t n = m_axes[0].buckets * m_cols;
+  for (int32_t i = 0; i < n; ++i)
+    m_cells[i].set(0);
+}
+
+int32_t PerfHistogram::get_bucket(int64_t value, const axis_config_d &ac)
+{
+  if (value < ac.min)
+    return 0;
+  uint64_t q = (uint64_t)(value - ac.min) / ac.quant_size;
+  uint64_t b;
+  if (ac.scale_type == SCALE_LINEAR) {
+    b = q + 1;
+  } else {
+    // [0, 1) quanta is bucket 1, [2^(i-2), 2^(i-1)) is bucket i
+    b = 1;
+    while (q) {
+      ++b;
+      q >>= 1;
+    }
+  }
+  if (b > (uint64_t)ac.buckets - 1)
+    b = ac.buckets - 1;
+  return b;
+}
+
+std::vector<std::pair<int64_t, int64_t> >
+PerfHistogram::get_bucket_ranges(const axis_config_d &ac)
+{
+  std::vector<std::pair<int64_t, int64_t> > r;
+  r.push_back(std::make_pair(std::numeric_limits<int64_t>::min(),
+			     ac.min - 1));
+  int64_t lower = ac.min;
+  for (int32_t i = 1; i < ac.buckets - 1; ++i) {
+    int64_t width = ac.quant_size;
+    if (ac.scale_type == SCALE_LOG2 && i > 1)
+      width = ac.quant_size << (i - 2);
+    r.push_back(std::make_pair(lower, lower + width - 1));
+    lower += width;
+  }
+  r.push_back(std::make_pair(lower, std::numeric_limits<int64_t>::max()));
+  return r;
+}
+
+void PerfHistogram::dump_axes(ceph::Formatter *f) const
+{
+  f->open_array_section("axes");
+  for (std::vector<axis_config_d>::const_iterator p = m_axes.begin();
+       p != m_axes.end();
+       ++p) {
+    f->open_object_section("axis");
+    f->dump_string("name", p->name);
+    f->dump_string("scale_type",
+		   p->scale_type == SCALE_LOG2 ? "log2" : "linear");
+    f->dump_int("min", p->min);
+    f->dump_int("quant_size", p->quant_size);
+    f->dump_int("buckets", p->buckets);
+    f->open_array_section("ranges");
+    std::vector<std::pair<int64_t, int64_t> > ranges = get_bucket_ranges(*p);
+    for (unsigned i = 0; i < ranges.size(); ++i) {
+      f->open_object_section("range");
+      if (i > 0)
+	f->dump_int("min", ranges[i].first);
+      if (i < ranges.size() - 1)
+	f->dump_int("max", ranges[i].second);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+}
+
+void PerfHistogram::dump_values(ceph::Formatter *f) const
+{
+  f->open_array_section("values");
+  for (int32_t x = 0; x < m_axes[0].buckets; ++x) {
+    if (m_axes.size() == 1) {
+      f->dump_unsigned("value", m_cells[x].read());
+      continue;
+    }
+    f->open_array_section("row");
+    for (int32_t y = 0; y < m_cols; ++y)
+      f->dump_unsigned("value", m_cells[x * m_cols + y].read());
+    f->close_section();
+  }
+  f->close_section();
+}
@@ -0,0 +1,88 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_PERF_HISTOGRAM_H
+#define CEPH_COMMON_PERF_HISTOGRAM_H
+
+#include "include/atomic.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace ceph {
+  class Formatter;
+}
+
+/*
+ * A one or two dimensional histogram, e.g. of op latency against op
+ * size.  Samples are counted lock-free, so it can be updated on every op.
+ *
+ * Each axis has buckets buckets.  The first holds values below min and
+ * the last everything past the top of the range.  The ones in between
+ * are quant_size wide on a linear axis; on a log2 axis the first of them
+ * is quant_size wide and each one after that is twice as wide as the one
+ * before, so a few dozen buckets span microseconds to minutes.
+ */
+class PerfHistogram
+{
+public:
+  enum scale_type_d {
+    SCALE_LINEAR = 1,
+    SCALE_LOG2 = 2,
+  };
+
+  struct axis_config_d {
+    const char *name;
+    scale_type_d scale_type;
+    int64_t min;
+    int64_t quant_size;
+    int32_t buckets;
+  };
+
+  PerfHistogram(const axis_config_d &x);
+  PerfHistogram(const axis_config_d &x, const axis_config_d &y);
+  ~PerfHistogram();
+
+  /// count a sample; y is ignored by a one dimensional histogram
+  void inc(int64_t x, int64_t y = 0) {
+    m_cells[get_bucket(x, m_axes[0]) * m_cols +
+	    (m_axes.size() > 1 ? get_bucket(y, m_axes[1]) : 0)].inc();
+  }
+  uint64_t read(int32_t bx, int32_t by = 0) const;
+  void reset();
+
+  const std::vector<axis_config_d>& get_axes() const { return m_axes; }
+
+  /// index of the bucket value falls in on axis ac
+  static int32_t get_bucket(int64_t value, const axis_config_d &ac);
+  /// inclusive [min, max] of every bucket on axis ac
+  static std::vector<std::pair<int64_t, int64_t> >
+  get_bucket_ranges(const axis_config_d &ac);
+
+  /// the axis configurations and bucket ranges, for the schema
+  void dump_axes(ceph::Formatter *f) const;
+  /// the counts, one array per bucket of the first axis if there are two
+  void dump_values(ceph::Formatter *f) const;
+
+private:
+  PerfHistogram(const PerfHistogram &rhs);
+  PerfHistogram& operator=(const PerfHistogram &rhs);
+
+  void init();
+
+  std::vector<axis_config_d> m_axes;
+  int32_t m_cols;  ///< buckets on the second axis, 1 if there is none
+  ceph::atomic64_t *m_cells;
+};
+
+#endif
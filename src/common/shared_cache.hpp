@@ -17,10 +17,13 @@
 
 #include <map>
 #include <list>
+#include <vector>
 #include <memory>
 #include <utility>
+#include "include/hash_namespace.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/perf_counters.h"
 
 template <class K, class V>
 class SharedLRU {
@@ -180,4 +183,352 @@ public:
   }
 };
 
+/**
+ * SharedLRU split into lock-striped shards.
+ *
+ * Keys are spread over the shards by hash.  Each shard has its own
+ * lock, its own map of weak references to the live values and keeps
+ * up to max_size / num_shards of them alive with a CLOCK
+ * approximation of the LRU: a hit only sets the reference bit of the
+ * entry instead of moving it to the front of a list, and the hand
+ * evicts the first entry found without the bit when the shard is full.
+ *
+ * The interface matches SharedPtrRegistry so that it can replace it
+ * where keeping recently used values around is worth it.  get_next
+ * walks the keys in order by merging the shards.
+ */
+template <class K, class V, class H = CEPH_HASH_NAMESPACE::hash<K> >
+class ShardedSharedLRU {
+public:
+  typedef ceph::shared_ptr<V> VPtr;
+  typedef ceph::weak_ptr<V> WeakVPtr;
+
+private:
+  struct Shard {
+    Mutex lock;
+    Cond cond;
+    map<K, pair<WeakVPtr, V*> > weak_refs;
+    map<K, size_t> slots;                 ///< key -> index in clock
+    vector<pair<K, VPtr> > clock;
+    vector<bool> referenced;
+    size_t hand;
+    size_t max_size;
+    uint64_t hits, misses, evictions;
+    Shard() : lock("ShardedSharedLRU::Shard::lock"), hand(0), max_size(0),
+	      hits(0), misses(0), evictions(0) {}
+  };
+  vector<Shard*> shards;
+  H hasher;
+
+  PerfCounters *logger;
+  int l_hit, l_miss, l_evict;
+
+  Shard *get_shard(const K &key) {
+    return shards[hasher(key) % shards.size()];
+  }
+
+  void count(int idx) {
+    if (logger)
+      logger->inc(idx);
+  }
+
+  /// drop the reference of slot n, shard lock held
+  void clock_remove(Shard *shard, size_t n, list<VPtr> *to_release) {
+    to_release->push_back(shard->clock[n].second);
+    shard->slots.erase(shard->clock[n].first);
+    size_t last = shard->clock.size() - 1;
+    if (n != last) {
+      shard->clock[n] = shard->clock[last];
+      shard->referenced[n] = shard->referenced[last];
+      shard->slots[shard->clock[n].first] = n;
+    }
+    shard->clock.pop_back();
+    shard->referenced.pop_back();
+    if (shard->hand >= shard->clock.size())
+      shard->hand = 0;
+  }
+
+  void trim(Shard *shard, list<VPtr> *to_release) {
+    while (shard->clock.size() > shard->max_size) {
+      while (shard->referenced[shard->hand]) {
+	shard->referenced[shard->hand] = false;
+	shard->hand = (shard->hand + 1) % shard->clock.size();
+      }
+      clock_remove(shard, shard->hand, to_release);
+      shard->evictions++;
+      count(l_evict);
+    }
+  }
+
+  /// mark key as recently used, shard lock held
+  void clock_touch(Shard *shard, const K &key, const VPtr &val,
+		   list<VPtr> *to_release) {
+    typename map<K, size_t>::iterator i = shard->slots.find(key);
+    if (i != shard->slots.end()) {
+      shard->referenced[i->second] = true;
+      return;
+    }
+    if (!shard->max_size)
+      return;
+    if (shard->clock.size() < shard->max_size) {
+      shard->slots[key] = shard->clock.size();
+      shard->clock.push_back(make_pair(key, val));
+      shard->referenced.push_back(false);
+      return;
+    }
+    // the new entry takes the slot of the first one the hand finds
+    // unused since its last pass
+    while (shard->referenced[shard->hand]) {
+      shard->referenced[shard->hand] = false;
+      shard->hand = (shard->hand + 1) % shard->clock.size();
+    }
+    pair<K, VPtr> &victim = shard->clock[shard->hand];
+    to_release->push_back(victim.second);
+    shard->slots.erase(victim.first);
+    victim = make_pair(key, val);
+    shard->slots[key] = shard->hand;
+    shard->hand = (shard->hand + 1) % shard->clock.size();
+    shard->evictions++;
+    count(l_evict);
+  }
+
+  /// live value of key or NULL, waits for values being destroyed
+  VPtr _lookup(Shard *shard, const K &key) {
+    while (1) {
+      typename map<K, pair<WeakVPtr, V*> >::iterator i =
+	shard->weak_refs.find(key);
+      if (i == shard->weak_refs.end())
+	return VPtr();
+      VPtr val = i->second.first.lock();
+      if (val)
+	return val;
+      shard->cond.Wait(shard->lock);
+    }
+  }
+
+  class Cleanup {
+    ShardedSharedLRU<K, V, H> *cache;
+    K key;
+  public:
+    Cleanup(ShardedSharedLRU<K, V, H> *cache, const K &key)
+      : cache(cache), key(key) {}
+    void operator()(V *ptr) {
+      Shard *shard = cache->get_shard(key);
+      {
+	Mutex::Locker l(shard->lock);
+	typename map<K, pair<WeakVPtr, V*> >::iterator i =
+	  shard->weak_refs.find(key);
+	if (i != shard->weak_refs.end() && i->second.second == ptr) {
+	  shard->weak_refs.erase(i);
+	  shard->cond.Signal();
+	}
+      }
+      delete ptr;
+    }
+  };
+
+  VPtr _insert(Shard *shard, const K &key, V *ptr, list<VPtr> *to_release) {
+    VPtr val(ptr, Cleanup(this, key));
+    shard->weak_refs.insert(make_pair(key, make_pair(WeakVPtr(val), ptr)));
+    clock_touch(shard, key, val, to_release);
+    return val;
+  }
+
+public:
+  ShardedSharedLRU(size_t max_size = 20, unsigned num_shards = 8)
+    : logger(NULL), l_hit(0), l_miss(0), l_evict(0) {
+    assert(num_shards > 0);
+    for (unsigned i = 0; i < num_shards; ++i)
+      shards.push_back(new Shard);
+    set_size(max_size);
+  }
+
+  ~ShardedSharedLRU() {
+    clear();
+    for (typename vector<Shard*>::iterator i = shards.begin();
+	 i != shards.end();
+	 ++i) {
+      assert((*i)->weak_refs.empty());
+      delete *i;
+    }
+  }
+
+  /// count hits, misses and evictions in logger
+  void set_logger(PerfCounters *_logger, int hit, int miss, int evict) {
+    logger = _logger;
+    l_hit = hit;
+    l_miss = miss;
+    l_evict = evict;
+  }
+
+  /// keep at most new_size values alive when unused
+  void set_size(size_t new_size) {
+    size_t per_shard = (new_size + shards.size() - 1) / shards.size();
+    for (typename vector<Shard*>::iterator i = shards.begin();
+	 i != shards.end();
+	 ++i) {
+      list<VPtr> to_release;
+      Mutex::Locker l((*i)->lock);
+      (*i)->max_size = per_shard;
+      trim(*i, &to_release);
+    }
+  }
+
+  unsigned get_num_shards() const {
+    return shards.size();
+  }
+
+  /// hits, misses and evictions counted by shard i
+  void get_shard_stats(unsigned i, uint64_t *hits, uint64_t *misses,
+		       uint64_t *evictions) {
+    assert(i < shards.size());
+    Mutex::Locker l(shards[i]->lock);
+    *hits = shards[i]->hits;
+    *misses = shards[i]->misses;
+    *evictions = shards[i]->evictions;
+  }
+
+  /// release the references held by the cache
+  void clear() {
+    for (typename vector<Shard*>::iterator i = shards.begin();
+	 i != shards.end();
+	 ++i) {
+      list<VPtr> to_release;
+      Mutex::Locker l((*i)->lock);
+      while (!(*i)->clock.empty())
+	clock_remove(*i, (*i)->clock.size() - 1, &to_release);
+    }
+  }
+
+  /// release the reference held by the cache on key
+  void clear(const K &key) {
+    Shard *shard = get_shard(key);
+    list<VPtr> to_release;
+    Mutex::Locker l(shard->lock);
+    typename map<K, size_t>::iterator i = shard->slots.find(key);
+    if (i != shard->slots.end())
+      clock_remove(shard, i->second, &to_release);
+  }
+
+  /// true if no value is alive, cached or not
+  bool empty() {
+    for (typename vector<Shard*>::iterator i = shards.begin();
+	 i != shards.end();
+	 ++i) {
+      Mutex::Locker l((*i)->lock);
+      if (!(*i)->weak_refs.empty())
+	return false;
+    }
+    return true;
+  }
+
+  /// first live value with a key greater than key
+  bool get_next(const K &key, pair<K, VPtr> *next) {
+    bool found = false;
+    pair<K, VPtr> r;
+    for (typename vector<Shard*>::iterator i = shards.begin();
+	 i != shards.end();
+	 ++i) {
+      // references are dropped after the lock is released
+      VPtr val;
+      pair<K, VPtr> prev;
+      Mutex::Locker l((*i)->lock);
+      typename map<K, pair<WeakVPtr, V*> >::iterator j =
+	(*i)->weak_refs.upper_bound(key);
+      while (j != (*i)->weak_refs.end() &&
+	     !(val = j->second.first.lock()))
+	++j;
+      if (j == (*i)->weak_refs.end())
+	continue;
+      if (!found || j->first < r.first) {
+	prev = r;
+	r = make_pair(j->first, val);
+	found = true;
+      }
+    }
+    if (found && next)
+      *next = r;
+    return found;
+  }
+
+  VPtr lookup(const K &key) {
+    Shard *shard = get_shard(key);
+    list<VPtr> to_release;
+    VPtr val;
+    {
+      Mutex::Locker l(shard->lock);
+      val = _lookup(shard, key);
+      if (val) {
+	clock_touch(shard, key, val, &to_release);
+	shard->hits++;
+      } else {
+	shard->misses++;
+      }
+    }
+    count(val ? l_hit : l_miss);
+    return val;
+  }
+
+  VPtr lookup_or_create(const K &key) {
+    Shard *shard = get_shard(key);
+    list<VPtr> to_release;
+    VPtr val;
+    bool hit = true;
+    {
+      Mutex::Locker l(shard->lock);
+      val = _lookup(shard, key);
+      if (val) {
+	clock_touch(shard, key, val, &to_release);
+	shard->hits++;
+      } else {
+	val = _insert(shard, key, new V(), &to_release);
+	shard->misses++;
+	hit = false;
+      }
+    }
+    count(hit ? l_hit : l_miss);
+    return val;
+  }
+
+  /// add value under key, which must not have a live value
+  VPtr add(const K &key, V *value) {
+    Shard *shard = get_shard(key);
+    list<VPtr> to_release;
+    VPtr val;
+    {
+      Mutex::Locker l(shard->lock);
+      assert(!_lookup(shard, key));
+      val = _insert(shard, key, value, &to_release);
+    }
+    return val;
+  }
+
+  /**
+   * add value under key unless key already has a live value
+   *
+   * If it does, value is deleted and the live value is returned, with
+   * *existed set.  This lets racing creators agree on one value
+   * without a lock of their own around lookup and add.
+   */
+  VPtr add(const K &key, V *value, bool *existed) {
+    Shard *shard = get_shard(key);
+    list<VPtr> to_release;
+    VPtr val;
+    {
+      Mutex::Locker l(shard->lock);
+      val = _lookup(shard, key);
+      if (val) {
+	clock_touch(shard, key, val, &to_release);
+      } else {
+	val = _insert(shard, key, value, &to_release);
+	value = NULL;
+      }
+    }
+    if (existed)
+      *existed = value != NULL;
+    delete value;
+    return val;
+  }
+};
+
 #endif
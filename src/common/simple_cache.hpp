@@ -37,6 +37,10 @@ class SimpleLRU {
   }
 
   void _add(K key, V value) {
+    typename map<K, typename list<pair<K, V> >::iterator>::iterator i =
+      contents.find(key);
+    if (i != contents.end())
+      lru.erase(i->second);
     lru.push_front(make_pair(key, value));
     contents[key] = lru.begin();
     trim_cache();
@@ -88,6 +92,24 @@ public:
     Mutex::Locker l(lock);
     _add(key, value);
   }
+
+  /// drop the unpinned entry for key
+  void clear(K key) {
+    Mutex::Locker l(lock);
+    typename map<K, typename list<pair<K, V> >::iterator>::iterator i =
+      contents.find(key);
+    if (i == contents.end())
+      return;
+    lru.erase(i->second);
+    contents.erase(i);
+  }
+
+  /// drop all unpinned entries
+  void clear() {
+    Mutex::Locker l(lock);
+    contents.clear();
+    lru.clear();
+  }
 };
 
 #endif
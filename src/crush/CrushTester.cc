@@ -1,5 +1,7 @@
 
 #include "CrushTester.h"
+#include "common/Clock.h"
+#include "common/Thread.h"
 
 #include <algorithm>
 #include <stdlib.h>
@@ -350,24 +352,13 @@ void CrushTester::write_integer_indexed_scalar_data_string(vector<string> &dst,
   dst.push_back( data_buffer.str() );
 }
 
-int CrushTester::test()
+void CrushTester::get_weights(vector<__u32>& weight)
 {
-  if (min_rule < 0 || max_rule < 0) {
-    min_rule = 0;
-    max_rule = crush.get_max_rules() - 1;
-  }
-  if (min_x < 0 || max_x < 0) {
-    min_x = 0;
-    max_x = 1023;
-  }
-
-  // initial osd weights
-  vector<__u32> weight;
-
   /*
    * note device weight is set by crushtool
    * (likely due to a given a command line option)
    */
+  weight.clear();
   for (int o = 0; o < crush.get_max_devices(); o++) {
     if (device_weight.count(o)) {
       weight.push_back(device_weight[o]);
@@ -377,6 +368,75 @@ int CrushTester::test()
       weight.push_back(0);
     }
   }
+}
+
+class CrushTesterMapThread : public Thread {
+  const CrushWrapper& crush;
+  int ruleno, x_start, x_count, maxout;
+  const vector<__u32>& weight;
+  vector< vector<int> >& out;
+public:
+  CrushTesterMapThread(const CrushWrapper& c, int r, int xs, int xc, int mo,
+                       const vector<__u32>& w, vector< vector<int> >& o)
+    : crush(c), ruleno(r), x_start(xs), x_count(xc), maxout(mo),
+      weight(w), out(o) {}
+  void *entry() {
+    crush.do_rule_batch(ruleno, x_start, x_count, out, maxout, weight);
+    return 0;
+  }
+};
+
+void CrushTester::map_range(int ruleno, int x_start, int x_count, int maxout,
+                            const vector<__u32>& weight,
+                            vector< vector<int> >& out)
+{
+  int threads = num_threads;
+  // the choose_tries histogram is not safe to update concurrently
+  if (threads < 1 || output_choose_tries)
+    threads = 1;
+  if (threads > x_count)
+    threads = x_count;
+  if (threads <= 1) {
+    crush.do_rule_batch(ruleno, x_start, x_count, out, maxout, weight);
+    return;
+  }
+
+  int per_thread = (x_count + threads - 1) / threads;
+  vector< vector< vector<int> > > results(threads);
+  vector<CrushTesterMapThread*> workers;
+  for (int i = 0; i < threads; i++) {
+    int start = i * per_thread;
+    int count = MIN(per_thread, x_count - start);
+    if (count <= 0)
+      break;
+    CrushTesterMapThread *t = new CrushTesterMapThread(
+      crush, ruleno, x_start + start, count, maxout, weight, results[i]);
+    t->create();
+    workers.push_back(t);
+  }
+  out.clear();
+  out.reserve(x_count);
+  for (unsigned i = 0; i < workers.size(); i++) {
+    workers[i]->join();
+    delete workers[i];
+    out.insert(out.end(), results[i].begin(), results[i].end());
+  }
+}
+
+int CrushTester::test()
+{
+  if (min_rule < 0 || max_rule < 0) {
+    min_rule = 0;
+    max_rule = crush.get_max_rules() - 1;
+  }
+  if (min_x < 0 || max_x < 0) {
+    min_x = 0;
+    max_x = 1023;
+  }
+
+  // initial osd weights
+  vector<__u32> weight;
+  get_weights(weight);
 
   if (output_utilization_all)
     err << "devices weights (hex): " << hex << weight << dec << std::endl;
@@ -482,6 +542,10 @@ int CrushTester::test()
         // create a vector to hold placement results temporarily 
         vector<int> temporary_per ( per.size() );
 
+        // CRUSH placements, mapped ahead a chunk at a time
+        vector< vector<int> > mapped;
+        int mapped_min = batch_min;
+
         for (int x = batch_min; x <= batch_max; x++) {
           // create a vector to hold the results of a CRUSH placement or RNG simulation
           vector<int> out;
@@ -489,7 +553,12 @@ int CrushTester::test()
           if (use_crush) {
             if (output_statistics)
               err << "CRUSH"; // prepend CRUSH to placement output
-            crush.do_rule(r, x, out, nr, weight);
+            if (x - mapped_min >= (int)mapped.size()) {
+              mapped_min = x;
+              map_range(r, x, MIN(batch_max - x + 1, 65536), nr, weight,
+                        mapped);
+            }
+            out.swap(mapped[x - mapped_min]);
           } else {
             if (output_statistics)
               err << "RNG"; // prepend RNG to placement output to denote simulation
@@ -597,3 +666,42 @@ int CrushTester::test()
 
   return 0;
 }
+
+int CrushTester::benchmark()
+{
+  if (min_rule < 0 || max_rule < 0) {
+    min_rule = 0;
+    max_rule = crush.get_max_rules() - 1;
+  }
+  if (min_x < 0 || max_x < 0) {
+    min_x = 0;
+    max_x = 1023;
+  }
+
+  vector<__u32> weight;
+  get_weights(weight);
+  adjust_weights(weight);
+
+  int num_x = max_x - min_x + 1;
+  for (int r = min_rule; r < crush.get_max_rules() && r <= max_rule; r++) {
+    if (!crush.rule_exists(r))
+      continue;
+    int minr = min_rep, maxr = max_rep;
+    if (min_rep < 0 || max_rep < 0) {
+      minr = crush.get_rule_mask_min_size(r);
+      maxr = crush.get_rule_mask_max_size(r);
+    }
+    for (int nr = minr; nr <= maxr; nr++) {
+      vector< vector<int> > out;
+      utime_t start = ceph_clock_now(NULL);
+      for (int x = min_x; x <= max_x; x += 65536)
+        map_range(r, x, MIN(max_x - x + 1, 65536), nr, weight, out);
+      double elapsed = (ceph_clock_now(NULL) - start);
+      err << "rule " << r << " (" << crush.get_rule_name(r) << ") num_rep " << nr
+          << ": " << num_x << " mappings in " << elapsed << " s, "
+          << (elapsed > 0 ? (double)num_x / elapsed : 0) << " mappings/s"
+          << " with " << num_threads << " threads" << std::endl;
+    }
+  }
+  return 0;
+}
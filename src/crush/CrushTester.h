@@ -19,6 +19,7 @@ class CrushTester {
   int min_rep, max_rep;
 
   int num_batches;
+  int num_threads;
   bool use_crush;
 
   float mark_down_device_ratio;
@@ -73,6 +74,19 @@ class CrushTester {
    */
   int random_placement(int ruleno, vector<int>& out, int maxout, vector<__u32>& weight);
 
+  /*
+   * initial device weights: those set by set_device_weight, 1.0 for
+   * the other devices of the map
+   */
+  void get_weights(vector<__u32>& weight);
+
+  /*
+   * map the inputs [x_start, x_start + x_count) with ruleno, shared
+   * between num_threads threads. out[i] is the mapping of x_start + i.
+   */
+  void map_range(int ruleno, int x_start, int x_count, int maxout,
+                 const vector<__u32>& weight, vector< vector<int> >& out);
+
   // scaffolding to store data for off-line processing
    struct tester_data_set {
      vector <string> device_utilization;
@@ -170,6 +184,7 @@ public:
       min_x(-1), max_x(-1),
       min_rep(-1), max_rep(-1),
       num_batches(1),
+      num_threads(1),
       use_crush(true),
       mark_down_device_ratio(0.0),
       mark_down_bucket_ratio(1.0),
@@ -247,6 +262,13 @@ public:
     return num_batches;
   }
 
+  void set_num_threads(int n) {
+    num_threads = n;
+  }
+  int get_num_threads() const {
+    return num_threads;
+  }
+
   void set_random_placement() {
     use_crush = false;
   }
@@ -325,6 +347,12 @@ public:
   }
 
   int test();
+
+  /*
+   * time the mapping of the inputs of each rule and number of
+   * replicas, and report the mappings per second
+   */
+  int benchmark();
 };
 
 #endif
@@ -24,6 +24,16 @@ bool CrushWrapper::has_v2_rules() const
   return false;
 }
 
+bool CrushWrapper::has_v4_buckets() const
+{
+  for (int i=0; i<crush->max_buckets; i++) {
+    crush_bucket *b = crush->buckets[i];
+    if (b && b->alg == CRUSH_BUCKET_STRAW2)
+      return true;
+  }
+  return false;
+}
+
 bool CrushWrapper::has_v3_rules() const
 {
   // check rules for use of SET_CHOOSELEAF_VARY_R step
@@ -859,6 +869,11 @@ void CrushWrapper::encode(bufferlist& bl, bool lean) const
       }
       break;
 
+    case CRUSH_BUCKET_STRAW2:
+      for (unsigned j=0; j<crush->buckets[i]->size; j++)
+	::encode(((crush_bucket_straw2*)crush->buckets[i])->item_weights[j], bl);
+      break;
+
     default:
       assert(0);
       break;
@@ -1003,6 +1018,9 @@ void CrushWrapper::decode_crush_bucket(crush_bucket** bptr, bufferlist::iterator
   case CRUSH_BUCKET_STRAW:
     size = sizeof(crush_bucket_straw);
     break;
+  case CRUSH_BUCKET_STRAW2:
+    size = sizeof(crush_bucket_straw2);
+    break;
   default:
     {
       char str[128];
@@ -1066,6 +1084,15 @@ void CrushWrapper::decode_crush_bucket(crush_bucket** bptr, bufferlist::iterator
     break;
   }
 
+  case CRUSH_BUCKET_STRAW2: {
+    crush_bucket_straw2* cbs = (crush_bucket_straw2*)bucket;
+    cbs->item_weights = (__u32*)calloc(1, bucket->size * sizeof(__u32));
+    for (unsigned j = 0; j < bucket->size; ++j) {
+      ::decode(cbs->item_weights[j], blp);
+    }
+    break;
+  }
+
   default:
     // We should have handled this case in the first switch statement
     assert(0);
@@ -1181,6 +1208,23 @@ void CrushWrapper::dump_rules(Formatter *f) const
   }
 }
 
+void CrushWrapper::do_rule_batch(int rule, int x_start, int x_count,
+				 vector<vector<int> >& out, int maxout,
+				 const vector<__u32>& weight) const
+{
+  vector<uint64_t> work((crush_work_size(crush, maxout) + 7) / 8);
+  crush_init_workspace(crush, &work[0]);
+  vector<int> rawout(x_count * maxout);
+  vector<int> lens(x_count);
+  crush_do_rule_batch(crush, rule, x_start, x_count, &rawout[0], maxout,
+		      &lens[0], &weight[0], weight.size(), &work[0]);
+  out.resize(x_count);
+  for (int i = 0; i < x_count; i++) {
+    int *p = &rawout[i * maxout];
+    out[i].assign(p, p + std::max(lens[i], 0));
+  }
+}
+
 void CrushWrapper::dump_rule(int ruleset, Formatter *f) const
 {
   f->open_object_section("rule");
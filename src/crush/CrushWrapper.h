@@ -50,7 +50,6 @@ inline static void decode(crush_rule_step &s, bufferlist::iterator &p)
 
 using namespace std;
 class CrushWrapper {
-  mutable Mutex mapper_lock;
 public:
   struct crush_map *crush;
   std::map<int32_t, string> type_map; /* bucket/device type names */
@@ -79,8 +78,7 @@ public:
   CrushWrapper(const CrushWrapper& other);
   const CrushWrapper& operator=(const CrushWrapper& other);
 
-  CrushWrapper() : mapper_lock("CrushWrapper::mapper_lock"),
-		   crush(0), have_rmaps(false) {
+  CrushWrapper() : crush(0), have_rmaps(false) {
     create();
   }
   ~CrushWrapper() {
@@ -215,6 +213,7 @@ public:
   }
   bool has_v2_rules() const;
   bool has_v3_rules() const;
+  bool has_v4_buckets() const;
 
 
   // bucket types
@@ -863,10 +862,10 @@ public:
   }
   void do_rule(int rule, int x, vector<int>& out, int maxout,
 	       const vector<__u32>& weight) const {
-    Mutex::Locker l(mapper_lock);
     int rawout[maxout];
-    int scratch[maxout * 3];
-    int numrep = crush_do_rule(crush, rule, x, rawout, maxout, &weight[0], weight.size(), scratch);
+    uint64_t work[(crush_work_size(crush, maxout) + 7) / 8];
+    crush_init_workspace(crush, work);
+    int numrep = crush_do_rule(crush, rule, x, rawout, maxout, &weight[0], weight.size(), work);
     if (numrep < 0)
       numrep = 0;
     out.resize(numrep);
@@ -874,6 +873,18 @@ public:
       out[i] = rawout[i];
   }
 
+  /**
+   * map the inputs [x_start, x_start + x_count)
+   *
+   * Same as do_rule for each input, but the workspace is set up once
+   * for the whole range.  Safe to call from several threads at once.
+   *
+   * @param out [out] out[i] is the mapping of x_start + i
+   */
+  void do_rule_batch(int rule, int x_start, int x_count,
+		     vector<vector<int> >& out, int maxout,
+		     const vector<__u32>& weight) const;
+
   int read_from_file(const char *fn) {
     bufferlist bl;
     std::string error;
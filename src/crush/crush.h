@@ -105,12 +105,17 @@ struct crush_rule {
  *  list            O(n)       optimal      poor
  *  tree            O(log n)   good         good
  *  straw           O(n)       optimal      optimal
+ *  straw2          O(n)       optimal      optimal
+ *
+ * straw2 draws each item independently of the others, so changing
+ * the weight of one item only moves data to or from that item.
  */
 enum {
 	CRUSH_BUCKET_UNIFORM = 1,
 	CRUSH_BUCKET_LIST = 2,
 	CRUSH_BUCKET_TREE = 3,
-	CRUSH_BUCKET_STRAW = 4
+	CRUSH_BUCKET_STRAW = 4,
+	CRUSH_BUCKET_STRAW2 = 5
 };
 extern const char *crush_bucket_alg_name(int alg);
 
@@ -124,8 +129,8 @@ struct crush_bucket {
 	__s32 *items;
 
 	/*
-	 * cached random permutation: used for uniform bucket and for
-	 * the linear search fallback for the other bucket types.
+	 * cached random permutation.  unused by the mapper, which keeps
+	 * it in the caller's struct crush_work instead.
 	 */
 	__u32 perm_x;  /* @x for which *perm is defined */
 	__u32 perm_n;  /* num elements of *perm that are permuted/defined */
@@ -157,7 +162,30 @@ struct crush_bucket_straw {
 	__u32 *straws;         /* 16-bit fixed point */
 };
 
+struct crush_bucket_straw2 {
+	struct crush_bucket h;
+	__u32 *item_weights;   /* 16-bit fixed point */
+};
+
+/*
+ * per-mapping state of a bucket: the cached random permutation used
+ * for uniform buckets and for the linear search fallback for the
+ * other bucket types.  it lives in the caller's workspace so that
+ * several threads can map with the same crush_map.
+ */
+struct crush_work_bucket {
+	__u32 perm_x;  /* @x for which *perm is defined */
+	__u32 perm_n;  /* num elements of *perm that are permuted/defined */
+	__u32 *perm;
+};
 
+/*
+ * workspace of a mapping, see crush_init_workspace()
+ */
+struct crush_work {
+	struct crush_work_bucket **work;  /* indexed by -1-bucket id */
+	int *scratch;                     /* 3 * result_max */
+};
 
 /*
  * CRUSH map includes all buckets, rules, etc.
@@ -201,6 +229,7 @@ extern void crush_destroy_bucket_uniform(struct crush_bucket_uniform *b);
 extern void crush_destroy_bucket_list(struct crush_bucket_list *b);
 extern void crush_destroy_bucket_tree(struct crush_bucket_tree *b);
 extern void crush_destroy_bucket_straw(struct crush_bucket_straw *b);
+extern void crush_destroy_bucket_straw2(struct crush_bucket_straw2 *b);
 extern void crush_destroy_bucket(struct crush_bucket *b);
 extern void crush_destroy_rule(struct crush_rule *r);
 extern void crush_destroy(struct crush_map *map);
@@ -0,0 +1,275 @@
+#ifndef CEPH_CRUSH_LN_H
+#define CEPH_CRUSH_LN_H
+
+/*
+ * fixed point log2 tables for crush_ln() in mapper.c
+ *
+ * __RH_LH_tbl[2*k]     = 2^48 * 128 / (128 + k), rounded up
+ * __RH_LH_tbl[2*k + 1] = 2^48 * log2((128 + k) / 128)
+ * __LL_tbl[k]          = 2^48 * log2(1 + k / 2^15)
+ */
+
+static const __s64 __RH_LH_tbl[128*2+2] = {
+	0x0001000000000000ll, 0x0000000000000000ll,
+	0x0000fe03f80fe040ll, 0x000002dfca16dde1ll,
+	0x0000fc0fc0fc0fc1ll, 0x000005b9e5a170b5ll,
+	0x0000fa232cf25214ll, 0x0000088e68ea899all,
+	0x0000f83e0f83e0f9ll, 0x00000b5d69bac77fll,
+	0x0000f6603d980f67ll, 0x00000e26fd5c8556ll,
+	0x0000f4898d5f85bcll, 0x000010eb389fa2a0ll,
+	0x0000f2b9d6480f2cll, 0x000013aa2fdd27f2ll,
+	0x0000f0f0f0f0f0f1ll, 0x00001663f6fac913ll,
+	0x0000ef2eb71fc435ll, 0x00001918a16e4633ll,
+	0x0000ed7303b5cc0fll, 0x00001bc84240adacll,
+	0x0000ebbdb2a5c162ll, 0x00001e72ec117fa6ll,
+	0x0000ea0ea0ea0ea1ll, 0x00002118b119b4f4ll,
+	0x0000e865ac7b7604ll, 0x000023b9a32eaa57ll,
+	0x0000e6c2b4481cd9ll, 0x00002655d3c4f15cll,
+	0x0000e525982af70dll, 0x000028ed53f307efll,
+	0x0000e38e38e38e39ll, 0x00002b803473f7adll,
+	0x0000e1fc780e1fc8ll, 0x00002e0e85a9de05ll,
+	0x0000e070381c0e08ll, 0x0000309857a05e07ll,
+	0x0000dee95c4ca038ll, 0x0000331dba0efce2ll,
+	0x0000dd67c8a60dd7ll, 0x0000359ebc5b69d9ll,
+	0x0000dbeb61eed19dll, 0x0000381b6d9bb29cll,
+	0x0000da740da740dbll, 0x00003a93dc9864b3ll,
+	0x0000d901b2036407ll, 0x00003d0817ce9cd5ll,
+	0x0000d79435e50d7all, 0x00003f782d7204d0ll,
+	0x0000d62b80d62b81ll, 0x000041e42b6ec0c0ll,
+	0x0000d4c77b03531ell, 0x0000444c1f6b4c2ell,
+	0x0000d3680d3680d4ll, 0x000046b016ca47c2ll,
+	0x0000d20d20d20d21ll, 0x000049101eac381dll,
+	0x0000d0b69fcbd259ll, 0x00004b6c43f1366bll,
+	0x0000cf6474a8819fll, 0x00004dc4933a9338ll,
+	0x0000ce168a772509ll, 0x0000501918ec6c11ll,
+	0x0000cccccccccccdll, 0x00005269e12f346ell,
+	0x0000cb8727c065c4ll, 0x000054b6f7f1325bll,
+	0x0000ca4587e6b750ll, 0x0000570068e7ef5all,
+	0x0000c907da4e8712ll, 0x000059463f919defll,
+	0x0000c7ce0c7ce0c8ll, 0x00005b8887367433ll,
+	0x0000c6980c6980c7ll, 0x00005dc74ae9fbedll,
+	0x0000c565c87b5f9ell, 0x00006002958c5871ll,
+	0x0000c4372f855d83ll, 0x0000623a71cb82c9ll,
+	0x0000c30c30c30c31ll, 0x0000646eea247c5cll,
+	0x0000c1e4bbd595f7ll, 0x000066a008e4788dll,
+	0x0000c0c0c0c0c0c1ll, 0x000068cdd829fd81ll,
+	0x0000bfa02fe80bfbll, 0x00006af861e5fc7dll,
+	0x0000be82fa0be830ll, 0x00006d1fafdce20bll,
+	0x0000bd6910470767ll, 0x00006f43cba79e41ll,
+	0x0000bc52640bc527ll, 0x00007164beb4a56dll,
+	0x0000bb3ee721a54ell, 0x000073829248e962ll,
+	0x0000ba2e8ba2e8bbll, 0x0000759d4f80cba8ll,
+	0x0000b92143fa36f6ll, 0x000077b4ff5108d9ll,
+	0x0000b81702e05c0cll, 0x000079c9aa879d53ll,
+	0x0000b70fbb5a19bfll, 0x00007bdb59cca389ll,
+	0x0000b60b60b60b61ll, 0x00007dea15a32c1bll,
+	0x0000b509e68a9b95ll, 0x00007ff5e66a0ffell,
+	0x0000b40b40b40b41ll, 0x000081fed45cbcccll,
+	0x0000b30f63528918ll, 0x00008404e793fb82ll,
+	0x0000b21642c8590cll, 0x000086082806b1d5ll,
+	0x0000b11fd3b80b12ll, 0x000088089d8a9e47ll,
+	0x0000b02c0b02c0b1ll, 0x00008a064fd50f2all,
+	0x0000af3addc680b0ll, 0x00008c01467b94bbll,
+	0x0000ae4c415c9883ll, 0x00008df988f4ae80ll,
+	0x0000ad602b580ad7ll, 0x00008fef1e987409ll,
+	0x0000ac7691840ac8ll, 0x000091e20ea1393ell,
+	0x0000ab8f69e2835all, 0x000093d2602c2e60ll,
+	0x0000aaaaaaaaaaabll, 0x000095c01a39fbd7ll,
+	0x0000a9c84a47a080ll, 0x000097ab43af59f9ll,
+	0x0000a8e83f5717c1ll, 0x00009993e355a4e5ll,
+	0x0000a80a80a80a81ll, 0x00009b79ffdb6c8bll,
+	0x0000a72f0539782all, 0x00009d5d9fd5010bll,
+	0x0000a655c4392d7cll, 0x00009f3ec9bcfb81ll,
+	0x0000a57eb50295fbll, 0x0000a11d83f4c355ll,
+	0x0000a4a9cf1d9684ll, 0x0000a2f9d4c5103all,
+	0x0000a3d70a3d70a4ll, 0x0000a4d3c25e68dcll,
+	0x0000a3065e3fae7dll, 0x0000a6ab52d99e76ll,
+	0x0000a237c32b16d0ll, 0x0000a8808c384548ll,
+	0x0000a16b312ea8fdll, 0x0000aa5374652a1cll,
+	0x0000a0a0a0a0a0a1ll, 0x0000ac241134c4eall,
+	0x00009fd809fd80a0ll, 0x0000adf26865a8a2ll,
+	0x00009f1165e72549ll, 0x0000afbe7fa0f04dll,
+	0x00009e4cad23dd60ll, 0x0000b1885c7aa982ll,
+	0x00009d89d89d89d9ll, 0x0000b35004723c46ll,
+	0x00009cc8e160c3fcll, 0x0000b5157cf2d078ll,
+	0x00009c09c09c09c1ll, 0x0000b6d8cb53b0call,
+	0x00009b4c6f9ef03bll, 0x0000b899f4d8ab64ll,
+	0x00009a90e7d95bc7ll, 0x0000ba58feb2703bll,
+	0x000099d722dabde6ll, 0x0000bc15edfeed33ll,
+	0x0000991f1a515886ll, 0x0000bdd0c7c9a817ll,
+	0x00009868c809868dll, 0x0000bf89910c1679ll,
+	0x000097b425ed097cll, 0x0000c1404eadf384ll,
+	0x000097012e025c05ll, 0x0000c2f5058593d9ll,
+	0x0000964fda6c0965ll, 0x0000c4a7ba58377cll,
+	0x000095a02568095bll, 0x0000c65871da59dell,
+	0x000094f2094f2095ll, 0x0000c80730b00016ll,
+	0x0000944580944581ll, 0x0000c9b3fb6d0559ll,
+	0x0000939a85c4093all, 0x0000cb5ed69565b0ll,
+	0x000092f113840498ll, 0x0000cd07c69d8702ll,
+	0x0000924924924925ll, 0x0000ceaecfea8086ll,
+	0x000091a2b3c4d5e7ll, 0x0000d053f6d26089ll,
+	0x000090fdbc090fdcll, 0x0000d1f73f9c70c1ll,
+	0x0000905a38633e07ll, 0x0000d398ae817906ll,
+	0x00008fb823ee08fcll, 0x0000d53847ac00a7ll,
+	0x00008f1779d9fdc4ll, 0x0000d6d60f388e42ll,
+	0x00008e78356d1409ll, 0x0000d8720935e643ll,
+	0x00008dda5202376all, 0x0000da0c39a54804ll,
+	0x00008d3dcb08d3ddll, 0x0000dba4a47aa997ll,
+	0x00008ca29c046515ll, 0x0000dd3b4d9cf24bll,
+	0x00008c08c08c08c1ll, 0x0000ded038e633f3ll,
+	0x00008b70344a139cll, 0x0000e0636a23e2efll,
+	0x00008ad8f2fba939ll, 0x0000e1f4e5170d03ll,
+	0x00008a42f870566all, 0x0000e384ad748f0ell,
+	0x000089ae4089ae41ll, 0x0000e512c6e54999ll,
+	0x0000891ac73ae982ll, 0x0000e69f35065448ll,
+	0x0000888888888889ll, 0x0000e829fb693045ll,
+	0x000087f78087f781ll, 0x0000e9b31d93f98fll,
+	0x00008767ab5f34e5ll, 0x0000eb3a9f019750ll,
+	0x000086d905447a35ll, 0x0000ecc08321eb31ll,
+	0x0000864b8a7de6d2ll, 0x0000ee44cd59ffabll,
+	0x000085bf37612cefll, 0x0000efc781043579ll,
+	0x0000853408534086ll, 0x0000f148a170700all,
+	0x000084a9f9c8084bll, 0x0000f2c831e44116ll,
+	0x0000842108421085ll, 0x0000f446359b1354ll,
+	0x0000839930523fbfll, 0x0000f5c2afc65448ll,
+	0x000083126e978d50ll, 0x0000f73da38d9d4bll,
+	0x0000828cbfbeb9a1ll, 0x0000f8b7140edbb2ll,
+	0x0000820820820821ll, 0x0000fa2f045e7833ll,
+	0x000081848da8faf1ll, 0x0000fba577877d7dll,
+	0x0000810204081021ll, 0x0000fd1a708bbe12ll,
+	0x0000808080808081ll, 0x0000fe8df263f958ll,
+	0x0000800000000000ll, 0x0001000000000000ll
+};
+
+static const __s64 __LL_tbl[256] = {
+	0x0000000000000000ll, 0x00000002e2a60a00ll,
+	0x00000005c5464ec6ll, 0x00000008a7e0ce68ll,
+	0x0000000b8a7588fdll, 0x0000000e6d047e9dll,
+	0x000000114f8daf5ell, 0x0000001432111b58ll,
+	0x00000017148ec2a2ll, 0x00000019f706a552ll,
+	0x0000001cd978c380ll, 0x0000001fbbe51d43ll,
+	0x000000229e4bb2b2ll, 0x0000002580ac83e4ll,
+	0x00000028630790f0ll, 0x0000002b455cd9edll,
+	0x0000002e27ac5ef3ll, 0x0000003109f62017ll,
+	0x00000033ec3a1d72ll, 0x00000036ce78571all,
+	0x00000039b0b0cd26ll, 0x0000003c92e37faell,
+	0x0000003f75106ec8ll, 0x0000004257379a8cll,
+	0x0000004539590310ll, 0x000000481b74a86cll,
+	0x0000004afd8a8ab6ll, 0x0000004ddf9aaa06ll,
+	0x00000050c1a50673ll, 0x00000053a3a9a013ll,
+	0x0000005685a876fell, 0x0000005967a18b4bll,
+	0x0000005c4994dd10ll, 0x0000005f2b826c65ll,
+	0x000000620d6a3961ll, 0x00000064ef4c441all,
+	0x00000067d1288ca8ll, 0x0000006ab2ff1322ll,
+	0x0000006d94cfd79fll, 0x00000070769ada36ll,
+	0x0000007358601afdll, 0x000000763a1f9a0cll,
+	0x000000791bd9577all, 0x0000007bfd8d535ell,
+	0x0000007edf3b8dcfll, 0x00000081c0e406e3ll,
+	0x00000084a286beb2ll, 0x000000878423b553ll,
+	0x0000008a65baeadcll, 0x0000008d474c5f66ll,
+	0x0000009028d81306ll, 0x000000930a5e05d3ll,
+	0x00000095ebde37e5ll, 0x00000098cd58a953ll,
+	0x0000009baecd5a34ll, 0x0000009e903c4a9ell,
+	0x000000a171a57aa8ll, 0x000000a45308ea6all,
+	0x000000a7346699fbll, 0x000000aa15be8971ll,
+	0x000000acf710b8e3ll, 0x000000afd85d2869ll,
+	0x000000b2b9a3d819ll, 0x000000b59ae4c80all,
+	0x000000b87c1ff854ll, 0x000000bb5d55690cll,
+	0x000000be3e851a4bll, 0x000000c11faf0c27ll,
+	0x000000c400d33eb6ll, 0x000000c6e1f1b211ll,
+	0x000000c9c30a664ell, 0x000000cca41d5b83ll,
+	0x000000cf852a91c8ll, 0x000000d266320934ll,
+	0x000000d54733c1ddll, 0x000000d8282fbbdbll,
+	0x000000db0925f744ll, 0x000000ddea167430ll,
+	0x000000e0cb0132b5ll, 0x000000e3abe632eall,
+	0x000000e68cc574e7ll, 0x000000e96d9ef8c1ll,
+	0x000000ec4e72be91ll, 0x000000ef2f40c66cll,
+	0x000000f21009106all, 0x000000f4f0cb9ca2ll,
+	0x000000f7d1886b2bll, 0x000000fab23f7c1all,
+	0x000000fd92f0cf89ll, 0x00000100739c658dll,
+	0x0000010354423e3cll, 0x0000010634e259afll,
+	0x00000109157cb7fcll, 0x0000010bf611593all,
+	0x0000010ed6a03d80ll, 0x00000111b72964e4ll,
+	0x0000011497accf7ell, 0x00000117782a7d64ll,
+	0x0000011a58a26eaell, 0x0000011d3914a372ll,
+	0x0000012019811bc7ll, 0x00000122f9e7d7c3ll,
+	0x00000125da48d77fll, 0x00000128baa41b10ll,
+	0x0000012b9af9a28ell, 0x0000012e7b496e0fll,
+	0x000001315b937dabll, 0x000001343bd7d178ll,
+	0x000001371c16698cll, 0x00000139fc4f4600ll,
+	0x0000013cdc8266e9ll, 0x0000013fbcafcc5fll,
+	0x000001429cd77678ll, 0x000001457cf9654cll,
+	0x000001485d1598f0ll, 0x0000014b3d2c117dll,
+	0x0000014e1d3ccf08ll, 0x00000150fd47d1a9ll,
+	0x00000153dd4d1977ll, 0x00000156bd4ca687ll,
+	0x000001599d4678f2ll, 0x0000015c7d3a90cell,
+	0x0000015f5d28ee32ll, 0x000001623d119134ll,
+	0x000001651cf479ecll, 0x00000167fcd1a870ll,
+	0x0000016adca91cd8ll, 0x0000016dbc7ad739ll,
+	0x000001709c46d7abll, 0x000001737c0d1e44ll,
+	0x000001765bcdab1cll, 0x000001793b887e49ll,
+	0x0000017c1b3d97e2ll, 0x0000017efaecf7fell,
+	0x00000181da969eb4ll, 0x00000184ba3a8c1all,
+	0x0000018799d8c047ll, 0x0000018a79713b52ll,
+	0x0000018d5903fd52ll, 0x000001903891065ell,
+	0x000001931818568cll, 0x00000195f799edf3ll,
+	0x00000198d715ccaall, 0x0000019bb68bf2c8ll,
+	0x0000019e95fc6064ll, 0x000001a175671593ll,
+	0x000001a454cc126ell, 0x000001a7342b570bll,
+	0x000001aa1384e381ll, 0x000001acf2d8b7e6ll,
+	0x000001afd226d451ll, 0x000001b2b16f38d9ll,
+	0x000001b590b1e595ll, 0x000001b86feeda9cll,
+	0x000001bb4f261803ll, 0x000001be2e579de3ll,
+	0x000001c10d836c52ll, 0x000001c3eca98366ll,
+	0x000001c6cbc9e336ll, 0x000001c9aae48bdall,
+	0x000001cc89f97d67ll, 0x000001cf6908b7f5ll,
+	0x000001d248123b9bll, 0x000001d52716086ell,
+	0x000001d806141e86ll, 0x000001dae50c7dfall,
+	0x000001ddc3ff26e0ll, 0x000001e0a2ec194fll,
+	0x000001e381d3555ell, 0x000001e660b4db23ll,
+	0x000001e93f90aab6ll, 0x000001ec1e66c42cll,
+	0x000001eefd37279dll, 0x000001f1dc01d520ll,
+	0x000001f4bac6cccall, 0x000001f799860eb4ll,
+	0x000001fa783f9af3ll, 0x000001fd56f3719ell,
+	0x0000020035a192cdll, 0x000002031449fe95ll,
+	0x00000205f2ecb50dll, 0x00000208d189b64dll,
+	0x0000020bb021026all, 0x0000020e8eb2997cll,
+	0x000002116d3e7b9all, 0x000002144bc4a8d9ll,
+	0x000002172a452151ll, 0x0000021a08bfe518ll,
+	0x0000021ce734f445ll, 0x0000021fc5a44eefll,
+	0x00000222a40df52cll, 0x000002258271e713ll,
+	0x0000022860d024bcll, 0x0000022b3f28ae3bll,
+	0x0000022e1d7b83a9ll, 0x00000230fbc8a51cll,
+	0x00000233da1012aall, 0x00000236b851cc6all,
+	0x00000239968dd273ll, 0x0000023c74c424dcll,
+	0x0000023f52f4c3ball, 0x00000242311faf26ll,
+	0x000002450f44e735ll, 0x00000247ed646bfell,
+	0x0000024acb7e3d99ll, 0x0000024da9925c1all,
+	0x0000025087a0c79all, 0x0000025365a9802fll,
+	0x0000025643ac85efll, 0x0000025921a9d8f1ll,
+	0x0000025bffa1794cll, 0x0000025edd936716ll,
+	0x00000261bb7fa266ll, 0x0000026499662b54ll,
+	0x00000267774701f4ll, 0x0000026a5522265ell,
+	0x0000026d32f798a9ll, 0x0000027010c758ebll,
+	0x00000272ee91673cll, 0x00000275cc55c3b0ll,
+	0x00000278aa146e60ll, 0x0000027b87cd6761ll,
+	0x0000027e6580aecbll, 0x00000281432e44b4ll,
+	0x0000028420d62932ll, 0x00000286fe785c5dll,
+	0x00000289dc14de4all, 0x0000028cb9abaf11ll,
+	0x0000028f973ccec8ll, 0x0000029274c83d86ll,
+	0x00000295524dfb61ll, 0x000002982fce0870ll,
+	0x0000029b0d4864c9ll, 0x0000029deabd1084ll,
+	0x000002a0c82c0bb6ll, 0x000002a3a5955676ll,
+	0x000002a682f8f0dcll, 0x000002a96056dafcll,
+	0x000002ac3daf14efll, 0x000002af1b019ecbll,
+	0x000002b1f84e78a6ll, 0x000002b4d595a296ll,
+	0x000002b7b2d71cb3ll, 0x000002ba9012e713ll,
+	0x000002bd6d4901cdll, 0x000002c04a796cf6ll,
+	0x000002c327a428a7ll, 0x000002c604c934f4ll,
+	0x000002c8e1e891f6ll, 0x000002cbbf023fc2ll,
+	0x000002ce9c163e6fll, 0x000002d179248e14ll,
+	0x000002d4562d2ec6ll, 0x000002d73330209dll,
+	0x000002da102d63b0ll, 0x000002dced24f814ll
+};
+
+#endif
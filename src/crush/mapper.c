@@ -4,6 +4,7 @@
 # include <linux/slab.h>
 # include <linux/bug.h>
 # include <linux/kernel.h>
+# include <linux/math64.h>
 # ifndef dprintk
 #  define dprintk(args...)
 # endif
@@ -18,10 +19,13 @@
 # define kfree(x) free(x)
 /*# define DEBUG_INDEP*/
 # include "include/int_types.h"
+# define S64_MIN (-0x7fffffffffffffffll - 1)
+# define div64_s64(dividend, divisor) ((dividend) / (divisor))
 #endif
 
 #include "crush.h"
 #include "hash.h"
+#include "crush_ln_table.h"
 
 /*
  * Implement the core CRUSH mapping algorithm.
@@ -67,59 +71,60 @@ int crush_find_rule(const struct crush_map *map, int ruleset, int type, int size
  * Since this is expensive, we optimize for the r=0 case, which
  * captures the vast majority of calls.
  */
-static int bucket_perm_choose(struct crush_bucket *bucket,
+static int bucket_perm_choose(const struct crush_bucket *bucket,
+			      struct crush_work_bucket *work,
 			      int x, int r)
 {
 	unsigned int pr = r % bucket->size;
 	unsigned int i, s;
 
 	/* start a new permutation if @x has changed */
-	if (bucket->perm_x != (__u32)x || bucket->perm_n == 0) {
+	if (work->perm_x != (__u32)x || work->perm_n == 0) {
 		dprintk("bucket %d new x=%d\n", bucket->id, x);
-		bucket->perm_x = x;
+		work->perm_x = x;
 
 		/* optimize common r=0 case */
 		if (pr == 0) {
 			s = crush_hash32_3(bucket->hash, x, bucket->id, 0) %
 				bucket->size;
-			bucket->perm[0] = s;
-			bucket->perm_n = 0xffff;   /* magic value, see below */
+			work->perm[0] = s;
+			work->perm_n = 0xffff;   /* magic value, see below */
 			goto out;
 		}
 
 		for (i = 0; i < bucket->size; i++)
-			bucket->perm[i] = i;
-		bucket->perm_n = 0;
-	} else if (bucket->perm_n == 0xffff) {
+			work->perm[i] = i;
+		work->perm_n = 0;
+	} else if (work->perm_n == 0xffff) {
 		/* clean up after the r=0 case above */
 		for (i = 1; i < bucket->size; i++)
-			bucket->perm[i] = i;
-		bucket->perm[bucket->perm[0]] = 0;
-		bucket->perm_n = 1;
+			work->perm[i] = i;
+		work->perm[work->perm[0]] = 0;
+		work->perm_n = 1;
 	}
 
 	/* calculate permutation up to pr */
-	for (i = 0; i < bucket->perm_n; i++)
-		dprintk(" perm_choose have %d: %d\n", i, bucket->perm[i]);
-	while (bucket->perm_n <= pr) {
-		unsigned int p = bucket->perm_n;
+	for (i = 0; i < work->perm_n; i++)
+		dprintk(" perm_choose have %d: %d\n", i, work->perm[i]);
+	while (work->perm_n <= pr) {
+		unsigned int p = work->perm_n;
 		/* no point in swapping the final entry */
 		if (p < bucket->size - 1) {
 			i = crush_hash32_3(bucket->hash, x, bucket->id, p) %
 				(bucket->size - p);
 			if (i) {
-				unsigned int t = bucket->perm[p + i];
-				bucket->perm[p + i] = bucket->perm[p];
-				bucket->perm[p] = t;
+				unsigned int t = work->perm[p + i];
+				work->perm[p + i] = work->perm[p];
+				work->perm[p] = t;
 			}
 			dprintk(" perm_choose swap %d with %d\n", p, p+i);
 		}
-		bucket->perm_n++;
+		work->perm_n++;
 	}
 	for (i = 0; i < bucket->size; i++)
-		dprintk(" perm_choose  %d: %d\n", i, bucket->perm[i]);
+		dprintk(" perm_choose  %d: %d\n", i, work->perm[i]);
 
-	s = bucket->perm[pr];
+	s = work->perm[pr];
 out:
 	dprintk(" perm_choose %d sz=%d x=%d r=%d (%d) s=%d\n", bucket->id,
 		bucket->size, x, r, pr, s);
@@ -127,10 +132,10 @@ out:
 }
 
 /* uniform */
-static int bucket_uniform_choose(struct crush_bucket_uniform *bucket,
-				 int x, int r)
+static int bucket_uniform_choose(const struct crush_bucket_uniform *bucket,
+				 struct crush_work_bucket *work, int x, int r)
 {
-	return bucket_perm_choose(&bucket->h, x, r);
+	return bucket_perm_choose(&bucket->h, work, x, r);
 }
 
 /* list */
@@ -239,14 +244,97 @@ static int bucket_straw_choose(struct crush_bucket_straw *bucket,
 	return bucket->h.items[high];
 }
 
-static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
+/* straw2 */
+
+/*
+ * crush_ln - 2^44 * log2(x + 1), for 0 <= x <= 0xffff
+ *
+ * The input is normalized to [2^15, 2^16], then the log of the high
+ * bits and of the remaining ratio are read from the tables.
+ */
+static __u64 crush_ln(unsigned int xin)
+{
+	unsigned int x = xin + 1;
+	int iexpon = 15;
+	int index1, index2;
+	__u64 RH, LH, LL, xl64, result;
+
+	/* normalize input */
+	while (!(x & 0x18000)) {
+		x <<= 1;
+		iexpon--;
+	}
+
+	index1 = (x >> 8) << 1;
+	/* RH ~ 2^56/index1 */
+	RH = __RH_LH_tbl[index1 - 256];
+	/* LH ~ 2^48 * log2(index1/256) */
+	LH = __RH_LH_tbl[index1 + 1 - 256];
+
+	/* RH*x ~ 2^48 * (2^15 + xf), xf<2^8 */
+	xl64 = (__s64)x * RH;
+	xl64 >>= 48;
+
+	result = iexpon;
+	result <<= (12 + 32);
+
+	index2 = xl64 & 0xff;
+	/* LL ~ 2^48*log2(1.0+index2/2^15) */
+	LL = __LL_tbl[index2];
+
+	LH = LH + LL;
+
+	LH >>= (48 - 12 - 32);
+	result += LH;
+
+	return result;
+}
+
+/*
+ * Each item draws ln(u) / w for a uniform u in (0, 1]: an exponential
+ * variable of rate w.  The largest draw wins, which happens with
+ * probability w / sum(w), and an item's draw depends only on its own
+ * weight.
+ */
+static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
+				int x, int r)
+{
+	unsigned int i, high = 0;
+	unsigned int u;
+	__s64 ln, draw, high_draw = 0;
+
+	for (i = 0; i < bucket->h.size; i++) {
+		if (bucket->item_weights[i]) {
+			u = crush_hash32_3(bucket->h.hash, x,
+					   bucket->h.items[i], r);
+			u &= 0xffff;
+
+			/* ln(u / 2^16) in 2^44 fixed point, <= 0 */
+			ln = crush_ln(u) - 0x1000000000000ll;
+
+			draw = div64_s64(ln, bucket->item_weights[i]);
+		} else {
+			draw = S64_MIN;
+		}
+
+		if (i == 0 || draw > high_draw) {
+			high = i;
+			high_draw = draw;
+		}
+	}
+	return bucket->h.items[high];
+}
+
+static int crush_bucket_choose(const struct crush_bucket *in,
+			       struct crush_work_bucket *work,
+			       int x, int r)
 {
 	dprintk(" crush_bucket_choose %d x=%d r=%d\n", in->id, x, r);
 	BUG_ON(in->size == 0);
 	switch (in->alg) {
 	case CRUSH_BUCKET_UNIFORM:
-		return bucket_uniform_choose((struct crush_bucket_uniform *)in,
-					  x, r);
+		return bucket_uniform_choose(
+			(const struct crush_bucket_uniform *)in, work, x, r);
 	case CRUSH_BUCKET_LIST:
 		return bucket_list_choose((struct crush_bucket_list *)in,
 					  x, r);
@@ -256,6 +344,9 @@ static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
 	case CRUSH_BUCKET_STRAW:
 		return bucket_straw_choose((struct crush_bucket_straw *)in,
 					   x, r);
+	case CRUSH_BUCKET_STRAW2:
+		return bucket_straw2_choose(
+			(const struct crush_bucket_straw2 *)in, x, r);
 	default:
 		dprintk("unknown bucket %d alg %d\n", in->id, in->alg);
 		return in->items[0];
@@ -299,8 +390,10 @@ static int is_out(const struct crush_map *map,
  * @vary_r: pass r to recursive calls
  * @out2: second output vector for leaf items (if @recurse_to_leaf)
  * @parent_r: r value passed from the parent
+ * @cw: workspace of this mapping
  */
 static int crush_choose_firstn(const struct crush_map *map,
+			       struct crush_work *cw,
 			       struct crush_bucket *bucket,
 			       const __u32 *weight, int weight_max,
 			       int x, int numrep, int type,
@@ -355,9 +448,13 @@ static int crush_choose_firstn(const struct crush_map *map,
 				if (local_fallback_retries > 0 &&
 				    flocal >= (in->size>>1) &&
 				    flocal > local_fallback_retries)
-					item = bucket_perm_choose(in, x, r);
+					item = bucket_perm_choose(
+						in, cw->work[-1-in->id],
+						x, r);
 				else
-					item = crush_bucket_choose(in, x, r);
+					item = crush_bucket_choose(
+						in, cw->work[-1-in->id],
+						x, r);
 				if (item >= map->max_devices) {
 					dprintk("   bad item %d\n", item);
 					skip_rep = 1;
@@ -401,6 +498,7 @@ static int crush_choose_firstn(const struct crush_map *map,
 						else
 							sub_r = 0;
 						if (crush_choose_firstn(map,
+							 cw,
 							 map->buckets[-1-item],
 							 weight, weight_max,
 							 x, outpos+1, 0,
@@ -479,6 +577,7 @@ reject:
  *
  */
 static void crush_choose_indep(const struct crush_map *map,
+			       struct crush_work *cw,
 			       struct crush_bucket *bucket,
 			       const __u32 *weight, int weight_max,
 			       int x, int left, int numrep, int type,
@@ -557,7 +656,8 @@ static void crush_choose_indep(const struct crush_map *map,
 					break;
 				}
 
-				item = crush_bucket_choose(in, x, r);
+				item = crush_bucket_choose(
+					in, cw->work[-1-in->id], x, r);
 				if (item >= map->max_devices) {
 					dprintk("   bad item %d\n", item);
 					out[rep] = CRUSH_ITEM_NONE;
@@ -604,6 +704,7 @@ static void crush_choose_indep(const struct crush_map *map,
 				if (recurse_to_leaf) {
 					if (item < 0) {
 						crush_choose_indep(map,
+						   cw,
 						   map->buckets[-1-item],
 						   weight, weight_max,
 						   x, 1, numrep, 0,
@@ -656,6 +757,70 @@ static void crush_choose_indep(const struct crush_map *map,
 #endif
 }
 
+/**
+ * crush_work_size - size of the workspace of a mapping
+ * @map: the crush_map
+ * @result_max: maximum result size
+ *
+ * The workspace holds the permutation state of every bucket and the
+ * scratch vectors of crush_do_rule.  It depends on the map, so it
+ * must be sized and initialized again after the map changes.
+ */
+size_t crush_work_size(const struct crush_map *map, int result_max)
+{
+	size_t size = sizeof(struct crush_work) +
+		map->max_buckets * sizeof(struct crush_work_bucket *);
+	int b;
+
+	for (b = 0; b < map->max_buckets; b++) {
+		if (!map->buckets[b])
+			continue;
+		size += sizeof(struct crush_work_bucket) +
+			map->buckets[b]->size * sizeof(__u32);
+	}
+	/* scratch vectors, after the permutations */
+	size += 3 * result_max * sizeof(int);
+	return size;
+}
+
+/**
+ * crush_init_workspace - prepare a workspace for crush_do_rule
+ * @map: the crush_map
+ * @v: workspace of crush_work_size() bytes, suitably aligned
+ *
+ * A workspace may be reused for any number of mappings of @map, but
+ * by a single thread at a time.
+ */
+void crush_init_workspace(const struct crush_map *map, void *v)
+{
+	struct crush_work *w = v;
+	char *point = (char *)v;
+	__u32 *perm;
+	int b;
+
+	point += sizeof(struct crush_work);
+	w->work = (struct crush_work_bucket **)point;
+	point += map->max_buckets * sizeof(struct crush_work_bucket *);
+	for (b = 0; b < map->max_buckets; b++) {
+		if (!map->buckets[b]) {
+			w->work[b] = NULL;
+			continue;
+		}
+		w->work[b] = (struct crush_work_bucket *)point;
+		point += sizeof(struct crush_work_bucket);
+	}
+	perm = (__u32 *)point;
+	for (b = 0; b < map->max_buckets; b++) {
+		if (!map->buckets[b])
+			continue;
+		w->work[b]->perm_x = 0;
+		w->work[b]->perm_n = 0;
+		w->work[b]->perm = perm;
+		perm += map->buckets[b]->size;
+	}
+	w->scratch = (int *)perm;
+}
+
 /**
  * crush_do_rule - calculate a mapping with the given input and rule
  * @map: the crush_map
@@ -665,17 +830,19 @@ static void crush_choose_indep(const struct crush_map *map,
  * @result_max: maximum result size
  * @weight: weight vector (for map leaves)
  * @weight_max: size of weight vector
- * @scratch: scratch vector for private use; must be >= 3 * result_max
+ * @cwin: workspace initialized by crush_init_workspace() with a
+ *        result_max at least as large as this one
  */
 int crush_do_rule(const struct crush_map *map,
 		  int ruleno, int x, int *result, int result_max,
 		  const __u32 *weight, int weight_max,
-		  int *scratch)
+		  void *cwin)
 {
 	int result_len;
-	int *a = scratch;
-	int *b = scratch + result_max;
-	int *c = scratch + result_max*2;
+	struct crush_work *cw = cwin;
+	int *a = cw->scratch;
+	int *b = cw->scratch + result_max;
+	int *c = cw->scratch + result_max*2;
 	int recurse_to_leaf;
 	int *w;
 	int wsize = 0;
@@ -788,6 +955,7 @@ int crush_do_rule(const struct crush_map *map,
 						recurse_tries = choose_tries;
 					osize += crush_choose_firstn(
 						map,
+						cw,
 						map->buckets[-1-w[i]],
 						weight, weight_max,
 						x, numrep,
@@ -804,6 +972,7 @@ int crush_do_rule(const struct crush_map *map,
 				} else {
 					crush_choose_indep(
 						map,
+						cw,
 						map->buckets[-1-w[i]],
 						weight, weight_max,
 						x, numrep, numrep,
@@ -848,4 +1017,33 @@ int crush_do_rule(const struct crush_map *map,
 	return result_len;
 }
 
+/**
+ * crush_do_rule_batch - map a range of inputs with the given rule
+ * @map: the crush_map
+ * @ruleno: the rule id
+ * @x_start: first hash input
+ * @x_count: number of inputs
+ * @result: result vectors, @result_max apart, one per input
+ * @result_max: maximum result size
+ * @result_len: length of each result vector
+ * @weight: weight vector (for map leaves)
+ * @weight_max: size of weight vector
+ * @cwin: workspace, as for crush_do_rule()
+ *
+ * Same as calling crush_do_rule() for each input, sharing the
+ * workspace between them.
+ */
+void crush_do_rule_batch(const struct crush_map *map,
+			 int ruleno, int x_start, int x_count,
+			 int *result, int result_max, int *result_len,
+			 const __u32 *weight, int weight_max,
+			 void *cwin)
+{
+	int i;
 
+	for (i = 0; i < x_count; i++)
+		result_len[i] = crush_do_rule(map, ruleno, x_start + i,
+					      result + i * result_max,
+					      result_max,
+					      weight, weight_max, cwin);
+}
@@ -11,10 +11,17 @@
 #include "crush.h"
 
 extern int crush_find_rule(const struct crush_map *map, int ruleset, int type, int size);
+extern size_t crush_work_size(const struct crush_map *map, int result_max);
+extern void crush_init_workspace(const struct crush_map *map, void *v);
 extern int crush_do_rule(const struct crush_map *map,
 			 int ruleno,
 			 int x, int *result, int result_max,
 			 const __u32 *weights, int weight_max,
-			 int *scratch);
+			 void *cwin);
+extern void crush_do_rule_batch(const struct crush_map *map,
+				int ruleno, int x_start, int x_count,
+				int *result, int result_max, int *result_len,
+				const __u32 *weights, int weight_max,
+				void *cwin);
 
 #endif
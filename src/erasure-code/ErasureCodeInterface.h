@@ -302,6 +302,54 @@ namespace ceph {
                        const bufferlist &in,
                        map<int, bufferlist> *encoded) = 0;
 
+    /**
+     * Encode **in**, the concatenation of stripes of
+     * **stripe_width** bytes each, and write the chunks of every
+     * stripe into the caller provided buffers of **encoded**, one
+     * after the other. It is the batched equivalent of calling
+     * **encode** on each stripe and concatenating the chunks with
+     * the same index.
+     *
+     * The **encoded** map must contain a buffer for every chunk index
+     * found in **want_to_encode** and nothing else. Each buffer must
+     * be **in.length() / stripe_width * get_chunk_size(stripe_width)**
+     * bytes long. Page aligned buffers allow the implementation to
+     * encode in place.
+     *
+     * The default implementation calls **encode** once per stripe
+     * and copies the result. Implementations are expected to
+     * override it to avoid the per stripe allocations.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] want_to_encode chunk indexes to be encoded
+     * @param [in] stripe_width size of a stripe, in bytes
+     * @param [in] in data to be encoded, a multiple of **stripe_width**
+     * @param [in,out] encoded map chunk indexes to output buffers
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_stripes(const set<int> &want_to_encode,
+			       unsigned int stripe_width,
+			       const bufferlist &in,
+			       map<int, bufferptr> *encoded) {
+      unsigned int chunk_size = get_chunk_size(stripe_width);
+      for (unsigned int offset = 0, chunk_offset = 0;
+	   offset < in.length();
+	   offset += stripe_width, chunk_offset += chunk_size) {
+	bufferlist stripe;
+	stripe.substr_of(in, offset, stripe_width);
+	map<int, bufferlist> chunks;
+	int r = encode(want_to_encode, stripe, &chunks);
+	if (r)
+	  return r;
+	for (map<int, bufferptr>::iterator i = encoded->begin();
+	     i != encoded->end();
+	     ++i)
+	  chunks[i->first].copy(0, chunk_size, i->second.c_str() + chunk_offset);
+      }
+      return 0;
+    }
+
     /**
      * Decode the **chunks** and store at least **want_to_read**
      * chunks in **decoded**.
@@ -132,6 +132,48 @@ int ErasureCodeJerasure::encode(const set<int> &want_to_encode,
   return 0;
 }
 
+int ErasureCodeJerasure::encode_stripes(const set<int> &want_to_encode,
+                                        unsigned int stripe_width,
+                                        const bufferlist &in,
+                                        map<int, bufferptr> *encoded)
+{
+  unsigned blocksize = get_chunk_size(stripe_width);
+  if (blocksize * k != stripe_width)
+    // stripes need padding, let encode() take care of it
+    return ErasureCodeInterface::encode_stripes(want_to_encode, stripe_width,
+						in, encoded);
+  assert(in.length() % stripe_width == 0);
+  unsigned stripes = in.length() / stripe_width;
+  dout(10) << "encode_stripes " << stripes << " stripes of "
+	   << stripe_width << dendl;
+  // chunks that are not wanted are encoded in a scratch buffer shared
+  // by all stripes, the others directly in the caller buffer
+  bufferptr scratch(buffer::create_page_aligned(blocksize * (k + m)));
+  char *chunks[k + m];
+  unsigned step[k + m];
+  for (int i = 0; i < k + m; i++) {
+    map<int, bufferptr>::iterator chunk = encoded->find(i);
+    if (chunk == encoded->end()) {
+      chunks[i] = scratch.c_str() + i * blocksize;
+      step[i] = 0;
+    } else {
+      assert(chunk->second.length() == stripes * blocksize);
+      chunks[i] = chunk->second.c_str();
+      step[i] = blocksize;
+    }
+  }
+  bufferlist data(in);
+  bufferlist::iterator p = data.begin();
+  for (unsigned stripe = 0; stripe < stripes; stripe++) {
+    for (int i = 0; i < k; i++)
+      p.copy(blocksize, chunks[i]);
+    jerasure_encode(&chunks[0], &chunks[k], blocksize);
+    for (int i = 0; i < k + m; i++)
+      chunks[i] += step[i];
+  }
+  return 0;
+}
+
 int ErasureCodeJerasure::decode(const set<int> &want_to_read,
                                 const map<int, bufferlist> &chunks,
                                 map<int, bufferlist> *decoded)
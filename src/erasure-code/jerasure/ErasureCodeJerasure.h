@@ -62,6 +62,11 @@ public:
                      const bufferlist &in,
                      map<int, bufferlist> *encoded);
 
+  virtual int encode_stripes(const set<int> &want_to_encode,
+                             unsigned int stripe_width,
+                             const bufferlist &in,
+                             map<int, bufferptr> *encoded);
+
   virtual int decode(const set<int> &want_to_read,
                      const map<int, bufferlist> &chunks,
                      map<int, bufferlist> *decoded);
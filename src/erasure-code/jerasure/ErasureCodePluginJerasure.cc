@@ -15,8 +15,10 @@
  */
 
 #include "common/debug.h"
+#include "common/errno.h"
 #include "erasure-code/ErasureCodePlugin.h"
 #include "ErasureCodeJerasure.h"
+#include "galois_simd.h"
 
 #define dout_subsys ceph_subsys_osd
 #undef dout_prefix
@@ -57,6 +59,21 @@ public:
 	   << dendl;
       return -ENOENT;
     }
+    map<std::string,std::string>::const_iterator simd =
+      parameters.find("jerasure-simd");
+    if (simd != parameters.end()) {
+      // a debug and benchmark knob: it affects the whole process
+      int r = galois_w08_simd_select(simd->second.c_str());
+      if (r < 0) {
+	derr << "jerasure-simd=" << simd->second << " is not available: "
+	     << cpp_strerror(r) << ". Choose one of auto, none, ssse3, "
+	     << "avx2, neon" << dendl;
+	delete interface;
+	return r;
+      }
+      dout(10) << "jerasure-simd=" << simd->second << " using "
+	       << galois_w08_simd_selected() << dendl;
+    }
     interface->init(parameters);
     *erasure_code = ErasureCodeInterfaceRef(interface);
     return 0;
@@ -66,5 +83,8 @@ public:
 int __erasure_code_init(char *plugin_name)
 {
   ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  galois_w08_simd_select("auto");
+  dout(10) << "w=8 region multiply uses " << galois_w08_simd_selected()
+	   << dendl;
   return instance.add(plugin_name, new ErasureCodePluginJerasure());
 }
@@ -53,6 +53,7 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 
 #include "galois.h"
+#include "galois_simd.h"
 #include "vectorop.h"
 
 #define NONE (10)
@@ -461,6 +462,17 @@ void galois_w08_region_multiply(char *region,      /* Region to multiply */
     }
   }
   srow = multby * nw[8];
+  if (galois_w08_simd != NULL && nbytes >= 32) {
+    unsigned char tables[32];
+    for (i = 0; i < 16; i++) {
+      tables[i] = galois_mult_tables[8][srow+i];
+      tables[16+i] = galois_mult_tables[8][srow+(i<<4)];
+    }
+    i = galois_w08_simd(tables, ur1, ur2, nbytes, r2 != NULL && add);
+    ur1 += i;
+    ur2 += i;
+    nbytes -= i;
+  }
   if (r2 == NULL || !add) {
     for (i = 0; i < nbytes; i++) {
       prod = galois_mult_tables[8][srow+ur1[i]];
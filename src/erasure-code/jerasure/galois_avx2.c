@@ -0,0 +1,69 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "galois_simd.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+int galois_w08_avx2_exists(void)
+{
+  return 1;
+}
+
+/* vpshufb looks up within each 128 bit lane, so both lanes get the tables */
+static inline __m256i load_table(const unsigned char *t)
+{
+  __m128i x = _mm_loadu_si128((const __m128i *)t);
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(x), x, 1);
+}
+
+int galois_w08_region_multiply_avx2(const unsigned char *tables,
+				    const unsigned char *src,
+				    unsigned char *dst,
+				    int nbytes, int add)
+{
+  const __m256i lo = load_table(tables);
+  const __m256i hi = load_table(tables + 16);
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  int i;
+
+  for (i = 0; i + 32 <= nbytes; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i l = _mm256_and_si256(x, mask);
+    __m256i h = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+    __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, l),
+				 _mm256_shuffle_epi8(hi, h));
+    if (add)
+      p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i *)(dst + i)));
+    _mm256_storeu_si256((__m256i *)(dst + i), p);
+  }
+  return i;
+}
+
+#else
+
+int galois_w08_avx2_exists(void)
+{
+  return 0;
+}
+
+int galois_w08_region_multiply_avx2(const unsigned char *tables,
+				    const unsigned char *src,
+				    unsigned char *dst,
+				    int nbytes, int add)
+{
+  return 0;
+}
+
+#endif
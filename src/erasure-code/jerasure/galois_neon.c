@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "galois_simd.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+int galois_w08_neon_exists(void)
+{
+  return 1;
+}
+
+#ifdef __aarch64__
+
+int galois_w08_region_multiply_neon(const unsigned char *tables,
+				    const unsigned char *src,
+				    unsigned char *dst,
+				    int nbytes, int add)
+{
+  const uint8x16_t lo = vld1q_u8(tables);
+  const uint8x16_t hi = vld1q_u8(tables + 16);
+  const uint8x16_t mask = vdupq_n_u8(0x0f);
+  int i;
+
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    uint8x16_t x = vld1q_u8(src + i);
+    uint8x16_t p = veorq_u8(vqtbl1q_u8(lo, vandq_u8(x, mask)),
+			    vqtbl1q_u8(hi, vshrq_n_u8(x, 4)));
+    if (add)
+      p = veorq_u8(p, vld1q_u8(dst + i));
+    vst1q_u8(dst + i, p);
+  }
+  return i;
+}
+
+#else
+
+/* armv7 only has the 64 bit table lookup, over up to four d registers */
+int galois_w08_region_multiply_neon(const unsigned char *tables,
+				    const unsigned char *src,
+				    unsigned char *dst,
+				    int nbytes, int add)
+{
+  uint8x8x2_t lo, hi;
+  const uint8x8_t mask = vdup_n_u8(0x0f);
+  int i;
+
+  lo.val[0] = vld1_u8(tables);
+  lo.val[1] = vld1_u8(tables + 8);
+  hi.val[0] = vld1_u8(tables + 16);
+  hi.val[1] = vld1_u8(tables + 24);
+
+  for (i = 0; i + 8 <= nbytes; i += 8) {
+    uint8x8_t x = vld1_u8(src + i);
+    uint8x8_t p = veor_u8(vtbl2_u8(lo, vand_u8(x, mask)),
+			  vtbl2_u8(hi, vshr_n_u8(x, 4)));
+    if (add)
+      p = veor_u8(p, vld1_u8(dst + i));
+    vst1_u8(dst + i, p);
+  }
+  return i;
+}
+
+#endif
+
+#else
+
+int galois_w08_neon_exists(void)
+{
+  return 0;
+}
+
+int galois_w08_region_multiply_neon(const unsigned char *tables,
+				    const unsigned char *src,
+				    unsigned char *dst,
+				    int nbytes, int add)
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,85 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "arch/intel.h"
+#include "arch/neon.h"
+#include "arch/probe.h"
+#include "galois_simd.h"
+
+galois_w08_simd_func_t galois_w08_simd = NULL;
+static const char *galois_w08_simd_name = "none";
+
+struct galois_w08_kernel {
+  const char *name;
+  int (*exists)(void);
+  int *cpu;
+  galois_w08_simd_func_t func;
+};
+
+/* in order of preference */
+static const struct galois_w08_kernel kernels[] = {
+  { "avx2", galois_w08_avx2_exists, &ceph_arch_intel_avx2,
+    galois_w08_region_multiply_avx2 },
+  { "ssse3", galois_w08_ssse3_exists, &ceph_arch_intel_ssse3,
+    galois_w08_region_multiply_ssse3 },
+  { "neon", galois_w08_neon_exists, &ceph_arch_neon,
+    galois_w08_region_multiply_neon },
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static int usable(const struct galois_w08_kernel *k)
+{
+  return k->exists() && *k->cpu;
+}
+
+int galois_w08_simd_select(const char *name)
+{
+  unsigned i;
+
+  ceph_arch_probe();
+  if (strcmp(name, "none") == 0) {
+    galois_w08_simd = NULL;
+    galois_w08_simd_name = "none";
+    return 0;
+  }
+  if (strcmp(name, "auto") == 0) {
+    galois_w08_simd = NULL;
+    galois_w08_simd_name = "none";
+    for (i = 0; i < NUM_KERNELS; i++) {
+      if (usable(&kernels[i])) {
+	galois_w08_simd = kernels[i].func;
+	galois_w08_simd_name = kernels[i].name;
+	break;
+      }
+    }
+    return 0;
+  }
+  for (i = 0; i < NUM_KERNELS; i++) {
+    if (strcmp(name, kernels[i].name) == 0) {
+      if (!usable(&kernels[i]))
+	return -EOPNOTSUPP;
+      galois_w08_simd = kernels[i].func;
+      galois_w08_simd_name = kernels[i].name;
+      return 0;
+    }
+  }
+  return -ENOENT;
+}
+
+const char *galois_w08_simd_selected(void)
+{
+  return galois_w08_simd_name;
+}
@@ -0,0 +1,75 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_GALOIS_SIMD_H
+#define CEPH_GALOIS_SIMD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Vectorized GF(2^8) region multiply.
+ *
+ * Multiplying by a constant c is linear over GF(2), so c*x is
+ * c*(x & 0x0f) ^ c*(x & 0xf0): two 16 entry tables, which fit a vector
+ * register and are looked up with a byte shuffle.  tables holds
+ * c*0 .. c*15 followed by c*0x00, c*0x10 .. c*0xf0.
+ *
+ * A kernel handles the longest prefix of src that is a whole number of
+ * vectors, writing (or, if add, xoring) the products to dst, which may
+ * be src.  It returns the number of bytes done; the caller does the
+ * rest.
+ */
+typedef int (*galois_w08_simd_func_t)(const unsigned char *tables,
+				      const unsigned char *src,
+				      unsigned char *dst,
+				      int nbytes, int add);
+
+extern int galois_w08_ssse3_exists(void);
+extern int galois_w08_region_multiply_ssse3(const unsigned char *tables,
+					    const unsigned char *src,
+					    unsigned char *dst,
+					    int nbytes, int add);
+
+extern int galois_w08_avx2_exists(void);
+extern int galois_w08_region_multiply_avx2(const unsigned char *tables,
+					   const unsigned char *src,
+					   unsigned char *dst,
+					   int nbytes, int add);
+
+extern int galois_w08_neon_exists(void);
+extern int galois_w08_region_multiply_neon(const unsigned char *tables,
+					   const unsigned char *src,
+					   unsigned char *dst,
+					   int nbytes, int add);
+
+/* the kernel galois_w08_region_multiply() uses; NULL for none */
+extern galois_w08_simd_func_t galois_w08_simd;
+
+/*
+ * Pick the kernel by name: "auto" for the best one this build and cpu
+ * support, "none" for the plain table lookup, or one of "ssse3", "avx2"
+ * or "neon".  Returns 0, -ENOENT for an unknown name or -EOPNOTSUPP if
+ * the kernel wasn't built or the cpu lacks the instructions.  This is
+ * process wide and must not race with encoding.
+ */
+extern int galois_w08_simd_select(const char *name);
+
+/* the name of the kernel in use */
+extern const char *galois_w08_simd_selected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "galois_simd.h"
+
+#ifdef __SSSE3__
+
+#include <tmmintrin.h>
+
+int galois_w08_ssse3_exists(void)
+{
+  return 1;
+}
+
+int galois_w08_region_multiply_ssse3(const unsigned char *tables,
+				     const unsigned char *src,
+				     unsigned char *dst,
+				     int nbytes, int add)
+{
+  const __m128i lo = _mm_loadu_si128((const __m128i *)tables);
+  const __m128i hi = _mm_loadu_si128((const __m128i *)(tables + 16));
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  int i;
+
+  for (i = 0; i + 16 <= nbytes; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i l = _mm_and_si128(x, mask);
+    __m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+    __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, l),
+			      _mm_shuffle_epi8(hi, h));
+    if (add)
+      p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i *)(dst + i)));
+    _mm_storeu_si128((__m128i *)(dst + i), p);
+  }
+  return i;
+}
+
+#else
+
+int galois_w08_ssse3_exists(void)
+{
+  return 0;
+}
+
+int galois_w08_region_multiply_ssse3(const unsigned char *tables,
+				     const unsigned char *src,
+				     unsigned char *dst,
+				     int nbytes, int add)
+{
+  return 0;
+}
+
+#endif
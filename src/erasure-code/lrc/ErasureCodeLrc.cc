@@ -0,0 +1,363 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <errno.h>
+#include <algorithm>
+
+#include "common/debug.h"
+#include "common/strtol.h"
+#include "include/stringify.h"
+#include "erasure-code/ErasureCodePlugin.h"
+#include "ErasureCodeLrc.h"
+
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix _prefix(_dout)
+
+static ostream& _prefix(std::ostream* _dout)
+{
+  return *_dout << "ErasureCodeLrc: ";
+}
+
+int ErasureCodeLrc::create_ruleset(const string &name,
+				   CrushWrapper &crush,
+				   ostream *ss) const
+{
+  return global->create_ruleset(name, crush, ss);
+}
+
+int ErasureCodeLrc::init(const map<std::string,std::string> &parameters)
+{
+  k = to_int("erasure-code-k", parameters, DEFAULT_K);
+  m = to_int("erasure-code-m", parameters, DEFAULT_M);
+  l = to_int("erasure-code-l", parameters, DEFAULT_L);
+  if (k < 1 || m < 1) {
+    derr << "k=" << k << " and m=" << m << " must be positive" << dendl;
+    return -EINVAL;
+  }
+  if (l < 1 || l > k) {
+    derr << "l=" << l << " must be in [1," << k << "]" << dendl;
+    return -EINVAL;
+  }
+
+  map<std::string,std::string> global_parameters = parameters;
+  std::string plugin = "jerasure";
+  map<std::string,std::string>::const_iterator p =
+    parameters.find("erasure-code-lrc-plugin");
+  if (p != parameters.end() && p->second.size())
+    plugin = p->second;
+  global_parameters.erase("erasure-code-lrc-plugin");
+  global_parameters.erase("erasure-code-l");
+  global_parameters["erasure-code-k"] = stringify(k);
+  global_parameters["erasure-code-m"] = stringify(m);
+  if (plugin == "jerasure" &&
+      global_parameters.count("erasure-code-technique") == 0)
+    global_parameters["erasure-code-technique"] = "reed_sol_van";
+
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  int r = instance.factory(plugin, global_parameters, &global);
+  if (r) {
+    derr << "global code plugin " << plugin << " failed: " << r << dendl;
+    return r;
+  }
+  if (global->get_data_chunk_count() != (unsigned)k ||
+      global->get_chunk_count() != (unsigned)(k + m)) {
+    derr << "global code plugin " << plugin << " has "
+	 << global->get_data_chunk_count() << "+"
+	 << global->get_chunk_count() - global->get_data_chunk_count()
+	 << " chunks instead of " << k << "+" << m << dendl;
+    return -EINVAL;
+  }
+  dout(10) << "k=" << k << " m=" << m << " l=" << l
+	   << " groups=" << get_local_group_count()
+	   << " plugin=" << plugin << dendl;
+  return 0;
+}
+
+unsigned int ErasureCodeLrc::get_chunk_size(unsigned int object_size) const
+{
+  return global->get_chunk_size(object_size);
+}
+
+int ErasureCodeLrc::get_local_group(int chunk) const
+{
+  if (chunk < k)
+    return chunk / l;
+  if (chunk < k + m)
+    return -1;
+  return chunk - k - m;
+}
+
+void ErasureCodeLrc::get_local_group_chunks(int group, set<int> *chunks) const
+{
+  for (int i = group * l; i < std::min(k, (group + 1) * l); i++)
+    chunks->insert(i);
+  chunks->insert(k + m + group);
+}
+
+int ErasureCodeLrc::minimum_to_decode(const set<int> &want_to_read,
+				      const set<int> &available_chunks,
+				      set<int> *minimum)
+{
+  map<int, int> available;
+  for (set<int>::const_iterator i = available_chunks.begin();
+       i != available_chunks.end();
+       ++i)
+    available[*i] = 1;
+  return minimum_to_decode_with_cost(want_to_read, available, minimum);
+}
+
+int ErasureCodeLrc::minimum_to_decode_with_cost(const set<int> &want_to_read,
+						const map<int, int> &available,
+						set<int> *minimum)
+{
+  set<int> missing;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    if (available.count(*i))
+      minimum->insert(*i);
+    else
+      missing.insert(*i);
+  }
+  if (missing.empty())
+    return 0;
+
+  // the chunks that are alone missing from their group, and what it
+  // takes to rebuild them. The global code can use the data chunks
+  // among them, for the price of reading the rest of their group.
+  map<int, set<int> > repairable;
+  map<int, int> global_available;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i)
+    if (i->first < k + m)
+      global_available.insert(*i);
+  for (unsigned group = 0; group < get_local_group_count(); group++) {
+    set<int> chunks;
+    get_local_group_chunks(group, &chunks);
+    set<int> rest;
+    int lost = -1, cost = 0;
+    for (set<int>::iterator i = chunks.begin(); i != chunks.end(); ++i) {
+      map<int, int>::const_iterator a = available.find(*i);
+      if (a != available.end()) {
+	rest.insert(*i);
+	cost += a->second;
+      } else if (lost == -1) {
+	lost = *i;
+      } else {
+	lost = -2;
+      }
+    }
+    if (lost >= 0) {
+      repairable[lost] = rest;
+      if (lost < k)
+	global_available[lost] = cost;
+    }
+  }
+
+  set<int> global_want;
+  for (set<int>::iterator i = missing.begin(); i != missing.end(); ++i) {
+    if (repairable.count(*i)) {
+      minimum->insert(repairable[*i].begin(), repairable[*i].end());
+    } else if (*i < k + m) {
+      global_want.insert(*i);
+    } else {
+      // a local parity is the xor of the data chunks of its group
+      set<int> chunks;
+      get_local_group_chunks(get_local_group(*i), &chunks);
+      chunks.erase(*i);
+      for (set<int>::iterator j = chunks.begin(); j != chunks.end(); ++j) {
+	if (available.count(*j))
+	  minimum->insert(*j);
+	else
+	  global_want.insert(*j);
+      }
+    }
+  }
+  if (global_want.empty())
+    return 0;
+
+  set<int> global_minimum;
+  int r = global->minimum_to_decode_with_cost(global_want, global_available,
+					      &global_minimum);
+  if (r)
+    return r;
+  for (set<int>::iterator i = global_minimum.begin();
+       i != global_minimum.end();
+       ++i) {
+    if (available.count(*i))
+      minimum->insert(*i);
+    else
+      minimum->insert(repairable[*i].begin(), repairable[*i].end());
+  }
+  return 0;
+}
+
+int ErasureCodeLrc::encode(const set<int> &want_to_encode,
+			   const bufferlist &in,
+			   map<int, bufferlist> *encoded)
+{
+  set<int> global_want;
+  for (int i = 0; i < k + m; i++)
+    global_want.insert(i);
+  int r = global->encode(global_want, in, encoded);
+  if (r)
+    return r;
+  unsigned blocksize = (*encoded)[0].length();
+  for (unsigned group = 0; group < get_local_group_count(); group++) {
+    r = local_rebuild(group, *encoded, blocksize);
+    if (r < 0)
+      return r;
+  }
+  for (unsigned i = 0; i < get_chunk_count(); i++) {
+    if (want_to_encode.count(i) == 0)
+      encoded->erase(i);
+  }
+  return 0;
+}
+
+int ErasureCodeLrc::decode(const set<int> &want_to_read,
+			   const map<int, bufferlist> &chunks,
+			   map<int, bufferlist> *decoded)
+{
+  set<int> have;
+  for (map<int, bufferlist>::const_iterator i = chunks.begin();
+       i != chunks.end();
+       ++i)
+    have.insert(i->first);
+  if (includes(have.begin(), have.end(),
+	       want_to_read.begin(), want_to_read.end())) {
+    for (set<int>::iterator i = want_to_read.begin();
+	 i != want_to_read.end();
+	 ++i)
+      (*decoded)[*i] = chunks.find(*i)->second;
+    return 0;
+  }
+
+  map<int, bufferlist> all(chunks);
+  unsigned blocksize = chunks.begin()->second.length();
+
+  // first whatever the local groups can do on their own
+  for (set<int>::iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i)
+    if (!all.count(*i) && *i < k)
+      local_rebuild(get_local_group(*i), all, blocksize);
+
+  set<int> global_want;
+  for (set<int>::iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    if (all.count(*i))
+      continue;
+    if (*i < k + m) {
+      global_want.insert(*i);
+    } else {
+      set<int> group;
+      get_local_group_chunks(get_local_group(*i), &group);
+      for (set<int>::iterator j = group.begin(); j != group.end(); ++j)
+	if (*j < k && !all.count(*j))
+	  global_want.insert(*j);
+    }
+  }
+
+  if (!global_want.empty()) {
+    // hand the global code every data chunk a group can rebuild
+    for (unsigned group = 0; group < get_local_group_count(); group++)
+      local_rebuild(group, all, blocksize);
+    map<int, bufferlist> global_chunks;
+    for (map<int, bufferlist>::iterator i = all.begin(); i != all.end(); ++i)
+      if (i->first < k + m)
+	global_chunks.insert(*i);
+    map<int, bufferlist> global_decoded;
+    int r = global->decode(global_want, global_chunks, &global_decoded);
+    if (r)
+      return r;
+    for (map<int, bufferlist>::iterator i = global_decoded.begin();
+	 i != global_decoded.end();
+	 ++i)
+      all.insert(*i);
+  }
+
+  for (set<int>::iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    if (!all.count(*i) && *i >= k + m)
+      local_rebuild(get_local_group(*i), all, blocksize);
+    if (!all.count(*i))
+      return -EIO;
+    (*decoded)[*i] = all[*i];
+  }
+  return 0;
+}
+
+/*
+ * If exactly one chunk of **group** is missing from **chunks**,
+ * compute it as the xor of the others and return its index.
+ */
+int ErasureCodeLrc::local_rebuild(int group, map<int, bufferlist> &chunks,
+				  unsigned blocksize) const
+{
+  set<int> members;
+  get_local_group_chunks(group, &members);
+  int lost = -1;
+  for (set<int>::iterator i = members.begin(); i != members.end(); ++i) {
+    if (chunks.count(*i))
+      continue;
+    if (lost != -1)
+      return -EIO;
+    lost = *i;
+  }
+  if (lost == -1)
+    return -ENOENT;
+
+  bufferptr parity(buffer::create_page_aligned(blocksize));
+  parity.zero();
+  char *p = parity.c_str();
+  for (set<int>::iterator i = members.begin(); i != members.end(); ++i) {
+    if (*i == lost)
+      continue;
+    bufferlist &chunk = chunks[*i];
+    assert(chunk.length() == blocksize);
+    const char *c = chunk.c_str();
+    unsigned j = 0;
+    if (((uintptr_t)c & (sizeof(uint64_t) - 1)) == 0)
+      for (; j + sizeof(uint64_t) <= blocksize; j += sizeof(uint64_t))
+	*(uint64_t*)(p + j) ^= *(const uint64_t*)(c + j);
+    for (; j < blocksize; j++)
+      p[j] ^= c[j];
+  }
+  chunks[lost].push_back(parity);
+  return lost;
+}
+
+int ErasureCodeLrc::to_int(const std::string &name,
+			   const map<std::string,std::string> &parameters,
+			   int default_value)
+{
+  map<std::string,std::string>::const_iterator p = parameters.find(name);
+  if (p == parameters.end() || p->second.size() == 0) {
+    dout(10) << name << " defaults to " << default_value << dendl;
+    return default_value;
+  }
+  std::string err;
+  int r = strict_strtol(p->second.c_str(), 10, &err);
+  if (!err.empty()) {
+    derr << "could not convert " << name << "=" << p->second
+	 << " to int because " << err
+	 << ", set to default " << default_value << dendl;
+    return default_value;
+  }
+  dout(10) << name << " set to " << r << dendl;
+  return r;
+}
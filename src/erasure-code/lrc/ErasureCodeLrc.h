@@ -0,0 +1,109 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_LRC_H
+#define CEPH_ERASURE_CODE_LRC_H
+
+#include "erasure-code/ErasureCodeInterface.h"
+
+/**
+ * A locally repairable code layered over another erasure code.
+ *
+ * The **k** data chunks and **m** global parity chunks are those of
+ * the global code, by default jerasure reed_sol_van. The data chunks
+ * are also split in groups of **l** and each group gets an xor
+ * parity chunk, so there are k + m + ceil(k / l) chunks in all:
+ *
+ *     0 .. k-1             data
+ *     k .. k+m-1           global parity
+ *     k+m .. k+m+groups-1  local parity of group 0, 1, ...
+ *
+ * A chunk that is the only one missing from its group is rebuilt from
+ * the l others of that group instead of k chunks. Anything else goes
+ * through the global code, which also sees the chunks the local
+ * groups can rebuild, so some patterns of more than m erasures can
+ * still be decoded.
+ */
+class ErasureCodeLrc : public ErasureCodeInterface {
+public:
+  static const int DEFAULT_K = 4;
+  static const int DEFAULT_M = 2;
+  static const int DEFAULT_L = 2;
+
+  int k;
+  int m;
+  int l;
+  ErasureCodeInterfaceRef global;
+
+  ErasureCodeLrc() : k(0), m(0), l(0) {}
+  virtual ~ErasureCodeLrc() {}
+
+  virtual int create_ruleset(const string &name,
+			     CrushWrapper &crush,
+			     ostream *ss) const;
+
+  virtual unsigned int get_chunk_count() const {
+    return k + m + get_local_group_count();
+  }
+
+  virtual unsigned int get_data_chunk_count() const {
+    return k;
+  }
+
+  virtual unsigned int get_chunk_size(unsigned int object_size) const;
+
+  virtual int minimum_to_decode(const set<int> &want_to_read,
+                                const set<int> &available_chunks,
+                                set<int> *minimum);
+
+  virtual int minimum_to_decode_with_cost(const set<int> &want_to_read,
+                                          const map<int, int> &available,
+                                          set<int> *minimum);
+
+  virtual int encode(const set<int> &want_to_encode,
+                     const bufferlist &in,
+                     map<int, bufferlist> *encoded);
+
+  virtual int decode(const set<int> &want_to_read,
+                     const map<int, bufferlist> &chunks,
+                     map<int, bufferlist> *decoded);
+
+  /**
+   * Parse **parameters** and instantiate the global code.
+   *
+   * erasure-code-l is the number of data chunks in a local group and
+   * erasure-code-lrc-plugin the plugin of the global code, which gets
+   * all the other parameters.
+   *
+   * @return **0** on success or a negative errno on error.
+   */
+  int init(const map<std::string,std::string> &parameters);
+
+  unsigned get_local_group_count() const {
+    return l ? (k + l - 1) / l : 0;
+  }
+
+  /// the local group of **chunk**, or -1 for a global parity chunk
+  int get_local_group(int chunk) const;
+
+  /// the data chunks of local **group** and its parity chunk
+  void get_local_group_chunks(int group, set<int> *chunks) const;
+
+private:
+  static int to_int(const std::string &name,
+                    const map<std::string,std::string> &parameters,
+                    int default_value);
+  int local_rebuild(int group, map<int, bufferlist> &chunks,
+		    unsigned blocksize) const;
+};
+
+#endif
@@ -21,6 +21,76 @@
 #endif
 
 #include <stdlib.h>
+#include "include/Spinlock.h"
+
+namespace ceph {
+  /**
+   * atomic integer of any width, implemented with a pthreads spinlock.
+   * Used where the libatomic_ops word is too narrow.
+   */
+  template <class T>
+  class atomic_spinlock_t {
+    mutable ceph_spinlock_t lock;
+    T val;
+  public:
+    atomic_spinlock_t(T i=0)
+      : val(i) {
+      ceph_spin_init(&lock);
+    }
+    ~atomic_spinlock_t() {
+      ceph_spin_destroy(&lock);
+    }
+    void set(T v) {
+      ceph_spin_lock(&lock);
+      val = v;
+      ceph_spin_unlock(&lock);
+    }
+    T inc() {
+      ceph_spin_lock(&lock);
+      T r = ++val;
+      ceph_spin_unlock(&lock);
+      return r;
+    }
+    T dec() {
+      ceph_spin_lock(&lock);
+      T r = --val;
+      ceph_spin_unlock(&lock);
+      return r;
+    }
+    void add(T d) {
+      ceph_spin_lock(&lock);
+      val += d;
+      ceph_spin_unlock(&lock);
+    }
+    void sub(T d) {
+      ceph_spin_lock(&lock);
+      val -= d;
+      ceph_spin_unlock(&lock);
+    }
+    T read() const {
+      T ret;
+      ceph_spin_lock(&lock);
+      ret = val;
+      ceph_spin_unlock(&lock);
+      return ret;
+    }
+    /// set to n if it is o; true if it was
+    bool compare_and_swap(T o, T n) {
+      bool ret = false;
+      ceph_spin_lock(&lock);
+      if (val == o) {
+	val = n;
+	ret = true;
+      }
+      ceph_spin_unlock(&lock);
+      return ret;
+    }
+  private:
+    // forbid copying
+    atomic_spinlock_t(const atomic_spinlock_t<T> &other);
+    atomic_spinlock_t &operator=(const atomic_spinlock_t<T> &rhs);
+  };
+}
 
 #ifndef NO_ATOMIC_OPS
 
@@ -57,17 +127,26 @@ namespace ceph {
       // at some point.  this hack can go away someday...
       return AO_load_full((AO_t *)&val);
     }
+    /// set to n if it is o; true if it was
+    bool compare_and_swap(AO_t o, AO_t n) {
+      return AO_compare_and_swap_full(&val, o, n);
+    }
   private:
     // forbid copying
     atomic_t(const atomic_t &other);
     atomic_t &operator=(const atomic_t &rhs);
   };
+
+#if SIZEOF_AO_T == 8
+  typedef atomic_t atomic64_t;
+#else
+  typedef atomic_spinlock_t<unsigned long long> atomic64_t;
+#endif
 }
 #else
 /*
  * crappy slow implementation that uses a pthreads spinlock.
  */
-#include "include/Spinlock.h"
 
 namespace ceph {
   class atomic_t {
@@ -115,11 +194,24 @@ namespace ceph {
       ceph_spin_unlock(&lock);
       return ret;
     }
+    /// set to n if it is o; true if it was
+    bool compare_and_swap(signed long o, signed long n) {
+      bool ret = false;
+      ceph_spin_lock(&lock);
+      if (val == o) {
+	val = n;
+	ret = true;
+      }
+      ceph_spin_unlock(&lock);
+      return ret;
+    }
   private:
     // forbid copying
     atomic_t(const atomic_t &other);
     atomic_t &operator=(const atomic_t &rhs);
   };
+
+  typedef atomic_spinlock_t<unsigned long long> atomic64_t;
 }
 #endif
 #endif
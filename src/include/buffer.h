@@ -58,6 +58,8 @@
 
 namespace ceph {
 
+class Formatter;
+
 class buffer {
   /*
    * exceptions
@@ -113,6 +115,16 @@ public:
   /// enable/disable tracking of buffer::ptr::c_str() calls
   static void track_c_str(bool b);
 
+  /// count of multi-segment lists copied to make them contiguous
+  static int get_rebuilds();
+  /// bytes copied by those rebuilds
+  static int get_rebuild_bytes();
+  /// enable/disable tracking of rebuilds
+  static void track_rebuilds(bool b);
+
+  /// dump usage of the small buffer pool
+  static void dump_pool(Formatter *f);
+
 private:
  
   /* hack for memory utilization debugging. */
@@ -130,6 +142,7 @@ private:
   class raw_hack_aligned;
   class raw_char;
   class raw_pipe;
+  class raw_pooled;
 
   friend std::ostream& operator<<(std::ostream& out, const raw &r);
 
@@ -221,6 +234,9 @@ public:
     void zero();
     void zero(unsigned o, unsigned l);
 
+    /// forget cached crcs; call after writing through c_str()
+    void invalidate_crc();
+
   };
 
   friend std::ostream& operator<<(std::ostream& out, const buffer::ptr& bp);
@@ -289,6 +305,19 @@ public:
       iterator& operator++();
       ptr get_current_ptr();
 
+      /// the next len bytes as one ptr, sharing the data if it is contiguous
+      ptr get_contiguous(unsigned len);
+
+      /// point *data at as many of the next want bytes as are contiguous,
+      /// and advance past them; returns how many that was
+      unsigned get_ptr_and_advance(unsigned want, const char **data);
+
+      /// crc32c of the next len bytes, a segment at a time
+      uint32_t crc32c(unsigned len, uint32_t crc);
+
+      /// memcmp the next len bytes against buf
+      int cmp(unsigned len, const char *buf);
+
       // copy data out.
       // note that these all _append_ to dest!
       void copy(unsigned len, char *dest);
@@ -342,6 +371,10 @@ public:
       return _len;
     }
     bool contents_equal(buffer::list& other);
+    bool contents_equal(const char *buf, unsigned len) const;
+
+    /// offset of the first match of needle at or after off, or -1
+    int find(const char *needle, unsigned len, unsigned off=0) const;
 
     bool can_zero_copy() const;
     bool is_page_aligned() const;
@@ -414,6 +447,8 @@ public:
     void append(const list& bl);
     void append(std::istream& in);
     void append_zero(unsigned len);
+    /// make room for len bytes of small appends in one contiguous buffer
+    void reserve(unsigned len);
     
     /*
      * get a char
@@ -437,6 +472,8 @@ public:
     int write_fd(int fd) const;
     int write_fd_zero_copy(int fd) const;
     uint32_t crc32c(uint32_t crc) const;
+    /// forget cached crcs; call after writing through c_str()
+    void invalidate_crc();
   };
 
   /*
@@ -50,6 +50,14 @@
 #define CEPH_FEATURE_MDS_INLINE_DATA     (1ULL<<40)
 #define CEPH_FEATURE_CRUSH_TUNABLES3     (1ULL<<41)
 #define CEPH_FEATURE_OSD_PRIMARY_AFFINITY (1ULL<<41)  /* overlap w/ tunables3 */
+#define CEPH_FEATURE_MSG_COMPRESS  (1ULL<<42)  /* compressed message bodies */
+#define CEPH_FEATURE_CRUSH_V4      (1ULL<<43)  /* straw2 buckets */
+#define CEPH_FEATURE_MDS_CAPS_BATCH (1ULL<<44)  /* MClientCapsBatch */
+#define CEPH_FEATURE_OSDMAP_COMPACT (1ULL<<45)  /* compact pg_temp encoding */
+#define CEPH_FEATURE_OSD_PARTIAL_RECOVERY (1ULL<<46)  /* push only dirty extents */
+#define CEPH_FEATURE_OSD_DATA_DIGEST (1ULL<<47)  /* object_info_t data_digest */
+#define CEPH_FEATURE_OS_COMPACT_TRANSACTION (1ULL<<48)  /* Transaction v8 */
+#define CEPH_FEATURE_OSD_BACKFILL_PREEMPT (1ULL<<49)  /* MBackfillReserve REVOKE/RELEASE */
 
 /*
  * The introduction of CEPH_FEATURE_OSD_SNAPMAPPER caused the feature
@@ -120,6 +128,14 @@ static inline unsigned long long ceph_sanitize_features(unsigned long long f) {
 	 CEPH_FEATURE_MDS_INLINE_DATA |	    \
 	 CEPH_FEATURE_CRUSH_TUNABLES3 |	    \
 	 CEPH_FEATURE_OSD_PRIMARY_AFFINITY |	\
+	 CEPH_FEATURE_MSG_COMPRESS |	    \
+	 CEPH_FEATURE_CRUSH_V4 |	    \
+	 CEPH_FEATURE_MDS_CAPS_BATCH |	    \
+	 CEPH_FEATURE_OSDMAP_COMPACT |	    \
+	 CEPH_FEATURE_OSD_PARTIAL_RECOVERY |	\
+	 CEPH_FEATURE_OSD_DATA_DIGEST |	    \
+	 CEPH_FEATURE_OS_COMPACT_TRANSACTION |	\
+	 CEPH_FEATURE_OSD_BACKFILL_PREEMPT |	\
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
@@ -131,6 +147,7 @@ static inline unsigned long long ceph_sanitize_features(unsigned long long f) {
 	(CEPH_FEATURE_CRUSH_TUNABLES |		\
 	 CEPH_FEATURE_CRUSH_TUNABLES2 |		\
 	 CEPH_FEATURE_CRUSH_TUNABLES3 |		\
-	 CEPH_FEATURE_CRUSH_V2)
+	 CEPH_FEATURE_CRUSH_V2 |		\
+	 CEPH_FEATURE_CRUSH_V4)
 
 #endif
@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <sys/statvfs.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -740,6 +741,37 @@ int ceph_read(struct ceph_mount_info *cmount, int fd, char *buf, int64_t size, i
 int ceph_write(struct ceph_mount_info *cmount, int fd, const char *buf, int64_t size,
 	       int64_t offset);
 
+/**
+ * Read data from the file into several buffers.
+ *
+ * @param cmount the ceph mount handle to use for performing the read.
+ * @param fd the file descriptor of the open file to read from.
+ * @param iov the buffers to read data into, filled in order
+ * @param iovcnt the number of buffers in iov
+ * @param offset the offset in the file to read from.  If this value is negative, the
+ *        function reads from the current offset of the file descriptor.
+ * @returns the number of bytes read, or a negative error code on failure.
+ */
+int ceph_preadv(struct ceph_mount_info *cmount, int fd, const struct iovec *iov,
+		int iovcnt, int64_t offset);
+
+/**
+ * Write data from several buffers to a file.
+ *
+ * If the file was opened with O_DIRECT, the data is written straight to
+ * the OSDs rather than through the client's object cache.
+ *
+ * @param cmount the ceph mount handle to use for performing the write.
+ * @param fd the file descriptor of the open file to write to
+ * @param iov the buffers to write, in order
+ * @param iovcnt the number of buffers in iov
+ * @param offset the offset of the file write into.  If this value is negative, the
+ *        function writes to the current offset of the file descriptor.
+ * @returns the number of bytes written, or a negative error code
+ */
+int ceph_pwritev(struct ceph_mount_info *cmount, int fd, const struct iovec *iov,
+		 int iovcnt, int64_t offset);
+
 /**
  * Truncate a file to the given size.
  *
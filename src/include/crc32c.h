@@ -29,4 +29,21 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
 	return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * calculate crc32c of length zero bytes in O(log length) time
+ *
+ * Same result as ceph_crc32c(crc, NULL, length).  This is what lets a
+ * crc computed with one initial value be adjusted to another,
+ *
+ *   crc32c(buf, v') = crc32c(buf, v) ^ crc32c(0*len(buf), v ^ v')
+ *
+ * and the crcs of two adjacent buffers be combined,
+ *
+ *   crc32c(a + b, v) = crc32c(0*len(b), crc32c(a, v)) ^ crc32c(b, 0)
+ *
+ * @param crc initial value
+ * @param length number of zero bytes
+ */
+extern uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length);
+
 #endif
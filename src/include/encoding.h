@@ -18,6 +18,8 @@
 
 #include "include/memory.h"
 
+#include <utility>
+
 #include "byteorder.h"
 #include "buffer.h"
 #include "assert.h"
@@ -43,6 +45,57 @@ using namespace ceph;
  *   ignored when not needed.
  */
 
+// --------------------------------------
+// encoding traits
+
+/**
+ * compile-time facts about a type's encoding
+ *
+ * fixed_size is the number of bytes every value of the type encodes
+ * to, or 0 if that varies.  Containers use it to reserve their whole
+ * encoding up front and to check once, before decoding anything, that
+ * the input is long enough.
+ *
+ * bulk is set if the in-memory representation of the type is exactly
+ * its encoding (no padding, and little-endian if an integer), so that
+ * a contiguous run of them can be copied in or out in one go.
+ *
+ * Types opt in with WRITE_FIXED_ENCODING_TRAITS or
+ * WRITE_BULK_ENCODING_TRAITS next to their encoder.  Neither changes
+ * the encoding itself.
+ */
+template<class T>
+struct encoding_traits {
+  static const unsigned fixed_size = 0;
+  static const bool bulk = false;
+};
+
+#define WRITE_FIXED_ENCODING_TRAITS(type, size)				  template<> struct encoding_traits<type> {				    static const unsigned fixed_size = size;				    static const bool bulk = false;					  };
+
+#ifdef CEPH_LITTLE_ENDIAN
+# define WRITE_BULK_ENCODING_TRAITS(type)				  template<> struct encoding_traits<type> {				    static const unsigned fixed_size = sizeof(type);			    static const bool bulk = true;					  };
+#else
+# define WRITE_BULK_ENCODING_TRAITS(type)				  WRITE_FIXED_ENCODING_TRAITS(type, sizeof(type))
+#endif
+
+template<class A, class B>
+struct encoding_traits<std::pair<A,B> > {
+  static const unsigned fixed_size =
+    (encoding_traits<A>::fixed_size && encoding_traits<B>::fixed_size) ?
+    encoding_traits<A>::fixed_size + encoding_traits<B>::fixed_size : 0;
+  static const bool bulk = false;
+};
+
+/// throw if fewer than n values of T can be left in p
+template<class T>
+inline void decode_check_fixed(__u32 n, bufferlist::iterator& p)
+{
+  if (encoding_traits<T>::fixed_size &&
+      (uint64_t)n * encoding_traits<T>::fixed_size > p.get_remaining())
+    throw buffer::end_of_buffer();
+}
+
+
 // --------------------------------------
 // base types
 
@@ -72,6 +125,22 @@ WRITE_RAW_ENCODER(ceph_le16)
 WRITE_RAW_ENCODER(float)
 WRITE_RAW_ENCODER(double)
 
+// raw encodings are the in-memory representation on any host
+#define WRITE_RAW_ENCODING_TRAITS(type)					\
+  template<> struct encoding_traits<type> {				\
+    static const unsigned fixed_size = sizeof(type);			\
+    static const bool bulk = true;					\
+  };
+
+WRITE_RAW_ENCODING_TRAITS(__u8)
+WRITE_RAW_ENCODING_TRAITS(__s8)
+WRITE_RAW_ENCODING_TRAITS(char)
+WRITE_RAW_ENCODING_TRAITS(ceph_le64)
+WRITE_RAW_ENCODING_TRAITS(ceph_le32)
+WRITE_RAW_ENCODING_TRAITS(ceph_le16)
+WRITE_RAW_ENCODING_TRAITS(float)
+WRITE_RAW_ENCODING_TRAITS(double)
+
 inline void encode(const bool &v, bufferlist& bl) {
   __u8 vv = v;
   encode_raw(vv, bl);
@@ -81,6 +150,7 @@ inline void decode(bool &v, bufferlist::iterator& p) {
   decode_raw(vv, p);
   v = vv;
 }
+WRITE_FIXED_ENCODING_TRAITS(bool, 1)
 
 
 // -----------------------------------
@@ -105,6 +175,13 @@ WRITE_INTTYPE_ENCODER(int32_t, le32)
 WRITE_INTTYPE_ENCODER(uint16_t, le16)
 WRITE_INTTYPE_ENCODER(int16_t, le16)
 
+WRITE_BULK_ENCODING_TRAITS(uint64_t)
+WRITE_BULK_ENCODING_TRAITS(int64_t)
+WRITE_BULK_ENCODING_TRAITS(uint32_t)
+WRITE_BULK_ENCODING_TRAITS(int32_t)
+WRITE_BULK_ENCODING_TRAITS(uint16_t)
+WRITE_BULK_ENCODING_TRAITS(int16_t)
+
 #ifdef ENCODE_DUMP
 # include <stdio.h>
 # include <sys/types.h>
@@ -197,12 +274,20 @@ inline void encode(const char *s, bufferlist& bl)
 template<class A>
 inline void encode_array_nohead(const A a[], int n, bufferlist &bl)
 {
+  if (encoding_traits<A>::bulk) {
+    bl.append((const char*)a, n * sizeof(A));
+    return;
+  }
   for (int i=0; i<n; i++)
     encode(a[i], bl);
 }
 template<class A>
 inline void decode_array_nohead(A a[], int n, bufferlist::iterator &p)
 {
+  if (encoding_traits<A>::bulk) {
+    p.copy(n * sizeof(A), (char*)a);
+    return;
+  }
   for (int i=0; i<n; i++)
     decode(a[i], p);
 }
@@ -431,6 +516,8 @@ template<class T>
 inline void encode(const std::set<T>& s, bufferlist& bl)
 {
   __u32 n = s.size();
+  if (encoding_traits<T>::fixed_size)
+    bl.reserve(sizeof(n) + n * encoding_traits<T>::fixed_size);
   encode(n, bl);
   for (typename std::set<T>::const_iterator p = s.begin(); p != s.end(); ++p)
     encode(*p, bl);
@@ -440,6 +527,7 @@ inline void decode(std::set<T>& s, bufferlist::iterator& p)
 {
   __u32 n;
   decode(n, p);
+  decode_check_fixed<T>(n, p);
   s.clear();
   while (n--) {
     T v;
@@ -472,6 +560,14 @@ template<class T>
 inline void encode(const std::vector<T>& v, bufferlist& bl, uint64_t features)
 {
   __u32 n = v.size();
+  if (encoding_traits<T>::bulk) {
+    encode(n, bl);
+    if (n)
+      bl.append((const char*)&v[0], n * sizeof(T));
+    return;
+  }
+  if (encoding_traits<T>::fixed_size)
+    bl.reserve(sizeof(n) + n * encoding_traits<T>::fixed_size);
   encode(n, bl);
   for (typename std::vector<T>::const_iterator p = v.begin(); p != v.end(); ++p)
     encode(*p, bl, features);
@@ -480,6 +576,14 @@ template<class T>
 inline void encode(const std::vector<T>& v, bufferlist& bl)
 {
   __u32 n = v.size();
+  if (encoding_traits<T>::bulk) {
+    encode(n, bl);
+    if (n)
+      bl.append((const char*)&v[0], n * sizeof(T));
+    return;
+  }
+  if (encoding_traits<T>::fixed_size)
+    bl.reserve(sizeof(n) + n * encoding_traits<T>::fixed_size);
   encode(n, bl);
   for (typename std::vector<T>::const_iterator p = v.begin(); p != v.end(); ++p)
     encode(*p, bl);
@@ -489,7 +593,13 @@ inline void decode(std::vector<T>& v, bufferlist::iterator& p)
 {
   __u32 n;
   decode(n, p);
+  decode_check_fixed<T>(n, p);
   v.resize(n);
+  if (encoding_traits<T>::bulk) {
+    if (n)
+      p.copy(n * sizeof(T), (char*)&v[0]);
+    return;
+  }
   for (__u32 i=0; i<n; i++) 
     decode(v[i], p);
 }
@@ -497,13 +607,26 @@ inline void decode(std::vector<T>& v, bufferlist::iterator& p)
 template<class T>
 inline void encode_nohead(const std::vector<T>& v, bufferlist& bl)
 {
+  if (encoding_traits<T>::bulk) {
+    if (!v.empty())
+      bl.append((const char*)&v[0], v.size() * sizeof(T));
+    return;
+  }
+  if (encoding_traits<T>::fixed_size)
+    bl.reserve(v.size() * encoding_traits<T>::fixed_size);
   for (typename std::vector<T>::const_iterator p = v.begin(); p != v.end(); ++p)
     encode(*p, bl);
 }
 template<class T>
 inline void decode_nohead(int len, std::vector<T>& v, bufferlist::iterator& p)
 {
+  decode_check_fixed<T>(len, p);
   v.resize(len);
+  if (encoding_traits<T>::bulk) {
+    if (len)
+      p.copy(len * sizeof(T), (char*)&v[0]);
+    return;
+  }
   for (__u32 i=0; i<v.size(); i++) 
     decode(v[i], p);
 }
@@ -562,6 +685,8 @@ template<class T, class U>
 inline void encode(const std::map<T,U>& m, bufferlist& bl)
 {
   __u32 n = m.size();
+  if (encoding_traits<std::pair<T,U> >::fixed_size)
+    bl.reserve(sizeof(n) + n * encoding_traits<std::pair<T,U> >::fixed_size);
   encode(n, bl);
   for (typename std::map<T,U>::const_iterator p = m.begin(); p != m.end(); ++p) {
     encode(p->first, bl);
@@ -572,6 +697,8 @@ template<class T, class U>
 inline void encode(const std::map<T,U>& m, bufferlist& bl, uint64_t features)
 {
   __u32 n = m.size();
+  if (encoding_traits<std::pair<T,U> >::fixed_size)
+    bl.reserve(sizeof(n) + n * encoding_traits<std::pair<T,U> >::fixed_size);
   encode(n, bl);
   for (typename std::map<T,U>::const_iterator p = m.begin(); p != m.end(); ++p) {
     encode(p->first, bl, features);
@@ -583,6 +710,7 @@ inline void decode(std::map<T,U>& m, bufferlist::iterator& p)
 {
   __u32 n;
   decode(n, p);
+  decode_check_fixed<std::pair<T,U> >(n, p);
   m.clear();
   while (n--) {
     T k;
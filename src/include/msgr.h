@@ -157,7 +157,7 @@ struct ceph_msg_header {
 
 	/* oldest code we think can decode this.  unknown if zero. */
 	__le16 compat_version;
-	__le16 reserved;
+	__le16 reserved;  /* compression algorithm, with MSG_COMPRESS */
 	__le32 crc;       /* header crc32c */
 } __attribute__ ((packed));
 
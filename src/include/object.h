@@ -122,6 +122,7 @@ struct snapid_t {
 
 inline void encode(snapid_t i, bufferlist &bl) { encode(i.val, bl); }
 inline void decode(snapid_t &i, bufferlist::iterator &p) { decode(i.val, p); }
+WRITE_BULK_ENCODING_TRAITS(snapid_t)
 
 inline ostream& operator<<(ostream& out, snapid_t s) {
   if (s == CEPH_NOSNAP)
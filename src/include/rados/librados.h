@@ -803,6 +803,24 @@ void rados_ioctx_set_namespace(rados_ioctx_t io, const char *nspace);
  */
 int rados_objects_list_open(rados_ioctx_t io, rados_list_ctx_t *ctx);
 
+/**
+ * Start listing one piece of the objects in a pool
+ *
+ * The pool's placement groups are split into num_shards contiguous
+ * ranges, and only the objects in range shard are listed.  Listing
+ * every shard, from as many threads or processes as there are shards,
+ * lists the whole pool once.
+ *
+ * @param io the pool to list from
+ * @param shard which piece to list, less than num_shards
+ * @param num_shards how many pieces to split the pool into
+ * @param ctx the handle to store list context in
+ * @returns 0 on success, negative error code on failure
+ * @returns -EINVAL if shard is not less than num_shards
+ */
+int rados_objects_list_open_shard(rados_ioctx_t io, uint32_t shard,
+                                  uint32_t num_shards, rados_list_ctx_t *ctx);
+
 /**
  * Return hash position of iterator, rounded to the current PG
  *
@@ -1548,6 +1566,76 @@ int rados_aio_get_return_value(rados_completion_t c);
  */
 void rados_aio_release(rados_completion_t c);
 
+/**
+ * @typedef rados_completion_queue_t
+ * A queue that collects completions as they complete, for
+ * applications that would rather poll for finished operations than
+ * be called back from a librados thread.
+ */
+typedef void *rados_completion_queue_t;
+
+/**
+ * Create a completion queue
+ *
+ * @param pcq where to store the queue
+ * @returns 0
+ */
+int rados_aio_create_completion_queue(rados_completion_queue_t *pcq);
+
+/**
+ * Release a completion queue
+ *
+ * Completions still on the queue are dropped. Completions created on
+ * it that have not completed yet remain valid and simply are not
+ * queued anywhere.
+ *
+ * @param cq the queue to release
+ */
+void rados_aio_completion_queue_release(rados_completion_queue_t cq);
+
+/**
+ * Construct a completion that is added to a queue when it completes
+ *
+ * The completion is queued once, when the operation is complete (see
+ * rados_aio_is_complete()). It has no callbacks, but callbacks may
+ * still be set on it.
+ *
+ * @param cq queue to add the completion to
+ * @param pc where to store the completion
+ * @returns 0
+ */
+int rados_aio_create_queued_completion(rados_completion_queue_t cq,
+				       rados_completion_t *pc);
+
+/**
+ * Take completed operations off a queue without blocking
+ *
+ * Completions that were released before being taken off the queue
+ * are skipped. The caller still owns the completions returned and
+ * must release them.
+ *
+ * @param cq queue to poll
+ * @param pc array to store up to max completions in
+ * @param max size of pc
+ * @returns number of completions stored in pc
+ */
+int rados_aio_completion_queue_poll(rados_completion_queue_t cq,
+				    rados_completion_t *pc, int max);
+
+/**
+ * Take completed operations off a queue, blocking until there is one
+ *
+ * Like rados_aio_completion_queue_poll(), but waits until at least
+ * one completion can be returned.
+ *
+ * @param cq queue to wait on
+ * @param pc array to store up to max completions in
+ * @param max size of pc, at least 1
+ * @returns number of completions stored in pc
+ */
+int rados_aio_completion_queue_wait(rados_completion_queue_t cq,
+				    rados_completion_t *pc, int max);
+
 /**
  * Write data to an object asynchronously
  *
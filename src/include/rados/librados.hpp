@@ -19,10 +19,12 @@ namespace librados
   using ceph::bufferlist;
 
   struct AioCompletionImpl;
+  struct AioCompletionQueueImpl;
   class IoCtx;
   struct IoCtxImpl;
   class ObjectOperationImpl;
   struct ObjListCtx;
+  struct OperationBatchImpl;
   struct PoolAsyncCompletionImpl;
   class RadosClient;
 
@@ -78,12 +80,41 @@ namespace librados
     /// move the iterator to a given hash position.  this may (will!) be rounded to the nearest pg.
     uint32_t seek(uint32_t pos);
 
+    /**
+     * get the size and mtime of the current object
+     *
+     * Only available when listing with an ObjectListFilter that has
+     * want_info set.
+     *
+     * @returns 0 on success, -ENODATA if the listing has no info
+     */
+    int get_info(uint64_t *psize, time_t *pmtime) const;
+
   private:
     void get_next();
     ceph::shared_ptr < ObjListCtx > ctx;
     std::pair<std::string, std::string> cur_obj;
   };
 
+  /**
+   * Which objects a filtered listing returns
+   *
+   * The OSDs apply the filter, so objects that do not match never reach
+   * the client.  An object must match every condition.
+   */
+  struct ObjectListFilter {
+    std::string prefix;       ///< name starts with this
+    std::string xattr;        ///< if not empty, xattr must equal xattr_value
+    bufferlist xattr_value;
+    uint64_t min_size;        ///< size must be in [min_size, max_size]
+    uint64_t max_size;
+    time_t min_mtime;         ///< mtime must be in [min_mtime, max_mtime]
+    time_t max_mtime;         ///< 0 for no upper bound
+    bool want_info;           ///< return size and mtime, see ObjectIterator::get_info()
+
+    ObjectListFilter();
+  };
+
   class WatchCtx {
   public:
     virtual ~WatchCtx();
@@ -109,6 +140,27 @@ namespace librados
     AioCompletionImpl *pc;
   };
 
+  /**
+   * completions collected as they complete, to be polled
+   *
+   * See rados_aio_create_completion_queue().
+   */
+  struct AioCompletionQueue {
+    AioCompletionQueue();
+    ~AioCompletionQueue();
+    /// a completion that is queued here when it completes
+    AioCompletion *create_completion();
+    /// take up to max completed operations, without blocking
+    int poll(std::list<AioCompletion*> *ls, int max);
+    /// take up to max completed operations, waiting for at least one
+    int wait(std::list<AioCompletion*> *ls, int max);
+    AioCompletionQueueImpl *pcq;
+  private:
+    AioCompletionQueue(const AioCompletionQueue&);
+    AioCompletionQueue& operator=(const AioCompletionQueue&);
+    int _poll(std::list<AioCompletion*> *ls, int max, bool block);
+  };
+
   struct PoolAsyncCompletion {
     PoolAsyncCompletion(PoolAsyncCompletionImpl *pc_) : pc(pc_) {}
     int set_callback(void *cb_arg, callback_t cb);
@@ -226,6 +278,7 @@ namespace librados
     ObjectOperation(const ObjectOperation& rhs);
     ObjectOperation& operator=(const ObjectOperation& rhs);
     friend class IoCtx;
+    friend class OperationBatch;
     friend class Rados;
   };
 
@@ -463,6 +516,47 @@ namespace librados
     void cache_evict();
   };
 
+  /*
+   * OperationBatch : compound operations on many objects
+   * Queue operations on different objects and submit them all at once
+   * with IoCtx::aio_operate_batch(), which is cheaper than calling
+   * aio_operate() for each of them.  The operations are independent;
+   * they are not applied atomically with each other.
+   */
+  class OperationBatch
+  {
+  public:
+    OperationBatch();
+    ~OperationBatch();
+
+    size_t size();
+
+    /**
+     * queue a write operation
+     *
+     * op is consumed when the batch is submitted, so it must live until
+     * then.  c is completed as it would be by aio_operate(), and may be
+     * NULL if only the completion of the whole batch matters.
+     */
+    void aio_operate(const std::string& oid, AioCompletion *c,
+		     ObjectWriteOperation *op, int flags);
+
+    /**
+     * queue a read operation
+     *
+     * op and pbl must live until the batch is submitted and the read is
+     * complete, respectively.  c may be NULL as for writes.
+     */
+    void aio_operate(const std::string& oid, AioCompletion *c,
+		     ObjectReadOperation *op, int flags, bufferlist *pbl);
+
+  private:
+    OperationBatchImpl *impl;
+    OperationBatch(const OperationBatch& rhs);
+    OperationBatch& operator=(const OperationBatch& rhs);
+    friend class IoCtx;
+  };
+
   /* IoCtx : This is a context in which we can perform I/O.
    * It includes a Pool,
    *
@@ -637,6 +731,16 @@ namespace librados
     ObjectIterator objects_begin();
     /// Start enumerating objects for a pool starting from a hash position
     ObjectIterator objects_begin(uint32_t start_hash_position);
+    /**
+     * Start enumerating the objects in one of num_shards pieces of a pool
+     *
+     * see rados_objects_list_open_shard(); an invalid shard gives an
+     * iterator that is already at the end
+     */
+    ObjectIterator objects_begin_shard(uint32_t shard, uint32_t num_shards);
+    /// Start enumerating the objects matching filter in a shard of a pool
+    ObjectIterator objects_begin(const ObjectListFilter& filter,
+				 uint32_t shard, uint32_t num_shards);
     /// Iterator indicating the end of a pool
     const ObjectIterator& objects_end() const;
 
@@ -791,6 +895,19 @@ namespace librados
 		    ObjectReadOperation *op, int flags,
 		    bufferlist *pbl);
 
+    /**
+     * Submit every operation queued in a batch
+     *
+     * The operations are sent to the OSDs together, grouped by OSD, and
+     * the batch is left empty.  Writes use the IoCtx's snapshot context.
+     *
+     * @param batch operations to submit
+     * @param c completed once every operation in the batch is complete
+     * (writes safe), with the first error if any failed; may be NULL
+     * @returns 0 on success, negative error code on failure
+     */
+    int aio_operate_batch(OperationBatch *batch, AioCompletion *c);
+
     // watch/notify
     int watch(const std::string& o, uint64_t ver, uint64_t *handle,
 	      librados::WatchCtx *ctx);
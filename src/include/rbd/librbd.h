@@ -26,6 +26,7 @@ extern "C" {
 #include <sys/types.h>
 #endif
 #include <string.h>
+#include <sys/uio.h>
 #include "../rados/librados.h"
 #include "features.h"
 
@@ -39,10 +40,15 @@ extern "C" {
 
 #define LIBRBD_SUPPORTS_WATCH 0
 #define LIBRBD_SUPPORTS_AIO_FLUSH 1
+#define LIBRBD_SUPPORTS_IOVEC 1
 
 typedef void *rbd_snap_t;
 typedef void *rbd_image_t;
 
+/**
+ * Progress callback for long-running operations.  Returning a negative
+ * error code stops the operation, which then returns that error.
+ */
 typedef int (*librbd_progress_fn_t)(uint64_t offset, uint64_t total, void *ptr);
 
 typedef struct {
@@ -360,6 +366,37 @@ int rbd_discard(rbd_image_t image, uint64_t ofs, uint64_t len);
 int rbd_aio_write(rbd_image_t image, uint64_t off, size_t len, const char *buf, rbd_completion_t c);
 int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len, char *buf, rbd_completion_t c);
 int rbd_aio_discard(rbd_image_t image, uint64_t off, uint64_t len, rbd_completion_t c);
+/**
+ * Start a write of the data in an array of buffers, in order.
+ *
+ * The buffers are used without copying them if there is no cache and
+ * rbd_disable_zero_copy_writes is off, so they must not change until
+ * the write completes.
+ *
+ * @param image the image to write to
+ * @param iov buffers to write
+ * @param iovcnt number of buffers
+ * @param off where to write in the image
+ * @param c what to call when the write is complete
+ * @returns 0 on success, negative error code on failure
+ */
+int rbd_aio_writev(rbd_image_t image, const struct iovec *iov, int iovcnt,
+		   uint64_t off, rbd_completion_t c);
+/**
+ * Start a read into an array of buffers, filling them in order.
+ *
+ * The data is copied straight from the OSD replies into the buffers,
+ * without an intermediate contiguous buffer.
+ *
+ * @param image the image to read from
+ * @param iov buffers to read into
+ * @param iovcnt number of buffers
+ * @param off where to read from in the image
+ * @param c what to call when the read is complete
+ * @returns 0 on success, negative error code on failure
+ */
+int rbd_aio_readv(rbd_image_t image, const struct iovec *iov, int iovcnt,
+		  uint64_t off, rbd_completion_t c);
 int rbd_aio_create_completion(void *cb_arg, rbd_callback_t complete_cb, rbd_completion_t *c);
 int rbd_aio_is_complete(rbd_completion_t c);
 int rbd_aio_wait_for_complete(rbd_completion_t c);
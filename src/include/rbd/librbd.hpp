@@ -51,6 +51,11 @@ namespace librbd {
   {
   public:
     virtual ~ProgressContext();
+    /**
+     * Called as a long-running operation makes progress.  Returning a
+     * negative error code stops the operation (leaving it partially
+     * done) and makes it return that error.
+     */
     virtual int update_progress(uint64_t offset, uint64_t total) = 0;
   };
 
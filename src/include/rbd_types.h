@@ -24,6 +24,9 @@
 /* New-style rbd image 'foo' consists of objects
  *   rbd_id.foo              - id of image
  *   rbd_header.<id>         - image metadata
+ *   rbd_object_map.<id>     - which data objects exist, if the image
+ *                             has the object map feature; snapshots
+ *                             have their own rbd_object_map.<id>.<snapid>
  *   rbd_data.<id>.00000000
  *   rbd_data.<id>.00000001
  *   ...                     - data
@@ -32,6 +35,7 @@
 #define RBD_HEADER_PREFIX      "rbd_header."
 #define RBD_DATA_PREFIX        "rbd_data."
 #define RBD_ID_PREFIX          "rbd_id."
+#define RBD_OBJECT_MAP_PREFIX  "rbd_object_map."
 
 /*
  * old-style rbd image 'foo' consists of objects
@@ -67,6 +71,9 @@
 #define RBD_MAX_OBJ_NAME_SIZE	96
 #define RBD_MAX_BLOCK_NAME_SIZE 24
 
+#define RBD_OBJECT_NONEXISTENT	0
+#define RBD_OBJECT_EXISTS	1
+
 #define RBD_COMP_NONE		0
 #define RBD_CRYPT_NONE		0
 
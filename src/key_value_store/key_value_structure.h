@@ -124,6 +124,13 @@ public:
    */
   virtual int get(const string &key, bufferlist *val) = 0;
 
+  /**
+   * efficiently gets the values of keys. Keys that do not exist are not put
+   * in out.
+   */
+  virtual int get_many(const std::set<string> &keys,
+      map<string, bufferlist> *out) = 0;
+
   /**
    * stores all keys in keys. set should put them in order by key.
    */
@@ -1814,7 +1814,225 @@ void KvFlatBtreeAsync::aio_get(const string &key, bufferlist *val,
   pthread_detach(t);
 }
 
+int KvFlatBtreeAsync::validate_icache() {
+  uint64_t size;
+  time_t mtime;
+  int err = 0;
+  librados::ObjectReadOperation oro;
+  oro.stat(&size, &mtime, &err);
+  err = io_ctx.operate(index_name, &oro, NULL);
+  if (err < 0) {
+    if (verbose) cout << "\t" << client_name
+	<< "-validate_icache: reading index failed with " << err << std::endl;
+    return err;
+  }
+  uint64_t version = io_ctx.get_last_version();
+  icache_lock.Lock();
+  if (version != icache_version) {
+    if (verbose) cout << "\t" << client_name
+	<< "-validate_icache: index is at " << version << ", cache was at "
+	<< icache_version << ". clearing cache" << std::endl;
+    icache.clear();
+    icache_version = version;
+  }
+  icache_lock.Unlock();
+  return 0;
+}
+
+int KvFlatBtreeAsync::group_by_leaf(const std::set<string> &keys,
+    map<string, std::set<string> > *leaves) {
+  for (std::set<string>::const_iterator it = keys.begin();
+      it != keys.end(); ++it) {
+    index_data idata;
+    int err = read_index(*it, &idata, NULL, false);
+    if (err < 0) {
+      if (verbose) cout << "\t" << client_name
+	  << ": getting oid failed with code " << err << std::endl;
+      return err;
+    }
+    (*leaves)[idata.obj].insert(*it);
+  }
+  return 0;
+}
+
 int KvFlatBtreeAsync::set_many(const map<string, bufferlist> &in_map) {
+  if (verbose) cout << client_name << ": setting " << in_map.size()
+      << " keys" << std::endl;
+  int err = validate_icache();
+  if (err < 0) {
+    return err;
+  }
+
+  std::set<string> keys;
+  for (map<string, bufferlist>::const_iterator it = in_map.begin();
+      it != in_map.end(); ++it) {
+    keys.insert(keys.end(), it->first);
+  }
+  map<string, std::set<string> > leaves;
+  err = group_by_leaf(keys, &leaves);
+  if (err < 0) {
+    return err;
+  }
+
+  //split each object's keys into groups of at most k
+  map<string, list<map<string, bufferlist> > > pending;
+  for (map<string, std::set<string> >::iterator lit = leaves.begin();
+      lit != leaves.end(); ++lit) {
+    list<map<string, bufferlist> > &groups = pending[lit->first];
+    for (std::set<string>::iterator kit = lit->second.begin();
+	kit != lit->second.end(); ++kit) {
+      if (groups.empty() || (int)groups.back().size() == k) {
+	groups.push_back(map<string, bufferlist>());
+      }
+      groups.back()[*kit] = in_map.find(*kit)->second;
+    }
+  }
+
+  //one group per object in flight, so that two groups never race for the
+  //room left in an object
+  map<string, bufferlist> rejected;
+  while (!pending.empty()) {
+    if ((((KeyValueStructure *)this)->*KvFlatBtreeAsync::interrupt)() == 1 ) {
+      if (verbose) cout << client_name << " IS SUICIDING!" << std::endl;
+      return -ESUICIDE;
+    }
+    vector<string> objs;
+    vector<librados::AioCompletion *> comps;
+    for (map<string, list<map<string, bufferlist> > >::iterator pit =
+	  pending.begin();
+	pit != pending.end() && comps.size() < MAX_LEAF_OPS; ++pit) {
+      const map<string, bufferlist> &group = pit->second.front();
+      bufferlist inbl;
+      omap_set_args args;
+      //only accept the group if the object stays within 2k
+      args.bound = 2 * k - group.size() + 1;
+      args.exclusive = false;
+      args.omap = group;
+      args.encode(inbl);
+      librados::ObjectWriteOperation owo;
+      owo.exec("kvs", "omap_insert", inbl);
+      librados::AioCompletion *c = rados.aio_create_completion();
+      io_ctx.aio_operate(pit->first, c, &owo);
+      objs.push_back(pit->first);
+      comps.push_back(c);
+    }
+    for (unsigned i = 0; i < comps.size(); i++) {
+      comps[i]->wait_for_safe();
+      int r = comps[i]->get_return_value();
+      comps[i]->release();
+      list<map<string, bufferlist> > &groups = pending[objs[i]];
+      if (r < 0) {
+	if (verbose) cout << "\t" << client_name << ": inserting into "
+	    << objs[i] << " failed with " << r << std::endl;
+	//full or changed: the rest of its keys go the slow way
+	for (list<map<string, bufferlist> >::iterator git = groups.begin();
+	    git != groups.end(); ++git) {
+	  rejected.insert(git->begin(), git->end());
+	}
+	groups.clear();
+      } else {
+	groups.pop_front();
+      }
+      if (groups.empty()) {
+	pending.erase(objs[i]);
+      }
+    }
+  }
+
+  if (rejected.empty()) {
+    return 0;
+  }
+  if (verbose) cout << "\t" << client_name << ": " << rejected.size()
+      << " keys did not fit" << std::endl;
+  if ((int)rejected.size() > k) {
+    return rewrite_many(rejected);
+  }
+  for (map<string, bufferlist>::iterator it = rejected.begin();
+      it != rejected.end(); ++it) {
+    err = set(it->first, it->second, true);
+    if (err < 0) {
+      return err;
+    }
+  }
+  return 0;
+}
+
+int KvFlatBtreeAsync::get_many(const std::set<string> &keys,
+    map<string, bufferlist> *out) {
+  opmap['g'] += keys.size();
+  if (verbose) cout << client_name << ": getting " << keys.size()
+      << " keys" << std::endl;
+  if ((((KeyValueStructure *)this)->*KvFlatBtreeAsync::interrupt)() == 1 ) {
+    return -ESUICIDE;
+  }
+  int err = validate_icache();
+  if (err < 0) {
+    return err;
+  }
+  map<string, std::set<string> > leaves;
+  err = group_by_leaf(keys, &leaves);
+  if (err < 0) {
+    return err;
+  }
+
+  std::set<string> retry;
+  map<string, std::set<string> >::iterator lit = leaves.begin();
+  while (lit != leaves.end()) {
+    vector<map<string, std::set<string> >::iterator> objs;
+    vector<librados::ObjectReadOperation *> ops;
+    vector<map<string, bufferlist> > vals;
+    vector<int> rvals;
+    vector<librados::AioCompletion *> comps;
+    for (; lit != leaves.end() && comps.size() < MAX_LEAF_OPS; ++lit) {
+      objs.push_back(lit);
+      ops.push_back(new librados::ObjectReadOperation);
+      comps.push_back(rados.aio_create_completion());
+    }
+    //the vectors the ops write into are not resized from here on
+    vals.resize(ops.size());
+    rvals.resize(ops.size());
+    for (unsigned i = 0; i < ops.size(); i++) {
+      ops[i]->omap_get_vals_by_keys(objs[i]->second, &vals[i], &rvals[i]);
+      io_ctx.aio_operate(objs[i]->first, comps[i], ops[i], NULL);
+    }
+    for (unsigned i = 0; i < ops.size(); i++) {
+      comps[i]->wait_for_complete();
+      int r = comps[i]->get_return_value();
+      comps[i]->release();
+      delete ops[i];
+      if (r == -ENOENT) {
+	//the object was split or merged away
+	if (verbose) cout << "\t" << client_name << ": " << objs[i]->first
+	    << " is gone" << std::endl;
+	retry.insert(objs[i]->second.begin(), objs[i]->second.end());
+      } else if (r < 0) {
+	if (verbose) cout << client_name
+	    << ": get_many encountered an unexpected error: " << r
+	    << std::endl;
+	err = r;
+      } else {
+	out->insert(vals[i].begin(), vals[i].end());
+      }
+    }
+  }
+  if (err < 0) {
+    return err;
+  }
+
+  for (std::set<string>::iterator it = retry.begin(); it != retry.end(); ++it) {
+    bufferlist val;
+    err = get(*it, &val);
+    if (err < 0) {
+      return err;
+    }
+    if (val.length() > 0) {
+      (*out)[*it] = val;
+    }
+  }
+  return 0;
+}
+
+int KvFlatBtreeAsync::rewrite_many(const map<string, bufferlist> &in_map) {
   int err = 0;
   bufferlist inbl;
   bufferlist outbl;
@@ -1865,7 +2083,7 @@ int KvFlatBtreeAsync::set_many(const map<string, bufferlist> &in_map) {
     if (err < 0) {
       if (verbose) cout << "reading " << idata.obj << " failed with " << err
 	  << std::endl;
-      return set_many(in_map);
+      return rewrite_many(in_map);
     }
 
     big_map.insert(to_delete[to_delete.size() - 1].omap.begin(),
@@ -1919,9 +2137,9 @@ int KvFlatBtreeAsync::set_many(const map<string, bufferlist> &in_map) {
 
   /////BEGIN CRITICAL SECTION/////
   //put prefix on index entry for idata.val
-  err = perform_ops("\t\t" + client_name + "-set_many:", idata, &ops);
+  err = perform_ops("\t\t" + client_name + "-rewrite_many:", idata, &ops);
   if (err < 0) {
-    return set_many(in_map);
+    return rewrite_many(in_map);
   }
   if (verbose) cout << "\t\t" << client_name << "-split: done splitting."
       << std::endl;
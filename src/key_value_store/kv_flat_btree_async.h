@@ -18,6 +18,9 @@
 #define EPREFIX 136
 #define EFIRSTOBJ 138
 
+//number of object ops set_many and get_many keep in flight
+#define MAX_LEAF_OPS 64
+
 #include "key_value_store/key_value_structure.h"
 #include "include/utime.h"
 #include "include/types.h"
@@ -508,6 +511,7 @@ protected:
   int client_index; //names of new objects are client_name.client_index
   Mutex icache_lock;
   IndexCache icache;
+  uint64_t icache_version; //version of the index object icache was read at
   friend struct index_data;
 
   /**
@@ -714,6 +718,28 @@ protected:
    */
   int get_op(const string &key, bufferlist * val, index_data &idata);
 
+  /**
+   * clears the cache if the index object changed since the last time this
+   * was called. Other threads sharing io_ctx may make this compare the wrong
+   * version, which only costs a stale entry that the object ops detect.
+   */
+  int validate_icache();
+
+  /**
+   * finds the object each of keys belongs in, from cache if possible.
+   *
+   * @param leaves: maps object names to the keys that go in them
+   */
+  int group_by_leaf(const std::set<string> &keys,
+      map<string, std::set<string> > *leaves);
+
+  /**
+   * the set_many of old: reads every object holding any of the keys,
+   * rewrites them with in_map merged in, and swaps them in the index.
+   * See set_many for when this is safe.
+   */
+  int rewrite_many(const map<string, bufferlist> &in_map);
+
   /**
    * does the ObjectWriteOperation and splits, reads the index, and/or retries
    * until success.
@@ -759,7 +785,8 @@ KvFlatBtreeAsync(int k_val, string name, int cache, double cache_r,
     client_index_lock("client_index_lock"),
     client_index(0),
     icache_lock("icache_lock"),
-    icache(cache)
+    icache(cache),
+    icache_version(0)
   {}
 
   /**
@@ -853,29 +880,27 @@ KvFlatBtreeAsync(int k_val, string name, int cache, double cache_r,
   int remove_all();
 
   /**
-   * This does not add prefixes to the index and therefore DOES NOT guarantee
-   * consistency! It is ONLY safe if there is only one instance at a time.
-   * It follows the same general logic as a rebalance, but
-   * with all objects that contain any of the keys in in_map. It is O(n), where
-   * n is the number of librados objects it has to change. Higher object sizes
-   * (i.e., k values) also decrease the efficiency of this method because it
-   * copies all of the entries in each object it modifies. Writing new objects
-   * is done in parallel.
-   *
-   * This is efficient if:
-   * * other clients are very unlikely to be modifying any of the objects while
-   * this operation is in progress
-   * * The entries in in_map are close together
-   * * It is especially efficient for initially entering lots of entries into
-   * an empty structure.
+   * Groups the keys of in_map by the object they belong in and inserts each
+   * group with one omap_insert, all objects at once (up to MAX_LEAF_OPS in
+   * flight). A group only goes in if the object stays within 2k entries;
+   * groups are sent k keys at a time.
    *
-   * It is very inefficient compared to setting one key and/or will starve if:
-   * * other clients are modifying the objects it tries to modify
-   * * The keys are distributed across the range of keys in the store
-   * * there is a small number of keys compared to k
+   * The keys of the objects that are full, or changed under us, are set one
+   * at a time, splitting as needed. If there are more than k of them, they
+   * go through rewrite_many instead, which does not add prefixes to the
+   * index and therefore DOES NOT guarantee consistency! It is ONLY safe if
+   * there is only one instance at a time. It follows the same general logic
+   * as a rebalance, but with all objects that contain any of the keys. This
+   * is what makes entering lots of entries into an empty structure fast.
    */
   int set_many(const map<string, bufferlist> &in_map);
 
+  /**
+   * Gets the values of keys, reading all the objects they are in at once.
+   * Keys that are not in the store are not in out.
+   */
+  int get_many(const std::set<string> &keys, map<string, bufferlist> *out);
+
   int get_all_keys(std::set<string> *keys);
   int get_all_keys_and_values(map<string,bufferlist> *kv_map);
 
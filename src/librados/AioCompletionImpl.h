@@ -42,7 +42,12 @@ struct librados::AioCompletionImpl {
   bufferlist bl;
   unsigned maxlen;
 
+  // for completions created on a completion queue
+  AioCompletionQueueImpl *cq;
+  void *cq_item;   ///< what polling the queue hands back for us
+
   IoCtxImpl *io;
+  uint64_t finisher_key;   ///< picks the thread our callbacks run on
   tid_t aio_write_seq;
   xlist<AioCompletionImpl*>::item aio_write_list_item;
 
@@ -54,7 +59,12 @@ struct librados::AioCompletionImpl {
 			callback_complete_arg(0),
 			callback_safe_arg(0),
 			is_read(false), maxlen(0),
-			io(NULL), aio_write_seq(0), aio_write_list_item(this) { }
+			cq(NULL), cq_item(NULL),
+			io(NULL), finisher_key(0), aio_write_seq(0), aio_write_list_item(this) { }
+  ~AioCompletionImpl();
+
+  /// hand ourselves to our completion queue, if any; call with lock held
+  void _queue_complete();
 
   int set_complete_callback(void *cb_arg, rados_callback_t cb) {
     lock.Lock();
@@ -164,6 +174,107 @@ struct librados::AioCompletionImpl {
   }
 };
 
+/**
+ * completions waiting to be polled
+ *
+ * Completions created on a queue are appended to it when they
+ * complete, directly from the thread that completed them, so an
+ * application can reap them in batches without any callback running.
+ */
+struct librados::AioCompletionQueueImpl {
+  Mutex lock;
+  Cond cond;
+  int ref;
+  std::list<AioCompletionImpl*> done;
+
+  AioCompletionQueueImpl() : lock("AioCompletionQueueImpl lock", false, false),
+			     ref(1) { }
+
+  void get() {
+    lock.Lock();
+    ++ref;
+    lock.Unlock();
+  }
+  void put() {
+    lock.Lock();
+    assert(ref > 0);
+    int n = --ref;
+    lock.Unlock();
+    if (!n)
+      delete this;
+  }
+
+  void push(AioCompletionImpl *c) {
+    assert(c->lock.is_locked());
+    c->_get();
+    lock.Lock();
+    done.push_back(c);
+    cond.Signal();
+    lock.Unlock();
+  }
+
+  /**
+   * take up to max finished completions
+   *
+   * Completions the application released before they were reaped are
+   * dropped rather than returned.
+   *
+   * @param items where to put the cq_item of each completion
+   * @param max how many to take at most
+   * @param block wait until there is at least one
+   * @returns number of items filled in
+   */
+  int poll(void **items, int max, bool block) {
+    int n = 0;
+    while (n == 0 && max > 0) {
+      std::list<AioCompletionImpl*> ls;
+      lock.Lock();
+      while (block && done.empty())
+	cond.Wait(lock);
+      while (!done.empty() && (int)ls.size() < max) {
+	ls.push_back(done.front());
+	done.pop_front();
+      }
+      lock.Unlock();
+      for (std::list<AioCompletionImpl*>::iterator p = ls.begin();
+	   p != ls.end(); ++p) {
+	AioCompletionImpl *c = *p;
+	c->lock.Lock();
+	if (!c->released)
+	  items[n++] = c->cq_item;
+	c->put_unlock();
+      }
+      if (!block)
+	break;
+    }
+    return n;
+  }
+
+  void release() {
+    std::list<AioCompletionImpl*> ls;
+    lock.Lock();
+    ls.swap(done);
+    lock.Unlock();
+    for (std::list<AioCompletionImpl*>::iterator p = ls.begin();
+	 p != ls.end(); ++p)
+      (*p)->put();
+    put();
+  }
+};
+
+inline librados::AioCompletionImpl::~AioCompletionImpl()
+{
+  if (cq)
+    cq->put();
+}
+
+inline void librados::AioCompletionImpl::_queue_complete()
+{
+  assert(lock.is_locked());
+  if (cq)
+    cq->push(this);
+}
+
 namespace librados {
 struct C_AioComplete : public Context {
   AioCompletionImpl *c;
@@ -223,6 +334,7 @@ struct C_AioCompleteAndSafe : public Context {
     c->rval = r;
     c->ack = true;
     c->safe = true;
+    c->_queue_complete();
     c->lock.Unlock();
     rados_callback_t cb_complete = c->callback_complete;
     void *cb_complete_arg = c->callback_complete_arg;
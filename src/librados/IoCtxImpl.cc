@@ -76,6 +76,13 @@ uint32_t librados::IoCtxImpl::get_object_pg_hash_position(const std::string& oid
   return objecter->get_object_pg_hash_position(poolid, oid, oloc.nspace);
 }
 
+void librados::IoCtxImpl::attach_aio(AioCompletionImpl *c,
+				    const object_t& oid)
+{
+  c->io = this;
+  c->finisher_key = client->aio_finisher_key(this, oid);
+}
+
 void librados::IoCtxImpl::queue_aio_write(AioCompletionImpl *c)
 {
   get();
@@ -107,7 +114,8 @@ void librados::IoCtxImpl::complete_aio_write(AioCompletionImpl *c)
     ldout(client->cct, 20) << " waking waiters on seq " << waiters->first << dendl;
     for (std::list<AioCompletionImpl*>::iterator it = waiters->second.begin();
 	 it != waiters->second.end(); ++it) {
-      client->finisher.queue(new C_AioCompleteAndSafe(*it));
+      client->aio_finisher.queue((*it)->finisher_key,
+				 new C_AioCompleteAndSafe(*it));
       (*it)->put();
     }
     aio_write_waiters.erase(waiters++);
@@ -124,10 +132,11 @@ void librados::IoCtxImpl::flush_aio_writes_async(AioCompletionImpl *c)
 			 << " completion " << c << dendl;
   Mutex::Locker l(aio_write_list_lock);
   tid_t seq = aio_write_seq;
+  c->finisher_key = client->aio_finisher_key(this, object_t());
   if (aio_write_list.empty()) {
     ldout(client->cct, 20) << "flush_aio_writes_async no writes. (tid "
 			   << seq << ")" << dendl;
-    client->finisher.queue(new C_AioCompleteAndSafe(c));
+    client->aio_finisher.queue(c->finisher_key, new C_AioCompleteAndSafe(c));
   } else {
     ldout(client->cct, 20) << "flush_aio_writes_async " << aio_write_list.size()
 			   << " writes in flight; waiting on tid " << seq << dendl;
@@ -405,6 +414,7 @@ uint32_t librados::IoCtxImpl::list_seek(Objecter::ListContext *context,
 {
   Mutex::Locker l(*lock);
   context->list.clear();
+  context->info.clear();
   return objecter->list_objects_seek(context, pos);
 }
 
@@ -531,6 +541,7 @@ int librados::IoCtxImpl::operate(const object_t& oid, ::ObjectOperation *o,
   Objecter::Op *objecter_op = objecter->prepare_mutate_op(oid, oloc,
 	                                                  *o, snapc, ut, flags,
 	                                                  NULL, oncommit, &ver);
+  objecter_op->complete_unlocked = true;
   lock->Lock();
   objecter->op_submit(objecter_op);
   lock->Unlock();
@@ -568,6 +579,7 @@ int librados::IoCtxImpl::operate_read(const object_t& oid,
   Objecter::Op *objecter_op = objecter->prepare_read_op(oid, oloc,
 	                                      *o, snap_seq, pbl, flags,
 	                                      onack, &ver);
+  objecter_op->complete_unlocked = true;
   lock->Lock();
   objecter->op_submit(objecter_op);
   lock->Unlock();
@@ -593,11 +605,12 @@ int librados::IoCtxImpl::aio_operate_read(const object_t &oid,
   Context *onack = new C_aio_Ack(c);
 
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, oid);
 
   Objecter::Op *objecter_op = objecter->prepare_read_op(oid, oloc,
 		 *o, snap_seq, pbl, flags,
 		 onack, &c->objver);
+  objecter_op->complete_unlocked = true;
   Mutex::Locker l(*lock);
   objecter->op_submit(objecter_op);
   return 0;
@@ -615,16 +628,94 @@ int librados::IoCtxImpl::aio_operate(const object_t& oid,
   Context *onack = new C_aio_Ack(c);
   Context *oncommit = new C_aio_Safe(c);
 
-  c->io = this;
+  attach_aio(c, oid);
   queue_aio_write(c);
 
+  Objecter::Op *objecter_op = objecter->prepare_mutate_op(oid, oloc,
+		 *o, snap_context, ut, flags,
+		 onack, oncommit, &c->objver);
+  objecter_op->complete_unlocked = true;
   Mutex::Locker l(*lock);
-  objecter->mutate(oid, oloc, *o, snap_context, ut, flags, onack, oncommit,
-		   &c->objver);
+  objecter->op_submit(objecter_op);
 
   return 0;
 }
 
+int librados::IoCtxImpl::aio_operate_batch(OperationBatchImpl *batch,
+					   AioCompletionImpl *c)
+{
+  vector<OperationBatchImpl::Item>& items = batch->items;
+  for (vector<OperationBatchImpl::Item>::iterator p = items.begin();
+       p != items.end();
+       ++p) {
+    /* can't write to a snapshot */
+    if (p->write && snap_seq != CEPH_NOSNAP)
+      return -EROFS;
+  }
+
+  ldout(client->cct, 10) << "aio_operate_batch " << items.size() << " ops"
+			 << dendl;
+  if (c)
+    c->finisher_key = client->aio_finisher_key(this, object_t());
+  if (items.empty()) {
+    if (c)
+      client->aio_finisher.queue(c->finisher_key, new C_AioCompleteAndSafe(c));
+    return 0;
+  }
+
+  utime_t ut = ceph_clock_now(client->cct);
+  C_GatherBuilder gather(client->cct);
+  if (c)
+    gather.set_finisher(new C_OnFinisher(
+			  new C_AioCompleteAndSafe(c),
+			  client->aio_finisher.get_shard(c->finisher_key)));
+
+  vector<Objecter::Op*> ops;
+  ops.reserve(items.size());
+  for (vector<OperationBatchImpl::Item>::iterator p = items.begin();
+       p != items.end();
+       ++p) {
+    Context *onack = NULL;
+    Context *oncommit = NULL;
+    if (p->c) {
+      onack = new C_aio_Ack(p->c);
+      attach_aio(p->c, p->oid);
+      if (p->write) {
+	oncommit = new C_aio_Safe(p->c);
+	queue_aio_write(p->c);
+      } else {
+	p->c->is_read = true;
+      }
+    }
+
+    // the batch is done when each write is safe and each read is acked
+    Context **done = p->write ? &oncommit : &onack;
+    if (c)
+      *done = *done ? new C_aio_BatchOp(*done, gather.new_sub()) :
+		      gather.new_sub();
+
+    version_t *objver = p->c ? &p->c->objver : NULL;
+    Objecter::Op *objecter_op;
+    if (p->write)
+      objecter_op = objecter->prepare_mutate_op(p->oid, oloc, *p->op, snapc,
+						ut, p->flags, onack, oncommit,
+						objver);
+    else
+      objecter_op = objecter->prepare_read_op(p->oid, oloc, *p->op,
+					      snap_seq, p->pbl, p->flags,
+					      onack, objver);
+    objecter_op->complete_unlocked = true;
+    ops.push_back(objecter_op);
+  }
+  items.clear();
+
+  if (c)
+    gather.activate();
+  Mutex::Locker l(*lock);
+  objecter->op_submit_batch(ops);
+  return 0;
+}
+
 int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
 				  bufferlist *pbl, size_t len, uint64_t off,
 				  uint64_t snapid)
@@ -635,7 +726,7 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
 
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, oid);
 
   Mutex::Locker l(*lock);
   objecter->read(oid, oloc,
@@ -654,7 +745,7 @@ int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
 
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, oid);
   c->maxlen = len;
   c->bl.clear();
   c->bl.push_back(buffer::create_static(len, buf));
@@ -691,7 +782,7 @@ int librados::IoCtxImpl::aio_sparse_read(const object_t oid,
   C_ObjectOperation *onack = new C_ObjectOperation(nested);
 
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, oid);
 
   onack->m_ops.sparse_read(off, len, m, data_bl, NULL);
 
@@ -713,7 +804,7 @@ int librados::IoCtxImpl::aio_write(const object_t &oid, AioCompletionImpl *c,
   if (snap_seq != CEPH_NOSNAP)
     return -EROFS;
 
-  c->io = this;
+  attach_aio(c, oid);
   queue_aio_write(c);
 
   Context *onack = new C_aio_Ack(c);
@@ -736,7 +827,7 @@ int librados::IoCtxImpl::aio_append(const object_t &oid, AioCompletionImpl *c,
   if (snap_seq != CEPH_NOSNAP)
     return -EROFS;
 
-  c->io = this;
+  attach_aio(c, oid);
   queue_aio_write(c);
 
   Context *onack = new C_aio_Ack(c);
@@ -760,7 +851,7 @@ int librados::IoCtxImpl::aio_write_full(const object_t &oid,
   if (snap_seq != CEPH_NOSNAP)
     return -EROFS;
 
-  c->io = this;
+  attach_aio(c, oid);
   queue_aio_write(c);
 
   Context *onack = new C_aio_Ack(c);
@@ -782,7 +873,7 @@ int librados::IoCtxImpl::aio_remove(const object_t &oid, AioCompletionImpl *c)
   if (snap_seq != CEPH_NOSNAP)
     return -EROFS;
 
-  c->io = this;
+  attach_aio(c, oid);
   queue_aio_write(c);
 
   Context *onack = new C_aio_Ack(c);
@@ -800,7 +891,7 @@ int librados::IoCtxImpl::aio_remove(const object_t &oid, AioCompletionImpl *c)
 int librados::IoCtxImpl::aio_stat(const object_t& oid, AioCompletionImpl *c,
 				  uint64_t *psize, time_t *pmtime)
 {
-  c->io = this;
+  attach_aio(c, oid);
   C_aio_stat_Ack *onack = new C_aio_stat_Ack(c, pmtime);
 
   Mutex::Locker l(*lock);
@@ -816,7 +907,7 @@ int librados::IoCtxImpl::hit_set_list(uint32_t hash, AioCompletionImpl *c,
 {
   Context *onack = new C_aio_Ack(c);
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, object_t());
 
   Mutex::Locker l(*lock);
   ::ObjectOperation rd;
@@ -832,7 +923,7 @@ int librados::IoCtxImpl::hit_set_get(uint32_t hash, AioCompletionImpl *c,
 {
   Context *onack = new C_aio_Ack(c);
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, object_t());
 
   Mutex::Locker l(*lock);
   ::ObjectOperation rd;
@@ -907,7 +998,7 @@ int librados::IoCtxImpl::aio_exec(const object_t& oid, AioCompletionImpl *c,
   Context *onack = new C_aio_Ack(c);
 
   c->is_read = true;
-  c->io = this;
+  attach_aio(c, oid);
 
   Mutex::Locker l(*lock);
   ::ObjectOperation rd;
@@ -1243,12 +1334,15 @@ void librados::IoCtxImpl::C_aio_Ack::finish(int r)
   if (c->bl.length() > 0) {
     c->rval = c->bl.length();
   }
+  c->_queue_complete();
 
   if (c->callback_complete) {
-    c->io->client->finisher.queue(new C_AioComplete(c));
+    c->io->client->aio_finisher.queue(c->finisher_key,
+				      new C_AioComplete(c));
   }
   if (c->is_read && c->callback_safe) {
-    c->io->client->finisher.queue(new C_AioSafe(c));
+    c->io->client->aio_finisher.queue(c->finisher_key,
+				      new C_AioSafe(c));
   }
 
   c->put_unlock();
@@ -1273,14 +1367,30 @@ void librados::IoCtxImpl::C_aio_stat_Ack::finish(int r)
   if (r >= 0 && pmtime) {
     *pmtime = mtime.sec();
   }
+  c->_queue_complete();
 
   if (c->callback_complete) {
-    c->io->client->finisher.queue(new C_AioComplete(c));
+    c->io->client->aio_finisher.queue(c->finisher_key,
+				      new C_AioComplete(c));
   }
 
   c->put_unlock();
 }
 
+///////////////////////////// C_aio_BatchOp //////////////////////////////
+
+librados::IoCtxImpl::C_aio_BatchOp::C_aio_BatchOp(Context *_op_ctx,
+						  Context *_batch_ctx)
+  : op_ctx(_op_ctx), batch_ctx(_batch_ctx)
+{
+}
+
+void librados::IoCtxImpl::C_aio_BatchOp::finish(int r)
+{
+  op_ctx->complete(r);
+  batch_ctx->complete(r);
+}
+
 //////////////////////////// C_aio_Safe ////////////////////////////////
 
 librados::IoCtxImpl::C_aio_Safe::C_aio_Safe(AioCompletionImpl *_c) : c(_c)
@@ -1294,12 +1404,14 @@ void librados::IoCtxImpl::C_aio_Safe::finish(int r)
   if (!c->ack) {
     c->rval = r;
     c->ack = true;
+    c->_queue_complete();
   }
   c->safe = true;
   c->cond.Signal();
 
   if (c->callback_safe) {
-    c->io->client->finisher.queue(new C_AioSafe(c));
+    c->io->client->aio_finisher.queue(c->finisher_key,
+				      new C_AioSafe(c));
   }
 
   c->io->complete_aio_write(c);
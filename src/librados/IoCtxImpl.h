@@ -28,6 +28,18 @@
 
 class RadosClient;
 
+struct librados::OperationBatchImpl {
+  struct Item {
+    object_t oid;
+    ::ObjectOperation *op;
+    AioCompletionImpl *c;
+    int flags;
+    bool write;
+    bufferlist *pbl;
+  };
+  vector<Item> items;
+};
+
 struct librados::IoCtxImpl {
   atomic_t ref_cnt;
   RadosClient *client;
@@ -82,6 +94,7 @@ struct librados::IoCtxImpl {
       delete this;
   }
 
+  void attach_aio(AioCompletionImpl *c, const object_t& oid);
   void queue_aio_write(struct AioCompletionImpl *c);
   void complete_aio_write(struct AioCompletionImpl *c);
   void flush_aio_writes_async(AioCompletionImpl *c);
@@ -147,6 +160,7 @@ struct librados::IoCtxImpl {
 		  int flags);
   int aio_operate_read(const object_t& oid, ::ObjectOperation *o,
 		       AioCompletionImpl *c, int flags, bufferlist *pbl);
+  int aio_operate_batch(OperationBatchImpl *batch, AioCompletionImpl *c);
 
   struct C_aio_Ack : public Context {
     librados::AioCompletionImpl *c;
@@ -154,6 +168,13 @@ struct librados::IoCtxImpl {
     void finish(int r);
   };
 
+  struct C_aio_BatchOp : public Context {
+    Context *op_ctx;
+    Context *batch_ctx;
+    C_aio_BatchOp(Context *_op_ctx, Context *_batch_ctx);
+    void finish(int r);
+  };
+
   struct C_aio_stat_Ack : public Context {
     librados::AioCompletionImpl *c;
     time_t *pmtime;
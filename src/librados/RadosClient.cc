@@ -26,6 +26,7 @@
 #include "common/common_init.h"
 #include "common/errno.h"
 #include "include/buffer.h"
+#include "include/ceph_hash.h"
 #include "include/stringify.h"
 
 #include "messages/MWatchNotify.h"
@@ -81,9 +82,33 @@ librados::RadosClient::RadosClient(CephContext *cct_)
     timer(cct, lock),
     refcnt(1),
     log_last_version(0), log_cb(NULL), log_cb_arg(NULL),
+    aio_order(AIO_ORDER_IOCTX),
     finisher(cct),
+    aio_finisher(cct, "aio_finisher", cct->_conf->rados_aio_completion_threads),
     max_watch_cookie(0)
 {
+  const string& order = cct->_conf->rados_aio_completion_order;
+  if (order == "object") {
+    aio_order = AIO_ORDER_OBJECT;
+  } else if (order == "none") {
+    aio_order = AIO_ORDER_NONE;
+  } else if (order != "ioctx") {
+    lderr(cct) << "unknown rados_aio_completion_order '" << order
+	       << "', ordering callbacks per ioctx" << dendl;
+  }
+}
+
+uint64_t librados::RadosClient::aio_finisher_key(IoCtxImpl *io,
+						 const object_t& oid)
+{
+  switch (aio_order) {
+  case AIO_ORDER_OBJECT:
+    return ceph_str_hash_rjenkins(oid.name.c_str(), oid.name.length());
+  case AIO_ORDER_NONE:
+    return aio_finisher_seq.inc();
+  default:
+    return ceph_str_hash_rjenkins((const char *)&io, sizeof(io));
+  }
 }
 
 int64_t librados::RadosClient::lookup_pool(const char *name)
@@ -275,6 +300,7 @@ int librados::RadosClient::connect()
   monclient.renew_subs();
 
   finisher.start();
+  aio_finisher.start();
 
   state = CONNECTED;
   instance_id = monclient.get_global_id();
@@ -299,6 +325,7 @@ void librados::RadosClient::shutdown()
   }
   if (state == CONNECTED) {
     finisher.stop();
+    aio_finisher.stop();
   }
   bool need_objecter = false;
   if (objecter && state == CONNECTED) {
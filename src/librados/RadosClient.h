@@ -15,9 +15,11 @@
 #define CEPH_LIBRADOS_RADOSCLIENT_H
 
 #include "common/Cond.h"
+#include "common/Finisher.h"
 #include "common/Mutex.h"
 #include "common/RWLock.h"
 #include "common/Timer.h"
+#include "include/atomic.h"
 #include "include/rados/librados.h"
 #include "include/rados/librados.hpp"
 #include "mon/MonClient.h"
@@ -81,8 +83,24 @@ private:
 
   int wait_for_osdmap();
 
+  enum {
+    AIO_ORDER_IOCTX,
+    AIO_ORDER_OBJECT,
+    AIO_ORDER_NONE,
+  } aio_order;
+  atomic64_t aio_finisher_seq;
+
 public:
   Finisher finisher;
+  ShardedFinisher aio_finisher;  ///< runs aio completion callbacks
+
+  /**
+   * choose the aio_finisher shard for a completion
+   *
+   * Callbacks queued with the same key run in the order they were
+   * queued; rados_aio_completion_order decides what shares a key.
+   */
+  uint64_t aio_finisher_key(IoCtxImpl *io, const object_t& oid);
 
   RadosClient(CephContext *cct_);
   ~RadosClient();
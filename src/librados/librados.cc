@@ -539,6 +539,25 @@ uint32_t librados::ObjectIterator::get_pg_hash_position() const
   return ctx->lc->get_pg_hash_position();
 }
 
+int librados::ObjectIterator::get_info(uint64_t *psize, time_t *pmtime) const
+{
+  if (!ctx || ctx->lc->info.empty())
+    return -ENODATA;
+  const pg_ls_info_t& info = ctx->lc->info.front();
+  if (psize)
+    *psize = info.size;
+  if (pmtime)
+    *pmtime = info.mtime.sec();
+  return 0;
+}
+
+librados::ObjectListFilter::ObjectListFilter()
+  : min_size(0), max_size((uint64_t)-1),
+    min_mtime(0), max_mtime(0),
+    want_info(false)
+{
+}
+
 const librados::ObjectIterator librados::ObjectIterator::__EndObjectIterator(NULL);
 
 ///////////////////////////// PoolAsyncCompletion //////////////////////////////
@@ -660,6 +679,49 @@ void librados::AioCompletion::AioCompletion::release()
   delete this;
 }
 
+///////////////////////////// AioCompletionQueue //////////////////////////////
+librados::AioCompletionQueue::AioCompletionQueue()
+  : pcq(new AioCompletionQueueImpl)
+{
+}
+
+librados::AioCompletionQueue::~AioCompletionQueue()
+{
+  pcq->release();
+}
+
+librados::AioCompletion *librados::AioCompletionQueue::create_completion()
+{
+  AioCompletionImpl *c = new AioCompletionImpl;
+  AioCompletion *comp = new AioCompletion(c);
+  pcq->get();
+  c->cq = pcq;
+  c->cq_item = comp;
+  return comp;
+}
+
+int librados::AioCompletionQueue::poll(std::list<AioCompletion*> *ls, int max)
+{
+  return _poll(ls, max, false);
+}
+
+int librados::AioCompletionQueue::wait(std::list<AioCompletion*> *ls, int max)
+{
+  return _poll(ls, max, true);
+}
+
+int librados::AioCompletionQueue::_poll(std::list<AioCompletion*> *ls,
+					int max, bool block)
+{
+  if (max <= 0)
+    return 0;
+  std::vector<void*> items(max);
+  int n = pcq->poll(&items[0], max, block);
+  for (int i = 0; i < n; ++i)
+    ls->push_back((AioCompletion*)items[i]);
+  return n;
+}
+
 ///////////////////////////// IoCtx //////////////////////////////
 librados::IoCtx::IoCtx() : io_ctx_impl(NULL)
 {
@@ -1068,6 +1130,11 @@ int librados::IoCtx::aio_operate(const std::string& oid, AioCompletion *c,
 				       translate_flags(flags), pbl);
 }
 
+int librados::IoCtx::aio_operate_batch(librados::OperationBatch *batch,
+				       AioCompletion *c)
+{
+  return io_ctx_impl->aio_operate_batch(batch->impl, c ? c->pc : NULL);
+}
 
 void librados::IoCtx::snap_set_read(snap_t seq)
 {
@@ -1231,6 +1298,45 @@ librados::ObjectIterator librados::IoCtx::objects_begin(uint32_t pos)
   return iter;
 }
 
+librados::ObjectIterator librados::IoCtx::objects_begin_shard(
+  uint32_t shard, uint32_t num_shards)
+{
+  rados_list_ctx_t listh;
+  if (rados_objects_list_open_shard(io_ctx_impl, shard, num_shards,
+				    &listh) < 0)
+    return objects_end();
+  ObjectIterator iter((ObjListCtx*)listh);
+  iter.get_next();
+  return iter;
+}
+
+librados::ObjectIterator librados::IoCtx::objects_begin(
+  const ObjectListFilter& filter, uint32_t shard, uint32_t num_shards)
+{
+  rados_list_ctx_t listh;
+  if (rados_objects_list_open_shard(io_ctx_impl, shard, num_shards,
+				    &listh) < 0)
+    return objects_end();
+
+  pg_ls_filter_t f;
+  f.prefix = filter.prefix;
+  f.xattr = filter.xattr;
+  f.xattr_value = filter.xattr_value;
+  f.min_size = filter.min_size;
+  f.max_size = filter.max_size;
+  f.min_mtime = utime_t(filter.min_mtime, 0);
+  f.max_mtime = utime_t(filter.max_mtime, 0);
+  f.want_info = filter.want_info;
+  Objecter::ListContext *lc = ((ObjListCtx*)listh)->lc;
+  ::encode(string("object"), lc->filter);
+  ::encode(f, lc->filter);
+  lc->want_info = filter.want_info;
+
+  ObjectIterator iter((ObjListCtx*)listh);
+  iter.get_next();
+  return iter;
+}
+
 const librados::ObjectIterator& librados::IoCtx::objects_end() const
 {
   return ObjectIterator::__EndObjectIterator;
@@ -1751,6 +1857,51 @@ librados::ObjectOperation::~ObjectOperation()
   delete o;
 }
 
+librados::OperationBatch::OperationBatch()
+  : impl(new OperationBatchImpl)
+{
+}
+
+librados::OperationBatch::~OperationBatch()
+{
+  delete impl;
+}
+
+size_t librados::OperationBatch::size()
+{
+  return impl->items.size();
+}
+
+void librados::OperationBatch::aio_operate(const std::string& oid,
+					   AioCompletion *c,
+					   ObjectWriteOperation *op,
+					   int flags)
+{
+  OperationBatchImpl::Item item;
+  item.oid = object_t(oid);
+  item.op = (::ObjectOperation *)op->impl;
+  item.c = c ? c->pc : NULL;
+  item.flags = translate_flags(flags);
+  item.write = true;
+  item.pbl = NULL;
+  impl->items.push_back(item);
+}
+
+void librados::OperationBatch::aio_operate(const std::string& oid,
+					   AioCompletion *c,
+					   ObjectReadOperation *op,
+					   int flags, bufferlist *pbl)
+{
+  OperationBatchImpl::Item item;
+  item.oid = object_t(oid);
+  item.op = (::ObjectOperation *)op->impl;
+  item.c = c ? c->pc : NULL;
+  item.flags = translate_flags(flags);
+  item.write = false;
+  item.pbl = pbl;
+  impl->items.push_back(item);
+}
+
 ///////////////////////////// C API //////////////////////////////
 static
 int rados_create_common(rados_t *pcluster,
@@ -2689,6 +2840,23 @@ extern "C" int rados_objects_list_open(rados_ioctx_t io, rados_list_ctx_t *listh
   return 0;
 }
 
+extern "C" int rados_objects_list_open_shard(rados_ioctx_t io, uint32_t shard,
+					     uint32_t num_shards,
+					     rados_list_ctx_t *listh)
+{
+  if (shard >= num_shards)
+    return -EINVAL;
+  librados::IoCtxImpl *ctx = (librados::IoCtxImpl *)io;
+  Objecter::ListContext *h = new Objecter::ListContext;
+  h->pool_id = ctx->poolid;
+  h->pool_snap_seq = ctx->snap_seq;
+  h->nspace = ctx->oloc.nspace;
+  h->shard = shard;
+  h->num_shards = num_shards;
+  *listh = (void *)new librados::ObjListCtx(ctx, h);
+  return 0;
+}
+
 extern "C" void rados_objects_list_close(rados_list_ctx_t h)
 {
   librados::ObjListCtx *lh = (librados::ObjListCtx *)h;
@@ -2716,9 +2884,12 @@ extern "C" int rados_objects_list_next(rados_list_ctx_t listctx, const char **en
   Objecter::ListContext *h = lh->lc;
 
   // if the list is non-empty, this method has been called before
-  if (!h->list.empty())
+  if (!h->list.empty()) {
     // so let's kill the previously-returned object
     h->list.pop_front();
+    if (!h->info.empty())
+      h->info.pop_front();
+  }
 
   if (h->list.empty()) {
     int ret = lh->ctx->list(lh->lc, RADOS_LIST_MAX_ENTRIES);
@@ -2810,7 +2981,42 @@ extern "C" uint64_t rados_aio_get_version(rados_completion_t c)
 
 extern "C" void rados_aio_release(rados_completion_t c)
 {
-  ((librados::AioCompletionImpl*)c)->put();
+  ((librados::AioCompletionImpl*)c)->release();
+}
+
+extern "C" int rados_aio_create_completion_queue(rados_completion_queue_t *pcq)
+{
+  *pcq = new librados::AioCompletionQueueImpl;
+  return 0;
+}
+
+extern "C" void rados_aio_completion_queue_release(rados_completion_queue_t cq)
+{
+  ((librados::AioCompletionQueueImpl*)cq)->release();
+}
+
+extern "C" int rados_aio_create_queued_completion(rados_completion_queue_t cq,
+						  rados_completion_t *pc)
+{
+  librados::AioCompletionQueueImpl *q = (librados::AioCompletionQueueImpl*)cq;
+  librados::AioCompletionImpl *c = new librados::AioCompletionImpl;
+  q->get();
+  c->cq = q;
+  c->cq_item = c;
+  *pc = c;
+  return 0;
+}
+
+extern "C" int rados_aio_completion_queue_poll(rados_completion_queue_t cq,
+					       rados_completion_t *pc, int max)
+{
+  return ((librados::AioCompletionQueueImpl*)cq)->poll(pc, max, false);
+}
+
+extern "C" int rados_aio_completion_queue_wait(rados_completion_queue_t cq,
+					       rados_completion_t *pc, int max)
+{
+  return ((librados::AioCompletionQueueImpl*)cq)->poll(pc, max, true);
 }
 
 extern "C" int rados_aio_read(rados_ioctx_t io, const char *o,
@@ -51,6 +51,17 @@ namespace librbd {
 		       << " bytes to bl " << (void*)read_bl << dendl;
 	read_bl->claim(bl);
       }
+      if (!read_iov.empty()) {
+	uint64_t off = 0;
+	for (std::vector<struct iovec>::iterator p = read_iov.begin();
+	     p != read_iov.end() && off < bl.length(); ++p) {
+	  uint64_t len = MIN(p->iov_len, bl.length() - off);
+	  bl.copy(off, len, (char *)p->iov_base);
+	  off += len;
+	}
+	ldout(cct, 20) << "AioCompletion::finalize() copied resulting " << off
+		       << " bytes to " << read_iov.size() << " iovecs" << dendl;
+      }
     }
   }
 
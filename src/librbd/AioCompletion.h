@@ -3,6 +3,10 @@
 #ifndef CEPH_LIBRBD_AIOCOMPLETION_H
 #define CEPH_LIBRBD_AIOCOMPLETION_H
 
+#include <sys/uio.h>
+
+#include <vector>
+
 #include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/ceph_context.h"
@@ -60,6 +64,7 @@ namespace librbd {
     bufferlist *read_bl;
     char *read_buf;
     size_t read_buf_len;
+    std::vector<struct iovec> read_iov;
 
     AioCompletion() : lock("AioCompletion::lock", true),
 		      done(false), rval(0), complete_cb(NULL),
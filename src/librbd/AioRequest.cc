@@ -3,12 +3,15 @@
 
 #include "common/ceph_context.h"
 #include "common/dout.h"
+#include "common/errno.h"
 #include "common/Mutex.h"
 #include "common/RWLock.h"
 
 #include "librbd/AioCompletion.h"
+#include "librbd/CopyupRequest.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/internal.h"
+#include "librbd/PersistentCache.h"
 
 #include "librbd/AioRequest.h"
 
@@ -60,23 +63,33 @@ namespace librbd {
 			   << " r = " << r << dendl;
 
     if (!m_tried_parent && r == -ENOENT) {
-      RWLock::RLocker l(m_ictx->snap_lock);
-      RWLock::RLocker l2(m_ictx->parent_lock);
-
-      // calculate reverse mapping onto the image
       vector<pair<uint64_t,uint64_t> > image_extents;
-      Striper::extent_to_file(m_ictx->cct, &m_ictx->layout,
-			    m_object_no, m_object_off, m_object_len,
-			    image_extents);
+      uint64_t object_overlap;
+      {
+	RWLock::RLocker l(m_ictx->snap_lock);
+	RWLock::RLocker l2(m_ictx->parent_lock);
 
-      uint64_t image_overlap = 0;
-      r = m_ictx->get_parent_overlap(m_snap_id, &image_overlap);
-      if (r < 0) {
-	assert(0 == "FIXME");
+	// calculate reverse mapping onto the image
+	Striper::extent_to_file(m_ictx->cct, &m_ictx->layout,
+				m_object_no, m_object_off, m_object_len,
+				image_extents);
+
+	uint64_t image_overlap = 0;
+	r = m_ictx->get_parent_overlap(m_snap_id, &image_overlap);
+	if (r < 0) {
+	  assert(0 == "FIXME");
+	}
+	object_overlap = m_ictx->prune_parent_extents(image_extents,
+						      image_overlap);
       }
-      uint64_t object_overlap = m_ictx->prune_parent_extents(image_extents, image_overlap);
+      // the parent read may complete (and delete us) before it returns
+      // if the parent's object map lets it skip everything, so don't
+      // hold our locks across it
       if (object_overlap) {
 	m_tried_parent = true;
+	if (m_ictx->cct->_conf->rbd_clone_copy_on_read &&
+	    !m_ictx->read_only && m_snap_id == CEPH_NOSNAP)
+	  copyup_on_read();
 	read_from_parent(image_extents);
 	return false;
       }
@@ -85,9 +98,46 @@ namespace librbd {
     return true;
   }
 
+  void AioRead::copyup_on_read()
+  {
+    // copy up the whole object, not just the extent being read
+    vector<pair<uint64_t,uint64_t> > image_extents;
+    {
+      RWLock::RLocker l(m_ictx->snap_lock);
+      RWLock::RLocker l2(m_ictx->parent_lock);
+      Striper::extent_to_file(m_ictx->cct, &m_ictx->layout, m_object_no, 0,
+			      m_ictx->get_object_size(), image_extents);
+      uint64_t image_overlap = 0;
+      if (m_ictx->get_parent_overlap(m_snap_id, &image_overlap) < 0 ||
+	  m_ictx->prune_parent_extents(image_extents, image_overlap) == 0)
+	return;
+    }
+
+    {
+      Mutex::Locker l(m_ictx->copyup_list_lock);
+      if (!m_ictx->copyup_list.insert(m_object_no).second) {
+	ldout(m_ictx->cct, 20) << "copy-on-read of " << m_oid
+			       << " already in flight" << dendl;
+	return;
+      }
+    }
+
+    CopyupRequest *req = new CopyupRequest(m_ictx, m_oid, m_object_no,
+					   image_extents);
+    req->send();
+  }
+
   int AioRead::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
 
+    if (m_snap_id != CEPH_NOSNAP && m_ictx->persistent_cache) {
+      // the result is not sparse; C_AioRead copes with an empty m_ext_map
+      m_ictx->persistent_cache->aio_read(m_oid, m_object_no, m_snap_id,
+					 m_object_off, m_object_len,
+					 &m_read_data, new C_CacheRead(this));
+      return 0;
+    }
+
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(this, rados_req_cb, NULL);
     int r;
@@ -109,6 +159,7 @@ namespace librbd {
 
   AbstractWrite::AbstractWrite()
     : m_state(LIBRBD_AIO_WRITE_FLAT),
+      m_state_after_pre(LIBRBD_AIO_WRITE_FLAT),
       m_parent_overlap(0) {}
   AbstractWrite::AbstractWrite(ImageCtx *ictx, const std::string &oid,
 			       uint64_t object_no, uint64_t object_off, uint64_t len,
@@ -119,7 +170,8 @@ namespace librbd {
 			       bool hide_enoent)
     : AioRequest(ictx, oid, object_no, object_off, len, snap_id, completion,
 		 hide_enoent),
-      m_state(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val)
+      m_state(LIBRBD_AIO_WRITE_FLAT),
+      m_state_after_pre(LIBRBD_AIO_WRITE_FLAT), m_snap_seq(snapc.seq.val)
   {
     m_object_image_extents = objectx;
     m_parent_overlap = object_overlap;
@@ -147,6 +199,19 @@ namespace librbd {
 
     bool finished = true;
     switch (m_state) {
+    case LIBRBD_AIO_WRITE_PRE:
+      ldout(m_ictx->cct, 20) << "WRITE_PRE" << dendl;
+      if (r < 0) {
+	lderr(m_ictx->cct) << "error updating object map for " << m_oid
+			   << ": " << cpp_strerror(r) << dendl;
+	break;
+      }
+      m_ictx->object_map.set_exists(m_object_no);
+      m_state = m_state_after_pre;
+      send_write();
+      finished = false;
+      break;
+
     case LIBRBD_AIO_WRITE_GUARD:
       ldout(m_ictx->cct, 20) << "WRITE_CHECK_GUARD" << dendl;
 
@@ -225,6 +290,20 @@ namespace librbd {
 
   int AbstractWrite::send() {
     ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid << " " << m_object_off << "~" << m_object_len << dendl;
+    if (may_create_object() &&
+	m_ictx->object_map.update_required(m_object_no)) {
+      m_state_after_pre = m_state;
+      m_state = LIBRBD_AIO_WRITE_PRE;
+      librados::AioCompletion *rados_completion =
+	librados::Rados::aio_create_completion(this, NULL, rados_req_cb);
+      m_ictx->object_map.aio_update(m_object_no, rados_completion);
+      rados_completion->release();
+      return 0;
+    }
+    return send_write();
+  }
+
+  int AbstractWrite::send_write() {
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(this, NULL, rados_req_cb);
     int r;
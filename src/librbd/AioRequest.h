@@ -83,6 +83,8 @@ namespace librbd {
     friend class C_AioRead;
 
   private:
+    void copyup_on_read();
+
     vector<pair<uint64_t,uint64_t> > m_buffer_extents;
     bool m_tried_parent;
     bool m_sparse;
@@ -122,9 +124,12 @@ namespace librbd {
      * LIBRBD_AIO_WRITE_FLAT
      *
      * Writes start in LIBRBD_AIO_WRITE_GUARD or _FLAT, depending on whether
-     * there is a parent or not.
+     * there is a parent or not.  If the object may be created and the
+     * object map does not have it yet, they first go through
+     * LIBRBD_AIO_WRITE_PRE to mark it in the object map.
      */
     enum write_state_d {
+      LIBRBD_AIO_WRITE_PRE,
       LIBRBD_AIO_WRITE_GUARD,
       LIBRBD_AIO_WRITE_COPYUP,
       LIBRBD_AIO_WRITE_FLAT
@@ -132,8 +137,13 @@ namespace librbd {
 
   protected:
     virtual void add_copyup_ops() = 0;
+    /// whether this write may leave the object existing
+    virtual bool may_create_object() const {
+      return true;
+    }
 
     write_state_d m_state;
+    write_state_d m_state_after_pre;
     vector<pair<uint64_t,uint64_t> > m_object_image_extents;
     uint64_t m_parent_overlap;
     librados::ObjectWriteOperation m_write;
@@ -142,6 +152,7 @@ namespace librbd {
     std::vector<librados::snap_t> m_snaps;
 
   private:
+    int send_write();
     void send_copyup();
   };
 
@@ -164,13 +175,24 @@ namespace librbd {
     }
     virtual ~AioWrite() {}
 
+    /// write another extent of the same object in the same op
+    void add_extent(uint64_t object_off, const ceph::bufferlist &data) {
+      m_write.write(object_off, data);
+      m_extra_extents.push_back(std::make_pair(object_off, data));
+    }
+
   protected:
     virtual void add_copyup_ops() {
       m_copyup.write(m_object_off, m_write_data);
+      for (std::vector<std::pair<uint64_t, ceph::bufferlist> >::iterator p =
+	     m_extra_extents.begin();
+	   p != m_extra_extents.end(); ++p)
+	m_copyup.write(p->first, p->second);
     }
 
   private:
     ceph::bufferlist m_write_data;
+    std::vector<std::pair<uint64_t, ceph::bufferlist> > m_extra_extents;
   };
 
   class AioRemove : public AbstractWrite {
@@ -197,6 +219,10 @@ namespace librbd {
       // removing an object never needs to copyup
       assert(0);
     }
+    virtual bool may_create_object() const {
+      // with a parent the object is truncated rather than removed
+      return has_parent();
+    }
   };
 
   class AioTruncate : public AbstractWrite {
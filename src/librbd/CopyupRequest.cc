@@ -0,0 +1,147 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/Mutex.h"
+#include "common/RWLock.h"
+
+#include "librbd/AioCompletion.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/CopyupRequest.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::CopyupRequest: "
+
+namespace librbd {
+
+  CopyupRequest::CopyupRequest(ImageCtx *ictx, const std::string &oid,
+			       uint64_t objectno,
+			       vector<pair<uint64_t,uint64_t> >& image_extents)
+    : m_ictx(ictx), m_oid(oid), m_object_no(objectno),
+      m_image_extents(image_extents), m_state(STATE_READ_FROM_PARENT)
+  {
+  }
+
+  CopyupRequest::~CopyupRequest()
+  {
+    Mutex::Locker l(m_ictx->copyup_list_lock);
+    m_ictx->copyup_list.erase(m_object_no);
+    if (m_ictx->copyup_list.empty())
+      m_ictx->copyup_list_cond.Signal();
+  }
+
+  void CopyupRequest::send()
+  {
+    ldout(m_ictx->cct, 20) << "send " << this << " " << m_oid
+			   << " extents " << m_image_extents << dendl;
+    m_state = STATE_READ_FROM_PARENT;
+    AioCompletion *comp = aio_create_completion_internal(
+      this, rbd_read_from_parent_cb);
+    int r = aio_read(m_ictx->parent, m_image_extents, NULL, &m_copyup_data,
+		     comp);
+    if (r < 0) {
+      comp->release();
+      complete(r);
+    }
+  }
+
+  void CopyupRequest::complete(int r)
+  {
+    if (should_complete(r))
+      delete this;
+  }
+
+  bool CopyupRequest::should_complete(int r)
+  {
+    CephContext *cct = m_ictx->cct;
+    ldout(cct, 20) << "should_complete " << this << " " << m_oid
+		   << " state " << m_state << " r = " << r << dendl;
+    if (r < 0) {
+      lderr(cct) << "copy-on-read of " << m_oid << " failed: "
+		 << cpp_strerror(r) << dendl;
+      return true;
+    }
+
+    switch (m_state) {
+    case STATE_READ_FROM_PARENT:
+      if (m_copyup_data.is_zero()) {
+	ldout(cct, 20) << "parent data is all zeros, nothing to copy up"
+		       << dendl;
+	return true;
+      }
+      send_object_map();
+      return false;
+
+    case STATE_OBJECT_MAP:
+      m_ictx->object_map.set_exists(m_object_no);
+      send_copyup();
+      return false;
+
+    case STATE_COPYUP:
+      m_ictx->perfcounter->inc(l_librbd_copyup_on_read);
+      return true;
+
+    default:
+      lderr(cct) << "invalid copyup state: " << m_state << dendl;
+      assert(0);
+    }
+    return true;
+  }
+
+  void CopyupRequest::send_object_map()
+  {
+    if (!m_ictx->object_map.update_required(m_object_no)) {
+      send_copyup();
+      return;
+    }
+    m_state = STATE_OBJECT_MAP;
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(this, NULL, rados_cb);
+    m_ictx->object_map.aio_update(m_object_no, rados_completion);
+    rados_completion->release();
+  }
+
+  void CopyupRequest::send_copyup()
+  {
+    ldout(m_ictx->cct, 20) << "copyup " << m_oid << " "
+			   << m_copyup_data.length() << " bytes" << dendl;
+    m_state = STATE_COPYUP;
+
+    uint64_t snap_seq;
+    std::vector<librados::snap_t> snaps;
+    {
+      RWLock::RLocker l(m_ictx->snap_lock);
+      snap_seq = m_ictx->snapc.seq.val;
+      snaps = m_ictx->snaps;
+    }
+
+    librados::ObjectWriteOperation copyup;
+    copyup.exec("rbd", "copyup", m_copyup_data);
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(this, NULL, rados_cb);
+    int r = m_ictx->data_ctx.aio_operate(m_oid, rados_completion, &copyup,
+					 snap_seq, snaps);
+    assert(r == 0);
+    rados_completion->release();
+  }
+
+  void CopyupRequest::rbd_read_from_parent_cb(completion_t cb, void *arg)
+  {
+    CopyupRequest *req = reinterpret_cast<CopyupRequest *>(arg);
+    AioCompletion *comp = reinterpret_cast<AioCompletion *>(cb);
+    int r = comp->get_return_value();
+    comp->release();
+    req->complete(r);
+  }
+
+  void CopyupRequest::rados_cb(rados_completion_t c, void *arg)
+  {
+    CopyupRequest *req = reinterpret_cast<CopyupRequest *>(arg);
+    req->complete(rados_aio_get_return_value(c));
+  }
+}
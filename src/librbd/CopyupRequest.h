@@ -0,0 +1,69 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_COPYUPREQUEST_H
+#define CEPH_LIBRBD_COPYUPREQUEST_H
+
+#include "include/int_types.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/rados/librados.hpp"
+#include "include/rbd/librbd.hpp"
+
+namespace librbd {
+
+  struct AioCompletion;
+  struct ImageCtx;
+
+  /**
+   * Copies a whole object of a clone up from its parent in the
+   * background, so later reads of it are served by the clone.  Used for
+   * copy-on-read (rbd_clone_copy_on_read).
+   *
+   * READ_FROM_PARENT ---> OBJECT_MAP ---> COPYUP ---> done
+   *         |                               ^
+   *         \-------------------------------/
+   *           (object map already has it)
+   *
+   * The copyup class method only writes the data if the object still
+   * does not exist, so a write to the object racing with this is safe.
+   * The object number is in ImageCtx::copyup_list while the request is
+   * in flight.
+   */
+  class CopyupRequest {
+  public:
+    CopyupRequest(ImageCtx *ictx, const std::string &oid, uint64_t objectno,
+		  std::vector<std::pair<uint64_t,uint64_t> >& image_extents);
+    ~CopyupRequest();
+
+    void send();
+    void complete(int r);
+
+  private:
+    enum state_d {
+      STATE_READ_FROM_PARENT,
+      STATE_OBJECT_MAP,
+      STATE_COPYUP
+    };
+
+    bool should_complete(int r);
+    void send_object_map();
+    void send_copyup();
+
+    static void rbd_read_from_parent_cb(completion_t cb, void *arg);
+    static void rados_cb(rados_completion_t cb, void *arg);
+
+    ImageCtx *m_ictx;
+    std::string m_oid;
+    uint64_t m_object_no;
+    std::vector<std::pair<uint64_t,uint64_t> > m_image_extents;
+    state_d m_state;
+    ceph::bufferlist m_copyup_data;
+  };
+
+}
+
+#endif
@@ -2,12 +2,15 @@
 // vim: ts=8 sw=2 smarttab
 #include <errno.h>
 
+#include <sstream>
+
 #include "common/ceph_context.h"
 #include "common/dout.h"
 #include "common/errno.h"
 #include "common/perf_counters.h"
 
 #include "librbd/internal.h"
+#include "librbd/PersistentCache.h"
 #include "librbd/WatchCtx.h"
 
 #include "librbd/ImageCtx.h"
@@ -45,13 +48,15 @@ namespace librbd {
       snap_lock("librbd::ImageCtx::snap_lock"),
       parent_lock("librbd::ImageCtx::parent_lock"),
       refresh_lock("librbd::ImageCtx::refresh_lock"),
+      copyup_list_lock("librbd::ImageCtx::copyup_list_lock"),
       extra_read_flags(0),
       old_format(true),
       order(0), size(0), features(0),
       format_string(NULL),
       id(image_id), parent(NULL),
       stripe_unit(0), stripe_count(0),
-      object_cacher(NULL), writeback_handler(NULL), object_set(NULL)
+      object_cacher(NULL), writeback_handler(NULL), object_set(NULL),
+      object_map(*this), persistent_cache(NULL), total_bytes_read(0)
   {
     md_ctx.dup(p);
     data_ctx.dup(p);
@@ -92,10 +97,15 @@ namespace librbd {
 				       cct->_conf->rbd_cache_target_dirty,
 				       cct->_conf->rbd_cache_max_dirty_age,
 				       cct->_conf->rbd_cache_block_writes_upfront);
+      object_cacher->set_max_coalesced_write(
+	cct->_conf->rbd_cache_max_coalesced_write);
       object_set = new ObjectCacher::ObjectSet(NULL, data_ctx.get_id(), 0);
       object_set->return_enoent = true;
       object_cacher->start();
     }
+
+    readahead.set_trigger_requests(cct->_conf->rbd_readahead_trigger_requests);
+    readahead.set_max_readahead_size(cct->_conf->rbd_readahead_max_bytes);
   }
 
   ImageCtx::~ImageCtx() {
@@ -112,6 +122,10 @@ namespace librbd {
       delete object_set;
       object_set = NULL;
     }
+    if (persistent_cache) {
+      delete persistent_cache;
+      persistent_cache = NULL;
+    }
     delete[] format_string;
   }
 
@@ -174,6 +188,9 @@ namespace librbd {
     layout.fl_object_size = 1ull << order;
     layout.fl_pg_pool = data_ctx.get_id();  // FIXME: pool id overflow?
 
+    // prefetch whole object sets
+    readahead.set_alignment(layout.fl_object_size * stripe_count);
+
     delete[] format_string;
     size_t len = object_prefix.length() + 16;
     format_string = new char[len];
@@ -191,6 +208,30 @@ namespace librbd {
 		   << dendl;
   }
 
+  void ImageCtx::init_persistent_cache()
+  {
+    const string &base = cct->_conf->rbd_persistent_cache_path;
+    if (base.empty())
+      return;
+
+    // object_prefix is unique within the pool for both formats
+    std::ostringstream path;
+    path << base << "/" << data_ctx.get_id() << "." << object_prefix;
+    persistent_cache = new PersistentCache(*this, path.str(),
+					   cct->_conf->rbd_persistent_cache_size);
+    int r = persistent_cache->init();
+    if (r < 0) {
+      lderr(cct) << "disabling persistent cache: " << cpp_strerror(r)
+		 << dendl;
+      delete persistent_cache;
+      persistent_cache = NULL;
+      return;
+    }
+
+    RWLock::RLocker l(snap_lock);
+    persistent_cache->discard_snaps(snaps);
+  }
+
   void ImageCtx::perf_start(string name) {
     PerfCountersBuilder plb(cct, name, l_librbd_first, l_librbd_last);
 
@@ -215,6 +256,11 @@ namespace librbd {
     plb.add_time_avg(l_librbd_aio_discard_latency, "aio_discard_latency");
     plb.add_u64_counter(l_librbd_aio_flush, "aio_flush");
     plb.add_time_avg(l_librbd_aio_flush_latency, "aio_flush_latency");
+    plb.add_u64_counter(l_librbd_readahead, "readahead");
+    plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes");
+    plb.add_u64_counter(l_librbd_copyup_on_read, "copyup_on_read");
+    plb.add_u64_counter(l_librbd_persistent_cache_hit, "persistent_cache_hit");
+    plb.add_u64_counter(l_librbd_persistent_cache_miss, "persistent_cache_miss");
     plb.add_u64_counter(l_librbd_snap_create, "snap_create");
     plb.add_u64_counter(l_librbd_snap_remove, "snap_remove");
     plb.add_u64_counter(l_librbd_snap_rollback, "snap_rollback");
@@ -235,6 +281,15 @@ namespace librbd {
     extra_read_flags |= flag;
   }
 
+  void ImageCtx::wait_for_pending_copyup() {
+    Mutex::Locker l(copyup_list_lock);
+    while (!copyup_list.empty()) {
+      ldout(cct, 20) << "waiting for " << copyup_list.size()
+		     << " copy-on-read requests" << dendl;
+      copyup_list_cond.Wait(copyup_list_lock);
+    }
+  }
+
   int ImageCtx::get_read_flags(snap_t snap_id) {
     int flags = librados::OPERATION_NOFLAG | extra_read_flags;
     if (snap_id == LIBRADOS_SNAP_HEAD)
@@ -334,9 +389,14 @@ namespace librbd {
   }
 
   uint64_t ImageCtx::get_num_objects() const
+  {
+    return get_num_objects(size);
+  }
+
+  uint64_t ImageCtx::get_num_objects(uint64_t in_size) const
   {
     uint64_t period = get_stripe_period();
-    uint64_t num_periods = (size + period - 1) / period;
+    uint64_t num_periods = (in_size + period - 1) / period;
     return num_periods * stripe_count;
   }
 
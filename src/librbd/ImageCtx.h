@@ -10,9 +10,12 @@
 #include <string>
 #include <vector>
 
+#include "common/Cond.h"
 #include "common/Mutex.h"
+#include "common/Readahead.h"
 #include "common/RWLock.h"
 #include "common/snap_types.h"
+#include "include/atomic.h"
 #include "include/buffer.h"
 #include "include/rbd/librbd.hpp"
 #include "include/rbd_types.h"
@@ -21,6 +24,7 @@
 
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/SnapInfo.h"
 #include "librbd/parent_types.h"
 
@@ -29,6 +33,7 @@ class PerfCounters;
 
 namespace librbd {
 
+  class PersistentCache;
   class WatchCtx;
 
   struct ImageCtx {
@@ -59,7 +64,8 @@ namespace librbd {
 
     /**
      * Lock ordering:
-     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock
+     * md_lock, cache_lock, snap_lock, parent_lock, refresh_lock,
+     * object_map's lock, copyup_list_lock
      */
     RWLock md_lock; // protects access to the mutable image metadata that
                    // isn't guarded by other locks below
@@ -68,6 +74,7 @@ namespace librbd {
     RWLock snap_lock; // protects snapshot-related member variables:
     RWLock parent_lock; // protects parent_md and parent
     Mutex refresh_lock; // protects refresh_seq and last_refresh
+    Mutex copyup_list_lock; // protects copyup_list
 
     unsigned extra_read_flags;
 
@@ -89,6 +96,15 @@ namespace librbd {
     LibrbdWriteback *writeback_handler;
     ObjectCacher::ObjectSet *object_set;
 
+    ObjectMap object_map;
+    PersistentCache *persistent_cache;
+
+    Readahead readahead;
+    atomic64_t total_bytes_read; ///< see rbd_readahead_disable_after_bytes
+
+    std::set<uint64_t> copyup_list; ///< objects being copied up on read
+    Cond copyup_list_cond;
+
     /**
      * Either image_name or image_id must be set.
      * If id is not known, pass the empty std::string,
@@ -99,9 +115,11 @@ namespace librbd {
     ~ImageCtx();
     int init();
     void init_layout();
+    void init_persistent_cache();
     void perf_start(std::string name);
     void perf_stop();
     void set_read_flag(unsigned flag);
+    void wait_for_pending_copyup();
     int get_read_flags(librados::snap_t snap_id);
     int snap_set(std::string in_snap_name);
     void snap_unset();
@@ -115,6 +133,7 @@ namespace librbd {
     uint64_t get_object_size() const;
     string get_object_name(uint64_t num) const;
     uint64_t get_num_objects() const;
+    uint64_t get_num_objects(uint64_t in_size) const;
     uint64_t get_stripe_unit() const;
     uint64_t get_stripe_count() const;
     uint64_t get_stripe_period() const;
@@ -14,6 +14,7 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/internal.h"
 #include "librbd/LibrbdWriteback.h"
+#include "librbd/PersistentCache.h"
 
 #include "include/assert.h"
 
@@ -97,6 +98,12 @@ namespace librbd {
   {
     // on completion, take the mutex and then call onfinish.
     Context *req = new C_Request(m_ictx->cct, onfinish, &m_lock);
+    if (snapid != CEPH_NOSNAP && m_ictx->persistent_cache) {
+      uint64_t object_no = oid_to_object_no(oid.name, m_ictx->object_prefix);
+      m_ictx->persistent_cache->aio_read(oid.name, object_no, snapid, off, len,
+					 pbl, req);
+      return;
+    }
     librados::AioCompletion *rados_completion =
       librados::Rados::aio_create_completion(req, context_cb, NULL);
     librados::ObjectReadOperation op;
@@ -139,6 +146,19 @@ namespace librbd {
 			       uint64_t trunc_size, __u32 trunc_seq,
 			       Context *oncommit)
   {
+    vector<pair<uint64_t, bufferlist> > io_vec(1, make_pair(off, bl));
+    return write_vector(oid, oloc, io_vec, snapc, mtime, trunc_size,
+			trunc_seq, oncommit);
+  }
+
+  tid_t LibrbdWriteback::write_vector(const object_t& oid,
+				      const object_locator_t& oloc,
+				      vector<pair<uint64_t, bufferlist> >& io_vec,
+				      const SnapContext& snapc, utime_t mtime,
+				      uint64_t trunc_size, __u32 trunc_seq,
+				      Context *oncommit)
+  {
+    assert(!io_vec.empty());
     m_ictx->snap_lock.get_read();
     librados::snap_t snap_id = m_ictx->snap_id;
     m_ictx->parent_lock.get_read();
@@ -160,9 +180,11 @@ namespace librbd {
     ldout(m_ictx->cct, 20) << "write will wait for result " << result << dendl;
     C_OrderedWrite *req_comp = new C_OrderedWrite(m_ictx->cct, result, this);
     AioWrite *req = new AioWrite(m_ictx, oid.name,
-				 object_no, off, objectx, object_overlap,
-				 bl, snapc, snap_id,
-				 req_comp);
+				 object_no, io_vec[0].first, objectx,
+				 object_overlap, io_vec[0].second, snapc,
+				 snap_id, req_comp);
+    for (size_t i = 1; i < io_vec.size(); ++i)
+      req->add_extent(io_vec[i].first, io_vec[i].second);
     req->send();
     return ++m_tid;
   }
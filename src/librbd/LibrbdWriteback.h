@@ -37,6 +37,15 @@ namespace librbd {
 			const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
 			__u32 trunc_seq, Context *oncommit);
 
+    virtual bool can_scattered_write() { return true; }
+    // Note that oloc, trunc_size, and trunc_seq are ignored
+    virtual tid_t write_vector(const object_t& oid,
+			       const object_locator_t& oloc,
+			       vector<pair<uint64_t, bufferlist> >& io_vec,
+			       const SnapContext& snapc, utime_t mtime,
+			       uint64_t trunc_size, __u32 trunc_seq,
+			       Context *oncommit);
+
     struct write_result_d {
       bool done;
       int ret;
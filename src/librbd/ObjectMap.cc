@@ -0,0 +1,214 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <iomanip>
+#include <sstream>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/RWLock.h"
+#include "include/rbd_types.h"
+
+#include "cls/rbd/cls_rbd_client.h"
+#include "librbd/ImageCtx.h"
+
+#include "librbd/ObjectMap.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::ObjectMap: "
+
+using std::string;
+using std::vector;
+
+namespace librbd {
+
+  ObjectMap::ObjectMap(ImageCtx &image_ctx)
+    : m_image_ctx(image_ctx),
+      m_lock("librbd::ObjectMap::m_lock"),
+      m_enabled(false), m_loaded(false)
+  {
+  }
+
+  string ObjectMap::object_map_name(const string &image_id, uint64_t snap_id)
+  {
+    string oid(RBD_OBJECT_MAP_PREFIX + image_id);
+    if (snap_id != CEPH_NOSNAP) {
+      std::stringstream snap_suffix;
+      snap_suffix << "." << std::setfill('0') << std::setw(16) << std::hex
+		  << snap_id;
+      oid += snap_suffix.str();
+    }
+    return oid;
+  }
+
+  int ObjectMap::refresh()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    uint64_t snap_id;
+    uint64_t features = 0;
+    {
+      RWLock::RLocker l(m_image_ctx.snap_lock);
+      snap_id = m_image_ctx.snap_id;
+      if (!m_image_ctx.old_format)
+	m_image_ctx.get_features(snap_id, &features);
+    }
+
+    string oid = object_map_name(m_image_ctx.id, snap_id);
+    vector<bool> object_map;
+    int r = 0;
+    if (features & RBD_FEATURE_OBJECT_MAP)
+      r = cls_client::object_map_load(&m_image_ctx.md_ctx, oid, &object_map);
+
+    Mutex::Locker l(m_lock);
+    m_oid = oid;
+    m_enabled = false;
+    m_loaded = false;
+    m_object_map.clear();
+    if ((features & RBD_FEATURE_OBJECT_MAP) == 0)
+      return 0;
+
+    if (r < 0) {
+      lderr(cct) << "error loading object map " << oid << ": "
+		 << cpp_strerror(r) << dendl;
+      if (snap_id == CEPH_NOSNAP && r != -ENOENT) {
+	// skip nothing, but keep updating the OSD copy on every write
+	// in case this was transient
+	m_enabled = true;
+	return r;
+      }
+      // without a map at the head there is nothing to keep up to date
+      return 0;
+    }
+
+    ldout(cct, 20) << "loaded object map " << oid << " covering "
+		   << object_map.size() << " objects" << dendl;
+    m_object_map.swap(object_map);
+    m_enabled = (snap_id == CEPH_NOSNAP);
+    m_loaded = true;
+    return 0;
+  }
+
+  bool ObjectMap::enabled() const
+  {
+    Mutex::Locker l(m_lock);
+    return m_loaded;
+  }
+
+  bool ObjectMap::object_may_exist(uint64_t object_no) const
+  {
+    Mutex::Locker l(m_lock);
+    if (!m_loaded || object_no >= m_object_map.size())
+      return true;
+    return m_object_map[object_no];
+  }
+
+  bool ObjectMap::update_required(uint64_t object_no) const
+  {
+    Mutex::Locker l(m_lock);
+    if (!m_enabled)
+      return false;
+    return !m_loaded || object_no >= m_object_map.size() ||
+	   !m_object_map[object_no];
+  }
+
+  void ObjectMap::aio_update(uint64_t object_no, librados::AioCompletion *c)
+  {
+    ldout(m_image_ctx.cct, 20) << "aio_update " << object_no << dendl;
+    librados::ObjectWriteOperation op;
+    cls_client::object_map_update(&op, object_no, object_no + 1,
+				  RBD_OBJECT_EXISTS);
+    string oid;
+    {
+      Mutex::Locker l(m_lock);
+      oid = m_oid;
+    }
+    int r = m_image_ctx.md_ctx.aio_operate(oid, c, &op);
+    assert(r == 0);
+  }
+
+  void ObjectMap::set_exists(uint64_t object_no)
+  {
+    Mutex::Locker l(m_lock);
+    if (m_loaded && object_no < m_object_map.size())
+      m_object_map[object_no] = true;
+  }
+
+  int ObjectMap::read(uint64_t snap_id, vector<bool> *object_map) const
+  {
+    return cls_client::object_map_load(&m_image_ctx.md_ctx,
+				       object_map_name(m_image_ctx.id, snap_id),
+				       object_map);
+  }
+
+  int ObjectMap::resize(uint64_t object_count)
+  {
+    string oid = object_map_name(m_image_ctx.id, CEPH_NOSNAP);
+    ldout(m_image_ctx.cct, 20) << "resize " << oid << " to " << object_count
+			       << " objects" << dendl;
+    int r = cls_client::object_map_resize(&m_image_ctx.md_ctx, oid,
+					  object_count);
+    if (r < 0)
+      return r;
+
+    Mutex::Locker l(m_lock);
+    if (m_loaded && m_oid == oid)
+      m_object_map.resize(object_count, false);
+    return 0;
+  }
+
+  int ObjectMap::snapshot(uint64_t snap_id, uint64_t object_count,
+			  const vector<bool> &before)
+  {
+    // anything written between reading 'before' and now shows up in
+    // 'after'; anything removed from the head in between is in 'before'.
+    // Writes mark the map before they send the data, so wait for
+    // in-flight updates from writes still using the old snap context.
+    int r = m_image_ctx.md_ctx.aio_flush();
+    if (r < 0)
+      return r;
+    vector<bool> after;
+    r = read(CEPH_NOSNAP, &after);
+    if (r < 0)
+      return r;
+
+    vector<bool> object_map(object_count, false);
+    for (uint64_t i = 0; i < object_count; ++i) {
+      object_map[i] = (i < before.size() && before[i]) ||
+		      (i < after.size() && after[i]);
+    }
+
+    string oid = object_map_name(m_image_ctx.id, snap_id);
+    ldout(m_image_ctx.cct, 20) << "snapshot " << oid << dendl;
+    return cls_client::object_map_save(&m_image_ctx.md_ctx, oid, object_map);
+  }
+
+  int ObjectMap::rollback(uint64_t snap_id, uint64_t object_count)
+  {
+    CephContext *cct = m_image_ctx.cct;
+    vector<bool> object_map;
+    int r = read(snap_id, &object_map);
+    if (r == -ENOENT) {
+      ldout(cct, 2) << "snapshot " << snap_id << " has no object map, "
+		    << "assuming every object exists" << dendl;
+      object_map.assign(object_count, true);
+    } else if (r < 0) {
+      return r;
+    }
+    object_map.resize(object_count, true);
+
+    string oid = object_map_name(m_image_ctx.id, CEPH_NOSNAP);
+    ldout(cct, 20) << "rollback " << oid << " to snapshot " << snap_id
+		   << dendl;
+    r = cls_client::object_map_save(&m_image_ctx.md_ctx, oid, object_map);
+    if (r < 0)
+      return r;
+
+    Mutex::Locker l(m_lock);
+    if (m_loaded && m_oid == oid)
+      m_object_map.swap(object_map);
+    return 0;
+  }
+
+}
@@ -0,0 +1,85 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_OBJECTMAP_H
+#define CEPH_LIBRBD_OBJECTMAP_H
+
+#include "include/int_types.h"
+
+#include <string>
+#include <vector>
+
+#include "common/Mutex.h"
+#include "include/rados/librados.hpp"
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * In-memory copy of an image's object map, for images with
+   * RBD_FEATURE_OBJECT_MAP.
+   *
+   * The object map has one bit per data object.  A clear bit means the
+   * object does not exist; a set bit means it may.  Writes set the bit
+   * on the OSD before they touch a data object whose bit is clear, so
+   * the map never misses an object but can keep a bit set after the
+   * object is gone (e.g. after a discard).  Bits are only cleared by
+   * resize, rollback and removal, which notify other clients so they
+   * reload their copy.
+   *
+   * Each snapshot gets a copy of the map when it is created.  Those
+   * never change, so reads from a snapshot can trust the map; at the
+   * head another client may have set bits we have not seen, so
+   * operations that skip objects based on it refresh() first.
+   */
+  class ObjectMap {
+  public:
+    ObjectMap(ImageCtx &image_ctx);
+
+    static std::string object_map_name(const std::string &image_id,
+				       uint64_t snap_id);
+
+    /// reload the map for the image's current snapshot (or the head)
+    int refresh();
+
+    /// whether the map is loaded and may be used to skip objects
+    bool enabled() const;
+    /// false only if object_no is known not to exist
+    bool object_may_exist(uint64_t object_no) const;
+    /// whether the OSD copy must be updated before writing object_no
+    bool update_required(uint64_t object_no) const;
+
+    /// mark object_no as existing on the OSD, completing c when done
+    void aio_update(uint64_t object_no, librados::AioCompletion *c);
+    /// record that the OSD copy of object_no's bit is set
+    void set_exists(uint64_t object_no);
+
+    /// read the map of a snapshot (or CEPH_NOSNAP) without caching it
+    int read(uint64_t snap_id, std::vector<bool> *object_map) const;
+    /// resize the head map to cover object_count objects
+    int resize(uint64_t object_count);
+    /**
+     * save the map of a snapshot that was just created
+     *
+     * @param snap_id new snapshot
+     * @param object_count number of objects in the snapshot
+     * @param before head map read before the snapshot was created
+     */
+    int snapshot(uint64_t snap_id, uint64_t object_count,
+		 const std::vector<bool> &before);
+    /// replace the head map with the map of a snapshot
+    int rollback(uint64_t snap_id, uint64_t object_count);
+
+  private:
+    ImageCtx &m_image_ctx;
+
+    mutable Mutex m_lock;
+    bool m_enabled;	///< writes must keep the OSD copy up to date
+    bool m_loaded;	///< m_object_map holds the OSD copy
+    std::string m_oid;
+    std::vector<bool> m_object_map;
+  };
+
+}
+
+#endif
@@ -0,0 +1,378 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/perf_counters.h"
+#include "include/encoding.h"
+
+#include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+
+#include "librbd/PersistentCache.h"
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::PersistentCache: "
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+using ceph::bufferlist;
+using librados::snap_t;
+
+namespace librbd {
+
+  static void copy_range(const bufferlist &data, uint64_t off, uint64_t len,
+			 bufferlist *pbl)
+  {
+    pbl->clear();
+    if (off >= data.length())
+      return;
+    bufferlist bl;
+    bl.substr_of(data, off, MIN(len, data.length() - off));
+    pbl->claim_append(bl);
+  }
+
+  class PersistentCache::C_Lookup : public Context {
+  public:
+    C_Lookup(PersistentCache *cache, const string &oid, const key_t &key,
+	     uint64_t off, uint64_t len, bufferlist *pbl, Context *on_finish)
+      : m_cache(cache), m_oid(oid), m_key(key), m_off(off), m_len(len),
+	m_pbl(pbl), m_on_finish(on_finish) {}
+    virtual void finish(int r) {
+      m_cache->lookup(m_oid, m_key, m_off, m_len, m_pbl, m_on_finish);
+    }
+  private:
+    PersistentCache *m_cache;
+    string m_oid;
+    key_t m_key;
+    uint64_t m_off, m_len;
+    bufferlist *m_pbl;
+    Context *m_on_finish;
+  };
+
+  class PersistentCache::ObjectRead {
+  public:
+    ObjectRead(PersistentCache *cache, const string &oid, const key_t &key,
+	       uint64_t off, uint64_t len, bufferlist *pbl, Context *on_finish)
+      : cache(cache), oid(oid), key(key), off(off), len(len), pbl(pbl),
+	on_finish(on_finish) {}
+
+    PersistentCache *cache;
+    string oid;
+    key_t key;
+    uint64_t off, len;
+    bufferlist *pbl;
+    Context *on_finish;
+    bufferlist data;	///< the whole object
+  };
+
+  class PersistentCache::C_Insert : public Context {
+  public:
+    C_Insert(PersistentCache *cache, const key_t &key, const bufferlist &data)
+      : m_cache(cache), m_key(key), m_data(data) {}
+    virtual void finish(int r) {
+      m_cache->write_entry(m_key, m_data);
+    }
+  private:
+    PersistentCache *m_cache;
+    key_t m_key;
+    bufferlist m_data;
+  };
+
+  class PersistentCache::C_DiscardSnaps : public Context {
+  public:
+    C_DiscardSnaps(PersistentCache *cache, const vector<snap_t> &snaps)
+      : m_cache(cache), m_snaps(snaps.begin(), snaps.end()) {}
+    virtual void finish(int r) {
+      m_cache->do_discard_snaps(m_snaps);
+    }
+  private:
+    PersistentCache *m_cache;
+    set<snap_t> m_snaps;
+  };
+
+  PersistentCache::PersistentCache(ImageCtx &image_ctx, const string &path,
+				   uint64_t max_size)
+    : m_image_ctx(image_ctx), m_path(path), m_max_size(max_size),
+      m_size(0), m_finisher(image_ctx.cct)
+  {
+  }
+
+  PersistentCache::~PersistentCache()
+  {
+    m_finisher.wait_for_empty();
+    m_finisher.stop();
+  }
+
+  int PersistentCache::init()
+  {
+    CephContext *cct = m_image_ctx.cct;
+    ldout(cct, 10) << "init " << m_path << " max_size " << m_max_size
+		   << dendl;
+
+    // create the configured directory as well as the image's
+    for (size_t pos = m_path.find('/', 1); ;
+	 pos = m_path.find('/', pos + 1)) {
+      string dir = m_path.substr(0, pos);
+      if (::mkdir(dir.c_str(), 0700) < 0 && errno != EEXIST) {
+	int r = -errno;
+	lderr(cct) << "error creating " << dir << ": " << cpp_strerror(r)
+		   << dendl;
+	return r;
+      }
+      if (pos == string::npos)
+	break;
+    }
+
+    DIR *dir = ::opendir(m_path.c_str());
+    if (!dir) {
+      int r = -errno;
+      lderr(cct) << "error opening " << m_path << ": " << cpp_strerror(r)
+		 << dendl;
+      return r;
+    }
+
+    // oldest first, so they are the first to go
+    std::multimap<time_t, std::pair<key_t, uint64_t> > found;
+    struct dirent *de;
+    while ((de = ::readdir(dir)) != NULL) {
+      string path = m_path + "/" + de->d_name;
+      if (strstr(de->d_name, ".tmp.")) {
+	// an entry that was being written when a client went away
+	::unlink(path.c_str());
+	continue;
+      }
+
+      unsigned long long object_no, snap_id;
+      char extra;
+      if (sscanf(de->d_name, "%llx.%llx%c", &object_no, &snap_id,
+		 &extra) != 2)
+	continue;
+      struct stat st;
+      if (::stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+	continue;
+      found.insert(std::make_pair(st.st_mtime,
+				  std::make_pair(key_t(object_no, snap_id),
+						 (uint64_t)st.st_size)));
+    }
+    ::closedir(dir);
+
+    for (std::multimap<time_t, std::pair<key_t, uint64_t> >::iterator it =
+	   found.begin();
+	 it != found.end(); ++it)
+      add_entry(it->second.first, it->second.second);
+    trim();
+    ldout(cct, 10) << "loaded " << m_entries.size() << " entries, " << m_size
+		   << " bytes" << dendl;
+
+    m_finisher.start();
+    return 0;
+  }
+
+  void PersistentCache::aio_read(const string &oid, uint64_t object_no,
+				 snap_t snap_id, uint64_t off, uint64_t len,
+				 bufferlist *pbl, Context *on_finish)
+  {
+    assert(snap_id != CEPH_NOSNAP);
+    m_finisher.queue(new C_Lookup(this, oid, key_t(object_no, snap_id), off,
+				  len, pbl, on_finish));
+  }
+
+  void PersistentCache::discard_snaps(const vector<snap_t> &snaps)
+  {
+    m_finisher.queue(new C_DiscardSnaps(this, snaps));
+  }
+
+  void PersistentCache::lookup(const string &oid, const key_t &key,
+			       uint64_t off, uint64_t len, bufferlist *pbl,
+			       Context *on_finish)
+  {
+    CephContext *cct = m_image_ctx.cct;
+    bufferlist data;
+    if (read_entry(key, &data)) {
+      ldout(cct, 20) << "hit " << oid << " snap " << key.second << " "
+		     << off << "~" << len << dendl;
+      m_image_ctx.perfcounter->inc(l_librbd_persistent_cache_hit);
+      copy_range(data, off, len, pbl);
+      on_finish->complete(pbl->length());
+      return;
+    }
+
+    ldout(cct, 20) << "miss " << oid << " snap " << key.second << " "
+		   << off << "~" << len << dendl;
+    m_image_ctx.perfcounter->inc(l_librbd_persistent_cache_miss);
+    read_object(new ObjectRead(this, oid, key, off, len, pbl, on_finish));
+  }
+
+  void PersistentCache::read_object(ObjectRead *req)
+  {
+    librados::AioCompletion *rados_completion =
+      librados::Rados::aio_create_completion(req, rados_read_cb, NULL);
+    librados::ObjectReadOperation op;
+    op.read(0, m_image_ctx.get_object_size(), &req->data, NULL);
+    int flags = m_image_ctx.get_read_flags(req->key.second);
+    int r = m_image_ctx.data_ctx.aio_operate(req->oid, rados_completion, &op,
+					     flags, NULL);
+    rados_completion->release();
+    if (r < 0)
+      finish_read_object(req, r);
+  }
+
+  void PersistentCache::rados_read_cb(rados_completion_t c, void *arg)
+  {
+    ObjectRead *req = reinterpret_cast<ObjectRead *>(arg);
+    req->cache->finish_read_object(req, rados_aio_get_return_value(c));
+  }
+
+  void PersistentCache::finish_read_object(ObjectRead *req, int r)
+  {
+    ldout(m_image_ctx.cct, 20) << "read " << req->oid << " snap "
+			       << req->key.second << " r = " << r << dendl;
+    if (r >= 0) {
+      if (req->data.length() <= m_max_size)
+	m_finisher.queue(new C_Insert(this, req->key, req->data));
+      copy_range(req->data, req->off, req->len, req->pbl);
+      r = req->pbl->length();
+    }
+    req->on_finish->complete(r);
+    delete req;
+  }
+
+  bool PersistentCache::read_entry(const key_t &key, bufferlist *data)
+  {
+    CephContext *cct = m_image_ctx.cct;
+    map<key_t, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+      return false;
+
+    string path = entry_path(key);
+    bufferlist bl;
+    string err;
+    int r = bl.read_file(path.c_str(), &err);
+    if (r < 0) {
+      // another client with the same directory may have evicted it
+      ldout(cct, 5) << "error reading " << path << ": " << err << dendl;
+      remove_entry(key);
+      return false;
+    }
+
+    __u8 struct_v = 0;
+    __u32 crc = 0;
+    try {
+      bufferlist::iterator p = bl.begin();
+      ::decode(struct_v, p);
+      ::decode(crc, p);
+      ::decode(*data, p);
+    } catch (const buffer::error &e) {
+      struct_v = 0;
+    }
+    if (struct_v != 1 || data->crc32c(0) != crc) {
+      lderr(cct) << "dropping corrupt cache entry " << path << dendl;
+      data->clear();
+      remove_entry(key);
+      return false;
+    }
+
+    m_lru.splice(m_lru.end(), m_lru, it->second.lru_pos);
+    return true;
+  }
+
+  void PersistentCache::write_entry(const key_t &key, const bufferlist &data)
+  {
+    CephContext *cct = m_image_ctx.cct;
+    // a concurrent miss on the same object may have got here first
+    if (m_entries.count(key))
+      return;
+
+    bufferlist bl;
+    __u8 struct_v = 1;
+    ::encode(struct_v, bl);
+    ::encode((__u32)data.crc32c(0), bl);
+    ::encode(data, bl);
+
+    string path = entry_path(key);
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << getpid() << "." << this;
+    int r = bl.write_file(tmp.str().c_str(), 0600);
+    if (r == 0 && ::rename(tmp.str().c_str(), path.c_str()) < 0)
+      r = -errno;
+    if (r < 0) {
+      lderr(cct) << "error writing " << path << ": " << cpp_strerror(r)
+		 << dendl;
+      ::unlink(tmp.str().c_str());
+      return;
+    }
+
+    ldout(cct, 20) << "cached " << path << " " << data.length() << " bytes"
+		   << dendl;
+    add_entry(key, bl.length());
+    trim();
+  }
+
+  void PersistentCache::add_entry(const key_t &key, uint64_t size)
+  {
+    Entry entry;
+    entry.size = size;
+    entry.lru_pos = m_lru.insert(m_lru.end(), key);
+    m_entries[key] = entry;
+    m_size += size;
+  }
+
+  void PersistentCache::remove_entry(const key_t &key)
+  {
+    map<key_t, Entry>::iterator it = m_entries.find(key);
+    assert(it != m_entries.end());
+    string path = entry_path(key);
+    if (::unlink(path.c_str()) < 0 && errno != ENOENT)
+      lderr(m_image_ctx.cct) << "error removing " << path << ": "
+			     << cpp_strerror(-errno) << dendl;
+    m_size -= it->second.size;
+    m_lru.erase(it->second.lru_pos);
+    m_entries.erase(it);
+  }
+
+  void PersistentCache::trim()
+  {
+    while (m_size > m_max_size && !m_lru.empty())
+      remove_entry(m_lru.front());
+  }
+
+  void PersistentCache::do_discard_snaps(const set<snap_t> &snaps)
+  {
+    vector<key_t> discard;
+    for (map<key_t, Entry>::iterator it = m_entries.begin();
+	 it != m_entries.end(); ++it) {
+      if (snaps.count(it->first.second) == 0)
+	discard.push_back(it->first);
+    }
+    if (!discard.empty())
+      ldout(m_image_ctx.cct, 10) << "discarding " << discard.size()
+				 << " entries of removed snapshots" << dendl;
+    for (vector<key_t>::iterator it = discard.begin(); it != discard.end();
+	 ++it)
+      remove_entry(*it);
+  }
+
+  string PersistentCache::entry_path(const key_t &key) const
+  {
+    char name[40];
+    snprintf(name, sizeof(name), "%llx.%llx",
+	     (unsigned long long)key.first, (unsigned long long)key.second);
+    return m_path + "/" + name;
+  }
+
+}
@@ -0,0 +1,109 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef CEPH_LIBRBD_PERSISTENTCACHE_H
+#define CEPH_LIBRBD_PERSISTENTCACHE_H
+
+#include "include/int_types.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/Finisher.h"
+#include "include/buffer.h"
+#include "include/Context.h"
+#include "include/rados/librados.hpp"
+
+namespace librbd {
+
+  struct ImageCtx;
+
+  /**
+   * Cache of data objects read from snapshots, kept in a local
+   * directory (rbd_persistent_cache_path) so it survives the process.
+   *
+   * Data at a snapshot never changes, so entries never need to be
+   * invalidated by writes.  The head is not cached for the same reason:
+   * other clients may write it at any time.  The parent of a clone is
+   * always read at a snapshot, so a parent shared by the clones on a
+   * host is served from local disk once it is warm.
+   *
+   * Each entry is a whole object at one snapshot, in a file named
+   * <object number>.<snap id> in a directory per image.  Entries are
+   * written to a temporary file and renamed into place, and carry a
+   * crc32c of their data, so a crash leaves either no entry or one that
+   * is found to be bad and dropped.  The directory is the only metadata:
+   * it is scanned on init(), and the least recently used entries are
+   * removed once it grows past rbd_persistent_cache_size.  Entries of
+   * removed snapshots are dropped when the image is refreshed.
+   *
+   * All file I/O happens in the cache's finisher thread, and the index
+   * is only touched from there once init() returns.
+   */
+  class PersistentCache {
+  public:
+    PersistentCache(ImageCtx &image_ctx, const std::string &path,
+		    uint64_t max_size);
+    ~PersistentCache();
+
+    /// create the directory and load the entries already in it
+    int init();
+
+    /**
+     * read off~len of an object at a snapshot, from the cache or, on a
+     * miss, by reading the whole object from the OSDs and caching it
+     *
+     * on_finish is completed from another thread with the number of
+     * bytes read, -ENOENT if the object does not exist or another error
+     */
+    void aio_read(const std::string &oid, uint64_t object_no,
+		  librados::snap_t snap_id, uint64_t off, uint64_t len,
+		  ceph::bufferlist *pbl, Context *on_finish);
+
+    /// drop the entries of snapshots that are not in snaps
+    void discard_snaps(const std::vector<librados::snap_t> &snaps);
+
+  private:
+    typedef std::pair<uint64_t, librados::snap_t> key_t;
+
+    struct Entry {
+      uint64_t size;
+      std::list<key_t>::iterator lru_pos;
+    };
+
+    class C_Lookup;
+    class ObjectRead;
+    class C_Insert;
+    class C_DiscardSnaps;
+
+    static void rados_read_cb(rados_completion_t c, void *arg);
+
+    void lookup(const std::string &oid, const key_t &key, uint64_t off,
+		uint64_t len, ceph::bufferlist *pbl, Context *on_finish);
+    void read_object(ObjectRead *req);
+    void finish_read_object(ObjectRead *req, int r);
+    bool read_entry(const key_t &key, ceph::bufferlist *data);
+    void write_entry(const key_t &key, const ceph::bufferlist &data);
+    void add_entry(const key_t &key, uint64_t size);
+    void remove_entry(const key_t &key);
+    void trim();
+    void do_discard_snaps(const std::set<librados::snap_t> &snaps);
+    std::string entry_path(const key_t &key) const;
+
+    ImageCtx &m_image_ctx;
+    std::string m_path;
+    uint64_t m_max_size;
+
+    std::map<key_t, Entry> m_entries;
+    std::list<key_t> m_lru;	///< least recently used first
+    uint64_t m_size;		///< bytes in all entries
+
+    Finisher m_finisher;
+  };
+
+}
+
+#endif
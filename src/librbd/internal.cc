@@ -17,6 +17,8 @@
 #include "librbd/AioCompletion.h"
 #include "librbd/AioRequest.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/ObjectMap.h"
+#include "librbd/PersistentCache.h"
 
 #include "librbd/internal.h"
 #include "librbd/parent_types.h"
@@ -145,7 +147,98 @@ namespace librbd {
     return 0;
   }
 
-  void trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx)
+  /**
+   * Runs an asynchronous operation on each object in a range, keeping
+   * at most rbd_concurrent_management_ops of them in flight.  This is
+   * what the bulk image operations (trim, rollback, flatten) use to
+   * walk the objects of an image.
+   *
+   * Subclasses implement send_object() to start the operation on one
+   * object and complete on_finish when it is done.  If send_object()
+   * returns an error it must not complete on_finish.
+   */
+  class ObjectWalker {
+  public:
+    /**
+     * @param skip_nonexistent skip objects the object map says do not
+     * exist; the caller must have refreshed the map
+     * @param ignore_enoent don't treat -ENOENT from an object as an error
+     */
+    ObjectWalker(ImageCtx *ictx, bool skip_nonexistent, bool ignore_enoent)
+      : m_ictx(ictx), m_skip_nonexistent(skip_nonexistent),
+	m_ignore_enoent(ignore_enoent) {}
+    virtual ~ObjectWalker() {}
+
+    /**
+     * Walk objects [start_object_no, end_object_no).  Progress is
+     * reported in objects.  If prog_ctx returns a negative value no more
+     * objects are started, and that value is returned once the ones in
+     * flight have finished.
+     *
+     * @returns 0 on success, the first error otherwise
+     */
+    int walk(uint64_t start_object_no, uint64_t end_object_no,
+	     ProgressContext &prog_ctx)
+    {
+      CephContext *cct = m_ictx->cct;
+      SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops,
+			      m_ignore_enoent);
+      uint64_t total = end_object_no - start_object_no;
+      int r = 0;
+      for (uint64_t i = start_object_no; i < end_object_no; ++i) {
+	if (m_skip_nonexistent && !m_ictx->object_map.object_may_exist(i)) {
+	  ldout(cct, 20) << "skipping nonexistent object " << i << dendl;
+	} else {
+	  Context *on_finish = new C_SimpleThrottle(&throttle);
+	  r = send_object(i, on_finish);
+	  if (r < 0) {
+	    delete on_finish;
+	    throttle.end_op(r);
+	    break;
+	  }
+	}
+
+	r = prog_ctx.update_progress(i - start_object_no + 1, total);
+	if (r < 0) {
+	  ldout(cct, 2) << "cancelled after " << (i - start_object_no + 1)
+			<< " of " << total << " objects: " << cpp_strerror(r)
+			<< dendl;
+	  break;
+	}
+	r = 0;
+      }
+
+      int ret = throttle.wait_for_ret();
+      return r < 0 ? r : ret;
+    }
+
+  protected:
+    virtual int send_object(uint64_t object_no, Context *on_finish) = 0;
+
+    ImageCtx *m_ictx;
+
+  private:
+    bool m_skip_nonexistent;
+    bool m_ignore_enoent;
+  };
+
+  class RemoveObjectWalker : public ObjectWalker {
+  public:
+    RemoveObjectWalker(ImageCtx *ictx)
+      : ObjectWalker(ictx, true, true) {}
+
+  protected:
+    virtual int send_object(uint64_t object_no, Context *on_finish) {
+      librados::AioCompletion *rados_completion =
+	librados::Rados::aio_create_completion(on_finish, NULL, rados_ctx_cb);
+      int r = m_ictx->data_ctx.aio_remove(m_ictx->get_object_name(object_no),
+					  rados_completion);
+      rados_completion->release();
+      return r;
+    }
+  };
+
+  int trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx)
   {
     CephContext *cct = (CephContext *)ictx->data_ctx.cct();
 
@@ -156,7 +249,6 @@ namespace librbd {
     // first object we can delete free and clear
     uint64_t delete_start = num_period * ictx->get_stripe_count();
     uint64_t num_objects = ictx->get_num_objects();
-    uint64_t object_size = ictx->get_object_size();
 
     ldout(cct, 10) << "trim_image " << size << " -> " << newsize
 		   << " periods " << num_period
@@ -165,23 +257,25 @@ namespace librbd {
 		   << " to " << (num_objects-1)
 		   << dendl;
 
-    SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops, true);
+    // pick up objects other clients created, so that we only skip
+    // objects that really do not exist
+    ictx->object_map.refresh();
+
+    int r;
     if (delete_start < num_objects) {
       ldout(cct, 2) << "trim_image objects " << delete_start << " to "
 		    << (num_objects - 1) << dendl;
-      for (uint64_t i = delete_start; i < num_objects; ++i) {
-	string oid = ictx->get_object_name(i);
-	Context *req_comp = new C_SimpleThrottle(&throttle);
-	librados::AioCompletion *rados_completion =
-	  librados::Rados::aio_create_completion(req_comp, NULL, rados_ctx_cb);
-	ictx->data_ctx.aio_remove(oid, rados_completion);
-	rados_completion->release();
-	prog_ctx.update_progress((i - delete_start) * object_size,
-				 (num_objects - delete_start) * object_size);
+      RemoveObjectWalker walker(ictx);
+      r = walker.walk(delete_start, num_objects, prog_ctx);
+      if (r < 0) {
+	lderr(cct) << "failed to remove some object(s): " << cpp_strerror(r)
+		   << dendl;
+	return r;
       }
     }
 
     // discard the weird boundary, if any
+    SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops, true);
     if (delete_off > newsize) {
       vector<ObjectExtent> extents;
       Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
@@ -190,6 +284,8 @@ namespace librbd {
       for (vector<ObjectExtent>::iterator p = extents.begin();
 	   p != extents.end(); ++p) {
 	ldout(ictx->cct, 20) << " ex " << *p << dendl;
+	if (!ictx->object_map.object_may_exist(p->objectno))
+	  continue;
 	Context *req_comp = new C_SimpleThrottle(&throttle);
 	librados::AioCompletion *rados_completion =
 	  librados::Rados::aio_create_completion(req_comp, NULL, rados_ctx_cb);
@@ -203,11 +299,13 @@ namespace librbd {
 	rados_completion->release();
       }
     }
-    int r = throttle.wait_for_ret();
+    r = throttle.wait_for_ret();
     if (r < 0) {
-      lderr(cct) << "warning: failed to remove some object(s): "
-		 << cpp_strerror(r) << dendl;
+      lderr(cct) << "failed to trim some object(s): " << cpp_strerror(r)
+		 << dendl;
+      return r;
     }
+    return 0;
   }
 
   int read_rbd_info(IoCtx& io_ctx, const string& info_oid,
@@ -321,30 +419,35 @@ namespace librbd {
     return io_ctx.tmap_update(RBD_DIRECTORY, cmdbl);
   }
 
-  int rollback_image(ImageCtx *ictx, uint64_t snap_id,
-		     ProgressContext& prog_ctx)
-  {
-    uint64_t numseg = ictx->get_num_objects();
-    uint64_t bsize = ictx->get_object_size();
-    int r;
-    CephContext *cct = ictx->cct;
-    SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops, true);
+  class RollbackObjectWalker : public ObjectWalker {
+  public:
+    RollbackObjectWalker(ImageCtx *ictx, uint64_t snap_id)
+      : ObjectWalker(ictx, false, true), m_snap_id(snap_id) {}
 
-    for (uint64_t i = 0; i < numseg; i++) {
-      string oid = ictx->get_object_name(i);
-      Context *req_comp = new C_SimpleThrottle(&throttle);
+  protected:
+    virtual int send_object(uint64_t object_no, Context *on_finish) {
+      string oid = m_ictx->get_object_name(object_no);
       librados::AioCompletion *rados_completion =
-	librados::Rados::aio_create_completion(req_comp, NULL, rados_ctx_cb);
+	librados::Rados::aio_create_completion(on_finish, NULL, rados_ctx_cb);
       librados::ObjectWriteOperation op;
-      op.selfmanaged_snap_rollback(snap_id);
-      ictx->data_ctx.aio_operate(oid, rados_completion, &op);
-      ldout(cct, 10) << "scheduling selfmanaged_snap_rollback on "
-		     << oid << " to " << snap_id << dendl;
+      op.selfmanaged_snap_rollback(m_snap_id);
+      ldout(m_ictx->cct, 10) << "scheduling selfmanaged_snap_rollback on "
+			     << oid << " to " << m_snap_id << dendl;
+      int r = m_ictx->data_ctx.aio_operate(oid, rados_completion, &op);
       rados_completion->release();
-      prog_ctx.update_progress(i * bsize, numseg * bsize);
+      return r;
     }
 
-    r = throttle.wait_for_ret();
+  private:
+    uint64_t m_snap_id;
+  };
+
+  int rollback_image(ImageCtx *ictx, uint64_t snap_id,
+		     ProgressContext& prog_ctx)
+  {
+    CephContext *cct = ictx->cct;
+    RollbackObjectWalker walker(ictx, snap_id);
+    int r = walker.walk(0, ictx->get_num_objects(), prog_ctx);
     if (r < 0) {
       ldout(cct, 10) << "failed to rollback at least one object: "
 		     << cpp_strerror(r) << dendl;
@@ -457,15 +560,53 @@ namespace librbd {
     if (r < 0)
       return r;
 
-    RWLock::RLocker l(ictx->md_lock);
-    do {
-      r = add_snap(ictx, snap_name);
-    } while (r == -ESTALE);
+    bool object_map = false;
+    vector<bool> before;
+    {
+      RWLock::RLocker l(ictx->md_lock);
+      if (!ictx->old_format && (ictx->features & RBD_FEATURE_OBJECT_MAP)) {
+	r = ictx->object_map.read(CEPH_NOSNAP, &before);
+	if (r < 0 && r != -ENOENT) {
+	  lderr(ictx->cct) << "error reading object map: " << cpp_strerror(r)
+			   << dendl;
+	  return r;
+	}
+	object_map = (r == 0);
+      }
 
-    if (r < 0)
-      return r;
+      do {
+	r = add_snap(ictx, snap_name);
+      } while (r == -ESTALE);
 
-    notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
+      if (r < 0)
+	return r;
+
+      notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
+    }
+
+    if (object_map) {
+      // refreshing flushes writes made with the old snap context, so
+      // every object in the snapshot is in the head map by now
+      r = ictx_check(ictx);
+      if (r < 0)
+	return r;
+
+      RWLock::RLocker l(ictx->md_lock);
+      ictx->snap_lock.get_read();
+      snap_t snap_id = ictx->get_snap_id(snap_name);
+      uint64_t object_count = 0;
+      if (snap_id != CEPH_NOSNAP)
+	object_count = ictx->get_num_objects(ictx->get_image_size(snap_id));
+      ictx->snap_lock.put_read();
+      if (snap_id != CEPH_NOSNAP) {
+	r = ictx->object_map.snapshot(snap_id, object_count, before);
+	if (r < 0) {
+	  // reads from the snapshot just won't skip anything
+	  lderr(ictx->cct) << "error saving snapshot object map: "
+			   << cpp_strerror(r) << dendl;
+	}
+      }
+    }
 
     ictx->perfcounter->inc(l_librbd_snap_create);
     return 0;
@@ -537,6 +678,14 @@ namespace librbd {
     if (r < 0)
       return r;
 
+    if (!ictx->old_format) {
+      r = ictx->md_ctx.remove(ObjectMap::object_map_name(ictx->id, snap_id));
+      if (r < 0 && r != -ENOENT) {
+	lderr(ictx->cct) << "error removing snapshot object map: "
+			 << cpp_strerror(r) << dendl;
+      }
+    }
+
     notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
 
     ictx->perfcounter->inc(l_librbd_snap_remove);
@@ -792,6 +941,22 @@ reprotect_and_return_err:
       }
     }
 
+    if (features & RBD_FEATURE_OBJECT_MAP) {
+      uint64_t su = stripe_unit ? stripe_unit : (1ull << order);
+      uint64_t sc = stripe_count ? stripe_count : 1;
+      uint64_t period = su * sc;
+      uint64_t num_objects = (size + period - 1) / period * sc;
+      r = cls_client::object_map_resize(&io_ctx,
+					ObjectMap::object_map_name(id,
+								   CEPH_NOSNAP),
+					num_objects);
+      if (r < 0) {
+	lderr(cct) << "error creating object map: " << cpp_strerror(r)
+		   << dendl;
+	goto err_remove_header;
+      }
+    }
+
     ldout(cct, 2) << "done." << dendl;
     return 0;
 
@@ -1379,8 +1544,14 @@ reprotect_and_return_err:
       assert(watchers.size() == 1);
 
       ictx->md_lock.get_read();
-      trim_image(ictx, 0, prog_ctx);
+      r = trim_image(ictx, 0, prog_ctx);
       ictx->md_lock.put_read();
+      if (r < 0) {
+	lderr(cct) << "error removing image data: " << cpp_strerror(r)
+		   << dendl;
+	close_image(ictx);
+	return r;
+      }
 
       ictx->parent_lock.get_read();
       // struct assignment
@@ -1396,6 +1567,16 @@ reprotect_and_return_err:
       }
       close_image(ictx);
 
+      if (!old_format) {
+	ldout(cct, 2) << "removing object map..." << dendl;
+	r = io_ctx.remove(ObjectMap::object_map_name(id, CEPH_NOSNAP));
+	if (r < 0 && r != -ENOENT) {
+	  lderr(cct) << "error removing object map: " << cpp_strerror(-r)
+		     << dendl;
+	  return r;
+	}
+      }
+
       ldout(cct, 2) << "removing header..." << dendl;
       r = io_ctx.remove(header_oid);
       if (r < 0 && r != -ENOENT) {
@@ -1451,18 +1632,32 @@ reprotect_and_return_err:
       return 0;
     }
 
+    bool object_map = !ictx->old_format &&
+      (ictx->features & RBD_FEATURE_OBJECT_MAP);
+    int r;
     if (size > ictx->size) {
       ldout(cct, 2) << "expanding image " << ictx->size << " -> " << size
 		    << dendl;
       // TODO: make ictx->set_size
+      // the new objects must be in the map before anyone can write them
+      if (object_map) {
+	r = ictx->object_map.resize(ictx->get_num_objects(size));
+	if (r < 0) {
+	  lderr(cct) << "error resizing object map: " << cpp_strerror(r)
+		     << dendl;
+	  return r;
+	}
+      }
     } else {
       ldout(cct, 2) << "shrinking image " << ictx->size << " -> " << size
 		    << dendl;
-      trim_image(ictx, size, prog_ctx);
+      r = trim_image(ictx, size, prog_ctx);
+      if (r < 0)
+	return r;
     }
+    bool shrink = size < ictx->size;
     ictx->size = size;
 
-    int r;
     if (ictx->old_format) {
       // rewrite header
       bufferlist bl;
@@ -1480,10 +1675,18 @@ reprotect_and_return_err:
     if (r < 0) {
       lderr(cct) << "error writing header: " << cpp_strerror(-r) << dendl;
       return r;
-    } else {
-      notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
     }
 
+    if (shrink && object_map) {
+      // the trimmed objects are gone, so they drop off the map
+      r = ictx->object_map.resize(ictx->get_num_objects());
+      if (r < 0) {
+	lderr(cct) << "error resizing object map: " << cpp_strerror(r)
+		   << dendl;
+      }
+    }
+    notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
+
     return 0;
   }
 
@@ -1800,8 +2003,15 @@ reprotect_and_return_err:
       }
 
       ictx->data_ctx.selfmanaged_snap_set_write_ctx(ictx->snapc.seq, ictx->snaps);
+
+      if (ictx->persistent_cache)
+	ictx->persistent_cache->discard_snaps(ictx->snaps);
     } // release snap_lock
 
+    int r = ictx->object_map.refresh();
+    if (r < 0)
+      return r;
+
     if (new_snap) {
       _flush(ictx);
     }
@@ -1864,6 +2074,15 @@ reprotect_and_return_err:
       return r;
     }
 
+    if (!ictx->old_format && (ictx->features & RBD_FEATURE_OBJECT_MAP)) {
+      r = ictx->object_map.rollback(snap_id, ictx->get_num_objects());
+      if (r < 0) {
+	lderr(cct) << "Error rolling back object map: " << cpp_strerror(-r)
+		   << dendl;
+	return r;
+      }
+    }
+
     notify_change(ictx->md_ctx, ictx->header_oid, NULL, ictx);
 
     ictx->perfcounter->inc(l_librbd_snap_rollback);
@@ -1891,6 +2110,9 @@ reprotect_and_return_err:
     return ret;
   }
 
+  static int copy_image(ImageCtx *src, ImageCtx *dest, bool dest_is_new,
+			ProgressContext &prog_ctx);
+
   int copy(ImageCtx *src, IoCtx& dest_md_ctx, const char *destname,
 	   ProgressContext &prog_ctx)
   {
@@ -1921,7 +2143,7 @@ reprotect_and_return_err:
       return r;
     }
 
-    r = copy(src, dest, prog_ctx);
+    r = copy_image(src, dest, true, prog_ctx);
     close_image(dest);
     return r;
   }
@@ -1972,7 +2194,12 @@ reprotect_and_return_err:
     bufferlist *m_bl;
   };
 
-  int copy(ImageCtx *src, ImageCtx *dest, ProgressContext &prog_ctx)
+  /**
+   * @param dest_is_new dest was just created, so regions of src that
+   * are known to be zero do not need to be written
+   */
+  static int copy_image(ImageCtx *src, ImageCtx *dest, bool dest_is_new,
+			ProgressContext &prog_ctx)
   {
     src->md_lock.get_read();
     src->snap_lock.get_read();
@@ -1992,11 +2219,37 @@ reprotect_and_return_err:
 		 << dest_size << dendl;
       return -EINVAL;
     }
-    int r;
+    int r = src->object_map.refresh();
+    if (r < 0)
+      return r;
+    uint64_t parent_overlap = 0;
+    {
+      RWLock::RLocker l(src->snap_lock);
+      RWLock::RLocker l2(src->parent_lock);
+      src->get_parent_overlap(src->snap_id, &parent_overlap);
+    }
+
     SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops, false);
     uint64_t period = src->get_stripe_period();
+    uint64_t stripe_count = src->get_stripe_count();
     for (uint64_t offset = 0; offset < src_size; offset += period) {
       uint64_t len = min(period, src_size - offset);
+
+      // nothing to copy if none of the objects backing this period
+      // exist and the parent has no data here
+      if (dest_is_new && offset >= parent_overlap) {
+	uint64_t object_no = offset / period * stripe_count;
+	bool may_exist = false;
+	for (uint64_t i = 0; i < stripe_count && !may_exist; ++i)
+	  may_exist = src->object_map.object_may_exist(object_no + i);
+	if (!may_exist) {
+	  r = prog_ctx.update_progress(offset, src_size);
+	  if (r < 0)
+	    break;
+	  continue;
+	}
+      }
+
       bufferlist *bl = new bufferlist();
       Context *ctx = new C_CopyRead(&throttle, dest, offset, bl);
       AioCompletion *comp = aio_create_completion_internal(ctx, rbd_ctx_cb);
@@ -2010,33 +2263,47 @@ reprotect_and_return_err:
 		   << cpp_strerror(r) << dendl;
 	return r;
       }
-      prog_ctx.update_progress(offset, src_size);
+      r = prog_ctx.update_progress(offset, src_size);
+      if (r < 0)
+	break;
     }
 
+    if (r < 0) {
+      ldout(cct, 2) << "copy cancelled: " << cpp_strerror(r) << dendl;
+      throttle.wait_for_ret();
+      return r;
+    }
     r = throttle.wait_for_ret();
     if (r >= 0)
       prog_ctx.update_progress(src_size, src_size);
     return r;
   }
 
+  int copy(ImageCtx *src, ImageCtx *dest, ProgressContext &prog_ctx)
+  {
+    return copy_image(src, dest, false, prog_ctx);
+  }
+
   // common snap_set functionality for snap_set and open_image
 
   int _snap_set(ImageCtx *ictx, const char *snap_name)
   {
-    RWLock::WLocker l1(ictx->snap_lock);
-    RWLock::WLocker l2(ictx->parent_lock);
-    int r;
-    if ((snap_name != NULL) && (strlen(snap_name) != 0)) {
-      r = ictx->snap_set(snap_name);
-    } else {
-      ictx->snap_unset();
-      r = 0;
-    }
-    if (r < 0) {
-      return r;
+    {
+      RWLock::WLocker l1(ictx->snap_lock);
+      RWLock::WLocker l2(ictx->parent_lock);
+      int r;
+      if ((snap_name != NULL) && (strlen(snap_name) != 0)) {
+	r = ictx->snap_set(snap_name);
+      } else {
+	ictx->snap_unset();
+	r = 0;
+      }
+      if (r < 0) {
+	return r;
+      }
+      refresh_parent(ictx);
     }
-    refresh_parent(ictx);
-    return 0;
+    return ictx->object_map.refresh();
   }
 
   int snap_set(ImageCtx *ictx, const char *snap_name)
@@ -2081,6 +2348,8 @@ reprotect_and_return_err:
     if (r < 0)
       goto err_close;
 
+    ictx->init_persistent_cache();
+
     if ((r = _snap_set(ictx, ictx->snap_name.c_str())) < 0)
       goto err_close;
 
@@ -2094,6 +2363,8 @@ reprotect_and_return_err:
   void close_image(ImageCtx *ictx)
   {
     ldout(ictx->cct, 20) << "close_image " << ictx << dendl;
+    ictx->readahead.wait_for_pending();
+    ictx->wait_for_pending_copyup();
     if (ictx->object_cacher)
       ictx->shutdown_cache(); // implicitly flushes
     else
@@ -2111,6 +2382,58 @@ reprotect_and_return_err:
   }
 
   // 'flatten' child image by copying all parent's blocks
+  class FlattenObjectWalker : public ObjectWalker {
+  public:
+    FlattenObjectWalker(ImageCtx *ictx, const ::SnapContext &snapc,
+			uint64_t object_size, uint64_t overlap)
+      : ObjectWalker(ictx, false, false), m_snapc(snapc),
+	m_object_size(object_size), m_overlap(overlap), m_parent_gone(false) {}
+
+    bool parent_gone() const {
+      return m_parent_gone;
+    }
+
+  protected:
+    virtual int send_object(uint64_t object_no, Context *on_finish) {
+      {
+	RWLock::RLocker l(m_ictx->parent_lock);
+	// stop early if the parent went away - it just means
+	// another flatten finished first
+	if (!m_ictx->parent) {
+	  m_parent_gone = true;
+	  return -ENOENT;
+	}
+      }
+
+      // map child object onto the parent
+      vector<pair<uint64_t,uint64_t> > objectx;
+      Striper::extent_to_file(m_ictx->cct, &m_ictx->layout,
+			      object_no, 0, m_object_size, objectx);
+      uint64_t object_overlap = m_ictx->prune_parent_extents(objectx,
+							     m_overlap);
+      assert(object_overlap <= m_object_size);
+
+      // an empty write copies the object up without changing it
+      bufferlist bl;
+      string oid = m_ictx->get_object_name(object_no);
+      AioWrite *req = new AioWrite(m_ictx, oid, object_no, 0, objectx,
+				   object_overlap, bl, m_snapc, CEPH_NOSNAP,
+				   on_finish);
+      int r = req->send();
+      if (r < 0) {
+	lderr(m_ictx->cct) << "failed to flatten object " << oid << dendl;
+	delete req;
+      }
+      return r;
+    }
+
+  private:
+    ::SnapContext m_snapc;
+    uint64_t m_object_size;
+    uint64_t m_overlap;
+    bool m_parent_gone;
+  };
+
   int flatten(ImageCtx *ictx, ProgressContext &prog_ctx)
   {
     CephContext *cct = ictx->cct;
@@ -2159,46 +2482,16 @@ reprotect_and_return_err:
       overlap_objects = overlap_periods * ictx->get_stripe_count();
     }
 
-    SimpleThrottle throttle(cct->_conf->rbd_concurrent_management_ops, false);
-
-    for (uint64_t ono = 0; ono < overlap_objects; ono++) {
-      {
-	RWLock::RLocker l(ictx->parent_lock);
-	// stop early if the parent went away - it just means
-	// another flatten finished first, so this one is useless.
-	if (!ictx->parent) {
-	  r = 0;
-	  goto err;
-	}
-      }
-
-      // map child object onto the parent
-      vector<pair<uint64_t,uint64_t> > objectx;
-      Striper::extent_to_file(cct, &ictx->layout,
-			    ono, 0, object_size,
-			    objectx);
-      uint64_t object_overlap = ictx->prune_parent_extents(objectx, overlap);
-      assert(object_overlap <= object_size);
-
-      bufferlist bl;
-      string oid = ictx->get_object_name(ono);
-      Context *comp = new C_SimpleThrottle(&throttle);
-      AioWrite *req = new AioWrite(ictx, oid, ono, 0, objectx, object_overlap,
-				   bl, snapc, CEPH_NOSNAP, comp);
-      r = req->send();
-      if (r < 0) {
-	lderr(cct) << "failed to flatten object " << oid << dendl;
-	goto err;
-      }
-
-      prog_ctx.update_progress(ono, overlap_objects);
+    FlattenObjectWalker walker(ictx, snapc, object_size, overlap);
+    r = walker.walk(0, overlap_objects, prog_ctx);
+    if (walker.parent_gone()) {
+      // another flatten finished first, so this one is useless
+      return 0;
     }
-
-    r = throttle.wait_for_ret();
     if (r < 0) {
       lderr(cct) << "failed to flatten at least one object: "
 		 << cpp_strerror(r) << dendl;
-      goto err;
+      return r;
     }
 
     // remove parent from this (base) image
@@ -2228,10 +2521,6 @@ reprotect_and_return_err:
     ldout(cct, 20) << "finished flattening" << dendl;
 
     return 0;
-
-  err:
-    throttle.wait_for_ret();
-    return r;
   }
 
   int list_lockers(ImageCtx *ictx,
@@ -2495,94 +2784,158 @@ reprotect_and_return_err:
 	return r;
     }
 
+    // objects that exist in neither object map have nothing to report
+    // beyond the parent diff, so there is no need to list their snaps
+    bool use_object_map = false;
+    vector<bool> end_object_map, from_object_map;
+    uint64_t end_features = 0;
+    ictx->snap_lock.get_read();
+    if (!ictx->old_format)
+      ictx->get_features(end_snap_id, &end_features);
+    ictx->snap_lock.put_read();
+    if (end_features & RBD_FEATURE_OBJECT_MAP) {
+      use_object_map = ictx->object_map.read(end_snap_id, &end_object_map) == 0;
+      if (use_object_map && from_snap_id != 0)
+	use_object_map = ictx->object_map.read(from_snap_id,
+					       &from_object_map) == 0;
+    }
+
     uint64_t period = ictx->get_stripe_period();
+    // list the snaps of the objects in several periods at once, keeping
+    // about rbd_concurrent_management_ops requests in flight
+    uint64_t batch_periods =
+      MAX(1, ictx->cct->_conf->rbd_concurrent_management_ops /
+	     ictx->get_stripe_count());
     uint64_t left = len;
 
     while (left > 0) {
-      uint64_t period_off = off - (off % period);
-      uint64_t read_len = min(period_off + period - off, left);
+      vector<pair<uint64_t, map<object_t,vector<ObjectExtent> > > > batch;
+      map<object_t, librados::snap_set_t> snap_sets;
+      map<object_t, librados::AioCompletion*> completions;
+      map<object_t, int> results;
+      for (uint64_t i = 0; i < batch_periods && left > 0; ++i) {
+	uint64_t period_off = off - (off % period);
+	uint64_t read_len = min(period_off + period - off, left);
+
+	// map to extents
+	batch.push_back(make_pair(off, map<object_t,vector<ObjectExtent> >()));
+	map<object_t,vector<ObjectExtent> > &object_extents =
+	  batch.back().second;
+	Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
+				 off, read_len, 0, object_extents, 0);
+
+	// start getting snap info for each object
+	for (map<object_t,vector<ObjectExtent> >::iterator p = object_extents.begin();
+	     p != object_extents.end();
+	     ++p) {
+	  uint64_t object_no = p->second[0].objectno;
+	  if (use_object_map &&
+	      (object_no < end_object_map.size() && !end_object_map[object_no]) &&
+	      (from_snap_id == 0 || (object_no < from_object_map.size() &&
+				     !from_object_map[object_no]))) {
+	    ldout(ictx->cct, 20) << "  object map says " << p->first
+				 << " does not exist" << dendl;
+	    results[p->first] = -ENOENT;
+	    continue;
+	  }
+	  librados::ObjectReadOperation op;
+	  op.list_snaps(&snap_sets[p->first], NULL);
+	  librados::AioCompletion *c = librados::Rados::aio_create_completion();
+	  r = head_ctx.aio_operate(p->first.name, c, &op, NULL);
+	  assert(r == 0);
+	  completions[p->first] = c;
+	}
 
-      // map to extents
-      map<object_t,vector<ObjectExtent> > object_extents;
-      Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
-			       off, read_len, 0, object_extents, 0);
-
-      // get snap info for each object
-      for (map<object_t,vector<ObjectExtent> >::iterator p = object_extents.begin();
-	   p != object_extents.end();
-	   ++p) {
-	ldout(ictx->cct, 20) << "diff_iterate object " << p->first << dendl;
-
-	librados::snap_set_t snap_set;
-	int r = head_ctx.list_snaps(p->first.name, &snap_set);
-	if (r == -ENOENT) {
-	  if (from_snap_id == 0 && !parent_diff.empty()) {
-	    // report parent diff instead
-	    for (vector<ObjectExtent>::iterator q = p->second.begin(); q != p->second.end(); ++q) {
-	      for (vector<pair<uint64_t,uint64_t> >::iterator r = q->buffer_extents.begin();
-		   r != q->buffer_extents.end();
-		   ++r) {
-		interval_set<uint64_t> o;
-		o.insert(off + r->first, r->second);
-		o.intersection_of(parent_diff);
-		ldout(ictx->cct, 20) << " reporting parent overlap " << o << dendl;
-		for (interval_set<uint64_t>::iterator s = o.begin(); s != o.end(); ++s) {
-		  cb(s.get_start(), s.get_len(), true, arg);
+	left -= read_len;
+	off += read_len;
+      }
+
+      for (map<object_t, librados::AioCompletion*>::iterator p =
+	     completions.begin();
+	   p != completions.end(); ++p) {
+	p->second->wait_for_complete();
+	results[p->first] = p->second->get_return_value();
+	p->second->release();
+      }
+
+      for (vector<pair<uint64_t, map<object_t,vector<ObjectExtent> > > >::iterator b = batch.begin();
+	   b != batch.end(); ++b) {
+	uint64_t period_start = b->first;
+	map<object_t,vector<ObjectExtent> > &object_extents = b->second;
+	// report each object
+	for (map<object_t,vector<ObjectExtent> >::iterator p = object_extents.begin();
+	     p != object_extents.end();
+	     ++p) {
+	  ldout(ictx->cct, 20) << "diff_iterate object " << p->first << dendl;
+
+	  int r = results[p->first];
+	  librados::snap_set_t &snap_set = snap_sets[p->first];
+	  if (r == -ENOENT) {
+	    if (from_snap_id == 0 && !parent_diff.empty()) {
+	      // report parent diff instead
+	      for (vector<ObjectExtent>::iterator q = p->second.begin(); q != p->second.end(); ++q) {
+		for (vector<pair<uint64_t,uint64_t> >::iterator r = q->buffer_extents.begin();
+		     r != q->buffer_extents.end();
+		     ++r) {
+		  interval_set<uint64_t> o;
+		  o.insert(period_start + r->first, r->second);
+		  o.intersection_of(parent_diff);
+		  ldout(ictx->cct, 20) << " reporting parent overlap " << o << dendl;
+		  for (interval_set<uint64_t>::iterator s = o.begin(); s != o.end(); ++s) {
+		    cb(s.get_start(), s.get_len(), true, arg);
+		  }
 		}
 	      }
 	    }
+	    continue;
 	  }
-	  continue;
-	}
-	if (r < 0)
-	  return r;
-
-	// calc diff from from_snap_id -> to_snap_id
-	interval_set<uint64_t> diff;
-	bool end_exists;
-	calc_snap_set_diff(ictx->cct, snap_set,
-			   from_snap_id,
-			   end_snap_id,
-			   &diff, &end_exists);
-	ldout(ictx->cct, 20) << "  diff " << diff << " end_exists=" << end_exists << dendl;
-	if (diff.empty())
-	  continue;
+	  if (r < 0)
+	    return r;
 
-	for (vector<ObjectExtent>::iterator q = p->second.begin(); q != p->second.end(); ++q) {
-	  ldout(ictx->cct, 20) << "diff_iterate object " << p->first
-			       << " extent " << q->offset << "~" << q->length
-			       << " from " << q->buffer_extents
-			       << dendl;
-	  uint64_t opos = q->offset;
-	  for (vector<pair<uint64_t,uint64_t> >::iterator r = q->buffer_extents.begin();
-	       r != q->buffer_extents.end();
-	       ++r) {
-	    interval_set<uint64_t> overlap;  // object extents
-	    overlap.insert(opos, r->second);
-	    overlap.intersection_of(diff);
-	    ldout(ictx->cct, 20) << " opos " << opos
-				 << " buf " << r->first << "~" << r->second
-				 << " overlap " << overlap
+	  // calc diff from from_snap_id -> to_snap_id
+	  interval_set<uint64_t> diff;
+	  bool end_exists;
+	  calc_snap_set_diff(ictx->cct, snap_set,
+			     from_snap_id,
+			     end_snap_id,
+			     &diff, &end_exists);
+	  ldout(ictx->cct, 20) << "  diff " << diff << " end_exists=" << end_exists << dendl;
+	  if (diff.empty())
+	    continue;
+
+	  for (vector<ObjectExtent>::iterator q = p->second.begin(); q != p->second.end(); ++q) {
+	    ldout(ictx->cct, 20) << "diff_iterate object " << p->first
+				 << " extent " << q->offset << "~" << q->length
+				 << " from " << q->buffer_extents
 				 << dendl;
-	    for (interval_set<uint64_t>::iterator s = overlap.begin();
-		 s != overlap.end();
-		 ++s) {
-	      uint64_t su_off = s.get_start() - opos;
-	      uint64_t logical_off = off + r->first + su_off;
-	      ldout(ictx->cct, 20) << "   overlap extent " << s.get_start() << "~" << s.get_len()
-				   << " logical "
-				   << logical_off << "~" << s.get_len()
+	    uint64_t opos = q->offset;
+	    for (vector<pair<uint64_t,uint64_t> >::iterator r = q->buffer_extents.begin();
+		 r != q->buffer_extents.end();
+		 ++r) {
+	      interval_set<uint64_t> overlap;  // object extents
+	      overlap.insert(opos, r->second);
+	      overlap.intersection_of(diff);
+	      ldout(ictx->cct, 20) << " opos " << opos
+				   << " buf " << r->first << "~" << r->second
+				   << " overlap " << overlap
 				   << dendl;
-	      cb(logical_off, s.get_len(), end_exists, arg);
+	      for (interval_set<uint64_t>::iterator s = overlap.begin();
+		   s != overlap.end();
+		   ++s) {
+		uint64_t su_off = s.get_start() - opos;
+		uint64_t logical_off = period_start + r->first + su_off;
+		ldout(ictx->cct, 20) << "   overlap extent " << s.get_start() << "~" << s.get_len()
+				     << " logical "
+				     << logical_off << "~" << s.get_len()
+				     << dendl;
+		cb(logical_off, s.get_len(), end_exists, arg);
+	      }
+	      opos += r->second;
 	    }
-	    opos += r->second;
+	    assert(opos == q->offset + q->length);
 	  }
-	  assert(opos == q->offset + q->length);
 	}
       }
-
-      left -= read_len;
-      off += read_len;
     }
 
     return 0;
@@ -2870,6 +3223,23 @@ reprotect_and_return_err:
     return r;
   }
 
+  /**
+   * Add caller memory to the data of a write.  It is only referenced,
+   * not copied, if rbd_disable_zero_copy_writes is off and there is no
+   * cache, which would keep the data after the write completes.
+   */
+  static void append_write_data(ImageCtx *ictx, const char *buf, size_t len,
+				bufferlist *bl)
+  {
+    if (ictx->object_cacher || ictx->cct->_conf->rbd_disable_zero_copy_writes)
+      bl->append(buf, len);
+    else
+      bl->push_back(buffer::create_static(len, const_cast<char *>(buf)));
+  }
+
+  static int _aio_write(ImageCtx *ictx, uint64_t off, const bufferlist &data,
+			AioCompletion *c);
+
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
 		AioCompletion *c)
   {
@@ -2877,6 +3247,33 @@ reprotect_and_return_err:
     ldout(cct, 20) << "aio_write " << ictx << " off = " << off << " len = "
 		   << len << " buf = " << (void*)buf << dendl;
 
+    bufferlist data;
+    append_write_data(ictx, buf, len, &data);
+    return _aio_write(ictx, off, data, c);
+  }
+
+  int aio_writev(ImageCtx *ictx, const struct iovec *iov, int iovcnt,
+		 uint64_t off, AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
+    ldout(cct, 20) << "aio_writev " << ictx << " off = " << off
+		   << " iovcnt = " << iovcnt << dendl;
+
+    if (iovcnt < 0)
+      return -EINVAL;
+
+    bufferlist data;
+    for (int i = 0; i < iovcnt; ++i)
+      append_write_data(ictx, (const char *)iov[i].iov_base, iov[i].iov_len,
+			&data);
+    return _aio_write(ictx, off, data, c);
+  }
+
+  static int _aio_write(ImageCtx *ictx, uint64_t off, const bufferlist &data,
+			AioCompletion *c)
+  {
+    CephContext *cct = ictx->cct;
+    size_t len = data.length();
     if (!len)
       return 0;
 
@@ -2918,7 +3315,9 @@ reprotect_and_return_err:
       for (vector<pair<uint64_t,uint64_t> >::iterator q = p->buffer_extents.begin();
 	   q != p->buffer_extents.end();
 	   ++q) {
-	bl.append(buf + q->first, q->second);
+	bufferlist sub;
+	sub.substr_of(data, q->first, q->second);
+	bl.claim_append(sub);
       }
 
       C_AioWrite *req_comp = new C_AioWrite(cct, c);
@@ -3055,6 +3454,116 @@ reprotect_and_return_err:
     return aio_read(ictx, image_extents, buf, bl, c);
   }
 
+  int aio_readv(ImageCtx *ictx, const struct iovec *iov, int iovcnt,
+		uint64_t off, AioCompletion *c)
+  {
+    if (iovcnt < 0)
+      return -EINVAL;
+
+    uint64_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+      len += iov[i].iov_len;
+    c->read_iov.assign(iov, iov + iovcnt);
+    return aio_read(ictx, off, len, NULL, NULL, c);
+  }
+
+  class C_RBD_Readahead : public Context {
+  public:
+    C_RBD_Readahead(ImageCtx *ictx, object_t oid, uint64_t offset,
+		    uint64_t length)
+      : ictx(ictx), oid(oid), offset(offset), length(length) { }
+    void finish(int r) {
+      ldout(ictx->cct, 20) << "C_RBD_Readahead on " << oid << ": " << offset
+			   << "+" << length << " r = " << r << dendl;
+      ictx->readahead.dec_pending();
+    }
+
+    ImageCtx *ictx;
+    object_t oid;
+    uint64_t offset;
+    uint64_t length;
+    bufferlist bl;
+  };
+
+  /**
+   * Feed a read to the image's sequential read detector and prefetch
+   * into the cache if it asks for it.  The prefetch is asynchronous and
+   * nothing waits on it but close_image().
+   */
+  static void readahead(ImageCtx *ictx,
+			const vector<pair<uint64_t,uint64_t> >& image_extents)
+  {
+    uint64_t total_bytes = 0;
+    for (vector<pair<uint64_t,uint64_t> >::const_iterator p =
+	   image_extents.begin();
+	 p != image_extents.end();
+	 ++p)
+      total_bytes += p->second;
+    uint64_t disable_after = ictx->cct->_conf->rbd_readahead_disable_after_bytes;
+    ictx->total_bytes_read.add(total_bytes);
+    if (disable_after > 0 && ictx->total_bytes_read.read() > disable_after)
+      return;
+
+    ictx->snap_lock.get_read();
+    uint64_t image_size = ictx->get_image_size(ictx->snap_id);
+    ictx->snap_lock.put_read();
+
+    pair<uint64_t, uint64_t> readahead_extent =
+      ictx->readahead.update(image_extents, image_size);
+    uint64_t ra_off = readahead_extent.first;
+    uint64_t ra_len = readahead_extent.second;
+    if (ra_len == 0)
+      return;
+
+    ldout(ictx->cct, 20) << "(readahead logical) " << ra_off << "~" << ra_len
+			 << dendl;
+    map<object_t,vector<ObjectExtent> > readahead_object_extents;
+    Striper::file_to_extents(ictx->cct, ictx->format_string, &ictx->layout,
+			     ra_off, ra_len, 0, readahead_object_extents);
+    for (map<object_t,vector<ObjectExtent> >::iterator p =
+	   readahead_object_extents.begin();
+	 p != readahead_object_extents.end();
+	 ++p) {
+      for (vector<ObjectExtent>::iterator q = p->second.begin();
+	   q != p->second.end();
+	   ++q) {
+	ldout(ictx->cct, 20) << "(readahead) oid " << q->oid << " "
+			     << q->offset << "~" << q->length << dendl;
+	C_RBD_Readahead *req_comp = new C_RBD_Readahead(ictx, q->oid,
+							q->offset, q->length);
+	ictx->readahead.inc_pending();
+	ictx->aio_read_from_cache(q->oid, &req_comp->bl, q->length, q->offset,
+				  req_comp);
+      }
+    }
+    ictx->perfcounter->inc(l_librbd_readahead);
+    ictx->perfcounter->inc(l_librbd_readahead_bytes, ra_len);
+  }
+
+  /**
+   * Whether a read from a snapshot can skip an object extent because the
+   * snapshot's object map says the object was never written and there
+   * is no parent data under it either.  Only snapshot maps are trusted
+   * here; the head map may be missing bits set by other clients.
+   */
+  static bool read_can_skip(ImageCtx *ictx, snap_t snap_id,
+			    const ObjectExtent& extent)
+  {
+    if (snap_id == CEPH_NOSNAP ||
+	ictx->object_map.object_may_exist(extent.objectno))
+      return false;
+
+    RWLock::RLocker l(ictx->snap_lock);
+    RWLock::RLocker l2(ictx->parent_lock);
+    vector<pair<uint64_t,uint64_t> > image_extents;
+    Striper::extent_to_file(ictx->cct, &ictx->layout, extent.objectno,
+			    extent.offset, extent.length, image_extents);
+    uint64_t overlap = 0;
+    if (ictx->get_parent_overlap(snap_id, &overlap) < 0)
+      return false;
+    return ictx->prune_parent_extents(image_extents, overlap) == 0;
+  }
+
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c)
   {
@@ -3098,6 +3607,18 @@ reprotect_and_return_err:
 	ldout(ictx->cct, 20) << " oid " << q->oid << " " << q->offset << "~" << q->length
 			     << " from " << q->buffer_extents << dendl;
 
+	if (read_can_skip(ictx, snap_id, *q)) {
+	  ldout(ictx->cct, 20) << " skipping nonexistent object " << q->oid
+			       << dendl;
+	  bufferlist bl;
+	  map<uint64_t, uint64_t> ext_map;
+	  c->lock.Lock();
+	  c->destriper.add_partial_sparse_result(ictx->cct, bl, ext_map,
+						 q->offset, q->buffer_extents);
+	  c->lock.Unlock();
+	  continue;
+	}
+
 	C_AioRead *req_comp = new C_AioRead(ictx->cct, c);
 	AioRead *req = new AioRead(ictx, q->oid.name, 
 				   q->objectno, q->offset, q->length,
@@ -3127,6 +3648,10 @@ reprotect_and_return_err:
     c->finish_adding_requests(ictx->cct);
     c->put();
 
+    // after the foreground reads are on their way
+    if (ret >= 0 && ictx->object_cacher)
+      readahead(ictx, image_extents);
+
     ictx->perfcounter->inc(l_librbd_aio_rd);
     ictx->perfcounter->inc(l_librbd_aio_rd_bytes, buffer_ofs);
 
@@ -40,6 +40,12 @@ enum {
   l_librbd_aio_flush,
   l_librbd_aio_flush_latency,
 
+  l_librbd_readahead,
+  l_librbd_readahead_bytes,
+  l_librbd_copyup_on_read,
+  l_librbd_persistent_cache_hit,
+  l_librbd_persistent_cache_miss,
+
   l_librbd_snap_create,
   l_librbd_snap_remove,
   l_librbd_snap_rollback,
@@ -141,7 +147,7 @@ namespace librbd {
   int break_lock(ImageCtx *ictx, const std::string& client,
 		 const std::string& cookie);
 
-  void trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx);
+  int trim_image(ImageCtx *ictx, uint64_t newsize, ProgressContext& prog_ctx);
   int read_rbd_info(librados::IoCtx& io_ctx, const std::string& info_oid,
 		    struct rbd_info *info);
 
@@ -180,9 +186,13 @@ namespace librbd {
   int discard(ImageCtx *ictx, uint64_t off, uint64_t len);
   int aio_write(ImageCtx *ictx, uint64_t off, size_t len, const char *buf,
 		AioCompletion *c);
+  int aio_writev(ImageCtx *ictx, const struct iovec *iov, int iovcnt,
+		 uint64_t off, AioCompletion *c);
   int aio_discard(ImageCtx *ictx, uint64_t off, uint64_t len, AioCompletion *c);
   int aio_read(ImageCtx *ictx, uint64_t off, size_t len,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
+  int aio_readv(ImageCtx *ictx, const struct iovec *iov, int iovcnt,
+		uint64_t off, AioCompletion *c);
   int aio_read(ImageCtx *ictx, const vector<pair<uint64_t,uint64_t> >& image_extents,
 	       char *buf, bufferlist *pbl, AioCompletion *c);
   int aio_flush(ImageCtx *ictx, AioCompletion *c);
@@ -1100,6 +1100,15 @@ extern "C" int rbd_aio_write(rbd_image_t image, uint64_t off, size_t len,
 			   (librbd::AioCompletion *)comp->pc);
 }
 
+extern "C" int rbd_aio_writev(rbd_image_t image, const struct iovec *iov,
+			      int iovcnt, uint64_t off, rbd_completion_t c)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  return librbd::aio_writev(ictx, iov, iovcnt, off,
+			    (librbd::AioCompletion *)comp->pc);
+}
+
 extern "C" int rbd_aio_discard(rbd_image_t image, uint64_t off, uint64_t len,
 			       rbd_completion_t c)
 {
@@ -1117,6 +1126,15 @@ extern "C" int rbd_aio_read(rbd_image_t image, uint64_t off, size_t len,
 			  (librbd::AioCompletion *)comp->pc);
 }
 
+extern "C" int rbd_aio_readv(rbd_image_t image, const struct iovec *iov,
+			     int iovcnt, uint64_t off, rbd_completion_t c)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librbd::RBD::AioCompletion *comp = (librbd::RBD::AioCompletion *)c;
+  return librbd::aio_readv(ictx, iov, iovcnt, off,
+			   (librbd::AioCompletion *)comp->pc);
+}
+
 extern "C" int rbd_flush(rbd_image_t image)
 {
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
@@ -19,8 +19,6 @@
 #define DEFAULT_MAX_NEW    100
 #define DEFAULT_MAX_RECENT 10000
 
-#define PREALLOC 1000000
-
 namespace ceph {
 namespace log {
 
@@ -36,7 +34,9 @@ static void log_on_exit(void *p)
 Log::Log(SubsystemMap *s)
   : m_indirect_this(NULL),
     m_subs(s),
-    m_new(), m_recent(),
+    m_new_head(NULL),
+    m_new_len(0),
+    m_recent(),
     m_fd(-1),
     m_syslog_log(-2), m_syslog_crash(-2),
     m_stderr_log(1), m_stderr_crash(-1),
@@ -57,11 +57,6 @@ Log::Log(SubsystemMap *s)
 
   ret = pthread_cond_init(&m_cond_flusher, NULL);
   assert(ret == 0);
-
-  // kludge for prealloc testing
-  if (false)
-    for (int i=0; i < PREALLOC; i++)
-      m_recent.enqueue(new Entry);
 }
 
 Log::~Log()
@@ -71,6 +66,8 @@ Log::~Log()
   }
 
   assert(!is_started());
+  EntryQueue t;
+  _take_new(&t);
   if (m_fd >= 0)
     TEMP_FAILURE_RETRY(::close(m_fd));
 
@@ -139,47 +136,86 @@ void Log::set_stderr_level(int log, int crash)
 
 void Log::submit_entry(Entry *e)
 {
-  pthread_mutex_lock(&m_queue_mutex);
-
-  // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
-    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  bool full = (int)m_new_len.inc() > m_max_new;
+
+  Entry *head = m_new_head;
+  while (true) {
+    e->m_next = head;
+    Entry *old = __sync_val_compare_and_swap(&m_new_head, head, e);
+    if (old == head)
+      break;
+    head = old;
+  }
 
-  m_new.enqueue(e);
-  pthread_cond_signal(&m_cond_flusher);
-  pthread_mutex_unlock(&m_queue_mutex);
+  // only the entry that makes the queue non-empty needs to wake the
+  // flusher, which checks for entries with m_queue_mutex held
+  bool wake = (head == NULL);
+  if (wake || full) {
+    pthread_mutex_lock(&m_queue_mutex);
+    if (wake)
+      pthread_cond_signal(&m_cond_flusher);
+    // wait for flush to catch up
+    while ((int)m_new_len.read() > m_max_new && !m_stop)
+      pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
 }
 
 Entry *Log::create_entry(int level, int subsys)
 {
-  if (true) {
+  m_free_lock.lock();
+  Entry *e = m_free.dequeue();
+  m_free_lock.unlock();
+  if (!e)
     return new Entry(ceph_clock_now(NULL),
-		   pthread_self(),
-		   level, subsys);
-  } else {
-    // kludge for perf testing
-    Entry *e = m_recent.dequeue();
-    e->m_stamp = ceph_clock_now(NULL);
-    e->m_thread = pthread_self();
-    e->m_prio = level;
-    e->m_subsys = subsys;
-    return e;
+		     pthread_self(),
+		     level, subsys);
+  e->reset(ceph_clock_now(NULL), pthread_self(), level, subsys);
+  return e;
+}
+
+void Log::_take_new(EntryQueue *q)
+{
+  Entry *e = __sync_lock_test_and_set(&m_new_head, (Entry *)NULL);
+  if (!e)
+    return;
+
+  // the stack is newest first; reverse it onto q
+  EntryQueue t;
+  while (e) {
+    Entry *next = e->m_next;
+    e->m_next = t.m_head;
+    t.m_head = e;
+    if (!t.m_tail)
+      t.m_tail = e;
+    t.m_len++;
+    e = next;
   }
+  m_new_len.sub(t.m_len);
+  q->swap(t);
+  assert(t.empty());
+
+  pthread_mutex_lock(&m_queue_mutex);
+  pthread_cond_broadcast(&m_cond_loggers);
+  pthread_mutex_unlock(&m_queue_mutex);
 }
 
 void Log::flush()
 {
   pthread_mutex_lock(&m_flush_mutex);
-  pthread_mutex_lock(&m_queue_mutex);
   EntryQueue t;
-  t.swap(m_new);
-  pthread_cond_broadcast(&m_cond_loggers);
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
-  // trim
-  while (m_recent.m_len > m_max_recent) {
-    delete m_recent.dequeue();
+  // trim, keeping up to m_max_new entries for reuse
+  if (m_recent.m_len > m_max_recent) {
+    EntryQueue trimmed;
+    while (m_recent.m_len > m_max_recent)
+      trimmed.enqueue(m_recent.dequeue());
+    m_free_lock.lock();
+    while (m_free.m_len < m_max_new && !trimmed.empty())
+      m_free.enqueue(trimmed.dequeue());
+    m_free_lock.unlock();
   }
 
   pthread_mutex_unlock(&m_flush_mutex);
@@ -254,10 +290,8 @@ void Log::dump_recent()
 {
   pthread_mutex_lock(&m_flush_mutex);
 
-  pthread_mutex_lock(&m_queue_mutex);
   EntryQueue t;
-  t.swap(m_new);
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
   EntryQueue old;
@@ -313,7 +347,7 @@ void *Log::entry()
 {
   pthread_mutex_lock(&m_queue_mutex);
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (m_new_head) {
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
       pthread_mutex_lock(&m_queue_mutex);
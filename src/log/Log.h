@@ -5,6 +5,8 @@
 #define __CEPH_LOG_LOG_H
 
 #include "common/Thread.h"
+#include "include/atomic.h"
+#include "include/Spinlock.h"
 
 #include <pthread.h>
 
@@ -21,14 +23,19 @@ class Log : private Thread
 
   SubsystemMap *m_subs;
   
-  pthread_mutex_t m_queue_mutex;
+  pthread_mutex_t m_queue_mutex;  ///< for sleeping on the conds below only
   pthread_mutex_t m_flush_mutex;
   pthread_cond_t m_cond_loggers;
   pthread_cond_t m_cond_flusher;
 
-  EntryQueue m_new;    ///< new entries
+  /// new entries, newest first; pushed with a CAS, drained with a swap
+  Entry *m_new_head;
+  atomic_t m_new_len;
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
+  Spinlock m_free_lock;
+  EntryQueue m_free;   ///< trimmed entries for create_entry() to reuse
+
   std::string m_log_file;
   int m_fd;
 
@@ -41,6 +48,7 @@ class Log : private Thread
 
   void *entry();
 
+  void _take_new(EntryQueue *q);
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
 
   void _log_message(const char *s, bool crash);
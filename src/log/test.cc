@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
 
 #include "log/Log.h"
 #include "common/Clock.h"
@@ -187,3 +190,62 @@ TEST(Log, ManyGather)
   log.flush();
   log.stop();
 }
+
+struct LogThread : public Thread {
+  Log *log;
+  int id, n;
+  LogThread(Log *l, int i, int c) : log(l), id(i), n(c) {}
+  void *entry() {
+    for (int i=0; i<n; i++) {
+      Entry *e = log->create_entry(1, 1);
+      ostream os(&e->m_streambuf);
+      os << "thread " << id << " line " << i;
+      if (i % 10 == 0)	// overflow the prealloc buffer now and then
+	os << " " << string(200, 'x');
+      log->submit_entry(e);
+    }
+    return NULL;
+  }
+};
+
+TEST(Log, ManyThreads)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 1);
+  Log log(&subs);
+  log.set_max_new(100);
+  log.set_max_recent(10);  // recycle entries aggressively
+  log.start();
+  ::unlink("/tmp/log_threads");
+  log.set_log_file("/tmp/log_threads");
+  log.reopen_log_file();
+
+  const int nthreads = 4, n = 10000;
+  LogThread *threads[nthreads];
+  for (int i=0; i<nthreads; i++) {
+    threads[i] = new LogThread(&log, i, n);
+    threads[i]->create();
+  }
+  for (int i=0; i<nthreads; i++) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  log.flush();
+  log.stop();
+
+  // every line from each thread, in order
+  ifstream in("/tmp/log_threads");
+  int next[nthreads] = { 0 };
+  string line;
+  while (getline(in, line)) {
+    size_t p = line.find("thread ");
+    ASSERT_NE(string::npos, p);
+    int id, i;
+    ASSERT_EQ(2, sscanf(line.c_str() + p, "thread %d line %d", &id, &i));
+    ASSERT_EQ(next[id], i);
+    ASSERT_EQ(i % 10 == 0, line.find(string(200, 'x')) != string::npos);
+    next[id]++;
+  }
+  for (int i=0; i<nthreads; i++)
+    ASSERT_EQ(n, next[i]);
+}
@@ -30,6 +30,7 @@ using namespace std;
 
 #include "SimpleLock.h"
 #include "LocalLock.h"
+#include "common/mempool.h"
 
 class CInode;
 class CDir;
@@ -64,9 +65,11 @@ public:
     void *n = pool.malloc();
     if (!n)
       throw std::bad_alloc();
+    mempool::get_pool(mempool::mempool_mds_co).adjust(sizeof(CDentry), 1);
     return n;
   }
   void operator delete(void *p) {
+    mempool::get_pool(mempool::mempool_mds_co).adjust(-(ssize_t)sizeof(CDentry), -1);
     pool.free(p);
   }
 
@@ -842,6 +842,19 @@ void CDir::init_fragment_pins()
     get(PIN_SUBTREE);
 }
 
+/*
+ * Only merge fragments that are both small and cold; a small fragment
+ * that is still busy would just be split again by its rd/wr rate.
+ */
+bool CDir::should_merge()
+{
+  if ((int)get_num_head_items() >= g_conf->mds_bal_merge_size)
+    return false;
+  utime_t now = ceph_clock_now(g_ceph_context);
+  return pop_me.get(META_POP_IRD).get(now, cache->decayrate) < g_conf->mds_bal_merge_rd &&
+    pop_me.get(META_POP_IWR).get(now, cache->decayrate) < g_conf->mds_bal_merge_wr;
+}
+
 void CDir::split(int bits, list<CDir*>& subs, list<Context*>& waiters, bool replay)
 {
   dout(10) << "split by " << bits << " bits on " << *this << dendl;
@@ -1432,7 +1445,7 @@ void CDir::_tmap_fetched(bufferlist& bl, const string& want_dn, int r)
     bl.clear();
   }
 
-  _omap_fetched(header, omap, want_dn, r);
+  _omap_fetched(header, omap, want_dn, false, r);
 }
 
 class C_Dir_OMAP_Fetched : public Context {
@@ -1442,29 +1455,86 @@ class C_Dir_OMAP_Fetched : public Context {
  public:
   bufferlist hdrbl;
   map<string, bufferlist> omap;
+  uint64_t max;
   int ret1, ret2;
 
-  C_Dir_OMAP_Fetched(CDir *d, const string& w) : dir(d), want_dn(w) { }
+  C_Dir_OMAP_Fetched(CDir *d, const string& w, uint64_t m) : dir(d), want_dn(w), max(m) { }
   void finish(int r) {
     if (r >= 0) r = ret1;
     if (r >= 0) r = ret2;
-    dir->_omap_fetched(hdrbl, omap, want_dn, r);
+    dir->_omap_fetched(hdrbl, omap, want_dn, omap.size() >= max, r);
   }
 };
 
+/*
+ * The entries of a dirfrag are read mds_dir_fetch_max_keys at a time,
+ * and each batch is added to the cache before the next is read, so a
+ * huge dirfrag is never held as one omap reply on top of its dentries.
+ */
+static uint64_t dir_fetch_max_keys()
+{
+  int max = g_conf->mds_dir_fetch_max_keys;
+  return max > 0 ? max : (uint64_t)-1;
+}
+
 void CDir::_omap_fetch(const string& want_dn)
 {
-  C_Dir_OMAP_Fetched *fin = new C_Dir_OMAP_Fetched(this, want_dn);
+  C_Dir_OMAP_Fetched *fin = new C_Dir_OMAP_Fetched(this, want_dn, dir_fetch_max_keys());
   object_t oid = get_ondisk_object();
   object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
   ObjectOperation rd;
   rd.omap_get_header(&fin->hdrbl, &fin->ret1);
-  rd.omap_get_vals("", "", (uint64_t)-1, &fin->omap, &fin->ret2);
+  rd.omap_get_vals("", "", fin->max, &fin->omap, &fin->ret2);
+  cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0, fin);
+}
+
+class C_Dir_OMAP_FetchedMore : public Context {
+ protected:
+  CDir *dir;
+  CDir::fetch_state_t *st;
+ public:
+  map<string, bufferlist> omap;
+  uint64_t max;
+  int ret;
+
+  C_Dir_OMAP_FetchedMore(CDir *d, CDir::fetch_state_t *s, uint64_t m) : dir(d), st(s), max(m) { }
+  void finish(int r) {
+    if (r >= 0) r = ret;
+    dir->_omap_fetched_more(st, omap, omap.size() >= max, r);
+  }
+};
+
+void CDir::_omap_fetch_more(fetch_state_t *st, const string& after)
+{
+  dout(10) << "_omap_fetch_more after '" << after << "' on " << *this << dendl;
+  C_Dir_OMAP_FetchedMore *fin = new C_Dir_OMAP_FetchedMore(this, st, dir_fetch_max_keys());
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
+  ObjectOperation rd;
+  rd.omap_get_vals(after, "", fin->max, &fin->omap, &fin->ret);
   cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0, fin);
 }
 
+void CDir::_omap_fetched_more(fetch_state_t *st, map<string, bufferlist>& omap,
+			      bool more, int r)
+{
+  dout(10) << "_fetched " << omap.size() << " more keys for " << *this << dendl;
+
+  // we hold an auth_pin, so the dirfrag is neither fragmented nor removed
+  assert(r == 0);
+  assert(is_auth());
+  assert(!is_frozen());
+
+  _omap_fetched_entries(st, omap);
+  if (more && !omap.empty()) {
+    _omap_fetch_more(st, omap.rbegin()->first);
+    return;
+  }
+  _omap_fetch_finish(st);
+}
+
 void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
-			 const string& want_dn, int r)
+			 const string& want_dn, bool more, int r)
 {
   LogClient &clog = cache->mds->clog;
   dout(10) << "_fetched header " << hdrbl.length() << " bytes "
@@ -1524,23 +1594,38 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
     }
   }
 
-  list<CInode*> undef_inodes;
+  fetch_state_t *st = new fetch_state_t(want_dn, got_fnode.version);
 
   // purge stale snaps?
   // only if we have past_parents open!
-  bool purged_any = false;
-  const set<snapid_t> *snaps = NULL;
   SnapRealm *realm = inode->find_snaprealm();
   if (!realm->have_past_parents_open()) {
     dout(10) << " no snap purge, one or more past parents NOT open" << dendl;
   } else if (fnode.snap_purged_thru < realm->get_last_destroyed()) {
-    snaps = &realm->get_snaps();
+    st->purge_snaps = true;
     dout(10) << " snap_purged_thru " << fnode.snap_purged_thru
 	     << " < " << realm->get_last_destroyed()
-	     << ", snap purge based on " << *snaps << dendl;
+	     << ", snap purge based on " << realm->get_snaps() << dendl;
     fnode.snap_purged_thru = realm->get_last_destroyed();
   }
 
+  _omap_fetched_entries(st, omap);
+  if (more && !omap.empty()) {
+    _omap_fetch_more(st, omap.rbegin()->first);
+    return;
+  }
+  _omap_fetch_finish(st);
+}
+
+void CDir::_omap_fetched_entries(fetch_state_t *st, map<string, bufferlist>& omap)
+{
+  LogClient &clog = cache->mds->clog;
+
+  // look the snaps up again for each batch; they may change in between
+  const set<snapid_t> *snaps = NULL;
+  if (st->purge_snaps)
+    snaps = &inode->find_snaprealm()->get_snaps();
+
   bool stray = inode->is_stray();
 
   unsigned pos = 0;
@@ -1569,7 +1654,7 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
       if (p == snaps->end() || *p > last) {
 	dout(10) << " skipping stale dentry on [" << first << "," << last << "]" << dendl;
 	stale = true;
-	purged_any = true;
+	st->purged_any = true;
       }
     }
     
@@ -1640,7 +1725,7 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
 	if (in) {
 	  dout(12) << "_fetched  had dentry " << *dn << dendl;
 	  if (in->state_test(CInode::STATE_REJOINUNDEF)) {
-	    undef_inodes.push_back(in);
+	    st->undef_inodes.push_back(in);
 	    undef_inode = true;
 	  }
 	} else
@@ -1709,7 +1794,7 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
       assert(0);
     }
     
-    if (dn && want_dn.length() && want_dn == dname) {
+    if (dn && st->want_dn.length() && st->want_dn == dname) {
       dout(10) << " touching wanted dn " << *dn << dendl;
       inode->mdcache->touch_dentry(dn);
     }
@@ -1728,23 +1813,26 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
      */
     if (committed_version == 0 &&     
 	dn &&
-	dn->get_version() <= got_fnode.version &&
+	dn->get_version() <= st->got_version &&
 	dn->is_dirty()) {
       dout(10) << "_fetched  had underwater dentry " << *dn << ", marking clean" << dendl;
       dn->mark_clean();
 
       if (dn->get_linkage()->is_primary()) {
-	assert(dn->get_linkage()->get_inode()->get_version() <= got_fnode.version);
+	assert(dn->get_linkage()->get_inode()->get_version() <= st->got_version);
 	dout(10) << "_fetched  had underwater inode " << *dn->get_linkage()->get_inode() << ", marking clean" << dendl;
 	dn->get_linkage()->get_inode()->mark_clean();
       }
     }
   }
+}
 
+void CDir::_omap_fetch_finish(fetch_state_t *st)
+{
   //cache->mds->logger->inc("newin", num_new_inodes_loaded);
   //hack_num_accessed = 0;
 
-  if (purged_any)
+  if (st->purged_any)
     log_mark_dirty();
 
   // mark complete, !fetching
@@ -1752,12 +1840,13 @@ void CDir::_omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
   state_clear(STATE_FETCHING);
 
   // open & force frags
-  while (!undef_inodes.empty()) {
-    CInode *in = undef_inodes.front();
-    undef_inodes.pop_front();
+  while (!st->undef_inodes.empty()) {
+    CInode *in = st->undef_inodes.front();
+    st->undef_inodes.pop_front();
     in->state_clear(CInode::STATE_REJOINUNDEF);
     cache->opened_undef_inode(in);
   }
+  delete st;
 
   auth_unpin(this);
 
@@ -33,6 +33,7 @@ using namespace std;
 
 
 #include "CInode.h"
+#include "common/mempool.h"
 
 class CDentry;
 class MDCache;
@@ -57,9 +58,11 @@ public:
     void *n = pool.malloc();
     if (!n)
       throw std::bad_alloc();
+    mempool::get_pool(mempool::mempool_mds_co).adjust(sizeof(CDir), 1);
     return n;
   }
   void operator delete(void *p) {
+    mempool::get_pool(mempool::mempool_mds_co).adjust(-(ssize_t)sizeof(CDir), -1);
     pool.free(p);
   }
 
@@ -372,9 +375,7 @@ public:
   bool should_split() {
     return (int)get_num_head_items() > g_conf->mds_bal_split_size;
   }
-  bool should_merge() {
-    return (int)get_num_head_items() < g_conf->mds_bal_merge_size;
-  }
+  bool should_merge();
 
 private:
   void prepare_new_fragment(bool replay);
@@ -487,10 +488,26 @@ private:
   }
   void fetch(Context *c, bool ignore_authpinnability=false);
   void fetch(Context *c, const string& want_dn, bool ignore_authpinnability=false);
+
+  // carried across the batches of entries of one fetch
+  struct fetch_state_t {
+    string want_dn;
+    version_t got_version;
+    bool purge_snaps;
+    bool purged_any;
+    list<CInode*> undef_inodes;
+    fetch_state_t(const string& w, version_t v) :
+      want_dn(w), got_version(v), purge_snaps(false), purged_any(false) {}
+  };
+  void _omap_fetched_more(fetch_state_t *st, map<string, bufferlist>& omap,
+			  bool more, int r);
 protected:
   void _omap_fetch(const string& want_dn);
   void _omap_fetched(bufferlist& hdrbl, map<string, bufferlist>& omap,
-		     const string& want_dn, int r);
+		     const string& want_dn, bool more, int r);
+  void _omap_fetch_more(fetch_state_t *st, const string& after);
+  void _omap_fetched_entries(fetch_state_t *st, map<string, bufferlist>& omap);
+  void _omap_fetch_finish(fetch_state_t *st);
   void _tmap_fetch(const string& want_dn);
   void _tmap_fetched(bufferlist &bl, const string& want_dn, int r);
 
@@ -24,6 +24,7 @@
 #include "MDS.h"
 #include "MDCache.h"
 #include "MDLog.h"
+#include "OpenFileTable.h"
 #include "Locker.h"
 #include "Mutation.h"
 
@@ -1173,6 +1174,33 @@ void CInode::set_object_info(MDSCacheObjectInfo &info)
   info.snapid = last;
 }
 
+static bool lock_state_is_empty(ceph_lock_state_t *s)
+{
+  return s->held_locks.empty() && s->waiting_locks.empty() &&
+    s->client_held_lock_counts.empty() && s->client_waiting_lock_counts.empty();
+}
+
+void CInode::_encode_file_locks(bufferlist& bl) const
+{
+  ceph_lock_state_t empty;
+  ::encode(fcntl_locks ? *fcntl_locks : empty, bl);
+  ::encode(flock_locks ? *flock_locks : empty, bl);
+}
+
+void CInode::_decode_file_locks(bufferlist::iterator& p)
+{
+  ::decode(*get_fcntl_lock_state(), p);
+  if (lock_state_is_empty(fcntl_locks)) {
+    delete fcntl_locks;
+    fcntl_locks = NULL;
+  }
+  ::decode(*get_flock_lock_state(), p);
+  if (lock_state_is_empty(flock_locks)) {
+    delete flock_locks;
+    flock_locks = NULL;
+  }
+}
+
 void CInode::encode_lock_state(int type, bufferlist& bl)
 {
   ::encode(first, bl);
@@ -1308,8 +1336,7 @@ void CInode::encode_lock_state(int type, bufferlist& bl)
 
   case CEPH_LOCK_IFLOCK:
     ::encode(inode.version, bl);
-    ::encode(fcntl_locks, bl);
-    ::encode(flock_locks, bl);
+    _encode_file_locks(bl);
     break;
 
   case CEPH_LOCK_IPOLICY:
@@ -1565,8 +1592,7 @@ void CInode::decode_lock_state(int type, bufferlist& bl)
 
   case CEPH_LOCK_IFLOCK:
     ::decode(inode.version, p);
-    ::decode(fcntl_locks, p);
-    ::decode(flock_locks, p);
+    _decode_file_locks(p);
     break;
 
   case CEPH_LOCK_IPOLICY:
@@ -2501,6 +2527,7 @@ Capability *CInode::add_client_cap(client_t client, Session *session, SnapRealm
       containing_realm = find_snaprealm();
     containing_realm->inodes_with_caps.push_back(&item_caps);
     dout(10) << "add_client_cap first cap, joining realm " << *containing_realm << dendl;
+    mdcache->mds->openfiles->add_inode(this);
   }
 
   mdcache->num_caps++;
@@ -2542,12 +2569,13 @@ void CInode::remove_client_cap(client_t client)
     containing_realm = NULL;
     item_open_file.remove_myself();  // unpin logsegment
     mdcache->num_inodes_with_caps--;
+    mdcache->mds->openfiles->remove_inode(this);
   }
   mdcache->num_caps--;
 
   //clean up advisory locks
-  bool fcntl_removed = fcntl_locks.remove_all_from(client);
-  bool flock_removed = flock_locks.remove_all_from(client);
+  bool fcntl_removed = fcntl_locks ? fcntl_locks->remove_all_from(client) : false;
+  bool flock_removed = flock_locks ? flock_locks->remove_all_from(client) : false;
   if (fcntl_removed || flock_removed) {
     list<Context*> waiters;
     take_waiting(CInode::WAIT_FLOCK, waiters);
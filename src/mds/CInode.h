@@ -18,6 +18,7 @@
 #define CEPH_CINODE_H
 
 #include "common/config.h"
+#include "common/mempool.h"
 #include "include/dlist.h"
 #include "include/elist.h"
 #include "include/types.h"
@@ -79,9 +80,11 @@ public:
     void *n = pool.malloc();
     if (!n)
       throw std::bad_alloc();
+    mempool::get_pool(mempool::mempool_mds_co).adjust(sizeof(CInode), 1);
     return n;
   }
   void operator delete(void *p) {
+    mempool::get_pool(mempool::mempool_mds_co).adjust(-(ssize_t)sizeof(CInode), -1);
     pool.free(p);
   }
 
@@ -387,8 +390,29 @@ public:
 
 protected:
 
-  ceph_lock_state_t fcntl_locks;
-  ceph_lock_state_t flock_locks;
+  // advisory locks are rare, so their state is only allocated on use
+  ceph_lock_state_t *fcntl_locks;
+  ceph_lock_state_t *flock_locks;
+
+public:
+  ceph_lock_state_t *get_fcntl_lock_state() {
+    if (!fcntl_locks)
+      fcntl_locks = new ceph_lock_state_t;
+    return fcntl_locks;
+  }
+  ceph_lock_state_t *get_flock_lock_state() {
+    if (!flock_locks)
+      flock_locks = new ceph_lock_state_t;
+    return flock_locks;
+  }
+  void clear_file_locks() {
+    delete fcntl_locks;
+    fcntl_locks = NULL;
+    delete flock_locks;
+    flock_locks = NULL;
+  }
+  void _encode_file_locks(bufferlist& bl) const;
+  void _decode_file_locks(bufferlist::iterator& p);
 
   // LogSegment dlists i (may) belong to
 public:
@@ -436,6 +460,7 @@ private:
     parent(0),
     inode_auth(CDIR_AUTH_DEFAULT),
     replica_caps_wanted(0),
+    fcntl_locks(0), flock_locks(0),
     item_dirty(this), item_caps(this), item_open_file(this), item_dirty_parent(this),
     item_dirty_dirfrag_dir(this), 
     item_dirty_dirfrag_nest(this), 
@@ -466,6 +491,7 @@ private:
     g_num_inos++;
     close_dirfrags();
     close_snaprealm();
+    clear_file_locks();
   }
   
 
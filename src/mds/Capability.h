@@ -22,6 +22,7 @@
 #include "common/config.h"
 
 #include "mdstypes.h"
+#include "common/mempool.h"
 
 /*
 
@@ -71,9 +72,11 @@ public:
     void *n = pool.malloc();
     if (!n)
       throw std::bad_alloc();
+    mempool::get_pool(mempool::mempool_mds_co).adjust(sizeof(Capability), 1);
     return n;
   }
   void operator delete(void *p) {
+    mempool::get_pool(mempool::mempool_mds_co).adjust(-(ssize_t)sizeof(Capability), -1);
     pool.free(p);
   }
 public:
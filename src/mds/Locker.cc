@@ -46,6 +46,7 @@
 #include "messages/MClientRequest.h"
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientCapRelease.h"
 
 #include "messages/MMDSSlaveRequest.h"
@@ -1853,7 +1854,7 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
 					 cap->get_mseq());
 	in->encode_cap_message(m, cap);
 
-	mds->send_message_client_counted(m, it->first);
+	send_caps_message(m, it->first);
       }
     }
 
@@ -1864,6 +1865,74 @@ bool Locker::issue_caps(CInode *in, Capability *only_cap)
   return (nissued == 0);  // true if no re-issued, no callbacks
 }
 
+class C_Locker_FlushCapsBatches : public Context {
+  Locker *locker;
+public:
+  C_Locker_FlushCapsBatches(Locker *l) : locker(l) {}
+  void finish(int r) {
+    locker->flush_caps_batches();
+  }
+};
+
+/*
+ * Grants and revokes for a client that understands MClientCapsBatch
+ * are collected and sent together, at the latest when the MDS is done
+ * with the message it is handling.  Any other message to the client
+ * first flushes its batch (see MDS::send_message_client), so nothing
+ * overtakes the caps messages queued before it.
+ */
+void Locker::send_caps_message(MClientCaps *m, client_t client)
+{
+  Session *session = mds->sessionmap.get_session(entity_name_t::CLIENT(client.v));
+  if (g_conf->mds_caps_batch_max <= 1 || !session || !session->connection ||
+      !session->connection->has_feature(CEPH_FEATURE_MDS_CAPS_BATCH)) {
+    mds->send_message_client_counted(m, client);
+    return;
+  }
+
+  version_t seq = session->inc_push_seq();
+  dout(10) << "send_caps_message batching for " << session->info.inst.name
+	   << " seq " << seq << " " << *m << dendl;
+  MClientCapsBatch *&batch = caps_batches[client];
+  if (!batch)
+    batch = new MClientCapsBatch;
+  batch->caps.push_back(m);
+  if ((int)batch->caps.size() >= g_conf->mds_caps_batch_max) {
+    flush_caps_batch(client);
+  } else if (!caps_batch_flush_event) {
+    caps_batch_flush_event = new C_Locker_FlushCapsBatches(this);
+    mds->timer.add_event_after(0, caps_batch_flush_event);
+  }
+}
+
+void Locker::flush_caps_batch(client_t client)
+{
+  map<client_t, MClientCapsBatch*>::iterator p = caps_batches.find(client);
+  if (p == caps_batches.end())
+    return;
+  MClientCapsBatch *batch = p->second;
+  caps_batches.erase(p);
+
+  Session *session = mds->sessionmap.get_session(entity_name_t::CLIENT(client.v));
+  if (!session) {
+    dout(10) << "flush_caps_batch no session for client." << client
+	     << ", dropping " << *batch << dendl;
+    batch->put();
+    return;
+  }
+  mds->send_message_client(batch, session);
+}
+
+void Locker::flush_caps_batches()
+{
+  if (caps_batch_flush_event) {
+    mds->timer.cancel_event(caps_batch_flush_event);
+    caps_batch_flush_event = 0;
+  }
+  while (!caps_batches.empty())
+    flush_caps_batch(caps_batches.begin()->first);
+}
+
 void Locker::issue_truncate(CInode *in)
 {
   dout(7) << "issue_truncate on " << *in << dendl;
@@ -2915,17 +2984,19 @@ bool Locker::_do_cap_update(CInode *in, Capability *cap,
     for ( int i=0; i < num_locks; ++i) {
       ceph_filelock decoded_lock;
       ::decode(decoded_lock, bli);
-      in->fcntl_locks.held_locks.
+      ceph_lock_state_t *lock_state = in->get_fcntl_lock_state();
+      lock_state->held_locks.
 	insert(pair<uint64_t, ceph_filelock>(decoded_lock.start, decoded_lock));
-      ++in->fcntl_locks.client_held_lock_counts[(client_t)(decoded_lock.client)];
+      ++lock_state->client_held_lock_counts[(client_t)(decoded_lock.client)];
     }
     ::decode(num_locks, bli);
     for ( int i=0; i < num_locks; ++i) {
       ceph_filelock decoded_lock;
       ::decode(decoded_lock, bli);
-      in->flock_locks.held_locks.
+      ceph_lock_state_t *lock_state = in->get_flock_lock_state();
+      lock_state->held_locks.
 	insert(pair<uint64_t, ceph_filelock>(decoded_lock.start, decoded_lock));
-      ++in->flock_locks.client_held_lock_counts[(client_t)(decoded_lock.client)];
+      ++lock_state->client_held_lock_counts[(client_t)(decoded_lock.client)];
     }
   }
 
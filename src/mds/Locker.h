@@ -44,6 +44,8 @@ class MDentryUnlink;
 class MLock;
 
 class MClientRequest;
+class MClientCaps;
+class MClientCapsBatch;
 
 class Anchor;
 class Capability;
@@ -62,7 +64,7 @@ private:
   MDCache *mdcache;
  
  public:
-  Locker(MDS *m, MDCache *c) : mds(m), mdcache(c) {}  
+  Locker(MDS *m, MDCache *c) : mds(m), mdcache(c), caps_batch_flush_event(0) {}  
 
   SimpleLock *get_lock(int lock_type, MDSCacheObjectInfo &info);
   
@@ -267,6 +269,14 @@ public:
   void resume_stale_caps(Session *session);
   void remove_stale_leases(Session *session);
 
+  // -- batched caps messages --
+  void send_caps_message(MClientCaps *m, client_t client);
+  void flush_caps_batch(client_t client);
+  void flush_caps_batches();
+private:
+  map<client_t, MClientCapsBatch*> caps_batches;
+  Context *caps_batch_flush_event;
+
 public:
   void request_inode_file_caps(CInode *in);
 protected:
@@ -139,6 +139,19 @@ double mds_load_t::mds_load()
   case 2:
     return cpu_load_avg;
 
+  case 3:
+    // weighted: reads and writes to the metadata i am auth for, plus
+    // requests, queued messages, caps held by clients and cpu
+    return
+      g_conf->mds_bal_weight_rd * (auth.vec[META_POP_IRD].get_last() +
+				   auth.vec[META_POP_READDIR].get_last() +
+				   auth.vec[META_POP_FETCH].get_last()) +
+      g_conf->mds_bal_weight_wr * (auth.vec[META_POP_IWR].get_last() +
+				   auth.vec[META_POP_STORE].get_last()) +
+      g_conf->mds_bal_weight_req * req_rate +
+      g_conf->mds_bal_weight_queue * queue_len +
+      g_conf->mds_bal_weight_caps * num_caps +
+      g_conf->mds_bal_weight_cpu * cpu_load_avg;
   }
   assert(0);
   return 0;
@@ -163,6 +176,7 @@ mds_load_t MDBalancer::get_load(utime_t now)
 
   load.req_rate = mds->get_req_rate();
   load.queue_len = mds->messenger->get_dispatch_queue_len();
+  load.num_caps = mds->mdcache->num_caps;
 
   ifstream cpu("/proc/loadavg");
   if (cpu.is_open())
@@ -344,6 +358,17 @@ void MDBalancer::queue_merge(CDir *dir)
   merge_queue.insert(dir->dirfrag());
 }
 
+/*
+ * Splits and merges freeze the dirfrag while they run, so only start a
+ * few at a time (mds_bal_fragment_max_inflight) and leave the rest
+ * queued for the next tick instead of stalling a whole tree of clients.
+ */
+bool MDBalancer::can_start_fragmenting()
+{
+  int max = g_conf->mds_bal_fragment_max_inflight;
+  return max <= 0 || mds->mdcache->get_num_fragmenting_dirs() < max;
+}
+
 void MDBalancer::do_fragmenting()
 {
   if (split_queue.empty() && merge_queue.empty()) {
@@ -360,6 +385,12 @@ void MDBalancer::do_fragmenting()
     for (set<dirfrag_t>::iterator i = q.begin();
 	 i != q.end();
 	 ++i) {
+      if (!can_start_fragmenting()) {
+	dout(10) << "do_fragmenting " << mds->mdcache->get_num_fragmenting_dirs()
+		 << " fragment ops in progress, deferring the rest" << dendl;
+	split_queue.insert(i, q.end());
+	break;
+      }
       CDir *dir = mds->mdcache->get_dirfrag(*i);
       if (!dir ||
 	  !dir->is_auth())
@@ -379,6 +410,12 @@ void MDBalancer::do_fragmenting()
     for (set<dirfrag_t>::iterator i = q.begin();
 	 i != q.end();
 	 ++i) {
+      if (!can_start_fragmenting()) {
+	dout(10) << "do_fragmenting " << mds->mdcache->get_num_fragmenting_dirs()
+		 << " fragment ops in progress, deferring the rest" << dendl;
+	merge_queue.insert(i, q.end());
+	break;
+      }
       CDir *dir = mds->mdcache->get_dirfrag(*i);
       if (!dir ||
 	  !dir->is_auth() ||
@@ -690,6 +727,7 @@ void MDBalancer::try_rebalance()
 	    dir->inode->is_stray())
 	  continue;
 	if (dir->is_freezing() || dir->is_frozen()) continue;  // export pbly already in progress
+	if (recently_imported(dir, rebalance_time)) continue;
 	double pop = dir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
 	assert(dir->inode->authority().first == target);  // cuz that's how i put it in the map, dummy
 
@@ -831,6 +869,31 @@ bool MDBalancer::check_targets()
   return ok;
 }
 
+/*
+ * A subtree imported less than mds_bal_import_cooldown seconds ago is
+ * not exported again: its load has only just moved, and the load the
+ * other MDSs reported was measured before it did.  Without this two
+ * MDSs can hand the same subtree back and forth every epoch.
+ */
+bool MDBalancer::recently_imported(CDir *dir, utime_t now)
+{
+  double cooldown = g_conf->mds_bal_import_cooldown;
+  map<dirfrag_t, utime_t>::iterator p = last_imported.begin();
+  while (p != last_imported.end()) {
+    if ((double)(now - p->second) >= cooldown)
+      last_imported.erase(p++);
+    else
+      ++p;
+  }
+
+  CDir *root = mds->mdcache->get_subtree_root(dir);
+  if (last_imported.count(root->dirfrag())) {
+    dout(10) << " imported recently, not exporting " << *dir << dendl;
+    return true;
+  }
+  return false;
+}
+
 void MDBalancer::find_exports(CDir *dir,
                               double amount,
                               list<CDir*>& exports,
@@ -869,6 +932,7 @@ void MDBalancer::find_exports(CDir *dir,
       if (already_exporting.count(subdir)) continue;
 
       if (subdir->is_frozen()) continue;  // can't export this right now!
+      if (recently_imported(subdir, rebalance_time)) continue;
 
       // how popular?
       double pop = subdir->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
@@ -1014,8 +1078,8 @@ void MDBalancer::hit_dir(utime_t now, CDir *dir, int type, int who, double amoun
 
     // merge?
     if (dir->get_frag() != frag_t() &&
-	(dir->get_num_head_items() < (unsigned)g_conf->mds_bal_merge_size) &&
-	merge_queue.count(dir->dirfrag()) == 0) {
+	merge_queue.count(dir->dirfrag()) == 0 &&
+	dir->should_merge()) {
       dout(10) << "hit_dir " << type << " pop is " << v << ", putting in merge_queue: " << *dir << dendl;
       merge_queue.insert(dir->dirfrag());
     }
@@ -1128,6 +1192,8 @@ void MDBalancer::subtract_export(CDir *dir, utime_t now)
 
 void MDBalancer::add_import(CDir *dir, utime_t now)
 {
+  last_imported[dir->dirfrag()] = now;
+
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
 
   while (true) {
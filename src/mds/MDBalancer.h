@@ -64,6 +64,9 @@ class MDBalancer {
   map<int32_t, int> old_prev_targets;  // # iterations they _haven't_ been targets
   bool check_targets();
 
+  map<dirfrag_t, utime_t> last_imported;
+  bool recently_imported(CDir *dir, utime_t now);
+
   double try_match(int ex, double& maxex,
                    int im, double& maxim);
   double get_maxim(int im) {
@@ -88,6 +91,7 @@ public:
 
   void tick();
 
+  bool can_start_fragmenting();
   void do_fragmenting();
 
   void export_empties();
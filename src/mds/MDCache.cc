@@ -93,6 +93,7 @@
 
 
 #include "InoTable.h"
+#include "OpenFileTable.h"
 
 #include "common/Timer.h"
 
@@ -143,6 +144,7 @@ MDCache::MDCache(MDS *m) :
 
   num_inodes_with_caps = 0;
   num_caps = 0;
+  cache_bytes_per_inode = 0;
 
   max_dir_commit_size = g_conf->mds_dir_max_commit_size ?
                         (g_conf->mds_dir_max_commit_size << 20) :
@@ -5163,7 +5165,10 @@ bool MDCache::process_imported_caps()
 
     cap_imports_num_opening++;
     dout(10) << "  opening missing ino " << p->first << dendl;
-    open_ino(p->first, (int64_t)-1, new C_MDC_RejoinOpenInoFinish(this, p->first), false);
+    vector<inode_backpointer_t> ancestors;
+    mds->openfiles->get_ancestors(p->first, ancestors);
+    open_ino(p->first, (int64_t)-1, new C_MDC_RejoinOpenInoFinish(this, p->first), false,
+	     false, &ancestors);
   }
 
   if (cap_imports_num_opening > 0)
@@ -6271,7 +6276,7 @@ bool MDCache::trim(int max)
 {
   // trim LRU
   if (max < 0) {
-    max = g_conf->mds_cache_size;
+    max = get_cache_size_max();
     if (!max) return false;
   }
   dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size() << dendl;
@@ -7104,6 +7109,15 @@ void MDCache::check_memory_usage()
   mds->mlogger->set(l_mdm_heap, last.get_heap());
   mds->mlogger->set(l_mdm_malloc, last.malloc);
 
+  // what the cache costs us per inode, with its dentries, dirfrags and
+  // caps; message and journal buffers are not part of it
+  uint64_t rss = (uint64_t)last.get_rss() << 10;
+  uint64_t buffers = buffer::get_total_alloc();
+  if (num_inodes > 0 && rss > buffers) {
+    cache_bytes_per_inode = (rss - buffers) / num_inodes;
+    mds->mlogger->set(l_mdm_bpi, cache_bytes_per_inode);
+  }
+
   /*int size = last.get_total();
   if (size > g_conf->mds_mem_max * .9) {
     float ratio = (float)g_conf->mds_mem_max * .9 / (float)size;
@@ -7111,14 +7125,47 @@ void MDCache::check_memory_usage()
       mds->server->recall_client_state(ratio);
   } else 
     */
-  if (num_inodes_with_caps > g_conf->mds_cache_size) {
-    float ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
-    if (ratio < 1.0)
-      mds->server->recall_client_state(ratio);
-  }
+  mds->mlogger->set(l_mdm_capi, num_inodes_with_caps);
 
+  // caps pin their inodes: once trim() cannot get the cache under its
+  // limit for them, ask clients to give enough back to get below 90%
+  int cache_size_max = get_cache_size_max();
+  int target = (int)(cache_size_max * .9);
+  int size = lru.lru_get_size();
+  if (cache_size_max && size > cache_size_max && num_inodes_with_caps > target)
+    mds->server->recall_client_state(MIN(num_inodes_with_caps, size) - target);
+
+}
+
+
+/*
+ * The cache is limited to mds_cache_size inodes and, if it is set, to
+ * mds_cache_memory_limit bytes, using the cost per inode measured by the
+ * last check_memory_usage().  0 means no limit.
+ */
+int MDCache::get_cache_size_max()
+{
+  int max = g_conf->mds_cache_size;
+  uint64_t limit = g_conf->mds_cache_memory_limit;
+  if (limit && cache_bytes_per_inode) {
+    uint64_t by_bytes = MAX(limit / cache_bytes_per_inode, 1);
+    if (!max || by_bytes < (uint64_t)max)
+      max = MIN(by_bytes, (uint64_t)INT_MAX);
+  }
+  return max;
 }
 
+void MDCache::cache_status(ostream& ss)
+{
+  ss << "cache has " << inode_map.size() << " inodes, "
+     << g_num_dir << " dirfrags, " << g_num_dn << " dentries, "
+     << num_caps << " caps; max " << get_cache_size_max() << " inodes";
+  if (g_conf->mds_cache_memory_limit)
+    ss << " (memory limit " << g_conf->mds_cache_memory_limit << " bytes)";
+  ss << "; " << cache_bytes_per_inode << " bytes per cached inode"
+     << " (sizeof CInode " << sizeof(CInode) << ", CDentry " << sizeof(CDentry)
+     << ", CDir " << sizeof(CDir) << ")";
+}
 
 
 // =========================================================================================
@@ -8627,7 +8674,8 @@ void MDCache::kick_open_ino_peers(int who)
 }
 
 void MDCache::open_ino(inodeno_t ino, int64_t pool, Context* fin,
-		       bool want_replica, bool want_xlocked)
+		       bool want_replica, bool want_xlocked,
+		       vector<inode_backpointer_t> *ancestors)
 {
   dout(10) << "open_ino " << ino << " pool " << pool << " want_replica "
 	   << want_replica << dendl;
@@ -8660,7 +8708,18 @@ void MDCache::open_ino(inodeno_t ino, int64_t pool, Context* fin,
     info.tid = ++open_ino_last_tid;
     info.pool = pool >= 0 ? pool : default_file_layout.fl_pg_pool;
     info.waiters.push_back(fin);
-    do_open_ino(ino, info, 0);
+    if (ancestors && !ancestors->empty()) {
+      // we were told where it was; walk down from there without asking
+      // peers or reading the backtrace, and fall back to that if wrong
+      dout(10) << " trying ancestors " << *ancestors << dendl;
+      info.ancestors = *ancestors;
+      info.check_peers = false;
+      info.fetch_backtrace = false;
+      info.checking = mds->get_nodeid();
+      _open_ino_traverse_dir(ino, info, 0);
+    } else {
+      do_open_ino(ino, info, 0);
+    }
   }
 }
 
@@ -107,6 +107,8 @@ public:
   int num_inodes_with_caps;
   int num_caps;
 
+  uint64_t cache_bytes_per_inode;  // measured by check_memory_usage()
+
   unsigned max_dir_commit_size;
 
   ceph_file_layout default_file_layout;
@@ -584,6 +586,8 @@ public:
 
   void trim_client_leases();
   void check_memory_usage();
+  int get_cache_size_max();
+  void cache_status(ostream& ss);
 
   // shutdown
   void shutdown_start();
@@ -825,7 +829,8 @@ protected:
 public:
   void kick_open_ino_peers(int who);
   void open_ino(inodeno_t ino, int64_t pool, Context *fin,
-		bool want_replica=true, bool want_xlocked=false);
+		bool want_replica=true, bool want_xlocked=false,
+		vector<inode_backpointer_t> *ancestors=NULL);
   
   // -- find_ino_peer --
   struct find_ino_peer_info_t {
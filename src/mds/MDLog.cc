@@ -67,7 +67,9 @@ void MDLog::create_logger()
   plb.add_u64(l_mdl_expos, "expos");
   plb.add_u64(l_mdl_wrpos, "wrpos");
   plb.add_u64(l_mdl_rdpos, "rdpos");
-  plb.add_u64(l_mdl_jlat, "jlat");
+  plb.add_time_avg(l_mdl_jlat, "jlat");
+  plb.add_u64_avg(l_mdl_jwrev, "jwrev");  // events per journal write
+  plb.add_time_avg(l_mdl_evenc, "evenc");
 
   // logger
   logger = plb.create_perf_counters();
@@ -86,6 +88,7 @@ void MDLog::init_journaler()
 			    &mds->timer);
   assert(journaler->is_readonly());
   journaler->set_write_error_handler(new C_MDL_WriteError(this));
+  journaler->set_write_entries_logger_key(l_mdl_jwrev);
 }
 
 void MDLog::handle_journaler_write_error(int r)
@@ -191,8 +194,11 @@ void MDLog::submit_entry(LogEvent *le, Context *c)
   
   // encode it, with event type
   {
+    utime_t start = ceph_clock_now(g_ceph_context);
     bufferlist bl;
     le->encode_with_header(bl);
+    if (logger)
+      logger->tinc(l_mdl_evenc, ceph_clock_now(g_ceph_context) - start);
 
     dout(5) << "submit_entry " << journaler->get_write_pos() << "~" << bl.length()
 	    << " : " << *le << dendl;
@@ -547,56 +553,76 @@ void MDLog::_replay_thread()
     
     assert(journaler->is_readable());
     
-    // read it
-    uint64_t pos = journaler->get_read_pos();
-    bufferlist bl;
-    bool r = journaler->try_read_entry(bl);
-    if (!r && journaler->get_error())
-      continue;
-    assert(r);
-    
-    // unpack event
-    LogEvent *le = LogEvent::decode(bl);
-    if (!le) {
-      dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	      << " -- unable to decode event" << dendl;
-      dout(0) << "dump of unknown or corrupt event:\n";
-      bl.hexdump(*_dout);
-      *_dout << dendl;
-
-      assert(!!"corrupt log event" == g_conf->mds_log_skip_corrupt_events);
+    // read what has been prefetched, up to a batch
+    list<ReplayEntry> batch;
+    while (journaler->is_readable() &&
+	   (int)batch.size() < g_conf->mds_log_replay_batch) {
+      batch.push_back(ReplayEntry(journaler->get_read_pos()));
+      ReplayEntry& e = batch.back();
+      if (!journaler->try_read_entry(e.bl)) {
+	batch.pop_back();
+	break;
+      }
+      e.end = journaler->get_read_pos();
+    }
+    if (batch.empty()) {
+      assert(journaler->get_error());
       continue;
     }
-    le->set_start_off(pos);
 
-    // new segment?
-    if (le->get_type() == EVENT_SUBTREEMAP ||
-	le->get_type() == EVENT_RESETJOURNAL) {
-      segments[pos] = new LogSegment(pos);
-      logger->set(l_mdl_seg, segments.size());
-    }
+    // unpack events; this needs nothing but the entries, so let the
+    // rest of the mds run meanwhile
+    mds->mds_lock.Unlock();
+    for (list<ReplayEntry>::iterator p = batch.begin(); p != batch.end(); ++p)
+      p->le = LogEvent::decode(p->bl);
+    mds->mds_lock.Lock();
 
-    // have we seen an import map yet?
-    if (segments.empty()) {
-      dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	       << " " << le->get_stamp() << " -- waiting for subtree_map.  (skipping " << *le << ")" << dendl;
-    } else {
-      dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	       << " " << le->get_stamp() << ": " << *le << dendl;
-      le->_segment = get_current_segment();    // replay may need this
-      le->_segment->num_events++;
-      le->_segment->end = journaler->get_read_pos();
-      num_events++;
-
-      le->replay(mds);
-    }
-    delete le;
+    for (list<ReplayEntry>::iterator p = batch.begin(); p != batch.end(); ++p) {
+      uint64_t pos = p->pos;
+      bufferlist& bl = p->bl;
+      LogEvent *le = p->le;
+      if (!le) {
+	dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
+		<< " -- unable to decode event" << dendl;
+	dout(0) << "dump of unknown or corrupt event:\n";
+	bl.hexdump(*_dout);
+	*_dout << dendl;
+
+	assert(!!"corrupt log event" == g_conf->mds_log_skip_corrupt_events);
+	continue;
+      }
+      le->set_start_off(pos);
 
-    logger->set(l_mdl_rdpos, pos);
+      // new segment?
+      if (le->get_type() == EVENT_SUBTREEMAP ||
+	  le->get_type() == EVENT_RESETJOURNAL) {
+	segments[pos] = new LogSegment(pos);
+	logger->set(l_mdl_seg, segments.size());
+      }
 
-    // drop lock for a second, so other events/messages (e.g. beacon timer!) can go off
-    mds->mds_lock.Unlock();
-    mds->mds_lock.Lock();
+      // have we seen an import map yet?
+      if (segments.empty()) {
+	dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
+		 << " " << le->get_stamp() << " -- waiting for subtree_map.  (skipping " << *le << ")" << dendl;
+      } else {
+	dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
+		 << " " << le->get_stamp() << ": " << *le << dendl;
+	le->_segment = get_current_segment();    // replay may need this
+	le->_segment->num_events++;
+	le->_segment->end = p->end;
+	num_events++;
+
+	le->replay(mds);
+      }
+      delete le;
+      p->le = NULL;
+
+      logger->set(l_mdl_rdpos, pos);
+
+      // drop lock for a second, so other events/messages (e.g. beacon timer!) can go off
+      mds->mds_lock.Unlock();
+      mds->mds_lock.Lock();
+    }
   }
 
   // done!
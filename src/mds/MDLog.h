@@ -34,6 +34,8 @@ enum {
   l_mdl_wrpos,
   l_mdl_rdpos,
   l_mdl_jlat,
+  l_mdl_evenc,
+  l_mdl_jwrev,
   l_mdl_last,
 };
 
@@ -94,6 +96,14 @@ protected:
 
   list<Context*> waitfor_replay;
 
+  // a journal entry read during replay
+  struct ReplayEntry {
+    uint64_t pos, end;
+    bufferlist bl;
+    LogEvent *le;
+    ReplayEntry(uint64_t p) : pos(p), end(p), le(NULL) {}
+  };
+
   void _replay();         // old way
   void _replay_thread();  // new way
 
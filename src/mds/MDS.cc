@@ -48,6 +48,7 @@
 #include "SnapClient.h"
 
 #include "InoTable.h"
+#include "OpenFileTable.h"
 
 #include "common/perf_counters.h"
 
@@ -128,6 +129,7 @@ MDS::MDS(const std::string &n, Messenger *m, MonClient *mc) :
   balancer = new MDBalancer(this);
 
   inotable = new InoTable(this);
+  openfiles = new OpenFileTable(this);
   snapserver = new SnapServer(this);
   snapclient = new SnapClient(this);
   anchorserver = new AnchorServer(this);
@@ -165,6 +167,7 @@ MDS::~MDS() {
   if (mdlog) { delete mdlog; mdlog = NULL; }
   if (balancer) { delete balancer; balancer = NULL; }
   if (inotable) { delete inotable; inotable = NULL; }
+  if (openfiles) { delete openfiles; openfiles = NULL; }
   if (anchorserver) { delete anchorserver; anchorserver = NULL; }
   if (snapserver) { delete snapserver; snapserver = NULL; }
   if (snapclient) { delete snapclient; snapclient = NULL; }
@@ -254,8 +257,15 @@ void MDS::create_logger()
     mds_plb.add_u64_counter(l_mds_iexp, "iexp");
     mds_plb.add_u64_counter(l_mds_im, "im");
     mds_plb.add_u64_counter(l_mds_iim, "iim");
+    mds_plb.add_time_avg(l_mds_dispatch_lock_wait, "dispatch_lock_wait");
+    mds_plb.add_time_avg(l_mds_dispatch_lock_held, "dispatch_lock_held");
+    mds_plb.add_u64_counter(l_mds_purge_objects, "purge_objects");  // file objects removed
+    mds_plb.add_u64(l_mds_purge_pending, "purge_pending");  // ... still to remove
+    mds_plb.add_time_avg(l_mds_purge_lat, "purge_latency");  // to purge a whole file
     logger = mds_plb.create_perf_counters();
     g_ceph_context->get_perfcounters_collection()->add(logger);
+    filer->set_purge_logger(logger, l_mds_purge_objects, l_mds_purge_pending,
+			    l_mds_purge_lat);
   }
 
   {
@@ -276,6 +286,9 @@ void MDS::create_logger()
     mdm_plb.add_u64(l_mdm_heap, "heap");
     mdm_plb.add_u64(l_mdm_malloc, "malloc");
     mdm_plb.add_u64(l_mdm_buf, "buf");
+    mdm_plb.add_u64(l_mdm_bpi, "bpi");
+    mdm_plb.add_u64(l_mdm_capi, "capi");  // inodes pinned by client caps
+    mdm_plb.add_u64_counter(l_mdm_recall, "recall");  // caps asked back
     mlogger = mdm_plb.create_perf_counters();
     g_ceph_context->get_perfcounters_collection()->add(mlogger);
   }
@@ -409,6 +422,7 @@ void MDS::send_message_client_counted(Message *m, Connection *connection)
 
 void MDS::send_message_client_counted(Message *m, Session *session)
 {
+  locker->flush_caps_batch(session->get_client());
   version_t seq = session->inc_push_seq();
   dout(10) << "send_message_client_counted " << session->info.inst.name << " seq "
 	   << seq << " " << *m << dendl;
@@ -421,6 +435,8 @@ void MDS::send_message_client_counted(Message *m, Session *session)
 
 void MDS::send_message_client(Message *m, Session *session)
 {
+  if (m->get_type() != CEPH_MSG_CLIENT_CAPS_BATCH)
+    locker->flush_caps_batch(session->get_client());
   dout(10) << "send_message_client " << session->info.inst << " " << *m << dendl;
  if (session->connection) {
     messenger->send_message(m, session->connection);
@@ -580,6 +596,7 @@ void MDS::tick()
     mdcache->trim_client_leases();
     mdcache->check_memory_usage();
     mdlog->trim();  // NOT during recovery!
+    openfiles->commit();
   }
 
   // log
@@ -740,6 +757,11 @@ void MDS::handle_command(MMonCommand *m)
     else
       mdcache->dump_cache();
   }
+  else if (m->cmd[0] == "cache_status") {
+    ostringstream ss;
+    mdcache->cache_status(ss);
+    clog.info() << ss.str();
+  }
   else if (m->cmd[0] == "exit") {
     suicide();
   }
@@ -1252,6 +1274,9 @@ void MDS::boot_start(int step, int r)
       dout(2) << "boot_start " << step << ": opening sessionmap" << dendl;
       sessionmap.load(gather.new_sub());
 
+      dout(2) << "boot_start " << step << ": opening open file table" << dendl;
+      openfiles->load(gather.new_sub());
+
       if (mdsmap->get_tableserver() == whoami) {
 	dout(2) << "boot_start " << step << ": opening anchor table" << dendl;
 	anchorserver->load(gather.new_sub());
@@ -1552,6 +1577,7 @@ void MDS::active_start()
 
   mdcache->clean_open_file_lists();
   mdcache->export_remaining_imported_caps();
+  openfiles->trim_unreclaimed();
   finish_contexts(g_ceph_context, waiting_for_replay);  // kick waiters
   finish_contexts(g_ceph_context, waiting_for_active);  // kick waiters
 }
@@ -1705,7 +1731,9 @@ void MDS::respawn()
 bool MDS::ms_dispatch(Message *m)
 {
   bool ret;
+  utime_t start = ceph_clock_now(g_ceph_context);
   mds_lock.Lock();
+  utime_t locked = ceph_clock_now(g_ceph_context);
   if (want_state == CEPH_MDS_STATE_DNE) {
     dout(10) << " stopping, discarding " << *m << dendl;
     m->put();
@@ -1713,6 +1741,11 @@ bool MDS::ms_dispatch(Message *m)
   } else {
     ret = _dispatch(m);
   }
+  // how long messages wait for, and then hold, the big lock
+  if (logger) {
+    logger->tinc(l_mds_dispatch_lock_wait, locked - start);
+    logger->tinc(l_mds_dispatch_lock_held, ceph_clock_now(g_ceph_context) - locked);
+  }
   mds_lock.Unlock();
   return ret;
 }
@@ -2067,6 +2100,8 @@ bool MDS::_dispatch(Message *m)
       dout(7) << "shutdown_pass=false" << dendl;
     }
   }
+
+  locker->flush_caps_batches();
   return true;
 }
 
@@ -74,6 +74,11 @@ enum {
   l_mds_iexp,
   l_mds_im,
   l_mds_iim,
+  l_mds_dispatch_lock_wait,
+  l_mds_dispatch_lock_held,
+  l_mds_purge_objects,
+  l_mds_purge_pending,
+  l_mds_purge_lat,
   l_mds_last,
 };
 
@@ -100,6 +105,9 @@ enum {
   l_mdm_heap,
   l_mdm_malloc,
   l_mdm_buf,
+  l_mdm_bpi,
+  l_mdm_capi,
+  l_mdm_recall,
   l_mdm_last,
 };
 
@@ -132,6 +140,7 @@ class MClientReply;
 class MMDSBeacon;
 
 class InoTable;
+class OpenFileTable;
 class SnapServer;
 class SnapClient;
 class AnchorServer;
@@ -175,6 +184,7 @@ class MDS : public Dispatcher {
   MDBalancer   *balancer;
 
   InoTable     *inotable;
+  OpenFileTable *openfiles;
 
   AnchorServer *anchorserver;
   AnchorClient *anchorclient;
@@ -0,0 +1,216 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "MDS.h"
+#include "MDCache.h"
+#include "CInode.h"
+#include "OpenFileTable.h"
+#include "osdc/Objecter.h"
+
+#include "common/config.h"
+#include "common/errno.h"
+#include "include/assert.h"
+
+#define dout_subsys ceph_subsys_mds
+#undef dout_prefix
+#define dout_prefix *_dout << "mds." << mds->get_nodeid() << ".openfiles "
+
+// keys read per op when loading
+static const unsigned LOAD_MAX_KEYS = 10000;
+
+static string ino_key(inodeno_t ino)
+{
+  char s[20];
+  snprintf(s, sizeof(s), "%llx", (unsigned long long)ino.val);
+  return string(s);
+}
+
+object_t OpenFileTable::get_object_name()
+{
+  char s[30];
+  snprintf(s, sizeof(s), "mds%d_openfiles", mds->whoami);
+  return object_t(s);
+}
+
+void OpenFileTable::add_inode(CInode *in)
+{
+  if (in->is_base() || in->last != CEPH_NOSNAP)
+    return;
+  dout(20) << "add_inode " << *in << dendl;
+  removed.erase(in->ino());
+  dirty[in->ino()] = in;
+}
+
+void OpenFileTable::remove_inode(CInode *in)
+{
+  if (in->is_base() || in->last != CEPH_NOSNAP)
+    return;
+  dout(20) << "remove_inode " << *in << dendl;
+  dirty.erase(in->ino());
+  removed.insert(in->ino());
+}
+
+
+// ----------------
+// COMMIT
+
+class C_OFT_Committed : public Context {
+  OpenFileTable *oft;
+public:
+  C_OFT_Committed(OpenFileTable *t) : oft(t) {}
+  void finish(int r) {
+    oft->_commit_finish(r);
+  }
+};
+
+void OpenFileTable::commit()
+{
+  if (committing || (dirty.empty() && removed.empty()))
+    return;
+
+  map<string, bufferlist> to_set;
+  set<string> to_remove;
+
+  int64_t pool = mds->mdsmap->get_metadata_pool();
+  for (map<inodeno_t, CInode*>::iterator p = dirty.begin(); p != dirty.end(); ++p) {
+    inode_backtrace_t bt;
+    p->second->build_backtrace(pool, bt);
+    if (bt.ancestors.empty())
+      continue;
+    ::encode(bt.ancestors, to_set[ino_key(p->first)]);
+    on_disk.insert(p->first);
+  }
+  for (set<inodeno_t>::iterator p = removed.begin(); p != removed.end(); ++p) {
+    if (on_disk.erase(*p))
+      to_remove.insert(ino_key(*p));
+  }
+  dirty.clear();
+  removed.clear();
+
+  if (to_set.empty() && to_remove.empty())
+    return;
+
+  dout(10) << "commit " << to_set.size() << " open, " << to_remove.size()
+	   << " closed" << dendl;
+
+  ObjectOperation op;
+  op.create(false);
+  if (!to_remove.empty())
+    op.omap_rm_keys(to_remove);
+  if (!to_set.empty())
+    op.omap_set(to_set);
+
+  SnapContext snapc;
+  object_locator_t oloc(pool);
+  committing = true;
+  mds->objecter->mutate(get_object_name(), oloc, op, snapc,
+			ceph_clock_now(g_ceph_context), 0,
+			NULL, new C_OFT_Committed(this));
+}
+
+void OpenFileTable::_commit_finish(int r)
+{
+  dout(10) << "_commit_finish " << r << dendl;
+  committing = false;
+  if (r < 0)
+    derr << "failed to write open file table: " << cpp_strerror(r) << dendl;
+}
+
+
+// ----------------
+// LOAD
+
+class C_OFT_Load : public Context {
+  OpenFileTable *oft;
+public:
+  map<string, bufferlist> omap;
+  int ret;
+  C_OFT_Load(OpenFileTable *t) : oft(t), ret(0) {}
+  void finish(int r) {
+    if (r >= 0)
+      r = ret;
+    oft->_load_finish(r, omap, omap.size() >= LOAD_MAX_KEYS);
+  }
+};
+
+void OpenFileTable::load(Context *onload)
+{
+  dout(10) << "load" << dendl;
+  if (onload)
+    waiting_for_load.push_back(onload);
+  _load(string());
+}
+
+void OpenFileTable::_load(const string& start_after)
+{
+  C_OFT_Load *c = new C_OFT_Load(this);
+  ObjectOperation op;
+  op.omap_get_vals(start_after, "", LOAD_MAX_KEYS, &c->omap, &c->ret);
+  object_locator_t oloc(mds->mdsmap->get_metadata_pool());
+  mds->objecter->read(get_object_name(), oloc, op, CEPH_NOSNAP, NULL, 0, c);
+}
+
+void OpenFileTable::_load_finish(int r, map<string, bufferlist>& omap, bool more)
+{
+  if (r == -ENOENT) {
+    dout(10) << "_load_finish no table" << dendl;
+    r = 0;
+    more = false;
+  } else if (r < 0) {
+    // only a hint; recover without it
+    derr << "_load_finish got " << cpp_strerror(r) << ", ignoring open file table" << dendl;
+    more = false;
+  } else {
+    for (map<string, bufferlist>::iterator p = omap.begin(); p != omap.end(); ++p) {
+      inodeno_t ino(strtoull(p->first.c_str(), NULL, 16));
+      bufferlist::iterator q = p->second.begin();
+      try {
+	::decode(loaded_anchors[ino], q);
+      } catch (buffer::error& e) {
+	derr << "_load_finish bad entry for " << ino << dendl;
+	loaded_anchors.erase(ino);
+      }
+      on_disk.insert(ino);
+    }
+  }
+
+  // keys sort as strings, not as inos, so continue after the last key we got
+  if (more) {
+    _load(omap.rbegin()->first);
+    return;
+  }
+
+  dout(10) << "_load_finish " << on_disk.size() << " open inodes" << dendl;
+  finish_contexts(g_ceph_context, waiting_for_load);
+}
+
+bool OpenFileTable::get_ancestors(inodeno_t ino, vector<inode_backpointer_t>& ancestors)
+{
+  map<inodeno_t, vector<inode_backpointer_t> >::iterator p = loaded_anchors.find(ino);
+  if (p == loaded_anchors.end())
+    return false;
+  ancestors = p->second;
+  return true;
+}
+
+void OpenFileTable::trim_unreclaimed()
+{
+  loaded_anchors.clear();
+  for (set<inodeno_t>::iterator p = on_disk.begin(); p != on_disk.end(); ++p) {
+    CInode *in = mds->mdcache->get_inode(*p);
+    if (!in || !in->is_any_caps())
+      removed.insert(*p);
+  }
+  dout(10) << "trim_unreclaimed " << removed.size() << " not reopened" << dendl;
+}
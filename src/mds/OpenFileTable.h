@@ -0,0 +1,73 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OPENFILETABLE_H
+#define CEPH_OPENFILETABLE_H
+
+#include "mdstypes.h"
+#include "inode_backtrace.h"
+#include "include/Context.h"
+
+class MDS;
+class CInode;
+
+/*
+ * The inodes this rank has issued client caps on, with their ancestry,
+ * kept in the omap of mds<rank>_openfiles in the metadata pool.
+ *
+ * After a restart, clients reassert caps on inodes that may not be in
+ * the cache.  Opening each of them from its backtrace costs a query to
+ * the other ranks and a read from the data pool; with the table, rejoin
+ * walks down from the nearest cached ancestor instead, and the dirfrag
+ * fetches are shared between all inodes under the same directory.
+ *
+ * The table is only a hint: it is written back from tick(), is not
+ * updated on rename, and a stale entry just falls back to the normal
+ * open_ino path.  Entries that no client reclaims are dropped once
+ * rejoin is over.
+ */
+class OpenFileTable {
+  MDS *mds;
+
+  set<inodeno_t> on_disk;         // keys in the object, as far as we know
+  map<inodeno_t, CInode*> dirty;  // to (re)write
+  set<inodeno_t> removed;         // to remove
+  bool committing;
+
+  // ancestors of what was open when we last stopped; only until rejoin is done
+  map<inodeno_t, vector<inode_backpointer_t> > loaded_anchors;
+  list<Context*> waiting_for_load;
+
+  object_t get_object_name();
+  void _load(const string& start_after);
+
+public:
+  OpenFileTable(MDS *m) : mds(m), committing(false) {}
+
+  void add_inode(CInode *in);
+  void remove_inode(CInode *in);
+
+  void commit();
+  void _commit_finish(int r);
+
+  void load(Context *onload);
+  void _load_finish(int r, map<string, bufferlist>& omap, bool more);
+
+  /// ancestors recorded for ino before the restart, if any
+  bool get_ancestors(inodeno_t ino, vector<inode_backpointer_t>& ancestors);
+  /// forget the loaded ancestors, and queue removal of entries nobody reclaimed
+  void trim_unreclaimed();
+};
+
+#endif
@@ -725,31 +725,43 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
   for (int i = 0; i < numlocks; ++i) {
     ::decode(lock, p);
     lock.client = client;
-    in->fcntl_locks.held_locks.insert(pair<uint64_t, ceph_filelock>
-				      (lock.start, lock));
-    ++in->fcntl_locks.client_held_lock_counts[client];
+    ceph_lock_state_t *lock_state = in->get_fcntl_lock_state();
+    lock_state->held_locks.insert(pair<uint64_t, ceph_filelock>
+				  (lock.start, lock));
+    ++lock_state->client_held_lock_counts[client];
   }
   ::decode(numlocks, p);
   for (int i = 0; i < numlocks; ++i) {
     ::decode(lock, p);
     lock.client = client;
-    in->flock_locks.held_locks.insert(pair<uint64_t, ceph_filelock>
-				      (lock.start, lock));
-    ++in->flock_locks.client_held_lock_counts[client];
+    ceph_lock_state_t *lock_state = in->get_flock_lock_state();
+    lock_state->held_locks.insert(pair<uint64_t, ceph_filelock>
+				  (lock.start, lock));
+    ++lock_state->client_held_lock_counts[client];
   }
 }
 
-void Server::recall_client_state(float ratio)
+/*
+ * Ask clients to give back about want caps, taking them from the
+ * clients that hold the most first.  A client is asked for at most
+ * mds_recall_max_caps at a time, and not again for mds_recall_interval,
+ * so that it has time to comply before we count on it again.
+ */
+void Server::recall_client_state(uint64_t want)
 {
-  int max_caps_per_client = (int)(g_conf->mds_cache_size * .8);
-  int min_caps_per_client = 100;
+  uint64_t max_caps_per_client = (uint64_t)(mdcache->get_cache_size_max() * .8);
+  uint64_t min_caps_per_client = 100;
+  utime_t now = ceph_clock_now(g_ceph_context);
+  utime_t cutoff = now;
+  cutoff -= g_conf->mds_recall_interval;
 
-  dout(10) << "recall_client_state " << ratio
+  dout(10) << "recall_client_state " << want << " caps"
 	   << ", caps per client " << min_caps_per_client << "-" << max_caps_per_client
 	   << dendl;
 
   set<Session*> sessions;
   mds->sessionmap.get_client_session_set(sessions);
+  vector<pair<uint64_t, Session*> > by_caps;
   for (set<Session*>::const_iterator p = sessions.begin();
        p != sessions.end();
        ++p) {
@@ -757,22 +769,41 @@ void Server::recall_client_state(float ratio)
     if (!session->is_open() ||
 	!session->info.inst.name.is_client())
       continue;
+    by_caps.push_back(make_pair((uint64_t)session->caps.size(), session));
+  }
+  sort(by_caps.begin(), by_caps.end(), greater<pair<uint64_t, Session*> >());
+
+  uint64_t recalled = 0;
+  for (vector<pair<uint64_t, Session*> >::iterator p = by_caps.begin();
+       p != by_caps.end() && recalled < want;
+       ++p) {
+    uint64_t caps = p->first;
+    Session *session = p->second;
+    if (caps <= min_caps_per_client)
+      break;  // and so do all that follow
 
     dout(10) << " session " << session->info.inst
-	     << " caps " << session->caps.size()
+	     << " caps " << caps
 	     << ", leases " << session->leases.size()
 	     << dendl;
 
-    if (session->caps.size() > min_caps_per_client) {	
-      int newlim = (int)(session->caps.size() * ratio);
-      if (newlim > max_caps_per_client)
-	newlim = max_caps_per_client;
-      MClientSession *m = new MClientSession(CEPH_SESSION_RECALL_STATE);
-      m->head.max_caps = newlim;
-      mds->send_message_client(m, session);
+    if (session->last_recall_sent > cutoff) {
+      dout(10) << "  asked at " << session->last_recall_sent << ", waiting" << dendl;
+      continue;
     }
-  }
- 
+
+    uint64_t n = MIN(caps - min_caps_per_client, want - recalled);
+    n = MIN(n, (uint64_t)g_conf->mds_recall_max_caps);
+    uint64_t newlim = caps - n;
+    if (newlim > max_caps_per_client)
+      newlim = max_caps_per_client;
+    MClientSession *m = new MClientSession(CEPH_SESSION_RECALL_STATE);
+    m->head.max_caps = newlim;
+    mds->send_message_client(m, session);
+    session->last_recall_sent = now;
+    recalled += caps - newlim;
+  }
+  mds->mlogger->inc(l_mdm_recall, recalled);
 }
 
 
@@ -874,6 +905,7 @@ void Server::early_reply(MDRequest *mdr, CInode *tracei, CDentry *tracedn)
   }
 
   reply->set_extra_bl(mdr->reply_extra_bl);
+  mds->locker->flush_caps_batch(client_t(req->get_source().num()));
   messenger->send_message(reply, req->get_connection());
 
   mdr->did_early_reply = true;
@@ -958,6 +990,7 @@ void Server::reply_request(MDRequest *mdr, MClientReply *reply, CInode *tracei,
     }
 
     reply->set_mdsmap_epoch(mds->mdsmap->get_epoch());
+    mds->locker->flush_caps_batch(client_t(req->get_source().num()));
     messenger->send_message(reply, client_con);
   }
   
@@ -3080,11 +3113,11 @@ void Server::handle_client_file_setlock(MDRequest *mdr)
   // get the appropriate lock state
   switch (req->head.args.filelock_change.rule) {
   case CEPH_LOCK_FLOCK:
-    lock_state = &cur->flock_locks;
+    lock_state = cur->get_flock_lock_state();
     break;
 
   case CEPH_LOCK_FCNTL:
-    lock_state = &cur->fcntl_locks;
+    lock_state = cur->get_fcntl_lock_state();
     break;
 
   default:
@@ -3167,11 +3200,11 @@ void Server::handle_client_file_readlock(MDRequest *mdr)
   ceph_lock_state_t *lock_state = NULL;
   switch (req->head.args.filelock_change.rule) {
   case CEPH_LOCK_FLOCK:
-    lock_state = &cur->flock_locks;
+    lock_state = cur->get_flock_lock_state();
     break;
 
   case CEPH_LOCK_FCNTL:
-    lock_state = &cur->fcntl_locks;
+    lock_state = cur->get_fcntl_lock_state();
     break;
 
   default:
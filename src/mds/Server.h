@@ -93,7 +93,7 @@ public:
   void reconnect_tick();
   void recover_filelocks(CInode *in, bufferlist locks, int64_t client);
 
-  void recall_client_state(float ratio);
+  void recall_client_state(uint64_t want);
 
   // -- requests --
   void handle_client_request(MClientRequest *m);
@@ -148,6 +148,7 @@ public:
   xlist<Capability*> caps;     // inodes with caps; front=most recently used
   xlist<ClientLease*> leases;  // metadata leases to clients
   utime_t last_cap_renew;
+  utime_t last_recall_sent;  // see Server::recall_client_state()
 
 public:
   version_t inc_push_seq() { return ++cap_push_seq; }
@@ -805,24 +805,27 @@ void dirfrag_load_vec_t::generate_test_instances(list<dirfrag_load_vec_t*>& ls)
  * mds_load_t
  */
 void mds_load_t::encode(bufferlist &bl) const {
-  ENCODE_START(2, 2, bl);
+  ENCODE_START(3, 2, bl);
   ::encode(auth, bl);
   ::encode(all, bl);
   ::encode(req_rate, bl);
   ::encode(cache_hit_rate, bl);
   ::encode(queue_len, bl);
   ::encode(cpu_load_avg, bl);
+  ::encode(num_caps, bl);
   ENCODE_FINISH(bl);
 }
 
 void mds_load_t::decode(const utime_t &t, bufferlist::iterator &bl) {
-  DECODE_START_LEGACY_COMPAT_LEN(2, 2, 2, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
   ::decode(auth, t, bl);
   ::decode(all, t, bl);
   ::decode(req_rate, bl);
   ::decode(cache_hit_rate, bl);
   ::decode(queue_len, bl);
   ::decode(cpu_load_avg, bl);
+  if (struct_v >= 3)
+    ::decode(num_caps, bl);
   DECODE_FINISH(bl);
 }
 
@@ -832,6 +835,7 @@ void mds_load_t::dump(Formatter *f) const
   f->dump_float("cache hit rate", cache_hit_rate);
   f->dump_float("queue length", queue_len);
   f->dump_float("cpu load", cpu_load_avg);
+  f->dump_unsigned("caps", num_caps);
   f->open_object_section("auth dirfrag");
   auth.dump(f);
   f->close_section();
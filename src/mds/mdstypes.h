@@ -967,14 +967,17 @@ struct mds_load_t {
 
   double cpu_load_avg;
 
+  uint64_t num_caps;
+
   mds_load_t(const utime_t &t) : 
     auth(t), all(t), req_rate(0), cache_hit_rate(0),
-    queue_len(0), cpu_load_avg(0)
+    queue_len(0), cpu_load_avg(0), num_caps(0)
   {}
   // mostly for the dencoder infrastructure
   mds_load_t() :
     auth(), all(),
-    req_rate(0), cache_hit_rate(0), queue_len(0), cpu_load_avg(0)
+    req_rate(0), cache_hit_rate(0), queue_len(0), cpu_load_avg(0),
+    num_caps(0)
   {}
   
   double mds_load();  // defiend in MDBalancer.cc
@@ -997,6 +1000,7 @@ inline ostream& operator<<( ostream& out, mds_load_t& load )
              << ", hr " << load.cache_hit_rate
              << ", qlen " << load.queue_len
 	     << ", cpu " << load.cpu_load_avg
+	     << ", caps " << load.num_caps
              << ">";
 }
 
@@ -18,7 +18,7 @@
 #include "msg/Message.h"
 
 class MBackfillReserve : public Message {
-  static const int HEAD_VERSION = 3;
+  static const int HEAD_VERSION = 4;
   static const int COMPAT_VERSION = 1;
 public:
   spg_t pgid;
@@ -27,19 +27,23 @@ public:
     REQUEST = 0,
     GRANT = 1,
     REJECT = 2,
+    REVOKE = 3,   // replica -> primary: our grant was preempted
+    RELEASE = 4,  // primary -> replica: give the grant back, we will ask again
   };
   int type;
   unsigned priority;
+  bool preemptible;  ///< REQUEST: replica may REVOKE its grant
 
   MBackfillReserve()
     : Message(MSG_OSD_BACKFILL_RESERVE, HEAD_VERSION, COMPAT_VERSION),
-      query_epoch(0), type(-1), priority(-1) {}
+      query_epoch(0), type(-1), priority(-1), preemptible(false) {}
   MBackfillReserve(int type,
 		   spg_t pgid,
-		   epoch_t query_epoch, unsigned prio = -1)
+		   epoch_t query_epoch, unsigned prio = -1,
+		   bool preemptible = false)
     : Message(MSG_OSD_BACKFILL_RESERVE, HEAD_VERSION, COMPAT_VERSION),
       pgid(pgid), query_epoch(query_epoch),
-      type(type), priority(prio) {}
+      type(type), priority(prio), preemptible(preemptible) {}
 
   const char *get_type_name() const {
     return "MBackfillReserve";
@@ -57,9 +61,19 @@ public:
     case REJECT:
       out << "REJECT ";
       break;
+    case REVOKE:
+      out << "REVOKE ";
+      break;
+    case RELEASE:
+      out << "RELEASE ";
+      break;
     }
     out << " pgid: " << pgid << ", query_epoch: " << query_epoch;
-    if (type == REQUEST) out << ", prio: " << priority;
+    if (type == REQUEST) {
+      out << ", prio: " << priority;
+      if (preemptible)
+	out << ", preemptible";
+    }
     return;
   }
 
@@ -76,7 +90,10 @@ public:
       ::decode(pgid.shard, p);
     else
       pgid.shard = ghobject_t::no_shard();
-
+    if (header.version >= 4)
+      ::decode(preemptible, p);
+    else
+      preemptible = false;
   }
 
   void encode_payload(uint64_t features) {
@@ -85,6 +102,7 @@ public:
     ::encode(type, payload);
     ::encode(priority, payload);
     ::encode(pgid.shard, payload);
+    ::encode(preemptible, payload);
   }
 };
 
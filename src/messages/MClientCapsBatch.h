@@ -0,0 +1,72 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MCLIENTCAPSBATCH_H
+#define CEPH_MCLIENTCAPSBATCH_H
+
+#include "msg/Message.h"
+#include "MClientCaps.h"
+
+/*
+ * Several MClientCaps for one client in a single message, so that
+ * issuing or revoking caps on many inodes at once does not cost a
+ * message each.  The client handles them in order, as if they had
+ * arrived one by one.  Only sent to clients with
+ * CEPH_FEATURE_MDS_CAPS_BATCH.
+ */
+class MClientCapsBatch : public Message {
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+ public:
+  vector<MClientCaps*> caps;
+
+  MClientCapsBatch()
+    : Message(CEPH_MSG_CLIENT_CAPS_BATCH, HEAD_VERSION, COMPAT_VERSION) {}
+private:
+  ~MClientCapsBatch() {
+    for (vector<MClientCaps*>::iterator p = caps.begin(); p != caps.end(); ++p)
+      (*p)->put();
+  }
+
+public:
+  const char *get_type_name() const { return "Cfcaps_batch"; }
+  void print(ostream& out) const {
+    out << "client_caps_batch(" << caps.size() << " caps)";
+  }
+
+  void encode_payload(uint64_t features) {
+    __u32 n = caps.size();
+    ::encode(n, payload);
+    for (vector<MClientCaps*>::iterator p = caps.begin(); p != caps.end(); ++p)
+      encode_message(*p, features, payload);
+  }
+  void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    __u32 n;
+    ::decode(n, p);
+    caps.reserve(n);
+    while (n--) {
+      Message *m = decode_message(NULL, p);
+      if (!m || m->get_type() != CEPH_MSG_CLIENT_CAPS) {
+	if (m)
+	  m->put();
+	throw buffer::malformed_input("bad MClientCaps in MClientCapsBatch");
+      }
+      caps.push_back(static_cast<MClientCaps*>(m));
+    }
+  }
+};
+
+#endif
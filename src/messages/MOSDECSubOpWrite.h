@@ -49,7 +49,7 @@ public:
   virtual void encode_payload(uint64_t features) {
     ::encode(pgid, payload);
     ::encode(map_epoch, payload);
-    ::encode(op, payload);
+    op.encode(payload, features);
   }
 
   const char *get_type_name() const { return "MOSDECSubOpWrite"; }
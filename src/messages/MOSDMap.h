@@ -29,6 +29,17 @@ class MOSDMap : public Message {
   map<epoch_t, bufferlist> maps;
   map<epoch_t, bufferlist> incremental_maps;
   epoch_t oldest_map, newest_map;
+  /// peer features the maps are already encoded for, if not the current encoding
+  uint64_t encode_features;
+
+  /// peers without these get the maps reencoded in an older format
+  static bool need_reencode(uint64_t features) {
+    return (features & CEPH_FEATURE_PGID64) == 0 ||
+      (features & CEPH_FEATURE_PGPOOL3) == 0 ||
+      (features & CEPH_FEATURE_OSDENC) == 0 ||
+      (features & CEPH_FEATURE_OSDMAP_ENC) == 0 ||
+      (features & CEPH_FEATURE_OSDMAP_COMPACT) == 0;
+  }
 
   epoch_t get_first() const {
     epoch_t e = 0;
@@ -56,11 +67,11 @@ class MOSDMap : public Message {
   }
 
 
-  MOSDMap() : Message(CEPH_MSG_OSD_MAP, HEAD_VERSION) { }
+  MOSDMap() : Message(CEPH_MSG_OSD_MAP, HEAD_VERSION), encode_features(0) { }
   MOSDMap(const uuid_d &f, OSDMap *oc=0)
     : Message(CEPH_MSG_OSD_MAP, HEAD_VERSION),
       fsid(f),
-      oldest_map(0), newest_map(0) {
+      oldest_map(0), newest_map(0), encode_features(0) {
     if (oc)
       oc->encode(maps[oc->get_epoch()]);
   }
@@ -84,21 +95,18 @@ public:
   }
   void encode_payload(uint64_t features) {
     ::encode(fsid, payload);
-    if ((features & CEPH_FEATURE_PGID64) == 0 ||
-	(features & CEPH_FEATURE_PGPOOL3) == 0 ||
-	(features & CEPH_FEATURE_OSDENC) == 0 ||
-        (features & CEPH_FEATURE_OSDMAP_ENC) == 0) {
+    if (need_reencode(features)) {
       if ((features & CEPH_FEATURE_PGID64) == 0 ||
 	  (features & CEPH_FEATURE_PGPOOL3) == 0)
 	header.version = 1;  // old old_client version
       else if ((features & CEPH_FEATURE_OSDENC) == 0)
 	header.version = 2;  // old pg_pool_t
-
+    }
+    if (need_reencode(features) && features != encode_features) {
       // reencode maps using old format
       //
-      // FIXME: this can probably be done more efficiently higher up
-      // the stack, or maybe replaced with something that only
-      // includes the pools the client cares about.
+      // the monitor does this up front, and caches the result
+      // (encode_features); other senders still pay for it here.
       for (map<epoch_t,bufferlist>::iterator p = incremental_maps.begin();
 	   p != incremental_maps.end();
 	   ++p) {
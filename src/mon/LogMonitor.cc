@@ -131,27 +131,37 @@ void LogMonitor::update_from_paxos(bool *need_bootstrap)
       le.decode(p);
       dout(7) << "update_from_paxos applying incremental log " << summary.version+1 <<  " " << le << dendl;
 
-      if (g_conf->mon_cluster_log_to_syslog) {
-	le.log_to_syslog(g_conf->mon_cluster_log_to_syslog_level,
-			 g_conf->mon_cluster_log_to_syslog_facility);
-      }
-      if (g_conf->mon_cluster_log_file.length()) {
-	int min = string_to_syslog_level(g_conf->mon_cluster_log_file_level);
-	int l = clog_type_to_syslog_level(le.type);
-	if (l <= min) {
-	  stringstream ss;
-	  ss << le << "\n";
-	  blog.append(ss.str());
-	}
-      }
-
+      log_locally(le, blog);
       summary.add(le);
     }
 
     summary.version++;
   }
 
+  write_log_file(blog);
+
+  check_subs();
+}
+
+void LogMonitor::log_locally(LogEntry& le, bufferlist& blog)
+{
+  if (g_conf->mon_cluster_log_to_syslog) {
+    le.log_to_syslog(g_conf->mon_cluster_log_to_syslog_level,
+		     g_conf->mon_cluster_log_to_syslog_facility);
+  }
+  if (g_conf->mon_cluster_log_file.length()) {
+    int min = string_to_syslog_level(g_conf->mon_cluster_log_file_level);
+    int l = clog_type_to_syslog_level(le.type);
+    if (l <= min) {
+      stringstream ss;
+      ss << le << "\n";
+      blog.append(ss.str());
+    }
+  }
+}
 
+void LogMonitor::write_log_file(bufferlist& blog)
+{
   if (blog.length()) {
     int fd = ::open(g_conf->mon_cluster_log_file.c_str(), O_WRONLY|O_APPEND|O_CREAT, 0600);
     if (fd < 0) {
@@ -166,8 +176,6 @@ void LogMonitor::update_from_paxos(bool *need_bootstrap)
       TEMP_FAILURE_RETRY(::close(fd));
     }
   }
-
-  check_subs();
 }
 
 void LogMonitor::store_do_append(MonitorDBStore::Transaction *t,
@@ -185,6 +193,7 @@ void LogMonitor::create_pending()
 {
   pending_log.clear();
   pending_summary = summary;
+  pending_per_source.clear();
   dout(10) << "create_pending v " << (get_last_committed() + 1) << dendl;
 }
 
@@ -256,10 +265,23 @@ bool LogMonitor::prepare_update(PaxosServiceMessage *m)
   }
 }
 
+/*
+ * Entries below mon_cluster_log_paxos_level are not worth a paxos
+ * round: if a message has nothing else, the mon that got it logs them
+ * to its own syslog and cluster log file, acks, and that's it.  They
+ * are not seen by the other mons or by 'ceph -w'.
+ */
+bool LogMonitor::needs_paxos(const LogEntry& le)
+{
+  return clog_type_to_syslog_level(le.type) <=
+    string_to_syslog_level(g_conf->mon_cluster_log_paxos_level);
+}
+
 bool LogMonitor::preprocess_log(MLog *m)
 {
   dout(10) << "preprocess_log " << *m << " from " << m->get_orig_source() << dendl;
   int num_new = 0;
+  bool any_paxos = false;
 
   MonSession *session = m->get_session();
   if (!session)
@@ -273,13 +295,29 @@ bool LogMonitor::preprocess_log(MLog *m)
   for (deque<LogEntry>::iterator p = m->entries.begin();
        p != m->entries.end();
        ++p) {
-    if (!pending_summary.contains(p->key()))
+    if (!pending_summary.contains(p->key())) {
       num_new++;
+      if (needs_paxos(*p))
+	any_paxos = true;
+    }
   }
   if (!num_new) {
     dout(10) << "  nothing new" << dendl;
     goto done;
   }
+  if (!any_paxos) {
+    dout(10) << "  logging " << num_new << " entries locally" << dendl;
+    bufferlist blog;
+    for (deque<LogEntry>::iterator p = m->entries.begin();
+	 p != m->entries.end();
+	 ++p) {
+      if (!pending_summary.contains(p->key()))
+	log_locally(*p, blog);
+    }
+    write_log_file(blog);
+    mon->send_reply(m, new MLogAck(m->fsid, m->entries.rbegin()->seq));
+    goto done;
+  }
 
   return false;
 
@@ -299,15 +337,30 @@ bool LogMonitor::prepare_log(MLog *m)
     return false;
   }
 
+  // one chatty source should not fill the round; what is over the
+  // cap is acked but dropped
+  int cap = g_conf->mon_log_max_entries_per_source;
+  unsigned& num = pending_per_source[m->get_orig_source()];
+  unsigned dropped = 0;
   for (deque<LogEntry>::iterator p = m->entries.begin();
        p != m->entries.end();
        ++p) {
     dout(10) << " logging " << *p << dendl;
     if (!pending_summary.contains(p->key())) {
+      if (cap > 0 && num >= (unsigned)cap &&
+	  p->type != CLOG_SEC && p->type < CLOG_ERROR) {
+	dropped++;
+	continue;
+      }
+      num++;
       pending_summary.add(*p);
       pending_log.insert(pair<utime_t,LogEntry>(p->stamp, *p));
     }
   }
+  if (dropped)
+    dout(1) << "prepare_log dropped " << dropped << " entries from "
+	    << m->get_orig_source() << ", over mon_log_max_entries_per_source"
+	    << dendl;
   wait_for_finished_proposal(new C_Log(this, m));
   return true;
 }
@@ -32,6 +32,7 @@ class LogMonitor : public PaxosService {
 private:
   multimap<utime_t,LogEntry> pending_log;
   LogSummary pending_summary, summary;
+  map<entity_name_t,unsigned> pending_per_source;  // entries in pending_log
 
   void create_initial();
   void update_from_paxos(bool *need_bootstrap);
@@ -47,6 +48,10 @@ private:
   bool prepare_log(MLog *m);
   void _updated_log(MLog *m);
 
+  bool needs_paxos(const LogEntry& le);
+  void log_locally(LogEntry& le, bufferlist& blog);
+  void write_log_file(bufferlist& blog);
+
   bool should_propose(double& delay);
 
   bool should_stash_full() {
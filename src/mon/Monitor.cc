@@ -166,6 +166,9 @@ Monitor::Monitor(CephContext* cct_, string nm, MonitorDBStore *s,
   sync_full(false),
   sync_start_version(0),
   sync_timeout_event(NULL),
+  sync_chunks_owed(0),
+  sync_bytes(0),
+  sync_get_chunk_event(NULL),
   sync_last_committed_floor(0),
 
   timecheck_round(0),
@@ -454,9 +457,14 @@ int Monitor::preinit()
     // and start fresh.
     bool clear_store = false;
     if (store->exists("mon_sync", "in_sync")) {
-      dout(1) << __func__ << " clean up potentially inconsistent store state"
-	      << dendl;
-      clear_store = true;
+      if (store->exists("mon_sync", "resume_key")) {
+	dout(1) << __func__ << " keeping partially synced store state, will"
+		<< " resume the sync" << dendl;
+      } else {
+	dout(1) << __func__ << " clean up potentially inconsistent store state"
+		<< dendl;
+	clear_store = true;
+      }
     }
 
     if (store->get("mon_sync", "force_sync") > 0) {
@@ -465,6 +473,10 @@ int Monitor::preinit()
     }
 
     if (clear_store) {
+      MonitorDBStore::Transaction t;
+      t.erase("mon_sync", "resume_key");
+      t.erase("mon_sync", "resume_version");
+      store->apply_transaction(t);
       set<string> sync_prefixes = get_sync_targets_names();
       store->clear(sync_prefixes);
     }
@@ -906,11 +918,18 @@ void Monitor::sync_reset_requester()
     timer.cancel_event(sync_timeout_event);
     sync_timeout_event = NULL;
   }
+  if (sync_get_chunk_event) {
+    timer.cancel_event(sync_get_chunk_event);
+    sync_get_chunk_event = NULL;
+  }
 
   sync_provider = entity_inst_t();
   sync_cookie = 0;
   sync_full = false;
   sync_start_version = 0;
+  sync_resume_key = pair<string,string>();
+  sync_chunks_owed = 0;
+  sync_bytes = 0;
 }
 
 void Monitor::sync_reset_provider()
@@ -947,15 +966,22 @@ void Monitor::sync_start(entity_inst_t &other, bool full)
 
     assert(g_conf->mon_sync_requester_kill_at != 1);
 
-    // clear the underlying store
-    set<string> targets = get_sync_targets_names();
-    dout(10) << __func__ << " clearing prefixes " << targets << dendl;
-    store->clear(targets);
-
-    // make sure paxos knows it has been reset.  this prevents a
-    // bootstrap and then different probe reply order from possibly
-    // deciding a partial or no sync is needed.
-    paxos->init();
+    // if an earlier attempt got somewhere, ask to pick up after the
+    // last key we stored; handle_sync_cookie starts over if the
+    // provider can't do that.
+    sync_resume_key = pair<string,string>();
+    if (store->exists("mon_sync", "resume_key")) {
+      bufferlist bl;
+      store->get("mon_sync", "resume_key", bl);
+      bufferlist::iterator p = bl.begin();
+      ::decode(sync_resume_key.first, p);
+      ::decode(sync_resume_key.second, p);
+      sync_start_version = store->get("mon_sync", "resume_version");
+      dout(10) << __func__ << " resuming from version " << sync_start_version
+	       << " key " << sync_resume_key << dendl;
+    } else {
+      sync_clear_store();
+    }
 
     assert(g_conf->mon_sync_requester_kill_at != 2);
   }
@@ -967,11 +993,33 @@ void Monitor::sync_start(entity_inst_t &other, bool full)
   sync_reset_timeout();
 
   MMonSync *m = new MMonSync(sync_full ? MMonSync::OP_GET_COOKIE_FULL : MMonSync::OP_GET_COOKIE_RECENT);
-  if (!sync_full)
+  if (!sync_full) {
     m->last_committed = paxos->get_version();
+  } else if (!sync_resume_key.first.empty()) {
+    m->last_committed = sync_start_version;
+    m->last_key = sync_resume_key;
+  }
   messenger->send_message(m, sync_provider);
 }
 
+void Monitor::sync_clear_store()
+{
+  MonitorDBStore::Transaction t;
+  t.erase("mon_sync", "resume_key");
+  t.erase("mon_sync", "resume_version");
+  store->apply_transaction(t);
+
+  // clear the underlying store
+  set<string> targets = get_sync_targets_names();
+  dout(10) << __func__ << " clearing prefixes " << targets << dendl;
+  store->clear(targets);
+
+  // make sure paxos knows it has been reset.  this prevents a
+  // bootstrap and then different probe reply order from possibly
+  // deciding a partial or no sync is needed.
+  paxos->init();
+}
+
 void Monitor::sync_stash_critical_state(MonitorDBStore::Transaction *t)
 {
   dout(10) << __func__ << dendl;
@@ -1017,6 +1065,8 @@ void Monitor::sync_finish(version_t last_committed)
   t.erase("mon_sync", "in_sync");
   t.erase("mon_sync", "force_sync");
   t.erase("mon_sync", "last_committed_floor");
+  t.erase("mon_sync", "resume_key");
+  t.erase("mon_sync", "resume_version");
   store->apply_transaction(t);
 
   assert(g_conf->mon_sync_requester_kill_at != 9);
@@ -1099,7 +1149,19 @@ void Monitor::handle_sync_get_cookie(MMonSync *m)
   if (m->op == MMonSync::OP_GET_COOKIE_FULL) {
     // full scan
     sync_targets = get_sync_targets_names();
-    sp.last_committed = paxos->get_version();
+    if (!m->last_key.first.empty() &&
+	m->last_committed >= paxos->get_first_committed() &&
+	m->last_committed <= paxos->get_version()) {
+      // resume an interrupted sync: the keys after the last one they
+      // have, from our snapshot, and every commit since their first
+      // attempt started.  replaying those in sync_finish brings the
+      // keys they got from the earlier snapshot up to date.
+      sp.last_committed = m->last_committed;
+      sp.last_key = m->last_key;
+      dout(10) << __func__ << " resuming after key " << sp.last_key << dendl;
+    } else {
+      sp.last_committed = paxos->get_version();
+    }
     sp.synchronizer = store->get_synchronizer(sp.last_key, sync_targets);
     sp.full = true;
     dout(10) << __func__ << " will sync prefixes " << sync_targets << dendl;
@@ -1111,6 +1173,7 @@ void Monitor::handle_sync_get_cookie(MMonSync *m)
 
   MMonSync *reply = new MMonSync(MMonSync::OP_COOKIE, sp.cookie);
   reply->last_committed = sp.last_committed;
+  reply->last_key = sp.last_key;
   messenger->send_message(reply, m->get_connection());
 }
 
@@ -1192,23 +1255,66 @@ void Monitor::handle_sync_cookie(MMonSync *m)
   sync_cookie = m->cookie;
   sync_start_version = m->last_committed;
 
+  if (sync_full) {
+    if (!sync_resume_key.first.empty() && m->last_key != sync_resume_key) {
+      dout(10) << __func__ << " provider can't resume after " << sync_resume_key
+	       << ", starting over" << dendl;
+      sync_clear_store();
+    }
+    sync_resume_key = pair<string,string>();
+
+    // remember where this attempt started, should we have to resume it
+    MonitorDBStore::Transaction t;
+    t.put("mon_sync", "resume_version", sync_start_version);
+    store->apply_transaction(t);
+  }
+
   sync_reset_timeout();
+  sync_stamp = ceph_clock_now(g_ceph_context);
+  sync_bytes = 0;
+  sync_chunks_owed = MAX(1, g_conf->mon_sync_max_inflight);
   sync_get_next_chunk();
 
   assert(g_conf->mon_sync_requester_kill_at != 3);
 }
 
+/*
+ * We keep up to mon_sync_max_inflight chunk requests outstanding, so
+ * the provider is reading the next chunk while we write out the last.
+ * It serves them in order off a single iterator, and the replies come
+ * back in order.  Requests beyond the last chunk get a no_cookie reply
+ * for a cookie we no longer hold, which we ignore.
+ */
 void Monitor::sync_get_next_chunk()
 {
-  dout(20) << __func__ << " cookie " << sync_cookie << " provider " << sync_provider << dendl;
-  if (g_conf->mon_inject_sync_get_chunk_delay > 0) {
-    dout(20) << __func__ << " injecting delay of " << g_conf->mon_inject_sync_get_chunk_delay << dendl;
-    usleep((long long)(g_conf->mon_inject_sync_get_chunk_delay * 1000000.0));
-  }
-  MMonSync *r = new MMonSync(MMonSync::OP_GET_CHUNK, sync_cookie);
-  messenger->send_message(r, sync_provider);
+  while (sync_chunks_owed > 0) {
+    if (sync_get_chunk_event)
+      return;
 
-  assert(g_conf->mon_sync_requester_kill_at != 4);
+    uint64_t rate = g_conf->mon_sync_max_bytes_per_sec;
+    if (rate) {
+      double elapsed = (double)(ceph_clock_now(g_ceph_context) - sync_stamp);
+      double delay = (double)sync_bytes / (double)rate - elapsed;
+      if (delay > 0) {
+	dout(20) << __func__ << " " << sync_bytes << " bytes in " << elapsed
+		 << "s, waiting " << delay << "s" << dendl;
+	sync_get_chunk_event = new C_SyncGetChunk(this);
+	timer.add_event_after(delay, sync_get_chunk_event);
+	return;
+      }
+    }
+
+    dout(20) << __func__ << " cookie " << sync_cookie << " provider " << sync_provider << dendl;
+    if (g_conf->mon_inject_sync_get_chunk_delay > 0) {
+      dout(20) << __func__ << " injecting delay of " << g_conf->mon_inject_sync_get_chunk_delay << dendl;
+      usleep((long long)(g_conf->mon_inject_sync_get_chunk_delay * 1000000.0));
+    }
+    MMonSync *r = new MMonSync(MMonSync::OP_GET_CHUNK, sync_cookie);
+    messenger->send_message(r, sync_provider);
+    --sync_chunks_owed;
+
+    assert(g_conf->mon_sync_requester_kill_at != 4);
+  }
 }
 
 void Monitor::handle_sync_chunk(MMonSync *m)
@@ -1227,9 +1333,19 @@ void Monitor::handle_sync_chunk(MMonSync *m)
   assert(state == STATE_SYNCHRONIZING);
   assert(g_conf->mon_sync_requester_kill_at != 5);
 
+  sync_bytes += m->chunk_bl.length();
+
   MonitorDBStore::Transaction tx;
   tx.append_from_encoded(m->chunk_bl);
 
+  if (sync_full && !m->last_key.first.empty()) {
+    // note how far we got along with the chunk itself
+    bufferlist bl;
+    ::encode(m->last_key.first, bl);
+    ::encode(m->last_key.second, bl);
+    tx.put("mon_sync", "resume_key", bl);
+  }
+
   dout(30) << __func__ << " tx dump:\n";
   JSONFormatter f(true);
   tx.dump(&f);
@@ -1258,6 +1374,7 @@ void Monitor::handle_sync_chunk(MMonSync *m)
 
   if (m->op == MMonSync::OP_CHUNK) {
     sync_reset_timeout();
+    ++sync_chunks_owed;
     sync_get_next_chunk();
   } else if (m->op == MMonSync::OP_LAST_CHUNK) {
     sync_finish(m->last_committed);
@@ -1267,6 +1384,12 @@ void Monitor::handle_sync_chunk(MMonSync *m)
 void Monitor::handle_sync_no_cookie(MMonSync *m)
 {
   dout(10) << __func__ << dendl;
+  if (m->cookie != sync_cookie) {
+    // a chunk request past the end, or from an earlier attempt
+    dout(10) << __func__ << " cookie " << m->cookie << " is not ours ("
+	     << sync_cookie << "), ignoring" << dendl;
+    return;
+  }
   bootstrap();
 }
 
@@ -1448,6 +1571,14 @@ void Monitor::handle_probe_reply(MMonProbe *m)
 	     << sync_last_committed_floor << ", ignoring"
 	     << dendl;
   } else {
+    if (store->exists("mon_sync", "in_sync")) {
+      dout(10) << " our store is only partially synced, finishing the sync"
+	       << dendl;
+      cancel_probe_timeout();
+      sync_start(other, true);
+      m->put();
+      return;
+    }
     if (paxos->get_version() < m->paxos_first_version &&
 	m->paxos_first_version > 1) {  // no need to sync if we're 0 and they start at 1.
       dout(10) << " peer paxos versions [" << m->paxos_first_version
@@ -260,6 +260,11 @@ private:
   bool sync_full;                ///< true if we are a full sync, false for recent catch-up
   version_t sync_start_version;  ///< last_committed at sync start
   Context *sync_timeout_event;   ///< timeout event
+  pair<string,string> sync_resume_key; ///< where an interrupted full sync left off
+  unsigned sync_chunks_owed;     ///< chunk requests we still mean to send
+  uint64_t sync_bytes;           ///< chunk bytes received since we got our cookie
+  utime_t sync_stamp;            ///< when we got our cookie
+  Context *sync_get_chunk_event; ///< deferred chunk request, for mon_sync_max_bytes_per_sec
 
   /**
    * floor for sync source
@@ -294,6 +299,15 @@ private:
     }
   };
 
+  struct C_SyncGetChunk : public Context {
+    Monitor *mon;
+    C_SyncGetChunk(Monitor *m) : mon(m) {}
+    void finish(int r) {
+      mon->sync_get_chunk_event = NULL;
+      mon->sync_get_next_chunk();
+    }
+  };
+
   /**
    * Obtain the synchronization target prefixes in set form.
    *
@@ -354,6 +368,11 @@ private:
    */
   void sync_stash_critical_state(MonitorDBStore::Transaction *tx);
 
+  /**
+   * clear the prefixes we sync, and forget any partial sync
+   */
+  void sync_clear_store();
+
   /**
    * reset the sync timeout
    *
@@ -378,7 +397,8 @@ private:
   void sync_finish(version_t last_committed);
 
   /**
-   * request the next chunk from the provider
+   * request the chunks we owe the provider requests for, as far as
+   * mon_sync_max_bytes_per_sec allows
    */
   void sync_get_next_chunk();
 
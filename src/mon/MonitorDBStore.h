@@ -26,10 +26,13 @@
 #include "include/assert.h"
 #include "common/Formatter.h"
 #include "common/errno.h"
+#include "common/safe_io.h"
 
 class MonitorDBStore
 {
-  boost::scoped_ptr<LevelDBStore> db;
+  string path;
+  string backend;  ///< KeyValueDB type, recorded in path/kv_backend
+  boost::scoped_ptr<KeyValueDB> db;
   bool do_dump;
   int dump_fd;
 
@@ -269,8 +272,9 @@ class MonitorDBStore
     bool done;
     pair<string,string> last_key;
     bufferlist crc_bl;
+    uint64_t chunk_len;  ///< encoded bytes added to the current chunk
 
-    StoreIteratorImpl() : done(false) { }
+    StoreIteratorImpl() : done(false), chunk_len(0) { }
     virtual ~StoreIteratorImpl() { }
 
     bool add_chunk_entry(Transaction &tx,
@@ -283,16 +287,16 @@ class MonitorDBStore
       tmp.put(prefix, key, value);
       tmp.encode(tmp_bl);
 
-      bufferlist tx_bl;
-      tx.encode(tx_bl);
-
-      size_t len = tx_bl.length() + tmp_bl.length();
+      // keep a running count; encoding tx for every entry made
+      // building a chunk quadratic in its number of keys
+      size_t len = chunk_len + tmp_bl.length();
 
       if (!tx.empty() && (len > max)) {
 	return false;
       }
 
       tx.append(tmp);
+      chunk_len = len;
       last_key.first = prefix;
       last_key.second = key;
 
@@ -350,6 +354,7 @@ class MonitorDBStore
     virtual void get_chunk_tx(Transaction &tx, uint64_t max) {
       assert(done == false);
       assert(iter->valid() == true);
+      chunk_len = 0;
 
       while (iter->valid()) {
 	string prefix(iter->raw_key().first);
@@ -488,30 +493,54 @@ class MonitorDBStore
 
   void init_options() {
     db->init();
+    if (backend != "leveldb")
+      return;
+    LevelDBStore *ldb = static_cast<LevelDBStore*>(db.get());
     if (g_conf->mon_leveldb_write_buffer_size)
-      db->options.write_buffer_size = g_conf->mon_leveldb_write_buffer_size;
+      ldb->options.write_buffer_size = g_conf->mon_leveldb_write_buffer_size;
     if (g_conf->mon_leveldb_cache_size)
-      db->options.cache_size = g_conf->mon_leveldb_cache_size;
+      ldb->options.cache_size = g_conf->mon_leveldb_cache_size;
     if (g_conf->mon_leveldb_block_size)
-      db->options.block_size = g_conf->mon_leveldb_block_size;
+      ldb->options.block_size = g_conf->mon_leveldb_block_size;
     if (g_conf->mon_leveldb_bloom_size)
-      db->options.bloom_size = g_conf->mon_leveldb_bloom_size;
+      ldb->options.bloom_size = g_conf->mon_leveldb_bloom_size;
     if (g_conf->mon_leveldb_compression)
-      db->options.compression_enabled = g_conf->mon_leveldb_compression;
+      ldb->options.compression_enabled = g_conf->mon_leveldb_compression;
     if (g_conf->mon_leveldb_max_open_files)
-      db->options.max_open_files = g_conf->mon_leveldb_max_open_files;
+      ldb->options.max_open_files = g_conf->mon_leveldb_max_open_files;
     if (g_conf->mon_leveldb_paranoid)
-      db->options.paranoid_checks = g_conf->mon_leveldb_paranoid;
+      ldb->options.paranoid_checks = g_conf->mon_leveldb_paranoid;
     if (g_conf->mon_leveldb_log.length())
-      db->options.log_file = g_conf->mon_leveldb_log;
+      ldb->options.log_file = g_conf->mon_leveldb_log;
+    // trims queue their compactions; space them out so the store
+    // keeps serving paxos while they run
+    ldb->options.compact_range_interval =
+      g_conf->mon_leveldb_compact_range_interval;
   }
 
   int open(ostream &out) {
+    if (!db) {
+      out << "unsupported monitor store backend " << backend << std::endl;
+      return -EINVAL;
+    }
     init_options();
     return db->open(out);
   }
 
   int create_and_open(ostream &out) {
+    if (!db) {
+      out << "unsupported monitor store backend " << backend << std::endl;
+      return -EINVAL;
+    }
+    if (path.length()) {
+      string kv_backend = backend + "\n";
+      int r = safe_write_file(path.c_str(), "kv_backend",
+			      kv_backend.c_str(), kv_backend.length());
+      if (r < 0) {
+	out << "unable to write kv_backend: " << cpp_strerror(r) << std::endl;
+	return r;
+      }
+    }
     init_options();
     return db->create_and_open(out);
   }
@@ -528,23 +557,43 @@ class MonitorDBStore
     return db->get_estimated_size(extras);
   }
 
-  MonitorDBStore(const string& path) :
+  /**
+   * The backend of an existing store is read from path/kv_backend;
+   * stores created before that file existed are leveldb.  New stores
+   * use mon_keyvaluedb.
+   */
+  MonitorDBStore(const string& p) :
     db(0), do_dump(false), dump_fd(-1) {
     string::const_reverse_iterator rit;
     int pos = 0;
-    for (rit = path.rbegin(); rit != path.rend(); ++rit, ++pos) {
+    for (rit = p.rbegin(); rit != p.rend(); ++rit, ++pos) {
       if (*rit != '/')
 	break;
     }
+    path = p.substr(0, p.size() - pos);
     ostringstream os;
-    os << path.substr(0, path.size() - pos) << "/store.db";
+    os << path << "/store.db";
     string full_path = os.str();
 
-    LevelDBStore *db_ptr = new LevelDBStore(g_ceph_context, full_path);
+    char buf[64];
+    int r = safe_read_file(path.c_str(), "kv_backend", buf, sizeof(buf));
+    if (r > 0) {
+      while (r && isspace(buf[r-1]))
+	--r;
+      backend = string(buf, r);
+    } else {
+      struct stat st;
+      if (::stat(full_path.c_str(), &st) == 0)
+	backend = "leveldb";
+      else
+	backend = g_conf->mon_keyvaluedb;
+    }
+
+    KeyValueDB *db_ptr = KeyValueDB::create(g_ceph_context, backend,
+					    full_path);
     if (!db_ptr) {
-      derr << __func__ << " error initializing level db back storage in "
-		<< full_path << dendl;
-      assert(0 != "MonitorDBStore: error initializing level db back storage");
+      derr << __func__ << " unsupported backend " << backend
+	   << " for store in " << full_path << dendl;
     }
     db.reset(db_ptr);
 
@@ -561,7 +610,7 @@ class MonitorDBStore
     }
   }
   MonitorDBStore(LevelDBStore *db_ptr) :
-    db(0), do_dump(false), dump_fd(-1) {
+    backend("leveldb"), db(0), do_dump(false), dump_fd(-1) {
     db.reset(db_ptr);
   }
   ~MonitorDBStore() {
@@ -199,6 +199,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     OSDMap::Incremental inc(inc_bl);
     err = osdmap.apply_incremental(inc);
     assert(err == 0);
+    inc_osd_cache.add(make_pair(osdmap.epoch, 0), inc_bl);
 
     if (t == NULL)
       t = new MonitorDBStore::Transaction;
@@ -210,6 +211,7 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
 
     put_version_full(t, osdmap.epoch, full_bl);
     put_version_latest_full(t, osdmap.epoch);
+    full_osd_cache.add(make_pair(osdmap.epoch, 0), full_bl);
 
     // share
     dout(1) << osdmap << dendl;
@@ -231,6 +233,14 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     delete t;
   }
 
+  if (g_conf->osd_map_mapping_cache &&
+      (!osdmap.get_mapping() ||
+       osdmap.get_mapping()->get_epoch() != osdmap.epoch)) {
+    OSDMapMapping *mapping = new OSDMapMapping;
+    mapping->update(osdmap, g_conf->osd_map_mapping_threads);
+    osdmap.set_mapping(OSDMapMappingRef(mapping));
+  }
+
   for (int o = 0; o < osdmap.get_max_osd(); o++) {
     if (osdmap.is_down(o)) {
       // invalidate osd_epoch cache
@@ -612,7 +622,8 @@ void OSDMonitor::share_map_with_random_osd()
 
   dout(10) << "committed, telling random " << s->inst << " all about it" << dendl;
   // whatev, they'll request more if they need it
-  MOSDMap *m = build_incremental(osdmap.get_epoch() - 1, osdmap.get_epoch());
+  MOSDMap *m = build_incremental(osdmap.get_epoch() - 1, osdmap.get_epoch(),
+				 s->con->get_features());
   mon->messenger->send_message(m, s->inst);
 }
 
@@ -1582,24 +1593,81 @@ void OSDMonitor::send_latest(PaxosServiceMessage *m, epoch_t start)
 }
 
 
-MOSDMap *OSDMonitor::build_latest_full()
+/*
+ * Every osd and client that subscribes after a map change wants the
+ * same few epochs, so keep them encoded, and reencoded for old peers,
+ * rather than going to the store (and decoding and encoding again in
+ * MOSDMap) for each of them.  The bufferlists are shared with the
+ * messages, not copied.
+ */
+int OSDMonitor::get_version(version_t ver, uint64_t features, bufferlist& bl)
+{
+  if (!MOSDMap::need_reencode(features))
+    features = 0;
+  if (inc_osd_cache.lookup(make_pair(ver, features), &bl))
+    return 0;
+  int ret = get_version(ver, bl);
+  if (ret < 0)
+    return ret;
+  if (features) {
+    OSDMap::Incremental inc;
+    bufferlist::iterator q = bl.begin();
+    inc.decode(q);
+    if (inc.fullmap.length()) {
+      // embedded full map?
+      OSDMap m;
+      m.decode(inc.fullmap);
+      inc.fullmap.clear();
+      m.encode(inc.fullmap, features);
+    }
+    bl.clear();
+    inc.encode(bl, features);
+  }
+  inc_osd_cache.add(make_pair(ver, features), bl);
+  return 0;
+}
+
+int OSDMonitor::get_version_full(version_t ver, uint64_t features, bufferlist& bl)
 {
-  MOSDMap *r = new MOSDMap(mon->monmap->fsid, &osdmap);
+  if (!MOSDMap::need_reencode(features))
+    features = 0;
+  if (full_osd_cache.lookup(make_pair(ver, features), &bl))
+    return 0;
+  int ret = get_version_full(ver, bl);
+  if (ret < 0)
+    return ret;
+  if (features) {
+    OSDMap m;
+    m.decode(bl);
+    bl.clear();
+    m.encode(bl, features);
+  }
+  full_osd_cache.add(make_pair(ver, features), bl);
+  return 0;
+}
+
+MOSDMap *OSDMonitor::build_latest_full(uint64_t features)
+{
+  MOSDMap *r = new MOSDMap(mon->monmap->fsid);
+  r->encode_features = features;
+  int err = get_version_full(osdmap.get_epoch(), features, r->maps[osdmap.get_epoch()]);
+  assert(err == 0);
   r->oldest_map = get_first_committed();
   r->newest_map = osdmap.get_epoch();
   return r;
 }
 
-MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
+MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to, uint64_t features)
 {
   dout(10) << "build_incremental [" << from << ".." << to << "]" << dendl;
   MOSDMap *m = new MOSDMap(mon->monmap->fsid);
+  m->encode_features = features;
   m->oldest_map = get_first_committed();
   m->newest_map = osdmap.get_epoch();
 
   for (epoch_t e = to; e >= from && e > 0; e--) {
     bufferlist bl;
-    int err = get_version(e, bl);
+    int err = get_version(e, features, bl);
     if (err == 0) {
       assert(bl.length());
       // if (get_version(e, bl) > 0) {
@@ -1609,7 +1677,7 @@ MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
     } else {
       assert(err == -ENOENT);
       assert(!bl.length());
-      get_version_full(e, bl);
+      get_version_full(e, features, bl);
       if (bl.length() > 0) {
       //else if (get_version("full", e, bl) > 0) {
       dout(20) << "build_incremental   full " << e << " "
@@ -1626,7 +1694,7 @@ MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
 void OSDMonitor::send_full(PaxosServiceMessage *m)
 {
   dout(5) << "send_full to " << m->get_orig_source_inst() << dendl;
-  mon->send_reply(m, build_latest_full());
+  mon->send_reply(m, build_latest_full(m->get_connection()->get_features()));
 }
 
 /* TBH, I'm fairly certain these two functions could somehow be using a single
@@ -1654,10 +1722,11 @@ void OSDMonitor::send_incremental(PaxosServiceMessage *req, epoch_t first)
     }
   }
 
+  uint64_t features = req->get_connection()->get_features();
   if (first < get_first_committed()) {
     first = get_first_committed();
     bufferlist bl;
-    int err = get_version_full(first, bl);
+    int err = get_version_full(first, features, bl);
     assert(err == 0);
     assert(bl.length());
 
@@ -1665,6 +1734,7 @@ void OSDMonitor::send_incremental(PaxosServiceMessage *req, epoch_t first)
 	     << first << " " << bl.length() << " bytes" << dendl;
 
     MOSDMap *m = new MOSDMap(osdmap.get_fsid());
+    m->encode_features = features;
     m->oldest_map = first;
     m->newest_map = osdmap.get_epoch();
     m->maps[first] = bl;
@@ -1678,7 +1748,7 @@ void OSDMonitor::send_incremental(PaxosServiceMessage *req, epoch_t first)
   // send some maps.  it may not be all of them, but it will get them
   // started.
   epoch_t last = MIN(first + g_conf->osd_map_message_max, osdmap.get_epoch());
-  MOSDMap *m = build_incremental(first, last);
+  MOSDMap *m = build_incremental(first, last, features);
   m->oldest_map = get_first_committed();
   m->newest_map = osdmap.get_epoch();
   mon->send_reply(req, m);
@@ -1687,15 +1757,16 @@ void OSDMonitor::send_incremental(PaxosServiceMessage *req, epoch_t first)
     osd_epoch[osd] = last;
 }
 
-void OSDMonitor::send_incremental(epoch_t first, entity_inst_t& dest, bool onetime)
+void OSDMonitor::send_incremental(epoch_t first, MonSession *session, bool onetime)
 {
   dout(5) << "send_incremental [" << first << ".." << osdmap.get_epoch() << "]"
-	  << " to " << dest << dendl;
+	  << " to " << session->inst << dendl;
 
+  uint64_t features = session->con->get_features();
   if (first < get_first_committed()) {
     first = get_first_committed();
     bufferlist bl;
-    int err = get_version_full(first, bl);
+    int err = get_version_full(first, features, bl);
     assert(err == 0);
     assert(bl.length());
 
@@ -1703,17 +1774,18 @@ void OSDMonitor::send_incremental(epoch_t first, entity_inst_t& dest, bool oneti
 	     << first << " " << bl.length() << " bytes" << dendl;
 
     MOSDMap *m = new MOSDMap(osdmap.get_fsid());
+    m->encode_features = features;
     m->oldest_map = first;
     m->newest_map = osdmap.get_epoch();
     m->maps[first] = bl;
-    mon->messenger->send_message(m, dest);
+    mon->messenger->send_message(m, session->inst);
     first++;
   }
 
   while (first <= osdmap.get_epoch()) {
     epoch_t last = MIN(first + g_conf->osd_map_message_max, osdmap.get_epoch());
-    MOSDMap *m = build_incremental(first, last);
-    mon->messenger->send_message(m, dest);
+    MOSDMap *m = build_incremental(first, last, features);
+    mon->messenger->send_message(m, session->inst);
     first = last + 1;
     if (onetime)
       break;
@@ -1751,9 +1823,9 @@ void OSDMonitor::check_sub(Subscription *sub)
 	   << (sub->onetime ? " (onetime)":" (ongoing)") << dendl;
   if (sub->next <= osdmap.get_epoch()) {
     if (sub->next >= 1)
-      send_incremental(sub->next, sub->session->inst, sub->incremental_onetime);
+      send_incremental(sub->next, sub->session, sub->incremental_onetime);
     else
-      mon->messenger->send_message(build_latest_full(),
+      mon->messenger->send_message(build_latest_full(sub->session->con->get_features()),
 				   sub->session->inst);
     if (sub->onetime)
       mon->session_map.remove_sub(sub);
@@ -2834,6 +2906,18 @@ int OSDMonitor::prepare_pool_properties(const unsigned pool_type,
     }
   }
 
+  map<string,string>::const_iterator expected =
+    properties_map->find("expected_num_objects");
+  if (expected != properties_map->end()) {
+    string err;
+    long long n = strict_strtoll(expected->second.c_str(), 10, &err);
+    if (!err.empty() || n < 0) {
+      ss << "expected_num_objects=" << expected->second
+	 << " is not a non-negative integer";
+      return -EINVAL;
+    }
+  }
+
   return 0;
 }
 
@@ -2991,6 +3075,9 @@ int OSDMonitor::prepare_new_pool(string& name, uint64_t auid, int crush_ruleset,
   pi->flags = g_conf->osd_pool_default_flags;
   if (g_conf->osd_pool_default_flag_hashpspool)
     pi->flags |= pg_pool_t::FLAG_HASHPSPOOL;
+  if (pool_type == pg_pool_t::TYPE_ERASURE &&
+      g_conf->osd_pool_default_ec_fast_read)
+    pi->flags |= pg_pool_t::FLAG_EC_FAST_READ;
 
   pi->size = size;
   pi->min_size = g_conf->get_osd_pool_default_min_size();
@@ -3195,6 +3282,14 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       BloomHitSet::Params *bsp = new BloomHitSet::Params;
       bsp->set_fpp(.01);
       p.hit_set_params = HitSet::Params(bsp);
+    } else if (val == "decay_bloom") {
+      DecayBloomHitSet::Params *dsp = new DecayBloomHitSet::Params;
+      dsp->set_fpp(.01);
+      p.hit_set_params = HitSet::Params(dsp);
+    } else if (val == "blocked_bloom") {
+      BlockedBloomHitSet::Params *bbp = new BlockedBloomHitSet::Params;
+      bbp->set_fpp(.01);
+      p.hit_set_params = HitSet::Params(bbp);
     } else if (val == "explicit_hash")
       p.hit_set_params = HitSet::Params(new ExplicitHashHitSet::Params);
     else if (val == "explicit_object")
@@ -3220,12 +3315,40 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       ss << "error parsing floating point value '" << val << "': " << floaterr;
       return -EINVAL;
     }
-    if (p.hit_set_params.get_type() != HitSet::TYPE_BLOOM) {
+    if (p.hit_set_params.get_type() != HitSet::TYPE_BLOOM &&
+	p.hit_set_params.get_type() != HitSet::TYPE_DECAY_BLOOM &&
+	p.hit_set_params.get_type() != HitSet::TYPE_BLOCKED_BLOOM) {
       ss << "hit set is not of type Bloom; invalid to set a false positive rate!";
       return -EINVAL;
     }
     BloomHitSet::Params *bloomp = static_cast<BloomHitSet::Params*>(p.hit_set_params.impl.get());
     bloomp->set_fpp(f);
+  } else if (var == "fast_read") {
+    if (!p.is_erasure()) {
+      ss << "fast_read is only supported on erasure coded pools";
+      return -EINVAL;
+    }
+    if (val == "true" || (interr.empty() && n == 1)) {
+      p.flags |= pg_pool_t::FLAG_EC_FAST_READ;
+    } else if (val == "false" || (interr.empty() && n == 0)) {
+      p.flags &= ~pg_pool_t::FLAG_EC_FAST_READ;
+    } else {
+      ss << "expecting value 'true', 'false', '0', or '1'";
+      return -EINVAL;
+    }
+  } else if (var == "replica_reads") {
+    if (p.is_erasure()) {
+      ss << "replica_reads is only supported on replicated pools";
+      return -EINVAL;
+    }
+    if (val == "true" || (interr.empty() && n == 1)) {
+      p.flags |= pg_pool_t::FLAG_REPLICA_READS;
+    } else if (val == "false" || (interr.empty() && n == 0)) {
+      p.flags &= ~pg_pool_t::FLAG_REPLICA_READS;
+    } else {
+      ss << "expecting value 'true', 'false', '0', or '1'";
+      return -EINVAL;
+    }
   } else if (var == "debug_fake_ec_pool") {
     if (val == "true" || (interr.empty() && n == 1)) {
       p.flags |= pg_pool_t::FLAG_DEBUG_FAKE_EC_POOL;
@@ -3274,6 +3397,18 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       return -EINVAL;
     }
     p.cache_min_evict_age = n;
+  } else if (var == "min_read_recency_for_promote") {
+    if (interr.length()) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.min_read_recency_for_promote = n;
+  } else if (var == "min_read_frequency_for_promote") {
+    if (interr.length()) {
+      ss << "error parsing integer value '" << val << "': " << interr;
+      return -EINVAL;
+    }
+    p.min_read_frequency_for_promote = n;
   } else {
     ss << "unrecognized variable '" << var << "'";
     return -EINVAL;
@@ -3373,6 +3508,12 @@ bool OSDMonitor::prepare_command_impl(MMonCommand *m,
       goto reply;
     }
 
+    if (crush.has_v4_buckets()) {
+      err = check_cluster_features(CEPH_FEATURE_CRUSH_V4, ss);
+      if (err)
+	goto reply;
+    }
+
     // sanity check: test some inputs to make sure this map isn't totally broken
     dout(10) << " testing map" << dendl;
     stringstream ess;
@@ -23,6 +23,7 @@
 using namespace std;
 
 #include "include/types.h"
+#include "common/simple_cache.hpp"
 #include "msg/Messenger.h"
 
 #include "osd/OSDMap.h"
@@ -137,6 +138,18 @@ private:
    */
   map<int,epoch_t> osd_epoch;
 
+  /*
+   * encoded maps, by epoch and the peer features they are encoded for
+   * (0 for the stored encoding), shared by everyone we send maps to.
+   */
+  SimpleLRU<pair<version_t, uint64_t>, bufferlist> inc_osd_cache;
+  SimpleLRU<pair<version_t, uint64_t>, bufferlist> full_osd_cache;
+
+  using PaxosService::get_version;
+  using PaxosService::get_version_full;
+  int get_version(version_t ver, uint64_t features, bufferlist& bl);
+  int get_version_full(version_t ver, uint64_t features, bufferlist& bl);
+
   void check_failures(utime_t now);
   bool check_failure(utime_t now, int target_osd, failure_info_t& fi);
 
@@ -201,11 +214,11 @@ private:
   bool can_mark_in(int o);
 
   // ...
-  MOSDMap *build_latest_full();
-  MOSDMap *build_incremental(epoch_t first, epoch_t last);
+  MOSDMap *build_latest_full(uint64_t features);
+  MOSDMap *build_incremental(epoch_t first, epoch_t last, uint64_t features);
   void send_full(PaxosServiceMessage *m);
   void send_incremental(PaxosServiceMessage *m, epoch_t first);
-  void send_incremental(epoch_t first, entity_inst_t& dest, bool onetime);
+  void send_incremental(epoch_t first, MonSession *session, bool onetime);
 
   int reweight_by_utilization(int oload, std::string& out_str);
 
@@ -338,6 +351,8 @@ private:
  public:
   OSDMonitor(Monitor *mn, Paxos *p, string service_name)
   : PaxosService(mn, p, service_name),
+    inc_osd_cache(g_conf->mon_osd_cache_size),
+    full_osd_cache(g_conf->mon_osd_cache_size),
     thrash_map(0), thrash_last_up_osd(-1) { }
 
   void tick();  // check state, take actions
@@ -316,6 +316,7 @@ void PGMap::register_nearfull_status(int osd, const osd_stat_t& s)
 void PGMap::calc_stats()
 {
   num_pg_by_state.clear();
+  num_pg_by_last_epoch_clean.clear();
   num_pg = 0;
   num_osd = 0;
   pg_pool_sum.clear();
@@ -386,6 +387,7 @@ void PGMap::stat_pg_add(const pg_t &pgid, const pg_stat_t &s)
 {
   num_pg++;
   num_pg_by_state[s.state]++;
+  num_pg_by_last_epoch_clean[s.get_effective_last_epoch_clean()]++;
   pg_pool_sum[pgid.pool()].add(s);
   pg_sum.add(s);
   if (s.state & PG_STATE_CREATING) {
@@ -400,6 +402,9 @@ void PGMap::stat_pg_sub(const pg_t &pgid, const pg_stat_t &s)
   num_pg--;
   if (--num_pg_by_state[s.state] == 0)
     num_pg_by_state.erase(s.state);
+  epoch_t lec = s.get_effective_last_epoch_clean();
+  if (--num_pg_by_last_epoch_clean[lec] == 0)
+    num_pg_by_last_epoch_clean.erase(lec);
 
   pool_stat_t& ps = pg_pool_sum[pgid.pool()];
   ps.sub(s);
@@ -433,13 +438,9 @@ epoch_t PGMap::calc_min_last_epoch_clean() const
 {
   if (pg_stat.empty())
     return 0;
-  ceph::unordered_map<pg_t,pg_stat_t>::const_iterator p = pg_stat.begin();
-  epoch_t min = p->second.get_effective_last_epoch_clean();
-  for (++p; p != pg_stat.end(); ++p) {
-    epoch_t lec = p->second.get_effective_last_epoch_clean();
-    if (lec < min)
-      min = lec;
-  }
+  // kept up to date by stat_pg_add/sub, so no need to walk all pgs
+  assert(!num_pg_by_last_epoch_clean.empty());
+  epoch_t min = num_pg_by_last_epoch_clean.begin()->first;
   // also scan osd epochs
   // don't trim past the oldest reported osd epoch
   for (ceph::unordered_map<int32_t, epoch_t>::const_iterator i = osd_epochs.begin();
@@ -101,6 +101,7 @@ public:
 
   // aggregate stats (soft state), generated by calc_stats()
   ceph::unordered_map<int,int> num_pg_by_state;
+  map<epoch_t,int> num_pg_by_last_epoch_clean;  // effective last_epoch_clean -> num pgs
   int64_t num_pg, num_osd;
   ceph::unordered_map<int,pool_stat_t> pg_pool_sum;
   pool_stat_t pg_sum;
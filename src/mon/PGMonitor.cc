@@ -328,6 +328,7 @@ void PGMonitor::handle_osd_timeouts()
 void PGMonitor::create_pending()
 {
   pending_inc = PGMap::Incremental();
+  pending_stats_only = true;
   pending_inc.version = pg_map.version + 1;
   if (pg_map.version == 0) {
     // pull initial values from first leader mon's config
@@ -591,6 +592,7 @@ bool PGMonitor::prepare_update(PaxosServiceMessage *m)
     return prepare_pg_stats((MPGStats*)m);
 
   case MSG_MON_COMMAND:
+    pending_stats_only = false;
     return prepare_command(static_cast<MMonCommand*>(m));
 
   default:
@@ -600,6 +602,30 @@ bool PGMonitor::prepare_update(PaxosServiceMessage *m)
   }
 }
 
+/*
+ * Stat reports are the bulk of pgmap updates, and with many osds they
+ * would have us commit (and every mon write out) a new pgmap every
+ * paxos round.  Gather them in pending_inc for
+ * mon_pg_stats_commit_interval instead, so that a pg reported several
+ * times in that span is written once.  Anything else still goes out at
+ * the usual pace, taking the gathered stats with it.  The osds get their
+ * acks when the stats commit.
+ */
+bool PGMonitor::should_propose(double& delay)
+{
+  PaxosService::should_propose(delay);
+
+  double interval = g_conf->mon_pg_stats_commit_interval;
+  if (pending_stats_only && interval > 0 && pg_map.version > 1) {
+    utime_t next = pg_map.stamp;
+    next += interval;
+    utime_t now = ceph_clock_now(g_ceph_context);
+    if (next > now && (double)(next - now) > delay)
+      delay = (double)(next - now);
+  }
+  return true;
+}
+
 void PGMonitor::handle_statfs(MStatfs *statfs)
 {
   // check caps
@@ -1744,8 +1770,36 @@ int PGMonitor::_warn_slow_request_histogram(const pow2_hist_t& h, string suffix,
   return sum;
 }
 
+/*
+ * Every 'ceph -s', 'ceph health' and health log check ends up here, and
+ * the stuck pg checks walk the whole pgmap.  Without detail, reuse the
+ * last summary while neither map has changed; the stuck checks also
+ * depend on the time, so only for mon_health_cache_ttl.
+ */
 void PGMonitor::get_health(list<pair<health_status_t,string> >& summary,
 			   list<pair<health_status_t,string> > *detail) const
+{
+  if (detail || g_conf->mon_health_cache_ttl <= 0) {
+    _get_health(summary, detail);
+    return;
+  }
+
+  utime_t now = ceph_clock_now(g_ceph_context);
+  epoch_t epoch = mon->osdmon()->osdmap.get_epoch();
+  if (health_cache_version != pg_map.version ||
+      health_cache_epoch != epoch ||
+      (double)(now - health_cache_stamp) > g_conf->mon_health_cache_ttl) {
+    health_cache.clear();
+    _get_health(health_cache, NULL);
+    health_cache_version = pg_map.version;
+    health_cache_epoch = epoch;
+    health_cache_stamp = now;
+  }
+  summary.insert(summary.end(), health_cache.begin(), health_cache.end());
+}
+
+void PGMonitor::_get_health(list<pair<health_status_t,string> >& summary,
+			    list<pair<health_status_t,string> > *detail) const
 {
   map<string,int> note;
   ceph::unordered_map<int,int>::const_iterator p = pg_map.num_pg_by_state.begin();
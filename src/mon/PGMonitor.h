@@ -53,6 +53,13 @@ public:
 
 private:
   PGMap::Incremental pending_inc;
+  bool pending_stats_only;  // pending_inc only has osd and pg stat reports
+
+  // health summary (without detail) for the current pgmap and osdmap
+  mutable list<pair<health_status_t,string> > health_cache;
+  mutable version_t health_cache_version;
+  mutable epoch_t health_cache_epoch;
+  mutable utime_t health_cache_stamp;
 
   const char *pgmap_meta_prefix;
   const char *pgmap_pg_prefix;
@@ -76,6 +83,7 @@ private:
 
   bool preprocess_query(PaxosServiceMessage *m);  // true if processed.
   bool prepare_update(PaxosServiceMessage *m);
+  bool should_propose(double &delay);
 
   bool preprocess_pg_stats(MPGStats *stats);
   bool pg_stats_have_changed(int from, const MPGStats *stats) const;
@@ -153,6 +161,9 @@ public:
     : PaxosService(mn, p, service_name),
       need_check_down_pgs(false),
       last_map_pg_create_osd_epoch(0),
+      pending_stats_only(true),
+      health_cache_version(0),
+      health_cache_epoch(0),
       pgmap_meta_prefix("pgmap_meta"),
       pgmap_pg_prefix("pgmap_pg"),
       pgmap_osd_prefix("pgmap_osd")
@@ -196,6 +207,8 @@ public:
 
   void get_health(list<pair<health_status_t,string> >& summary,
 		  list<pair<health_status_t,string> > *detail) const;
+  void _get_health(list<pair<health_status_t,string> >& summary,
+		   list<pair<health_status_t,string> > *detail) const;
   void check_full_osd_health(list<pair<health_status_t,string> >& summary,
 			     list<pair<health_status_t,string> > *detail,
 			     const set<int>& s, const char *desc, health_status_t sev) const;
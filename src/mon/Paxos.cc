@@ -903,13 +903,19 @@ void Paxos::commit_proposal()
   assert(!proposals.empty());
   assert(is_updating());
 
-  C_Proposal *proposal = static_cast<C_Proposal*>(proposals.front());
-  assert(proposal->proposed);
-  dout(10) << __func__ << " proposal " << proposal << " took "
-	   << (ceph_clock_now(NULL) - proposal->proposal_time)
-	   << " to finish" << dendl;
-  proposals.pop_front();
-  proposal->complete(0);
+  // everything propose_queued() folded into this round
+  list<Context*> committed;
+  while (!proposals.empty() &&
+	 static_cast<C_Proposal*>(proposals.front())->proposed) {
+    C_Proposal *proposal = static_cast<C_Proposal*>(proposals.front());
+    dout(10) << __func__ << " proposal " << proposal << " took "
+	     << (ceph_clock_now(NULL) - proposal->proposal_time)
+	     << " to finish" << dendl;
+    committed.push_back(proposal);
+    proposals.pop_front();
+  }
+  assert(!committed.empty());
+  finish_contexts(g_ceph_context, committed, 0);
 }
 
 void Paxos::finish_round()
@@ -1319,6 +1325,14 @@ void Paxos::list_proposals(ostream& out)
   }
 }
 
+/*
+ * Services keep proposing while a round is in flight, and used to
+ * line up behind it for a round each.  Fold everything queued by then
+ * into a single value instead: each proposal is a transaction on its
+ * own service's keys, so they apply together, and commit_proposal()
+ * finishes them in order.  A busy cluster thus gets larger rounds
+ * rather than a longer queue.
+ */
 void Paxos::propose_queued()
 {
   assert(is_active());
@@ -1328,16 +1342,35 @@ void Paxos::propose_queued()
   assert(!proposal->proposed);
 
   cancel_events();
+
+  bufferlist bl;
+  unsigned num = 0;
+  if (proposals.size() == 1) {
+    bl = proposal->bl;
+    proposal->proposed = true;
+    num = 1;
+  } else {
+    MonitorDBStore::Transaction t;
+    for (list<Context*>::iterator p = proposals.begin();
+	 p != proposals.end();
+	 ++p) {
+      C_Proposal *q = static_cast<C_Proposal*>(*p);
+      assert(!q->proposed);
+      decode_append_transaction(t, q->bl);
+      q->proposed = true;
+      ++num;
+    }
+    t.encode(bl);
+  }
   dout(10) << __func__ << " " << (last_committed + 1)
-	  << " " << proposal->bl.length() << " bytes" << dendl;
-  proposal->proposed = true;
+	  << " " << bl.length() << " bytes from " << num << " proposals" << dendl;
 
   dout(30) << __func__ << " ";
   list_proposals(*_dout);
   *_dout << dendl;
 
   state = STATE_UPDATING;
-  begin(proposal->bl);
+  begin(bl);
 }
 
 void Paxos::queue_proposal(bufferlist& bl, Context *onfinished)
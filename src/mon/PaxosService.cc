@@ -153,13 +153,21 @@ bool PaxosService::should_propose(double& delay)
   // simple default policy: quick startup, then some damping.
   if (get_last_committed() <= 1)
     delay = 0.0;
-  else {
+  else if (g_conf->paxos_propose_interval > 0) {
     utime_t now = ceph_clock_now(g_ceph_context);
     if ((now - paxos->last_commit_time) > g_conf->paxos_propose_interval)
       delay = (double)g_conf->paxos_min_wait;
     else
       delay = (double)(g_conf->paxos_propose_interval + paxos->last_commit_time
 		       - now);
+  } else if (paxos->is_active()) {
+    // idle; give a burst of updates paxos_min_wait to gather
+    delay = (double)g_conf->paxos_min_wait;
+  } else {
+    // a round is in flight, and whatever is queued by the time it
+    // commits goes out together in the next one (see
+    // Paxos::propose_queued), so the batching follows the load.
+    delay = 0.0;
   }
   return true;
 }
@@ -381,6 +389,10 @@ void PaxosService::trim(MonitorDBStore::Transaction *t,
   if (g_conf->mon_compact_on_trim) {
     dout(20) << " compacting prefix " << get_service_name() << dendl;
     t->compact_range(get_service_name(), stringify(from - 1), stringify(to));
+    // the full versions we removed sort apart from the incrementals
+    t->compact_range(get_service_name(),
+		     mon->store->combine_strings("full", from - 1),
+		     mon->store->combine_strings("full", to));
   }
 }
 
@@ -14,7 +14,7 @@
 
 #include "msg/Message.h"
 #include "DispatchQueue.h"
-#include "SimpleMessenger.h"
+#include "Messenger.h"
 #include "common/ceph_context.h"
 
 #define dout_subsys ceph_subsys_ms
@@ -51,10 +51,61 @@ void DispatchQueue::enqueue(Message *m, int priority, uint64_t id)
   cond.Signal();
 }
 
+void DispatchQueue::dispatch_throttle_release(uint64_t msize)
+{
+  if (msize) {
+    ldout(cct,10) << "dispatch_throttle_release " << msize << " to dispatch throttler "
+	    << dispatch_throttler.get_current() << "/"
+	    << dispatch_throttler.get_max() << dendl;
+    dispatch_throttler.put(msize);
+  }
+}
+
+uint64_t DispatchQueue::pre_dispatch(Message *m)
+{
+  uint64_t msize = m->get_dispatch_throttle_size();
+  m->set_dispatch_throttle_size(0);  // clear it out, in case we requeue this message.
+
+  // local deliveries never came off the wire
+  const ConnectionRef& con = m->get_connection();
+  if (con && m->get_recv_complete_stamp() != utime_t())
+    con->stats.note_dispatch_lat(ceph_clock_now(cct) - m->get_recv_complete_stamp());
+
+  ldout(cct,1) << "<== " << m->get_source_inst()
+	       << " " << m->get_seq()
+	       << " ==== " << *m
+	       << " ==== " << m->get_payload().length() << "+" << m->get_middle().length()
+	       << "+" << m->get_data().length()
+	       << " (" << m->get_footer().front_crc << " " << m->get_footer().middle_crc
+	       << " " << m->get_footer().data_crc << ")"
+	       << " " << m << " con " << m->get_connection()
+	       << dendl;
+  return msize;
+}
+
+bool DispatchQueue::can_fast_dispatch(Message *m)
+{
+  return msgr->ms_can_fast_dispatch(m);
+}
+
+void DispatchQueue::fast_dispatch(Message *m)
+{
+  if (stop) {
+    ldout(cct,10) << " stop flag set, discarding " << m << " " << *m << dendl;
+    dispatch_throttle_release(m->get_dispatch_throttle_size());
+    m->put();
+    return;
+  }
+  uint64_t msize = pre_dispatch(m);
+  msgr->ms_fast_dispatch(m);
+  dispatch_throttle_release(msize);
+  ldout(cct,20) << "done calling fast dispatch on " << m << dendl;
+}
+
 void DispatchQueue::local_delivery(Message *m, int priority)
 {
   Mutex::Locker l(lock);
-  m->set_connection(msgr->local_connection.get());
+  m->set_connection(msgr->get_loopback_connection().get());
   add_arrival(m);
   if (priority >= CEPH_MSG_PRIO_LOW) {
     mqueue.enqueue_strict(
@@ -108,21 +159,10 @@ void DispatchQueue::entry()
 	  ldout(cct,10) << " stop flag set, discarding " << m << " " << *m << dendl;
 	  m->put();
 	} else {
-	  uint64_t msize = m->get_dispatch_throttle_size();
-	  m->set_dispatch_throttle_size(0);  // clear it out, in case we requeue this message.
-
-	  ldout(cct,1) << "<== " << m->get_source_inst()
-		       << " " << m->get_seq()
-		       << " ==== " << *m
-		       << " ==== " << m->get_payload().length() << "+" << m->get_middle().length()
-		       << "+" << m->get_data().length()
-		       << " (" << m->get_footer().front_crc << " " << m->get_footer().middle_crc
-		       << " " << m->get_footer().data_crc << ")"
-		       << " " << m << " con " << m->get_connection()
-		       << dendl;
+	  uint64_t msize = pre_dispatch(m);
 	  msgr->ms_deliver_dispatch(m);
 
-	  msgr->dispatch_throttle_release(msize);
+	  dispatch_throttle_release(msize);
 
 	  ldout(cct,20) << "done calling dispatch on " << m << dendl;
 	}
@@ -149,7 +189,7 @@ void DispatchQueue::discard_queue(uint64_t id) {
     assert(!(i->is_code())); // We don't discard id 0, ever!
     Message *m = i->get_message();
     remove_arrival(m);
-    msgr->dispatch_throttle_release(m->get_dispatch_throttle_size());
+    dispatch_throttle_release(m->get_dispatch_throttle_size());
     m->put();
   }
 }
@@ -25,11 +25,12 @@
 #include "common/Thread.h"
 #include "common/RefCountedObj.h"
 #include "common/PrioritizedQueue.h"
+#include "common/Throttle.h"
 
 class CephContext;
 class DispatchQueue;
 class Pipe;
-class SimpleMessenger;
+class Messenger;
 class Message;
 struct Connection;
 
@@ -65,7 +66,7 @@ class DispatchQueue {
   };
     
   CephContext *cct;
-  SimpleMessenger *msgr;
+  Messenger *msgr;
   Mutex lock;
   Cond cond;
 
@@ -106,7 +107,13 @@ class DispatchQueue {
     }
   } dispatch_thread;
 
+  /// clear m's dispatch throttle size and log it; returns that size
+  uint64_t pre_dispatch(Message *m);
+
   public:
+  /// Throttle preventing us from building up a big backlog waiting for dispatch
+  Throttle dispatch_throttler;
+
   bool stop;
   void local_delivery(Message *m, int priority);
 
@@ -158,6 +165,15 @@ class DispatchQueue {
     cond.Signal();
   }
 
+  void dispatch_throttle_release(uint64_t msize);
+
+  /// true if m should skip the queue and go to fast_dispatch()
+  bool can_fast_dispatch(Message *m);
+  /**
+   * Deliver m right away in the calling (reader) thread. The caller
+   * must not hold any locks the Dispatcher's send path may take.
+   */
+  void fast_dispatch(Message *m);
   void enqueue(Message *m, int priority, uint64_t id);
   void discard_queue(uint64_t id);
   uint64_t get_id() {
@@ -169,13 +185,15 @@ class DispatchQueue {
   void wait();
   void shutdown();
 
-  DispatchQueue(CephContext *cct, SimpleMessenger *msgr)
+  DispatchQueue(CephContext *cct, Messenger *msgr, const string &name)
     : cct(cct), msgr(msgr),
       lock("SimpleMessenger::DispatchQeueu::lock"), 
       mqueue(cct->_conf->ms_pq_max_tokens_per_priority,
 	     cct->_conf->ms_pq_min_cost),
       next_pipe_id(1),
       dispatch_thread(this),
+      dispatch_throttler(cct, string("msgr_dispatch_throttler-") + name,
+			 cct->_conf->ms_dispatch_throttle_bytes),
       stop(false)
     {}
 };
@@ -33,6 +33,63 @@ public:
   // how i receive messages
   virtual bool ms_dispatch(Message *m) = 0;
 
+  /**
+   * @defgroup FastDispatch
+   * @{
+   */
+  /**
+   * Report whether this Dispatcher may ever fast dispatch a Message;
+   * it is checked once, when the Dispatcher is added to a Messenger.
+   *
+   * @return true if ms_can_fast_dispatch() may return true.
+   */
+  virtual bool ms_can_fast_dispatch_any() const { return false; }
+  /**
+   * Report whether this Dispatcher wants to receive m directly from
+   * the thread that read it off the wire, bypassing the DispatchQueue.
+   *
+   * This is called for every incoming Message and must be cheap; it
+   * must not take locks or look at much more than the Message type.
+   *
+   * @param m The Message to check.
+   * @return true if m should be passed to ms_fast_dispatch().
+   */
+  virtual bool ms_can_fast_dispatch(Message *m) const { return false; }
+  /**
+   * Handle a Message from the reader thread. Only called for Messages
+   * ms_can_fast_dispatch() accepted, and must not refuse them. Messages
+   * on a Connection are fast dispatched in order, but there is no
+   * ordering against Messages that go through ms_dispatch().
+   *
+   * This blocks further reads on the Connection, so the Dispatcher
+   * should hand long work off to its own threads.
+   *
+   * @param m The Message to handle. We take ownership of one reference.
+   */
+  virtual void ms_fast_dispatch(Message *m) { assert(0); }
+  /**
+   * @} //FastDispatch
+   */
+
+  /**
+   * Supply the buffer an incoming message's data segment is read
+   * into, so it lands directly where its consumer wants it (e.g.
+   * aligned for a journal opened with O_DIRECT) and is not copied
+   * again later. Buffers posted with Connection::post_rx_buffer()
+   * take precedence.
+   *
+   * This is called from the thread reading the message, possibly with
+   * the messenger's connection lock held, before the message has been
+   * decoded; it must not block or send messages.
+   *
+   * @param con The Connection the message arrives on.
+   * @param header The header of the incoming message.
+   * @param bl [out] Empty on entry; fill in header.data_len bytes.
+   * @return true if bl was filled in, false to get the default layout.
+   */
+  virtual bool ms_get_rx_buffer(Connection *con, const ceph_msg_header& header,
+				bufferlist& bl) { return false; }
+
   /**
    * This function will be called whenever a new Connection is made to the
    * Messenger.
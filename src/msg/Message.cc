@@ -100,6 +100,7 @@ using namespace std;
 #include "messages/MClientReply.h"
 #include "messages/MClientCaps.h"
 #include "messages/MClientCapRelease.h"
+#include "messages/MClientCapsBatch.h"
 #include "messages/MClientLease.h"
 #include "messages/MClientSnap.h"
 
@@ -168,6 +169,8 @@ using namespace std;
 
 #define dout_subsys ceph_subsys_ms
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(Message, msgr)
+
 void Message::encode(uint64_t features, bool datacrc)
 {
   // encode and copy out of *m
@@ -241,6 +244,20 @@ void Message::dump(Formatter *f) const
   f->dump_string("summary", ss.str());
 }
 
+void ConnectionStats::dump(Formatter *f) const
+{
+  Spinlock::Locker l(lock);
+  f->open_object_section("out_q_depth");
+  out_q_depth.dump(f);
+  f->close_section();
+  f->open_object_section("send_latency_us");
+  send_lat.dump(f);
+  f->close_section();
+  f->open_object_section("dispatch_latency_us");
+  dispatch_lat.dump(f);
+  f->close_section();
+}
+
 Message *decode_message(CephContext *cct, ceph_msg_header& header, ceph_msg_footer& footer,
 			bufferlist& front, bufferlist& middle, bufferlist& data)
 {
@@ -523,6 +540,9 @@ Message *decode_message(CephContext *cct, ceph_msg_header& header, ceph_msg_foot
   case CEPH_MSG_CLIENT_CAPRELEASE:
     m = new MClientCapRelease;
     break;
+  case CEPH_MSG_CLIENT_CAPS_BATCH:
+    m = new MClientCapsBatch;
+    break;
   case CEPH_MSG_CLIENT_LEASE:
     m = new MClientLease;
     break;
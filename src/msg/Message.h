@@ -24,7 +24,10 @@
 
 #include "include/types.h"
 #include "include/buffer.h"
+#include "include/Spinlock.h"
 #include "common/Throttle.h"
+#include "common/histogram.h"
+#include "common/mempool.h"
 #include "msg_types.h"
 
 #include "common/RefCountedObj.h"
@@ -171,6 +174,37 @@
 
 class Messenger;
 
+/**
+ * Histograms describing the traffic on one Connection; times are in
+ * microseconds.  Cheap enough to always keep.
+ */
+struct ConnectionStats {
+  Spinlock lock;
+  pow2_hist_t out_q_depth;   ///< messages already queued when one is sent
+  pow2_hist_t send_lat;      ///< submitted to written to the socket
+  pow2_hist_t dispatch_lat;  ///< fully read (and ackable) to dispatched
+
+  static int32_t to_usec(utime_t t) {
+    if (t.sec() >= 2000)      // keep within int32_t
+      return 2000000000;
+    return t.sec() * 1000000 + t.usec();
+  }
+
+  void note_out_q_depth(unsigned n) {
+    Spinlock::Locker l(lock);
+    out_q_depth.add(n);
+  }
+  void note_send_lat(utime_t t) {
+    Spinlock::Locker l(lock);
+    send_lat.add(to_usec(t));
+  }
+  void note_dispatch_lat(utime_t t) {
+    Spinlock::Locker l(lock);
+    dispatch_lat.add(to_usec(t));
+  }
+  void dump(Formatter *f) const;
+};
+
 struct Connection : private RefCountedObject {
   Mutex lock;
   Messenger *msgr;
@@ -186,6 +220,8 @@ public:
   int rx_buffers_version;
   map<tid_t,pair<bufferlist,int> > rx_buffers;
 
+  ConnectionStats stats;
+
   friend class boost::intrusive_ptr<Connection>;
 
 public:
@@ -296,6 +332,22 @@ public:
 };
 typedef boost::intrusive_ptr<Connection> ConnectionRef;
 
+/**
+ * Throttles private to one connection, so that a single peer can only
+ * take part of what its policy throttlers share among all peers of
+ * that type.  A max of 0 means no limit.  Messages read on the
+ * connection hold a reference, since they may outlive it.
+ */
+struct ConnThrottle : public RefCountedObject {
+  Throttle bytes;
+  Throttle messages;
+
+  ConnThrottle(CephContext *cct, const string &name,
+	       uint64_t max_bytes, uint64_t max_messages)
+    : bytes(cct, name + "-bytes", max_bytes),
+      messages(cct, name + "-messages", max_messages) {}
+};
+
 
 
 // abstract Message class
@@ -318,6 +370,9 @@ protected:
   utime_t throttle_stamp;
   /* time at which message was fully read */
   utime_t recv_complete_stamp;
+  /* queue_stamp is set when the Messenger queues the Message to be
+   * sent */
+  utime_t queue_stamp;
 
   ConnectionRef connection;
 
@@ -328,6 +383,9 @@ protected:
   // release a count back to this throttler when we are destroyed
   Throttle *msg_throttler;
 
+  // our connection's private throttles; released like the two above
+  ConnThrottle *conn_throttle;
+
   // keep track of how big this message was when we reserved space in
   // the msgr dispatch_throttler, so that we can properly release it
   // later.  this is necessary because messages can enter the dispatch
@@ -338,10 +396,13 @@ protected:
   friend class Messenger;
 
 public:
+  MEMPOOL_CLASS_HELPERS()
+
   Message()
     : connection(NULL),
       byte_throttler(NULL),
       msg_throttler(NULL),
+      conn_throttle(NULL),
       dispatch_throttle_size(0) {
     memset(&header, 0, sizeof(header));
     memset(&footer, 0, sizeof(footer));
@@ -350,6 +411,7 @@ public:
     : connection(NULL),
       byte_throttler(NULL),
       msg_throttler(NULL),
+      conn_throttle(NULL),
       dispatch_throttle_size(0) {
     memset(&header, 0, sizeof(header));
     header.type = t;
@@ -367,10 +429,26 @@ public:
 protected:
   virtual ~Message() { 
     assert(nref.read() == 0);
-    if (byte_throttler)
-      byte_throttler->put(payload.length() + middle.length() + data.length());
+    throttle_put(payload.length() + middle.length() + data.length());
     if (msg_throttler)
       msg_throttler->put();
+    if (conn_throttle) {
+      conn_throttle->messages.put();
+      conn_throttle->put();
+    }
+  }
+
+  void throttle_put(uint64_t bytes) {
+    if (byte_throttler)
+      byte_throttler->put(bytes);
+    if (conn_throttle)
+      conn_throttle->bytes.put(bytes);
+  }
+  void throttle_take(uint64_t bytes) {
+    if (byte_throttler)
+      byte_throttler->take(bytes);
+    if (conn_throttle)
+      conn_throttle->bytes.take(bytes);
   }
 public:
   const ConnectionRef& get_connection() { return connection; }
@@ -381,6 +459,13 @@ public:
   Throttle *get_byte_throttler() { return byte_throttler; }
   void set_message_throttler(Throttle *t) { msg_throttler = t; }
   Throttle *get_message_throttler() { return msg_throttler; }
+  /// hand over the message and bytes already taken from t
+  void set_conn_throttle(ConnThrottle *t) {
+    assert(!conn_throttle);
+    conn_throttle = t;
+    if (t)
+      t->get();
+  }
  
   void set_dispatch_throttle_size(uint64_t s) { dispatch_throttle_size = s; }
   uint64_t get_dispatch_throttle_size() { return dispatch_throttle_size; }
@@ -398,48 +483,39 @@ public:
    */
 
   void clear_payload() {
-    if (byte_throttler)
-      byte_throttler->put(payload.length() + middle.length());
+    throttle_put(payload.length() + middle.length());
     payload.clear();
     middle.clear();
   }
   void clear_data() {
-    if (byte_throttler)
-      byte_throttler->put(data.length());
+    throttle_put(data.length());
     data.clear();
   }
 
   bool empty_payload() { return payload.length() == 0; }
   bufferlist& get_payload() { return payload; }
   void set_payload(bufferlist& bl) {
-    if (byte_throttler)
-      byte_throttler->put(payload.length());
+    throttle_put(payload.length());
     payload.claim(bl);
-    if (byte_throttler)
-      byte_throttler->take(payload.length());
+    throttle_take(payload.length());
   }
 
   void set_middle(bufferlist& bl) {
-    if (byte_throttler)
-      byte_throttler->put(payload.length());
+    throttle_put(payload.length());
     middle.claim(bl);
-    if (byte_throttler)
-      byte_throttler->take(payload.length());
+    throttle_take(payload.length());
   }
   bufferlist& get_middle() { return middle; }
 
   void set_data(const bufferlist &d) {
-    if (byte_throttler)
-      byte_throttler->put(data.length());
+    throttle_put(data.length());
     data = d;
-    if (byte_throttler)
-      byte_throttler->take(data.length());
+    throttle_take(data.length());
   }
 
   bufferlist& get_data() { return data; }
   void claim_data(bufferlist& bl) {
-    if (byte_throttler)
-      byte_throttler->put(data.length());
+    throttle_put(data.length());
     bl.claim(data);
   }
   off_t get_data_len() { return data.length(); }
@@ -452,6 +528,8 @@ public:
   const utime_t& get_throttle_stamp() const { return throttle_stamp; }
   void set_recv_complete_stamp(utime_t t) { recv_complete_stamp = t; }
   const utime_t& get_recv_complete_stamp() const { return recv_complete_stamp; }
+  void set_queue_stamp(utime_t t) { queue_stamp = t; }
+  const utime_t& get_queue_stamp() const { return queue_stamp; }
 
   void calc_header_crc() {
     header.crc = ceph_crc32c(0, (unsigned char*)&header,
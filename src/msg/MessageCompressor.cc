@@ -0,0 +1,163 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+
+#include "MessageCompressor.h"
+#include "Message.h"
+#include "include/ceph_features.h"
+#include "include/crc32c.h"
+#include "include/encoding.h"
+#include "include/str_list.h"
+#include "common/Clock.h"
+#include "common/Compressor.h"
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/perf_counters.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix *_dout << "compressor "
+
+// three __le32 segment lengths
+static const unsigned COMPRESS_PREFIX_LEN = 12;
+
+MessageCompressor::MessageCompressor(CephContext *cct, const std::string &name)
+  : cct(cct), logger(NULL), compressor(NULL),
+    min_size(cct->_conf->ms_compress_min_size)
+{
+  const std::string &alg = cct->_conf->ms_compress_algorithm;
+  if (alg != "none") {
+    compressor = Compressor::get(alg);
+    if (!compressor)
+      lderr(cct) << "unknown ms_compress_algorithm '" << alg
+		 << "', not compressing" << dendl;
+  }
+  list<string> l;
+  get_str_list(cct->_conf->ms_compress_msg_types, l);
+  types.insert(l.begin(), l.end());
+
+  PerfCountersBuilder b(cct, std::string("msgr_compress-") + name,
+			l_msgr_compress_first, l_msgr_compress_last);
+  b.add_u64_counter(l_msgr_compress_in_bytes, "compress_in_bytes");
+  b.add_u64_counter(l_msgr_compress_out_bytes, "compress_out_bytes");
+  b.add_u64_counter(l_msgr_compress_saved_bytes, "compress_saved_bytes");
+  b.add_u64_counter(l_msgr_compress_rejected, "compress_rejected");
+  b.add_time_avg(l_msgr_compress_time, "compress_time");
+  b.add_time_avg(l_msgr_decompress_time, "decompress_time");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+}
+
+MessageCompressor::~MessageCompressor()
+{
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+}
+
+bool MessageCompressor::compress(Connection *con, Message *m,
+				 ceph_msg_header &header, bufferlist &out)
+{
+  if (!compressor || !con->has_feature(CEPH_FEATURE_MSG_COMPRESS))
+    return false;
+  unsigned front_len = m->get_payload().length();
+  unsigned middle_len = m->get_middle().length();
+  unsigned data_len = m->get_data().length();
+  unsigned len = front_len + middle_len + data_len;
+  if (len < min_size)
+    return false;
+  if (!types.empty() && !types.count(m->get_type_name()))
+    return false;
+
+  bufferlist in = m->get_payload();
+  in.append(m->get_middle());
+  in.append(m->get_data());
+
+  bufferlist z;
+  utime_t start = ceph_clock_now(cct);
+  int r = compressor->compress(in, z);
+  logger->tinc(l_msgr_compress_time, ceph_clock_now(cct) - start);
+  if (r < 0 || z.length() + COMPRESS_PREFIX_LEN >= len) {
+    ldout(cct, 20) << "compress " << *m << " " << len << " bytes: r " << r
+		   << " out " << z.length() << ", sending uncompressed" << dendl;
+    logger->inc(l_msgr_compress_rejected);
+    return false;
+  }
+
+  ::encode(front_len, out);
+  ::encode(middle_len, out);
+  ::encode(data_len, out);
+  out.claim_append(z);
+  ldout(cct, 20) << "compress " << *m << " " << len << " -> " << out.length()
+		 << " bytes with " << compressor->get_type_name() << dendl;
+  logger->inc(l_msgr_compress_in_bytes, len);
+  logger->inc(l_msgr_compress_out_bytes, out.length());
+  logger->inc(l_msgr_compress_saved_bytes, len - out.length());
+
+  header.front_len = 0;
+  header.middle_len = 0;
+  header.data_len = out.length();
+  header.reserved = compressor->get_type();
+  header.crc = ceph_crc32c(0, (unsigned char *)&header,
+			   sizeof(header) - sizeof(header.crc));
+  return true;
+}
+
+int MessageCompressor::decompress(ceph_msg_header &header, bufferlist &front,
+				  bufferlist &middle, bufferlist &data)
+{
+  Compressor *c = Compressor::get(header.reserved);
+  if (!c) {
+    ldout(cct, 0) << "decompress unknown algorithm " << header.reserved << dendl;
+    return -EOPNOTSUPP;
+  }
+  if (front.length() || middle.length() || data.length() < COMPRESS_PREFIX_LEN) {
+    ldout(cct, 0) << "decompress malformed body " << front.length() << "+"
+		  << middle.length() << "+" << data.length() << dendl;
+    return -EINVAL;
+  }
+
+  unsigned front_len, middle_len, data_len;
+  bufferlist::iterator p = data.begin();
+  ::decode(front_len, p);
+  ::decode(middle_len, p);
+  ::decode(data_len, p);
+  bufferlist z;
+  z.substr_of(data, COMPRESS_PREFIX_LEN, data.length() - COMPRESS_PREFIX_LEN);
+
+  bufferlist raw;
+  utime_t start = ceph_clock_now(cct);
+  int r = c->decompress(z, raw);
+  logger->tinc(l_msgr_decompress_time, ceph_clock_now(cct) - start);
+  if (r < 0 ||
+      (uint64_t)raw.length() != (uint64_t)front_len + middle_len + data_len) {
+    ldout(cct, 0) << "decompress with " << c->get_type_name() << " failed: r " << r
+		  << " got " << raw.length() << " bytes, expected "
+		  << front_len << "+" << middle_len << "+" << data_len << dendl;
+    return r < 0 ? r : -EINVAL;
+  }
+
+  front.substr_of(raw, 0, front_len);
+  middle.substr_of(raw, front_len, middle_len);
+  bufferlist d;
+  d.substr_of(raw, front_len + middle_len, data_len);
+  data.swap(d);
+
+  header.front_len = front_len;
+  header.middle_len = middle_len;
+  header.data_len = data_len;
+  header.reserved = 0;
+  header.crc = ceph_crc32c(0, (unsigned char *)&header,
+			   sizeof(header) - sizeof(header.crc));
+  return 0;
+}
@@ -0,0 +1,96 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_MESSAGECOMPRESSOR_H
+#define CEPH_MSG_MESSAGECOMPRESSOR_H
+
+#include <set>
+#include <string>
+
+#include "include/types.h"
+#include "include/msgr.h"
+
+class CephContext;
+class Compressor;
+struct Connection;
+class Message;
+class PerfCounters;
+
+enum {
+  l_msgr_compress_first = 94100,
+  l_msgr_compress_in_bytes,
+  l_msgr_compress_out_bytes,
+  l_msgr_compress_saved_bytes,
+  l_msgr_compress_rejected,
+  l_msgr_compress_time,
+  l_msgr_decompress_time,
+  l_msgr_compress_last,
+};
+
+/**
+ * Wire compression of message bodies.
+ *
+ * If both ends have CEPH_FEATURE_MSG_COMPRESS, a sender may replace the
+ * front, middle and data segments of a message with a single data
+ * segment holding
+ *
+ *   __le32 front_len, __le32 middle_len, __le32 data_len
+ *   compressed(front + middle + data)
+ *
+ * header.reserved then carries the Compressor type id, the other
+ * lengths are zero and header.crc covers this wire header.  The footer
+ * crcs and signature still describe the original message, which the
+ * receiver rebuilds exactly before decoding it.
+ *
+ * Which messages get compressed is decided by ms_compress_algorithm,
+ * ms_compress_min_size and ms_compress_msg_types, read when the
+ * messenger is created.  Any algorithm we know is accepted on receive.
+ */
+class MessageCompressor {
+  CephContext *cct;
+  PerfCounters *logger;
+  Compressor *compressor;   ///< for outgoing messages; NULL if off
+  uint64_t min_size;
+  std::set<std::string> types;  ///< Message::get_type_name(); empty for all
+
+public:
+  MessageCompressor(CephContext *cct, const std::string &name);
+  ~MessageCompressor();
+
+  /**
+   * Compress m's body for sending on con, if both qualify.
+   *
+   * @param con The Connection m goes out on
+   * @param m The encoded, signed Message
+   * @param header [in/out] The header to put on the wire; updated if
+   * m gets compressed
+   * @param out [out] The new data segment
+   * @return true if m was compressed, false to send it as is
+   */
+  bool compress(Connection *con, Message *m, ceph_msg_header &header,
+		bufferlist &out);
+
+  /**
+   * Undo compress() on a received message.  header and the segments are
+   * restored to what the sender encoded.
+   *
+   * @return 0 on success, negative error code on a bad body
+   */
+  int decompress(ceph_msg_header &header, bufferlist &front,
+		 bufferlist &middle, bufferlist &data);
+
+  static bool is_compressed(const ceph_msg_header &header) {
+    return header.reserved != 0;
+  }
+};
+
+#endif
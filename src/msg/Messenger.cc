@@ -3,11 +3,78 @@
 #include "Messenger.h"
 
 #include "SimpleMessenger.h"
+#ifdef __linux__
+#include "async/AsyncMessenger.h"
+#endif
+
+#include "common/config.h"
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_ms
 
 Messenger *Messenger::create(CephContext *cct,
 			     entity_name_t name,
 			     string lname,
 			     uint64_t nonce)
 {
+  const string &type = cct->_conf->ms_type;
+  if (type == "async") {
+#ifdef __linux__
+    return new AsyncMessenger(cct, name, lname, nonce);
+#else
+    lderr(cct) << "ms_type async is not supported on this platform, using simple" << dendl;
+#endif
+  } else if (type != "simple") {
+    lderr(cct) << "unrecognized ms_type '" << type << "', using simple" << dendl;
+  }
   return new SimpleMessenger(cct, name, lname, nonce);
 }
+
+static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
+{
+  // create a buffer to read into that matches the data alignment
+  unsigned left = len;
+  if (off & ~CEPH_PAGE_MASK) {
+    // head
+    unsigned head = 0;
+    head = MIN(CEPH_PAGE_SIZE - (off & ~CEPH_PAGE_MASK), left);
+    bufferptr bp = buffer::create(head);
+    data.push_back(bp);
+    left -= head;
+  }
+  unsigned middle = left & CEPH_PAGE_MASK;
+  if (middle > 0) {
+    bufferptr bp = buffer::create_page_aligned(middle);
+    data.push_back(bp);
+    left -= middle;
+  }
+  if (left) {
+    bufferptr bp = buffer::create(left);
+    data.push_back(bp);
+  }
+}
+
+void Messenger::ms_deliver_alloc_rx_buffer(Connection *con,
+					   const ceph_msg_header& header,
+					   bufferlist& bl)
+{
+  unsigned data_len = le32_to_cpu(header.data_len);
+  unsigned data_off = le32_to_cpu(header.data_off);
+  for (list<Dispatcher*>::iterator p = dispatchers.begin();
+       p != dispatchers.end();
+       ++p) {
+    if (!(*p)->ms_get_rx_buffer(con, header, bl))
+      continue;
+    if (bl.length() > data_len) {
+      bufferlist t;
+      t.substr_of(bl, 0, data_len);
+      bl.swap(t);
+    } else if (bl.length() < data_len) {
+      ldout(cct, 0) << "ms_deliver_alloc_rx_buffer " << bl.length()
+		    << " byte rx buffer for " << data_len << " bytes, extending" << dendl;
+      bl.push_back(buffer::create(data_len - bl.length()));
+    }
+    return;
+  }
+  alloc_aligned_buffer(bl, data_len, data_off);
+}
@@ -39,6 +39,7 @@ class Timer;
 class Messenger {
 private:
   list<Dispatcher*> dispatchers;
+  list<Dispatcher*> fast_dispatchers;
 
 protected:
   /// the "name" of the local daemon. eg client.99
@@ -76,6 +77,12 @@ public:
      */
     Throttle *throttler_bytes;
     Throttle *throttler_messages;
+    /**
+     *  Caps on what each Connection may hold of the above, so that one
+     *  peer can't take all of it and stall the others; 0 for no cap.
+     */
+    uint64_t conn_throttle_bytes;
+    uint64_t conn_throttle_messages;
 
     /// Specify features supported locally by the endpoint.
     uint64_t features_supported;
@@ -86,6 +93,8 @@ public:
       : lossy(false), server(false), standby(false), resetcheck(true),
 	throttler_bytes(NULL),
 	throttler_messages(NULL),
+	conn_throttle_bytes(0),
+	conn_throttle_messages(0),
 	features_supported(CEPH_FEATURES_SUPPORTED_DEFAULT),
 	features_required(0) {}
   private:
@@ -93,10 +102,23 @@ public:
       : lossy(l), server(s), standby(st), resetcheck(r),
 	throttler_bytes(NULL),
 	throttler_messages(NULL),
+	conn_throttle_bytes(0),
+	conn_throttle_messages(0),
 	features_supported(sup | CEPH_FEATURES_SUPPORTED_DEFAULT),
 	features_required(req) {}
 
   public:
+    /// the throttles for a new Connection, or NULL if there are no caps
+    ConnThrottle *new_conn_throttle(CephContext *cct, int peer_type,
+				    const entity_addr_t& peer_addr) const {
+      if (!conn_throttle_bytes && !conn_throttle_messages)
+	return NULL;
+      ostringstream ss;
+      ss << "conn-" << ceph_entity_type_name(peer_type) << "-" << peer_addr;
+      return new ConnThrottle(cct, ss.str(), conn_throttle_bytes,
+			      conn_throttle_messages);
+    }
+
     static Policy stateful_server(uint64_t sup, uint64_t req) {
       return Policy(false, true, true, true, sup, req);
     }
@@ -279,6 +301,20 @@ public:
    * you destroy the Messenger.
    */
   virtual void set_policy_throttlers(int type, Throttle *bytes, Throttle *msgs=NULL) = 0;
+  /**
+   * Cap how much of the policy Throttlers each Connection with the given
+   * type of peer may hold.  A Connection that reaches its cap stops
+   * reading until some of its Messages are released, without holding
+   * up the other Connections.
+   *
+   * This is an init-time function and cannot be called after calling
+   * start() or bind().
+   *
+   * @param type The peer type the caps apply to.
+   * @param bytes Bytes of Message data each Connection may hold, 0 for no cap.
+   * @param msgs Messages each Connection may hold, 0 for no cap.
+   */
+  virtual void set_policy_conn_throttle(int type, uint64_t bytes, uint64_t msgs) = 0;
   /**
    * Set the default send priority
    *
@@ -301,6 +337,8 @@ public:
   void add_dispatcher_head(Dispatcher *d) { 
     bool first = dispatchers.empty();
     dispatchers.push_front(d);
+    if (d->ms_can_fast_dispatch_any())
+      fast_dispatchers.push_front(d);
     if (first)
       ready();
   }
@@ -314,6 +352,8 @@ public:
   void add_dispatcher_tail(Dispatcher *d) { 
     bool first = dispatchers.empty();
     dispatchers.push_back(d);
+    if (d->ms_can_fast_dispatch_any())
+      fast_dispatchers.push_back(d);
     if (first)
       ready();
   }
@@ -592,6 +632,53 @@ public:
     assert(!cct->_conf->ms_die_on_unhandled_msg);
     m->put();
   }
+  /**
+   * Check whether any fast Dispatcher wants to handle a Message.
+   *
+   * @param m The Message to check.
+   * @return true if ms_fast_dispatch() may be called for m.
+   */
+  bool ms_can_fast_dispatch(Message *m) {
+    for (list<Dispatcher*>::iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_can_fast_dispatch(m))
+	return true;
+    }
+    return false;
+  }
+  /**
+   * Deliver a single Message to the first fast Dispatcher that
+   * accepts it. Only call this if ms_can_fast_dispatch(m) was true.
+   *
+   * @param m The Message to deliver. We take ownership of
+   * one reference to it.
+   */
+  void ms_fast_dispatch(Message *m) {
+    m->set_dispatch_stamp(ceph_clock_now(cct));
+    for (list<Dispatcher*>::iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_can_fast_dispatch(m)) {
+	(*p)->ms_fast_dispatch(m);
+	return;
+      }
+    }
+    assert(0);
+  }
+  /**
+   * Allocate the buffer an incoming message's data segment is read
+   * into. Each Dispatcher gets a chance to supply it (see
+   * Dispatcher::ms_get_rx_buffer()); otherwise it is laid out to match
+   * the data alignment given in the header.
+   *
+   * @param con The Connection the message arrives on.
+   * @param header The header of the incoming message.
+   * @param bl [out] Empty on entry; holds exactly header.data_len bytes
+   * on return.
+   */
+  void ms_deliver_alloc_rx_buffer(Connection *con, const ceph_msg_header& header,
+				  bufferlist& bl);
   /**
    * Notify each Dispatcher of a new Connection. Call
    * this function whenever a new Connection is initiated.
@@ -24,6 +24,7 @@
 
 #include "common/debug.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 
 // Below included to get encode_encrypt(); That probably should be in Crypto.h, instead
 
@@ -31,6 +32,12 @@
 #include "auth/cephx/CephxProtocol.h"
 #include "auth/AuthSessionHandler.h"
 
+#ifdef WITH_LTTNG
+#include "tracing/msg.h"
+#else
+#define tracepoint(...)
+#endif
+
 // Constant to limit starting sequence number to 2^31.  Nothing special about it, just a big number.  PLR
 #define SEQ_MASK  0x7fffffff 
 #define dout_subsys ceph_subsys_ms
@@ -79,12 +86,14 @@ Pipe::Pipe(SimpleMessenger *r, int st, Connection *con)
     conn_id(r->dispatch_queue.get_id()),
     sd(-1), port(0),
     peer_type(-1),
+    conn_throttle(NULL),
     pipe_lock("SimpleMessenger::Pipe::pipe_lock"),
     state(st),
     session_security(NULL),
     connection_state(NULL),
     reader_running(false), reader_needs_join(false),
     writer_running(false),
+    out_q_len(0),
     in_q(&(r->dispatch_queue)),
     keepalive(false),
     close_on_empty(false),
@@ -114,6 +123,8 @@ Pipe::~Pipe()
   assert(sent.empty());
   delete session_security;
   delete delay_thread;
+  if (conn_throttle)
+    conn_throttle->put();
 }
 
 void Pipe::handle_ack(uint64_t seq)
@@ -195,7 +206,13 @@ void Pipe::DelayedDelivery::flush()
   while (!delay_queue.empty()) {
     Message *m = delay_queue.front().second;
     delay_queue.pop_front();
-    pipe->in_q->enqueue(m, m->get_priority(), pipe->conn_id);
+    if (pipe->in_q->can_fast_dispatch(m)) {
+      delay_lock.Unlock();
+      pipe->in_q->fast_dispatch(m);
+      delay_lock.Lock();
+    } else {
+      pipe->in_q->enqueue(m, m->get_priority(), pipe->conn_id);
+    }
   }
 }
 
@@ -362,6 +379,8 @@ int Pipe::accept()
     // note peer's type, flags
     set_peer_type(connect.host_type);
     policy = msgr->get_policy(connect.host_type);
+    if (!conn_throttle)
+      conn_throttle = policy.new_conn_throttle(msgr->cct, peer_type, peer_addr);
     ldout(msgr->cct,10) << "accept of host_type " << connect.host_type
 			<< ", policy.lossy=" << policy.lossy
 			<< " policy.server=" << policy.server
@@ -632,6 +651,8 @@ int Pipe::accept()
          p != existing->out_q.end();
          ++p)
       out_q[p->first].splice(out_q[p->first].begin(), p->second);
+    out_q_len += existing->out_q_len;
+    existing->out_q_len = 0;
   }
   existing->pipe_lock.Unlock();
 
@@ -1192,6 +1213,7 @@ void Pipe::requeue_sent()
     ldout(msgr->cct,10) << "requeue_sent " << *m << " for resend seq " << out_seq
 			<< " (" << m->get_seq() << ")" << dendl;
     rq.push_front(m);
+    ++out_q_len;
     out_seq--;
   }
 }
@@ -1210,6 +1232,7 @@ void Pipe::discard_requeued_up_to(uint64_t seq)
 			<< " <= " << seq << ", discarding" << dendl;
     m->put();
     rq.pop_front();
+    --out_q_len;
     out_seq++;
   }
   if (rq.empty())
@@ -1235,6 +1258,17 @@ void Pipe::discard_out_queue()
       (*r)->put();
     }
   out_q.clear();
+  out_q_len = 0;
+}
+
+void Pipe::_send(Message *m)
+{
+  assert(pipe_lock.is_locked());
+  connection_state->stats.note_out_q_depth(out_q_len);
+  m->set_queue_stamp(ceph_clock_now(msgr->cct));
+  out_q[m->get_priority()].push_back(m);
+  ++out_q_len;
+  cond.Signal();
 }
 
 void Pipe::fault(bool onread)
@@ -1493,7 +1527,14 @@ void Pipe::reader()
 	}
 	delay_thread->queue(release, m);
       } else {
-	in_q->enqueue(m, m->get_priority(), conn_id);
+	if (in_q->can_fast_dispatch(m)) {
+	  // the Dispatcher may send on this very connection
+	  pipe_lock.Unlock();
+	  in_q->fast_dispatch(m);
+	  pipe_lock.Lock();
+	} else {
+	  in_q->enqueue(m, m->get_priority(), conn_id);
+	}
       }
     } 
     
@@ -1568,36 +1609,38 @@ void Pipe::writer()
     if (state != STATE_CONNECTING && state != STATE_WAIT && state != STATE_STANDBY &&
 	(is_queued() || in_seq > in_seq_acked)) {
 
+      // gather a keepalive, an ack and as many messages as the batch
+      // limits allow, and write them out in one go.
+      bufferlist batch;
+      vector<Message*> batch_msgs;
+      bool batch_full = false;
+      uint64_t max_bytes = msgr->cct->_conf->ms_writer_batch_bytes;
+      unsigned max_iovs = msgr->cct->_conf->ms_writer_batch_iovs;
+
       // keepalive?
-      if (keepalive) {
-	pipe_lock.Unlock();
-	int rc = write_keepalive();
-	pipe_lock.Lock();
-	if (rc < 0) {
-	  ldout(msgr->cct,2) << "writer couldn't write keepalive, " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-	  fault();
- 	  continue;
-	}
-	keepalive = false;
-      }
+      bool send_keepalive = keepalive;
+      if (send_keepalive)
+	write_keepalive(batch);
 
       // send ack?
+      uint64_t send_seq = 0;
       if (in_seq > in_seq_acked) {
-	uint64_t send_seq = in_seq;
-	pipe_lock.Unlock();
-	int rc = write_ack(send_seq);
-	pipe_lock.Lock();
-	if (rc < 0) {
-	  ldout(msgr->cct,2) << "writer couldn't write ack, " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-	  fault();
- 	  continue;
-	}
-	in_seq_acked = send_seq;
+	send_seq = in_seq;
+	write_ack(send_seq, batch);
       }
 
-      // grab outgoing message
-      Message *m = _get_next_outgoing();
-      if (m) {
+      // grab outgoing messages
+      while (true) {
+	if (!batch_msgs.empty() &&
+	    (batch.length() >= max_bytes ||
+	     batch.buffers().size() >= max_iovs)) {
+	  batch_full = true;
+	  break;
+	}
+	Message *m = _get_next_outgoing();
+	if (!m)
+	  break;
+
 	m->set_seq(++out_seq);
 	if (!policy.lossy || close_on_empty) {
 	  // put on sent list
@@ -1640,23 +1683,52 @@ void Pipe::writer()
 	  }
 	}
 
-	bufferlist blist = m->get_payload();
-	blist.append(m->get_middle());
-	blist.append(m->get_data());
-
-	pipe_lock.Unlock();
+	// the body may go out compressed, under its own wire header
+	ceph_msg_header wire_header = header;
+	bufferlist blist;
+	if (!msgr->compressor.compress(connection_state.get(), m, wire_header, blist)) {
+	  blist = m->get_payload();
+	  blist.append(m->get_middle());
+	  blist.append(m->get_data());
+	}
 
         ldout(msgr->cct,20) << "writer sending " << m->get_seq() << " " << m << dendl;
-	int rc = write_message(header, footer, blist);
+	write_message(wire_header, footer, blist, batch);
+	batch_msgs.push_back(m);
+      }
 
-	pipe_lock.Lock();
-	if (rc < 0) {
-          ldout(msgr->cct,1) << "writer error sending " << m << ", "
-		  << errno << ": " << strerror_r(errno, buf, sizeof(buf)) << dendl;
-	  fault();
-        }
-	m->put();
+      pipe_lock.Unlock();
+
+      ldout(msgr->cct,20) << "writer writing batch of " << batch_msgs.size()
+			  << " messages, " << batch.length() << " bytes in "
+			  << batch.buffers().size() << " buffers" << dendl;
+      int rc = write_batch(batch);
+
+      pipe_lock.Lock();
+      if (rc < 0) {
+	ldout(msgr->cct,1) << "writer error sending batch of " << batch_msgs.size()
+			   << " messages, " << errno << ": "
+			   << strerror_r(errno, buf, sizeof(buf)) << dendl;
+	fault();
+      } else {
+	if (send_keepalive)
+	  keepalive = false;
+	if (send_seq)
+	  in_seq_acked = send_seq;
+	msgr->logger->inc(l_msgr_writer_batch_msgs, batch_msgs.size());
+	msgr->logger->inc(l_msgr_writer_batch_bytes, batch.length());
+	if (batch_full)
+	  msgr->logger->inc(l_msgr_writer_batch_full);
+	utime_t now = ceph_clock_now(msgr->cct);
+	for (vector<Message*>::iterator p = batch_msgs.begin();
+	     p != batch_msgs.end();
+	     ++p)
+	  connection_state->stats.note_send_lat(now - (*p)->get_queue_stamp());
       }
+      for (vector<Message*>::iterator p = batch_msgs.begin();
+	   p != batch_msgs.end();
+	   ++p)
+	(*p)->put();
       continue;
     }
     
@@ -1690,30 +1762,6 @@ void Pipe::unlock_maybe_reap()
   }
 }
 
-static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
-{
-  // create a buffer to read into that matches the data alignment
-  unsigned left = len;
-  if (off & ~CEPH_PAGE_MASK) {
-    // head
-    unsigned head = 0;
-    head = MIN(CEPH_PAGE_SIZE - (off & ~CEPH_PAGE_MASK), left);
-    bufferptr bp = buffer::create(head);
-    data.push_back(bp);
-    left -= head;
-  }
-  unsigned middle = left & CEPH_PAGE_MASK;
-  if (middle > 0) {
-    bufferptr bp = buffer::create_page_aligned(middle);
-    data.push_back(bp);
-    left -= middle;
-  }
-  if (left) {
-    bufferptr bp = buffer::create(left);
-    data.push_back(bp);
-  }
-}
-
 int Pipe::read_message(Message **pm)
 {
   int ret = -1;
@@ -1755,10 +1803,28 @@ int Pipe::read_message(Message **pm)
 
   bufferlist front, middle, data;
   int front_len, middle_len;
-  unsigned data_len, data_off;
+  unsigned data_len;
   int aborted;
   Message *message;
   utime_t recv_stamp = ceph_clock_now(msgr->cct);
+  bool compressed = connection_state->has_feature(CEPH_FEATURE_MSG_COMPRESS) &&
+    MessageCompressor::is_compressed(header);
+
+  uint64_t message_size = header.front_len + header.middle_len + header.data_len;
+
+  // our own caps first, so that if we are over them we wait without
+  // holding any of what the policy throttlers share with other pipes
+  if (conn_throttle) {
+    ldout(msgr->cct,10) << "reader wants 1 message and " << message_size
+			<< " bytes from connection throttler "
+			<< conn_throttle->messages.get_current() << "/"
+			<< conn_throttle->messages.get_max() << " "
+			<< conn_throttle->bytes.get_current() << "/"
+			<< conn_throttle->bytes.get_max() << dendl;
+    conn_throttle->messages.get();
+    if (message_size)
+      conn_throttle->bytes.get(message_size);
+  }
 
   if (policy.throttler_messages) {
     ldout(msgr->cct,10) << "reader wants " << 1 << " message from policy throttler "
@@ -1767,7 +1833,6 @@ int Pipe::read_message(Message **pm)
     policy.throttler_messages->get();
   }
 
-  uint64_t message_size = header.front_len + header.middle_len + header.data_len;
   if (message_size) {
     if (policy.throttler_bytes) {
       ldout(msgr->cct,10) << "reader wants " << message_size << " bytes from policy throttler "
@@ -1781,9 +1846,9 @@ int Pipe::read_message(Message **pm)
     // blocks indefinitely, which it shouldn't).  in contrast, the
     // policy throttle carries for the lifetime of the message.
     ldout(msgr->cct,10) << "reader wants " << message_size << " from dispatch throttler "
-	     << msgr->dispatch_throttler.get_current() << "/"
-	     << msgr->dispatch_throttler.get_max() << dendl;
-    msgr->dispatch_throttler.get(message_size);
+	     << msgr->dispatch_queue.dispatch_throttler.get_current() << "/"
+	     << msgr->dispatch_queue.dispatch_throttler.get_max() << dendl;
+    msgr->dispatch_queue.dispatch_throttler.get(message_size);
   }
 
   utime_t throttle_stamp = ceph_clock_now(msgr->cct);
@@ -1811,7 +1876,6 @@ int Pipe::read_message(Message **pm)
 
   // read data
   data_len = le32_to_cpu(header.data_len);
-  data_off = le32_to_cpu(header.data_off);
   if (data_len) {
     unsigned offset = 0;
     unsigned left = data_len;
@@ -1827,7 +1891,23 @@ int Pipe::read_message(Message **pm)
 
       // get a buffer
       connection_state->lock.Lock();
-      map<tid_t,pair<bufferlist,int> >::iterator p = connection_state->rx_buffers.find(header.tid);
+      // a compressed body is inflated into new buffers anyway
+      map<tid_t,pair<bufferlist,int> >::iterator p = compressed ?
+	connection_state->rx_buffers.end() : connection_state->rx_buffers.find(header.tid);
+      if (p == connection_state->rx_buffers.end() && !newbuf.length()) {
+	// the Dispatchers may hand us a buffer; don't call them locked
+	connection_state->lock.Unlock();
+	ldout(msgr->cct,20) << "reader allocating new rx buffer at offset " << offset << dendl;
+	if (compressed)
+	  newbuf.push_back(buffer::create(data_len));
+	else
+	  msgr->ms_deliver_alloc_rx_buffer(connection_state.get(), header, newbuf);
+	blp = newbuf.begin();
+	blp.advance(offset);
+	connection_state->lock.Lock();
+	if (!compressed)
+	  p = connection_state->rx_buffers.find(header.tid);
+      }
       if (p != connection_state->rx_buffers.end()) {
 	if (rxbuf.length() == 0 || p->second.second != rxbuf_version) {
 	  ldout(msgr->cct,10) << "reader seleting rx buffer v " << p->second.second
@@ -1841,13 +1921,6 @@ int Pipe::read_message(Message **pm)
 	  blp = p->second.first.begin();
 	  blp.advance(offset);
 	}
-      } else {
-	if (!newbuf.length()) {
-	  ldout(msgr->cct,20) << "reader allocating new rx buffer at offset " << offset << dendl;
-	  alloc_aligned_buffer(newbuf, data_len, data_off);
-	  blp = newbuf.begin();
-	  blp.advance(offset);
-	}
       }
       bufferptr bp = blp.get_current_ptr();
       int read = MIN(bp.length(), left);
@@ -1858,6 +1931,8 @@ int Pipe::read_message(Message **pm)
       if (got < 0)
 	goto out_dethrottle;
       if (got > 0) {
+	// a posted rx buffer may have been summed before it was reused
+	bp.invalidate_crc();
 	blp.advance(got);
 	data.append(bp, 0, got);
 	offset += got;
@@ -1890,6 +1965,17 @@ int Pipe::read_message(Message **pm)
     goto out_dethrottle;
   }
 
+  if (compressed) {
+    ldout(msgr->cct,20) << "reader got " << data.length() << " byte compressed body" << dendl;
+    int r = msgr->compressor.decompress(header, front, middle, data);
+    if (r < 0) {
+      ldout(msgr->cct,0) << "reader failed to decompress message body: "
+			 << cpp_strerror(r) << dendl;
+      ret = -EINVAL;
+      goto out_dethrottle;
+    }
+  }
+
   ldout(msgr->cct,20) << "reader got " << front.length() << " + " << middle.length() << " + " << data.length()
 	   << " byte message" << dendl;
   message = decode_message(msgr->cct, header, footer, front, middle, data);
@@ -1914,6 +2000,7 @@ int Pipe::read_message(Message **pm)
 
   message->set_byte_throttler(policy.throttler_bytes);
   message->set_message_throttler(policy.throttler_messages);
+  message->set_conn_throttle(conn_throttle);
 
   // store reservation size in message, so we don't get confused
   // by messages entering the dispatch queue through other paths.
@@ -1923,11 +2010,21 @@ int Pipe::read_message(Message **pm)
   message->set_throttle_stamp(throttle_stamp);
   message->set_recv_complete_stamp(ceph_clock_now(msgr->cct));
 
+  tracepoint(ceph_msg, read_message,
+	     message->get_source().type(), message->get_source().num(),
+	     message->get_tid(), message->get_seq(), message->get_type(),
+	     message->get_payload().length(), message->get_data().length());
+
   *pm = message;
   return 0;
 
  out_dethrottle:
   // release bytes reserved from the throttlers on failure
+  if (conn_throttle) {
+    conn_throttle->messages.put();
+    if (message_size)
+      conn_throttle->bytes.put(message_size);
+  }
   if (policy.throttler_messages) {
     ldout(msgr->cct,10) << "reader releasing " << 1 << " message to policy throttler "
 			<< policy.throttler_messages->get_current() << "/"
@@ -1997,75 +2094,35 @@ int Pipe::do_sendmsg(struct msghdr *msg, int len, bool more)
 }
 
 
-int Pipe::write_ack(uint64_t seq)
+void Pipe::write_ack(uint64_t seq, bufferlist& batch)
 {
   ldout(msgr->cct,10) << "write_ack " << seq << dendl;
 
-  char c = CEPH_MSGR_TAG_ACK;
   ceph_le64 s;
   s = seq;
-
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec msgvec[2];
-  msgvec[0].iov_base = &c;
-  msgvec[0].iov_len = 1;
-  msgvec[1].iov_base = &s;
-  msgvec[1].iov_len = sizeof(s);
-  msg.msg_iov = msgvec;
-  msg.msg_iovlen = 2;
-  
-  if (do_sendmsg(&msg, 1 + sizeof(s), true) < 0)
-    return -1;	
-  return 0;
+  batch.append((char)CEPH_MSGR_TAG_ACK);
+  batch.append((char*)&s, sizeof(s));
 }
 
-int Pipe::write_keepalive()
+void Pipe::write_keepalive(bufferlist& batch)
 {
   ldout(msgr->cct,10) << "write_keepalive" << dendl;
 
-  char c = CEPH_MSGR_TAG_KEEPALIVE;
-
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec msgvec[2];
-  msgvec[0].iov_base = &c;
-  msgvec[0].iov_len = 1;
-  msg.msg_iov = msgvec;
-  msg.msg_iovlen = 1;
-  
-  if (do_sendmsg(&msg, 1) < 0)
-    return -1;	
-  return 0;
+  batch.append((char)CEPH_MSGR_TAG_KEEPALIVE);
 }
 
 
-int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, bufferlist& blist)
+void Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, bufferlist& blist,
+			 bufferlist& batch)
 {
-  int ret;
-
-  // set up msghdr and iovecs
-  struct msghdr msg;
-  memset(&msg, 0, sizeof(msg));
-  struct iovec *msgvec = new iovec[3 + blist.buffers().size()];  // conservative upper bound
-  msg.msg_iov = msgvec;
-  int msglen = 0;
-  
   // send tag
-  char tag = CEPH_MSGR_TAG_MSG;
-  msgvec[msg.msg_iovlen].iov_base = &tag;
-  msgvec[msg.msg_iovlen].iov_len = 1;
-  msglen++;
-  msg.msg_iovlen++;
+  batch.append((char)CEPH_MSGR_TAG_MSG);
 
   // send envelope
-  ceph_msg_header_old oldheader;
   if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
-    msgvec[msg.msg_iovlen].iov_base = (char*)&header;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(header);
-    msglen += sizeof(header);
-    msg.msg_iovlen++;
+    batch.append((char*)&header, sizeof(header));
   } else {
+    ceph_msg_header_old oldheader;
     memcpy(&oldheader, &header, sizeof(header));
     oldheader.src.name = header.src;
     oldheader.src.addr = connection_state->get_peer_addr();
@@ -2073,91 +2130,67 @@ int Pipe::write_message(ceph_msg_header& header, ceph_msg_footer& footer, buffer
     oldheader.reserved = header.reserved;
     oldheader.crc = ceph_crc32c(0, (unsigned char*)&oldheader,
 				sizeof(oldheader) - sizeof(oldheader.crc));
-    msgvec[msg.msg_iovlen].iov_base = (char*)&oldheader;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(oldheader);
-    msglen += sizeof(oldheader);
-    msg.msg_iovlen++;
+    batch.append((char*)&oldheader, sizeof(oldheader));
   }
 
-  // payload (front+data)
-  list<bufferptr>::const_iterator pb = blist.buffers().begin();
-  int b_off = 0;  // carry-over buffer offset, if any
-  int bl_pos = 0; // blist pos
-  int left = blist.length();
-
-  while (left > 0) {
-    int donow = MIN(left, (int)pb->length()-b_off);
-    if (donow == 0) {
-      ldout(msgr->cct,0) << "donow = " << donow << " left " << left << " pb->length " << pb->length()
-	      << " b_off " << b_off << dendl;
-    }
-    assert(donow > 0);
-    ldout(msgr->cct,30) << " bl_pos " << bl_pos << " b_off " << b_off
-	     << " leftinchunk " << left
-	     << " buffer len " << pb->length()
-	     << " writing " << donow 
-	     << dendl;
-    
-    if (msg.msg_iovlen >= IOV_MAX-2) {
-      if (do_sendmsg(&msg, msglen, true))
-	goto fail;
-      
-      // and restart the iov
-      msg.msg_iov = msgvec;
-      msg.msg_iovlen = 0;
-      msglen = 0;
-    }
-    
-    msgvec[msg.msg_iovlen].iov_base = (void*)(pb->c_str()+b_off);
-    msgvec[msg.msg_iovlen].iov_len = donow;
-    msglen += donow;
-    msg.msg_iovlen++;
-    
-    left -= donow;
-    assert(left >= 0);
-    b_off += donow;
-    bl_pos += donow;
-    if (left == 0)
-      break;
-    while (b_off == (int)pb->length()) {
-      ++pb;
-      b_off = 0;
-    }
-  }
-  assert(left == 0);
+  // payload (front+middle+data)
+  batch.append(blist);
 
   // send footer; if receiver doesn't support signatures, use the old footer format
-
-  ceph_msg_footer_old old_footer;
   if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
-    msgvec[msg.msg_iovlen].iov_base = (void*)&footer;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(footer);
-    msglen += sizeof(footer);
-    msg.msg_iovlen++;
+    batch.append((char*)&footer, sizeof(footer));
   } else {
+    ceph_msg_footer_old old_footer;
     old_footer.front_crc = footer.front_crc;   
     old_footer.middle_crc = footer.middle_crc;   
     old_footer.data_crc = footer.data_crc;   
     old_footer.flags = footer.flags;   
-    msgvec[msg.msg_iovlen].iov_base = (char*)&old_footer;
-    msgvec[msg.msg_iovlen].iov_len = sizeof(old_footer);
-    msglen += sizeof(old_footer);
+    batch.append((char*)&old_footer, sizeof(old_footer));
+  }
+}
+
+int Pipe::write_batch(bufferlist& batch)
+{
+  // set up msghdr and iovecs
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  int nvec = MIN(batch.buffers().size(), (size_t)IOV_MAX);
+  struct iovec *msgvec = new iovec[nvec];
+  msg.msg_iov = msgvec;
+  int msglen = 0;
+  int ret = 0;
+
+  for (list<bufferptr>::const_iterator pb = batch.buffers().begin();
+       pb != batch.buffers().end();
+       ++pb) {
+    if (pb->length() == 0)
+      continue;
+    if ((int)msg.msg_iovlen == nvec) {
+      if (do_sendmsg(&msg, msglen, true)) {
+	ret = -1;
+	goto out;
+      }
+
+      // and restart the iov
+      msg.msg_iov = msgvec;
+      msg.msg_iovlen = 0;
+      msglen = 0;
+    }
+    ldout(msgr->cct,30) << "write_batch iov " << msg.msg_iovlen
+			<< " len " << pb->length() << dendl;
+    msgvec[msg.msg_iovlen].iov_base = (void*)pb->c_str();
+    msgvec[msg.msg_iovlen].iov_len = pb->length();
+    msglen += pb->length();
     msg.msg_iovlen++;
   }
 
   // send
-  if (do_sendmsg(&msg, msglen))
-    goto fail;
-
-  ret = 0;
+  if (msglen && do_sendmsg(&msg, msglen))
+    ret = -1;
 
  out:
   delete[] msgvec;
   return ret;
-
- fail:
-  ret = -1;
-  goto out;
 }
 
 
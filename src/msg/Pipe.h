@@ -139,6 +139,7 @@ class DispatchQueue;
     int peer_type;
     entity_addr_t peer_addr;
     Messenger::Policy policy;
+    ConnThrottle *conn_throttle;  ///< from policy, if it caps each connection
     
     Mutex pipe_lock;
     int state;
@@ -158,6 +159,7 @@ class DispatchQueue;
     bool writer_running;
 
     map<int, list<Message*> > out_q;  // priority queue for outbound msgs
+    unsigned out_q_len;               // messages in out_q
     DispatchQueue *in_q;
     list<Message*> sent;
     Cond cond;
@@ -180,7 +182,21 @@ class DispatchQueue;
     int randomize_out_seq();
 
     int read_message(Message **pm);
-    int write_message(ceph_msg_header& h, ceph_msg_footer& f, bufferlist& body);
+    /**
+     * Append the wire encoding of a message (tag, header, body and
+     * footer) to a batch for write_batch().  The body buffers are
+     * referenced, not copied.
+     */
+    void write_message(ceph_msg_header& h, ceph_msg_footer& f, bufferlist& body,
+		       bufferlist& batch);
+    /**
+     * Write out everything the writer gathered in one pass with as few
+     * sendmsg calls as possible (one, unless it spans more than IOV_MAX
+     * buffers).
+     *
+     * @return 0, or -1 on failure (unrecoverable -- close the socket).
+     */
+    int write_batch(bufferlist& batch);
     /**
      * Write the given data (of length len) to the Pipe's socket. This function
      * will loop until all passed data has been written out.
@@ -193,8 +209,8 @@ class DispatchQueue;
      * @return 0, or -1 on failure (unrecoverable -- close the socket).
      */
     int do_sendmsg(struct msghdr *msg, int len, bool more=false);
-    int write_ack(uint64_t s);
-    int write_keepalive();
+    void write_ack(uint64_t s, bufferlist& batch);
+    void write_keepalive(bufferlist& batch);
 
     void fault(bool reader=false);
 
@@ -237,11 +253,7 @@ class DispatchQueue;
     void join();
     void stop();
 
-    void _send(Message *m) {
-      assert(pipe_lock.is_locked());
-      out_q[m->get_priority()].push_back(m);
-      cond.Signal();
-    }
+    void _send(Message *m);
     void _send_keepalive() {
       assert(pipe_lock.is_locked());
       keepalive = true;
@@ -255,6 +267,7 @@ class DispatchQueue;
         if (!p->second.empty()) {
           m = p->second.front();
           p->second.pop_front();
+          --out_q_len;
         }
         if (p->second.empty())
           out_q.erase(p->first);
@@ -21,6 +21,9 @@
 
 #include "common/config.h"
 #include "common/Timer.h"
+#include "common/perf_counters.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
 #include "common/errno.h"
 #include "auth/Crypto.h"
 #include "include/Spinlock.h"
@@ -37,11 +40,29 @@ static ostream& _prefix(std::ostream *_dout, SimpleMessenger *msgr) {
  * SimpleMessenger
  */
 
+class SimpleMessengerSocketHook : public AdminSocketHook {
+  SimpleMessenger *msgr;
+public:
+  SimpleMessengerSocketHook(SimpleMessenger *m) : msgr(m) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    Formatter *f = new_formatter(format);
+    if (!f)
+      f = new_formatter("json-pretty");
+    msgr->dump_stats(f);
+    f->flush(out);
+    delete f;
+    return true;
+  }
+};
+
 SimpleMessenger::SimpleMessenger(CephContext *cct, entity_name_t name,
 				 string mname, uint64_t _nonce)
   : Messenger(cct, name),
     accepter(this, _nonce),
-    dispatch_queue(cct, this),
+    dispatch_queue(cct, this, mname),
+    logger(NULL),
+    compressor(cct, mname),
     reaper_thread(this),
     my_type(name.type()),
     nonce(_nonce),
@@ -49,13 +70,30 @@ SimpleMessenger::SimpleMessenger(CephContext *cct, entity_name_t name,
     global_seq(0),
     cluster_protocol(0),
     policy_lock("SimpleMessenger::policy_lock"),
-    dispatch_throttler(cct, string("msgr_dispatch_throttler-") + mname, cct->_conf->ms_dispatch_throttle_bytes),
     reaper_started(false), reaper_stop(false),
     timeout(0),
     local_connection(new Connection(this))
 {
   ceph_spin_init(&global_seq_lock);
   init_local_connection();
+
+  PerfCountersBuilder b(cct, string("msgr-") + mname, l_msgr_first, l_msgr_last);
+  b.add_u64_avg(l_msgr_writer_batch_msgs, "writer_batch_msgs");
+  b.add_u64_avg(l_msgr_writer_batch_bytes, "writer_batch_bytes");
+  b.add_u64_counter(l_msgr_writer_batch_full, "writer_batch_full");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+
+  asok_hook = new SimpleMessengerSocketHook(this);
+  asok_command = "dump_messenger_stats " + mname;
+  int r = cct->get_admin_socket()->register_command(
+    asok_command, asok_command, asok_hook,
+    "dump per-peer queue depth and latency histograms of messenger " + mname);
+  if (r < 0) {
+    ldout(cct, 1) << "failed to register '" << asok_command << "': "
+		  << cpp_strerror(r) << dendl;
+    asok_command.clear();
+  }
 }
 
 /**
@@ -67,6 +105,11 @@ SimpleMessenger::~SimpleMessenger()
   assert(!did_bind); // either we didn't bind or we shut down the Accepter
   assert(rank_pipe.empty()); // we don't have any running Pipes.
   assert(reaper_stop && !reaper_started); // the reaper thread is stopped
+  if (asok_command.length())
+    cct->get_admin_socket()->unregister_command(asok_command);
+  delete asok_hook;
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
 }
 
 void SimpleMessenger::ready()
@@ -190,12 +233,7 @@ int SimpleMessenger::get_proto_version(int peer_type, bool connect)
 
 void SimpleMessenger::dispatch_throttle_release(uint64_t msize)
 {
-  if (msize) {
-    ldout(cct,10) << "dispatch_throttle_release " << msize << " to dispatch throttler "
-	    << dispatch_throttler.get_current() << "/"
-	    << dispatch_throttler.get_max() << dendl;
-    dispatch_throttler.put(msize);
-  }
+  dispatch_queue.dispatch_throttle_release(msize);
 }
 
 void SimpleMessenger::reaper_entry()
@@ -561,6 +599,27 @@ void SimpleMessenger::wait()
 }
 
 
+void SimpleMessenger::dump_stats(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  f->open_array_section("peers");
+  for (ceph::unordered_map<entity_addr_t,Pipe*>::iterator p = rank_pipe.begin();
+       p != rank_pipe.end();
+       ++p) {
+    Pipe *pipe = p->second;
+    f->open_object_section("peer");
+    f->dump_stream("addr") << p->first;
+    pipe->pipe_lock.Lock();
+    f->dump_string("type", ceph_entity_type_name(pipe->peer_type));
+    f->dump_string("state", pipe->get_state_name());
+    f->dump_unsigned("out_q_len", pipe->out_q_len);
+    pipe->connection_state->stats.dump(f);
+    pipe->pipe_lock.Unlock();
+    f->close_section();
+  }
+  f->close_section();
+}
+
 void SimpleMessenger::mark_down_all()
 {
   ldout(cct,1) << "mark_down_all" << dendl;
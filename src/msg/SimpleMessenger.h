@@ -34,11 +34,23 @@ using namespace std;
 #include "Message.h"
 #include "include/assert.h"
 #include "DispatchQueue.h"
+#include "MessageCompressor.h"
 
 #include "Pipe.h"
 #include "Accepter.h"
 #include "include/Spinlock.h"
 
+class PerfCounters;
+class SimpleMessengerSocketHook;
+
+enum {
+  l_msgr_first = 94000,
+  l_msgr_writer_batch_msgs,
+  l_msgr_writer_batch_bytes,
+  l_msgr_writer_batch_full,
+  l_msgr_last,
+};
+
 /*
  * This class handles transmission and reception of messages. Generally
  * speaking, there are several major components:
@@ -133,6 +145,17 @@ public:
     }
   }
 
+  void set_policy_conn_throttle(int type, uint64_t bytes, uint64_t msgs) {
+    Mutex::Locker l(policy_lock);
+    if (policy_map.count(type)) {
+      policy_map[type].conn_throttle_bytes = bytes;
+      policy_map[type].conn_throttle_messages = msgs;
+    } else {
+      default_policy.conn_throttle_bytes = bytes;
+      default_policy.conn_throttle_messages = msgs;
+    }
+  }
+
   int bind(const entity_addr_t& bind_addr);
   int rebind(const set<int>& avoid_ports);
 
@@ -202,6 +225,16 @@ private:
 public:
   Accepter accepter;
   DispatchQueue dispatch_queue;
+  /// writer batching stats, shared by all our Pipes
+  PerfCounters *logger;
+  /// wire compression of message bodies
+  MessageCompressor compressor;
+
+  /**
+   * Dump the queue depth and latency histograms kept for each peer;
+   * this is the dump_messenger_stats admin socket command.
+   */
+  void dump_stats(Formatter *f);
 
   friend class Accepter;
 
@@ -310,6 +343,10 @@ private:
   /// lock to protect the global_seq
   ceph_spinlock_t global_seq_lock;
 
+  SimpleMessengerSocketHook *asok_hook;
+  /// our dump_messenger_stats command; empty if we failed to register it
+  string asok_command;
+
   /**
    * hash map of addresses to Pipes
    *
@@ -338,9 +375,6 @@ private:
   /// map specifying different Policies for specific peer types
   map<int, Policy> policy_map; // entity_name_t::type -> Policy
 
-  /// Throttle preventing us from building up a big backlog waiting for dispatch
-  Throttle dispatch_throttler;
-
   bool reaper_started, reaper_stop;
   Cond reaper_cond;
 
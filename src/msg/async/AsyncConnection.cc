@@ -0,0 +1,2199 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+
+#include "include/Context.h"
+#include "common/errno.h"
+#include "common/debug.h"
+#include "auth/Crypto.h"
+#include "AsyncMessenger.h"
+#include "AsyncConnection.h"
+
+// Constant to limit starting sequence number to 2^31.  Nothing special about it, just a big number.  PLR
+#define SEQ_MASK  0x7fffffff
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix _conn_prefix(_dout)
+ostream& AsyncConnection::_conn_prefix(std::ostream *_dout) {
+  return *_dout << "-- " << async_msgr->get_myinst().addr << " >> " << peer_addr
+		<< " conn(" << this
+		<< " sd=" << sd << " :" << port
+		<< " s=" << get_state_name(state)
+		<< " pgs=" << peer_global_seq
+		<< " cs=" << connect_seq
+		<< " l=" << policy.lossy
+		<< ").";
+}
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+# ifdef SO_NOSIGPIPE
+#  define CEPH_USE_SO_NOSIGPIPE
+# else
+#  error "Cannot block SIGPIPE!"
+# endif
+#endif
+
+/// throttled reads are retried after this many microseconds
+#define THROTTLE_RETRY_US 1000
+
+class C_handle_read : public EventCallback {
+  AsyncConnection *conn;
+
+ public:
+  C_handle_read(AsyncConnection *c): conn(c) {}
+  void do_request(int fd) {
+    conn->process();
+  }
+};
+
+class C_handle_write : public EventCallback {
+  AsyncConnection *conn;
+
+ public:
+  C_handle_write(AsyncConnection *c): conn(c) {}
+  void do_request(int fd) {
+    conn->handle_write();
+  }
+};
+
+class C_time_wakeup : public EventCallback {
+  AsyncConnection *conn;
+
+ public:
+  C_time_wakeup(AsyncConnection *c): conn(c) {}
+  void do_request(int id) {
+    conn->wakeup_from(id);
+  }
+};
+
+class C_clean_handler : public EventCallback {
+  AsyncConnection *conn;
+ public:
+  C_clean_handler(AsyncConnection *c): conn(c) {}
+  void do_request(int id) {
+    conn->cleanup_handler();
+  }
+};
+
+static int set_nonblock(int sd)
+{
+  int flags = fcntl(sd, F_GETFL);
+  if (flags < 0 || fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return -errno;
+  return 0;
+}
+
+
+/**************************************
+ * AsyncConnection
+ */
+
+AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m,
+				 EventCenter *c, Connection *con)
+  : async_msgr(m), cct(cct), conn_id(m->dispatch_queue.get_id()),
+    center(c), lock("AsyncConnection::lock"), state(STATE_NONE),
+    connection_state(NULL),
+    sd(-1), port(0), peer_type(-1),
+    conn_throttle(NULL),
+    session_security(NULL),
+    keepalive(false), close_on_empty(false),
+    connect_seq(0), peer_global_seq(0),
+    out_seq(0), in_seq(0), in_seq_acked(0),
+    write_registered(false), cleanup_queued(false),
+    state_offset(0), state_buffer(buffer::create(4096)),
+    global_seq(0), got_bad_auth(false), authorizer(NULL), replaced(false),
+    cur_msg_size(0),
+    conn_throttled_message(false), conn_throttled_bytes(0),
+    throttled_message(false),
+    throttled_bytes(0), throttled_dispatch(0)
+{
+  if (con) {
+    connection_state = con;
+    connection_state->reset_pipe(this);
+  } else {
+    connection_state = new Connection(async_msgr);
+    connection_state->pipe = get();
+  }
+
+  memset(&connect_msg, 0, sizeof(connect_msg));
+  memset(&connect_reply, 0, sizeof(connect_reply));
+  memset(&current_header, 0, sizeof(current_header));
+
+  read_handler.reset(new C_handle_read(this));
+  write_handler.reset(new C_handle_write(this));
+  time_handler.reset(new C_time_wakeup(this));
+  cleanup.reset(new C_clean_handler(this));
+
+  if (randomize_out_seq()) {
+    ldout(cct, 15) << "AsyncConnection(): Could not get random bytes to set seq number for session reset; set seq number to " << out_seq << dendl;
+  }
+}
+
+AsyncConnection::~AsyncConnection()
+{
+  assert(out_q.empty());
+  assert(sent.empty());
+  assert(sd < 0);
+  delete session_security;
+  delete authorizer;
+  if (conn_throttle)
+    conn_throttle->put();
+}
+
+int AsyncConnection::randomize_out_seq()
+{
+  if (connection_state->get_features() & CEPH_FEATURE_MSG_AUTH) {
+    // Set out_seq to a random value, so CRC won't be predictable.
+    int seq_error = get_random_bytes((char *)&out_seq, sizeof(out_seq));
+    out_seq &= SEQ_MASK;
+    ldout(cct, 10) << "randomize_out_seq " << out_seq << dendl;
+    return seq_error;
+  } else {
+    // previously, seq #'s always started at 0.
+    out_seq = 0;
+    return 0;
+  }
+}
+
+void AsyncConnection::set_socket_options()
+{
+  // disable Nagle algorithm?
+  if (cct->_conf->ms_tcp_nodelay) {
+    int flag = 1;
+    int r = ::setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+    if (r < 0) {
+      r = -errno;
+      ldout(cct, 0) << "couldn't set TCP_NODELAY: " << cpp_strerror(r) << dendl;
+    }
+  }
+  if (cct->_conf->ms_tcp_rcvbuf) {
+    int size = cct->_conf->ms_tcp_rcvbuf;
+    int r = ::setsockopt(sd, SOL_SOCKET, SO_RCVBUF, (void*)&size, sizeof(size));
+    if (r < 0)  {
+      r = -errno;
+      ldout(cct, 0) << "couldn't set SO_RCVBUF to " << size << ": " << cpp_strerror(r) << dendl;
+    }
+  }
+
+  // block ESIGPIPE
+#ifdef CEPH_USE_SO_NOSIGPIPE
+  int val = 1;
+  int r = ::setsockopt(sd, SOL_SOCKET, SO_NOSIGPIPE, (void*)&val, sizeof(val));
+  if (r) {
+    r = -errno;
+    ldout(cct, 0) << "couldn't set SO_NOSIGPIPE: " << cpp_strerror(r) << dendl;
+  }
+#endif
+}
+
+void AsyncConnection::register_conn()
+{
+  ldout(cct, 10) << "register_conn" << dendl;
+  assert(async_msgr->lock.is_locked());
+  AsyncConnection *existing = async_msgr->_lookup_conn(peer_addr);
+  assert(existing == NULL);
+  async_msgr->conns[peer_addr] = this;
+}
+
+void AsyncConnection::unregister_conn()
+{
+  assert(async_msgr->lock.is_locked());
+  ceph::unordered_map<entity_addr_t, AsyncConnection*>::iterator p =
+    async_msgr->conns.find(peer_addr);
+  if (p != async_msgr->conns.end() && p->second == this) {
+    ldout(cct, 10) << "unregister_conn" << dendl;
+    async_msgr->conns.erase(p);
+  } else {
+    ldout(cct, 10) << "unregister_conn - not registered" << dendl;
+    async_msgr->accepting_conns.erase(this);  // somewhat overkill, but safe.
+  }
+}
+
+int AsyncConnection::read_bulk(char *buf, int len)
+{
+  if (cct->_conf->ms_inject_socket_failures && sd >= 0) {
+    if (rand() % cct->_conf->ms_inject_socket_failures == 0) {
+      ldout(cct, 0) << "injecting socket failure" << dendl;
+      ::shutdown(sd, SHUT_RDWR);
+    }
+  }
+
+ again:
+  int got = ::recv(sd, buf, len, MSG_DONTWAIT);
+  if (got < 0) {
+    if (errno == EINTR)
+      goto again;
+    if (errno == EAGAIN)
+      return 0;
+    ldout(cct, 10) << "read_bulk socket " << sd << " returned "
+		   << got << " errno " << errno << " " << cpp_strerror(errno) << dendl;
+    return -1;
+  } else if (got == 0) {
+    // the socket was readable but empty: the peer sent a FIN
+    ldout(cct, 10) << "read_bulk peer closed socket " << sd << dendl;
+    return -1;
+  }
+  return got;
+}
+
+int AsyncConnection::read_until(unsigned needed, char *p)
+{
+  if (sd < 0)
+    return -1;
+
+  while (state_offset < needed) {
+    int got = read_bulk(p + state_offset, needed - state_offset);
+    if (got < 0)
+      return -1;
+    if (got == 0)
+      return needed - state_offset;
+    state_offset += got;
+  }
+  state_offset = 0;
+  return 0;
+}
+
+int AsyncConnection::_try_send(bufferlist &send_bl)
+{
+  outcoming_bl.claim_append(send_bl);
+  return _send_pending();
+}
+
+int AsyncConnection::_send_pending()
+{
+  assert(lock.is_locked());
+  if (sd < 0)
+    return -1;
+
+  while (outcoming_bl.length()) {
+    struct msghdr msg;
+    struct iovec msgvec[IOV_MAX];
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = msgvec;
+    uint64_t msglen = 0;
+
+    list<bufferptr>::const_iterator pb = outcoming_bl.buffers().begin();
+    while (pb != outcoming_bl.buffers().end() && msg.msg_iovlen < IOV_MAX) {
+      if (pb->length()) {
+	msgvec[msg.msg_iovlen].iov_base = (void*)pb->c_str();
+	msgvec[msg.msg_iovlen].iov_len = pb->length();
+	msg.msg_iovlen++;
+	msglen += pb->length();
+      }
+      ++pb;
+    }
+
+    int r = ::sendmsg(sd, &msg, MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EINTR)
+	continue;
+      if (errno == EAGAIN)
+	break;
+      ldout(cct, 1) << "_send_pending sendmsg error: " << cpp_strerror(errno) << dendl;
+      return -1;
+    }
+
+    ldout(cct, 30) << "_send_pending sent " << r << " of " << msglen << dendl;
+    outcoming_bl.splice(0, r);
+    if ((uint64_t)r < msglen)
+      break;
+  }
+
+  // only watch for writability while there is something left to write
+  if (outcoming_bl.length() && !write_registered) {
+    center->create_file_event(sd, EVENT_WRITABLE, write_handler);
+    write_registered = true;
+  } else if (!outcoming_bl.length() && write_registered) {
+    center->delete_file_event(sd, EVENT_WRITABLE);
+    write_registered = false;
+  }
+  return outcoming_bl.length();
+}
+
+void AsyncConnection::_schedule(uint64_t us)
+{
+  assert(lock.is_locked());
+  uint64_t id = center->create_time_event(us, time_handler);
+  register_time_events.insert(id);
+}
+
+void AsyncConnection::process()
+{
+  int r = 0;
+  int prev_state;
+  bool need_write = false;
+
+  Mutex::Locker l(lock);
+  do {
+    ldout(cct, 20) << "process prev state is " << get_state_name(state) << dendl;
+    prev_state = state;
+    switch (state) {
+      case STATE_OPEN:
+	{
+	  char tag = -1;
+	  r = read_until(sizeof(tag), state_buffer.c_str());
+	  if (r < 0) {
+	    ldout(cct, 2) << "process couldn't read tag" << dendl;
+	    goto fail;
+	  } else if (r > 0) {
+	    break;
+	  }
+	  tag = state_buffer[0];
+
+	  if (tag == CEPH_MSGR_TAG_KEEPALIVE) {
+	    ldout(cct, 20) << "process got KEEPALIVE" << dendl;
+	    state = STATE_OPEN_KEEPALIVE;
+	  } else if (tag == CEPH_MSGR_TAG_ACK) {
+	    ldout(cct, 20) << "process got ACK" << dendl;
+	    state = STATE_OPEN_TAG_ACK;
+	  } else if (tag == CEPH_MSGR_TAG_MSG) {
+	    ldout(cct, 20) << "process got MSG" << dendl;
+	    recv_stamp = ceph_clock_now(cct);
+	    state = STATE_OPEN_MESSAGE_HEADER;
+	  } else if (tag == CEPH_MSGR_TAG_CLOSE) {
+	    ldout(cct, 20) << "process got CLOSE" << dendl;
+	    state = STATE_OPEN_TAG_CLOSE;
+	  } else {
+	    ldout(cct, 0) << "process bad tag " << (int)tag << dendl;
+	    goto fail;
+	  }
+	  break;
+	}
+
+      case STATE_OPEN_KEEPALIVE:
+	state = STATE_OPEN;
+	break;
+
+      case STATE_OPEN_TAG_ACK:
+	{
+	  ceph_le64 seq;
+	  r = read_until(sizeof(seq), state_buffer.c_str());
+	  if (r < 0) {
+	    ldout(cct, 2) << "process couldn't read ack seq" << dendl;
+	    goto fail;
+	  } else if (r > 0) {
+	    break;
+	  }
+	  memcpy(&seq, state_buffer.c_str(), sizeof(seq));
+	  handle_ack(seq);
+	  if (state == STATE_CLOSED)
+	    return;
+	  state = STATE_OPEN;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_HEADER:
+	{
+	  __u32 header_crc;
+	  ceph_msg_header header;
+	  if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
+	    r = read_until(sizeof(header), state_buffer.c_str());
+	    if (r < 0) {
+	      ldout(cct, 1) << "process read message header failed" << dendl;
+	      goto fail;
+	    } else if (r > 0) {
+	      break;
+	    }
+	    memcpy(&header, state_buffer.c_str(), sizeof(header));
+	    header_crc = ceph_crc32c(0, (unsigned char *)&header, sizeof(header) - sizeof(header.crc));
+	  } else {
+	    ceph_msg_header_old oldheader;
+	    r = read_until(sizeof(oldheader), state_buffer.c_str());
+	    if (r < 0) {
+	      ldout(cct, 1) << "process read message header failed" << dendl;
+	      goto fail;
+	    } else if (r > 0) {
+	      break;
+	    }
+	    memcpy(&oldheader, state_buffer.c_str(), sizeof(oldheader));
+	    // this is fugly
+	    memcpy(&header, &oldheader, sizeof(header));
+	    header.src = oldheader.src.name;
+	    header.reserved = oldheader.reserved;
+	    header.crc = oldheader.crc;
+	    header_crc = ceph_crc32c(0, (unsigned char *)&oldheader, sizeof(oldheader) - sizeof(oldheader.crc));
+	  }
+
+	  ldout(cct, 20) << "process got envelope type=" << header.type
+			 << " src " << entity_name_t(header.src)
+			 << " front=" << header.front_len
+			 << " data=" << header.data_len
+			 << " off " << header.data_off << dendl;
+
+	  // verify header crc
+	  if (header_crc != header.crc) {
+	    ldout(cct, 0) << "process got bad header crc " << header_crc << " != " << header.crc << dendl;
+	    goto fail;
+	  }
+
+	  current_header = header;
+	  cur_msg_size = header.front_len + header.middle_len + header.data_len;
+	  front.clear();
+	  middle.clear();
+	  data.clear();
+	  state = STATE_OPEN_MESSAGE_THROTTLE_MESSAGE;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_THROTTLE_MESSAGE:
+	{
+	  // our own caps first, so that if we are over them we wait
+	  // without holding any of what the policy throttlers share
+	  if (conn_throttle && !conn_throttled_message) {
+	    if (!conn_throttle->messages.get_or_fail()) {
+	      ldout(cct, 10) << "process wants 1 message from connection throttler "
+			     << conn_throttle->messages.get_current() << "/"
+			     << conn_throttle->messages.get_max() << " failed, just wait." << dendl;
+	      center->delete_file_event(sd, EVENT_READABLE);
+	      _schedule(THROTTLE_RETRY_US);
+	      break;
+	    }
+	    conn_throttled_message = true;
+	  }
+	  if (cur_msg_size && conn_throttle && !conn_throttled_bytes) {
+	    if (!conn_throttle->bytes.get_or_fail(cur_msg_size)) {
+	      ldout(cct, 10) << "process wants " << cur_msg_size << " bytes from connection throttler "
+			     << conn_throttle->bytes.get_current() << "/"
+			     << conn_throttle->bytes.get_max() << " failed, just wait." << dendl;
+	      center->delete_file_event(sd, EVENT_READABLE);
+	      _schedule(THROTTLE_RETRY_US);
+	      break;
+	    }
+	    conn_throttled_bytes = cur_msg_size;
+	  }
+
+	  if (policy.throttler_messages) {
+	    ldout(cct, 10) << "process wants " << 1 << " message from policy throttler "
+			   << policy.throttler_messages->get_current() << "/"
+			   << policy.throttler_messages->get_max() << dendl;
+	    if (!policy.throttler_messages->get_or_fail()) {
+	      ldout(cct, 10) << "process wants 1 message from policy throttle "
+			     << policy.throttler_messages->get_current() << "/"
+			     << policy.throttler_messages->get_max() << " failed, just wait." << dendl;
+	      // stop reading until the retry fires, or the loop would spin
+	      center->delete_file_event(sd, EVENT_READABLE);
+	      _schedule(THROTTLE_RETRY_US);
+	      break;
+	    }
+	    throttled_message = true;
+	  }
+	  state = STATE_OPEN_MESSAGE_THROTTLE_BYTES;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_THROTTLE_BYTES:
+	{
+	  if (cur_msg_size && policy.throttler_bytes) {
+	    ldout(cct, 10) << "process wants " << cur_msg_size << " bytes from policy throttler "
+			   << policy.throttler_bytes->get_current() << "/"
+			   << policy.throttler_bytes->get_max() << dendl;
+	    if (!policy.throttler_bytes->get_or_fail(cur_msg_size)) {
+	      ldout(cct, 10) << "process wants " << cur_msg_size << " bytes from policy throttler "
+			     << policy.throttler_bytes->get_current() << "/"
+			     << policy.throttler_bytes->get_max() << " failed, just wait." << dendl;
+	      center->delete_file_event(sd, EVENT_READABLE);
+	      _schedule(THROTTLE_RETRY_US);
+	      break;
+	    }
+	    throttled_bytes = cur_msg_size;
+	  }
+	  state = STATE_OPEN_MESSAGE_THROTTLE_DISPATCH_QUEUE;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_THROTTLE_DISPATCH_QUEUE:
+	{
+	  // throttle total bytes waiting for dispatch.  do this _after_ the
+	  // policy throttle, as this one does not deadlock (unless dispatch
+	  // blocks indefinitely, which it shouldn't).  in contrast, the
+	  // policy throttle carries for the lifetime of the message.
+	  if (cur_msg_size) {
+	    Throttle &t = async_msgr->dispatch_queue.dispatch_throttler;
+	    ldout(cct, 10) << "process wants " << cur_msg_size << " from dispatch throttler "
+			   << t.get_current() << "/" << t.get_max() << dendl;
+	    if (!t.get_or_fail(cur_msg_size)) {
+	      ldout(cct, 10) << "process wants " << cur_msg_size << " from dispatch throttler "
+			     << t.get_current() << "/" << t.get_max() << " failed, just wait." << dendl;
+	      center->delete_file_event(sd, EVENT_READABLE);
+	      _schedule(THROTTLE_RETRY_US);
+	      break;
+	    }
+	    throttled_dispatch = cur_msg_size;
+	  }
+	  throttle_stamp = ceph_clock_now(cct);
+	  state = STATE_OPEN_MESSAGE_READ_FRONT;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_READ_FRONT:
+	{
+	  // read front
+	  unsigned front_len = current_header.front_len;
+	  if (front_len) {
+	    if (!front.length())
+	      front.push_back(buffer::create(front_len));
+	    r = read_until(front_len, front.c_str());
+	    if (r < 0) {
+	      ldout(cct, 1) << "process read message front failed" << dendl;
+	      goto fail;
+	    } else if (r > 0) {
+	      break;
+	    }
+	    ldout(cct, 20) << "process got front " << front.length() << dendl;
+	  }
+	  state = STATE_OPEN_MESSAGE_READ_MIDDLE;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_READ_MIDDLE:
+	{
+	  // read middle
+	  unsigned middle_len = current_header.middle_len;
+	  if (middle_len) {
+	    if (!middle.length())
+	      middle.push_back(buffer::create(middle_len));
+	    r = read_until(middle_len, middle.c_str());
+	    if (r < 0) {
+	      ldout(cct, 1) << "process read message middle failed" << dendl;
+	      goto fail;
+	    } else if (r > 0) {
+	      break;
+	    }
+	    ldout(cct, 20) << "process got middle " << middle.length() << dendl;
+	  }
+	  state = STATE_OPEN_MESSAGE_READ_DATA_PREPARE;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_READ_DATA_PREPARE:
+	{
+	  // read data
+	  unsigned data_len = le32_to_cpu(current_header.data_len);
+	  if (data_len) {
+	    // a compressed body is inflated into new buffers anyway
+	    if (connection_state->has_feature(CEPH_FEATURE_MSG_COMPRESS) &&
+		MessageCompressor::is_compressed(current_header))
+	      data.push_back(buffer::create(data_len));
+	    else
+	      async_msgr->ms_deliver_alloc_rx_buffer(connection_state.get(), current_header, data);
+	    data_blp = data.begin();
+	  }
+	  state = STATE_OPEN_MESSAGE_READ_DATA;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_READ_DATA:
+	{
+	  while (data.length() && !data_blp.end()) {
+	    bufferptr bp = data_blp.get_current_ptr();
+	    r = read_until(bp.length(), bp.c_str());
+	    if (r < 0) {
+	      ldout(cct, 1) << "process read data error" << dendl;
+	      goto fail;
+	    } else if (r > 0) {
+	      break;
+	    }
+	    // a posted rx buffer may have been summed before it was reused
+	    bp.invalidate_crc();
+	    data_blp.advance(bp.length());
+	  }
+	  if (r > 0)
+	    break;
+	  state = STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH;
+	  break;
+	}
+
+      case STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH:
+	{
+	  ceph_msg_footer footer;
+	  ceph_msg_footer_old old_footer;
+	  // footer
+	  if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
+	    r = read_until(sizeof(footer), state_buffer.c_str());
+	    if (r > 0)
+	      break;
+	    memcpy(&footer, state_buffer.c_str(), sizeof(footer));
+	  } else {
+	    r = read_until(sizeof(old_footer), state_buffer.c_str());
+	    if (r > 0)
+	      break;
+	    memcpy(&old_footer, state_buffer.c_str(), sizeof(old_footer));
+	    footer.front_crc = old_footer.front_crc;
+	    footer.middle_crc = old_footer.middle_crc;
+	    footer.data_crc = old_footer.data_crc;
+	    footer.sig = 0;
+	    footer.flags = old_footer.flags;
+	  }
+	  if (r < 0) {
+	    ldout(cct, 1) << "process read footer data error " << dendl;
+	    goto fail;
+	  }
+
+	  int aborted = (footer.flags & CEPH_MSG_FOOTER_COMPLETE) == 0;
+	  ldout(cct, 10) << "aborted = " << aborted << dendl;
+	  if (aborted) {
+	    ldout(cct, 0) << "process got " << front.length() << " + " << middle.length() << " + " << data.length()
+			  << " byte message.. ABORTED" << dendl;
+	    _release_throttles();
+	    state = STATE_OPEN;
+	    break;
+	  }
+
+	  if (connection_state->has_feature(CEPH_FEATURE_MSG_COMPRESS) &&
+	      MessageCompressor::is_compressed(current_header)) {
+	    ldout(cct, 20) << "process got " << data.length() << " byte compressed body" << dendl;
+	    r = async_msgr->compressor.decompress(current_header, front, middle, data);
+	    if (r < 0) {
+	      ldout(cct, 1) << "process failed to decompress message body: "
+			    << cpp_strerror(r) << dendl;
+	      goto fail;
+	    }
+	  }
+
+	  ldout(cct, 20) << "process got " << front.length() << " + " << middle.length()
+			 << " + " << data.length() << " byte message" << dendl;
+	  Message *message = decode_message(cct, current_header, footer, front, middle, data);
+	  if (!message) {
+	    ldout(cct, 1) << "decode message failed " << dendl;
+	    goto fail;
+	  }
+
+	  //
+	  //  Check the signature if one should be present.  A zero return indicates success. PLR
+	  //
+	  if (session_security == NULL) {
+	    ldout(cct, 10) << "No session security set" << dendl;
+	  } else {
+	    if (session_security->check_message_signature(message)) {
+	      ldout(cct, 0) << "Signature check failed" << dendl;
+	      message->put();
+	      goto fail;
+	    }
+	  }
+
+	  // the message now owns the policy throttle reservations
+	  message->set_byte_throttler(policy.throttler_bytes);
+	  message->set_message_throttler(policy.throttler_messages);
+	  message->set_conn_throttle(conn_throttle);
+	  throttled_message = false;
+	  throttled_bytes = 0;
+	  conn_throttled_message = false;
+	  conn_throttled_bytes = 0;
+
+	  // store reservation size in message, so we don't get confused
+	  // by messages entering the dispatch queue through other paths.
+	  message->set_dispatch_throttle_size(throttled_dispatch);
+	  throttled_dispatch = 0;
+
+	  message->set_recv_stamp(recv_stamp);
+	  message->set_throttle_stamp(throttle_stamp);
+	  message->set_recv_complete_stamp(ceph_clock_now(cct));
+
+	  front.clear();
+	  middle.clear();
+	  data.clear();
+	  state = STATE_OPEN;
+
+	  // check received seq#.  if it is old, drop the message.
+	  // note that incoming messages may skip ahead.  this is convenient for the client
+	  // side queueing because messages can't be renumbered, but the (kernel) client will
+	  // occasionally pull a message out of the sent queue to send elsewhere.  in that case
+	  // it doesn't matter if we "got" it or not.
+	  if (message->get_seq() <= in_seq) {
+	    ldout(cct, 0) << "process got old message "
+			  << message->get_seq() << " <= " << in_seq << " " << message << " " << *message
+			  << ", discarding" << dendl;
+	    async_msgr->dispatch_throttle_release(message->get_dispatch_throttle_size());
+	    message->put();
+	    if (connection_state->has_feature(CEPH_FEATURE_RECONNECT_SEQ) &&
+		cct->_conf->ms_die_on_old_message)
+	      assert(0 == "old msgs despite reconnect_seq feature");
+	    break;
+	  }
+
+	  message->set_connection(connection_state.get());
+
+	  // note last received message.
+	  in_seq = message->get_seq();
+	  need_write = true;  // ack it
+
+	  ldout(cct, 10) << "process got message " << message->get_seq()
+			 << " " << message << " " << *message << dendl;
+	  if (async_msgr->dispatch_queue.can_fast_dispatch(message)) {
+	    // the Dispatcher may send on this very connection
+	    lock.Unlock();
+	    async_msgr->dispatch_queue.fast_dispatch(message);
+	    lock.Lock();
+	    // we may have been marked down meanwhile
+	    if (state == STATE_CLOSED) {
+	      ldout(cct, 10) << "process closed during fast dispatch" << dendl;
+	      return;
+	    }
+	  } else {
+	    async_msgr->dispatch_queue.enqueue(message, message->get_priority(), conn_id);
+	  }
+	  break;
+	}
+
+      case STATE_OPEN_TAG_CLOSE:
+	{
+	  ldout(cct, 20) << "process got CLOSE, closing" << dendl;
+	  bufferlist bl;
+	  bl.append((char)CEPH_MSGR_TAG_CLOSE);
+	  // we can ignore r, actually; we don't care if this succeeds.
+	  _try_send(bl);
+	  _stop();
+	  return;
+	}
+
+      case STATE_STANDBY:
+      case STATE_WAIT:
+	ldout(cct, 20) << "process nothing to do in " << get_state_name(state) << dendl;
+	break;
+
+      case STATE_CLOSED:
+	ldout(cct, 20) << "process socket closed" << dendl;
+	return;
+
+      default:
+	{
+	  if (_process_connection() < 0)
+	    goto fail;
+	  break;
+	}
+    }
+  } while (prev_state != state);
+
+  if (state != STATE_CLOSED && (need_write || (is_queued() && state == STATE_OPEN)))
+    center->dispatch_event_external(write_handler);
+  return;
+
+ fail:
+  if (state == STATE_CLOSED)
+    return;
+  if (state >= STATE_ACCEPTING && state <= STATE_ACCEPTING_READY)
+    _fail_accept();
+  else
+    fault();
+}
+
+int AsyncConnection::_process_connection()
+{
+  int r = 0;
+  assert(lock.is_locked());
+
+  switch (state) {
+    case STATE_CONNECTING:
+      {
+	ldout(cct, 10) << "connect " << connect_seq << dendl;
+	if (sd >= 0) {
+	  center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
+	  write_registered = false;
+	  ::close(sd);
+	  sd = -1;
+	}
+	outcoming_bl.clear();
+	state_offset = 0;
+
+	global_seq = async_msgr->get_global_seq();
+	got_bad_auth = false;
+
+	sd = ::socket(peer_addr.get_family(), SOCK_STREAM, 0);
+	if (sd < 0) {
+	  lderr(cct) << "connect couldn't create socket " << cpp_strerror(errno) << dendl;
+	  return -1;
+	}
+	r = set_nonblock(sd);
+	if (r < 0) {
+	  lderr(cct) << "connect couldn't set socket nonblocking " << cpp_strerror(r) << dendl;
+	  return -1;
+	}
+
+	// connect!
+	ldout(cct, 10) << "connecting to " << peer_addr << dendl;
+	r = ::connect(sd, (sockaddr*)&peer_addr.addr, peer_addr.addr_size());
+	if (r < 0 && errno != EINPROGRESS) {
+	  ldout(cct, 2) << "connect error " << peer_addr << ", "
+			<< errno << ": " << cpp_strerror(errno) << dendl;
+	  return -1;
+	}
+
+	set_socket_options();
+
+	// the peer speaks first: wait for its banner
+	center->create_file_event(sd, EVENT_READABLE, read_handler);
+	state = STATE_CONNECTING_WAIT_BANNER;
+	break;
+      }
+
+    case STATE_CONNECTING_WAIT_BANNER:
+      {
+	unsigned banner_len = strlen(CEPH_BANNER);
+	r = read_until(banner_len, state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 2) << "connect couldn't read banner" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+	if (memcmp(state_buffer.c_str(), CEPH_BANNER, banner_len)) {
+	  ldout(cct, 0) << "connect protocol error (bad banner) on peer " << peer_addr << dendl;
+	  return -1;
+	}
+
+	bufferlist bl;
+	bl.append(state_buffer.c_str(), banner_len);
+	r = _try_send(bl);
+	if (r < 0) {
+	  ldout(cct, 2) << "connect couldn't write my banner" << dendl;
+	  return -1;
+	}
+	state = STATE_CONNECTING_WAIT_IDENTIFY_PEER;
+	break;
+      }
+
+    case STATE_CONNECTING_WAIT_IDENTIFY_PEER:
+      {
+	entity_addr_t paddr, peer_addr_for_me;
+	bufferlist myaddrbl;
+
+	r = read_until(sizeof(paddr) * 2, state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 2) << "connect couldn't read peer addrs" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+
+	bufferlist bl;
+	bl.append(state_buffer.c_str(), sizeof(paddr) * 2);
+	bufferlist::iterator p = bl.begin();
+	::decode(paddr, p);
+	::decode(peer_addr_for_me, p);
+	port = peer_addr_for_me.get_port();
+
+	ldout(cct, 20) << "connect read peer addr " << paddr << " on socket " << sd << dendl;
+	if (peer_addr != paddr) {
+	  if (paddr.is_blank_ip() &&
+	      peer_addr.get_port() == paddr.get_port() &&
+	      peer_addr.get_nonce() == paddr.get_nonce()) {
+	    ldout(cct, 0) << "connect claims to be "
+			  << paddr << " not " << peer_addr << " - presumably this is the same node!" << dendl;
+	  } else {
+	    ldout(cct, 0) << "connect claims to be "
+			  << paddr << " not " << peer_addr << " - wrong node!" << dendl;
+	    return -1;
+	  }
+	}
+
+	ldout(cct, 20) << "connect peer addr for me is " << peer_addr_for_me << dendl;
+	// learned_addr takes the messenger lock, which nests outside ours
+	lock.Unlock();
+	async_msgr->learned_addr(peer_addr_for_me);
+	lock.Lock();
+	if (state != STATE_CONNECTING_WAIT_IDENTIFY_PEER) {
+	  ldout(cct, 1) << "connect state changed while learning addr, now "
+			<< get_state_name(state) << dendl;
+	  return state == STATE_CLOSED ? -1 : 0;
+	}
+
+	::encode(async_msgr->get_myaddr(), myaddrbl);
+	r = _try_send(myaddrbl);
+	if (r < 0) {
+	  ldout(cct, 2) << "connect couldn't write my addr" << dendl;
+	  return -1;
+	}
+	ldout(cct, 10) << "connect sent my addr " << async_msgr->get_myaddr() << dendl;
+	state = STATE_CONNECTING_SEND_CONNECT_MSG;
+	break;
+      }
+
+    case STATE_CONNECTING_SEND_CONNECT_MSG:
+      {
+	r = _send_connect_message();
+	if (r < 0)
+	  return -1;
+	break;
+      }
+
+    case STATE_CONNECTING_WAIT_CONNECT_REPLY:
+      {
+	r = read_until(sizeof(connect_reply), state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 1) << "connect read reply failed" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+	memcpy(&connect_reply, state_buffer.c_str(), sizeof(connect_reply));
+	// sanitize features
+	connect_reply.features = ceph_sanitize_features(connect_reply.features);
+
+	ldout(cct, 20) << "connect got reply tag " << (int)connect_reply.tag
+		       << " connect_seq " << connect_reply.connect_seq
+		       << " global_seq " << connect_reply.global_seq
+		       << " proto " << connect_reply.protocol_version
+		       << " flags " << (int)connect_reply.flags
+		       << " features " << connect_reply.features << dendl;
+
+	authorizer_reply.clear();
+	if (connect_reply.authorizer_len) {
+	  ldout(cct, 10) << "reply.authorizer_len=" << connect_reply.authorizer_len << dendl;
+	  authorizer_buf.clear();
+	  authorizer_buf.push_back(buffer::create(connect_reply.authorizer_len));
+	  state = STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH;
+	  break;
+	}
+
+	return handle_connect_reply(connect_msg, connect_reply);
+      }
+
+    case STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH:
+      {
+	r = read_until(connect_reply.authorizer_len, authorizer_buf.c_str());
+	if (r < 0) {
+	  ldout(cct, 10) << "connect couldn't read connect authorizer_reply" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+	authorizer_reply.claim(authorizer_buf);
+	return handle_connect_reply(connect_msg, connect_reply);
+      }
+
+    case STATE_CONNECTING_WAIT_ACK_SEQ:
+      {
+	uint64_t newly_acked_seq = 0;
+	r = read_until(sizeof(newly_acked_seq), state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 2) << "connect read error on newly_acked_seq" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+	memcpy(&newly_acked_seq, state_buffer.c_str(), sizeof(newly_acked_seq));
+	ldout(cct, 2) << " got newly_acked_seq " << newly_acked_seq
+		      << " vs out_seq " << out_seq << dendl;
+	while (newly_acked_seq > out_seq) {
+	  Message *m = _get_next_outgoing();
+	  assert(m);
+	  ldout(cct, 2) << " discarding previously sent " << m->get_seq()
+			<< " " << *m << dendl;
+	  assert(m->get_seq() <= newly_acked_seq);
+	  m->put();
+	  ++out_seq;
+	}
+
+	bufferlist bl;
+	bl.append((char*)&in_seq, sizeof(in_seq));
+	r = _try_send(bl);
+	if (r < 0) {
+	  ldout(cct, 2) << "connect write error on in_seq" << dendl;
+	  return -1;
+	}
+	state = STATE_CONNECTING_READY;
+	break;
+      }
+
+    case STATE_CONNECTING_READY:
+      {
+	// hooray!
+	peer_global_seq = connect_reply.global_seq;
+	policy.lossy = connect_reply.flags & CEPH_MSG_CONNECT_LOSSY;
+	connect_seq++;
+	assert(connect_seq == connect_reply.connect_seq);
+	backoff = utime_t();
+	connection_state->set_features((uint64_t)connect_reply.features & (uint64_t)connect_msg.features);
+	ldout(cct, 10) << "connect success " << connect_seq << ", lossy = " << policy.lossy
+		       << ", features " << connection_state->get_features() << dendl;
+
+	// If we have an authorizer, get a new AuthSessionHandler to deal with ongoing security of the
+	// connection.  PLR
+	delete session_security;
+	if (authorizer != NULL) {
+	  session_security = get_auth_session_handler(cct, authorizer->protocol, authorizer->session_key,
+						      connection_state->get_features());
+	} else {
+	  // We have no authorizer, so we shouldn't be applying security to messages in this connection.  PLR
+	  session_security = NULL;
+	}
+	delete authorizer;
+	authorizer = NULL;
+
+	async_msgr->dispatch_queue.queue_connect(connection_state.get());
+	state = STATE_OPEN;
+	if (is_queued())
+	  center->dispatch_event_external(write_handler);
+	break;
+      }
+
+    case STATE_ACCEPTING:
+      {
+	bufferlist bl;
+	entity_addr_t socket_addr;
+	socklen_t len;
+
+	set_socket_options();
+
+	// announce myself, my addr, and the peer's socket addr (they might
+	// not know their ip)
+	bl.append(CEPH_BANNER, strlen(CEPH_BANNER));
+	::encode(async_msgr->get_myaddr(), bl);
+	port = async_msgr->get_myaddr().get_port();
+
+	len = sizeof(socket_addr.ss_addr());
+	r = ::getpeername(sd, (sockaddr*)&socket_addr.ss_addr(), &len);
+	if (r < 0) {
+	  ldout(cct, 0) << "accept failed to getpeername " << cpp_strerror(errno) << dendl;
+	  return -1;
+	}
+	::encode(socket_addr, bl);
+	ldout(cct, 1) << "accept sd=" << sd << " " << socket_addr << dendl;
+
+	r = _try_send(bl);
+	if (r < 0) {
+	  ldout(cct, 10) << "accept couldn't write banner and addrs" << dendl;
+	  return -1;
+	}
+	state = STATE_ACCEPTING_WAIT_BANNER_ADDR;
+	break;
+      }
+
+    case STATE_ACCEPTING_WAIT_BANNER_ADDR:
+      {
+	entity_addr_t socket_addr;
+	unsigned banner_len = strlen(CEPH_BANNER);
+	r = read_until(banner_len + sizeof(peer_addr), state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 10) << "accept couldn't read banner and peer_addr" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+
+	if (memcmp(state_buffer.c_str(), CEPH_BANNER, banner_len)) {
+	  ldout(cct, 1) << "accept peer sent bad banner '" << string(state_buffer.c_str(), banner_len)
+			<< "' (should be '" << CEPH_BANNER << "')" << dendl;
+	  return -1;
+	}
+
+	bufferlist addr_bl;
+	addr_bl.append(state_buffer.c_str() + banner_len, sizeof(peer_addr));
+	{
+	  bufferlist::iterator ti = addr_bl.begin();
+	  ::decode(peer_addr, ti);
+	}
+
+	ldout(cct, 10) << "accept peer addr is " << peer_addr << dendl;
+	if (peer_addr.is_blank_ip()) {
+	  // peer apparently doesn't know what ip they have; figure it out for them.
+	  socklen_t len = sizeof(socket_addr.ss_addr());
+	  r = ::getpeername(sd, (sockaddr*)&socket_addr.ss_addr(), &len);
+	  if (r < 0) {
+	    ldout(cct, 0) << "accept failed to getpeername " << cpp_strerror(errno) << dendl;
+	    return -1;
+	  }
+	  int port = peer_addr.get_port();
+	  peer_addr.addr = socket_addr.addr;
+	  peer_addr.set_port(port);
+	  ldout(cct, 0) << "accept peer addr is really " << peer_addr
+			<< " (socket is " << socket_addr << ")" << dendl;
+	}
+	set_peer_addr(peer_addr);  // so that connection_state gets set up
+	state = STATE_ACCEPTING_WAIT_CONNECT_MSG;
+	break;
+      }
+
+    case STATE_ACCEPTING_WAIT_CONNECT_MSG:
+      {
+	r = read_until(sizeof(connect_msg), state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 10) << "accept couldn't read connect" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+	memcpy(&connect_msg, state_buffer.c_str(), sizeof(connect_msg));
+	// sanitize features
+	connect_msg.features = ceph_sanitize_features(connect_msg.features);
+
+	ldout(cct, 20) << "accept got peer connect_seq " << connect_msg.connect_seq
+		       << " global_seq " << connect_msg.global_seq << dendl;
+
+	authorizer_buf.clear();
+	if (connect_msg.authorizer_len)
+	  authorizer_buf.push_back(buffer::create(connect_msg.authorizer_len));
+	authorizer_reply.clear();
+	state = STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH;
+	break;
+      }
+
+    case STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH:
+      {
+	if (connect_msg.authorizer_len) {
+	  r = read_until(connect_msg.authorizer_len, authorizer_buf.c_str());
+	  if (r < 0) {
+	    ldout(cct, 10) << "accept couldn't read connect authorizer" << dendl;
+	    return -1;
+	  } else if (r > 0) {
+	    break;
+	  }
+	}
+
+	bufferlist authorizer_bl;
+	authorizer_bl.claim(authorizer_buf);
+	return handle_connect_msg(connect_msg, authorizer_bl, authorizer_reply);
+      }
+
+    case STATE_ACCEPTING_WAIT_SEQ:
+      {
+	uint64_t newly_acked_seq;
+	r = read_until(sizeof(newly_acked_seq), state_buffer.c_str());
+	if (r < 0) {
+	  ldout(cct, 2) << "accept read error on newly_acked_seq" << dendl;
+	  return -1;
+	} else if (r > 0) {
+	  break;
+	}
+	memcpy(&newly_acked_seq, state_buffer.c_str(), sizeof(newly_acked_seq));
+	discard_requeued_up_to(newly_acked_seq);
+	state = STATE_ACCEPTING_READY;
+	break;
+      }
+
+    case STATE_ACCEPTING_READY:
+      {
+	ldout(cct, 20) << "accept done" << dendl;
+	state = STATE_OPEN;
+	if (is_queued())
+	  center->dispatch_event_external(write_handler);
+	break;
+      }
+
+    default:
+      {
+	lderr(cct) << "bad state " << get_state_name(state) << dendl;
+	assert(0);
+      }
+  }
+
+  return 0;
+}
+
+int AsyncConnection::_send_connect_message()
+{
+  assert(lock.is_locked());
+  // the authorizer comes from the dispatchers, which may block; don't
+  // do that under our lock
+  lock.Unlock();
+  AuthAuthorizer *a = async_msgr->get_authorizer(peer_type, got_bad_auth);
+  lock.Lock();
+  if (state != STATE_CONNECTING_SEND_CONNECT_MSG) {
+    ldout(cct, 1) << "_send_connect_message state changed while getting authorizer, now "
+		  << get_state_name(state) << dendl;
+    delete a;
+    return state == STATE_CLOSED ? -1 : 0;
+  }
+  delete authorizer;
+  authorizer = a;
+
+  ceph_msg_connect &connect = connect_msg;
+  memset(&connect, 0, sizeof(connect));
+  connect.features = policy.features_supported;
+  connect.host_type = async_msgr->get_my_type();
+  connect.global_seq = global_seq;
+  connect.connect_seq = connect_seq;
+  connect.protocol_version = async_msgr->get_proto_version(peer_type, true);
+  connect.authorizer_protocol = authorizer ? authorizer->protocol : 0;
+  connect.authorizer_len = authorizer ? authorizer->bl.length() : 0;
+  if (authorizer)
+    ldout(cct, 10) << "connect.authorizer_len=" << connect.authorizer_len
+		   << " protocol=" << connect.authorizer_protocol << dendl;
+  connect.flags = 0;
+  if (policy.lossy)
+    connect.flags |= CEPH_MSG_CONNECT_LOSSY;  // this is fyi, actually, server decides!
+
+  bufferlist bl;
+  bl.append((char*)&connect, sizeof(connect));
+  if (authorizer)
+    bl.append(authorizer->bl.c_str(), authorizer->bl.length());
+
+  ldout(cct, 10) << "connect sending gseq=" << global_seq << " cseq=" << connect_seq
+		 << " proto=" << connect.protocol_version << dendl;
+  int r = _try_send(bl);
+  if (r < 0) {
+    ldout(cct, 2) << "connect couldn't send connect message" << dendl;
+    return -1;
+  }
+  ldout(cct, 20) << "connect wrote (self +) cseq, waiting for reply" << dendl;
+  state = STATE_CONNECTING_WAIT_CONNECT_REPLY;
+  return 0;
+}
+
+int AsyncConnection::handle_connect_reply(ceph_msg_connect &connect, ceph_msg_connect_reply &reply)
+{
+  assert(lock.is_locked());
+  if (authorizer) {
+    bufferlist::iterator iter = authorizer_reply.begin();
+    if (!authorizer->verify_reply(iter)) {
+      ldout(cct, 0) << "failed verifying authorize reply" << dendl;
+      return -1;
+    }
+  }
+
+  if (reply.tag == CEPH_MSGR_TAG_FEATURES) {
+    ldout(cct, 0) << "connect protocol feature mismatch, my " << std::hex
+		  << connect.features << " < peer " << reply.features
+		  << " missing " << (reply.features & ~policy.features_supported)
+		  << std::dec << dendl;
+    return -1;
+  }
+
+  if (reply.tag == CEPH_MSGR_TAG_BADPROTOVER) {
+    ldout(cct, 0) << "connect protocol version mismatch, my " << connect.protocol_version
+		  << " != " << reply.protocol_version << dendl;
+    return -1;
+  }
+
+  if (reply.tag == CEPH_MSGR_TAG_BADAUTHORIZER) {
+    ldout(cct, 0) << "connect got BADAUTHORIZER" << dendl;
+    if (got_bad_auth)
+      return -1;
+    got_bad_auth = true;  // try harder with a fresh authorizer
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+  }
+  if (reply.tag == CEPH_MSGR_TAG_RESETSESSION) {
+    ldout(cct, 0) << "connect got RESETSESSION" << dendl;
+    was_session_reset();
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+  }
+  if (reply.tag == CEPH_MSGR_TAG_RETRY_GLOBAL) {
+    global_seq = async_msgr->get_global_seq(reply.global_seq);
+    ldout(cct, 10) << "connect got RETRY_GLOBAL " << reply.global_seq
+		   << " chose new " << global_seq << dendl;
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+  }
+  if (reply.tag == CEPH_MSGR_TAG_RETRY_SESSION) {
+    assert(reply.connect_seq > connect_seq);
+    ldout(cct, 10) << "connect got RETRY_SESSION " << connect_seq
+		   << " -> " << reply.connect_seq << dendl;
+    connect_seq = reply.connect_seq;
+    state = STATE_CONNECTING_SEND_CONNECT_MSG;
+    return 0;
+  }
+
+  if (reply.tag == CEPH_MSGR_TAG_WAIT) {
+    ldout(cct, 3) << "connect got WAIT (connection race)" << dendl;
+    // the peer's incoming connection will replace us
+    if (sd >= 0) {
+      center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
+      write_registered = false;
+      ::close(sd);
+      sd = -1;
+    }
+    outcoming_bl.clear();
+    state = STATE_WAIT;
+    return 0;
+  }
+
+  if (reply.tag == CEPH_MSGR_TAG_READY ||
+      reply.tag == CEPH_MSGR_TAG_SEQ) {
+    uint64_t feat_missing = policy.features_required & ~(uint64_t)reply.features;
+    if (feat_missing) {
+      ldout(cct, 1) << "missing required features " << std::hex << feat_missing << std::dec << dendl;
+      return -1;
+    }
+
+    if (reply.tag == CEPH_MSGR_TAG_SEQ) {
+      ldout(cct, 10) << "got CEPH_MSGR_TAG_SEQ, reading acked_seq and writing in_seq" << dendl;
+      state = STATE_CONNECTING_WAIT_ACK_SEQ;
+    } else {
+      state = STATE_CONNECTING_READY;
+    }
+    return 0;
+  }
+
+  // protocol error
+  ldout(cct, 0) << "connect got bad tag " << (int)reply.tag << dendl;
+  return -1;
+}
+
+int AsyncConnection::_reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
+				   bufferlist &authorizer_reply)
+{
+  assert(lock.is_locked());
+  bufferlist reply_bl;
+  reply.tag = tag;
+  reply.features = ((uint64_t)connect.features & policy.features_supported) | policy.features_required;
+  reply.authorizer_len = authorizer_reply.length();
+  reply_bl.append((char*)&reply, sizeof(reply));
+  if (reply.authorizer_len)
+    reply_bl.append(authorizer_reply.c_str(), authorizer_reply.length());
+  int r = _try_send(reply_bl);
+  if (r < 0)
+    return -1;
+  state = STATE_ACCEPTING_WAIT_CONNECT_MSG;
+  return 0;
+}
+
+int AsyncConnection::handle_connect_msg(ceph_msg_connect &connect, bufferlist &authorizer_bl,
+					bufferlist &authorizer_reply)
+{
+  int r;
+  ceph_msg_connect_reply reply;
+  bufferlist reply_bl;
+  uint64_t existing_seq = -1;
+  char reply_tag = 0;
+  uint64_t feat_missing;
+  bool authorizer_valid;
+  CryptoKey session_key;
+  AsyncConnection *existing;
+  int removed;
+
+  assert(lock.is_locked());
+  assert(state == STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH);
+
+  memset(&reply, 0, sizeof(reply));
+
+  // note peer's type, flags
+  set_peer_type(connect.host_type);
+  policy = async_msgr->get_policy(connect.host_type);
+  if (!conn_throttle)
+    conn_throttle = policy.new_conn_throttle(cct, peer_type, peer_addr);
+  ldout(cct, 10) << "accept of host_type " << connect.host_type
+		 << ", policy.lossy=" << policy.lossy
+		 << " policy.server=" << policy.server
+		 << " policy.standby=" << policy.standby
+		 << " policy.resetcheck=" << policy.resetcheck
+		 << dendl;
+
+  reply.protocol_version = async_msgr->get_proto_version(peer_type, false);
+
+  // mismatch?
+  ldout(cct, 10) << "accept my proto " << reply.protocol_version
+		 << ", their proto " << connect.protocol_version << dendl;
+  if (connect.protocol_version != reply.protocol_version)
+    return _reply_accept(CEPH_MSGR_TAG_BADPROTOVER, connect, reply, authorizer_reply);
+
+  // require signatures for cephx?
+  if (connect.authorizer_protocol == CEPH_AUTH_CEPHX) {
+    if (peer_type == CEPH_ENTITY_TYPE_OSD ||
+	peer_type == CEPH_ENTITY_TYPE_MDS) {
+      if (cct->_conf->cephx_require_signatures ||
+	  cct->_conf->cephx_cluster_require_signatures) {
+	ldout(cct, 10) << "using cephx, requiring MSG_AUTH feature bit for cluster" << dendl;
+	policy.features_required |= CEPH_FEATURE_MSG_AUTH;
+      }
+    } else {
+      if (cct->_conf->cephx_require_signatures ||
+	  cct->_conf->cephx_service_require_signatures) {
+	ldout(cct, 10) << "using cephx, requiring MSG_AUTH feature bit for service" << dendl;
+	policy.features_required |= CEPH_FEATURE_MSG_AUTH;
+      }
+    }
+  }
+
+  feat_missing = policy.features_required & ~(uint64_t)connect.features;
+  if (feat_missing) {
+    ldout(cct, 1) << "peer missing required features " << std::hex << feat_missing << std::dec << dendl;
+    return _reply_accept(CEPH_MSGR_TAG_FEATURES, connect, reply, authorizer_reply);
+  }
+
+  // Check the authorizer.  If not good, bail out.
+  lock.Unlock();
+  bool valid = async_msgr->verify_authorizer(connection_state.get(), peer_type, connect.authorizer_protocol,
+					     authorizer_bl, authorizer_reply, authorizer_valid, session_key);
+  if (!valid || !authorizer_valid) {
+    ldout(cct, 0) << "accept: got bad authorizer" << dendl;
+    lock.Lock();
+    if (state != STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH)
+      return -1;
+    delete session_security;
+    session_security = NULL;
+    return _reply_accept(CEPH_MSGR_TAG_BADAUTHORIZER, connect, reply, authorizer_reply);
+  }
+
+  ldout(cct, 10) << "accept:  setting up session_security." << dendl;
+
+  async_msgr->lock.Lock();
+  lock.Lock();
+  if (async_msgr->dispatch_queue.stop)
+    goto shutting_down;
+  if (state != STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH)
+    goto shutting_down;
+
+  // existing?
+  existing = async_msgr->_lookup_conn(peer_addr);
+  if (existing) {
+    existing->lock.Lock(true);  // skip lockdep check (we are locking a second connection here)
+
+    if (connect.global_seq < existing->peer_global_seq) {
+      ldout(cct, 10) << "accept existing " << existing << ".gseq " << existing->peer_global_seq
+		     << " > " << connect.global_seq << ", RETRY_GLOBAL" << dendl;
+      reply.global_seq = existing->peer_global_seq;  // so we can send it below..
+      existing->lock.Unlock();
+      async_msgr->lock.Unlock();
+      return _reply_accept(CEPH_MSGR_TAG_RETRY_GLOBAL, connect, reply, authorizer_reply);
+    } else {
+      ldout(cct, 10) << "accept existing " << existing << ".gseq " << existing->peer_global_seq
+		     << " <= " << connect.global_seq << ", looks ok" << dendl;
+    }
+
+    if (existing->policy.lossy) {
+      ldout(cct, 0) << "accept replacing existing (lossy) channel (new one lossy="
+		    << policy.lossy << ")" << dendl;
+      existing->was_session_reset();
+      goto replace;
+    }
+
+    ldout(cct, 0) << "accept connect_seq " << connect.connect_seq
+		  << " vs existing " << existing->connect_seq
+		  << " state " << get_state_name(existing->state) << dendl;
+
+    if (connect.connect_seq == 0 && existing->connect_seq > 0) {
+      ldout(cct, 0) << "accept peer reset, then tried to connect to us, replacing" << dendl;
+      if (policy.resetcheck)
+	existing->was_session_reset(); // this resets out_queue, msg_ and connect_seq #'s
+      goto replace;
+    }
+
+    if (connect.connect_seq < existing->connect_seq) {
+      // old attempt, or we sent READY but they didn't get it.
+      ldout(cct, 10) << "accept existing " << existing << ".cseq " << existing->connect_seq
+		     << " > " << connect.connect_seq << ", RETRY_SESSION" << dendl;
+      goto retry_session;
+    }
+
+    if (connect.connect_seq == existing->connect_seq) {
+      // if the existing connection successfully opened, and/or
+      // subsequently went to standby, then the peer should bump
+      // their connect_seq and retry: this is not a connection race
+      // we need to resolve here.
+      if (is_open_state(existing->state) ||
+	  existing->state == STATE_STANDBY) {
+	ldout(cct, 10) << "accept connection race, existing " << existing
+		       << ".cseq " << existing->connect_seq
+		       << " == " << connect.connect_seq
+		       << ", OPEN|STANDBY, RETRY_SESSION" << dendl;
+	goto retry_session;
+      }
+
+      // connection race?
+      if (peer_addr < async_msgr->get_myaddr() ||
+	  existing->policy.server) {
+	// incoming wins
+	ldout(cct, 10) << "accept connection race, existing " << existing << ".cseq " << existing->connect_seq
+		       << " == " << connect.connect_seq << ", or we are server, replacing my attempt" << dendl;
+	if (!(is_connecting_state(existing->state) ||
+	      existing->state == STATE_WAIT))
+	  lderr(cct) << "accept race bad state, would replace, existing="
+		     << get_state_name(existing->state)
+		     << " " << existing << ".cseq=" << existing->connect_seq
+		     << " == " << connect.connect_seq
+		     << dendl;
+	assert(is_connecting_state(existing->state) ||
+	       existing->state == STATE_WAIT);
+	goto replace;
+      } else {
+	// our existing outgoing wins
+	ldout(cct, 10) << "accept connection race, existing " << existing << ".cseq " << existing->connect_seq
+		       << " == " << connect.connect_seq << ", sending WAIT" << dendl;
+	assert(peer_addr > async_msgr->get_myaddr());
+	if (!is_connecting_state(existing->state))
+	  lderr(cct) << "accept race bad state, would send wait, existing="
+		     << get_state_name(existing->state)
+		     << " " << existing << ".cseq=" << existing->connect_seq
+		     << " == " << connect.connect_seq
+		     << dendl;
+	assert(is_connecting_state(existing->state));
+	// make sure our outgoing connection will follow through
+	existing->_send_keepalive();
+	existing->lock.Unlock();
+	async_msgr->lock.Unlock();
+	return _reply_accept(CEPH_MSGR_TAG_WAIT, connect, reply, authorizer_reply);
+      }
+    }
+
+    assert(connect.connect_seq > existing->connect_seq);
+    assert(connect.global_seq >= existing->peer_global_seq);
+    if (policy.resetcheck &&   // RESETSESSION only used by servers; peers do not reset each other
+	existing->connect_seq == 0) {
+      ldout(cct, 0) << "accept we reset (peer sent cseq " << connect.connect_seq
+		    << ", " << existing << ".cseq = " << existing->connect_seq
+		    << "), sending RESETSESSION" << dendl;
+      existing->lock.Unlock();
+      async_msgr->lock.Unlock();
+      return _reply_accept(CEPH_MSGR_TAG_RESETSESSION, connect, reply, authorizer_reply);
+    }
+
+    // reconnect
+    ldout(cct, 10) << "accept peer sent cseq " << connect.connect_seq
+		   << " > " << existing->connect_seq << dendl;
+    goto replace;
+  } // existing
+  else if (policy.resetcheck && connect.connect_seq > 0) {
+    // we reset, and they are opening a new session
+    ldout(cct, 0) << "accept we reset (peer sent cseq " << connect.connect_seq << "), sending RESETSESSION" << dendl;
+    async_msgr->lock.Unlock();
+    return _reply_accept(CEPH_MSGR_TAG_RESETSESSION, connect, reply, authorizer_reply);
+  } else {
+    // new session
+    ldout(cct, 10) << "accept new session" << dendl;
+    existing = NULL;
+    goto open;
+  }
+  assert(0);
+
+ retry_session:
+  assert(existing->lock.is_locked());
+  assert(lock.is_locked());
+  reply.connect_seq = existing->connect_seq + 1;
+  existing->lock.Unlock();
+  async_msgr->lock.Unlock();
+  return _reply_accept(CEPH_MSGR_TAG_RETRY_SESSION, connect, reply, authorizer_reply);
+
+ replace:
+  assert(existing->lock.is_locked());
+  assert(lock.is_locked());
+  if (connect.features & CEPH_FEATURE_RECONNECT_SEQ) {
+    reply_tag = CEPH_MSGR_TAG_SEQ;
+    existing_seq = existing->in_seq;
+  }
+  ldout(cct, 10) << "accept replacing " << existing << dendl;
+  existing->_stop();
+  existing->unregister_conn();
+  replaced = true;
+
+  if (existing->policy.lossy) {
+    // disconnect from the Connection
+    assert(existing->connection_state);
+    if (existing->connection_state->clear_pipe(existing))
+      async_msgr->dispatch_queue.queue_reset(existing->connection_state.get());
+  } else {
+    // queue a reset on the old connection
+    async_msgr->dispatch_queue.queue_reset(connection_state.get());
+
+    // drop my Connection, and take a ref to the existing one. do not
+    // clear existing->connection_state, since it is still dereferenced
+    // when the existing connection is torn down.
+    connection_state = existing->connection_state;
+
+    // make existing Connection reference us
+    connection_state->reset_pipe(this);
+
+    // steal incoming queue
+    uint64_t replaced_conn_id = conn_id;
+    conn_id = existing->conn_id;
+    existing->conn_id = replaced_conn_id;
+    in_seq = existing->in_seq;
+    in_seq_acked = in_seq;
+
+    // steal outgoing queue and out_seq
+    existing->requeue_sent();
+    out_seq = existing->out_seq;
+    ldout(cct, 10) << "accept re-queuing on out_seq " << out_seq << " in_seq " << in_seq << dendl;
+    for (map<int, list<Message*> >::iterator p = existing->out_q.begin();
+	 p != existing->out_q.end();
+	 ++p)
+      out_q[p->first].splice(out_q[p->first].begin(), p->second);
+    existing->out_q.clear();
+  }
+  existing->lock.Unlock();
+
+ open:
+  connect_seq = connect.connect_seq + 1;
+  peer_global_seq = connect.global_seq;
+  ldout(cct, 10) << "accept success, connect_seq = " << connect_seq << ", sending READY" << dendl;
+
+  // send READY reply
+  reply.tag = (reply_tag ? reply_tag : CEPH_MSGR_TAG_READY);
+  reply.features = policy.features_supported;
+  reply.global_seq = async_msgr->get_global_seq();
+  reply.connect_seq = connect_seq;
+  reply.flags = 0;
+  reply.authorizer_len = authorizer_reply.length();
+  if (policy.lossy)
+    reply.flags = reply.flags | CEPH_MSG_CONNECT_LOSSY;
+
+  connection_state->set_features((uint64_t)reply.features & (uint64_t)connect.features);
+  ldout(cct, 10) << "accept features " << connection_state->get_features() << dendl;
+
+  delete session_security;
+  session_security = get_auth_session_handler(cct, connect.authorizer_protocol, session_key,
+					      connection_state->get_features());
+
+  // notify
+  async_msgr->dispatch_queue.queue_accept(connection_state.get());
+
+  // ok!
+  if (async_msgr->dispatch_queue.stop)
+    goto shutting_down;
+  removed = async_msgr->accepting_conns.erase(this);
+  assert(removed == 1);
+  register_conn();
+  async_msgr->lock.Unlock();
+
+  reply_bl.append((char*)&reply, sizeof(reply));
+  if (reply.authorizer_len)
+    reply_bl.append(authorizer_reply.c_str(), authorizer_reply.length());
+  if (reply_tag == CEPH_MSGR_TAG_SEQ)
+    reply_bl.append((char*)&existing_seq, sizeof(existing_seq));
+
+  // peers only send messages once they have seen our reply, so the
+  // acked seq (if any) is the next thing to arrive
+  state = reply_tag == CEPH_MSGR_TAG_SEQ ? STATE_ACCEPTING_WAIT_SEQ : STATE_ACCEPTING_READY;
+  r = _try_send(reply_bl);
+  if (r < 0)
+    return -1;
+  return 0;
+
+ shutting_down:
+  async_msgr->lock.Unlock();
+  ldout(cct, 1) << "accept shutting down" << dendl;
+  _stop();
+  return -1;
+}
+
+int AsyncConnection::_fail_accept()
+{
+  assert(lock.is_locked());
+  ldout(cct, 10) << "accept fault" << dendl;
+  if (state == STATE_CLOSED)
+    return -1;
+
+  bool queued = is_queued();
+  ldout(cct, 10) << "  queued = " << (int)queued << dendl;
+  if (queued) {
+    state = policy.server ? STATE_STANDBY : STATE_CONNECTING;
+  } else if (replaced) {
+    state = STATE_STANDBY;
+  } else {
+    _stop();
+    return -1;
+  }
+  fault();
+  return -1;
+}
+
+void AsyncConnection::connect(const entity_addr_t& addr, int type)
+{
+  Mutex::Locker l(lock);
+  set_peer_type(type);
+  set_peer_addr(addr);
+  policy = async_msgr->get_policy(type);
+  state = STATE_CONNECTING;
+  center->dispatch_event_external(read_handler);
+}
+
+void AsyncConnection::accept(int incoming)
+{
+  Mutex::Locker l(lock);
+  assert(sd < 0);
+  sd = incoming;
+  int r = set_nonblock(sd);
+  if (r < 0)
+    ldout(cct, 0) << "accept couldn't set socket nonblocking " << cpp_strerror(r) << dendl;
+  state = STATE_ACCEPTING;
+  center->create_file_event(sd, EVENT_READABLE, read_handler);
+  center->dispatch_event_external(read_handler);
+}
+
+void AsyncConnection::_send(Message *m)
+{
+  assert(lock.is_locked());
+  out_q[m->get_priority()].push_back(m);
+  if (is_open_state(state) || state == STATE_STANDBY)
+    center->dispatch_event_external(write_handler);
+}
+
+void AsyncConnection::_send_keepalive()
+{
+  assert(lock.is_locked());
+  keepalive = true;
+  if (is_open_state(state) || state == STATE_STANDBY)
+    center->dispatch_event_external(write_handler);
+}
+
+void AsyncConnection::_write_message(Message *m)
+{
+  assert(lock.is_locked());
+  m->set_seq(++out_seq);
+  if (!policy.lossy || close_on_empty) {
+    // put on sent list
+    sent.push_back(m);
+    m->get();
+  }
+
+  // associate message with Connection (for benefit of encode_payload)
+  m->set_connection(connection_state.get());
+
+  uint64_t features = connection_state->get_features();
+  if (m->empty_payload())
+    ldout(cct, 20) << "write_message encoding " << m->get_seq() << " features " << features
+		   << " " << m << " " << *m << dendl;
+  else
+    ldout(cct, 20) << "write_message half-reencoding " << m->get_seq() << " features " << features
+		   << " " << m << " " << *m << dendl;
+
+  // encode and copy out of *m
+  m->encode(features, !cct->_conf->ms_nocrc);
+
+  // prepare everything
+  ceph_msg_header& header = m->get_header();
+  ceph_msg_footer& footer = m->get_footer();
+
+  // Now that we have all the crcs calculated, handle the
+  // digital signature for the message, if the connection has session
+  // security set up.  Some session security options do not
+  // actually calculate and check the signature, but they should
+  // handle the calls to sign_message and check_signature.  PLR
+  if (session_security == NULL) {
+    ldout(cct, 20) << "write_message no session security" << dendl;
+  } else {
+    if (session_security->sign_message(m)) {
+      ldout(cct, 20) << "write_message failed to sign seq # " << header.seq
+		     << "): sig = " << footer.sig << dendl;
+    } else {
+      ldout(cct, 20) << "write_message signed seq # " << header.seq
+		     << "): sig = " << footer.sig << dendl;
+    }
+  }
+
+  // the body may go out compressed, under its own wire header
+  ceph_msg_header wire_header = header;
+  bufferlist body;
+  if (!async_msgr->compressor.compress(connection_state.get(), m, wire_header, body)) {
+    // payload (front+middle+data), referenced rather than copied
+    body.append(m->get_payload());
+    body.append(m->get_middle());
+    body.append(m->get_data());
+  }
+
+  bufferlist bl;
+  bl.append((char)CEPH_MSGR_TAG_MSG);
+
+  // send envelope
+  if (connection_state->has_feature(CEPH_FEATURE_NOSRCADDR)) {
+    bl.append((char*)&wire_header, sizeof(wire_header));
+  } else {
+    ceph_msg_header_old oldheader;
+    memcpy(&oldheader, &wire_header, sizeof(wire_header));
+    oldheader.src.name = wire_header.src;
+    oldheader.src.addr = connection_state->get_peer_addr();
+    oldheader.orig_src = oldheader.src;
+    oldheader.reserved = wire_header.reserved;
+    oldheader.crc = ceph_crc32c(0, (unsigned char*)&oldheader,
+				sizeof(oldheader) - sizeof(oldheader.crc));
+    bl.append((char*)&oldheader, sizeof(oldheader));
+  }
+
+  bl.claim_append(body);
+
+  // send footer; if receiver doesn't support signatures, use the old footer format
+  if (connection_state->has_feature(CEPH_FEATURE_MSG_AUTH)) {
+    bl.append((char*)&footer, sizeof(footer));
+  } else {
+    ceph_msg_footer_old old_footer;
+    old_footer.front_crc = footer.front_crc;
+    old_footer.middle_crc = footer.middle_crc;
+    old_footer.data_crc = footer.data_crc;
+    old_footer.flags = footer.flags;
+    bl.append((char*)&old_footer, sizeof(old_footer));
+  }
+
+  ldout(cct, 20) << "write_message sending " << m->get_seq() << " " << m << dendl;
+  outcoming_bl.claim_append(bl);
+}
+
+void AsyncConnection::_write_ack(uint64_t seq)
+{
+  ldout(cct, 10) << "write_ack " << seq << dendl;
+
+  char c = CEPH_MSGR_TAG_ACK;
+  ceph_le64 s;
+  s = seq;
+  outcoming_bl.append(&c, 1);
+  outcoming_bl.append((char*)&s, sizeof(s));
+}
+
+void AsyncConnection::_write_keepalive()
+{
+  ldout(cct, 10) << "write_keepalive" << dendl;
+
+  char c = CEPH_MSGR_TAG_KEEPALIVE;
+  outcoming_bl.append(&c, 1);
+}
+
+void AsyncConnection::handle_write()
+{
+  int r;
+  Mutex::Locker l(lock);
+  ldout(cct, 10) << "handle_write: state = " << get_state_name(state)
+		 << " policy.server=" << policy.server << dendl;
+
+  // standby?
+  if (is_queued() && state == STATE_STANDBY && !policy.server) {
+    connect_seq++;
+    state = STATE_CONNECTING;
+    center->dispatch_event_external(read_handler);
+    return;
+  }
+
+  if (!is_open_state(state)) {
+    // mid-handshake: just flush whatever the handshake has queued
+    if (state != STATE_CLOSED && state != STATE_STANDBY &&
+	state != STATE_WAIT && outcoming_bl.length()) {
+      r = _send_pending();
+      if (r < 0)
+	goto fail;
+    }
+    return;
+  }
+
+  // keepalive?
+  if (keepalive) {
+    _write_keepalive();
+    keepalive = false;
+  }
+
+  // send ack?
+  if (in_seq > in_seq_acked) {
+    _write_ack(in_seq);
+    in_seq_acked = in_seq;
+  }
+
+  // stop pulling messages off the queue once the socket backs up; the
+  // writable event brings us back here
+  while (true) {
+    r = _send_pending();
+    if (r < 0) {
+      ldout(cct, 1) << "handle_write error sending" << dendl;
+      goto fail;
+    }
+    if (r > 0)
+      return;
+
+    Message *m = _get_next_outgoing();
+    if (!m)
+      break;
+    _write_message(m);
+    m->put();
+  }
+
+  if (sent.empty() && close_on_empty) {
+    ldout(cct, 10) << "handle_write out and sent queues empty, closing" << dendl;
+    _stop();
+  }
+  return;
+
+ fail:
+  fault();
+}
+
+void AsyncConnection::wakeup_from(uint64_t id)
+{
+  lock.Lock();
+  register_time_events.erase(id);
+  if (sd >= 0 && state != STATE_CLOSED)
+    center->create_file_event(sd, EVENT_READABLE, read_handler);
+  lock.Unlock();
+  process();
+}
+
+Message *AsyncConnection::_get_next_outgoing()
+{
+  assert(lock.is_locked());
+  Message *m = 0;
+  while (!m && !out_q.empty()) {
+    map<int, list<Message*> >::reverse_iterator p = out_q.rbegin();
+    if (!p->second.empty()) {
+      m = p->second.front();
+      p->second.pop_front();
+    }
+    if (p->second.empty())
+      out_q.erase(p->first);
+  }
+  return m;
+}
+
+void AsyncConnection::handle_ack(uint64_t seq)
+{
+  ldout(cct, 15) << "got ack seq " << seq << dendl;
+  // trim sent list
+  while (!sent.empty() &&
+	 sent.front()->get_seq() <= seq) {
+    Message *m = sent.front();
+    sent.pop_front();
+    ldout(cct, 10) << "got ack seq "
+		   << seq << " >= " << m->get_seq() << " on " << m << " " << *m << dendl;
+    m->put();
+  }
+
+  if (sent.empty() && close_on_empty) {
+    ldout(cct, 10) << "got last ack, queue empty, closing" << dendl;
+    _stop();
+  }
+}
+
+void AsyncConnection::requeue_sent()
+{
+  if (sent.empty())
+    return;
+
+  list<Message*>& rq = out_q[CEPH_MSG_PRIO_HIGHEST];
+  while (!sent.empty()) {
+    Message *m = sent.back();
+    sent.pop_back();
+    ldout(cct, 10) << "requeue_sent " << *m << " for resend seq " << out_seq
+		   << " (" << m->get_seq() << ")" << dendl;
+    rq.push_front(m);
+    out_seq--;
+  }
+}
+
+void AsyncConnection::discard_requeued_up_to(uint64_t seq)
+{
+  ldout(cct, 10) << "discard_requeued_up_to " << seq << dendl;
+  if (out_q.count(CEPH_MSG_PRIO_HIGHEST) == 0)
+    return;
+  list<Message*>& rq = out_q[CEPH_MSG_PRIO_HIGHEST];
+  while (!rq.empty()) {
+    Message *m = rq.front();
+    if (m->get_seq() == 0 || m->get_seq() > seq)
+      break;
+    ldout(cct, 10) << "discard_requeued_up_to " << *m << " for resend seq " << out_seq
+		   << " <= " << seq << ", discarding" << dendl;
+    m->put();
+    rq.pop_front();
+    out_seq++;
+  }
+  if (rq.empty())
+    out_q.erase(CEPH_MSG_PRIO_HIGHEST);
+}
+
+/*
+ * Tears down the connection's message queues.
+ * Must hold lock prior to calling.
+ */
+void AsyncConnection::discard_out_queue()
+{
+  ldout(cct, 10) << "discard_queue" << dendl;
+
+  for (list<Message*>::iterator p = sent.begin(); p != sent.end(); ++p) {
+    ldout(cct, 20) << "  discard " << *p << dendl;
+    (*p)->put();
+  }
+  sent.clear();
+  for (map<int, list<Message*> >::iterator p = out_q.begin(); p != out_q.end(); ++p)
+    for (list<Message*>::iterator r = p->second.begin(); r != p->second.end(); ++r) {
+      ldout(cct, 20) << "  discard " << *r << dendl;
+      (*r)->put();
+    }
+  out_q.clear();
+}
+
+void AsyncConnection::was_session_reset()
+{
+  assert(lock.is_locked());
+
+  ldout(cct, 10) << "was_session_reset" << dendl;
+  async_msgr->dispatch_queue.discard_queue(conn_id);
+  discard_out_queue();
+
+  async_msgr->dispatch_queue.queue_remote_reset(connection_state.get());
+
+  if (randomize_out_seq()) {
+    ldout(cct, 15) << "was_session_reset(): Could not get random bytes to set seq number for session reset; set seq number to " << out_seq << dendl;
+  }
+
+  in_seq = 0;
+  connect_seq = 0;
+}
+
+void AsyncConnection::_release_throttles()
+{
+  // release bytes reserved from the throttlers for a message we won't
+  // deliver
+  if (throttled_message) {
+    ldout(cct, 10) << "releasing " << 1 << " message to policy throttler "
+		   << policy.throttler_messages->get_current() << "/"
+		   << policy.throttler_messages->get_max() << dendl;
+    policy.throttler_messages->put();
+    throttled_message = false;
+  }
+  if (throttled_bytes) {
+    ldout(cct, 10) << "releasing " << throttled_bytes << " bytes to policy throttler "
+		   << policy.throttler_bytes->get_current() << "/"
+		   << policy.throttler_bytes->get_max() << dendl;
+    policy.throttler_bytes->put(throttled_bytes);
+    throttled_bytes = 0;
+  }
+  if (throttled_dispatch) {
+    async_msgr->dispatch_throttle_release(throttled_dispatch);
+    throttled_dispatch = 0;
+  }
+  if (conn_throttled_message) {
+    conn_throttle->messages.put();
+    conn_throttled_message = false;
+  }
+  if (conn_throttled_bytes) {
+    conn_throttle->bytes.put(conn_throttled_bytes);
+    conn_throttled_bytes = 0;
+  }
+}
+
+void AsyncConnection::fault()
+{
+  const md_config_t *conf = cct->_conf;
+  assert(lock.is_locked());
+
+  if (state == STATE_CLOSED) {
+    ldout(cct, 10) << "fault already closed" << dendl;
+    return;
+  }
+
+  ldout(cct, 2) << "fault " << errno << ": " << cpp_strerror(errno) << dendl;
+
+  // abandon whatever was half read or half written
+  _release_throttles();
+  front.clear();
+  middle.clear();
+  data.clear();
+  outcoming_bl.clear();
+  state_offset = 0;
+
+  bool connecting = is_connecting_state(state);
+
+  // lossy channel?
+  if (policy.lossy && !connecting) {
+    ldout(cct, 10) << "fault on lossy channel, failing" << dendl;
+
+    // _lookup_conn ignores us from now on, and the cleanup event
+    // unregisters us
+    _stop();
+
+    async_msgr->dispatch_queue.discard_queue(conn_id);
+    discard_out_queue();
+
+    // disconnect from Connection, and mark it failed.  future messages
+    // will be dropped.
+    assert(connection_state);
+    if (connection_state->clear_pipe(this))
+      async_msgr->dispatch_queue.queue_reset(connection_state.get());
+    return;
+  }
+
+  // the socket is dead; a reconnect creates a new one
+  if (sd >= 0) {
+    center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
+    write_registered = false;
+    ::close(sd);
+    sd = -1;
+  }
+
+  // requeue sent items
+  requeue_sent();
+
+  if (policy.standby && !is_queued()) {
+    ldout(cct, 0) << "fault with nothing to send, going to standby" << dendl;
+    state = STATE_STANDBY;
+    return;
+  }
+
+  if (!connecting) {
+    if (policy.server) {
+      ldout(cct, 0) << "fault, server, going to standby" << dendl;
+      state = STATE_STANDBY;
+    } else {
+      ldout(cct, 0) << "fault, initiating reconnect" << dendl;
+      connect_seq++;
+      state = STATE_CONNECTING;
+      center->dispatch_event_external(read_handler);
+    }
+    backoff = utime_t();
+  } else {
+    state = STATE_CONNECTING;
+    if (backoff == utime_t()) {
+      ldout(cct, 0) << "fault" << dendl;
+      backoff.set_from_double(conf->ms_initial_backoff);
+      center->dispatch_event_external(read_handler);
+    } else {
+      ldout(cct, 10) << "fault waiting " << backoff << dendl;
+      _schedule(backoff.to_nsec() / 1000);
+      backoff += backoff;
+      if (backoff > conf->ms_max_backoff)
+	backoff.set_from_double(conf->ms_max_backoff);
+    }
+  }
+}
+
+void AsyncConnection::stop()
+{
+  Mutex::Locker l(lock);
+  _stop();
+}
+
+void AsyncConnection::_stop()
+{
+  ldout(cct, 10) << "stop" << dendl;
+  assert(lock.is_locked());
+  state = STATE_CLOSED;
+  state_closed.set(1);
+  shutdown_socket();
+  if (!cleanup_queued) {
+    // the socket belongs to our Worker; tear it down there.  keep
+    // ourselves alive until that has happened.
+    cleanup_queued = true;
+    get();
+    center->dispatch_event_external(cleanup);
+  }
+}
+
+void AsyncConnection::cleanup_handler()
+{
+  lock.Lock();
+  ldout(cct, 10) << "cleanup_handler" << dendl;
+  assert(state == STATE_CLOSED);
+  for (set<uint64_t>::iterator it = register_time_events.begin();
+       it != register_time_events.end(); ++it)
+    center->delete_time_event(*it);
+  register_time_events.clear();
+  if (sd >= 0) {
+    center->delete_file_event(sd, EVENT_READABLE|EVENT_WRITABLE);
+    write_registered = false;
+    ::close(sd);
+    sd = -1;
+  }
+  outcoming_bl.clear();
+  _release_throttles();
+  discard_out_queue();
+  // mark_down, mark_down_all, or fault() usually did this already, or
+  // an accept may have switched the Connection to a different
+  // AsyncConnection... but make sure!
+  if (connection_state->clear_pipe(this))
+    async_msgr->dispatch_queue.queue_reset(connection_state.get());
+  lock.Unlock();
+
+  async_msgr->queue_reap(this);
+  put();
+}
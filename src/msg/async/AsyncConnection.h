@@ -0,0 +1,283 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_ASYNCCONNECTION_H
+#define CEPH_MSG_ASYNCCONNECTION_H
+
+#include <list>
+#include <map>
+#include <set>
+using namespace std;
+
+#include "common/Mutex.h"
+#include "include/atomic.h"
+#include "include/buffer.h"
+
+#include "auth/AuthSessionHandler.h"
+#include "msg/Messenger.h"
+#include "msg/Message.h"
+#include "Event.h"
+
+class AsyncMessenger;
+
+/**
+ * AsyncConnection is the non-blocking counterpart of Pipe.  It owns a
+ * socket that is serviced by exactly one EventCenter (and thus one
+ * worker thread), and drives the same on-wire protocol as Pipe as a
+ * state machine: whenever the socket becomes readable process() reads
+ * as far as it can without blocking and remembers where it stopped.
+ *
+ * Like Pipe, it is stored in Connection::pipe, so a Connection may be
+ * handed off between AsyncConnections during reconnects and races.
+ *
+ * Lock ordering:
+ *
+ *   AsyncMessenger::lock
+ *       AsyncConnection::lock
+ *           DispatchQueue::lock
+ */
+class AsyncConnection : public RefCountedObject {
+ public:
+  enum {
+    STATE_NONE,
+    STATE_OPEN,
+    STATE_OPEN_KEEPALIVE,
+    STATE_OPEN_TAG_ACK,
+    STATE_OPEN_MESSAGE_HEADER,
+    STATE_OPEN_MESSAGE_THROTTLE_MESSAGE,
+    STATE_OPEN_MESSAGE_THROTTLE_BYTES,
+    STATE_OPEN_MESSAGE_THROTTLE_DISPATCH_QUEUE,
+    STATE_OPEN_MESSAGE_READ_FRONT,
+    STATE_OPEN_MESSAGE_READ_MIDDLE,
+    STATE_OPEN_MESSAGE_READ_DATA_PREPARE,
+    STATE_OPEN_MESSAGE_READ_DATA,
+    STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH,
+    STATE_OPEN_TAG_CLOSE,
+    STATE_CONNECTING,
+    STATE_CONNECTING_WAIT_BANNER,
+    STATE_CONNECTING_WAIT_IDENTIFY_PEER,
+    STATE_CONNECTING_SEND_CONNECT_MSG,
+    STATE_CONNECTING_WAIT_CONNECT_REPLY,
+    STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH,
+    STATE_CONNECTING_WAIT_ACK_SEQ,
+    STATE_CONNECTING_READY,
+    STATE_ACCEPTING,
+    STATE_ACCEPTING_WAIT_BANNER_ADDR,
+    STATE_ACCEPTING_WAIT_CONNECT_MSG,
+    STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH,
+    STATE_ACCEPTING_WAIT_SEQ,
+    STATE_ACCEPTING_READY,
+    STATE_STANDBY,
+    STATE_CLOSED,
+    STATE_WAIT,       // just wait for racing connection
+  };
+
+  static const char *get_state_name(int state) {
+    const char* const statenames[] = {"STATE_NONE",
+				      "STATE_OPEN",
+				      "STATE_OPEN_KEEPALIVE",
+				      "STATE_OPEN_TAG_ACK",
+				      "STATE_OPEN_MESSAGE_HEADER",
+				      "STATE_OPEN_MESSAGE_THROTTLE_MESSAGE",
+				      "STATE_OPEN_MESSAGE_THROTTLE_BYTES",
+				      "STATE_OPEN_MESSAGE_THROTTLE_DISPATCH_QUEUE",
+				      "STATE_OPEN_MESSAGE_READ_FRONT",
+				      "STATE_OPEN_MESSAGE_READ_MIDDLE",
+				      "STATE_OPEN_MESSAGE_READ_DATA_PREPARE",
+				      "STATE_OPEN_MESSAGE_READ_DATA",
+				      "STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH",
+				      "STATE_OPEN_TAG_CLOSE",
+				      "STATE_CONNECTING",
+				      "STATE_CONNECTING_WAIT_BANNER",
+				      "STATE_CONNECTING_WAIT_IDENTIFY_PEER",
+				      "STATE_CONNECTING_SEND_CONNECT_MSG",
+				      "STATE_CONNECTING_WAIT_CONNECT_REPLY",
+				      "STATE_CONNECTING_WAIT_CONNECT_REPLY_AUTH",
+				      "STATE_CONNECTING_WAIT_ACK_SEQ",
+				      "STATE_CONNECTING_READY",
+				      "STATE_ACCEPTING",
+				      "STATE_ACCEPTING_WAIT_BANNER_ADDR",
+				      "STATE_ACCEPTING_WAIT_CONNECT_MSG",
+				      "STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH",
+				      "STATE_ACCEPTING_WAIT_SEQ",
+				      "STATE_ACCEPTING_READY",
+				      "STATE_STANDBY",
+				      "STATE_CLOSED",
+				      "STATE_WAIT"};
+    if (state < 0 || state > STATE_WAIT)
+      return "UNKNOWN";
+    return statenames[state];
+  }
+
+  /// established, or about to be once the final handshake bytes are in
+  static bool is_open_state(int state) {
+    return (state >= STATE_OPEN && state <= STATE_OPEN_TAG_CLOSE) ||
+      state == STATE_ACCEPTING_WAIT_SEQ || state == STATE_ACCEPTING_READY;
+  }
+  static bool is_connecting_state(int state) {
+    return state >= STATE_CONNECTING && state <= STATE_CONNECTING_READY;
+  }
+
+  AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c,
+		  Connection *con);
+  ~AsyncConnection();
+
+  ostream& _conn_prefix(std::ostream *_dout);
+
+  /// start the client handshake towards addr
+  void connect(const entity_addr_t& addr, int type);
+  /// take over an accepted socket and start the server handshake
+  void accept(int sd);
+
+  /// queue a message; the caller must hold lock
+  void _send(Message *m);
+  /// queue a keepalive; the caller must hold lock
+  void _send_keepalive();
+  /// mark the connection closed; the socket is torn down asynchronously
+  void stop();
+  void _stop();
+
+  bool is_queued() { return !out_q.empty() || keepalive; }
+  bool is_closed() { return state_closed.read(); }
+  const entity_addr_t& get_peer_addr() { return peer_addr; }
+
+  /// callbacks from the EventCenter
+  void process();
+  void handle_write();
+  void wakeup_from(uint64_t id);
+  void cleanup_handler();
+
+ private:
+  void set_peer_addr(const entity_addr_t& a) {
+    if (&peer_addr != &a)
+      peer_addr = a;
+    connection_state->set_peer_addr(a);
+  }
+  void set_peer_type(int t) {
+    peer_type = t;
+    connection_state->set_peer_type(t);
+  }
+
+  int randomize_out_seq();
+  void set_socket_options();
+  void register_conn();
+  void unregister_conn();
+
+  /**
+   * Read into p until exactly `needed` bytes, counted from the start of
+   * the current state, are present.
+   *
+   * @return 0 when complete, a positive number of missing bytes if the
+   *         socket would block, or negative on error
+   */
+  int read_until(unsigned needed, char *p);
+  int read_bulk(char *buf, int len);
+  /**
+   * Append bl to the outgoing buffer and push out as much as the socket
+   * takes.  Interest in EVENT_WRITABLE is registered while data remains.
+   *
+   * @return bytes still pending, or negative on error
+   */
+  int _try_send(bufferlist &bl);
+  int _send_pending();
+  void _write_message(Message *m);
+  void _write_ack(uint64_t seq);
+  void _write_keepalive();
+
+  int _process_connection();
+  int handle_connect_reply(ceph_msg_connect &connect, ceph_msg_connect_reply &r);
+  int handle_connect_msg(ceph_msg_connect &m, bufferlist &aubl, bufferlist &bl);
+  int _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
+		    bufferlist &authorizer_reply);
+  int _send_connect_message();
+  int _fail_accept();
+
+  Message *_get_next_outgoing();
+  void requeue_sent();
+  void discard_requeued_up_to(uint64_t seq);
+  void discard_out_queue();
+  void was_session_reset();
+  void handle_ack(uint64_t seq);
+  void _release_throttles();
+
+  void fault();
+  void _schedule(uint64_t us);
+  void shutdown_socket() {
+    if (sd >= 0)
+      ::shutdown(sd, SHUT_RDWR);
+  }
+
+ public:
+  AsyncMessenger *async_msgr;
+  CephContext *cct;
+  uint64_t conn_id;
+  EventCenter *center;
+  Mutex lock;
+  int state;
+  atomic_t state_closed; // non-zero iff state = STATE_CLOSED
+  Messenger::Policy policy;
+  ConnThrottle *conn_throttle;  ///< from policy, if it caps each connection
+  ConnectionRef connection_state;
+
+ private:
+  int sd;
+  int port;
+  int peer_type;
+  entity_addr_t peer_addr;
+  AuthSessionHandler *session_security;
+
+  map<int, list<Message*> > out_q;  // priority queue for outbound msgs
+  list<Message*> sent;
+  bool keepalive;
+  bool close_on_empty;
+  __u32 connect_seq, peer_global_seq;
+  uint64_t out_seq;
+  uint64_t in_seq, in_seq_acked;
+  utime_t backoff;         // backoff time
+
+  bufferlist outcoming_bl;
+  bool write_registered;
+  set<uint64_t> register_time_events;
+  bool cleanup_queued;
+
+  EventCallbackRef read_handler;
+  EventCallbackRef write_handler;
+  EventCallbackRef time_handler;
+  EventCallbackRef cleanup;
+
+  // handshake state
+  unsigned state_offset;
+  bufferptr state_buffer;
+  __u32 global_seq;
+  bool got_bad_auth;
+  AuthAuthorizer *authorizer;
+  ceph_msg_connect connect_msg;
+  ceph_msg_connect_reply connect_reply;
+  bufferlist authorizer_buf, authorizer_reply;
+  bool replaced;
+
+  // message being read
+  ceph_msg_header current_header;
+  bufferlist front, middle, data;
+  bufferlist::iterator data_blp;
+  utime_t recv_stamp, throttle_stamp;
+  uint64_t cur_msg_size;
+  bool conn_throttled_message;
+  uint64_t conn_throttled_bytes;
+  bool throttled_message;
+  uint64_t throttled_bytes;
+  uint64_t throttled_dispatch;
+
+  friend class AsyncMessenger;
+};
+
+#endif
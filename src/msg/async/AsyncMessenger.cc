@@ -0,0 +1,887 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <fstream>
+#include <sys/socket.h>
+
+#include "AsyncMessenger.h"
+
+#include "common/config.h"
+#include "common/errno.h"
+#include "common/debug.h"
+#include "auth/Crypto.h"
+#include "include/Spinlock.h"
+
+#define dout_subsys ceph_subsys_ms
+#undef dout_prefix
+#define dout_prefix _prefix(_dout, this)
+static ostream& _prefix(std::ostream *_dout, AsyncMessenger *m) {
+  return *_dout << "-- " << m->get_myaddr() << " ";
+}
+
+static ostream& _prefix(std::ostream *_dout, Processor *p) {
+  return *_dout << " Processor -- ";
+}
+
+static ostream& _prefix(std::ostream *_dout, Worker *w) {
+  return *_dout << "--";
+}
+
+/// how long a Worker blocks in the event loop without any event (usec)
+#define EVENT_LOOP_TIMEOUT_US 30000000
+
+
+/*******************
+ * Processor
+ */
+
+class C_handle_accept : public EventCallback {
+  Processor *pro;
+
+ public:
+  C_handle_accept(Processor *p): pro(p) {}
+  void do_request(int id) {
+    pro->accept();
+  }
+};
+
+Processor::Processor(AsyncMessenger *r, uint64_t n)
+  : msgr(r), listen_sd(-1), nonce(n), worker(NULL),
+    listen_handler(new C_handle_accept(this))
+{
+}
+
+int Processor::bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports)
+{
+  const md_config_t *conf = msgr->cct->_conf;
+  // bind to a socket
+  ldout(msgr->cct, 10) << __func__ << dendl;
+
+  int family;
+  switch (bind_addr.get_family()) {
+  case AF_INET:
+  case AF_INET6:
+    family = bind_addr.get_family();
+    break;
+
+  default:
+    // bind_addr is empty
+    family = conf->ms_bind_ipv6 ? AF_INET6 : AF_INET;
+  }
+
+  /* socket creation */
+  listen_sd = ::socket(family, SOCK_STREAM, 0);
+  if (listen_sd < 0) {
+    lderr(msgr->cct) << __func__ << " unable to create socket: "
+		     << cpp_strerror(errno) << dendl;
+    return -errno;
+  }
+
+  // the listen socket is serviced from the event loop: never block on it
+  int flags = fcntl(listen_sd, F_GETFL);
+  if (flags < 0 || fcntl(listen_sd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    int rc = -errno;
+    lderr(msgr->cct) << __func__ << " unable to set listen socket nonblocking: "
+		     << cpp_strerror(rc) << dendl;
+    return rc;
+  }
+
+  // use whatever user specified (if anything)
+  entity_addr_t listen_addr = bind_addr;
+  listen_addr.set_family(family);
+
+  /* bind to port */
+  int rc = -1;
+  if (listen_addr.get_port()) {
+    // specific port
+
+    // reuse addr+port when possible
+    int on = 1;
+    rc = ::setsockopt(listen_sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (rc < 0) {
+      lderr(msgr->cct) << __func__ << " unable to setsockopt: "
+		       << cpp_strerror(errno) << dendl;
+      return -errno;
+    }
+
+    rc = ::bind(listen_sd, (struct sockaddr *) &listen_addr.ss_addr(), listen_addr.addr_size());
+    if (rc < 0) {
+      lderr(msgr->cct) << __func__ << " unable to bind to " << listen_addr.ss_addr()
+		       << ": " << cpp_strerror(errno) << dendl;
+      return -errno;
+    }
+  } else {
+    // try a range of ports
+    for (int port = msgr->cct->_conf->ms_bind_port_min; port <= msgr->cct->_conf->ms_bind_port_max; port++) {
+      if (avoid_ports.count(port))
+	continue;
+      listen_addr.set_port(port);
+      rc = ::bind(listen_sd, (struct sockaddr *) &listen_addr.ss_addr(), listen_addr.addr_size());
+      if (rc == 0)
+	break;
+    }
+    if (rc < 0) {
+      lderr(msgr->cct) << __func__ << " unable to bind to " << listen_addr.ss_addr()
+		       << " on any port in range " << msgr->cct->_conf->ms_bind_port_min
+		       << "-" << msgr->cct->_conf->ms_bind_port_max
+		       << ": " << cpp_strerror(errno) << dendl;
+      return -errno;
+    }
+    ldout(msgr->cct, 10) << __func__ << " bound on random port " << listen_addr << dendl;
+  }
+
+  // what port did we get?
+  socklen_t llen = sizeof(listen_addr.ss_addr());
+  rc = getsockname(listen_sd, (sockaddr*)&listen_addr.ss_addr(), &llen);
+  if (rc < 0) {
+    rc = -errno;
+    lderr(msgr->cct) << __func__ << " failed getsockname: " << cpp_strerror(rc) << dendl;
+    return rc;
+  }
+
+  ldout(msgr->cct, 10) << __func__ << " bound to " << listen_addr << dendl;
+
+  // listen!
+  rc = ::listen(listen_sd, 128);
+  if (rc < 0) {
+    rc = -errno;
+    lderr(msgr->cct) << __func__ << " unable to listen on " << listen_addr
+		     << ": " << cpp_strerror(rc) << dendl;
+    return rc;
+  }
+
+  msgr->set_myaddr(bind_addr);
+  if (bind_addr != entity_addr_t())
+    msgr->learned_addr(bind_addr);
+  else
+    assert(msgr->get_need_addr());  // should still be true.
+
+  if (msgr->get_myaddr().get_port() == 0) {
+    msgr->set_myaddr(listen_addr);
+  }
+  entity_addr_t addr = msgr->get_myaddr();
+  addr.nonce = nonce;
+  msgr->set_myaddr(addr);
+
+  msgr->init_local_connection();
+
+  ldout(msgr->cct, 1) << __func__ << " my_inst.addr is " << msgr->get_myaddr()
+		      << " need_addr=" << msgr->get_need_addr() << dendl;
+  return 0;
+}
+
+int Processor::rebind(const set<int>& avoid_ports)
+{
+  ldout(msgr->cct, 1) << __func__ << " avoid " << avoid_ports << dendl;
+
+  // invalidate our previously learned address.
+  msgr->unlearn_addr();
+
+  entity_addr_t addr = msgr->get_myaddr();
+  set<int> new_avoid = avoid_ports;
+  new_avoid.insert(addr.get_port());
+  addr.set_port(0);
+
+  // adjust the nonce; we want our entity_addr_t to be truly unique.
+  nonce += 1000000;
+  msgr->my_inst.addr.nonce = nonce;
+  ldout(msgr->cct, 10) << __func__ << " new nonce " << nonce << " and inst " << msgr->my_inst << dendl;
+
+  ldout(msgr->cct, 10) << __func__ << " will try " << addr << " and avoid ports " << new_avoid << dendl;
+  int r = bind(addr, new_avoid);
+  if (r == 0)
+    start(worker);
+  return r;
+}
+
+int Processor::start(Worker *w)
+{
+  ldout(msgr->cct, 1) << __func__ << " " << dendl;
+
+  // start thread
+  worker = w;
+  if (listen_sd >= 0)
+    return worker->center.create_file_event(listen_sd, EVENT_READABLE, listen_handler);
+  return 0;
+}
+
+void Processor::accept()
+{
+  ldout(msgr->cct, 10) << __func__ << " listen_sd=" << listen_sd << dendl;
+  int errors = 0;
+  while (errors < 4) {
+    entity_addr_t addr;
+    socklen_t slen = sizeof(addr.ss_addr());
+    int sd = ::accept(listen_sd, (sockaddr*)&addr.ss_addr(), &slen);
+    if (sd >= 0) {
+      errors = 0;
+      ldout(msgr->cct, 10) << __func__ << " accepted incoming on sd " << sd << dendl;
+
+      msgr->add_accept(sd);
+      continue;
+    } else {
+      if (errno == EINTR) {
+	continue;
+      } else if (errno == EAGAIN) {
+	break;
+      } else {
+	errors++;
+	ldout(msgr->cct, 20) << __func__ << " no incoming connection?  sd = " << sd
+			     << " errno " << errno << " " << cpp_strerror(errno) << dendl;
+      }
+    }
+  }
+}
+
+void Processor::stop()
+{
+  ldout(msgr->cct, 10) << __func__ << dendl;
+
+  if (listen_sd >= 0) {
+    if (worker)
+      worker->center.delete_file_event(listen_sd, EVENT_READABLE);
+    ::shutdown(listen_sd, SHUT_RDWR);
+    ::close(listen_sd);
+    listen_sd = -1;
+  }
+}
+
+
+/*******************
+ * Worker
+ */
+#undef dout_prefix
+#define dout_prefix _prefix(_dout, this)
+
+void *Worker::entry()
+{
+  ldout(cct, 10) << __func__ << " starting" << dendl;
+  center.set_owner(pthread_self());
+  while (!done) {
+    ldout(cct, 20) << __func__ << " calling event process" << dendl;
+
+    int r = center.process_events(EVENT_LOOP_TIMEOUT_US);
+    if (r < 0) {
+      ldout(cct, 20) << __func__ << " process events failed: "
+		     << cpp_strerror(errno) << dendl;
+      // TODO do something?
+    }
+  }
+
+  return 0;
+}
+
+void Worker::stop()
+{
+  ldout(cct, 10) << __func__ << dendl;
+  done = true;
+  center.wakeup();
+  if (is_started())
+    join();
+}
+
+
+/*******************
+ * AsyncMessenger
+ */
+#undef dout_prefix
+#define dout_prefix _prefix(_dout, this)
+
+AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
+			       string mname, uint64_t _nonce)
+  : Messenger(cct, name),
+    my_type(name.type()),
+    nonce(_nonce),
+    next_worker(0),
+    processor(this, _nonce),
+    dispatch_queue(cct, this, mname),
+    compressor(cct, mname),
+    lock("AsyncMessenger::lock"),
+    need_addr(true), did_bind(false),
+    global_seq(0),
+    cluster_protocol(0),
+    policy_lock("AsyncMessenger::policy_lock"),
+    local_connection(new Connection(this))
+{
+  ceph_spin_init(&global_seq_lock);
+  int nr_workers = cct->_conf->ms_async_op_threads;
+  if (nr_workers < 1)
+    nr_workers = 1;
+  for (int i = 0; i < nr_workers; ++i) {
+    Worker *w = new Worker(cct);
+    int r = w->center.init(5000);
+    assert(r == 0);
+    workers.push_back(w);
+  }
+  init_local_connection();
+}
+
+/**
+ * Destroy the AsyncMessenger. Pretty simple since all the work is done
+ * elsewhere.
+ */
+AsyncMessenger::~AsyncMessenger()
+{
+  assert(!did_bind); // either we didn't bind or we shut down the Processor
+  assert(all_conns.empty()); // every connection has been reaped
+  for (vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+    (*it)->stop();
+    delete *it;
+  }
+  workers.clear();
+  ceph_spin_destroy(&global_seq_lock);
+}
+
+void AsyncMessenger::ready()
+{
+  ldout(cct,10) << __func__ << " " << get_myaddr() << dendl;
+  dispatch_queue.start();
+
+  lock.Lock();
+  if (did_bind)
+    processor.start(workers[0]);
+  lock.Unlock();
+}
+
+int AsyncMessenger::shutdown()
+{
+  ldout(cct,10) << __func__ << " " << get_myaddr() << dendl;
+  mark_down_all();
+  dispatch_queue.shutdown();
+  return 0;
+}
+
+int AsyncMessenger::bind(const entity_addr_t &bind_addr)
+{
+  lock.Lock();
+  if (started) {
+    ldout(cct,10) << __func__ << " already started" << dendl;
+    lock.Unlock();
+    return -1;
+  }
+  ldout(cct,10) << __func__ << " bind " << bind_addr << dendl;
+  lock.Unlock();
+
+  // bind to a socket
+  set<int> avoid_ports;
+  int r = processor.bind(bind_addr, avoid_ports);
+  if (r >= 0)
+    did_bind = true;
+  return r;
+}
+
+int AsyncMessenger::rebind(const set<int>& avoid_ports)
+{
+  ldout(cct,1) << __func__ << " rebind avoid " << avoid_ports << dendl;
+  assert(did_bind);
+  processor.stop();
+  mark_down_all();
+  return processor.rebind(avoid_ports);
+}
+
+int AsyncMessenger::start()
+{
+  lock.Lock();
+  ldout(cct,1) << __func__ << " start" << dendl;
+
+  // register at least one entity, first!
+  assert(my_type >= 0);
+
+  assert(!started);
+  started = true;
+
+  if (!did_bind) {
+    my_inst.addr.nonce = nonce;
+    init_local_connection();
+  }
+
+  for (vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it)
+    (*it)->create();
+
+  lock.Unlock();
+  return 0;
+}
+
+void AsyncMessenger::wait()
+{
+  lock.Lock();
+  if (!started) {
+    lock.Unlock();
+    return;
+  }
+  lock.Unlock();
+
+  ldout(cct,10) << __func__ << ": waiting for dispatch queue" << dendl;
+  dispatch_queue.wait();
+  ldout(cct,10) << __func__ << ": dispatch queue is stopped" << dendl;
+
+  // done!  clean up.
+  if (did_bind) {
+    ldout(cct,20) << __func__ << ": stopping processor" << dendl;
+    processor.stop();
+    did_bind = false;
+    ldout(cct,20) << __func__ << ": stopped processor" << dendl;
+  }
+
+  // close all connections, and wait for the Workers to reap them
+  lock.Lock();
+  {
+    ldout(cct,10) << __func__ << ": closing connections" << dendl;
+
+    for (set<AsyncConnection*>::iterator it = all_conns.begin(); it != all_conns.end(); ++it)
+      (*it)->stop();
+
+    ldout(cct,10) << __func__ << ": waiting for " << all_conns.size()
+		  << " connections to close" << dendl;
+    while (!all_conns.empty())
+      stop_cond.Wait(lock);
+  }
+  lock.Unlock();
+
+  for (vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it)
+    (*it)->stop();
+
+  ldout(cct,10) << __func__ << ": done." << dendl;
+  ldout(cct,1) << __func__ << " complete." << dendl;
+  started = false;
+  my_type = -1;
+}
+
+Worker *AsyncMessenger::get_worker()
+{
+  assert(lock.is_locked());
+  Worker *w = workers[next_worker];
+  next_worker = (next_worker + 1) % workers.size();
+  return w;
+}
+
+AsyncConnection *AsyncMessenger::add_accept(int sd)
+{
+  lock.Lock();
+  AsyncConnection *conn = new AsyncConnection(cct, this, &get_worker()->center, NULL);
+  conn->accept(sd);
+  accepting_conns.insert(conn);
+  all_conns.insert(conn);
+  lock.Unlock();
+  return conn;
+}
+
+/* create_connect
+ * NOTE: assumes messenger.lock held.
+ */
+AsyncConnection *AsyncMessenger::create_connect(const entity_addr_t& addr, int type,
+						Connection *con, Message *first)
+{
+  assert(lock.is_locked());
+  assert(addr != my_inst.addr);
+
+  ldout(cct, 10) << __func__ << " " << addr
+		 << ", creating connection and registering" << dendl;
+
+  // create connection
+  AsyncConnection *conn = new AsyncConnection(cct, this, &get_worker()->center, con);
+  conn->connect(addr, type);
+  if (first) {
+    Mutex::Locker l(conn->lock);
+    conn->_send(first);
+  }
+  assert(!conns.count(addr) || conns[addr]->is_closed());
+  conns[addr] = conn;
+  all_conns.insert(conn);
+
+  return conn;
+}
+
+void AsyncMessenger::queue_reap(AsyncConnection *conn)
+{
+  ldout(cct, 10) << __func__ << " " << conn << dendl;
+  lock.Lock();
+  conn->unregister_conn();
+  assert(all_conns.count(conn));
+  all_conns.erase(conn);
+  conn->put();
+  stop_cond.Signal();
+  lock.Unlock();
+}
+
+int AsyncMessenger::_send_message(Message *m, const entity_inst_t& dest,
+				  bool lazy)
+{
+  // set envelope
+  m->get_header().src = get_myname();
+
+  if (!m->get_priority()) m->set_priority(get_default_send_priority());
+
+  ldout(cct,1) << (lazy ? "lazy " : "") <<"--> " << dest.name << " "
+	       << dest.addr << " -- " << *m
+	       << " -- ?+" << m->get_data().length()
+	       << " " << m
+	       << dendl;
+
+  if (dest.addr == entity_addr_t()) {
+    ldout(cct,0) << (lazy ? "lazy_" : "") << "send_message message " << *m
+		 << " with empty dest " << dest.addr << dendl;
+    m->put();
+    return -EINVAL;
+  }
+
+  lock.Lock();
+  AsyncConnection *conn = _lookup_conn(dest.addr);
+  submit_message(m, (conn ? conn->connection_state.get() : NULL),
+		 dest.addr, dest.name.type(), lazy);
+  lock.Unlock();
+  return 0;
+}
+
+int AsyncMessenger::_send_message(Message *m, Connection *con, bool lazy)
+{
+  //set envelope
+  m->get_header().src = get_myname();
+
+  if (!m->get_priority()) m->set_priority(get_default_send_priority());
+
+  ldout(cct,1) << (lazy ? "lazy " : "") << "--> " << con->get_peer_addr()
+	       << " -- " << *m
+	       << " -- ?+" << m->get_data().length()
+	       << " " << m << " con " << con
+	       << dendl;
+
+  lock.Lock();
+  submit_message(m, con, con->get_peer_addr(), con->get_peer_type(), lazy);
+  lock.Unlock();
+  return 0;
+}
+
+void AsyncMessenger::submit_message(Message *m, Connection *con,
+				    const entity_addr_t& dest_addr, int dest_type, bool lazy)
+{
+  // existing connection?
+  if (con) {
+    AsyncConnection *conn = NULL;
+    bool ok = con->try_get_pipe((RefCountedObject**)&conn);
+    if (!ok) {
+      ldout(cct,0) << __func__ << " " << *m << " remote, " << dest_addr
+		   << ", failed lossy con, dropping message " << m << dendl;
+      m->put();
+      return;
+    }
+    if (conn) {
+      conn->lock.Lock();
+      if (conn->state != AsyncConnection::STATE_CLOSED) {
+	ldout(cct,20) << __func__ << " " << *m << " remote, " << dest_addr << ", have connection." << dendl;
+	conn->_send(m);
+	conn->lock.Unlock();
+	conn->put();
+	return;
+      }
+      conn->lock.Unlock();
+      conn->put();
+      ldout(cct,20) << __func__ << " " << *m << " remote, " << dest_addr
+		    << ", had connection " << conn << ", but it closed." << dendl;
+      m->put();
+      return;
+    }
+  }
+
+  // local?
+  if (my_inst.addr == dest_addr) {
+    // local
+    ldout(cct,20) << __func__ << " " << *m << " local" << dendl;
+    dispatch_queue.local_delivery(m, m->get_priority());
+    return;
+  }
+
+  // remote, no existing connection.
+  const Policy& policy = get_policy(dest_type);
+  if (policy.server) {
+    ldout(cct,20) << __func__ << " " << *m << " remote, " << dest_addr << ", lossy server for target type "
+		  << ceph_entity_type_name(dest_type) << ", no session, dropping." << dendl;
+    m->put();
+  } else if (lazy) {
+    ldout(cct,20) << __func__ << " " << *m << " remote, " << dest_addr << ", lazy, dropping." << dendl;
+    m->put();
+  } else {
+    ldout(cct,20) << __func__ << " " << *m << " remote, " << dest_addr << ", new connection." << dendl;
+    create_connect(dest_addr, dest_type, con, m);
+  }
+}
+
+/**
+ * If my_inst.addr doesn't have an IP set, this function
+ * will fill it in from the passed addr. Otherwise it does nothing and returns.
+ */
+void AsyncMessenger::set_addr_unknowns(entity_addr_t &addr)
+{
+  if (my_inst.addr.is_blank_ip()) {
+    int port = my_inst.addr.get_port();
+    my_inst.addr.addr = addr.addr;
+    my_inst.addr.set_port(port);
+    init_local_connection();
+  }
+}
+
+int AsyncMessenger::get_proto_version(int peer_type, bool connect)
+{
+  // set reply protocol version
+  if (peer_type == my_type) {
+    // internal
+    return cluster_protocol;
+  } else {
+    // public
+    if (connect) {
+      switch (peer_type) {
+      case CEPH_ENTITY_TYPE_OSD: return CEPH_OSDC_PROTOCOL;
+      case CEPH_ENTITY_TYPE_MDS: return CEPH_MDSC_PROTOCOL;
+      case CEPH_ENTITY_TYPE_MON: return CEPH_MONC_PROTOCOL;
+      }
+    } else {
+      switch (my_type) {
+      case CEPH_ENTITY_TYPE_OSD: return CEPH_OSDC_PROTOCOL;
+      case CEPH_ENTITY_TYPE_MDS: return CEPH_MDSC_PROTOCOL;
+      case CEPH_ENTITY_TYPE_MON: return CEPH_MONC_PROTOCOL;
+      }
+    }
+  }
+  return 0;
+}
+
+AuthAuthorizer *AsyncMessenger::get_authorizer(int peer_type, bool force_new)
+{
+  return ms_deliver_get_authorizer(peer_type, force_new);
+}
+
+bool AsyncMessenger::verify_authorizer(Connection *con, int peer_type,
+				       int protocol, bufferlist& authorizer, bufferlist& authorizer_reply,
+				       bool& isvalid, CryptoKey& session_key)
+{
+  return ms_deliver_verify_authorizer(con, peer_type, protocol, authorizer, authorizer_reply, isvalid, session_key);
+}
+
+ConnectionRef AsyncMessenger::get_connection(const entity_inst_t& dest)
+{
+  Mutex::Locker l(lock);
+  if (my_inst.addr == dest.addr) {
+    // local
+    return local_connection;
+  }
+
+  AsyncConnection *conn = _lookup_conn(dest.addr);
+  if (conn) {
+    ldout(cct, 10) << __func__ << " " << dest << " existing " << conn << dendl;
+  } else {
+    conn = create_connect(dest.addr, dest.name.type(), NULL, NULL);
+    ldout(cct, 10) << __func__ << " " << dest << " new " << conn << dendl;
+  }
+  // an AsyncConnection keeps its Connection for its whole lifetime
+  return conn->connection_state;
+}
+
+ConnectionRef AsyncMessenger::get_loopback_connection()
+{
+  return local_connection;
+}
+
+int AsyncMessenger::send_keepalive(const entity_inst_t& dest)
+{
+  int ret = 0;
+
+  lock.Lock();
+  // local?
+  if (my_inst.addr != dest.addr) {
+    // remote.
+    AsyncConnection *conn = _lookup_conn(dest.addr);
+    if (conn) {
+      ldout(cct,20) << __func__ << " remote, " << dest.addr << ", have connection." << dendl;
+      Mutex::Locker l(conn->lock);
+      conn->_send_keepalive();
+    } else {
+      ldout(cct,20) << __func__ << " no connection for " << dest.addr << ", doing nothing." << dendl;
+      ret = -EINVAL;
+    }
+  }
+  lock.Unlock();
+  return ret;
+}
+
+int AsyncMessenger::send_keepalive(Connection *con)
+{
+  int ret = 0;
+  AsyncConnection *conn = static_cast<AsyncConnection *>(con->get_pipe());
+  if (conn) {
+    ldout(cct,20) << __func__ << " con " << con << ", have connection." << dendl;
+    assert(conn->async_msgr == this);
+    conn->lock.Lock();
+    conn->_send_keepalive();
+    conn->lock.Unlock();
+    conn->put();
+  } else {
+    ldout(cct,0) << __func__ << " con " << con << ", no connection." << dendl;
+    ret = -EPIPE;
+  }
+  return ret;
+}
+
+void AsyncMessenger::mark_down_all()
+{
+  ldout(cct,1) << __func__ << dendl;
+  lock.Lock();
+  for (set<AsyncConnection*>::iterator q = accepting_conns.begin();
+       q != accepting_conns.end(); ++q) {
+    AsyncConnection *p = *q;
+    ldout(cct, 5) << __func__ << " accepting_conn " << p << dendl;
+    p->lock.Lock();
+    p->_stop();
+    ConnectionRef con = p->connection_state;
+    if (con && con->clear_pipe(p))
+      dispatch_queue.queue_reset(con.get());
+    p->lock.Unlock();
+  }
+  accepting_conns.clear();
+
+  while (!conns.empty()) {
+    ceph::unordered_map<entity_addr_t, AsyncConnection*>::iterator it = conns.begin();
+    AsyncConnection *p = it->second;
+    ldout(cct, 5) << __func__ << " " << it->first << " " << p << dendl;
+    conns.erase(it);
+    p->lock.Lock();
+    p->_stop();
+    ConnectionRef con = p->connection_state;
+    if (con && con->clear_pipe(p))
+      dispatch_queue.queue_reset(con.get());
+    p->lock.Unlock();
+  }
+  lock.Unlock();
+}
+
+void AsyncMessenger::mark_down(const entity_addr_t& addr)
+{
+  lock.Lock();
+  AsyncConnection *p = _lookup_conn(addr);
+  if (p) {
+    ldout(cct, 1) << __func__ << " " << addr << " -- " << p << dendl;
+    p->unregister_conn();
+    p->lock.Lock();
+    p->_stop();
+    // generate a reset event for the caller in this case, even
+    // though they asked for it, since this is the addr-based (and
+    // not Connection* based) interface
+    ConnectionRef con = p->connection_state;
+    if (con && con->clear_pipe(p))
+      dispatch_queue.queue_reset(con.get());
+    p->lock.Unlock();
+  } else {
+    ldout(cct, 1) << __func__ << " " << addr << " -- connection dne" << dendl;
+  }
+  lock.Unlock();
+}
+
+void AsyncMessenger::mark_down(Connection *con)
+{
+  if (con == NULL)
+    return;
+  lock.Lock();
+  AsyncConnection *p = static_cast<AsyncConnection *>(con->get_pipe());
+  if (p) {
+    ldout(cct, 1) << __func__ << " " << con << " -- " << p << dendl;
+    assert(p->async_msgr == this);
+    p->unregister_conn();
+    p->lock.Lock();
+    p->_stop();
+    // do not generate a reset event for the caller in this case,
+    // since they asked for it.
+    p->connection_state->clear_pipe(p);
+    p->lock.Unlock();
+    p->put();
+  } else {
+    ldout(cct, 1) << __func__ << " " << con << " -- connection dne" << dendl;
+  }
+  lock.Unlock();
+}
+
+void AsyncMessenger::mark_down_on_empty(Connection *con)
+{
+  lock.Lock();
+  AsyncConnection *p = static_cast<AsyncConnection *>(con->get_pipe());
+  if (p) {
+    assert(p->async_msgr == this);
+    p->lock.Lock();
+    p->unregister_conn();
+    if (p->out_q.empty()) {
+      ldout(cct, 1) << __func__ << " " << con << " -- " << p << " closing (queue is empty)" << dendl;
+      p->_stop();
+    } else {
+      ldout(cct, 1) << __func__ << " " << con << " -- " << p << " marking (queue is not empty)" << dendl;
+      p->close_on_empty = true;
+    }
+    p->lock.Unlock();
+    p->put();
+  } else {
+    ldout(cct, 1) << __func__ << " " << con << " -- connection dne" << dendl;
+  }
+  lock.Unlock();
+}
+
+void AsyncMessenger::mark_disposable(Connection *con)
+{
+  lock.Lock();
+  AsyncConnection *p = static_cast<AsyncConnection *>(con->get_pipe());
+  if (p) {
+    ldout(cct, 1) << __func__ << " " << con << " -- " << p << dendl;
+    assert(p->async_msgr == this);
+    p->lock.Lock();
+    p->policy.lossy = true;
+    p->lock.Unlock();
+    p->put();
+  } else {
+    ldout(cct, 1) << __func__ << " " << con << " -- connection dne" << dendl;
+  }
+  lock.Unlock();
+}
+
+void AsyncMessenger::learned_addr(const entity_addr_t &peer_addr_for_me)
+{
+  // be careful here: multiple threads may block here, and readers of
+  // my_inst.addr do NOT hold any lock.
+
+  // this always goes from true -> false under the protection of the
+  // mutex.  if it is already false, we need not retake the mutex at
+  // all.
+  if (!need_addr)
+    return;
+
+  lock.Lock();
+  if (need_addr) {
+    entity_addr_t t = peer_addr_for_me;
+    t.set_port(my_inst.addr.get_port());
+    my_inst.addr.addr = t.addr;
+    ldout(cct, 1) << __func__ << " learned my addr " << my_inst.addr << dendl;
+    need_addr = false;
+    init_local_connection();
+  }
+  lock.Unlock();
+}
+
+void AsyncMessenger::unlearn_addr()
+{
+  lock.Lock();
+  need_addr = true;
+  lock.Unlock();
+}
+
+void AsyncMessenger::init_local_connection()
+{
+  local_connection->peer_addr = my_inst.addr;
+  local_connection->peer_type = my_type;
+}
@@ -0,0 +1,366 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ASYNCMESSENGER_H
+#define CEPH_ASYNCMESSENGER_H
+
+#include "include/types.h"
+#include "include/xlist.h"
+
+#include <list>
+#include <map>
+#include <vector>
+using namespace std;
+#include "include/unordered_map.h"
+#include "include/unordered_set.h"
+
+#include "common/Mutex.h"
+#include "include/atomic.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "common/Throttle.h"
+
+#include "msg/Messenger.h"
+#include "msg/Message.h"
+#include "include/assert.h"
+#include "msg/DispatchQueue.h"
+#include "msg/MessageCompressor.h"
+#include "include/Spinlock.h"
+
+#include "AsyncConnection.h"
+#include "Event.h"
+
+class AsyncMessenger;
+
+/**
+ * A Worker is a thread running one EventCenter loop.  Every
+ * AsyncConnection is bound to exactly one Worker for its lifetime.
+ */
+class Worker : public Thread {
+  CephContext *cct;
+  bool done;
+
+ public:
+  EventCenter center;
+  Worker(CephContext *c) : cct(c), done(false), center(c) {}
+  void *entry();
+  void stop();
+};
+
+/**
+ * The Processor owns the listening socket.  Incoming connections are
+ * accepted from an event on the first Worker and handed to
+ * AsyncMessenger::add_accept().
+ */
+class Processor {
+  AsyncMessenger *msgr;
+  int listen_sd;
+  uint64_t nonce;
+  Worker *worker;
+  EventCallbackRef listen_handler;
+
+ public:
+  Processor(AsyncMessenger *r, uint64_t n);
+
+  void stop();
+  int bind(const entity_addr_t &bind_addr, const set<int>& avoid_ports);
+  int rebind(const set<int>& avoid_port);
+  int start(Worker *w);
+  void accept();
+};
+
+/*
+ * AsyncMessenger is an event-driven alternative to SimpleMessenger.
+ * Instead of two threads per Pipe it multiplexes all sockets over a
+ * small, fixed pool of Workers (ms_async_op_threads), which keeps the
+ * thread count flat as the number of peers grows.  The wire protocol,
+ * Policy handling and DispatchQueue delivery are the same as for
+ * SimpleMessenger, so the two interoperate.
+ *
+ * Lock ordering:
+ *
+ *   AsyncMessenger::lock
+ *       AsyncConnection::lock
+ *           DispatchQueue::lock
+ */
+class AsyncMessenger : public Messenger {
+  // First we have the public Messenger interface implementation...
+public:
+  /**
+   * Initialize the AsyncMessenger!
+   *
+   * @param cct The CephContext to use
+   * @param name The name to assign ourselves
+   * _nonce A unique ID to use for this AsyncMessenger. It should not
+   * be a value that will be repeated if the daemon restarts.
+   */
+  AsyncMessenger(CephContext *cct, entity_name_t name,
+		 string mname, uint64_t _nonce);
+
+  virtual ~AsyncMessenger();
+
+  /** @defgroup Accessors
+   * @{
+   */
+  void set_addr_unknowns(entity_addr_t& addr);
+
+  int get_dispatch_queue_len() {
+    return dispatch_queue.get_queue_len();
+  }
+
+  double get_dispatch_queue_max_age(utime_t now) {
+    return dispatch_queue.get_max_age(now);
+  }
+  /** @} Accessors */
+
+  /**
+   * @defgroup Configuration functions
+   * @{
+   */
+  void set_cluster_protocol(int p) {
+    assert(!started && !did_bind);
+    cluster_protocol = p;
+  }
+
+  void set_default_policy(Policy p) {
+    Mutex::Locker l(policy_lock);
+    default_policy = p;
+  }
+
+  void set_policy(int type, Policy p) {
+    Mutex::Locker l(policy_lock);
+    policy_map[type] = p;
+  }
+
+  void set_policy_throttlers(int type, Throttle *byte_throttle, Throttle *msg_throttle) {
+    Mutex::Locker l(policy_lock);
+    if (policy_map.count(type)) {
+      policy_map[type].throttler_bytes = byte_throttle;
+      policy_map[type].throttler_messages = msg_throttle;
+    } else {
+      default_policy.throttler_bytes = byte_throttle;
+      default_policy.throttler_messages = msg_throttle;
+    }
+  }
+
+  void set_policy_conn_throttle(int type, uint64_t bytes, uint64_t msgs) {
+    Mutex::Locker l(policy_lock);
+    if (policy_map.count(type)) {
+      policy_map[type].conn_throttle_bytes = bytes;
+      policy_map[type].conn_throttle_messages = msgs;
+    } else {
+      default_policy.conn_throttle_bytes = bytes;
+      default_policy.conn_throttle_messages = msgs;
+    }
+  }
+
+  int bind(const entity_addr_t& bind_addr);
+  int rebind(const set<int>& avoid_ports);
+
+  /** @} Configuration functions */
+
+  /**
+   * @defgroup Startup/Shutdown
+   * @{
+   */
+  virtual int start();
+  virtual void wait();
+  virtual int shutdown();
+
+  /** @} // Startup/Shutdown */
+
+  /**
+   * @defgroup Messaging
+   * @{
+   */
+  virtual int send_message(Message *m, const entity_inst_t& dest) {
+    return _send_message(m, dest, false);
+  }
+
+  virtual int send_message(Message *m, Connection *con) {
+    return _send_message(m, con, false);
+  }
+
+  virtual int lazy_send_message(Message *m, const entity_inst_t& dest) {
+    return _send_message(m, dest, true);
+  }
+
+  virtual int lazy_send_message(Message *m, Connection *con) {
+    return _send_message(m, con, true);
+  }
+  /** @} // Messaging */
+
+  /**
+   * @defgroup Connection Management
+   * @{
+   */
+  virtual ConnectionRef get_connection(const entity_inst_t& dest);
+  virtual ConnectionRef get_loopback_connection();
+  virtual int send_keepalive(const entity_inst_t& addr);
+  virtual int send_keepalive(Connection *con);
+  virtual void mark_down(const entity_addr_t& addr);
+  virtual void mark_down(Connection *con);
+  virtual void mark_down_on_empty(Connection *con);
+  virtual void mark_disposable(Connection *con);
+  virtual void mark_down_all();
+  /** @} // Connection Management */
+
+protected:
+  /**
+   * Start up the DispatchQueue thread and the Processor once we have
+   * somebody to dispatch to.
+   */
+  virtual void ready();
+
+private:
+  /// pick the Worker a new connection is bound to (round robin)
+  Worker *get_worker();
+
+  /**
+   * Create an AsyncConnection to the given entity and start connecting.
+   * Assumes lock is held.
+   *
+   * @return the new connection. Caller does not own a reference.
+   */
+  AsyncConnection *create_connect(const entity_addr_t& addr, int type,
+				  Connection *con, Message *first);
+
+  int _send_message(Message *m, const entity_inst_t& dest, bool lazy);
+  int _send_message(Message *m, Connection *con, bool lazy);
+  void submit_message(Message *m, Connection *con,
+		      const entity_addr_t& addr, int dest_type, bool lazy);
+
+  AsyncConnection *_lookup_conn(const entity_addr_t& k) {
+    assert(lock.is_locked());
+    ceph::unordered_map<entity_addr_t, AsyncConnection*>::iterator p = conns.find(k);
+    if (p == conns.end())
+      return NULL;
+    // a closed connection may linger in the map until it is reaped
+    if (p->second->is_closed())
+      return NULL;
+    return p->second;
+  }
+
+  /// the peer type of our endpoint
+  int my_type;
+  /// approximately unique ID set by the Constructor for use in entity_addr_t
+  uint64_t nonce;
+  vector<Worker*> workers;
+  unsigned next_worker;
+  Processor processor;
+
+public:
+  DispatchQueue dispatch_queue;
+  MessageCompressor compressor;
+
+  friend class Processor;
+  friend class AsyncConnection;
+
+  /**
+   * Register a new connection for an accepted socket.
+   *
+   * @param sd socket
+   */
+  AsyncConnection *add_accept(int sd);
+
+private:
+  /// overall lock used for AsyncMessenger data structures
+  Mutex lock;
+  /// true, specifying we haven't learned our addr; set false when we find it.
+  bool need_addr;
+  /// true if we bound to a specific address; cleared by Processor::stop()
+  bool did_bind;
+  /// counter for the global seq our connection protocol uses
+  __u32 global_seq;
+  /// lock to protect the global_seq
+  ceph_spinlock_t global_seq_lock;
+
+  /**
+   * hash map of addresses to connections
+   *
+   * NOTE: a connection with state CLOSED may still be in the map but is
+   * considered invalid and can be replaced by anyone holding the msgr lock
+   */
+  ceph::unordered_map<entity_addr_t, AsyncConnection*> conns;
+  /// connections that are still in the accept handshake
+  set<AsyncConnection*> accepting_conns;
+  /// every live connection; each entry holds a reference
+  set<AsyncConnection*> all_conns;
+
+  /// internal cluster protocol version, if any, for talking to entities of the same type.
+  int cluster_protocol;
+
+  /// lock protecting policy
+  Mutex policy_lock;
+  /// the default Policy we use for connections
+  Policy default_policy;
+  /// map specifying different Policies for specific peer types
+  map<int, Policy> policy_map; // entity_name_t::type -> Policy
+
+  /// signaled whenever a connection is reaped
+  Cond stop_cond;
+
+public:
+  /// con used for sending messages to ourselves
+  ConnectionRef local_connection;
+
+  /**
+   * @defgroup AsyncMessenger internals
+   * @{
+   */
+  AuthAuthorizer *get_authorizer(int peer_type, bool force_new);
+  bool verify_authorizer(Connection *con, int peer_type, int protocol, bufferlist& auth, bufferlist& auth_reply,
+			 bool& isvalid, CryptoKey& session_key);
+
+  __u32 get_global_seq(__u32 old=0) {
+    ceph_spin_lock(&global_seq_lock);
+    if (old > global_seq)
+      global_seq = old;
+    __u32 ret = ++global_seq;
+    ceph_spin_unlock(&global_seq_lock);
+    return ret;
+  }
+  int get_proto_version(int peer_type, bool connect);
+  int get_my_type() const { return my_type; }
+  bool get_need_addr() const { return need_addr; }
+
+  void init_local_connection();
+  void learned_addr(const entity_addr_t& peer_addr_for_me);
+  void unlearn_addr();
+
+  Policy get_policy(int t) {
+    Mutex::Locker l(policy_lock);
+    if (policy_map.count(t))
+      return policy_map[t];
+    else
+      return default_policy;
+  }
+  Policy get_default_policy() {
+    Mutex::Locker l(policy_lock);
+    return default_policy;
+  }
+
+  void dispatch_throttle_release(uint64_t msize) {
+    dispatch_queue.dispatch_throttle_release(msize);
+  }
+
+  /**
+   * Drop the messenger's reference to a connection whose socket has
+   * been torn down.  Called by the connection itself, from its Worker.
+   */
+  void queue_reap(AsyncConnection *conn);
+  /**
+   * @} // AsyncMessenger Internals
+   */
+};
+
+#endif
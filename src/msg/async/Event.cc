@@ -0,0 +1,311 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common/errno.h"
+#include "common/debug.h"
+#include "common/Clock.h"
+#include "Event.h"
+#include "EventEpoll.h"
+
+#define dout_subsys ceph_subsys_ms
+
+#undef dout_prefix
+#define dout_prefix *_dout << "Event "
+
+/**
+ * Drains the notify pipe; the wakeup itself is the point.
+ */
+class C_handle_notify : public EventCallback {
+ public:
+  C_handle_notify() {}
+  void do_request(int fd) {
+    char c[256];
+    int r;
+    do {
+      r = ::read(fd, c, sizeof(c));
+    } while (r > 0 || (r < 0 && errno == EINTR));
+  }
+};
+
+int EventCenter::init(int nevent)
+{
+  // can't init multi times
+  assert(!driver);
+
+  driver = new EpollDriver(cct);
+  int r = driver->init(nevent);
+  if (r < 0) {
+    lderr(cct) << __func__ << " failed to init event driver: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    r = -errno;
+    lderr(cct) << __func__ << " can't create notify pipe: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  notify_receive_fd = fds[0];
+  notify_send_fd = fds[1];
+  for (int i = 0; i < 2; i++) {
+    int flags = fcntl(fds[i], F_GETFL);
+    if (flags < 0 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) < 0) {
+      r = -errno;
+      lderr(cct) << __func__ << " failed to set notify pipe nonblocking: "
+		 << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+
+  notify_handler = EventCallbackRef(new C_handle_notify());
+  return create_file_event(notify_receive_fd, EVENT_READABLE, notify_handler);
+}
+
+EventCenter::~EventCenter()
+{
+  if (notify_receive_fd >= 0) {
+    delete_file_event(notify_receive_fd, EVENT_READABLE);
+    ::close(notify_receive_fd);
+  }
+  if (notify_send_fd >= 0)
+    ::close(notify_send_fd);
+
+  delete driver;
+}
+
+int EventCenter::create_file_event(int fd, int mask, EventCallbackRef ctxt)
+{
+  int r = 0;
+  {
+    Mutex::Locker l(lock);
+    FileEvent &event = file_events[fd];
+    ldout(cct, 20) << __func__ << " create event fd=" << fd << " mask=" << mask
+		   << " original mask is " << event.mask << dendl;
+    if ((event.mask & mask) != mask) {
+      r = driver->add_event(fd, event.mask, mask);
+      if (r < 0) {
+	if (event.mask == EVENT_NONE)
+	  file_events.erase(fd);
+	return r;
+      }
+    }
+
+    event.mask |= mask;
+    if (mask & EVENT_READABLE)
+      event.read_cb = ctxt;
+    if (mask & EVENT_WRITABLE)
+      event.write_cb = ctxt;
+  }
+  if (!in_thread())
+    wakeup();
+  return r;
+}
+
+void EventCenter::delete_file_event(int fd, int mask)
+{
+  Mutex::Locker l(lock);
+  std::map<int, FileEvent>::iterator it = file_events.find(fd);
+  if (it == file_events.end())
+    return;
+
+  FileEvent &event = it->second;
+  ldout(cct, 20) << __func__ << " delete fd=" << fd << " mask=" << mask
+		 << " original mask is " << event.mask << dendl;
+  int del = event.mask & mask;
+  if (del)
+    driver->del_event(fd, event.mask, del);
+
+  if (mask & EVENT_READABLE)
+    event.read_cb.reset();
+  if (mask & EVENT_WRITABLE)
+    event.write_cb.reset();
+
+  event.mask = event.mask & (~mask);
+  if (event.mask == EVENT_NONE)
+    file_events.erase(it);
+}
+
+uint64_t EventCenter::create_time_event(uint64_t microseconds, EventCallbackRef ctxt)
+{
+  uint64_t id;
+  bool earliest;
+  {
+    Mutex::Locker l(lock);
+    utime_t expire = ceph_clock_now(cct);
+    expire += utime_t(microseconds / 1000000, (microseconds % 1000000) * 1000);
+
+    TimeEvent event;
+    id = time_event_next_id++;
+    event.id = id;
+    event.time_cb = ctxt;
+    std::multimap<utime_t, TimeEvent>::iterator it =
+      time_events.insert(make_pair(expire, event));
+    time_event_ids[id] = it;
+    earliest = (it == time_events.begin());
+
+    ldout(cct, 10) << __func__ << " id=" << id << " trigger after "
+		   << microseconds << "us" << dendl;
+  }
+  if (earliest && !in_thread())
+    wakeup();
+  return id;
+}
+
+void EventCenter::delete_time_event(uint64_t id)
+{
+  Mutex::Locker l(lock);
+  ldout(cct, 10) << __func__ << " id=" << id << dendl;
+  std::map<uint64_t, std::multimap<utime_t, TimeEvent>::iterator>::iterator it =
+    time_event_ids.find(id);
+  if (it == time_event_ids.end())
+    return;
+  time_events.erase(it->second);
+  time_event_ids.erase(it);
+}
+
+void EventCenter::wakeup()
+{
+  ldout(cct, 20) << __func__ << dendl;
+  char buf[1];
+  buf[0] = 'c';
+  // wake up "event_wait"; it does not matter if the pipe is already full
+  int n = write(notify_send_fd, buf, 1);
+  (void)n;
+}
+
+void EventCenter::dispatch_event_external(EventCallbackRef e)
+{
+  external_lock.Lock();
+  external_events.push_back(e);
+  external_lock.Unlock();
+  if (!in_thread())
+    wakeup();
+}
+
+int EventCenter::process_time_events()
+{
+  int processed = 0;
+  utime_t now = ceph_clock_now(cct);
+  ldout(cct, 20) << __func__ << " cur time is " << now << dendl;
+
+  while (true) {
+    EventCallbackRef cb;
+    uint64_t id;
+    {
+      Mutex::Locker l(lock);
+      std::multimap<utime_t, TimeEvent>::iterator it = time_events.begin();
+      if (it == time_events.end() || it->first > now)
+	break;
+      id = it->second.id;
+      cb = it->second.time_cb;
+      time_event_ids.erase(id);
+      time_events.erase(it);
+    }
+    ldout(cct, 10) << __func__ << " process time event: id=" << id << dendl;
+    cb->do_request(id);
+    processed++;
+  }
+
+  return processed;
+}
+
+int EventCenter::process_events(int timeout_microseconds)
+{
+  struct timeval tv;
+  int numevents;
+  bool trigger_time = false;
+
+  utime_t now = ceph_clock_now(cct);
+  utime_t period(timeout_microseconds / 1000000,
+		 (timeout_microseconds % 1000000) * 1000);
+  utime_t end_time = now;
+  end_time += period;
+
+  {
+    Mutex::Locker l(lock);
+    if (!time_events.empty() && time_events.begin()->first <= end_time) {
+      end_time = time_events.begin()->first;
+      trigger_time = true;
+    }
+  }
+
+  {
+    Mutex::Locker l(external_lock);
+    if (!external_events.empty())
+      end_time = now;
+  }
+
+  if (end_time > now) {
+    utime_t left = end_time - now;
+    tv.tv_sec = left.sec();
+    tv.tv_usec = left.usec();
+  } else {
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+  }
+
+  ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec
+		 << " usec " << tv.tv_usec << dendl;
+  std::vector<FiredFileEvent> fired_events;
+  numevents = driver->event_wait(fired_events, &tv);
+  for (int j = 0; j < numevents; j++) {
+    int rfired = 0;
+    EventCallbackRef read_cb, write_cb;
+    {
+      Mutex::Locker l(lock);
+      std::map<int, FileEvent>::iterator it = file_events.find(fired_events[j].fd);
+      if (it == file_events.end())
+	continue;
+      // take refs so that the handler may delete its own event
+      if (it->second.mask & fired_events[j].mask & EVENT_READABLE)
+	read_cb = it->second.read_cb;
+      if (it->second.mask & fired_events[j].mask & EVENT_WRITABLE)
+	write_cb = it->second.write_cb;
+    }
+
+    if (read_cb) {
+      rfired = 1;
+      read_cb->do_request(fired_events[j].fd);
+    }
+
+    if (write_cb) {
+      if (!rfired || write_cb != read_cb)
+	write_cb->do_request(fired_events[j].fd);
+    }
+
+    ldout(cct, 20) << __func__ << " event_wq process is " << fired_events[j].fd
+		   << " mask is " << fired_events[j].mask << dendl;
+  }
+
+  if (trigger_time)
+    numevents += process_time_events();
+
+  std::deque<EventCallbackRef> cur_process;
+  external_lock.Lock();
+  cur_process.swap(external_events);
+  external_lock.Unlock();
+  while (!cur_process.empty()) {
+    EventCallbackRef e = cur_process.front();
+    cur_process.pop_front();
+    ldout(cct, 20) << __func__ << " do " << e << dendl;
+    e->do_request(0);
+    numevents++;
+  }
+  return numevents;
+}
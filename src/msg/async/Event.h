@@ -0,0 +1,133 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_EVENT_H
+#define CEPH_MSG_EVENT_H
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <map>
+#include <deque>
+#include <vector>
+
+#include "include/memory.h"
+#include "include/utime.h"
+#include "common/Mutex.h"
+
+class CephContext;
+
+#define EVENT_NONE 0
+#define EVENT_READABLE 1
+#define EVENT_WRITABLE 2
+
+/**
+ * EventCallback is the unit of work run by an EventCenter.  File events
+ * are called with the fd that fired, time events with their id, and
+ * external events with 0.
+ */
+class EventCallback {
+ public:
+  virtual void do_request(int fd_or_id) = 0;
+  virtual ~EventCallback() {}
+};
+
+typedef ceph::shared_ptr<EventCallback> EventCallbackRef;
+
+struct FiredFileEvent {
+  int fd;
+  int mask;
+};
+
+/**
+ * EventDriver is the wrapper around the OS readiness notification
+ * facility (epoll on linux).
+ */
+class EventDriver {
+ public:
+  virtual ~EventDriver() {}
+  virtual int init(int nevent) = 0;
+  virtual int add_event(int fd, int cur_mask, int add_mask) = 0;
+  virtual int del_event(int fd, int cur_mask, int del_mask) = 0;
+  /// wait for events, @return number of fired events or negative error
+  virtual int event_wait(std::vector<FiredFileEvent> &fired_events,
+			 struct timeval *tp) = 0;
+};
+
+/**
+ * EventCenter multiplexes file, timer and externally queued events for
+ * a single thread.
+ *
+ * All methods may be called from any thread; the loop itself
+ * (process_events) must only be driven by the owning thread.  When an
+ * event is registered from a foreign thread the loop is woken up so
+ * that the change takes effect immediately.
+ */
+class EventCenter {
+  struct FileEvent {
+    int mask;
+    EventCallbackRef read_cb;
+    EventCallbackRef write_cb;
+    FileEvent() : mask(EVENT_NONE) {}
+  };
+
+  struct TimeEvent {
+    uint64_t id;
+    EventCallbackRef time_cb;
+    TimeEvent() : id(0) {}
+  };
+
+  CephContext *cct;
+  Mutex lock;
+  std::map<int, FileEvent> file_events;
+  std::multimap<utime_t, TimeEvent> time_events;
+  std::map<uint64_t, std::multimap<utime_t, TimeEvent>::iterator> time_event_ids;
+  uint64_t time_event_next_id;
+  EventDriver *driver;
+
+  Mutex external_lock;
+  std::deque<EventCallbackRef> external_events;
+
+  int notify_receive_fd;
+  int notify_send_fd;
+  pthread_t owner;
+  EventCallbackRef notify_handler;
+
+  int process_time_events();
+
+ public:
+  EventCenter(CephContext *c)
+    : cct(c), lock("EventCenter::lock"),
+      time_event_next_id(1), driver(NULL),
+      external_lock("EventCenter::external_lock"),
+      notify_receive_fd(-1), notify_send_fd(-1), owner(0) {}
+  ~EventCenter();
+
+  int init(int nevent);
+  /// bind the center to the calling thread
+  void set_owner(pthread_t p) { owner = p; }
+  bool in_thread() const { return pthread_equal(pthread_self(), owner); }
+
+  int create_file_event(int fd, int mask, EventCallbackRef ctxt);
+  void delete_file_event(int fd, int mask);
+  /// schedule ctxt to run in @a microseconds; @return the event id
+  uint64_t create_time_event(uint64_t microseconds, EventCallbackRef ctxt);
+  void delete_time_event(uint64_t id);
+  /// queue ctxt to be run by the owning thread
+  void dispatch_event_external(EventCallbackRef e);
+  void wakeup();
+
+  /// run one iteration of the loop, blocking at most timeout_microseconds
+  int process_events(int timeout_microseconds);
+};
+
+#endif
@@ -0,0 +1,36 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MSG_EVENTEPOLL_H
+#define CEPH_MSG_EVENTEPOLL_H
+
+#include <sys/epoll.h>
+
+#include "Event.h"
+
+class EpollDriver : public EventDriver {
+  int epfd;
+  struct epoll_event *events;
+  CephContext *cct;
+  int size;
+
+ public:
+  EpollDriver(CephContext *c) : epfd(-1), events(NULL), cct(c), size(0) {}
+  virtual ~EpollDriver();
+
+  int init(int nevent);
+  int add_event(int fd, int cur_mask, int add_mask);
+  int del_event(int fd, int cur_mask, int del_mask);
+  int event_wait(std::vector<FiredFileEvent> &fired_events, struct timeval *tp);
+};
+
+#endif
@@ -278,19 +278,12 @@ int cls_cxx_getxattr(cls_method_context_t hctx, const char *name,
                      bufferlist *outbl)
 {
   ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
-  bufferlist name_data;
-  vector<OSDOp> nops(1);
-  OSDOp& op = nops[0];
-  int r;
-
-  op.op.op = CEPH_OSD_OP_GETXATTR;
-  op.indata.append(name);
-  op.op.xattr.name_len = strlen(name);
-  r = (*pctx)->pg->do_osd_ops(*pctx, nops);
+  bufferlist bl;
+  int r = (*pctx)->pg->do_cls_getxattr(*pctx, name, &bl);
   if (r < 0)
     return r;
 
-  outbl->claim(op.outdata);
+  outbl->claim(bl);
   return outbl->length();
 }
 
@@ -433,15 +426,12 @@ int cls_cxx_map_get_vals(cls_method_context_t hctx, const string &start_obj,
 int cls_cxx_map_read_header(cls_method_context_t hctx, bufferlist *outbl)
 {
   ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
-  vector<OSDOp> ops(1);
-  OSDOp& op = ops[0];
-  int ret;
-  op.op.op = CEPH_OSD_OP_OMAPGETHEADER;
-  ret = (*pctx)->pg->do_osd_ops(*pctx, ops);
+  bufferlist bl;
+  int ret = (*pctx)->pg->do_cls_omap_get_header(*pctx, &bl);
   if (ret < 0)
     return ret;
 
-  outbl->claim(op.outdata);
+  outbl->claim(bl);
 
   return 0;
 }
@@ -450,32 +440,18 @@ int cls_cxx_map_get_val(cls_method_context_t hctx, const string &key,
 			bufferlist *outbl)
 {
   ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
-  vector<OSDOp> ops(1);
-  OSDOp& op = ops[0];
-  int ret;
-
   set<string> k;
   k.insert(key);
-  ::encode(k, op.indata);
-
-  op.op.op = CEPH_OSD_OP_OMAPGETVALSBYKEYS;
-  ret = (*pctx)->pg->do_osd_ops(*pctx, ops);
+  map<string, bufferlist> m;
+  int ret = (*pctx)->pg->do_cls_omap_get_vals_by_keys(*pctx, k, &m);
   if (ret < 0)
     return ret;
 
-  bufferlist::iterator iter = op.outdata.begin();
-  try {
-    map<string, bufferlist> m;
+  map<string, bufferlist>::iterator iter = m.begin();
+  if (iter == m.end())
+    return -ENOENT;
 
-    ::decode(m, iter);
-    map<string, bufferlist>::iterator iter = m.begin();
-    if (iter == m.end())
-      return -ENOENT;
-
-    *outbl = iter->second;
-  } catch (buffer::error& e) {
-    return -EIO;
-  }
+  outbl->claim(iter->second);
   return 0;
 }
 
@@ -548,6 +524,20 @@ int cls_cxx_map_remove_key(cls_method_context_t hctx, const string &key)
   return (*pctx)->pg->do_osd_ops(*pctx, ops);
 }
 
+int cls_cxx_map_remove_keys(cls_method_context_t hctx, const set<string> &keys)
+{
+  ReplicatedPG::OpContext **pctx = (ReplicatedPG::OpContext **)hctx;
+  vector<OSDOp> ops(1);
+  OSDOp& op = ops[0];
+  bufferlist& update_bl = op.indata;
+
+  ::encode(keys, update_bl);
+
+  op.op.op = CEPH_OSD_OP_OMAPRMKEYS;
+
+  return (*pctx)->pg->do_osd_ops(*pctx, ops);
+}
+
 int cls_gen_random_bytes(char *buf, int size)
 {
   return get_random_bytes(buf, size);
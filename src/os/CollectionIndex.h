@@ -183,6 +183,25 @@ protected:
   /// Call prior to removing directory
   virtual int prep_delete() { return 0; }
 
+  /**
+   * Lay the collection out for the number of objects it will hold
+   *
+   * Only done while the collection is empty; a no-op otherwise.
+   *
+   * @param [in] pg_num pg_num of the pool the collection's pg is in
+   * @param [in] expected_num_objs objects expected in the whole pool
+   * @return Error code, 0 on success
+   */
+  virtual int pre_hash_collection(
+    uint32_t pg_num,
+    uint64_t expected_num_objs
+    ) { return 0; }
+
+  /// Split the subdir at path now if it is still over-full
+  virtual int split_dir(
+    const vector<string> &path ///< [in] subdir queued for splitting
+    ) { return 0; }
+
   /// Virtual destructor
   virtual ~CollectionIndex() {}
 };
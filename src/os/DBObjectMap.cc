@@ -502,12 +502,43 @@ int DBObjectMap::DBObjectMapIteratorImpl::status()
   return r;
 }
 
+ObjectMap::Batch DBObjectMap::start_batch()
+{
+  return Batch(new DBBatch(db->get_transaction()));
+}
+
+int DBObjectMap::submit_batch(Batch batch)
+{
+  DBBatch *b = static_cast<DBBatch*>(batch.get());
+  int r = db->submit_transaction(b->t);
+  b->headers.clear();
+  b->t = db->get_transaction();
+  return r;
+}
+
+DBObjectMap::Header DBObjectMap::lookup_batch_header(DBBatch *b,
+						     const ghobject_t &oid,
+						     bool create)
+{
+  map<ghobject_t, Header>::iterator p = b->headers.find(oid);
+  if (p != b->headers.end())
+    return p->second;
+  Header header = create ? lookup_create_map_header(oid, b->t) :
+    lookup_map_header(oid);
+  if (header)
+    b->headers[oid] = header;
+  return header;
+}
+
 int DBObjectMap::set_keys(const ghobject_t &oid,
 			  const map<string, bufferlist> &set,
-			  const SequencerPosition *spos)
+			  const SequencerPosition *spos,
+			  Batch batch)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_create_map_header(oid, t);
+  DBBatch *b = static_cast<DBBatch*>(batch.get());
+  KeyValueDB::Transaction t = b ? b->t : db->get_transaction();
+  Header header = b ? lookup_batch_header(b, oid, true) :
+    lookup_create_map_header(oid, t);
   if (!header)
     return -EINVAL;
   if (check_spos(oid, header, spos))
@@ -515,21 +546,24 @@ int DBObjectMap::set_keys(const ghobject_t &oid,
 
   t->set(user_prefix(header), set);
 
-  return db->submit_transaction(t);
+  return b ? 0 : db->submit_transaction(t);
 }
 
 int DBObjectMap::set_header(const ghobject_t &oid,
 			    const bufferlist &bl,
-			    const SequencerPosition *spos)
+			    const SequencerPosition *spos,
+			    Batch batch)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
-  Header header = lookup_create_map_header(oid, t);
+  DBBatch *b = static_cast<DBBatch*>(batch.get());
+  KeyValueDB::Transaction t = b ? b->t : db->get_transaction();
+  Header header = b ? lookup_batch_header(b, oid, true) :
+    lookup_create_map_header(oid, t);
   if (!header)
     return -EINVAL;
   if (check_spos(oid, header, spos))
     return 0;
   _set_header(header, bl, t);
-  return db->submit_transaction(t);
+  return b ? 0 : db->submit_transaction(t);
 }
 
 void DBObjectMap::_set_header(Header header, const bufferlist &bl,
@@ -696,17 +730,27 @@ int DBObjectMap::need_parent(DBObjectMapIterator iter)
 
 int DBObjectMap::rm_keys(const ghobject_t &oid,
 			 const set<string> &to_clear,
-			 const SequencerPosition *spos)
+			 const SequencerPosition *spos,
+			 Batch batch)
 {
-  Header header = lookup_map_header(oid);
+  DBBatch *b = static_cast<DBBatch*>(batch.get());
+  Header header = b ? lookup_batch_header(b, oid, false) :
+    lookup_map_header(oid);
   if (!header)
     return -ENOENT;
-  KeyValueDB::Transaction t = db->get_transaction();
+  if (b && header->parent) {
+    // copying up from the parent reads the db, which must be current
+    int r = submit_batch(batch);
+    if (r < 0)
+      return r;
+    b = NULL;
+  }
+  KeyValueDB::Transaction t = b ? b->t : db->get_transaction();
   if (check_spos(oid, header, spos))
     return 0;
   t->rmkeys(user_prefix(header), to_clear);
   if (!header->parent) {
-    return db->submit_transaction(t);
+    return b ? 0 : db->submit_transaction(t);
   }
 
   // Copy up keys from parent around to_clear
@@ -1045,6 +1089,7 @@ int DBObjectMap::upgrade()
   KeyValueDB::Transaction t = db->get_transaction();
   write_state(t);
   db->submit_transaction_sync(t);
+  caches.clear();
   return 0;
 }
 
@@ -1097,6 +1142,27 @@ int DBObjectMap::sync(const ghobject_t *oid,
   return db->submit_transaction_sync(t);
 }
 
+/**
+ * Every key of header seq lives under a prefix starting with
+ * USER_PREFIX + header_key(seq), and header_key() is fixed width, so
+ * the cleared headers span one contiguous prefix range.
+ */
+void DBObjectMap::compact_cleared()
+{
+  uint64_t first, last;
+  {
+    Mutex::Locker l(header_lock);
+    if (!cleared_max)
+      return;
+    first = cleared_min;
+    last = cleared_max;
+    cleared_min = cleared_max = 0;
+  }
+  dout(10) << "compact_cleared seqs " << first << "~" << last << dendl;
+  db->compact_prefix_range_async(USER_PREFIX + header_key(first),
+				 USER_PREFIX + header_key(last + 1));
+}
+
 int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
   dout(20) << "dbobjectmap: seq is " << state.seq << dendl;
   KeyValueDB::Transaction t = _t ? _t : db->get_transaction();
@@ -1114,6 +1180,12 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(const ghobject_t &oid)
   while (map_header_in_use.count(oid))
     header_cond.Wait(header_lock);
 
+  {
+    _Header cached;
+    if (caches.lookup(oid, &cached))
+      return Header(new _Header(cached), RemoveMapHeaderOnDelete(this, oid));
+  }
+
   map<string, bufferlist> out;
   set<string> to_get;
   to_get.insert(map_header_key(oid));
@@ -1126,6 +1198,7 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(const ghobject_t &oid)
   Header ret(new _Header(), RemoveMapHeaderOnDelete(this, oid));
   bufferlist::iterator iter = out.begin()->second.begin();
   ret->decode(iter);
+  caches.add(oid, *ret);
   return ret;
 }
 
@@ -1194,6 +1267,13 @@ DBObjectMap::Header DBObjectMap::lookup_create_map_header(
 void DBObjectMap::clear_header(Header header, KeyValueDB::Transaction t)
 {
   dout(20) << "clear_header: clearing seq " << header->seq << dendl;
+  {
+    Mutex::Locker l(header_lock);
+    if (!cleared_max || header->seq < cleared_min)
+      cleared_min = header->seq;
+    if (header->seq > cleared_max)
+      cleared_max = header->seq;
+  }
   t->rmkeys_by_prefix(user_prefix(header));
   t->rmkeys_by_prefix(sys_prefix(header));
   t->rmkeys_by_prefix(complete_prefix(header));
@@ -1220,6 +1300,7 @@ void DBObjectMap::remove_map_header(const ghobject_t &oid,
   set<string> to_remove;
   to_remove.insert(map_header_key(oid));
   t->rmkeys(HOBJECT_TO_SEQ, to_remove);
+  caches.clear(oid);
 }
 
 void DBObjectMap::set_map_header(const ghobject_t &oid, _Header header,
@@ -1231,6 +1312,7 @@ void DBObjectMap::set_map_header(const ghobject_t &oid, _Header header,
   map<string, bufferlist> to_set;
   header.encode(to_set[map_header_key(oid)]);
   t->set(HOBJECT_TO_SEQ, to_set);
+  caches.add(oid, header);
 }
 
 bool DBObjectMap::check_spos(const ghobject_t &oid,
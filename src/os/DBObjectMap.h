@@ -16,6 +16,8 @@
 #include "osd/osd_types.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/config.h"
+#include "common/simple_cache.hpp"
 
 /**
  * DBObjectMap: Implements ObjectMap in terms of KeyValueDB
@@ -50,6 +52,8 @@
  * the complete set, we have to check the parent if we don't find it in the
  * key set.  During rm_keys, we copy keys from the parent and update the
  * complete set to reflect the change @see rm_keys.
+ *
+ * Leaf headers (GHOBJECT_TO_SEQ) are cached, @see caches.
  */
 class DBObjectMap : public ObjectMap {
 public:
@@ -68,20 +72,31 @@ public:
   set<uint64_t> in_use;
   set<ghobject_t> map_header_in_use;
 
+  /// seqs of headers cleared since the last compact_cleared(), under header_lock
+  uint64_t cleared_min, cleared_max;
+
   DBObjectMap(KeyValueDB *db) : db(db),
-				header_lock("DBOBjectMap")
+				header_lock("DBOBjectMap"),
+				cleared_min(0), cleared_max(0),
+				caches(g_conf->filestore_omap_header_cache_size)
     {}
 
+  Batch start_batch();
+
+  int submit_batch(Batch batch);
+
   int set_keys(
     const ghobject_t &oid,
     const map<string, bufferlist> &set,
-    const SequencerPosition *spos=0
+    const SequencerPosition *spos=0,
+    Batch batch=Batch()
     );
 
   int set_header(
     const ghobject_t &oid,
     const bufferlist &bl,
-    const SequencerPosition *spos=0
+    const SequencerPosition *spos=0,
+    Batch batch=Batch()
     );
 
   int get_header(
@@ -102,7 +117,8 @@ public:
   int rm_keys(
     const ghobject_t &oid,
     const set<string> &to_clear,
-    const SequencerPosition *spos=0
+    const SequencerPosition *spos=0,
+    Batch batch=Batch()
     );
 
   int get(
@@ -169,6 +185,9 @@ public:
   /// Ensure that all previous operations are durable
   int sync(const ghobject_t *oid=0, const SequencerPosition *spos=0);
 
+  /// Compact the key range spanned by the headers cleared so far
+  void compact_cleared();
+
   /// Util, list all objects, there must be no other concurrent access
   int list_objects(vector<ghobject_t> *objs ///< [out] objects
     );
@@ -282,6 +301,26 @@ private:
   /// Implicit lock on Header->seq
   typedef ceph::shared_ptr<_Header> Header;
 
+  /**
+   * Leaf headers by object, as last written to GHOBJECT_TO_SEQ
+   *
+   * Kept up to date by set_map_header and remove_map_header, which
+   * every change to a leaf goes through (clone, clear, rm_keys, sync).
+   */
+  SimpleLRU<ghobject_t, _Header> caches;
+
+  /// @see ObjectMap::BatchImpl
+  class DBBatch : public BatchImpl {
+  public:
+    KeyValueDB::Transaction t;
+    /// leaf headers resolved in this batch, possibly not yet in db
+    map<ghobject_t, Header> headers;
+    DBBatch(KeyValueDB::Transaction t) : t(t) {}
+  };
+
+  /// Lookup (or create) leaf header for oid, once per batch
+  Header lookup_batch_header(DBBatch *b, const ghobject_t &oid, bool create);
+
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
   string complete_prefix(Header header);
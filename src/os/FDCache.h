@@ -22,10 +22,14 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/shared_cache.hpp"
+#include "common/Formatter.h"
 #include "include/compat.h"
 
 /**
  * FD Cache
+ *
+ * Sharded by object hash, each shard with its own lock, so that
+ * lfn_open callers on different objects do not serialize.
  */
 class FDCache : public md_config_obs_t {
 public:
@@ -37,7 +41,21 @@ public:
   class FD {
   public:
     const int fd;
-    FD(int _fd) : fd(_fd) {
+
+    /// FileStore's view of the object's inline xattrs, under xattr_lock
+    enum {
+      XATTR_UNKNOWN,
+      XATTR_UNPACKED,  ///< one fs xattr each
+      XATTR_PACKED     ///< all in packed_xattrs
+    };
+    Mutex xattr_lock;
+    int xattr_state;
+    map<string, bufferptr> packed_xattrs;
+
+    FD(int _fd)
+      : fd(_fd),
+	xattr_lock("FDCache::FD::xattr_lock"),
+	xattr_state(XATTR_UNKNOWN) {
       assert(_fd >= 0);
     }
     int operator*() const {
@@ -49,14 +67,16 @@ public:
   };
 
 private:
-  SharedLRU<ghobject_t, FD> registry;
+  ShardedSharedLRU<ghobject_t, FD> registry;
   CephContext *cct;
 
 public:
-  FDCache(CephContext *cct) : cct(cct) {
+  FDCache(CephContext *cct)
+    : registry(cct->_conf->filestore_fd_cache_size,
+	       cct->_conf->filestore_fd_cache_shards),
+      cct(cct) {
     assert(cct);
     cct->_conf->add_observer(this);
-    registry.set_size(cct->_conf->filestore_fd_cache_size);
   }
   ~FDCache() {
     cct->_conf->remove_observer(this);
@@ -67,8 +87,14 @@ public:
     return registry.lookup(hoid);
   }
 
-  FDRef add(const ghobject_t &hoid, int fd) {
-    return registry.add(hoid, new FD(fd));
+  /**
+   * cache fd for hoid
+   *
+   * If another thread cached an fd for hoid first, fd is closed and
+   * the cached one is returned with *existed set.
+   */
+  FDRef add(const ghobject_t &hoid, int fd, bool *existed) {
+    return registry.add(hoid, new FD(fd), existed);
   }
 
   /// clear cached fd for hoid, subsequent lookups will get an empty FD
@@ -77,6 +103,25 @@ public:
     assert(!registry.lookup(hoid));
   }
 
+  /// count hits, misses and evictions of all shards in logger
+  void set_logger(PerfCounters *logger, int hit, int miss, int evict) {
+    registry.set_logger(logger, hit, miss, evict);
+  }
+
+  void dump(Formatter *f) {
+    f->open_array_section("shards");
+    for (unsigned i = 0; i < registry.get_num_shards(); ++i) {
+      uint64_t hits, misses, evictions;
+      registry.get_shard_stats(i, &hits, &misses, &evictions);
+      f->open_object_section("shard");
+      f->dump_unsigned("hits", hits);
+      f->dump_unsigned("misses", misses);
+      f->dump_unsigned("evictions", evictions);
+      f->close_section();
+    }
+    f->close_section();
+  }
+
   /// md_config_obs_t
   const char** get_tracked_conf_keys() const {
     static const char* KEYS[] = {
@@ -34,6 +34,12 @@
 #include "common/blkdev.h"
 #include "common/linux_version.h"
 
+#ifdef WITH_LTTNG
+#include "tracing/os.h"
+#else
+#define tracepoint(...)
+#endif
+
 #define dout_subsys ceph_subsys_journal
 #undef dout_prefix
 #define dout_prefix *_dout << "journal "
@@ -693,7 +699,7 @@ bufferptr FileJournal::prepare_header()
   ::encode(header, bl);
   bufferptr bp = buffer::create_page_aligned(get_top());
   bp.zero();
-  memcpy(bp.c_str(), bl.c_str(), bl.length());
+  bl.copy(0, bl.length(), bp.c_str());
   return bp;
 }
 
@@ -748,7 +754,7 @@ int FileJournal::prepare_multi_write(bufferlist& bl, uint64_t& orig_ops, uint64_
   off64_t queue_pos = write_pos;
 
   int eleft = g_conf->journal_max_write_entries;
-  unsigned bmax = g_conf->journal_max_write_bytes;
+  uint64_t bmax = batch_max_bytes();
 
   if (full_state != FULL_NOTFULL)
     return -ENOSPC;
@@ -787,7 +793,7 @@ int FileJournal::prepare_multi_write(bufferlist& bl, uint64_t& orig_ops, uint64_
     }
     if (bmax) {
       if (bl.length() >= bmax) {
-	dout(20) << "prepare_multi_write hit max write size " << g_conf->journal_max_write_bytes << dendl;
+	dout(20) << "prepare_multi_write hit max write size " << bmax << dendl;
 	break;
       }
     }
@@ -798,6 +804,93 @@ int FileJournal::prepare_multi_write(bufferlist& bl, uint64_t& orig_ops, uint64_
   return 0;
 }
 
+void FileJournal::batch_model_t::add(double bytes, double lat)
+{
+  // forget old samples so the model follows the device
+  const double decay = .95;
+  n = n * decay + 1;
+  sx = sx * decay + bytes;
+  sy = sy * decay + lat;
+  sxx = sxx * decay + bytes * bytes;
+  sxy = sxy * decay + bytes * lat;
+}
+
+double FileJournal::batch_model_t::per_byte() const
+{
+  double d = n * sxx - sx * sx;
+  if (d <= 0 || d < 1e-9 * n * sxx)
+    return 0;  // all writes the same size; no slope to fit
+  double r = (n * sxy - sx * sy) / d;
+  return r > 0 ? r : 0;
+}
+
+double FileJournal::batch_model_t::fixed() const
+{
+  if (n == 0)
+    return 0;
+  double r = (sy - per_byte() * sx) / n;
+  return r > 0 ? r : 0;
+}
+
+void FileJournal::batch_record(uint64_t bytes, utime_t lat)
+{
+  if (logger) {
+    logger->tinc(l_os_j_wr_lat, lat);
+    logger->hinc(l_os_j_wr_lat_bytes_hist, lat.to_nsec() / 1000, bytes);
+  }
+  Mutex::Locker l(batch_lock);
+  batch_model.add(bytes, (double)lat);
+}
+
+/**
+ * largest write that the model expects to finish within
+ * journal_batch_target_latency, capped by journal_max_write_bytes
+ */
+uint64_t FileJournal::batch_max_bytes()
+{
+  uint64_t bmax = g_conf->journal_max_write_bytes;
+  double target = g_conf->journal_batch_target_latency;
+  if (target <= 0)
+    return bmax;
+  Mutex::Locker l(batch_lock);
+  if (!batch_model.valid() || batch_model.per_byte() <= 0)
+    return bmax;
+  double slack = target - batch_model.fixed();
+  uint64_t cap = CEPH_PAGE_SIZE;
+  if (slack > 0)
+    cap = MAX(cap, (uint64_t)(slack / batch_model.per_byte()));
+  if (bmax && cap > bmax)
+    cap = bmax;
+  return cap;
+}
+
+/**
+ * how long to hold queued entries back in the hope of more
+ *
+ * Holding only pays when the fixed cost of a write (the device flush)
+ * dominates the latency of what is queued, and never longer than the
+ * latency target leaves room for or journal_batch_max_hold.
+ */
+utime_t FileJournal::batch_hold(uint64_t queued)
+{
+  double target = g_conf->journal_batch_target_latency;
+  if (target <= 0)
+    return utime_t();
+  Mutex::Locker l(batch_lock);
+  if (!batch_model.valid())
+    return utime_t();
+  double fixed = batch_model.fixed();
+  double var = batch_model.per_byte() * queued;
+  if (fixed <= var)
+    return utime_t();
+  double hold = MIN(target - fixed - var, g_conf->journal_batch_max_hold);
+  if (hold <= 0)
+    return utime_t();
+  utime_t r;
+  r.set_from_double(hold);
+  return r;
+}
+
 /*
 void FileJournal::queue_write_fin(uint64_t seq, Context *fin)
 {
@@ -835,10 +928,12 @@ void FileJournal::queue_completions_thru(uint64_t seq)
     if (logger) {
       logger->tinc(l_os_j_lat, lat);
     }
+    tracepoint(ceph_os, journal_complete,
+	       next.tracked_op ? next.tracked_op->get_seq() : 0, next.seq);
     if (next.finish)
       finisher->queue(next.finish);
     if (next.tracked_op)
-      next.tracked_op->mark_event("journaled_completion_queued");
+      next.tracked_op->mark_event(TrackedOp::EVENT_JOURNALED_COMPLETION_QUEUED);
   }
   finisher_cond.Signal();
 }
@@ -898,7 +993,7 @@ int FileJournal::prepare_single_write(bufferlist& bl, off64_t& queue_pos, uint64
   bl.append((const char*)&h, sizeof(h));
 
   if (next_write.tracked_op)
-    next_write.tracked_op->mark_event("write_thread_in_journal_buffer");
+    next_write.tracked_op->mark_event(TrackedOp::EVENT_WRITE_THREAD_IN_JOURNAL_BUFFER);
 
   // pop from writeq
   pop_write();
@@ -917,6 +1012,7 @@ void FileJournal::align_bl(off64_t pos, bufferlist& bl)
   // make sure list segments are page aligned
   if (directio && (!bl.is_page_aligned() ||
 		   !bl.is_n_page_sized())) {
+    split_page_aligned(bl);
     bl.rebuild_page_aligned();
     if ((bl.length() & ~CEPH_PAGE_MASK) != 0 ||
 	(pos & ~CEPH_PAGE_MASK) != 0)
@@ -926,6 +1022,46 @@ void FileJournal::align_bl(off64_t pos, bufferlist& bl)
   }
 }
 
+/**
+ * split page aligned segments into their whole pages and the tail
+ *
+ * Payload data usually arrives in page aligned buffers whose length is
+ * not a page multiple.  rebuild_page_aligned() would copy such a buffer
+ * whole; split off the tail so only it is consolidated with the
+ * footer and whatever follows, and the pages are written from the
+ * original buffer.
+ */
+void FileJournal::split_page_aligned(bufferlist& bl)
+{
+  bool need = false;
+  for (list<bufferptr>::const_iterator p = bl.buffers().begin();
+       p != bl.buffers().end();
+       ++p) {
+    if (p->is_page_aligned() && !p->is_n_page_sized() &&
+	p->length() > CEPH_PAGE_SIZE) {
+      need = true;
+      break;
+    }
+  }
+  if (!need)
+    return;
+
+  bufferlist out;
+  for (list<bufferptr>::const_iterator p = bl.buffers().begin();
+       p != bl.buffers().end();
+       ++p) {
+    if (p->is_page_aligned() && !p->is_n_page_sized() &&
+	p->length() > CEPH_PAGE_SIZE) {
+      unsigned head = p->length() & CEPH_PAGE_MASK;
+      out.push_back(bufferptr(*p, 0, head));
+      out.push_back(bufferptr(*p, head, p->length() - head));
+    } else {
+      out.push_back(*p);
+    }
+  }
+  bl.swap(out);
+}
+
 int FileJournal::write_bl(off64_t& pos, bufferlist& bl)
 {
   int ret;
@@ -1055,6 +1191,7 @@ void FileJournal::do_write(bufferlist& bl)
 
   utime_t lat = ceph_clock_now(g_ceph_context) - from;    
   dout(20) << "do_write latency " << lat << dendl;
+  batch_record(bl.length(), lat);
 
   write_lock.Lock();    
 
@@ -1111,6 +1248,37 @@ void FileJournal::write_thread_entry()
 	continue;
       }
     }
+
+    // adaptive batching: if nothing is in flight and the device's fixed
+    // write cost dominates, wait a little for more entries
+    {
+      bool idle = true;
+#ifdef HAVE_LIBAIO
+      if (aio) {
+	Mutex::Locker locker(aio_lock);
+	idle = aio_num == 0;
+      }
+#endif
+      utime_t hold;
+      if (idle)
+	hold = batch_hold(throttle_bytes.get_current());
+      if (hold > utime_t()) {
+	uint64_t bmax = batch_max_bytes();
+	utime_t start = ceph_clock_now(g_ceph_context);
+	utime_t until = start;
+	until += hold;
+	Mutex::Locker locker(writeq_lock);
+	while (!write_stop &&
+	       throttle_bytes.get_current() < bmax &&
+	       ceph_clock_now(g_ceph_context) < until)
+	  writeq_cond.WaitUntil(writeq_lock, until);
+	utime_t held = ceph_clock_now(g_ceph_context) - start;
+	dout(20) << "write_thread_entry held " << held << " for batching, "
+		 << throttle_bytes.get_current() << " bytes queued" << dendl;
+	if (logger)
+	  logger->tinc(l_os_j_wr_hold, held);
+      }
+    }
     
 #ifdef HAVE_LIBAIO
     if (aio) {
@@ -1289,6 +1457,7 @@ int FileJournal::write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq)
     aio_queue.push_back(aio_info(tbl, pos, bl.length() > 0 ? 0 : seq));
     aio_info& aio = aio_queue.back();
     aio.iov = iov;
+    aio.start = ceph_clock_now(g_ceph_context);
 
     io_prep_pwritev(&aio.iocb, fd, aio.iov, n, pos);
 
@@ -1359,6 +1528,7 @@ void FileJournal::write_finish_thread_entry()
 	dout(10) << "write_finish_thread_entry aio " << ai->off
 		 << "~" << ai->len << " done" << dendl;
 	ai->done = true;
+	batch_record(ai->len, ceph_clock_now(g_ceph_context) - ai->start);
       }
       check_aio_completion();
     }
@@ -1424,12 +1594,14 @@ void FileJournal::submit_entry(uint64_t seq, bufferlist& e, int alignment,
 	  << " len " << e.length()
 	  << " (" << oncommit << ")" << dendl;
   assert(e.length() > 0);
+  tracepoint(ceph_os, journal_submit,
+	     osd_op ? osd_op->get_seq() : 0, seq, e.length());
 
   dout(30) << "XXX throttle take " << e.length() << dendl;
   throttle_ops.take(1);
   throttle_bytes.take(e.length());
   if (osd_op)
-    osd_op->mark_event("commit_queued_for_journal_write");
+    osd_op->mark_event(TrackedOp::EVENT_COMMIT_QUEUED_FOR_JOURNAL_WRITE);
   if (logger) {
     logger->set(l_os_jq_max_ops, throttle_ops.get_max());
     logger->set(l_os_jq_max_bytes, throttle_bytes.get_max());
@@ -1693,11 +1865,11 @@ FileJournal::read_entry_result FileJournal::do_read_entry(
     bl = &_bl;
 
   // header
-  entry_header_t *h;
+  entry_header_t hdr, *h = &hdr;
   bufferlist hbl;
   off64_t _next_pos;
   wrap_read_bl(pos, sizeof(*h), &hbl, &_next_pos);
-  h = (entry_header_t *)hbl.c_str();
+  hbl.copy(0, sizeof(hdr), (char *)&hdr);
 
   if (!h->check_magic(pos, header.get_fsid64())) {
     dout(25) << "read_entry " << pos
@@ -1721,11 +1893,9 @@ FileJournal::read_entry_result FileJournal::do_read_entry(
     pos += h->post_pad;
 
   // footer
-  entry_header_t *f;
   bufferlist fbl;
-  wrap_read_bl(pos, sizeof(*f), &fbl, &pos);
-  f = (entry_header_t *)fbl.c_str();
-  if (memcmp(f, h, sizeof(*f))) {
+  wrap_read_bl(pos, sizeof(*h), &fbl, &pos);
+  if (!fbl.contents_equal((const char *)h, sizeof(*h))) {
     if (ss)
       *ss << "bad footer magic, partial entry";
     if (next_pos)
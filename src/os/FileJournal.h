@@ -237,6 +237,7 @@ private:
     bool done;
     uint64_t off, len;    ///< these are for debug only
     uint64_t seq;         ///< seq number to complete on aio completion, if non-zero
+    utime_t start;        ///< submit time, for the batch latency model
 
     aio_info(bufferlist& b, uint64_t o, uint64_t s)
       : iov(NULL), done(false), off(o), len(b.length()), seq(s) {
@@ -289,6 +290,26 @@ private:
   Mutex write_lock;
   bool write_stop;
 
+  /**
+   * latency model for adaptive write batching
+   *
+   * Fits lat = fixed + per_byte * bytes over recent journal writes with
+   * exponentially decayed least squares.  Protected by batch_lock.
+   */
+  struct batch_model_t {
+    double n, sx, sy, sxx, sxy;
+    batch_model_t() : n(0), sx(0), sy(0), sxx(0), sxy(0) {}
+    void add(double bytes, double lat);
+    bool valid() const { return n >= 8; }
+    double per_byte() const;
+    double fixed() const;
+  };
+  Mutex batch_lock;
+  batch_model_t batch_model;
+  void batch_record(uint64_t bytes, utime_t lat);
+  uint64_t batch_max_bytes();
+  utime_t batch_hold(uint64_t queued);
+
   Cond commit_cond;
 
   int _open(bool wr, bool create=false);
@@ -315,6 +336,7 @@ private:
   int write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq);
 
 
+  void split_page_aligned(bufferlist& bl);
   void align_bl(off64_t pos, bufferlist& bl);
   int write_bl(off64_t& pos, bufferlist& bl);
 
@@ -379,6 +401,7 @@ private:
     throttle_bytes(g_ceph_context, "filestore_bytes"),
     write_lock("FileJournal::write_lock", false, true, false, g_ceph_context),
     write_stop(false),
+    batch_lock("FileJournal::batch_lock"),
     write_thread(this),
     write_finish_thread(this) { }
   ~FileJournal() {
@@ -52,6 +52,7 @@
 #include "common/BackTrace.h"
 #include "include/types.h"
 #include "FileJournal.h"
+#include "StripedJournal.h"
 
 #include "osd/osd_types.h"
 #include "include/color.h"
@@ -65,6 +66,8 @@
 #include "common/perf_counters.h"
 #include "common/sync_filesystem.h"
 #include "common/fd.h"
+#include "include/str_list.h"
+#include "common/numa.h"
 #include "HashIndex.h"
 #include "DBObjectMap.h"
 #include "LevelDBStore.h"
@@ -76,6 +79,12 @@ using ceph::crypto::SHA1;
 
 #include "common/config.h"
 
+#ifdef WITH_LTTNG
+#include "tracing/os.h"
+#else
+#define tracepoint(...)
+#endif
+
 #define dout_subsys ceph_subsys_filestore
 #undef dout_prefix
 #define dout_prefix *_dout << "filestore(" << basedir << ") "
@@ -93,6 +102,11 @@ using ceph::crypto::SHA1;
 #define XATTR_NO_SPILL_OUT "0"
 #define XATTR_SPILL_OUT "1"
 
+// with filestore_xattr_packed, an object's inline xattrs are encoded
+// together as a map<string,bufferptr> in XATTR_PACKED_NAME, and any
+// "user.ceph.*" xattrs left on it are ignored
+#define XATTR_PACKED_NAME "user.cephos.packed"
+
 //Initial features in new superblock.
 static CompatSet get_fs_initial_compat_set() {
   CompatSet::FeatureSet ceph_osd_feature_compat;
@@ -235,7 +249,6 @@ int FileStore::lfn_open(coll_t cid,
 
   int fd, exist;
   if (!replaying) {
-    Mutex::Locker l(fdcache_lock);
     *outfd = fdcache.lookup(oid);
     if (*outfd)
       return 0;
@@ -278,14 +291,8 @@ int FileStore::lfn_open(coll_t cid,
   }
 
   if (!replaying) {
-    Mutex::Locker l(fdcache_lock);
-    *outfd = fdcache.lookup(oid);
-    if (*outfd) {
-      TEMP_FAILURE_RETRY(::close(fd));
-      return 0;
-    } else {
-      *outfd = fdcache.add(oid, fd);
-    }
+    bool existed;
+    *outfd = fdcache.add(oid, fd, &existed);
   } else {
     *outfd = FDRef(new FDCache::FD(fd));
   }
@@ -365,7 +372,6 @@ int FileStore::lfn_unlink(coll_t cid, const ghobject_t& o,
   int r = get_index(cid, &index);
   if (r < 0)
     return r;
-  Mutex::Locker l(fdcache_lock);
   {
     IndexedPath path;
     int exist;
@@ -410,6 +416,14 @@ int FileStore::lfn_unlink(coll_t cid, const ghobject_t& o,
   return index->unlink(o);
 }
 
+// journal write latency in usec from 20us to ~2.6s, size in bytes from 4KB to 32MB
+static const PerfHistogram::axis_config_d j_wr_hist_lat_axis = {
+  "latency_usec", PerfHistogram::SCALE_LOG2, 0, 20, 20
+};
+static const PerfHistogram::axis_config_d j_wr_hist_bytes_axis = {
+  "size_bytes", PerfHistogram::SCALE_LOG2, 0, 4096, 15
+};
+
 FileStore::FileStore(const std::string &base, const std::string &jdev, const char *name, bool do_update) :
   JournalingObjectStore(base),
   internal_name(name),
@@ -419,19 +433,26 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   basedir_fd(-1), current_fd(-1),
   generic_backend(NULL), backend(NULL),
   index_manager(do_update),
-  ondisk_finisher(g_ceph_context),
+  ondisk_finisher(g_ceph_context, "", g_conf->filestore_ondisk_finisher_threads),
   lock("FileStore::lock"),
   force_sync(false), sync_epoch(0),
   sync_entry_timeo_lock("sync_entry_timeo_lock"),
   timer(g_ceph_context, sync_entry_timeo_lock),
   stop(false), sync_thread(this),
-  fdcache_lock("fdcache_lock"),
+  removal_lock("FileStore::removal_lock"),
+  removal_stop(false), removal_thread(this),
+#ifdef HAVE_LIBAIO
+  aio(false), aio_ctx(0),
+  aio_lock("FileStore::aio_lock"),
+  aio_num(0), aio_stop(false),
+  aio_finish_thread(this),
+#endif
   fdcache(g_ceph_context),
   wbthrottle(g_ceph_context),
   default_osr("default"),
   op_queue_len(0), op_queue_bytes(0),
   op_throttle_lock("FileStore::op_throttle_lock"),
-  op_finisher(g_ceph_context),
+  op_finisher(g_ceph_context, "", g_conf->filestore_apply_finisher_threads),
   op_tp(g_ceph_context, "FileStore::op_tp", g_conf->filestore_op_threads, "filestore_op_threads"),
   op_wq(this, g_conf->filestore_op_thread_timeout,
 	g_conf->filestore_op_thread_suicide_timeout, &op_tp),
@@ -452,19 +473,14 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   m_journal_force_aio(g_conf->journal_force_aio),
   m_osd_rollback_to_cluster_snap(g_conf->osd_rollback_to_cluster_snap),
   m_osd_use_stale_snap(g_conf->osd_use_stale_snap),
-  m_filestore_queue_max_ops(g_conf->filestore_queue_max_ops),
-  m_filestore_queue_max_bytes(g_conf->filestore_queue_max_bytes),
-  m_filestore_queue_committing_max_ops(g_conf->filestore_queue_committing_max_ops),
-  m_filestore_queue_committing_max_bytes(g_conf->filestore_queue_committing_max_bytes),
   m_filestore_do_dump(false),
   m_filestore_dump_fmt(true),
   m_filestore_sloppy_crc(g_conf->filestore_sloppy_crc),
   m_filestore_sloppy_crc_block_size(g_conf->filestore_sloppy_crc_block_size),
-  m_fs_type(FS_TYPE_NONE),
-  m_filestore_max_inline_xattr_size(0),
-  m_filestore_max_inline_xattrs(0)
+  m_fs_type(FS_TYPE_NONE)
 {
   m_filestore_kill_at.set(g_conf->filestore_kill_at);
+  set_queue_limits_via_conf(g_conf);
 
   ostringstream oss;
   oss << basedir << "/current";
@@ -490,6 +506,10 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   plb.add_time_avg(l_os_j_lat, "journal_latency");
   plb.add_u64_counter(l_os_j_wr, "journal_wr");
   plb.add_u64_avg(l_os_j_wr_bytes, "journal_wr_bytes");
+  plb.add_time_avg(l_os_j_wr_lat, "journal_wr_latency");
+  plb.add_time_avg(l_os_j_wr_hold, "journal_wr_hold");
+  plb.add_histogram(l_os_j_wr_lat_bytes_hist, "journal_wr_latency_bytes_histogram",
+		    j_wr_hist_lat_axis, j_wr_hist_bytes_axis);
   plb.add_u64(l_os_oq_max_ops, "op_queue_max_ops");
   plb.add_u64(l_os_oq_ops, "op_queue_ops");
   plb.add_u64_counter(l_os_ops, "ops");
@@ -502,10 +522,16 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, const cha
   plb.add_u64_counter(l_os_commit, "commitcycle");
   plb.add_time_avg(l_os_commit_len, "commitcycle_interval");
   plb.add_time_avg(l_os_commit_lat, "commitcycle_latency");
+  plb.add_time_avg(l_os_commit_quiesce_lat, "commitcycle_quiesce_latency");
   plb.add_u64_counter(l_os_j_full, "journal_full");
   plb.add_time_avg(l_os_queue_lat, "queue_transaction_latency_avg");
+  plb.add_u64_counter(l_os_fdc_hit, "fdcache_hit");
+  plb.add_u64_counter(l_os_fdc_miss, "fdcache_miss");
+  plb.add_u64_counter(l_os_fdc_evict, "fdcache_evict");
+  plb.add_u64_counter(l_os_coalesced, "ops_coalesced");
 
   logger = plb.create_perf_counters();
+  fdcache.set_logger(logger, l_os_fdc_hit, l_os_fdc_miss, l_os_fdc_evict);
 
   g_ceph_context->get_perfcounters_collection()->add(logger);
   g_ceph_context->_conf->add_observer(this);
@@ -525,6 +551,7 @@ FileStore::~FileStore()
 
   if (journal)
     journal->logger = NULL;
+  fdcache.set_logger(NULL, 0, 0, 0);
   delete logger;
 
   if (m_filestore_do_dump) {
@@ -561,8 +588,16 @@ int FileStore::open_journal()
 {
   if (journalpath.length()) {
     dout(10) << "open_journal at " << journalpath << dendl;
-    journal = new FileJournal(fsid, &finisher, &sync_cond, journalpath.c_str(),
-			      m_journal_dio, m_journal_aio, m_journal_force_aio);
+    list<string> paths;
+    get_str_list(journalpath, ",", paths);
+    if (paths.size() > 1)
+      journal = new StripedJournal(fsid, &finisher, &sync_cond, paths,
+				   m_journal_dio, m_journal_aio,
+				   m_journal_force_aio);
+    else
+      journal = new FileJournal(fsid, &finisher, &sync_cond,
+				journalpath.c_str(), m_journal_dio,
+				m_journal_aio, m_journal_force_aio);
     if (journal)
       journal->logger = logger;
   }
@@ -576,7 +611,15 @@ int FileStore::dump_journal(ostream& out)
   if (!journalpath.length())
     return -EINVAL;
 
-  FileJournal *journal = new FileJournal(fsid, &finisher, &sync_cond, journalpath.c_str(), m_journal_dio);
+  list<string> paths;
+  get_str_list(journalpath, ",", paths);
+  Journal *journal;
+  if (paths.size() > 1)
+    journal = new StripedJournal(fsid, &finisher, &sync_cond, paths,
+				 m_journal_dio);
+  else
+    journal = new FileJournal(fsid, &finisher, &sync_cond,
+			      journalpath.c_str(), m_journal_dio);
   r = journal->dump(out);
   delete journal;
   return r;
@@ -728,18 +771,42 @@ int FileStore::mkfs()
   }
 
   {
-    leveldb::Options options;
-    options.create_if_missing = true;
-    leveldb::DB *db;
-    leveldb::Status status = leveldb::DB::Open(options, omap_dir, &db);
-    if (status.ok()) {
-      delete db;
-      dout(1) << "leveldb db exists/created" << dendl;
-    } else {
-      derr << "mkfs failed to create leveldb: " << status.ToString() << dendl;
+    // the omap backend is fixed when the omap is created; stores that
+    // predate the omap_backend marker are leveldb
+    string omap_backend;
+    ret = read_meta("omap_backend", &omap_backend);
+    if (ret == -ENOENT) {
+      struct stat st;
+      if (::stat(omap_dir.c_str(), &st) == 0)
+	omap_backend = "leveldb";
+      else
+	omap_backend = g_conf->filestore_omap_backend;
+      ret = write_meta("omap_backend", omap_backend);
+    }
+    if (ret < 0) {
+      derr << "mkfs failed to record omap backend: " << cpp_strerror(ret)
+	   << dendl;
+      goto close_fsid_fd;
+    }
+
+    KeyValueDB *omap_store = KeyValueDB::create(g_ceph_context, omap_backend,
+						omap_dir);
+    if (!omap_store) {
+      derr << "mkfs: unsupported omap backend " << omap_backend << dendl;
+      ret = -EINVAL;
+      goto close_fsid_fd;
+    }
+    omap_store->init();
+    stringstream err;
+    if (omap_store->create_and_open(err)) {
+      delete omap_store;
+      derr << "mkfs failed to create " << omap_backend << ": " << err.str()
+	   << dendl;
       ret = -1;
       goto close_fsid_fd;
     }
+    delete omap_store;
+    dout(1) << omap_backend << " db exists/created" << dendl;
   }
 
   // journal?
@@ -1330,30 +1397,51 @@ int FileStore::mount()
   }
 
   {
-    LevelDBStore *omap_store = new LevelDBStore(g_ceph_context, omap_dir);
+    string omap_backend;
+    ret = read_meta("omap_backend", &omap_backend);
+    if (ret == -ENOENT) {
+      omap_backend = "leveldb";
+    } else if (ret < 0) {
+      derr << "Error reading omap backend: " << cpp_strerror(ret) << dendl;
+      goto close_current_fd;
+    }
+
+    KeyValueDB *omap_store = KeyValueDB::create(g_ceph_context, omap_backend,
+						omap_dir);
+    if (!omap_store) {
+      derr << "mount: unsupported omap backend " << omap_backend << dendl;
+      ret = -EINVAL;
+      goto close_current_fd;
+    }
 
     omap_store->init();
-    if (g_conf->osd_leveldb_write_buffer_size)
-      omap_store->options.write_buffer_size = g_conf->osd_leveldb_write_buffer_size;
-    if (g_conf->osd_leveldb_cache_size)
-      omap_store->options.cache_size = g_conf->osd_leveldb_cache_size;
-    if (g_conf->osd_leveldb_block_size)
-      omap_store->options.block_size = g_conf->osd_leveldb_block_size;
-    if (g_conf->osd_leveldb_bloom_size)
-      omap_store->options.bloom_size = g_conf->osd_leveldb_bloom_size;
-    if (g_conf->osd_leveldb_compression)
-      omap_store->options.compression_enabled = g_conf->osd_leveldb_compression;
-    if (g_conf->osd_leveldb_paranoid)
-      omap_store->options.paranoid_checks = g_conf->osd_leveldb_paranoid;
-    if (g_conf->osd_leveldb_max_open_files)
-      omap_store->options.max_open_files = g_conf->osd_leveldb_max_open_files;
-    if (g_conf->osd_leveldb_log.length())
-      omap_store->options.log_file = g_conf->osd_leveldb_log;
+    if (omap_backend == "leveldb") {
+      LevelDBStore *ldb = static_cast<LevelDBStore*>(omap_store);
+      if (g_conf->osd_leveldb_write_buffer_size)
+	ldb->options.write_buffer_size = g_conf->osd_leveldb_write_buffer_size;
+      if (g_conf->osd_leveldb_cache_size)
+	ldb->options.cache_size = g_conf->osd_leveldb_cache_size;
+      if (g_conf->osd_leveldb_block_size)
+	ldb->options.block_size = g_conf->osd_leveldb_block_size;
+      if (g_conf->osd_leveldb_bloom_size)
+	ldb->options.bloom_size = g_conf->osd_leveldb_bloom_size;
+      if (g_conf->osd_leveldb_compression)
+	ldb->options.compression_enabled = g_conf->osd_leveldb_compression;
+      if (g_conf->osd_leveldb_paranoid)
+	ldb->options.paranoid_checks = g_conf->osd_leveldb_paranoid;
+      if (g_conf->osd_leveldb_max_open_files)
+	ldb->options.max_open_files = g_conf->osd_leveldb_max_open_files;
+      if (g_conf->osd_leveldb_log.length())
+	ldb->options.log_file = g_conf->osd_leveldb_log;
+      ldb->options.compact_range_interval =
+	g_conf->osd_leveldb_compact_range_interval;
+    }
 
     stringstream err;
     if (omap_store->create_and_open(err)) {
       delete omap_store;
-      derr << "Error initializing leveldb: " << err.str() << dendl;
+      derr << "Error initializing " << omap_backend << ": " << err.str()
+	   << dendl;
       ret = -1;
       goto close_current_fd;
     }
@@ -1472,6 +1560,27 @@ int FileStore::mount()
 
   journal_start();
 
+  if (!g_conf->filestore_op_thread_cpus.empty()) {
+    set<int> cpus;
+    if (parse_cpu_list(g_conf->filestore_op_thread_cpus, &cpus) < 0)
+      derr << "mount ignoring bad filestore_op_thread_cpus '"
+	   << g_conf->filestore_op_thread_cpus << "'" << dendl;
+    else
+      op_tp.set_affinity(cpus);
+  }
+
+#ifdef HAVE_LIBAIO
+  if (g_conf->filestore_aio) {
+    ret = aio_start();
+    if (ret < 0)
+      derr << "mount unable to start aio data writes: " << cpp_strerror(ret)
+	   << ", falling back to synchronous writes" << dendl;
+    ret = 0;
+  }
+#endif
+
+  index_manager.start();
+  removal_start();
   op_tp.start();
   op_finisher.start();
   ondisk_finisher.start();
@@ -1495,6 +1604,103 @@ done:
   return ret;
 }
 
+void FileStore::removal_start()
+{
+  char removed[PATH_MAX];
+  snprintf(removed, sizeof(removed), "%s/removed", current_fn.c_str());
+  Mutex::Locker l(removal_lock);
+  // whatever journal replay queued is in here too
+  removal_queue.clear();
+  DIR *dir = ::opendir(removed);
+  if (dir) {
+    char buf[offsetof(struct dirent, d_name) + PATH_MAX + 1];
+    struct dirent *de;
+    while (::readdir_r(dir, (struct dirent *)&buf, &de) == 0 && de) {
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+	continue;
+      removal_queue.push_back(string(removed) + "/" + de->d_name);
+    }
+    ::closedir(dir);
+  }
+  if (!removal_queue.empty())
+    dout(0) << "mount " << removal_queue.size()
+	    << " removed collections left to delete" << dendl;
+  removal_stop = false;
+  removal_thread.create();
+}
+
+void FileStore::removal_shutdown()
+{
+  removal_lock.Lock();
+  removal_stop = true;
+  removal_cond.Signal();
+  removal_lock.Unlock();
+  removal_thread.join();
+}
+
+void FileStore::removal_entry()
+{
+  removal_lock.Lock();
+  while (!removal_stop) {
+    if (removal_queue.empty()) {
+      removal_cond.Wait(removal_lock);
+      continue;
+    }
+    string path = removal_queue.front();
+    removal_lock.Unlock();
+    dout(10) << "removal_entry deleting " << path << dendl;
+    int r = _remove_tree(path);
+    if (r < 0 && r != -EINTR)
+      derr << "removal_entry failed to delete " << path << ": "
+	   << cpp_strerror(r) << dendl;
+    removal_lock.Lock();
+    // a failed delete is retried at the next mount
+    if (r != -EINTR)
+      removal_queue.pop_front();
+  }
+  removal_lock.Unlock();
+}
+
+/// rm -r, giving up with -EINTR if we are stopping
+int FileStore::_remove_tree(const string &path)
+{
+  DIR *dir = ::opendir(path.c_str());
+  if (!dir)
+    return errno == ENOENT ? 0 : -errno;
+  int r = 0;
+  char buf[offsetof(struct dirent, d_name) + PATH_MAX + 1];
+  struct dirent *de;
+  while ((r = ::readdir_r(dir, (struct dirent *)&buf, &de)) == 0 && de) {
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+      continue;
+    string sub = path + "/" + de->d_name;
+    if (::unlink(sub.c_str()) == 0 || errno == ENOENT)
+      continue;
+    if (errno != EISDIR && errno != EPERM) {
+      r = -errno;
+      break;
+    }
+    {
+      Mutex::Locker l(removal_lock);
+      if (removal_stop) {
+	r = -EINTR;
+	break;
+      }
+    }
+    r = _remove_tree(sub);
+    if (r < 0)
+      break;
+  }
+  ::closedir(dir);
+  if (r > 0)
+    r = -r;
+  if (r < 0)
+    return r;
+  if (::rmdir(path.c_str()) < 0 && errno != ENOENT)
+    return -errno;
+  return 0;
+}
+
 int FileStore::umount() 
 {
   dout(5) << "umount " << basedir << dendl;
@@ -1509,6 +1715,11 @@ int FileStore::umount()
   sync_thread.join();
   wbthrottle.stop();
   op_tp.stop();
+  index_manager.stop();
+  removal_shutdown();
+#ifdef HAVE_LIBAIO
+  aio_shutdown();
+#endif
 
   journal_stop();
 
@@ -1616,12 +1827,13 @@ void FileStore::queue_op(OpSequencer *osr, Op *o)
 void FileStore::op_queue_reserve_throttle(Op *o, ThreadPool::TPHandle *handle)
 {
   // Do not call while holding the journal lock!
-  uint64_t max_ops = m_filestore_queue_max_ops;
-  uint64_t max_bytes = m_filestore_queue_max_bytes;
+  queue_limits_t limits = m_filestore_queue_limits.get();
+  uint64_t max_ops = limits.max_ops;
+  uint64_t max_bytes = limits.max_bytes;
 
   if (backend->can_checkpoint() && is_committing()) {
-    max_ops += m_filestore_queue_committing_max_ops;
-    max_bytes += m_filestore_queue_committing_max_bytes;
+    max_ops += limits.committing_max_ops;
+    max_bytes += limits.committing_max_bytes;
   }
 
   logger->set(l_os_oq_max_ops, max_ops);
@@ -1680,7 +1892,9 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
 
   osr->apply_lock.Lock();
   Op *o = osr->peek_queue();
-  apply_manager.op_apply_start(o->op);
+  apply_manager.op_apply_start(o->op, &handle);
+  tracepoint(ceph_os, apply_start,
+	     o->osd_op ? o->osd_op->get_seq() : 0, o->op, o->bytes);
   dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
   int r = _do_transactions(o->tls, o->op, &handle);
   apply_manager.op_apply_finish(o->op);
@@ -1691,7 +1905,9 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
 void FileStore::_finish_op(OpSequencer *osr)
 {
   Op *o = osr->dequeue();
-  
+  tracepoint(ceph_os, apply_finish,
+	     o->osd_op ? o->osd_op->get_seq() : 0, o->op);
+
   dout(10) << "_finish_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << dendl;
   osr->apply_lock.Unlock();  // locked in _do_op
 
@@ -1706,7 +1922,7 @@ void FileStore::_finish_op(OpSequencer *osr)
     o->onreadable_sync->complete(0);
   }
   if (o->onreadable) {
-    op_finisher.queue(o->onreadable);
+    op_finisher.queue(osr->finisher_key(), o->onreadable);
   }
   delete o;
 }
@@ -1805,7 +2021,7 @@ int FileStore::queue_transactions(Sequencer *posr, list<Transaction*> &tls,
   if (onreadable_sync) {
     onreadable_sync->complete(r);
   }
-  op_finisher.queue(onreadable, r);
+  op_finisher.queue(osr->finisher_key(), onreadable, r);
 
   submit_manager.op_submit_finish(op);
   apply_manager.op_apply_finish(op);
@@ -1826,7 +2042,7 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
   // getting blocked behind an ondisk completion.
   if (ondisk) {
     dout(10) << " queueing ondisk " << ondisk << dendl;
-    ondisk_finisher.queue(ondisk);
+    ondisk_finisher.queue(osr->finisher_key(), ondisk);
   }
 }
 
@@ -1845,16 +2061,28 @@ int FileStore::_do_transactions(
     ops += (*p)->get_num_ops();
   }
 
+  AioBatch *aiob = NULL;
+#ifdef HAVE_LIBAIO
+  AioBatch batch;
+  if (aio && !replaying && !m_filestore_sloppy_crc)
+    aiob = &batch;
+#endif
+
   int trans_num = 0;
   for (list<Transaction*>::iterator p = tls.begin();
        p != tls.end();
        ++p, trans_num++) {
-    r = _do_transaction(**p, op_seq, trans_num, handle);
+    r = _do_transaction(**p, op_seq, trans_num, handle, aiob);
     if (r < 0)
       break;
     if (handle)
       handle->reset_tp_timeout();
   }
+
+#ifdef HAVE_LIBAIO
+  if (aiob)
+    _aio_drain(aiob);
+#endif
   
   return r;
 }
@@ -2113,13 +2341,19 @@ int FileStore::_check_replay_guard(int fd, const SequencerPosition& spos)
 
 unsigned FileStore::_do_transaction(
   Transaction& t, uint64_t op_seq, int trans_num,
-  ThreadPool::TPHandle *handle)
+  ThreadPool::TPHandle *handle, AioBatch *aiob)
 {
   dout(10) << "_do_transaction on " << &t << dendl;
 
   Transaction::iterator i = t.begin();
   
   SequencerPosition spos(op_seq, trans_num, 0);
+  ObjectMap::Batch omap_batch;
+  vector<char> plan;
+  if (g_conf->filestore_coalesce_ops)
+    t.get_op_plan(&plan);
+  else
+    plan.assign(t.get_num_ops(), Transaction::OP_PLAN_APPLY);
   while (i.have_op()) {
     if (handle)
       handle->reset_tp_timeout();
@@ -2127,8 +2361,29 @@ unsigned FileStore::_do_transaction(
     int op = i.get_op();
     int r = 0;
 
+    if (plan[spos.op] == Transaction::OP_PLAN_SKIP) {
+      dout(20) << "_do_transaction skipping op " << spos.op << " (" << op
+	       << "), undone later in the transaction" << dendl;
+      logger->inc(l_os_coalesced);
+      spos.op++;
+      continue;
+    }
+    if (plan[spos.op] == Transaction::OP_PLAN_TOUCH) {
+      // only its cid and oid matter, and they come first
+      logger->inc(l_os_coalesced);
+      op = Transaction::OP_TOUCH;
+    }
+
     _inject_failure();
 
+    if (omap_batch && !_omap_op_batchable(op))
+      _omap_submit_batch(omap_batch);
+
+#ifdef HAVE_LIBAIO
+    if (aiob && !aiob->objects.empty() && !_aio_op_safe(op))
+      _aio_drain(aiob);
+#endif
+
     switch (op) {
     case Transaction::OP_NOP:
       break;
@@ -2150,8 +2405,14 @@ unsigned FileStore::_do_transaction(
 	bool replica = i.get_replica();
 	bufferlist bl;
 	i.get_bl(bl);
-	if (_check_replay_guard(cid, oid, spos) > 0)
-	  r = _write(cid, oid, off, len, bl, replica);
+	if (_check_replay_guard(cid, oid, spos) > 0) {
+#ifdef HAVE_LIBAIO
+	  if (aiob)
+	    r = _write_aio(aiob, cid, oid, off, len, bl, replica);
+	  else
+#endif
+	    r = _write(cid, oid, off, len, bl, replica);
+	}
       }
       break;
       
@@ -2202,9 +2463,10 @@ unsigned FileStore::_do_transaction(
 	string name = i.get_attrname();
 	bufferlist bl;
 	i.get_bl(bl);
+	map<string, bufferptr> to_set;
+	to_set[name] = bl.begin().get_contiguous(bl.length());
+	_coalesce_setattrs(i, plan, cid, oid, to_set, spos);
 	if (_check_replay_guard(cid, oid, spos) > 0) {
-	  map<string, bufferptr> to_set;
-	  to_set[name] = bufferptr(bl.c_str(), bl.length());
 	  r = _setattrs(cid, oid, to_set, spos);
 	  if (r == -ENOSPC)
 	    dout(0) << " ENOSPC on setxattr on " << cid << "/" << oid
@@ -2219,6 +2481,7 @@ unsigned FileStore::_do_transaction(
 	ghobject_t oid = i.get_oid();
 	map<string, bufferptr> aset;
 	i.get_attrset(aset);
+	_coalesce_setattrs(i, plan, cid, oid, aset, spos);
 	if (_check_replay_guard(cid, oid, spos) > 0)
 	  r = _setattrs(cid, oid, aset, spos);
   	if (r == -ENOSPC)
@@ -2285,6 +2548,27 @@ unsigned FileStore::_do_transaction(
       }
       break;
 
+    case Transaction::OP_COLL_HINT:
+      {
+	coll_t cid = i.get_cid();
+	uint32_t type = i.get_u32();
+	bufferlist hint;
+	i.get_bl(hint);
+	bufferlist::iterator hiter = hint.begin();
+	if (type == Transaction::COLL_HINT_EXPECTED_NUM_OBJECTS) {
+	  uint32_t pg_num;
+	  uint64_t num_objs;
+	  ::decode(pg_num, hiter);
+	  ::decode(num_objs, hiter);
+	  if (_check_replay_guard(cid, spos) > 0)
+	    r = _collection_hint_expected_num_objs(cid, pg_num, num_objs);
+	} else {
+	  // hints are advisory
+	  dout(10) << "unrecognized collection hint type " << type << dendl;
+	}
+      }
+      break;
+
     case Transaction::OP_RMCOLL:
       {
 	coll_t cid = i.get_cid();
@@ -2293,6 +2577,14 @@ unsigned FileStore::_do_transaction(
       }
       break;
 
+    case Transaction::OP_RMCOLL_RECURSIVE:
+      {
+	coll_t cid = i.get_cid();
+	if (_check_replay_guard(cid, spos) > 0)
+	  r = _collection_remove_bulk(cid, spos);
+      }
+      break;
+
     case Transaction::OP_COLL_ADD:
       {
 	coll_t ncid = i.get_cid();
@@ -2341,7 +2633,9 @@ unsigned FileStore::_do_transaction(
 	bufferlist bl;
 	i.get_bl(bl);
 	if (_check_replay_guard(cid, spos) > 0)
-	  r = _collection_setattr(cid, name.c_str(), bl.c_str(), bl.length());
+	  r = _collection_setattr(cid, name.c_str(),
+				  bl.begin().get_contiguous(bl.length()).c_str(),
+				  bl.length());
       }
       break;
 
@@ -2379,7 +2673,10 @@ unsigned FileStore::_do_transaction(
 	ghobject_t oid = i.get_oid();
 	map<string, bufferlist> aset;
 	i.get_attrset(aset);
-	r = _omap_setkeys(cid, oid, aset, spos);
+	_coalesce_omap_setkeys(i, plan, cid, oid, aset, spos);
+	if (!omap_batch)
+	  omap_batch = object_map->start_batch();
+	r = _omap_setkeys(cid, oid, aset, spos, omap_batch);
       }
       break;
     case Transaction::OP_OMAP_RMKEYS:
@@ -2388,7 +2685,9 @@ unsigned FileStore::_do_transaction(
 	ghobject_t oid = i.get_oid();
 	set<string> keys;
 	i.get_keyset(keys);
-	r = _omap_rmkeys(cid, oid, keys, spos);
+	if (!omap_batch)
+	  omap_batch = object_map->start_batch();
+	r = _omap_rmkeys(cid, oid, keys, spos, omap_batch);
       }
       break;
     case Transaction::OP_OMAP_RMKEYRANGE:
@@ -2407,7 +2706,9 @@ unsigned FileStore::_do_transaction(
 	ghobject_t oid = i.get_oid();
 	bufferlist bl;
 	i.get_bl(bl);
-	r = _omap_setheader(cid, oid, bl, spos);
+	if (!omap_batch)
+	  omap_batch = object_map->start_batch();
+	r = _omap_setheader(cid, oid, bl, spos, omap_batch);
       }
       break;
     case Transaction::OP_SPLIT_COLLECTION:
@@ -2512,11 +2813,106 @@ unsigned FileStore::_do_transaction(
     spos.op++;
   }
 
+  if (omap_batch)
+    _omap_submit_batch(omap_batch);
+
   _inject_failure();
 
   return 0;  // FIXME count errors
 }
 
+/**
+ * Fold the setattr and setattrs ops right after the current one, on
+ * the same object, into aset, so they cost a single _setattrs.  spos
+ * is left at the last op folded in.
+ */
+void FileStore::_coalesce_setattrs(Transaction::iterator &i,
+				   const vector<char> &plan,
+				   const coll_t &cid, const ghobject_t &oid,
+				   map<string, bufferptr> &aset,
+				   SequencerPosition &spos)
+{
+  if (!g_conf->filestore_coalesce_ops)
+    return;
+  while (i.have_op() && plan[spos.op + 1] == Transaction::OP_PLAN_APPLY) {
+    Transaction::iterator j = i;
+    int op = j.get_op();
+    if (op != Transaction::OP_SETATTR && op != Transaction::OP_SETATTRS)
+      break;
+    if (j.get_cid() != cid || j.get_oid() != oid)
+      break;
+    if (op == Transaction::OP_SETATTR) {
+      string name = j.get_attrname();
+      bufferlist bl;
+      j.get_bl(bl);
+      aset[name] = bl.begin().get_contiguous(bl.length());
+    } else {
+      map<string, bufferptr> more;
+      j.get_attrset(more);
+      for (map<string, bufferptr>::iterator p = more.begin();
+	   p != more.end();
+	   ++p)
+	aset[p->first] = p->second;
+    }
+    i = j;
+    spos.op++;
+    logger->inc(l_os_coalesced);
+  }
+}
+
+/// as _coalesce_setattrs, for omap_setkeys
+void FileStore::_coalesce_omap_setkeys(Transaction::iterator &i,
+				       const vector<char> &plan,
+				       const coll_t &cid, const ghobject_t &oid,
+				       map<string, bufferlist> &aset,
+				       SequencerPosition &spos)
+{
+  if (!g_conf->filestore_coalesce_ops)
+    return;
+  while (i.have_op() && plan[spos.op + 1] == Transaction::OP_PLAN_APPLY) {
+    Transaction::iterator j = i;
+    if (j.get_op() != Transaction::OP_OMAP_SETKEYS)
+      break;
+    if (j.get_cid() != cid || j.get_oid() != oid)
+      break;
+    map<string, bufferlist> more;
+    j.get_attrset(more);
+    for (map<string, bufferlist>::iterator p = more.begin();
+	 p != more.end();
+	 ++p)
+      aset[p->first] = p->second;
+    i = j;
+    spos.op++;
+    logger->inc(l_os_coalesced);
+  }
+}
+
+/**
+ * Consecutive omap updates in a transaction share one kv transaction.
+ * Any other op may read the omap or the object it belongs to, so the
+ * batch is submitted before it runs.
+ */
+bool FileStore::_omap_op_batchable(int op)
+{
+  switch (op) {
+  case Transaction::OP_OMAP_SETKEYS:
+  case Transaction::OP_OMAP_RMKEYS:
+  case Transaction::OP_OMAP_SETHEADER:
+    return true;
+  }
+  return false;
+}
+
+void FileStore::_omap_submit_batch(ObjectMap::Batch &batch)
+{
+  int r = object_map->submit_batch(batch);
+  if (r < 0) {
+    derr << __func__ << " error " << cpp_strerror(r) << dendl;
+    assert(0 == "unexpected error submitting omap batch");
+  }
+  batch.reset();
+}
+
   /*********************************************/
 
 
@@ -2561,6 +2957,32 @@ int FileStore::read(
   size_t len,
   bufferlist& bl,
   bool allow_eio)
+{
+  return _read(cid, oid, offset, len, bl, allow_eio, false);
+}
+
+int FileStore::read_once(
+  coll_t cid,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t len,
+  bufferlist& bl,
+  bool allow_eio)
+{
+  // fadvise(DONTNEED) has known issues on xfs (see filestore replica
+  // fadvise); there we read through the cache as usual
+  return _read(cid, oid, offset, len, bl, allow_eio,
+	       m_fs_type != FS_TYPE_XFS);
+}
+
+int FileStore::_read(
+  coll_t cid,
+  const ghobject_t& oid,
+  uint64_t offset,
+  size_t len,
+  bufferlist& bl,
+  bool allow_eio,
+  bool dontneed)
 {
   int got;
 
@@ -2593,6 +3015,11 @@ int FileStore::read(
   bptr.set_length(got);   // properly size the buffer
   bl.push_back(bptr);   // put it in the target bufferlist
 
+#ifdef HAVE_POSIX_FADVISE
+  if (dontneed && got > 0)
+    ::posix_fadvise(**fd, offset, got, POSIX_FADV_DONTNEED);
+#endif
+
   if (m_filestore_sloppy_crc && (!replaying || backend->can_checkpoint())) {
     ostringstream ss;
     int errors = backend->_crc_verify_read(**fd, offset, got, bl, &ss);
@@ -2615,19 +3042,116 @@ int FileStore::read(
   }
 }
 
+int FileStore::_do_fiemap(int fd, uint64_t offset, size_t len,
+                          map<uint64_t, uint64_t> *m)
+{
+  uint64_t i;
+  struct fiemap *fiemap = NULL;
+  int r = backend->do_fiemap(fd, offset, len, &fiemap);
+  if (r < 0)
+    return r;
+
+  if (fiemap->fm_mapped_extents == 0) {
+    free(fiemap);
+    return r;
+  }
+
+  struct fiemap_extent *extent = &fiemap->fm_extents[0];
+
+  /* start where we were asked to start */
+  if (extent->fe_logical < offset) {
+    extent->fe_length -= offset - extent->fe_logical;
+    extent->fe_logical = offset;
+  }
+
+  i = 0;
+
+  while (i < fiemap->fm_mapped_extents) {
+    struct fiemap_extent *next = extent + 1;
+
+    dout(10) << "FileStore::fiemap() fm_mapped_extents=" << fiemap->fm_mapped_extents
+	     << " fe_logical=" << extent->fe_logical << " fe_length=" << extent->fe_length << dendl;
+
+    /* try to merge extents */
+    while ((i < fiemap->fm_mapped_extents - 1) &&
+           (extent->fe_logical + extent->fe_length == next->fe_logical)) {
+        next->fe_length += extent->fe_length;
+        next->fe_logical = extent->fe_logical;
+        extent = next;
+        next = extent + 1;
+        i++;
+    }
+
+    if (extent->fe_logical + extent->fe_length > offset + len)
+      extent->fe_length = offset + len - extent->fe_logical;
+    (*m)[extent->fe_logical] = extent->fe_length;
+    i++;
+    extent++;
+  }
+  free(fiemap);
+  return r;
+}
+
+int FileStore::_do_seek_hole_data(int fd, uint64_t offset, size_t len,
+                                  map<uint64_t, uint64_t> *m)
+{
+#if defined(__linux__) && defined(SEEK_HOLE) && defined(SEEK_DATA)
+  // lseek moves the file offset of the cached fd, which _write and
+  // _do_copy_range position with; seek on a private open file instead
+  char fn[32];
+  snprintf(fn, sizeof(fn), "/proc/self/fd/%d", fd);
+  int sfd = ::open(fn, O_RDONLY);
+  if (sfd < 0) {
+    dout(10) << "_do_seek_hole_data reopen of " << fn << " got "
+	     << cpp_strerror(-errno) << ", mapping all of it" << dendl;
+    (*m)[offset] = len;
+    return 0;
+  }
+
+  int r = 0;
+  uint64_t end = offset + len;
+  off_t data_pos = offset;
+  while ((uint64_t)data_pos < end) {
+    data_pos = ::lseek(sfd, data_pos, SEEK_DATA);
+    if (data_pos < 0) {
+      if (errno != ENXIO)  // ENXIO: no data past here
+	r = -errno;
+      break;
+    }
+    if ((uint64_t)data_pos >= end)
+      break;
+    off_t hole_pos = ::lseek(sfd, data_pos, SEEK_HOLE);
+    if (hole_pos < 0) {
+      r = -errno;
+      break;
+    }
+    if ((uint64_t)hole_pos > end)
+      hole_pos = end;
+    dout(20) << "_do_seek_hole_data data " << data_pos << "~"
+	     << (hole_pos - data_pos) << dendl;
+    (*m)[data_pos] = hole_pos - data_pos;
+    data_pos = hole_pos;
+  }
+  TEMP_FAILURE_RETRY(::close(sfd));
+  return r;
+#else
+  (*m)[offset] = len;
+  return 0;
+#endif
+}
+
 int FileStore::fiemap(coll_t cid, const ghobject_t& oid,
                     uint64_t offset, size_t len,
                     bufferlist& bl)
 {
-  if (!backend->has_fiemap() || len <= (size_t)m_filestore_fiemap_threshold) {
+  if ((!backend->has_fiemap() && !backend->has_seek_data_hole()) ||
+      len <= (size_t)m_filestore_fiemap_threshold) {
     map<uint64_t, uint64_t> m;
     m[offset] = len;
     ::encode(m, bl);
     return 0;
   }
 
-
-  struct fiemap *fiemap = NULL;
   map<uint64_t, uint64_t> exomap;
 
   dout(15) << "fiemap " << cid << "/" << oid << " " << offset << "~" << len << dendl;
@@ -2637,53 +3161,12 @@ int FileStore::fiemap(coll_t cid, const ghobject_t& oid,
   if (r < 0) {
     dout(10) << "read couldn't open " << cid << "/" << oid << ": " << cpp_strerror(r) << dendl;
   } else {
-    uint64_t i;
-
-    r = backend->do_fiemap(**fd, offset, len, &fiemap);
-    if (r < 0)
-      goto done;
-
-    if (fiemap->fm_mapped_extents == 0) {
-      free(fiemap);
-      goto done;
-    }
-
-    struct fiemap_extent *extent = &fiemap->fm_extents[0];
-
-    /* start where we were asked to start */
-    if (extent->fe_logical < offset) {
-      extent->fe_length -= offset - extent->fe_logical;
-      extent->fe_logical = offset;
-    }
-
-    i = 0;
-
-    while (i < fiemap->fm_mapped_extents) {
-      struct fiemap_extent *next = extent + 1;
-
-      dout(10) << "FileStore::fiemap() fm_mapped_extents=" << fiemap->fm_mapped_extents
-	       << " fe_logical=" << extent->fe_logical << " fe_length=" << extent->fe_length << dendl;
-
-      /* try to merge extents */
-      while ((i < fiemap->fm_mapped_extents - 1) &&
-             (extent->fe_logical + extent->fe_length == next->fe_logical)) {
-          next->fe_length += extent->fe_length;
-          next->fe_logical = extent->fe_logical;
-          extent = next;
-          next = extent + 1;
-          i++;
-      }
-
-      if (extent->fe_logical + extent->fe_length > offset + len)
-        extent->fe_length = offset + len - extent->fe_logical;
-      exomap[extent->fe_logical] = extent->fe_length;
-      i++;
-      extent++;
-    }
-    free(fiemap);
+    if (backend->has_fiemap())
+      r = _do_fiemap(**fd, offset, len, &exomap);
+    else
+      r = _do_seek_hole_data(**fd, offset, len, &exomap);
   }
 
-done:
   if (r >= 0) {
     lfn_close(fd);
     ::encode(exomap, bl);
@@ -2782,6 +3265,210 @@ int FileStore::_write(coll_t cid, const ghobject_t& oid,
   return r;
 }
 
+#ifdef HAVE_LIBAIO
+int FileStore::aio_start()
+{
+  assert(!aio);
+  aio_ctx = 0;
+  int r = io_setup(g_conf->filestore_aio_queue_depth, &aio_ctx);
+  if (r < 0)
+    return r;
+  aio_stop = false;
+  aio_finish_thread.create();
+  aio = true;
+  dout(5) << "aio_start queue depth " << g_conf->filestore_aio_queue_depth
+	  << dendl;
+  return 0;
+}
+
+void FileStore::aio_shutdown()
+{
+  if (!aio)
+    return;
+  aio_lock.Lock();
+  assert(aio_num == 0);
+  aio_stop = true;
+  aio_cond.SignalAll();
+  aio_lock.Unlock();
+  aio_finish_thread.join();
+  io_destroy(aio_ctx);
+  aio_ctx = 0;
+  aio = false;
+}
+
+void FileStore::aio_finish_entry()
+{
+  aio_lock.Lock();
+  while (true) {
+    while (!aio_stop && aio_num == 0)
+      aio_cond.Wait(aio_lock);
+    if (aio_num == 0)
+      break;
+    aio_lock.Unlock();
+
+    io_event event[16];
+    int r = io_getevents(aio_ctx, 1, 16, event, NULL);
+    aio_lock.Lock();
+    if (r < 0) {
+      if (r == -EINTR)
+	continue;
+      derr << "aio_finish_entry io_getevents got " << cpp_strerror(r) << dendl;
+      assert(0 == "got unexpected error from io_getevents");
+    }
+    for (int i = 0; i < r; i++) {
+      aio_write_t *aw = (aio_write_t *)event[i].obj;
+      if (event[i].res != aw->len) {
+	derr << "aio write " << aw->off << "~" << aw->len
+	     << " got " << cpp_strerror(event[i].res) << dendl;
+	assert(0 == "unexpected aio error");
+      }
+      dout(20) << "aio_finish_entry write " << aw->off << "~" << aw->len
+	       << " done" << dendl;
+      aw->batch->pending--;
+      aio_num--;
+    }
+    aio_cond.SignalAll();
+  }
+  aio_lock.Unlock();
+}
+
+/**
+ * ops that cannot observe or clobber in-flight object data
+ *
+ * OP_WRITE is included because _write_aio checks for overlap with the
+ * batch itself.
+ */
+bool FileStore::_aio_op_safe(int op)
+{
+  switch (op) {
+  case Transaction::OP_NOP:
+  case Transaction::OP_TOUCH:
+  case Transaction::OP_WRITE:
+  case Transaction::OP_SETATTR:
+  case Transaction::OP_SETATTRS:
+  case Transaction::OP_RMATTR:
+  case Transaction::OP_RMATTRS:
+  case Transaction::OP_MKCOLL:
+  case Transaction::OP_COLL_SETATTR:
+  case Transaction::OP_COLL_RMATTR:
+  case Transaction::OP_OMAP_CLEAR:
+  case Transaction::OP_OMAP_SETKEYS:
+  case Transaction::OP_OMAP_RMKEYS:
+  case Transaction::OP_OMAP_RMKEYRANGE:
+  case Transaction::OP_OMAP_SETHEADER:
+    return true;
+  }
+  return false;
+}
+
+int FileStore::_write_aio(AioBatch *b, coll_t cid, const ghobject_t& oid,
+			  uint64_t offset, size_t len, const bufferlist& bl,
+			  bool replica)
+{
+  // a later write to the same object must land after the earlier ones
+  if (b->objects.count(oid))
+    _aio_drain(b);
+
+  // O_DIRECT needs page aligned extents; everything else goes the
+  // usual way through the page cache
+  if (len == 0 || len != bl.length() ||
+      (offset & ~CEPH_PAGE_MASK) || (len & ~CEPH_PAGE_MASK))
+    return _write(cid, oid, offset, len, bl, replica);
+
+  dout(15) << "write_aio " << cid << "/" << oid << " " << offset << "~" << len
+	   << dendl;
+
+  FDRef fd;
+  int r = lfn_open(cid, oid, true, &fd);
+  if (r < 0) {
+    dout(0) << "write_aio couldn't open " << cid << "/" << oid << ": "
+	    << cpp_strerror(r) << dendl;
+    return r;
+  }
+  lfn_close(fd);
+
+  IndexedPath path;
+  r = lfn_find(cid, oid, &path);
+  if (r < 0)
+    return r;
+  int dfd = ::open(path->path(), O_WRONLY|O_DIRECT);
+  if (dfd < 0) {
+    r = -errno;
+    dout(10) << "write_aio O_DIRECT open of " << path->path() << " failed: "
+	     << cpp_strerror(r) << ", writing synchronously" << dendl;
+    return _write(cid, oid, offset, len, bl, replica);
+  }
+
+  b->writes.push_back(aio_write_t());
+  aio_write_t &aw = b->writes.back();
+  aw.batch = b;
+  aw.fd = dfd;
+  aw.off = offset;
+  aw.len = len;
+  aw.bl = bl;
+  aw.bl.rebuild_page_aligned();
+  if (aw.bl.buffers().size() > IOV_MAX) {
+    bufferptr bp = buffer::create_page_aligned(len);
+    aw.bl.copy(0, len, bp.c_str());
+    aw.bl.clear();
+    aw.bl.push_back(bp);
+  }
+  for (list<bufferptr>::const_iterator p = aw.bl.buffers().begin();
+       p != aw.bl.buffers().end();
+       ++p) {
+    iovec v;
+    v.iov_base = (void *)p->c_str();
+    v.iov_len = p->length();
+    aw.iov.push_back(v);
+  }
+  io_prep_pwritev(&aw.io, dfd, &aw.iov[0], aw.iov.size(), offset);
+  b->objects.insert(oid);
+
+  Mutex::Locker l(aio_lock);
+  while (aio_num >= g_conf->filestore_aio_queue_depth)
+    aio_cond.Wait(aio_lock);
+  iocb *piocb = &aw.io;
+  int attempts = 10;
+  while (true) {
+    r = io_submit(aio_ctx, 1, &piocb);
+    if (r == -EAGAIN && attempts-- > 0) {
+      aio_lock.Unlock();
+      usleep(500);
+      aio_lock.Lock();
+      continue;
+    }
+    if (r < 0) {
+      derr << "write_aio io_submit " << offset << "~" << len
+	   << " got " << cpp_strerror(r) << dendl;
+      assert(0 == "io_submit got unexpected error");
+    }
+    break;
+  }
+  b->pending++;
+  aio_num++;
+  aio_cond.SignalAll();
+  return len;
+}
+
+void FileStore::_aio_drain(AioBatch *b)
+{
+  if (b->writes.empty())
+    return;
+  dout(20) << "_aio_drain " << b->writes.size() << " writes on "
+	   << b->objects.size() << " objects" << dendl;
+  aio_lock.Lock();
+  while (b->pending > 0)
+    aio_cond.Wait(aio_lock);
+  aio_lock.Unlock();
+  for (list<aio_write_t>::iterator p = b->writes.begin();
+       p != b->writes.end();
+       ++p)
+    TEMP_FAILURE_RETRY(::close(p->fd));
+  b->writes.clear();
+  b->objects.clear();
+}
+#endif
+
 int FileStore::_zero(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len)
 {
   dout(15) << "zero " << cid << "/" << oid << " " << offset << "~" << len << dendl;
@@ -2870,11 +3557,17 @@ int FileStore::_clone(coll_t cid, const ghobject_t& oldoid, const ghobject_t& ne
 
   {
     map<string, bufferptr> aset;
-    r = _fgetattrs(**o, aset, false);
+    r = _obj_getattrs(o, aset, false);
     if (r < 0)
       goto out3;
 
-    r = _fsetattrs(**n, aset);
+    if (g_conf->filestore_xattr_packed) {
+      r = _fset_packed_xattrs(n, aset);
+    } else {
+      r = _rm_packed_xattrs(n);
+      if (r >= 0)
+	r = _fsetattrs(**n, aset);
+    }
     if (r < 0)
       goto out3;
   }
@@ -3059,10 +3752,17 @@ void FileStore::sync_entry()
   again:
     fin.swap(sync_waiters);
     lock.Unlock();
-    
-    op_tp.pause();
+
+    // commit_start() holds back new applies and waits for the running
+    // ones, which is all a consistent commit needs.  Op threads that have
+    // not reached the apply (e.g. throttled) need not finish first.
+    utime_t quiesce_start = ceph_clock_now(g_ceph_context);
+    bool pause_tp = g_conf->filestore_commit_pause_op_threads;
+    if (pause_tp)
+      op_tp.pause();
     if (apply_manager.commit_start()) {
       utime_t start = ceph_clock_now(g_ceph_context);
+      logger->tinc(l_os_commit_quiesce_lat, start - quiesce_start);
       uint64_t cp = apply_manager.get_committing_seq();
 
       sync_entry_timeo_lock.Lock();
@@ -3102,7 +3802,8 @@ void FileStore::sync_entry()
 
 	snaps.push_back(cp);
 	apply_manager.commit_started();
-	op_tp.unpause();
+	if (pause_tp)
+	  op_tp.unpause();
 
 	if (cid > 0) {
 	  dout(20) << " waiting for checkpoint " << cid << " to complete" << dendl;
@@ -3116,7 +3817,8 @@ void FileStore::sync_entry()
       } else
       {
 	apply_manager.commit_started();
-	op_tp.unpause();
+	if (pause_tp)
+	  op_tp.unpause();
 
 	int err = backend->syncfs();
 	if (err < 0) {
@@ -3170,7 +3872,7 @@ void FileStore::sync_entry()
       sync_entry_timeo_lock.Lock();
       timer.cancel_event(sync_entry_timeo);
       sync_entry_timeo_lock.Unlock();
-    } else {
+    } else if (pause_tp) {
       op_tp.unpause();
     }
     
@@ -3409,6 +4111,113 @@ int FileStore::_fsetattrs(int fd, map<string, bufferptr> &aset)
   return 0;
 }
 
+/*
+ * An object's inline xattrs are either all packed into one fs xattr or
+ * stored one fs xattr each; FD caches which, and the decoded pack, so
+ * that reading them usually costs no syscalls at all.  Every change to
+ * the pack goes through the FD, which FDCache shares between everyone
+ * with the object open.
+ */
+int FileStore::_load_packed_xattrs(FDRef fd)
+{
+  Mutex::Locker l(fd->xattr_lock);
+  if (fd->xattr_state != FDCache::FD::XATTR_UNKNOWN)
+    return fd->xattr_state;
+
+  bufferptr bp;
+  int r = _fgetattr(**fd, XATTR_PACKED_NAME, bp);
+  if (r == -ENODATA) {
+    fd->xattr_state = FDCache::FD::XATTR_UNPACKED;
+    return fd->xattr_state;
+  }
+  if (r < 0)
+    return r;
+  bufferlist bl;
+  bl.push_back(bp);
+  bufferlist::iterator p = bl.begin();
+  try {
+    ::decode(fd->packed_xattrs, p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " corrupt " << XATTR_PACKED_NAME << " on fd "
+	 << **fd << dendl;
+    fd->packed_xattrs.clear();
+    return -EIO;
+  }
+  fd->xattr_state = FDCache::FD::XATTR_PACKED;
+  return fd->xattr_state;
+}
+
+int FileStore::_fset_packed_xattrs(FDRef fd, const map<string, bufferptr> &aset)
+{
+  bufferlist bl;
+  ::encode(aset, bl);
+  int r = chain_fsetxattr(**fd, XATTR_PACKED_NAME, bl.c_str(), bl.length());
+  Mutex::Locker l(fd->xattr_lock);
+  if (r < 0) {
+    derr << __func__ << " chain_fsetxattr returned " << r << dendl;
+    fd->xattr_state = FDCache::FD::XATTR_UNKNOWN;
+    fd->packed_xattrs.clear();
+    return r;
+  }
+  fd->xattr_state = FDCache::FD::XATTR_PACKED;
+  fd->packed_xattrs = aset;
+  return 0;
+}
+
+int FileStore::_rm_packed_xattrs(FDRef fd)
+{
+  int r = chain_fremovexattr(**fd, XATTR_PACKED_NAME);
+  if (r == -ENODATA)
+    r = 0;
+  Mutex::Locker l(fd->xattr_lock);
+  fd->xattr_state = r < 0 ? FDCache::FD::XATTR_UNKNOWN :
+    FDCache::FD::XATTR_UNPACKED;
+  fd->packed_xattrs.clear();
+  return r;
+}
+
+int FileStore::_obj_getattr(FDRef fd, const char *name, bufferptr& bp)
+{
+  int r = _load_packed_xattrs(fd);
+  if (r < 0)
+    return r;
+  if (r == FDCache::FD::XATTR_PACKED) {
+    Mutex::Locker l(fd->xattr_lock);
+    map<string, bufferptr>::iterator p = fd->packed_xattrs.find(name);
+    if (p == fd->packed_xattrs.end())
+      return -ENODATA;
+    bp = buffer::copy(p->second.c_str(), p->second.length());
+    return bp.length();
+  }
+  char n[CHAIN_XATTR_MAX_NAME_LEN];
+  get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
+  return _fgetattr(**fd, n, bp);
+}
+
+int FileStore::_obj_getattrs(FDRef fd, map<string,bufferptr>& aset, bool user_only)
+{
+  int r = _load_packed_xattrs(fd);
+  if (r < 0)
+    return r;
+  if (r != FDCache::FD::XATTR_PACKED)
+    return _fgetattrs(**fd, aset, user_only);
+
+  Mutex::Locker l(fd->xattr_lock);
+  for (map<string, bufferptr>::iterator p = fd->packed_xattrs.begin();
+       p != fd->packed_xattrs.end();
+       ++p) {
+    const char *set_name = p->first.c_str();
+    if (user_only) {
+      if (*set_name != '_')
+	continue;
+      set_name++;
+    }
+    if (*set_name)
+      aset[set_name] = buffer::copy(p->second.c_str(), p->second.length());
+  }
+  return 0;
+}
+
 // debug EIO injection
 void FileStore::inject_data_error(const ghobject_t &oid) {
   Mutex::Locker l(read_error_lock);
@@ -3456,9 +4265,7 @@ int FileStore::getattr(coll_t cid, const ghobject_t& oid, const char *name, buff
   if (r < 0) {
     goto out;
   }
-  char n[CHAIN_XATTR_MAX_NAME_LEN];
-  get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
-  r = _fgetattr(**fd, n, bp);
+  r = _obj_getattr(fd, name, bp);
   lfn_close(fd);
   if (r == -ENODATA) {
     map<string, bufferlist> got;
@@ -3479,8 +4286,8 @@ int FileStore::getattr(coll_t cid, const ghobject_t& oid, const char *name, buff
       dout(10) << __func__ << " got.size() is 0" << dendl;
       return -ENODATA;
     }
-    bp = bufferptr(got.begin()->second.c_str(),
-		   got.begin()->second.length());
+    bp = got.begin()->second.begin().get_contiguous(
+      got.begin()->second.length());
     r = bp.length();
   }
  out:
@@ -3513,7 +4320,7 @@ int FileStore::getattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr>
   if (r >= 0 && !strncmp(buf, XATTR_NO_SPILL_OUT, sizeof(XATTR_NO_SPILL_OUT)))
     spill_out = false;
 
-  r = _fgetattrs(**fd, aset, user_only);
+  r = _obj_getattrs(fd, aset, user_only);
   if (r < 0) {
     goto out;
   }
@@ -3557,7 +4364,7 @@ int FileStore::getattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr>
 	key = i->first;
     }
     aset.insert(make_pair(key,
-			    bufferptr(i->second.c_str(), i->second.length())));
+			  i->second.begin().get_contiguous(i->second.length())));
   }
  out:
   dout(10) << "getattrs " << cid << "/" << oid << " = " << r << dendl;
@@ -3578,8 +4385,11 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
   set<string> omap_remove;
   map<string, bufferptr> inline_set;
   map<string, bufferptr> inline_to_set;
+  map<string, bufferptr> unpacked;
   FDRef fd;
   int spill_out = -1;
+  bool pack = false;
+  xattr_limits_t limits = m_filestore_xattr_limits.get();
 
   int r = lfn_open(cid, oid, false, &fd);
   if (r < 0) {
@@ -3593,9 +4403,18 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
   else
     spill_out = 1;
 
-  r = _fgetattrs(**fd, inline_set, false);
+  r = _load_packed_xattrs(fd);
+  if (r < 0)
+    goto out_close;
+  pack = (r == FDCache::FD::XATTR_PACKED);
+  if (!pack && g_conf->filestore_xattr_packed) {
+    // repack; the old xattrs go once the pack is written
+    pack = true;
+    _fgetattrs(**fd, unpacked, false);
+  }
+  r = _obj_getattrs(fd, inline_set, false);
   assert(!m_filestore_fail_eio || r != -EIO);
-  dout(15) << "setattrs " << cid << "/" << oid << dendl;
+  dout(15) << "setattrs " << cid << "/" << oid << (pack ? " packed" : "") << dendl;
   r = 0;
 
   for (map<string,bufferptr>::iterator p = aset.begin();
@@ -3604,19 +4423,21 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
     char n[CHAIN_XATTR_MAX_NAME_LEN];
     get_attrname(p->first.c_str(), n, CHAIN_XATTR_MAX_NAME_LEN);
 
-    if (p->second.length() > m_filestore_max_inline_xattr_size) {
+    if (p->second.length() > limits.max_inline_size) {
 	if (inline_set.count(p->first)) {
 	  inline_set.erase(p->first);
-	  r = chain_fremovexattr(**fd, n);
-	  if (r < 0)
-	    goto out_close;
+	  if (!pack) {
+	    r = chain_fremovexattr(**fd, n);
+	    if (r < 0)
+	      goto out_close;
+	  }
 	}
 	omap_set[p->first].push_back(p->second);
 	continue;
     }
 
     if (!inline_set.count(p->first) &&
-	  inline_set.size() >= m_filestore_max_inline_xattrs) {
+	  inline_set.size() >= limits.max_inline_count) {
 	if (inline_set.count(p->first)) {
 	  inline_set.erase(p->first);
 	  r = chain_fremovexattr(**fd, n);
@@ -3637,9 +4458,22 @@ int FileStore::_setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr
 		    sizeof(XATTR_SPILL_OUT));
   }
 
-  r = _fsetattrs(**fd, inline_to_set);
-  if (r < 0)
-    goto out_close;
+  if (pack) {
+    r = _fset_packed_xattrs(fd, inline_set);
+    if (r < 0)
+      goto out_close;
+    for (map<string, bufferptr>::iterator p = unpacked.begin();
+	 p != unpacked.end();
+	 ++p) {
+      char n[CHAIN_XATTR_MAX_NAME_LEN];
+      get_attrname(p->first.c_str(), n, CHAIN_XATTR_MAX_NAME_LEN);
+      chain_fremovexattr(**fd, n);
+    }
+  } else {
+    r = _fsetattrs(**fd, inline_to_set);
+    if (r < 0)
+      goto out_close;
+  }
 
   if (spill_out && !omap_remove.empty()) {
     r = object_map->remove_xattrs(oid, omap_remove, &spos);
@@ -3687,9 +4521,21 @@ int FileStore::_rmattr(coll_t cid, const ghobject_t& oid, const char *name,
     spill_out = false;
   }
 
-  char n[CHAIN_XATTR_MAX_NAME_LEN];
-  get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
-  r = chain_fremovexattr(**fd, n);
+  r = _load_packed_xattrs(fd);
+  if (r == FDCache::FD::XATTR_PACKED) {
+    map<string, bufferptr> aset;
+    r = _obj_getattrs(fd, aset, false);
+    if (r >= 0) {
+      if (aset.erase(name))
+	r = _fset_packed_xattrs(fd, aset);
+      else
+	r = -ENODATA;
+    }
+  } else if (r >= 0) {
+    char n[CHAIN_XATTR_MAX_NAME_LEN];
+    get_attrname(name, n, CHAIN_XATTR_MAX_NAME_LEN);
+    r = chain_fremovexattr(**fd, n);
+  }
   if (r == -ENODATA && spill_out) {
     Index index;
     r = get_index(cid, &index);
@@ -3735,7 +4581,9 @@ int FileStore::_rmattrs(coll_t cid, const ghobject_t& oid,
     spill_out = false;
   }
 
-  r = _fgetattrs(**fd, aset, false);
+  r = _rm_packed_xattrs(fd);
+  if (r >= 0)
+    r = _fgetattrs(**fd, aset, false);
   if (r >= 0) {
     for (map<string,bufferptr>::iterator p = aset.begin(); p != aset.end(); ++p) {
       char n[CHAIN_XATTR_MAX_NAME_LEN];
@@ -3947,6 +4795,92 @@ int FileStore::_collection_remove_recursive(const coll_t &cid,
   return _destroy_collection(cid);
 }
 
+/**
+ * Remove a collection without unlinking its objects one at a time.
+ *
+ * Only the omap of each object is cleared here (unless another link
+ * keeps the object alive), along with our caches of it; the directory
+ * is then renamed into current/removed, and the files go from there in
+ * the background.  Nothing is left for a replay to redo: the omap
+ * clears are guarded by spos, and the rename fails with ENOENT.
+ */
+int FileStore::_collection_remove_bulk(const coll_t &cid,
+				       const SequencerPosition &spos)
+{
+  dout(15) << "_collection_remove_bulk " << cid << dendl;
+  int r;
+  {
+    Index index;
+    r = get_index(cid, &index);
+    if (r < 0)
+      return r;
+
+    vector<ghobject_t> objects;
+    ghobject_t next;
+    uint64_t num = 0;
+    while (!next.is_max()) {
+      objects.clear();
+      r = index->collection_list_partial(next, 200, 300, 0, &objects, &next);
+      if (r < 0)
+	return r;
+      for (vector<ghobject_t>::iterator i = objects.begin();
+	   i != objects.end();
+	   ++i, ++num) {
+	IndexedPath path;
+	int exist;
+	r = index->lookup(*i, &path, &exist);
+	if (r < 0)
+	  return r;
+	struct stat st;
+	r = ::stat(path->path(), &st);
+	if (r < 0) {
+	  r = -errno;
+	  assert(!m_filestore_fail_eio || r != -EIO);
+	  return r;
+	}
+	if (st.st_nlink == 1) {
+	  r = object_map->clear(*i, &spos);
+	  if (r < 0 && r != -ENOENT) {
+	    assert(!m_filestore_fail_eio || r != -EIO);
+	    return r;
+	  }
+	  wbthrottle.clear_object(*i);
+	  fdcache.clear(*i);
+	} else if (!backend->can_checkpoint()) {
+	  object_map->sync(&*i, &spos);
+	}
+      }
+    }
+    dout(10) << "_collection_remove_bulk " << cid << " cleared " << num
+	     << " objects" << dendl;
+  }
+
+  char fn[PATH_MAX], removed[PATH_MAX], to[PATH_MAX];
+  get_cdir(cid, fn, sizeof(fn));
+  snprintf(removed, sizeof(removed), "%s/removed", current_fn.c_str());
+  r = ::mkdir(removed, 0755);
+  if (r < 0 && errno != EEXIST) {
+    r = -errno;
+    derr << "_collection_remove_bulk unable to create " << removed << ": "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  snprintf(to, sizeof(to), "%s/%s.%llu.%d.%d", removed, cid.c_str(),
+	   (unsigned long long)spos.seq, spos.trans, spos.op);
+  r = ::rename(fn, to);
+  if (r < 0)
+    r = -errno;
+  index_manager.forget_collection(cid);
+  dout(10) << "_collection_remove_bulk " << fn << " -> " << to << " = " << r
+	   << dendl;
+  if (r == 0) {
+    Mutex::Locker l(removal_lock);
+    removal_queue.push_back(to);
+    removal_cond.Signal();
+  }
+  return r;
+}
+
 int FileStore::_collection_rename(const coll_t &cid, const coll_t &ncid,
 				  const SequencerPosition& spos)
 {
@@ -3972,6 +4906,8 @@ int FileStore::_collection_rename(const coll_t &cid, const coll_t &ncid,
   }
   _set_global_replay_guard(cid, spos);
 
+  index_manager.forget_collection(cid);
+  index_manager.forget_collection(ncid);
   int ret = 0;
   if (::rename(old_coll, new_coll)) {
     if (replaying && !backend->can_checkpoint() &&
@@ -4053,7 +4989,8 @@ int FileStore::list_collections(vector<coll_t>& ls)
     } else if (de->d_type != DT_DIR) {
       continue;
     }
-    if (strcmp(de->d_name, "omap") == 0) {
+    if (strcmp(de->d_name, "omap") == 0 ||
+	strcmp(de->d_name, "removed") == 0) {
       continue;
     }
     if (de->d_name[0] == '.' &&
@@ -4165,6 +5102,90 @@ int FileStore::collection_list_partial(coll_t c, ghobject_t start,
   return 0;
 }
 
+/**
+ * The xattrs are read by path, as we go down the listing, rather than
+ * through an open fd per object, and into a buffer that an object_info_t
+ * usually fits in, so most objects cost a single getxattr.  Values that
+ * spilled out to the omap are read from there.
+ */
+int FileStore::collection_list_partial_attr(coll_t c, ghobject_t start,
+					    int min, int max, snapid_t seq,
+					    const char *attr,
+					    vector<ghobject_t> *ls,
+					    vector<bufferptr> *attrs,
+					    ghobject_t *next)
+{
+  dout(10) << "collection_list_partial_attr: " << c << " " << attr << dendl;
+  Index index;
+  int r = get_index(c, &index);
+  if (r < 0)
+    return r;
+  r = index->collection_list_partial(start, min, max, seq, ls, next);
+  if (r < 0) {
+    assert(!m_filestore_fail_eio || r != -EIO);
+    return r;
+  }
+
+  char n[CHAIN_XATTR_MAX_NAME_LEN];
+  get_attrname(attr, n, CHAIN_XATTR_MAX_NAME_LEN);
+  char val[512];
+  attrs->resize(ls->size());
+  for (unsigned i = 0; i < ls->size(); ++i) {
+    const ghobject_t &oid = (*ls)[i];
+    IndexedPath path;
+    int exist;
+    r = index->lookup(oid, &path, &exist);
+    if (r < 0) {
+      assert(!m_filestore_fail_eio || r != -EIO);
+      return r;
+    }
+    if (!exist)
+      continue;  // raced with a remove
+    bufferptr &bp = (*attrs)[i];
+    int l = chain_getxattr(path->path(), n, val, sizeof(val));
+    if (l >= 0) {
+      bp = buffer::create(l);
+      memcpy(bp.c_str(), val, l);
+    } else if (l == -ERANGE) {
+      l = chain_getxattr(path->path(), n, 0, 0);
+      if (l > 0) {
+	bp = buffer::create(l);
+	l = chain_getxattr(path->path(), n, bp.c_str(), l);
+      }
+    }
+    if (l == -ENODATA) {
+      // it may be packed
+      FDRef fd;
+      l = lfn_open(c, oid, false, &fd);
+      if (l >= 0) {
+	l = _obj_getattr(fd, attr, bp);
+	lfn_close(fd);
+      }
+    }
+    if (l == -ENODATA) {
+      set<string> to_get;
+      to_get.insert(string(attr));
+      map<string, bufferlist> got;
+      l = object_map->get_xattrs(oid, to_get, &got);
+      if (l < 0 && l != -ENOENT) {
+	assert(!m_filestore_fail_eio || l != -EIO);
+	return l;
+      }
+      if (!got.empty())
+	bp = got.begin()->second.begin().get_contiguous(
+	  got.begin()->second.length());
+      l = 0;
+    }
+    if (l < 0 && l != -ENOENT) {
+      assert(!m_filestore_fail_eio || l != -EIO);
+      return l;
+    }
+  }
+  dout(20) << "collection_list_partial_attr: " << ls->size() << " objects"
+	   << dendl;
+  return 0;
+}
+
 int FileStore::collection_list(coll_t c, vector<ghobject_t>& ls)
 {  
   Index index;
@@ -4311,6 +5332,20 @@ int FileStore::_create_collection(coll_t c)
   return init_index(c);
 }
 
+int FileStore::_collection_hint_expected_num_objs(coll_t c, uint32_t pg_num,
+						  uint64_t expected_num_objs)
+{
+  dout(15) << "collection_hint_expected_num_objs " << c << " pg_num "
+	   << pg_num << " expected_num_objs " << expected_num_objs << dendl;
+  Index index;
+  int r = get_index(c, &index);
+  if (r < 0)
+    return r;
+  r = index->pre_hash_collection(pg_num, expected_num_objs);
+  dout(10) << "collection_hint_expected_num_objs " << c << " = " << r << dendl;
+  return r;
+}
+
 int FileStore::_destroy_collection(coll_t c) 
 {
   {
@@ -4328,6 +5363,7 @@ int FileStore::_destroy_collection(coll_t c)
   int r = ::rmdir(fn);
   if (r < 0)
     r = -errno;
+  index_manager.forget_collection(c);
   dout(10) << "_destroy_collection " << fn << " = " << r << dendl;
   return r;
 }
@@ -4497,24 +5533,26 @@ int FileStore::_omap_clear(coll_t cid, const ghobject_t &hoid,
 
 int FileStore::_omap_setkeys(coll_t cid, const ghobject_t &hoid,
 			     const map<string, bufferlist> &aset,
-			     const SequencerPosition &spos) {
+			     const SequencerPosition &spos,
+			     ObjectMap::Batch batch) {
   dout(15) << __func__ << " " << cid << "/" << hoid << dendl;
   IndexedPath path;
   int r = lfn_find(cid, hoid, &path);
   if (r < 0)
     return r;
-  return object_map->set_keys(hoid, aset, &spos);
+  return object_map->set_keys(hoid, aset, &spos, batch);
 }
 
 int FileStore::_omap_rmkeys(coll_t cid, const ghobject_t &hoid,
 			    const set<string> &keys,
-			    const SequencerPosition &spos) {
+			    const SequencerPosition &spos,
+			    ObjectMap::Batch batch) {
   dout(15) << __func__ << " " << cid << "/" << hoid << dendl;
   IndexedPath path;
   int r = lfn_find(cid, hoid, &path);
   if (r < 0)
     return r;
-  r = object_map->rm_keys(hoid, keys, &spos);
+  r = object_map->rm_keys(hoid, keys, &spos, batch);
   if (r < 0 && r != -ENOENT)
     return r;
   return 0;
@@ -4539,14 +5577,15 @@ int FileStore::_omap_rmkeyrange(coll_t cid, const ghobject_t &hoid,
 
 int FileStore::_omap_setheader(coll_t cid, const ghobject_t &hoid,
 			       const bufferlist &bl,
-			       const SequencerPosition &spos)
+			       const SequencerPosition &spos,
+			       ObjectMap::Batch batch)
 {
   dout(15) << __func__ << " " << cid << "/" << hoid << dendl;
   IndexedPath path;
   int r = lfn_find(cid, hoid, &path);
   if (r < 0)
     return r;
-  return object_map->set_header(hoid, bl, &spos);
+  return object_map->set_header(hoid, bl, &spos, batch);
 }
 
 int FileStore::_split_collection(coll_t cid,
@@ -4711,15 +5750,16 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
       changed.count("filestore_max_inline_xattrs_xfs") ||
       changed.count("filestore_max_inline_xattrs_btrfs") ||
       changed.count("filestore_max_inline_xattrs_other")) {
-    Mutex::Locker l(lock);
     set_xattr_limits_via_conf();
   }
-  if (changed.count("filestore_min_sync_interval") ||
-      changed.count("filestore_max_sync_interval") ||
-      changed.count("filestore_queue_max_ops") ||
+  if (changed.count("filestore_queue_max_ops") ||
       changed.count("filestore_queue_max_bytes") ||
       changed.count("filestore_queue_committing_max_ops") ||
-      changed.count("filestore_queue_committing_max_bytes") ||
+      changed.count("filestore_queue_committing_max_bytes")) {
+    set_queue_limits_via_conf(conf);
+  }
+  if (changed.count("filestore_min_sync_interval") ||
+      changed.count("filestore_max_sync_interval") ||
       changed.count("filestore_kill_at") ||
       changed.count("filestore_fail_eio") ||
       changed.count("filestore_sloppy_crc") ||
@@ -4728,10 +5768,6 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
     Mutex::Locker l(lock);
     m_filestore_min_sync_interval = conf->filestore_min_sync_interval;
     m_filestore_max_sync_interval = conf->filestore_max_sync_interval;
-    m_filestore_queue_max_ops = conf->filestore_queue_max_ops;
-    m_filestore_queue_max_bytes = conf->filestore_queue_max_bytes;
-    m_filestore_queue_committing_max_ops = conf->filestore_queue_committing_max_ops;
-    m_filestore_queue_committing_max_bytes = conf->filestore_queue_committing_max_bytes;
     m_filestore_kill_at.set(conf->filestore_kill_at);
     m_filestore_fail_eio = conf->filestore_fail_eio;
     m_filestore_replica_fadvise = conf->filestore_replica_fadvise;
@@ -4818,17 +5854,31 @@ void FileStore::set_xattr_limits_via_conf()
       assert(!"Unknown fs type");
   }
 
+  xattr_limits_t limits;
+
   //Use override value if set
   if (g_conf->filestore_max_inline_xattr_size)
-    m_filestore_max_inline_xattr_size = g_conf->filestore_max_inline_xattr_size;
+    limits.max_inline_size = g_conf->filestore_max_inline_xattr_size;
   else
-    m_filestore_max_inline_xattr_size = fs_xattr_size;
+    limits.max_inline_size = fs_xattr_size;
 
   //Use override value if set
   if (g_conf->filestore_max_inline_xattrs)
-    m_filestore_max_inline_xattrs = g_conf->filestore_max_inline_xattrs;
+    limits.max_inline_count = g_conf->filestore_max_inline_xattrs;
   else
-    m_filestore_max_inline_xattrs = fs_xattrs;
+    limits.max_inline_count = fs_xattrs;
+
+  m_filestore_xattr_limits.set(limits);
+}
+
+void FileStore::set_queue_limits_via_conf(const md_config_t *conf)
+{
+  queue_limits_t limits;
+  limits.max_ops = conf->filestore_queue_max_ops;
+  limits.max_bytes = conf->filestore_queue_max_bytes;
+  limits.committing_max_ops = conf->filestore_queue_committing_max_ops;
+  limits.committing_max_bytes = conf->filestore_queue_committing_max_bytes;
+  m_filestore_queue_limits.set(limits);
 }
 
 // -- FSSuperblock --
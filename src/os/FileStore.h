@@ -35,6 +35,7 @@ using namespace std;
 #include "common/WorkQueue.h"
 
 #include "common/Mutex.h"
+#include "common/config_snapshot.h"
 #include "HashIndex.h"
 #include "IndexManager.h"
 #include "ObjectMap.h"
@@ -44,6 +45,10 @@ using namespace std;
 
 #include "include/uuid.h"
 
+#ifdef HAVE_LIBAIO
+# include <libaio.h>
+#endif
+
 
 // from include/linux/falloc.h:
 #ifndef FALLOC_FL_PUNCH_HOLE
@@ -74,6 +79,9 @@ enum {
   l_os_j_lat,
   l_os_j_wr,
   l_os_j_wr_bytes,
+  l_os_j_wr_lat,
+  l_os_j_wr_hold,
+  l_os_j_wr_lat_bytes_hist,
   l_os_oq_max_ops,
   l_os_oq_ops,
   l_os_ops,
@@ -85,8 +93,13 @@ enum {
   l_os_commit,
   l_os_commit_len,
   l_os_commit_lat,
+  l_os_commit_quiesce_lat,
   l_os_j_full,
   l_os_queue_lat,
+  l_os_fdc_hit,
+  l_os_fdc_miss,
+  l_os_fdc_evict,
+  l_os_coalesced,
   l_os_last,
 };
 
@@ -175,7 +188,7 @@ private:
   // ObjectMap
   boost::scoped_ptr<ObjectMap> object_map;
   
-  Finisher ondisk_finisher;
+  ShardedFinisher ondisk_finisher;  ///< keyed by OpSequencer::finisher_key()
 
   // helper fns
   int get_cdir(coll_t cid, char *s, int len);
@@ -207,6 +220,80 @@ private:
     }
   } sync_thread;
 
+  // -- removed collections --
+  /**
+   * Collections removed by _collection_remove_bulk are renamed into
+   * current/removed and deleted from here, in the background; what
+   * is left at mount is picked up again.
+   */
+  Mutex removal_lock;
+  Cond removal_cond;
+  list<string> removal_queue;  ///< dirs under current/removed
+  bool removal_stop;
+  void removal_entry();
+  struct RemovalThread : public Thread {
+    FileStore *fs;
+    RemovalThread(FileStore *f) : fs(f) {}
+    void *entry() {
+      fs->removal_entry();
+      return 0;
+    }
+  } removal_thread;
+  void removal_start();
+  void removal_shutdown();
+  int _remove_tree(const string &path);
+
+  // -- aio data writes --
+  struct AioBatch;
+#ifdef HAVE_LIBAIO
+  /// a data write in flight, see _write_aio
+  struct aio_write_t {
+    iocb io;          ///< must be first; io_getevents hands this back
+    AioBatch *batch;
+    int fd;           ///< O_DIRECT fd, closed when the batch drains
+    bufferlist bl;    ///< page aligned copy, pinned until completion
+    vector<iovec> iov;
+    uint64_t off, len;
+    aio_write_t() : batch(NULL), fd(-1), off(0), len(0) {}
+  };
+  /**
+   * the aio writes issued by one _do_transactions call
+   *
+   * Writes are left in flight while the rest of the transactions
+   * proceed.  Any op that might observe or clobber the data of an
+   * object in the batch drains it first, and the batch is always
+   * drained before the op is applied.
+   */
+  struct AioBatch {
+    list<aio_write_t> writes;
+    set<ghobject_t> objects;
+    int pending;      ///< protected by aio_lock
+    AioBatch() : pending(0) {}
+  };
+  bool aio;           ///< set while the aio finisher is running
+  io_context_t aio_ctx;
+  Mutex aio_lock;
+  Cond aio_cond;
+  int aio_num;        ///< writes in flight, protected by aio_lock
+  bool aio_stop;
+  void aio_finish_entry();
+  struct AioFinishThread : public Thread {
+    FileStore *fs;
+    AioFinishThread(FileStore *f) : fs(f) {}
+    void *entry() {
+      fs->aio_finish_entry();
+      return 0;
+    }
+  } aio_finish_thread;
+  int aio_start();
+  void aio_shutdown();
+  bool _aio_op_safe(int op);
+  int _write_aio(AioBatch *b, coll_t cid, const ghobject_t& oid,
+		 uint64_t offset, size_t len, const bufferlist& bl,
+		 bool replica);
+  void _aio_drain(AioBatch *b);
+#endif
+
   // -- op workqueue --
   struct Op {
     utime_t start;
@@ -242,6 +329,10 @@ private:
       assert(apply_lock.is_locked());
       return q.front();
     }
+    /// finisher shard key: completions for one sequencer stay in order
+    uint64_t finisher_key() const {
+      return (uintptr_t)this / sizeof(*this);
+    }
     Op *dequeue() {
       assert(apply_lock.is_locked());
       Mutex::Locker l(qlock);
@@ -286,7 +377,6 @@ private:
 
   friend ostream& operator<<(ostream& out, const OpSequencer& s);
 
-  Mutex fdcache_lock;
   FDCache fdcache;
   WBThrottle wbthrottle;
 
@@ -295,7 +385,7 @@ private:
   uint64_t op_queue_len, op_queue_bytes;
   Cond op_throttle_cond;
   Mutex op_throttle_lock;
-  Finisher op_finisher;
+  ShardedFinisher op_finisher;      ///< keyed by sequencer
 
   ThreadPool op_tp;
   struct OpWQ : public ThreadPool::WorkQueue<OpSequencer> {
@@ -407,7 +497,7 @@ public:
   }
   unsigned _do_transaction(
     Transaction& t, uint64_t op_seq, int trans_num,
-    ThreadPool::TPHandle *handle);
+    ThreadPool::TPHandle *handle, AioBatch *aiob = NULL);
 
   int queue_transactions(Sequencer *osr, list<Transaction*>& tls,
 			 TrackedOpRef op = TrackedOpRef(),
@@ -475,7 +565,26 @@ public:
     size_t len,
     bufferlist& bl,
     bool allow_eio = false);
+  int read_once(
+    coll_t cid,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    bufferlist& bl,
+    bool allow_eio = false);
+  int _read(
+    coll_t cid,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    bufferlist& bl,
+    bool allow_eio,
+    bool dontneed);
   int fiemap(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, bufferlist& bl);
+  int _do_fiemap(int fd, uint64_t offset, size_t len,
+                 map<uint64_t, uint64_t> *m);
+  int _do_seek_hole_data(int fd, uint64_t offset, size_t len,
+                         map<uint64_t, uint64_t> *m);
 
   int _touch(coll_t cid, const ghobject_t& oid);
   int _write(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, const bufferlist& bl,
@@ -495,6 +604,13 @@ public:
   int _fgetattrs(int fd, map<string,bufferptr>& aset, bool user_only);
   int _fsetattrs(int fd, map<string, bufferptr> &aset);
 
+  // object xattrs, packed or one fs xattr each
+  int _load_packed_xattrs(FDRef fd);
+  int _fset_packed_xattrs(FDRef fd, const map<string, bufferptr> &aset);
+  int _rm_packed_xattrs(FDRef fd);
+  int _obj_getattr(FDRef fd, const char *name, bufferptr& bp);
+  int _obj_getattrs(FDRef fd, map<string,bufferptr>& aset, bool user_only);
+
   void _start_sync();
 
   void start_sync();
@@ -506,6 +622,10 @@ public:
 
   int dump_journal(ostream& out);
 
+  void compact_removed() {
+    object_map->compact_cleared();
+  }
+
   void set_fsid(uuid_d u) {
     fsid = u;
   }
@@ -543,6 +663,8 @@ public:
   int _collection_setattrs(coll_t cid, map<string,bufferptr> &aset);
   int _collection_remove_recursive(const coll_t &cid,
 				   const SequencerPosition &spos);
+  int _collection_remove_bulk(const coll_t &cid,
+			      const SequencerPosition &spos);
   int _collection_rename(const coll_t &cid, const coll_t &ncid,
 			 const SequencerPosition& spos);
 
@@ -556,6 +678,12 @@ public:
   int collection_list_partial(coll_t c, ghobject_t start,
 			      int min, int max, snapid_t snap,
 			      vector<ghobject_t> *ls, ghobject_t *next);
+  int collection_list_partial_attr(coll_t c, ghobject_t start,
+				   int min, int max, snapid_t snap,
+				   const char *attr,
+				   vector<ghobject_t> *ls,
+				   vector<bufferptr> *attrs,
+				   ghobject_t *next);
   int collection_list_range(coll_t c, ghobject_t start, ghobject_t end,
                             snapid_t seq, vector<ghobject_t> *ls);
 
@@ -577,6 +705,9 @@ public:
   int _create_collection(coll_t c);
   int _create_collection(coll_t c, const SequencerPosition &spos);
   int _destroy_collection(coll_t c);
+  /// pre-split the collection's subdirs for the expected object count
+  int _collection_hint_expected_num_objs(coll_t c, uint32_t pg_num,
+					 uint64_t expected_num_objs);
   int _collection_add(coll_t c, coll_t ocid, const ghobject_t& oid,
 		      const SequencerPosition& spos);
   int _collection_move_rename(coll_t oldcid, const ghobject_t& oldoid,
@@ -594,14 +725,26 @@ private:
 		  const SequencerPosition &spos);
   int _omap_setkeys(coll_t cid, const ghobject_t &oid,
 		    const map<string, bufferlist> &aset,
-		    const SequencerPosition &spos);
+		    const SequencerPosition &spos,
+		    ObjectMap::Batch batch=ObjectMap::Batch());
   int _omap_rmkeys(coll_t cid, const ghobject_t &oid, const set<string> &keys,
-		   const SequencerPosition &spos);
+		   const SequencerPosition &spos,
+		   ObjectMap::Batch batch=ObjectMap::Batch());
   int _omap_rmkeyrange(coll_t cid, const ghobject_t &oid,
 		       const string& first, const string& last,
 		       const SequencerPosition &spos);
   int _omap_setheader(coll_t cid, const ghobject_t &oid, const bufferlist &bl,
-		      const SequencerPosition &spos);
+		      const SequencerPosition &spos,
+		      ObjectMap::Batch batch=ObjectMap::Batch());
+  bool _omap_op_batchable(int op);
+  void _omap_submit_batch(ObjectMap::Batch &batch);
+  void _coalesce_setattrs(Transaction::iterator &i, const vector<char> &plan,
+			  const coll_t &cid, const ghobject_t &oid,
+			  map<string, bufferptr> &aset, SequencerPosition &spos);
+  void _coalesce_omap_setkeys(Transaction::iterator &i, const vector<char> &plan,
+			      const coll_t &cid, const ghobject_t &oid,
+			      map<string, bufferlist> &aset,
+			      SequencerPosition &spos);
   int _split_collection(coll_t cid, uint32_t bits, uint32_t rem, coll_t dest,
                         const SequencerPosition &spos);
   int _split_collection_create(coll_t cid, uint32_t bits, uint32_t rem,
@@ -624,10 +767,17 @@ private:
   bool m_journal_dio, m_journal_aio, m_journal_force_aio;
   std::string m_osd_rollback_to_cluster_snap;
   bool m_osd_use_stale_snap;
-  int m_filestore_queue_max_ops;
-  int m_filestore_queue_max_bytes;
-  int m_filestore_queue_committing_max_ops;
-  int m_filestore_queue_committing_max_bytes;
+
+  /// op queue throttle limits, read per op
+  struct queue_limits_t {
+    int max_ops;
+    int max_bytes;
+    int committing_max_ops;     // extra allowance while committing
+    int committing_max_bytes;
+  };
+  ConfigSnapshot<queue_limits_t> m_filestore_queue_limits;
+  void set_queue_limits_via_conf(const md_config_t *conf);
+
   bool m_filestore_do_dump;
   std::ofstream m_filestore_dump;
   JSONFormatter m_filestore_dump_fmt;
@@ -638,8 +788,11 @@ private:
 
   //Determined xattr handling based on fs type
   void set_xattr_limits_via_conf();
-  uint32_t m_filestore_max_inline_xattr_size;
-  uint32_t m_filestore_max_inline_xattrs;
+  struct xattr_limits_t {
+    uint32_t max_inline_size;
+    uint32_t max_inline_count;
+  };
+  ConfigSnapshot<xattr_limits_t> m_filestore_xattr_limits;
 
   FSSuperblock superblock;
 
@@ -709,6 +862,7 @@ public:
   virtual int destroy_checkpoint(const string& name) = 0;
   virtual int syncfs() = 0;
   virtual bool has_fiemap() = 0;
+  virtual bool has_seek_data_hole() = 0;
   virtual int do_fiemap(int fd, off_t start, size_t len, struct fiemap **pfiemap) = 0;
   virtual int clone_range(int from, int to, uint64_t srcoff, uint64_t len, uint64_t dstoff) = 0;
 
@@ -57,7 +57,9 @@
 GenericFileStoreBackend::GenericFileStoreBackend(FileStore *fs):
   FileStoreBackend(fs),
   ioctl_fiemap(false),
+  seek_data_hole(false),
   m_filestore_fiemap(g_conf->filestore_fiemap),
+  m_filestore_seek_data_hole(g_conf->filestore_seek_data_hole),
   m_filestore_fsync_flushes_journal_data(g_conf->filestore_fsync_flushes_journal_data) {}
 
 int GenericFileStoreBackend::detect_features()
@@ -131,6 +133,26 @@ int GenericFileStoreBackend::detect_features()
     ioctl_fiemap = false;
   }
 
+  // the file starts with a hole up to the first extent written above
+#if defined(__linux__) && defined(SEEK_HOLE) && defined(SEEK_DATA)
+  off_t data = ::lseek(fd, 0, SEEK_DATA);
+  off_t hole = ::lseek(fd, v[0], SEEK_HOLE);
+  if (data < 0 || hole < 0) {
+    dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is NOT supported" << dendl;
+  } else if (data != v[0] || hole != v[0] + v[1]) {
+    dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is supported, but does not report holes" << dendl;
+  } else {
+    dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is supported and appears to work" << dendl;
+    seek_data_hole = true;
+  }
+#else
+  dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is NOT supported" << dendl;
+#endif
+  if (seek_data_hole && !m_filestore_seek_data_hole) {
+    dout(0) << "detect_features: SEEK_DATA/SEEK_HOLE is disabled via 'filestore seek data hole' config option" << dendl;
+    seek_data_hole = false;
+  }
+
   ::unlink(fn);
   TEMP_FAILURE_RETRY(::close(fd));
 
@@ -923,6 +923,12 @@ GenericObjectMap::Header GenericObjectMap::_lookup_header(
   while (map_header_in_use.count(oid))
     header_cond.Wait(header_lock);
 
+  {
+    _Header cached;
+    if (caches.lookup(make_pair(cid, oid), &cached))
+      return Header(new _Header(cached), RemoveMapHeaderOnDelete(this, cid, oid));
+  }
+
   map<string, bufferlist> out;
   set<string> to_get;
   to_get.insert(header_key(cid, oid));
@@ -935,6 +941,7 @@ GenericObjectMap::Header GenericObjectMap::_lookup_header(
   Header ret(new _Header(), RemoveMapHeaderOnDelete(this, cid, oid));
   bufferlist::iterator iter = out.begin()->second.begin();
   ret->decode(iter);
+  caches.add(make_pair(cid, oid), *ret);
   return ret;
 }
 
@@ -1027,6 +1034,7 @@ void GenericObjectMap::remove_header(const coll_t &cid,
   set<string> to_remove;
   to_remove.insert(header_key(cid, oid));
   t->rmkeys(GHOBJECT_TO_SEQ_PREFIX, to_remove);
+  caches.clear(make_pair(cid, oid));
 }
 
 void GenericObjectMap::set_header(const coll_t &cid, const ghobject_t &oid,
@@ -1038,6 +1046,7 @@ void GenericObjectMap::set_header(const coll_t &cid, const ghobject_t &oid,
   map<string, bufferlist> to_set;
   header.encode(to_set[header_key(cid, oid)]);
   t->set(GHOBJECT_TO_SEQ_PREFIX, to_set);
+  caches.add(make_pair(cid, oid), header);
 }
 
 int GenericObjectMap::list_objects(const coll_t &cid, ghobject_t start, int max,
@@ -30,6 +30,8 @@
 #include "osd/osd_types.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/config.h"
+#include "common/simple_cache.hpp"
 
 /**
  * Genericobjectmap: Provide with key/value associated to ghobject_t APIs to caller
@@ -81,7 +83,8 @@ class GenericObjectMap {
   set<uint64_t> in_use;
   set<ghobject_t> map_header_in_use;
 
-  GenericObjectMap(KeyValueDB *db) : db(db), header_lock("GenericObjectMap") {}
+  GenericObjectMap(KeyValueDB *db) : db(db), header_lock("GenericObjectMap"),
+    caches(g_conf->keyvaluestore_header_cache_size) {}
 
   int get(
     const coll_t &cid,
@@ -213,6 +216,15 @@ class GenericObjectMap {
 
   typedef ceph::shared_ptr<_Header> Header;
 
+  /**
+   * Leaf headers by object, as last written to GHOBJECT_TO_SEQ
+   *
+   * Kept up to date by set_header and remove_header, which every change
+   * to a leaf goes through, so a hot object's header is read from the
+   * db once rather than once per transaction.
+   */
+  SimpleLRU<pair<coll_t, ghobject_t>, _Header> caches;
+
   Header lookup_header(const coll_t &cid, const ghobject_t &oid) {
     Mutex::Locker l(header_lock);
     return _lookup_header(cid, oid);
@@ -257,6 +257,10 @@ int HashIndex::_created(const vector<string> &path,
     return r;
 
   if (must_split(info)) {
+    if (split_queue) {
+      split_queue->queue_split(coll(), get_base_path(), path);
+      return 0;
+    }
     int r = initiate_split(path, info);
     if (r < 0)
       return r;
@@ -266,6 +270,161 @@ int HashIndex::_created(const vector<string> &path,
   }
 }
 
+int HashIndex::split_dir(const vector<string> &path) {
+  subdir_info_s info;
+  int r = get_info(path, &info);
+  if (r == -ENOENT || r == -ENODATA)
+    return 0; // merged or removed since it was queued
+  if (r < 0)
+    return r;
+  if (!must_split(info))
+    return 0;
+  dout(10) << "split_dir " << coll() << " " << path << " objs "
+	   << info.objs << dendl;
+  r = initiate_split(path, info);
+  if (r < 0)
+    return r;
+  r = complete_split(path, info);
+  if (r < 0)
+    return r;
+
+  // the subdir may have grown well past the threshold while it waited
+  if (split_queue) {
+    set<string> subdirs;
+    r = list_subdirs(path, &subdirs);
+    if (r < 0)
+      return r;
+    vector<string> sub = path;
+    sub.push_back("");
+    for (set<string>::iterator i = subdirs.begin(); i != subdirs.end(); ++i) {
+      *sub.rbegin() = *i;
+      subdir_info_s sub_info;
+      r = get_info(sub, &sub_info);
+      if (r < 0)
+	return r;
+      if (must_split(sub_info))
+	split_queue->queue_split(coll(), get_base_path(), sub);
+    }
+  }
+  return 0;
+}
+
+/**
+ * The objects of a pg agree on the low order bits of their hash (see
+ * ceph_stable_mod), so the top of the tree is a single chain of subdirs
+ * and only the levels below it fan out.  Create enough of those that
+ * no leaf has to split before the pool reaches expected_num_objs.
+ */
+int HashIndex::pre_hash_collection(uint32_t pg_num,
+				   uint64_t expected_num_objs) {
+  spg_t pgid;
+  snapid_t snap;
+  if (!coll().is_pg(pgid, snap) || snap != CEPH_NOSNAP || pg_num == 0)
+    return 0;
+  uint64_t leaf_objs = (uint64_t)merge_threshold * 16 * split_multiplier;
+  if (leaf_objs == 0)
+    return 0;
+  uint64_t leaves = expected_num_objs / pg_num / leaf_objs;
+  if (leaves <= 1)
+    return 0;
+
+  // only while nothing is stored, objects would be stranded above the
+  // new subdirs otherwise
+  vector<ghobject_t> ls;
+  ghobject_t next;
+  int r = _collection_list_partial(ghobject_t(), 0, 1, 0, &ls, &next);
+  if (r < 0)
+    return r;
+  if (!ls.empty()) {
+    dout(10) << "pre_hash_collection " << coll() << " is not empty" << dendl;
+    return 0;
+  }
+
+  uint32_t ps = pgid.ps();
+  int bits = pg_pool_t::calc_bits_of(pg_num - 1);
+  int fixed_bits = bits;
+  if (bits > 0 && ps < (1u << (bits - 1)) &&
+      (ps | (1u << (bits - 1))) >= pg_num)
+    --fixed_bits;  // also gets the hashes of the missing upper twin
+
+  vector<string> path;
+  char buf[2];
+  for (int i = 0; i < fixed_bits / 4; ++i) {
+    snprintf(buf, sizeof(buf), "%X", (ps >> (4 * i)) & 0xf);
+    path.push_back(buf);
+    r = create_path(path);
+    if (r < 0 && r != -EEXIST)
+      return r;
+  }
+  if (path.size() >= (unsigned)MAX_HASH_LEVEL)
+    return 0;
+
+  // the next level is only partly fixed
+  int rem = fixed_bits % 4;
+  uint32_t low = (ps >> (4 * (fixed_bits / 4))) & ((1 << rem) - 1);
+  uint32_t subs = 16 >> rem;
+  unsigned levels = 0;
+  for (uint64_t n = subs;
+       n < leaves && path.size() + 1 + levels < (unsigned)MAX_HASH_LEVEL;
+       n *= 16)
+    ++levels;
+  dout(10) << "pre_hash_collection " << coll() << " pg_num " << pg_num
+	   << " expected_num_objs " << expected_num_objs << ": " << subs
+	   << " subdirs at level " << path.size() << ", " << levels
+	   << " full levels below" << dendl;
+
+  cache_clear();
+  path.push_back("");
+  for (uint32_t j = 0; j < subs; ++j) {
+    snprintf(buf, sizeof(buf), "%X", low | (j << rem));
+    *path.rbegin() = buf;
+    r = create_path(path);
+    if (r < 0 && r != -EEXIST)
+      return r;
+    r = pre_split_folder(path, levels);
+    if (r < 0)
+      return r;
+  }
+  path.pop_back();
+
+  // record the new layout bottom up, along the fixed chain
+  while (true) {
+    r = reset_attr(path);
+    if (r < 0)
+      return r;
+    r = fsync_dir(path);
+    if (r < 0)
+      return r;
+    if (path.empty())
+      break;
+    path.pop_back();
+  }
+  return 0;
+}
+
+int HashIndex::pre_split_folder(vector<string> &path, unsigned levels) {
+  int r;
+  if (levels > 0) {
+    char buf[2];
+    path.push_back("");
+    for (int i = 0; i < 16; ++i) {
+      snprintf(buf, sizeof(buf), "%X", i);
+      *path.rbegin() = buf;
+      r = create_path(path);
+      if (r < 0 && r != -EEXIST)
+	return r;
+      r = pre_split_folder(path, levels - 1);
+      if (r < 0)
+	return r;
+    }
+    path.pop_back();
+  }
+  r = reset_attr(path);
+  if (r < 0)
+    return r;
+  return fsync_dir(path);
+}
+
 int HashIndex::_remove(const vector<string> &path,
 		       const ghobject_t &oid,
 		       const string &mangled_name) {
@@ -65,6 +65,25 @@ private:
   int merge_threshold;
   int split_multiplier;
 
+public:
+  /**
+   * Receives splits that _created chose not to do inline
+   *
+   * @see IndexManager, filestore_split_defer
+   */
+  class SplitQueue {
+  public:
+    virtual void queue_split(
+      coll_t c,                  ///< [in] collection
+      const string &base_path,   ///< [in] path to the collection
+      const vector<string> &path ///< [in] subdir to split
+      ) = 0;
+    virtual ~SplitQueue() {}
+  };
+
+private:
+  SplitQueue *split_queue; ///< NULL to split inline
+
   /// Encodes current subdir state for determining when to split/merge.
   struct subdir_info_s {
     uint64_t objs;       ///< Objects in subdir.
@@ -140,7 +159,13 @@ public:
     double retry_probability=0) ///< [in] retry probability
     : LFNIndex(collection, base_path, index_version, retry_probability),
       merge_threshold(merge_at),
-      split_multiplier(split_multiple) {}
+      split_multiplier(split_multiple),
+      split_queue(NULL) {}
+
+  /// Hand over-full subdirs to q instead of splitting them in _created
+  void set_split_queue(SplitQueue *q) {
+    split_queue = q;
+  }
 
   /// @see CollectionIndex
   uint32_t collection_version() { return index_version; }
@@ -157,6 +182,17 @@ public:
     uint32_t bits,
     ceph::shared_ptr<CollectionIndex> dest
     );
+
+  /// @see CollectionIndex
+  int pre_hash_collection(
+    uint32_t pg_num,
+    uint64_t expected_num_objs
+    );
+
+  /// @see CollectionIndex
+  int split_dir(
+    const vector<string> &path
+    );
 	
 protected:
   int _init();
@@ -266,6 +302,12 @@ private:
     vector<string> *path   ///< [out] Path components for hoid.
     );
 
+  /// Create every subdir of path down to levels below it
+  int pre_split_folder(
+    vector<string> &path, ///< [in] subdir to fill, restored on return
+    unsigned levels       ///< [in] levels of subdirs to create
+    ); ///< @return Error Code, 0 on success
+
   /// do collection split for path
   static int col_split_level(
     HashIndex &from,            ///< [in] from index
@@ -25,6 +25,7 @@
 #include "common/Cond.h"
 #include "common/config.h"
 #include "common/debug.h"
+#include "common/errno.h"
 #include "include/buffer.h"
 
 #include "IndexManager.h"
@@ -34,6 +35,8 @@
 
 #include "chain_xattr.h"
 
+#define dout_subsys ceph_subsys_filestore
+
 static int set_version(const char *path, uint32_t version) {
   bufferlist bl;
   ::encode(version, bl);
@@ -68,8 +71,22 @@ void IndexManager::put_index(coll_t c) {
   cond.Signal();
 }
 
+void IndexManager::_forget_collection(coll_t c) {
+  lookup_caches.erase(c);
+  for (list<split_item_t>::iterator i = split_items.begin();
+       i != split_items.end(); ) {
+    if (i->c == c) {
+      split_queued.erase(make_pair(i->c, i->path));
+      split_items.erase(i++);
+    } else {
+      ++i;
+    }
+  }
+}
+
 int IndexManager::init_index(coll_t c, const char *path, uint32_t version) {
   Mutex::Locker l(lock);
+  _forget_collection(c);
   int r = set_version(path, version);
   if (r < 0)
     return r;
@@ -109,15 +126,96 @@ int IndexManager::build_index(coll_t c, const char *path, Index *index) {
 
   } else {
     // No need to check
-    *index = Index(new HashIndex(c, path, g_conf->filestore_merge_threshold,
-				 g_conf->filestore_split_multiple,
-				 CollectionIndex::HOBJECT_WITH_POOL,
-				 g_conf->filestore_index_retry_probability),
-		   RemoveOnDelete(c, this));
+    HashIndex *hindex = new HashIndex(c, path,
+				      g_conf->filestore_merge_threshold,
+				      g_conf->filestore_split_multiple,
+				      CollectionIndex::HOBJECT_WITH_POOL,
+				      g_conf->filestore_index_retry_probability);
+    if (g_conf->filestore_index_lookup_cache_size > 0) {
+      ceph::shared_ptr<LFNIndex::LookupCache> &cache = lookup_caches[c];
+      if (!cache)
+	cache.reset(new LFNIndex::LookupCache(
+		      g_conf->filestore_index_lookup_cache_size));
+      hindex->set_lookup_cache(cache);
+    }
+    if (split_thread.is_started())
+      hindex->set_split_queue(this);
+    *index = Index(hindex, RemoveOnDelete(c, this));
     return 0;
   }
 }
 
+void IndexManager::forget_collection(coll_t c) {
+  Mutex::Locker l(lock);
+  _forget_collection(c);
+}
+
+void IndexManager::start() {
+  if (!g_conf->filestore_split_defer)
+    return;
+  split_stop = false;
+  split_thread.create();
+}
+
+void IndexManager::stop() {
+  if (!split_thread.is_started())
+    return;
+  lock.Lock();
+  split_stop = true;
+  split_cond.Signal();
+  lock.Unlock();
+  split_thread.join();
+  lock.Lock();
+  split_items.clear();
+  split_queued.clear();
+  lock.Unlock();
+}
+
+void IndexManager::queue_split(coll_t c, const string &base_path,
+			       const vector<string> &path) {
+  Mutex::Locker l(lock);
+  if (split_stop || !split_queued.insert(make_pair(c, path)).second)
+    return;
+  split_items.push_back(split_item_t(c, base_path, path));
+  split_cond.Signal();
+}
+
+void IndexManager::split_entry() {
+  lock.Lock();
+  while (!split_stop) {
+    if (split_items.empty()) {
+      split_cond.Wait(lock);
+      continue;
+    }
+    if (ceph_clock_now(g_ceph_context) < split_next) {
+      split_cond.WaitUntil(lock, split_next);
+      continue;
+    }
+    split_item_t item = split_items.front();
+    split_items.pop_front();
+    split_queued.erase(make_pair(item.c, item.path));
+
+    lock.Unlock();
+    // waits for the current users of the collection
+    Index index;
+    int r = get_index(item.c, item.base_path.c_str(), &index);
+    if (r == 0)
+      r = index->split_dir(item.path);
+    if (r < 0)
+      derr << "deferred split of " << item.c << " " << item.path
+	   << " failed: " << cpp_strerror(r) << dendl;
+    index.reset();
+    lock.Lock();
+
+    if (g_conf->filestore_split_rate > 0) {
+      utime_t interval;
+      interval.set_from_double(1.0 / g_conf->filestore_split_rate);
+      split_next = ceph_clock_now(g_ceph_context) + interval;
+    }
+  }
+  lock.Unlock();
+}
+
 int IndexManager::get_index(coll_t c, const char *path, Index *index) {
   Mutex::Locker l(lock);
   while (1) {
@@ -19,8 +19,10 @@
 
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/Thread.h"
 #include "common/config.h"
 #include "common/debug.h"
+#include "include/utime.h"
 
 #include "CollectionIndex.h"
 #include "HashIndex.h"
@@ -43,8 +45,11 @@ typedef ceph::shared_ptr<CollectionIndex> Index;
  * carry a reference to the parrent index.  Once all
  * shared_ptr<CollectionIndex> references have expired, the destructor
  * removes the weak_ptr from col_indices and wakes waiters.
+ *
+ * With filestore_split_defer, HashIndex subdir splits are queued here
+ * and done by a background thread, no faster than filestore_split_rate.
  */
-class IndexManager {
+class IndexManager : public HashIndex::SplitQueue {
   Mutex lock; ///< Lock for Index Manager
   Cond cond;  ///< Cond for waiters on col_indices
   bool upgrade;
@@ -52,6 +57,36 @@ class IndexManager {
   /// Currently in use CollectionIndices
   map<coll_t,ceph::weak_ptr<CollectionIndex> > col_indices;
 
+  /// lookup caches, kept across the short lived HashIndex instances
+  map<coll_t,ceph::shared_ptr<LFNIndex::LookupCache> > lookup_caches;
+
+  /// Deferred subdir splits, in queue order
+  struct split_item_t {
+    coll_t c;
+    string base_path;
+    vector<string> path;
+    split_item_t(coll_t c, const string &b, const vector<string> &p)
+      : c(c), base_path(b), path(p) {}
+  };
+  list<split_item_t> split_items;
+  set<pair<coll_t, vector<string> > > split_queued; ///< dedups split_items
+  Cond split_cond;
+  bool split_stop;
+  utime_t split_next; ///< no split before this, see filestore_split_rate
+
+  void split_entry();
+  struct SplitThread : public Thread {
+    IndexManager *manager;
+    SplitThread(IndexManager *m) : manager(m) {}
+    void *entry() {
+      manager->split_entry();
+      return 0;
+    }
+  } split_thread;
+
+  /// @see forget_collection, call with lock held
+  void _forget_collection(coll_t c);
+
   /// Cleans up state for c @see RemoveOnDelete
   void put_index(
     coll_t c ///< Put the index for c
@@ -86,7 +121,18 @@ class IndexManager {
 public:
   /// Constructor
   IndexManager(bool upgrade) : lock("IndexManager lock"),
-			       upgrade(upgrade) {}
+			       upgrade(upgrade),
+			       split_stop(false),
+			       split_thread(this) {}
+
+  /// Start the deferred split thread, if filestore_split_defer is set
+  void start();
+  /// Stop the deferred split thread; queued splits are dropped
+  void stop();
+
+  /// @see HashIndex::SplitQueue
+  void queue_split(coll_t c, const string &base_path,
+		   const vector<string> &path);
 
   /**
    * Reserve and return index for c
@@ -107,6 +153,16 @@ public:
    * @return error code
    */
   int init_index(coll_t c, const char *path, uint32_t filestore_version);
+
+  /**
+   * Forget cached lookups and queued splits for c
+   *
+   * Must be called when the collection directory is removed or
+   * renamed underneath the index.
+   *
+   * @param [in] c Collection to forget
+   */
+  void forget_collection(coll_t c);
 };
 
 #endif
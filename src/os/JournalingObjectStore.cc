@@ -106,13 +106,18 @@ int JournalingObjectStore::journal_replay(uint64_t fs_op_seq)
 
 // ------------------------------------
 
-uint64_t JournalingObjectStore::ApplyManager::op_apply_start(uint64_t op)
+uint64_t JournalingObjectStore::ApplyManager::op_apply_start(
+  uint64_t op, ThreadPool::TPHandle *handle)
 {
   Mutex::Locker l(apply_lock);
   while (blocked) {
-    // note: this only happens during journal replay
+    // a commit is quiescing applies
     dout(10) << "op_apply_start blocked, waiting" << dendl;
+    if (handle)
+      handle->suspend_tp_timeout();
     blocked_cond.Wait(apply_lock);
+    if (handle)
+      handle->reset_tp_timeout();
   }
   dout(10) << "op_apply_start " << op << " open_ops " << open_ops << " -> " << (open_ops+1) << dendl;
   assert(!blocked);
@@ -131,7 +136,7 @@ void JournalingObjectStore::ApplyManager::op_apply_finish(uint64_t op)
   --open_ops;
   assert(open_ops >= 0);
 
-  // signal a blocked commit_start (only needed during journal replay)
+  // signal a blocked commit_start
   if (blocked) {
     blocked_cond.Signal();
   }
@@ -18,6 +18,7 @@
 #include "ObjectStore.h"
 #include "Journal.h"
 #include "common/RWLock.h"
+#include "common/WorkQueue.h"
 
 class JournalingObjectStore : public ObjectStore {
 protected:
@@ -69,7 +70,8 @@ protected:
       com_lock("JOS::ApplyManager::com_lock", false, true, false, g_ceph_context),
       committing_seq(0), committed_seq(0) {}
     void add_waiter(uint64_t, Context*);
-    uint64_t op_apply_start(uint64_t op);
+    /// waits while a commit is starting; handle, if any, is not timed out
+    uint64_t op_apply_start(uint64_t op, ThreadPool::TPHandle *handle = NULL);
     void op_apply_finish(uint64_t op);
     bool commit_start();
     void commit_started();
@@ -12,6 +12,8 @@
 #include "ObjectMap.h"
 
 using std::string;
+class CephContext;
+
 /**
  * Defines virtual interface to be implemented by key value store
  *
@@ -19,6 +21,36 @@ using std::string;
  */
 class KeyValueDB {
 public:
+  /**
+   * Create a store of the named type ("leveldb", "rocksdb") at dir.
+   *
+   * @return NULL if the type is unknown or was not built in
+   */
+  static KeyValueDB *create(CephContext *cct, const string& type,
+			    const string& dir);
+
+  /**
+   * Folds merge operands into a key's value, see TransactionImpl::merge
+   *
+   * The operation must be associative; backends may combine operands
+   * with each other before they see the stored value.
+   */
+  class MergeOperator {
+  public:
+    /// value of a key that did not exist, after merging r into it
+    virtual void merge_nonexistent(
+      const char *rdata, size_t rlen, string *new_value) = 0;
+    /// value of a key holding l, after merging r into it
+    virtual void merge(
+      const char *ldata, size_t llen,
+      const char *rdata, size_t rlen,
+      string *new_value) = 0;
+    /// stable name, identifies the operator to the backend
+    virtual string name() const = 0;
+    virtual ~MergeOperator() {}
+  };
+  typedef ceph::shared_ptr<MergeOperator> MergeOperatorRef;
+
   class TransactionImpl {
   public:
     /// Set Keys
@@ -60,11 +92,38 @@ public:
       const string &prefix ///< [in] Prefix by which to remove keys
       ) = 0;
 
+    /**
+     * Merge value into key with the operator registered for prefix
+     *
+     * Unlike a get followed by a set, the stored value is not read by
+     * the caller.  Backends without native merge support fold the
+     * operands in at submit time.
+     */
+    virtual void merge(
+      const string &prefix,   ///< [in] Prefix with a merge operator
+      const string &k,	      ///< [in] Key to merge into
+      const bufferlist &bl    ///< [in] Merge operand
+      ) = 0;
+
     virtual ~TransactionImpl() {};
   };
   typedef ceph::shared_ptr< TransactionImpl > Transaction;
 
   virtual int init() = 0;
+
+  /// use mop for merges under prefix; must be called before open()
+  virtual int set_merge_operator(const string &prefix, MergeOperatorRef mop) {
+    merge_ops[prefix] = mop;
+    return 0;
+  }
+  /// operator registered for prefix, or NULL
+  MergeOperatorRef get_merge_operator(const string &prefix) {
+    std::map<string, MergeOperatorRef>::iterator p = merge_ops.find(prefix);
+    if (p == merge_ops.end())
+      return MergeOperatorRef();
+    return p->second;
+  }
+
   virtual int open(ostream &out) = 0;
   virtual int create_and_open(ostream &out) = 0;
 
@@ -171,9 +230,25 @@ public:
 
   virtual uint64_t get_estimated_size(map<string,uint64_t> &extra) = 0;
 
+  /// compact the whole store; a no-op for stores that don't compact
+  virtual void compact() {}
+
+  /// compact all keys with a given prefix
+  virtual void compact_prefix(const string& prefix) {}
+  virtual void compact_prefix_async(const string& prefix) {}
+  virtual void compact_range(const string& prefix,
+			     const string& start, const string& end) {}
+  virtual void compact_range_async(const string& prefix,
+				   const string& start, const string& end) {}
+  /// compact all keys whose prefix sorts in [start_prefix, end_prefix)
+  virtual void compact_prefix_range_async(const string& start_prefix,
+					  const string& end_prefix) {}
+
   virtual ~KeyValueDB() {}
 
 protected:
+  std::map<string, MergeOperatorRef> merge_ops;
+
   virtual WholeSpaceIterator _get_iterator() = 0;
   virtual WholeSpaceIterator _get_snapshot_iterator() = 0;
 };
@@ -35,6 +35,7 @@
 #include <sstream>
 
 #include "KeyValueStore.h"
+#include "LevelDBStore.h"
 #include "common/BackTrace.h"
 #include "include/types.h"
 
@@ -48,7 +49,6 @@
 #include "common/safe_io.h"
 #include "common/perf_counters.h"
 #include "common/sync_filesystem.h"
-#include "LevelDBStore.h"
 
 #include "common/ceph_crypto.h"
 using ceph::crypto::SHA1;
@@ -125,6 +125,7 @@ int StripObjectMap::create_strip_header(const coll_t &cid,
   strip_header.oid = oid;
   strip_header.cid = cid;
   strip_header.header = header;
+  strip_header.strip_size = new_strip_size;
 
   return 0;
 }
@@ -484,6 +485,30 @@ int KeyValueStore::_create_current()
   return ret;
 }
 
+/**
+ * The backend is recorded next to current/ when the store is created.
+ * Stores that predate the record, or whose db was created before it
+ * was written, are leveldb.
+ */
+int KeyValueStore::_detect_backend(bool creating)
+{
+  int r = read_meta("kv_backend", &kv_backend);
+  if (r == 0)
+    return 0;
+  if (r != -ENOENT)
+    return r;
+
+  struct stat st;
+  string db_current = current_fn + "/CURRENT";
+  if (!creating || ::stat(db_current.c_str(), &st) == 0) {
+    kv_backend = "leveldb";
+    return 0;
+  }
+  kv_backend = g_conf->keyvaluestore_backend;
+  dout(1) << "_detect_backend creating " << kv_backend << " backend" << dendl;
+  return write_meta("kv_backend", kv_backend);
+}
+
 
 
 // =========== KeyValueStore API Implementation ==============
@@ -494,7 +519,6 @@ KeyValueStore::KeyValueStore(const std::string &base,
   internal_name(name),
   basedir(base),
   fsid_fd(-1), op_fd(-1), current_fd(-1),
-  kv_type(KV_TYPE_NONE),
   backend(NULL),
   ondisk_finisher(g_ceph_context),
   lock("KeyValueStore::lock"),
@@ -619,18 +643,18 @@ int KeyValueStore::mkfs()
     goto close_fsid_fd;
   }
 
-  if (_detect_backend()) {
+  if (_detect_backend(true)) {
     derr << "KeyValueStore::mkfs error in _detect_backend" << dendl;
     ret = -1;
     goto close_fsid_fd;
   }
 
   {
-    KeyValueDB *store;
-    if (kv_type == KV_TYPE_LEVELDB) {
-      store = new LevelDBStore(g_ceph_context, current_fn);
-    } else {
-      derr << "KeyValueStore::mkfs error: unknown backend type" << kv_type << dendl;
+    KeyValueDB *store = KeyValueDB::create(g_ceph_context, kv_backend,
+					   current_fn);
+    if (!store) {
+      derr << "KeyValueStore::mkfs error: unknown backend type " << kv_backend
+	   << dendl;
       ret = -1;
       goto close_fsid_fd;
     }
@@ -819,24 +843,35 @@ int KeyValueStore::mount()
 
   assert(current_fd >= 0);
 
-  if (_detect_backend()) {
+  if (_detect_backend(false)) {
     derr << "KeyValueStore::mount error in _detect_backend" << dendl;
     ret = -1;
     goto close_current_fd;
   }
 
   {
-    KeyValueDB *store;
-    if (kv_type == KV_TYPE_LEVELDB) {
-      store = new LevelDBStore(g_ceph_context, current_fn);
-    } else {
-      derr << "KeyValueStore::mount error: unknown backend type" << kv_type
+    KeyValueDB *store = KeyValueDB::create(g_ceph_context, kv_backend,
+					   current_fn);
+    if (!store) {
+      derr << "KeyValueStore::mount error: unknown backend type " << kv_backend
            << dendl;
       ret = -1;
       goto close_current_fd;
     }
 
     store->init();
+    if (kv_backend == "leveldb") {
+      LevelDBStore *ldb = static_cast<LevelDBStore*>(store);
+      if (g_conf->keyvaluestore_leveldb_write_buffer_size)
+        ldb->options.write_buffer_size =
+          g_conf->keyvaluestore_leveldb_write_buffer_size;
+      if (g_conf->keyvaluestore_leveldb_cache_size)
+        ldb->options.cache_size = g_conf->keyvaluestore_leveldb_cache_size;
+      if (g_conf->keyvaluestore_leveldb_block_size)
+        ldb->options.block_size = g_conf->keyvaluestore_leveldb_block_size;
+      if (g_conf->keyvaluestore_leveldb_bloom_size)
+        ldb->options.bloom_size = g_conf->keyvaluestore_leveldb_bloom_size;
+    }
     stringstream err;
     if (store->open(err)) {
       derr << "KeyValueStore::mount Error initializing keyvaluestore backend: "
@@ -1255,6 +1290,16 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
       }
       break;
 
+    case Transaction::OP_COLL_HINT:
+      {
+        // keys are not laid out by hash; nothing to prepare
+        i.get_cid();
+        i.get_u32();
+        bufferlist hint;
+        i.get_bl(hint);
+      }
+      break;
+
     case Transaction::OP_RMCOLL:
       {
         coll_t cid = i.get_cid();
@@ -1262,6 +1307,15 @@ unsigned KeyValueStore::_do_transaction(Transaction& transaction,
       }
       break;
 
+    case Transaction::OP_RMCOLL_RECURSIVE:
+      {
+        // the objects' keys are not grouped by collection; remove them
+        // one by one
+        coll_t cid = i.get_cid();
+        r = _collection_remove_recursive(cid, t);
+      }
+      break;
+
     case Transaction::OP_COLL_ADD:
       {
         coll_t ncid = i.get_cid();
@@ -1711,7 +1765,7 @@ int KeyValueStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size,
 
   if (header->max_size > size) {
     vector<StripObjectMap::StripExtent> extents;
-    StripObjectMap::file_to_extents(size, header->max_size,
+    StripObjectMap::file_to_extents(size, header->max_size - size,
                                     header->strip_size, extents);
     assert(extents.size());
 
@@ -1731,10 +1785,10 @@ int KeyValueStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size,
       old.copy(0, iter->offset, value);
       value.append_zero(header->strip_size-iter->offset);
       assert(value.length() == header->strip_size);
-      ++iter;
 
       values[strip_object_key(iter->no)] = value;
       t.set_buffer_keys(OBJECT_STRIP_PREFIX, header, values);
+      ++iter;
     }
 
     set<string> keys;
@@ -1799,6 +1853,7 @@ int KeyValueStore::_write(coll_t cid, const ghobject_t& oid,
   if (len > bl.length())
     len = bl.length();
 
+  uint64_t old_size = header->max_size;
   if (len + offset > header->max_size) {
     header->max_size = len + offset;
     header->bits.resize(header->max_size/header->strip_size+1);
@@ -1814,9 +1869,17 @@ int KeyValueStore::_write(coll_t cid, const ghobject_t& oid,
     bufferlist value;
     string key = strip_object_key(iter->no);
     if (header->bits[iter->no]) {
-      if (iter->offset == 0 && iter->len == header->strip_size) {
+      uint64_t strip_off = iter->no * header->strip_size;
+      if (iter->offset == 0 &&
+          (iter->len == header->strip_size ||
+           strip_off + iter->len >= old_size)) {
+        // nothing in the strip survives this write (past old_size it is
+        // all zeros), so there is no need to read it back
         bl.copy(bl_offset, iter->len, value);
         bl_offset += iter->len;
+
+        if (value.length() < header->strip_size)
+          value.append_zero(header->strip_size-value.length());
       } else {
         bufferlist old;
         r = t.get_buffer_key(header, OBJECT_STRIP_PREFIX, key, old);
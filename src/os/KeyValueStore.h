@@ -41,12 +41,6 @@ using namespace std;
 
 #include "include/uuid.h"
 
-enum kvstore_types {
-    KV_TYPE_NONE = 0,
-    KV_TYPE_LEVELDB,
-    KV_TYPE_OTHER
-};
-
 
 class StripObjectMap: public GenericObjectMap {
  public:
@@ -121,9 +115,18 @@ class StripObjectMap: public GenericObjectMap {
                    StripObjectHeader *header);
 
 
-  StripObjectMap(KeyValueDB *db): GenericObjectMap(db) {}
+  StripObjectMap(KeyValueDB *db): GenericObjectMap(db),
+    new_strip_size(default_strip_size) {
+    if (g_conf->keyvaluestore_default_strip_size > 0)
+      new_strip_size = g_conf->keyvaluestore_default_strip_size;
+  }
 
+  /// strip size of headers which never recorded one
   static const uint64_t default_strip_size = 1024;
+
+  /// strip size given to newly created objects; existing objects keep
+  /// the one recorded in their header
+  uint64_t new_strip_size;
 };
 
 
@@ -146,7 +149,7 @@ class KeyValueStore : public ObjectStore,
 
   int fsid_fd, op_fd, current_fd;
 
-  enum kvstore_types kv_type;
+  string kv_backend; ///< KeyValueDB type, see KeyValueDB::create()
 
   deque<uint64_t> snaps;
 
@@ -356,7 +359,7 @@ class KeyValueStore : public ObjectStore,
                 bool update_to=false);
   ~KeyValueStore();
 
-  int _detect_backend() { kv_type = KV_TYPE_LEVELDB; return 0; }
+  int _detect_backend(bool creating);
   bool test_mount_in_use();
   int version_stamp_is_valid(uint32_t *version);
   int update_version_stamp();
@@ -70,6 +70,7 @@ void LFNIndex::set_ref(ceph::shared_ptr<CollectionIndex> ref)
 
 int LFNIndex::init()
 {
+  cache_clear();
   return _init();
 }
 
@@ -84,9 +85,19 @@ int LFNIndex::created(const ghobject_t &oid, const char *path)
   r = lfn_created(path_comp, oid, short_name);
   if (r < 0)
     goto out;
+  if (lookup_cache) {
+    // a split in _created below moves objects and clears the cache again
+    lookup_entry_t e;
+    e.path = path_comp;
+    e.short_name = short_name;
+    e.exist = 1;
+    lookup_cache->add(oid, e);
+  }
   r = _created(path_comp, oid, short_name);
-  if (r < 0)
+  if (r < 0) {
+    cache_erase(oid);
     goto out;
+  }
     );
 }
 
@@ -113,6 +124,16 @@ int LFNIndex::lookup(const ghobject_t &oid,
   WRAP_RETRY(
   vector<string> path;
   string short_name;
+  if (lookup_cache) {
+    lookup_entry_t e;
+    if (lookup_cache->lookup(oid, &e)) {
+      *exist = e.exist;
+      *out_path = IndexedPath(
+	new Path(get_full_path(e.path, e.short_name), self_ref));
+      r = 0;
+      goto out;
+    }
+  }
   r = _lookup(oid, &path, &short_name, exist);
   if (r < 0)
     goto out;
@@ -131,6 +152,13 @@ int LFNIndex::lookup(const ghobject_t &oid,
   } else {
     *exist = 1;
   }
+  if (lookup_cache) {
+    lookup_entry_t e;
+    e.path = path;
+    e.short_name = short_name;
+    e.exist = *exist;
+    lookup_cache->add(oid, e);
+  }
   *out_path = IndexedPath(new Path(full_path, self_ref));
   r = 0;
   );
@@ -178,6 +206,7 @@ int LFNIndex::link_object(const vector<string> &from,
   int r;
   string from_path = get_full_path(from, from_short_name);
   string to_path;
+  cache_clear();
   maybe_inject_failure();
   r = lfn_get_name(to, oid, 0, &to_path, 0);
   if (r < 0)
@@ -195,6 +224,7 @@ int LFNIndex::remove_objects(const vector<string> &dir,
 			     const map<string, ghobject_t> &to_remove,
 			     map<string, ghobject_t> *remaining)
 {
+  cache_clear();
   set<string> clean_chains;
   for (map<string, ghobject_t>::const_iterator to_clean = to_remove.begin();
        to_clean != to_remove.end();
@@ -260,6 +290,7 @@ int LFNIndex::move_objects(const vector<string> &from,
 {
   map<string, ghobject_t> to_move;
   int r;
+  cache_clear();
   r = list_objects(from, 0, NULL, &to_move);
   if (r < 0)
     return r;
@@ -306,6 +337,11 @@ int LFNIndex::remove_object(const vector<string> &from,
   maybe_inject_failure();
   if (r < 0)
     return r;
+  // unlinking a long name compacts its chain, renaming its neighbours
+  if (lfn_is_hashed_filename(short_name))
+    cache_clear();
+  else
+    cache_erase(oid);
   return lfn_unlink(from, oid, short_name);
 }
 
@@ -325,6 +361,8 @@ int LFNIndex::move_subdir(
 {
   vector<string> sub_path(path.begin(), path.end());
   sub_path.push_back(dir);
+  from.cache_clear();
+  dest.cache_clear();
   string from_path(from.get_full_path_subdir(sub_path));
   string to_path(dest.get_full_path_subdir(sub_path));
   int r = ::rename(from_path.c_str(), to_path.c_str());
@@ -344,6 +382,8 @@ int LFNIndex::move_object(
   string to_path;
   string to_name;
   int exists;
+  from.cache_clear();
+  dest.cache_clear();
   int r = dest.lfn_get_name(path, obj.second, &to_name, &to_path, &exists);
   if (r < 0)
     return r;
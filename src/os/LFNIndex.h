@@ -26,6 +26,7 @@
 #include "osd/osd_types.h"
 #include "include/object.h"
 #include "common/ceph_crypto.h"
+#include "common/simple_cache.hpp"
 
 #include "CollectionIndex.h"
 
@@ -122,9 +123,28 @@ protected:
     error_injection_enabled = false;
   }
 
+public:
+  /// where lookup() resolved an object to, see LookupCache
+  struct lookup_entry_t {
+    vector<string> path;
+    string short_name;
+    int exist;
+    lookup_entry_t() : exist(0) {}
+  };
+  /**
+   * bounded cache of lookup() results for one collection
+   *
+   * Outlives the LFNIndex instances, which IndexManager builds afresh
+   * for every user of the collection.  Any change that can move or
+   * rename other objects (subdir split or merge, lfn chain compaction,
+   * collection split) clears it.
+   */
+  typedef SimpleLRU<ghobject_t, lookup_entry_t> LookupCache;
+
 private:
   string lfn_attribute;
   coll_t collection;
+  ceph::shared_ptr<LookupCache> lookup_cache;
 
 public:
   /// Constructor
@@ -151,6 +171,10 @@ public:
 
   coll_t coll() const { return collection; }
 
+  void set_lookup_cache(ceph::shared_ptr<LookupCache> c) {
+    lookup_cache = c;
+  }
+
   /// Virtual destructor
   virtual ~LFNIndex() {}
 
@@ -269,6 +293,21 @@ protected:
 
   /* Non-virtual utility methods */
 
+  /// Gets the base path
+  const string &get_base_path(); ///< @return Index base_path
+
+  /// Forget the cached lookup of oid
+  void cache_erase(const ghobject_t &oid) {
+    if (lookup_cache)
+      lookup_cache->clear(oid);
+  }
+
+  /// Forget all cached lookups
+  void cache_clear() {
+    if (lookup_cache)
+      lookup_cache->clear();
+  }
+
   /// Sync a subdirectory
   int fsync_dir(
     const vector<string> &path ///< [in] Path to sync
@@ -526,9 +565,6 @@ private:
     ); ///< @return Hashed filename.
 
   /* other common methods */
-  /// Gets the base path
-  const string &get_base_path(); ///< @return Index base_path
-
   /// Get full path the subdir
   string get_full_path_subdir(
     const vector<string> &rel ///< [in] The subdir.
@@ -7,6 +7,9 @@
 #include <string>
 #include "include/memory.h"
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
 using std::string;
 #include "common/perf_counters.h"
 
@@ -22,6 +25,7 @@ int LevelDBStore::init()
   options.paranoid_checks = g_conf->leveldb_paranoid;
   options.max_open_files = g_conf->leveldb_max_open_files;
   options.log_file = g_conf->leveldb_log;
+  options.compact_range_interval = g_conf->leveldb_compact_range_interval;
   return 0;
 }
 
@@ -87,6 +91,13 @@ int LevelDBStore::do_open(ostream &out, bool create_if_missing)
   plb.add_u64_counter(l_leveldb_compact_range, "leveldb_compact_range");
   plb.add_u64_counter(l_leveldb_compact_queue_merge, "leveldb_compact_queue_merge");
   plb.add_u64(l_leveldb_compact_queue_len, "leveldb_compact_queue_len");
+  plb.add_time_avg(l_leveldb_get_latency, "leveldb_get_latency");
+  plb.add_time_avg(l_leveldb_submit_latency, "leveldb_submit_latency");
+  plb.add_time(l_leveldb_compact_time, "leveldb_compact_time");
+  plb.add_u64(l_leveldb_compact_read_bytes, "leveldb_compact_read_bytes");
+  plb.add_u64(l_leveldb_compact_write_bytes, "leveldb_compact_write_bytes");
+  plb.add_u64(l_leveldb_sst_bytes, "leveldb_sst_bytes");
+  plb.add_u64(l_leveldb_mem_usage, "leveldb_mem_usage");
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
   return 0;
@@ -120,21 +131,47 @@ void LevelDBStore::close()
 
 int LevelDBStore::submit_transaction(KeyValueDB::Transaction t)
 {
+  utime_t start = ceph_clock_now(cct);
   LevelDBTransactionImpl * _t =
     static_cast<LevelDBTransactionImpl *>(t.get());
+  if (_t->has_merges) {
+    merge_lock.Lock();
+    int r = resolve_merges(_t);
+    if (r < 0) {
+      merge_lock.Unlock();
+      return r;
+    }
+  }
   leveldb::Status s = db->Write(leveldb::WriteOptions(), &(_t->bat));
+  if (_t->has_merges)
+    merge_lock.Unlock();
   logger->inc(l_leveldb_txns);
+  logger->tinc(l_leveldb_submit_latency, ceph_clock_now(cct) - start);
+  maybe_update_stats();
   return s.ok() ? 0 : -1;
 }
 
 int LevelDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
 {
+  utime_t start = ceph_clock_now(cct);
   LevelDBTransactionImpl * _t =
     static_cast<LevelDBTransactionImpl *>(t.get());
   leveldb::WriteOptions options;
   options.sync = true;
+  if (_t->has_merges) {
+    merge_lock.Lock();
+    int r = resolve_merges(_t);
+    if (r < 0) {
+      merge_lock.Unlock();
+      return r;
+    }
+  }
   leveldb::Status s = db->Write(options, &(_t->bat));
+  if (_t->has_merges)
+    merge_lock.Unlock();
   logger->inc(l_leveldb_txns);
+  logger->tinc(l_leveldb_submit_latency, ceph_clock_now(cct) - start);
+  maybe_update_stats();
   return s.ok() ? 0 : -1;
 }
 
@@ -151,6 +188,7 @@ void LevelDBStore::LevelDBTransactionImpl::set(
   bat.Delete(leveldb::Slice(*(keys.rbegin())));
   bat.Put(leveldb::Slice(*(keys.rbegin())),
 	  leveldb::Slice(bl.c_str(), bl.length()));
+  record(prefix, k, OP_SET, to_set_bl);
 }
 
 void LevelDBStore::LevelDBTransactionImpl::rmkey(const string &prefix,
@@ -159,6 +197,7 @@ void LevelDBStore::LevelDBTransactionImpl::rmkey(const string &prefix,
   string key = combine_strings(prefix, k);
   keys.push_back(key);
   bat.Delete(leveldb::Slice(*(keys.rbegin())));
+  record(prefix, k, OP_RMKEY);
 }
 
 void LevelDBStore::LevelDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
@@ -170,14 +209,113 @@ void LevelDBStore::LevelDBTransactionImpl::rmkeys_by_prefix(const string &prefix
     string key = combine_strings(prefix, it->key());
     keys.push_back(key);
     bat.Delete(*(keys.rbegin()));
+    record(prefix, it->key(), OP_RMKEY);
   }
 }
 
+void LevelDBStore::LevelDBTransactionImpl::merge(
+  const string &prefix,
+  const string &k,
+  const bufferlist &bl)
+{
+  assert(db->get_merge_operator(prefix));
+  record(prefix, k, OP_MERGE, bl);
+  has_merges = true;
+}
+
+void LevelDBStore::LevelDBTransactionImpl::record(
+  const string &prefix,
+  const string &k,
+  int op,
+  const bufferlist &bl)
+{
+  if (!db->get_merge_operator(prefix))
+    return;
+  merge_keys[make_pair(prefix, k)].push_back(make_pair(op, bl));
+}
+
+/**
+ * Replay the ops on each merged key over its stored value and put the
+ * result last in the batch, where it wins over the earlier set/rmkey
+ * entries for the key.  The caller holds merge_lock across this and the
+ * write, so merges into the same key don't race with each other.
+ */
+int LevelDBStore::resolve_merges(LevelDBTransactionImpl *t)
+{
+  for (map<pair<string, string>, list<pair<int, bufferlist> > >::iterator p =
+	 t->merge_keys.begin();
+       p != t->merge_keys.end();
+       ++p) {
+    const string &prefix = p->first.first;
+    list<pair<int, bufferlist> > &ops = p->second;
+    list<pair<int, bufferlist> >::iterator q;
+    for (q = ops.begin(); q != ops.end(); ++q)
+      if (q->first == LevelDBTransactionImpl::OP_MERGE)
+	break;
+    if (q == ops.end())
+      continue;
+
+    MergeOperatorRef mop = get_merge_operator(prefix);
+    bool exists = false;
+    string value;
+    if (ops.front().first == LevelDBTransactionImpl::OP_MERGE) {
+      std::set<string> keys;
+      std::map<string, bufferlist> out;
+      keys.insert(p->first.second);
+      int r = get(prefix, keys, &out);
+      if (r < 0)
+	return r;
+      if (!out.empty()) {
+	exists = true;
+	value.assign(out.begin()->second.c_str(), out.begin()->second.length());
+      }
+    }
+    for (q = ops.begin(); q != ops.end(); ++q) {
+      switch (q->first) {
+      case LevelDBTransactionImpl::OP_SET:
+	value.assign(q->second.c_str(), q->second.length());
+	exists = true;
+	break;
+      case LevelDBTransactionImpl::OP_RMKEY:
+	value.clear();
+	exists = false;
+	break;
+      case LevelDBTransactionImpl::OP_MERGE:
+	{
+	  string merged;
+	  if (exists)
+	    mop->merge(value.data(), value.length(),
+		       q->second.c_str(), q->second.length(), &merged);
+	  else
+	    mop->merge_nonexistent(q->second.c_str(), q->second.length(),
+				   &merged);
+	  value.swap(merged);
+	  exists = true;
+	}
+	break;
+      }
+    }
+
+    t->keys.push_back(combine_strings(prefix, p->first.second));
+    if (exists) {
+      t->buffers.push_back(bufferlist());
+      t->buffers.rbegin()->append(value);
+      bufferlist &bl = *(t->buffers.rbegin());
+      t->bat.Put(leveldb::Slice(*(t->keys.rbegin())),
+		 leveldb::Slice(bl.c_str(), bl.length()));
+    } else {
+      t->bat.Delete(leveldb::Slice(*(t->keys.rbegin())));
+    }
+  }
+  return 0;
+}
+
 int LevelDBStore::get(
     const string &prefix,
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
+  utime_t start = ceph_clock_now(cct);
   KeyValueDB::Iterator it = get_iterator(prefix);
   for (std::set<string>::const_iterator i = keys.begin();
        i != keys.end();
@@ -189,9 +327,61 @@ int LevelDBStore::get(
       break;
   }
   logger->inc(l_leveldb_gets);
+  logger->tinc(l_leveldb_get_latency, ceph_clock_now(cct) - start);
   return 0;
 }
 
+/**
+ * leveldb only reports compaction activity as text, one row per level:
+ *
+ *   Level  Files Size(MB) Time(sec) Read(MB) Write(MB)
+ *
+ * Sum the rows into the perf counters.  Memory usage is only reported
+ * by newer leveldb versions.
+ */
+void LevelDBStore::update_stats()
+{
+  string stats;
+  if (db->GetProperty("leveldb.stats", &stats)) {
+    double total_size = 0, total_time = 0, total_read = 0, total_write = 0;
+    istringstream is(stats);
+    string line;
+    while (getline(is, line)) {
+      int level, files;
+      double size, time, read, write;
+      if (sscanf(line.c_str(), "%d %d %lf %lf %lf %lf", &level, &files,
+		 &size, &time, &read, &write) != 6)
+	continue;
+      total_size += size;
+      total_time += time;
+      total_read += read;
+      total_write += write;
+    }
+    utime_t t;
+    t.set_from_double(total_time);
+    logger->tset(l_leveldb_compact_time, t);
+    logger->set(l_leveldb_compact_read_bytes, total_read * (1 << 20));
+    logger->set(l_leveldb_compact_write_bytes, total_write * (1 << 20));
+    logger->set(l_leveldb_sst_bytes, total_size * (1 << 20));
+  }
+  if (db->GetProperty("leveldb.approximate-memory-usage", &stats))
+    logger->set(l_leveldb_mem_usage, strtoull(stats.c_str(), NULL, 10));
+}
+
+void LevelDBStore::maybe_update_stats()
+{
+  utime_t now = ceph_clock_now(cct);
+  {
+    Mutex::Locker l(stats_lock);
+    utime_t interval;
+    interval.set_from_double(g_conf->leveldb_stats_interval);
+    if (now - stats_stamp < interval)
+      return;
+    stats_stamp = now;
+  }
+  update_stats();
+}
+
 string LevelDBStore::combine_strings(const string &prefix, const string &value)
 {
   string out = prefix;
@@ -225,6 +415,7 @@ void LevelDBStore::compact()
 {
   logger->inc(l_leveldb_compact);
   db->CompactRange(NULL, NULL);
+  update_stats();
 }
 
 
@@ -239,7 +430,16 @@ void LevelDBStore::compact_thread_entry()
       compact_queue_lock.Unlock();
       logger->inc(l_leveldb_compact_range);
       compact_range(range.first, range.second);
+      update_stats();
       compact_queue_lock.Lock();
+      // leave the disk to foreground io for a while between ranges
+      if (options.compact_range_interval > 0 && !compact_queue_stop) {
+	utime_t interval;
+	interval.set_from_double(options.compact_range_interval);
+	compact_queue_cond.WaitInterval(cct, compact_queue_lock, interval);
+      }
+      if (compact_queue_stop)
+	break;
       continue;
     }
     compact_queue_cond.Wait(compact_queue_lock);
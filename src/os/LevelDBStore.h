@@ -38,6 +38,13 @@ enum {
   l_leveldb_compact_range,
   l_leveldb_compact_queue_merge,
   l_leveldb_compact_queue_len,
+  l_leveldb_get_latency,
+  l_leveldb_submit_latency,
+  l_leveldb_compact_time,
+  l_leveldb_compact_read_bytes,
+  l_leveldb_compact_write_bytes,
+  l_leveldb_sst_bytes,
+  l_leveldb_mem_usage,
   l_leveldb_last,
 };
 
@@ -56,6 +63,16 @@ class LevelDBStore : public KeyValueDB {
 
   int do_open(ostream &out, bool create_if_missing);
 
+  // periodically refreshed leveldb properties, see update_stats()
+  Mutex stats_lock;
+  utime_t stats_stamp;
+  void update_stats();
+  void maybe_update_stats();
+
+  // leveldb has no merge support; submits that carry merges read,
+  // fold and write them back under this lock, see resolve_merges()
+  Mutex merge_lock;
+
   // manage async compactions
   Mutex compact_queue_lock;
   Cond compact_queue_cond;
@@ -99,6 +116,10 @@ public:
   void compact_range_async(const string& prefix, const string& start, const string& end) {
     compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
   }
+  void compact_prefix_range_async(const string& start_prefix,
+				  const string& end_prefix) {
+    compact_range_async(start_prefix, end_prefix);
+  }
 
   /**
    * options_t: Holds options which are minimally interpreted
@@ -117,6 +138,7 @@ public:
     uint64_t block_size; /// user data per block
     int bloom_size; /// number of bits per entry to put in a bloom filter
     bool compression_enabled; /// whether to use libsnappy compression or not
+    double compact_range_interval; /// min seconds between queued compactions
 
     // don't change these ones. No, seriously
     int block_restart_interval;
@@ -132,6 +154,7 @@ public:
       block_size(0), //< 0 means default
       bloom_size(0), //< 0 means no bloom filter (default)
       compression_enabled(true), //< set to false for no compression
+      compact_range_interval(0), //< 0 means back to back
       block_restart_interval(0), //< 0 means default
       error_if_exists(false), //< set to true if you want to check nonexistence
       paranoid_checks(false) //< set to true if you want paranoid checks
@@ -146,6 +169,8 @@ public:
 #ifdef HAVE_LEVELDB_FILTER_POLICY
     filterpolicy(NULL),
 #endif
+    stats_lock("LevelDBStore::stats_lock"),
+    merge_lock("LevelDBStore::merge_lock"),
     compact_queue_lock("LevelDBStore::compact_thread_lock"),
     compact_queue_stop(false),
     compact_thread(this),
@@ -174,7 +199,12 @@ public:
     list<string> keys;
     LevelDBStore *db;
 
-    LevelDBTransactionImpl(LevelDBStore *db) : db(db) {}
+    /// ops on keys under prefixes with a merge operator, in order
+    enum { OP_SET, OP_RMKEY, OP_MERGE };
+    map<pair<string, string>, list<pair<int, bufferlist> > > merge_keys;
+    bool has_merges;
+
+    LevelDBTransactionImpl(LevelDBStore *db) : db(db), has_merges(false) {}
     void set(
       const string &prefix,
       const string &k,
@@ -185,8 +215,18 @@ public:
     void rmkeys_by_prefix(
       const string &prefix
       );
+    void merge(
+      const string &prefix,
+      const string &k,
+      const bufferlist &bl);
+  private:
+    void record(const string &prefix, const string &k, int op,
+		const bufferlist &bl = bufferlist());
   };
 
+  /// append the folded value of every merged key in t to its batch
+  int resolve_merges(LevelDBTransactionImpl *t);
+
   KeyValueDB::Transaction get_transaction() {
     return ceph::shared_ptr< LevelDBTransactionImpl >(
       new LevelDBTransactionImpl(this));
@@ -40,6 +40,100 @@ bool operator>(const MemStore::CollectionRef& l,
 }
 
 
+// ---------------
+// object data
+
+void MemStore::Object::read_data(uint64_t offset, uint64_t len,
+				 bufferlist *bl) const
+{
+  uint64_t end = offset + len;
+  map<uint64_t,bufferptr>::const_iterator p =
+    data.lower_bound(offset - offset % page_size);
+  while (offset < end) {
+    uint64_t page = offset - offset % page_size;
+    if (p != data.end() && p->first == page) {
+      uint64_t l = MIN(page_size - (offset - page), end - offset);
+      bl->append(p->second, offset - page, l);
+      offset += l;
+      ++p;
+    } else {
+      // a hole, up to the next page we have
+      uint64_t l = MIN((p == data.end() ? end : p->first), end) - offset;
+      bl->append_zero(l);
+      offset += l;
+    }
+  }
+}
+
+void MemStore::Object::write_data(uint64_t offset, const bufferlist& bl)
+{
+  uint64_t end = offset + bl.length();
+  unsigned pos = 0;
+  while (offset < end) {
+    uint64_t page = offset - offset % page_size;
+    uint64_t poff = offset - page;
+    uint64_t l = MIN(page_size - poff, end - offset);
+    bufferlist sub;
+    sub.substr_of(bl, pos, l);
+    if (l == page_size && sub.buffers().size() == 1) {
+      // a whole page from one buffer: just keep a reference to it
+      data[page] = sub.buffers().front();
+    } else {
+      bufferptr np = buffer::create(page_size);
+      map<uint64_t,bufferptr>::iterator p = data.find(page);
+      if (p != data.end())
+	memcpy(np.c_str(), p->second.c_str(), page_size);
+      else
+	np.zero();
+      sub.copy(0, l, np.c_str() + poff);
+      data[page] = np;
+    }
+    offset += l;
+    pos += l;
+  }
+  if (end > data_len)
+    data_len = end;
+}
+
+void MemStore::Object::zero_data(uint64_t offset, uint64_t len)
+{
+  uint64_t end = offset + len;
+  if (end > data_len)
+    data_len = end;
+  map<uint64_t,bufferptr>::iterator p =
+    data.lower_bound(offset - offset % page_size);
+  while (p != data.end() && p->first < end) {
+    uint64_t from = MAX(offset, p->first) - p->first;
+    uint64_t to = MIN(end, p->first + page_size) - p->first;
+    if (from == 0 && to == page_size) {
+      data.erase(p++);
+      continue;
+    }
+    bufferptr np(p->second.c_str(), page_size);
+    memset(np.c_str() + from, 0, to - from);
+    p->second = np;
+    ++p;
+  }
+}
+
+void MemStore::Object::truncate_data(uint64_t size)
+{
+  if (size < data_len) {
+    // pages past the end must read as zeros if the object grows again
+    map<uint64_t,bufferptr>::iterator p =
+      data.lower_bound(size - size % page_size);
+    if (p != data.end() && p->first < size) {
+      bufferptr np(p->second.c_str(), page_size);
+      memset(np.c_str() + (size - p->first), 0, page_size - (size - p->first));
+      p->second = np;
+      ++p;
+    }
+    data.erase(p, data.end());
+  }
+  data_len = size;
+}
+
+
 int MemStore::peek_journal_fsid(uuid_d *fsid)
 {
   *fsid = uuid_d();
@@ -64,7 +158,7 @@ int MemStore::umount()
 int MemStore::_save()
 {
   dout(10) << __func__ << dendl;
-  Mutex::Locker l(apply_lock); // block any writer
+  // by now there are no writers left
   dump_all();
   set<coll_t> collections;
   for (ceph::unordered_map<coll_t,CollectionRef>::iterator p = coll_map.begin();
@@ -162,7 +256,7 @@ int MemStore::_load()
     int r = cbl.read_file(fn.c_str(), &err);
     if (r < 0)
       return r;
-    CollectionRef c(new Collection);
+    CollectionRef c(new Collection(page_size));
     bufferlist::iterator p = cbl.begin();
     c->decode(p);
     coll_map[*q] = c;
@@ -254,7 +348,6 @@ bool MemStore::exists(coll_t cid, const ghobject_t& oid)
   CollectionRef c = get_collection(cid);
   if (!c)
     return false;
-  RWLock::RLocker l(c->lock);
 
   // Perform equivalent of c->get_object_(oid) != NULL. In C++11 the
   // shared_ptr needs to be compared to nullptr.
@@ -271,12 +364,11 @@ int MemStore::stat(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  st->st_size = o->data.length();
+  Mutex::Locker l(o->lock);
+  st->st_size = o->data_len;
   st->st_blksize = 4096;
   st->st_blocks = (st->st_size + st->st_blksize - 1) / st->st_blksize;
   st->st_nlink = 1;
@@ -296,20 +388,19 @@ int MemStore::read(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker lc(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (offset >= o->data.length())
+  Mutex::Locker lo(o->lock);
+  if (offset >= o->data_len)
     return 0;
   size_t l = len;
   if (l == 0)  // note: len == 0 means read the entire object
-    l = o->data.length();
-  else if (offset + l > o->data.length())
-    l = o->data.length() - offset;
+    l = o->data_len - offset;
+  else if (offset + l > o->data_len)
+    l = o->data_len - offset;
   bl.clear();
-  bl.substr_of(o->data, offset, l);
+  o->read_data(offset, l, &bl);
   return bl.length();
 }
 
@@ -321,16 +412,15 @@ int MemStore::fiemap(coll_t cid, const ghobject_t& oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker lc(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (offset >= o->data.length())
+  Mutex::Locker lo(o->lock);
+  if (offset >= o->data_len)
     return 0;
   size_t l = len;
-  if (offset + l > o->data.length())
-    l = o->data.length() - offset;
+  if (offset + l > o->data_len)
+    l = o->data_len - offset;
   map<uint64_t, uint64_t> m;
   m[offset] = l;
   ::encode(m, bl);
@@ -344,11 +434,10 @@ int MemStore::getattr(coll_t cid, const ghobject_t& oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   string k(name);
   if (!o->xattr.count(k)) {
     return -ENODATA;
@@ -364,11 +453,10 @@ int MemStore::getattrs(coll_t cid, const ghobject_t& oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   if (user_only) {
     for (map<string,bufferptr>::iterator p = o->xattr.begin();
 	 p != o->xattr.end();
@@ -528,11 +616,10 @@ int MemStore::omap_get(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   *header = o->omap_header;
   *out = o->omap;
   return 0;
@@ -549,11 +636,10 @@ int MemStore::omap_get_header(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   *header = o->omap_header;
   return 0;
 }
@@ -568,11 +654,10 @@ int MemStore::omap_get_keys(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   for (map<string,bufferlist>::iterator p = o->omap.begin();
        p != o->omap.end();
        ++p)
@@ -591,11 +676,10 @@ int MemStore::omap_get_values(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   for (set<string>::const_iterator p = keys.begin();
        p != keys.end();
        ++p) {
@@ -617,11 +701,10 @@ int MemStore::omap_check_keys(
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   for (set<string>::const_iterator p = keys.begin();
        p != keys.end();
        ++p) {
@@ -639,11 +722,10 @@ ObjectMap::ObjectMapIterator MemStore::get_omap_iterator(coll_t cid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return ObjectMap::ObjectMapIterator();
-  RWLock::RLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return ObjectMap::ObjectMapIterator();
+  Mutex::Locker l(o->lock);
   return ObjectMap::ObjectMapIterator(new OmapIteratorImpl(c, o));
 }
 
@@ -656,8 +738,16 @@ int MemStore::queue_transactions(Sequencer *osr,
 				 TrackedOpRef op,
 				 ThreadPool::TPHandle *handle)
 {
-  // fixme: ignore the Sequencer and serialize everything.
-  Mutex::Locker l(apply_lock);
+  if (!osr)
+    osr = &default_osr;
+  OpSequencer *seq;
+  {
+    Mutex::Locker l(sequencer_lock);
+    if (!osr->p)
+      osr->p = new OpSequencer;
+    seq = static_cast<OpSequencer*>(osr->p);
+  }
+  Mutex::Locker l(seq->apply_lock);
 
   for (list<Transaction*>::iterator p = tls.begin(); p != tls.end(); ++p) {
     // poke the TPHandle heartbeat just to exercise that code path
@@ -828,6 +918,16 @@ void MemStore::_do_transaction(Transaction& t)
       }
       break;
 
+    case Transaction::OP_COLL_HINT:
+      {
+	// no on-disk layout to prepare
+	i.get_cid();
+	i.get_u32();
+	bufferlist hint;
+	i.get_bl(hint);
+      }
+      break;
+
     case Transaction::OP_RMCOLL:
       {
 	coll_t cid = i.get_cid();
@@ -835,6 +935,13 @@ void MemStore::_do_transaction(Transaction& t)
       }
       break;
 
+    case Transaction::OP_RMCOLL_RECURSIVE:
+      {
+	coll_t cid = i.get_cid();
+	r = _destroy_collection(cid, true);
+      }
+      break;
+
     case Transaction::OP_COLL_ADD:
       {
 	coll_t ncid = i.get_cid();
@@ -1008,14 +1115,8 @@ int MemStore::_touch(coll_t cid, const ghobject_t& oid)
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
 
-  ObjectRef o = c->get_object(oid);
-  if (!o) {
-    o.reset(new Object);
-    c->object_map[oid] = o;
-    c->object_hash[oid] = o;
-  }
+  c->get_or_create_object(oid);
   return 0;
 }
 
@@ -1030,58 +1131,27 @@ int MemStore::_write(coll_t cid, const ghobject_t& oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
 
-  ObjectRef o = c->get_object(oid);
-  if (!o) {
-    // write implicitly creates a missing object
-    o.reset(new Object);
-    c->object_map[oid] = o;
-    c->object_hash[oid] = o;
-  }
-
-  _write_into_bl(bl, offset, &o->data);
+  // write implicitly creates a missing object
+  ObjectRef o = c->get_or_create_object(oid);
+  Mutex::Locker l(o->lock);
+  o->write_data(offset, bl);
   return 0;
 }
 
-void MemStore::_write_into_bl(const bufferlist& src, unsigned offset,
-			      bufferlist *dst)
-{
-  unsigned len = src.length();
-
-  // before
-  bufferlist newdata;
-  if (dst->length() >= offset) {
-    newdata.substr_of(*dst, 0, offset);
-  } else {
-    newdata.substr_of(*dst, 0, dst->length());
-    bufferptr bp(offset - dst->length());
-    bp.zero();
-    newdata.append(bp);
-  }
-
-  newdata.append(src);
-
-  // after
-  if (dst->length() > offset + len) {
-    bufferlist tail;
-    tail.substr_of(*dst, offset + len, dst->length() - (offset + len));
-    newdata.append(tail);
-  }
-
-  dst->claim(newdata);
-}
-
 int MemStore::_zero(coll_t cid, const ghobject_t& oid,
 		    uint64_t offset, size_t len)
 {
   dout(10) << __func__ << " " << cid << " " << oid << " " << offset << "~"
 	   << len << dendl;
-  bufferptr bp(len);
-  bp.zero();
-  bufferlist bl;
-  bl.push_back(bp);
-  return _write(cid, oid, offset, len, bl);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+
+  ObjectRef o = c->get_or_create_object(oid);
+  Mutex::Locker l(o->lock);
+  o->zero_data(offset, len);
+  return 0;
 }
 
 int MemStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size)
@@ -1090,22 +1160,11 @@ int MemStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size)
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (o->data.length() > size) {
-    bufferlist bl;
-    bl.substr_of(o->data, 0, size);
-    o->data.claim(bl);
-  } else if (o->data.length() == size) {
-    // do nothing
-  } else {
-    bufferptr bp(size - o->data.length());
-    bp.zero();
-    o->data.append(bp);
-  }
+  Mutex::Locker l(o->lock);
+  o->truncate_data(size);
   return 0;
 }
 
@@ -1117,11 +1176,9 @@ int MemStore::_remove(coll_t cid, const ghobject_t& oid)
     return -ENOENT;
   RWLock::WLocker l(c->lock);
 
-  ObjectRef o = c->get_object(oid);
-  if (!o)
+  if (!c->object_hash.erase(oid))
     return -ENOENT;
   c->object_map.erase(oid);
-  c->object_hash.erase(oid);
   return 0;
 }
 
@@ -1132,11 +1189,10 @@ int MemStore::_setattrs(coll_t cid, const ghobject_t& oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   for (map<string,bufferptr>::const_iterator p = aset.begin(); p != aset.end(); ++p)
     o->xattr[p->first] = p->second;
   return 0;
@@ -1148,11 +1204,10 @@ int MemStore::_rmattr(coll_t cid, const ghobject_t& oid, const char *name)
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   if (!o->xattr.count(name))
     return -ENODATA;
   o->xattr.erase(name);
@@ -1165,11 +1220,10 @@ int MemStore::_rmattrs(coll_t cid, const ghobject_t& oid)
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   o->xattr.clear();
   return 0;
 }
@@ -1182,20 +1236,29 @@ int MemStore::_clone(coll_t cid, const ghobject_t& oldoid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
 
   ObjectRef oo = c->get_object(oldoid);
   if (!oo)
     return -ENOENT;
-  ObjectRef no = c->get_object(newoid);
-  if (!no) {
-    no.reset(new Object);
-    c->object_map[newoid] = no;
-    c->object_hash[newoid] = no;
+  ObjectRef no = c->get_or_create_object(newoid);
+
+  // pages are shared, not copied; see Object
+  map<uint64_t,bufferptr> data;
+  uint64_t data_len;
+  bufferlist omap_header;
+  map<string,bufferlist> omap;
+  {
+    Mutex::Locker l(oo->lock);
+    data = oo->data;
+    data_len = oo->data_len;
+    omap_header = oo->omap_header;
+    omap = oo->omap;
   }
-  no->data = oo->data;
-  no->omap_header = oo->omap_header;
-  no->omap = oo->omap;
+  Mutex::Locker l(no->lock);
+  no->data.swap(data);
+  no->data_len = data_len;
+  no->omap_header.claim(omap_header);
+  no->omap.swap(omap);
   return 0;
 }
 
@@ -1210,24 +1273,22 @@ int MemStore::_clone_range(coll_t cid, const ghobject_t& oldoid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
 
   ObjectRef oo = c->get_object(oldoid);
   if (!oo)
     return -ENOENT;
-  ObjectRef no = c->get_object(newoid);
-  if (!no) {
-    no.reset(new Object);
-    c->object_map[newoid] = no;
-    c->object_hash[newoid] = no;
-  }
-  if (srcoff >= oo->data.length())
-    return 0;
-  if (srcoff + len >= oo->data.length())
-    len = oo->data.length() - srcoff;
+  ObjectRef no = c->get_or_create_object(newoid);
   bufferlist bl;
-  bl.substr_of(oo->data, srcoff, len);
-  _write_into_bl(bl, dstoff, &no->data);
+  {
+    Mutex::Locker l(oo->lock);
+    if (srcoff >= oo->data_len)
+      return 0;
+    if (srcoff + len >= oo->data_len)
+      len = oo->data_len - srcoff;
+    oo->read_data(srcoff, len, &bl);
+  }
+  Mutex::Locker l(no->lock);
+  no->write_data(dstoff, bl);
   return len;
 }
 
@@ -1237,11 +1298,10 @@ int MemStore::_omap_clear(coll_t cid, const ghobject_t &oid)
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   o->omap.clear();
   return 0;
 }
@@ -1253,11 +1313,10 @@ int MemStore::_omap_setkeys(coll_t cid, const ghobject_t &oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   for (map<string,bufferlist>::const_iterator p = aset.begin(); p != aset.end(); ++p)
     o->omap[p->first] = p->second;
   return 0;
@@ -1270,11 +1329,10 @@ int MemStore::_omap_rmkeys(coll_t cid, const ghobject_t &oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p)
     o->omap.erase(*p);
   return 0;
@@ -1288,11 +1346,10 @@ int MemStore::_omap_rmkeyrange(coll_t cid, const ghobject_t &oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   map<string,bufferlist>::iterator p = o->omap.upper_bound(first);
   map<string,bufferlist>::iterator e = o->omap.lower_bound(last);
   while (p != e)
@@ -1307,11 +1364,10 @@ int MemStore::_omap_setheader(coll_t cid, const ghobject_t &oid,
   CollectionRef c = get_collection(cid);
   if (!c)
     return -ENOENT;
-  RWLock::WLocker l(c->lock);
-
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
+  Mutex::Locker l(o->lock);
   o->omap_header = bl;
   return 0;
 }
@@ -1323,18 +1379,18 @@ int MemStore::_create_collection(coll_t cid)
   ceph::unordered_map<coll_t,CollectionRef>::iterator cp = coll_map.find(cid);
   if (cp != coll_map.end())
     return -EEXIST;
-  coll_map[cid].reset(new Collection);
+  coll_map[cid].reset(new Collection(page_size));
   return 0;
 }
 
-int MemStore::_destroy_collection(coll_t cid)
+int MemStore::_destroy_collection(coll_t cid, bool recursive)
 {
   dout(10) << __func__ << " " << cid << dendl;
   RWLock::WLocker l(coll_lock);
   ceph::unordered_map<coll_t,CollectionRef>::iterator cp = coll_map.find(cid);
   if (cp == coll_map.end())
     return -ENOENT;
-  {
+  if (!recursive) {
     RWLock::RLocker l2(cp->second->lock);
     if (!cp->second->object_map.empty())
       return -ENOTEMPTY;
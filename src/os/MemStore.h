@@ -20,20 +20,40 @@
 #include "include/unordered_map.h"
 #include "include/memory.h"
 #include "common/Finisher.h"
+#include "common/Mutex.h"
 #include "common/RWLock.h"
 #include "ObjectStore.h"
 
 class MemStore : public ObjectStore {
 public:
+  /**
+   * Object data lives in fixed size pages, keyed by offset; a missing
+   * page reads as zeros.  A page is never modified once stored, only
+   * replaced, so reads can hand out references to it without copying,
+   * and a write copies at most the pages it partially covers.
+   */
   struct Object {
-    bufferlist data;
+    Mutex lock;  ///< protects everything below
+    size_t page_size;
+    map<uint64_t,bufferptr> data;
+    uint64_t data_len;
     map<string,bufferptr> xattr;
     bufferlist omap_header;
     map<string,bufferlist> omap;
 
+    Object(size_t ps)
+      : lock("MemStore::Object::lock"), page_size(ps), data_len(0) {}
+
+    void read_data(uint64_t offset, uint64_t len, bufferlist *bl) const;
+    void write_data(uint64_t offset, const bufferlist& bl);
+    void zero_data(uint64_t offset, uint64_t len);
+    void truncate_data(uint64_t size);
+
     void encode(bufferlist& bl) const {
       ENCODE_START(1, 1, bl);
-      ::encode(data, bl);
+      bufferlist dbl;
+      read_data(0, data_len, &dbl);
+      ::encode(dbl, bl);
       ::encode(xattr, bl);
       ::encode(omap_header, bl);
       ::encode(omap, bl);
@@ -41,14 +61,19 @@ public:
     }
     void decode(bufferlist::iterator& p) {
       DECODE_START(1, p);
-      ::decode(data, p);
+      bufferlist dbl;
+      ::decode(dbl, p);
+      data.clear();
+      data_len = 0;
+      write_data(0, dbl);
       ::decode(xattr, p);
       ::decode(omap_header, p);
       ::decode(omap, p);
       DECODE_FINISH(p);
     }
     void dump(Formatter *f) const {
-      f->dump_int("data_len", data.length());
+      f->dump_int("data_len", data_len);
+      f->dump_int("data_pages", data.size());
       f->dump_int("omap_header_len", omap_header.length());
 
       f->open_array_section("xattrs");
@@ -80,20 +105,32 @@ public:
     ceph::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
     map<ghobject_t, ObjectRef> object_map;        ///< for iteration
     map<string,bufferptr> xattr;
-    RWLock lock;   ///< for object_{map,hash}
+    RWLock lock;   ///< for object_{map,hash} and xattr
+    size_t page_size;
 
-    // NOTE: The lock only needs to protect the object_map/hash, not the
-    // contents of individual objects.  The osd is already sequencing
-    // reads and writes, so we will never see them concurrently at this
-    // level.
+    // NOTE: The lock only protects the object_map/hash; the contents of
+    // each object are under its own lock, so that transactions on
+    // different objects (and reads) do not serialize here.
 
     ObjectRef get_object(ghobject_t oid) {
+      RWLock::RLocker l(lock);
       ceph::unordered_map<ghobject_t,ObjectRef>::iterator o = object_hash.find(oid);
       if (o == object_hash.end())
 	return ObjectRef();
       return o->second;
     }
 
+    ObjectRef get_or_create_object(ghobject_t oid) {
+      RWLock::WLocker l(lock);
+      ceph::unordered_map<ghobject_t,ObjectRef>::iterator o = object_hash.find(oid);
+      if (o != object_hash.end())
+	return o->second;
+      ObjectRef r(new Object(page_size));
+      object_map[oid] = r;
+      object_hash[oid] = r;
+      return r;
+    }
+
     void encode(bufferlist& bl) const {
       ENCODE_START(1, 1, bl);
       ::encode(xattr, bl);
@@ -115,7 +152,7 @@ public:
       while (s--) {
 	ghobject_t k;
 	::decode(k, p);
-	ObjectRef o(new Object);
+	ObjectRef o(new Object(page_size));
 	o->decode(p);
 	object_map.insert(make_pair(k, o));
 	object_hash.insert(make_pair(k, o));
@@ -123,7 +160,7 @@ public:
       DECODE_FINISH(p);
     }
 
-    Collection() : lock("MemStore::Collection::lock") {}
+    Collection(size_t ps) : lock("MemStore::Collection::lock"), page_size(ps) {}
   };
   typedef ceph::shared_ptr<Collection> CollectionRef;
 
@@ -137,35 +174,35 @@ private:
       : c(c), o(o), it(o->omap.begin()) {}
 
     int seek_to_first() {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       it = o->omap.begin();
       return 0;
     }
     int upper_bound(const string &after) {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       it = o->omap.upper_bound(after);
       return 0;
     }
     int lower_bound(const string &to) {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       it = o->omap.lower_bound(to);
       return 0;
     }
     bool valid() {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       return it != o->omap.end();      
     }
     int next() {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       ++it;
       return 0;
     }
     string key() {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       return it->first;
     }
     bufferlist value() {
-      RWLock::RLocker l(c->lock);
+      Mutex::Locker l(o->lock);
       return it->second;
     }
     int status() {
@@ -174,9 +211,21 @@ private:
   };
 
 
+  /// transactions on one sequencer apply in order; others run in parallel
+  struct OpSequencer : public Sequencer_impl {
+    Mutex apply_lock;
+    OpSequencer() : apply_lock("MemStore::OpSequencer::apply_lock") {}
+    void flush() {
+      // transactions are applied before queue_transactions returns
+      Mutex::Locker l(apply_lock);
+    }
+  };
+
   ceph::unordered_map<coll_t, CollectionRef> coll_map;
   RWLock coll_lock;    ///< rwlock to protect coll_map
-  Mutex apply_lock;    ///< serialize all updates
+  Mutex sequencer_lock;  ///< for attaching OpSequencers
+  Sequencer default_osr;
+  size_t page_size;
 
   CollectionRef get_collection(coll_t cid);
 
@@ -184,8 +233,6 @@ private:
 
   void _do_transaction(Transaction& t);
 
-  void _write_into_bl(const bufferlist& src, unsigned offset, bufferlist *dst);
-
   int _touch(coll_t cid, const ghobject_t& oid);
   int _write(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, const bufferlist& bl,
       bool replica = false);
@@ -208,7 +255,7 @@ private:
   int _omap_setheader(coll_t cid, const ghobject_t &oid, const bufferlist &bl);
 
   int _create_collection(coll_t c);
-  int _destroy_collection(coll_t c);
+  int _destroy_collection(coll_t c, bool recursive = false);
   int _collection_add(coll_t cid, coll_t ocid, const ghobject_t& oid);
   int _collection_move_rename(coll_t oldcid, const ghobject_t& oldoid,
 			      coll_t cid, const ghobject_t& o);
@@ -229,8 +276,12 @@ public:
   MemStore(CephContext *cct, const string& path)
     : ObjectStore(path),
       coll_lock("MemStore::coll_lock"),
-      apply_lock("MemStore::apply_lock"),
-      finisher(cct) { }
+      sequencer_lock("MemStore::sequencer_lock"),
+      default_osr("memstore default"),
+      page_size(cct->_conf->memstore_page_size),
+      finisher(cct) {
+    assert(page_size > 0);
+  }
   ~MemStore() { }
 
   int update_version_stamp() {
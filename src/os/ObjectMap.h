@@ -28,18 +28,38 @@
  */
 class ObjectMap {
 public:
+  /**
+   * Updates collected for one submission to the backing store
+   *
+   * Ops given a batch take effect at submit_batch.  Reads, and ops
+   * that are not given the batch, do not see them before that.
+   */
+  class BatchImpl {
+  public:
+    virtual ~BatchImpl() {}
+  };
+  typedef ceph::shared_ptr<BatchImpl> Batch;
+
+  /// Start a batch, NULL if the implementation does not batch
+  virtual Batch start_batch() { return Batch(); }
+
+  /// Submit everything added to batch
+  virtual int submit_batch(Batch batch) { return 0; }
+
   /// Set keys and values from specified map
   virtual int set_keys(
     const ghobject_t &oid,              ///< [in] object containing map
     const map<string, bufferlist> &set,  ///< [in] key to value map to set
-    const SequencerPosition *spos=0     ///< [in] sequencer position
+    const SequencerPosition *spos=0,    ///< [in] sequencer position
+    Batch batch=Batch()                 ///< [in] batch to add to
     ) = 0;
 
   /// Set header
   virtual int set_header(
     const ghobject_t &oid,              ///< [in] object containing map
     const bufferlist &bl,               ///< [in] header to set
-    const SequencerPosition *spos=0     ///< [in] sequencer position
+    const SequencerPosition *spos=0,    ///< [in] sequencer position
+    Batch batch=Batch()                 ///< [in] batch to add to
     ) = 0;
 
   /// Retrieve header
@@ -58,7 +78,8 @@ public:
   virtual int rm_keys(
     const ghobject_t &oid,              ///< [in] object containing map
     const set<string> &to_clear,        ///< [in] Keys to clear
-    const SequencerPosition *spos=0     ///< [in] sequencer position
+    const SequencerPosition *spos=0,    ///< [in] sequencer position
+    Batch batch=Batch()                 ///< [in] batch to add to
     ) = 0;
 
   /// Clear all omap keys and the header
@@ -137,6 +158,9 @@ public:
 
   virtual bool check(std::ostream &out) { return true; }
 
+  /// Queue a background compaction of the maps cleared so far
+  virtual void compact_cleared() {}
+
   class ObjectMapIteratorImpl {
   public:
     virtual int seek_to_first() = 0;
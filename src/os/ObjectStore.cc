@@ -112,6 +112,384 @@ int ObjectStore::queue_transactions(
 			    onreadable_sync, op);
 }
 
+/*
+ * What each op carries, in the order the iterator hands it out:
+ * c cid, o oid, n u64, u u32, and then what goes in data_bl: b
+ * bufferlist, s string, a attr map, k key set.  This is what tells the
+ * old encoding, where all of these follow the op one after another,
+ * from the new one.
+ */
+static const char *get_op_layout(int op)
+{
+  switch (op) {
+  case ObjectStore::Transaction::OP_NOP:
+  case ObjectStore::Transaction::OP_STARTSYNC:
+    return "";
+  case ObjectStore::Transaction::OP_TOUCH:
+  case ObjectStore::Transaction::OP_REMOVE:
+  case ObjectStore::Transaction::OP_RMATTRS:
+  case ObjectStore::Transaction::OP_COLL_REMOVE:
+  case ObjectStore::Transaction::OP_OMAP_CLEAR:
+    return "co";
+  case ObjectStore::Transaction::OP_WRITE:
+    return "connb";
+  case ObjectStore::Transaction::OP_ZERO:
+  case ObjectStore::Transaction::OP_TRIMCACHE:
+    return "conn";
+  case ObjectStore::Transaction::OP_TRUNCATE:
+    return "con";
+  case ObjectStore::Transaction::OP_SETATTR:
+    return "cosb";
+  case ObjectStore::Transaction::OP_SETATTRS:
+  case ObjectStore::Transaction::OP_OMAP_SETKEYS:
+    return "coa";
+  case ObjectStore::Transaction::OP_RMATTR:
+    return "cos";
+  case ObjectStore::Transaction::OP_CLONE:
+    return "coo";
+  case ObjectStore::Transaction::OP_CLONERANGE:
+    return "coonn";
+  case ObjectStore::Transaction::OP_CLONERANGE2:
+    return "coonnn";
+  case ObjectStore::Transaction::OP_MKCOLL:
+  case ObjectStore::Transaction::OP_RMCOLL:
+  case ObjectStore::Transaction::OP_RMCOLL_RECURSIVE:
+    return "c";
+  case ObjectStore::Transaction::OP_COLL_HINT:
+    return "cub";
+  case ObjectStore::Transaction::OP_COLL_ADD:
+  case ObjectStore::Transaction::OP_COLL_MOVE:
+    return "cco";
+  case ObjectStore::Transaction::OP_COLL_MOVE_RENAME:
+    return "coco";
+  case ObjectStore::Transaction::OP_COLL_SETATTR:
+    return "csb";
+  case ObjectStore::Transaction::OP_COLL_RMATTR:
+    return "cs";
+  case ObjectStore::Transaction::OP_COLL_SETATTRS:
+    return "ca";
+  case ObjectStore::Transaction::OP_COLL_RENAME:
+    return "cc";
+  case ObjectStore::Transaction::OP_OMAP_RMKEYS:
+    return "cok";
+  case ObjectStore::Transaction::OP_OMAP_RMKEYRANGE:
+    return "coss";
+  case ObjectStore::Transaction::OP_OMAP_SETHEADER:
+    return "cob";
+  case ObjectStore::Transaction::OP_SPLIT_COLLECTION:
+  case ObjectStore::Transaction::OP_SPLIT_COLLECTION2:
+    return "cuuc";
+  }
+  return NULL;
+}
+
+void ObjectStore::Transaction::_decode_legacy(bufferlist& tbl,
+					      bool sobject_encoding)
+{
+  bufferlist::iterator p = tbl.begin();
+  while (!p.end()) {
+    __u32 op;
+    ::decode(op, p);
+    const char *layout = get_op_layout(op);
+    if (!layout)
+      throw buffer::malformed_input("unknown transaction op");
+    _start_op(op);
+    for (; *layout; ++layout) {
+      switch (*layout) {
+      case 'c':
+	{
+	  coll_t c;
+	  ::decode(c, p);
+	  _add_cid(c);
+	}
+	break;
+      case 'o':
+	{
+	  ghobject_t oid;
+	  if (sobject_encoding) {
+	    sobject_t soid;
+	    ::decode(soid, p);
+	    oid.hobj.snap = soid.snap;
+	    oid.hobj.oid = soid.oid;
+	    oid.generation = ghobject_t::NO_GEN;
+	    oid.shard_id = ghobject_t::NO_SHARD;
+	  } else {
+	    ::decode(oid, p);
+	  }
+	  _add_oid(oid);
+	}
+	break;
+      case 'n':
+	{
+	  uint64_t v;
+	  ::decode(v, p);
+	  _add_num(v);
+	}
+	break;
+      case 'u':
+	{
+	  uint32_t v;
+	  ::decode(v, p);
+	  _add_u32(v);
+	}
+	break;
+      case 'b':
+	{
+	  bufferlist bl;
+	  ::decode(bl, p);
+	  if (op == OP_WRITE && bl.length() > largest_data_len) {
+	    largest_data_len = bl.length();
+	    largest_data_off = cur_op.num[0];
+	    largest_data_off_in_tbl = data_bl.length() + sizeof(__u32);
+	  }
+	  ::encode(bl, data_bl);
+	}
+	break;
+      case 's':
+	{
+	  string str;
+	  ::decode(str, p);
+	  ::encode(str, data_bl);
+	}
+	break;
+      case 'a':
+	{
+	  map<string,bufferlist> aset;
+	  ::decode(aset, p);
+	  ::encode(aset, data_bl);
+	}
+	break;
+      case 'k':
+	{
+	  set<string> keys;
+	  ::decode(keys, p);
+	  ::encode(keys, data_bl);
+	}
+	break;
+      default:
+	assert(0 == "bad op layout");
+      }
+    }
+    _finish_op();
+  }
+}
+
+void ObjectStore::Transaction::_encode_legacy(bufferlist& tbl,
+					      uint32_t *data_off_in_tbl) const
+{
+  uint32_t largest = 0;
+  unsigned data_off = 0;
+  bufferlist::iterator p = const_cast<bufferlist&>(op_bl).begin();
+  while (!p.end()) {
+    Op op;
+    p.copy(sizeof(op), (char *)&op);
+    const char *layout = get_op_layout(op.op);
+    assert(layout);
+    __u32 opcode = op.op;
+    ::encode(opcode, tbl);
+    unsigned ci = 0, oi = 0, ui = 0, ni = 0;
+    for (; *layout; ++layout) {
+      switch (*layout) {
+      case 'c':
+	::encode(colls[op.cid[ci++]], tbl);
+	continue;
+      case 'o':
+	::encode(objects[op.oid[oi++]], tbl);
+	continue;
+      case 'n':
+	{
+	  uint64_t v = op.num[ni++];
+	  ::encode(v, tbl);
+	}
+	continue;
+      case 'u':
+	{
+	  uint32_t v = op.u32[ui++];
+	  ::encode(v, tbl);
+	}
+	continue;
+      }
+      break;
+    }
+    // everything else is encoded just the same in data_bl
+    if (op.data_len) {
+      if (op.op == OP_WRITE && op.num[1] > largest) {
+	largest = op.num[1];
+	*data_off_in_tbl = tbl.length() + sizeof(__u32);
+      }
+      data_bl.copy(data_off, op.data_len, tbl);
+    }
+    data_off += op.data_len;
+  }
+}
+
+void ObjectStore::Transaction::append(Transaction& other)
+{
+  ops += other.ops;
+  assert(pad_unused_bytes == 0);
+  assert(other.pad_unused_bytes == 0);
+  if (other.largest_data_len > largest_data_len) {
+    largest_data_len = other.largest_data_len;
+    largest_data_off = other.largest_data_off;
+    largest_data_off_in_tbl = data_bl.length() + other.largest_data_off_in_tbl;
+  }
+  data_bl.append(other.data_bl);
+
+  vector<__le32> cids(other.colls.size()), oids(other.objects.size());
+  for (unsigned i = 0; i < other.colls.size(); ++i)
+    cids[i] = _get_coll_id(other.colls[i]);
+  for (unsigned i = 0; i < other.objects.size(); ++i)
+    oids[i] = _get_object_id(other.objects[i]);
+  bufferlist::iterator p = other.op_bl.begin();
+  while (!p.end()) {
+    Op op;
+    p.copy(sizeof(op), (char *)&op);
+    const char *layout = get_op_layout(op.op);
+    assert(layout);
+    unsigned ci = 0, oi = 0;
+    for (; *layout; ++layout) {
+      if (*layout == 'c') {
+	op.cid[ci] = cids[op.cid[ci]];
+	++ci;
+      } else if (*layout == 'o') {
+	op.oid[oi] = oids[op.oid[oi]];
+	++oi;
+      }
+    }
+    op_bl.append((const char *)&op, sizeof(op));
+  }
+
+  on_applied.splice(on_applied.end(), other.on_applied);
+  on_commit.splice(on_commit.end(), other.on_commit);
+  on_applied_sync.splice(on_applied_sync.end(), other.on_applied_sync);
+}
+
+/// an update of a single object which a later remove makes moot
+static bool op_removable(int op)
+{
+  switch (op) {
+  case ObjectStore::Transaction::OP_WRITE:
+  case ObjectStore::Transaction::OP_ZERO:
+  case ObjectStore::Transaction::OP_TRUNCATE:
+  case ObjectStore::Transaction::OP_SETATTR:
+  case ObjectStore::Transaction::OP_SETATTRS:
+  case ObjectStore::Transaction::OP_RMATTR:
+  case ObjectStore::Transaction::OP_RMATTRS:
+  case ObjectStore::Transaction::OP_OMAP_CLEAR:
+  case ObjectStore::Transaction::OP_OMAP_SETKEYS:
+  case ObjectStore::Transaction::OP_OMAP_RMKEYS:
+  case ObjectStore::Transaction::OP_OMAP_RMKEYRANGE:
+  case ObjectStore::Transaction::OP_OMAP_SETHEADER:
+    return true;
+  }
+  return false;
+}
+
+/// an update of a single object's attrs or omap, which a truncate leaves alone
+static bool op_not_data(int op)
+{
+  switch (op) {
+  case ObjectStore::Transaction::OP_SETATTR:
+  case ObjectStore::Transaction::OP_SETATTRS:
+  case ObjectStore::Transaction::OP_RMATTR:
+  case ObjectStore::Transaction::OP_RMATTRS:
+  case ObjectStore::Transaction::OP_OMAP_CLEAR:
+  case ObjectStore::Transaction::OP_OMAP_SETKEYS:
+  case ObjectStore::Transaction::OP_OMAP_RMKEYS:
+  case ObjectStore::Transaction::OP_OMAP_RMKEYRANGE:
+  case ObjectStore::Transaction::OP_OMAP_SETHEADER:
+    return true;
+  }
+  return false;
+}
+
+void ObjectStore::Transaction::get_op_plan(vector<char> *plan) const
+{
+  vector<Op> v;
+  v.reserve(ops);
+  bufferlist::iterator p = const_cast<bufferlist&>(op_bl).begin();
+  while (!p.end()) {
+    Op op;
+    p.copy(sizeof(op), (char *)&op);
+    v.push_back(op);
+  }
+  plan->assign(v.size(), OP_PLAN_APPLY);
+
+  // which cids and oids each op refers to
+  vector<unsigned> num_cids(v.size()), num_oids(v.size());
+  for (unsigned k = 0; k < v.size(); ++k) {
+    const char *layout = get_op_layout(v[k].op);
+    if (!layout)
+      return;  // we can't tell what it touches
+    for (; *layout; ++layout) {
+      if (*layout == 'c')
+	num_cids[k]++;
+      else if (*layout == 'o')
+	num_oids[k]++;
+    }
+  }
+
+  for (unsigned r = 0; r < v.size(); ++r) {
+    bool remove = v[r].op == OP_REMOVE;
+    if (!remove && v[r].op != OP_TRUNCATE)
+      continue;
+    uint32_t cid = v[r].cid[0], oid = v[r].oid[0];
+    uint64_t size = v[r].num[0];
+    int first_write = -1;
+    for (int k = (int)r - 1; k >= 0; --k) {
+      const Op& op = v[k];
+      bool ours = num_cids[k] == 1 && num_oids[k] == 1 &&
+	op.cid[0] == cid && op.oid[0] == oid;
+      bool other = false;
+      for (unsigned j = 0; j < num_oids[k]; ++j)
+	if (op.oid[j] == oid)
+	  other = !ours;
+      if (num_oids[k] == 0)
+	for (unsigned j = 0; j < num_cids[k]; ++j)
+	  if (op.cid[j] == cid)
+	    other = true;  // the whole collection
+      if (other)
+	break;
+      if (!ours)
+	continue;
+      if (remove) {
+	if (!op_removable(op.op))
+	  break;
+	(*plan)[k] = OP_PLAN_SKIP;
+      } else if ((op.op == OP_WRITE || op.op == OP_ZERO) &&
+		 op.num[0] >= size) {
+	(*plan)[k] = OP_PLAN_SKIP;
+	if (op.op == OP_WRITE)
+	  first_write = k;
+      } else if (!op_not_data(op.op)) {
+	break;
+      }
+    }
+    // the remove doesn't care if the object exists, but the truncate does
+    if (first_write >= 0)
+      (*plan)[first_write] = OP_PLAN_TOUCH;
+  }
+}
+
+int ObjectStore::collection_list_partial_attr(coll_t c, ghobject_t start,
+					      int min, int max, snapid_t snap,
+					      const char *attr,
+					      vector<ghobject_t> *ls,
+					      vector<bufferptr> *attrs,
+					      ghobject_t *next)
+{
+  int r = collection_list_partial(c, start, min, max, snap, ls, next);
+  if (r < 0)
+    return r;
+  attrs->resize(ls->size());
+  for (unsigned i = 0; i < ls->size(); ++i) {
+    r = getattr(c, (*ls)[i], attr, (*attrs)[i]);
+    if (r < 0 && r != -ENODATA)
+      return r;
+  }
+  return 0;
+}
+
 void ObjectStore::Transaction::dump(ceph::Formatter *f)
 {
   f->open_array_section("ops");
@@ -313,6 +691,19 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       }
       break;
 
+    case Transaction::OP_COLL_HINT:
+      {
+	coll_t cid = i.get_cid();
+	uint32_t type = i.get_u32();
+	bufferlist hint;
+	i.get_bl(hint);
+	f->dump_string("op_name", "coll_hint");
+	f->dump_stream("collection") << cid;
+	f->dump_unsigned("type", type);
+	f->dump_unsigned("hint_length", hint.length());
+      }
+      break;
+
     case Transaction::OP_RMCOLL:
       {
 	coll_t cid = i.get_cid();
@@ -321,6 +712,14 @@ void ObjectStore::Transaction::dump(ceph::Formatter *f)
       }
       break;
 
+    case Transaction::OP_RMCOLL_RECURSIVE:
+      {
+	coll_t cid = i.get_cid();
+	f->dump_string("op_name", "rmcoll_recursive");
+	f->dump_stream("collection") << cid;
+      }
+      break;
+
     case Transaction::OP_COLL_ADD:
       {
 	coll_t ncid = i.get_cid();
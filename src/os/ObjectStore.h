@@ -150,23 +150,118 @@ public:
 				    doesn't create the destination */
       OP_OMAP_RMKEYRANGE = 37,  // cid, oid, firstkey, lastkey
       OP_COLL_MOVE_RENAME = 38,   // oldcid, oldoid, newcid, newoid
+      OP_COLL_HINT = 39,   // cid, type, bl
+      OP_RMCOLL_RECURSIVE = 40,   // cid
     };
 
+    // collection hint types, see collection_hint()
+    enum {
+      COLL_HINT_EXPECTED_NUM_OBJECTS = 1,  // pg_num (u32), objects (u64)
+    };
+
+    /**
+     * Ops are kept as fixed size headers in op_bl.  Collections and
+     * objects are stored once each, in colls and objects, and the
+     * headers refer to them by index; offsets, lengths and the like go
+     * in the header too.  Everything of variable size (attr names,
+     * data, attr and key sets) is encoded in data_bl, in op order.
+     *
+     * This is also the encoding (v8), so encoding a transaction is a
+     * matter of appending these, and iterating one does not decode
+     * each op.  Transactions in the old encoding, with ops, cids and
+     * oids encoded one after another in a single bufferlist, are
+     * converted as they are decoded, and can be encoded that way for
+     * peers that do not understand the new one.
+     */
+    struct Op {
+      __le32 op;
+      __le32 data_len;  ///< bytes of this op's items in data_bl
+      __le32 cid[2];    ///< indexes into colls
+      __le32 oid[2];    ///< indexes into objects
+      __le32 u32[2];
+      __le64 num[3];    ///< offsets and lengths
+    } __attribute__ ((packed));
+
   private:
     uint64_t ops;
     uint64_t pad_unused_bytes;
     uint32_t largest_data_len, largest_data_off, largest_data_off_in_tbl;
-    bufferlist tbl;
-    bool sobject_encoding;
-    int64_t pool_override;
-    bool use_pool_override;
-    bool replica;
+    bufferlist op_bl;
+    bufferlist data_bl;
+    vector<coll_t> colls;
+    vector<ghobject_t> objects;
+    map<coll_t, __le32> coll_index;         ///< built as needed, from colls
+    map<ghobject_t, __le32> object_index;   ///< built as needed, from objects
     bool tolerate_collection_add_enoent;
 
+    Op cur_op;                  ///< op being added
+    unsigned cur_data_start;    ///< where its items start in data_bl
+    unsigned cur_cid, cur_oid, cur_u32, cur_num;
+
     list<Context *> on_applied;
     list<Context *> on_commit;
     list<Context *> on_applied_sync;
 
+    __le32 _get_coll_id(const coll_t& cid) {
+      if (coll_index.size() != colls.size())
+	for (unsigned i = coll_index.size(); i < colls.size(); ++i)
+	  coll_index[colls[i]] = i;
+      map<coll_t, __le32>::iterator p = coll_index.find(cid);
+      if (p != coll_index.end())
+	return p->second;
+      __le32 id;
+      id = colls.size();
+      colls.push_back(cid);
+      coll_index[cid] = id;
+      return id;
+    }
+    __le32 _get_object_id(const ghobject_t& oid) {
+      if (object_index.size() != objects.size())
+	for (unsigned i = object_index.size(); i < objects.size(); ++i)
+	  object_index[objects[i]] = i;
+      map<ghobject_t, __le32>::iterator p = object_index.find(oid);
+      if (p != object_index.end())
+	return p->second;
+      __le32 id;
+      id = objects.size();
+      objects.push_back(oid);
+      object_index[oid] = id;
+      return id;
+    }
+
+    void _start_op(__u32 op) {
+      memset(&cur_op, 0, sizeof(cur_op));
+      cur_op.op = op;
+      cur_data_start = data_bl.length();
+      cur_cid = cur_oid = cur_u32 = cur_num = 0;
+    }
+    void _add_cid(const coll_t& cid) {
+      assert(cur_cid < 2);
+      cur_op.cid[cur_cid++] = _get_coll_id(cid);
+    }
+    void _add_oid(const ghobject_t& oid) {
+      assert(cur_oid < 2);
+      cur_op.oid[cur_oid++] = _get_object_id(oid);
+    }
+    void _add_u32(uint32_t v) {
+      assert(cur_u32 < 2);
+      cur_op.u32[cur_u32++] = v;
+    }
+    void _add_num(uint64_t v) {
+      assert(cur_num < 3);
+      cur_op.num[cur_num++] = v;
+    }
+    void _finish_op() {
+      cur_op.data_len = data_bl.length() - cur_data_start;
+      op_bl.append((const char *)&cur_op, sizeof(cur_op));
+      ops++;
+    }
+
+    /// rebuild from the old encoding of tbl
+    void _decode_legacy(bufferlist& tbl, bool sobject_encoding);
+    /// the old encoding of our ops
+    void _encode_legacy(bufferlist& tbl, uint32_t *data_off_in_tbl) const;
+
   public:
     void set_tolerate_collection_add_enoent() {
       tolerate_collection_add_enoent = true;
@@ -221,14 +316,6 @@ public:
       return C_Contexts::list_to_context(on_applied_sync);
     }
 
-    void set_pool_override(int64_t pool) {
-      pool_override = pool;
-    }
-    void set_replica() {
-      replica = true;
-    }
-    bool get_replica() { return replica; }
-
     void swap(Transaction& other) {
       std::swap(ops, other.ops);
       std::swap(largest_data_len, other.largest_data_len);
@@ -237,26 +324,24 @@ public:
       std::swap(on_applied, other.on_applied);
       std::swap(on_commit, other.on_commit);
       std::swap(on_applied_sync, other.on_applied_sync);
-      tbl.swap(other.tbl);
+      op_bl.swap(other.op_bl);
+      data_bl.swap(other.data_bl);
+      colls.swap(other.colls);
+      objects.swap(other.objects);
+      coll_index.swap(other.coll_index);
+      object_index.swap(other.object_index);
     }
 
-    void append(Transaction& other) {
-      ops += other.ops;
-      assert(pad_unused_bytes == 0);
-      assert(other.pad_unused_bytes == 0);
-      if (other.largest_data_len > largest_data_len) {
-	largest_data_len = other.largest_data_len;
-	largest_data_off = other.largest_data_off;
-	largest_data_off_in_tbl = tbl.length() + other.largest_data_off_in_tbl;
-      }
-      tbl.append(other.tbl);
-      on_applied.splice(on_applied.end(), other.on_applied);
-      on_commit.splice(on_commit.end(), other.on_commit);
-      on_applied_sync.splice(on_applied_sync.end(), other.on_applied_sync);
-    }
+    /// add other's ops after ours; their collections and objects are renumbered
+    void append(Transaction& other);
 
     uint64_t get_encoded_bytes() {
-      return 1 + 8 + 8 + 4 + 4 + 4 + 4 + tbl.length();
+      return 1 + 8 + 8 + 4 + 4 + 4 + 4 + data_bl.length() +
+	4 + op_bl.length() + get_index_bytes();
+    }
+    /// roughly what colls and objects take up encoded
+    uint64_t get_index_bytes() {
+      return 8 + colls.size() * 64 + objects.size() * 128;
     }
 
     uint64_t get_num_bytes() {
@@ -277,7 +362,7 @@ public:
 	  sizeof(largest_data_len) +
 	  sizeof(largest_data_off) +
 	  sizeof(largest_data_off_in_tbl) +
-	  sizeof(__u32);  // tbl length
+	  sizeof(__u32);  // data_bl length
       }
       return 0;  // none
     }
@@ -295,23 +380,44 @@ public:
       return ops;
     }
 
+    /// how each op needs applying, see get_op_plan()
+    enum {
+      OP_PLAN_APPLY = 0,
+      OP_PLAN_SKIP = 1,    ///< a later op undoes it
+      OP_PLAN_TOUCH = 2,   ///< only create the object, if it does not exist
+    };
+    /**
+     * Find ops whose effect a later op in this transaction undoes
+     *
+     * Updates of an object that is removed later on, and writes past
+     * the offset it is later truncated to, need not be applied, as long
+     * as nothing in between refers to the object otherwise.  A write
+     * that may have created the object is turned into a touch.
+     *
+     * @param plan [out] one OP_PLAN_* per op
+     */
+    void get_op_plan(vector<char> *plan) const;
+
     // ---- iterator ----
     class iterator {
-      bufferlist::iterator p;
-      bool sobject_encoding;
-      int64_t pool_override;
-      bool use_pool_override;
-      bool replica;
+      Transaction *t;
+      bufferlist::iterator op_p;
+      bufferlist::iterator data_p;
+      unsigned data_off;   ///< where the next op's items start
+      Op op;
+      unsigned cur_cid, cur_oid, cur_u32, cur_num;
       bool _tolerate_collection_add_enoent;
 
       iterator(Transaction *t)
-	: p(t->tbl.begin()),
-	  sobject_encoding(t->sobject_encoding),
-	  pool_override(t->pool_override),
-	  use_pool_override(t->use_pool_override),
-	  replica(t->replica),
+	: t(t),
+	  op_p(t->op_bl.begin()),
+	  data_p(t->data_bl.begin()),
+	  data_off(0),
+	  cur_cid(0), cur_oid(0), cur_u32(0), cur_num(0),
 	  _tolerate_collection_add_enoent(
-	    t->tolerate_collection_add_enoent) {}
+	    t->tolerate_collection_add_enoent) {
+	memset(&op, 0, sizeof(op));
+      }
 
       friend class Transaction;
 
@@ -320,69 +426,56 @@ public:
 	return _tolerate_collection_add_enoent;
       }
       bool have_op() {
-	return !p.end();
+	return !op_p.end();
       }
       int get_op() {
-	__u32 op;
-	::decode(op, p);
-	return op;
+	op_p.copy(sizeof(op), (char *)&op);
+	cur_cid = cur_oid = cur_u32 = cur_num = 0;
+	// skip whatever the last op's reader left of its items
+	if (data_p.get_off() != data_off)
+	  data_p.seek(data_off);
+	data_off += op.data_len;
+	return op.op;
       }
       void get_bl(bufferlist& bl) {
-	::decode(bl, p);
+	::decode(bl, data_p);
       }
       ghobject_t get_oid() {
-	ghobject_t oid;
-	if (sobject_encoding) {
-	  sobject_t soid;
-	  ::decode(soid, p);
-	  oid.hobj.snap = soid.snap;
-	  oid.hobj.oid = soid.oid;
-	  oid.generation = ghobject_t::NO_GEN;
-	  oid.shard_id = ghobject_t::NO_SHARD;
-	} else {
-	  ::decode(oid, p);
-	  if (use_pool_override && pool_override != -1 &&
-	      !oid.hobj.is_max() && oid.hobj.pool == -1) {
-	    oid.hobj.pool = pool_override;
-	  }
-	}
-	return oid;
+	assert(cur_oid < 2);
+	return t->objects[op.oid[cur_oid++]];
       }
       coll_t get_cid() {
-	coll_t c;
-	::decode(c, p);
-	return c;
+	assert(cur_cid < 2);
+	return t->colls[op.cid[cur_cid++]];
       }
       uint64_t get_length() {
-	uint64_t len;
-	::decode(len, p);
-	return len;
+	assert(cur_num < 3);
+	return op.num[cur_num++];
       }
       string get_attrname() {
 	string s;
-	::decode(s, p);
+	::decode(s, data_p);
 	return s;
       }
       string get_key() {
 	string s;
-	::decode(s, p);
+	::decode(s, data_p);
 	return s;
       }
       void get_attrset(map<string,bufferptr>& aset) {
-	::decode(aset, p);
+	::decode(aset, data_p);
       }
       void get_attrset(map<string,bufferlist>& aset) {
-	::decode(aset, p);
+	::decode(aset, data_p);
       }
       void get_keyset(set<string> &keys) {
-	::decode(keys, p);
+	::decode(keys, data_p);
       }
       uint32_t get_u32() {
-	uint32_t bits;
-	::decode(bits, p);
-	return bits;
+	assert(cur_u32 < 2);
+	return op.u32[cur_u32++];
       }
-      bool get_replica() { return replica; }
+      bool get_replica() { return t->replica; }
     };
 
     iterator begin() {
@@ -391,156 +484,161 @@ public:
     // -----------------------------
 
     void start_sync() {
-      __u32 op = OP_STARTSYNC;
-      ::encode(op, tbl);
-      ops++;
+      _start_op(OP_STARTSYNC);
+      _finish_op();
     }
     void nop() {
-      __u32 op = OP_NOP;
-      ::encode(op, tbl);
-      ops++;
+      _start_op(OP_NOP);
+      _finish_op();
     }
     void touch(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_TOUCH;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_TOUCH);
+      _add_cid(cid);
+      _add_oid(oid);
+      _finish_op();
     }
     void write(coll_t cid, const ghobject_t& oid, uint64_t off, uint64_t len, const bufferlist& data) {
-      __u32 op = OP_WRITE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(off, tbl);
-      ::encode(len, tbl);
+      _start_op(OP_WRITE);
+      _add_cid(cid);
+      _add_oid(oid);
+      _add_num(off);
+      _add_num(len);
       assert(len == data.length());
       if (data.length() > largest_data_len) {
 	largest_data_len = data.length();
 	largest_data_off = off;
-	largest_data_off_in_tbl = tbl.length() + sizeof(__u32);  // we are about to 
+	largest_data_off_in_tbl = data_bl.length() + sizeof(__u32);  // we are about to
       }
-      ::encode(data, tbl);
-      ops++;
+      ::encode(data, data_bl);
+      _finish_op();
     }
     void zero(coll_t cid, const ghobject_t& oid, uint64_t off, uint64_t len) {
-      __u32 op = OP_ZERO;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(off, tbl);
-      ::encode(len, tbl);
-      ops++;
+      _start_op(OP_ZERO);
+      _add_cid(cid);
+      _add_oid(oid);
+      _add_num(off);
+      _add_num(len);
+      _finish_op();
     }
     void truncate(coll_t cid, const ghobject_t& oid, uint64_t off) {
-      __u32 op = OP_TRUNCATE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(off, tbl);
-      ops++;
+      _start_op(OP_TRUNCATE);
+      _add_cid(cid);
+      _add_oid(oid);
+      _add_num(off);
+      _finish_op();
     }
     void remove(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_REMOVE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_REMOVE);
+      _add_cid(cid);
+      _add_oid(oid);
+      _finish_op();
     }
     void setattr(coll_t cid, const ghobject_t& oid, const char* name, bufferlist& val) {
       string n(name);
       setattr(cid, oid, n, val);
     }
     void setattr(coll_t cid, const ghobject_t& oid, const string& s, bufferlist& val) {
-      __u32 op = OP_SETATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(s, tbl);
-      ::encode(val, tbl);
-      ops++;
+      _start_op(OP_SETATTR);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(s, data_bl);
+      ::encode(val, data_bl);
+      _finish_op();
     }
     void setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferptr>& attrset) {
-      __u32 op = OP_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(attrset, tbl);
-      ops++;
+      _start_op(OP_SETATTRS);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(attrset, data_bl);
+      _finish_op();
     }
     void setattrs(coll_t cid, const ghobject_t& oid, map<string,bufferlist>& attrset) {
-      __u32 op = OP_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(attrset, tbl);
-      ops++;
+      _start_op(OP_SETATTRS);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(attrset, data_bl);
+      _finish_op();
     }
     void rmattr(coll_t cid, const ghobject_t& oid, const char *name) {
       string n(name);
       rmattr(cid, oid, n);
     }
     void rmattr(coll_t cid, const ghobject_t& oid, const string& s) {
-      __u32 op = OP_RMATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(s, tbl);
-      ops++;
+      _start_op(OP_RMATTR);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(s, data_bl);
+      _finish_op();
     }
     void rmattrs(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_RMATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_RMATTRS);
+      _add_cid(cid);
+      _add_oid(oid);
+      _finish_op();
     }
     void clone(coll_t cid, const ghobject_t& oid, ghobject_t noid) {
-      __u32 op = OP_CLONE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(noid, tbl);
-      ops++;
+      _start_op(OP_CLONE);
+      _add_cid(cid);
+      _add_oid(oid);
+      _add_oid(noid);
+      _finish_op();
     }
     void clone_range(coll_t cid, const ghobject_t& oid, ghobject_t noid,
 		     uint64_t srcoff, uint64_t srclen, uint64_t dstoff) {
-      __u32 op = OP_CLONERANGE2;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(noid, tbl);
-      ::encode(srcoff, tbl);
-      ::encode(srclen, tbl);
-      ::encode(dstoff, tbl);
-      ops++;
+      _start_op(OP_CLONERANGE2);
+      _add_cid(cid);
+      _add_oid(oid);
+      _add_oid(noid);
+      _add_num(srcoff);
+      _add_num(srclen);
+      _add_num(dstoff);
+      _finish_op();
     }
     void create_collection(coll_t cid) {
-      __u32 op = OP_MKCOLL;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ops++;
+      _start_op(OP_MKCOLL);
+      _add_cid(cid);
+      _finish_op();
+    }
+    /**
+     * Tell the store how a collection is going to be used
+     *
+     * Hints are advisory; a store may ignore any of them.
+     */
+    void collection_hint(coll_t cid, uint32_t type, const bufferlist& hint) {
+      _start_op(OP_COLL_HINT);
+      _add_cid(cid);
+      _add_u32(type);
+      ::encode(hint, data_bl);
+      _finish_op();
     }
     void remove_collection(coll_t cid) {
-      __u32 op = OP_RMCOLL;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ops++;
+      _start_op(OP_RMCOLL);
+      _add_cid(cid);
+      _finish_op();
+    }
+    /**
+     * Remove a collection and every object in it
+     *
+     * The store need not go through the objects one remove at a time,
+     * and may finish freeing their space in the background.
+     */
+    void remove_collection_recursive(coll_t cid) {
+      _start_op(OP_RMCOLL_RECURSIVE);
+      _add_cid(cid);
+      _finish_op();
     }
     void collection_add(coll_t cid, coll_t ocid, const ghobject_t& oid) {
-      __u32 op = OP_COLL_ADD;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(ocid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_COLL_ADD);
+      _add_cid(cid);
+      _add_cid(ocid);
+      _add_oid(oid);
+      _finish_op();
     }
     void collection_remove(coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_COLL_REMOVE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_COLL_REMOVE);
+      _add_cid(cid);
+      _add_oid(oid);
+      _finish_op();
     }
     void collection_move(coll_t cid, coll_t oldcid, const ghobject_t& oid) {
       collection_add(cid, oldcid, oid);
@@ -549,13 +647,12 @@ public:
     }
     void collection_move_rename(coll_t oldcid, const ghobject_t& oldoid,
 				coll_t cid, const ghobject_t& oid) {
-      __u32 op = OP_COLL_MOVE_RENAME;
-      ::encode(op, tbl);
-      ::encode(oldcid, tbl);
-      ::encode(oldoid, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_COLL_MOVE_RENAME);
+      _add_cid(oldcid);
+      _add_oid(oldoid);
+      _add_cid(cid);
+      _add_oid(oid);
+      _finish_op();
     }
 
     void collection_setattr(coll_t cid, const char* name, bufferlist& val) {
@@ -563,12 +660,11 @@ public:
       collection_setattr(cid, n, val);
     }
     void collection_setattr(coll_t cid, const string& name, bufferlist& val) {
-      __u32 op = OP_COLL_SETATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(name, tbl);
-      ::encode(val, tbl);
-      ops++;
+      _start_op(OP_COLL_SETATTR);
+      _add_cid(cid);
+      ::encode(name, data_bl);
+      ::encode(val, data_bl);
+      _finish_op();
     }
 
     void collection_rmattr(coll_t cid, const char* name) {
@@ -576,32 +672,28 @@ public:
       collection_rmattr(cid, n);
     }
     void collection_rmattr(coll_t cid, const string& name) {
-      __u32 op = OP_COLL_RMATTR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(name, tbl);
-      ops++;
+      _start_op(OP_COLL_RMATTR);
+      _add_cid(cid);
+      ::encode(name, data_bl);
+      _finish_op();
     }
     void collection_setattrs(coll_t cid, map<string,bufferptr>& aset) {
-      __u32 op = OP_COLL_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(aset, tbl);
-      ops++;
+      _start_op(OP_COLL_SETATTRS);
+      _add_cid(cid);
+      ::encode(aset, data_bl);
+      _finish_op();
     }
     void collection_setattrs(coll_t cid, map<string,bufferlist>& aset) {
-      __u32 op = OP_COLL_SETATTRS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(aset, tbl);
-      ops++;
+      _start_op(OP_COLL_SETATTRS);
+      _add_cid(cid);
+      ::encode(aset, data_bl);
+      _finish_op();
     }
     void collection_rename(coll_t cid, coll_t ncid) {
-      __u32 op = OP_COLL_RENAME;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(ncid, tbl);
-      ops++;
+      _start_op(OP_COLL_RENAME);
+      _add_cid(cid);
+      _add_cid(ncid);
+      _finish_op();
     }
 
     /// Remove omap from oid
@@ -609,11 +701,10 @@ public:
       coll_t cid,           ///< [in] Collection containing oid
       const ghobject_t &oid  ///< [in] Object from which to remove omap
       ) {
-      __u32 op = OP_OMAP_CLEAR;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ops++;
+      _start_op(OP_OMAP_CLEAR);
+      _add_cid(cid);
+      _add_oid(oid);
+      _finish_op();
     }
     /// Set keys on oid omap.  Replaces duplicate keys.
     void omap_setkeys(
@@ -621,12 +712,11 @@ public:
       const ghobject_t &oid,                ///< [in] Object to update
       const map<string, bufferlist> &attrset ///< [in] Replacement keys and values
       ) {
-      __u32 op = OP_OMAP_SETKEYS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(attrset, tbl);
-      ops++;
+      _start_op(OP_OMAP_SETKEYS);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(attrset, data_bl);
+      _finish_op();
     }
     /// Remove keys from oid omap
     void omap_rmkeys(
@@ -634,12 +724,11 @@ public:
       const ghobject_t &oid,  ///< [in] Object from which to remove the omap
       const set<string> &keys ///< [in] Keys to clear
       ) {
-      __u32 op = OP_OMAP_RMKEYS;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(keys, tbl);
-      ops++;
+      _start_op(OP_OMAP_RMKEYS);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(keys, data_bl);
+      _finish_op();
     }
 
     /// Remove key range from oid omap
@@ -649,13 +738,12 @@ public:
       const string& first,    ///< [in] first key in range
       const string& last      ///< [in] first key past range
       ) {
-      __u32 op = OP_OMAP_RMKEYRANGE;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(first, tbl);
-      ::encode(last, tbl);
-      ops++;
+      _start_op(OP_OMAP_RMKEYRANGE);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(first, data_bl);
+      ::encode(last, data_bl);
+      _finish_op();
     }
 
     /// Set omap header
@@ -664,12 +752,11 @@ public:
       const ghobject_t &oid,  ///< [in] Object from which to remove the omap
       const bufferlist &bl    ///< [in] Header value
       ) {
-      __u32 op = OP_OMAP_SETHEADER;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(oid, tbl);
-      ::encode(bl, tbl);
-      ops++;
+      _start_op(OP_OMAP_SETHEADER);
+      _add_cid(cid);
+      _add_oid(oid);
+      ::encode(bl, data_bl);
+      _finish_op();
     }
 
     /// Split collection based on given prefixes
@@ -678,74 +765,124 @@ public:
       uint32_t bits,
       uint32_t rem,
       coll_t destination) {
-      __u32 op = OP_SPLIT_COLLECTION2;
-      ::encode(op, tbl);
-      ::encode(cid, tbl);
-      ::encode(bits, tbl);
-      ::encode(rem, tbl);
-      ::encode(destination, tbl);
-      ++ops;
+      _start_op(OP_SPLIT_COLLECTION2);
+      _add_cid(cid);
+      _add_u32(bits);
+      _add_u32(rem);
+      _add_cid(destination);
+      _finish_op();
     }
 
     // etc.
     Transaction() :
       ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
-      sobject_encoding(false), pool_override(-1), use_pool_override(false),
-      replica(false),
-      tolerate_collection_add_enoent(false) {}
+      tolerate_collection_add_enoent(false),
+      use_pool_override(false), replica(false) {}
 
     Transaction(bufferlist::iterator &dp) :
       ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
-      sobject_encoding(false), pool_override(-1), use_pool_override(false),
-      replica(false),
-      tolerate_collection_add_enoent(false) {
+      tolerate_collection_add_enoent(false),
+      use_pool_override(false), replica(false) {
       decode(dp);
     }
 
     Transaction(bufferlist &nbl) :
       ops(0), pad_unused_bytes(0), largest_data_len(0), largest_data_off(0), largest_data_off_in_tbl(0),
-      sobject_encoding(false), pool_override(-1), use_pool_override(false),
-      replica(false),
-      tolerate_collection_add_enoent(false) {
+      tolerate_collection_add_enoent(false),
+      use_pool_override(false), replica(false) {
       bufferlist::iterator dp = nbl.begin();
       decode(dp); 
     }
 
-    void encode(bufferlist& bl) const {
-      ENCODE_START(7, 5, bl);
+    /// without CEPH_FEATURE_OS_COMPACT_TRANSACTION, in the old encoding
+    void encode(bufferlist& bl, uint64_t features = CEPH_FEATURES_ALL) const {
+      if (!(features & CEPH_FEATURE_OS_COMPACT_TRANSACTION)) {
+	bufferlist tbl;
+	uint32_t data_off_in_tbl = 0;
+	_encode_legacy(tbl, &data_off_in_tbl);
+	ENCODE_START(7, 5, bl);
+	::encode(ops, bl);
+	::encode(pad_unused_bytes, bl);
+	::encode(largest_data_len, bl);
+	::encode(largest_data_off, bl);
+	::encode(data_off_in_tbl, bl);
+	::encode(tbl, bl);
+	::encode(tolerate_collection_add_enoent, bl);
+	ENCODE_FINISH(bl);
+	return;
+      }
+      // data_bl goes where tbl used to, so get_data_offset() still holds
+      ENCODE_START(8, 8, bl);
       ::encode(ops, bl);
       ::encode(pad_unused_bytes, bl);
       ::encode(largest_data_len, bl);
       ::encode(largest_data_off, bl);
       ::encode(largest_data_off_in_tbl, bl);
-      ::encode(tbl, bl);
+      ::encode(data_bl, bl);
+      ::encode(op_bl, bl);
+      ::encode(colls, bl);
+      ::encode(objects, bl);
       ::encode(tolerate_collection_add_enoent, bl);
       ENCODE_FINISH(bl);
     }
     void decode(bufferlist::iterator &bl) {
-      DECODE_START_LEGACY_COMPAT_LEN(7, 5, 5, bl);
+      DECODE_START_LEGACY_COMPAT_LEN(8, 5, 5, bl);
       DECODE_OLDEST(2);
-      if (struct_v < 4)
-	sobject_encoding = true;
-      else
-	sobject_encoding = false;
-      ::decode(ops, bl);
-      ::decode(pad_unused_bytes, bl);
-      if (struct_v >= 3) {
+      if (struct_v >= 8) {
+	::decode(ops, bl);
+	::decode(pad_unused_bytes, bl);
 	::decode(largest_data_len, bl);
 	::decode(largest_data_off, bl);
 	::decode(largest_data_off_in_tbl, bl);
-      }
-      ::decode(tbl, bl);
-      if (struct_v < 6) {
-	use_pool_override = true;
-      }
-      if (struct_v >= 7) {
+	::decode(data_bl, bl);
+	::decode(op_bl, bl);
+	::decode(colls, bl);
+	::decode(objects, bl);
 	::decode(tolerate_collection_add_enoent, bl);
+      } else {
+	uint64_t legacy_ops;
+	bufferlist tbl;
+	::decode(legacy_ops, bl);
+	::decode(pad_unused_bytes, bl);
+	if (struct_v >= 3) {
+	  uint32_t unused;
+	  ::decode(unused, bl);
+	  ::decode(unused, bl);
+	  ::decode(unused, bl);
+	}
+	::decode(tbl, bl);
+	if (struct_v >= 7) {
+	  ::decode(tolerate_collection_add_enoent, bl);
+	}
+	use_pool_override = struct_v < 6;
+	_decode_legacy(tbl, struct_v < 4);
+	assert(ops == legacy_ops);
       }
       DECODE_FINISH(bl);
     }
 
+    /// give objects decoded without a pool (v5 and older) this one
+    void set_pool_override(int64_t pool) {
+      if (!use_pool_override)
+	return;
+      for (vector<ghobject_t>::iterator p = objects.begin();
+	   p != objects.end();
+	   ++p) {
+	if (!p->hobj.is_max() && p->hobj.pool == -1)
+	  p->hobj.pool = pool;
+      }
+      object_index.clear();
+    }
+    void set_replica() {
+      replica = true;
+    }
+    bool get_replica() { return replica; }
+
+  private:
+    bool use_pool_override;
+    bool replica;
+
+  public:
     void dump(ceph::Formatter *f);
     static void generate_test_instances(list<Transaction*>& o);
   };
@@ -936,6 +1073,21 @@ public:
     bufferlist& bl,
     bool allow_eio = false) = 0;
 
+  /**
+   * read data we don't expect to need again soon, e.g. for scrub
+   *
+   * The same as read(), but stores with a page cache may keep it out.
+   */
+  virtual int read_once(
+    coll_t cid,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len,
+    bufferlist& bl,
+    bool allow_eio = false) {
+    return read(cid, oid, offset, len, bl, allow_eio);
+  }
+
   virtual int fiemap(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len, bufferlist& bl) = 0;
 
   virtual int getattr(coll_t cid, const ghobject_t& oid, const char *name, bufferptr& value) = 0;
@@ -997,6 +1149,24 @@ public:
 				      int min, int max, snapid_t snap, 
 				      vector<ghobject_t> *ls, ghobject_t *next) = 0;
 
+  /**
+   * list objects as collection_list_partial does, along with the value
+   * of one xattr of each
+   *
+   * Cheaper than a getattr per object, where the store can do better.
+   *
+   * @param attr name of the xattr
+   * @param attrs [out] its value for each object in ls, in the same
+   *              order; empty where the object has no such xattr
+   * @return zero on success, or negative error
+   */
+  virtual int collection_list_partial_attr(coll_t c, ghobject_t start,
+					   int min, int max, snapid_t snap,
+					   const char *attr,
+					   vector<ghobject_t> *ls,
+					   vector<bufferptr> *attrs,
+					   ghobject_t *next);
+
   /**
    * list contents of a collection that fall in the range [start, end)
    *
@@ -1081,6 +1251,12 @@ public:
 
   virtual int dump_journal(ostream& out) { return -EOPNOTSUPP; }
 
+  /**
+   * Queue a background compaction of the metadata freed by removals
+   * applied so far, e.g. after removing a pg.  Best effort.
+   */
+  virtual void compact_removed() {}
+
   virtual int snapshot(const string& name) { return -EOPNOTSUPP; }
     
   virtual void set_fsid(uuid_d u) = 0;
@@ -0,0 +1,427 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#include "RocksDBStore.h"
+
+#include <set>
+#include <map>
+#include <string>
+#include "include/memory.h"
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+using std::string;
+#include "common/perf_counters.h"
+
+int RocksDBStore::init()
+{
+  // init defaults.  caller can override these if they want
+  // prior to calling open.
+  options.write_buffer_size = g_conf->rocksdb_write_buffer_size;
+  options.write_buffer_num = g_conf->rocksdb_write_buffer_num;
+  options.cache_size = g_conf->rocksdb_cache_size;
+  options.block_size = g_conf->rocksdb_block_size;
+  options.bloom_size = g_conf->rocksdb_bloom_size;
+  options.compression_enabled = g_conf->rocksdb_compression;
+  options.paranoid_checks = g_conf->rocksdb_paranoid;
+  options.max_open_files = g_conf->rocksdb_max_open_files;
+  options.background_compactions = g_conf->rocksdb_background_compactions;
+  options.background_flushes = g_conf->rocksdb_background_flushes;
+  options.wal_dir = g_conf->rocksdb_wal_dir;
+  options.max_total_wal_size = g_conf->rocksdb_max_total_wal_size;
+  options.disable_wal = g_conf->rocksdb_disable_wal;
+  options.log_file = g_conf->rocksdb_log;
+  return 0;
+}
+
+/// hands each merge to the MergeOperator registered for its prefix
+class RocksDBStore::MergeOperatorRouter :
+  public rocksdb::AssociativeMergeOperator {
+  RocksDBStore &store;
+  string name;
+public:
+  MergeOperatorRouter(RocksDBStore &s) : store(s) {
+    // named after every prefix and operator it routes
+    for (map<string, MergeOperatorRef>::iterator p = store.merge_ops.begin();
+	 p != store.merge_ops.end();
+	 ++p)
+      name += p->first + "=" + p->second->name() + ";";
+  }
+
+  const char *Name() const {
+    return name.c_str();
+  }
+
+  bool Merge(const rocksdb::Slice& key,
+	     const rocksdb::Slice* existing_value,
+	     const rocksdb::Slice& value,
+	     std::string* new_value,
+	     rocksdb::Logger* logger) const {
+    string prefix;
+    if (split_key(key, &prefix, 0) < 0)
+      return false;
+    MergeOperatorRef mop = store.get_merge_operator(prefix);
+    if (!mop)
+      return false;
+    if (existing_value)
+      mop->merge(existing_value->data(), existing_value->size(),
+		 value.data(), value.size(), new_value);
+    else
+      mop->merge_nonexistent(value.data(), value.size(), new_value);
+    return true;
+  }
+};
+
+int RocksDBStore::do_open(ostream &out, bool create_if_missing)
+{
+  rocksdb::Options ldoptions;
+
+  if (options.write_buffer_size)
+    ldoptions.write_buffer_size = options.write_buffer_size;
+  if (options.write_buffer_num)
+    ldoptions.max_write_buffer_number = options.write_buffer_num;
+  if (options.max_open_files)
+    ldoptions.max_open_files = options.max_open_files;
+
+  // compactions run on the env's low priority pool, flushes on the
+  // high priority one; size both to match
+  if (options.background_compactions)
+    ldoptions.max_background_compactions = options.background_compactions;
+  if (options.background_flushes)
+    ldoptions.max_background_flushes = options.background_flushes;
+  ldoptions.env->SetBackgroundThreads(ldoptions.max_background_compactions,
+				      rocksdb::Env::LOW);
+  ldoptions.env->SetBackgroundThreads(ldoptions.max_background_flushes,
+				      rocksdb::Env::HIGH);
+
+  rocksdb::BlockBasedTableOptions table_options;
+  if (options.cache_size)
+    table_options.block_cache = rocksdb::NewLRUCache(options.cache_size);
+  if (options.block_size)
+    table_options.block_size = options.block_size;
+  if (options.bloom_size)
+    table_options.filter_policy.reset(
+      rocksdb::NewBloomFilterPolicy(options.bloom_size));
+  ldoptions.table_factory.reset(
+    rocksdb::NewBlockBasedTableFactory(table_options));
+
+  if (options.compression_enabled)
+    ldoptions.compression = rocksdb::kSnappyCompression;
+  else
+    ldoptions.compression = rocksdb::kNoCompression;
+
+  if (options.wal_dir.length())
+    ldoptions.wal_dir = options.wal_dir;
+  if (options.max_total_wal_size)
+    ldoptions.max_total_wal_size = options.max_total_wal_size;
+
+  if (!merge_ops.empty())
+    ldoptions.merge_operator.reset(new MergeOperatorRouter(*this));
+
+  ldoptions.paranoid_checks = options.paranoid_checks;
+  ldoptions.create_if_missing = create_if_missing;
+
+  if (options.log_file.length()) {
+    rocksdb::Env *env = rocksdb::Env::Default();
+    env->NewLogger(options.log_file, &ldoptions.info_log);
+  }
+
+  rocksdb::DB *_db;
+  rocksdb::Status status = rocksdb::DB::Open(ldoptions, path, &_db);
+  if (!status.ok()) {
+    out << status.ToString() << std::endl;
+    return -EINVAL;
+  }
+  db.reset(_db);
+
+  if (g_conf->rocksdb_compact_on_mount) {
+    derr << "Compacting rocksdb store..." << dendl;
+    compact();
+    derr << "Finished compacting rocksdb store" << dendl;
+  }
+
+  PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
+  plb.add_u64_counter(l_rocksdb_gets, "rocksdb_get");
+  plb.add_u64_counter(l_rocksdb_txns, "rocksdb_transaction");
+  plb.add_u64_counter(l_rocksdb_compact, "rocksdb_compact");
+  plb.add_u64_counter(l_rocksdb_compact_range, "rocksdb_compact_range");
+  plb.add_u64_counter(l_rocksdb_compact_queue_merge, "rocksdb_compact_queue_merge");
+  plb.add_u64(l_rocksdb_compact_queue_len, "rocksdb_compact_queue_len");
+  logger = plb.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  return 0;
+}
+
+RocksDBStore::~RocksDBStore()
+{
+  close();
+  delete logger;
+
+  // Ensure db is destroyed before dependent block cache and filter policy
+  db.reset();
+}
+
+void RocksDBStore::close()
+{
+  // stop compaction thread
+  compact_queue_lock.Lock();
+  if (compact_thread.is_started()) {
+    compact_queue_stop = true;
+    compact_queue_cond.Signal();
+    compact_queue_lock.Unlock();
+    compact_thread.join();
+  } else {
+    compact_queue_lock.Unlock();
+  }
+
+  if (logger)
+    cct->get_perfcounters_collection()->remove(logger);
+}
+
+int RocksDBStore::submit_transaction(KeyValueDB::Transaction t)
+{
+  RocksDBTransactionImpl * _t =
+    static_cast<RocksDBTransactionImpl *>(t.get());
+  rocksdb::WriteOptions woptions;
+  woptions.disableWAL = options.disable_wal;
+  rocksdb::Status s = db->Write(woptions, &(_t->bat));
+  logger->inc(l_rocksdb_txns);
+  return s.ok() ? 0 : -1;
+}
+
+int RocksDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
+{
+  RocksDBTransactionImpl * _t =
+    static_cast<RocksDBTransactionImpl *>(t.get());
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  woptions.disableWAL = options.disable_wal;
+  rocksdb::Status s = db->Write(woptions, &(_t->bat));
+  logger->inc(l_rocksdb_txns);
+  return s.ok() ? 0 : -1;
+}
+
+void RocksDBStore::RocksDBTransactionImpl::set(
+  const string &prefix,
+  const string &k,
+  const bufferlist &to_set_bl)
+{
+  // WriteBatch copies keys and values, so they need not outlive it
+  bufferlist bl = to_set_bl;
+  string key = combine_strings(prefix, k);
+  bat.Put(rocksdb::Slice(key), rocksdb::Slice(bl.c_str(), bl.length()));
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
+					         const string &k)
+{
+  string key = combine_strings(prefix, k);
+  bat.Delete(rocksdb::Slice(key));
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
+{
+  KeyValueDB::Iterator it = db->get_iterator(prefix);
+  for (it->seek_to_first();
+       it->valid();
+       it->next()) {
+    string key = combine_strings(prefix, it->key());
+    bat.Delete(rocksdb::Slice(key));
+  }
+}
+
+void RocksDBStore::RocksDBTransactionImpl::merge(
+  const string &prefix,
+  const string &k,
+  const bufferlist &to_merge_bl)
+{
+  assert(db->get_merge_operator(prefix));
+  bufferlist bl = to_merge_bl;
+  string key = combine_strings(prefix, k);
+  bat.Merge(rocksdb::Slice(key), rocksdb::Slice(bl.c_str(), bl.length()));
+}
+
+int RocksDBStore::get(
+    const string &prefix,
+    const std::set<string> &keys,
+    std::map<string, bufferlist> *out)
+{
+  for (std::set<string>::const_iterator i = keys.begin();
+       i != keys.end();
+       ++i) {
+    string value;
+    rocksdb::Status s = db->Get(rocksdb::ReadOptions(),
+				rocksdb::Slice(combine_strings(prefix, *i)),
+				&value);
+    if (s.ok()) {
+      bufferlist bl;
+      bl.append(value);
+      out->insert(make_pair(*i, bl));
+    } else if (!s.IsNotFound()) {
+      lderr(cct) << __func__ << " " << s.ToString() << dendl;
+      return -EIO;
+    }
+  }
+  logger->inc(l_rocksdb_gets);
+  return 0;
+}
+
+string RocksDBStore::combine_strings(const string &prefix, const string &value)
+{
+  string out = prefix;
+  out.push_back(0);
+  out.append(value);
+  return out;
+}
+
+bufferlist RocksDBStore::to_bufferlist(rocksdb::Slice in)
+{
+  bufferlist bl;
+  bl.append(bufferptr(in.data(), in.size()));
+  return bl;
+}
+
+int RocksDBStore::split_key(rocksdb::Slice in, string *prefix, string *key)
+{
+  string in_prefix = in.ToString();
+  size_t prefix_len = in_prefix.find('\0');
+  if (prefix_len >= in_prefix.size())
+    return -EINVAL;
+
+  if (prefix)
+    *prefix = string(in_prefix, 0, prefix_len);
+  if (key)
+    *key= string(in_prefix, prefix_len + 1);
+  return 0;
+}
+
+void RocksDBStore::compact()
+{
+  logger->inc(l_rocksdb_compact);
+  db->CompactRange(NULL, NULL);
+}
+
+
+void RocksDBStore::compact_thread_entry()
+{
+  compact_queue_lock.Lock();
+  while (!compact_queue_stop) {
+    while (!compact_queue.empty()) {
+      pair<string,string> range = compact_queue.front();
+      compact_queue.pop_front();
+      logger->set(l_rocksdb_compact_queue_len, compact_queue.size());
+      compact_queue_lock.Unlock();
+      logger->inc(l_rocksdb_compact_range);
+      compact_range(range.first, range.second);
+      compact_queue_lock.Lock();
+      continue;
+    }
+    compact_queue_cond.Wait(compact_queue_lock);
+  }
+  compact_queue_lock.Unlock();
+}
+
+void RocksDBStore::compact_range_async(const string& start, const string& end)
+{
+  Mutex::Locker l(compact_queue_lock);
+
+  // try to merge adjacent ranges.  this is O(n), but the queue should
+  // be short.  note that we do not cover all overlap cases and merge
+  // opportunities here, but we capture the ones we currently need.
+  list< pair<string,string> >::iterator p = compact_queue.begin();
+  while (p != compact_queue.end()) {
+    if (p->first == start && p->second == end) {
+      // dup; no-op
+      return;
+    }
+    if (p->first <= end && p->first > start) {
+      // merge with existing range to the right
+      compact_queue.push_back(make_pair(start, p->second));
+      compact_queue.erase(p);
+      logger->inc(l_rocksdb_compact_queue_merge);
+      break;
+    }
+    if (p->second >= start && p->second < end) {
+      // merge with existing range to the left
+      compact_queue.push_back(make_pair(p->first, end));
+      compact_queue.erase(p);
+      logger->inc(l_rocksdb_compact_queue_merge);
+      break;
+    }
+    ++p;
+  }
+  if (p == compact_queue.end()) {
+    // no merge, new entry.
+    compact_queue.push_back(make_pair(start, end));
+    logger->set(l_rocksdb_compact_queue_len, compact_queue.size());
+  }
+  compact_queue_cond.Signal();
+  if (!compact_thread.is_started()) {
+    compact_thread.create();
+  }
+}
+
+uint64_t RocksDBStore::get_estimated_size(map<string,uint64_t> &extra)
+{
+  DIR *store_dir = opendir(path.c_str());
+  if (!store_dir) {
+    lderr(cct) << __func__ << " something happened opening the store: "
+	       << cpp_strerror(errno) << dendl;
+    return 0;
+  }
+
+  uint64_t total_size = 0;
+  uint64_t sst_size = 0;
+  uint64_t log_size = 0;
+  uint64_t misc_size = 0;
+
+  struct dirent *entry = NULL;
+  while ((entry = readdir(store_dir)) != NULL) {
+    string n(entry->d_name);
+
+    if (n == "." || n == "..")
+      continue;
+
+    string fpath = path + '/' + n;
+    struct stat s;
+    int err = stat(fpath.c_str(), &s);
+    if (err < 0)
+      err = -errno;
+    // we may race against rocksdb while reading files; this should only
+    // happen when those files are being updated, data is being shuffled
+    // and files get removed, in which case there's not much of a problem
+    // as we'll get to them next time around.
+    if (err == -ENOENT)
+      continue;
+    if (err < 0) {
+      lderr(cct) << __func__ << " error obtaining stats for " << fpath
+		 << ": " << cpp_strerror(err) << dendl;
+      goto err;
+    }
+
+    size_t pos = n.find_last_of('.');
+    if (pos == string::npos) {
+      misc_size += s.st_size;
+      continue;
+    }
+
+    string ext = n.substr(pos+1);
+    if (ext == "sst") {
+      sst_size += s.st_size;
+    } else if (ext == "log") {
+      log_size += s.st_size;
+    } else {
+      misc_size += s.st_size;
+    }
+  }
+
+  total_size = sst_size + log_size + misc_size;
+
+  extra["sst"] = sst_size;
+  extra["log"] = log_size;
+  extra["misc"] = misc_size;
+  extra["total"] = total_size;
+
+err:
+  closedir(store_dir);
+  return total_size;
+}
@@ -0,0 +1,347 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+#ifndef ROCKS_DB_STORE_H
+#define ROCKS_DB_STORE_H
+
+#include "include/types.h"
+#include "include/buffer.h"
+#include "KeyValueDB.h"
+#include <set>
+#include <map>
+#include <string>
+#include "include/memory.h"
+#include <boost/scoped_ptr.hpp>
+#include "rocksdb/db.h"
+#include "rocksdb/env.h"
+#include "rocksdb/write_batch.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/cache.h"
+#include "rocksdb/filter_policy.h"
+#include "rocksdb/table.h"
+#include "rocksdb/merge_operator.h"
+
+#include <errno.h>
+#include "common/errno.h"
+#include "common/dout.h"
+#include "include/assert.h"
+#include "common/Formatter.h"
+
+#include "common/ceph_context.h"
+
+class PerfCounters;
+
+enum {
+  l_rocksdb_first = 34400,
+  l_rocksdb_gets,
+  l_rocksdb_txns,
+  l_rocksdb_compact,
+  l_rocksdb_compact_range,
+  l_rocksdb_compact_queue_merge,
+  l_rocksdb_compact_queue_len,
+  l_rocksdb_last,
+};
+
+/**
+ * Uses RocksDB to implement the KeyValueDB interface
+ *
+ * The on-disk key layout is the same as LevelDBStore's.  Unlike
+ * LevelDB, RocksDB compacts and flushes on a pool of background
+ * threads and looks up point reads through the bloom filters, so get()
+ * uses DB::Get rather than seeking an iterator.  Merges are native:
+ * the operators registered with set_merge_operator() are installed as
+ * a single rocksdb merge operator that dispatches on the key prefix.
+ */
+class RocksDBStore : public KeyValueDB {
+  CephContext *cct;
+  PerfCounters *logger;
+  string path;
+  boost::scoped_ptr<rocksdb::DB> db;
+
+  int do_open(ostream &out, bool create_if_missing);
+  class MergeOperatorRouter;
+  friend class MergeOperatorRouter;
+
+  // manage async compactions
+  Mutex compact_queue_lock;
+  Cond compact_queue_cond;
+  list< pair<string,string> > compact_queue;
+  bool compact_queue_stop;
+  class CompactThread : public Thread {
+    RocksDBStore *db;
+  public:
+    CompactThread(RocksDBStore *d) : db(d) {}
+    void *entry() {
+      db->compact_thread_entry();
+      return NULL;
+    }
+    friend class RocksDBStore;
+  } compact_thread;
+
+  void compact_thread_entry();
+
+  void compact_range(const string& start, const string& end) {
+    rocksdb::Slice cstart(start);
+    rocksdb::Slice cend(end);
+    db->CompactRange(&cstart, &cend);
+  }
+  void compact_range_async(const string& start, const string& end);
+
+public:
+  /// compact the underlying rocksdb store
+  void compact();
+
+  /// compact rocksdb for all keys with a given prefix
+  void compact_prefix(const string& prefix) {
+    compact_range(prefix, past_prefix(prefix));
+  }
+  void compact_prefix_async(const string& prefix) {
+    compact_range_async(prefix, past_prefix(prefix));
+  }
+
+  void compact_range(const string& prefix, const string& start, const string& end) {
+    compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
+  }
+  void compact_range_async(const string& prefix, const string& start, const string& end) {
+    compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
+  }
+  void compact_prefix_range_async(const string& start_prefix,
+				  const string& end_prefix) {
+    compact_range_async(start_prefix, end_prefix);
+  }
+
+  /**
+   * options_t: Holds options which are minimally interpreted
+   * on initialization and then passed through to RocksDB.
+   * See rocksdb/options.h and rocksdb/table.h for more precise
+   * details on each.
+   *
+   * Set them after constructing the RocksDBStore, but before calling
+   * open() or create_and_open().
+   */
+  struct options_t {
+    uint64_t write_buffer_size; /// in-memory write buffer size
+    int write_buffer_num; /// write buffers filled before writes stall
+    int max_open_files; /// maximum number of files RocksDB can open at once
+    uint64_t cache_size; /// size of the block cache
+    uint64_t block_size; /// user data per block
+    int bloom_size; /// number of bits per entry to put in a bloom filter
+    bool compression_enabled; /// whether to use libsnappy compression or not
+    bool paranoid_checks;
+    int background_compactions; /// compaction threads
+    int background_flushes; /// memtable flush threads
+
+    string wal_dir; /// write-ahead log directory, empty for the db path
+    uint64_t max_total_wal_size; /// wal size that forces memtable flushes
+    bool disable_wal; /// skip the wal on writes
+
+    string log_file;
+
+    options_t() :
+      write_buffer_size(0), //< 0 means default
+      write_buffer_num(0), //< 0 means default
+      max_open_files(0), //< 0 means default
+      cache_size(0), //< 0 means default
+      block_size(0), //< 0 means default
+      bloom_size(0), //< 0 means no bloom filter (default)
+      compression_enabled(true), //< set to false for no compression
+      paranoid_checks(false), //< set to true if you want paranoid checks
+      background_compactions(0), //< 0 means default
+      background_flushes(0), //< 0 means default
+      max_total_wal_size(0), //< 0 means default
+      disable_wal(false)
+    {}
+  } options;
+
+  RocksDBStore(CephContext *c, const string &path) :
+    cct(c),
+    logger(NULL),
+    path(path),
+    compact_queue_lock("RocksDBStore::compact_thread_lock"),
+    compact_queue_stop(false),
+    compact_thread(this),
+    options()
+  {}
+
+  ~RocksDBStore();
+
+  int init();
+
+  /// Opens underlying db
+  int open(ostream &out) {
+    return do_open(out, false);
+  }
+  /// Creates underlying db if missing and opens it
+  int create_and_open(ostream &out) {
+    return do_open(out, true);
+  }
+
+  void close();
+
+  class RocksDBTransactionImpl : public KeyValueDB::TransactionImpl {
+  public:
+    rocksdb::WriteBatch bat;
+    RocksDBStore *db;
+
+    RocksDBTransactionImpl(RocksDBStore *db) : db(db) {}
+    void set(
+      const string &prefix,
+      const string &k,
+      const bufferlist &bl);
+    void rmkey(
+      const string &prefix,
+      const string &k);
+    void rmkeys_by_prefix(
+      const string &prefix
+      );
+    void merge(
+      const string &prefix,
+      const string &k,
+      const bufferlist &bl);
+  };
+
+  KeyValueDB::Transaction get_transaction() {
+    return ceph::shared_ptr< RocksDBTransactionImpl >(
+      new RocksDBTransactionImpl(this));
+  }
+
+  int submit_transaction(KeyValueDB::Transaction t);
+  int submit_transaction_sync(KeyValueDB::Transaction t);
+  int get(
+    const string &prefix,
+    const std::set<string> &key,
+    std::map<string, bufferlist> *out
+    );
+
+  class RocksDBWholeSpaceIteratorImpl :
+    public KeyValueDB::WholeSpaceIteratorImpl {
+  protected:
+    boost::scoped_ptr<rocksdb::Iterator> dbiter;
+  public:
+    RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
+      dbiter(iter) { }
+    virtual ~RocksDBWholeSpaceIteratorImpl() { }
+
+    int seek_to_first() {
+      dbiter->SeekToFirst();
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    int seek_to_first(const string &prefix) {
+      rocksdb::Slice slice_prefix(prefix);
+      dbiter->Seek(slice_prefix);
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    int seek_to_last() {
+      dbiter->SeekToLast();
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    int seek_to_last(const string &prefix) {
+      string limit = past_prefix(prefix);
+      rocksdb::Slice slice_limit(limit);
+      dbiter->Seek(slice_limit);
+
+      if (!dbiter->Valid()) {
+        dbiter->SeekToLast();
+      } else {
+        dbiter->Prev();
+      }
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    int upper_bound(const string &prefix, const string &after) {
+      lower_bound(prefix, after);
+      if (valid()) {
+	pair<string,string> key = raw_key();
+	if (key.first == prefix && key.second == after)
+	  next();
+      }
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    int lower_bound(const string &prefix, const string &to) {
+      string bound = combine_strings(prefix, to);
+      rocksdb::Slice slice_bound(bound);
+      dbiter->Seek(slice_bound);
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    bool valid() {
+      return dbiter->Valid();
+    }
+    int next() {
+      if (valid())
+	dbiter->Next();
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    int prev() {
+      if (valid())
+	dbiter->Prev();
+      return dbiter->status().ok() ? 0 : -1;
+    }
+    string key() {
+      string out_key;
+      split_key(dbiter->key(), 0, &out_key);
+      return out_key;
+    }
+    pair<string,string> raw_key() {
+      string prefix, key;
+      split_key(dbiter->key(), &prefix, &key);
+      return make_pair(prefix, key);
+    }
+    bufferlist value() {
+      return to_bufferlist(dbiter->value());
+    }
+    int status() {
+      return dbiter->status().ok() ? 0 : -1;
+    }
+  };
+
+  class RocksDBSnapshotIteratorImpl : public RocksDBWholeSpaceIteratorImpl {
+    rocksdb::DB *db;
+    const rocksdb::Snapshot *snapshot;
+  public:
+    RocksDBSnapshotIteratorImpl(rocksdb::DB *db, const rocksdb::Snapshot *s,
+				rocksdb::Iterator *iter) :
+      RocksDBWholeSpaceIteratorImpl(iter), db(db), snapshot(s) { }
+
+    ~RocksDBSnapshotIteratorImpl() {
+      assert(snapshot != NULL);
+      // release the iterator before the snapshot it reads from
+      dbiter.reset();
+      db->ReleaseSnapshot(snapshot);
+    }
+  };
+
+  /// Utility
+  static string combine_strings(const string &prefix, const string &value);
+  static int split_key(rocksdb::Slice in, string *prefix, string *key);
+  static bufferlist to_bufferlist(rocksdb::Slice in);
+  static string past_prefix(const string &prefix) {
+    string limit = prefix;
+    limit.push_back(1);
+    return limit;
+  }
+
+  virtual uint64_t get_estimated_size(map<string,uint64_t> &extra);
+
+protected:
+  WholeSpaceIterator _get_iterator() {
+    return ceph::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+      new RocksDBWholeSpaceIteratorImpl(
+	db->NewIterator(rocksdb::ReadOptions())
+      )
+    );
+  }
+
+  WholeSpaceIterator _get_snapshot_iterator() {
+    const rocksdb::Snapshot *snapshot;
+    rocksdb::ReadOptions options;
+
+    snapshot = db->GetSnapshot();
+    options.snapshot = snapshot;
+
+    return ceph::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
+      new RocksDBSnapshotIteratorImpl(db.get(), snapshot,
+	db->NewIterator(options))
+    );
+  }
+
+};
+
+#endif
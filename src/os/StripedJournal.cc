@@ -0,0 +1,213 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "StripedJournal.h"
+#include "FileJournal.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#define dout_subsys ceph_subsys_journal
+#undef dout_prefix
+#define dout_prefix *_dout << "striped journal "
+
+class StripedJournal::C_StripeCommit : public Context {
+  StripedJournal *journal;
+  uint64_t seq;
+public:
+  C_StripeCommit(StripedJournal *j, uint64_t s) : journal(j), seq(s) {}
+  void finish(int r) {
+    journal->_committed(seq);
+  }
+};
+
+StripedJournal::StripedJournal(uuid_d fsid, Finisher *fin, Cond *sync_cond,
+			       const list<string> &paths,
+			       bool dio, bool ai, bool faio)
+  : Journal(fsid, fin, sync_cond),
+    read_seq(0),
+    completions_lock("StripedJournal::completions_lock")
+{
+  assert(!paths.empty());
+  for (list<string>::const_iterator p = paths.begin(); p != paths.end(); ++p)
+    stripes.push_back(new FileJournal(fsid, fin, sync_cond, p->c_str(),
+				      dio, ai, faio));
+  stripe_base.resize(stripes.size(), 0);
+}
+
+StripedJournal::~StripedJournal()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    delete stripes[i];
+}
+
+int StripedJournal::check()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i) {
+    int r = stripes[i]->check();
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+int StripedJournal::create()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i) {
+    int r = stripes[i]->create();
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+/**
+ * Each stripe is a FileJournal that expects to find fs_op_seq + 1 as
+ * its next entry.  Open stripe i just before the first seq it owns
+ * instead; committed_thru values below that are then skipped for it.
+ */
+int StripedJournal::open(uint64_t fs_op_seq)
+{
+  dout(2) << "open " << stripes.size() << " stripes fs_op_seq " << fs_op_seq
+	  << dendl;
+  uint64_t n = stripes.size();
+  for (uint64_t i = 0; i < n; ++i) {
+    uint64_t first = fs_op_seq + 1;
+    first += (i + n - first % n) % n;
+    stripe_base[i] = first - 1;
+    stripes[i]->logger = logger;
+    stripes[i]->set_wait_on_full(wait_on_full);
+    int r = stripes[i]->open(stripe_base[i]);
+    if (r < 0) {
+      derr << "open stripe " << i << " failed: " << cpp_strerror(r) << dendl;
+      for (uint64_t j = 0; j < i; ++j)
+	stripes[j]->close();
+      return r;
+    }
+  }
+  read_seq = fs_op_seq + 1;
+  return 0;
+}
+
+void StripedJournal::close()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    stripes[i]->close();
+}
+
+void StripedJournal::flush()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    stripes[i]->flush();
+}
+
+void StripedJournal::throttle()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    stripes[i]->throttle();
+}
+
+int StripedJournal::dump(ostream& out)
+{
+  for (unsigned i = 0; i < stripes.size(); ++i) {
+    int r = stripes[i]->dump(out);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+bool StripedJournal::is_writeable()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    if (!stripes[i]->is_writeable())
+      return false;
+  return true;
+}
+
+void StripedJournal::make_writeable()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    stripes[i]->make_writeable();
+}
+
+void StripedJournal::submit_entry(uint64_t seq, bufferlist& e, int alignment,
+				  Context *oncommit, TrackedOpRef osd_op)
+{
+  dout(10) << "submit_entry seq " << seq << " to stripe "
+	   << seq % stripes.size() << dendl;
+  {
+    Mutex::Locker l(completions_lock);
+    completions[seq] = oncommit;
+  }
+  stripe_of(seq)->submit_entry(seq, e, alignment,
+			       new C_StripeCommit(this, seq), osd_op);
+}
+
+/// fire the oncommits of every leading seq that all stripes have journaled
+void StripedJournal::_committed(uint64_t seq)
+{
+  list<Context*> ls;
+  {
+    Mutex::Locker l(completions_lock);
+    completed.insert(seq);
+    while (!completions.empty() &&
+	   completed.count(completions.begin()->first)) {
+      dout(20) << "_committed seq " << completions.begin()->first << dendl;
+      completed.erase(completions.begin()->first);
+      if (completions.begin()->second)
+	ls.push_back(completions.begin()->second);
+      completions.erase(completions.begin());
+    }
+  }
+  // we are already running in the finisher, as FileJournal's own
+  // completions do
+  for (list<Context*>::iterator p = ls.begin(); p != ls.end(); ++p)
+    (*p)->complete(0);
+}
+
+void StripedJournal::commit_start(uint64_t seq)
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    stripes[i]->commit_start(seq);
+}
+
+void StripedJournal::committed_thru(uint64_t seq)
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    if (seq >= stripe_base[i])
+      stripes[i]->committed_thru(seq);
+}
+
+bool StripedJournal::read_entry(bufferlist &bl, uint64_t &seq)
+{
+  uint64_t s = read_seq;
+  if (!stripe_of(s)->read_entry(bl, s))
+    return false;
+  if (s != read_seq) {
+    derr << "read_entry expected seq " << read_seq << " on stripe "
+	 << read_seq % stripes.size() << " but found " << s
+	 << ", stopping replay" << dendl;
+    bl.clear();
+    return false;
+  }
+  seq = s;
+  read_seq++;
+  return true;
+}
+
+bool StripedJournal::should_commit_now()
+{
+  for (unsigned i = 0; i < stripes.size(); ++i)
+    if (stripes[i]->should_commit_now())
+      return true;
+  return false;
+}
@@ -0,0 +1,89 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_STRIPEDJOURNAL_H
+#define CEPH_STRIPEDJOURNAL_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Journal.h"
+#include "common/Mutex.h"
+
+class FileJournal;
+
+/**
+ * StripedJournal
+ *
+ * Spreads journal entries over several FileJournals, one per device.
+ * Entry seq goes to stripe seq % n, so each stripe holds every n-th
+ * entry and writes it with its own write thread and aio queue.
+ *
+ * The stripes complete entries independently.  Commit callbacks are
+ * held back and fired in seq order, so an entry is only reported as
+ * durable once every entry before it is durable too.  Replay reads the
+ * stripes in turn, seq by seq, and stops at the first entry missing
+ * from its stripe.
+ */
+class StripedJournal : public Journal {
+  std::vector<FileJournal*> stripes;
+  /// committed_thru below this is meaningless to stripe i, see open()
+  std::vector<uint64_t> stripe_base;
+  uint64_t read_seq;   ///< next seq to replay
+
+  Mutex completions_lock;
+  std::map<uint64_t, Context*> completions;  ///< seq -> oncommit
+  std::set<uint64_t> completed;              ///< journaled, not yet fired
+
+  FileJournal *stripe_of(uint64_t seq) {
+    return stripes[seq % stripes.size()];
+  }
+  void _committed(uint64_t seq);
+  class C_StripeCommit;
+
+public:
+  StripedJournal(uuid_d fsid, Finisher *fin, Cond *sync_cond,
+		 const std::list<std::string> &paths,
+		 bool dio=false, bool ai=true, bool faio=false);
+  ~StripedJournal();
+
+  unsigned get_num_stripes() const {
+    return stripes.size();
+  }
+
+  int check();
+  int create();
+  int open(uint64_t fs_op_seq);
+  void close();
+
+  void flush();
+  void throttle();
+
+  int dump(ostream& out);
+
+  bool is_writeable();
+  void make_writeable();
+  void submit_entry(uint64_t seq, bufferlist& e, int alignment,
+		    Context *oncommit,
+		    TrackedOpRef osd_op = TrackedOpRef());
+  void commit_start(uint64_t seq);
+  void committed_thru(uint64_t seq);
+
+  bool read_entry(bufferlist &bl, uint64_t &seq);
+
+  bool should_commit_now();
+};
+
+#endif
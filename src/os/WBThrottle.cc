@@ -8,6 +8,7 @@
 
 WBThrottle::WBThrottle(CephContext *cct) :
   cur_ios(0), cur_size(0),
+  writeback_interval(0),
   cct(cct),
   logger(NULL),
   stopping(true),
@@ -28,6 +29,7 @@ WBThrottle::WBThrottle(CephContext *cct) :
   b.add_u64(l_wbthrottle_ios_wb, "ios_wb");
   b.add_u64(l_wbthrottle_inodes_dirtied, "inodes_dirtied");
   b.add_u64(l_wbthrottle_inodes_wb, "inodes_wb");
+  b.add_u64_counter(l_wbthrottle_inodes_writeback, "inodes_writeback");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
   for (unsigned i = l_wbthrottle_first + 1; i != l_wbthrottle_last; ++i)
@@ -78,6 +80,7 @@ const char** WBThrottle::get_tracked_conf_keys() const
     "filestore_wbthrottle_xfs_ios_hard_limit",
     "filestore_wbthrottle_xfs_inodes_start_flusher",
     "filestore_wbthrottle_xfs_inodes_hard_limit",
+    "filestore_wbthrottle_writeback_interval",
     NULL
   };
   return KEYS;
@@ -115,6 +118,11 @@ void WBThrottle::set_from_conf()
   } else {
     assert(0 == "invalid value for fs");
   }
+  writeback_interval = cct->_conf->filestore_wbthrottle_writeback_interval;
+#ifndef HAVE_SYNC_FILE_RANGE
+  writeback_interval = 0;
+#endif
+  next_writeback = utime_t();
   cond.Signal();
 }
 
@@ -135,11 +143,20 @@ bool WBThrottle::get_next_should_flush(
 {
   assert(lock.is_locked());
   assert(next);
-  while (!stopping &&
-         cur_ios < io_limits.first &&
-         pending_wbs.size() < fd_limits.first &&
-         cur_size < size_limits.first)
-         cond.Wait(lock);
+  while (!stopping && !beyond_start_limits()) {
+    if (writeback_interval <= 0) {
+      cond.Wait(lock);
+      continue;
+    }
+    utime_t now = ceph_clock_now(cct);
+    if (now >= next_writeback) {
+      start_writeback();
+      next_writeback = ceph_clock_now(cct);
+      next_writeback += writeback_interval;
+      continue;
+    }
+    cond.WaitUntil(lock, next_writeback);
+  }
   if (stopping)
     return false;
   assert(!pending_wbs.empty());
@@ -152,6 +169,37 @@ bool WBThrottle::get_next_should_flush(
   return true;
 }
 
+/*
+ * Between commits, the objects we are tracking would otherwise sit
+ * dirty in the page cache until we hit a flusher limit or the commit's
+ * syncfs writes them all at once.  Kick them to disk in the background
+ * instead; they stay tracked until the commit, since only fdatasync or
+ * syncfs makes them durable, but by then there is little left to write.
+ */
+void WBThrottle::start_writeback()
+{
+  assert(lock.is_locked());
+  vector<FDRef> fds;
+  for (map<ghobject_t, pair<PendingWB, FDRef> >::iterator i =
+	 pending_wbs.begin();
+       i != pending_wbs.end();
+       ++i) {
+    if (i->second.first.writeback)
+      continue;
+    i->second.first.writeback = true;
+    fds.push_back(i->second.second);
+  }
+  if (fds.empty())
+    return;
+
+  lock.Unlock();
+#ifdef HAVE_SYNC_FILE_RANGE
+  for (vector<FDRef>::iterator p = fds.begin(); p != fds.end(); ++p)
+    ::sync_file_range(***p, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+  lock.Lock();
+  logger->inc(l_wbthrottle_inodes_writeback, fds.size());
+}
 
 void *WBThrottle::entry()
 {
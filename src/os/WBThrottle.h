@@ -35,6 +35,7 @@ enum {
   l_wbthrottle_ios_wb,
   l_wbthrottle_inodes_dirtied,
   l_wbthrottle_inodes_wb,
+  l_wbthrottle_inodes_writeback,
   l_wbthrottle_last
 };
 
@@ -62,18 +63,24 @@ class WBThrottle : Thread, public md_config_obs_t {
   uint64_t cur_ios;  /// Currently unflushed IOs
   uint64_t cur_size; /// Currently unflushed bytes
 
+  /// Start writeback of dirty objects this often (0: only when over limits)
+  double writeback_interval;
+  utime_t next_writeback;
+
   /**
    * PendingWB tracks the ios pending on an object.
    */
   class PendingWB {
   public:
     bool nocache;
+    bool writeback;  ///< writeback started since the last write
     uint64_t size;
     uint64_t ios;
-    PendingWB() : nocache(true), size(0), ios(0) {}
+    PendingWB() : nocache(true), writeback(false), size(0), ios(0) {}
     void add(bool _nocache, uint64_t _size, uint64_t _ios) {
       if (!_nocache)
 	nocache = false; // only nocache if all writes are nocache
+      writeback = false;
       size += _size;
       ios += _ios;
     }
@@ -116,6 +123,15 @@ class WBThrottle : Thread, public md_config_obs_t {
 
   map<ghobject_t, pair<PendingWB, FDRef> > pending_wbs;
 
+  bool beyond_start_limits() const {
+    return cur_ios >= io_limits.first ||
+      pending_wbs.size() >= fd_limits.first ||
+      cur_size >= size_limits.first;
+  }
+
+  /// start (but do not wait for) writeback of objects not yet started
+  void start_writeback();
+
   /// get next flush to perform
   bool get_next_should_flush(
     boost::tuple<ghobject_t, FDRef, PendingWB> *next ///< [out] next to flush
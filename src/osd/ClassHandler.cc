@@ -13,6 +13,7 @@
 #endif
 
 #include "common/config.h"
+#include "common/perf_counters.h"
 
 #define dout_subsys ceph_subsys_osd
 #undef dout_prefix
@@ -70,6 +71,7 @@ int ClassHandler::open_all_classes()
 void ClassHandler::shutdown()
 {
   for (map<string, ClassData>::iterator p = classes.begin(); p != classes.end(); ++p) {
+    p->second.destroy_perf_counters();
     dlclose(p->second.handle);
   }
   classes.clear();
@@ -157,6 +159,8 @@ int ClassHandler::_load_class(ClassData *cls)
   
   dout(10) << "_load_class " << cls->name << " success" << dendl;
   cls->status = ClassData::CLASS_OPEN;
+  if (cct->_conf->osd_class_perf_counters)
+    cls->create_perf_counters();
   return 0;
 }
 
@@ -245,9 +249,47 @@ void ClassHandler::ClassMethod::unregister()
   cls->unregister_method(this);
 }
 
+/*
+ * One time average per method, named after it, under cls_<class>: its
+ * avgcount is the number of calls.  Methods are all registered by the
+ * class's init, so we can size the logger once that is done.
+ */
+void ClassHandler::ClassData::create_perf_counters()
+{
+  if (logger || methods_map.empty())
+    return;
+  int first = 0, last = methods_map.size() + 1;
+  PerfCountersBuilder plb(handler->cct, string("cls_") + name, first, last);
+  int idx = first + 1;
+  for (map<string, ClassMethod>::iterator p = methods_map.begin();
+       p != methods_map.end();
+       ++p, ++idx) {
+    plb.add_time_avg(idx, p->second.name.c_str());
+    p->second.perf_index = idx;
+  }
+  logger = plb.create_perf_counters();
+  handler->cct->get_perfcounters_collection()->add(logger);
+}
+
+void ClassHandler::ClassData::destroy_perf_counters()
+{
+  if (!logger)
+    return;
+  handler->cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  logger = NULL;
+  for (map<string, ClassMethod>::iterator p = methods_map.begin();
+       p != methods_map.end();
+       ++p)
+    p->second.perf_index = 0;
+}
+
 int ClassHandler::ClassMethod::exec(cls_method_context_t ctx, bufferlist& indata, bufferlist& outdata)
 {
   int ret;
+  utime_t start;
+  if (perf_index)
+    start = ceph_clock_now(cls->handler->cct);
   if (cxx_func) {
     // C++ call version
     ret = cxx_func(ctx, &indata, &outdata);
@@ -262,6 +304,8 @@ int ClassHandler::ClassMethod::exec(cls_method_context_t ctx, bufferlist& indata
       outdata.push_back(bp);
     }
   }
+  if (perf_index)
+    cls->logger->tinc(perf_index, ceph_clock_now(cls->handler->cct) - start);
   return ret;
 }
 
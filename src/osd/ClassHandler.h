@@ -9,6 +9,8 @@
 #include "common/Mutex.h"
 #include "common/ceph_context.h"
 
+class PerfCounters;
+
 
 class ClassHandler
 {
@@ -23,6 +25,7 @@ public:
     int flags;
     cls_method_call_t func;
     cls_method_cxx_call_t cxx_func;
+    int perf_index;  ///< our counter in cls->logger, or 0 for none
 
     int exec(cls_method_context_t ctx, bufferlist& indata, bufferlist& outdata);
     void unregister();
@@ -32,7 +35,7 @@ public:
       return flags;
     }
 
-    ClassMethod() : cls(0), flags(0), func(0), cxx_func(0) {}
+    ClassMethod() : cls(0), flags(0), func(0), cxx_func(0), perf_index(0) {}
   };
 
   struct ClassData {
@@ -47,6 +50,7 @@ public:
     string name;
     ClassHandler *handler;
     void *handle;
+    PerfCounters *logger;  ///< call count and latency of each method
 
     map<string, ClassMethod> methods_map;
 
@@ -57,7 +61,8 @@ public:
 
     ClassData() : status(CLASS_UNKNOWN), 
 		  handler(NULL),
-		  handle(NULL) {}
+		  handle(NULL),
+		  logger(NULL) {}
     ~ClassData() { }
 
     ClassMethod *register_method(const char *mname, int flags, cls_method_call_t func);
@@ -69,6 +74,9 @@ public:
       return _get_method(mname);
     }
     int get_method_flags(const char *mname);
+
+    void create_perf_counters();
+    void destroy_perf_counters();
   };
 
 private:
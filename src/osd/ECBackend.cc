@@ -100,6 +100,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::ReadOp &rhs)
 	     << ", priority=" << rhs.priority
 	     << ", obj_to_source=" << rhs.obj_to_source
 	     << ", source_to_obj=" << rhs.source_to_obj
+	     << ", do_redundant_reads=" << rhs.do_redundant_reads
 	     << ", in_progress=" << rhs.in_progress << ")";
 }
 
@@ -114,6 +115,7 @@ void ECBackend::ReadOp::dump(Formatter *f) const
   f->dump_stream("priority") << priority;
   f->dump_stream("obj_to_source") << obj_to_source;
   f->dump_stream("source_to_obj") << source_to_obj;
+  f->dump_bool("do_redundant_reads", do_redundant_reads);
   f->dump_stream("in_progress") << in_progress;
 }
 
@@ -491,10 +493,12 @@ void ECBackend::continue_recovery_op(
       ObjectRecoveryProgress after_progress = op.recovery_progress;
       after_progress.data_recovered_to += get_recovery_chunk_size();
       after_progress.first = false;
-      if (after_progress.data_recovered_to >= op.obc->obs.oi.size) {
-	after_progress.data_recovered_to =
-	  sinfo.logical_to_next_stripe_offset(
-	    op.obc->obs.oi.size);
+      // the tail comes along with the hinfo attr, only the full
+      // stripes are in the chunks
+      uint64_t striped = sinfo.aligned_chunk_offset_to_logical_offset(
+	op.hinfo->get_total_chunk_size());
+      if (after_progress.data_recovered_to >= striped) {
+	after_progress.data_recovered_to = striped;
 	after_progress.data_complete = true;
       }
       for (set<pg_shard_t>::iterator mi = op.missing_on.begin();
@@ -714,7 +718,7 @@ struct SubWriteCommitted : public Context {
       version(version), last_complete(last_complete) {}
   void finish(int) {
     if (msg)
-      msg->mark_event("sub_op_committed");
+      msg->mark_event(TrackedOp::EVENT_SUB_OP_COMMITTED);
     pg->sub_write_committed(tid, version, last_complete);
   }
 };
@@ -756,7 +760,7 @@ struct SubWriteApplied : public Context {
     : pg(pg), msg(msg), tid(tid), version(version) {}
   void finish(int) {
     if (msg)
-      msg->mark_event("sub_op_applied");
+      msg->mark_event(TrackedOp::EVENT_SUB_OP_APPLIED);
     pg->sub_write_applied(tid, version);
   }
 };
@@ -907,6 +911,18 @@ void ECBackend::handle_sub_read_reply(
   dout(10) << __func__ << ": reply " << op << dendl;
   map<tid_t, ReadOp>::iterator iter = tid_to_read_map.find(op.tid);
   if (iter == tid_to_read_map.end()) {
+    map<tid_t, FastReadStragglers>::iterator siter =
+      fast_read_stragglers.find(op.tid);
+    if (siter != fast_read_stragglers.end() &&
+	siter->second.waiting.erase(from)) {
+      // a fast read completed without this reply
+      if (siter->second.waiting.empty()) {
+	get_parent()->get_logger()->tinc(
+	  l_osd_ec_fast_read_saved_lat,
+	  ceph_clock_now(cct) - siter->second.completed);
+	fast_read_stragglers.erase(siter);
+      }
+    }
     //canceled
     return;
   }
@@ -961,12 +977,50 @@ void ECBackend::handle_sub_read_reply(
 
   assert(rop.in_progress.count(from));
   rop.in_progress.erase(from);
-  if (!rop.in_progress.empty()) {
-    dout(10) << __func__ << " readop not complete: " << rop << dendl;
-  } else {
+  if (rop.in_progress.empty()) {
     dout(10) << __func__ << " readop complete: " << rop << dendl;
     complete_read_op(rop, m);
+  } else if (rop.do_redundant_reads && read_op_decodable(rop)) {
+    dout(10) << __func__ << " readop decodable, not waiting for "
+	     << rop.in_progress << ": " << rop << dendl;
+    get_parent()->get_logger()->inc(l_osd_ec_fast_read_early);
+    FastReadStragglers &stragglers = fast_read_stragglers[rop.tid];
+    stragglers.completed = ceph_clock_now(cct);
+    for (set<pg_shard_t>::iterator i = rop.in_progress.begin();
+	 i != rop.in_progress.end();
+	 ++i) {
+      shard_to_read_map[*i].erase(rop.tid);
+      stragglers.waiting.insert(*i);
+    }
+    rop.in_progress.clear();
+    complete_read_op(rop, m);
+  } else {
+    dout(10) << __func__ << " readop not complete: " << rop << dendl;
+  }
+}
+
+bool ECBackend::read_op_decodable(ReadOp &rop)
+{
+  set<int> want;
+  for (unsigned i = 0; i < ec_impl->get_data_chunk_count(); ++i)
+    want.insert(i);
+  for (map<hobject_t, set<pg_shard_t> >::iterator i =
+	 rop.obj_to_source.begin();
+       i != rop.obj_to_source.end();
+       ++i) {
+    const read_result_t &res = rop.complete[i->first];
+    set<int> have;
+    for (set<pg_shard_t>::iterator j = i->second.begin();
+	 j != i->second.end();
+	 ++j) {
+      if (!rop.in_progress.count(*j) && !res.errors.count(*j))
+	have.insert(j->shard);
+    }
+    set<int> min;
+    if (ec_impl->minimum_to_decode(want, have, &min) != 0)
+      return false;
   }
+  return true;
 }
 
 void ECBackend::complete_read_op(ReadOp &rop, RecoveryMessages *m)
@@ -1040,6 +1094,22 @@ void ECBackend::filter_read_op(
 void ECBackend::check_recovery_sources(const OSDMapRef osdmap)
 {
   set<tid_t> tids_to_filter;
+  for (map<tid_t, FastReadStragglers>::iterator i =
+	 fast_read_stragglers.begin();
+       i != fast_read_stragglers.end();
+       ) {
+    bool down = false;
+    for (set<pg_shard_t>::iterator j = i->second.waiting.begin();
+	 j != i->second.waiting.end();
+	 ++j) {
+      if (osdmap->is_down(j->osd))
+	down = true;
+    }
+    if (down)
+      fast_read_stragglers.erase(i++);
+    else
+      ++i;
+  }
   for (map<pg_shard_t, set<tid_t> >::iterator i = shard_to_read_map.begin();
        i != shard_to_read_map.end();
        ) {
@@ -1084,6 +1154,7 @@ void ECBackend::_on_change(ObjectStore::Transaction *t)
   }
   in_progress_client_reads.clear();
   shard_to_read_map.clear();
+  fast_read_stragglers.clear();
   clear_state();
 }
 
@@ -1215,7 +1286,8 @@ int ECBackend::get_min_avail_to_read_shards(
   const hobject_t &hoid,
   const set<int> &want,
   bool for_recovery,
-  set<pg_shard_t> *to_read)
+  set<pg_shard_t> *to_read,
+  int extra)
 {
   map<hobject_t, set<pg_shard_t> >::const_iterator miter =
     get_parent()->get_missing_loc_shards().find(hoid);
@@ -1272,14 +1344,33 @@ int ECBackend::get_min_avail_to_read_shards(
     }
   }
 
+  // the local shard costs no network round trip; a code with local
+  // parity also uses the costs to choose the smallest set to read
+  map<int, int> cost;
+  for (set<int>::iterator i = have.begin(); i != have.end(); ++i)
+    cost[*i] = shards[*i] == get_parent()->whoami_shard() ? 1 : 2;
+
   set<int> need;
-  int r = ec_impl->minimum_to_decode(want, have, &need);
+  int r = ec_impl->minimum_to_decode_with_cost(want, cost, &need);
   if (r < 0)
     return r;
 
   if (!to_read)
     return 0;
 
+  // add the cheapest of the shards we don't strictly need
+  for (int c = 1; c <= 2 && extra != 0; ++c) {
+    for (map<int, int>::iterator i = cost.begin();
+	 i != cost.end() && extra != 0;
+	 ++i) {
+      if (i->second == c && !need.count(i->first)) {
+	need.insert(i->first);
+	if (extra > 0)
+	  --extra;
+      }
+    }
+  }
+
   for (set<int>::iterator i = need.begin();
        i != need.end();
        ++i) {
@@ -1292,7 +1383,8 @@ int ECBackend::get_min_avail_to_read_shards(
 void ECBackend::start_read_op(
   int priority,
   map<hobject_t, read_request_t> &to_read,
-  OpRequestRef _op)
+  OpRequestRef _op,
+  bool do_redundant_reads)
 {
   tid_t tid = get_parent()->get_tid();
   assert(!tid_to_read_map.count(tid));
@@ -1301,6 +1393,7 @@ void ECBackend::start_read_op(
   op.tid = tid;
   op.to_read.swap(to_read);
   op.op = _op;
+  op.do_redundant_reads = do_redundant_reads;
   dout(10) << __func__ << ": starting " << op << dendl;
 
   map<pg_shard_t, ECSubRead> messages;
@@ -1378,9 +1471,10 @@ ECUtil::HashInfoRef ECBackend::get_hash_info(
       ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
       &st);
     ECUtil::HashInfo hinfo(ec_impl->get_chunk_count());
-    if (r >= 0 && st.st_size > 0) {
+    if (r >= 0) {
       dout(10) << __func__ << ": found on disk, size " << st.st_size << dendl;
       bufferlist bl;
+      // an object may hold all of its data in the tail of the attr
       r = store->getattr(
 	coll,
 	ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
@@ -1391,7 +1485,7 @@ ECUtil::HashInfoRef ECBackend::get_hash_info(
 	::decode(hinfo, bp);
 	assert(hinfo.get_total_chunk_size() == (unsigned)st.st_size);
       } else {
-	assert(0 == "missing hash attr");
+	assert(st.st_size == 0 || 0 == "missing hash attr");
       }
     }
     ref = unstable_hashinfo_registry.lookup_or_create(hoid, hinfo);
@@ -1504,12 +1598,17 @@ struct CallClientContexts :
   ECBackend::ClientAsyncReadStatus *status;
   list<pair<pair<uint64_t, uint64_t>,
 	    pair<bufferlist*, Context*> > > to_read;
+  uint64_t striped;
+  bufferlist tail;
   CallClientContexts(
     ECBackend *ec,
     ECBackend::ClientAsyncReadStatus *status,
     const list<pair<pair<uint64_t, uint64_t>,
-		    pair<bufferlist*, Context*> > > &to_read)
-    : ec(ec), status(status), to_read(to_read) {}
+		    pair<bufferlist*, Context*> > > &to_read,
+    uint64_t striped,
+    const bufferlist &tail)
+    : ec(ec), status(status), to_read(to_read),
+      striped(striped), tail(tail) {}
   void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) {
     ECBackend::read_result_t &res = in.second;
     assert(res.returned.size() == to_read.size());
@@ -1536,12 +1635,15 @@ struct CallClientContexts :
 	ec->ec_impl,
 	to_decode,
 	&bl);
+      if (tail.length() && adjusted.first + bl.length() == striped)
+	bl.append(tail);
       assert(i->second.second);
       assert(i->second.first);
+      uint64_t skip = MIN(i->first.first - adjusted.first, bl.length());
       i->second.first->substr_of(
 	bl,
-	i->first.first - adjusted.first,
-	MIN(i->first.second, bl.length() - (i->first.first - adjusted.first)));
+	skip,
+	MIN(i->first.second, bl.length() - skip));
       if (i->second.second) {
 	i->second.second->complete(i->second.first->length());
       }
@@ -1575,8 +1677,12 @@ void ECBackend::objects_read_async(
   Context *on_complete)
 {
   in_progress_client_reads.push_back(ClientAsyncReadStatus(on_complete));
+  ECUtil::HashInfoRef hinfo = get_hash_info(hoid);
   CallClientContexts *c = new CallClientContexts(
-    this, &(in_progress_client_reads.back()), to_read);
+    this, &(in_progress_client_reads.back()), to_read,
+    sinfo.aligned_chunk_offset_to_logical_offset(
+      hinfo->get_total_chunk_size()),
+    hinfo->get_tail());
   list<pair<uint64_t, uint64_t> > offsets;
   for (list<pair<pair<uint64_t, uint64_t>,
 		 pair<bufferlist*, Context*> > >::const_iterator i =
@@ -1591,13 +1697,18 @@ void ECBackend::objects_read_async(
   for (int i = 0; i < (int)ec_impl->get_data_chunk_count(); ++i) {
     want_to_read.insert(i);
   }
+  bool fast_read = fast_read_enabled();
   set<pg_shard_t> shards;
   int r = get_min_avail_to_read_shards(
     hoid,
     want_to_read,
     false,
-    &shards);
+    &shards,
+    fast_read ? cct->_conf->osd_ec_fast_read_extra_shards : 0);
   assert(r == 0);
+  fast_read = fast_read && shards.size() > ec_impl->get_data_chunk_count();
+  if (fast_read)
+    get_parent()->get_logger()->inc(l_osd_ec_fast_read);
 
   map<hobject_t, read_request_t> for_read_op;
   for_read_op.insert(
@@ -1613,10 +1724,18 @@ void ECBackend::objects_read_async(
   start_read_op(
     cct->_conf->osd_client_op_priority,
     for_read_op,
-    OpRequestRef());
+    OpRequestRef(),
+    fast_read);
   return;
 }
 
+bool ECBackend::fast_read_enabled() const
+{
+  const pg_pool_t *pool = get_osdmap()->get_pg_pool(
+    get_parent()->whoami_spg_t().pgid.pool());
+  return pool && (pool->get_flags() & pg_pool_t::FLAG_EC_FAST_READ);
+}
+
 
 int ECBackend::objects_get_attrs(
   const hobject_t &hoid,
@@ -1645,14 +1764,48 @@ void ECBackend::rollback_append(
   uint64_t old_size,
   ObjectStore::Transaction *t)
 {
-  assert(old_size % sinfo.get_stripe_width() == 0);
+  // the old tail is brought back with the old hinfo attr
   t->truncate(
     coll,
     ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-    sinfo.aligned_logical_offset_to_chunk_offset(
+    sinfo.logical_to_prev_chunk_offset(
       old_size));
 }
 
+bool ECBackend::can_rollback_write(
+  const hobject_t &hoid,
+  uint64_t off)
+{
+  ECUtil::HashInfoRef hinfo = get_hash_info(hoid);
+  uint64_t striped = sinfo.aligned_chunk_offset_to_logical_offset(
+    hinfo->get_total_chunk_size());
+  return off >= striped && off <= striped + hinfo->get_tail().length();
+}
+
+uint64_t ECBackend::be_get_ondisk_size(
+  uint64_t logical_size,
+  const map<string, bufferptr> &attrs)
+{
+  map<string, bufferptr>::const_iterator i =
+    attrs.find(ECUtil::get_hinfo_key());
+  if (i != attrs.end()) {
+    ECUtil::HashInfo hinfo;
+    bufferlist bl;
+    bl.push_back(i->second);
+    try {
+      bufferlist::iterator bp = bl.begin();
+      ::decode(hinfo, bp);
+    } catch (...) {
+      return sinfo.logical_to_next_chunk_offset(logical_size);
+    }
+    // objects written before the tail was kept have their last
+    // stripe padded
+    if (hinfo.get_tail().length())
+      return sinfo.logical_to_prev_chunk_offset(logical_size);
+  }
+  return sinfo.logical_to_next_chunk_offset(logical_size);
+}
+
 void ECBackend::be_deep_scrub(
   const hobject_t &poid,
   ScrubMap::object &o,
@@ -1666,13 +1819,7 @@ void ECBackend::be_deep_scrub(
   while (true) {
     bufferlist bl;
     handle.reset_tp_timeout();
-    r = store->read(
-      coll,
-      ghobject_t(
-	poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-      pos,
-      stride, bl,
-      true);
+    r = be_deep_scrub_read(poid, pos, stride, bl);
     if (r < 0)
       break;
     if (bl.length() % sinfo.get_chunk_size()) {
@@ -1707,8 +1854,9 @@ void ECBackend::be_deep_scrub(
    * our locally stored hash of shard 0 on the assumption that if
    * we match our chunk hash and our recollection of the hash for
    * chunk 0 matches that of our peers, there is likely no corruption.
+   * The tail is folded in since it is not in any chunk.
    */
-  o.digest = hinfo->get_chunk_hash(0);
+  o.digest = hinfo->get_tail().crc32c(hinfo->get_chunk_hash(0));
   o.digest_present = true;
 
   o.omap_digest = 0;
@@ -129,6 +129,13 @@ public:
    * still only perform a client read from shards in the acting set.  This
    * ensures that we won't ever have to restart a client initiated read in
    * check_recovery_sources.
+   *
+   * On pools with FLAG_EC_FAST_READ set, client reads are sent to more
+   * shards than are needed (@see osd_ec_fast_read_extra_shards) and the
+   * read completes as soon as the replies received so far can be
+   * decoded.  Replies from the remaining shards are dropped on arrival,
+   * after accounting the time they would have cost us in
+   * fast_read_stragglers.
    */
   friend struct CallClientContexts;
   struct ClientAsyncReadStatus {
@@ -144,6 +151,10 @@ public:
 		    pair<bufferlist*, Context*> > > &to_read,
     Context *on_complete);
 
+  bool can_rollback_write(
+    const hobject_t &hoid,
+    uint64_t off);
+
 private:
   friend struct ECRecoveryHandle;
   uint64_t get_recovery_chunk_size() const {
@@ -290,14 +301,21 @@ public:
     map<hobject_t, set<pg_shard_t> > obj_to_source;
     map<pg_shard_t, set<hobject_t> > source_to_obj;
 
+    /// true if more shards were asked than needed, @see fast read above
+    bool do_redundant_reads;
+
     void dump(Formatter *f) const;
 
     set<pg_shard_t> in_progress;
+
+    ReadOp() : priority(0), tid(0), do_redundant_reads(false) {}
   };
   friend struct FinishReadOp;
   void filter_read_op(
     const OSDMapRef osdmap,
     ReadOp &op);
+  /// true if every object in rop can be decoded from the replies so far
+  bool read_op_decodable(ReadOp &rop);
   void complete_read_op(ReadOp &rop, RecoveryMessages *m);
   friend ostream &operator<<(ostream &lhs, const ReadOp &rhs);
   map<tid_t, ReadOp> tid_to_read_map;
@@ -305,7 +323,16 @@ public:
   void start_read_op(
     int priority,
     map<hobject_t, read_request_t> &to_read,
-    OpRequestRef op);
+    OpRequestRef op,
+    bool do_redundant_reads = false);
+
+  /// shards still owing a reply to a completed fast read
+  struct FastReadStragglers {
+    utime_t completed;
+    set<pg_shard_t> waiting;
+  };
+  map<tid_t, FastReadStragglers> fast_read_stragglers;
+  bool fast_read_enabled() const;
 
 
   /**
@@ -450,7 +477,8 @@ public:
     const hobject_t &hoid,     ///< [in] object
     const set<int> &want,      ///< [in] desired shards
     bool for_recovery,         ///< [in] true if we may use non-acting replicas
-    set<pg_shard_t> *to_read   ///< [out] shards to read
+    set<pg_shard_t> *to_read,  ///< [out] shards to read
+    int extra = 0              ///< [in] extra shards to add, -1 for all
     ); ///< @return error code, 0 on success
 
   int objects_get_attrs(
@@ -468,9 +496,9 @@ public:
     const hobject_t &obj,
     ScrubMap::object &o,
     ThreadPool::TPHandle &handle);
-  uint64_t be_get_ondisk_size(uint64_t logical_size) {
-    return sinfo.logical_to_next_chunk_offset(logical_size);
-  }
+  uint64_t be_get_ondisk_size(
+    uint64_t logical_size,
+    const map<string, bufferptr> &attrs);
 };
 
 #endif
@@ -50,7 +50,7 @@ struct ECSubWrite {
       trim_to(trim_to), log_entries(log_entries),
       temp_removed(temp_removed),
       temp_added(temp_added) {}
-  void encode(bufferlist &bl) const;
+  void encode(bufferlist &bl, uint64_t features = CEPH_FEATURES_ALL) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<ECSubWrite*>& o);
@@ -114,45 +114,72 @@ struct TransGenerator : public boost::static_visitor<void> {
     }
   }
   void operator()(const ECTransaction::AppendOp &op) {
-    uint64_t offset = op.off;
-    bufferlist bl(op.bl);
-    assert(bl.length());
-    assert(offset % sinfo.get_stripe_width() == 0);
-    map<int, bufferlist> buffers;
-
+    assert(op.bl.length());
     assert(hash_infos.count(op.oid));
     ECUtil::HashInfoRef hinfo = hash_infos[op.oid];
 
-    // align
-    if (bl.length() % sinfo.get_stripe_width())
-      bl.append_zero(
-	sinfo.get_stripe_width() -
-	((offset + bl.length()) % sinfo.get_stripe_width()));
-    assert(bl.length() - op.bl.length() < sinfo.get_stripe_width());
-    int r = ECUtil::encode(
-      sinfo, ecimpl, bl, want, &buffers);
+    // the write starts within the unencoded tail, which is rewritten
+    // and encoded together with it up to the last full stripe, and
+    // what is left of the result becomes the new tail
+    uint64_t offset = sinfo.aligned_chunk_offset_to_logical_offset(
+      hinfo->get_total_chunk_size());
+    const bufferlist &tail = hinfo->get_tail();
+    assert(op.off >= offset);
+    assert(op.off <= offset + tail.length());
+    uint64_t prefix = op.off - offset;
+    bufferlist bl;
+    if (prefix)
+      bl.substr_of(tail, 0, prefix);
+    bl.append(op.bl);
+    if (prefix + op.bl.length() < tail.length()) {
+      bufferlist rest;
+      rest.substr_of(
+	tail,
+	prefix + op.bl.length(),
+	tail.length() - prefix - op.bl.length());
+      bl.claim_append(rest);
+    }
+
+    uint64_t to_encode = sinfo.logical_to_prev_stripe_offset(bl.length());
+    bufferlist new_tail;
+    if (to_encode < bl.length())
+      new_tail.substr_of(bl, to_encode, bl.length() - to_encode);
+    hinfo->set_tail(new_tail);
 
-    hinfo->append(
-      sinfo.aligned_logical_offset_to_chunk_offset(op.off),
-      buffers);
+    map<int, bufferlist> buffers;
+    if (to_encode) {
+      bufferlist encode_bl;
+      encode_bl.substr_of(bl, 0, to_encode);
+      int r = ECUtil::encode(
+	sinfo, ecimpl, encode_bl, want, &buffers);
+      assert(r == 0);
+      hinfo->append(
+	sinfo.aligned_logical_offset_to_chunk_offset(offset),
+	buffers);
+    }
     bufferlist hbuf;
     ::encode(
       *hinfo,
       hbuf);
 
-    assert(r == 0);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
-      assert(buffers.count(i->first));
-      bufferlist &enc_bl = buffers[i->first];
-      i->second.write(
-	get_coll_ct(i->first, op.oid),
-	ghobject_t(op.oid, ghobject_t::NO_GEN, i->first),
-	sinfo.logical_to_prev_chunk_offset(
-	  offset),
-	enc_bl.length(),
-	enc_bl);
+      if (to_encode) {
+	assert(buffers.count(i->first));
+	bufferlist &enc_bl = buffers[i->first];
+	i->second.write(
+	  get_coll_ct(i->first, op.oid),
+	  ghobject_t(op.oid, ghobject_t::NO_GEN, i->first),
+	  sinfo.aligned_logical_offset_to_chunk_offset(
+	    offset),
+	  enc_bl.length(),
+	  enc_bl);
+      } else {
+	i->second.touch(
+	  get_coll_ct(i->first, op.oid),
+	  ghobject_t(op.oid, ghobject_t::NO_GEN, i->first));
+      }
       i->second.setattr(
 	get_coll_ct(i->first, op.oid),
 	ghobject_t(op.oid, ghobject_t::NO_GEN, i->first),
@@ -113,19 +113,19 @@ int ECUtil::encode(
   if (logical_size == 0)
     return 0;
 
-  for (uint64_t i = 0; i < logical_size; i += sinfo.get_stripe_width()) {
-    map<int, bufferlist> encoded;
-    bufferlist buf;
-    buf.substr_of(in, i, sinfo.get_stripe_width());
-    int r = ec_impl->encode(want, buf, &encoded);
-    assert(r == 0);
-    for (map<int, bufferlist>::iterator i = encoded.begin();
-	 i != encoded.end();
-	 ++i) {
-      assert(i->second.length() == sinfo.get_chunk_size());
-      (*out)[i->first].claim_append(i->second);
-    }
-  }
+  // one contiguous buffer per shard for all the stripes
+  uint64_t chunks_size = sinfo.aligned_logical_offset_to_chunk_offset(
+    logical_size);
+  map<int, bufferptr> encoded;
+  for (set<int>::const_iterator i = want.begin(); i != want.end(); ++i)
+    encoded[*i] = buffer::create_page_aligned(chunks_size);
+  int r = ec_impl->encode_stripes(
+    want, sinfo.get_stripe_width(), in, &encoded);
+  assert(r == 0);
+  for (map<int, bufferptr>::iterator i = encoded.begin();
+       i != encoded.end();
+       ++i)
+    (*out)[i->first].push_back(i->second);
 
   for (map<int, bufferlist>::iterator i = out->begin();
        i != out->end();
@@ -140,17 +140,22 @@ int ECUtil::encode(
 
 void ECUtil::HashInfo::encode(bufferlist &bl) const
 {
-  ENCODE_START(1, 1, bl);
+  ENCODE_START(2, 1, bl);
   ::encode(total_chunk_size, bl);
   ::encode(cumulative_shard_hashes, bl);
+  ::encode(tail, bl);
   ENCODE_FINISH(bl);
 }
 
 void ECUtil::HashInfo::decode(bufferlist::iterator &bl)
 {
-  DECODE_START(1, bl);
+  DECODE_START(2, bl);
   ::decode(total_chunk_size, bl);
   ::decode(cumulative_shard_hashes, bl);
+  if (struct_v >= 2)
+    ::decode(tail, bl);
+  else
+    tail.clear();
   DECODE_FINISH(bl);
 }
 
@@ -165,6 +170,7 @@ void ECUtil::HashInfo::dump(Formatter *f) const
     f->close_section();
   }
   f->close_section();
+  f->dump_unsigned("tail_length", tail.length());
 }
 
 void ECUtil::HashInfo::generate_test_instances(list<HashInfo*>& o)
@@ -179,6 +185,9 @@ void ECUtil::HashInfo::generate_test_instances(list<HashInfo*>& o)
     buffers[2] = bl;
     o.back()->append(0, buffers);
     o.back()->append(20, buffers);
+    bufferlist tail;
+    tail.append("tail");
+    o.back()->set_tail(tail);
   }
   o.push_back(new HashInfo(4));
 }
@@ -107,6 +107,8 @@ int encode(
 class HashInfo {
   uint64_t total_chunk_size;
   vector<uint32_t> cumulative_shard_hashes;
+  // the bytes past the last full stripe, not yet encoded into chunks
+  bufferlist tail;
 public:
   HashInfo() : total_chunk_size(0) {}
   HashInfo(unsigned num_chunks)
@@ -131,6 +133,7 @@ public:
     cumulative_shard_hashes = vector<uint32_t>(
       cumulative_shard_hashes.size(),
       0);
+    tail.clear();
   }
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
@@ -143,6 +146,17 @@ public:
   uint64_t get_total_chunk_size() const {
     return total_chunk_size;
   }
+  /**
+   * The end of an object is kept here, replicated on every shard
+   * with the rest of the HashInfo, until there is enough of it to
+   * fill a stripe. It is always shorter than the stripe width.
+   */
+  const bufferlist &get_tail() const {
+    return tail;
+  }
+  void set_tail(const bufferlist &bl) {
+    tail = bl;
+  }
 };
 typedef std::tr1::shared_ptr<HashInfo> HashInfoRef;
 
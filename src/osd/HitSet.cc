@@ -13,6 +13,9 @@
  */
 
 #include "HitSet.h"
+extern "C" {
+#include "crush/hash.h"
+}
 
 // -- HitSet --
 
@@ -28,6 +31,14 @@ HitSet::HitSet(const HitSet::Params& params)
     }
     break;
 
+  case TYPE_DECAY_BLOOM:
+    impl.reset(new DecayBloomHitSet(static_cast<DecayBloomHitSet::Params*>(params.impl.get())));
+    break;
+
+  case TYPE_BLOCKED_BLOOM:
+    impl.reset(new BlockedBloomHitSet(static_cast<BlockedBloomHitSet::Params*>(params.impl.get())));
+    break;
+
   case TYPE_EXPLICIT_HASH:
     impl.reset(new ExplicitHashHitSet(static_cast<ExplicitHashHitSet::Params*>(params.impl.get())));
     break;
@@ -73,6 +84,12 @@ void HitSet::decode(bufferlist::iterator &bl)
   case TYPE_BLOOM:
     impl.reset(new BloomHitSet);
     break;
+  case TYPE_DECAY_BLOOM:
+    impl.reset(new DecayBloomHitSet);
+    break;
+  case TYPE_BLOCKED_BLOOM:
+    impl.reset(new BlockedBloomHitSet);
+    break;
   case TYPE_NONE:
     impl.reset(NULL);
     break;
@@ -107,6 +124,14 @@ void HitSet::generate_test_instances(list<HitSet*>& o)
   o.back()->insert(hobject_t());
   o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
   o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
+  o.push_back(new HitSet(new DecayBloomHitSet(10, .1, 1)));
+  o.back()->insert(hobject_t());
+  o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+  o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
+  o.push_back(new HitSet(new BlockedBloomHitSet(10, .1, 1)));
+  o.back()->insert(hobject_t());
+  o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+  o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
 }
 
 HitSet::Params::Params(const Params& o)
@@ -160,6 +185,12 @@ bool HitSet::Params::create_impl(impl_type_t type)
   case TYPE_BLOOM:
     impl.reset(new BloomHitSet::Params);
     break;
+  case TYPE_DECAY_BLOOM:
+    impl.reset(new DecayBloomHitSet::Params);
+    break;
+  case TYPE_BLOCKED_BLOOM:
+    impl.reset(new BlockedBloomHitSet::Params);
+    break;
   case TYPE_NONE:
     impl.reset(NULL);
     break;
@@ -205,6 +236,10 @@ void HitSet::Params::generate_test_instances(list<HitSet::Params*>& o)
   loop_hitset_params(ExplicitHashHitSet);
   o.push_back(new Params(new ExplicitObjectHitSet::Params));
   loop_hitset_params(ExplicitObjectHitSet);
+  o.push_back(new Params(new DecayBloomHitSet::Params));
+  loop_hitset_params(DecayBloomHitSet);
+  o.push_back(new Params(new BlockedBloomHitSet::Params));
+  loop_hitset_params(BlockedBloomHitSet);
 }
 
 ostream& operator<<(ostream& out, const HitSet::Params& p) {
@@ -216,3 +251,170 @@ ostream& operator<<(ostream& out, const HitSet::Params& p) {
   out << "}";
   return out;
 }
+
+
+// -- DecayBloomHitSet --
+
+DecayBloomHitSet::DecayBloomHitSet(unsigned inserts, double fpp, uint32_t s)
+  : num_hashes(1), seed(s), count(0)
+{
+  if (inserts < 1)
+    inserts = 1;
+  if (fpp <= 0.0 || fpp >= 1.0)
+    fpp = .01;
+  double m = ceil(-(double)inserts * log(fpp) / (M_LN2 * M_LN2));
+  counters.resize((size_t)m);
+  num_hashes = MAX(1, (unsigned)(M_LN2 * m / inserts + .5));
+}
+
+DecayBloomHitSet::DecayBloomHitSet(const DecayBloomHitSet::Params *p)
+{
+  *this = DecayBloomHitSet(p->target_size, p->get_fpp(), p->seed);
+}
+
+unsigned DecayBloomHitSet::get_pos(const hobject_t& o, unsigned i) const
+{
+  return crush_hash32_2(CRUSH_HASH_RJENKINS1, o.hash, seed + i) %
+    counters.size();
+}
+
+unsigned DecayBloomHitSet::get_min(const hobject_t& o) const
+{
+  if (counters.empty())
+    return 0;
+  unsigned ret = 255;
+  for (unsigned i = 0; i < num_hashes; ++i)
+    ret = MIN(ret, counters[get_pos(o, i)]);
+  return ret;
+}
+
+void DecayBloomHitSet::insert(const hobject_t& o)
+{
+  ++count;
+  if (counters.empty())
+    return;
+  // conservative update: only raise the counters to the new minimum,
+  // which keeps collisions from inflating each other
+  unsigned v = MIN(get_min(o) + STEP, 255);
+  for (unsigned i = 0; i < num_hashes; ++i) {
+    uint8_t& c = counters[get_pos(o, i)];
+    if (c < v)
+      c = v;
+  }
+}
+
+unsigned DecayBloomHitSet::approx_unique_insert_count() const
+{
+  double m = counters.size();
+  unsigned set = 0;
+  for (vector<uint8_t>::const_iterator p = counters.begin();
+       p != counters.end();
+       ++p)
+    if (*p)
+      ++set;
+  if (set >= m)
+    return count;
+  return -m / num_hashes * log(1.0 - (double)set / m);
+}
+
+int DecayBloomHitSet::get_age(const hobject_t& o) const
+{
+  unsigned c = get_min(o);
+  if (!c)
+    return -1;
+  int age = 0;
+  while ((STEP >> age) > c)
+    ++age;
+  return age;
+}
+
+void DecayBloomHitSet::decay()
+{
+  for (vector<uint8_t>::iterator p = counters.begin();
+       p != counters.end();
+       ++p)
+    *p >>= 1;
+  count = 0;
+}
+
+void DecayBloomHitSet::encode(bufferlist &bl) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(num_hashes, bl);
+  ::encode(seed, bl);
+  ::encode(count, bl);
+  uint32_t size = counters.size();
+  ::encode(size, bl);
+  uint32_t nonzero = 0;
+  for (unsigned i = 0; i < size; ++i)
+    if (counters[i])
+      ++nonzero;
+  // (gap, counter) pairs take 5 bytes
+  if (nonzero * 5 < size) {
+    ::encode((__u8)1, bl);
+    ::encode(nonzero, bl);
+    uint32_t last = 0;
+    for (unsigned i = 0; i < size; ++i) {
+      if (!counters[i])
+	continue;
+      ::encode(i - last, bl);
+      ::encode(counters[i], bl);
+      last = i + 1;
+    }
+  } else {
+    ::encode((__u8)0, bl);
+    if (size)
+      bl.append((const char *)&counters[0], size);
+  }
+  ENCODE_FINISH(bl);
+}
+
+void DecayBloomHitSet::decode(bufferlist::iterator &bl)
+{
+  DECODE_START(1, bl);
+  ::decode(num_hashes, bl);
+  ::decode(seed, bl);
+  ::decode(count, bl);
+  uint32_t size;
+  ::decode(size, bl);
+  counters.assign(size, 0);
+  __u8 sparse;
+  ::decode(sparse, bl);
+  if (sparse) {
+    uint32_t nonzero;
+    ::decode(nonzero, bl);
+    uint32_t pos = 0;
+    while (nonzero--) {
+      uint32_t gap;
+      ::decode(gap, bl);
+      pos += gap;
+      if (pos >= size)
+	throw buffer::malformed_input("DecayBloomHitSet counter out of range");
+      ::decode(counters[pos], bl);
+      ++pos;
+    }
+  } else if (size) {
+    bl.copy(size, (char *)&counters[0]);
+  }
+  DECODE_FINISH(bl);
+}
+
+void DecayBloomHitSet::dump(Formatter *f) const
+{
+  f->dump_unsigned("num_hashes", num_hashes);
+  f->dump_unsigned("seed", seed);
+  f->dump_unsigned("insert_count", count);
+  f->dump_unsigned("num_counters", counters.size());
+  f->dump_unsigned("approx_unique_insert_count", approx_unique_insert_count());
+}
+
+void DecayBloomHitSet::generate_test_instances(list<DecayBloomHitSet*>& o)
+{
+  o.push_back(new DecayBloomHitSet);
+  o.push_back(new DecayBloomHitSet(10, .1, 1));
+  o.back()->insert(hobject_t());
+  o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+  o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
+  o.push_back(new DecayBloomHitSet(1000, .01, 2));
+  o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+}
@@ -37,7 +37,9 @@ public:
     TYPE_NONE = 0,
     TYPE_EXPLICIT_HASH = 1,
     TYPE_EXPLICIT_OBJECT = 2,
-    TYPE_BLOOM = 3
+    TYPE_BLOOM = 3,
+    TYPE_DECAY_BLOOM = 4,
+    TYPE_BLOCKED_BLOOM = 5
   } impl_type_t;
 
   static const char *get_type_name(impl_type_t t) {
@@ -46,6 +48,8 @@ public:
     case TYPE_EXPLICIT_HASH: return "explicit_hash";
     case TYPE_EXPLICIT_OBJECT: return "explicit_object";
     case TYPE_BLOOM: return "bloom";
+    case TYPE_DECAY_BLOOM: return "decay_bloom";
+    case TYPE_BLOCKED_BLOOM: return "blocked_bloom";
     default: return "???";
     }
   }
@@ -61,6 +65,10 @@ public:
     virtual impl_type_t get_type() const = 0;
     virtual bool is_full() const = 0;
     virtual void insert(const hobject_t& o) = 0;
+    virtual void insert_many(const vector<hobject_t>& ls) {
+      for (vector<hobject_t>::const_iterator p = ls.begin(); p != ls.end(); ++p)
+	insert(*p);
+    }
     virtual bool contains(const hobject_t& o) const = 0;
     virtual unsigned insert_count() const = 0;
     virtual unsigned approx_unique_insert_count() const = 0;
@@ -69,6 +77,20 @@ public:
     virtual void dump(Formatter *f) const = 0;
     virtual Impl* clone() const = 0;
     virtual void seal() {}
+
+    /// true if the set carries decayed hits from earlier periods
+    virtual bool is_cumulative() const { return false; }
+    /// roughly how many times o has been hit lately
+    virtual unsigned get_temperature(const hobject_t& o) const {
+      return contains(o) ? 1 : 0;
+    }
+    /// roughly how many periods ago o was last hit (0: this one), or -1
+    virtual int get_age(const hobject_t& o) const {
+      return contains(o) ? 0 : -1;
+    }
+    /// start a new period, keeping what is left of the old ones
+    virtual void decay() {}
+
     virtual ~Impl() {}
   };
 
@@ -142,6 +164,10 @@ public:
   void insert(const hobject_t& o) {
     impl->insert(o);
   }
+  /// insert a batch of objects, which may be cheaper than one at a time
+  void insert_many(const vector<hobject_t>& ls) {
+    impl->insert_many(ls);
+  }
   /// query whether a hash is in the set
   bool contains(const hobject_t& o) const {
     return impl->contains(o);
@@ -159,6 +185,22 @@ public:
     impl->seal();
   }
 
+  bool is_cumulative() const {
+    return impl && impl->is_cumulative();
+  }
+  unsigned get_temperature(const hobject_t& o) const {
+    return impl->get_temperature(o);
+  }
+  int get_age(const hobject_t& o) const {
+    return impl->get_age(o);
+  }
+  /// reopen a (sealed) cumulative set for the next period
+  void decay() {
+    assert(is_cumulative());
+    sealed = false;
+    impl->decay();
+  }
+
   void encode(bufferlist &bl) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
@@ -474,4 +516,184 @@ public:
 };
 WRITE_CLASS_ENCODER(BloomHitSet)
 
+/**
+ * use a blocked_bloom_filter to track hits to the set
+ *
+ * Same answers as a BloomHitSet, but each insert or lookup costs one
+ * cache miss rather than one per hash function.  It can not be
+ * compressed when sealed.
+ */
+class BlockedBloomHitSet : public HitSet::Impl {
+  blocked_bloom_filter bloom;
+
+public:
+  HitSet::impl_type_t get_type() const {
+    return HitSet::TYPE_BLOCKED_BLOOM;
+  }
+
+  /// sized like a BloomHitSet: for target_size objects at fpp
+  class Params : public BloomHitSet::Params {
+  public:
+    virtual HitSet::impl_type_t get_type() const {
+      return HitSet::TYPE_BLOCKED_BLOOM;
+    }
+    virtual HitSet::Impl *get_new_impl() const {
+      return new BlockedBloomHitSet;
+    }
+
+    Params() {}
+    Params(double fpp, uint64_t t, uint64_t s)
+      : BloomHitSet::Params(fpp, t, s) {}
+
+    static void generate_test_instances(list<Params*>& o) {
+      o.push_back(new Params);
+      o.push_back(new Params(.1, 300, 99));
+    }
+  };
+
+  BlockedBloomHitSet() {}
+  BlockedBloomHitSet(unsigned inserts, double fpp, int seed)
+    : bloom(inserts, fpp, seed)
+  {}
+  BlockedBloomHitSet(const BlockedBloomHitSet::Params *p)
+    : bloom(p->target_size, p->get_fpp(), p->seed)
+  {}
+
+  HitSet::Impl *clone() const {
+    return new BlockedBloomHitSet(*this);
+  }
+
+  bool is_full() const {
+    return bloom.is_full();
+  }
+
+  void insert(const hobject_t& o) {
+    bloom.insert(o.hash);
+  }
+  void insert_many(const vector<hobject_t>& ls) {
+    vector<uint32_t> hashes;
+    hashes.reserve(ls.size());
+    for (vector<hobject_t>::const_iterator p = ls.begin(); p != ls.end(); ++p)
+      hashes.push_back(p->hash);
+    if (!hashes.empty())
+      bloom.insert_many(&hashes[0], hashes.size());
+  }
+  bool contains(const hobject_t& o) const {
+    return bloom.contains(o.hash);
+  }
+  unsigned insert_count() const {
+    return bloom.element_count();
+  }
+  unsigned approx_unique_insert_count() const {
+    return bloom.approx_unique_element_count();
+  }
+
+  void encode(bufferlist &bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(bloom, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) {
+    DECODE_START(1, bl);
+    ::decode(bloom, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const {
+    f->open_object_section("blocked_bloom_filter");
+    bloom.dump(f);
+    f->close_section();
+  }
+  static void generate_test_instances(list<BlockedBloomHitSet*>& o) {
+    o.push_back(new BlockedBloomHitSet);
+    o.push_back(new BlockedBloomHitSet(10, .1, 1));
+    o.back()->insert(hobject_t());
+    o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+    o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
+  }
+};
+WRITE_CLASS_ENCODER(BlockedBloomHitSet)
+
+/**
+ * count hits in a counting bloom filter whose counters are halved at
+ * the start of every period
+ *
+ * A single set then carries the recent history of the pg: how hot an
+ * object is, and roughly when it was last hit, so the agent needs no
+ * archived sets but the last.  Each insert adds STEP to the object's
+ * counters (saturating at 255, and only to those at the minimum), so an
+ * object hit once is forgotten after log2(STEP) + 1 periods.  Counters
+ * are mostly zero, and are encoded sparsely when that is smaller.
+ */
+class DecayBloomHitSet : public HitSet::Impl {
+  vector<uint8_t> counters;
+  uint32_t num_hashes;
+  uint32_t seed;
+  uint32_t count;     ///< inserts this period
+
+  unsigned get_pos(const hobject_t& o, unsigned i) const;
+  unsigned get_min(const hobject_t& o) const;
+
+public:
+  static const unsigned STEP = 32;
+
+  HitSet::impl_type_t get_type() const {
+    return HitSet::TYPE_DECAY_BLOOM;
+  }
+
+  /// sized like a BloomHitSet: for target_size objects at fpp
+  class Params : public BloomHitSet::Params {
+  public:
+    virtual HitSet::impl_type_t get_type() const {
+      return HitSet::TYPE_DECAY_BLOOM;
+    }
+    virtual HitSet::Impl *get_new_impl() const {
+      return new DecayBloomHitSet;
+    }
+
+    Params() {}
+    Params(double fpp, uint64_t t, uint64_t s)
+      : BloomHitSet::Params(fpp, t, s) {}
+
+    static void generate_test_instances(list<Params*>& o) {
+      o.push_back(new Params);
+      o.push_back(new Params(.1, 300, 99));
+    }
+  };
+
+  DecayBloomHitSet() : num_hashes(1), seed(0), count(0) {}
+  DecayBloomHitSet(unsigned inserts, double fpp, uint32_t seed);
+  DecayBloomHitSet(const DecayBloomHitSet::Params *p);
+
+  HitSet::Impl *clone() const {
+    return new DecayBloomHitSet(*this);
+  }
+
+  bool is_full() const {
+    return false;
+  }
+  void insert(const hobject_t& o);
+  bool contains(const hobject_t& o) const {
+    return get_min(o) > 0;
+  }
+  unsigned insert_count() const {
+    return count;
+  }
+  unsigned approx_unique_insert_count() const;
+
+  bool is_cumulative() const {
+    return true;
+  }
+  unsigned get_temperature(const hobject_t& o) const {
+    return (get_min(o) + STEP - 1) / STEP;
+  }
+  int get_age(const hobject_t& o) const;
+  void decay();
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &bl);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<DecayBloomHitSet*>& o);
+};
+WRITE_CLASS_ENCODER(DecayBloomHitSet)
+
 #endif
@@ -45,6 +45,8 @@
 
 #include "os/ObjectStore.h"
 
+#include "crush/hash.h"
+
 #include "ReplicatedPG.h"
 
 #include "Ager.h"
@@ -108,6 +110,7 @@
 #include "common/Timer.h"
 #include "common/LogClient.h"
 #include "common/HeartbeatMap.h"
+#include "common/numa.h"
 #include "common/admin_socket.h"
 
 #include "global/signal_handler.h"
@@ -132,6 +135,12 @@
 #include "include/assert.h"
 #include "common/config.h"
 
+#ifdef WITH_LTTNG
+#include "tracing/osd.h"
+#else
+#define tracepoint(...)
+#endif
+
 #define dout_subsys ceph_subsys_osd
 #undef dout_prefix
 #define dout_prefix _prefix(_dout, whoami, get_osdmap())
@@ -195,11 +204,12 @@ OSDService::OSDService(OSD *osd) :
   pre_publish_lock("OSDService::pre_publish_lock"),
   sched_scrub_lock("OSDService::sched_scrub_lock"), scrubs_pending(0),
   scrubs_active(0),
+  snap_trim_lock("OSDService::snap_trim_lock"),
+  snap_trims_active(0),
   agent_lock("OSD::agent_lock"),
   agent_valid_iterator(false),
   agent_ops(0),
   agent_active(true),
-  agent_thread(this),
   agent_stop_flag(false),
   objecter_lock("OSD::objecter_lock"),
   objecter_timer(osd->client_messenger->cct, objecter_lock),
@@ -207,8 +217,10 @@ OSDService::OSDService(OSD *osd) :
 			objecter_lock, objecter_timer, 0, 0)),
   objecter_finisher(osd->client_messenger->cct),
   objecter_dispatcher(this),
+  oi_cache(cct->_conf->osd_object_info_cache_bytes),
   watch_lock("OSD::watch_lock"),
   watch_timer(osd->client_messenger->cct, watch_lock),
+  watch_finisher(osd->client_messenger->cct),
   next_notif_id(0),
   backfill_request_lock("OSD::backfill_request_lock"),
   backfill_request_timer(cct, backfill_request_lock, false),
@@ -422,6 +434,7 @@ void OSDService::shutdown()
     Mutex::Locker l(watch_lock);
     watch_timer.shutdown();
   }
+  watch_finisher.stop();
 
   {
     Mutex::Locker l(objecter_lock);
@@ -435,6 +448,10 @@ void OSDService::shutdown()
     Mutex::Locker l(backfill_request_lock);
     backfill_request_timer.shutdown();
   }
+  {
+    Mutex::Locker l(snap_trim_lock);
+    snap_trim_waiters.clear();
+  }
   osdmap = OSDMapRef();
   next_osdmap = OSDMapRef();
 }
@@ -451,8 +468,13 @@ void OSDService::init()
     objecter->init_locked();
   }
   watch_timer.init();
+  watch_finisher.start();
 
-  agent_thread.create();
+  for (int i = 0; i < MAX(1, g_conf->osd_agent_threads); ++i) {
+    AgentThread *t = new AgentThread(this);
+    t->create();
+    agent_threads.push_back(t);
+  }
 }
 
 void OSDService::activate_map()
@@ -478,30 +500,49 @@ void OSDService::agent_entry()
   while (!agent_stop_flag) {
     uint64_t level = agent_queue.rbegin()->first;
     set<PGRef>& top = agent_queue.rbegin()->second;
+    int max_ops = _agent_max_ops(level);
     dout(10) << __func__
 	     << " tiers " << agent_queue.size()
 	     << ", top is " << level
 	     << " with pgs " << top.size()
-	     << ", ops " << agent_ops << "/"
-	     << g_conf->osd_agent_max_ops
+	     << " (" << agent_busy_pgs.size() << " busy)"
+	     << ", ops " << agent_ops << "/" << max_ops
 	     << (agent_active ? " active" : " NOT ACTIVE")
 	     << dendl;
     dout(20) << __func__ << " oids " << agent_oids << dendl;
-    if (agent_ops >= g_conf->osd_agent_max_ops || top.empty() ||
+    if (agent_ops >= max_ops || top.empty() ||
 	!agent_active) {
       agent_cond.Wait(agent_lock);
       continue;
     }
 
+    // round robin over the top tier, skipping pgs other agent threads
+    // are already working on
     if (!agent_valid_iterator || agent_queue_pos == top.end()) {
       agent_queue_pos = top.begin();
       agent_valid_iterator = true;
     }
-    PGRef pg = *agent_queue_pos;
-    int max = g_conf->osd_agent_max_ops - agent_ops;
+    PGRef pg;
+    for (unsigned i = 0; i < top.size(); ++i) {
+      if (agent_queue_pos == top.end())
+	agent_queue_pos = top.begin();
+      PGRef p = *agent_queue_pos++;
+      if (!agent_busy_pgs.count(p)) {
+	pg = p;
+	break;
+      }
+    }
+    if (!pg) {
+      agent_cond.Wait(agent_lock);
+      continue;
+    }
+    agent_busy_pgs.insert(pg);
+    int max = max_ops - agent_ops;
     agent_lock.Unlock();
     pg->agent_work(max);
     agent_lock.Lock();
+    agent_busy_pgs.erase(pg);
+    agent_cond.Signal();
   }
   agent_lock.Unlock();
   dout(10) << __func__ << " finish" << dendl;
@@ -514,7 +555,13 @@ void OSDService::agent_stop()
     agent_stop_flag = true;
     agent_cond.Signal();
   }
-  agent_thread.join();
+  for (vector<AgentThread*>::iterator p = agent_threads.begin();
+       p != agent_threads.end();
+       ++p) {
+    (*p)->join();
+    delete *p;
+  }
+  agent_threads.clear();
 
   agent_queue.clear();
 }
@@ -882,6 +929,8 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   osd_compat(get_osd_compat_set()),
   state(STATE_INITIALIZING), boot_epoch(0), up_epoch(0), bind_epoch(0),
   op_tp(cct, "OSD::op_tp", cct->_conf->osd_op_threads, "osd_op_threads"),
+  osd_op_tp(cct, "OSD::osd_op_tp",
+    cct->_conf->osd_op_num_threads_per_shard * cct->_conf->osd_op_num_shards),
   recovery_tp(cct, "OSD::recovery_tp", cct->_conf->osd_recovery_threads, "osd_recovery_threads"),
   disk_tp(cct, "OSD::disk_tp", cct->_conf->osd_disk_threads, "osd_disk_threads"),
   command_tp(cct, "OSD::command_tp", 1),
@@ -895,10 +944,14 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   heartbeat_dispatcher(this),
   stat_lock("OSD::stat_lock"),
   finished_lock("OSD::finished_lock"),
-  op_tracker(cct, cct->_conf->osd_enable_op_tracker),
+  op_tracker(cct, cct->_conf->osd_enable_op_tracker,
+             cct->_conf->osd_num_op_tracker_shard),
   test_ops_hook(NULL),
-  op_wq(this, cct->_conf->osd_op_thread_timeout, &op_tp),
+  op_wq(cct->_conf->osd_op_num_shards, this,
+    cct->_conf->osd_op_thread_timeout, cct->_conf->osd_op_thread_timeout * 10,
+    &osd_op_tp),
   peering_wq(this, cct->_conf->osd_op_thread_timeout, &op_tp),
+  peering_msg_lock("OSD::peering_msg_lock"),
   map_lock("OSD::map_lock"),
   peer_map_epoch_lock("OSD::peer_map_epoch_lock"),
   debug_drop_pg_create_probability(cct->_conf->osd_debug_drop_pg_create_probability),
@@ -927,6 +980,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
                                          cct->_conf->osd_op_log_threshold);
   op_tracker.set_history_size_and_duration(cct->_conf->osd_op_history_size,
                                            cct->_conf->osd_op_history_duration);
+  op_tracker.set_sample_every(cct->_conf->osd_op_tracker_sample);
 }
 
 OSD::~OSD()
@@ -936,6 +990,8 @@ OSD::~OSD()
   delete class_handler;
   cct->get_perfcounters_collection()->remove(recoverystate_perf);
   cct->get_perfcounters_collection()->remove(logger);
+  service.local_reserver.set_perf_counters(NULL, 0, 0);
+  service.remote_reserver.set_perf_counters(NULL, 0, 0);
   delete recoverystate_perf;
   delete logger;
   delete store;
@@ -1093,11 +1149,13 @@ int OSD::init()
 	  << (journal_path.empty() ? "(no journal)" : journal_path) << dendl;
   assert(store);  // call pre_init() first!
 
+  boot_start = ceph_clock_now(cct);
   int r = store->mount();
   if (r < 0) {
     derr << "OSD:init: unable to mount object store" << dendl;
     return r;
   }
+  boot_mount_lat = ceph_clock_now(cct) - boot_start;
 
   dout(2) << "boot" << dendl;
 
@@ -1193,11 +1251,18 @@ int OSD::init()
   bind_epoch = osdmap->get_epoch();
 
   // load up pgs (as they previously existed)
-  load_pgs();
+  {
+    utime_t start = ceph_clock_now(cct);
+    load_pgs();
+    boot_load_pgs_lat = ceph_clock_now(cct) - start;
+  }
 
   dout(2) << "superblock: i am osd." << superblock.whoami << dendl;
 
   create_logger();
+  logger->tset(l_osd_boot_mount_lat, boot_mount_lat);
+  logger->tset(l_osd_boot_read_pgs_lat, boot_read_pgs_lat);
+  logger->tset(l_osd_boot_load_pgs_lat, boot_load_pgs_lat);
     
   // i'm ready!
   client_messenger->add_dispatcher_head(this);
@@ -1217,7 +1282,20 @@ int OSD::init()
   // tell monc about log_client so it will know about mon session resets
   monc->set_log_client(&clog);
 
+  if (!cct->_conf->osd_op_thread_cpus.empty()) {
+    set<int> cpus;
+    r = parse_cpu_list(cct->_conf->osd_op_thread_cpus, &cpus);
+    if (r < 0) {
+      derr << "bad osd_op_thread_cpus '" << cct->_conf->osd_op_thread_cpus
+	   << "'" << dendl;
+      goto out;
+    }
+    op_tp.set_affinity(cpus);
+    osd_op_tp.set_affinity(cpus);
+  }
+
   op_tp.start();
+  osd_op_tp.start();
   recovery_tp.start();
   disk_tp.start();
   command_tp.start();
@@ -1365,6 +1443,14 @@ void OSD::final_init()
   assert(r == 0);
 }
 
+// latency in usec from 100us to ~13s, size in bytes from 512 to 64MB
+static const PerfHistogram::axis_config_d op_hist_lat_axis = {
+  "latency_usec", PerfHistogram::SCALE_LOG2, 0, 100, 20
+};
+static const PerfHistogram::axis_config_d op_hist_bytes_axis = {
+  "size_bytes", PerfHistogram::SCALE_LOG2, 0, 512, 20
+};
+
 void OSD::create_logger()
 {
   dout(10) << "create_logger" << dendl;
@@ -1384,11 +1470,15 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_op_r_outb, "op_r_out_bytes");   // client read out bytes
   osd_plb.add_time_avg(l_osd_op_r_lat,  "op_r_latency");    // client read latency
   osd_plb.add_time_avg(l_osd_op_r_process_lat, "op_r_process_latency");   // client read process latency
+  osd_plb.add_histogram(l_osd_op_r_lat_outb_hist, "op_r_latency_out_bytes_histogram",
+			op_hist_lat_axis, op_hist_bytes_axis);  // client read latency by size
   osd_plb.add_u64_counter(l_osd_op_w,      "op_w");        // client writes
   osd_plb.add_u64_counter(l_osd_op_w_inb,  "op_w_in_bytes");    // client write in bytes
   osd_plb.add_time_avg(l_osd_op_w_rlat, "op_w_rlat");   // client write readable/applied latency
   osd_plb.add_time_avg(l_osd_op_w_lat,  "op_w_latency");    // client write latency
   osd_plb.add_time_avg(l_osd_op_w_process_lat, "op_w_process_latency");   // client write process latency
+  osd_plb.add_histogram(l_osd_op_w_lat_inb_hist, "op_w_latency_in_bytes_histogram",
+			op_hist_lat_axis, op_hist_bytes_axis);  // client write latency by size
   osd_plb.add_u64_counter(l_osd_op_rw,     "op_rw");       // client rmw
   osd_plb.add_u64_counter(l_osd_op_rw_inb, "op_rw_in_bytes");   // client rmw in bytes
   osd_plb.add_u64_counter(l_osd_op_rw_outb,"op_rw_out_bytes");  // client rmw out bytes
@@ -1448,14 +1538,49 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_tier_whiteout, "tier_whiteout");
   osd_plb.add_u64_counter(l_osd_tier_dirty, "tier_dirty");
   osd_plb.add_u64_counter(l_osd_tier_clean, "tier_clean");
+  osd_plb.add_u64_counter(l_osd_tier_proxy_read, "tier_proxy_read");
 
   osd_plb.add_u64_counter(l_osd_agent_wake, "agent_wake");
   osd_plb.add_u64_counter(l_osd_agent_skip, "agent_skip");
   osd_plb.add_u64_counter(l_osd_agent_flush, "agent_flush");
   osd_plb.add_u64_counter(l_osd_agent_evict, "agent_evict");
+  osd_plb.add_u64_counter(l_osd_agent_flush_bytes, "agent_flush_bytes");
+  osd_plb.add_u64_counter(l_osd_agent_evict_bytes, "agent_evict_bytes");
+  osd_plb.add_u64_counter(l_osd_agent_skip_hot, "agent_skip_hot");
+
+  osd_plb.add_u64_counter(l_osd_snap_trim, "snap_trim");  // clones trimmed
+  osd_plb.add_u64_counter(l_osd_snap_trim_bytes, "snap_trim_bytes");
+  osd_plb.add_u64_counter(l_osd_snap_trim_wait, "snap_trim_wait");  // pgs held back by osd_max_trimming_pgs
+
+  osd_plb.add_u64_counter(l_osd_ec_fast_read, "ec_fast_read");  // ec reads sent to extra shards
+  osd_plb.add_u64_counter(l_osd_ec_fast_read_early, "ec_fast_read_early");  // ... completed before every shard replied
+  osd_plb.add_time_avg(l_osd_ec_fast_read_saved_lat, "ec_fast_read_saved_latency");  // completion to last straggler reply
+
+  osd_plb.add_u64_counter(l_osd_obc_cache_hit, "object_ctx_cache_hit");
+  osd_plb.add_u64_counter(l_osd_obc_cache_miss, "object_ctx_cache_miss");
+  osd_plb.add_u64_counter(l_osd_obc_cache_evict, "object_ctx_cache_evict");
+  osd_plb.add_u64_counter(l_osd_oi_cache_hit, "object_info_cache_hit");
+  osd_plb.add_u64_counter(l_osd_oi_cache_miss, "object_info_cache_miss");
+  osd_plb.add_u64(l_osd_oi_cache_bytes, "object_info_cache_bytes");
+
+  osd_plb.add_time(l_osd_boot_mount_lat, "boot_mount_latency");  // mounting the store
+  osd_plb.add_time(l_osd_boot_read_pgs_lat, "boot_read_pgs_latency");  // reading pg infos and logs
+  osd_plb.add_time(l_osd_boot_load_pgs_lat, "boot_load_pgs_latency");  // all of load_pgs, past intervals included
+  osd_plb.add_time(l_osd_boot_active_lat, "boot_active_latency");  // from mount until marked up and active
+
+  osd_plb.add_u64_counter(l_osd_local_reserver_preempt, "local_reserver_preempt");  // backfills we lead that were paused for higher priority work
+  osd_plb.add_time_avg(l_osd_local_reserver_wait, "local_reserver_wait");  // wait for a local backfill/recovery slot
+  osd_plb.add_u64_counter(l_osd_remote_reserver_preempt, "remote_reserver_preempt");  // backfills into us that were paused for higher priority work
+  osd_plb.add_time_avg(l_osd_remote_reserver_wait, "remote_reserver_wait");  // wait for a remote backfill/recovery slot
 
   logger = osd_plb.create_perf_counters();
+  service.local_reserver.set_perf_counters(
+    logger, l_osd_local_reserver_preempt, l_osd_local_reserver_wait);
+  service.remote_reserver.set_perf_counters(
+    logger, l_osd_remote_reserver_preempt, l_osd_remote_reserver_wait);
   cct->get_perfcounters_collection()->add(logger);
+  service.oi_cache.set_logger(logger, l_osd_oi_cache_hit, l_osd_oi_cache_miss,
+			      l_osd_oi_cache_bytes);
 }
 
 void OSD::create_recoverystate_perf()
@@ -1510,6 +1635,7 @@ void OSD::suicide(int exitcode)
 
   derr << " pausing thread pools" << dendl;
   op_tp.pause();
+  osd_op_tp.pause();
   disk_tp.pause();
   recovery_tp.pause();
   command_tp.pause();
@@ -1599,6 +1725,10 @@ int OSD::shutdown()
   op_tp.stop();
   dout(10) << "op tp stopped" << dendl;
 
+  osd_op_tp.drain();
+  osd_op_tp.stop();
+  dout(10) << "osd op tp stopped" << dendl;
+
   command_tp.drain();
   command_tp.stop();
   dout(10) << "command tp stopped" << dendl;
@@ -1901,6 +2031,26 @@ OSD::res_result OSD::_try_resurrect_pg(
   return RES_NONE;
 }
 
+/// let the store lay out a new pg collection for its pool's expected size
+static void hint_pg_collection(OSDMapRef osdmap, spg_t pgid,
+			       ObjectStore::Transaction *t)
+{
+  const pg_pool_t *pool = osdmap->get_pg_pool(pgid.pool());
+  if (!pool)
+    return;
+  uint64_t expected_num_objs = pool->get_expected_num_objects();
+  if (!expected_num_objs)
+    return;
+  bufferlist hint;
+  uint32_t pg_num = pool->get_pg_num();
+  ::encode(pg_num, hint);
+  ::encode(expected_num_objs, hint);
+  t->collection_hint(
+    coll_t(pgid),
+    ObjectStore::Transaction::COLL_HINT_EXPECTED_NUM_OBJECTS,
+    hint);
+}
+
 PG *OSD::_create_lock_pg(
   OSDMapRef createmap,
   spg_t pgid,
@@ -2016,6 +2166,7 @@ void OSD::load_pgs()
   }
 
   bool has_upgraded = false;
+  list<LoadPG> to_load;
   for (map<spg_t, interval_set<snapid_t> >::iterator i = pgs.begin();
        i != pgs.end();
        ++i) {
@@ -2040,13 +2191,22 @@ void OSD::load_pgs()
     }
 
     dout(10) << "pgid " << pgid << " coll " << coll_t(pgid) << dendl;
-    bufferlist bl;
-    epoch_t map_epoch = PG::peek_map_epoch(store, coll_t(pgid), service.infos_oid, &bl);
+    LoadPG l;
+    epoch_t map_epoch = PG::peek_map_epoch(store, coll_t(pgid), service.infos_oid, &l.bl);
+
+    l.pg = _open_lock_pg(map_epoch == 0 ? osdmap : service.get_map(map_epoch), pgid);
+    l.snaps = i->second;
+    to_load.push_back(l);
+  }
 
-    PG *pg = _open_lock_pg(map_epoch == 0 ? osdmap : service.get_map(map_epoch), pgid);
+  // read pg state, log
+  read_pgs(to_load);
 
-    // read pg state, log
-    pg->read_state(store, bl);
+  for (list<LoadPG>::iterator i = to_load.begin();
+       i != to_load.end();
+       ++i) {
+    PG *pg = i->pg;
+    spg_t pgid = pg->info.pgid;
 
     if (pg->must_upgrade()) {
       if (!has_upgraded) {
@@ -2055,11 +2215,11 @@ void OSD::load_pgs()
       }
       dout(10) << "PG " << pg->info.pgid
 	       << " must upgrade..." << dendl;
-      pg->upgrade(store, i->second);
-    } else if (!i->second.empty()) {
+      pg->upgrade(store, i->snaps);
+    } else if (!i->snaps.empty()) {
       // handle upgrade bug
-      for (interval_set<snapid_t>::iterator j = i->second.begin();
-	   j != i->second.end();
+      for (interval_set<snapid_t>::iterator j = i->snaps.begin();
+	   j != i->snaps.end();
 	   ++j) {
 	for (snapid_t k = j.get_start();
 	     k != j.get_start() + j.get_len();
@@ -2109,6 +2269,68 @@ void OSD::load_pgs()
   build_past_intervals_parallel();
 }
 
+/*
+ * Reading the info and log is most of what load_pgs does, and PGs are
+ * independent of each other, so do it on osd_load_pgs_threads threads.
+ * The PGs are locked by load_pgs while we do.
+ */
+struct ReadPGsWQ : public ThreadPool::WorkQueue<OSD::LoadPG> {
+  ObjectStore *store;
+  list<OSD::LoadPG*> q;
+  ReadPGsWQ(ObjectStore *s, time_t ti, ThreadPool *tp)
+    : ThreadPool::WorkQueue<OSD::LoadPG>("OSD::ReadPGsWQ", ti, 0, tp),
+      store(s) {}
+  bool _enqueue(OSD::LoadPG *l) {
+    q.push_back(l);
+    return true;
+  }
+  void _dequeue(OSD::LoadPG *l) {
+    assert(0);
+  }
+  OSD::LoadPG *_dequeue() {
+    if (q.empty())
+      return NULL;
+    OSD::LoadPG *l = q.front();
+    q.pop_front();
+    return l;
+  }
+  bool _empty() {
+    return q.empty();
+  }
+  void _process(OSD::LoadPG *l) {
+    l->pg->read_state(store, l->bl);
+  }
+  void _clear() {
+    q.clear();
+  }
+};
+
+void OSD::read_pgs(list<LoadPG>& to_load)
+{
+  utime_t start = ceph_clock_now(cct);
+  int threads = cct->_conf->osd_load_pgs_threads;
+  if (threads > (int)to_load.size())
+    threads = to_load.size();
+  dout(10) << "read_pgs " << to_load.size() << " pgs on " << threads
+	   << " threads" << dendl;
+
+  if (threads <= 1) {
+    for (list<LoadPG>::iterator i = to_load.begin(); i != to_load.end(); ++i)
+      i->pg->read_state(store, i->bl);
+  } else {
+    ThreadPool tp(cct, "OSD::read_pgs_tp", threads);
+    ReadPGsWQ wq(store, cct->_conf->osd_op_thread_timeout, &tp);
+    tp.start();
+    for (list<LoadPG>::iterator i = to_load.begin(); i != to_load.end(); ++i)
+      wq.queue(&*i);
+    wq.drain();
+    tp.stop();
+  }
+
+  boot_read_pgs_lat = ceph_clock_now(cct) - start;
+  dout(10) << "read_pgs done in " << boot_read_pgs_lat << dendl;
+}
+
 
 /*
  * build past_intervals efficiently on old, degraded, and buried
@@ -2318,6 +2540,7 @@ void OSD::handle_pg_peering_evt(
     case RES_NONE: {
       // ok, create the pg locally using provided Info and History
       rctx.transaction->create_collection(coll_t(pgid));
+      hint_pg_collection(get_map(epoch), pgid, rctx.transaction);
       PG *pg = _create_lock_pg(
 	get_map(epoch),
 	pgid, create, false, result == RES_SELF,
@@ -2736,6 +2959,7 @@ void OSD::maybe_update_heartbeat_peers()
 
   // build heartbeat from set
   if (is_active()) {
+    set<int> pg_peers;
     for (ceph::unordered_map<spg_t, PG*>::iterator i = pg_map.begin();
 	 i != pg_map.end();
 	 ++i) {
@@ -2746,14 +2970,28 @@ void OSD::maybe_update_heartbeat_peers()
 	   p != pg->heartbeat_peers.end();
 	   ++p)
 	if (osdmap->is_up(*p))
-	  _add_heartbeat_peer(*p);
+	  pg_peers.insert(*p);
       for (set<int>::iterator p = pg->probe_targets.begin();
 	   p != pg->probe_targets.end();
 	   ++p)
 	if (osdmap->is_up(*p))
-	  _add_heartbeat_peer(*p);
+	  pg_peers.insert(*p);
       pg->heartbeat_peer_lock.Unlock();
     }
+    pg_peers.erase(whoami);
+
+    unsigned max = cct->_conf->osd_heartbeat_max_peers;
+    if (max && max < (unsigned)cct->_conf->osd_heartbeat_min_peers)
+      max = cct->_conf->osd_heartbeat_min_peers;
+    if (max && pg_peers.size() > max) {
+      set<int> chosen;
+      _choose_heartbeat_peers(pg_peers, max, &chosen);
+      dout(10) << " pinging " << chosen.size() << " of " << pg_peers.size()
+	       << " pg peers" << dendl;
+      pg_peers.swap(chosen);
+    }
+    for (set<int>::iterator p = pg_peers.begin(); p != pg_peers.end(); ++p)
+      _add_heartbeat_peer(*p);
   }
 
   // include next and previous up osds to ensure we have a fully-connected set
@@ -2813,6 +3051,66 @@ void OSD::maybe_update_heartbeat_peers()
   dout(10) << "maybe_update_heartbeat_peers " << heartbeat_peers.size() << " peers, extras " << extras << dendl;
 }
 
+/*
+ * Pick max of the candidates, spread as evenly as we can over their
+ * crush parents (normally hosts), so that losing a failure domain is
+ * seen by peers in all the others.  Within a domain, and between
+ * domains, order by a hash of our id and theirs: the choice is stable
+ * across updates, and each osd prefers different peers, so that
+ * together the osds still watch everyone.  The ring neighbours added
+ * by the caller make sure every up osd has at least two watchers.
+ */
+void OSD::_choose_heartbeat_peers(const set<int>& candidates, unsigned max,
+				  set<int> *chosen)
+{
+  // domain -> (hash -> osd)
+  map<int, map<uint32_t,int> > by_domain;
+  for (set<int>::const_iterator p = candidates.begin();
+       p != candidates.end();
+       ++p) {
+    int parent = 0;
+    if (osdmap->crush->get_immediate_parent_id(*p, &parent) < 0)
+      parent = 0;
+    by_domain[parent][crush_hash32_2(CRUSH_HASH_RJENKINS1, whoami, *p)] = *p;
+  }
+
+  // visit domains in an order of our own, too
+  map<uint32_t, map<uint32_t,int>*> domains;
+  for (map<int, map<uint32_t,int> >::iterator p = by_domain.begin();
+       p != by_domain.end();
+       ++p)
+    domains[crush_hash32_2(CRUSH_HASH_RJENKINS1, whoami, p->first)] = &p->second;
+
+  while (chosen->size() < max) {
+    bool any = false;
+    for (map<uint32_t, map<uint32_t,int>*>::iterator p = domains.begin();
+	 p != domains.end() && chosen->size() < max;
+	 ++p) {
+      if (p->second->empty())
+	continue;
+      chosen->insert(p->second->begin()->second);
+      p->second->erase(p->second->begin());
+      any = true;
+    }
+    if (!any)
+      break;
+  }
+}
+
+void OSD::note_heartbeat_peer_traffic(int p, utime_t stamp)
+{
+  Mutex::Locker l(heartbeat_lock);
+  map<int,HeartbeatInfo>::iterator i = heartbeat_peers.find(p);
+  if (i == heartbeat_peers.end() || stamp <= i->second.last_rx_back)
+    return;
+  dout(30) << "note_heartbeat_peer_traffic osd." << p
+	   << " last_rx_back " << i->second.last_rx_back << " -> " << stamp << dendl;
+  i->second.last_rx_back = stamp;
+  // as with a ping reply, if there is no front con, set both stamps.
+  if (i->second.con_front == NULL)
+    i->second.last_rx_front = stamp;
+}
+
 void OSD::reset_heartbeat_peers()
 {
   assert(osd_lock.is_locked());
@@ -3053,7 +3351,11 @@ void OSD::heartbeat()
 
   utime_t now = ceph_clock_now(cct);
 
-  // send heartbeats
+  // send heartbeats.  skip the back ping to peers we have heard from
+  // over the cluster network since the last round; that traffic already
+  // shows they are alive there.
+  utime_t recent = now;
+  recent -= cct->_conf->osd_heartbeat_interval;
   for (map<int,HeartbeatInfo>::iterator i = heartbeat_peers.begin();
        i != heartbeat_peers.end();
        ++i) {
@@ -3061,12 +3363,19 @@ void OSD::heartbeat()
     i->second.last_tx = now;
     if (i->second.first_tx == utime_t())
       i->second.first_tx = now;
-    dout(30) << "heartbeat sending ping to osd." << peer << dendl;
-    hbclient_messenger->send_message(new MOSDPing(monc->get_fsid(),
-						  service.get_osdmap()->get_epoch(),
-						  MOSDPing::PING,
-						  now),
-				     i->second.con_back);
+    if (cct->_conf->osd_heartbeat_use_replication &&
+	i->second.con_front &&
+	i->second.last_rx_back > recent) {
+      dout(30) << "heartbeat sending front ping to osd." << peer
+	       << ", recent traffic on back" << dendl;
+    } else {
+      dout(30) << "heartbeat sending ping to osd." << peer << dendl;
+      hbclient_messenger->send_message(new MOSDPing(monc->get_fsid(),
+						    service.get_osdmap()->get_epoch(),
+						    MOSDPing::PING,
+						    now),
+				       i->second.con_back);
+    }
     if (i->second.con_front)
       hbclient_messenger->send_message(new MOSDPing(monc->get_fsid(),
 						    service.get_osdmap()->get_epoch(),
@@ -3200,6 +3509,9 @@ void OSD::tick()
     check_replay_queue();
   }
 
+  // in case the peering wq went idle with messages still held back
+  flush_peering_msgs(service.get_osdmap(), false);
+
   // only do waiters if dispatch() isn't currently running.  (if it is,
   // it'll do the waiters, and doing them here may screw up ordering
   // of op_queue vs handle_osd_map.)
@@ -3363,12 +3675,18 @@ void TestOpsSocketHook::test_ops(OSDService *service, ObjectStore *store,
 }
 
 // =========================================
+/**
+ * Remove the snap mapper entries of the objects in coll, and unless
+ * bulk is set (the collection is then removed whole afterwards), the
+ * objects themselves.
+ */
 bool remove_dir(
   CephContext *cct,
   ObjectStore *store, SnapMapper *mapper,
   OSDriver *osdriver,
   ObjectStore::Sequencer *osr,
   coll_t coll, DeletingStateRef dstate,
+  bool bulk,
   ThreadPool::TPHandle &handle)
 {
   vector<ghobject_t> olist;
@@ -3393,7 +3711,8 @@ bool remove_dir(
       if (r != 0 && r != -ENOENT) {
 	assert(0);
       }
-      t->remove(coll, *i);
+      if (!bulk)
+	t->remove(coll, *i);
       if (num >= cct->_conf->osd_target_transaction_size) {
 	C_SaferCond waiter;
 	store->queue_transaction(osr, t, &waiter);
@@ -3438,6 +3757,7 @@ void OSD::RemoveWQ::_process(
   if (!item.second->start_clearing())
     return;
 
+  bool bulk = pg->cct->_conf->osd_pg_remove_bulk;
   list<coll_t> colls_to_remove;
   pg->get_colls(&colls_to_remove);
   for (list<coll_t>::iterator i = colls_to_remove.begin();
@@ -3445,11 +3765,16 @@ void OSD::RemoveWQ::_process(
        ++i) {
     bool cont = remove_dir(
       pg->cct, store, &mapper, &driver, pg->osr.get(), *i, item.second,
-      handle);
+      bulk, handle);
     if (!cont)
       return;
   }
 
+  // the removed objects' omap keys linger in the kv store until it
+  // compacts them; do that now rather than paying for them on reads
+  if (pg->cct->_conf->osd_pg_remove_compact_omap)
+    store->compact_removed();
+
   if (!item.second->start_deleting())
     return;
 
@@ -3463,7 +3788,10 @@ void OSD::RemoveWQ::_process(
   for (list<coll_t>::iterator i = colls_to_remove.begin();
        i != colls_to_remove.end();
        ++i) {
-    t->remove_collection(*i);
+    if (bulk)
+      t->remove_collection_recursive(*i);
+    else
+      t->remove_collection(*i);
   }
 
   // We need the sequencer to stick around until the op is complete
@@ -4624,6 +4952,13 @@ bool OSD::ms_dispatch(Message *m)
   return true;
 }
 
+void OSD::ms_fast_dispatch(Message *m)
+{
+  // ops still serialize on osd_lock, but they no longer queue up behind
+  // every other message for the messenger's single dispatch thread.
+  ms_dispatch(m);
+}
+
 bool OSD::ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new)
 {
   dout(10) << "OSD::ms_get_authorizer type=" << ceph_entity_type_name(dest_type) << dendl;
@@ -4867,7 +5202,7 @@ void OSD::_dispatch(Message *m)
   default:
     {
       OpRequestRef op = op_tracker.create_request<OpRequest>(m);
-      op->mark_event("waiting_for_osdmap");
+      op->mark_event(TrackedOp::EVENT_WAITING_FOR_OSDMAP);
       // no map?  starting up?
       if (!osdmap) {
         dout(7) << "no OSDMap, not booted" << dendl;
@@ -5027,6 +5362,89 @@ void OSD::sched_scrub()
   dout(20) << "sched_scrub done" << dendl;
 }
 
+void OSDService::deep_scrub_read(uint64_t bytes)
+{
+  uint64_t rate = cct->_conf->osd_deep_scrub_max_bytes_per_sec;
+  if (!rate)
+    return;
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(sched_scrub_lock);
+  // no credit for time spent idle
+  if (deep_scrub_paid_until < now)
+    deep_scrub_paid_until = now;
+  deep_scrub_paid_until += (double)bytes / (double)rate;
+}
+
+utime_t OSDService::deep_scrub_wait()
+{
+  if (!cct->_conf->osd_deep_scrub_max_bytes_per_sec)
+    return utime_t();
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(sched_scrub_lock);
+  if (deep_scrub_paid_until <= now)
+    return utime_t();
+  return deep_scrub_paid_until - now;
+}
+
+bool OSDService::snap_trim_reserve(PG *pg)
+{
+  Mutex::Locker l(snap_trim_lock);
+  if (snap_trims_active < cct->_conf->osd_max_trimming_pgs) {
+    ++snap_trims_active;
+    dout(20) << "snap_trim_reserve " << pg->info.pgid << ", "
+	     << snap_trims_active << " active" << dendl;
+    return true;
+  }
+  dout(20) << "snap_trim_reserve " << pg->info.pgid << " waiting, "
+	   << snap_trims_active << " active" << dendl;
+  PGRef pgref(pg);
+  if (std::find(snap_trim_waiters.begin(), snap_trim_waiters.end(), pgref) ==
+      snap_trim_waiters.end())
+    snap_trim_waiters.push_back(pgref);
+  logger->inc(l_osd_snap_trim_wait);
+  return false;
+}
+
+void OSDService::snap_trim_release()
+{
+  PGRef next;
+  {
+    Mutex::Locker l(snap_trim_lock);
+    --snap_trims_active;
+    assert(snap_trims_active >= 0);
+    if (!snap_trim_waiters.empty()) {
+      next = snap_trim_waiters.front();
+      snap_trim_waiters.pop_front();
+    }
+  }
+  if (next)
+    queue_for_snap_trim(next.get());
+}
+
+void OSDService::snap_trim_charge(uint64_t cost)
+{
+  uint64_t rate = cct->_conf->osd_snap_trim_max_cost_per_sec;
+  if (!rate)
+    return;
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(snap_trim_lock);
+  // no credit for time spent idle
+  if (snap_trim_paid_until < now)
+    snap_trim_paid_until = now;
+  snap_trim_paid_until += (double)cost / (double)rate;
+}
+
+utime_t OSDService::snap_trim_wait()
+{
+  if (!cct->_conf->osd_snap_trim_max_cost_per_sec)
+    return utime_t();
+  utime_t now = ceph_clock_now(cct);
+  Mutex::Locker l(snap_trim_lock);
+  if (snap_trim_paid_until <= now)
+    return utime_t();
+  return snap_trim_paid_until - now;
+}
+
 bool OSDService::inc_scrubs_pending()
 {
   bool result = false;
@@ -5242,6 +5660,14 @@ void OSD::handle_osd_map(MOSDMap *m)
   // even if this map isn't from a mon, we may have satisfied our subscription
   monc->sub_got("osdmap", last);
 
+  // don't gossip it back to whoever gave it to us
+  epoch_t had = osdmap->get_epoch();
+  int from = -1;
+  if (m->get_source().is_osd()) {
+    from = m->get_source().num();
+    note_peer_epoch(from, last);
+  }
+
   // missing some?
   bool skip_maps = false;
   if (first > osdmap->get_epoch() + 1) {
@@ -5299,10 +5725,8 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
 	OSDMapRef prev = get_map(e - 1);
-	prev->encode(obl);
-	o->decode(obl);
+	o->shallow_copy_from(*prev);
       }
 
       OSDMap::Incremental inc;
@@ -5352,6 +5776,20 @@ void OSD::handle_osd_map(MOSDMap *m)
 
   if (last_marked_full > superblock.last_map_marked_full)
     superblock.last_map_marked_full = last_marked_full;
+
+  // precompute the pg mappings of the newest map before blocking
+  // readers of osdmap; they replace those of the map we leave.
+  OSDMapRef oldmap = osdmap;
+  if (cct->_conf->osd_map_mapping_cache && start <= superblock.newest_map) {
+    OSDMapRef newest = get_map(superblock.newest_map);
+    OSDMapMapping *mapping = new OSDMapMapping;
+    utime_t begin = ceph_clock_now(cct);
+    mapping->update(*newest, cct->_conf->osd_map_mapping_threads);
+    dout(10) << " computed " << mapping->get_num_pgs() << " pg mappings of e"
+	     << newest->get_epoch() << " in " << (ceph_clock_now(cct) - begin)
+	     << dendl;
+    newest->set_mapping(OSDMapMappingRef(mapping));
+  }
  
   map_lock.get_write();
 
@@ -5384,6 +5822,8 @@ void OSD::handle_osd_map(MOSDMap *m)
     advance_map(t, fin);
     had_map_since = ceph_clock_now(cct);
   }
+  if (oldmap != osdmap)
+    oldmap->clear_mapping();
 
   if (osdmap->is_up(whoami) &&
       osdmap->get_addr(whoami) == client_messenger->get_myaddr() &&
@@ -5392,6 +5832,10 @@ void OSD::handle_osd_map(MOSDMap *m)
     if (is_booting()) {
       dout(1) << "state: booting -> active" << dendl;
       state = STATE_ACTIVE;
+      if (boot_start != utime_t()) {
+	logger->tset(l_osd_boot_active_lat, ceph_clock_now(cct) - boot_start);
+	boot_start = utime_t();
+      }
 
       // set incarnation so that osd_reqid_t's we generate for our
       // objecter requests are unique across restarts.
@@ -5500,6 +5944,7 @@ void OSD::handle_osd_map(MOSDMap *m)
     peering_wq.drain();
   } else {
     activate_map();
+    gossip_map(had, from);
   }
 
   if (m->newest_map && m->newest_map > last) {
@@ -5797,6 +6242,48 @@ MOSDMap *OSD::build_incremental_map_msg(epoch_t since, epoch_t to)
   return m;
 }
 
+/*
+ * Push a map we just got on to a few peers that may not have it,
+ * instead of leaving them to hear of it on their next op or
+ * heartbeat, or to ask the monitor.  Each osd forwards a new epoch
+ * once, so it spreads through the cluster in a logarithmic number of
+ * hops while the monitor only seeds it.  We stick to peers we already
+ * talk to (peer_map_epoch), so no new connections are opened for it.
+ */
+void OSD::gossip_map(epoch_t had, int from)
+{
+  int fanout = cct->_conf->osd_map_gossip_fanout;
+  if (fanout <= 0 || !had)
+    return;
+
+  epoch_t e = osdmap->get_epoch();
+  vector<int> peers;
+  {
+    Mutex::Locker l(peer_map_epoch_lock);
+    for (map<int,epoch_t>::iterator p = peer_map_epoch.begin();
+	 p != peer_map_epoch.end();
+	 ++p) {
+      if (p->first != from && p->second < e && osdmap->is_up(p->first))
+	peers.push_back(p->first);
+    }
+  }
+
+  while (fanout-- > 0 && !peers.empty()) {
+    unsigned i = rand() % peers.size();
+    int peer = peers[i];
+    peers[i] = peers.back();
+    peers.pop_back();
+
+    ConnectionRef con = service.get_con_osd_cluster(peer, e);
+    if (!con)
+      continue;
+    epoch_t since = MAX(get_peer_epoch(peer), had);
+    dout(10) << "gossip_map " << since << ".." << e << " to osd." << peer << dendl;
+    send_incremental_map(since, con.get());
+    note_peer_epoch(peer, e);
+  }
+}
+
 void OSD::send_map(MOSDMap *m, Connection *con)
 {
   Messenger *msgr = client_messenger;
@@ -6200,6 +6687,7 @@ void OSD::handle_pg_create(OpRequestRef op)
     if (can_create_pg(pgid)) {
       pg_interval_map_t pi;
       rctx.transaction->create_collection(coll_t(pgid));
+      hint_pg_collection(osdmap, pgid, rctx.transaction);
       pg = _create_lock_pg(
 	osdmap, pgid, true, false, false,
 	0, creating_pgs[pgid].acting, whoami,
@@ -6291,6 +6779,11 @@ void OSD::dispatch_context(PG::RecoveryCtx &ctx, PG *pg, OSDMapRef curmap,
 {
   if (service.get_osdmap()->is_up(whoami) &&
       is_active()) {
+    // anything held back for batching goes first, to keep the order
+    if (!ctx.notify_list->empty() ||
+	!ctx.query_map->empty() ||
+	!ctx.info_map->empty())
+      flush_peering_msgs(curmap, true);
     do_notifies(*ctx.notify_list, curmap);
     do_queries(*ctx.query_map, curmap);
     do_infos(*ctx.info_map, curmap);
@@ -6314,6 +6807,87 @@ void OSD::dispatch_context(PG::RecoveryCtx &ctx, PG *pg, OSDMapRef curmap,
   }
 }
 
+/** queue_peering_msgs
+ * Move the notifies, queries and infos of ctx to the pending ones.  A
+ * later query for the same PG replaces an earlier one.
+ */
+void OSD::queue_peering_msgs(PG::RecoveryCtx &ctx, OSDMapRef curmap)
+{
+  Mutex::Locker l(peering_msg_lock);
+  if (ctx.notify_list->empty() &&
+      ctx.query_map->empty() &&
+      ctx.info_map->empty())
+    return;
+  if (pending_notifies.empty() &&
+      pending_queries.empty() &&
+      pending_infos.empty())
+    peering_msg_since = ceph_clock_now(cct);
+  if (!peering_msg_map ||
+      peering_msg_map->get_epoch() < curmap->get_epoch())
+    peering_msg_map = curmap;
+
+  for (map<int, vector<pair<pg_notify_t, pg_interval_map_t> > >::iterator p =
+	 ctx.notify_list->begin();
+       p != ctx.notify_list->end();
+       ++p) {
+    vector<pair<pg_notify_t, pg_interval_map_t> >& v = pending_notifies[p->first];
+    v.insert(v.end(), p->second.begin(), p->second.end());
+  }
+  for (map<int, map<spg_t, pg_query_t> >::iterator p = ctx.query_map->begin();
+       p != ctx.query_map->end();
+       ++p) {
+    map<spg_t, pg_query_t>& m = pending_queries[p->first];
+    for (map<spg_t, pg_query_t>::iterator q = p->second.begin();
+	 q != p->second.end();
+	 ++q)
+      m[q->first] = q->second;
+  }
+  for (map<int, vector<pair<pg_notify_t, pg_interval_map_t> > >::iterator p =
+	 ctx.info_map->begin();
+       p != ctx.info_map->end();
+       ++p) {
+    vector<pair<pg_notify_t, pg_interval_map_t> >& v = pending_infos[p->first];
+    v.insert(v.end(), p->second.begin(), p->second.end());
+  }
+  ctx.notify_list->clear();
+  ctx.query_map->clear();
+  ctx.info_map->clear();
+}
+
+/** flush_peering_msgs
+ * Send the pending peering messages if force, or if they have waited
+ * osd_peering_msg_batch_delay.  We hold peering_msg_lock while sending
+ * so that two flushes cannot reorder messages for the same PG.
+ */
+void OSD::flush_peering_msgs(OSDMapRef curmap, bool force)
+{
+  Mutex::Locker l(peering_msg_lock);
+  if (pending_notifies.empty() &&
+      pending_queries.empty() &&
+      pending_infos.empty())
+    return;
+  if (!force &&
+      ceph_clock_now(cct) - peering_msg_since <
+      cct->_conf->osd_peering_msg_batch_delay)
+    return;
+
+  if (curmap->get_epoch() < peering_msg_map->get_epoch())
+    curmap = peering_msg_map;
+  dout(10) << "flush_peering_msgs to " << pending_notifies.size()
+	   << "/" << pending_queries.size() << "/" << pending_infos.size()
+	   << " osds (notify/query/info)" << dendl;
+  if (service.get_osdmap()->is_up(whoami) &&
+      is_active()) {
+    do_notifies(pending_notifies, curmap);
+    do_queries(pending_queries, curmap);
+    do_infos(pending_infos, curmap);
+  }
+  pending_notifies.clear();
+  pending_queries.clear();
+  pending_infos.clear();
+  peering_msg_map.reset();
+}
+
 /** do_notifies
  * Send an MOSDPGNotify to a primary, with a list of PGs that I have
  * content for, and they are primary for.
@@ -6675,7 +7249,7 @@ void OSD::handle_pg_backfill_reserve(OpRequestRef op)
       new PG::CephPeeringEvt(
 	m->query_epoch,
 	m->query_epoch,
-	PG::RequestBackfillPrio(m->priority)));
+	PG::RequestBackfillPrio(m->priority, m->preemptible)));
   } else if (m->type == MBackfillReserve::GRANT) {
     evt = PG::CephPeeringEvtRef(
       new PG::CephPeeringEvt(
@@ -6688,6 +7262,18 @@ void OSD::handle_pg_backfill_reserve(OpRequestRef op)
 	m->query_epoch,
 	m->query_epoch,
 	PG::RemoteReservationRejected()));
+  } else if (m->type == MBackfillReserve::REVOKE) {
+    evt = PG::CephPeeringEvtRef(
+      new PG::CephPeeringEvt(
+	m->query_epoch,
+	m->query_epoch,
+	PG::RemoteBackfillPreempted()));
+  } else if (m->type == MBackfillReserve::RELEASE) {
+    evt = PG::CephPeeringEvtRef(
+      new PG::CephPeeringEvt(
+	m->query_epoch,
+	m->query_epoch,
+	PG::RecoveryDone()));
   } else {
     assert(0);
   }
@@ -7324,6 +7910,10 @@ void OSD::handle_replica_op(OpRequestRef op)
 
   // must be a rep op.
   assert(m->get_source().is_osd());
+
+  // it doubles as a heartbeat from the sender
+  if (cct->_conf->osd_heartbeat_use_replication)
+    note_heartbeat_peer_traffic(m->get_source().num(), m->get_recv_stamp());
   
   // require same or newer map
   if (!require_same_or_newer_map(op, m->map_epoch))
@@ -7372,77 +7962,159 @@ void OSD::enqueue_op(PG *pg, OpRequestRef op)
   pg->queue_op(op);
 }
 
-void OSD::OpWQ::_enqueue(pair<PGRef, OpRequestRef> item)
+unsigned OSD::ShardedOpWQ::get_op_class(OpRequestRef op)
+{
+  switch (op->get_req()->get_type()) {
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_PUSH_REPLY:
+    return OP_CLASS_RECOVERY;
+  case MSG_OSD_PG_SCAN:
+  case MSG_OSD_PG_BACKFILL:
+    return OP_CLASS_BACKFILL;
+  default:
+    return OP_CLASS_CLIENT;
+  }
+}
+
+void OSD::ShardedOpWQ::init_mclock(ShardData *sdata)
+{
+  md_config_t *conf = osd->cct->_conf;
+  typedef MClockQueue< pair<PGRef, OpRequestRef>, entity_inst_t>::ClassInfo
+    ClassInfo;
+  sdata->mqueue.set_class_info(
+    OP_CLASS_CLIENT,
+    ClassInfo(conf->osd_op_queue_mclock_client_res,
+	      conf->osd_op_queue_mclock_client_wgt,
+	      conf->osd_op_queue_mclock_client_lim));
+  sdata->mqueue.set_class_info(
+    OP_CLASS_RECOVERY,
+    ClassInfo(conf->osd_op_queue_mclock_recovery_res,
+	      conf->osd_op_queue_mclock_recovery_wgt,
+	      conf->osd_op_queue_mclock_recovery_lim));
+  sdata->mqueue.set_class_info(
+    OP_CLASS_BACKFILL,
+    ClassInfo(conf->osd_op_queue_mclock_backfill_res,
+	      conf->osd_op_queue_mclock_backfill_wgt,
+	      conf->osd_op_queue_mclock_backfill_lim));
+}
+
+void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
+{
+  uint32_t shard_index = thread_index % num_shards;
+
+  ShardData *sdata = shard_list[shard_index];
+  assert(NULL != sdata);
+  sdata->sdata_op_ordering_lock.Lock();
+  if (sdata->queue_empty()) {
+    sdata->sdata_op_ordering_lock.Unlock();
+    osd->cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
+    sdata->sdata_lock.Lock();
+    sdata->sdata_cond.WaitInterval(osd->cct, sdata->sdata_lock, utime_t(2, 0));
+    sdata->sdata_lock.Unlock();
+    sdata->sdata_op_ordering_lock.Lock();
+    if (sdata->queue_empty()) {
+      sdata->sdata_op_ordering_lock.Unlock();
+      return;
+    }
+  }
+  pair<PGRef, OpRequestRef> item = sdata->queue_dequeue(osd->cct);
+  sdata->pg_for_processing[&*(item.first)].push_back(item.second);
+  sdata->sdata_op_ordering_lock.Unlock();
+  osd->logger->set(l_osd_opq, queued.dec());
+
+  ThreadPool::TPHandle tp_handle(osd->cct, hb, timeout_interval,
+				 suicide_interval);
+
+  (item.first)->lock_suspend_timeout(tp_handle);
+
+  OpRequestRef op;
+  {
+    Mutex::Locker l(sdata->sdata_op_ordering_lock);
+    if (!sdata->pg_for_processing.count(&*(item.first))) {
+      (item.first)->unlock();
+      return;
+    }
+    assert(sdata->pg_for_processing[&*(item.first)].size());
+    op = sdata->pg_for_processing[&*(item.first)].front();
+    sdata->pg_for_processing[&*(item.first)].pop_front();
+    if (!(sdata->pg_for_processing[&*(item.first)].size()))
+      sdata->pg_for_processing.erase(&*(item.first));
+  }
+
+  osd->dequeue_op(item.first, op, tp_handle);
+  (item.first)->unlock();
+}
+
+void OSD::ShardedOpWQ::_enqueue(pair<PGRef, OpRequestRef> item)
 {
+  ShardData *sdata = get_shard(&*(item.first));
+  assert(NULL != sdata);
   unsigned priority = item.second->get_req()->get_priority();
   unsigned cost = item.second->get_req()->get_cost();
-  if (priority >= CEPH_MSG_PRIO_LOW)
-    pqueue.enqueue_strict(
+  osd_reqid_t reqid = item.second->get_reqid();
+  tracepoint(ceph_osd, opwq_enqueue,
+	     reqid.name.type(), reqid.name.num(), reqid.tid, reqid.inc,
+	     item.second->get_seq());
+  sdata->sdata_op_ordering_lock.Lock();
+  if (sdata->use_mclock) {
+    if (priority >= CEPH_MSG_PRIO_LOW)
+      sdata->mqueue.enqueue_strict(
+	item.second->get_req()->get_source_inst(),
+	priority, item);
+    else
+      sdata->mqueue.enqueue(item.second->get_req()->get_source_inst(),
+	get_op_class(item.second), item, ceph_clock_now(osd->cct));
+  } else if (priority >= CEPH_MSG_PRIO_LOW)
+    sdata->pqueue.enqueue_strict(
       item.second->get_req()->get_source_inst(),
       priority, item);
   else
-    pqueue.enqueue(item.second->get_req()->get_source_inst(),
+    sdata->pqueue.enqueue(item.second->get_req()->get_source_inst(),
       priority, cost, item);
-  osd->logger->set(l_osd_opq, pqueue.length());
+  sdata->sdata_op_ordering_lock.Unlock();
+  osd->logger->set(l_osd_opq, queued.inc());
+
+  sdata->sdata_lock.Lock();
+  sdata->sdata_cond.SignalOne();
+  sdata->sdata_lock.Unlock();
 }
 
-void OSD::OpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item)
+void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, OpRequestRef> item)
 {
-  {
-    Mutex::Locker l(qlock);
-    if (pg_for_processing.count(&*(item.first))) {
-      pg_for_processing[&*(item.first)].push_front(item.second);
-      item.second = pg_for_processing[&*(item.first)].back();
-      pg_for_processing[&*(item.first)].pop_back();
-    }
+  ShardData *sdata = get_shard(&*(item.first));
+  assert(NULL != sdata);
+  sdata->sdata_op_ordering_lock.Lock();
+  if (sdata->pg_for_processing.count(&*(item.first))) {
+    sdata->pg_for_processing[&*(item.first)].push_front(item.second);
+    item.second = sdata->pg_for_processing[&*(item.first)].back();
+    sdata->pg_for_processing[&*(item.first)].pop_back();
   }
   unsigned priority = item.second->get_req()->get_priority();
   unsigned cost = item.second->get_req()->get_cost();
-  if (priority >= CEPH_MSG_PRIO_LOW)
-    pqueue.enqueue_strict_front(
+  if (sdata->use_mclock) {
+    if (priority >= CEPH_MSG_PRIO_LOW)
+      sdata->mqueue.enqueue_strict_front(
+	item.second->get_req()->get_source_inst(),
+	priority, item);
+    else
+      sdata->mqueue.enqueue_front(item.second->get_req()->get_source_inst(),
+	get_op_class(item.second), item, ceph_clock_now(osd->cct));
+  } else if (priority >= CEPH_MSG_PRIO_LOW)
+    sdata->pqueue.enqueue_strict_front(
       item.second->get_req()->get_source_inst(),
       priority, item);
   else
-    pqueue.enqueue_front(item.second->get_req()->get_source_inst(),
+    sdata->pqueue.enqueue_front(item.second->get_req()->get_source_inst(),
       priority, cost, item);
-  osd->logger->set(l_osd_opq, pqueue.length());
-}
+  sdata->sdata_op_ordering_lock.Unlock();
+  osd->logger->set(l_osd_opq, queued.inc());
 
-PGRef OSD::OpWQ::_dequeue()
-{
-  assert(!pqueue.empty());
-  PGRef pg;
-  {
-    Mutex::Locker l(qlock);
-    pair<PGRef, OpRequestRef> ret = pqueue.dequeue();
-    pg = ret.first;
-    pg_for_processing[&*pg].push_back(ret.second);
-  }
-  osd->logger->set(l_osd_opq, pqueue.length());
-  return pg;
+  sdata->sdata_lock.Lock();
+  sdata->sdata_cond.SignalOne();
+  sdata->sdata_lock.Unlock();
 }
 
-void OSD::OpWQ::_process(PGRef pg, ThreadPool::TPHandle &handle)
-{
-  pg->lock_suspend_timeout(handle);
-  OpRequestRef op;
-  {
-    Mutex::Locker l(qlock);
-    if (!pg_for_processing.count(&*pg)) {
-      pg->unlock();
-      return;
-    }
-    assert(pg_for_processing[&*pg].size());
-    op = pg_for_processing[&*pg].front();
-    pg_for_processing[&*pg].pop_front();
-    if (!(pg_for_processing[&*pg].size()))
-      pg_for_processing.erase(&*pg);
-  }
-  osd->dequeue_op(pg, op, handle);
-  pg->unlock();
-}
-
-
 void OSDService::dequeue_pg(PG *pg, list<OpRequestRef> *dequeued)
 {
   osd->op_wq.dequeue(pg, dequeued);
@@ -7458,6 +8130,10 @@ void OSD::dequeue_op(
   utime_t now = ceph_clock_now(cct);
   op->set_dequeued_time(now);
   utime_t latency = now - op->get_req()->get_recv_stamp();
+  osd_reqid_t reqid = op->get_reqid();
+  tracepoint(ceph_osd, opwq_dequeue,
+	     reqid.name.type(), reqid.name.num(), reqid.tid, reqid.inc,
+	     op->get_seq());
   dout(10) << "dequeue_op " << op << " prio " << op->get_req()->get_priority()
 	   << " cost " << op->get_req()->get_cost()
 	   << " latency " << latency
@@ -7551,6 +8227,16 @@ void OSD::process_peering_events(
   }
   if (need_up_thru)
     queue_want_up_thru(same_interval_since);
+
+  // hold our messages back while more peering work is queued, so that
+  // they share messages with those of the next batches
+  if (cct->_conf->osd_peering_msg_batch_delay > 0) {
+    queue_peering_msgs(rctx, curmap);
+    peering_wq.lock();
+    bool more = !peering_wq._empty();
+    peering_wq.unlock();
+    flush_peering_msgs(curmap, !more);
+  }
   dispatch_context(rctx, 0, curmap, &handle);
 
   service.send_pg_temp();
@@ -7564,6 +8250,7 @@ const char** OSD::get_tracked_conf_keys() const
     "osd_max_backfills",
     "osd_op_complaint_time", "osd_op_log_threshold",
     "osd_op_history_size", "osd_op_history_duration",
+    "osd_op_tracker_sample",
     NULL
   };
   return KEYS;
@@ -7586,6 +8273,9 @@ void OSD::handle_conf_change(const struct md_config_t *conf,
     op_tracker.set_history_size_and_duration(cct->_conf->osd_op_history_size,
                                              cct->_conf->osd_op_history_duration);
   }
+  if (changed.count("osd_op_tracker_sample")) {
+    op_tracker.set_sample_every(cct->_conf->osd_op_tracker_sample);
+  }
 }
 
 // --------------------------------
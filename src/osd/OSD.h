@@ -24,6 +24,7 @@
 #include "common/Mutex.h"
 #include "common/RWLock.h"
 #include "common/Timer.h"
+#include "common/WheelTimer.h"
 #include "common/WorkQueue.h"
 #include "common/LogClient.h"
 #include "common/AsyncReserver.h"
@@ -49,10 +50,12 @@ using namespace std;
 #include "include/unordered_set.h"
 
 #include "Watch.h"
+#include "ObjectInfoCache.h"
 #include "common/shared_cache.hpp"
 #include "common/simple_cache.hpp"
 #include "common/sharedptr_registry.hpp"
 #include "common/PrioritizedQueue.h"
+#include "common/MClockQueue.h"
 
 #define CEPH_OSD_PROTOCOL    10 /* cluster internal */
 
@@ -70,11 +73,13 @@ enum {
   l_osd_op_r_outb,
   l_osd_op_r_lat,
   l_osd_op_r_process_lat,
+  l_osd_op_r_lat_outb_hist,
   l_osd_op_w,
   l_osd_op_w_inb,
   l_osd_op_w_rlat,
   l_osd_op_w_lat,
   l_osd_op_w_process_lat,
+  l_osd_op_w_lat_inb_hist,
   l_osd_op_rw,
   l_osd_op_rw_inb,
   l_osd_op_rw_outb,
@@ -133,11 +138,40 @@ enum {
   l_osd_tier_whiteout,
   l_osd_tier_dirty,
   l_osd_tier_clean,
+  l_osd_tier_proxy_read,
 
   l_osd_agent_wake,
   l_osd_agent_skip,
   l_osd_agent_flush,
   l_osd_agent_evict,
+  l_osd_agent_flush_bytes,
+  l_osd_agent_evict_bytes,
+  l_osd_agent_skip_hot,
+
+  l_osd_snap_trim,
+  l_osd_snap_trim_bytes,
+  l_osd_snap_trim_wait,
+
+  l_osd_ec_fast_read,
+  l_osd_ec_fast_read_early,
+  l_osd_ec_fast_read_saved_lat,
+
+  l_osd_obc_cache_hit,
+  l_osd_obc_cache_miss,
+  l_osd_obc_cache_evict,
+  l_osd_oi_cache_hit,
+  l_osd_oi_cache_miss,
+  l_osd_oi_cache_bytes,
+
+  l_osd_boot_mount_lat,
+  l_osd_boot_read_pgs_lat,
+  l_osd_boot_load_pgs_lat,
+  l_osd_boot_active_lat,
+
+  l_osd_local_reserver_preempt,
+  l_osd_local_reserver_wait,
+  l_osd_remote_reserver_preempt,
+  l_osd_remote_reserver_wait,
 
   l_osd_last,
 };
@@ -320,7 +354,7 @@ public:
   PerfCounters *&logger;
   PerfCounters *&recoverystate_perf;
   MonClient   *&monc;
-  ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>, PGRef> &op_wq;
+  ShardedThreadPool::ShardedWQ< pair<PGRef, OpRequestRef> > &op_wq;
   ThreadPool::BatchWorkQueue<PG> &peering_wq;
   ThreadPool::WorkQueue<PG> &recovery_wq;
   ThreadPool::WorkQueue<PG> &snap_trim_wq;
@@ -403,6 +437,7 @@ public:
   int scrubs_pending;
   int scrubs_active;
   set< pair<utime_t,spg_t> > last_scrub_pg;
+  utime_t deep_scrub_paid_until;  ///< when deep scrub reads so far are within osd_deep_scrub_max_bytes_per_sec
 
   void reg_last_pg_scrub(spg_t pgid, utime_t t) {
     Mutex::Locker l(sched_scrub_lock);
@@ -443,6 +478,25 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+  /// account for bytes read by a deep scrub
+  void deep_scrub_read(uint64_t bytes);
+  /// how long to wait before reading more for a deep scrub
+  utime_t deep_scrub_wait();
+
+  // -- snap trim scheduling --
+  Mutex snap_trim_lock;
+  int snap_trims_active;
+  list<PGRef> snap_trim_waiters;  ///< pgs to requeue when a slot frees up
+  utime_t snap_trim_paid_until;   ///< when trims so far are within osd_snap_trim_max_cost_per_sec
+
+  /// take one of the osd_max_trimming_pgs slots, or queue pg for the next free one
+  bool snap_trim_reserve(PG *pg);
+  void snap_trim_release();
+  /// account for the cost of a batch of trimmed clones
+  void snap_trim_charge(uint64_t cost);
+  /// how long to wait before trimming more
+  utime_t snap_trim_wait();
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -456,6 +510,7 @@ public:
   bool agent_valid_iterator;
   int agent_ops;
   set<hobject_t> agent_oids;
+  set<PGRef> agent_busy_pgs;  ///< pgs an agent thread is working on
   bool agent_active;
   struct AgentThread : public Thread {
     OSDService *osd;
@@ -464,12 +519,20 @@ public:
       osd->agent_entry();
       return NULL;
     }
-  } agent_thread;
+  };
+  vector<AgentThread*> agent_threads;
   bool agent_stop_flag;
 
   void agent_entry();
   void agent_stop();
 
+  /// flush ops we allow when the most urgent pg is at this effort
+  int _agent_max_ops(uint64_t effort) {
+    int lo = g_conf->osd_agent_min_ops;
+    int hi = MAX(lo, g_conf->osd_agent_max_ops);
+    return lo + (hi - lo) * effort / 1000000;
+  }
+
   void _enqueue(PG *pg, uint64_t priority) {
     if (!agent_queue.empty() &&
 	agent_queue.rbegin()->first < priority)
@@ -565,9 +628,13 @@ public:
   friend struct ObjecterDispatcher;
 
 
+  // -- object_info_t and SnapSet of objects without a context --
+  ObjectInfoCache oi_cache;
+
   // -- Watch --
   Mutex watch_lock;
-  SafeTimer watch_timer;
+  WheelTimer watch_timer;
+  Finisher watch_finisher;  ///< sends notifies queued under the pg lock
   uint64_t next_notif_id;
   uint64_t get_next_id(epoch_t cur_epoch) {
     Mutex::Locker l(watch_lock);
@@ -923,6 +990,7 @@ public:
 private:
 
   ThreadPool op_tp;
+  ShardedThreadPool osd_op_tp;
   ThreadPool recovery_tp;
   ThreadPool disk_tp;
   ThreadPool command_tp;
@@ -1006,6 +1074,9 @@ private:
   
   void _add_heartbeat_peer(int p);
   void _remove_heartbeat_peer(int p);
+  void _choose_heartbeat_peers(const set<int>& candidates, unsigned max,
+			       set<int> *chosen);
+  void note_heartbeat_peer_traffic(int p, utime_t stamp);
   bool heartbeat_reset(Connection *con);
   void maybe_update_heartbeat_peers();
   void reset_heartbeat_peers();
@@ -1087,29 +1158,123 @@ private:
 
   // -- op queue --
 
-  struct OpWQ: public ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>,
-					       PGRef > {
-    Mutex qlock;
-    map<PG*, list<OpRequestRef> > pg_for_processing;
+  class ShardedOpWQ: public ShardedThreadPool::ShardedWQ< pair<PGRef, OpRequestRef> > {
+
+  public:
+    /// classes of ops for osd_op_queue = mclock
+    enum {
+      OP_CLASS_CLIENT,
+      OP_CLASS_RECOVERY,
+      OP_CLASS_BACKFILL,
+    };
+    static unsigned get_op_class(OpRequestRef op);
+
+  private:
+    struct ShardData {
+      Mutex sdata_lock;
+      Cond sdata_cond;
+      Mutex sdata_op_ordering_lock;
+      map<PG*, list<OpRequestRef> > pg_for_processing;
+      // one of these is used, as osd_op_queue says
+      bool use_mclock;
+      PrioritizedQueue< pair<PGRef, OpRequestRef>, entity_inst_t> pqueue;
+      MClockQueue< pair<PGRef, OpRequestRef>, entity_inst_t> mqueue;
+      ShardData(string lock_name, string ordering_lock,
+		uint64_t max_tok_per_prio, uint64_t min_cost, bool mclock)
+	: sdata_lock(lock_name.c_str()),
+	  sdata_op_ordering_lock(ordering_lock.c_str()),
+	  use_mclock(mclock),
+	  pqueue(max_tok_per_prio, min_cost) {}
+
+      bool queue_empty() {
+	return use_mclock ? mqueue.empty() : pqueue.empty();
+      }
+      pair<PGRef, OpRequestRef> queue_dequeue(CephContext *cct) {
+	if (use_mclock)
+	  return mqueue.dequeue(ceph_clock_now(cct));
+	return pqueue.dequeue();
+      }
+      template <class F>
+      void queue_remove_by_filter(F f, list<pair<PGRef, OpRequestRef> > *out) {
+	if (use_mclock)
+	  mqueue.remove_by_filter(f, out);
+	else
+	  pqueue.remove_by_filter(f, out);
+      }
+      void queue_dump(Formatter *f) {
+	if (use_mclock)
+	  mqueue.dump(f);
+	else
+	  pqueue.dump(f);
+      }
+    };
+
+    vector<ShardData*> shard_list;
     OSD *osd;
-    PrioritizedQueue<pair<PGRef, OpRequestRef>, entity_inst_t > pqueue;
-    OpWQ(OSD *o, time_t ti, ThreadPool *tp)
-      : ThreadPool::WorkQueueVal<pair<PGRef, OpRequestRef>, PGRef >(
-	"OSD::OpWQ", ti, ti*10, tp),
-	qlock("OpWQ::qlock"),
+    uint32_t num_shards;
+    atomic_t queued;  ///< ops queued across all shards (for l_osd_opq)
+
+    ShardData *get_shard(PG *pg) {
+      return shard_list[pg->get_pgid().ps() % num_shards];
+    }
+
+  public:
+    ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti, time_t si,
+		ShardedThreadPool *tp)
+      : ShardedThreadPool::ShardedWQ< pair<PGRef, OpRequestRef> >(ti, si, tp),
 	osd(o),
-	pqueue(o->cct->_conf->osd_op_pq_max_tokens_per_priority,
-	       o->cct->_conf->osd_op_pq_min_cost)
-    {}
+	num_shards(pnum_shards) {
+      for (uint32_t i = 0; i < num_shards; i++) {
+	char lock_name[32] = {0};
+	snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
+	char order_lock[32] = {0};
+	snprintf(order_lock, sizeof(order_lock), "%s.%d",
+		 "OSD:ShardedOpWQ:order:", i);
+	ShardData *one_shard = new ShardData(
+	  lock_name, order_lock,
+	  osd->cct->_conf->osd_op_pq_max_tokens_per_priority,
+	  osd->cct->_conf->osd_op_pq_min_cost,
+	  osd->cct->_conf->osd_op_queue == "mclock");
+	init_mclock(one_shard);
+	shard_list.push_back(one_shard);
+      }
+    }
 
-    void dump(Formatter *f) {
-      Mutex::Locker l(qlock);
-      pqueue.dump(f);
+    ~ShardedOpWQ() {
+      while (!shard_list.empty()) {
+	delete shard_list.back();
+	shard_list.pop_back();
+      }
     }
 
-    void _enqueue_front(pair<PGRef, OpRequestRef> item);
+    void init_mclock(ShardData *sdata);
+    void _process(uint32_t thread_index, heartbeat_handle_d *hb);
     void _enqueue(pair<PGRef, OpRequestRef> item);
-    PGRef _dequeue();
+    void _enqueue_front(pair<PGRef, OpRequestRef> item);
+
+    void return_waiting_threads() {
+      for (uint32_t i = 0; i < num_shards; i++) {
+	ShardData *sdata = shard_list[i];
+	assert(NULL != sdata);
+	sdata->sdata_lock.Lock();
+	sdata->sdata_cond.SignalAll();
+	sdata->sdata_lock.Unlock();
+      }
+    }
+
+    void dump(Formatter *f) {
+      for (uint32_t i = 0; i < num_shards; i++) {
+	ShardData *sdata = shard_list[i];
+	char lock_name[32] = {0};
+	snprintf(lock_name, sizeof(lock_name), "%s%d", "OSD:ShardedOpWQ:", i);
+	assert(NULL != sdata);
+	sdata->sdata_op_ordering_lock.Lock();
+	f->open_object_section(lock_name);
+	sdata->queue_dump(f);
+	f->close_section();
+	sdata->sdata_op_ordering_lock.Unlock();
+      }
+    }
 
     struct Pred {
       PG *pg;
@@ -1118,32 +1283,36 @@ private:
 	return op.first == pg;
       }
     };
+
     void dequeue(PG *pg, list<OpRequestRef> *dequeued = 0) {
-      lock();
-      if (!dequeued) {
-	pqueue.remove_by_filter(Pred(pg));
-	pg_for_processing.erase(pg);
-      } else {
-	list<pair<PGRef, OpRequestRef> > _dequeued;
-	pqueue.remove_by_filter(Pred(pg), &_dequeued);
-	for (list<pair<PGRef, OpRequestRef> >::iterator i = _dequeued.begin();
-	     i != _dequeued.end();
-	     ++i) {
+      ShardData *sdata = get_shard(pg);
+      list<pair<PGRef, OpRequestRef> > _dequeued;
+      sdata->sdata_op_ordering_lock.Lock();
+      sdata->queue_remove_by_filter(Pred(pg), &_dequeued);
+      for (list<pair<PGRef, OpRequestRef> >::iterator i = _dequeued.begin();
+	   i != _dequeued.end();
+	   ++i) {
+	if (dequeued)
 	  dequeued->push_back(i->second);
-	}
-	if (pg_for_processing.count(pg)) {
+	queued.dec();
+      }
+      if (sdata->pg_for_processing.count(pg)) {
+	if (dequeued)
 	  dequeued->splice(
 	    dequeued->begin(),
-	    pg_for_processing[pg]);
-	  pg_for_processing.erase(pg);
-	}
+	    sdata->pg_for_processing[pg]);
+	sdata->pg_for_processing.erase(pg);
       }
-      unlock();
+      sdata->sdata_op_ordering_lock.Unlock();
     }
-    bool _empty() {
-      return pqueue.empty();
+
+    bool is_shard_empty(uint32_t thread_index) {
+      uint32_t shard_index = thread_index % num_shards;
+      ShardData *sdata = shard_list[shard_index];
+      assert(NULL != sdata);
+      Mutex::Locker l(sdata->sdata_op_ordering_lock);
+      return sdata->queue_empty();
     }
-    void _process(PGRef pg, ThreadPool::TPHandle &handle);
   } op_wq;
 
   void enqueue_op(PG *pg, OpRequestRef op);
@@ -1207,6 +1376,17 @@ private:
     const list<PG*> &pg,
     ThreadPool::TPHandle &handle);
 
+  // peering messages from the peering wq, held for a moment so that one
+  // message per peer carries the PGs of several batches
+  Mutex peering_msg_lock;
+  utime_t peering_msg_since;  // when the oldest pending one was queued
+  OSDMapRef peering_msg_map;
+  map<int, vector<pair<pg_notify_t, pg_interval_map_t> > > pending_notifies;
+  map<int, map<spg_t, pg_query_t> > pending_queries;
+  map<int, vector<pair<pg_notify_t, pg_interval_map_t> > > pending_infos;
+  void queue_peering_msgs(PG::RecoveryCtx &ctx, OSDMapRef curmap);
+  void flush_peering_msgs(OSDMapRef curmap, bool force);
+
   friend class PG;
   friend class ReplicatedPG;
 
@@ -1277,6 +1457,7 @@ private:
 
   MOSDMap *build_incremental_map_msg(epoch_t from, epoch_t to);
   void send_incremental_map(epoch_t since, Connection *con);
+  void gossip_map(epoch_t had, int from);
   void send_map(MOSDMap *m, Connection *con);
 
 protected:
@@ -1332,6 +1513,19 @@ protected:
   void load_pgs();
   void build_past_intervals_parallel();
 
+  // time spent in each phase of startup, for the boot_* perf counters
+  utime_t boot_start;
+  utime_t boot_mount_lat, boot_read_pgs_lat, boot_load_pgs_lat;
+public:
+  struct LoadPG {
+    PG *pg;
+    bufferlist bl;                 // from peek_map_epoch
+    interval_set<snapid_t> snaps;  // snap collections
+    LoadPG() : pg(NULL) {}
+  };
+protected:
+  void read_pgs(list<LoadPG>& to_load);
+
   void calc_priors_during(
     spg_t pgid, epoch_t start, epoch_t end, set<pg_shard_t>& pset);
 
@@ -1662,7 +1856,14 @@ protected:
       osd->snap_trim_queue.pop_front();
       return pg;
     }
-    void _process(PG *pg) {
+    void _process(PG *pg, ThreadPool::TPHandle &handle) {
+      // pace to osd_snap_trim_max_cost_per_sec, without holding the pg lock
+      utime_t wait = osd->service.snap_trim_wait();
+      if (wait > utime_t()) {
+	handle.suspend_tp_timeout();
+	wait.sleep();
+	handle.reset_tp_timeout();
+      }
       pg->snap_trimmer();
       pg->put("SnapTrimWQ");
     }
@@ -1801,6 +2002,21 @@ protected:
 	osd->osd_lock.Unlock();
 	return;
       }
+      if (msg->deep) {
+	utime_t wait = osd->service.deep_scrub_wait();
+	if (wait > utime_t()) {
+	  osd->osd_lock.Unlock();
+	  handle.suspend_tp_timeout();
+	  wait.sleep();
+	  handle.reset_tp_timeout();
+	  osd->osd_lock.Lock();
+	  if (osd->is_stopping()) {
+	    osd->osd_lock.Unlock();
+	    msg->put();
+	    return;
+	  }
+	}
+      }
       if (osd->_have_pg(msg->pgid)) {
 	PG *pg = osd->_lookup_lock_pg(msg->pgid);
 	osd->osd_lock.Unlock();
@@ -1861,6 +2077,22 @@ protected:
 
  private:
   bool ms_dispatch(Message *m);
+  bool ms_can_fast_dispatch_any() const { return true; }
+  bool ms_can_fast_dispatch(Message *m) const {
+    switch (m->get_type()) {
+    case CEPH_MSG_OSD_OP:
+    case MSG_OSD_SUBOP:
+    case MSG_OSD_SUBOPREPLY:
+    case MSG_OSD_EC_WRITE:
+    case MSG_OSD_EC_WRITE_REPLY:
+    case MSG_OSD_EC_READ:
+    case MSG_OSD_EC_READ_REPLY:
+      return true;
+    default:
+      return false;
+    }
+  }
+  void ms_fast_dispatch(Message *m);
   bool ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new);
   bool ms_verify_authorizer(Connection *con, int peer_type,
 			    int protocol, bufferlist& authorizer, bufferlist& authorizer_reply,
@@ -22,6 +22,8 @@
 
 #define dout_subsys ceph_subsys_osd
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(OSDMap, osdmap)
+
 // ----------------------------------
 // osd_info_t
 
@@ -776,6 +778,7 @@ void OSDMap::Incremental::generate_test_instances(list<Incremental*>& o)
 void OSDMap::set_epoch(epoch_t e)
 {
   epoch = e;
+  mapping.reset();
   for (map<int64_t,pg_pool_t>::iterator p = pools.begin();
        p != pools.end();
        ++p)
@@ -814,6 +817,8 @@ void OSDMap::get_blacklist(list<pair<entity_addr_t,utime_t> > *bl) const
 
 void OSDMap::set_max_osd(int m)
 {
+  unshare(osd_addrs);
+  unshare(osd_uuid);
   int o = max_osd;
   max_osd = m;
   osd_state.resize(m);
@@ -829,8 +834,10 @@ void OSDMap::set_max_osd(int m)
   osd_addrs->hb_back_addr.resize(m);
   osd_addrs->hb_front_addr.resize(m);
   osd_uuid->resize(m);
-  if (osd_primary_affinity)
+  if (osd_primary_affinity) {
+    unshare(osd_primary_affinity);
     osd_primary_affinity->resize(m, CEPH_OSD_DEFAULT_PRIMARY_AFFINITY);
+  }
 
   calc_num_osds();
 }
@@ -942,6 +949,8 @@ uint64_t OSDMap::get_features(uint64_t *pmask) const
   if (crush->has_nondefault_tunables3() ||
       crush->has_v3_rules())
     features |= CEPH_FEATURE_CRUSH_TUNABLES3;
+  if (crush->has_v4_buckets())
+    features |= CEPH_FEATURE_CRUSH_V4;
   mask |= CEPH_FEATURES_CRUSH;
 
   for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin(); p != pools.end(); ++p) {
@@ -1000,9 +1009,13 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
   int diff = 0;
 
   // do addrs match?
-  if (o->max_osd != n->max_osd)
+  if (o->osd_addrs == n->osd_addrs)
+    diff = -1;  // already shared
+  else
+    unshare(n->osd_addrs);
+  if (diff == 0 && o->max_osd != n->max_osd)
     diff++;
-  for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
+  for (int i = 0; diff >= 0 && i < o->max_osd && i < n->max_osd; i++) {
     if ( n->osd_addrs->client_addr[i] &&  o->osd_addrs->client_addr[i] &&
 	*n->osd_addrs->client_addr[i] == *o->osd_addrs->client_addr[i])
       n->osd_addrs->client_addr[i] = o->osd_addrs->client_addr[i];
@@ -1030,15 +1043,18 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
   }
 
   // does crush match?
-  bufferlist oc, nc;
-  ::encode(*o->crush, oc);
-  ::encode(*n->crush, nc);
-  if (oc.contents_equal(nc)) {
-    n->crush = o->crush;
+  if (o->crush != n->crush) {
+    bufferlist oc, nc;
+    ::encode(*o->crush, oc);
+    ::encode(*n->crush, nc);
+    if (oc.contents_equal(nc)) {
+      n->crush = o->crush;
+    }
   }
 
   // does pg_temp match?
-  if (o->pg_temp->size() == n->pg_temp->size()) {
+  if (o->pg_temp != n->pg_temp &&
+      o->pg_temp->size() == n->pg_temp->size()) {
     if (*o->pg_temp == *n->pg_temp)
       n->pg_temp = o->pg_temp;
   }
@@ -1049,6 +1065,11 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
       n->primary_temp = o->primary_temp;
   }
 
+  // does primary affinity match?
+  if (o->osd_primary_affinity && n->osd_primary_affinity &&
+      *o->osd_primary_affinity == *n->osd_primary_affinity)
+    n->osd_primary_affinity = o->osd_primary_affinity;
+
   // do uuids match?
   if (o->osd_uuid->size() == n->osd_uuid->size() &&
       *o->osd_uuid == *n->osd_uuid)
@@ -1135,6 +1156,7 @@ int OSDMap::apply_incremental(const Incremental &inc)
   assert(inc.epoch == epoch+1);
   epoch++;
   modified = inc.modified;
+  mapping.reset();
 
   // full map?
   if (inc.fullmap.length()) {
@@ -1143,10 +1165,20 @@ int OSDMap::apply_incremental(const Incremental &inc)
     return 0;
   }
 
-  // nope, incremental.
+  // nope, incremental.  the pieces we share with the previous epoch
+  // (see shallow_copy_from) are copied only if we change them.
   if (inc.new_flags >= 0)
     flags = inc.new_flags;
 
+  if (!inc.new_state.empty() || !inc.new_uuid.empty())
+    unshare(osd_uuid);
+  if (!inc.new_up_client.empty() || !inc.new_up_cluster.empty())
+    unshare(osd_addrs);
+  if (!inc.new_pg_temp.empty())
+    unshare(pg_temp);
+  if (!inc.new_primary_temp.empty())
+    unshare(primary_temp);
+
   if (inc.new_max_osd >= 0)
     set_max_osd(inc.new_max_osd);
 
@@ -1545,6 +1577,10 @@ void OSDMap::_pg_to_up_acting_osds(pg_t pg, vector<int> *up, int *up_primary,
       *acting_primary = -1;
     return;
   }
+  OSDMapMappingRef m = mapping.get();
+  if (m && m->get_epoch() == epoch &&
+      m->get(*pool, pg, up, up_primary, acting, acting_primary))
+    return;
   vector<int> raw;
   vector<int> _up;
   vector<int> _acting;
@@ -1695,6 +1731,159 @@ void OSDMap::encode_classic(bufferlist& bl, uint64_t features) const
   ::encode(osd_addrs->hb_front_addr, bl);
 }
 
+/*
+ * With CEPH_FEATURE_OSDMAP_COMPACT, pg_temp and primary_temp are
+ * written as varints, grouped by pool, with each pg's seed as a delta
+ * from the previous one.  pg_temp sets are written once in a table and
+ * referred to by index, since during backfill many pgs share the same
+ * set.  On a large cluster this is most of the size of a full map.
+ */
+static void encode_varint(uint64_t v, bufferlist& bl)
+{
+  while (v >= 0x80) {
+    __u8 b = (v & 0x7f) | 0x80;
+    ::encode(b, bl);
+    v >>= 7;
+  }
+  __u8 b = v;
+  ::encode(b, bl);
+}
+
+static uint64_t decode_varint(bufferlist::iterator& p)
+{
+  uint64_t v = 0;
+  __u8 b;
+  for (int shift = 0; ; shift += 7) {
+    ::decode(b, p);
+    if (shift >= 64)
+      throw buffer::malformed_input("varint too long");
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0)
+      break;
+  }
+  return v;
+}
+
+// osd ids and preferred may be negative
+static void encode_svarint(int64_t v, bufferlist& bl)
+{
+  encode_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63), bl);
+}
+
+static int64_t decode_svarint(bufferlist::iterator& p)
+{
+  uint64_t v = decode_varint(p);
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// a map keyed by pg, as (pool, count, entries...) for each pool
+template<class T, class F>
+static void encode_pgs_compact(const map<pg_t,T>& m, F encode_value, bufferlist& bl)
+{
+  set<uint64_t> pools;
+  typename map<pg_t,T>::const_iterator p;
+  for (p = m.begin(); p != m.end(); ++p)
+    pools.insert(p->first.pool());
+  encode_varint(pools.size(), bl);
+  p = m.begin();
+  while (p != m.end()) {
+    uint64_t pool = p->first.pool();
+    typename map<pg_t,T>::const_iterator end = p;
+    uint32_t n = 0;
+    while (end != m.end() && end->first.pool() == pool) {
+      ++end;
+      ++n;
+    }
+    encode_varint(pool, bl);
+    encode_varint(n, bl);
+    uint32_t last = 0;
+    for (; p != end; ++p) {
+      // pgs sort by preferred before seed, so this may wrap; that's fine
+      encode_varint(p->first.ps() - last, bl);
+      last = p->first.ps();
+      encode_svarint(p->first.preferred(), bl);
+      encode_value(p->second, bl);
+    }
+  }
+}
+
+template<class T, class F>
+static void decode_pgs_compact(map<pg_t,T>& m, F decode_value, bufferlist::iterator& bl)
+{
+  m.clear();
+  uint64_t npools = decode_varint(bl);
+  while (npools--) {
+    uint64_t pool = decode_varint(bl);
+    uint64_t n = decode_varint(bl);
+    uint32_t last = 0;
+    while (n--) {
+      last += decode_varint(bl);
+      int preferred = decode_svarint(bl);
+      decode_value(m[pg_t(last, pool, preferred)], bl);
+    }
+  }
+}
+
+struct encode_temp_index {
+  const map<vector<int>,uint32_t>& index;
+  encode_temp_index(const map<vector<int>,uint32_t>& i) : index(i) {}
+  void operator()(const vector<int>& v, bufferlist& bl) const {
+    encode_varint(index.find(v)->second, bl);
+  }
+};
+
+struct decode_temp_index {
+  const vector<vector<int> >& table;
+  decode_temp_index(const vector<vector<int> >& t) : table(t) {}
+  void operator()(vector<int>& v, bufferlist::iterator& bl) const {
+    uint64_t i = decode_varint(bl);
+    if (i >= table.size())
+      throw buffer::malformed_input("bad pg_temp index");
+    v = table[i];
+  }
+};
+
+static void encode_osd_compact(const int& osd, bufferlist& bl)
+{
+  encode_svarint(osd, bl);
+}
+
+static void decode_osd_compact(int& osd, bufferlist::iterator& bl)
+{
+  osd = decode_svarint(bl);
+}
+
+static void encode_pg_temp_compact(const map<pg_t,vector<int> >& pg_temp,
+				   bufferlist& bl)
+{
+  map<vector<int>,uint32_t> index;
+  vector<const vector<int>*> table;
+  for (map<pg_t,vector<int> >::const_iterator p = pg_temp.begin();
+       p != pg_temp.end(); ++p) {
+    if (index.insert(make_pair(p->second, (uint32_t)table.size())).second)
+      table.push_back(&p->second);
+  }
+  encode_varint(table.size(), bl);
+  for (vector<const vector<int>*>::iterator p = table.begin(); p != table.end(); ++p) {
+    encode_varint((*p)->size(), bl);
+    for (vector<int>::const_iterator q = (*p)->begin(); q != (*p)->end(); ++q)
+      encode_svarint(*q, bl);
+  }
+  encode_pgs_compact(pg_temp, encode_temp_index(index), bl);
+}
+
+static void decode_pg_temp_compact(map<pg_t,vector<int> >& pg_temp,
+				   bufferlist::iterator& bl)
+{
+  vector<vector<int> > table(decode_varint(bl));
+  for (vector<vector<int> >::iterator p = table.begin(); p != table.end(); ++p) {
+    p->resize(decode_varint(bl));
+    for (vector<int>::iterator q = p->begin(); q != p->end(); ++q)
+      *q = decode_svarint(bl);
+  }
+  decode_pgs_compact(pg_temp, decode_temp_index(table), bl);
+}
+
 void OSDMap::encode(bufferlist& bl, uint64_t features) const
 {
   if ((features & CEPH_FEATURE_OSDMAP_ENC) == 0) {
@@ -1705,7 +1894,8 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
   ENCODE_START(7, 7, bl);
 
   {
-    ENCODE_START(2, 1, bl); // client-usable data
+    bool compact = features & CEPH_FEATURE_OSDMAP_COMPACT;
+    ENCODE_START(compact ? 3 : 2, 1, bl); // client-usable data
     // base
     ::encode(fsid, bl);
     ::encode(epoch, bl);
@@ -1723,8 +1913,13 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
     ::encode(osd_weight, bl);
     ::encode(osd_addrs->client_addr, bl);
 
-    ::encode(*pg_temp, bl);
-    ::encode(*primary_temp, bl);
+    if (compact) {
+      encode_pg_temp_compact(*pg_temp, bl);
+      encode_pgs_compact(*primary_temp, encode_osd_compact, bl);
+    } else {
+      ::encode(*pg_temp, bl);
+      ::encode(*primary_temp, bl);
+    }
     if (osd_primary_affinity) {
       ::encode(*osd_primary_affinity, bl);
     } else {
@@ -1882,6 +2077,15 @@ void OSDMap::decode(bufferlist::iterator& bl)
    * a struct_v < 7, we must rewind to the beginning and use our
    * classic decoder.
    */
+  mapping.reset();
+
+  // never decode into something we may share with another epoch
+  osd_addrs.reset(new addrs_s);
+  pg_temp.reset(new map<pg_t,vector<int> >);
+  primary_temp.reset(new map<pg_t,int>);
+  osd_uuid.reset(new vector<uuid_d>);
+  crush.reset(new CrushWrapper);
+
   DECODE_START_LEGACY_COMPAT_LEN(7, 7, 7, bl); // wrapper
   if (struct_v < 7) {
     int struct_v_size = sizeof(struct_v);
@@ -1893,7 +2097,7 @@ void OSDMap::decode(bufferlist::iterator& bl)
    * Since we made it past that hurdle, we can use our normal paths.
    */
   {
-    DECODE_START(2, bl); // client-usable data
+    DECODE_START(3, bl); // client-usable data
     // base
     ::decode(fsid, bl);
     ::decode(epoch, bl);
@@ -1911,8 +2115,13 @@ void OSDMap::decode(bufferlist::iterator& bl)
     ::decode(osd_weight, bl);
     ::decode(osd_addrs->client_addr, bl);
 
-    ::decode(*pg_temp, bl);
-    ::decode(*primary_temp, bl);
+    if (struct_v >= 3) {
+      decode_pg_temp_compact(*pg_temp, bl);
+      decode_pgs_compact(*primary_temp, decode_osd_compact, bl);
+    } else {
+      ::decode(*pg_temp, bl);
+      ::decode(*primary_temp, bl);
+    }
     if (struct_v >= 2) {
       osd_primary_affinity.reset(new vector<__u32>);
       ::decode(*osd_primary_affinity, bl);
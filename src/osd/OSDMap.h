@@ -24,9 +24,11 @@
 #include "common/config.h"
 #include "include/types.h"
 #include "osd_types.h"
+#include "OSDMapMapping.h"
 #include "msg/Message.h"
 #include "common/Mutex.h"
 #include "common/Clock.h"
+#include "common/mempool.h"
 
 #include "include/ceph_features.h"
 
@@ -109,6 +111,8 @@ ostream& operator<<(ostream& out, const osd_xinfo_t& xi);
 class OSDMap {
 
 public:
+  MEMPOOL_CLASS_HELPERS()
+
   class Incremental {
   public:
     /// feature bits we were encoded with.  the subsequent OSDMap
@@ -224,6 +228,9 @@ private:
   string cluster_snapshot;
   bool new_blacklist_entries;
 
+  /// precomputed pg mappings of this epoch, if any
+  mutable OSDMapMappingSlot mapping;
+
  public:
   ceph::shared_ptr<CrushWrapper> crush;       // hierarchical map
 
@@ -231,6 +238,13 @@ private:
   friend class PGMonitor;
   friend class MDS;
 
+  /// make p our own before changing it, if another map shares it
+  template<class T>
+  static void unshare(ceph::shared_ptr<T>& p) {
+    if (p && !p.unique())
+      p.reset(new T(*p));
+  }
+
  public:
   OSDMap() : epoch(0), 
 	     pool_max(-1),
@@ -267,6 +281,19 @@ public:
     // allocate a new CrushWrapper, though.
   }
 
+  /**
+   * copy o, sharing everything behind a shared_ptr with it
+   *
+   * apply_incremental() and decode() copy or replace a shared piece
+   * before they change it, so the result can be moved to the next
+   * epoch without touching o, and only what the incremental changed
+   * is duplicated.
+   */
+  void shallow_copy_from(const OSDMap& o) {
+    *this = o;
+    mapping.reset();
+  }
+
   // map info
   const uuid_d& get_fsid() const { return fsid; }
   void set_fsid(uuid_d& f) { fsid = f; }
@@ -274,6 +301,24 @@ public:
   epoch_t get_epoch() const { return epoch; }
   void inc_epoch() { epoch++; }
 
+  /**
+   * attach the precomputed mapping of this epoch
+   *
+   * The pg mapping functions read it instead of running CRUSH.  It is
+   * dropped when the map moves to another epoch; a map must not be
+   * modified in place while a mapping is attached.
+   */
+  void set_mapping(OSDMapMappingRef m) const {
+    assert(!m || m->get_epoch() == epoch);
+    mapping.set(m);
+  }
+  void clear_mapping() const {
+    mapping.reset();
+  }
+  OSDMapMappingRef get_mapping() const {
+    return mapping.get();
+  }
+
   void set_epoch(epoch_t e);
 
   /* stamps etc */
@@ -348,6 +393,8 @@ public:
     if (!osd_primary_affinity)
       osd_primary_affinity.reset(new vector<__u32>(max_osd,
 						   CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
+    else
+      unshare(osd_primary_affinity);
     (*osd_primary_affinity)[o] = w;
   }
   unsigned get_primary_affinity(int o) const {
@@ -0,0 +1,134 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "OSDMapMapping.h"
+#include "OSDMap.h"
+#include "common/Thread.h"
+
+void OSDMapMapping::PoolMapping::set(
+  unsigned ps,
+  const vector<int> &up, int up_primary,
+  const vector<int> &acting, int acting_primary)
+{
+  int32_t *row = &table[ps * row_size()];
+  if (up.size() > size || acting.size() > size) {
+    // pg_temp wider than the pool; leave it to the map
+    row[2] = -1;
+    return;
+  }
+  row[0] = up_primary;
+  row[1] = acting_primary;
+  row[2] = up.size();
+  row[3] = acting.size();
+  for (unsigned i = 0; i < up.size(); ++i)
+    row[4 + i] = up[i];
+  for (unsigned i = 0; i < acting.size(); ++i)
+    row[4 + size + i] = acting[i];
+}
+
+bool OSDMapMapping::PoolMapping::get(
+  unsigned ps,
+  vector<int> *up, int *up_primary,
+  vector<int> *acting, int *acting_primary) const
+{
+  const int32_t *row = &table[ps * row_size()];
+  if (row[2] < 0)
+    return false;
+  if (up)
+    up->assign(row + 4, row + 4 + row[2]);
+  if (up_primary)
+    *up_primary = row[0];
+  if (acting)
+    acting->assign(row + 4 + size, row + 4 + size + row[3]);
+  if (acting_primary)
+    *acting_primary = row[1];
+  return true;
+}
+
+/// computes every nth pg of the pools, starting at the mth
+struct OSDMapMapping::Job : public Thread {
+  const OSDMap &osdmap;
+  vector<pair<int64_t, PoolMapping*> > &pools;
+  unsigned start, step;
+
+  Job(const OSDMap &osdmap, vector<pair<int64_t, PoolMapping*> > &pools,
+      unsigned start, unsigned step)
+    : osdmap(osdmap), pools(pools), start(start), step(step) {}
+
+  void *entry() {
+    vector<int> up, acting;
+    int up_primary, acting_primary;
+    for (vector<pair<int64_t, PoolMapping*> >::iterator p = pools.begin();
+	 p != pools.end();
+	 ++p) {
+      PoolMapping *pm = p->second;
+      for (unsigned ps = start; ps < pm->pg_num; ps += step) {
+	osdmap.pg_to_up_acting_osds(pg_t(ps, p->first, -1),
+				    &up, &up_primary, &acting, &acting_primary);
+	pm->set(ps, up, up_primary, acting, acting_primary);
+      }
+    }
+    return 0;
+  }
+};
+
+void OSDMapMapping::update(const OSDMap &osdmap, unsigned threads)
+{
+  epoch = osdmap.get_epoch();
+  pools.clear();
+  num_pgs = 0;
+
+  vector<pair<int64_t, PoolMapping*> > todo;
+  const map<int64_t, pg_pool_t> &mp = osdmap.get_pools();
+  for (map<int64_t, pg_pool_t>::const_iterator p = mp.begin();
+       p != mp.end();
+       ++p) {
+    PoolMapping &pm = pools[p->first] =
+      PoolMapping(p->second.get_size(), p->second.get_pg_num());
+    todo.push_back(make_pair(p->first, &pm));
+    num_pgs += pm.pg_num;
+  }
+
+  if (threads < 1)
+    threads = 1;
+  if (threads > num_pgs)
+    threads = MAX(num_pgs, 1u);
+
+  // this thread takes the first share
+  vector<Job*> jobs;
+  for (unsigned i = 1; i < threads; ++i) {
+    Job *j = new Job(osdmap, todo, i, threads);
+    j->create();
+    jobs.push_back(j);
+  }
+  Job(osdmap, todo, 0, threads).entry();
+  for (vector<Job*>::iterator j = jobs.begin(); j != jobs.end(); ++j) {
+    (*j)->join();
+    delete *j;
+  }
+}
+
+bool OSDMapMapping::get(const pg_pool_t &pool, pg_t pg,
+			vector<int> *up, int *up_primary,
+			vector<int> *acting, int *acting_primary) const
+{
+  map<int64_t, PoolMapping>::const_iterator p = pools.find(pg.pool());
+  if (p == pools.end())
+    return false;
+  const PoolMapping &pm = p->second;
+  if (pm.pg_num != pool.get_pg_num() || pm.size != pool.get_size())
+    return false;
+  pg = pool.raw_pg_to_pg(pg);
+  if (pg.ps() >= pm.pg_num)
+    return false;
+  return pm.get(pg.ps(), up, up_primary, acting, acting_primary);
+}
@@ -0,0 +1,132 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSDMAPMAPPING_H
+#define CEPH_OSDMAPMAPPING_H
+
+#include <map>
+#include <vector>
+#include "include/memory.h"
+#include "include/Spinlock.h"
+#include "osd_types.h"
+
+class OSDMap;
+
+/**
+ * up and acting sets of every pg of an OSDMap epoch
+ *
+ * Computing the mapping of a pg runs CRUSH, which dominates the cost
+ * of targeting an op or of a peering pass.  An OSDMapMapping holds
+ * the result for all the pgs of all the pools, computed once when the
+ * map is received, and is attached to the OSDMap it was computed
+ * from (@see OSDMap::set_mapping).  The mapping functions of the map
+ * then read it instead of running CRUSH.
+ *
+ * The sets of each pool are stored in a single vector, one row per
+ * pg: up_primary, acting_primary, up size, acting size followed by
+ * the up and acting sets padded to the pool size.
+ */
+class OSDMapMapping {
+  struct PoolMapping {
+    unsigned size;           ///< pool size, the width of the sets
+    unsigned pg_num;
+    vector<int32_t> table;
+
+    PoolMapping() : size(0), pg_num(0) {}
+    PoolMapping(unsigned size, unsigned pg_num)
+      : size(size), pg_num(pg_num), table((4 + 2 * size) * pg_num) {}
+
+    unsigned row_size() const {
+      return 4 + 2 * size;
+    }
+    void set(unsigned ps,
+	     const vector<int> &up, int up_primary,
+	     const vector<int> &acting, int acting_primary);
+    bool get(unsigned ps,
+	     vector<int> *up, int *up_primary,
+	     vector<int> *acting, int *acting_primary) const;
+  };
+
+  epoch_t epoch;
+  map<int64_t, PoolMapping> pools;
+  unsigned num_pgs;
+
+  struct Job;
+  friend struct Job;
+
+public:
+  OSDMapMapping() : epoch(0), num_pgs(0) {}
+
+  /**
+   * compute the mapping of every pg of osdmap
+   *
+   * @param osdmap the map to compute the mapping of
+   * @param threads number of threads sharing the work
+   */
+  void update(const OSDMap &osdmap, unsigned threads);
+
+  /**
+   * look up a pg
+   *
+   * pg may be a raw pg, it is folded into pg_num as the map does.
+   * Fills in whatever fields are non-NULL.
+   * @return false if the pg is not covered by the mapping
+   */
+  bool get(const pg_pool_t &pool, pg_t pg,
+	   vector<int> *up, int *up_primary,
+	   vector<int> *acting, int *acting_primary) const;
+
+  epoch_t get_epoch() const {
+    return epoch;
+  }
+  unsigned get_num_pgs() const {
+    return num_pgs;
+  }
+};
+typedef ceph::shared_ptr<const OSDMapMapping> OSDMapMappingRef;
+
+/**
+ * the mapping attached to an OSDMap
+ *
+ * Maps are shared between threads once published, the slot can
+ * still be set or cleared at any time.  It is not copied with the
+ * map: a copy is made to be modified.
+ */
+class OSDMapMappingSlot {
+  Spinlock lock;
+  OSDMapMappingRef mapping;
+
+public:
+  OSDMapMappingSlot() {}
+  OSDMapMappingSlot(const OSDMapMappingSlot &other) {}
+  const OSDMapMappingSlot &operator=(const OSDMapMappingSlot &other) {
+    reset();
+    return *this;
+  }
+
+  OSDMapMappingRef get() const {
+    Spinlock::Locker l(lock);
+    return mapping;
+  }
+  void set(OSDMapMappingRef m) {
+    // the old mapping is released outside of the spinlock
+    OSDMapMappingRef old;
+    Spinlock::Locker l(lock);
+    old = mapping;
+    mapping = m;
+  }
+  void reset() {
+    set(OSDMapMappingRef());
+  }
+};
+
+#endif
@@ -0,0 +1,162 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "ObjectInfoCache.h"
+#include "common/perf_counters.h"
+
+ObjectInfoCache::lru_t::iterator ObjectInfoCache::_lookup(
+  const spg_t& pgid, const hobject_t& head)
+{
+  map<spg_t, pg_index_t>::iterator p = index.find(pgid);
+  if (p == index.end())
+    return lru.end();
+  pg_index_t::iterator q = p->second.find(head);
+  if (q == p->second.end())
+    return lru.end();
+  lru.splice(lru.begin(), lru, q->second);
+  return q->second;
+}
+
+ObjectInfoCache::Family *ObjectInfoCache::_get_or_create(
+  const spg_t& pgid, const hobject_t& head)
+{
+  lru_t::iterator p = _lookup(pgid, head);
+  if (p != lru.end())
+    return &*p;
+  lru.push_front(Family(pgid, head));
+  index[pgid][head] = lru.begin();
+  Family *f = &lru.front();
+  _add_bytes(f, sizeof(Family) + head.oid.name.length() +
+	     head.get_key().length() + head.get_namespace().length());
+  return f;
+}
+
+void ObjectInfoCache::_erase(lru_t::iterator p)
+{
+  map<spg_t, pg_index_t>::iterator i = index.find(p->pgid);
+  assert(i != index.end());
+  i->second.erase(p->head);
+  if (i->second.empty())
+    index.erase(i);
+  bytes -= p->bytes;
+  lru.erase(p);
+}
+
+void ObjectInfoCache::_add_bytes(Family *f, size_t b)
+{
+  f->bytes += b;
+  bytes += b;
+}
+
+void ObjectInfoCache::_trim()
+{
+  // never evict the family we just added to
+  while (bytes > max_bytes && lru.size() > 1)
+    _erase(--lru.end());
+  if (logger)
+    logger->set(l_bytes, bytes);
+}
+
+void ObjectInfoCache::_hit(bool hit)
+{
+  if (logger)
+    logger->inc(hit ? l_hit : l_miss);
+}
+
+bool ObjectInfoCache::get_oi(const spg_t& pgid, const hobject_t& oid,
+			     object_info_t *oi)
+{
+  Mutex::Locker l(lock);
+  lru_t::iterator p = _lookup(pgid, oid.get_head());
+  if (p != lru.end()) {
+    map<snapid_t, object_info_t>::iterator q = p->ois.find(oid.snap);
+    if (q != p->ois.end()) {
+      *oi = q->second;
+      _hit(true);
+      return true;
+    }
+  }
+  _hit(false);
+  return false;
+}
+
+void ObjectInfoCache::add_oi(const spg_t& pgid, const object_info_t& oi,
+			     size_t encoded_len)
+{
+  Mutex::Locker l(lock);
+  if (!max_bytes)
+    return;
+  Family *f = _get_or_create(pgid, oi.soid.get_head());
+  if (f->ois.count(oi.soid.snap))
+    return;
+  f->ois[oi.soid.snap] = oi;
+  _add_bytes(f, sizeof(object_info_t) + encoded_len);
+  _trim();
+}
+
+bool ObjectInfoCache::get_snapset(const spg_t& pgid, const hobject_t& head,
+				  SnapSet *ss)
+{
+  Mutex::Locker l(lock);
+  lru_t::iterator p = _lookup(pgid, head);
+  if (p != lru.end() && p->have_snapset) {
+    *ss = p->snapset;
+    _hit(true);
+    return true;
+  }
+  _hit(false);
+  return false;
+}
+
+void ObjectInfoCache::add_snapset(const spg_t& pgid, const hobject_t& head,
+				  const SnapSet& ss, size_t encoded_len)
+{
+  Mutex::Locker l(lock);
+  if (!max_bytes)
+    return;
+  Family *f = _get_or_create(pgid, head);
+  if (f->have_snapset)
+    return;
+  f->have_snapset = true;
+  f->snapset = ss;
+  _add_bytes(f, sizeof(SnapSet) + encoded_len);
+  _trim();
+}
+
+void ObjectInfoCache::invalidate(const spg_t& pgid, const hobject_t& oid)
+{
+  Mutex::Locker l(lock);
+  map<spg_t, pg_index_t>::iterator p = index.find(pgid);
+  if (p == index.end())
+    return;
+  pg_index_t::iterator q = p->second.find(oid.get_head());
+  if (q == p->second.end())
+    return;
+  _erase(q->second);
+  if (logger)
+    logger->set(l_bytes, bytes);
+}
+
+void ObjectInfoCache::clear_pg(const spg_t& pgid)
+{
+  Mutex::Locker l(lock);
+  map<spg_t, pg_index_t>::iterator p = index.find(pgid);
+  if (p == index.end())
+    return;
+  for (pg_index_t::iterator q = p->second.begin(); q != p->second.end(); ++q) {
+    bytes -= q->second->bytes;
+    lru.erase(q->second);
+  }
+  index.erase(p);
+  if (logger)
+    logger->set(l_bytes, bytes);
+}
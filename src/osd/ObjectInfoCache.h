@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_OBJECTINFOCACHE_H
+#define CEPH_OSD_OBJECTINFOCACHE_H
+
+#include <list>
+#include <map>
+
+#include "common/Mutex.h"
+#include "osd_types.h"
+
+class PerfCounters;
+
+/**
+ * Decoded object_info_t and SnapSet of recently used objects, by pg
+ *
+ * A pg adds what it reads from disk when it builds an ObjectContext or
+ * SnapSetContext, and looks here before reading again once the context
+ * has been dropped.  Entries are kept per snapshot family (head,
+ * snapdir and clones), since that is what a write may change: the pg
+ * invalidates the family of every object it writes, and all of its
+ * entries when its interval changes.
+ *
+ * Bounded by an estimate of the memory used, evicting the least
+ * recently used family first.  Shared by all pgs, hence the lock.
+ */
+class ObjectInfoCache {
+  struct Family {
+    spg_t pgid;
+    hobject_t head;
+    map<snapid_t, object_info_t> ois;
+    bool have_snapset;
+    SnapSet snapset;
+    size_t bytes;
+    Family(spg_t p, const hobject_t& h)
+      : pgid(p), head(h), have_snapset(false), bytes(0) {}
+  };
+  typedef list<Family> lru_t;
+  typedef map<hobject_t, lru_t::iterator> pg_index_t;
+
+  Mutex lock;
+  lru_t lru;  ///< most recently used first
+  map<spg_t, pg_index_t> index;
+  size_t bytes, max_bytes;
+
+  PerfCounters *logger;
+  int l_hit, l_miss, l_bytes;
+
+  lru_t::iterator _lookup(const spg_t& pgid, const hobject_t& head);
+  Family *_get_or_create(const spg_t& pgid, const hobject_t& head);
+  void _erase(lru_t::iterator p);
+  void _add_bytes(Family *f, size_t b);
+  void _trim();
+  void _hit(bool hit);
+
+public:
+  ObjectInfoCache(size_t max)
+    : lock("ObjectInfoCache::lock"), bytes(0), max_bytes(max),
+      logger(NULL), l_hit(0), l_miss(0), l_bytes(0) {}
+
+  void set_logger(PerfCounters *l, int hit, int miss, int b) {
+    logger = l;
+    l_hit = hit;
+    l_miss = miss;
+    l_bytes = b;
+  }
+
+  /// object_info_t of oid, if we have it
+  bool get_oi(const spg_t& pgid, const hobject_t& oid, object_info_t *oi);
+  /// encoded_len is the size of the attr oi was decoded from
+  void add_oi(const spg_t& pgid, const object_info_t& oi, size_t encoded_len);
+
+  /// SnapSet of the family of head, if we have it
+  bool get_snapset(const spg_t& pgid, const hobject_t& head, SnapSet *ss);
+  void add_snapset(const spg_t& pgid, const hobject_t& head,
+		   const SnapSet& ss, size_t encoded_len);
+
+  /// forget everything about oid's family; call before writing to it
+  void invalidate(const spg_t& pgid, const hobject_t& oid);
+  /// forget everything about pgid
+  void clear_pg(const spg_t& pgid);
+
+  size_t get_bytes() {
+    Mutex::Locker l(lock);
+    return bytes;
+  }
+};
+
+#endif
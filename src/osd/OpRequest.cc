@@ -36,18 +36,7 @@ void OpRequest::_dump(utime_t now, Formatter *f) const
     f->dump_int("tid", m->get_tid());
     f->close_section(); // client_info
   }
-  {
-    f->open_array_section("events");
-    for (list<pair<utime_t, string> >::const_iterator i = events.begin();
-	 i != events.end();
-	 ++i) {
-      f->open_object_section("event");
-      f->dump_stream("time") << i->first;
-      f->dump_string("event", i->second);
-      f->close_section();
-    }
-    f->close_section();
-  }
+  dump_events(f);
 }
 
 void OpRequest::init_from_message()
@@ -116,38 +116,39 @@ public:
   }
 
   void mark_queued_for_pg() {
-    mark_event("queued_for_pg");
-    current = "queued for pg";
+    mark_event(EVENT_QUEUED_FOR_PG);
+    current.clear();
     hit_flag_points |= flag_queued_for_pg;
     latest_flag_point = flag_queued_for_pg;
   }
   void mark_reached_pg() {
-    mark_event("reached_pg");
-    current = "reached pg";
+    mark_event(EVENT_REACHED_PG);
+    current.clear();
     hit_flag_points |= flag_reached_pg;
     latest_flag_point = flag_reached_pg;
   }
-  void mark_delayed(string s) {
-    mark_event(s);
+  void mark_delayed(const char *s) {
+    mark_event(EVENT_DELAYED, s);
     current = s;
     hit_flag_points |= flag_delayed;
     latest_flag_point = flag_delayed;
   }
   void mark_started() {
-    mark_event("started");
-    current = "started";
+    mark_event(EVENT_STARTED);
+    current.clear();
     hit_flag_points |= flag_started;
     latest_flag_point = flag_started;
   }
-  void mark_sub_op_sent(string s) {
-    mark_event(s);
+  /// s says who we wait for; only build it if is_sampled()
+  void mark_sub_op_sent(const string &s = string()) {
+    mark_event(EVENT_SUB_OP_SENT, s);
     current = s;
     hit_flag_points |= flag_sub_op_sent;
     latest_flag_point = flag_sub_op_sent;
   }
   void mark_commit_sent() {
-    mark_event("commit_sent");
-    current = "commit sent";
+    mark_event(EVENT_COMMIT_SENT);
+    current.clear();
     hit_flag_points |= flag_commit_sent;
     latest_flag_point = flag_commit_sent;
   }
@@ -178,6 +178,7 @@ PG::PG(OSDService *o, OSDMapRef curmap,
   heartbeat_peer_lock("PG::heartbeat_peer_lock"),
   backfill_reserved(0),
   backfill_reserving(0),
+  backfill_preempt(false),
   flushes_in_progress(0),
   pg_stats_publish_lock("PG::pg_stats_publish_lock"),
   pg_stats_publish_valid(false),
@@ -2891,9 +2892,9 @@ void PG::filter_snapc(SnapContext& snapc)
   }
 }
 
-void PG::requeue_object_waiters(map<hobject_t, list<OpRequestRef> >& m)
+void PG::requeue_object_waiters(object_waiters_t& m)
 {
-  for (map<hobject_t, list<OpRequestRef> >::iterator it = m.begin();
+  for (object_waiters_t::iterator it = m.begin();
        it != m.end();
        ++it)
     requeue_ops(it->second);
@@ -3192,6 +3193,43 @@ void PG::reject_reservation()
     get_osdmap()->get_epoch());
 }
 
+/*
+ * Only preempt when every backfill target can be told to give its slot
+ * back; a target that keeps it would ignore our next request.
+ */
+bool PG::backfill_preemptible()
+{
+  if (!cct->_conf->osd_backfill_preempt)
+    return false;
+  for (set<pg_shard_t>::iterator p = backfill_targets.begin();
+       p != backfill_targets.end();
+       ++p) {
+    ConnectionRef con = osd->get_con_osd_cluster(
+      p->osd, get_osdmap()->get_epoch());
+    if (!con || !con->has_feature(CEPH_FEATURE_OSD_BACKFILL_PREEMPT))
+      return false;
+  }
+  return true;
+}
+
+void PG::release_remote_backfill_reservations()
+{
+  for (set<pg_shard_t>::iterator p = backfill_targets.begin();
+       p != backfill_targets.end();
+       ++p) {
+    ConnectionRef con = osd->get_con_osd_cluster(
+      p->osd, get_osdmap()->get_epoch());
+    if (!con || !con->has_feature(CEPH_FEATURE_OSD_BACKFILL_PREEMPT))
+      continue;
+    osd->send_message_osd_cluster(
+      new MBackfillReserve(
+	MBackfillReserve::RELEASE,
+	spg_t(info.pgid.pgid, p->shard),
+	get_osdmap()->get_epoch()),
+      con.get());
+  }
+}
+
 void PG::schedule_backfill_full_retry()
 {
   Mutex::Locker lock(osd->backfill_request_lock);
@@ -3353,6 +3391,16 @@ int PG::build_scrub_map_chunk(
   get_pgbackend()->be_scan_list(map, ls, deep, handle);
   _scan_snaps(map);
 
+  if (deep) {
+    uint64_t bytes = 0;
+    for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
+      std::map<hobject_t, ScrubMap::object>::iterator o = map.objects.find(*p);
+      if (o != map.objects.end())
+	bytes += o->second.size;
+    }
+    osd->deep_scrub_read(bytes);
+  }
+
   // pg attrs
   osd->store->collection_getattrs(coll, map.attrs);
   dout(10) << __func__ << " done." << dendl;
@@ -3571,6 +3619,21 @@ void PG::replica_scrub(
  */
 void PG::scrub(ThreadPool::TPHandle &handle)
 {
+  // pace deep scrub to osd_deep_scrub_max_bytes_per_sec, without
+  // holding the pg lock while we wait
+  lock();
+  bool deep = scrubber.active && scrubber.deep;
+  unlock();
+  if (deep) {
+    utime_t wait = osd->deep_scrub_wait();
+    if (wait > utime_t()) {
+      dout(20) << "scrub waiting " << wait << " for deep scrub bandwidth" << dendl;
+      handle.suspend_tp_timeout();
+      wait.sleep();
+      handle.reset_tp_timeout();
+    }
+  }
+
   lock();
   if (deleting) {
     unlock();
@@ -5653,6 +5716,22 @@ PG::RecoveryState::Backfilling::react(const RemoteReservationRejected &)
   return transit<NotBackfilling>();
 }
 
+/*
+ * A higher priority reservation took our local slot, or a target's.
+ * Hand back whatever we still hold and queue up again; backfill picks
+ * up from last_backfill_started once we are Backfilling again.
+ */
+boost::statechart::result
+PG::RecoveryState::Backfilling::react(const DeferBackfill &)
+{
+  PG *pg = context< RecoveryMachine >().pg;
+  dout(10) << "backfill preempted, waiting for reservations" << dendl;
+  pg->osd->local_reserver.cancel_reservation(pg->info.pgid);
+  pg->release_remote_backfill_reservations();
+  pg->osd->recovery_wq.dequeue(pg);
+  return transit<WaitLocalBackfillReserved>();
+}
+
 void PG::RecoveryState::Backfilling::exit()
 {
   context< RecoveryMachine >().log_exit(state_name, enter_time);
@@ -5695,7 +5774,8 @@ PG::RecoveryState::WaitRemoteBackfillReserved::react(const RemoteBackfillReserve
           new MBackfillReserve(
 	  MBackfillReserve::REQUEST,
 	  spg_t(pg->info.pgid.pgid, backfill_osd_it->shard),
-	  pg->get_osdmap()->get_epoch(), priority),
+	  pg->get_osdmap()->get_epoch(), priority,
+	  pg->backfill_preempt),
 	con.get());
       } else {
         post_event(RemoteBackfillReserved());
@@ -5729,6 +5809,16 @@ PG::RecoveryState::WaitRemoteBackfillReserved::react(const RemoteReservationReje
   return transit<NotBackfilling>();
 }
 
+boost::statechart::result
+PG::RecoveryState::WaitRemoteBackfillReserved::react(const DeferBackfill &evt)
+{
+  PG *pg = context< RecoveryMachine >().pg;
+  dout(10) << "backfill preempted while reserving, starting over" << dendl;
+  pg->osd->local_reserver.cancel_reservation(pg->info.pgid);
+  pg->release_remote_backfill_reservations();
+  return transit<WaitLocalBackfillReserved>();
+}
+
 /*--WaitLocalBackfillReserved--*/
 PG::RecoveryState::WaitLocalBackfillReserved::WaitLocalBackfillReserved(my_context ctx)
   : my_base(ctx),
@@ -5737,12 +5827,17 @@ PG::RecoveryState::WaitLocalBackfillReserved::WaitLocalBackfillReserved(my_conte
   context< RecoveryMachine >().log_enter(state_name);
   PG *pg = context< RecoveryMachine >().pg;
   pg->state_set(PG_STATE_BACKFILL_WAIT);
+  pg->backfill_preempt = pg->backfill_preemptible();
   pg->osd->local_reserver.request_reservation(
     pg->info.pgid,
     new QueuePeeringEvt<LocalBackfillReserved>(
       pg, pg->get_osdmap()->get_epoch(),
       LocalBackfillReserved()), pg->is_degraded() ? OSDService::BACKFILL_HIGH
-	 : OSDService::BACKFILL_LOW);
+	 : OSDService::BACKFILL_LOW,
+    pg->backfill_preempt ?
+      new QueuePeeringEvt<DeferBackfill>(
+	pg, pg->get_osdmap()->get_epoch(),
+	DeferBackfill()) : NULL);
 }
 
 void PG::RecoveryState::WaitLocalBackfillReserved::exit()
@@ -5847,7 +5942,11 @@ PG::RecoveryState::RepNotRecovering::react(const RequestBackfillPrio &evt)
       pg->info.pgid,
       new QueuePeeringEvt<RemoteBackfillReserved>(
         pg, pg->get_osdmap()->get_epoch(),
-        RemoteBackfillReserved()), evt.priority);
+        RemoteBackfillReserved()), evt.priority,
+      evt.preemptible && pg->cct->_conf->osd_backfill_preempt ?
+        new QueuePeeringEvt<RepBackfillPreempted>(
+	  pg, pg->get_osdmap()->get_epoch(),
+	  RepBackfillPreempted()) : NULL);
   }
   return transit<RepWaitBackfillReserved>();
 }
@@ -5882,6 +5981,15 @@ PG::RecoveryState::RepWaitBackfillReserved::react(const RemoteReservationRejecte
   return transit<RepNotRecovering>();
 }
 
+boost::statechart::result
+PG::RecoveryState::RepWaitBackfillReserved::react(const RecoveryDone &evt)
+{
+  // the primary was preempted before we granted
+  PG *pg = context< RecoveryMachine >().pg;
+  pg->osd->remote_reserver.cancel_reservation(pg->info.pgid);
+  return transit<RepNotRecovering>();
+}
+
 /*---RepRecovering-------*/
 PG::RecoveryState::RepRecovering::RepRecovering(my_context ctx)
   : my_base(ctx),
@@ -5898,6 +6006,21 @@ PG::RecoveryState::RepRecovering::react(const BackfillTooFull &)
   return transit<RepNotRecovering>();
 }
 
+boost::statechart::result
+PG::RecoveryState::RepRecovering::react(const RepBackfillPreempted &)
+{
+  PG *pg = context< RecoveryMachine >().pg;
+  dout(10) << "backfill reservation preempted, revoking" << dendl;
+  pg->osd->send_message_osd_cluster(
+    pg->primary.osd,
+    new MBackfillReserve(
+      MBackfillReserve::REVOKE,
+      spg_t(pg->info.pgid.pgid, pg->primary.shard),
+      pg->get_osdmap()->get_epoch()),
+    pg->get_osdmap()->get_epoch());
+  return transit<RepNotRecovering>();
+}
+
 void PG::RecoveryState::RepRecovering::exit()
 {
   context< RecoveryMachine >().log_exit(state_name, enter_time);
@@ -626,6 +626,7 @@ protected:
   map<pg_shard_t, BackfillInterval> peer_backfill_info;
   bool backfill_reserved;
   bool backfill_reserving;
+  bool backfill_preempt;  ///< current backfill reservations may be preempted
 
   friend class OSD;
 
@@ -646,16 +647,18 @@ protected:
   list<OpRequestRef>            waiting_for_active;
   list<OpRequestRef>            waiting_for_cache_not_full;
   list<OpRequestRef>            waiting_for_all_missing;
-  map<hobject_t, list<OpRequestRef> > waiting_for_unreadable_object,
-			     waiting_for_degraded_object,
-			     waiting_for_blocked_object;
+  // looked up by object on every op; never walked in order
+  typedef ceph::unordered_map<hobject_t, list<OpRequestRef> > object_waiters_t;
+  object_waiters_t waiting_for_unreadable_object,
+		   waiting_for_degraded_object,
+		   waiting_for_blocked_object;
   // Callbacks should assume pg (and nothing else) is locked
-  map<hobject_t, list<Context*> > callbacks_for_degraded_object;
+  ceph::unordered_map<hobject_t, list<Context*> > callbacks_for_degraded_object;
   map<eversion_t,list<OpRequestRef> > waiting_for_ack, waiting_for_ondisk;
   map<eversion_t,OpRequestRef>   replay_queue;
   void split_ops(PG *child, unsigned split_bits);
 
-  void requeue_object_waiters(map<hobject_t, list<OpRequestRef> >& m);
+  void requeue_object_waiters(object_waiters_t& m);
   void requeue_op(OpRequestRef op);
   void requeue_ops(list<OpRequestRef> &l);
 
@@ -1156,6 +1159,8 @@ public:
 
   void reject_reservation();
   void schedule_backfill_full_retry();
+  bool backfill_preemptible();
+  void release_remote_backfill_reservations();
 
   // -- recovery state --
 
@@ -1291,11 +1296,14 @@ public:
   };
   struct RequestBackfillPrio : boost::statechart::event< RequestBackfillPrio > {
     unsigned priority;
-    RequestBackfillPrio(unsigned prio) :
+    bool preemptible;
+    RequestBackfillPrio(unsigned prio, bool preemptible = false) :
               boost::statechart::event< RequestBackfillPrio >(),
-			  priority(prio) {}
+			  priority(prio), preemptible(preemptible) {}
     void print(std::ostream *out) const {
       *out << "RequestBackfillPrio: priority " << priority;
+      if (preemptible)
+	*out << " preemptible";
     }
   };
 #define TrivialEvent(T) struct T : boost::statechart::event< T > { \
@@ -1319,6 +1327,9 @@ public:
   TrivialEvent(RequestRecovery)
   TrivialEvent(RecoveryDone)
   TrivialEvent(BackfillTooFull)
+  TrivialEvent(DeferBackfill)
+  TrivialEvent(RemoteBackfillPreempted)
+  TrivialEvent(RepBackfillPreempted)
 
   TrivialEvent(AllReplicasRecovered)
   TrivialEvent(DoRecovery)
@@ -1603,10 +1614,17 @@ public:
     struct Backfilling : boost::statechart::state< Backfilling, Active >, NamedState {
       typedef boost::mpl::list<
 	boost::statechart::transition< Backfilled, Recovered >,
-	boost::statechart::custom_reaction< RemoteReservationRejected >
+	boost::statechart::custom_reaction< RemoteReservationRejected >,
+	boost::statechart::custom_reaction< DeferBackfill >,
+	boost::statechart::custom_reaction< RemoteBackfillPreempted >
 	> reactions;
       Backfilling(my_context ctx);
       boost::statechart::result react(const RemoteReservationRejected& evt);
+      boost::statechart::result react(const DeferBackfill& evt);
+      boost::statechart::result react(const RemoteBackfillPreempted& evt) {
+	post_event(DeferBackfill());
+	return discard_event();
+      }
       void exit();
     };
 
@@ -1614,6 +1632,8 @@ public:
       typedef boost::mpl::list<
 	boost::statechart::custom_reaction< RemoteBackfillReserved >,
 	boost::statechart::custom_reaction< RemoteReservationRejected >,
+	boost::statechart::custom_reaction< DeferBackfill >,
+	boost::statechart::custom_reaction< RemoteBackfillPreempted >,
 	boost::statechart::transition< AllBackfillsReserved, Backfilling >
 	> reactions;
       set<pg_shard_t>::const_iterator backfill_osd_it;
@@ -1621,6 +1641,11 @@ public:
       void exit();
       boost::statechart::result react(const RemoteBackfillReserved& evt);
       boost::statechart::result react(const RemoteReservationRejected& evt);
+      boost::statechart::result react(const DeferBackfill& evt);
+      boost::statechart::result react(const RemoteBackfillPreempted& evt) {
+	post_event(DeferBackfill());
+	return discard_event();
+      }
     };
 
     struct WaitLocalBackfillReserved : boost::statechart::state< WaitLocalBackfillReserved, Active >, NamedState {
@@ -1663,22 +1688,26 @@ public:
     struct RepRecovering : boost::statechart::state< RepRecovering, ReplicaActive >, NamedState {
       typedef boost::mpl::list<
 	boost::statechart::transition< RecoveryDone, RepNotRecovering >,
-	boost::statechart::custom_reaction< BackfillTooFull >
+	boost::statechart::custom_reaction< BackfillTooFull >,
+	boost::statechart::custom_reaction< RepBackfillPreempted >
 	> reactions;
       RepRecovering(my_context ctx);
       boost::statechart::result react(const BackfillTooFull &evt);
+      boost::statechart::result react(const RepBackfillPreempted &evt);
       void exit();
     };
 
     struct RepWaitBackfillReserved : boost::statechart::state< RepWaitBackfillReserved, ReplicaActive >, NamedState {
       typedef boost::mpl::list<
 	boost::statechart::custom_reaction< RemoteBackfillReserved >,
-	boost::statechart::custom_reaction< RemoteReservationRejected >
+	boost::statechart::custom_reaction< RemoteReservationRejected >,
+	boost::statechart::custom_reaction< RecoveryDone >
 	> reactions;
       RepWaitBackfillReserved(my_context ctx);
       void exit();
       boost::statechart::result react(const RemoteBackfillReserved &evt);
       boost::statechart::result react(const RemoteReservationRejected &evt);
+      boost::statechart::result react(const RecoveryDone &evt);
     };
 
     struct RepWaitRecoveryReserved : boost::statechart::state< RepWaitRecoveryReserved, ReplicaActive >, NamedState {
@@ -141,6 +141,49 @@ int PGBackend::objects_list_partial(
   return r;
 }
 
+int PGBackend::objects_list_partial_attr(
+  const hobject_t &begin,
+  int min,
+  int max,
+  snapid_t seq,
+  const string &attr,
+  vector<hobject_t> *ls,
+  vector<bufferptr> *attrs,
+  hobject_t *next)
+{
+  assert(ls);
+  assert(attrs);
+  ghobject_t _next(begin);
+  ls->reserve(max);
+  attrs->reserve(max);
+  int r = 0;
+  while (!_next.is_max() && ls->size() < (unsigned)min) {
+    vector<ghobject_t> objects;
+    vector<bufferptr> values;
+    int r = store->collection_list_partial_attr(
+      coll,
+      _next,
+      min - ls->size(),
+      max - ls->size(),
+      seq,
+      attr.c_str(),
+      &objects,
+      &values,
+      &_next);
+    if (r != 0)
+      break;
+    for (unsigned i = 0; i < objects.size(); ++i) {
+      if (objects[i].is_no_gen()) {
+	ls->push_back(objects[i].hobj);
+	attrs->push_back(values[i]);
+      }
+    }
+  }
+  if (r == 0)
+    *next = _next.hobj;
+  return r;
+}
+
 int PGBackend::objects_list_range(
   const hobject_t &start,
   const hobject_t &end,
@@ -291,6 +334,17 @@ PGBackend *PGBackend::build_pg_backend(
   }
 }
 
+int PGBackend::be_deep_scrub_read(
+  const hobject_t &poid, uint64_t off, uint64_t len, bufferlist &bl)
+{
+  ghobject_t goid(poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard);
+  // a deep scrub reads everything once; don't push hot data out of the
+  // page cache for it
+  if (g_conf->osd_deep_scrub_drop_cache)
+    return store->read_once(coll, goid, off, len, bl, true);
+  return store->read(coll, goid, off, len, bl, true);
+}
+
 /*
  * pg lock may or may not be held
  */
@@ -469,7 +523,7 @@ map<pg_shard_t, ScrubMap *>::const_iterator
       // invalid object info, probably corrupt
       continue;
     }
-    uint64_t correct_size = be_get_ondisk_size(oi.size);
+    uint64_t correct_size = be_get_ondisk_size(oi.size, i->second.attrs);
     if (correct_size != i->second.size) {
       // invalid size, probably corrupt
       dout(10) << __func__ << ": rejecting osd " << j->first
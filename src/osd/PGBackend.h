@@ -535,6 +535,17 @@
      vector<hobject_t> *ls,
      hobject_t *next);
 
+   /// List objects in collection, with the value of attr for each
+   int objects_list_partial_attr(
+     const hobject_t &begin,
+     int min,
+     int max,
+     snapid_t seq,
+     const string &attr,
+     vector<hobject_t> *ls,
+     vector<bufferptr> *attrs,
+     hobject_t *next);
+
    int objects_list_range(
      const hobject_t &start,
      const hobject_t &end,
@@ -562,7 +573,18 @@
 		pair<bufferlist*, Context*> > > &to_read,
      Context *on_complete) = 0;
 
+   /**
+    * true if a write to hoid at off (which is not an append to the
+    * end of a stripe) can be done so that it can be rolled back
+    */
+   virtual bool can_rollback_write(
+     const hobject_t &hoid,
+     uint64_t off) { return false; }
+
    virtual bool scrub_supported() { return false; }
+
+   /// true if a replicated write to hoid is here but not yet applied and on disk
+   virtual bool is_write_in_flight(const hobject_t &hoid) const { return false; }
    void be_scan_list(
      ScrubMap &map, const vector<hobject_t> &ls, bool deep,
      ThreadPool::TPHandle &handle);
@@ -584,11 +606,15 @@
      const vector<int> &acting,
      ostream &errorstream);
    virtual uint64_t be_get_ondisk_size(
-     uint64_t logical_size) { assert(0); return 0; }
+     uint64_t logical_size,
+     const map<string, bufferptr> &attrs) { assert(0); return 0; }
    virtual void be_deep_scrub(
      const hobject_t &poid,
      ScrubMap::object &o,
      ThreadPool::TPHandle &handle) { assert(0); }
+   /// read our shard of poid for a deep scrub
+   int be_deep_scrub_read(
+     const hobject_t &poid, uint64_t off, uint64_t len, bufferlist &bl);
 
    static PGBackend *build_pg_backend(
      const pg_pool_t &pool,
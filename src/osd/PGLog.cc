@@ -55,7 +55,7 @@ void PGLog::IndexedLog::split_into(
 void PGLog::IndexedLog::trim(
   LogEntryHandler *handler,
   eversion_t s,
-  set<eversion_t> *trimmed)
+  eversion_t *trimmed_to)
 {
   if (complete_to != log.end() &&
       complete_to->version <= s) {
@@ -68,8 +68,8 @@ void PGLog::IndexedLog::trim(
     if (e.version > s)
       break;
     generic_dout(20) << "trim " << e << dendl;
-    if (trimmed)
-      trimmed->insert(e.version);
+    if (trimmed_to)
+      *trimmed_to = e.version;
     handler->trim(e);
     unindex(e);         // remove from index,
     log.pop_front();    // from log
@@ -139,7 +139,7 @@ void PGLog::trim(
     assert(trim_to <= info.last_complete);
 
     dout(10) << "trim " << log << " to " << trim_to << dendl;
-    log.trim(handler, trim_to, &trimmed);
+    log.trim(handler, trim_to, &trimmed_to);
     info.log_tail = log.tail;
   }
 }
@@ -422,13 +422,13 @@ void PGLog::rewind_divergent_log(ObjectStore::Transaction& t, eversion_t newhead
       break;
     }
     --p;
-    mark_dirty_from(p->version);
     if (p->version <= newhead) {
       ++p;
       divergent.splice(divergent.begin(), log.log, p, log.log.end());
       break;
     }
     assert(p->version > newhead);
+    mark_dirty_from(p->version);
     dout(10) << "rewind_divergent_log future divergent " << *p << dendl;
   }
 
@@ -535,7 +535,8 @@ void PGLog::merge_log(ObjectStore::Transaction& t,
 	break;
       }
     }
-    mark_dirty_from(lower_bound);
+    // entries up to lower_bound are shared and already on disk
+    mark_dirty_from(eversion_t(lower_bound.epoch, lower_bound.version + 1));
 
     // index, update missing, delete deleted
     for (list<pg_log_entry_t>::iterator p = from; p != to; ++p) {
@@ -609,14 +610,14 @@ void PGLog::write_log(
 	     << ", dirty_from: " << dirty_from
 	     << ", dirty_divergent_priors: " << dirty_divergent_priors
 	     << ", writeout_from: " << writeout_from
-	     << ", trimmed: " << trimmed
+	     << ", trimmed_to: " << trimmed_to
 	     << dendl;
     _write_log(
       t, log, log_oid, divergent_priors,
       dirty_to,
       dirty_from,
       writeout_from,
-      trimmed,
+      trimmed_to,
       dirty_divergent_priors,
       !touched_log,
       (pg_log_debug ? &log_keys_debug : 0));
@@ -632,7 +633,7 @@ void PGLog::write_log(ObjectStore::Transaction& t, pg_log_t &log,
   _write_log(
     t, log, log_oid,
     divergent_priors, eversion_t::max(), eversion_t(), eversion_t(),
-    set<eversion_t>(),
+    eversion_t(),
     true, true, 0);
 }
 
@@ -642,26 +643,24 @@ void PGLog::_write_log(
   eversion_t dirty_to,
   eversion_t dirty_from,
   eversion_t writeout_from,
-  const set<eversion_t> &trimmed,
+  eversion_t trimmed_to,
   bool dirty_divergent_priors,
   bool touch_log,
   set<string> *log_keys_debug
   )
 {
-  set<string> to_remove;
-  for (set<eversion_t>::const_iterator i = trimmed.begin();
-       i != trimmed.end();
-       ++i) {
-    to_remove.insert(i->get_key_name());
-    if (log_keys_debug) {
-      assert(log_keys_debug->count(i->get_key_name()));
-      log_keys_debug->erase(i->get_key_name());
-    }
-  }
-
 //dout(10) << "write_log, clearing up to " << dirty_to << dendl;
   if (touch_log)
     t.touch(coll_t(), log_oid);
+  if (trimmed_to != eversion_t() && trimmed_to >= dirty_to) {
+    // we trim from the tail, so this is everything up to trimmed_to
+    string end = eversion_t(trimmed_to.epoch,
+			    trimmed_to.version + 1).get_key_name();
+    t.omap_rmkeyrange(
+      coll_t(), log_oid,
+      eversion_t().get_key_name(), end);
+    clear_up_to(log_keys_debug, end);
+  }
   if (dirty_to != eversion_t()) {
     t.omap_rmkeyrange(
       coll_t(), log_oid,
@@ -710,7 +709,6 @@ void PGLog::_write_log(
   }
   ::encode(log.can_rollback_to, keys["can_rollback_to"]);
 
-  t.omap_rmkeys(coll_t::META_COLL, log_oid, to_remove);
   t.omap_setkeys(coll_t::META_COLL, log_oid, keys);
 }
 
@@ -58,14 +58,18 @@ struct PGLog {
    */
   struct IndexedLog : public pg_log_t {
     ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
-    ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
+
+    // only the primary looks up requests, so caller_ops is built on the
+    // first lookup rather than kept for every entry of every pg
+    mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
+    mutable bool caller_ops_indexed;
 
     // recovery pointers
     list<pg_log_entry_t>::iterator complete_to;  // not inclusive of referenced item
     version_t last_requested;           // last object requested by primary
 
     /****/
-    IndexedLog() : last_requested(0) {}
+    IndexedLog() : caller_ops_indexed(false), last_requested(0) {}
 
     void claim_log(const pg_log_t& o) {
       log = o.log;
@@ -93,26 +97,39 @@ struct PGLog {
       return objects.count(oid);
     }
     bool logged_req(const osd_reqid_t &r) const {
+      index_caller_ops();
       return caller_ops.count(r);
     }
     const pg_log_entry_t *get_request(const osd_reqid_t &r) const {
+      index_caller_ops();
       ceph::unordered_map<osd_reqid_t,pg_log_entry_t*>::const_iterator p = caller_ops.find(r);
       if (p == caller_ops.end())
 	return NULL;
       return p->second;
     }
 
+    void index_caller_ops() const {
+      if (caller_ops_indexed)
+	return;
+      for (list<pg_log_entry_t>::const_iterator i = log.begin();
+           i != log.end();
+           ++i) {
+	if (i->reqid_is_indexed()) {
+	  //assert(caller_ops.count(i->reqid) == 0);  // divergent merge_log indexes new before unindexing old
+	  caller_ops[i->reqid] = const_cast<pg_log_entry_t*>(&(*i));
+	}
+      }
+      caller_ops_indexed = true;
+    }
+
     void index() {
       objects.clear();
       caller_ops.clear();
+      caller_ops_indexed = false;
       for (list<pg_log_entry_t>::iterator i = log.begin();
            i != log.end();
            ++i) {
         objects[i->soid] = &(*i);
-	if (i->reqid_is_indexed()) {
-	  //assert(caller_ops.count(i->reqid) == 0);  // divergent merge_log indexes new before unindexing old
-	  caller_ops[i->reqid] = &(*i);
-	}
       }
     }
 
@@ -120,7 +137,7 @@ struct PGLog {
       if (objects.count(e.soid) == 0 || 
           objects[e.soid]->version < e.version)
         objects[e.soid] = &e;
-      if (e.reqid_is_indexed()) {
+      if (caller_ops_indexed && e.reqid_is_indexed()) {
 	//assert(caller_ops.count(i->reqid) == 0);  // divergent merge_log indexes new before unindexing old
 	caller_ops[e.reqid] = &e;
       }
@@ -128,12 +145,14 @@ struct PGLog {
     void unindex() {
       objects.clear();
       caller_ops.clear();
+      caller_ops_indexed = false;
     }
     void unindex(pg_log_entry_t& e) {
       // NOTE: this only works if we remove from the _tail_ of the log!
       if (objects.count(e.soid) && objects[e.soid]->version == e.version)
         objects.erase(e.soid);
-      if (e.reqid_is_indexed() &&
+      if (caller_ops_indexed &&
+	  e.reqid_is_indexed() &&
 	  caller_ops.count(e.reqid) &&  // divergent merge_log indexes new before unindexing old
 	  caller_ops[e.reqid] == &e)
 	caller_ops.erase(e.reqid);
@@ -143,20 +162,21 @@ struct PGLog {
     void add(pg_log_entry_t& e) {
       // add to log
       log.push_back(e);
+      log.back().compact_buffers();
       assert(e.version > head);
       assert(head.version == 0 || e.version.version > head.version);
       head = e.version;
 
       // to our index
       objects[e.soid] = &(log.back());
-      if (e.reqid_is_indexed())
+      if (caller_ops_indexed && e.reqid_is_indexed())
 	caller_ops[e.reqid] = &(log.back());
     }
 
     void trim(
       LogEntryHandler *handler,
       eversion_t s,
-      set<eversion_t> *trimmed);
+      eversion_t *trimmed_to);
 
     ostream& print(ostream& out) const;
   };
@@ -175,7 +195,7 @@ protected:
   eversion_t dirty_to;         ///< must clear/writeout all keys up to dirty_to
   eversion_t dirty_from;       ///< must clear/writeout all keys past dirty_from
   eversion_t writeout_from;    ///< must writout keys past writeout_from
-  set<eversion_t> trimmed;     ///< must clear keys in trimmed
+  eversion_t trimmed_to;       ///< must clear keys up to trimmed_to
   bool dirty_divergent_priors;
   CephContext *cct;
 
@@ -185,7 +205,7 @@ protected:
       (dirty_from != eversion_t::max()) ||
       dirty_divergent_priors ||
       (writeout_from != eversion_t::max()) ||
-      !(trimmed.empty());
+      (trimmed_to != eversion_t());
   }
   void mark_dirty_to(eversion_t to) {
     if (to > dirty_to)
@@ -243,7 +263,7 @@ protected:
     dirty_from = eversion_t::max();
     dirty_divergent_priors = false;
     touched_log = true;
-    trimmed.clear();
+    trimmed_to = eversion_t();
     writeout_from = eversion_t::max();
     check();
   }
@@ -434,7 +454,7 @@ public:
     eversion_t dirty_to,
     eversion_t dirty_from,
     eversion_t writeout_from,
-    const set<eversion_t> &trimmed,
+    eversion_t trimmed_to,
     bool dirty_divergent_priors,
     bool touch_log,
     set<string> *log_keys_debug
@@ -202,6 +202,7 @@ void ReplicatedBackend::_on_change(ObjectStore::Transaction *t)
     if (i->second.on_applied)
       delete i->second.on_applied;
   }
+  writes_in_flight.clear();
   clear_state();
 }
 
@@ -558,7 +559,7 @@ void ReplicatedBackend::op_applied(
 {
   dout(10) << __func__ << ": " << op->tid << dendl;
   if (op->op)
-    op->op->mark_event("op_applied");
+    op->op->mark_event(TrackedOp::EVENT_OP_APPLIED);
 
   op->waiting_for_applied.erase(get_parent()->whoami_shard());
   parent->op_applied(op->v);
@@ -578,7 +579,7 @@ void ReplicatedBackend::op_commit(
 {
   dout(10) << __func__ << ": " << op->tid << dendl;
   if (op->op)
-    op->op->mark_event("op_commit");
+    op->op->mark_event(TrackedOp::EVENT_OP_COMMIT);
 
   op->waiting_for_commit.erase(get_parent()->whoami_shard());
 
@@ -628,11 +629,11 @@ void ReplicatedBackend::sub_op_modify_reply(OpRequestRef op)
       assert(ip_op.waiting_for_commit.count(from));
       ip_op.waiting_for_commit.erase(from);
       if (ip_op.op)
-	ip_op.op->mark_event("sub_op_commit_rec");
+	ip_op.op->mark_event(TrackedOp::EVENT_SUB_OP_COMMIT_REC);
     } else {
       assert(ip_op.waiting_for_applied.count(from));
       if (ip_op.op)
-	ip_op.op->mark_event("sub_op_applied_rec");
+	ip_op.op->mark_event(TrackedOp::EVENT_SUB_OP_APPLIED_REC);
     }
     ip_op.waiting_for_applied.erase(from);
 
@@ -665,13 +666,10 @@ void ReplicatedBackend::be_deep_scrub(
   bufferlist bl, hdrbl;
   int r;
   __u64 pos = 0;
-  while ( (r = store->read(
-	     coll,
-	     ghobject_t(
-	       poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+  while ( (r = be_deep_scrub_read(
+	     poid,
 	     pos,
-	     cct->_conf->osd_deep_scrub_stride, bl,
-	     true)) > 0) {
+	     cct->_conf->osd_deep_scrub_stride, bl)) > 0) {
     handle.reset_tp_timeout();
     h << bl;
     pos += bl.length();
@@ -685,6 +683,27 @@ void ReplicatedBackend::be_deep_scrub(
   o.digest = h.digest();
   o.digest_present = true;
 
+  // check against what was recorded when it was written
+  map<string, bufferptr>::iterator a = o.attrs.find(OI_ATTR);
+  if (r == 0 && a != o.attrs.end()) {
+    bufferlist bv;
+    bv.push_back(a->second);
+    object_info_t oi;
+    try {
+      bufferlist::iterator bp = bv.begin();
+      oi.decode(bp);
+    } catch (buffer::error& e) {
+      oi.clear_data_digest();
+    }
+    if (oi.is_data_digest() && oi.size == pos &&
+	oi.data_digest != o.digest) {
+      derr << "_scan_list  " << poid << " data digest 0x" << std::hex
+	   << o.digest << " != recorded 0x" << oi.data_digest << std::dec
+	   << ", read_error" << dendl;
+      o.read_error = true;
+    }
+  }
+
   bl.clear();
   r = store->omap_get_header(
     coll,
@@ -300,7 +300,10 @@ private:
 		 eversion_t version,
 		 interval_set<uint64_t> &data_subset,
 		 map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-		 PushOp *op);
+		 PushOp *op,
+		 bool partial = false);
+  bool calc_partial_push(ObjectContextRef obc, const hobject_t& soid,
+			 pg_shard_t peer, interval_set<uint64_t>& data_subset);
   void calc_head_subsets(ObjectContextRef obc, SnapSet& snapset, const hobject_t& head,
 			 const pg_missing_t& missing,
 			 const hobject_t &last_backfill,
@@ -374,6 +377,7 @@ private:
     int ackerosd;
     eversion_t last_complete;
     epoch_t epoch_started;
+    set<hobject_t> objects;  ///< in writes_in_flight until applied and committed
 
     uint64_t bytes_written;
 
@@ -406,11 +410,20 @@ private:
   void sub_op_modify_commit(RepModifyRef rm);
   bool scrub_supported() { return true; }
 
+  /// objects with sub ops not yet both applied and committed, as a replica
+  map<hobject_t, int> writes_in_flight;
+  void sub_op_modify_done(RepModifyRef rm);
+  bool is_write_in_flight(const hobject_t &hoid) const {
+    return writes_in_flight.count(hoid);
+  }
+
   void be_deep_scrub(
     const hobject_t &obj,
     ScrubMap::object &o,
     ThreadPool::TPHandle &handle);
-  uint64_t be_get_ondisk_size(uint64_t logical_size) { return logical_size; }
+  uint64_t be_get_ondisk_size(
+    uint64_t logical_size,
+    const map<string, bufferptr> &attrs) { return logical_size; }
 };
 
 #endif
@@ -58,6 +58,12 @@
 #include "json_spirit/json_spirit_reader.h"
 #include "include/assert.h"  // json_spirit clobbers it
 
+#ifdef WITH_LTTNG
+#include "tracing/osd.h"
+#else
+#define tracepoint(...)
+#endif
+
 #define dout_subsys ceph_subsys_osd
 #define DOUT_PREFIX_ARGS this, osd->whoami, get_osdmap()
 #undef dout_prefix
@@ -73,6 +79,16 @@ static ostream& _prefix(std::ostream *_dout, T *pg) {
 
 #include <errno.h>
 
+static void trace_op_reply(OpRequestRef op, MOSDOpReply *reply)
+{
+#ifdef WITH_LTTNG
+  osd_reqid_t reqid = op->get_reqid();
+  tracepoint(ceph_osd, op_reply,
+	     reqid.name.type(), reqid.name.num(), reqid.tid, reqid.inc,
+	     op->get_seq(), reply->get_result(), reply->get_flags());
+#endif
+}
+
 PGLSFilter::PGLSFilter()
 {
 }
@@ -204,6 +220,7 @@ void ReplicatedPG::on_local_recover(
   )
 {
   dout(10) << __func__ << ": " << hoid << dendl;
+  osd->oi_cache.invalidate(info.pgid, hoid);
   ObjectRecoveryInfo recovery_info(_recovery_info);
   if (recovery_info.soid.snap < CEPH_NOSNAP) {
     assert(recovery_info.oi.snaps.size());
@@ -515,27 +532,61 @@ bool PGLSParentFilter::filter(bufferlist& xattr_data, bufferlist& outdata)
 
 bool PGLSPlainFilter::filter(bufferlist& xattr_data, bufferlist& outdata)
 {
-  if (val.size() != xattr_data.length())
+  return xattr_data.contents_equal(val.c_str(), val.size());
+}
+
+bool PGLSFilter::filter_object(const hobject_t& obj, PGBackend *backend,
+			       bufferlist& outdata)
+{
+  bufferlist bl;
+  int ret = backend->objects_get_attr(obj, get_xattr(), &bl);
+  if (ret < 0)
+    return false;
+  return filter(bl, outdata);
+}
+
+bool PGLSObjectFilter::filter(bufferlist& xattr_data, bufferlist& outdata)
+{
+  return xattr_data.contents_equal(f.xattr_value);
+}
+
+bool PGLSObjectFilter::filter_object(const hobject_t& obj, PGBackend *backend,
+				     bufferlist& outdata)
+{
+  // cheapest first: the name needs no reads
+  if (obj.oid.name.compare(0, f.prefix.length(), f.prefix) != 0)
     return false;
 
-  if (memcmp(val.c_str(), xattr_data.c_str(), val.size()))
+  pg_ls_info_t info;
+  if (f.needs_object_info()) {
+    bufferlist bl;
+    int ret = backend->objects_get_attr(obj, OI_ATTR, &bl);
+    if (ret < 0)
+      return false;
+    object_info_t oi(bl);
+    info.size = oi.size;
+    info.mtime = oi.mtime;
+    if (info.size < f.min_size || info.size > f.max_size)
+      return false;
+    if (info.mtime < f.min_mtime ||
+	(!f.max_mtime.is_zero() && info.mtime > f.max_mtime))
+      return false;
+  }
+
+  if (xattr.length() && !PGLSFilter::filter_object(obj, backend, outdata))
     return false;
 
+  if (f.want_info)
+    ::encode(info, outdata);
   return true;
 }
 
 bool ReplicatedPG::pgls_filter(PGLSFilter *filter, hobject_t& sobj, bufferlist& outdata)
 {
-  bufferlist bl;
-  int ret = pgbackend->objects_get_attr(
-    sobj,
-    filter->get_xattr(),
-    &bl);
-  dout(0) << "getattr (sobj=" << sobj << ", attr=" << filter->get_xattr() << ") returned " << ret << dendl;
-  if (ret < 0)
-    return false;
-
-  return filter->filter(bl, outdata);
+  bool r = filter->filter_object(sobj, pgbackend.get(), outdata);
+  dout(20) << "pgls_filter " << sobj << " attr " << filter->get_xattr()
+	   << (r ? " matches" : " does not match") << dendl;
+  return r;
 }
 
 int ReplicatedPG::get_pgls_filter(bufferlist::iterator& iter, PGLSFilter **pfilter)
@@ -550,11 +601,18 @@ int ReplicatedPG::get_pgls_filter(bufferlist::iterator& iter, PGLSFilter **pfilt
     return -EINVAL;
   }
 
-  if (type.compare("parent") == 0) {
-    filter = new PGLSParentFilter(iter);
-  } else if (type.compare("plain") == 0) {
-    filter = new PGLSPlainFilter(iter);
-  } else {
+  try {
+    if (type.compare("parent") == 0) {
+      filter = new PGLSParentFilter(iter);
+    } else if (type.compare("plain") == 0) {
+      filter = new PGLSPlainFilter(iter);
+    } else if (type.compare("object") == 0) {
+      filter = new PGLSObjectFilter(iter);
+    } else {
+      return -EINVAL;
+    }
+  }
+  catch (buffer::error& e) {
     return -EINVAL;
   }
 
@@ -1029,10 +1087,15 @@ ReplicatedPG::ReplicatedPG(OSDService *o, OSDMapRef curmap,
   pgbackend(
     PGBackend::build_pg_backend(
       _pool.info, this, coll_t(p), coll_t::make_temp_coll(p), o->store, cct)),
+  object_contexts(cct->_conf->osd_pg_object_context_cache_count,
+		  cct->_conf->osd_pg_object_context_cache_shards),
   snapset_contexts_lock("ReplicatedPG::snapset_contexts"),
   temp_seq(0),
+  data_digest_epoch(0), data_digest_ok(false),
   snap_trimmer_machine(this)
 { 
+  object_contexts.set_logger(osd->logger, l_osd_obc_cache_hit,
+			     l_osd_obc_cache_miss, l_osd_obc_cache_evict);
   missing_loc.set_backend_predicates(
     pgbackend->get_is_readable_predicate(),
     pgbackend->get_is_recoverable_predicate());
@@ -1161,6 +1224,10 @@ void ReplicatedPG::do_op(OpRequestRef op)
 {
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
   assert(m->get_header().type == CEPH_MSG_OSD_OP);
+  osd_reqid_t reqid = op->get_reqid();
+  tracepoint(ceph_osd, do_op,
+	     reqid.name.type(), reqid.name.num(), reqid.tid, reqid.inc,
+	     op->get_seq());
   if (op->includes_pg_op()) {
     if (pg_op_must_wait(m)) {
       wait_for_all_missing(op);
@@ -1187,6 +1254,21 @@ void ReplicatedPG::do_op(OpRequestRef op)
 		 CEPH_NOSNAP, m->get_pg().ps(),
 		 info.pgid.pool(), m->get_object_locator().nspace);
 
+  // a read sent to a replica: only serve it if the object is here and
+  // no write to it is still on its way to disk; clones are written with
+  // their head, so checking the head covers them.  otherwise send the
+  // client to the primary.
+  if (!is_primary() && !write_ordered &&
+      (pool.info.ec_pool() ||
+       pool.info.cache_mode != pg_pool_t::CACHEMODE_NONE ||
+       is_missing_object(head) ||
+       pgbackend->is_write_in_flight(head))) {
+    dout(20) << __func__ << ": replica can't serve " << head
+	     << " now, back to the primary" << dendl;
+    osd->reply_op_error(op, -EAGAIN);
+    return;
+  }
+
 
   if (write_ordered && scrubber.write_blocked_by_scrub(head)) {
     dout(20) << __func__ << ": waiting for scrub" << dendl;
@@ -1245,7 +1327,8 @@ void ReplicatedPG::do_op(OpRequestRef op)
     // we have to wait for the object.
     if (is_primary() ||
 	(!(m->get_flags() & CEPH_OSD_FLAG_BALANCE_READS) &&
-	 !(m->get_flags() & CEPH_OSD_FLAG_LOCALIZE_READS))) {
+	 !(m->get_flags() & CEPH_OSD_FLAG_LOCALIZE_READS) &&
+	 !(pool.info.flags & pg_pool_t::FLAG_REPLICA_READS))) {
       // missing the specific snap we need; requeue and wait.
       assert(!can_create); // only happens on a read
       wait_for_unreadable_object(missing_oid, op);
@@ -1253,7 +1336,9 @@ void ReplicatedPG::do_op(OpRequestRef op)
     }
   }
 
+  bool in_hit_set = false;
   if (hit_set) {
+    in_hit_set = hit_set->contains(oid);
     hit_set->insert(oid);
     if (hit_set->is_full() ||
 	hit_set_start_stamp + pool.info.hit_set_period <= m->get_recv_stamp()) {
@@ -1265,7 +1350,8 @@ void ReplicatedPG::do_op(OpRequestRef op)
   }
 
   if ((m->get_flags() & CEPH_OSD_FLAG_IGNORE_CACHE) == 0 &&
-      maybe_handle_cache(op, write_ordered, obc, r, missing_oid, false))
+      maybe_handle_cache(op, write_ordered, obc, r, missing_oid, false,
+			 in_hit_set))
     return;
 
   if (r) {
@@ -1454,7 +1540,8 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op,
 				      bool write_ordered,
 				      ObjectContextRef obc,
                                       int r, const hobject_t& missing_oid,
-				      bool must_promote)
+				      bool must_promote,
+				      bool in_hit_set)
 {
   if (obc)
     dout(25) << __func__ << " " << obc->obs.oi << " "
@@ -1499,6 +1586,20 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op,
     if (!must_promote && can_skip_promote(op, obc)) {
       return false;
     }
+    if (!must_promote && !op->may_write() && !op->may_cache() &&
+	!write_ordered) {
+      MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+      hobject_t oid(m->get_oid(),
+		    m->get_object_locator().key,
+		    m->get_snapid(),
+		    m->get_pg().ps(),
+		    m->get_object_locator().get_pool(),
+		    m->get_object_locator().nspace);
+      if (!promote_admits(oid, in_hit_set)) {
+	do_proxy_read(op);
+	return true;
+      }
+    }
     promote_object(op, obc, missing_oid);
     return true;
 
@@ -1535,6 +1636,42 @@ bool ReplicatedPG::maybe_handle_cache(OpRequestRef op,
   return false;
 }
 
+bool ReplicatedPG::promote_admits(const hobject_t& oid, bool in_hit_set)
+{
+  unsigned recency = pool.info.min_read_recency_for_promote;
+  if (!recency || !hit_set)
+    return true;
+
+  // look at the current HitSet and the most recent recency-1 archived
+  // ones, newest first; a cumulative set instead tells us how many
+  // recent hits it has seen, this one included
+  unsigned count = in_hit_set ? 1 : 0;
+  unsigned looked = 1;
+  if (hit_set->is_cumulative()) {
+    unsigned temp = hit_set->get_temperature(oid);
+    count = temp ? temp - 1 : 0;
+    looked = recency;
+  } else if (recency > 1 && agent_state) {
+    agent_load_hit_sets();
+    for (map<time_t,HitSetRef>::reverse_iterator p =
+	   agent_state->hit_set_map.rbegin();
+	 p != agent_state->hit_set_map.rend() && looked < recency;
+	 ++p, ++looked) {
+      if (p->second->contains(oid))
+	++count;
+    }
+  }
+
+  // a young pool may not have recency HitSets yet; judge by what we have
+  unsigned frequency = pool.info.min_read_frequency_for_promote;
+  if (!frequency || frequency > looked)
+    frequency = looked;
+
+  dout(20) << __func__ << " " << oid << " in " << count << "/" << looked
+	   << " hit sets, need " << frequency << dendl;
+  return count >= frequency;
+}
+
 bool ReplicatedPG::can_skip_promote(OpRequestRef op, ObjectContextRef obc)
 {
   MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
@@ -1563,6 +1700,111 @@ void ReplicatedPG::do_cache_redirect(OpRequestRef op, ObjectContextRef obc)
   return;
 }
 
+struct C_ProxyRead : public Context {
+  ReplicatedPGRef pg;
+  epoch_t last_peering_reset;
+  tid_t tid;
+  C_ProxyRead(ReplicatedPG *p, epoch_t lpr)
+    : pg(p), last_peering_reset(lpr), tid(0)
+  {}
+  void finish(int r) {
+    if (r == -ECANCELED)
+      return;
+    pg->lock();
+    if (last_peering_reset == pg->get_last_peering_reset()) {
+      pg->finish_proxy_read(tid, r);
+    }
+    pg->unlock();
+  }
+};
+
+void ReplicatedPG::do_proxy_read(OpRequestRef op)
+{
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_req());
+  object_locator_t oloc(m->get_object_locator());
+  oloc.pool = pool.info.tier_of;
+  hobject_t soid(m->get_oid(),
+		 m->get_object_locator().key,
+		 m->get_snapid(),
+		 m->get_pg().ps(),
+		 m->get_object_locator().get_pool(),
+		 m->get_object_locator().nspace);
+  unsigned flags = CEPH_OSD_FLAG_IGNORE_CACHE | CEPH_OSD_FLAG_IGNORE_OVERLAY;
+  dout(10) << __func__ << " " << soid << " from pool " << oloc.pool
+	   << " for " << *m << dendl;
+
+  ProxyReadOpRef prdop(new ProxyReadOp(op, soid, m->ops));
+
+  // have each reply land in the client's own op, in place
+  ObjectOperation obj_op;
+  obj_op.ops = prdop->ops;
+  obj_op.out_bl.resize(prdop->ops.size());
+  obj_op.out_rval.resize(prdop->ops.size());
+  obj_op.out_handler.resize(prdop->ops.size());
+  for (unsigned i = 0; i < prdop->ops.size(); i++) {
+    obj_op.out_bl[i] = &prdop->ops[i].outdata;
+    obj_op.out_rval[i] = &prdop->ops[i].rval;
+    obj_op.out_handler[i] = NULL;
+  }
+
+  C_ProxyRead *fin = new C_ProxyRead(this, get_last_peering_reset());
+  osd->objecter_lock.Lock();
+  tid_t tid = osd->objecter->read(soid.oid, oloc, obj_op,
+				  m->get_snapid(), NULL,
+				  flags,
+				  new C_OnFinisher(fin,
+						   &osd->objecter_finisher),
+				  &prdop->user_version);
+  fin->tid = tid;
+  prdop->objecter_tid = tid;
+  proxyread_ops[tid] = prdop;
+  osd->objecter_lock.Unlock();
+
+  osd->logger->inc(l_osd_tier_proxy_read);
+}
+
+void ReplicatedPG::finish_proxy_read(tid_t tid, int r)
+{
+  map<tid_t, ProxyReadOpRef>::iterator p = proxyread_ops.find(tid);
+  if (p == proxyread_ops.end()) {
+    dout(10) << __func__ << " no proxyread_op found for tid " << tid << dendl;
+    return;
+  }
+  ProxyReadOpRef prdop = p->second;
+  proxyread_ops.erase(p);
+  dout(10) << __func__ << " " << prdop->soid << " tid " << tid
+	   << " " << cpp_strerror(r) << dendl;
+
+  MOSDOp *m = static_cast<MOSDOp*>(prdop->op->get_req());
+  int flags = m->get_flags() & (CEPH_OSD_FLAG_ACK|CEPH_OSD_FLAG_ONDISK);
+  MOSDOpReply *reply = new MOSDOpReply(m, r, get_osdmap()->get_epoch(),
+				       flags, true);
+  reply->claim_op_out_data(prdop->ops);
+  reply->set_reply_versions(eversion_t(), prdop->user_version);
+  osd->send_message_osd_client(reply, m->get_connection());
+}
+
+void ReplicatedPG::cancel_proxy_read_ops(bool requeue)
+{
+  dout(10) << __func__ << dendl;
+  {
+    Mutex::Locker l(osd->objecter_lock);
+    for (map<tid_t, ProxyReadOpRef>::iterator p = proxyread_ops.begin();
+	 p != proxyread_ops.end();
+	 ++p)
+      osd->objecter->op_cancel(p->first, -ECANCELED);
+  }
+  if (requeue) {
+    // oldest first, so they keep their order once requeued
+    for (map<tid_t, ProxyReadOpRef>::reverse_iterator p =
+	   proxyread_ops.rbegin();
+	 p != proxyread_ops.rend();
+	 ++p)
+      requeue_op(p->second->op);
+  }
+  proxyread_ops.clear();
+}
+
 class PromoteCallback: public ReplicatedPG::CopyCallback {
   OpRequestRef op;
   ObjectContextRef obc;
@@ -1849,12 +2091,14 @@ void ReplicatedPG::log_op_stats(OpContext *ctx)
     osd->logger->inc(l_osd_op_r_outb, outb);
     osd->logger->tinc(l_osd_op_r_lat, latency);
     osd->logger->tinc(l_osd_op_r_process_lat, process_latency);
+    osd->logger->hinc(l_osd_op_r_lat_outb_hist, latency.to_nsec() / 1000, outb);
   } else if (op->may_write() || op->may_cache()) {
     osd->logger->inc(l_osd_op_w);
     osd->logger->inc(l_osd_op_w_inb, inb);
     osd->logger->tinc(l_osd_op_w_rlat, rlatency);
     osd->logger->tinc(l_osd_op_w_lat, latency);
     osd->logger->tinc(l_osd_op_w_process_lat, process_latency);
+    osd->logger->hinc(l_osd_op_w_lat_inb_hist, latency.to_nsec() / 1000, inb);
   } else
     assert(0);
 
@@ -2468,10 +2712,13 @@ void ReplicatedPG::snap_trimmer()
 int ReplicatedPG::do_xattr_cmp_u64(int op, __u64 v1, bufferlist& xattr)
 {
   __u64 v2;
-  if (xattr.length())
-    v2 = atoll(xattr.c_str());
-  else
+  if (xattr.length()) {
+    string v2s;
+    xattr.copy(0, xattr.length(), v2s);
+    v2 = atoll(v2s.c_str());
+  } else {
     v2 = 0;
+  }
 
   dout(20) << "do_xattr_cmp_u64 '" << v1 << "' vs '" << v2 << "' op " << op << dendl;
 
@@ -2495,7 +2742,8 @@ int ReplicatedPG::do_xattr_cmp_u64(int op, __u64 v1, bufferlist& xattr)
 
 int ReplicatedPG::do_xattr_cmp_str(int op, string& v1s, bufferlist& xattr)
 {
-  string v2s(xattr.c_str(), xattr.length());
+  string v2s;
+  xattr.copy(0, xattr.length(), v2s);
 
   dout(20) << "do_xattr_cmp_str '" << v1s << "' vs '" << v2s << "' op " << op << dendl;
 
@@ -2942,6 +3190,17 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	} else {
 	  int r = pgbackend->objects_read_sync(
 	    soid, op.extent.offset, op.extent.length, &osd_op.outdata);
+	  if (r >= 0 && op.extent.offset == 0 && (uint64_t)r == oi.size &&
+	      oi.is_data_digest() && trim == (uint64_t)-1 &&
+	      cct->_conf->osd_read_verify_data_digest &&
+	      osd_op.outdata.crc32c(0) != oi.data_digest) {
+	    osd->clog.error() << info.pgid << " " << soid << " data digest 0x"
+			      << std::hex << osd_op.outdata.crc32c(0)
+			      << " != recorded 0x" << oi.data_digest << std::dec
+			      << " on read\n";
+	    osd_op.outdata.clear();
+	    r = -EIO;
+	  }
 	  if (r >= 0)
 	    op.extent.length = r;
 	  else {
@@ -3536,7 +3795,8 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	}
 
 	if (pool.info.requires_aligned_append() &&
-	    (op.extent.offset % pool.info.required_alignment() != 0)) {
+	    (op.extent.offset % pool.info.required_alignment() != 0) &&
+	    !pgbackend->can_rollback_write(soid, op.extent.offset)) {
 	  result = -EOPNOTSUPP;
 	  break;
 	}
@@ -3545,6 +3805,11 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  ctx->mod_desc.create();
 	} else if (op.extent.offset == oi.size) {
 	  ctx->mod_desc.append(oi.size);
+	} else if (pool.info.require_rollback() &&
+		   pgbackend->can_rollback_write(soid, op.extent.offset)) {
+	  // rewrites the part of the object that is not encoded yet,
+	  // which is restored with the hinfo when rolling back
+	  ctx->mod_desc.append(oi.size);
 	} else {
 	  ctx->mod_desc.mark_unrollbackable();
 	  if (pool.info.require_rollback()) {
@@ -3570,6 +3835,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	    dout(10) << " truncate_seq " << op.extent.truncate_seq << " > current " << seq
 		     << ", truncating to " << op.extent.truncate_size << dendl;
 	    t->truncate(soid, op.extent.truncate_size);
+	    oi.clear_data_digest();
 	    oi.truncate_seq = op.extent.truncate_seq;
 	    oi.truncate_size = op.extent.truncate_size;
 	    if (op.extent.truncate_size != oi.size) {
@@ -3592,6 +3858,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	} else {
 	  t->write(soid, op.extent.offset, op.extent.length, osd_op.indata);
 	}
+	write_data_digest(oi, op.extent.offset, osd_op.indata);
 	write_update_size_and_usage(ctx->delta_stats, oi, ssc->snapset, ctx->modified_ranges,
 				    op.extent.offset, op.extent.length, true);
 	if (!obs.exists) {
@@ -3632,6 +3899,10 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  }
 	  t->write(soid, op.extent.offset, op.extent.length, osd_op.indata);
 	}
+	if (op.extent.offset == 0 && can_track_data_digest())
+	  oi.set_data_digest(osd_op.indata.crc32c(0));
+	else
+	  oi.clear_data_digest();
 	if (!obs.exists) {
 	  ctx->delta_stats.num_objects++;
 	  obs.exists = true;
@@ -3669,6 +3940,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (obs.exists && !oi.is_whiteout()) {
 	  ctx->mod_desc.mark_unrollbackable();
 	  t->zero(soid, op.extent.offset, op.extent.length);
+	  oi.clear_data_digest();
 	  interval_set<uint64_t> ch;
 	  ch.insert(op.extent.offset, op.extent.length);
 	  ctx->modified_ranges.union_of(ch);
@@ -3710,6 +3982,8 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	    t->touch(soid);
 	    ctx->delta_stats.num_objects++;
 	    obs.exists = true;
+	    bufferlist empty;
+	    write_data_digest(oi, 0, empty);
 	  }
 	}
       }
@@ -3761,6 +4035,12 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  ctx->delta_stats.num_bytes -= oi.size;
 	  ctx->delta_stats.num_bytes += op.extent.offset;
 	  oi.size = op.extent.offset;
+	  if (oi.size == 0) {
+	    bufferlist empty;
+	    write_data_digest(oi, 0, empty);
+	  } else {
+	    oi.clear_data_digest();
+	  }
 	}
 	ctx->delta_stats.num_wr++;
 	// do no set exists, or we will break above DELETE -> TRUNCATE munging.
@@ -3801,6 +4081,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	t->clone_range(src_obc->obs.oi.soid,
 		      obs.oi.soid, op.clonerange.src_offset,
 		      op.clonerange.length, op.clonerange.offset);
+	oi.clear_data_digest();
 		      
 
 	write_update_size_and_usage(ctx->delta_stats, oi, ssc->snapset, ctx->modified_ranges,
@@ -4391,6 +4672,57 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
   return result;
 }
 
+/*
+ * These do what do_osd_ops does for a single GETXATTR, OMAPGETHEADER or
+ * OMAPGETVALSBYKEYS, for callers that would otherwise encode the
+ * arguments into an OSDOp only to have them decoded again.
+ */
+int ReplicatedPG::do_cls_getxattr(OpContext *ctx, const string& name,
+				  bufferlist *out)
+{
+  dout(10) << "do_cls_getxattr " << ctx->new_obs.oi.soid << " " << name << dendl;
+  ++ctx->num_read;
+  ++ctx->current_osd_subop_num;
+  int r = getattr_maybe_cache(ctx->obc, "_" + name, out);
+  if (r < 0)
+    return r;
+  ctx->delta_stats.num_rd_kb += SHIFT_ROUND_UP(r, 10);
+  ctx->delta_stats.num_rd++;
+  return r;
+}
+
+int ReplicatedPG::do_cls_omap_get_header(OpContext *ctx, bufferlist *out)
+{
+  dout(10) << "do_cls_omap_get_header " << ctx->new_obs.oi.soid << dendl;
+  if (pool.info.require_rollback())
+    return -EOPNOTSUPP;
+  ++ctx->num_read;
+  ++ctx->current_osd_subop_num;
+  osd->store->omap_get_header(coll, ctx->new_obs.oi.soid, out);
+  ctx->delta_stats.num_rd_kb += SHIFT_ROUND_UP(out->length(), 10);
+  ctx->delta_stats.num_rd++;
+  return 0;
+}
+
+int ReplicatedPG::do_cls_omap_get_vals_by_keys(OpContext *ctx,
+					       const set<string>& keys,
+					       map<string, bufferlist> *out)
+{
+  dout(10) << "do_cls_omap_get_vals_by_keys " << ctx->new_obs.oi.soid
+	   << " " << keys << dendl;
+  if (pool.info.require_rollback())
+    return -EOPNOTSUPP;
+  ++ctx->num_read;
+  ++ctx->current_osd_subop_num;
+  osd->store->omap_get_values(coll, ctx->new_obs.oi.soid, keys, out);
+  uint64_t len = 0;
+  for (map<string, bufferlist>::iterator p = out->begin(); p != out->end(); ++p)
+    len += p->first.length() + p->second.length();
+  ctx->delta_stats.num_rd_kb += SHIFT_ROUND_UP(len, 10);
+  ctx->delta_stats.num_rd++;
+  return 0;
+}
+
 int ReplicatedPG::_get_tmap(OpContext *ctx, bufferlist *header, bufferlist *vals)
 {
   if (ctx->new_obs.oi.size == 0) {
@@ -4436,6 +4768,43 @@ int ReplicatedPG::_verify_no_head_clones(const hobject_t& soid,
   return 0;
 }
 
+/*
+ * We keep a crc32c of the whole object in object_info_t when a write
+ * lets us do so cheaply: one that covers all of the data, or appends to
+ * an object whose digest we know.  Anything else that changes the data
+ * drops it.  An osd that doesn't know about the digest would leave it
+ * stale, so we only set it once every up osd does.
+ */
+bool ReplicatedPG::can_track_data_digest()
+{
+  if (!cct->_conf->osd_data_digest || pool.info.require_rollback())
+    return false;
+  OSDMapRef osdmap = get_osdmap();
+  if (osdmap->get_epoch() != data_digest_epoch) {
+    data_digest_epoch = osdmap->get_epoch();
+    data_digest_ok =
+      osdmap->get_up_osd_features() & CEPH_FEATURE_OSD_DATA_DIGEST;
+  }
+  return data_digest_ok;
+}
+
+/// bl is being written at off; oi.size is still the size before it
+void ReplicatedPG::write_data_digest(object_info_t& oi, uint64_t off,
+				     bufferlist& bl)
+{
+  if (can_track_data_digest()) {
+    if (off == 0 && bl.length() >= oi.size) {
+      oi.set_data_digest(bl.crc32c(0));
+      return;
+    }
+    if (off == oi.size && oi.is_data_digest()) {
+      oi.set_data_digest(bl.crc32c(oi.data_digest));
+      return;
+    }
+  }
+  oi.clear_data_digest();
+}
+
 inline int ReplicatedPG::_delete_head(OpContext *ctx, bool no_whiteout)
 {
   SnapSet& snapset = ctx->new_snapset;
@@ -4444,6 +4813,8 @@ inline int ReplicatedPG::_delete_head(OpContext *ctx, bool no_whiteout)
   const hobject_t& soid = oi.soid;
   PGBackend::PGTransaction* t = ctx->op_t;
 
+  oi.clear_data_digest();
+
   if (!obs.exists || (obs.oi.is_whiteout() && !no_whiteout))
     return -ENOENT;
 
@@ -4501,6 +4872,8 @@ int ReplicatedPG::_rollback_to(OpContext *ctx, ceph_osd_op& op)
   snapid_t snapid = (uint64_t)op.snap.snapid;
   hobject_t missing_oid;
 
+  oi.clear_data_digest();
+
   dout(10) << "_rollback_to " << soid << " snapid " << snapid << dendl;
 
   ObjectContextRef rollback_to;
@@ -4679,7 +5052,10 @@ void ReplicatedPG::make_writeable(OpContext *ctx)
     object_info_t *snap_oi;
     if (is_primary()) {
       ctx->clone_obc = object_contexts.lookup_or_create(static_snap_oi.soid);
-      ctx->clone_obc->destructor_callback = new C_PG_ObjectContext(this, ctx->clone_obc.get());
+      // may still be cached from a clone that was removed
+      if (!ctx->clone_obc->destructor_callback)
+	ctx->clone_obc->destructor_callback =
+	  new C_PG_ObjectContext(this, ctx->clone_obc.get());
       ctx->clone_obc->obs.oi = static_snap_oi;
       ctx->clone_obc->obs.exists = true;
       if (pool.info.require_rollback())
@@ -4829,6 +5205,7 @@ void ReplicatedPG::do_osd_op_effects(OpContext *ctx)
     }
   }
 
+  NotifySendBatch *batch = NULL;
   for (list<notify_info_t>::iterator p = ctx->notifies.begin();
        p != ctx->notifies.end();
        ++p) {
@@ -4843,15 +5220,27 @@ void ReplicatedPG::do_osd_op_effects(OpContext *ctx)
 	osd->get_next_id(get_osdmap()->get_epoch()),
 	ctx->obc->obs.oi.user_version,
 	osd));
+    if (!batch)
+      batch = new NotifySendBatch(osd);
+    list<WatchRef> started;
     for (map<pair<uint64_t, entity_name_t>, WatchRef>::iterator i =
 	   ctx->obc->watchers.begin();
 	 i != ctx->obc->watchers.end();
 	 ++i) {
       dout(10) << "starting notify on watch " << i->first << dendl;
-      i->second->start_notify(notif);
+      i->second->start_notify(notif, batch);
+      started.push_back(i->second);
     }
+    notif->start_watchers(started);
     notif->init();
   }
+  if (batch) {
+    // leave the fan-out to the finisher rather than do it under our lock
+    if (batch->empty())
+      delete batch;
+    else
+      osd->watch_finisher.queue(batch);
+  }
 
   for (list<OpContext::NotifyAck>::iterator p = ctx->notify_acks.begin();
        p != ctx->notify_acks.end();
@@ -4921,6 +5310,23 @@ int ReplicatedPG::prepare_transaction(OpContext *ctx)
     }
   }
 
+  // note what data we changed before make_writeable() trims
+  // modified_ranges down to the clone overlap.  every op that changes
+  // data adds to modified_ranges; a change of size is added here.
+  if (soid.snap == CEPH_NOSNAP && !pool.info.require_rollback() &&
+      ctx->obs->exists && ctx->new_obs.exists) {
+    ctx->extents_known = true;
+    ctx->dirty_extents = ctx->modified_ranges;
+    uint64_t old_size = ctx->obs->oi.size;
+    uint64_t new_size = ctx->new_obs.oi.size;
+    if (old_size != new_size) {
+      interval_set<uint64_t> resized;
+      resized.insert(MIN(old_size, new_size),
+		     MAX(old_size, new_size) - MIN(old_size, new_size));
+      ctx->dirty_extents.union_of(resized);
+    }
+  }
+
   // clone, if necessary
   if (soid.snap == CEPH_NOSNAP)
     make_writeable(ctx);
@@ -5071,6 +5477,10 @@ void ReplicatedPG::finish_ctx(OpContext *ctx, int log_op_type)
 				    ctx->obs->oi.version,
 				    ctx->user_at_version, ctx->reqid,
 				    ctx->mtime));
+  if (ctx->extents_known && log_op_type == pg_log_entry_t::MODIFY) {
+    ctx->log.back().has_extents = true;
+    ctx->log.back().extents = ctx->dirty_extents;
+  }
   if (soid.snap < CEPH_NOSNAP) {
     set<snapid_t> _snaps(ctx->new_obs.oi.snaps.begin(),
 			 ctx->new_obs.oi.snaps.end());
@@ -5139,6 +5549,7 @@ void ReplicatedPG::complete_read_ctx(int result, OpContext *ctx)
   }
 
   reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
+  trace_op_reply(ctx->op, reply);
   osd->send_message_osd_client(reply, m->get_connection());
   close_op_ctx(ctx, 0);
 }
@@ -5605,6 +6016,7 @@ void ReplicatedPG::finish_copyfrom(OpContext *ctx)
 
   // CopyFromCallback fills this in for us
   obs.oi.user_version = ctx->user_at_version;
+  obs.oi.clear_data_digest();
 
   // cache: clear whiteout?
   if (obs.oi.is_whiteout()) {
@@ -5660,7 +6072,7 @@ void ReplicatedPG::finish_promote(int r, OpRequestRef op,
 
   if (r < 0 && !whiteout) {
     // we need to get rid of the op in the blocked queue
-    map<hobject_t,list<OpRequestRef> >::iterator blocked_iter =
+    object_waiters_t::iterator blocked_iter =
       waiting_for_blocked_object.find(soid);
     assert(blocked_iter != waiting_for_blocked_object.end());
     assert(blocked_iter->second.begin()->get() == op.get());
@@ -5696,6 +6108,7 @@ void ReplicatedPG::finish_promote(int r, OpRequestRef op,
       tctx->discard_temp_oid = results->temp_oid;
     }
     tctx->new_obs.oi.size = results->object_size;
+    tctx->new_obs.oi.clear_data_digest();
     tctx->delta_stats.num_bytes += results->object_size;
     tctx->new_obs.oi.category = results->category;
     tctx->new_obs.oi.user_version = results->user_version;
@@ -6153,6 +6566,12 @@ void ReplicatedPG::repop_all_committed(RepGather *repop)
   dout(10) << __func__ << ": repop tid " << repop->rep_tid << " all committed "
 	   << dendl;
   repop->all_committed = true;
+  if (repop->ctx->op) {
+    osd_reqid_t reqid = repop->ctx->op->get_reqid();
+    tracepoint(ceph_osd, op_commit,
+	       reqid.name.type(), reqid.name.num(), reqid.tid, reqid.inc,
+	       repop->ctx->op->get_seq());
+  }
 
   if (!repop->rep_aborted) {
     if (repop->v != eversion_t()) {
@@ -6255,6 +6674,7 @@ void ReplicatedPG::eval_repop(RepGather *repop)
 	}
 	reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
 	dout(10) << " sending commit on " << *repop << " " << reply << dendl;
+	trace_op_reply(repop->ctx->op, reply);
 	osd->send_message_osd_client(reply, m->get_connection());
 	repop->sent_disk = true;
 	repop->ctx->op->mark_commit_sent();
@@ -6295,6 +6715,7 @@ void ReplicatedPG::eval_repop(RepGather *repop)
 	reply->add_flags(CEPH_OSD_FLAG_ACK);
 	dout(10) << " sending ack on " << *repop << " " << reply << dendl;
         assert(entity_name_t::TYPE_OSD != m->get_connection()->peer_type);
+	trace_op_reply(repop->ctx->op, reply);
 	osd->send_message_osd_client(reply, m->get_connection());
 	repop->sent_ack = true;
       }
@@ -6346,6 +6767,8 @@ void ReplicatedPG::issue_repop(RepGather *repop, utime_t now)
           << " o " << soid
           << dendl;
 
+  osd->oi_cache.invalidate(info.pgid, soid);
+
   repop->v = ctx->at_version;
 
   for (set<pg_shard_t>::iterator i = actingbackfill.begin();
@@ -6416,14 +6839,23 @@ void ReplicatedBackend::issue_op(
 {
   int acks_wanted = CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK;
 
-  if (parent->get_actingbackfill_shards().size() > 1) {
-    ostringstream ss;
-    set<pg_shard_t> replicas = parent->get_actingbackfill_shards();
-    replicas.erase(parent->whoami_shard());
-    ss << "waiting for subops from " << replicas;
-    if (op->op)
+  if (op->op && parent->get_actingbackfill_shards().size() > 1) {
+    if (op->op->is_sampled()) {
+      ostringstream ss;
+      set<pg_shard_t> replicas = parent->get_actingbackfill_shards();
+      replicas.erase(parent->whoami_shard());
+      ss << "waiting for subops from " << replicas;
       op->op->mark_sub_op_sent(ss.str());
+    } else {
+      op->op->mark_sub_op_sent();
+    }
   }
+
+  // encode once; the messages share the buffers.  legacy_op_bl is in
+  // the old transaction encoding, for peers that need it.
+  bufferlist op_bl, legacy_op_bl, empty_bl, logs_bl;
+  ::encode(log_entries, logs_bl);
+
   for (set<pg_shard_t>::const_iterator i =
 	 parent->get_actingbackfill_shards().begin();
        i != parent->get_actingbackfill_shards().end();
@@ -6448,13 +6880,25 @@ void ReplicatedBackend::issue_op(
 	       << " beyond MAX(last_backfill_started "
 	       << ", pinfo.last_backfill "
 	       << pinfo.last_backfill << ")" << dendl;
-      ObjectStore::Transaction t;
-      ::encode(t, wr->get_data());
+      if (!empty_bl.length()) {
+	ObjectStore::Transaction t;
+	::encode(t, empty_bl);
+      }
+      wr->set_data(empty_bl);
     } else {
-      ::encode(*op_t, wr->get_data());
+      uint64_t features = get_osdmap()->get_xinfo(peer.osd).features;
+      if (features & CEPH_FEATURE_OS_COMPACT_TRANSACTION) {
+	if (!op_bl.length())
+	  op_t->encode(op_bl, features);
+	wr->set_data(op_bl);
+      } else {
+	if (!legacy_op_bl.length())
+	  op_t->encode(legacy_op_bl, features);
+	wr->set_data(legacy_op_bl);
+      }
     }
 
-    ::encode(log_entries, wr->logbl);
+    wr->logbl = logs_bl;
 
     if (pinfo.is_incomplete())
       wr->pg_stats = pinfo.stats;  // reflects backfill progress
@@ -6724,11 +7168,13 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
 	     << " oi:" << obc->obs.oi << dendl;
   } else {
     // check disk
+    object_info_t oi;
     bufferlist bv;
     if (attrs) {
       assert(attrs->count(OI_ATTR));
       bv = attrs->find(OI_ATTR)->second;
-    } else {
+      oi.decode(bv);
+    } else if (!osd->oi_cache.get_oi(info.pgid, soid, &oi)) {
       int r = pgbackend->objects_get_attr(soid, OI_ATTR, &bv);
       if (r < 0) {
 	if (!can_create)
@@ -6741,10 +7187,10 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
 	  soid.has_snapset() ? attrs : 0);
 	return create_object_context(oi, ssc);
       }
+      oi.decode(bv);
+      osd->oi_cache.add_oi(info.pgid, oi, bv.length());
     }
 
-    object_info_t oi(bv);
-
     assert(oi.soid.pool == (int64_t)info.pgid.pool());
 
     obc = object_contexts.lookup_or_create(oi.soid);
@@ -7015,7 +7461,7 @@ void ReplicatedPG::add_object_context_to_pg_stat(ObjectContextRef obc, pg_stat_t
 void ReplicatedPG::kick_object_context_blocked(ObjectContextRef obc)
 {
   const hobject_t& soid = obc->obs.oi.soid;
-  map<hobject_t, list<OpRequestRef> >::iterator p = waiting_for_blocked_object.find(soid);
+  object_waiters_t::iterator p = waiting_for_blocked_object.find(soid);
   if (p == waiting_for_blocked_object.end())
     return;
 
@@ -7054,17 +7500,22 @@ SnapSetContext *ReplicatedPG::get_snapset_context(
     ssc = p->second;
   } else {
     bufferlist bv;
+    hobject_t head(oid, key, CEPH_NOSNAP, seed,
+		   info.pgid.pool(), nspace);
+    SnapSet cached;
+    bool have_cached = false;
     if (!attrs) {
-      hobject_t head(oid, key, CEPH_NOSNAP, seed,
-		     info.pgid.pool(), nspace);
-      int r = pgbackend->objects_get_attr(head, SS_ATTR, &bv);
-      if (r < 0) {
-	// try _snapset
-	hobject_t snapdir(oid, key, CEPH_SNAPDIR, seed,
-			  info.pgid.pool(), nspace);
-	r = pgbackend->objects_get_attr(snapdir, SS_ATTR, &bv);
-	if (r < 0 && !can_create)
-	  return NULL;
+      have_cached = osd->oi_cache.get_snapset(info.pgid, head, &cached);
+      if (!have_cached) {
+	int r = pgbackend->objects_get_attr(head, SS_ATTR, &bv);
+	if (r < 0) {
+	  // try _snapset
+	  hobject_t snapdir(oid, key, CEPH_SNAPDIR, seed,
+			    info.pgid.pool(), nspace);
+	  r = pgbackend->objects_get_attr(snapdir, SS_ATTR, &bv);
+	  if (r < 0 && !can_create)
+	    return NULL;
+	}
       }
     } else {
       assert(attrs->count(SS_ATTR));
@@ -7072,9 +7523,13 @@ SnapSetContext *ReplicatedPG::get_snapset_context(
     }
     ssc = new SnapSetContext(oid);
     _register_snapset_context(ssc);
-    if (bv.length()) {
+    if (have_cached) {
+      ssc->snapset = cached;
+    } else if (bv.length()) {
       bufferlist::iterator bvp = bv.begin();
       ssc->snapset.decode(bvp);
+      if (!attrs)
+	osd->oi_cache.add_snapset(info.pgid, head, ssc->snapset, bv.length());
     }
   }
   assert(ssc);
@@ -7165,6 +7620,12 @@ void ReplicatedBackend::sub_op_modify(OpRequestRef op)
       }
       rm->opt.set_pool_override(get_info().pgid.pool());
     }
+    for (vector<pg_log_entry_t>::iterator i = log.begin();
+	 i != log.end();
+	 ++i) {
+      if (rm->objects.insert(i->soid).second)
+	writes_in_flight[i->soid]++;
+    }
     rm->opt.set_replica();
 
     bool update_snaps = false;
@@ -7211,7 +7672,7 @@ void ReplicatedBackend::sub_op_modify(OpRequestRef op)
 
 void ReplicatedBackend::sub_op_modify_applied(RepModifyRef rm)
 {
-  rm->op->mark_event("sub_op_applied");
+  rm->op->mark_event(TrackedOp::EVENT_SUB_OP_APPLIED);
   rm->applied = true;
 
   dout(10) << "sub_op_modify_applied on " << rm << " op "
@@ -7230,6 +7691,8 @@ void ReplicatedBackend::sub_op_modify_applied(RepModifyRef rm)
   }
   
   parent->op_applied(m->version);
+  if (rm->committed)
+    sub_op_modify_done(rm);
 }
 
 void ReplicatedBackend::sub_op_modify_commit(RepModifyRef rm)
@@ -7255,6 +7718,21 @@ void ReplicatedBackend::sub_op_modify_commit(RepModifyRef rm)
   
   log_subop_stats(get_parent()->get_logger(), rm->op,
 		  l_osd_sop_w_inb, l_osd_sop_w_lat);
+  if (rm->applied)
+    sub_op_modify_done(rm);
+}
+
+void ReplicatedBackend::sub_op_modify_done(RepModifyRef rm)
+{
+  for (set<hobject_t>::iterator i = rm->objects.begin();
+       i != rm->objects.end();
+       ++i) {
+    map<hobject_t, int>::iterator p = writes_in_flight.find(*i);
+    assert(p != writes_in_flight.end());
+    if (--p->second == 0)
+      writes_in_flight.erase(p);
+  }
+  rm->objects.clear();
 }
 
 
@@ -7636,6 +8114,13 @@ void ReplicatedBackend::prep_push_to_replica(
 		       pi->second.last_backfill,
 		       data_subset, clone_subsets);
   } else if (soid.snap == CEPH_NOSNAP) {
+    // only what changed since the version the replica has?
+    if (calc_partial_push(obc, soid, peer, data_subset)) {
+      prep_push(obc, soid, peer, oi.version, data_subset, clone_subsets, pop,
+		true);
+      return;
+    }
+
     // pushing head or unversioned object.
     // base this on partially on replica's clones?
     SnapSetContext *ssc = obc->ssc;
@@ -7665,13 +8150,71 @@ void ReplicatedBackend::prep_push(ObjectContextRef obc,
 	    pop);
 }
 
+/*
+ * A replica that missed a few writes to an object while it was down
+ * still has the object at the version it had.  If every log entry
+ * since then recorded the extents it wrote, we push just those (plus
+ * attrs and omap, which are not tracked), and the replica applies them
+ * to a copy of what it has.  Otherwise we push the whole object.
+ */
+bool ReplicatedBackend::calc_partial_push(
+  ObjectContextRef obc, const hobject_t& soid, pg_shard_t peer,
+  interval_set<uint64_t>& data_subset)
+{
+  if (!cct->_conf->osd_recover_partial)
+    return false;
+  if (!(get_osdmap()->get_xinfo(peer.osd).features &
+	CEPH_FEATURE_OSD_PARTIAL_RECOVERY))
+    return false;
+
+  const pg_info_t& pinfo = get_parent()->get_shard_info(peer);
+  if (!pinfo.last_backfill.is_max() && !(soid < pinfo.last_backfill))
+    return false;
+  const pg_missing_t& pmissing = get_parent()->get_shard_missing(peer);
+  map<hobject_t, pg_missing_t::item>::const_iterator m =
+    pmissing.missing.find(soid);
+  if (m == pmissing.missing.end() || m->second.have == eversion_t())
+    return false;
+  eversion_t have = m->second.have;
+
+  const pg_log_t& log = get_parent()->get_log().get_log();
+  if (have < log.tail)
+    return false;
+  interval_set<uint64_t> dirty;
+  eversion_t expect = obc->obs.oi.version;
+  for (list<pg_log_entry_t>::const_reverse_iterator p = log.log.rbegin();
+       p != log.log.rend() && p->version > have;
+       ++p) {
+    if (p->soid != soid)
+      continue;
+    if (p->version != expect || !p->is_modify() || !p->has_extents) {
+      dout(20) << __func__ << " " << soid << " can't use " << *p << dendl;
+      return false;
+    }
+    dirty.union_of(p->extents);
+    expect = p->prior_version;
+  }
+  if (expect != have)
+    return false;
+
+  interval_set<uint64_t> all;
+  if (obc->obs.oi.size)
+    all.insert(0, obc->obs.oi.size);
+  dirty.intersection_of(all);
+  dout(10) << __func__ << " " << soid << " osd." << peer << " has " << have
+	   << ", pushing " << dirty << dendl;
+  data_subset.swap(dirty);
+  return true;
+}
+
 void ReplicatedBackend::prep_push(
   ObjectContextRef obc,
   const hobject_t& soid, pg_shard_t peer,
   eversion_t version,
   interval_set<uint64_t> &data_subset,
   map<hobject_t, interval_set<uint64_t> >& clone_subsets,
-  PushOp *pop)
+  PushOp *pop,
+  bool partial)
 {
   get_parent()->begin_peer_recover(peer, soid);
   // take note.
@@ -7683,6 +8226,7 @@ void ReplicatedBackend::prep_push(
   pi.recovery_info.soid = soid;
   pi.recovery_info.oi = obc->obs.oi;
   pi.recovery_info.version = version;
+  pi.recovery_info.partial = partial;
   pi.recovery_progress.first = true;
   pi.recovery_progress.data_recovered_to = 0;
   pi.recovery_progress.data_complete = 0;
@@ -7745,7 +8289,7 @@ void ReplicatedBackend::submit_push_data(
   ObjectStore::Transaction *t)
 {
   coll_t target_coll;
-  if (first && complete) {
+  if (first && complete && !recovery_info.partial) {
     target_coll = coll;
   } else {
     dout(10) << __func__ << ": Creating oid "
@@ -7754,7 +8298,18 @@ void ReplicatedBackend::submit_push_data(
     target_coll = get_temp_coll(t);
   }
 
-  if (first) {
+  if (first && recovery_info.partial) {
+    // start from the version we have; the push carries what changed
+    // since, and all of the attrs and omap
+    t->remove(target_coll, recovery_info.soid);
+    t->collection_move_rename(coll, recovery_info.soid,
+			      target_coll, recovery_info.soid);
+    get_parent()->on_local_recover_start(recovery_info.soid, t);
+    t->truncate(target_coll, recovery_info.soid, recovery_info.size);
+    t->rmattrs(target_coll, recovery_info.soid);
+    t->omap_clear(target_coll, recovery_info.soid);
+    t->omap_setheader(target_coll, recovery_info.soid, omap_header);
+  } else if (first) {
     get_parent()->on_local_recover_start(recovery_info.soid, t);
     t->remove(get_temp_coll(t), recovery_info.soid);
     t->touch(target_coll, recovery_info.soid);
@@ -7919,7 +8474,7 @@ struct C_OnPushCommit : public Context {
   OpRequestRef op;
   C_OnPushCommit(ReplicatedPG *pg, OpRequestRef op) : pg(pg), op(op) {}
   void finish(int) {
-    op->mark_event("committed");
+    op->mark_event(TrackedOp::EVENT_OP_COMMITTED);
     log_subop_stats(pg->osd->logger, op, l_osd_push_inb, l_osd_sop_push_lat);
   }
 };
@@ -8606,7 +9161,7 @@ ObjectContextRef ReplicatedPG::mark_object_lost(ObjectStore::Transaction *t,
 {
   // Wake anyone waiting for this object. Now that it's been marked as lost,
   // we will just return an error code.
-  map<hobject_t, list<OpRequestRef> >::iterator wmo =
+  object_waiters_t::iterator wmo =
     waiting_for_unreadable_object.find(oid);
   if (wmo != waiting_for_unreadable_object.end()) {
     requeue_ops(wmo->second);
@@ -8618,6 +9173,7 @@ ObjectContextRef ReplicatedPG::mark_object_lost(ObjectStore::Transaction *t,
   pg_log.add(e);
   
   ObjectContextRef obc = get_object_context(oid, true);
+  osd->oi_cache.invalidate(info.pgid, oid);
 
   obc->ondisk_write_lock();
 
@@ -8869,9 +9425,13 @@ void ReplicatedPG::on_shutdown()
 
   unreg_next_scrub();
   cancel_copy_ops(false);
+  cancel_proxy_read_ops(false);
   cancel_flush_ops(false);
   apply_and_flush_repops(false);
   context_registry_on_change();
+  object_contexts.clear();
+  osd->oi_cache.clear_pg(info.pgid);
+  snap_trimmer_machine.release();
 
   osd->remote_reserver.cancel_reservation(info.pgid);
   osd->local_reserver.cancel_reservation(info.pgid);
@@ -8918,6 +9478,8 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
   scrub_clear_state();
 
   context_registry_on_change();
+  object_contexts.clear();
+  osd->oi_cache.clear_pg(info.pgid);
 
   for (list<pair<OpRequestRef, OpContext*> >::iterator i =
          in_progress_async_reads.begin();
@@ -8928,6 +9490,7 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
   }
 
   cancel_copy_ops(is_primary());
+  cancel_proxy_read_ops(is_primary());
   cancel_flush_ops(is_primary());
 
   // requeue object waiters
@@ -8936,7 +9499,7 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
   } else {
     waiting_for_unreadable_object.clear();
   }
-  for (map<hobject_t,list<OpRequestRef> >::iterator p = waiting_for_degraded_object.begin();
+  for (object_waiters_t::iterator p = waiting_for_degraded_object.begin();
        p != waiting_for_degraded_object.end();
        waiting_for_degraded_object.erase(p++)) {
     if (is_primary())
@@ -8945,7 +9508,7 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
       p->second.clear();
     finish_degraded_object(p->first);
   }
-  for (map<hobject_t,list<OpRequestRef> >::iterator p = waiting_for_blocked_object.begin();
+  for (object_waiters_t::iterator p = waiting_for_blocked_object.begin();
        p != waiting_for_blocked_object.end();
        waiting_for_blocked_object.erase(p++)) {
     if (is_primary())
@@ -8970,6 +9533,7 @@ void ReplicatedPG::on_change(ObjectStore::Transaction *t)
 
   // clear snap_trimmer state
   snap_trimmer_machine.process_event(Reset());
+  snap_trimmer_machine.release();
 
   debug_op_order.clear();
   unstable_stats.clear();
@@ -9308,6 +9872,7 @@ int ReplicatedPG::recover_primary(int max, ThreadPool::TPHandle &handle)
 	      dout(10) << " already reverting " << soid << dendl;
 	    } else {
 	      dout(10) << " reverting " << soid << " to " << latest->prior_version << dendl;
+	      osd->oi_cache.invalidate(info.pgid, soid);
 	      obc->ondisk_write_lock();
 	      obc->obs.oi.version = latest->version;
 
@@ -10066,14 +10631,17 @@ void ReplicatedPG::scan_range(
   dout(10) << "scan_range from " << bi->begin << dendl;
   bi->objects.clear();  // for good measure
 
+  // get the object_info_t xattrs along with the names
   vector<hobject_t> ls;
-  ls.reserve(max);
-  int r = pgbackend->objects_list_partial(bi->begin, min, max, 0, &ls, &bi->end);
+  vector<bufferptr> attrs;
+  int r = pgbackend->objects_list_partial_attr(
+    bi->begin, min, max, 0, OI_ATTR, &ls, &attrs, &bi->end);
   assert(r >= 0);
   dout(10) << " got " << ls.size() << " items, next " << bi->end << dendl;
   dout(20) << ls << dendl;
 
-  for (vector<hobject_t>::iterator p = ls.begin(); p != ls.end(); ++p) {
+  for (unsigned i = 0; i < ls.size(); ++i) {
+    vector<hobject_t>::iterator p = ls.begin() + i;
     handle.reset_tp_timeout();
     ObjectContextRef obc;
     if (is_primary())
@@ -10083,8 +10651,12 @@ void ReplicatedPG::scan_range(
       dout(20) << "  " << *p << " " << obc->obs.oi.version << dendl;
     } else {
       bufferlist bl;
-      int r = pgbackend->objects_get_attr(*p, OI_ATTR, &bl);
-      assert(r >= 0);
+      if (attrs[i].length()) {
+	bl.push_back(attrs[i]);
+      } else {
+	int r = pgbackend->objects_get_attr(*p, OI_ATTR, &bl);
+	assert(r >= 0);
+      }
       object_info_t oi(bl);
       bi->objects[*p] = oi.version;
       dout(20) << "  " << *p << " " << oi.version << dendl;
@@ -10182,6 +10754,41 @@ void ReplicatedPG::hit_set_setup()
   // FIXME: discard any previous data for now
   hit_set_create();
 
+  // ...except for a cumulative set, which only needs the last archived
+  // one to pick up where the previous primary left off
+  if (hit_set->is_cumulative() &&
+      !info.hit_set.history.empty() &&
+      pool.info.is_replicated()) {
+    const pg_hit_set_info_t& last = info.hit_set.history.back();
+    hobject_t oid = get_hit_set_archive_object(last.begin, last.end);
+    bufferlist bl;
+    int r = osd->store->read(coll, oid, 0, 0, bl);
+    HitSetRef hs(new HitSet);
+    try {
+      bufferlist::iterator p = bl.begin();
+      if (r >= 0)
+	::decode(*hs, p);
+    } catch (buffer::error& e) {
+      r = -EIO;
+    }
+    if (r >= 0 && hs->is_cumulative()) {
+      // one decay for the period after it, and one per period since
+      utime_t now = ceph_clock_now(NULL);
+      unsigned periods = 1;
+      if (now > last.end)
+	periods += (now - last.end).sec() / pool.info.hit_set_period;
+      hs->decay();
+      for (unsigned i = 1; i < periods && i < 8; ++i)
+	hs->impl->decay();
+      dout(10) << __func__ << " resuming from " << oid << ", "
+	       << periods << " periods old" << dendl;
+      hit_set = hs;
+    } else {
+      dout(10) << __func__ << " not resuming from " << oid << ": "
+	       << cpp_strerror(r) << dendl;
+    }
+  }
+
   // include any writes we know about from the pg log.  this doesn't
   // capture reads, but it is better than nothing!
   hit_set_apply_log();
@@ -10194,12 +10801,17 @@ void ReplicatedPG::hit_set_create()
   HitSet::Params params(pool.info.hit_set_params);
 
   dout(20) << __func__ << " " << params << dendl;
-  if (pool.info.hit_set_params.get_type() == HitSet::TYPE_BLOOM) {
+  if (pool.info.hit_set_params.get_type() == HitSet::TYPE_BLOOM ||
+      pool.info.hit_set_params.get_type() == HitSet::TYPE_DECAY_BLOOM ||
+      pool.info.hit_set_params.get_type() == HitSet::TYPE_BLOCKED_BLOOM) {
+    // the other bloom Params are BloomHitSet::Params
     BloomHitSet::Params *p =
       static_cast<BloomHitSet::Params*>(params.impl.get());
 
     // convert false positive rate so it holds up across the full period
-    p->set_fpp(p->get_fpp() / pool.info.hit_set_count);
+    // (a decaying set is looked at on its own)
+    if (pool.info.hit_set_params.get_type() != HitSet::TYPE_DECAY_BLOOM)
+      p->set_fpp(p->get_fpp() / pool.info.hit_set_count);
     if (p->get_fpp() <= 0.0)
       p->set_fpp(.01);  // fpp cannot be zero!
 
@@ -10247,10 +10859,12 @@ bool ReplicatedPG::hit_set_apply_log()
   list<pg_log_entry_t>::const_reverse_iterator p = pg_log.get_log().log.rbegin();
   while (p != pg_log.get_log().log.rend() && p->version > to)
     ++p;
+  vector<hobject_t> ls;
   while (p != pg_log.get_log().log.rend() && p->version > from) {
-    hit_set->insert(p->soid);
+    ls.push_back(p->soid);
     ++p;
   }
+  hit_set->insert_many(ls);
 
   return true;
 }
@@ -10278,7 +10892,7 @@ void ReplicatedPG::hit_set_persist()
     dout(20) << __func__ << " archive " << oid << dendl;
     reset = true;
 
-    if (agent_state)
+    if (agent_state && !hit_set->is_cumulative())
       agent_state->add_hit_set(info.hit_set.current_info.begin, hit_set);
 
   } else {
@@ -10333,7 +10947,15 @@ void ReplicatedPG::hit_set_persist()
   info.hit_set.current_info.version = ctx->at_version;
   if (reset) {
     info.hit_set.history.push_back(info.hit_set.current_info);
-    hit_set_create();
+    if (hit_set->is_cumulative()) {
+      // carry the decayed counts over; the archived copy stays as it is
+      HitSetRef next(new HitSet(*hit_set));
+      next->decay();
+      hit_set = next;
+      hit_set_start_stamp = now;
+    } else {
+      hit_set_create();
+    }
     info.hit_set.current_info = pg_hit_set_info_t();
     info.hit_set.current_last_stamp = utime_t();
   } else {
@@ -10495,8 +11117,10 @@ void ReplicatedPG::agent_work(int start_max)
   const pg_pool_t *base_pool = get_osdmap()->get_pg_pool(pool.info.tier_of);
   assert(base_pool);
 
+  // look at more objects per pass the further over target we are
   int ls_min = 1;
-  int ls_max = 10; // FIXME?
+  int ls_max = MAX(10, (int)((uint64_t)cct->_conf->osd_agent_max_list *
+			     agent_state->get_effort() / 1000000));
 
   // list some objects.  this conveniently lists clones (oldest to
   // newest) before heads... the same order we want to flush in.
@@ -10510,19 +11134,19 @@ void ReplicatedPG::agent_work(int start_max)
 					  &ls, &next);
   assert(r >= 0);
   dout(20) << __func__ << " got " << ls.size() << " objects" << dendl;
-  int started = 0;
-  for (vector<hobject_t>::iterator p = ls.begin();
-       p != ls.end();
-       ++p) {
-    if (is_degraded_object(*p)) {
-      dout(20) << __func__ << " skip (degraded) " << *p << dendl;
+  int flushed = 0;
+  vector<hobject_t>::iterator p = ls.begin();
+  while (p != ls.end()) {
+    vector<hobject_t>::iterator cur = p++;
+    if (is_degraded_object(*cur)) {
+      dout(20) << __func__ << " skip (degraded) " << *cur << dendl;
       osd->logger->inc(l_osd_agent_skip);
       continue;
     }
-    ObjectContextRef obc = get_object_context(*p, false, NULL);
+    ObjectContextRef obc = get_object_context(*cur, false, NULL);
     if (!obc) {
       // we didn't flush; we may miss something here.
-      dout(20) << __func__ << " skip (no obc) " << *p << dendl;
+      dout(20) << __func__ << " skip (no obc) " << *cur << dendl;
       osd->logger->inc(l_osd_agent_skip);
       continue;
     }
@@ -10555,13 +11179,16 @@ void ReplicatedPG::agent_work(int start_max)
       continue;
     }
 
+    // flushes are async and bounded by start_max; evictions are
+    // bounded by how many objects we listed
     if (agent_state->flush_mode != TierAgentState::FLUSH_MODE_IDLE &&
+	flushed < start_max &&
 	agent_maybe_flush(obc))
-      ++started;
-    if (agent_state->evict_mode != TierAgentState::EVICT_MODE_IDLE &&
-	agent_maybe_evict(obc))
-      ++started;
-    if (started >= start_max)
+      ++flushed;
+    if (agent_state->evict_mode != TierAgentState::EVICT_MODE_IDLE)
+      agent_maybe_evict(obc);
+    if (flushed >= start_max &&
+	agent_state->evict_mode == TierAgentState::EVICT_MODE_IDLE)
       break;
   }
 
@@ -10572,7 +11199,9 @@ void ReplicatedPG::agent_work(int start_max)
     agent_state->temp_hist.decay();
   }
 
-  if (next.is_max())
+  if (p != ls.end())
+    agent_state->position = *p;  // pick up where we stopped
+  else if (next.is_max())
     agent_state->position = hobject_t();
   else
     agent_state->position = next;
@@ -10583,7 +11212,16 @@ void ReplicatedPG::agent_work(int start_max)
 
 void ReplicatedPG::agent_load_hit_sets()
 {
-  if (agent_state->evict_mode == TierAgentState::EVICT_MODE_IDLE) {
+  // a cumulative current set already has all the history we keep
+  if (hit_set && hit_set->is_cumulative()) {
+    agent_state->discard_hit_sets();
+    return;
+  }
+
+  // promote_admits looks back over archived HitSets even when we are
+  // not evicting
+  if (agent_state->evict_mode == TierAgentState::EVICT_MODE_IDLE &&
+      pool.info.min_read_recency_for_promote <= 1) {
     agent_state->discard_hit_sets();
     return;
   }
@@ -10662,6 +11300,7 @@ bool ReplicatedPG::agent_maybe_flush(ObjectContextRef& obc)
   start_flush(ctx, false);
 
   osd->logger->inc(l_osd_agent_flush);
+  osd->logger->inc(l_osd_agent_flush_bytes, obc->obs.oi.size);
   return true;
 }
 
@@ -10727,11 +11366,14 @@ bool ReplicatedPG::agent_maybe_evict(ObjectContextRef& obc)
     // FIXME: ignore temperature for now.
 
     // KISS: if [lower,upper] spans our target effort, evict it.
-    if (atime_lower >= agent_state->evict_effort)
+    if (atime_lower >= agent_state->evict_effort) {
+      osd->logger->inc(l_osd_agent_skip_hot);
       return false;
+    }
   }
 
   dout(10) << __func__ << " evicting " << obc->obs.oi << dendl;
+  uint64_t size = obc->obs.oi.size;
   RepGather *repop = simple_repop_create(obc);
   OpContext *ctx = repop->ctx;
   ctx->at_version = get_next_version();
@@ -10742,6 +11384,7 @@ bool ReplicatedPG::agent_maybe_evict(ObjectContextRef& obc)
   simple_repop_submit(repop);
   osd->logger->inc(l_osd_tier_evict);
   osd->logger->inc(l_osd_agent_evict);
+  osd->logger->inc(l_osd_agent_evict_bytes, size);
   return true;
 }
 
@@ -10751,10 +11394,27 @@ void ReplicatedPG::agent_stop()
   if (agent_state && !agent_state->is_idle()) {
     agent_state->evict_mode = TierAgentState::EVICT_MODE_IDLE;
     agent_state->flush_mode = TierAgentState::FLUSH_MODE_IDLE;
-    osd->agent_disable_pg(this, agent_state->evict_effort);
+    osd->agent_disable_pg(this, agent_state->get_effort());
   }
 }
 
+/// scale how far over target we are into an effort in
+/// [osd_agent_min_evict_effort..1], quantized to avoid too much
+/// reordering in the agent_queue.
+static unsigned agent_effort(CephContext *cct, uint64_t over, uint64_t span)
+{
+  uint64_t effort = span ? MIN(over * 1000000 / span, 1000000) : 1000000;
+  effort = MAX(effort,
+	       (uint64_t)(1000000.0 * cct->_conf->osd_agent_min_evict_effort));
+  uint64_t inc = cct->_conf->osd_agent_quantize_effort * 1000000;
+  assert(inc > 0);
+  effort -= effort % inc;
+  if (effort < inc)
+    effort = inc;
+  assert(effort >= inc && effort <= 1000000);
+  return effort;
+}
+
 void ReplicatedPG::agent_choose_mode()
 {
   uint64_t divisor = pool.info.get_pg_num_divisor(info.pgid.pgid);
@@ -10796,8 +11456,13 @@ void ReplicatedPG::agent_choose_mode()
     flush_target += flush_slop;
   else
     flush_target -= MIN(flush_target, flush_slop);
-  if (dirty_micro > flush_target)
+  unsigned flush_effort = 0;
+  if (dirty_micro > flush_target) {
+    // push harder as the dirty fraction approaches full
     flush_mode = TierAgentState::FLUSH_MODE_ACTIVE;
+    flush_effort = agent_effort(cct, dirty_micro - flush_target,
+				1000000 - MIN(flush_target, 1000000));
+  }
 
   // evict mode
   TierAgentState::evict_mode_t evict_mode = TierAgentState::EVICT_MODE_IDLE;
@@ -10816,23 +11481,16 @@ void ReplicatedPG::agent_choose_mode()
   } else if (full_micro > evict_target) {
     // set effort in [0..1] range based on where we are between
     evict_mode = TierAgentState::EVICT_MODE_SOME;
-    uint64_t over = full_micro - evict_target;
-    uint64_t span = 1000000 - evict_target;
-    evict_effort = MAX(over * 1000000 / span,
-		       (unsigned)(1000000.0 * g_conf->osd_agent_min_evict_effort));
-
-    // quantize effort to avoid too much reordering in the agent_queue.
-    uint64_t inc = g_conf->osd_agent_quantize_effort * 1000000;
-    assert(inc > 0);
-    uint64_t was = evict_effort;
-    evict_effort -= evict_effort % inc;
-    if (evict_effort < inc)
-      evict_effort = inc;
-    assert(evict_effort >= inc && evict_effort <= 1000000);
-    dout(30) << __func__ << " evict_effort " << was << " quantized by " << inc << " to " << evict_effort << dendl;
+    evict_effort = agent_effort(cct, full_micro - evict_target,
+				1000000 - evict_target);
   }
 
+  // when full, only flushing gets us clean objects to evict
+  if (evict_mode == TierAgentState::EVICT_MODE_FULL && flush_effort)
+    flush_effort = 1000000;
+
   bool old_idle = agent_state->is_idle();
+  uint64_t old_effort = agent_state->get_effort();
   if (flush_mode != agent_state->flush_mode) {
     dout(5) << __func__ << " flush_mode "
 	    << TierAgentState::get_flush_mode_name(agent_state->flush_mode)
@@ -10852,7 +11510,6 @@ void ReplicatedPG::agent_choose_mode()
     }
     agent_state->evict_mode = evict_mode;
   }
-  uint64_t old_effort = agent_state->evict_effort;
   if (evict_effort != agent_state->evict_effort) {
     dout(5) << __func__ << " evict_effort "
 	    << ((float)agent_state->evict_effort / 1000000.0)
@@ -10861,19 +11518,26 @@ void ReplicatedPG::agent_choose_mode()
 	    << dendl;
     agent_state->evict_effort = evict_effort;
   }
+  if (flush_effort != agent_state->flush_effort) {
+    dout(5) << __func__ << " flush_effort "
+	    << ((float)agent_state->flush_effort / 1000000.0)
+	    << " -> "
+	    << ((float)flush_effort / 1000000.0)
+	    << dendl;
+    agent_state->flush_effort = flush_effort;
+  }
 
-  // NOTE: we are using evict_effort as a proxy for *all* agent effort
-  // (including flush).  This is probably fine (they should be
-  // correlated) but it is not precisely correct.
+  // we queue by the larger of the flush and evict efforts
+  uint64_t effort = agent_state->get_effort();
   if (agent_state->is_idle()) {
     if (!old_idle) {
       osd->agent_disable_pg(this, old_effort);
     }
   } else {
     if (old_idle) {
-      osd->agent_enable_pg(this, agent_state->evict_effort);
-    } else if (old_effort != agent_state->evict_effort) {
-      osd->agent_adjust_pg(this, old_effort, agent_state->evict_effort);
+      osd->agent_enable_pg(this, effort);
+    } else if (old_effort != effort) {
+      osd->agent_adjust_pg(this, old_effort, effort);
     }
   }
 }
@@ -10885,6 +11549,18 @@ void ReplicatedPG::agent_estimate_atime_temp(const hobject_t& oid,
   *atime = -1;
   if (temp)
     *temp = 0;
+  if (hit_set->is_cumulative()) {
+    // a single lookup in the current set
+    int age = hit_set->get_age(oid);
+    if (age == 0)
+      *atime = 0;
+    else if (age > 0)
+      *atime = (ceph_clock_now(NULL) - hit_set_start_stamp).sec() +
+	(age - 1) * pool.info.hit_set_period;
+    if (temp)
+      *temp = hit_set->get_temperature(oid);
+    return;
+  }
   if (hit_set->contains(oid)) {
     *atime = 0;
     if (temp)
@@ -10994,12 +11670,14 @@ void ReplicatedPG::_scrub(ScrubMap& scrubmap)
     bv.push_back(p->second.attrs[OI_ATTR]);
     object_info_t oi(bv);
 
-    if (pgbackend->be_get_ondisk_size(oi.size) != p->second.size) {
+    uint64_t ondisk_size =
+      pgbackend->be_get_ondisk_size(oi.size, p->second.attrs);
+    if (ondisk_size != p->second.size) {
       osd->clog.error() << mode << " " << info.pgid << " " << soid
 			<< " on disk size (" << p->second.size
 			<< ") does not match object info size ("
 			<< oi.size << ") ajusted for ondisk to ("
-			<< pgbackend->be_get_ondisk_size(oi.size)
+			<< ondisk_size
 			<< ")";
       ++scrubber.shallow_errors;
     }
@@ -11126,6 +11804,15 @@ ReplicatedPG::SnapTrimmer::~SnapTrimmer()
   }
 }
 
+void ReplicatedPG::SnapTrimmer::release()
+{
+  if (!reserved)
+    return;
+  dout(10) << "releasing snap trim slot" << dendl;
+  reserved = false;
+  pg->osd->snap_trim_release();
+}
+
 void ReplicatedPG::SnapTrimmer::log_enter(const char *state_name)
 {
   dout(20) << "enter " << state_name << dendl;
@@ -11163,17 +11850,25 @@ boost::statechart::result ReplicatedPG::NotTrimming::react(const SnapTrim&)
 
   if (!pg->is_primary() || !pg->is_active() || !pg->is_clean()) {
     dout(10) << "NotTrimming not primary, active, clean" << dendl;
+    context< SnapTrimmer >().release();
     return discard_event();
   } else if (pg->scrubber.active) {
     dout(10) << "NotTrimming finalizing scrub" << dendl;
+    context< SnapTrimmer >().release();
     pg->queue_snap_trim();
     return discard_event();
   }
 
-  // Primary trimming
+  // Primary trimming; keep our slot until the whole queue is trimmed
   if (pg->snap_trimq.empty()) {
+    context< SnapTrimmer >().release();
+    return discard_event();
+  } else if (!context< SnapTrimmer >().reserved &&
+	     !pg->osd->snap_trim_reserve(pg)) {
+    dout(10) << "NotTrimming waiting for a snap trim slot" << dendl;
     return discard_event();
   } else {
+    context< SnapTrimmer >().reserved = true;
     context<SnapTrimmer>().snap_to_trim = pg->snap_trimq.range_start();
     dout(10) << "NotTrimming: trimming "
 	     << pg->snap_trimq.range_start()
@@ -11210,10 +11905,27 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
   snapid_t snap_to_trim = context<SnapTrimmer>().snap_to_trim;
   set<RepGather *> &repops = context<SnapTrimmer>().repops;
 
+  // Wait for the last batch to apply; its repops requeue us as they do
+  for (set<RepGather *>::iterator i = repops.begin();
+       i != repops.end();
+       repops.erase(i++)) {
+    if (!(*i)->all_applied) {
+      dout(10) << "TrimmingObjects: waiting on " << repops.size()
+	       << " trims to apply" << dendl;
+      context<SnapTrimmer>().requeue = false;
+      return discard_event();
+    }
+    (*i)->put();
+  }
+
   dout(10) << "TrimmingObjects: trimming snap " << snap_to_trim << dendl;
 
-  // Get next
-  int r = pg->snap_mapper.get_next_object_to_trim(snap_to_trim, &pos);
+  // Get the next batch
+  vector<hobject_t> to_trim;
+  int r = pg->snap_mapper.get_next_objects_to_trim(
+    snap_to_trim,
+    MAX(1, pg->cct->_conf->osd_snap_trim_batch),
+    &to_trim);
   if (r != 0 && r != -ENOENT) {
     derr << __func__ << ": get_next returned " << cpp_strerror(r) << dendl;
     assert(0);
@@ -11224,13 +11936,27 @@ boost::statechart::result ReplicatedPG::TrimmingObjects::react(const SnapTrim&)
     return transit< WaitingOnReplicas >();
   }
 
-  dout(10) << "TrimmingObjects react trimming " << pos << dendl;
-  RepGather *repop = pg->trim_object(pos);
-  assert(repop);
-  repop->queue_snap_trimmer = true;
-
-  repops.insert(repop->get());
-  pg->simple_repop_submit(repop);
+  uint64_t cost = 0, bytes = 0;
+  for (vector<hobject_t>::iterator p = to_trim.begin();
+       p != to_trim.end();
+       ++p) {
+    pos = *p;
+    dout(10) << "TrimmingObjects react trimming " << pos << dendl;
+    RepGather *repop = pg->trim_object(pos);
+    assert(repop);
+    repop->queue_snap_trimmer = true;
+    bytes += repop->obc->obs.oi.size;
+    cost += pg->cct->_conf->osd_snap_trim_cost + repop->obc->obs.oi.size;
+
+    repops.insert(repop->get());
+    pg->simple_repop_submit(repop);
+  }
+  pg->osd->logger->inc(l_osd_snap_trim, to_trim.size());
+  pg->osd->logger->inc(l_osd_snap_trim_bytes, bytes);
+  pg->osd->snap_trim_charge(cost);
+
+  // requeued once the batch has applied
+  context<SnapTrimmer>().requeue = false;
   return discard_event();
 }
 /* WaitingOnReplicasObjects */
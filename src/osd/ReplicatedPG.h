@@ -35,6 +35,7 @@
 #include "messages/MOSDSubOp.h"
 
 #include "common/sharedptr_registry.hpp"
+#include "common/shared_cache.hpp"
 
 #include "PGBackend.h"
 #include "ReplicatedBackend.h"
@@ -65,6 +66,13 @@ public:
   virtual ~PGLSFilter();
   virtual bool filter(bufferlist& xattr_data, bufferlist& outdata) = 0;
   virtual string& get_xattr() { return xattr; }
+
+  /**
+   * decide whether to list obj, appending anything to return for it to
+   * outdata.  The default passes the value of get_xattr() to filter().
+   */
+  virtual bool filter_object(const hobject_t& obj, PGBackend *backend,
+			     bufferlist& outdata);
 };
 
 class PGLSPlainFilter : public PGLSFilter {
@@ -78,6 +86,21 @@ public:
   virtual bool filter(bufferlist& xattr_data, bufferlist& outdata);
 };
 
+/// matches pg_ls_filter_t, see there
+class PGLSObjectFilter : public PGLSFilter {
+  pg_ls_filter_t f;
+public:
+  PGLSObjectFilter(bufferlist::iterator& params) {
+    ::decode(f, params);
+    if (f.xattr.length())
+      xattr = "_" + f.xattr;
+  }
+  virtual ~PGLSObjectFilter() {}
+  virtual bool filter(bufferlist& xattr_data, bufferlist& outdata);
+  virtual bool filter_object(const hobject_t& obj, PGBackend *backend,
+			     bufferlist& outdata);
+};
+
 class PGLSParentFilter : public PGLSFilter {
   inodeno_t parent_ino;
 public:
@@ -166,6 +189,22 @@ public:
   };
   typedef boost::shared_ptr<CopyOp> CopyOpRef;
 
+  /// a client read served from the base tier without promoting
+  struct ProxyReadOp {
+    OpRequestRef op;
+    hobject_t soid;
+    vector<OSDOp> ops;  ///< the client's ops; replies land in their outdata
+
+    tid_t objecter_tid;
+    version_t user_version;
+
+    ProxyReadOp(OpRequestRef _op, hobject_t oid, vector<OSDOp>& _ops)
+      : op(_op), soid(oid), ops(_ops),
+	objecter_tid(0),
+	user_version(0) {}
+  };
+  typedef boost::shared_ptr<ProxyReadOp> ProxyReadOpRef;
+
   /**
    * The CopyCallback class defines an interface for completions to the
    * copy_start code. Users of the copy infrastructure must implement
@@ -449,6 +488,8 @@ public:
     vector<pg_log_entry_t> log;
 
     interval_set<uint64_t> modified_ranges;
+    bool extents_known;                   ///< dirty_extents is all the data we changed
+    interval_set<uint64_t> dirty_extents; ///< for the log entry; see prepare_transaction
     ObjectContextRef obc;
     map<hobject_t,ObjectContextRef> src_obc;
     ObjectContextRef clone_obc;    // if we created a clone
@@ -522,6 +563,7 @@ public:
       bytes_written(0), bytes_read(0), user_at_version(0),
       current_osd_subop_num(0),
       op_t(NULL),
+      extents_known(false),
       data_off(0), reply(NULL), pg(_pg),
       num_read(0),
       num_write(0),
@@ -739,7 +781,7 @@ protected:
   bool agent_maybe_flush(ObjectContextRef& obc);  ///< maybe flush
   bool agent_maybe_evict(ObjectContextRef& obc);  ///< maybe evict
 
-  void agent_load_hit_sets();  ///< load HitSets, if needed
+  void agent_load_hit_sets();  ///< load HitSets, if needed (by the agent or promote_admits)
 
   /// estimate object atime and temperature
   ///
@@ -785,7 +827,7 @@ protected:
   friend struct C_OnPushCommit;
 
   // projected object info
-  SharedPtrRegistry<hobject_t, ObjectContext> object_contexts;
+  ShardedSharedLRU<hobject_t, ObjectContext> object_contexts;
   map<object_t, SnapSetContext*> snapset_contexts;
   Mutex snapset_contexts_lock;
 
@@ -968,7 +1010,8 @@ protected:
 				 bool write_ordered,
 				 ObjectContextRef obc, int r,
 				 const hobject_t& missing_oid,
-				 bool must_promote);
+				 bool must_promote,
+				 bool in_hit_set = false);
   /**
    * This helper function tells the client to redirect their request elsewhere.
    */
@@ -984,6 +1027,15 @@ protected:
    */
   bool can_skip_promote(OpRequestRef op, ObjectContextRef obc);
 
+  /**
+   * Check whether a read miss on oid has been seen often enough lately
+   * to be worth promoting, per the pool's min_read_{recency,frequency}
+   * _for_promote.
+   *
+   * @param in_hit_set whether oid was in the current HitSet before this op
+   */
+  bool promote_admits(const hobject_t& oid, bool in_hit_set);
+
   int prepare_transaction(OpContext *ctx);
   list<pair<OpRequestRef, OpContext*> > in_progress_async_reads;
   void complete_read_ctx(int result, OpContext *ctx);
@@ -1140,6 +1192,15 @@ protected:
 
   friend struct C_Copyfrom;
 
+  // -- proxyread --
+  map<tid_t, ProxyReadOpRef> proxyread_ops;
+
+  void do_proxy_read(OpRequestRef op);
+  void finish_proxy_read(tid_t tid, int r);
+  void cancel_proxy_read_ops(bool requeue);
+
+  friend struct C_ProxyRead;
+
   // -- flush --
   map<hobject_t, FlushOpRef> flush_ops;
 
@@ -1193,6 +1254,12 @@ public:
   void snap_trimmer();
   int do_osd_ops(OpContext *ctx, vector<OSDOp>& ops);
 
+  // reads on behalf of object class methods, without the OSDOp round trip
+  int do_cls_getxattr(OpContext *ctx, const string& name, bufferlist *out);
+  int do_cls_omap_get_header(OpContext *ctx, bufferlist *out);
+  int do_cls_omap_get_vals_by_keys(OpContext *ctx, const set<string>& keys,
+				   map<string, bufferlist> *out);
+
   int _get_tmap(OpContext *ctx, bufferlist *header, bufferlist *vals);
   int do_tmap2omap(OpContext *ctx, unsigned flags);
   int do_tmapup(OpContext *ctx, bufferlist::iterator& bp, OSDOp& osd_op);
@@ -1238,8 +1305,11 @@ private:
     snapid_t snap_to_trim;
     bool need_share_pg_info;
     bool requeue;
-    SnapTrimmer(ReplicatedPG *pg) : pg(pg), need_share_pg_info(false), requeue(false) {}
+    bool reserved;  ///< we hold one of the osd's osd_max_trimming_pgs slots
+    SnapTrimmer(ReplicatedPG *pg)
+      : pg(pg), need_share_pg_info(false), requeue(false), reserved(false) {}
     ~SnapTrimmer();
+    void release();
     void log_enter(const char *state_name);
     void log_exit(const char *state_name, utime_t duration);
   } snap_trimmer_machine;
@@ -1279,6 +1349,12 @@ private:
   int _verify_no_head_clones(const hobject_t& soid,
 			     const SnapSet& ss);
   int _delete_head(OpContext *ctx, bool no_whiteout);
+
+  // -- data digest --
+  epoch_t data_digest_epoch;  ///< when we last checked the up osds' features
+  bool data_digest_ok;
+  bool can_track_data_digest();
+  void write_data_digest(object_info_t& oi, uint64_t off, bufferlist& bl);
   int _rollback_to(OpContext *ctx, ceph_osd_op& op);
 public:
   bool same_for_read_since(epoch_t e);
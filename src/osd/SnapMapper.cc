@@ -46,6 +46,24 @@ int OSDriver::get_next(
   }
 }
 
+int OSDriver::get_next_n(
+  const std::string &key,
+  unsigned max,
+  std::vector<pair<std::string, bufferlist> > *out)
+{
+  ObjectMap::ObjectMapIterator iter =
+    os->get_omap_iterator(cid, hoid);
+  if (!iter) {
+    assert(0);
+    return -EINVAL;
+  }
+  for (iter->upper_bound(key);
+       iter->valid() && out->size() < max;
+       iter->next())
+    out->push_back(make_pair(iter->key(), iter->value()));
+  return out->empty() ? -ENOENT : 0;
+}
+
 struct Mapping {
   snapid_t snap;
   hobject_t hoid;
@@ -262,6 +280,42 @@ int SnapMapper::get_next_object_to_trim(
   return -ENOENT;
 }
 
+int SnapMapper::get_next_objects_to_trim(
+  snapid_t snap,
+  unsigned max,
+  vector<hobject_t> *out)
+{
+  assert(out);
+  assert(out->empty());
+  for (set<string>::iterator i = prefixes.begin();
+       i != prefixes.end() && out->size() < max;
+       ++i) {
+    string list_after(get_prefix(snap) + *i);
+
+    vector<pair<string, bufferlist> > next;
+    int r = backend.get_next_n(list_after, max - out->size(), &next);
+    if (r == -ENOENT)
+      break; // Done
+    if (r < 0)
+      return r;
+
+    for (vector<pair<string, bufferlist> >::iterator j = next.begin();
+	 j != next.end();
+	 ++j) {
+      if (j->first.substr(0, list_after.size()) != list_after)
+	break; // Done with this prefix
+
+      assert(is_mapping(j->first));
+
+      pair<snapid_t, hobject_t> next_decoded(from_raw(*j));
+      assert(next_decoded.first == snap);
+      assert(check(next_decoded.second));
+      out->push_back(next_decoded.second);
+    }
+  }
+  return out->empty() ? -ENOENT : 0;
+}
+
 
 int SnapMapper::remove_oid(
   const hobject_t &oid,
@@ -17,6 +17,7 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <utility>
 #include <string.h>
 
@@ -71,6 +72,10 @@ public:
   int get_next(
     const std::string &key,
     pair<std::string, bufferlist> *next);
+  int get_next_n(
+    const std::string &key,
+    unsigned max,
+    std::vector<pair<std::string, bufferlist> > *out);
 };
 
 /**
@@ -216,6 +221,13 @@ public:
     hobject_t *hoid             ///< [out] next hoid to trim
     );  ///< @return error, -ENOENT if no more objects
 
+  /// Returns up to max objects with snap as a snap, with one scan per prefix
+  int get_next_objects_to_trim(
+    snapid_t snap,              ///< [in] snap to check
+    unsigned max,               ///< [in] most objects to return
+    std::vector<hobject_t> *out ///< [out] next hoids to trim
+    );  ///< @return error, -ENOENT if no more objects
+
   /// Remove mapping for oid
   int remove_oid(
     const hobject_t &oid,    ///< [in] oid to remove
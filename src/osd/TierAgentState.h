@@ -65,13 +65,23 @@ struct TierAgentState {
   /// distributed) that i should aim to evict.
   unsigned evict_effort;
 
+  /// how hard to flush, in [0..1000000], by how far over the dirty
+  /// target we are
+  unsigned flush_effort;
+
   TierAgentState()
     : hist_age(0),
       flush_mode(FLUSH_MODE_IDLE),
       evict_mode(EVICT_MODE_IDLE),
-      evict_effort(0)
+      evict_effort(0),
+      flush_effort(0)
   {}
 
+  /// overall urgency; our priority in the OSD's agent queue
+  unsigned get_effort() const {
+    return MAX(evict_effort, flush_effort);
+  }
+
   /// false if we have any work to do
   bool is_idle() const {
     return
@@ -99,6 +109,7 @@ struct TierAgentState {
     f->dump_string("flush_mode", get_flush_mode_name());
     f->dump_string("evict_mode", get_evict_mode_name());
     f->dump_unsigned("evict_effort", evict_effort);
+    f->dump_unsigned("flush_effort", flush_effort);
     f->dump_stream("position") << position;
     f->open_object_section("atime_hist");
     atime_hist.dump(f);
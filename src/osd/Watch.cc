@@ -26,6 +26,31 @@ static ostream& _prefix(
   return *_dout << notify->gen_dbg_prefix();
 }
 
+NotifySendBatch::~NotifySendBatch()
+{
+  for (map<ConnectionRef, list<Message*> >::iterator p = msgs.begin();
+       p != msgs.end();
+       ++p) {
+    for (list<Message*>::iterator q = p->second.begin();
+	 q != p->second.end();
+	 ++q)
+      (*q)->put();
+  }
+}
+
+void NotifySendBatch::finish(int r)
+{
+  for (map<ConnectionRef, list<Message*> >::iterator p = msgs.begin();
+       p != msgs.end();
+       ++p) {
+    while (!p->second.empty()) {
+      osd->send_message_osd_client(p->second.front(), p->first);
+      p->second.pop_front();
+    }
+  }
+  msgs.clear();
+}
+
 Notify::Notify(
   ConnectionRef client,
   unsigned num_watchers,
@@ -143,11 +168,11 @@ void Notify::unregister_cb()
   }
 }
 
-void Notify::start_watcher(WatchRef watch)
+void Notify::start_watchers(const list<WatchRef> &ws)
 {
   Mutex::Locker l(lock);
-  dout(10) << "start_watcher" << dendl;
-  watchers.insert(watch);
+  dout(10) << "start_watchers " << ws.size() << dendl;
+  watchers.insert(ws.begin(), ws.end());
 }
 
 void Notify::complete_watcher(WatchRef watch)
@@ -380,15 +405,14 @@ void Watch::remove()
   discard_state();
 }
 
-void Watch::start_notify(NotifyRef notif)
+void Watch::start_notify(NotifyRef notif, NotifySendBatch *batch)
 {
   dout(10) << "start_notify " << notif->notify_id << dendl;
   assert(in_progress_notifies.find(notif->notify_id) ==
 	 in_progress_notifies.end());
   in_progress_notifies[notif->notify_id] = notif;
-  notif->start_watcher(self.lock());
   if (connected())
-    send_notify(notif);
+    send_notify(notif, batch);
 }
 
 void Watch::cancel_notify(NotifyRef notif)
@@ -397,13 +421,16 @@ void Watch::cancel_notify(NotifyRef notif)
   in_progress_notifies.erase(notif->notify_id);
 }
 
-void Watch::send_notify(NotifyRef notif)
+void Watch::send_notify(NotifyRef notif, NotifySendBatch *batch)
 {
   dout(10) << "send_notify" << dendl;
   MWatchNotify *notify_msg = new MWatchNotify(
     cookie, notif->version, notif->notify_id,
     WATCH_NOTIFY, notif->payload);
-  osd->send_message_osd_client(notify_msg, conn.get());
+  if (batch)
+    batch->add(conn, notify_msg);
+  else
+    osd->send_message_osd_client(notify_msg, conn.get());
 }
 
 void Watch::notify_ack(uint64_t notify_id)
@@ -44,6 +44,29 @@ typedef ceph::weak_ptr<Notify> WNotifyRef;
 
 struct CancelableContext;
 
+/**
+ * MWatchNotify messages built under a pg lock, sent once it is dropped
+ *
+ * Messages are grouped by connection, so that a connection watching
+ * many objects gets its notifies queued back to back.  They all share
+ * the payload buffers of their Notify.
+ */
+class NotifySendBatch : public Context {
+  OSDService *osd;
+  map<ConnectionRef, list<Message*> > msgs;
+public:
+  NotifySendBatch(OSDService *osd) : osd(osd) {}
+  ~NotifySendBatch();
+
+  bool empty() const {
+    return msgs.empty();
+  }
+  void add(ConnectionRef con, Message *m) {
+    msgs[con].push_back(m);
+  }
+  void finish(int r);
+};
+
 /**
  * Notify tracks the progress of a particular notify
  *
@@ -121,9 +144,9 @@ public:
   /// Call after creation to initialize
   void init();
 
-  /// Called once per watcher prior to init()
-  void start_watcher(
-    WatchRef watcher ///< [in] watcher to complete
+  /// Called with all the watchers prior to init()
+  void start_watchers(
+    const list<WatchRef> &ws ///< [in] watchers to notify
     );
 
   /// Called once per NotifyAck
@@ -175,8 +198,8 @@ class Watch {
   /// Unregisters the timeout callback
   void unregister_cb();
 
-  /// send a Notify message when connected for notif
-  void send_notify(NotifyRef notif);
+  /// send a Notify message when connected for notif, or add it to batch
+  void send_notify(NotifyRef notif, NotifySendBatch *batch = NULL);
 
   /// Cleans up state on discard or remove (including Connection state, obc)
   void discard_state();
@@ -225,9 +248,10 @@ public:
   /// Called on unwatch
   void remove();
 
-  /// Adds notif as in-progress notify
+  /// Adds notif as in-progress notify; the caller passes us to notif
   void start_notify(
-    NotifyRef notif ///< [in] Reference to new in-progress notify
+    NotifyRef notif, ///< [in] Reference to new in-progress notify
+    NotifySendBatch *batch = NULL ///< [in] where to queue the message, if any
     );
 
   /// Removes timed out notify
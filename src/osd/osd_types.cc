@@ -14,6 +14,7 @@
 
 #include "osd_types.h"
 #include "include/ceph_features.h"
+#include "common/strtol.h"
 extern "C" {
 #include "crush/hash.h"
 }
@@ -794,6 +795,8 @@ void pg_pool_t::dump(Formatter *f) const
   f->close_section(); // hit_set_params
   f->dump_unsigned("hit_set_period", hit_set_period);
   f->dump_unsigned("hit_set_count", hit_set_count);
+  f->dump_unsigned("min_read_recency_for_promote", min_read_recency_for_promote);
+  f->dump_unsigned("min_read_frequency_for_promote", min_read_frequency_for_promote);
   f->dump_unsigned("stripe_width", get_stripe_width());
 }
 
@@ -808,6 +811,19 @@ int pg_pool_t::calc_bits_of(int t)
   return b;
 }
 
+uint64_t pg_pool_t::get_expected_num_objects() const
+{
+  map<string,string>::const_iterator p =
+    properties.find("expected_num_objects");
+  if (p == properties.end())
+    return 0;
+  string err;
+  long long n = strict_strtoll(p->second.c_str(), 10, &err);
+  if (!err.empty() || n < 0)
+    return 0;
+  return n;
+}
+
 void pg_pool_t::calc_pg_masks()
 {
   pg_num_mask = (1 << calc_bits_of(pg_num-1)) - 1;
@@ -1046,7 +1062,7 @@ void pg_pool_t::encode(bufferlist& bl, uint64_t features) const
   }
 
   __u8 encode_compat = 5;
-  ENCODE_START(13, encode_compat, bl);
+  ENCODE_START(14, encode_compat, bl);
   ::encode(type, bl);
   ::encode(size, bl);
   ::encode(crush_ruleset, bl);
@@ -1086,12 +1102,14 @@ void pg_pool_t::encode(bufferlist& bl, uint64_t features) const
   ::encode(cache_target_full_ratio_micro, bl);
   ::encode(cache_min_flush_age, bl);
   ::encode(cache_min_evict_age, bl);
+  ::encode(min_read_recency_for_promote, bl);
+  ::encode(min_read_frequency_for_promote, bl);
   ENCODE_FINISH_NEW_COMPAT(bl, encode_compat);
 }
 
 void pg_pool_t::decode(bufferlist::iterator& bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(13, 5, 5, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(14, 5, 5, bl);
   ::decode(type, bl);
   ::decode(size, bl);
   ::decode(crush_ruleset, bl);
@@ -1186,6 +1204,14 @@ void pg_pool_t::decode(bufferlist::iterator& bl)
     cache_min_flush_age = def.cache_min_flush_age;
     cache_min_evict_age = def.cache_min_evict_age;
   }
+  if (struct_v >= 14) {
+    ::decode(min_read_recency_for_promote, bl);
+    ::decode(min_read_frequency_for_promote, bl);
+  } else {
+    pg_pool_t def;
+    min_read_recency_for_promote = def.min_read_recency_for_promote;
+    min_read_frequency_for_promote = def.min_read_frequency_for_promote;
+  }
 
   DECODE_FINISH(bl);
   calc_pg_masks();
@@ -1240,6 +1266,8 @@ void pg_pool_t::generate_test_instances(list<pg_pool_t*>& o)
   a.cache_target_full_ratio_micro = 987222;
   a.cache_min_flush_age = 231;
   a.cache_min_evict_age = 2321;
+  a.min_read_recency_for_promote = 3;
+  a.min_read_frequency_for_promote = 2;
   o.push_back(new pg_pool_t(a));
 }
 
@@ -1281,6 +1309,10 @@ ostream& operator<<(ostream& out, const pg_pool_t& p)
 	<< " " << p.hit_set_period << "s"
 	<< " x" << p.hit_set_count;
   }
+  if (p.min_read_recency_for_promote)
+    out << " min_read_recency_for_promote " << p.min_read_recency_for_promote
+	<< " min_read_frequency_for_promote "
+	<< p.min_read_frequency_for_promote;
   out << " stripe_width " << p.get_stripe_width();
   return out;
 }
@@ -2451,6 +2483,19 @@ void pg_log_entry_t::encode_with_checksum(bufferlist& bl) const
   ::encode(crc, bl);
 }
 
+static void compact_bl(bufferlist& bl)
+{
+  if (bl.length() &&
+      (!bl.is_contiguous() || bl.buffers().front().raw_length() > bl.length()))
+    bl.rebuild();
+}
+
+void pg_log_entry_t::compact_buffers()
+{
+  compact_bl(snaps);
+  compact_bl(mod_desc.bl);
+}
+
 void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 {
   bufferlist bl;
@@ -2465,7 +2510,7 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(9, 4, bl);
+  ENCODE_START(10, 4, bl);
   ::encode(op, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
@@ -2489,12 +2534,14 @@ void pg_log_entry_t::encode(bufferlist &bl) const
   ::encode(snaps, bl);
   ::encode(user_version, bl);
   ::encode(mod_desc, bl);
+  ::encode(has_extents, bl);
+  ::encode(extents, bl);
   ENCODE_FINISH(bl);
 }
 
 void pg_log_entry_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(8, 4, 4, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(10, 4, 4, bl);
   ::decode(op, bl);
   if (struct_v < 2) {
     sobject_t old_soid;
@@ -2541,7 +2588,16 @@ void pg_log_entry_t::decode(bufferlist::iterator &bl)
   else
     mod_desc.mark_unrollbackable();
 
+  if (struct_v >= 10) {
+    ::decode(has_extents, bl);
+    ::decode(extents, bl);
+  } else {
+    has_extents = false;
+    extents.clear();
+  }
+
   DECODE_FINISH(bl);
+  compact_buffers();
 }
 
 void pg_log_entry_t::dump(Formatter *f) const
@@ -2571,6 +2627,8 @@ void pg_log_entry_t::dump(Formatter *f) const
     mod_desc.dump(f);
     f->close_section();
   }
+  if (has_extents)
+    f->dump_stream("extents") << extents;
 }
 
 void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
@@ -2580,6 +2638,11 @@ void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
   o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,2), eversion_t(3,4),
 				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
 				 utime_t(8,9)));
+  o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,3), eversion_t(1,2),
+				 2, osd_reqid_t(entity_name_t::CLIENT(777), 9, 999),
+				 utime_t(8,10)));
+  o.back()->has_extents = true;
+  o.back()->extents.insert(4096, 4096);
 }
 
 ostream& operator<<(ostream& out, const pg_log_entry_t& e)
@@ -3515,6 +3578,7 @@ void object_info_t::copy_user_bits(const object_info_t& other)
   truncate_seq = other.truncate_seq;
   truncate_size = other.truncate_size;
   flags = other.flags;
+  data_digest = other.data_digest;
   category = other.category;
   user_version = other.user_version;
 }
@@ -3542,7 +3606,7 @@ void object_info_t::encode(bufferlist& bl) const
        ++i) {
     old_watchers.insert(make_pair(i->first.second, i->second));
   }
-  ENCODE_START(13, 8, bl);
+  ENCODE_START(14, 8, bl);
   ::encode(soid, bl);
   ::encode(myoloc, bl);	//Retained for compatibility
   ::encode(category, bl);
@@ -3567,13 +3631,14 @@ void object_info_t::encode(bufferlist& bl) const
   ::encode(watchers, bl);
   __u32 _flags = flags;
   ::encode(_flags, bl);
+  ::encode(data_digest, bl);
   ENCODE_FINISH(bl);
 }
 
 void object_info_t::decode(bufferlist::iterator& bl)
 {
   object_locator_t myoloc;
-  DECODE_START_LEGACY_COMPAT_LEN(13, 8, 8, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(14, 8, 8, bl);
   map<entity_name_t, watch_info_t> old_watchers;
   if (struct_v >= 2 && struct_v <= 5) {
     sobject_t obj;
@@ -3645,6 +3710,11 @@ void object_info_t::decode(bufferlist::iterator& bl)
     ::decode(_flags, bl);
     flags = (flag_t)_flags;
   }
+  if (struct_v >= 14) {
+    ::decode(data_digest, bl);
+  } else {
+    clear_data_digest();
+  }
   DECODE_FINISH(bl);
 }
 
@@ -3669,6 +3739,8 @@ void object_info_t::dump(Formatter *f) const
   f->close_section();
   f->dump_unsigned("truncate_seq", truncate_seq);
   f->dump_unsigned("truncate_size", truncate_size);
+  if (is_data_digest())
+    f->dump_unsigned("data_digest", data_digest);
   f->open_object_section("watchers");
   for (map<pair<uint64_t, entity_name_t>,watch_info_t>::const_iterator p =
          watchers.begin(); p != watchers.end(); ++p) {
@@ -3771,7 +3843,7 @@ void ObjectRecoveryProgress::dump(Formatter *f) const
 
 void ObjectRecoveryInfo::encode(bufferlist &bl) const
 {
-  ENCODE_START(2, 1, bl);
+  ENCODE_START(3, 1, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
   ::encode(size, bl);
@@ -3779,13 +3851,14 @@ void ObjectRecoveryInfo::encode(bufferlist &bl) const
   ::encode(ss, bl);
   ::encode(copy_subset, bl);
   ::encode(clone_subset, bl);
+  ::encode(partial, bl);
   ENCODE_FINISH(bl);
 }
 
 void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
 				int64_t pool)
 {
-  DECODE_START(2, bl);
+  DECODE_START(3, bl);
   ::decode(soid, bl);
   ::decode(version, bl);
   ::decode(size, bl);
@@ -3793,6 +3866,10 @@ void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
   ::decode(ss, bl);
   ::decode(copy_subset, bl);
   ::decode(clone_subset, bl);
+  if (struct_v >= 3)
+    ::decode(partial, bl);
+  else
+    partial = false;
   DECODE_FINISH(bl);
 
   if (struct_v < 2) {
@@ -3838,6 +3915,7 @@ void ObjectRecoveryInfo::dump(Formatter *f) const
   }
   f->dump_stream("copy_subset") << copy_subset;
   f->dump_stream("clone_subset") << clone_subset;
+  f->dump_bool("partial", partial);
 }
 
 ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
@@ -3851,6 +3929,7 @@ ostream &ObjectRecoveryInfo::print(ostream &out) const
 	     << soid << "@" << version
 	     << ", copy_subset: " << copy_subset
 	     << ", clone_subset: " << clone_subset
+	     << (partial ? ", partial" : "")
 	     << ")";
 }
 
@@ -4391,3 +4470,7 @@ void OSDOp::merge_osd_op_vector_out_data(vector<OSDOp>& ops, bufferlist& out)
     }
   }
 }
+
+// -- ObjectContext --
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(ObjectContext, osd_obc)
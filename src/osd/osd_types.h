@@ -28,6 +28,7 @@
 #include "include/utime.h"
 #include "include/CompatSet.h"
 #include "common/histogram.h"
+#include "common/mempool.h"
 #include "include/interval_set.h"
 #include "common/Formatter.h"
 #include "common/bloom_filter.hpp"
@@ -614,6 +615,7 @@ public:
   }
 };
 WRITE_CLASS_ENCODER(eversion_t)
+WRITE_FIXED_ENCODING_TRAITS(eversion_t, 12)
 
 inline bool operator==(const eversion_t& l, const eversion_t& r) {
   return (l.epoch == r.epoch) && (l.version == r.version);
@@ -810,6 +812,8 @@ struct pg_pool_t {
     FLAG_HASHPSPOOL = 1, // hash pg seed and pool together (instead of adding)
     FLAG_FULL       = 2, // pool is full
     FLAG_DEBUG_FAKE_EC_POOL = 1<<2, // require ReplicatedPG to act like an EC pg
+    FLAG_EC_FAST_READ = 1<<3, // read extra shards, complete on the first decodable set
+    FLAG_REPLICA_READS = 1<<4, // clients may read from replicas
   };
 
   static const char *get_flag_name(int f) {
@@ -817,6 +821,8 @@ struct pg_pool_t {
     case FLAG_HASHPSPOOL: return "hashpspool";
     case FLAG_FULL: return "full";
     case FLAG_DEBUG_FAKE_EC_POOL: return "require_local_rollback";
+    case FLAG_EC_FAST_READ: return "fast_read";
+    case FLAG_REPLICA_READS: return "replica_reads";
     default: return "???";
     }
   }
@@ -927,6 +933,8 @@ public:
   HitSet::Params hit_set_params; ///< The HitSet params to use on this pool
   uint32_t hit_set_period;      ///< periodicity of HitSet segments (seconds)
   uint32_t hit_set_count;       ///< number of periods to retain
+  uint32_t min_read_recency_for_promote;   ///< HitSets a read miss looks back over before promoting (0 for always promote)
+  uint32_t min_read_frequency_for_promote; ///< how many of those it must appear in (0 for all)
 
   uint32_t stripe_width;        ///< erasure coded stripe size in bytes
 
@@ -950,6 +958,8 @@ public:
       hit_set_params(),
       hit_set_period(0),
       hit_set_count(0),
+      min_read_recency_for_promote(0),
+      min_read_frequency_for_promote(0),
       stripe_width(0)
   { }
 
@@ -1036,6 +1046,9 @@ public:
     return quota_max_objects;
   }
 
+  /// "expected_num_objects" property, 0 if unset or malformed
+  uint64_t get_expected_num_objects() const;
+
   static int calc_bits_of(int t);
   void calc_pg_masks();
 
@@ -1922,10 +1935,15 @@ struct pg_log_entry_t {
 
   /// describes state for a locally-rollbackable entry
   ObjectModDesc mod_desc;
+
+  /// data changed by a MODIFY, if we know; lets recovery push only that
+  bool has_extents;
+  interval_set<uint64_t> extents;
       
   pg_log_entry_t()
     : op(0), user_version(0),
-      invalid_hash(false), invalid_pool(false), offset(0) {}
+      invalid_hash(false), invalid_pool(false), offset(0),
+      has_extents(false) {}
   pg_log_entry_t(int _op, const hobject_t& _soid, 
 		 const eversion_t& v, const eversion_t& pv,
 		 version_t uv,
@@ -1933,7 +1951,7 @@ struct pg_log_entry_t {
     : op(_op), soid(_soid), version(v),
       prior_version(pv), user_version(uv),
       reqid(rid), mtime(mt), invalid_hash(false), invalid_pool(false),
-      offset(0) {}
+      offset(0), has_extents(false) {}
       
   bool is_clone() const { return op == CLONE; }
   bool is_modify() const { return op == MODIFY; }
@@ -1957,6 +1975,10 @@ struct pg_log_entry_t {
     return reqid != osd_reqid_t() && (op == MODIFY || op == DELETE);
   }
 
+  /// copy snaps and mod_desc into buffers of their own size, so that an
+  /// entry kept in the log does not pin the page or message they came from
+  void compact_buffers();
+
   string get_key_name() const;
   void encode_with_checksum(bufferlist& bl) const;
   void decode_with_checksum(bufferlist::iterator& p);
@@ -2203,6 +2225,110 @@ struct pg_ls_response_t {
 
 WRITE_CLASS_ENCODER(pg_ls_response_t)
 
+/**
+ * pg_ls_filter_t - objects a pgls with the "object" filter returns
+ *
+ * An object is listed only if it matches every condition.  The OSD
+ * evaluates it, so clients get only the objects they want and, with
+ * want_info, their size and mtime without stat-ing each one.
+ */
+struct pg_ls_filter_t {
+  string prefix;          ///< object name starts with this
+  string xattr;           ///< if not empty, user xattr that must ...
+  bufferlist xattr_value; ///< ... have this value
+  uint64_t min_size, max_size;
+  utime_t min_mtime, max_mtime;  ///< zero max_mtime means no bound
+  bool want_info;         ///< return a pg_ls_info_t per listed object
+
+  pg_ls_filter_t()
+    : min_size(0), max_size((uint64_t)-1), want_info(false) {}
+
+  bool needs_object_info() const {
+    return min_size > 0 || max_size != (uint64_t)-1 ||
+      min_mtime != utime_t() || max_mtime != utime_t() || want_info;
+  }
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(prefix, bl);
+    ::encode(xattr, bl);
+    ::encode(xattr_value, bl);
+    ::encode(min_size, bl);
+    ::encode(max_size, bl);
+    ::encode(min_mtime, bl);
+    ::encode(max_mtime, bl);
+    ::encode(want_info, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(prefix, bl);
+    ::decode(xattr, bl);
+    ::decode(xattr_value, bl);
+    ::decode(min_size, bl);
+    ::decode(max_size, bl);
+    ::decode(min_mtime, bl);
+    ::decode(max_mtime, bl);
+    ::decode(want_info, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const {
+    f->dump_string("prefix", prefix);
+    f->dump_string("xattr", xattr);
+    f->dump_unsigned("xattr_value_len", xattr_value.length());
+    f->dump_unsigned("min_size", min_size);
+    f->dump_unsigned("max_size", max_size);
+    f->dump_stream("min_mtime") << min_mtime;
+    f->dump_stream("max_mtime") << max_mtime;
+    f->dump_int("want_info", want_info);
+  }
+  static void generate_test_instances(list<pg_ls_filter_t*>& o) {
+    o.push_back(new pg_ls_filter_t);
+    o.push_back(new pg_ls_filter_t);
+    o.back()->prefix = "rbd_data.";
+    o.back()->xattr = "owner";
+    o.back()->xattr_value.append("me");
+    o.back()->min_size = 1;
+    o.back()->max_size = 4096;
+    o.back()->min_mtime = utime_t(1, 2);
+    o.back()->max_mtime = utime_t(3, 4);
+    o.back()->want_info = true;
+  }
+};
+WRITE_CLASS_ENCODER(pg_ls_filter_t)
+
+/// metadata of an object listed with pg_ls_filter_t::want_info
+struct pg_ls_info_t {
+  uint64_t size;
+  utime_t mtime;
+
+  pg_ls_info_t() : size(0) {}
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(size, bl);
+    ::encode(mtime, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(size, bl);
+    ::decode(mtime, bl);
+    DECODE_FINISH(bl);
+  }
+  void dump(Formatter *f) const {
+    f->dump_unsigned("size", size);
+    f->dump_stream("mtime") << mtime;
+  }
+  static void generate_test_instances(list<pg_ls_info_t*>& o) {
+    o.push_back(new pg_ls_info_t);
+    o.push_back(new pg_ls_info_t);
+    o.back()->size = 4096;
+    o.back()->mtime = utime_t(1, 2);
+  }
+};
+WRITE_CLASS_ENCODER(pg_ls_info_t)
+
 /**
  * object_copy_cursor_t
  */
@@ -2483,6 +2609,7 @@ struct object_info_t {
     FLAG_WHITEOUT = 1<<1,  // object logically does not exist
     FLAG_DIRTY    = 1<<2,  // object has been modified since last flushed or undirtied
     FLAG_OMAP     = 1 << 3,  // has (or may have) some/any omap data
+    FLAG_DATA_DIGEST = 1 << 4,  // has a data_digest
     // ...
     FLAG_USES_TMAP = 1<<8,  // deprecated; no longer used.
   } flag_t;
@@ -2501,6 +2628,8 @@ struct object_info_t {
       s += "|uses_tmap";
     if (flags & FLAG_OMAP)
       s += "|omap";
+    if (flags & FLAG_DATA_DIGEST)
+      s += "|data_digest";
     if (s.length())
       return s.substr(1);
     return s;
@@ -2516,6 +2645,9 @@ struct object_info_t {
 
   map<pair<uint64_t, entity_name_t>, watch_info_t> watchers;
 
+  /// crc32c (seed 0) of all of the data, if FLAG_DATA_DIGEST
+  __u32 data_digest;
+
   void copy_user_bits(const object_info_t& other);
 
   static ps_t legacy_object_locator_to_ps(const object_t &oid, 
@@ -2539,6 +2671,17 @@ struct object_info_t {
   bool is_dirty() const {
     return test_flag(FLAG_DIRTY);
   }
+  bool is_data_digest() const {
+    return test_flag(FLAG_DATA_DIGEST);
+  }
+  void set_data_digest(__u32 d) {
+    set_flag(FLAG_DATA_DIGEST);
+    data_digest = d;
+  }
+  void clear_data_digest() {
+    clear_flag(FLAG_DATA_DIGEST);
+    data_digest = 0;
+  }
 
   void encode(bufferlist& bl) const;
   void decode(bufferlist::iterator& bl);
@@ -2551,13 +2694,13 @@ struct object_info_t {
 
   explicit object_info_t()
     : user_version(0), size(0), flags((flag_t)0),
-      truncate_seq(0), truncate_size(0)
+      truncate_seq(0), truncate_size(0), data_digest(0)
   {}
 
   object_info_t(const hobject_t& s)
     : soid(s),
       user_version(0), size(0), flags((flag_t)0),
-      truncate_seq(0), truncate_size(0) {}
+      truncate_seq(0), truncate_size(0), data_digest(0) {}
 
   object_info_t(bufferlist& bl) {
     decode(bl);
@@ -2598,6 +2741,8 @@ struct ObjectContext;
 typedef ceph::shared_ptr<ObjectContext> ObjectContextRef;
 
 struct ObjectContext {
+  MEMPOOL_CLASS_HELPERS()
+
   ObjectState obs;
 
   SnapSetContext *ssc;  // may be null
@@ -2877,8 +3022,10 @@ struct ObjectRecoveryInfo {
   SnapSet ss;
   interval_set<uint64_t> copy_subset;
   map<hobject_t, interval_set<uint64_t> > clone_subset;
+  /// copy_subset is only what changed since the version the target has
+  bool partial;
 
-  ObjectRecoveryInfo() : size(0) { }
+  ObjectRecoveryInfo() : size(0), partial(false) { }
 
   static void generate_test_instances(list<ObjectRecoveryInfo*>& o);
   void encode(bufferlist &bl) const;
@@ -26,6 +26,7 @@
 #include "include/Context.h"
 
 #include "common/config.h"
+#include "common/perf_counters.h"
 
 #define dout_subsys ceph_subsys_filer
 #undef dout_prefix
@@ -161,8 +162,11 @@ void Filer::_probed(Probe *probe, const object_t& oid, uint64_t size, utime_t mt
     if (!probe->found_size) {
       assert(probe->known_size[p->oid] <= shouldbe);
 
+      // going backward, an empty object is only the end if it is the
+      // first object of the file
       if ((probe->fwd && probe->known_size[p->oid] == shouldbe) ||
-	  (!probe->fwd && probe->known_size[p->oid] == 0 && probe->probing_off > 0))
+	  (!probe->fwd && probe->known_size[p->oid] == 0 &&
+	   (probe->probing_off > 0 || p + 1 != probe->probing.end())))
 	continue;  // keep going
       
       // aha, we found the end!
@@ -194,16 +198,21 @@ void Filer::_probed(Probe *probe, const object_t& oid, uint64_t size, utime_t mt
     // keep probing!
     ldout(cct, 10) << "_probed probing further" << dendl;
 
+    // probe twice as many periods at once each round, up to
+    // filer_probe_max_periods, so that long runs of full (or empty)
+    // objects take few round trips.
     uint64_t period = (uint64_t)probe->layout.fl_stripe_count * (uint64_t)probe->layout.fl_object_size;
+    unsigned max_window = MAX(1, cct->_conf->filer_probe_max_periods);
+    probe->window = MIN(probe->window * 2, max_window);
     if (probe->fwd) {
       probe->probing_off += probe->probing_len;
       assert(probe->probing_off % period == 0);
-      probe->probing_len = period;
+      probe->probing_len = period * probe->window;
     } else {
-      // previous period.
+      // previous periods.
       assert(probe->probing_off % period == 0);
-      probe->probing_len = period;
-      probe->probing_off -= period;
+      probe->probing_len = MIN(period * probe->window, probe->probing_off);
+      probe->probing_off -= probe->probing_len;
     }
     _probe(probe);
     return;
@@ -231,6 +240,8 @@ struct PurgeRange {
   int flags;
   Context *oncommit;
   int uncommitted;
+  uint64_t total;
+  utime_t start;
 };
 
 int Filer::purge_range(inodeno_t ino,
@@ -262,6 +273,12 @@ int Filer::purge_range(inodeno_t ino,
   pr->flags = flags;
   pr->oncommit = oncommit;
   pr->uncommitted = 0;
+  pr->total = num_obj;
+  pr->start = ceph_clock_now(cct);
+
+  purge_pending += num_obj;
+  if (logger)
+    logger->set(logger_key_purge_pending, purge_pending);
 
   _do_purge_range(pr, 0);
   return 0;
@@ -282,13 +299,26 @@ void Filer::_do_purge_range(PurgeRange *pr, int fin)
   ldout(cct, 10) << "_do_purge_range " << pr->ino << " objects " << pr->first << "~" << pr->num
 	   << " uncommitted " << pr->uncommitted << dendl;
 
+  if (fin) {
+    purge_pending -= fin;
+    if (logger) {
+      logger->inc(logger_key_purge_objects, fin);
+      logger->set(logger_key_purge_pending, purge_pending);
+    }
+  }
+
   if (pr->num == 0 && pr->uncommitted == 0) {
+    utime_t dur = ceph_clock_now(cct) - pr->start;
+    ldout(cct, 5) << "_do_purge_range " << pr->ino << " purged " << pr->total
+		  << " objects in " << dur << dendl;
+    if (logger)
+      logger->tinc(logger_key_purge_lat, dur);
     pr->oncommit->complete(0);
     delete pr;
     return;
   }
 
-  int max = 10 - pr->uncommitted;
+  int max = MAX(1, cct->_conf->filer_max_purge_ops) - pr->uncommitted;
   while (pr->num > 0 && max > 0) {
     object_t oid = file_object_t(pr->ino, pr->first);
     object_locator_t oloc = objecter->osdmap->file_to_object_locator(pr->layout);
@@ -35,6 +35,7 @@
 class Context;
 class Messenger;
 class OSDMap;
+class PerfCounters;
 
 
 
@@ -61,6 +62,7 @@ class Filer {
     
     vector<ObjectExtent> probing;
     uint64_t probing_off, probing_len;
+    unsigned window;  // periods probed at once; doubles each round
     
     map<object_t, uint64_t> known_size;
     utime_t max_mtime;
@@ -74,7 +76,7 @@ class Filer {
 	  uint64_t f, uint64_t *e, utime_t *m, int fl, bool fw, Context *c) : 
       ino(i), layout(l), snapid(sn),
       psize(e), pmtime(m), flags(fl), fwd(fw), onfinish(c),
-      probing_off(f), probing_len(0),
+      probing_off(f), probing_len(0), window(1),
       err(0), found_size(false) {}
   };
   
@@ -83,13 +85,33 @@ class Filer {
   void _probe(Probe *p);
   void _probed(Probe *p, const object_t& oid, uint64_t size, utime_t mtime);
 
+  // purge accounting
+  PerfCounters *logger;
+  int logger_key_purge_objects, logger_key_purge_pending, logger_key_purge_lat;
+  uint64_t purge_pending;  // objects not yet removed, over all purge_range()s
+
  public:
   Filer(const Filer& other);
   const Filer operator=(const Filer& other);
 
-  Filer(Objecter *o) : cct(o->cct), objecter(o) {}
+  Filer(Objecter *o) : cct(o->cct), objecter(o),
+		       logger(NULL), logger_key_purge_objects(-1),
+		       logger_key_purge_pending(-1), logger_key_purge_lat(-1),
+		       purge_pending(0) {}
   ~Filer() {}
 
+  /**
+   * Count objects removed by purge_range() under the objects (u64
+   * counter) key, those still to remove under pending (u64), and the
+   * time each purge_range() takes under lat (time avg).
+   */
+  void set_purge_logger(PerfCounters *l, int objects, int pending, int lat) {
+    logger = l;
+    logger_key_purge_objects = objects;
+    logger_key_purge_pending = pending;
+    logger_key_purge_lat = lat;
+  }
+
   bool is_active() {
     return objecter->is_active(); // || (oc && oc->is_active());
   }
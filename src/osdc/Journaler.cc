@@ -60,10 +60,18 @@ void Journaler::set_layout(ceph_file_layout *l)
 
   // prefetch intelligently.
   // (watch out, this is big if you use big objects or weird striping)
+  // start with a short read-ahead, and let wait_for_readable() grow it
+  // if the reader keeps up with it.
   uint64_t periods = cct->_conf->journaler_prefetch_periods;
   if (periods < 2)
     periods = 2;  // we need at least 2 periods to make progress.
-  fetch_len = layout.fl_stripe_count * layout.fl_object_size * periods;
+  uint64_t start = cct->_conf->journaler_prefetch_min_periods;
+  if (start < 2)
+    start = 2;
+  if (start > periods)
+    start = periods;
+  fetch_len_max = get_layout_period() * periods;
+  fetch_len = get_layout_period() * start;
 }
 
 
@@ -419,6 +427,12 @@ void Journaler::_finish_flush(int r, uint64_t start, utime_t stamp)
 		 << "/" << flush_pos << "/" << safe_pos
 		 << dendl;
 
+  // group commit: send whatever was flushed while this write was in flight
+  if (flush_deferred) {
+    flush_deferred = false;
+    _do_flush();
+  }
+
   // kick waiters <= safe_pos
   while (!waitfor_safe.empty()) {
     if (waitfor_safe.begin()->first > safe_pos)
@@ -463,6 +477,7 @@ uint64_t Journaler::append_entry(bufferlist& bl)
   ::encode(s, write_buf);
   write_buf.claim_append(bl);
   write_pos += sizeof(s) + s;
+  write_buf_entries++;
 
   // flush previous object?
   uint64_t su = get_layout_period();
@@ -516,6 +531,11 @@ void Journaler::_do_flush(unsigned amount)
     waiting_for_zero = false;
   }
   ldout(cct, 10) << "_do_flush flushing " << flush_pos << "~" << len << dendl;
+
+  if (logger && logger_key_write_entries >= 0 && write_buf_entries) {
+    logger->inc(logger_key_write_entries, write_buf_entries);
+    write_buf_entries = 0;
+  }
   
   // submit write for anything pending
   // flush _start_ pos to _finish_flush
@@ -592,6 +612,14 @@ void Journaler::flush(Context *onsafe)
 	  timer->cancel_event(delay_flush_event);
 	delay_flush_event = new C_DelayFlush(this);
 	timer->add_event_after(cct->_conf->journaler_batch_interval, delay_flush_event);	
+      } else if (cct->_conf->journaler_max_inflight_writes > 0 &&
+		 (int)pending_safe.size() >= cct->_conf->journaler_max_inflight_writes &&
+		 write_buf.length() < cct->_conf->journaler_group_commit_max) {
+	// group commit: go out with everything else flushed until a
+	// write in flight commits, rather than as a write of our own
+	ldout(cct, 20) << "flush deferring flush, " << pending_safe.size()
+		       << " writes in flight" << dendl;
+	flush_deferred = true;
       } else {
 	ldout(cct, 20) << "flush not delaying flush" << dendl;
 	_do_flush();
@@ -965,6 +993,14 @@ void Journaler::wait_for_readable(Context *onreadable)
   assert(!_is_readable());
   assert(on_readable == 0);
   on_readable = onreadable;
+
+  // the reader has caught up with reads still in flight; read further
+  // ahead so that more objects are in flight at once.
+  if (requested_pos > received_pos && fetch_len < fetch_len_max) {
+    fetch_len = MIN(fetch_len * 2, fetch_len_max);
+    ldout(cct, 10) << "wait_for_readable growing fetch_len to " << fetch_len << dendl;
+    _prefetch();
+  }
 }
 
 
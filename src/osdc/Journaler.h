@@ -114,6 +114,7 @@ private:
 
   PerfCounters *logger;
   int logger_key_lat;
+  int logger_key_write_entries;
 
   SafeTimer *timer;
 
@@ -173,6 +174,8 @@ private:
   uint64_t flush_pos;       // where we will flush. if write_pos>flush_pos, we're buffering writes.
   uint64_t safe_pos;        // what has been committed safely to disk.
   bufferlist write_buf;  // write buffer.  flush_pos + write_buf.length() == write_pos.
+  uint64_t write_buf_entries; // entries appended since the last write went out
+  bool flush_deferred;   // a flush waits for an in-flight write to commit
 
   bool waiting_for_zero;
   interval_set<uint64_t> pending_zero;  // non-contig bits we've zeroed
@@ -192,7 +195,8 @@ private:
 
   map<uint64_t,bufferlist> prefetch_buf;
 
-  uint64_t fetch_len;     // how much to read at a time
+  uint64_t fetch_len;     // how far to read ahead of read_pos
+  uint64_t fetch_len_max; // ... at most, as fetch_len grows
   uint64_t temp_fetch_len;
 
   // for wait_for_readable()
@@ -245,12 +249,14 @@ public:
     cct(obj->cct), last_written(mag), last_committed(mag),
     ino(ino_), pg_pool(pool), readonly(true), magic(mag),
     objecter(obj), filer(objecter), logger(l), logger_key_lat(lkey),
+    logger_key_write_entries(-1),
     timer(tim), delay_flush_event(0),
     state(STATE_UNDEF), error(0),
     prezeroing_pos(0), prezero_pos(0), write_pos(0), flush_pos(0), safe_pos(0),
+    write_buf_entries(0), flush_deferred(false),
     waiting_for_zero(false),
     read_pos(0), requested_pos(0), received_pos(0),
-    fetch_len(0), temp_fetch_len(0),
+    fetch_len(0), fetch_len_max(0), temp_fetch_len(0),
     on_readable(0), on_write_error(NULL),
     expire_pos(0), trimming_pos(0), trimmed_pos(0) 
   {
@@ -261,6 +267,8 @@ public:
     assert(state == STATE_ACTIVE);
     readonly = true;
     delay_flush_event = 0;
+    flush_deferred = false;
+    write_buf_entries = 0;
     state = STATE_UNDEF;
     error = 0;
     prezeroing_pos = 0;
@@ -272,6 +280,7 @@ public:
     requested_pos = 0;
     received_pos = 0;
     fetch_len = 0;
+    fetch_len_max = 0;
     assert(!on_readable);
     expire_pos = 0;
     trimming_pos = 0;
@@ -353,6 +362,14 @@ public:
     on_write_error = c;
   }
 
+  /**
+   * Count the entries that go out in each journal write under
+   * this (u64 avg) key of the logger.
+   */
+  void set_write_entries_logger_key(int key) {
+    logger_key_write_entries = key;
+  }
+
   // trim
   void set_expire_pos(int64_t ep) { expire_pos = ep; }
   void set_trimmed_pos(int64_t p) { trimming_pos = trimmed_pos = p; }
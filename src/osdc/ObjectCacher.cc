@@ -505,7 +505,7 @@ ObjectCacher::ObjectCacher(CephContext *cct_, string name, WritebackHandler& wb,
     cct(cct_), writeback_handler(wb), name(name), lock(l),
     max_dirty(max_dirty), target_dirty(target_dirty),
     max_size(max_bytes), max_objects(max_objects),
-    block_writes_upfront(block_writes_upfront),
+    block_writes_upfront(block_writes_upfront), max_coalesced_write(0),
     flush_set_callback(flush_callback), flush_set_callback_arg(flush_callback_arg),
     last_read_tid(0),
     flusher_stop(false), flusher_thread(this), finisher(cct),
@@ -799,11 +799,115 @@ void ObjectCacher::bh_read_finish(int64_t poolid, sobject_t oid, tid_t tid,
 }
 
 
+void ObjectCacher::get_coalesced_bhs(BufferHead *bh,
+				     list<BufferHead*> *blist)
+{
+  assert(lock.is_locked());
+  Object *ob = bh->ob;
+  uint64_t total = bh->length();
+  blist->push_back(bh);
+
+  // grow the write outwards from bh, skipping over clean, missing and
+  // in-flight extents; bhs written under another snap context have to
+  // go in their own write
+  map<loff_t, BufferHead*>::iterator left = ob->data.find(bh->start());
+  map<loff_t, BufferHead*>::iterator right = left;
+  assert(left != ob->data.end());
+  ++right;
+  bool more_left = left != ob->data.begin();
+  bool more_right = right != ob->data.end();
+  while (more_left || more_right) {
+    if (more_right) {
+      BufferHead *r = right->second;
+      if (r->is_dirty() && r->snapc.seq == bh->snapc.seq) {
+	if (total + r->length() > max_coalesced_write) {
+	  more_right = false;
+	} else {
+	  total += r->length();
+	  blist->push_back(r);
+	}
+      }
+      if (more_right) {
+	++right;
+	more_right = right != ob->data.end();
+      }
+    }
+    if (more_left) {
+      --left;
+      BufferHead *l = left->second;
+      if (l->is_dirty() && l->snapc.seq == bh->snapc.seq) {
+	if (total + l->length() > max_coalesced_write) {
+	  more_left = false;
+	  continue;
+	}
+	total += l->length();
+	blist->push_front(l);
+      }
+      more_left = left != ob->data.begin();
+    }
+  }
+}
+
+void ObjectCacher::bh_write_scattered(list<BufferHead*>& blist)
+{
+  assert(lock.is_locked());
+  BufferHead *front = blist.front();
+  Object *ob = front->ob;
+  ldout(cct, 7) << "bh_write_scattered " << blist.size() << " bhs from "
+		<< *front << " to " << *blist.back() << dendl;
+
+  ob->get();
+
+  vector<pair<uint64_t, bufferlist> > io_vec;
+  utime_t last_write;
+  uint64_t total = 0;
+  for (list<BufferHead*>::iterator p = blist.begin(); p != blist.end(); ++p) {
+    BufferHead *bh = *p;
+    assert(bh->ob == ob);
+    io_vec.push_back(make_pair(bh->start(), bh->bl));
+    if (bh->last_write > last_write)
+      last_write = bh->last_write;
+    total += bh->length();
+  }
+
+  // the commit applies to every tx bh in the range with this tid
+  loff_t start = front->start();
+  loff_t end = blist.back()->end();
+  C_WriteCommit *oncommit = new C_WriteCommit(this, ob->oloc.pool,
+					      ob->get_soid(), start,
+					      end - start);
+  tid_t tid = writeback_handler.write_vector(ob->get_oid(), ob->get_oloc(),
+					     io_vec, front->snapc, last_write,
+					     ob->truncate_size,
+					     ob->truncate_seq, oncommit);
+  ldout(cct, 20) << " tid " << tid << " on " << ob->get_oid() << dendl;
+
+  oncommit->tid = tid;
+  ob->last_write_tid = tid;
+  for (list<BufferHead*>::iterator p = blist.begin(); p != blist.end(); ++p) {
+    (*p)->last_write_tid = tid;
+    mark_tx(*p);
+  }
+
+  if (perfcounter) {
+    perfcounter->inc(l_objectcacher_data_flushed, total);
+  }
+}
+
 void ObjectCacher::bh_write(BufferHead *bh)
 {
   assert(lock.is_locked());
   ldout(cct, 7) << "bh_write " << *bh << dendl;
 
+  if (max_coalesced_write && writeback_handler.can_scattered_write()) {
+    list<BufferHead*> blist;
+    get_coalesced_bhs(bh, &blist);
+    if (blist.size() > 1) {
+      bh_write_scattered(blist);
+      return;
+    }
+  }
+
   bh->ob->get();
 
   // finishers
@@ -922,12 +1026,12 @@ void ObjectCacher::bh_write_commit(int64_t poolid, sobject_t oid, loff_t start,
   }
 }
 
-void ObjectCacher::flush(loff_t amount)
+bool ObjectCacher::flush(loff_t amount, int max_bhs)
 {
   assert(lock.is_locked());
   utime_t cutoff = ceph_clock_now(cct);
 
-  ldout(cct, 10) << "flush " << amount << dendl;
+  ldout(cct, 10) << "flush " << amount << " max_bhs " << max_bhs << dendl;
   
   /*
    * NOTE: we aren't actually pulling things off the LRU here, just looking at the
@@ -935,14 +1039,19 @@ void ObjectCacher::flush(loff_t amount)
    * can call lru_dirty.lru_get_next_expire() again.
    */
   loff_t did = 0;
+  int started = 0;
   while (amount == 0 || did < amount) {
+    if (max_bhs && started == max_bhs)
+      return false;
     BufferHead *bh = static_cast<BufferHead*>(bh_lru_dirty.lru_get_next_expire());
     if (!bh) break;
     if (bh->last_write > cutoff) break;
 
     did += bh->length();
     bh_write(bh);
-  }    
+    ++started;
+  }
+  return true;
 }
 
 
@@ -1441,7 +1550,13 @@ void ObjectCacher::flusher_entry()
 		     << " dirty_waiting > target "
 		     << target_dirty
 		     << ", flushing some dirty bhs" << dendl;
-      flush(actual - target_dirty);
+      if (!flush(actual - target_dirty, MAX_FLUSH_UNDER_LOCK)) {
+	// back off the lock so readers and writers can get in between
+	// batches, then recheck how much is left to flush
+	lock.Unlock();
+	lock.Lock();
+	continue;
+      }
     } else {
       // check tail of lru for old dirty items
       utime_t cutoff = ceph_clock_now(cct);
@@ -335,6 +335,7 @@ class ObjectCacher {
   uint64_t max_dirty, target_dirty, max_size, max_objects;
   utime_t max_dirty_age;
   bool block_writes_upfront;
+  uint64_t max_coalesced_write;
 
   flush_set_callback_t flush_set_callback;
   void *flush_set_callback_arg;
@@ -433,9 +434,25 @@ class ObjectCacher {
   // io
   void bh_read(BufferHead *bh);
   void bh_write(BufferHead *bh);
+  void bh_write_scattered(list<BufferHead*>& blist);
+  /**
+   * find the dirty bhs of bh's object that can be written back along
+   * with it, in offset order
+   *
+   * @param bh dirty bh that is being written back
+   * @param blist [out] bhs to write, including bh
+   */
+  void get_coalesced_bhs(BufferHead *bh, list<BufferHead*> *blist);
 
   void trim();
-  void flush(loff_t amount=0);
+  /**
+   * start writeback on the oldest dirty buffers
+   *
+   * @param amount bytes to flush, or 0 for all dirty buffers
+   * @param max_bhs stop after starting this many writes, 0 for no limit
+   * @return false if max_bhs was reached before amount
+   */
+  bool flush(loff_t amount=0, int max_bhs=0);
 
   /**
    * flush a range of buffers
@@ -618,6 +635,14 @@ public:
   void set_max_dirty(uint64_t v) {
     max_dirty = v;
   }
+  /**
+   * write back other dirty extents of an object along with the one
+   * being flushed, as a single op of up to this many bytes, if the
+   * writeback handler can do scattered writes; 0 disables this
+   */
+  void set_max_coalesced_write(uint64_t v) {
+    max_coalesced_write = v;
+  }
 
   // file functions
 
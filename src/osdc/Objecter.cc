@@ -67,6 +67,8 @@ enum {
   l_osdc_op_w,
   l_osdc_op_rmw,
   l_osdc_op_pg,
+  l_osdc_op_r_lat_outb_hist,
+  l_osdc_op_w_lat_inb_hist,
 
   l_osdc_osdop_stat,
   l_osdc_osdop_create,
@@ -159,6 +161,14 @@ void Objecter::handle_conf_change(const struct md_config_t *conf,
 
 // messages ------------------------------
 
+// latency in usec from 100us to ~13s, size in bytes from 512 to 64MB
+static const PerfHistogram::axis_config_d op_hist_lat_axis = {
+  "latency_usec", PerfHistogram::SCALE_LOG2, 0, 100, 20
+};
+static const PerfHistogram::axis_config_d op_hist_bytes_axis = {
+  "size_bytes", PerfHistogram::SCALE_LOG2, 0, 512, 20
+};
+
 void Objecter::init_unlocked()
 {
   assert(!initialized);
@@ -179,6 +189,10 @@ void Objecter::init_unlocked()
     pcb.add_u64_counter(l_osdc_op_w, "op_w");
     pcb.add_u64_counter(l_osdc_op_rmw, "op_rmw");
     pcb.add_u64_counter(l_osdc_op_pg, "op_pg");
+    pcb.add_histogram(l_osdc_op_r_lat_outb_hist, "op_r_latency_out_bytes_histogram",
+		      op_hist_lat_axis, op_hist_bytes_axis);
+    pcb.add_histogram(l_osdc_op_w_lat_inb_hist, "op_w_latency_in_bytes_histogram",
+		      op_hist_lat_axis, op_hist_bytes_axis);
 
     pcb.add_u64_counter(l_osdc_osdop_stat, "osdop_stat");
     pcb.add_u64_counter(l_osdc_osdop_create, "osdop_create");
@@ -477,6 +491,17 @@ void Objecter::dispatch(Message *m)
   }
 }
 
+void Objecter::update_osdmap_mapping()
+{
+  if (!cct->_conf->osd_map_mapping_cache)
+    return;
+  OSDMapMapping *mapping = new OSDMapMapping;
+  mapping->update(*osdmap, cct->_conf->osd_map_mapping_threads);
+  ldout(cct, 10) << "update_osdmap_mapping " << mapping->get_num_pgs()
+		 << " pgs at e" << osdmap->get_epoch() << dendl;
+  osdmap->set_mapping(OSDMapMappingRef(mapping));
+}
+
 void Objecter::scan_requests(bool force_resend,
 			     bool force_resend_writes,
 			     map<tid_t, Op*>& need_resend,
@@ -619,6 +644,8 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	logger->set(l_osdc_map_epoch, osdmap->get_epoch());
 
 	was_full = was_full || osdmap->test_flag(CEPH_OSDMAP_FULL);
+	if (e == m->get_last())
+	  update_osdmap_mapping();
 	scan_requests(skipped_map, was_full, need_resend, need_resend_linger,
 		      need_resend_command);
 
@@ -643,6 +670,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
       if (m->maps.count(m->get_last())) {
 	ldout(cct, 3) << "handle_osd_map decoding full epoch " << m->get_last() << dendl;
 	osdmap->decode(m->maps[m->get_last()]);
+	update_osdmap_mapping();
 
 	scan_requests(false, false, need_resend, need_resend_linger,
 		      need_resend_command);
@@ -1239,12 +1267,63 @@ tid_t Objecter::op_submit(Op *op)
   return _op_submit(op);
 }
 
-tid_t Objecter::_op_submit(Op *op)
+void Objecter::op_submit_batch(vector<Op*>& ops)
+{
+  assert(client_lock.is_locked());
+  assert(initialized);
+
+  ldout(cct, 10) << "op_submit_batch " << ops.size() << " ops" << dendl;
+  vector<Op*> to_send;
+  to_send.reserve(ops.size());
+  for (vector<Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+    Op *op = *p;
+    assert(op->ops.size() == op->out_bl.size());
+    assert(op->ops.size() == op->out_rval.size());
+    assert(op->ops.size() == op->out_handler.size());
+
+    if (osd_timeout > 0) {
+      op->ontimeout = new C_CancelOp(op, this);
+      timer.add_event_after(osd_timeout, op->ontimeout);
+    }
+
+    if (!try_take_op_budget(op)) {
+      // waiting for budget drops our lock; send what is already
+      // mapped before a new map can come in under us
+      _send_op_batch(to_send);
+      take_op_budget(op);
+    }
+    _op_submit(op, &to_send);
+  }
+  _send_op_batch(to_send);
+}
+
+void Objecter::_send_op_batch(vector<Op*>& to_send)
+{
+  map<int, vector<Op*> > by_osd;
+  for (vector<Op*>::iterator p = to_send.begin(); p != to_send.end(); ++p)
+    by_osd[(*p)->session->osd].push_back(*p);
+  to_send.clear();
+
+  for (map<int, vector<Op*> >::iterator p = by_osd.begin();
+       p != by_osd.end();
+       ++p) {
+    ldout(cct, 20) << "_send_op_batch " << p->second.size() << " ops to osd."
+		   << p->first << dendl;
+    for (vector<Op*>::iterator q = p->second.begin();
+	 q != p->second.end();
+	 ++q)
+      send_op(*q);
+  }
+}
+
+tid_t Objecter::_op_submit(Op *op, vector<Op*> *to_send)
 {
   // pick tid
   tid_t mytid = ++last_tid;
   op->tid = mytid;
   assert(client_inc >= 0);
+  if (op->submit_stamp == utime_t())
+    op->submit_stamp = ceph_clock_now(cct);
 
   // pick target
   num_homeless_ops++;  // initially; recalc_op_target() will decrement if it finds a target
@@ -1334,7 +1413,10 @@ tid_t Objecter::_op_submit(Op *op)
     op->paused = true;
     maybe_request_map();
   } else if (op->session) {
-    send_op(op);
+    if (to_send)
+      to_send->push_back(op);
+    else
+      send_op(op);
   } else {
     maybe_request_map();
   }
@@ -1484,14 +1566,23 @@ int Objecter::recalc_op_target(Op *op)
     op->used_replica = false;
     if (primary != -1) {
       int osd;
-      bool read = is_read && !is_write;
-      if (read && (op->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
+      bool read = is_read && !is_write && !op->read_from_primary;
+      int read_flags = op->flags;
+      if (read && !op->precalc_pgid &&
+	  !(read_flags & (CEPH_OSD_FLAG_BALANCE_READS |
+			  CEPH_OSD_FLAG_LOCALIZE_READS))) {
+	const pg_pool_t *pi = osdmap->get_pg_pool(pgid.pool());
+	if (pi && (pi->get_flags() & pg_pool_t::FLAG_REPLICA_READS))
+	  read_flags |= crush_location.empty() ?
+	    CEPH_OSD_FLAG_BALANCE_READS : CEPH_OSD_FLAG_LOCALIZE_READS;
+      }
+      if (read && (read_flags & CEPH_OSD_FLAG_BALANCE_READS)) {
 	int p = rand() % acting.size();
 	if (p)
 	  op->used_replica = true;
 	osd = acting[p];
 	ldout(cct, 10) << " chose random osd." << osd << " of " << acting << dendl;
-      } else if (read && (op->flags & CEPH_OSD_FLAG_LOCALIZE_READS) &&
+      } else if (read && (read_flags & CEPH_OSD_FLAG_LOCALIZE_READS) &&
 		 acting.size() > 1) {
 	// look for a local replica.  prefer the primary if the
 	// distance is the same.
@@ -1756,6 +1847,11 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
 
   if (rc == -EAGAIN) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
+    if (op->used_replica) {
+      // the replica could not serve it; ask the primary this time
+      op->read_from_primary = true;
+      op->acting.clear();
+    }
     unregister_op(op);
     _op_submit(op);
     m->put();
@@ -1770,6 +1866,12 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
   // per-op result demuxing
   vector<OSDOp> out_ops;
   m->claim_ops(out_ops);
+
+  uint64_t inb = 0, outb = 0;
+  for (vector<OSDOp>::iterator p = op->ops.begin(); p != op->ops.end(); ++p)
+    inb += p->indata.length();
+  for (vector<OSDOp>::iterator p = out_ops.begin(); p != out_ops.end(); ++p)
+    outb += p->outdata.length();
   
   if (out_ops.size() != op->ops.size())
     ldout(cct, 0) << "WARNING: tid " << op->tid << " reply ops " << out_ops
@@ -1826,20 +1928,31 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
   }
 
   // done with this tid?
+  bool complete_unlocked = op->complete_unlocked;
   if (!op->onack && !op->oncommit) {
     ldout(cct, 15) << "handle_osd_op_reply completed tid " << tid << dendl;
+    int64_t lat = (ceph_clock_now(cct) - op->submit_stamp).to_nsec() / 1000;
+    if (op->flags & CEPH_OSD_FLAG_WRITE)
+      logger->hinc(l_osdc_op_w_lat_inb_hist, lat, inb);
+    else if (op->flags & CEPH_OSD_FLAG_READ)
+      logger->hinc(l_osdc_op_r_lat_outb_hist, lat, outb);
     finish_op(op);
   }
   
   ldout(cct, 5) << num_unacked << " unacked, " << num_uncommitted << " uncommitted" << dendl;
 
   // do callbacks
+  complete_unlocked = complete_unlocked && (onack || oncommit);
+  if (complete_unlocked)
+    client_lock.Unlock();
   if (onack) {
     onack->complete(rc);
   }
   if (oncommit) {
     oncommit->complete(rc);
   }
+  if (complete_unlocked)
+    client_lock.Lock();
 
   m->put();
 }
@@ -1877,7 +1990,7 @@ void Objecter::list_objects(ListContext *list_context, Context *onfinish)
     ++list_context->current_pg;
     list_context->current_pg_epoch = 0;
     list_context->cookie = collection_list_handle_t();
-    if (list_context->current_pg >= list_context->starting_pg_num) {
+    if (list_context->current_pg >= list_context->end_pg) {
       list_context->at_end_of_pool = true;
       ldout(cct, 20) << " no more pgs; reached end of pool" << dendl;
     } else {
@@ -1893,18 +2006,28 @@ void Objecter::list_objects(ListContext *list_context, Context *onfinish)
   int pg_num = pool->get_pg_num();
 
   if (list_context->starting_pg_num == 0) {     // there can't be zero pgs!
-    list_context->starting_pg_num = pg_num;
+    list_context->set_pg_num(pg_num);
     ldout(cct, 20) << pg_num << " placement groups" << dendl;
+    if (list_context->current_pg < list_context->start_pg)
+      list_context->current_pg = list_context->start_pg;
   }
   if (list_context->starting_pg_num != pg_num) {
     // start reading from the beginning; the pgs have changed
     ldout(cct, 10) << " pg_num changed; restarting with " << pg_num << dendl;
-    list_context->current_pg = 0;
+    list_context->set_pg_num(pg_num);
+    list_context->current_pg = list_context->start_pg;
     list_context->cookie = collection_list_handle_t();
     list_context->current_pg_epoch = 0;
-    list_context->starting_pg_num = pg_num;
   }
   assert(list_context->current_pg <= pg_num);
+  if (list_context->current_pg >= list_context->end_pg) {
+    // our shard has no pgs, or we were seeked past them
+    ldout(cct, 20) << " past pg " << list_context->end_pg
+		   << "; reached end of shard" << dendl;
+    list_context->at_end_of_pool = true;
+    onfinish->complete(0);
+    return;
+  }
 
   ObjectOperation op;
   op.pg_ls(list_context->max_entries, list_context->filter, list_context->cookie,
@@ -1939,9 +2062,20 @@ void Objecter::_list_reply(ListContext *list_context, int r,
   int response_size = response.entries.size();
   ldout(cct, 20) << " response.entries.size " << response_size
 		 << ", response.entries " << response.entries << dendl;
-  list_context->extra_info.append(extra_info);
-  if (response_size) {
-    list_context->list.merge(response.entries);
+  if (list_context->want_info) {
+    bufferlist::iterator p = extra_info.begin();
+    while (!p.end()) {
+      pg_ls_info_t info;
+      ::decode(info, p);
+      list_context->info.push_back(info);
+    }
+    // keep the entries in the order of their info
+    list_context->list.splice(list_context->list.end(), response.entries);
+  } else {
+    list_context->extra_info.append(extra_info);
+    if (response_size) {
+      list_context->list.merge(response.entries);
+    }
   }
 
   // if the osd returns 1 (newer code), or no entries, it means we
@@ -194,8 +194,9 @@ struct ObjectOperation {
     string mname = "filter";
     ::encode(cname, osd_op.indata);
     ::encode(mname, osd_op.indata);
-    ::encode(cookie, osd_op.indata);
+    // the osd decodes the filter before the cookie
     osd_op.indata.append(filter);
+    ::encode(cookie, osd_op.indata);
   }
 
   // ------
@@ -1060,6 +1061,7 @@ public:
     vector<int> acting;  ///< acting for last pg we mapped to
     int primary;         ///< primary for last pg we mapped to
     bool used_replica;
+    bool read_from_primary;  ///< a replica sent us back; don't try another
 
     ConnectionRef con;  // for rx buffer only
 
@@ -1087,6 +1089,7 @@ public:
     epoch_t *reply_epoch;
 
     utime_t stamp;
+    utime_t submit_stamp;  ///< first submission; stamp is the last send
 
     epoch_t map_dne_bound;
 
@@ -1095,13 +1098,20 @@ public:
     /// true if we should resend this message on failure
     bool should_resend;
 
+    /**
+     * true if onack and oncommit do not need client_lock, so they are
+     * completed with it dropped instead of making every other user of
+     * the Objecter wait on them.  Out handlers still run under the lock.
+     */
+    bool complete_unlocked;
+
     Op(const object_t& o, const object_locator_t& ol, vector<OSDOp>& op,
        int f, Context *ac, Context *co, version_t *ov) :
       session(NULL), session_item(this), incarnation(0),
       base_oid(o), base_oloc(ol),
       precalc_pgid(false),
       primary(-1),
-      used_replica(false), con(NULL),
+      used_replica(false), read_from_primary(false), con(NULL),
       snapid(CEPH_NOSNAP),
       outbl(NULL),
       flags(f), priority(0), onack(ac), oncommit(co),
@@ -1110,7 +1120,8 @@ public:
       paused(false), objver(ov), reply_epoch(NULL),
       map_dne_bound(0),
       budgeted(false),
-      should_resend(true) {
+      should_resend(true),
+      complete_unlocked(false) {
       ops.swap(op);
       
       /* initialize out_* to match op vector */
@@ -1206,23 +1217,41 @@ public:
     int max_entries;
     string nspace;
 
+    /// list only piece shard of num_shards, split by pg
+    uint32_t shard;
+    uint32_t num_shards;
+    int start_pg, end_pg;  ///< pgs of our shard, [start_pg, end_pg)
+
     bufferlist bl;   // raw data read to here
     std::list<pair<object_t, string> > list;
 
     bufferlist filter;
 
     bufferlist extra_info;
+    /// the filter returns a pg_ls_info_t per entry, kept here in step
+    /// with list instead of in extra_info
+    bool want_info;
+    std::list<pg_ls_info_t> info;
 
     ListContext() : current_pg(0), current_pg_epoch(0), starting_pg_num(0),
 		    at_end_of_pool(false),
 		    at_end_of_pg(false),
 		    pool_id(0),
-		    pool_snap_seq(0), max_entries(0) {}
+		    pool_snap_seq(0), max_entries(0),
+		    shard(0), num_shards(1),
+		    start_pg(0), end_pg(0),
+		    want_info(false) {}
 
     bool at_end() const {
       return at_end_of_pool;
     }
 
+    void set_pg_num(int pg_num) {
+      starting_pg_num = pg_num;
+      start_pg = (uint64_t)pg_num * shard / num_shards;
+      end_pg = (uint64_t)pg_num * (shard + 1) / num_shards;
+    }
+
     uint32_t get_pg_hash_position() const {
       return current_pg;
     }
@@ -1492,6 +1521,23 @@ public:
     }
     op->budgeted = true;
   }
+  /// take op's budget only if that does not mean waiting for it
+  bool try_take_op_budget(Op *op) {
+    int op_budget = calc_op_budget(op);
+    if (keep_balanced_budget) {
+      if (!op_throttle_bytes.get_or_fail(op_budget))
+	return false;
+      if (!op_throttle_ops.get_or_fail(1)) {
+	op_throttle_bytes.put(op_budget);
+	return false;
+      }
+    } else {
+      op_throttle_bytes.take(op_budget);
+      op_throttle_ops.take(1);
+    }
+    op->budgeted = true;
+    return true;
+  }
   void put_op_budget(Op *op) {
     assert(op->budgeted);
     int op_budget = calc_op_budget(op);
@@ -1550,6 +1596,8 @@ public:
 		     map<tid_t, Op*>& need_resend,
 		     list<LingerOp*>& need_resend_linger,
 		     map<tid_t, CommandOp*>& need_resend_command);
+  /// precompute the pg mappings of osdmap, if enabled
+  void update_osdmap_mapping();
 
   int64_t get_object_hash_position(int64_t pool, const string& key, const string& ns);
   int64_t get_object_pg_hash_position(int64_t pool, const string& key, const string& ns);
@@ -1563,12 +1611,22 @@ public:
 
 private:
   // low-level
-  tid_t _op_submit(Op *op);
+  tid_t _op_submit(Op *op, vector<Op*> *to_send = NULL);
+  void _send_op_batch(vector<Op*>& to_send);
   inline void unregister_op(Op *op);
 
   // public interface
 public:
   tid_t op_submit(Op *op);
+  /**
+   * submit many ops at once
+   *
+   * The ops are mapped first and then sent grouped by OSD, so the
+   * messages for each OSD are queued back to back and can go out in as
+   * few writes as the messenger manages.  Ops for the same object keep
+   * their order in the vector.
+   */
+  void op_submit_batch(vector<Op*>& ops);
   bool is_active() {
     return !(ops.empty() && linger_ops.empty() && poolstat_ops.empty() && statfs_ops.empty());
   }
@@ -32,6 +32,36 @@ void Striper::file_to_extents(CephContext *cct, const char *object_format,
 			    vector<ObjectExtent>& extents,
 			    uint64_t buffer_offset)
 {
+  // most i/o falls within one stripe unit, and so maps onto a single
+  // extent of a single object: skip the per-object map for it.
+  __u32 su = layout->fl_stripe_unit;
+  assert(len > 0);
+  if (offset % su + len <= su) {
+    __u32 stripe_count = layout->fl_stripe_count;
+    uint64_t stripes_per_object = layout->fl_object_size / su;
+    uint64_t blockno = offset / su;
+    uint64_t stripeno = blockno / stripe_count;
+    uint64_t stripepos = blockno % stripe_count;
+    uint64_t objectsetno = stripeno / stripes_per_object;
+    uint64_t objectno = objectsetno * stripe_count + stripepos;
+
+    char buf[strlen(object_format) + 32];
+    snprintf(buf, sizeof(buf), object_format, (long long unsigned)objectno);
+
+    extents.resize(extents.size() + 1);
+    ObjectExtent& ex = extents.back();
+    ex.oid = buf;
+    ex.objectno = objectno;
+    ex.oloc = OSDMap::file_to_object_locator(*layout);
+    ex.offset = (stripeno % stripes_per_object) * su + offset % su;
+    ex.length = len;
+    ex.truncate_size = object_truncate_size(cct, layout, objectno, trunc_size);
+    ex.buffer_extents.push_back(make_pair(buffer_offset, len));
+    ldout(cct, 15) << "file_to_extents " << offset << "~" << len
+		   << " format " << object_format << " -> " << ex << dendl;
+    return;
+  }
+
   map<object_t,vector<ObjectExtent> > object_extents;
   file_to_extents(cct, object_format, layout, offset, len, trunc_size,
 		  object_extents, buffer_offset);
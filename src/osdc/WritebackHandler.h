@@ -32,6 +32,21 @@ class WritebackHandler {
 		      uint64_t off, uint64_t len, const SnapContext& snapc,
 		      const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
 		      __u32 trunc_seq, Context *oncommit) = 0;
+
+  /// whether write_vector() is supported
+  virtual bool can_scattered_write() { return false; }
+  /**
+   * write several extents of one object in a single operation
+   *
+   * @param io_vec (offset, data) of each extent, in offset order
+   */
+  virtual tid_t write_vector(const object_t& oid, const object_locator_t& oloc,
+			     vector<pair<uint64_t, bufferlist> >& io_vec,
+			     const SnapContext& snapc, utime_t mtime,
+			     uint64_t trunc_size, __u32 trunc_seq,
+			     Context *oncommit) {
+    assert(0 == "this WritebackHandler does not support scattered writes");
+  }
   virtual tid_t lock(const object_t& oid, const object_locator_t& oloc, int op,
 		     int flags, Context *onack, Context *oncommit) {
     assert(0 == "this WritebackHandler does not support the lock operation");
@@ -27,12 +27,15 @@
 #include "include/byteorder.h"
 
 #include "include/intarith.h"
+#include "include/interval_set.h"
 
 #include "include/compat.h"
 #include "common/blkdev.h"
 
 #include <boost/scoped_ptr.hpp>
+#include <deque>
 #include <dirent.h>
+#include <math.h>
 #include <errno.h>
 #include <iostream>
 #include <memory>
@@ -125,11 +128,18 @@ void usage()
 "  lock list <image-name>                      show locks held on an image\n"
 "  lock add <image-name> <id> [--shared <tag>] take a lock called id on an image\n"
 "  lock remove <image-name> <id> <locker>      release a lock on an image\n"
-"  bench-write <image-name>                    simple write benchmark\n"
-"                 --io-size <bytes>              write size\n"
-"                 --io-threads <num>             ios in flight\n"
-"                 --io-total <bytes>             total bytes to write\n"
-"                 --io-pattern <seq|rand>        write pattern\n"
+"  bench <image-name>                          benchmark reads and/or writes\n"
+"                 --io-type <read|write|rw>      io type (default write)\n"
+"                 --io-size <bytes>              io size\n"
+"                 --io-threads <num>             independent io streams\n"
+"                 --io-depth <num>               ios in flight (default\n"
+"                                                io-threads)\n"
+"                 --io-total <bytes>             total bytes to read/write\n"
+"                 --io-pattern <seq|rand|zipf>   io pattern\n"
+"                 --rw-mix-read <percent>        reads in a rw mix (default 50)\n"
+"                 --zipf-theta <theta>           zipf skew, 0 < theta < 1\n"
+"                                                (default 0.99)\n"
+"  bench-write <image-name>                    bench --io-type write\n"
 "\n"
 "<image-name>, <snap-name> are [pool/]name[@snap], or you may specify\n"
 "individual pieces of names with -p/--pool, --image, and/or --snap.\n"
@@ -167,6 +177,8 @@ static string feature_str(uint64_t feature)
     return "layering";
   case RBD_FEATURE_STRIPINGV2:
     return "striping";
+  case RBD_FEATURE_OBJECT_MAP:
+    return "object-map";
   default:
     return "";
   }
@@ -176,7 +188,7 @@ static string features_str(uint64_t features)
 {
   string s = "";
 
-  for (uint64_t feature = 1; feature <= RBD_FEATURE_STRIPINGV2;
+  for (uint64_t feature = 1; feature <= RBD_FEATURE_OBJECT_MAP;
        feature <<= 1) {
     if (feature & features) {
       if (s.size())
@@ -190,7 +202,7 @@ static string features_str(uint64_t features)
 static void format_features(Formatter *f, uint64_t features)
 {
   f->open_array_section("features");
-  for (uint64_t feature = 1; feature <= RBD_FEATURE_STRIPINGV2;
+  for (uint64_t feature = 1; feature <= RBD_FEATURE_OBJECT_MAP;
        feature <<= 1) {
     f->dump_string("feature", feature_str(feature));
   }
@@ -450,7 +462,7 @@ static int do_clone(librbd::RBD &rbd, librados::IoCtx &p_ioctx,
 		    uint64_t features, int *c_order)
 {
   if (features == 0)
-    features = RBD_FEATURES_ALL;
+    features = RBD_FEATURE_LAYERING | RBD_FEATURE_STRIPINGV2;
   else if ((features & RBD_FEATURE_LAYERING) != RBD_FEATURE_LAYERING)
     return -EINVAL;
 
@@ -830,19 +842,34 @@ static void rbd_bencher_completion(void *c, void *pc);
 
 struct rbd_bencher;
 
+struct rbd_bencher_op {
+  rbd_bencher *bencher;
+  bool read;
+  utime_t start;
+  bufferlist bl;    ///< read into
+
+  rbd_bencher_op(rbd_bencher *b, bool r)
+    : bencher(b), read(r), start(ceph_clock_now(NULL)) {}
+};
+
 struct rbd_bencher {
   librbd::Image *image;
   Mutex lock;
   Cond cond;
   int in_flight;
 
+  // latencies (in seconds) of ios completed since the last report,
+  // and overall
+  vector<double> interval_lat;
+  vector<double> read_lat, write_lat;
+
   rbd_bencher(librbd::Image *i)
     : image(i),
       lock("rbd_bencher::lock"),
       in_flight(0)
   { }
 
-  bool start_write(int max, uint64_t off, uint64_t len, bufferlist& bl)
+  bool start_io(int max, bool read, uint64_t off, uint64_t len, bufferlist& bl)
   {
     {
       Mutex::Locker l(lock);
@@ -850,9 +877,13 @@ struct rbd_bencher {
 	return false;
       in_flight++;
     }
+    rbd_bencher_op *op = new rbd_bencher_op(this, read);
     librbd::RBD::AioCompletion *c =
-      new librbd::RBD::AioCompletion((void *)this, rbd_bencher_completion);
-    image->aio_write(off, len, bl, c);
+      new librbd::RBD::AioCompletion((void *)op, rbd_bencher_completion);
+    if (read)
+      image->aio_read(off, len, op->bl, c);
+    else
+      image->aio_write(off, len, bl, c);
     //cout << "start " << c << " at " << off << "~" << len << std::endl;
     return true;
   }
@@ -866,39 +897,154 @@ struct rbd_bencher {
     }
   }
 
+  void take_interval(vector<double> *lat) {
+    Mutex::Locker l(lock);
+    lat->swap(interval_lat);
+    interval_lat.clear();
+  }
 };
 
 void rbd_bencher_completion(void *vc, void *pc)
 {
   librbd::RBD::AioCompletion *c = (librbd::RBD::AioCompletion *)vc;
-  rbd_bencher *b = static_cast<rbd_bencher *>(pc);
+  rbd_bencher_op *op = static_cast<rbd_bencher_op *>(pc);
+  rbd_bencher *b = op->bencher;
   //cout << "complete " << c << std::endl;
   int ret = c->get_return_value();
-  if (ret != 0) {
-    cout << "write error: " << cpp_strerror(ret) << std::endl;
+  if (ret < 0 || (!op->read && ret != 0)) {
+    cout << (op->read ? "read" : "write") << " error: "
+	 << cpp_strerror(ret) << std::endl;
     assert(0 == ret);
   }
+  double lat = ceph_clock_now(NULL) - op->start;
   b->lock.Lock();
   b->in_flight--;
+  b->interval_lat.push_back(lat);
+  if (op->read)
+    b->read_lat.push_back(lat);
+  else
+    b->write_lat.push_back(lat);
   b->cond.Signal();
   b->lock.Unlock();
   c->release();
+  delete op;
+}
+
+static uint64_t bench_rand(uint64_t n)
+{
+  return ((((uint64_t)rand()) << 31) ^ (uint64_t)rand()) % n;
+}
+
+/**
+ * Zipf distributed block numbers in [0, n), using the method of Gray
+ * et al, "Quickly Generating Billion-Record Synthetic Databases".
+ * Popular blocks are scattered over the image rather than bunched up
+ * at its start.
+ */
+class rbd_bench_zipf {
+  uint64_t n;
+  double theta, alpha, zetan, eta;
+
+  static double zeta(uint64_t n, double theta) {
+    // sum as far as is cheap, then approximate the rest by its integral
+    const uint64_t exact = 10000000;
+    double sum = 0;
+    for (uint64_t i = 1; i <= n && i <= exact; ++i)
+      sum += pow((double)i, -theta);
+    if (n > exact)
+      sum += (pow((double)n, 1.0 - theta) - pow((double)exact, 1.0 - theta)) /
+	(1.0 - theta);
+    return sum;
+  }
+
+public:
+  rbd_bench_zipf(uint64_t _n, double _theta)
+    : n(_n), theta(_theta), alpha(1.0 / (1.0 - _theta)) {
+    zetan = zeta(n, theta);
+    eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+  }
+
+  uint64_t next() {
+    double u = (double)rand() / RAND_MAX;
+    double uz = u * zetan;
+    uint64_t rank;
+    if (uz < 1.0)
+      rank = 0;
+    else if (uz < 1.0 + pow(0.5, theta))
+      rank = 1;
+    else
+      rank = (uint64_t)(n * pow(eta * u - eta + 1.0, alpha));
+    if (rank >= n)
+      rank = n - 1;
+    // scatter the ranks over the image
+    uint64_t h = rank + 1;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h % n;
+  }
+};
+
+static double bench_percentile(const vector<double>& sorted, double pct)
+{
+  if (sorted.empty())
+    return 0;
+  size_t i = (size_t)(sorted.size() * pct / 100.0);
+  return sorted[MIN(i, sorted.size() - 1)];
+}
+
+static void bench_dump_latency(const char *what, vector<double>& lat)
+{
+  if (lat.empty())
+    return;
+  sort(lat.begin(), lat.end());
+  double sum = 0;
+  for (vector<double>::iterator p = lat.begin(); p != lat.end(); ++p)
+    sum += *p;
+  printf("%s latency (ms): ios %u avg %.3lf p50 %.3lf p90 %.3lf p99 %.3lf "
+	 "p99.9 %.3lf max %.3lf\n",
+	 what, (unsigned)lat.size(), sum * 1000.0 / lat.size(),
+	 bench_percentile(lat, 50) * 1000.0,
+	 bench_percentile(lat, 90) * 1000.0,
+	 bench_percentile(lat, 99) * 1000.0,
+	 bench_percentile(lat, 99.9) * 1000.0,
+	 lat.back() * 1000.0);
 }
 
-static int do_bench_write(librbd::Image& image, uint64_t io_size,
-			  uint64_t io_threads, uint64_t io_bytes,
-			  string pattern)
+static int do_bench(librbd::Image& image, string io_type, uint64_t io_size,
+		    uint64_t io_threads, uint64_t io_depth, uint64_t io_bytes,
+		    string pattern, int rw_mix_read, double zipf_theta)
 {
   rbd_bencher b(&image);
 
-  cout << "bench-write "
+  if (!io_depth)
+    io_depth = io_threads;
+
+  cout << "bench "
+       << " io_type " << io_type
        << " io_size " << io_size
        << " io_threads " << io_threads
+       << " io_depth " << io_depth
        << " bytes " << io_bytes
-       << " pattern " << pattern
+       << " pattern " << pattern;
+  if (io_type == "rw")
+    cout << " rw_mix_read " << rw_mix_read;
+  if (pattern == "zipf")
+    cout << " zipf_theta " << zipf_theta;
+  cout << " rbd_cache " << (g_conf->rbd_cache ? "true" : "false")
        << std::endl;
 
-  if (pattern != "rand" && pattern != "seq")
+  if (pattern != "rand" && pattern != "seq" && pattern != "zipf")
+    return -EINVAL;
+  if (io_type != "read" && io_type != "write" && io_type != "rw")
+    return -EINVAL;
+  if (rw_mix_read < 0 || rw_mix_read > 100)
+    return -EINVAL;
+  if (pattern == "zipf" && (zipf_theta <= 0 || zipf_theta >= 1))
+    return -EINVAL;
+  if (!io_size || !io_threads)
     return -EINVAL;
 
   srand(time(NULL) % (unsigned long) -1);
@@ -908,51 +1054,65 @@ static int do_bench_write(librbd::Image& image, uint64_t io_size,
   bufferlist bl;
   bl.push_back(bp);
 
-  utime_t start = ceph_clock_now(NULL);
-  utime_t last;
-  unsigned ios = 0;
-
   uint64_t size = 0;
   image.size(&size);
+  uint64_t blocks = size / io_size;
+  if (!blocks)
+    return -EINVAL;
 
   vector<uint64_t> thread_offset;
   uint64_t i;
-  uint64_t start_pos;
 
-  // disturb all thread's offset, used by seq write
-  for (i = 0; i < io_threads; i++) {
-    start_pos = (rand() % (size / io_size)) * io_size;
-    thread_offset.push_back(start_pos);
-  }
+  // disturb all thread's offset, used by seq io
+  for (i = 0; i < io_threads; i++)
+    thread_offset.push_back(bench_rand(blocks) * io_size);
 
-  printf("  SEC       OPS   OPS/SEC   BYTES/SEC\n");
+  boost::scoped_ptr<rbd_bench_zipf> zipf;
+  if (pattern == "zipf")
+    zipf.reset(new rbd_bench_zipf(blocks, zipf_theta));
+
+  utime_t start = ceph_clock_now(NULL);
+  utime_t last;
+  unsigned ios = 0;
+  vector<double> lat;
+
+  printf("  SEC       OPS   OPS/SEC   BYTES/SEC   P50(ms)   P99(ms)\n");
   uint64_t off;
-  for (off = 0; off < io_bytes; off += io_size) {
-    b.wait_for(io_threads - 1);
-    i = 0;
-    while (i < io_threads && off < io_bytes &&
-	   b.start_write(io_threads, thread_offset[i], io_size, bl)) {
-      ++i;
+  i = 0;
+  for (off = 0; off < io_bytes; ) {
+    b.wait_for(io_depth - 1);
+
+    uint64_t pos;
+    if (pattern == "rand") {
+      pos = bench_rand(blocks) * io_size;
+    } else if (pattern == "zipf") {
+      pos = zipf->next() * io_size;
+    } else {
+      pos = thread_offset[i];
+      thread_offset[i] += io_size;
+      if (thread_offset[i] + io_size > size)
+	thread_offset[i] = 0;
+    }
+    bool read = io_type == "read" ||
+      (io_type == "rw" && (int)(rand() % 100) < rw_mix_read);
+    if (b.start_io(io_depth, read, pos, io_size, bl)) {
       ++ios;
       off += io_size;
-
-      if (pattern == "rand") {
-        thread_offset[i] = (rand() % (size / io_size)) * io_size;
-      } else {
-        thread_offset[i] += io_size;
-        if (thread_offset[i] + io_size > size)
-          thread_offset[i] = 0;
-      }
+      i = (i + 1) % io_threads;
     }
 
     utime_t now = ceph_clock_now(NULL);
     utime_t elapsed = now - start;
     if (elapsed.sec() != last.sec()) {
-      printf("%5d  %8d  %8.2lf  %8.2lf\n",
+      b.take_interval(&lat);
+      sort(lat.begin(), lat.end());
+      printf("%5d  %8d  %8.2lf  %10.2lf  %8.3lf  %8.3lf\n",
 	     (int)elapsed,
-	     (int)(ios - io_threads),
-	     (double)(ios - io_threads) / elapsed,
-	     (double)(off - io_threads * io_size) / elapsed);
+	     (int)(ios - io_depth),
+	     (double)(ios - io_depth) / elapsed,
+	     (double)(off - io_depth * io_size) / elapsed,
+	     bench_percentile(lat, 50) * 1000.0,
+	     bench_percentile(lat, 99) * 1000.0);
       last = elapsed;
     }
   }
@@ -967,74 +1127,171 @@ static int do_bench_write(librbd::Image& image, uint64_t io_size,
 
   printf("elapsed: %5d  ops: %8d  ops/sec: %8.2lf  bytes/sec: %8.2lf\n",
 	 (int)elapsed, ios, (double)ios / elapsed, (double)off / elapsed);
+  bench_dump_latency("read", b.read_lat);
+  bench_dump_latency("write", b.write_lat);
 
   return 0;
 }
 
+/**
+ * A window of up to max aio reads, writes and discards on an image.
+ *
+ * Ops are retired oldest first, so whatever is done with their
+ * results (e.g. writing them to a stream) happens in the order they
+ * were started.  Holes are queued as ops that do no I/O so they keep
+ * their place in that order.
+ */
+class AioWindow {
+public:
+  struct Op {
+    uint64_t off;
+    uint64_t len;
+    bool exists;    ///< false for holes and discards
+    bufferlist bl;
+    librbd::RBD::AioCompletion *c;
+    int r;
+    Op(uint64_t o, uint64_t l, bool e)
+      : off(o), len(l), exists(e), c(NULL), r(0) {}
+  };
+
+  AioWindow(librbd::Image *i, int m)
+    : image(i), max(MAX(m, 1)) {}
+  ~AioWindow() {
+    while (!ops.empty())
+      retire_oldest();
+  }
+
+  bool full() const { return ops.size() >= max; }
+  bool empty() const { return ops.empty(); }
+
+  int start_read(uint64_t off, uint64_t len) {
+    Op &op = push(off, len, true);
+    return started(op, image->aio_read(off, len, op.bl, op.c));
+  }
+  int start_write(uint64_t off, bufferlist& bl) {
+    Op &op = push(off, bl.length(), true);
+    op.bl.claim(bl);
+    return started(op, image->aio_write(off, op.len, op.bl, op.c));
+  }
+  int start_discard(uint64_t off, uint64_t len) {
+    Op &op = push(off, len, false);
+    return started(op, image->aio_discard(off, len, op.c));
+  }
+  void add_hole(uint64_t off, uint64_t len) {
+    ops.push_back(Op(off, len, false));
+  }
+
+  Op& oldest() { return ops.front(); }
+  /// wait for the oldest op, returning its result
+  int wait_oldest() {
+    Op &op = ops.front();
+    if (op.c) {
+      op.c->wait_for_complete();
+      op.r = op.c->get_return_value();
+      op.c->release();
+      op.c = NULL;
+    }
+    return op.r;
+  }
+  void pop_oldest() {
+    assert(ops.front().c == NULL);
+    ops.pop_front();
+  }
+  int retire_oldest() {
+    int r = wait_oldest();
+    pop_oldest();
+    return r;
+  }
+  /// retire everything, returning the first error
+  int drain() {
+    int ret = 0;
+    while (!ops.empty()) {
+      int r = retire_oldest();
+      if (r < 0 && ret == 0)
+	ret = r;
+    }
+    return ret;
+  }
+
+private:
+  librbd::Image *image;
+  size_t max;
+  std::deque<Op> ops;
+
+  Op& push(uint64_t off, uint64_t len, bool exists) {
+    // zero-length ops complete without calling back, so never start one
+    assert(len > 0);
+    ops.push_back(Op(off, len, exists));
+    Op &op = ops.back();
+    op.c = new librbd::RBD::AioCompletion(NULL, NULL);
+    return op;
+  }
+  int started(Op &op, int r) {
+    if (r < 0) {
+      // failed up front; the completion will never fire
+      op.c->release();
+      op.c = NULL;
+      op.r = r;
+    }
+    return r;
+  }
+};
+
 struct ExportContext {
   librbd::Image *image;
   int fd;
   uint64_t totalsize;
+  uint64_t obj_size;
   MyProgressContext pc;
+  AioWindow window;
+  bufferptr zeros;
+  int r;          ///< first error seen by a diff_iterate callback
 
-  ExportContext(librbd::Image *i, int f, uint64_t t) :
+  ExportContext(librbd::Image *i, int f, uint64_t t, uint64_t o) :
     image(i),
     fd(f),
     totalsize(t),
-    pc("Exporting image")
+    obj_size(o),
+    pc("Exporting image"),
+    window(i, g_conf->rbd_export_import_concurrent_ops),
+    r(0)
   {}
 };
 
-static int export_read_cb(uint64_t ofs, size_t len, const char *buf, void *arg)
+static int export_extent_cb(uint64_t ofs, size_t len, int exists, void *arg)
 {
-  ssize_t ret;
-  ExportContext *ec = static_cast<ExportContext *>(arg);
-  int fd = ec->fd;
-  static char *localbuf = NULL;
-  static size_t maplen = 0;
-
-  if (fd == 1) {
-    if (!buf) {
-      // can't seek stdout; need actual data to write
-      if (maplen < len) {
-	// never mapped, or need to map larger
-	int r;
-	if (localbuf != NULL){
-	  if ((r = munmap(localbuf, len)) < 0) {
-	    cerr << "rbd: error " << r << "munmap'ing buffer" << std::endl;
-	    return errno;
-	  }
-	}
+  // with no start snap, everything reported holds data
+  interval_set<uint64_t> *data = static_cast<interval_set<uint64_t> *>(arg);
+  if (exists && len && !data->intersects(ofs, len))
+    data->insert(ofs, len);
+  return 0;
+}
 
-	maplen = len;
-	localbuf = (char *)mmap(NULL, maplen, PROT_READ,
-			        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-	if (localbuf == MAP_FAILED) {
-	  cerr << "rbd: MAP_FAILED mmap'ing buffer for zero writes"
-	       << std::endl;
-	  return -ENOMEM;
-	}
-      }
-      ret = write(fd, localbuf, len);
-    } else {
-      ret = write(fd, buf, len);
-    }
-  } else {		// not stdout
-    if (!buf || buf_is_zero(buf, len)) {
-      /* a hole */
-      return 0;
+static int export_write(ExportContext *ec, AioWindow::Op& op)
+{
+  int r;
+  if (ec->fd == 1) {
+    if (op.exists)
+      return op.bl.write_fd(1);
+    // can't seek stdout; write the hole out as zeros
+    if (!ec->zeros.length()) {
+      ec->zeros = buffer::create_page_aligned(ec->obj_size);
+      ec->zeros.zero();
     }
+    bufferlist bl;
+    bl.append(ec->zeros, 0, op.len);
+    return bl.write_fd(1);
+  }
 
-    ret = lseek64(fd, ofs, SEEK_SET);
-    if (ret < 0)
+  // the object may still hold runs of zeros; leave those sparse too
+  if (op.exists && !op.bl.is_zero()) {
+    if (lseek64(ec->fd, op.off, SEEK_SET) < 0)
       return -errno;
-    ret = write(fd, buf, len);
-    ec->pc.update_progress(ofs, ec->totalsize);
+    r = op.bl.write_fd(ec->fd);
+    if (r < 0)
+      return r;
   }
-
-  if (ret < 0)
-    return -errno;
-
+  ec->pc.update_progress(op.off + op.len, ec->totalsize);
   return 0;
 }
 
@@ -1048,6 +1305,12 @@ static int do_export(librbd::Image& image, const char *path)
   if (r < 0)
     return r;
 
+  // read only what the object map or object listing says exists
+  interval_set<uint64_t> data;
+  r = image.diff_iterate(NULL, 0, info.size, export_extent_cb, &data);
+  if (r < 0)
+    return r;
+
   if (strcmp(path, "-") == 0)
     fd = 1;
   else
@@ -1055,10 +1318,36 @@ static int do_export(librbd::Image& image, const char *path)
   if (fd < 0)
     return -errno;
 
-  ExportContext ec(&image, fd, info.size);
-  r = image.read_iterate2(0, info.size, export_read_cb, (void *)&ec);
-  if (r < 0)
-    goto out;
+  ExportContext ec(&image, fd, info.size, info.obj_size);
+  AioWindow &w = ec.window;
+  interval_set<uint64_t>::iterator p = data.begin();
+  uint64_t pos = 0;
+  while (pos < info.size || !w.empty()) {
+    if (pos < info.size && !w.full()) {
+      // the next piece of data or hole, at most up to the end of the object
+      uint64_t end = MIN(info.size, pos - pos % info.obj_size + info.obj_size);
+      while (p != data.end() && p.get_start() + p.get_len() <= pos)
+	++p;
+      if (p != data.end() && p.get_start() <= pos) {
+	end = MIN(end, p.get_start() + p.get_len());
+	r = w.start_read(pos, end - pos);
+	if (r < 0)
+	  goto out;
+      } else {
+	if (p != data.end())
+	  end = MIN(end, p.get_start());
+	w.add_hole(pos, end - pos);
+      }
+      pos = end;
+      continue;
+    }
+    r = w.wait_oldest();
+    if (r >= 0)
+      r = export_write(&ec, w.oldest());
+    w.pop_oldest();
+    if (r < 0)
+      goto out;
+  }
 
   if (fd != 1)
     r = ftruncate(fd, info.size);
@@ -1066,6 +1355,7 @@ static int do_export(librbd::Image& image, const char *path)
     goto out;
 
  out:
+  w.drain();
   close(fd);
   if (r < 0)
     ec.pc.fail();
@@ -1074,36 +1364,60 @@ static int do_export(librbd::Image& image, const char *path)
   return r;
 }
 
-static int export_diff_cb(uint64_t ofs, size_t _len, int exists, void *arg)
+static int export_diff_write(ExportContext *ec, AioWindow::Op& op)
 {
-  ExportContext *ec = static_cast<ExportContext *>(arg);
-  int r;
-
   // extent
   bufferlist bl;
-  __u8 tag = exists ? 'w' : 'z';
+  __u8 tag = op.exists ? 'w' : 'z';
   ::encode(tag, bl);
-  ::encode(ofs, bl);
-  uint64_t len = _len;
-  ::encode(len, bl);
-  r = bl.write_fd(ec->fd);
+  ::encode(op.off, bl);
+  ::encode(op.len, bl);
+  if (op.exists) {
+    if (op.bl.length() != op.len)
+      return -EIO;
+    bl.claim_append(op.bl);
+  }
+  int r = bl.write_fd(ec->fd);
   if (r < 0)
     return r;
 
-  if (exists) {
-    // read block
-    bl.clear();
-    r = ec->image->read(ofs, len, bl);
-    if (r < 0)
-      return r;
-    r = bl.write_fd(ec->fd);
-    if (r < 0)
-      return r;
-  }
+  ec->pc.update_progress(op.off, ec->totalsize);
+  return 0;
+}
 
-  ec->pc.update_progress(ofs, ec->totalsize);
+static int export_diff_retire(ExportContext *ec)
+{
+  AioWindow &w = ec->window;
+  int r = w.wait_oldest();
+  if (r >= 0)
+    r = export_diff_write(ec, w.oldest());
+  w.pop_oldest();
+  return r;
+}
 
-  return 0;
+static int export_diff_cb(uint64_t ofs, size_t _len, int exists, void *arg)
+{
+  ExportContext *ec = static_cast<ExportContext *>(arg);
+  AioWindow &w = ec->window;
+  uint64_t end = ofs + _len;
+
+  // diff_iterate ignores what we return, so remember the first error
+  // and do nothing more once there is one
+  while (ec->r >= 0 && ofs < end) {
+    if (w.full()) {
+      ec->r = export_diff_retire(ec);
+      continue;
+    }
+    if (!exists) {
+      w.add_hole(ofs, end - ofs);
+      break;
+    }
+    // a read per object
+    uint64_t len = MIN(end - ofs, ec->obj_size - ofs % ec->obj_size);
+    ec->r = w.start_read(ofs, len);
+    ofs += len;
+  }
+  return ec->r;
 }
 
 static int do_export_diff(librbd::Image& image, const char *fromsnapname,
@@ -1157,8 +1471,12 @@ static int do_export_diff(librbd::Image& image, const char *fromsnapname,
     }
   }
 
-  ExportContext ec(&image, fd, info.size);
+  ExportContext ec(&image, fd, info.size, info.obj_size);
   r = image.diff_iterate(fromsnapname, 0, info.size, export_diff_cb, (void *)&ec);
+  if (r >= 0)
+    r = ec.r;
+  while (r >= 0 && !ec.window.empty())
+    r = export_diff_retire(&ec);
   if (r < 0)
     goto out;
 
@@ -1170,6 +1488,7 @@ static int do_export_diff(librbd::Image& image, const char *fromsnapname,
   }
 
  out:
+  ec.window.drain();
   close(fd);
   if (r < 0)
     ec.pc.fail();
@@ -1308,10 +1627,11 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
   // try to fill whole imgblklen blocks for sparsification
   uint64_t image_pos = 0;
   size_t imgblklen = 1 << *order;
-  char *p = new char[imgblklen];
+  bufferptr p;
   size_t reqlen = imgblklen;	// amount requested from read
   ssize_t readlen;		// amount received from one read
   size_t blklen = 0;		// amount accumulated from reads to fill blk
+  bool seek_data = false;	// skip the file's holes without reading them
   librbd::Image image;
 
   bool from_stdin = !strcmp(path, "-");
@@ -1337,6 +1657,9 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     }
     if (stat_buf.st_size)
       size = (uint64_t)stat_buf.st_size;
+#if defined(__linux__) && defined(SEEK_HOLE) && defined(SEEK_DATA)
+    seek_data = S_ISREG(stat_buf.st_mode);
+#endif
 
     if (!size) {
       int64_t bdev_size = 0;
@@ -1360,46 +1683,97 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     goto done;
   }
 
-  // loop body handles 0 return, as we may have a block to flush
-  while ((readlen = ::read(fd, p + blklen, reqlen)) >= 0) {
-    blklen += readlen;
-    // if read was short, try again to fill the block before writing
-    if (readlen && ((size_t)readlen < reqlen)) {
-      reqlen -= readlen;
-      continue;
-    }
-    if (!from_stdin)
-      pc.update_progress(image_pos, size);
-
-    bufferlist bl(blklen);
-    bl.append(p, blklen);
-    // resize output image by binary expansion as we go for stdin
-    if (from_stdin && (image_pos + (size_t)blklen) > size) {
-      size *= 2;
-      r = image.resize(size);
-      if (r < 0) {
-	cerr << "rbd: can't resize image during import" << std::endl;
+  {
+    AioWindow w(&image, g_conf->rbd_export_import_concurrent_ops);
+
+    // loop body handles 0 return, as we may have a block to flush
+    while (true) {
+      if (!blklen) {
+#if defined(__linux__) && defined(SEEK_HOLE) && defined(SEEK_DATA)
+	if (seek_data) {
+	  off_t data_pos = lseek64(fd, image_pos, SEEK_DATA);
+	  if (data_pos < 0 && errno == ENXIO)
+	    break;  // nothing but a hole is left
+	  if (data_pos < 0) {
+	    seek_data = false;
+	    data_pos = image_pos;
+	  }
+	  // stay block aligned
+	  image_pos = data_pos - data_pos % imgblklen;
+	  if (lseek64(fd, image_pos, SEEK_SET) < 0) {
+	    r = -errno;
+	    cerr << "rbd: error seeking in " << path << std::endl;
+	    goto done;
+	  }
+	}
+#endif
+	// a new buffer for each block, as the last may still be in flight
+	p = buffer::create(imgblklen);
+      }
+      readlen = ::read(fd, p.c_str() + blklen, reqlen);
+      if (readlen < 0) {
+	r = -errno;
+	cerr << "rbd: error reading " << path << std::endl;
 	goto done;
       }
-    }
+      blklen += readlen;
+      // if read was short, try again to fill the block before writing
+      if (readlen && ((size_t)readlen < reqlen)) {
+	reqlen -= readlen;
+	continue;
+      }
+      if (!from_stdin)
+	pc.update_progress(image_pos, size);
+
+      // resize output image by binary expansion as we go for stdin
+      if (from_stdin && (image_pos + (size_t)blklen) > size) {
+	r = w.drain();
+	if (r < 0) {
+	  cerr << "rbd: error writing to image" << std::endl;
+	  goto done;
+	}
+	size *= 2;
+	r = image.resize(size);
+	if (r < 0) {
+	  cerr << "rbd: can't resize image during import" << std::endl;
+	  goto done;
+	}
+      }
 
-    // write as much as we got; perhaps less than imgblklen
-    // but skip writing zeros to create sparse images
-    if (!bl.is_zero()) {
-      r = image.write(image_pos, blklen, bl);
-      if (r < 0) {
-	cerr << "rbd: error writing to image position " << image_pos
-	     << std::endl;
-	goto done;
+      // write as much as we got; perhaps less than imgblklen
+      // but skip writing zeros to create sparse images
+      if (blklen) {
+	bufferlist bl;
+	bl.append(p, 0, blklen);
+	if (!bl.is_zero()) {
+	  while (w.full()) {
+	    r = w.retire_oldest();
+	    if (r < 0) {
+	      cerr << "rbd: error writing to image" << std::endl;
+	      goto done;
+	    }
+	  }
+	  r = w.start_write(image_pos, bl);
+	  if (r < 0) {
+	    cerr << "rbd: error writing to image position " << image_pos
+		 << std::endl;
+	    goto done;
+	  }
+	}
       }
+      // done with whole block, whether written or not
+      image_pos += blklen;
+      // if read had returned 0, we're at EOF and should quit
+      if (readlen == 0)
+	break;
+      blklen = 0;
+      reqlen = imgblklen;
+    }
+    r = w.drain();
+    if (r < 0) {
+      cerr << "rbd: error writing to image" << std::endl;
+      goto done;
     }
-    // done with whole block, whether written or not
-    image_pos += blklen;
-    // if read had returned 0, we're at EOF and should quit
-    if (readlen == 0)
-      break;
-    blklen = 0;
-    reqlen = imgblklen;
   }
   if (from_stdin) {
     r = image.resize(image_pos);
@@ -1420,7 +1794,6 @@ static int do_import(librbd::RBD &rbd, librados::IoCtx& io_ctx,
     close(fd);
   }
  done2:
-  delete[] p;
   return r;
 }
 
@@ -1456,6 +1829,7 @@ static int do_import_diff(librbd::Image &image, const char *path)
   uint64_t size = 0;
   uint64_t off = 0;
   string from, to;
+  AioWindow w(&image, g_conf->rbd_export_import_concurrent_ops);
 
   bool from_stdin = !strcmp(path, "-");
   if (from_stdin) {
@@ -1529,6 +1903,9 @@ static int do_import_diff(librbd::Image &image, const char *path)
       bufferlist::iterator p = bl.begin();
       ::decode(end_size, p);
       uint64_t cur_size;
+      r = w.drain();
+      if (r < 0)
+	goto done;
       image.size(&cur_size);
       if (cur_size != end_size) {
 	dout(2) << "resize " << cur_size << " -> " << end_size << dendl;
@@ -1550,6 +1927,12 @@ static int do_import_diff(librbd::Image &image, const char *path)
       ::decode(off, p);
       ::decode(len, p);
 
+      while (w.full()) {
+	r = w.retire_oldest();
+	if (r < 0)
+	  goto done;
+      }
+
       if (tag == 'w') {
 	bufferptr bp = buffer::create(len);
 	r = safe_read_exact(fd, bp.c_str(), len);
@@ -1558,11 +1941,15 @@ static int do_import_diff(librbd::Image &image, const char *path)
 	bufferlist data;
 	data.append(bp);
 	dout(2) << " write " << off << "~" << len << dendl;
-	image.write(off, len, data);
+	if (len)
+	  r = w.start_write(off, data);
       } else {
 	dout(2) << " zero " << off << "~" << len << dendl;
-	image.discard(off, len);
+	if (len)
+	  r = w.start_discard(off, len);
       }
+      if (r < 0)
+	goto done;
     } else {
       cerr << "unrecognized tag byte " << (int)tag << " in stream; aborting" << std::endl;
       r = -EINVAL;
@@ -1579,6 +1966,10 @@ static int do_import_diff(librbd::Image &image, const char *path)
     }
   }
 
+  r = w.drain();
+  if (r < 0)
+    goto done;
+
   // take final snap
   if (to.length()) {
     dout(2) << " create end snap " << to << dendl;
@@ -1586,6 +1977,7 @@ static int do_import_diff(librbd::Image &image, const char *path)
   }
 
  done:
+  w.drain();
   if (r < 0)
     pc.fail();
   else
@@ -2219,6 +2611,7 @@ enum {
   OPT_LOCK_LIST,
   OPT_LOCK_ADD,
   OPT_LOCK_REMOVE,
+  OPT_BENCH,
   OPT_BENCH_WRITE,
 };
 
@@ -2266,6 +2659,8 @@ static int get_cmd(const char *cmd, bool snapcmd, bool lockcmd)
       return OPT_SHOWMAPPED;
     if (strcmp(cmd, "unmap") == 0)
       return OPT_UNMAP;
+    if (strcmp(cmd, "bench") == 0)
+      return OPT_BENCH;
     if (strcmp(cmd, "bench-write") == 0)
       return OPT_BENCH_WRITE;
   } else if (snapcmd) {
@@ -2353,7 +2748,11 @@ int main(int argc, const char **argv)
   int pretty_format = 0;
   long long stripe_unit = 0, stripe_count = 0;
   long long bench_io_size = 4096, bench_io_threads = 16, bench_bytes = 1 << 30;
+  long long bench_io_depth = 0;
   string bench_pattern = "seq";
+  string bench_io_type = "write";
+  int bench_rw_mix_read = 50;
+  double bench_zipf_theta = 0.99;
 
   std::string val;
   std::ostringstream err;
@@ -2412,6 +2811,11 @@ int main(int argc, const char **argv)
     } else if (ceph_argparse_withlonglong(args, i, &bench_io_threads, &err, "--io-threads", (char*)NULL)) {
     } else if (ceph_argparse_withlonglong(args, i, &bench_bytes, &err, "--io-total", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &bench_pattern, &err, "--io-pattern", (char*)NULL)) {
+    } else if (ceph_argparse_withlonglong(args, i, &bench_io_depth, &err, "--io-depth", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &bench_io_type, &err, "--io-type", (char*)NULL)) {
+    } else if (ceph_argparse_withint(args, i, &bench_rw_mix_read, &err, "--rw-mix-read", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &val, "--zipf-theta", (char*)NULL)) {
+      bench_zipf_theta = atof(val.c_str());
     } else if (ceph_argparse_withlonglong(args, i, &stripe_count, &err, "--stripe-count", (char*)NULL)) {
     } else if (ceph_argparse_witharg(args, i, &val, "--path", (char*)NULL)) {
       path = strdup(val.c_str());
@@ -2514,6 +2918,7 @@ if (!set_conf_param(v, p1, p2, p3)) { \
       case OPT_SNAP_UNPROTECT:
       case OPT_WATCH:
       case OPT_MAP:
+      case OPT_BENCH:
       case OPT_BENCH_WRITE:
       case OPT_LOCK_LIST:
       case OPT_DIFF:
@@ -2727,6 +3132,7 @@ if (!set_conf_param(v, p1, p2, p3)) { \
        opt_cmd == OPT_SNAP_UNPROTECT || opt_cmd == OPT_WATCH ||
        opt_cmd == OPT_FLATTEN || opt_cmd == OPT_LOCK_ADD ||
        opt_cmd == OPT_LOCK_REMOVE || opt_cmd == OPT_BENCH_WRITE ||
+       opt_cmd == OPT_BENCH ||
        opt_cmd == OPT_INFO || opt_cmd == OPT_SNAP_LIST ||
        opt_cmd == OPT_IMPORT_DIFF ||
        opt_cmd == OPT_EXPORT || opt_cmd == OPT_EXPORT_DIFF || opt_cmd == OPT_COPY ||
@@ -3116,9 +3522,14 @@ if (!set_conf_param(v, p1, p2, p3)) { \
     break;
 
   case OPT_BENCH_WRITE:
-    r = do_bench_write(image, bench_io_size, bench_io_threads, bench_bytes, bench_pattern);
+    bench_io_type = "write";
+    // fall through
+  case OPT_BENCH:
+    r = do_bench(image, bench_io_type, bench_io_size, bench_io_threads,
+		 bench_io_depth, bench_bytes, bench_pattern, bench_rw_mix_read,
+		 bench_zipf_theta);
     if (r < 0) {
-      cerr << "bench-write failed: " << cpp_strerror(-r) << std::endl;
+      cerr << "bench failed: " << cpp_strerror(-r) << std::endl;
       return -r;
     }
     break;
@@ -1,5 +1,10 @@
 /*
  * rbd-fuse
+ *
+ * Built on the low-level FUSE API: requests are served by the FUSE
+ * session loop's worker threads, and reads, writes and fsyncs are
+ * answered from librbd aio completion callbacks, so many requests can
+ * be in flight at once.
  */
 #define FUSE_USE_VERSION 30
 
@@ -12,447 +17,709 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <fuse.h>
+#include <fuse_lowlevel.h>
+#include <limits.h>
 #include <pthread.h>
 #include <string.h>
+#include <sys/statvfs.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <getopt.h>
 
 #include "include/rbd/librbd.h"
 
-static int gotrados = 0;
 char *pool_name;
 rados_t cluster;
 rados_ioctx_t ioctx;
 
-static pthread_mutex_t readdir_lock;
-
-struct rbd_stat {
-	u_char valid;
-	rbd_image_info_t rbd_info;
-};
-
 struct rbd_options {
 	char *ceph_config;
 	char *pool_name;
 };
 
-struct rbd_image {
-	char *image_name;
-	struct rbd_image *next;
-};
-struct rbd_image *rbd_images;
+struct rbd_options rbd_options = {"/etc/ceph/ceph.conf", "rbd"};
 
-struct rbd_openimage {
+/*
+ * One per image we have seen in the pool.  Entries are never freed
+ * while mounted, so an image name keeps its inode number even if the
+ * image is removed and created again.  Images are opened on first
+ * use, and their rbd_stat() info is cached for RBDFS_ATTR_TIMEOUT.
+ */
+struct rbd_image {
 	char *image_name;
-	rbd_image_t image;
-	struct rbd_stat rbd_stat;
+	fuse_ino_t ino;
+	int exists;			/* listed by the last rbd_list */
+
+	pthread_mutex_t lock;		/* protects the fields below */
+	rbd_image_t image;		/* NULL until first used */
+	rbd_image_info_t info;
+	time_t info_stamp;		/* 0 if info is not valid */
+	int opens;			/* outstanding fuse opens */
 };
-#define MAX_RBD_IMAGES		128
-struct rbd_openimage opentbl[MAX_RBD_IMAGES];
 
-struct rbd_options rbd_options = {"/etc/ceph/ceph.conf", "rbd"};
+/* protects images, num_images, max_images, last_enumerate */
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rbd_image **images;
+static unsigned num_images, max_images;
+static time_t last_enumerate;
 
-#define rbdsize(fd)	opentbl[fd].rbd_stat.rbd_info.size
-#define rbdblksize(fd)	opentbl[fd].rbd_stat.rbd_info.obj_size
-#define rbdblkcnt(fd)	opentbl[fd].rbd_stat.rbd_info.num_objs
+#define RBDFS_ATTR_TIMEOUT	1.0
+/* image inodes follow the root */
+#define image_index(ino)	((ino) - FUSE_ROOT_ID - 1)
 
 uint64_t imagesize = 1024ULL * 1024 * 1024;
 uint64_t imageorder = 22ULL;
 uint64_t imagefeatures = 1ULL;
 
-// Minimize calls to rbd_list: marks bracketing of opendir/<ops>/releasedir
-int in_opendir;
-
 /* prototypes */
 int connect_to_cluster(rados_t *pcluster);
-void enumerate_images(struct rbd_image **head);
-int open_rbd_image(const char *image_name);
-int find_openrbd(const char *path);
+void enumerate_images(int force);
 
 void simple_err(const char *msg, int err);
 
+/* find or add the entry for name; call with images_lock held */
+static struct rbd_image *
+add_image(const char *name)
+{
+	struct rbd_image *im;
+	unsigned i;
+
+	for (i = 0; i < num_images; i++) {
+		if (strcmp(images[i]->image_name, name) == 0)
+			return images[i];
+	}
+
+	if (num_images == max_images) {
+		unsigned n = max_images ? max_images * 2 : 64;
+		struct rbd_image **p = realloc(images, n * sizeof(*images));
+		if (p == NULL)
+			return NULL;
+		images = p;
+		max_images = n;
+	}
+	im = calloc(1, sizeof(*im));
+	if (im == NULL)
+		return NULL;
+	im->image_name = strdup(name);
+	im->ino = FUSE_ROOT_ID + 1 + num_images;
+	pthread_mutex_init(&im->lock, NULL);
+	images[num_images++] = im;
+	return im;
+}
+
+/*
+ * Refresh the image table from rbd_list.  Unless force is set, this is
+ * skipped if the table was refreshed within the last second.
+ */
 void
-enumerate_images(struct rbd_image **head)
+enumerate_images(int force)
 {
-	char *ibuf;
-	size_t ibuf_len;
-	struct rbd_image *im, *next;
+	char *ibuf = NULL;
+	size_t ibuf_len = 1024;
 	char *ip;
 	int actual_len;
+	unsigned i;
+	time_t now = time(NULL);
 
-	if (*head != NULL) {
-		for (im = *head; im != NULL;) {
-			next = im->next;
-			free(im);
-			im = next;
-		}
-		*head = NULL;
+	pthread_mutex_lock(&images_lock);
+	if (!force && now - last_enumerate < RBDFS_ATTR_TIMEOUT) {
+		pthread_mutex_unlock(&images_lock);
+		return;
+	}
+	pthread_mutex_unlock(&images_lock);
+
+	while (1) {
+		ibuf = malloc(ibuf_len);
+		if (ibuf == NULL)
+			return;
+		actual_len = rbd_list(ioctx, ibuf, &ibuf_len);
+		if (actual_len != -ERANGE)
+			break;
+		free(ibuf);
 	}
-
-	ibuf_len = 1024;
-	ibuf = malloc(ibuf_len);
-	actual_len = rbd_list(ioctx, ibuf, &ibuf_len);
 	if (actual_len < 0) {
-		simple_err("rbd_list: error %d\n", actual_len);
+		simple_err("rbd_list", actual_len);
+		free(ibuf);
 		return;
 	}
 
-	fprintf(stderr, "pool %s: ", pool_name);
-	for (ip = ibuf; *ip != '\0' && ip < &ibuf[actual_len];
-	     ip += strlen(ip) + 1)  {
-		fprintf(stderr, "%s, ", ip);
-		im = malloc(sizeof(*im));
-		im->image_name = ip;
-		im->next = *head;
-		*head = im;
+	pthread_mutex_lock(&images_lock);
+	for (i = 0; i < num_images; i++)
+		images[i]->exists = 0;
+	for (ip = ibuf; ip < &ibuf[actual_len] && *ip != '\0';
+	     ip += strlen(ip) + 1) {
+		struct rbd_image *im = add_image(ip);
+		if (im != NULL)
+			im->exists = 1;
 	}
-	fprintf(stderr, "\n");
-	return;
+	last_enumerate = now;
+	pthread_mutex_unlock(&images_lock);
+	free(ibuf);
 }
 
-int
-find_openrbd(const char *path)
+static struct rbd_image *
+find_image_ino(fuse_ino_t ino)
 {
-	int i;
+	struct rbd_image *im = NULL;
+
+	pthread_mutex_lock(&images_lock);
+	if (ino > FUSE_ROOT_ID && image_index(ino) < num_images &&
+	    images[image_index(ino)]->exists)
+		im = images[image_index(ino)];
+	pthread_mutex_unlock(&images_lock);
+	return im;
+}
 
-	/* find in opentbl[] entry if already open */
-	for (i = 0; i < MAX_RBD_IMAGES; i++) {
-		if ((opentbl[i].image_name != NULL) &&
-		    (strcmp(opentbl[i].image_name, path) == 0)) {
-			return i;
+static struct rbd_image *
+find_image_name(const char *name, int refresh)
+{
+	struct rbd_image *im = NULL;
+	unsigned i;
+
+	enumerate_images(refresh);
+	pthread_mutex_lock(&images_lock);
+	for (i = 0; i < num_images; i++) {
+		if (images[i]->exists &&
+		    strcmp(images[i]->image_name, name) == 0) {
+			im = images[i];
+			break;
 		}
 	}
-	return -1;
+	pthread_mutex_unlock(&images_lock);
+	return im;
 }
 
-int
-open_rbd_image(const char *image_name)
+/* open the image and (re)read its info if needed; im->lock held */
+static int
+_image_refresh(struct rbd_image *im, int force)
 {
-	struct rbd_image *im;
-	struct rbd_openimage *rbd;
-	int fd;
-
-	if (image_name == (char *)NULL) 
-		return -1;
+	int r;
 
-	// relies on caller to keep rbd_images up to date
-	for (im = rbd_images; im != NULL; im = im->next) {
-		if (strcmp(im->image_name, image_name) == 0) {
-			break;
+	if (im->image == NULL) {
+		r = rbd_open(ioctx, im->image_name, &im->image, NULL);
+		if (r < 0) {
+			simple_err("can't open image", r);
+			im->image = NULL;
+			return r;
 		}
+		im->info_stamp = 0;
 	}
-	if (im == NULL)
-		return -1;
-
-	/* find in opentbl[] entry if already open */
-	if ((fd = find_openrbd(image_name)) != -1) {
-		rbd = &opentbl[fd];
-	} else {
-		int i;
-		// allocate an opentbl[] and open the image
-		for (i = 0; i < MAX_RBD_IMAGES; i++) {
-			if (opentbl[i].image == NULL) {
-				fd = i;
-				rbd = &opentbl[fd];
-				rbd->image_name = strdup(image_name);
-				break;
-			}
-		}
-		if (i == MAX_RBD_IMAGES)
-			return -1;
-		int ret = rbd_open(ioctx, rbd->image_name, &(rbd->image), NULL);
-		if (ret < 0) {
-			simple_err("open_rbd_image: can't open: ", ret);
-			return ret;
+	if (force || im->info_stamp == 0 ||
+	    time(NULL) - im->info_stamp >= RBDFS_ATTR_TIMEOUT) {
+		r = rbd_stat(im->image, &im->info, sizeof(im->info));
+		if (r < 0) {
+			im->info_stamp = 0;
+			return r;
 		}
+		im->info_stamp = time(NULL);
 	}
-	rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
-		 sizeof(rbd_image_info_t));
-	rbd->rbd_stat.valid = 1;
-	return fd;
+	return 0;
 }
 
-static void
-iter_images(void *cookie,
-	    void (*iter)(void *cookie, const char *image))
+static int
+image_refresh(struct rbd_image *im, int force)
 {
-	struct rbd_image *im;
-
-	pthread_mutex_lock(&readdir_lock);
+	int r;
 
-	for (im = rbd_images; im != NULL; im = im->next)
-		iter(cookie, im->image_name);
-	pthread_mutex_unlock(&readdir_lock);
+	pthread_mutex_lock(&im->lock);
+	r = _image_refresh(im, force);
+	pthread_mutex_unlock(&im->lock);
+	return r;
 }
 
-static void count_images_cb(void *cookie, const char *image)
+/* grow the image to at least size bytes */
+static int
+image_extend(struct rbd_image *im, uint64_t size)
 {
-	(*((unsigned int *)cookie))++;
+	int r = 0;
+
+	pthread_mutex_lock(&im->lock);
+	if (size > im->info.size) {
+		fprintf(stderr, "rbd-fuse: resizing %s to 0x%"PRIx64"\n",
+			im->image_name, size);
+		r = rbd_resize(im->image, size);
+		if (r == 0)
+			r = _image_refresh(im, 1);
+	}
+	pthread_mutex_unlock(&im->lock);
+	return r;
 }
 
-static int count_images(void)
+static void
+fill_root_attr(struct stat *stbuf)
 {
-	unsigned int count = 0;
+	time_t now = time(NULL);
+	unsigned i, count = 0;
 
-	pthread_mutex_lock(&readdir_lock);
-	enumerate_images(&rbd_images);
-	pthread_mutex_unlock(&readdir_lock);
+	enumerate_images(0);
+	pthread_mutex_lock(&images_lock);
+	for (i = 0; i < num_images; i++)
+		count += images[i]->exists;
+	pthread_mutex_unlock(&images_lock);
 
-	iter_images(&count, count_images_cb);
-	return count;
+	memset(stbuf, 0, sizeof(struct stat));
+	stbuf->st_ino = FUSE_ROOT_ID;
+	stbuf->st_mode = S_IFDIR + 0755;
+	stbuf->st_nlink = 2 + count;
+	stbuf->st_uid = getuid();
+	stbuf->st_gid = getgid();
+	stbuf->st_size = 1024;
+	stbuf->st_blksize = 1024;
+	stbuf->st_blocks = 1;
+	stbuf->st_atime = now;
+	stbuf->st_mtime = now;
+	stbuf->st_ctime = now;
 }
 
-static int rbdfs_getattr(const char *path, struct stat *stbuf)
+static int
+fill_image_attr(struct rbd_image *im, struct stat *stbuf)
 {
-	int fd;
-	time_t now;
-
-	if (!gotrados)
-		return -ENXIO;
-
-	if (path[0] == 0)
-		return -ENOENT;
-
-	memset(stbuf, 0, sizeof(struct stat));
-
-	if (strcmp(path, "/") == 0) {
-
-		now = time(NULL);
-		stbuf->st_mode = S_IFDIR + 0755;
-		stbuf->st_nlink = 2+count_images();
-		stbuf->st_uid = getuid();
-		stbuf->st_gid = getgid();
-		stbuf->st_size = 1024;
-		stbuf->st_blksize = 1024;
-		stbuf->st_blocks = 1;
-		stbuf->st_atime = now;
-		stbuf->st_mtime = now;
-		stbuf->st_ctime = now;
-
-		return 0;
-	}
+	time_t now = time(NULL);
+	int r;
 
-	if (!in_opendir) {
-		pthread_mutex_lock(&readdir_lock);
-		enumerate_images(&rbd_images);
-		pthread_mutex_unlock(&readdir_lock);
+	pthread_mutex_lock(&im->lock);
+	r = _image_refresh(im, 0);
+	if (r < 0) {
+		pthread_mutex_unlock(&im->lock);
+		return r;
 	}
-	fd = open_rbd_image(path + 1);
-	if (fd < 0)
-		return -ENOENT;
-
-	now = time(NULL);
+	memset(stbuf, 0, sizeof(struct stat));
+	stbuf->st_ino = im->ino;
 	stbuf->st_mode = S_IFREG | 0666;
 	stbuf->st_nlink = 1;
 	stbuf->st_uid = getuid();
 	stbuf->st_gid = getgid();
-	stbuf->st_size = rbdsize(fd);
-	stbuf->st_blksize = rbdblksize(fd);
-	stbuf->st_blocks = rbdblkcnt(fd);
+	stbuf->st_size = im->info.size;
+	stbuf->st_blksize = im->info.obj_size;
+	stbuf->st_blocks = im->info.num_objs;
 	stbuf->st_atime = now;
 	stbuf->st_mtime = now;
 	stbuf->st_ctime = now;
-
+	pthread_mutex_unlock(&im->lock);
 	return 0;
 }
 
-
-static int rbdfs_open(const char *path, struct fuse_file_info *fi)
+static int
+fill_entry(struct rbd_image *im, struct fuse_entry_param *e)
 {
-	int fd;
+	memset(e, 0, sizeof(*e));
+	e->ino = im->ino;
+	e->attr_timeout = RBDFS_ATTR_TIMEOUT;
+	e->entry_timeout = RBDFS_ATTR_TIMEOUT;
+	return fill_image_attr(im, &e->attr);
+}
 
-	if (!gotrados)
-		return -ENXIO;
+static void rbdfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
+{
+	struct fuse_entry_param e;
+	struct rbd_image *im;
+	int r;
 
-	if (path[0] == 0)
-		return -ENOENT;
+	if (parent != FUSE_ROOT_ID) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	im = find_image_name(name, 0);
+	if (im == NULL)
+		im = find_image_name(name, 1);
+	if (im == NULL) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	r = fill_entry(im, &e);
+	if (r < 0)
+		fuse_reply_err(req, -r);
+	else
+		fuse_reply_entry(req, &e);
+}
 
-	pthread_mutex_lock(&readdir_lock);
-	enumerate_images(&rbd_images);
-	pthread_mutex_unlock(&readdir_lock);
-	fd = open_rbd_image(path + 1);
-	if (fd < 0)
-		return -ENOENT;
+static void rbdfs_getattr(fuse_req_t req, fuse_ino_t ino,
+			  struct fuse_file_info *fi)
+{
+	struct stat stbuf;
+	struct rbd_image *im;
+	int r;
 
-	fi->fh = fd;
-	return 0;
+	if (ino == FUSE_ROOT_ID) {
+		fill_root_attr(&stbuf);
+		fuse_reply_attr(req, &stbuf, RBDFS_ATTR_TIMEOUT);
+		return;
+	}
+	im = find_image_ino(ino);
+	if (im == NULL) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	r = fill_image_attr(im, &stbuf);
+	if (r < 0)
+		fuse_reply_err(req, -r);
+	else
+		fuse_reply_attr(req, &stbuf, RBDFS_ATTR_TIMEOUT);
 }
 
-static int rbdfs_read(const char *path, char *buf, size_t size,
-			off_t offset, struct fuse_file_info *fi)
+// only size changes mean anything; times are not kept
+static void rbdfs_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+			  int to_set, struct fuse_file_info *fi)
 {
-	size_t numread;
-	struct rbd_openimage *rbd;
-
-	if (!gotrados)
-		return -ENXIO;
+	struct stat stbuf;
+	struct rbd_image *im;
+	int r;
 
-	rbd = &opentbl[fi->fh];
-	numread = 0;
-	while (size > 0) {
-		ssize_t ret;
+	if (ino == FUSE_ROOT_ID) {
+		fill_root_attr(&stbuf);
+		fuse_reply_attr(req, &stbuf, RBDFS_ATTR_TIMEOUT);
+		return;
+	}
+	im = find_image_ino(ino);
+	if (im == NULL) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	if (to_set & FUSE_SET_ATTR_SIZE) {
+		pthread_mutex_lock(&im->lock);
+		r = _image_refresh(im, 0);
+		if (r == 0) {
+			fprintf(stderr, "truncate %s to %"PRIdMAX" (0x%"PRIxMAX")\n",
+				im->image_name, (intmax_t)attr->st_size,
+				(uintmax_t)attr->st_size);
+			r = rbd_resize(im->image, attr->st_size);
+		}
+		if (r == 0)
+			r = _image_refresh(im, 1);
+		pthread_mutex_unlock(&im->lock);
+		if (r < 0) {
+			fuse_reply_err(req, -r);
+			return;
+		}
+	}
+	r = fill_image_attr(im, &stbuf);
+	if (r < 0)
+		fuse_reply_err(req, -r);
+	else
+		fuse_reply_attr(req, &stbuf, RBDFS_ATTR_TIMEOUT);
+}
 
-		ret = rbd_read(rbd->image, offset, size, buf);
+static void rbdfs_open(fuse_req_t req, fuse_ino_t ino,
+		       struct fuse_file_info *fi)
+{
+	struct rbd_image *im = find_image_ino(ino);
+	int r;
 
-		if (ret <= 0)
-			break;
-		buf += ret;
-		size -= ret;
-		offset += ret;
-		numread += ret;
+	if (im == NULL) {
+		fuse_reply_err(req, ENOENT);
+		return;
 	}
-
-	return numread;
+	pthread_mutex_lock(&im->lock);
+	r = _image_refresh(im, 1);
+	if (r == 0)
+		im->opens++;
+	pthread_mutex_unlock(&im->lock);
+	if (r < 0) {
+		fuse_reply_err(req, -r);
+		return;
+	}
+	fi->fh = (uintptr_t)im;
+	fuse_reply_open(req, fi);
 }
 
-static int rbdfs_write(const char *path, const char *buf, size_t size,
-			 off_t offset, struct fuse_file_info *fi)
+static void rbdfs_release(fuse_req_t req, fuse_ino_t ino,
+			  struct fuse_file_info *fi)
 {
-	size_t numwritten;
-	struct rbd_openimage *rbd;
+	struct rbd_image *im = (struct rbd_image *)(uintptr_t)fi->fh;
 
-	if (!gotrados)
-		return -ENXIO;
+	pthread_mutex_lock(&im->lock);
+	im->opens--;
+	pthread_mutex_unlock(&im->lock);
+	fuse_reply_err(req, 0);
+}
 
-	rbd = &opentbl[fi->fh];
-	numwritten = 0;
-	while (size > 0) {
-		ssize_t ret;
+/*
+ * aio requests: the fuse request is answered from the librbd
+ * completion callback
+ */
+enum {
+	RBDFS_AIO_READ,
+	RBDFS_AIO_WRITE,
+	RBDFS_AIO_FLUSH,
+};
 
-		if (offset + size > rbdsize(fi->fh)) {
-			int r;
-			fprintf(stderr, "rbdfs_write resizing %s to 0x%"PRIxMAX"\n",
-				path, offset+size);
-			r = rbd_resize(rbd->image, offset+size);
-			if (r < 0)
-				return r;
+struct rbdfs_aio {
+	fuse_req_t req;
+	int op;
+	char *buf;
+	size_t len;
+};
 
-			r = rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
-				 sizeof(rbd_image_info_t));
-			if (r < 0)
-				return r;
-		}
-		ret = rbd_write(rbd->image, offset, size, buf);
+static void rbdfs_aio_done(rbd_completion_t c, void *arg)
+{
+	struct rbdfs_aio *aio = arg;
+	ssize_t r = rbd_aio_get_return_value(c);
 
-		if (ret < 0)
+	rbd_aio_release(c);
+	if (r < 0) {
+		fuse_reply_err(aio->req, -r);
+	} else {
+		switch (aio->op) {
+		case RBDFS_AIO_READ:
+			fuse_reply_buf(aio->req, aio->buf, r);
+			break;
+		case RBDFS_AIO_WRITE:
+			fuse_reply_write(aio->req, aio->len);
 			break;
-		buf += ret;
-		size -= ret;
-		offset += ret;
-		numwritten += ret;
+		default:
+			fuse_reply_err(aio->req, 0);
+			break;
+		}
 	}
-
-	return numwritten;
+	free(aio->buf);
+	free(aio);
 }
 
-static void rbdfs_statfs_image_cb(void *num, const char *image)
+static struct rbdfs_aio *
+rbdfs_aio_new(fuse_req_t req, int op, size_t len, rbd_completion_t *c)
 {
-	int	fd;
-
-	((uint64_t *)num)[0]++;
+	struct rbdfs_aio *aio = malloc(sizeof(*aio));
+
+	if (aio == NULL)
+		return NULL;
+	aio->req = req;
+	aio->op = op;
+	aio->len = len;
+	aio->buf = NULL;
+	if (len > 0) {
+		aio->buf = malloc(len);
+		if (aio->buf == NULL) {
+			free(aio);
+			return NULL;
+		}
+	}
+	if (rbd_aio_create_completion(aio, rbdfs_aio_done, c) < 0) {
+		free(aio->buf);
+		free(aio);
+		return NULL;
+	}
+	return aio;
+}
 
-	fd = open_rbd_image(image);
-	if (fd >= 0)
-		((uint64_t *)num)[1] += rbdsize(fd);
+/* the request could not be submitted: answer it here */
+static void
+rbdfs_aio_fail(struct rbdfs_aio *aio, rbd_completion_t c, int r)
+{
+	rbd_aio_release(c);
+	fuse_reply_err(aio->req, -r);
+	free(aio->buf);
+	free(aio);
 }
 
-static int rbdfs_statfs(const char *path, struct statvfs *buf)
+static void rbdfs_read(fuse_req_t req, fuse_ino_t ino, size_t size,
+		       off_t offset, struct fuse_file_info *fi)
 {
-	uint64_t num[2];
+	struct rbd_image *im = (struct rbd_image *)(uintptr_t)fi->fh;
+	struct rbdfs_aio *aio;
+	rbd_completion_t c;
+	uint64_t image_size;
+	int r;
 
-	if (!gotrados)
-		return -ENXIO;
+	pthread_mutex_lock(&im->lock);
+	image_size = im->info.size;
+	pthread_mutex_unlock(&im->lock);
 
-	num[0] = 1;
-	num[1] = 0;
-	pthread_mutex_lock(&readdir_lock);
-	enumerate_images(&rbd_images);
-	pthread_mutex_unlock(&readdir_lock);
-	iter_images(num, rbdfs_statfs_image_cb);
+	if ((uint64_t)offset >= image_size) {
+		fuse_reply_buf(req, NULL, 0);
+		return;
+	}
+	if (offset + size > image_size)
+		size = image_size - offset;
 
-#define	RBDFS_BSIZE	4096
-	buf->f_bsize = RBDFS_BSIZE;
-	buf->f_frsize = RBDFS_BSIZE;
-	buf->f_blocks = num[1] / RBDFS_BSIZE;
-	buf->f_bfree = 0;
-	buf->f_bavail = 0;
-	buf->f_files = num[0];
-	buf->f_ffree = 0;
-	buf->f_favail = 0;
-	buf->f_fsid = 0;
-	buf->f_flag = 0;
-	buf->f_namemax = PATH_MAX;
+	aio = rbdfs_aio_new(req, RBDFS_AIO_READ, size, &c);
+	if (aio == NULL) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+	r = rbd_aio_read(im->image, offset, size, aio->buf, c);
+	if (r < 0)
+		rbdfs_aio_fail(aio, c, r);
+}
 
-	return 0;
+static void rbdfs_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+			size_t size, off_t offset, struct fuse_file_info *fi)
+{
+	struct rbd_image *im = (struct rbd_image *)(uintptr_t)fi->fh;
+	struct rbdfs_aio *aio;
+	rbd_completion_t c;
+	int r;
+
+	r = image_extend(im, offset + size);
+	if (r < 0) {
+		fuse_reply_err(req, -r);
+		return;
+	}
+
+	// buf belongs to fuse and is reused once we return, while librbd
+	// may write from the buffer it is given until the write completes
+	aio = rbdfs_aio_new(req, RBDFS_AIO_WRITE, size, &c);
+	if (aio == NULL) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+	memcpy(aio->buf, buf, size);
+	r = rbd_aio_write(im->image, offset, size, aio->buf, c);
+	if (r < 0)
+		rbdfs_aio_fail(aio, c, r);
 }
 
-static int rbdfs_fsync(const char *path, int datasync,
-			 struct fuse_file_info *fi)
+static void rbdfs_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+			struct fuse_file_info *fi)
 {
-	if (!gotrados)
-		return -ENXIO;
-	rbd_flush(opentbl[fi->fh].image);
-	return 0;
+	struct rbd_image *im = (struct rbd_image *)(uintptr_t)fi->fh;
+	struct rbdfs_aio *aio;
+	rbd_completion_t c;
+	int r;
+
+	aio = rbdfs_aio_new(req, RBDFS_AIO_FLUSH, 0, &c);
+	if (aio == NULL) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
+	r = rbd_aio_flush(im->image, c);
+	if (r < 0)
+		rbdfs_aio_fail(aio, c, r);
 }
 
-static int rbdfs_opendir(const char *path, struct fuse_file_info *fi)
+static void rbdfs_statfs(fuse_req_t req, fuse_ino_t ino)
 {
-	// only one directory, so global "in_opendir" flag should be fine
-	pthread_mutex_lock(&readdir_lock);
-	in_opendir++;
-	enumerate_images(&rbd_images);
-	pthread_mutex_unlock(&readdir_lock);
-	return 0;
+	struct statvfs buf;
+	uint64_t files = 1, bytes = 0;
+	unsigned i, n;
+
+	enumerate_images(0);
+	pthread_mutex_lock(&images_lock);
+	n = num_images;
+	pthread_mutex_unlock(&images_lock);
+
+	for (i = 0; i < n; i++) {
+		struct rbd_image *im;
+
+		pthread_mutex_lock(&images_lock);
+		im = images[i]->exists ? images[i] : NULL;
+		pthread_mutex_unlock(&images_lock);
+		if (im == NULL)
+			continue;
+		files++;
+		pthread_mutex_lock(&im->lock);
+		if (_image_refresh(im, 0) == 0)
+			bytes += im->info.size;
+		pthread_mutex_unlock(&im->lock);
+	}
+
+#define	RBDFS_BSIZE	4096
+	memset(&buf, 0, sizeof(buf));
+	buf.f_bsize = RBDFS_BSIZE;
+	buf.f_frsize = RBDFS_BSIZE;
+	buf.f_blocks = bytes / RBDFS_BSIZE;
+	buf.f_bfree = 0;
+	buf.f_bavail = 0;
+	buf.f_files = files;
+	buf.f_ffree = 0;
+	buf.f_favail = 0;
+	buf.f_fsid = 0;
+	buf.f_flag = 0;
+	buf.f_namemax = PATH_MAX;
+
+	fuse_reply_statfs(req, &buf);
 }
 
-struct rbdfs_readdir_info {
-	void *buf;
-	fuse_fill_dir_t filler;
+/*
+ * The directory listing is built once at opendir and handed out in
+ * pieces by readdir.
+ */
+struct rbdfs_dirbuf {
+	char *p;
+	size_t size;
 };
 
-static void rbdfs_readdir_cb(void *_info, const char *name)
+static void
+dirbuf_add(fuse_req_t req, struct rbdfs_dirbuf *b, const char *name,
+	   fuse_ino_t ino)
 {
-	struct rbdfs_readdir_info *info = _info;
-
-	info->filler(info->buf, name, NULL, 0);
+	struct stat stbuf;
+	size_t oldsize = b->size;
+	char *p;
+
+	b->size += fuse_add_direntry(req, NULL, 0, name, NULL, 0);
+	p = realloc(b->p, b->size);
+	if (p == NULL) {
+		b->size = oldsize;
+		return;
+	}
+	b->p = p;
+	memset(&stbuf, 0, sizeof(stbuf));
+	stbuf.st_ino = ino;
+	fuse_add_direntry(req, b->p + oldsize, b->size - oldsize, name, &stbuf,
+			  b->size);
 }
 
-static int rbdfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-			   off_t offset, struct fuse_file_info *fi)
+static void rbdfs_opendir(fuse_req_t req, fuse_ino_t ino,
+			  struct fuse_file_info *fi)
 {
-	struct rbdfs_readdir_info info = { buf, filler };
+	struct rbdfs_dirbuf *b;
+	unsigned i;
 
-	if (!gotrados)
-		return -ENXIO;
-	if (!in_opendir)
-		fprintf(stderr, "in readdir, but not inside opendir?\n");
+	if (ino != FUSE_ROOT_ID) {
+		fuse_reply_err(req, ENOTDIR);
+		return;
+	}
+	b = calloc(1, sizeof(*b));
+	if (b == NULL) {
+		fuse_reply_err(req, ENOMEM);
+		return;
+	}
 
-	if (strcmp(path, "/") != 0)
-		return -ENOENT;
+	enumerate_images(1);
+	dirbuf_add(req, b, ".", FUSE_ROOT_ID);
+	dirbuf_add(req, b, "..", FUSE_ROOT_ID);
+	pthread_mutex_lock(&images_lock);
+	for (i = 0; i < num_images; i++) {
+		if (images[i]->exists)
+			dirbuf_add(req, b, images[i]->image_name,
+				   images[i]->ino);
+	}
+	pthread_mutex_unlock(&images_lock);
 
-	filler(buf, ".", NULL, 0);
-	filler(buf, "..", NULL, 0);
-	iter_images(&info, rbdfs_readdir_cb);
+	fi->fh = (uintptr_t)b;
+	fuse_reply_open(req, fi);
+}
 
-	return 0;
+static void rbdfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+			  off_t off, struct fuse_file_info *fi)
+{
+	struct rbdfs_dirbuf *b = (struct rbdfs_dirbuf *)(uintptr_t)fi->fh;
+
+	if ((size_t)off < b->size)
+		fuse_reply_buf(req, b->p + off,
+			       b->size - off < size ? b->size - off : size);
+	else
+		fuse_reply_buf(req, NULL, 0);
 }
-static int rbdfs_releasedir(const char *path, struct fuse_file_info *fi)
+
+static void rbdfs_releasedir(fuse_req_t req, fuse_ino_t ino,
+			     struct fuse_file_info *fi)
 {
-	// see opendir comments
-	pthread_mutex_lock(&readdir_lock);
-	in_opendir--;
-	pthread_mutex_unlock(&readdir_lock);
-	return 0;
+	struct rbdfs_dirbuf *b = (struct rbdfs_dirbuf *)(uintptr_t)fi->fh;
+
+	free(b->p);
+	free(b);
+	fuse_reply_err(req, 0);
 }
 
-void *
-rbdfs_init(struct fuse_conn_info *conn)
+void
+rbdfs_init(void *userdata, struct fuse_conn_info *conn)
 {
 	int ret;
 
-	// init cannot fail, so if we fail here, gotrados remains at 0,
-	// causing other operations to fail immediately with ENXIO
+	// init cannot fail, so give up on the whole mount if we can't
+	// get to the pool
 
 	ret = connect_to_cluster(&cluster);
 	if (ret < 0)
@@ -465,73 +732,94 @@ rbdfs_init(struct fuse_conn_info *conn)
 #if FUSE_VERSION >= FUSE_MAKE_VERSION(2, 8)
 	conn->want |= FUSE_CAP_BIG_WRITES;
 #endif
-	gotrados = 1;
-
-	// init's return value shows up in fuse_context.private_data,
-	// also to void (*destroy)(void *); useful?
-	return NULL;
+	// let the kernel keep several reads (and readahead) in flight
+	conn->want |= FUSE_CAP_ASYNC_READ;
 }
 
-// return -errno on error.  fi->fh is not set until open time
-
-int
-rbdfs_create(const char *path, mode_t mode, struct fuse_file_info *fi)
+void
+rbdfs_destroy(void *userdata)
 {
-	int r;
-	int order = imageorder;
+	unsigned i;
 
-	r = rbd_create2(ioctx, path+1, imagesize, imagefeatures, &order);
-	return r;
+	for (i = 0; i < num_images; i++) {
+		if (images[i]->image != NULL)
+			rbd_close(images[i]->image);
+	}
+	rados_ioctx_destroy(ioctx);
+	rados_shutdown(cluster);
 }
 
-int
-rbdfs_utime(const char *path, struct utimbuf *utime)
+static void rbdfs_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+			 mode_t mode, struct fuse_file_info *fi)
 {
-	// called on create; not relevant
-	return 0;
-}
+	struct fuse_entry_param e;
+	struct rbd_image *im;
+	int order = imageorder;
+	int r;
 
-int
-rbdfs_unlink(const char *path)
-{
-	int fd = find_openrbd(path);
-	if (fd != -1) {
-		struct rbd_openimage *rbd = &opentbl[fd];
-		rbd_close(rbd->image);
-		rbd->image = 0;
-		free(rbd->image_name);
-		rbd->rbd_stat.valid = 0;
+	if (parent != FUSE_ROOT_ID) {
+		fuse_reply_err(req, EACCES);
+		return;
 	}
-	return rbd_remove(ioctx, path+1);
+	r = rbd_create2(ioctx, name, imagesize, imagefeatures, &order);
+	if (r < 0) {
+		fuse_reply_err(req, -r);
+		return;
+	}
+	im = find_image_name(name, 1);
+	if (im == NULL) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	r = fill_entry(im, &e);
+	if (r < 0) {
+		fuse_reply_err(req, -r);
+		return;
+	}
+	pthread_mutex_lock(&im->lock);
+	im->opens++;
+	pthread_mutex_unlock(&im->lock);
+	fi->fh = (uintptr_t)im;
+	fuse_reply_create(req, &e, fi);
 }
 
-
-int
-rbdfs_truncate(const char *path, off_t size)
+static void rbdfs_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
 {
-	int fd;
+	struct rbd_image *im;
 	int r;
-	struct rbd_openimage *rbd;
-
-	if ((fd = open_rbd_image(path+1)) < 0)
-		return -ENOENT;
-
-	rbd = &opentbl[fd];
-	fprintf(stderr, "truncate %s to %"PRIdMAX" (0x%"PRIxMAX")\n", path, size, size);
-	r = rbd_resize(rbd->image, size);
-	if (r < 0)
-		return r;
 
-	r = rbd_stat(rbd->image, &(rbd->rbd_stat.rbd_info),
-		 sizeof(rbd_image_info_t));
-	if (r < 0)
-		return r;
-	return 0;
+	if (parent != FUSE_ROOT_ID) {
+		fuse_reply_err(req, ENOENT);
+		return;
+	}
+	im = find_image_name(name, 0);
+	if (im != NULL) {
+		pthread_mutex_lock(&im->lock);
+		if (im->opens > 0) {
+			pthread_mutex_unlock(&im->lock);
+			fuse_reply_err(req, EBUSY);
+			return;
+		}
+		// our own watch would keep rbd_remove from going ahead
+		if (im->image != NULL) {
+			rbd_close(im->image);
+			im->image = NULL;
+		}
+		im->info_stamp = 0;
+		pthread_mutex_unlock(&im->lock);
+	}
+	r = rbd_remove(ioctx, name);
+	if (r == 0 && im != NULL) {
+		pthread_mutex_lock(&images_lock);
+		im->exists = 0;
+		pthread_mutex_unlock(&images_lock);
+	}
+	fuse_reply_err(req, -r);
 }
 
 /**
  * set an xattr on path, with name/value, length size.
- * Presumably flags are from Linux, as in XATTR_CREATE or 
+ * Presumably flags are from Linux, as in XATTR_CREATE or
  * XATTR_REPLACE (both "set", but fail if exist vs fail if not exist.
  *
  * We accept xattrs only on the root node.
@@ -549,28 +837,34 @@ struct rbdfuse_attr {
 	{ NULL }
 };
 
-int
-rbdfs_setxattr(const char *path, const char *name, const char *value,
-		 size_t size, int flags)
+static void rbdfs_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+			   const char *value, size_t size, int flags)
 {
 	struct rbdfuse_attr *ap;
-	if (strcmp(path, "/") != 0)
-		return -EINVAL;
+	char buf[128];
+
+	if (ino != FUSE_ROOT_ID || size >= sizeof(buf)) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
+	// value is not nul-terminated
+	memcpy(buf, value, size);
+	buf[size] = '\0';
 
 	for (ap = attrs; ap->attrname != NULL; ap++) {
 		if (strcmp(name, ap->attrname) == 0) {
-			*ap->attrvalp = strtoull(value, NULL, 0);
+			*ap->attrvalp = strtoull(buf, NULL, 0);
 			fprintf(stderr, "rbd-fuse: %s set to 0x%"PRIx64"\n",
 				ap->attrname, *ap->attrvalp);
-			return 0;
+			fuse_reply_err(req, 0);
+			return;
 		}
 	}
-	return -EINVAL;
+	fuse_reply_err(req, EINVAL);
 }
 
-int
-rbdfs_getxattr(const char *path, const char *name, char *value,
-		 size_t size)
+static void rbdfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+			   size_t size)
 {
 	struct rbdfuse_attr *ap;
 	char buf[128];
@@ -580,52 +874,61 @@ rbdfs_getxattr(const char *path, const char *name, char *value,
 	for (ap = attrs; ap->attrname != NULL; ap++) {
 		if (strcmp(name, ap->attrname) == 0) {
 			sprintf(buf, "%"PRIu64, *ap->attrvalp);
-			if (value != NULL && size >= strlen(buf))
-				strcpy(value, buf);
 			fprintf(stderr, "rbd-fuse: get %s\n", ap->attrname);
-			return (strlen(buf));
+			if (size == 0)
+				fuse_reply_xattr(req, strlen(buf));
+			else if (size < strlen(buf))
+				fuse_reply_err(req, ERANGE);
+			else
+				fuse_reply_buf(req, buf, strlen(buf));
+			return;
 		}
 	}
-	return 0;
+	fuse_reply_err(req, ENODATA);
 }
 
-int
-rbdfs_listxattr(const char *path, char *list, size_t len)
+static void rbdfs_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size)
 {
 	struct rbdfuse_attr *ap;
-	size_t required_len = 0;
+	char list[256];
+	size_t len = 0;
 
-	if (strcmp(path, "/") != 0)
-		return -EINVAL;
+	if (ino != FUSE_ROOT_ID) {
+		fuse_reply_err(req, EINVAL);
+		return;
+	}
 
-	for (ap = attrs; ap->attrname != NULL; ap++)
-		required_len += strlen(ap->attrname) + 1;
-	if (len >= required_len) {
-		for (ap = attrs; ap->attrname != NULL; ap++) {
-			sprintf(list, "%s", ap->attrname);
-			list += strlen(ap->attrname) + 1;
-		}
+	for (ap = attrs; ap->attrname != NULL; ap++) {
+		strcpy(list + len, ap->attrname);
+		len += strlen(ap->attrname) + 1;
 	}
-	return required_len;
+	if (size == 0)
+		fuse_reply_xattr(req, len);
+	else if (size < len)
+		fuse_reply_err(req, ERANGE);
+	else
+		fuse_reply_buf(req, list, len);
 }
 
-static struct fuse_operations rbdfs_oper = {
+static struct fuse_lowlevel_ops rbdfs_oper = {
 	.create		= rbdfs_create,
+	.destroy	= rbdfs_destroy,
 	.fsync		= rbdfs_fsync,
 	.getattr	= rbdfs_getattr,
 	.getxattr	= rbdfs_getxattr,
 	.init		= rbdfs_init,
 	.listxattr	= rbdfs_listxattr,
+	.lookup		= rbdfs_lookup,
 	.open		= rbdfs_open,
 	.opendir	= rbdfs_opendir,
 	.read		= rbdfs_read,
 	.readdir	= rbdfs_readdir,
+	.release	= rbdfs_release,
 	.releasedir	= rbdfs_releasedir,
+	.setattr	= rbdfs_setattr,
 	.setxattr	= rbdfs_setxattr,
 	.statfs		= rbdfs_statfs,
-	.truncate	= rbdfs_truncate,
 	.unlink		= rbdfs_unlink,
-	.utime		= rbdfs_utime,
 	.write		= rbdfs_write,
 };
 
@@ -649,8 +952,11 @@ static struct fuse_opt rbdfs_opts[] = {
 	{"-p %s", offsetof(struct rbd_options, pool_name), KEY_RADOS_POOLNAME},
 	{"--poolname=%s", offsetof(struct rbd_options, pool_name),
 	 KEY_RADOS_POOLNAME_LONG},
+	FUSE_OPT_END
 };
 
+static int show_help, show_version;
+
 static void usage(const char *progname)
 {
 	fprintf(stderr,
@@ -661,6 +967,7 @@ static void usage(const char *progname)
 "    -V   --version         print version\n"
 "    -c   --configfile      ceph configuration file [/etc/ceph/ceph.conf]\n"
 "    -p   --poolname        rados pool name [rbd]\n"
+"    -s                     serve requests from a single thread\n"
 "\n", progname);
 }
 
@@ -670,14 +977,14 @@ static int rbdfs_opt_proc(void *data, const char *arg, int key,
 	if (key == KEY_HELP) {
 		usage(outargs->argv[0]);
 		fuse_opt_add_arg(outargs, "-ho");
-		fuse_main(outargs->argc, outargs->argv, &rbdfs_oper, NULL);
-		exit(1);
+		show_help = 1;
+		return 0;
 	}
 
 	if (key == KEY_VERSION) {
 		fuse_opt_add_arg(outargs, "--version");
-		fuse_main(outargs->argc, outargs->argv, &rbdfs_oper, NULL);
-		exit(0);
+		show_version = 1;
+		return 0;
 	}
 
 	if (key == KEY_CEPH_CONFIG) {
@@ -740,13 +1047,54 @@ failed_shutdown:
 int main(int argc, char *argv[])
 {
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	struct fuse_chan *ch;
+	struct fuse_session *se;
+	char *mountpoint = NULL;
+	int multithreaded, foreground;
+	int r = -1;
 
 	if (fuse_opt_parse(&args, &rbd_options, rbdfs_opts, rbdfs_opt_proc)
 	    == -1) {
 		exit(1);
 	}
+	if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded,
+			       &foreground) == -1)
+		goto out;
+	if (show_help || show_version) {
+		// fuse_parse_cmdline printed the rest
+		r = show_help ? -1 : 0;
+		goto out;
+	}
+	if (mountpoint == NULL) {
+		usage(argv[0]);
+		goto out;
+	}
 
-	pthread_mutex_init(&readdir_lock, NULL);
+	ch = fuse_mount(mountpoint, &args);
+	if (ch == NULL)
+		goto out;
+
+	se = fuse_lowlevel_new(&args, &rbdfs_oper, sizeof(rbdfs_oper), NULL);
+	if (se != NULL) {
+		if (fuse_set_signal_handlers(se) != -1) {
+			fuse_session_add_chan(se, ch);
+			// daemonize before the cluster connection (in init)
+			// starts any threads
+			if (fuse_daemonize(foreground) != -1) {
+				if (multithreaded)
+					r = fuse_session_loop_mt(se);
+				else
+					r = fuse_session_loop(se);
+			}
+			fuse_remove_signal_handlers(se);
+			fuse_session_remove_chan(ch);
+		}
+		fuse_session_destroy(se);
+	}
+	fuse_unmount(mountpoint, ch);
 
-	return fuse_main(args.argc, args.argv, &rbdfs_oper, NULL);
+out:
+	free(mountpoint);
+	fuse_opt_free_args(&args);
+	return r ? 1 : 0;
 }
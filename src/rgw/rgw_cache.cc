@@ -2,36 +2,71 @@
 
 #include <errno.h>
 
+#include "include/ceph_hash.h"
+
 #define dout_subsys ceph_subsys_rgw
 
 using namespace std;
 
+ObjectCache::~ObjectCache()
+{
+  for (int i = 0; i < RGW_CACHE_SHARDS; i++) {
+    Shard& shard = shards[i];
+    while (!shard.lru.empty()) {
+      remove_entry(shard, shard.lru.front());
+    }
+  }
+}
+
+ObjectCache::Shard& ObjectCache::get_shard(const string& name)
+{
+  return shards[ceph_str_hash_linux(name.c_str(), name.size()) % RGW_CACHE_SHARDS];
+}
+
+void ObjectCache::remove_entry(Shard& shard, ObjectCacheEntry *entry)
+{
+  entry->lru_item.remove_myself();
+  shard.cache_map.erase(entry->name);
+  delete entry;
+}
+
+void ObjectCache::trim(Shard& shard, ObjectCacheEntry *keep)
+{
+  while (shard.cache_map.size() > max_shard_entries) {
+    ObjectCacheEntry *entry = shard.lru.front();
+    if (entry == keep)
+      break;
+    ldout(cct, 10) << "removing entry: name=" << entry->name << " from cache LRU" << dendl;
+    remove_entry(shard, entry);
+  }
+}
+
 int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask)
 {
-  RWLock::RLocker l(lock);
+  Shard& shard = get_shard(name);
+  Mutex::Locker l(shard.lock);
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  ceph::unordered_map<string, ObjectCacheEntry *>::iterator iter = shard.cache_map.find(name);
+  if (iter == shard.cache_map.end()) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
     return -ENOENT;
   }
 
-  ObjectCacheEntry& entry = iter->second;
-
-  if (lru_counter - entry.lru_promotion_ts > lru_window) {
-    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << lru_counter << " promotion_ts=" << entry.lru_promotion_ts << dendl;
-    lock.unlock();
-    lock.get_write(); /* promote lock to writer */
+  ObjectCacheEntry *entry = iter->second;
 
-    /* check again, we might have lost a race here */
-    if (lru_counter - entry.lru_promotion_ts > lru_window) {
-      touch_lru(name, entry, iter->second.lru_iter);
-    }
+  if (!entry->expires.is_zero() && entry->expires < ceph_clock_now(cct)) {
+    ldout(cct, 10) << "cache get: name=" << name << " : expired" << dendl;
+    remove_entry(shard, entry);
+    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    return -ENOENT;
   }
 
-  ObjectCacheInfo& src = iter->second.info;
-  if ((src.flags & mask) != mask) {
+  shard.lru.push_back(&entry->lru_item);
+
+  ObjectCacheInfo& src = entry->info;
+  /* a negative entry answers any request */
+  if (src.status >= 0 && (src.flags & mask) != mask) {
     ldout(cct, 10) << "cache get: name=" << name << " : type miss (requested=" << mask << ", cached=" << src.flags << ")" << dendl;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
     return -ENOENT;
@@ -44,22 +79,55 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask)
   return 0;
 }
 
+void ObjectCache::invalidate_chained(const string& name)
+{
+  Mutex::Locker l(chained_lock);
+  for (list<RGWChainedCache *>::iterator iter = chained_caches.begin(); iter != chained_caches.end(); ++iter) {
+    (*iter)->invalidate(name);
+  }
+}
+
+void ObjectCache::chain_cache(RGWChainedCache *cc)
+{
+  Mutex::Locker l(chained_lock);
+  chained_caches.push_back(cc);
+}
+
+void ObjectCache::unchain_cache(RGWChainedCache *cc)
+{
+  Mutex::Locker l(chained_lock);
+  chained_caches.remove(cc);
+}
+
 void ObjectCache::put(string& name, ObjectCacheInfo& info)
 {
-  RWLock::WLocker l(lock);
+  do_put(name, info);
+
+  /* only once the new contents are in place, so what is derived again is current */
+  invalidate_chained(name);
+}
+
+void ObjectCache::do_put(string& name, ObjectCacheInfo& info)
+{
+  Shard& shard = get_shard(name);
+  Mutex::Locker l(shard.lock);
 
   ldout(cct, 10) << "cache put: name=" << name << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
-    ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+  ObjectCacheEntry *&pentry = shard.cache_map[name];
+  if (!pentry) {
+    pentry = new ObjectCacheEntry(name);
   }
-  ObjectCacheEntry& entry = iter->second;
-  ObjectCacheInfo& target = entry.info;
+  ObjectCacheEntry *entry = pentry;
+  ObjectCacheInfo& target = entry->info;
+
+  shard.lru.push_back(&entry->lru_item);
+  trim(shard, entry);
 
-  touch_lru(name, entry, entry.lru_iter);
+  int expiry = cct->_conf->rgw_cache_expiry_interval;
+  if (expiry > 0) {
+    entry->expires = ceph_clock_now(cct);
+    entry->expires += expiry;
+  }
 
   target.status = info.status;
 
@@ -104,62 +172,16 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info)
 
 void ObjectCache::remove(string& name)
 {
-  RWLock::WLocker l(lock);
-
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
-    return;
-
-  ldout(cct, 10) << "removing " << name << " from cache" << dendl;
-
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
-}
-
-void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
-{
-  while (lru_size > (size_t)cct->_conf->rgw_cache_lru_size) {
-    list<string>::iterator iter = lru.begin();
-    if ((*iter).compare(name) == 0) {
-      /*
-       * if the entry we're touching happens to be at the lru end, don't remove it,
-       * lru shrinking can wait for next time
-       */
-      break;
+  {
+    Shard& shard = get_shard(name);
+    Mutex::Locker l(shard.lock);
+
+    ceph::unordered_map<string, ObjectCacheEntry *>::iterator iter = shard.cache_map.find(name);
+    if (iter != shard.cache_map.end()) {
+      ldout(cct, 10) << "removing " << name << " from cache" << dendl;
+      remove_entry(shard, iter->second);
     }
-    map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
-    ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
-      cache_map.erase(map_iter);
-    lru.pop_front();
-    lru_size--;
   }
 
-  if (lru_iter == lru.end()) {
-    lru.push_back(name);
-    lru_size++;
-    lru_iter--;
-    ldout(cct, 10) << "adding " << name << " to cache LRU end" << dendl;
-  } else {
-    ldout(cct, 10) << "moving " << name << " to cache LRU end" << dendl;
-    lru.erase(lru_iter);
-    lru.push_back(name);
-    lru_iter = lru.end();
-    --lru_iter;
-  }
-
-  lru_counter++;
-  entry.lru_promotion_ts = lru_counter;
+  invalidate_chained(name);
 }
-
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
-{
-  if (lru_iter == lru.end())
-    return;
-
-  lru.erase(lru_iter);
-  lru_size--;
-  lru_iter = lru.end();
-}
-
-
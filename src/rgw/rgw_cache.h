@@ -7,7 +7,9 @@
 #include "include/types.h"
 #include "include/utime.h"
 #include "include/assert.h"
-#include "common/RWLock.h"
+#include "include/unordered_map.h"
+#include "include/xlist.h"
+#include "common/Mutex.h"
 
 enum {
   UPDATE_OBJ,
@@ -125,32 +127,67 @@ struct RGWCacheNotifyInfo {
 WRITE_CLASS_ENCODER(RGWCacheNotifyInfo)
 
 struct ObjectCacheEntry {
+  string name;
   ObjectCacheInfo info;
-  std::list<string>::iterator lru_iter;
-  uint64_t lru_promotion_ts;
+  utime_t expires; /* zero if the entry doesn't expire */
+  xlist<ObjectCacheEntry *>::item lru_item;
 
-  ObjectCacheEntry() : lru_promotion_ts(0) {}
+  ObjectCacheEntry(const string& _name) : name(_name), lru_item(this) {}
 };
 
+/*
+ * something derived from cached objects, such as their decoded
+ * contents; it is told whenever a cached object is replaced or
+ * removed, here or through a notification from another gateway
+ */
+class RGWChainedCache {
+public:
+  virtual ~RGWChainedCache() {}
+  /* name is the object's cache name, "<pool>+<oid>" */
+  virtual void invalidate(const string& name) = 0;
+};
+
+#define RGW_CACHE_SHARDS 16
+
+/*
+ * Entries are spread over shards by name, each with its own lock, hash
+ * table and intrusive LRU list, so that lookups of different objects
+ * don't contend and a hit only relinks the entry.  An entry with a
+ * negative status records that the object doesn't exist.  Entries
+ * expire rgw_cache_expiry_interval seconds after they were put.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  unsigned long lru_size;
-  unsigned long lru_counter;
-  unsigned long lru_window;
-  RWLock lock;
+  struct Shard {
+    Mutex lock;
+    ceph::unordered_map<string, ObjectCacheEntry *> cache_map;
+    xlist<ObjectCacheEntry *> lru; /* least recently used first */
+
+    Shard() : lock("ObjectCache::Shard::lock") {}
+  };
+
+  Shard shards[RGW_CACHE_SHARDS];
+  size_t max_shard_entries;
   CephContext *cct;
 
-  void touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  Mutex chained_lock;
+  list<RGWChainedCache *> chained_caches;
+
+  Shard& get_shard(const string& name);
+  void remove_entry(Shard& shard, ObjectCacheEntry *entry);
+  void trim(Shard& shard, ObjectCacheEntry *keep);
+  void do_put(std::string& name, ObjectCacheInfo& bl);
+  void invalidate_chained(const string& name);
 public:
-  ObjectCache() : lru_size(0), lru_counter(0), lru_window(0), lock("ObjectCache"), cct(NULL) { }
+  ObjectCache() : max_shard_entries(0), cct(NULL), chained_lock("ObjectCache::chained_lock") { }
+  ~ObjectCache();
   int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask);
   void put(std::string& name, ObjectCacheInfo& bl);
   void remove(std::string& name);
+  void chain_cache(RGWChainedCache *cc);
+  void unchain_cache(RGWChainedCache *cc);
   void set_ctx(CephContext *_cct) {
     cct = _cct;
-    lru_window = cct->_conf->rgw_cache_lru_size / 2;
+    max_shard_entries = (cct->_conf->rgw_cache_lru_size + RGW_CACHE_SHARDS - 1) / RGW_CACHE_SHARDS;
   }
 };
 
@@ -194,6 +231,14 @@ class RGWCache  : public T
     return true;
   }
 
+  bool chain_cache(RGWChainedCache *cc) {
+    cache.chain_cache(cc);
+    return true;
+  }
+  void unchain_cache(RGWChainedCache *cc) {
+    cache.unchain_cache(cc);
+  }
+
   int distribute_cache(const string& normal_name, rgw_obj& obj, ObjectCacheInfo& obj_info, int op);
   int watch_cb(int opcode, uint64_t ver, bufferlist& bl);
 public:
@@ -4,10 +4,11 @@
 #include <stdlib.h>
 
 #include "include/types.h"
+#include "common/Formatter.h"
 
 #include "rgw_common.h"
 
-class RGWClientIO {
+class RGWClientIO : public FormatterSink {
   bool account;
 
   size_t bytes_sent;
@@ -28,6 +29,9 @@ public:
   void init(CephContext *cct);
   int print(const char *format, ...);
   int write(const char *buf, int len);
+  void write_formatted(const char *data, size_t len) {
+    write(data, len);
+  }
   virtual void flush() = 0;
   int read(char *buf, int max, int *actual);
 
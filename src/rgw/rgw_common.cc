@@ -46,6 +46,13 @@ int rgw_perf_start(CephContext *cct)
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss");
 
+  plb.add_u64_counter(l_rgw_index_complete, "index_complete");
+  plb.add_u64_counter(l_rgw_index_complete_failed, "index_complete_failed");
+  plb.add_time_avg(l_rgw_index_complete_lat, "index_complete_lat");
+
+  plb.add_u64_counter(l_rgw_gc_removed, "gc_removed");
+  plb.add_u64(l_rgw_gc_backlog, "gc_backlog");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
@@ -29,18 +29,21 @@ void RGWGC::initialize(CephContext *_cct, RGWRados *_store) {
     max_objs = HASH_PRIME;
 
   obj_names = new string[max_objs];
+  shard_backlog = new uint64_t[max_objs];
 
   for (int i = 0; i < max_objs; i++) {
     obj_names[i] = gc_oid_prefix;
     char buf[32];
     snprintf(buf, 32, ".%d", i);
     obj_names[i].append(buf);
+    shard_backlog[i] = 0;
   }
 }
 
 void RGWGC::finalize()
 {
   delete[] obj_names;
+  delete[] shard_backlog;
 }
 
 int RGWGC::tag_index(const string& tag)
@@ -127,6 +130,72 @@ int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std
   return 0;
 }
 
+void RGWGC::throttle_removal()
+{
+  int max = cct->_conf->rgw_gc_max_removals_per_sec;
+  if (max <= 0)
+    return;
+
+  Mutex::Locker l(rate_lock);
+  for (;;) {
+    utime_t now = ceph_clock_now(cct);
+    utime_t window_end = rate_window_start;
+    window_end += utime_t(1, 0);
+    if (now >= window_end) {
+      rate_window_start = now;
+      rate_window_ops = 0;
+    }
+    if (rate_window_ops < max) {
+      ++rate_window_ops;
+      return;
+    }
+    rate_cond.WaitInterval(cct, rate_lock, window_end - now);
+  }
+}
+
+void RGWGC::put_tag(const string& tag, map<string, TagState>& tags, std::list<string>& remove_tags)
+{
+  map<string, TagState>::iterator iter = tags.find(tag);
+  assert(iter != tags.end());
+  if (--iter->second.pending > 0)
+    return;
+
+  /* all of the chain is gone, the entry can go too; failed ones are kept for the backlog */
+  if (!iter->second.failed) {
+    remove_tags.push_back(tag);
+    tags.erase(iter);
+  }
+}
+
+void RGWGC::complete_remove_io(RemoveIO& io, map<string, TagState>& tags, std::list<string>& remove_tags)
+{
+  io.c->wait_for_complete();
+  int ret = io.c->get_return_value();
+  io.c->release();
+  if (ret == -ENOENT)
+    ret = 0;
+  if (ret < 0) {
+    dout(0) << "failed to remove " << io.obj.pool << ":" << io.obj.oid << "@" << io.obj.key << dendl;
+    tags[io.tag].failed = true;
+  } else if (perfcounter) {
+    perfcounter->inc(l_rgw_gc_removed);
+  }
+  put_tag(io.tag, tags, remove_tags);
+}
+
+void RGWGC::set_backlog(int index, uint64_t entries)
+{
+  Mutex::Locker l(backlog_lock);
+  shard_backlog[index] = entries;
+
+  uint64_t total = 0;
+  for (int i = 0; i < max_objs; i++) {
+    total += shard_backlog[i];
+  }
+  if (perfcounter)
+    perfcounter->set(l_rgw_gc_backlog, total);
+}
+
 int RGWGC::process(int index, int max_secs)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
@@ -152,9 +221,18 @@ int RGWGC::process(int index, int max_secs)
   if (ret < 0)
     return ret;
 
+  /*
+   * tail objects are removed with up to rgw_gc_max_concurrent_io aio
+   * operations in flight; an entry is removed once all of its chain is
+   */
+  unsigned max_aio = max(1, cct->_conf->rgw_gc_max_concurrent_io);
+  map<string, IoCtx> ctxs;
+  std::list<RemoveIO> ios;
+  map<string, TagState> tags;
+  uint64_t left = 0; /* expired entries not handled in this pass */
+
   string marker;
   bool truncated;
-  IoCtx *ctx = NULL;
   do {
     int max = 100;
     std::list<cls_rgw_gc_obj_info> entries;
@@ -166,11 +244,10 @@ int RGWGC::process(int index, int max_secs)
     if (ret < 0)
       goto done;
 
-    string last_pool;
-    ctx = new IoCtx;
+    left = entries.size();
+
     std::list<cls_rgw_gc_obj_info>::iterator iter;
-    for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
+    for (iter = entries.begin(); iter != entries.end(); ++iter, --left) {
       cls_rgw_gc_obj_info& info = *iter;
       std::list<cls_rgw_obj>::iterator liter;
       cls_rgw_obj_chain& chain = info.chain;
@@ -179,55 +256,103 @@ int RGWGC::process(int index, int max_secs)
       if (now >= end)
         goto done;
 
-      remove_tag = true;
+      TagState& state = tags[info.tag];
+      state = TagState();
+      state.pending = 1;
+
       for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
         cls_rgw_obj& obj = *liter;
 
-        if (obj.pool != last_pool) {
-          delete ctx;
-          ctx = new IoCtx;
-	  ret = store->rados->ioctx_create(obj.pool.c_str(), *ctx);
-	  if (ret < 0) {
-	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
-	    continue;
-	  }
-          last_pool = obj.pool;
+        map<string, IoCtx>::iterator citer = ctxs.find(obj.pool);
+        if (citer == ctxs.end()) {
+          IoCtx ctx;
+          ret = store->rados->ioctx_create(obj.pool.c_str(), ctx);
+          if (ret < 0) {
+            dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
+            state.failed = true;
+            continue;
+          }
+          citer = ctxs.insert(make_pair(obj.pool, ctx)).first;
+        }
+        IoCtx& ctx = citer->second;
+
+        throttle_removal();
+        while (ios.size() >= max_aio) {
+          complete_remove_io(ios.front(), tags, remove_tags);
+          ios.pop_front();
         }
 
-        ctx->locator_set_key(obj.key);
-	dout(0) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
-	ObjectWriteOperation op;
-	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(obj.oid, &op);
-	if (ret == -ENOENT)
-	  ret = 0;
+        ctx.locator_set_key(obj.key);
+        dout(0) << "gc::process: removing " << obj.pool << ":" << obj.oid << dendl;
+        ObjectWriteOperation op;
+        cls_refcount_put(op, info.tag, true);
+        librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+        ret = ctx.aio_operate(obj.oid, c, &op);
         if (ret < 0) {
-          remove_tag = false;
+          c->release();
           dout(0) << "failed to remove " << obj.pool << ":" << obj.oid << "@" << obj.key << dendl;
+          state.failed = true;
+          continue;
         }
+        state.pending++;
+        ios.push_back(RemoveIO(c, info.tag, obj));
 
-        if (going_down()) // leave early, even if tag isn't removed, it's ok
+        if (going_down()) { // leave early, even if tag isn't removed, it's ok
+          put_tag(info.tag, tags, remove_tags);
           goto done;
+        }
       }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
+      put_tag(info.tag, tags, remove_tags);
+
 #define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          remove(index, remove_tags);
-          remove_tags.clear();
-        }
+      if (remove_tags.size() > MAX_REMOVE_CHUNK) {
+        remove(index, remove_tags);
+        remove_tags.clear();
       }
     }
+
+    /* the next listing starts over, so it must not see what is in flight */
+    while (!ios.empty()) {
+      complete_remove_io(ios.front(), tags, remove_tags);
+      ios.pop_front();
+    }
+    if (!remove_tags.empty()) {
+      remove(index, remove_tags);
+      remove_tags.clear();
+    }
   } while (truncated);
 
 done:
+  while (!ios.empty()) {
+    complete_remove_io(ios.front(), tags, remove_tags);
+    ios.pop_front();
+  }
   if (!remove_tags.empty())
     remove(index, remove_tags);
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
+
+  /* entries whose removal failed are still there too */
+  left += tags.size();
+  if (!going_down())
+    set_backlog(index, left);
   return 0;
 }
 
+void *RGWGC::GCShardWorker::entry()
+{
+  for (;;) {
+    int i = next->inc() - 1;
+    if (i >= num_shards || gc->going_down())
+      break;
+    int r = gc->process((i + start) % num_shards, max_secs);
+    if (r < 0) {
+      ret = r;
+      break;
+    }
+  }
+  return NULL;
+}
+
 int RGWGC::process()
 {
   int max_objs = cct->_conf->rgw_gc_max_objs;
@@ -238,14 +363,30 @@ int RGWGC::process()
   if (ret < 0)
     return ret;
 
-  for (int i = 0; i < max_objs; i++) {
-    int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
-    if (ret < 0)
-      return ret;
+  /* shards are handed out to the workers in turn */
+  int num_workers = cct->_conf->rgw_gc_processor_threads;
+  if (num_workers > max_objs)
+    num_workers = max_objs;
+  if (num_workers < 1)
+    num_workers = 1;
+
+  atomic_t next;
+  vector<GCShardWorker *> workers;
+  for (int i = 0; i < num_workers; i++) {
+    GCShardWorker *worker = new GCShardWorker(this, &next, start % max_objs, max_objs, max_secs);
+    worker->create();
+    workers.push_back(worker);
   }
 
-  return 0;
+  for (vector<GCShardWorker *>::iterator iter = workers.begin(); iter != workers.end(); ++iter) {
+    GCShardWorker *worker = *iter;
+    worker->join();
+    if (worker->ret < 0 && ret >= 0)
+      ret = worker->ret;
+    delete worker;
+  }
+
+  return ret;
 }
 
 bool RGWGC::going_down()
@@ -19,7 +19,54 @@ class RGWGC {
   string *obj_names;
   atomic_t down_flag;
 
+  /* removals in the current second, shared by all shard workers */
+  Mutex rate_lock;
+  Cond rate_cond;
+  utime_t rate_window_start;
+  int rate_window_ops;
+
+  /* expired entries each shard's last pass left behind */
+  Mutex backlog_lock;
+  uint64_t *shard_backlog;
+
+  /* a tail object removal in flight */
+  struct RemoveIO {
+    librados::AioCompletion *c;
+    string tag;
+    cls_rgw_obj obj;
+
+    RemoveIO(librados::AioCompletion *_c, const string& _tag, const cls_rgw_obj& _obj) : c(_c), tag(_tag), obj(_obj) {}
+  };
+
+  /* per tag, the removals in flight plus one while they are being sent */
+  struct TagState {
+    int pending;
+    bool failed;
+
+    TagState() : pending(0), failed(false) {}
+  };
+
   int tag_index(const string& tag);
+  void throttle_removal();
+  void complete_remove_io(RemoveIO& io, map<string, TagState>& tags, std::list<string>& remove_tags);
+  void put_tag(const string& tag, map<string, TagState>& tags, std::list<string>& remove_tags);
+  void set_backlog(int index, uint64_t entries);
+
+  /* processes shards of one gc round until none are left */
+  class GCShardWorker : public Thread {
+    RGWGC *gc;
+    atomic_t *next;
+    int start;
+    int num_shards;
+    int max_secs;
+
+  public:
+    int ret;
+
+    GCShardWorker(RGWGC *_gc, atomic_t *_next, int _start, int _num_shards, int _max_secs)
+      : gc(_gc), next(_next), start(_start), num_shards(_num_shards), max_secs(_max_secs), ret(0) {}
+    void *entry();
+  };
 
   class GCWorker : public Thread {
     CephContext *cct;
@@ -35,7 +82,9 @@ class RGWGC {
 
   GCWorker *worker;
 public:
-  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL),
+            rate_lock("RGWGC::rate_lock"), rate_window_ops(0),
+            backlog_lock("RGWGC::backlog_lock"), shard_backlog(NULL), worker(NULL) {}
   ~RGWGC() {
     stop_processor();
     finalize();
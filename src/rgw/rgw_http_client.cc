@@ -2,11 +2,85 @@
 #include <curl/easy.h>
 #include <curl/multi.h>
 
+#include "common/Mutex.h"
 #include "rgw_common.h"
 #include "rgw_http_client.h"
 
 #define dout_subsys ceph_subsys_rgw
 
+/*
+ * curl keeps the connections of an easy handle open after a transfer,
+ * and the next transfer on that handle to the same host reuses them.
+ * Handing finished handles to later requests instead of cleaning them
+ * up keeps connections to the other zones alive between requests.
+ */
+class RGWCurlHandles {
+  CephContext *cct;
+  Mutex lock;
+  list<CURL *> idle;
+
+public:
+  RGWCurlHandles(CephContext *_cct) : cct(_cct), lock("RGWCurlHandles") {}
+  ~RGWCurlHandles() {
+    for (list<CURL *>::iterator iter = idle.begin(); iter != idle.end(); ++iter) {
+      curl_easy_cleanup(*iter);
+    }
+  }
+
+  CURL *get() {
+    CURL *h = NULL;
+    lock.Lock();
+    if (!idle.empty()) {
+      h = idle.front();
+      idle.pop_front();
+    }
+    lock.Unlock();
+    if (!h)
+      return curl_easy_init();
+
+    /* drops the options of the last request, but not its connections */
+    curl_easy_reset(h);
+    return h;
+  }
+
+  void put(CURL *h) {
+    Mutex::Locker l(lock);
+    if ((int)idle.size() >= cct->_conf->rgw_curl_max_idle_handles) {
+      curl_easy_cleanup(h);
+      return;
+    }
+    idle.push_front(h); /* most recently used handles have the live connections */
+  }
+};
+
+static RGWCurlHandles *curl_handles = NULL;
+
+void rgw_http_client_init(CephContext *cct)
+{
+  curl_handles = new RGWCurlHandles(cct);
+}
+
+void rgw_http_client_cleanup()
+{
+  delete curl_handles;
+  curl_handles = NULL;
+}
+
+static CURL *get_curl_handle()
+{
+  if (curl_handles)
+    return curl_handles->get();
+  return curl_easy_init();
+}
+
+static void put_curl_handle(CURL *h)
+{
+  if (curl_handles)
+    curl_handles->put(h);
+  else
+    curl_easy_cleanup(h);
+}
+
 static size_t receive_http_header(void *ptr, size_t size, size_t nmemb, void *_info)
 {
   RGWHTTPClient *client = static_cast<RGWHTTPClient *>(_info);
@@ -49,7 +123,7 @@ int RGWHTTPClient::process(const char *method, const char *url)
 
   char error_buf[CURL_ERROR_SIZE];
 
-  curl_handle = curl_easy_init();
+  curl_handle = get_curl_handle();
 
   dout(20) << "sending request to " << url << dendl;
 
@@ -91,7 +165,7 @@ int RGWHTTPClient::process(const char *method, const char *url)
     dout(0) << "curl_easy_performed returned error: " << error_buf << dendl;
     ret = -EINVAL;
   }
-  curl_easy_cleanup(curl_handle);
+  put_curl_handle(curl_handle);
   curl_slist_free_all(h);
 
   return ret;
@@ -101,14 +175,20 @@ struct multi_req_data {
   CURL *easy_handle;
   CURLM *multi_handle;
   curl_slist *h;
+  char error_buf[CURL_ERROR_SIZE];
 
-  multi_req_data() : easy_handle(NULL), multi_handle(NULL), h(NULL) {}
+  multi_req_data() : easy_handle(NULL), multi_handle(NULL), h(NULL) {
+    error_buf[0] = '\0';
+  }
   ~multi_req_data() {
-    if (multi_handle)
+    if (multi_handle) {
+      if (easy_handle)
+        curl_multi_remove_handle(multi_handle, easy_handle);
       curl_multi_cleanup(multi_handle);
+    }
 
     if (easy_handle)
-      curl_easy_cleanup(easy_handle);
+      put_curl_handle(easy_handle);
 
     if (h)
       curl_slist_free_all(h);
@@ -122,10 +202,8 @@ int RGWHTTPClient::init_async(const char *method, const char *url, void **handle
   multi_req_data *req_data = new multi_req_data;
   *handle = (void *)req_data;
 
-  char error_buf[CURL_ERROR_SIZE];
-
   multi_handle = curl_multi_init();
-  easy_handle = curl_easy_init();
+  easy_handle = get_curl_handle();
 
   req_data->multi_handle = multi_handle;
   req_data->easy_handle = easy_handle;
@@ -164,7 +242,7 @@ int RGWHTTPClient::init_async(const char *method, const char *url, void **handle
   curl_easy_setopt(easy_handle, CURLOPT_WRITEHEADER, (void *)this);
   curl_easy_setopt(easy_handle, CURLOPT_WRITEFUNCTION, receive_http_data);
   curl_easy_setopt(easy_handle, CURLOPT_WRITEDATA, (void *)this);
-  curl_easy_setopt(easy_handle, CURLOPT_ERRORBUFFER, (void *)error_buf);
+  curl_easy_setopt(easy_handle, CURLOPT_ERRORBUFFER, (void *)req_data->error_buf);
   if (h) {
     curl_easy_setopt(easy_handle, CURLOPT_HTTPHEADER, (void *)h);
   }
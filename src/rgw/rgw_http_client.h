@@ -38,4 +38,8 @@ public:
   int complete_request(void *handle);
 };
 
+/* keep finished curl handles, and their open connections, for reuse */
+void rgw_http_client_init(CephContext *cct);
+void rgw_http_client_cleanup();
+
 #endif
@@ -92,6 +92,7 @@ void RGWLoadGenIO::init_env(CephContext *cct)
 
 int RGWLoadGenIO::send_status(const char *status, const char *status_name)
 {
+  this->status = atoi(status);
   return 0;
 }
 
@@ -109,3 +110,84 @@ int RGWLoadGenIO::send_content_length(uint64_t len)
 {
   return 0;
 }
+
+utime_t RGWLoadGenStats::OpStats::percentile(int pct) const
+{
+  uint64_t target = (count * pct + 99) / 100;
+  uint64_t seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += hist[i];
+    if (seen >= target && seen > 0) {
+      utime_t t;
+      t.set_from_double((double)(1ULL << i) / 1000000);
+      return t;
+    }
+  }
+  return max_lat;
+}
+
+void RGWLoadGenStats::add(const string& op, utime_t& lat, uint64_t bytes, bool failed)
+{
+  uint64_t usec = lat.to_nsec() / 1000;
+  int b = 0;
+  while (b < NUM_BUCKETS - 1 && (1ULL << b) <= usec)
+    b++;
+
+  Mutex::Locker l(lock);
+  OpStats& stats = ops[op];
+  stats.count++;
+  if (failed)
+    stats.failed++;
+  stats.bytes += bytes;
+  stats.total_lat += lat;
+  if (lat > stats.max_lat)
+    stats.max_lat = lat;
+  stats.hist[b]++;
+}
+
+void RGWLoadGenStats::dump(Formatter *f, utime_t& now)
+{
+  Mutex::Locker l(lock);
+  double elapsed = (double)(now - start);
+  uint64_t total = 0;
+  uint64_t total_bytes = 0;
+
+  f->open_object_section("loadgen");
+  f->dump_float("elapsed", elapsed);
+  f->open_array_section("ops");
+  for (map<string, OpStats>::iterator iter = ops.begin(); iter != ops.end(); ++iter) {
+    OpStats& stats = iter->second;
+    total += stats.count;
+    total_bytes += stats.bytes;
+
+    f->open_object_section("op");
+    f->dump_string("type", iter->first);
+    f->dump_unsigned("count", stats.count);
+    f->dump_unsigned("failed", stats.failed);
+    f->dump_unsigned("bytes", stats.bytes);
+    if (elapsed > 0)
+      f->dump_float("ops_per_sec", stats.count / elapsed);
+    f->dump_float("avg_lat", (double)stats.total_lat / stats.count);
+    f->dump_float("p50_lat", (double)stats.percentile(50));
+    f->dump_float("p99_lat", (double)stats.percentile(99));
+    f->dump_float("max_lat", (double)stats.max_lat);
+    f->open_array_section("histogram");
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+      if (!stats.hist[i])
+        continue;
+      f->open_object_section("bucket");
+      f->dump_unsigned("lt_usec", 1ULL << i);
+      f->dump_unsigned("count", stats.hist[i]);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+  f->dump_unsigned("total_ops", total);
+  if (elapsed > 0) {
+    f->dump_float("ops_per_sec", total / elapsed);
+    f->dump_float("bytes_per_sec", total_bytes / elapsed);
+  }
+  f->close_section();
+}
@@ -1,6 +1,7 @@
 #ifndef CEPH_RGW_LOADGEN_H
 #define CEPH_RGW_LOADGEN_H
 
+#include "common/Mutex.h"
 #include "rgw_client_io.h"
 
 
@@ -25,6 +26,7 @@ class RGWLoadGenIO : public RGWClientIO
 {
   uint64_t left_to_read;
   RGWLoadGenRequestEnv *req;
+  int status;
 public:
   void init_env(CephContext *cct);
 
@@ -37,8 +39,44 @@ public:
   int complete_request();
   int send_content_length(uint64_t len);
 
-  RGWLoadGenIO(RGWLoadGenRequestEnv *_re) : left_to_read(0), req(_re) {}
+  RGWLoadGenIO(RGWLoadGenRequestEnv *_re) : left_to_read(0), req(_re), status(0) {}
   void flush();
+
+  int get_status() { return status; }
+};
+
+/*
+ * Latency and throughput of the requests sent by the loadgen frontend,
+ * per kind of request (e.g. "GET object", "PUT bucket").
+ */
+class RGWLoadGenStats {
+  /* bucket i counts latencies below 2^i usec */
+  static const int NUM_BUCKETS = 32;
+
+  struct OpStats {
+    uint64_t count;
+    uint64_t failed;
+    uint64_t bytes;
+    utime_t total_lat;
+    utime_t max_lat;
+    uint64_t hist[NUM_BUCKETS];
+
+    OpStats() : count(0), failed(0), bytes(0) {
+      memset(hist, 0, sizeof(hist));
+    }
+    utime_t percentile(int pct) const;
+  };
+
+  Mutex lock;
+  utime_t start;
+  map<string, OpStats> ops;
+
+public:
+  RGWLoadGenStats() : lock("RGWLoadGenStats") {}
+
+  void begin(utime_t& now) { start = now; }
+  void add(const string& op, utime_t& lat, uint64_t bytes, bool failed);
+  void dump(Formatter *f, utime_t& now);
 };
 
 
@@ -153,6 +153,92 @@ public:
 
 static UsageLogger *usage_logger = NULL;
 
+static int append_ops_log(RGWRados *store, const string& oid, bufferlist& bl)
+{
+  rgw_obj obj(store->zone.log_pool, oid);
+
+  int ret = store->append_async(obj, bl.length(), bl);
+  if (ret == -ENOENT) {
+    ret = store->create_pool(store->zone.log_pool);
+    if (ret < 0)
+      return ret;
+    // retry
+    ret = store->append_async(obj, bl.length(), bl);
+  }
+  return ret;
+}
+
+/*
+ * ops log entries bound for rados, gathered per log object so that
+ * each object gets one append per flush rather than one per request
+ */
+class OpsLogBuffer {
+  CephContext *cct;
+  RGWRados *store;
+  map<string, bufferlist> pending;
+  uint64_t pending_bytes;
+  Mutex lock;
+  Mutex timer_lock;
+  SafeTimer timer;
+
+  class C_OpsLogTimeout : public Context {
+    OpsLogBuffer *buffer;
+  public:
+    C_OpsLogTimeout(OpsLogBuffer *_b) : buffer(_b) {}
+    void finish(int r) {
+      buffer->flush();
+      buffer->set_timer();
+    }
+  };
+
+  void set_timer() {
+    timer.add_event_after(cct->_conf->rgw_ops_log_flush_interval, new C_OpsLogTimeout(this));
+  }
+public:
+
+  OpsLogBuffer(CephContext *_cct, RGWRados *_store) : cct(_cct), store(_store), pending_bytes(0), lock("OpsLogBuffer"), timer_lock("OpsLogBuffer::timer_lock"), timer(cct, timer_lock) {
+    timer.init();
+    Mutex::Locker l(timer_lock);
+    set_timer();
+  }
+
+  ~OpsLogBuffer() {
+    Mutex::Locker l(timer_lock);
+    flush();
+    timer.cancel_all_events();
+    timer.shutdown();
+  }
+
+  void insert(const string& oid, bufferlist& bl) {
+    lock.Lock();
+    pending_bytes += bl.length();
+    pending[oid].claim_append(bl);
+    bool need_flush = (pending_bytes >= (uint64_t)cct->_conf->rgw_ops_log_flush_threshold);
+    lock.Unlock();
+    if (need_flush) {
+      Mutex::Locker l(timer_lock);
+      flush();
+    }
+  }
+
+  void flush() {
+    map<string, bufferlist> old_pending;
+    lock.Lock();
+    old_pending.swap(pending);
+    pending_bytes = 0;
+    lock.Unlock();
+
+    map<string, bufferlist>::iterator iter;
+    for (iter = old_pending.begin(); iter != old_pending.end(); ++iter) {
+      int ret = append_ops_log(store, iter->first, iter->second);
+      if (ret < 0)
+        ldout(cct, 0) << "ERROR: failed to log entries to " << iter->first << " ret=" << ret << dendl;
+    }
+  }
+};
+
+static OpsLogBuffer *ops_log_buffer = NULL;
+
 void rgw_log_usage_init(CephContext *cct, RGWRados *store)
 {
   usage_logger = new UsageLogger(cct, store);
@@ -164,6 +250,18 @@ void rgw_log_usage_finalize()
   usage_logger = NULL;
 }
 
+void rgw_log_ops_init(CephContext *cct, RGWRados *store)
+{
+  if (cct->_conf->rgw_ops_log_rados && cct->_conf->rgw_ops_log_flush_threshold > 0)
+    ops_log_buffer = new OpsLogBuffer(cct, store);
+}
+
+void rgw_log_ops_finalize()
+{
+  delete ops_log_buffer;
+  ops_log_buffer = NULL;
+}
+
 static void log_usage(struct req_state *s, const string& op_name)
 {
   if (!usage_logger)
@@ -342,22 +440,15 @@ int rgw_log_op(RGWRados *store, struct req_state *s, const string& op_name, OpsL
     string oid = render_log_object_name(s->cct->_conf->rgw_log_object_name, &bdt,
 				        s->bucket.bucket_id, entry.bucket);
 
-    rgw_obj obj(store->zone.log_pool, oid);
-
-    ret = store->append_async(obj, bl.length(), bl);
-    if (ret == -ENOENT) {
-      ret = store->create_pool(store->zone.log_pool);
-      if (ret < 0)
-        goto done;
-      // retry
-      ret = store->append_async(obj, bl.length(), bl);
-    }
+    if (ops_log_buffer)
+      ops_log_buffer->insert(oid, bl);
+    else
+      ret = append_ops_log(store, oid, bl);
   }
 
   if (olog) {
     olog->log(entry);
   }
-done:
   if (ret < 0)
     ldout(s->cct, 0) << "ERROR: failed to log entry" << dendl;
 
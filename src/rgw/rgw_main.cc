@@ -29,6 +29,7 @@
 #include "common/Throttle.h"
 #include "common/safe_io.h"
 #include "include/str_list.h"
+#include "include/stringify.h"
 #include "rgw_common.h"
 #include "rgw_rados.h"
 #include "rgw_acl.h"
@@ -52,6 +53,7 @@
 #include "rgw_log.h"
 #include "rgw_tools.h"
 #include "rgw_resolve.h"
+#include "rgw_http_client.h"
 #include "rgw_loadgen.h"
 #include "rgw_civetweb.h"
 
@@ -336,6 +338,9 @@ struct RGWLoadGenRequest : public RGWRequest {
 
 class RGWLoadGenProcess : public RGWProcess {
   RGWAccessKey access_key;
+  RGWLoadGenStats stats;
+
+  int gen_obj_size();
 public:
   RGWLoadGenProcess(CephContext *cct, RGWProcessEnv *pe, int num_threads, RGWFrontendConfig *_conf) :
     RGWProcess(cct, pe, num_threads, _conf) {}
@@ -352,6 +357,16 @@ void RGWLoadGenProcess::checkpoint()
   m_tp.drain(&req_wq);
 }
 
+int RGWLoadGenProcess::gen_obj_size()
+{
+  int min_size, max_size;
+  conf->get_val("obj_size", 4096, &min_size);
+  conf->get_val("obj_size_max", min_size, &max_size);
+  if (max_size <= min_size)
+    return min_size;
+  return min_size + rand() % (max_size - min_size + 1);
+}
+
 void RGWLoadGenProcess::run()
 {
   m_tp.start(); /* start thread pool */
@@ -365,10 +380,28 @@ void RGWLoadGenProcess::run()
   int num_buckets;
   conf->get_val("num_buckets", 1, &num_buckets);
 
+  /*
+   * with num_ops set, send that many requests picked at random by the
+   * weights below between writing and removing the objects, instead of
+   * reading each object once
+   */
+  int num_ops;
+  conf->get_val("num_ops", 0, &num_ops);
+
+  int get_weight, put_weight, list_weight, delete_weight;
+  conf->get_val("get_weight", 70, &get_weight);
+  conf->get_val("put_weight", 20, &put_weight);
+  conf->get_val("list_weight", 5, &list_weight);
+  conf->get_val("delete_weight", 5, &delete_weight);
+  int total_weight = get_weight + put_weight + list_weight + delete_weight;
+
   string buckets[num_buckets];
 
   atomic_t failed;
 
+  utime_t now = ceph_clock_now(NULL);
+  stats.begin(now);
+
   for (i = 0; i < num_buckets; i++) {
     buckets[i] = "/loadgen";
     string& bucket = buckets[i];
@@ -394,7 +427,7 @@ void RGWLoadGenProcess::run()
   }
 
   for (i = 0; i < num_objs; i++) {
-    gen_request("PUT", objs[i], 4096, &failed);
+    gen_request("PUT", objs[i], gen_obj_size(), &failed);
   }
 
   checkpoint();
@@ -404,8 +437,28 @@ void RGWLoadGenProcess::run()
     goto done;
   }
 
-  for (i = 0; i < num_objs; i++) {
-    gen_request("GET", objs[i], 4096, NULL);
+  if (num_ops <= 0 || total_weight <= 0) {
+    for (i = 0; i < num_objs; i++) {
+      gen_request("GET", objs[i], 0, NULL);
+    }
+  } else {
+    /* a deleted object is written again before it is read */
+    vector<bool> removed(num_objs, false);
+    for (i = 0; i < num_ops; i++) {
+      int n = rand() % num_objs;
+      int w = rand() % total_weight;
+      if (w < list_weight) {
+        gen_request("GET", buckets[n % num_buckets], 0, NULL);
+      } else if (w < list_weight + delete_weight && !removed[n]) {
+        gen_request("DELETE", objs[n], 0, NULL);
+        removed[n] = true;
+      } else if (w < list_weight + delete_weight + put_weight || removed[n]) {
+        gen_request("PUT", objs[n], gen_obj_size(), NULL);
+        removed[n] = false;
+      } else {
+        gen_request("GET", objs[n], 0, NULL);
+      }
+    }
   }
 
   checkpoint();
@@ -427,6 +480,13 @@ done:
 
   delete[] objs;
 
+  now = ceph_clock_now(NULL);
+  JSONFormatter f(true);
+  stats.dump(&f, now);
+  stringstream ss;
+  f.flush(ss);
+  dout(0) << "loadgen results: " << ss.str() << dendl;
+
   signal_shutdown();
 }
 
@@ -659,16 +719,25 @@ void RGWLoadGenProcess::handle_request(RGWRequest *r)
 
   RGWLoadGenIO client_io(&env);
 
+  utime_t start = ceph_clock_now(NULL);
   int ret = process_request(store, rest, req, &client_io, olog);
-  if (ret < 0) {
+  utime_t lat = ceph_clock_now(NULL) - start;
+
+  bool failed = (ret < 0 || client_io.get_status() >= 400);
+  if (failed) {
     /* we don't really care about return code */
-    dout(20) << "process_request() returned " << ret << dendl;
+    dout(20) << "process_request() returned " << ret << " status=" << client_io.get_status() << dendl;
 
     if (req->fail_flag) {
       req->fail_flag->inc();
     }
   }
 
+  /* "/bucket" or "/bucket/object" */
+  string type = req->method;
+  type.append(req->resource.find('/', 1) == string::npos ? " bucket" : " object");
+  stats.add(type, lat, client_io.get_bytes_sent() + client_io.get_bytes_received(), failed);
+
   delete req;
 }
 
@@ -864,7 +933,9 @@ public:
   RGWFCGXFrontend(RGWProcessEnv& pe, RGWFrontendConfig *_conf) : RGWProcessFrontend(pe, _conf) {}
 
   int init() {
-    pprocess = new RGWFCGXProcess(g_ceph_context, &env, g_conf->rgw_thread_pool_size, conf);
+    int num_threads;
+    conf->get_val("num_threads", g_conf->rgw_thread_pool_size, &num_threads);
+    pprocess = new RGWFCGXProcess(g_ceph_context, &env, num_threads, conf);
     return 0;
   }
 };
@@ -920,16 +991,36 @@ public:
   }
 
   int run() {
-    char thread_pool_buf[32];
-    snprintf(thread_pool_buf, sizeof(thread_pool_buf), "%d", (int)g_conf->rgw_thread_pool_size);
+    string num_threads_str;
+    conf->get_val("num_threads", stringify(g_conf->rgw_thread_pool_size), &num_threads_str);
     string port_str;
     conf->get_val("port", "80", &port_str);
-    const char *options[] = {"listening_ports", port_str.c_str(), "enable_keep_alive", "yes", "num_threads", thread_pool_buf, NULL};
+
+    vector<const char *> options;
+    options.push_back("listening_ports");
+    options.push_back(port_str.c_str());
+    options.push_back("enable_keep_alive");
+    options.push_back("yes");
+    options.push_back("num_threads");
+    options.push_back(num_threads_str.c_str());
+
+    /*
+     * civetweb serves each connection from one of its threads until the
+     * connection closes, so an idle keep-alive connection or a stalled
+     * client pins a thread; a socket timeout bounds how long they can
+     * hold it
+     */
+    string request_timeout_str;
+    if (conf->get_val("request_timeout_ms", "", &request_timeout_str)) {
+      options.push_back("request_timeout_ms");
+      options.push_back(request_timeout_str.c_str());
+    }
+    options.push_back(NULL);
 
     struct mg_callbacks cb;
     memset((void *)&cb, 0, sizeof(cb));
     cb.begin_request = civetweb_callback;
-    ctx = mg_start(&cb, &env, (const char **)&options);
+    ctx = mg_start(&cb, &env, &options[0]);
 
     if (!ctx) {
       return -EIO;
@@ -1002,6 +1093,7 @@ int main(int argc, const char **argv)
   rgw_rest_init(g_ceph_context);
   
   curl_global_init(CURL_GLOBAL_ALL);
+  rgw_http_client_init(g_ceph_context);
   
   FCGX_Init();
 
@@ -1023,8 +1115,10 @@ int main(int argc, const char **argv)
     return 1;
 
   rgw_user_init(store->meta_mgr);
+  rgw_user_cache_init(store);
   rgw_bucket_init(store->meta_mgr);
   rgw_log_usage_init(g_ceph_context, store);
+  rgw_log_ops_init(g_ceph_context, store);
 
   RGWREST rest;
 
@@ -1184,6 +1278,8 @@ int main(int argc, const char **argv)
   }
 
   rgw_log_usage_finalize();
+  rgw_log_ops_finalize();
+  rgw_user_cache_finalize(store);
 
   delete olog;
 
@@ -1193,6 +1289,7 @@ int main(int argc, const char **argv)
 
   rgw_tools_cleanup();
   rgw_shutdown_resolver();
+  rgw_http_client_cleanup();
   curl_global_cleanup();
 
   dout(1) << "final shutdown" << dendl;
@@ -8,6 +8,9 @@
 #include "common/armor.h"
 #include "common/mime.h"
 #include "common/utf8.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
 #include "common/ceph_json.h"
 
 #include "rgw_rados.h"
@@ -1382,9 +1385,14 @@ int RGWPutObjProcessor_Multipart::prepare(RGWRados *store, void *obj_ctx)
 
   manifest.set_prefix(upload_prefix);
 
+  int r = init_chunk_size();
+  if (r < 0) {
+    return r;
+  }
+
   manifest.set_multipart_part_rule(store->ctx()->_conf->rgw_obj_stripe_size, num);
 
-  int r = manifest_gen.create_begin(store->ctx(), &manifest, bucket, target_obj);
+  r = manifest_gen.create_begin(store->ctx(), &manifest, bucket, target_obj);
   if (r < 0) {
     return r;
   }
@@ -1481,9 +1489,73 @@ void RGWPutObj::pre_exec()
   rgw_bucket_object_pre_exec(s);
 }
 
+/*
+ * Computes the MD5 of an upload in its own thread, so that hashing one
+ * chunk overlaps with reading the next one from the client and writing
+ * it out.  The data is shared with the writes, not copied.
+ */
+class RGWPutObjHashThread : public Thread {
+  MD5 hash;
+  Mutex lock;
+  Cond cond;
+  list<bufferlist> queue;
+  uint64_t queued;
+  uint64_t max_queued;
+  bool done;
+
+  void *entry() {
+    lock.Lock();
+    while (true) {
+      while (queue.empty() && !done)
+        cond.Wait(lock);
+      if (queue.empty())
+        break;
+      bufferlist bl;
+      bl.swap(queue.front());
+      queue.pop_front();
+      lock.Unlock();
+
+      const list<bufferptr>& buffers = bl.buffers();
+      for (list<bufferptr>::const_iterator iter = buffers.begin(); iter != buffers.end(); ++iter) {
+        hash.Update((const unsigned char *)iter->c_str(), iter->length());
+      }
+
+      lock.Lock();
+      queued -= bl.length();
+      cond.Signal();
+    }
+    lock.Unlock();
+    return NULL;
+  }
+
+public:
+  RGWPutObjHashThread(uint64_t _max_queued) : lock("RGWPutObjHashThread::lock"),
+                                              queued(0), max_queued(_max_queued), done(false) {}
+
+  void add(bufferlist& bl) {
+    Mutex::Locker l(lock);
+    while (queued > max_queued)
+      cond.Wait(lock);
+    queue.push_back(bl);
+    queued += bl.length();
+    cond.Signal();
+  }
+
+  void finish(unsigned char *m) {
+    lock.Lock();
+    done = true;
+    cond.Signal();
+    lock.Unlock();
+    join();
+    hash.Final(m);
+  }
+};
+
 void RGWPutObj::execute()
 {
   RGWPutObjProcessor *processor = NULL;
+  RGWPutObjHashThread *hash_thread = NULL;
+  uint64_t hash_thread_min_size;
   char supplied_md5_bin[CEPH_CRYPTO_MD5_DIGESTSIZE + 1];
   char supplied_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
   char calc_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
@@ -1539,6 +1611,13 @@ void RGWPutObj::execute()
   if (ret < 0)
     goto done;
 
+  hash_thread_min_size = s->cct->_conf->rgw_put_obj_hash_thread_min_size;
+  if (hash_thread_min_size &&
+      (chunked_upload || s->content_length >= hash_thread_min_size)) {
+    hash_thread = new RGWPutObjHashThread(s->cct->_conf->rgw_put_obj_min_window_size);
+    hash_thread->create();
+  }
+
   do {
     bufferlist data;
     len = get_data(data);
@@ -1550,13 +1629,20 @@ void RGWPutObj::execute()
       break;
 
     void *handle;
-    const unsigned char *data_ptr = (const unsigned char *)data.c_str();
+    const unsigned char *data_ptr = NULL;
+
+    /* handle_data() takes the buffers out of data */
+    if (hash_thread)
+      hash_thread->add(data);
+    else
+      data_ptr = (const unsigned char *)data.c_str();
 
     ret = processor->handle_data(data, ofs, &handle);
     if (ret < 0)
       goto done;
 
-    hash.Update(data_ptr, len);
+    if (!hash_thread)
+      hash.Update(data_ptr, len);
 
     ret = processor->throttle_data(handle);
     if (ret < 0)
@@ -1578,7 +1664,13 @@ void RGWPutObj::execute()
     goto done;
   }
 
-  hash.Final(m);
+  if (hash_thread) {
+    hash_thread->finish(m);
+    delete hash_thread;
+    hash_thread = NULL;
+  } else {
+    hash.Final(m);
+  }
 
   buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
 
@@ -1613,6 +1705,10 @@ void RGWPutObj::execute()
 
   ret = processor->complete(etag, &mtime, 0, attrs);
 done:
+  if (hash_thread) {
+    hash_thread->finish(m);
+    delete hash_thread;
+  }
   dispose_processor(processor);
   perfcounter->tinc(l_rgw_put_lat,
                    (ceph_clock_now(s->cct) - s->time));
@@ -2570,7 +2666,7 @@ void RGWCompleteMultipart::execute()
 
   int total_parts = 0;
   int handled_parts = 0;
-  int max_parts = 1000;
+  int max_parts = s->cct->_conf->rgw_multipart_complete_batch_size;
   int marker = 0;
   bool truncated;
 
@@ -27,6 +27,7 @@
 #include "rgw_tools.h"
 
 #include "common/Clock.h"
+#include "include/ceph_hash.h"
 
 #include "include/rados/librados.hpp"
 using namespace librados;
@@ -53,6 +54,74 @@ static string notify_oid_prefix = "notify";
 static string *notify_oids = NULL;
 static string shadow_ns = "shadow";
 static string dir_oid_prefix = ".dir.";
+
+/*
+ * A bucket index is either a single object, .dir.<marker>, or, when the
+ * bucket was created with num_shards > 0, objects .dir.<marker>.<shard>
+ * with every index entry in the shard its name hashes to.
+ */
+static void get_bucket_index_oid(const string& marker, uint32_t num_shards, uint32_t shard, string& oid)
+{
+  oid = dir_oid_prefix;
+  oid.append(marker);
+  if (num_shards) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), ".%u", shard);
+    oid.append(buf);
+  }
+}
+
+static uint32_t get_bucket_index_shard(const string& obj_key, uint32_t num_shards)
+{
+  if (!num_shards)
+    return 0;
+  return ceph_str_hash_linux(obj_key.c_str(), obj_key.size()) % num_shards;
+}
+
+/*
+ * Bucket index log markers of a sharded bucket combine the markers of
+ * all shards as "<shard>#<marker>,<shard>#<marker>,...".  An unsharded
+ * bucket uses the plain marker of its single index object.
+ */
+static void parse_bi_log_marker(uint32_t num_shards, const string& marker, map<int, string>& markers)
+{
+  markers.clear();
+  if (!num_shards) {
+    markers[0] = marker;
+    return;
+  }
+  size_t pos = 0;
+  while (pos < marker.size()) {
+    size_t end = marker.find(',', pos);
+    if (end == string::npos)
+      end = marker.size();
+    string s = marker.substr(pos, end - pos);
+    size_t sep = s.find('#');
+    if (sep != string::npos) {
+      int shard = atoi(s.substr(0, sep).c_str());
+      markers[shard] = s.substr(sep + 1);
+    }
+    pos = end + 1;
+  }
+}
+
+static string get_bi_log_marker(uint32_t num_shards, map<int, string>& markers)
+{
+  if (!num_shards)
+    return markers[0];
+  string marker;
+  for (map<int, string>::iterator iter = markers.begin(); iter != markers.end(); ++iter) {
+    if (iter->second.empty())
+      continue;
+    if (!marker.empty())
+      marker.append(",");
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d#", iter->first);
+    marker.append(buf);
+    marker.append(iter->second);
+  }
+  return marker;
+}
 static string default_storage_pool = ".rgw.buckets";
 static string avail_pools = ".pools.avail";
 
@@ -1141,10 +1210,10 @@ int RGWPutObjProcessor_Atomic::handle_data(bufferlist& bl, off_t ofs, void **pha
   }
 
   pending_data_bl.claim_append(bl);
-  if (pending_data_bl.length() < RGW_MAX_CHUNK_SIZE)
+  if (pending_data_bl.length() < max_chunk_size)
     return 0;
 
-  pending_data_bl.splice(0, RGW_MAX_CHUNK_SIZE, &bl);
+  pending_data_bl.splice(0, max_chunk_size, &bl);
 
   if (!data_ofs && !immutable_head()) {
     first_chunk.claim(bl);
@@ -1167,9 +1236,14 @@ int RGWPutObjProcessor_Atomic::prepare(RGWRados *store, void *obj_ctx)
 
   head_obj.init(bucket, obj_str);
 
-  manifest.set_trivial_rule(RGW_MAX_CHUNK_SIZE, store->ctx()->_conf->rgw_obj_stripe_size);
+  int r = init_chunk_size();
+  if (r < 0) {
+    return r;
+  }
+
+  manifest.set_trivial_rule(max_chunk_size, store->ctx()->_conf->rgw_obj_stripe_size);
 
-  int r = manifest_gen.create_begin(store->ctx(), &manifest, bucket, head_obj);
+  r = manifest_gen.create_begin(store->ctx(), &manifest, bucket, head_obj);
   if (r < 0) {
     return r;
   }
@@ -1177,6 +1251,20 @@ int RGWPutObjProcessor_Atomic::prepare(RGWRados *store, void *obj_ctx)
   return 0;
 }
 
+int RGWPutObjProcessor_Atomic::init_chunk_size()
+{
+  int r = store->get_max_chunk_size(bucket, &max_chunk_size);
+  if (r < 0) {
+    return r;
+  }
+
+  uint64_t window_chunks = store->ctx()->_conf->rgw_put_obj_min_window_size / max_chunk_size;
+  if (window_chunks > max_chunks)
+    max_chunks = window_chunks;
+
+  return 0;
+}
+
 int RGWPutObjProcessor_Atomic::prepare_next_part(off_t ofs) {
 
   int ret = manifest_gen.create_next(ofs);
@@ -1315,6 +1403,15 @@ void RGWRados::finalize()
     delete conn;
   }
   RGWQuotaHandler::free_handler(quota_handler);
+
+  if (index_completion_throttle) {
+    /* wait for the bucket index completions still in flight */
+    int64_t max = index_completion_throttle->get_max();
+    index_completion_throttle->get(max);
+    index_completion_throttle->put(max);
+    delete index_completion_throttle;
+    index_completion_throttle = NULL;
+  }
 }
 
 /** 
@@ -1340,6 +1437,9 @@ int RGWRados::init_rados()
   meta_mgr = new RGWMetadataManager(cct, this);
   data_log = new RGWDataChangesLog(cct, this);
 
+  index_completion_throttle = new Throttle(cct, "rgw_index_completions",
+                                           cct->_conf->rgw_bucket_index_max_aio);
+
   return ret;
 }
 
@@ -2184,13 +2284,32 @@ int RGWRados::list_objects(rgw_bucket& bucket, int max, string& prefix, string&
   prefix_obj.set_obj(prefix);
   string cur_prefix = prefix_obj.object;
 
+  /*
+   * the index collapses common prefixes itself, searching the raw names
+   * for the delimiter past the raw prefix.  With no raw prefix, that
+   * would also match the '_' that starts escaped and namespaced names,
+   * so a delimiter starting with one is left to us.
+   */
+  string index_delim;
+  if (!delim.empty() && (!cur_prefix.empty() || delim[0] != '_'))
+    index_delim = delim;
+
   do {
     std::map<string, RGWObjEnt> ent_map;
+    set<string> index_prefixes;
     int r = cls_bucket_list(bucket, cur_marker, cur_prefix, max - count, ent_map,
-                            &truncated, &cur_marker);
+                            &truncated, &cur_marker, NULL, index_delim, &index_prefixes);
     if (r < 0)
       return r;
 
+    set<string>::iterator piter;
+    for (piter = index_prefixes.begin(); piter != index_prefixes.end(); ++piter) {
+      string obj = *piter;
+      if (!rgw_obj::translate_raw_obj_to_obj_in_ns(obj, ns) && enforce_ns)
+        continue;
+      common_prefixes[obj] = true;
+    }
+
     std::map<string, RGWObjEnt>::iterator eiter;
     for (eiter = ent_map.begin(); eiter != ent_map.end(); ++eiter) {
       string obj = eiter->first;
@@ -2266,7 +2385,7 @@ int RGWRados::create_pool(rgw_bucket& bucket)
   return 0;
 }
 
-int RGWRados::init_bucket_index(rgw_bucket& bucket)
+int RGWRados::init_bucket_index(rgw_bucket& bucket, uint32_t num_shards)
 {
   librados::IoCtx index_ctx; // context for new bucket
 
@@ -2274,14 +2393,17 @@ int RGWRados::init_bucket_index(rgw_bucket& bucket)
   if (r < 0)
     return r;
 
-  string dir_oid =  dir_oid_prefix;
-  dir_oid.append(bucket.marker);
+  uint32_t n = (num_shards ? num_shards : 1);
+  for (uint32_t i = 0; i < n; i++) {
+    string dir_oid;
+    get_bucket_index_oid(bucket.marker, num_shards, i, dir_oid);
 
-  librados::ObjectWriteOperation op;
-  op.create(true);
-  r = cls_rgw_init_index(index_ctx, op, dir_oid);
-  if (r < 0 && r != -EEXIST)
-    return r;
+    librados::ObjectWriteOperation op;
+    op.create(true);
+    r = cls_rgw_init_index(index_ctx, op, dir_oid);
+    if (r < 0 && r != -EEXIST)
+      return r;
+  }
 
   return 0;
 }
@@ -2331,10 +2453,8 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
       bucket.bucket_id = pmaster_bucket->bucket_id;
     }
 
-    string dir_oid =  dir_oid_prefix;
-    dir_oid.append(bucket.marker);
-
-    r = init_bucket_index(bucket);
+    uint32_t num_shards = cct->_conf->rgw_bucket_index_max_shards;
+    r = init_bucket_index(bucket, num_shards);
     if (r < 0)
       return r;
 
@@ -2350,6 +2470,7 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
     info.owner = owner.user_id;
     info.region = region_name;
     info.placement_rule = selected_placement_rule;
+    info.num_shards = num_shards;
     if (!creation_time)
       time(&info.creation_time);
     else
@@ -2381,7 +2502,12 @@ int RGWRados::create_bucket(RGWUserInfo& owner, rgw_bucket& bucket,
         if (r < 0)
           return r;
 
-        index_ctx.remove(dir_oid);
+        uint32_t n = (num_shards ? num_shards : 1);
+        for (uint32_t j = 0; j < n; j++) {
+          string dir_oid;
+          get_bucket_index_oid(bucket.marker, num_shards, j, dir_oid);
+          index_ctx.remove(dir_oid);
+        }
       }
       /* ret == -ENOENT here */
     }
@@ -2870,6 +2996,29 @@ int RGWRados::put_obj_data(void *ctx, rgw_obj& obj,
   return aio_wait(handle);
 }
 
+int RGWRados::get_max_chunk_size(rgw_bucket& bucket, uint64_t *max_chunk_size)
+{
+  librados::IoCtx io_ctx;
+  int r = open_bucket_data_ctx(bucket, io_ctx);
+  if (r < 0)
+    return r;
+
+  uint64_t chunk_size = RGW_MAX_CHUNK_SIZE;
+  if (io_ctx.pool_requires_alignment()) {
+    /* e.g. erasure coded pools, which only take appends of whole stripes */
+    uint64_t align = io_ctx.pool_required_alignment();
+    if (align) {
+      chunk_size -= chunk_size % align;
+      if (!chunk_size)
+        chunk_size = align;
+    }
+  }
+
+  ldout(cct, 20) << "max_chunk_size=" << chunk_size << " for bucket " << bucket << dendl;
+  *max_chunk_size = chunk_size;
+  return 0;
+}
+
 int RGWRados::aio_put_obj_data(void *ctx, rgw_obj& obj, bufferlist& bl,
 			       off_t ofs, bool exclusive,
                                void **handle)
@@ -3009,6 +3158,20 @@ public:
  * err: stores any errors resulting from the get of the original object
  * Returns: 0 on success, -ERR# otherwise.
  */
+typedef list<pair<rgw_obj, librados::AioCompletion *> > pending_ref_list;
+
+static int complete_ref_get(pending_ref_list& pending, vector<rgw_obj>& ref_objs)
+{
+  pair<rgw_obj, librados::AioCompletion *>& p = pending.front();
+  p.second->wait_for_complete();
+  int r = p.second->get_return_value();
+  p.second->release();
+  if (r >= 0)
+    ref_objs.push_back(p.first);
+  pending.pop_front();
+  return r;
+}
+
 int RGWRados::copy_obj(void *ctx,
                const string& user_id,
                const string& client_id,
@@ -3244,6 +3407,13 @@ set_err_state:
 
   if (!copy_itself) {
     manifest = astate->manifest;
+
+    /* take the tail references in parallel, large objects have many */
+    int max_aio = cct->_conf->rgw_copy_obj_max_concurrent_io;
+    if (max_aio < 1)
+      max_aio = 1;
+    pending_ref_list pending;
+    ret = 0;
     for (; miter != astate->manifest.obj_end(); ++miter) {
       ObjectWriteOperation op;
       cls_refcount_get(op, tag, true);
@@ -3251,12 +3421,28 @@ set_err_state:
       get_obj_bucket_and_oid_key(loc, bucket, oid, key);
       io_ctx.locator_set_key(key);
 
-      ret = io_ctx.operate(oid, &op);
-      if (ret < 0)
-        goto done_ret;
+      librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      ret = io_ctx.aio_operate(oid, c, &op);
+      if (ret < 0) {
+        c->release();
+        break;
+      }
+      pending.push_back(make_pair(loc, c));
 
-      ref_objs.push_back(loc);
+      if ((int)pending.size() >= max_aio) {
+        ret = complete_ref_get(pending, ref_objs);
+        if (ret < 0)
+          break;
+      }
+    }
+    /* only roll back the references that were taken */
+    while (!pending.empty()) {
+      int r = complete_ref_get(pending, ref_objs);
+      if (r < 0 && ret >= 0)
+        ret = r;
     }
+    if (ret < 0)
+      goto done_ret;
 
     pmanifest = &manifest;
   } else {
@@ -3280,6 +3466,8 @@ set_err_state:
   ep.owner = dest_bucket_info.owner;
 
   ret = put_obj_meta(ctx, dest_obj, end + 1, src_attrs, category, PUT_OBJ_CREATE, ep);
+  if (ret < 0)
+    goto done_ret;
 
   if (mtime)
     obj_stat(ctx, dest_obj, NULL, mtime, NULL, NULL, NULL, NULL);
@@ -3400,8 +3588,8 @@ done_err:
 int RGWRados::delete_bucket(rgw_bucket& bucket, RGWObjVersionTracker& objv_tracker)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  vector<string> oids;
+  int r = open_bucket_index(bucket, index_ctx, oids);
   if (r < 0)
     return r;
 
@@ -3529,7 +3717,7 @@ int RGWRados::complete_atomic_overwrite(RGWRadosCtx *rctx, RGWObjState *state, r
   return ret;
 }
 
-int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx, string& bucket_oid)
+int RGWRados::open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx& index_ctx, uint32_t *num_shards)
 {
   if (bucket_is_system(bucket))
     return -EINVAL;
@@ -3543,12 +3731,71 @@ int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx,
     return -EIO;
   }
 
-  bucket_oid = dir_oid_prefix;
-  bucket_oid.append(bucket.marker);
+  RGWBucketInfo info;
+  string entry;
+  get_bucket_instance_entry(bucket, entry);
+  r = get_bucket_instance_info(NULL, entry, info, NULL, NULL);
+  if (r == -ENOENT) {
+    /* bucket predates bucket instances, its index was never sharded */
+    *num_shards = 0;
+    return 0;
+  }
+  if (r < 0)
+    return r;
+
+  *num_shards = info.num_shards;
+
+  return 0;
+}
+
+int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx, vector<string>& bucket_oids,
+                                uint32_t *pnum_shards)
+{
+  uint32_t num_shards;
+  int r = open_bucket_index_base(bucket, index_ctx, &num_shards);
+  if (r < 0)
+    return r;
+
+  bucket_oids.clear();
+  uint32_t n = (num_shards ? num_shards : 1);
+  for (uint32_t i = 0; i < n; i++) {
+    string oid;
+    get_bucket_index_oid(bucket.marker, num_shards, i, oid);
+    bucket_oids.push_back(oid);
+  }
+
+  if (pnum_shards)
+    *pnum_shards = num_shards;
+
+  return 0;
+}
+
+int RGWRados::open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx& index_ctx, const string& obj_key,
+                                      string& bucket_oid)
+{
+  uint32_t num_shards;
+  int r = open_bucket_index_base(bucket, index_ctx, &num_shards);
+  if (r < 0)
+    return r;
+
+  get_bucket_index_oid(bucket.marker, num_shards, get_bucket_index_shard(obj_key, num_shards), bucket_oid);
 
   return 0;
 }
 
+static void add_dir_header_stats(rgw_bucket_dir_header& total, rgw_bucket_dir_header& header)
+{
+  map<uint8_t, struct rgw_bucket_category_stats>::iterator iter = header.stats.begin();
+  for (; iter != header.stats.end(); ++iter) {
+    struct rgw_bucket_category_stats& s = total.stats[iter->first];
+    s.total_size += iter->second.total_size;
+    s.total_size_rounded += iter->second.total_size_rounded;
+    s.num_entries += iter->second.num_entries;
+  }
+  total.ver += header.ver;
+  total.master_ver += header.master_ver;
+}
+
 static void translate_raw_stats(rgw_bucket_dir_header& header, map<RGWObjCategory, RGWStorageStats>& stats)
 {
   map<uint8_t, struct rgw_bucket_category_stats>::iterator iter = header.stats.begin();
@@ -3568,18 +3815,26 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 				 map<RGWObjCategory, RGWStorageStats> *calculated_stats)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  vector<string> oids;
 
-  int ret = open_bucket_index(bucket, index_ctx, oid);
+  int ret = open_bucket_index(bucket, index_ctx, oids);
   if (ret < 0)
     return ret;
 
   rgw_bucket_dir_header existing_header;
   rgw_bucket_dir_header calculated_header;
 
-  ret = cls_rgw_bucket_check_index_op(index_ctx, oid, &existing_header, &calculated_header);
-  if (ret < 0)
-    return ret;
+  for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    rgw_bucket_dir_header existing;
+    rgw_bucket_dir_header calculated;
+
+    ret = cls_rgw_bucket_check_index_op(index_ctx, *iter, &existing, &calculated);
+    if (ret < 0)
+      return ret;
+
+    add_dir_header_stats(existing_header, existing);
+    add_dir_header_stats(calculated_header, calculated);
+  }
 
   translate_raw_stats(existing_header, *existing_stats);
   translate_raw_stats(calculated_header, *calculated_stats);
@@ -3590,13 +3845,19 @@ int RGWRados::bucket_check_index(rgw_bucket& bucket,
 int RGWRados::bucket_rebuild_index(rgw_bucket& bucket)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  vector<string> oids;
 
-  int ret = open_bucket_index(bucket, index_ctx, oid);
+  int ret = open_bucket_index(bucket, index_ctx, oids);
   if (ret < 0)
     return ret;
 
-  return cls_rgw_bucket_rebuild_index_op(index_ctx, oid);
+  for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    ret = cls_rgw_bucket_rebuild_index_op(index_ctx, *iter);
+    if (ret < 0)
+      return ret;
+  }
+
+  return 0;
 }
 
 
@@ -4597,14 +4858,16 @@ struct get_obj_data : public RefCountedObject {
   RGWGetDataCB *client_cb;
   atomic_t cancelled;
   atomic_t err_code;
+  /* bytes read or being read and not yet handed to client_cb */
   Throttle throttle;
   list<bufferlist> read_list;
+  uint64_t read_list_len; /* throttle bytes held by read_list */
 
   get_obj_data(CephContext *_cct)
     : cct(_cct),
       rados(NULL), ctx(NULL),
       total_read(0), lock("get_obj_data"), data_lock("get_obj_data::data_lock"),
-      client_cb(NULL),
+      client_cb(NULL), read_list_len(0),
       throttle(cct, "get_obj_data", cct->_conf->rgw_get_obj_window_size, false) {}
   virtual ~get_obj_data() { } 
   void set_cancelled(int r) {
@@ -4652,6 +4915,7 @@ struct get_obj_data : public RefCountedObject {
     Mutex::Locker l(lock);
 
     get_obj_io& io = io_map[ofs];
+    io.len = len;
     *pbl = &io.bl;
 
     struct get_obj_aio_data aio;
@@ -4701,7 +4965,7 @@ struct get_obj_data : public RefCountedObject {
     }
   }
 
-  int get_complete_ios(off_t ofs, list<bufferlist>& bl_list) {
+  int get_complete_ios(off_t ofs, list<bufferlist>& bl_list, uint64_t *bl_len) {
     Mutex::Locker l(lock);
 
     map<off_t, get_obj_io>::iterator liter = io_map.begin();
@@ -4740,6 +5004,7 @@ struct get_obj_data : public RefCountedObject {
 
       map<off_t, get_obj_io>::iterator old_liter = liter++;
       bl_list.push_back(old_liter->second.bl);
+      *bl_len += old_liter->second.len;
       io_map.erase(old_liter);
     }
 
@@ -4772,22 +5037,23 @@ void RGWRados::get_obj_aio_completion_cb(completion_t c, void *arg)
 
   list<bufferlist> bl_list;
   list<bufferlist>::iterator iter;
+  uint64_t bl_len = 0;
   int r;
 
   ldout(cct, 20) << "get_obj_aio_completion_cb: io completion ofs=" << ofs << " len=" << len << dendl;
-  d->throttle.put(len);
 
   if (d->is_cancelled())
     goto done;
 
   d->data_lock.Lock();
 
-  r = d->get_complete_ios(ofs, bl_list);
+  r = d->get_complete_ios(ofs, bl_list, &bl_len);
   if (r < 0) {
     goto done_unlock;
   }
 
   d->read_list.splice(d->read_list.end(), bl_list);
+  d->read_list_len += bl_len;
 
 done_unlock:
   d->data_lock.Unlock();
@@ -4801,6 +5067,8 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
   d->data_lock.Lock();
   list<bufferlist> l;
   l.swap(d->read_list);
+  uint64_t len = d->read_list_len;
+  d->read_list_len = 0;
   d->get();
   d->read_list.clear();
 
@@ -4818,6 +5086,9 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
     }
   }
 
+  /* only now that the client took the data does it leave the window */
+  d->throttle.put(len);
+
   d->data_lock.Lock();
   d->put();
   if (r < 0) {
@@ -4877,7 +5148,23 @@ int RGWRados::get_obj_iterate_cb(void *ctx, RGWObjState *astate,
 
   get_obj_bucket_and_oid_key(obj, bucket, oid, key);
 
-  d->throttle.get(len);
+  /*
+   * the window is full of reads in flight and data waiting for the
+   * client; hand completed reads to the client, in order, to make room
+   */
+  while (!d->throttle.get_or_fail(len)) {
+    bool done = false;
+    r = d->wait_next_io(&done);
+    if (r < 0)
+      return r;
+    r = flush_read_list(d);
+    if (r < 0)
+      return r;
+    if (done) {
+      d->throttle.get(len);
+      break;
+    }
+  }
   if (d->is_cancelled()) {
     return d->get_err_code();
   }
@@ -5697,20 +5984,53 @@ int RGWRados::list_bi_log_entries(rgw_bucket& bucket, string& marker, uint32_t m
   result.clear();
 
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  vector<string> oids;
+  uint32_t num_shards;
+  int r = open_bucket_index(bucket, index_ctx, oids, &num_shards);
   if (r < 0)
     return r;
 
-  std::list<rgw_bi_log_entry> entries;
-  int ret = cls_rgw_bi_log_list(index_ctx, oid, marker, max - result.size(), entries, truncated);
-  if (ret < 0)
-    return ret;
+  map<int, string> markers;
+  parse_bi_log_marker(num_shards, marker, markers);
+
+  size_t n = oids.size();
+  vector<std::list<rgw_bi_log_entry> > entries(n);
+  vector<std::list<rgw_bi_log_entry>::iterator> iters(n);
+  bool any_truncated = false;
+  for (size_t i = 0; i < n; i++) {
+    bool shard_truncated = false;
+    int ret = cls_rgw_bi_log_list(index_ctx, oids[i], markers[i], max, entries[i], &shard_truncated);
+    if (ret < 0)
+      return ret;
+    iters[i] = entries[i].begin();
+    any_truncated = any_truncated || shard_truncated;
+  }
 
-  std::list<rgw_bi_log_entry>::iterator iter;
-  for (iter = entries.begin(); iter != entries.end(); ++iter) {
-    result.push_back(*iter);
+  /* merge the shards by time; each entry's id is the marker to resume after it */
+  while (result.size() < max) {
+    int pick = -1;
+    for (size_t i = 0; i < n; i++) {
+      if (iters[i] == entries[i].end())
+        continue;
+      if (pick < 0 || iters[i]->timestamp < iters[pick]->timestamp)
+        pick = i;
+    }
+    if (pick < 0)
+      break;
+
+    rgw_bi_log_entry& entry = *iters[pick];
+    markers[pick] = entry.id;
+    entry.id = get_bi_log_marker(num_shards, markers);
+    result.push_back(entry);
+    ++iters[pick];
+  }
+
+  bool more = any_truncated;
+  for (size_t i = 0; i < n && !more; i++) {
+    more = (iters[i] != entries[i].end());
   }
+  if (truncated)
+    *truncated = more;
 
   return 0;
 }
@@ -5718,14 +6038,26 @@ int RGWRados::list_bi_log_entries(rgw_bucket& bucket, string& marker, uint32_t m
 int RGWRados::trim_bi_log_entries(rgw_bucket& bucket, string& start_marker, string& end_marker)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  vector<string> oids;
+  uint32_t num_shards;
+  int r = open_bucket_index(bucket, index_ctx, oids, &num_shards);
   if (r < 0)
     return r;
 
-  int ret = cls_rgw_bi_log_trim(index_ctx, oid, start_marker, end_marker);
-  if (ret < 0)
-    return ret;
+  map<int, string> start_markers;
+  map<int, string> end_markers;
+  parse_bi_log_marker(num_shards, start_marker, start_markers);
+  parse_bi_log_marker(num_shards, end_marker, end_markers);
+
+  for (size_t i = 0; i < oids.size(); i++) {
+    map<int, string>::iterator end_iter = end_markers.find(i);
+    if (num_shards && !end_marker.empty() && end_iter == end_markers.end())
+      continue; /* nothing of this shard was consumed */
+
+    int ret = cls_rgw_bi_log_trim(index_ctx, oids[i], start_markers[i], end_markers[i]);
+    if (ret < 0)
+      return ret;
+  }
 
   return 0;
 }
@@ -5772,7 +6104,7 @@ int RGWRados::cls_obj_prepare_op(rgw_bucket& bucket, RGWModifyOp op, string& tag
   librados::IoCtx index_ctx;
   string oid;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index_shard(bucket, index_ctx, name, oid);
   if (r < 0)
     return r;
 
@@ -5782,6 +6114,38 @@ int RGWRados::cls_obj_prepare_op(rgw_bucket& bucket, RGWModifyOp op, string& tag
   return r;
 }
 
+/*
+ * A bucket index completion is not waited for.  If it is lost the entry
+ * stays pending in the index, and the next listing that sees it checks
+ * the object and repairs the entry (see check_disk_state()).
+ */
+class RGWIndexCompletion {
+  CephContext *cct;
+  Throttle *throttle;
+  string oid;
+  utime_t start;
+
+public:
+  RGWIndexCompletion(CephContext *_cct, Throttle *_throttle, const string& _oid)
+    : cct(_cct), throttle(_throttle), oid(_oid), start(ceph_clock_now(_cct)) {}
+
+  static void complete_cb(librados::completion_t c, void *arg) {
+    RGWIndexCompletion *ic = static_cast<RGWIndexCompletion *>(arg);
+    int r = rados_aio_get_return_value(c);
+    if (r < 0) {
+      ldout(ic->cct, 0) << "WARNING: bucket index completion on " << ic->oid << " returned r=" << r << dendl;
+    }
+    if (perfcounter) {
+      perfcounter->inc(l_rgw_index_complete);
+      if (r < 0)
+        perfcounter->inc(l_rgw_index_complete_failed);
+      perfcounter->tinc(l_rgw_index_complete_lat, ceph_clock_now(ic->cct) - ic->start);
+    }
+    ic->throttle->put(1);
+    delete ic;
+  }
+};
+
 int RGWRados::cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& tag,
                                   int64_t pool, uint64_t epoch,
                                   RGWObjEnt& ent, RGWObjCategory category,
@@ -5790,10 +6154,32 @@ int RGWRados::cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& ta
   librados::IoCtx index_ctx;
   string oid;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index_shard(bucket, index_ctx, ent.name, oid);
   if (r < 0)
     return r;
 
+  /* objects to drop that live in other shards are removed separately */
+  list<string> shard_remove_objs;
+  list<string> other_remove_objs;
+  if (remove_objs) {
+    for (list<string>::iterator iter = remove_objs->begin(); iter != remove_objs->end(); ++iter) {
+      string remove_oid;
+      r = open_bucket_index_shard(bucket, index_ctx, *iter, remove_oid);
+      if (r < 0)
+        return r;
+      if (remove_oid == oid)
+        shard_remove_objs.push_back(*iter);
+      else
+        other_remove_objs.push_back(*iter);
+    }
+    if (!other_remove_objs.empty()) {
+      r = remove_objs_from_index(bucket, other_remove_objs);
+      if (r < 0)
+        return r;
+    }
+    remove_objs = &shard_remove_objs;
+  }
+
   ObjectWriteOperation o;
   rgw_bucket_dir_entry_meta dir_meta;
   dir_meta.size = ent.size;
@@ -5809,9 +6195,15 @@ int RGWRados::cls_obj_complete_op(rgw_bucket& bucket, RGWModifyOp op, string& ta
   ver.epoch = epoch;
   cls_rgw_bucket_complete_op(o, op, tag, ver, ent.name, dir_meta, remove_objs, zone_public_config.log_data);
 
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  index_completion_throttle->get(1);
+  RGWIndexCompletion *ic = new RGWIndexCompletion(cct, index_completion_throttle, oid);
+  AioCompletion *c = librados::Rados::aio_create_completion(ic, NULL, RGWIndexCompletion::complete_cb);
   r = index_ctx.aio_operate(oid, c, &o);
   c->release();
+  if (r < 0) {
+    index_completion_throttle->put(1);
+    delete ic;
+  }
   return r;
 }
 
@@ -5842,43 +6234,103 @@ int RGWRados::cls_obj_complete_cancel(rgw_bucket& bucket, string& tag, string& n
 int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout)
 {
   librados::IoCtx index_ctx;
-  string oid;
+  vector<string> oids;
 
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  int r = open_bucket_index(bucket, index_ctx, oids);
   if (r < 0)
     return r;
 
-  ObjectWriteOperation o;
-  cls_rgw_bucket_set_tag_timeout(o, timeout);
+  for (vector<string>::iterator iter = oids.begin(); iter != oids.end(); ++iter) {
+    ObjectWriteOperation o;
+    cls_rgw_bucket_set_tag_timeout(o, timeout);
 
-  r = index_ctx.operate(oid, &o);
+    r = index_ctx.operate(*iter, &o);
+    if (r < 0)
+      return r;
+  }
 
-  return r;
+  return 0;
 }
 
 int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
 		              uint32_t num, map<string, RGWObjEnt>& m,
 			      bool *is_truncated, string *last_entry,
-			      bool (*force_check_filter)(const string&  name))
+			      bool (*force_check_filter)(const string&  name),
+			      const string& delim, set<string> *common_prefixes)
 {
   ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start << " num " << num << dendl;
 
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  vector<string> oids;
+  int r = open_bucket_index(bucket, index_ctx, oids);
   if (r < 0)
     return r;
 
-  struct rgw_bucket_dir dir;
-  r = cls_rgw_list_op(index_ctx, oid, start, prefix, num, &dir, is_truncated);
+  /* every shard is asked for num entries, and the smallest names win */
+  vector<rgw_cls_list_ret> results;
+  r = cls_rgw_list_op_multi(index_ctx, oids, start, prefix, (common_prefixes ? delim : string()),
+                            num, results);
   if (r < 0)
     return r;
 
-  map<string, struct rgw_bucket_dir_entry>::iterator miter;
-  bufferlist updates;
-  for (miter = dir.m.begin(); miter != dir.m.end(); ++miter) {
+  /*
+   * common prefixes are merged along with the entries, as placeholders
+   * under their own name; a name with the delimiter is never an entry
+   * of a shard that collapsed it
+   */
+  size_t n = oids.size();
+  set<string> shard_prefixes;
+  vector<map<string, struct rgw_bucket_dir_entry>::iterator> iters(n);
+  for (size_t i = 0; i < n; i++) {
+    set<string>::iterator piter;
+    for (piter = results[i].common_prefixes.begin(); piter != results[i].common_prefixes.end(); ++piter) {
+      results[i].dir.m[*piter];
+      shard_prefixes.insert(*piter);
+    }
+    iters[i] = results[i].dir.m.begin();
+  }
+
+  vector<bufferlist> updates(n);
+  uint32_t count = 0;
+  while (count < num) {
+    /*
+     * a truncated shard that ran out may still hold names below those
+     * left in the other shards, so the merge cannot go past it
+     */
+    int pick = -1;
+    bool blocked = false;
+    for (size_t i = 0; i < n; i++) {
+      if (iters[i] == results[i].dir.m.end()) {
+        if (results[i].is_truncated) {
+          blocked = true;
+          break;
+        }
+        continue;
+      }
+      if (pick < 0 || iters[i]->first < iters[pick]->first)
+        pick = i;
+    }
+    if (blocked || pick < 0)
+      break;
+
+    if (shard_prefixes.count(iters[pick]->first)) {
+      const string& cp = iters[pick]->first;
+      if (!common_prefixes->count(cp)) {
+        common_prefixes->insert(cp);
+        ++count;
+      }
+      /* continue past every name under it */
+      *last_entry = cp;
+      last_entry->append(1, (char)0xFF);
+      ++iters[pick];
+      continue;
+    }
+
     RGWObjEnt e;
-    rgw_bucket_dir_entry& dirent = miter->second;
+    rgw_bucket_dir_entry& dirent = iters[pick]->second;
+    *last_entry = iters[pick]->first;
+    ++iters[pick];
+    ++count;
 
     // fill it in with initial values; we may correct later
     e.name = dirent.name;
@@ -5903,7 +6355,7 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates);
+      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[pick]);
       if (r < 0) {
         if (r == -ENOENT)
           continue;
@@ -5915,16 +6367,22 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, string start, string prefix,
     ldout(cct, 10) << "RGWRados::cls_bucket_list: got " << e.name << dendl;
   }
 
-  if (dir.m.size()) {
-    *last_entry = dir.m.rbegin()->first;
+  if (is_truncated) {
+    *is_truncated = false;
+    for (size_t i = 0; i < n; i++) {
+      if (iters[i] != results[i].dir.m.end() || results[i].is_truncated)
+        *is_truncated = true;
+    }
   }
 
-  if (updates.length()) {
+  for (size_t i = 0; i < n; i++) {
+    if (!updates[i].length())
+      continue;
     ObjectWriteOperation o;
-    cls_rgw_suggest_changes(o, updates);
+    cls_rgw_suggest_changes(o, updates[i]);
     // we don't care if we lose suggested updates, send them off blindly
     AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
-    r = index_ctx.aio_operate(oid, c, &o);
+    r = index_ctx.aio_operate(oids[i], c, &o);
     c->release();
   }
   return m.size();
@@ -5992,31 +6450,53 @@ int RGWRados::cls_obj_usage_log_trim(string& oid, string& user, uint64_t start_e
 int RGWRados::remove_objs_from_index(rgw_bucket& bucket, list<string>& oid_list)
 {
   librados::IoCtx index_ctx;
-  string dir_oid;
-
-  int r = open_bucket_index(bucket, index_ctx, dir_oid);
-  if (r < 0)
-    return r;
-
-  bufferlist updates;
+  map<string, bufferlist> updates; /* per index object */
 
   list<string>::iterator iter;
 
   for (iter = oid_list.begin(); iter != oid_list.end(); ++iter) {
     string& oid = *iter;
+    string dir_oid;
+    int r = open_bucket_index_shard(bucket, index_ctx, oid, dir_oid);
+    if (r < 0)
+      return r;
     dout(2) << "RGWRados::remove_objs_from_index bucket=" << bucket << " oid=" << oid << dendl;
     rgw_bucket_dir_entry entry;
     entry.ver.epoch = (uint64_t)-1; // ULLONG_MAX, needed to that objclass doesn't skip out request
     entry.name = oid;
-    updates.append(CEPH_RGW_REMOVE);
-    ::encode(entry, updates);
+    bufferlist& bl = updates[dir_oid];
+    bl.append(CEPH_RGW_REMOVE);
+    ::encode(entry, bl);
   }
 
-  bufferlist out;
+  /* send the updates for all shards at once, then wait for them */
+  list<librados::AioCompletion *> completions;
+  int ret = 0;
+  map<string, bufferlist>::iterator uiter;
+  for (uiter = updates.begin(); uiter != updates.end(); ++uiter) {
+    librados::ObjectWriteOperation op;
+    op.exec("rgw", "dir_suggest_changes", uiter->second);
+    librados::AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int r = index_ctx.aio_operate(uiter->first, c, &op);
+    if (r < 0) {
+      c->release();
+      ret = r;
+      break;
+    }
+    completions.push_back(c);
+  }
 
-  r = index_ctx.exec(dir_oid, "rgw", "dir_suggest_changes", updates, out);
+  list<librados::AioCompletion *>::iterator citer;
+  for (citer = completions.begin(); citer != completions.end(); ++citer) {
+    librados::AioCompletion *c = *citer;
+    c->wait_for_complete();
+    int r = c->get_return_value();
+    c->release();
+    if (r < 0 && ret >= 0)
+      ret = r;
+  }
 
-  return r;
+  return ret;
 }
 
 int RGWRados::check_disk_state(librados::IoCtx io_ctx,
@@ -6123,29 +6603,113 @@ int RGWRados::check_disk_state(librados::IoCtx io_ctx,
 int RGWRados::cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  vector<string> oids;
+  uint32_t num_shards;
+  int r = open_bucket_index(bucket, index_ctx, oids, &num_shards);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header(index_ctx, oid, &header);
-  if (r < 0)
-    return r;
+  if (!num_shards)
+    return cls_rgw_get_dir_header(index_ctx, oids[0], &header);
+
+  map<int, string> max_markers;
+  for (size_t i = 0; i < oids.size(); i++) {
+    rgw_bucket_dir_header shard_header;
+    r = cls_rgw_get_dir_header(index_ctx, oids[i], &shard_header);
+    if (r < 0)
+      return r;
+
+    add_dir_header_stats(header, shard_header);
+    max_markers[i] = shard_header.max_marker;
+  }
+  header.max_marker = get_bi_log_marker(num_shards, max_markers);
 
   return 0;
 }
 
+/* sums up the headers of all shards of a bucket index before calling cb */
+class RGWGetDirHeaderShards {
+  Mutex lock;
+  RGWGetDirHeader_CB *cb;
+  uint32_t num_shards;
+  int pending;
+  int ret;
+  rgw_bucket_dir_header header;
+  map<int, string> max_markers;
+
+  void finish() {
+    header.max_marker = get_bi_log_marker(num_shards, max_markers);
+    cb->handle_response(ret, header);
+    cb->put();
+    delete this;
+  }
+
+public:
+  RGWGetDirHeaderShards(RGWGetDirHeader_CB *_cb, uint32_t _num_shards)
+    : lock("RGWGetDirHeaderShards::lock"), cb(_cb), num_shards(_num_shards),
+      pending(_num_shards), ret(0) {}
+
+  void handle_response(int shard, int r, rgw_bucket_dir_header& shard_header) {
+    lock.Lock();
+    if (r < 0) {
+      ret = r;
+    } else {
+      add_dir_header_stats(header, shard_header);
+      max_markers[shard] = shard_header.max_marker;
+    }
+    bool done = (--pending == 0);
+    lock.Unlock();
+    if (done)
+      finish();
+  }
+
+  /* shards whose request could not be sent */
+  void fail(int count, int r) {
+    lock.Lock();
+    ret = r;
+    pending -= count;
+    bool done = (pending == 0);
+    lock.Unlock();
+    if (done)
+      finish();
+  }
+};
+
+class RGWGetDirHeaderShard_CB : public RGWGetDirHeader_CB {
+  RGWGetDirHeaderShards *shards;
+  int shard;
+public:
+  RGWGetDirHeaderShard_CB(RGWGetDirHeaderShards *_shards, int _shard) : shards(_shards), shard(_shard) {}
+  void handle_response(int r, rgw_bucket_dir_header& header) {
+    shards->handle_response(shard, r, header);
+  }
+};
+
 int RGWRados::cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx)
 {
   librados::IoCtx index_ctx;
-  string oid;
-  int r = open_bucket_index(bucket, index_ctx, oid);
+  vector<string> oids;
+  uint32_t num_shards;
+  int r = open_bucket_index(bucket, index_ctx, oids, &num_shards);
   if (r < 0)
     return r;
 
-  r = cls_rgw_get_dir_header_async(index_ctx, oid, ctx);
-  if (r < 0)
-    return r;
+  if (!num_shards)
+    return cls_rgw_get_dir_header_async(index_ctx, oids[0], ctx);
+
+  RGWGetDirHeaderShards *shards = new RGWGetDirHeaderShards(ctx, num_shards);
+  for (size_t i = 0; i < oids.size(); i++) {
+    r = cls_rgw_get_dir_header_async(index_ctx, oids[i], new RGWGetDirHeaderShard_CB(shards, i));
+    if (r < 0) {
+      if (i == 0) {
+        delete shards;
+        return r;
+      }
+      /* the shards already sent still complete, and ctx with them */
+      shards->fail(oids.size() - i, r);
+      break;
+    }
+  }
 
   return 0;
 }
@@ -6515,19 +7079,20 @@ int RGWRados::process_intent_log(rgw_bucket& bucket, string& oid,
         break;
       } else {
         librados::IoCtx index_ctx;
-        string oid;
-        int r = open_bucket_index(entry.obj.bucket, index_ctx, oid);
+        vector<string> oids;
+        int r = open_bucket_index(entry.obj.bucket, index_ctx, oids);
         if (r < 0)
           return r;
-        ObjectWriteOperation op;
-        op.remove();
-        oid.append(entry.obj.bucket.marker);
-        librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
-        r = index_ctx.aio_operate(oid, completion, &op);
-        completion->release();
-        if (r < 0 && r != -ENOENT) {
-          cerr << "failed to remove bucket: " << entry.obj.bucket << std::endl;
-          complete = false;
+        for (vector<string>::iterator oiter = oids.begin(); oiter != oids.end(); ++oiter) {
+          ObjectWriteOperation op;
+          op.remove();
+          librados::AioCompletion *completion = rados->aio_create_completion(NULL, NULL, NULL);
+          r = index_ctx.aio_operate(*oiter, completion, &op);
+          completion->release();
+          if (r < 0 && r != -ENOENT) {
+            cerr << "failed to remove bucket: " << entry.obj.bucket << std::endl;
+            complete = false;
+          }
         }
       }
       break;
@@ -17,6 +17,8 @@ class RGWWatcher;
 class SafeTimer;
 class ACLOwner;
 class RGWGC;
+class RGWChainedCache;
+class Throttle;
 
 /* flags for put_obj_meta() */
 #define PUT_OBJ_CREATE      0x01
@@ -559,13 +561,13 @@ struct put_obj_aio_info {
 class RGWPutObjProcessor_Aio : public RGWPutObjProcessor
 {
   list<struct put_obj_aio_info> pending;
-  size_t max_chunks;
 
   struct put_obj_aio_info pop_pending();
   int wait_pending_front();
   bool pending_has_completed();
 
 protected:
+  size_t max_chunks; /* writes in flight, grows while they complete quickly */
   uint64_t obj_len;
 
   int drain_pending();
@@ -592,6 +594,7 @@ class RGWPutObjProcessor_Atomic : public RGWPutObjProcessor_Aio
   uint64_t extra_data_len;
   bufferlist extra_data_bl;
   bufferlist pending_data_bl;
+  uint64_t max_chunk_size;
 protected:
   rgw_bucket bucket;
   string obj_str;
@@ -608,6 +611,7 @@ protected:
   int write_data(bufferlist& bl, off_t ofs, void **phandle);
   virtual int do_complete(string& etag, time_t *mtime, time_t set_mtime, map<string, bufferlist>& attrs);
 
+  int init_chunk_size();
   int prepare_next_part(off_t ofs);
   int complete_parts();
   int complete_writing_data();
@@ -622,6 +626,7 @@ public:
                                 cur_part_id(0),
                                 data_ofs(0),
                                 extra_data_len(0),
+                                max_chunk_size(RGW_MAX_CHUNK_SIZE),
                                 bucket(_b),
                                 obj_str(_o),
                                 unique_tag(_t) {}
@@ -1144,7 +1149,11 @@ class RGWRados
   int open_bucket_pool_ctx(const string& bucket_name, const string& pool, librados::IoCtx&  io_ctx);
   int open_bucket_index_ctx(rgw_bucket& bucket, librados::IoCtx&  index_ctx);
   int open_bucket_data_ctx(rgw_bucket& bucket, librados::IoCtx&  io_ctx);
-  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx&  index_ctx, string& bucket_oid);
+  int open_bucket_index_base(rgw_bucket& bucket, librados::IoCtx&  index_ctx, uint32_t *num_shards);
+  int open_bucket_index(rgw_bucket& bucket, librados::IoCtx&  index_ctx, vector<string>& bucket_oids,
+                        uint32_t *num_shards = NULL);
+  int open_bucket_index_shard(rgw_bucket& bucket, librados::IoCtx&  index_ctx, const string& obj_key,
+                              string& bucket_oid);
 
   struct GetObjState {
     librados::IoCtx io_ctx;
@@ -1237,6 +1246,8 @@ protected:
 
   RGWQuotaHandler *quota_handler;
 
+  Throttle *index_completion_throttle; /* bounds bucket index completions in flight */
+
 public:
   RGWRados() : lock("rados_timer_lock"), timer(NULL),
                gc(NULL), use_gc_thread(false), quota_threads(false),
@@ -1246,6 +1257,7 @@ public:
                cct(NULL), rados(NULL),
                pools_initialized(false),
                quota_handler(NULL),
+               index_completion_throttle(NULL),
                rest_master_conn(NULL),
                meta_mgr(NULL), data_log(NULL) {}
 
@@ -1352,7 +1364,7 @@ public:
    * create a bucket with name bucket and the given list of attrs
    * returns 0 on success, -ERR# otherwise.
    */
-  virtual int init_bucket_index(rgw_bucket& bucket);
+  virtual int init_bucket_index(rgw_bucket& bucket, uint32_t num_shards);
   int select_bucket_placement(RGWUserInfo& user_info, const string& region_name, const std::string& rule,
                               const std::string& bucket_name, rgw_bucket& bucket, string *pselected_rule);
   int select_legacy_bucket_placement(const string& bucket_name, rgw_bucket& bucket);
@@ -1420,6 +1432,8 @@ public:
               off_t ofs, size_t len, bool exclusive);
   virtual int aio_put_obj_data(void *ctx, rgw_obj& obj, bufferlist& bl,
                                off_t ofs, bool exclusive, void **handle);
+  /* size of the writes of an object's data, a multiple of the data pool's alignment */
+  int get_max_chunk_size(rgw_bucket& bucket, uint64_t *max_chunk_size);
   /* note that put_obj doesn't set category on an object, only use it for none user objects */
   int put_system_obj(void *ctx, rgw_obj& obj, const char *data, size_t len, bool exclusive,
               time_t *mtime, map<std::string, bufferlist>& attrs, RGWObjVersionTracker *objv_tracker,
@@ -1645,6 +1659,9 @@ public:
   virtual void finalize_watch();
   virtual int distribute(const string& key, bufferlist& bl);
   virtual int watch_cb(int opcode, uint64_t ver, bufferlist& bl) { return 0; }
+  /* returns false if there is no object cache to chain to */
+  virtual bool chain_cache(RGWChainedCache *cc) { return false; }
+  virtual void unchain_cache(RGWChainedCache *cc) {}
   void pick_control_oid(const string& key, string& notify_oid);
 
   void *create_context(void *user_ctx) {
@@ -1706,7 +1723,8 @@ public:
   int cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout);
   int cls_bucket_list(rgw_bucket& bucket, string start, string prefix, uint32_t num,
                       map<string, RGWObjEnt>& m, bool *is_truncated,
-                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL);
+                      string *last_entry, bool (*force_check_filter)(const string&  name) = NULL,
+                      const string& delim = string(), set<string> *common_prefixes = NULL);
   int cls_bucket_head(rgw_bucket& bucket, struct rgw_bucket_dir_header& header);
   int cls_bucket_head_async(rgw_bucket& bucket, RGWGetDirHeader_CB *ctx);
   int prepare_update_index(RGWObjState *state, rgw_bucket& bucket,
@@ -455,6 +455,10 @@ void end_header(struct req_state *s, RGWOp *op, const char *content_type)
 
   s->cio->set_account(true);
   rgw_flush_formatter_and_reset(s, s->formatter);
+
+  /* the headers are out, so the body can go out as it is generated */
+  if (s->cct->_conf->rgw_formatter_flush_threshold > 0)
+    s->formatter->set_sink(s->cio, s->cct->_conf->rgw_formatter_flush_threshold);
 }
 
 void abort_early(struct req_state *s, RGWOp *op, int err_no)
@@ -7,6 +7,7 @@
 #include "common/Formatter.h"
 #include "common/ceph_json.h"
 #include "rgw_rados.h"
+#include "rgw_cache.h"
 #include "rgw_acl.h"
 
 #include "include/types.h"
@@ -25,6 +26,107 @@ using namespace std;
 
 static RGWMetadataHandler *user_meta_handler = NULL;
 
+/*
+ * user info decoded from the cached user objects, so that
+ * authenticating a request doesn't decode the user's keys again.  An
+ * entry is dropped whenever the object cache replaces or removes the
+ * user object, and after rgw_cache_expiry_interval.
+ */
+class RGWUserInfoCache : public RGWChainedCache {
+  struct Entry {
+    RGWUserInfo info;
+    obj_version version;
+    time_t mtime;
+    utime_t expires;
+    list<string>::iterator lru_iter;
+  };
+
+  CephContext *cct;
+  string prefix; /* cache names of the user objects start with this */
+  Mutex lock;
+  map<string, Entry> entries;
+  list<string> lru; /* most recently used first */
+  size_t max;
+  uint64_t seq; /* bumped by every invalidation */
+
+public:
+  RGWUserInfoCache(CephContext *_cct, const string& _prefix, size_t _max)
+    : cct(_cct), prefix(_prefix), lock("RGWUserInfoCache"), max(_max), seq(0) {}
+
+  uint64_t get_seq() {
+    Mutex::Locker l(lock);
+    return seq;
+  }
+
+  bool find(const string& name, RGWUserInfo& info, obj_version *version, time_t *mtime) {
+    Mutex::Locker l(lock);
+    map<string, Entry>::iterator iter = entries.find(name);
+    if (iter == entries.end())
+      return false;
+
+    Entry& e = iter->second;
+    if (!e.expires.is_zero() && e.expires < ceph_clock_now(cct)) {
+      lru.erase(e.lru_iter);
+      entries.erase(iter);
+      return false;
+    }
+
+    lru.erase(e.lru_iter);
+    lru.push_front(name);
+    e.lru_iter = lru.begin();
+
+    info = e.info;
+    if (version)
+      *version = e.version;
+    if (mtime)
+      *mtime = e.mtime;
+    return true;
+  }
+
+  /* seq is what get_seq() returned before the object was read */
+  void add(const string& name, RGWUserInfo& info, obj_version& version, time_t mtime, uint64_t read_seq) {
+    Mutex::Locker l(lock);
+    if (read_seq != seq)
+      return; /* it may have changed since it was read */
+
+    map<string, Entry>::iterator iter = entries.find(name);
+    if (iter != entries.end())
+      lru.erase(iter->second.lru_iter);
+
+    Entry& e = entries[name];
+    e.info = info;
+    e.version = version;
+    e.mtime = mtime;
+    int expiry = cct->_conf->rgw_cache_expiry_interval;
+    if (expiry > 0) {
+      e.expires = ceph_clock_now(cct);
+      e.expires += expiry;
+    }
+    lru.push_front(name);
+    e.lru_iter = lru.begin();
+
+    while (lru.size() > max) {
+      entries.erase(lru.back());
+      lru.pop_back();
+    }
+  }
+
+  void invalidate(const string& name) {
+    if (name.compare(0, prefix.size(), prefix) != 0)
+      return;
+
+    Mutex::Locker l(lock);
+    ++seq;
+    map<string, Entry>::iterator iter = entries.find(name);
+    if (iter == entries.end())
+      return;
+    lru.erase(iter->second.lru_iter);
+    entries.erase(iter);
+  }
+};
+
+static RGWUserInfoCache *user_info_cache = NULL;
+
 
 /**
  * Get the anonymous (ie, unauthenticated) user info.
@@ -223,10 +325,27 @@ int rgw_get_user_info_by_uid(RGWRados *store, string& uid, RGWUserInfo& info,
 {
   bufferlist bl;
   RGWUID user_id;
+  RGWObjVersionTracker ot;
+  time_t mtime;
+  string cache_name;
+  uint64_t seq = 0;
+
+  if (!objv_tracker)
+    objv_tracker = &ot;
+
+  if (user_info_cache) {
+    rgw_obj obj(store->zone.user_uid_pool, uid);
+    cache_name = obj.bucket.name + "+" + obj.object;
+    if (user_info_cache->find(cache_name, info, &objv_tracker->read_version, pmtime))
+      return 0;
+    seq = user_info_cache->get_seq();
+  }
 
-  int ret = rgw_get_system_obj(store, NULL, store->zone.user_uid_pool, uid, bl, objv_tracker, pmtime);
+  int ret = rgw_get_system_obj(store, NULL, store->zone.user_uid_pool, uid, bl, objv_tracker, &mtime);
   if (ret < 0)
     return ret;
+  if (pmtime)
+    *pmtime = mtime;
 
   bufferlist::iterator iter = bl.begin();
   try {
@@ -243,6 +362,9 @@ int rgw_get_user_info_by_uid(RGWRados *store, string& uid, RGWUserInfo& info,
     return -EIO;
   }
 
+  if (user_info_cache)
+    user_info_cache->add(cache_name, info, objv_tracker->read_version, mtime, seq);
+
   return 0;
 }
 
@@ -2459,3 +2581,25 @@ void rgw_user_init(RGWMetadataManager *mm)
   user_meta_handler = new RGWUserMetadataHandler;
   mm->register_handler(user_meta_handler);
 }
+
+void rgw_user_cache_init(RGWRados *store)
+{
+  CephContext *cct = store->ctx();
+  RGWUserInfoCache *cache = new RGWUserInfoCache(cct, store->zone.user_uid_pool.name + "+",
+                                                 cct->_conf->rgw_user_info_cache_size);
+  if (!store->chain_cache(cache)) {
+    /* without the object cache nothing would tell us about changes */
+    delete cache;
+    return;
+  }
+  user_info_cache = cache;
+}
+
+void rgw_user_cache_finalize(RGWRados *store)
+{
+  if (!user_info_cache)
+    return;
+  store->unchain_cache(user_info_cache);
+  delete user_info_cache;
+  user_info_cache = NULL;
+}
@@ -658,5 +658,7 @@ public:
 class RGWMetadataManager;
 
 extern void rgw_user_init(RGWMetadataManager *mm);
+extern void rgw_user_cache_init(RGWRados *store);
+extern void rgw_user_cache_finalize(RGWRados *store);
 
 #endif
@@ -213,6 +213,25 @@ int KeyValueDBMemory::rmkeys_by_prefix(const string &prefix) {
   return 0;
 }
 
+int KeyValueDBMemory::merge(const string &prefix,
+			    const string &key,
+			    const bufferlist &bl) {
+  MergeOperatorRef mop = get_merge_operator(prefix);
+  assert(mop);
+  bufferlist rbl = bl;
+  string merged;
+  map<std::pair<string,string>,bufferlist>::iterator i =
+    db.find(make_pair(prefix, key));
+  if (i != db.end())
+    mop->merge(i->second.c_str(), i->second.length(),
+	       rbl.c_str(), rbl.length(), &merged);
+  else
+    mop->merge_nonexistent(rbl.c_str(), rbl.length(), &merged);
+  db[make_pair(prefix, key)].clear();
+  db[make_pair(prefix, key)].append(merged);
+  return 0;
+}
+
 KeyValueDB::WholeSpaceIterator KeyValueDBMemory::_get_iterator() {
   return ceph::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
     new WholeSpaceMemIterator(this)
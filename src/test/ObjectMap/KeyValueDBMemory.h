@@ -56,6 +56,12 @@ public:
     const string &prefix
     );
 
+  int merge(
+    const string &prefix,
+    const string &key,
+    const bufferlist &bl
+    );
+
   class TransactionImpl_ : public TransactionImpl {
   public:
     list<Context *> on_commit;
@@ -110,6 +116,22 @@ public:
       on_commit.push_back(new RmKeysByPrefixOp(db, prefix));
     }
 
+    struct MergeOp : public Context {
+      KeyValueDBMemory *db;
+      std::pair<string,string> key;
+      bufferlist value;
+      MergeOp(KeyValueDBMemory *db,
+	      const std::pair<string,string> &key,
+	      const bufferlist &value)
+	: db(db), key(key), value(value) {}
+      void finish(int r) {
+	db->merge(key.first, key.second, value);
+      }
+    };
+    void merge(const string &prefix, const string &k, const bufferlist &bl) {
+      on_commit.push_back(new MergeOp(db, std::make_pair(prefix, k), bl));
+    }
+
     int complete() {
       for (list<Context *>::iterator i = on_commit.begin();
 	   i != on_commit.end();
@@ -27,6 +27,7 @@
 using namespace std;
 
 string store_path;
+string store_type = "leveldb";
 
 class IteratorTest : public ::testing::Test
 {
@@ -37,7 +38,10 @@ public:
   virtual void SetUp() {
     assert(!store_path.empty());
 
-    LevelDBStore *db_ptr = new LevelDBStore(g_ceph_context, store_path);
+    KeyValueDB *db_ptr = KeyValueDB::create(g_ceph_context, store_type,
+					    store_path);
+    assert(db_ptr);
+    db_ptr->init();
     assert(!db_ptr->create_and_open(std::cerr));
     db.reset(db_ptr);
     mock.reset(new KeyValueDBMemory());
@@ -1767,6 +1771,112 @@ TEST_F(EmptyStore, UpperBoundMockDB)
 }
 
 
+// ------- Merge -------
+/// adds little-endian u64 operands
+class AddOperator : public KeyValueDB::MergeOperator {
+public:
+  void merge_nonexistent(const char *rdata, size_t rlen, string *new_value) {
+    *new_value = string(rdata, rlen);
+  }
+  void merge(const char *ldata, size_t llen, const char *rdata, size_t rlen,
+	     string *new_value) {
+    assert(llen == sizeof(uint64_t) && rlen == sizeof(uint64_t));
+    uint64_t l, r;
+    memcpy(&l, ldata, sizeof(l));
+    memcpy(&r, rdata, sizeof(r));
+    l += r;
+    *new_value = string((char *)&l, sizeof(l));
+  }
+  string name() const {
+    return "add";
+  }
+};
+
+class MergeTest : public IteratorTest
+{
+public:
+  string prefix;
+
+  virtual void SetUp() {
+    // merge operators have to be in place before the store is opened
+    prefix = "_MERGE_";
+    KeyValueDB *db_ptr = KeyValueDB::create(g_ceph_context, store_type,
+					    store_path + ".merge");
+    assert(db_ptr);
+    db_ptr->set_merge_operator(prefix, KeyValueDB::MergeOperatorRef(new AddOperator));
+    db_ptr->init();
+    assert(!db_ptr->create_and_open(std::cerr));
+    db.reset(db_ptr);
+    mock.reset(new KeyValueDBMemory());
+    mock->set_merge_operator(prefix, KeyValueDB::MergeOperatorRef(new AddOperator));
+
+    clear(db.get());
+    ASSERT_TRUE(validate_db_clear(db.get()));
+    clear(mock.get());
+    ASSERT_TRUE(validate_db_match());
+  }
+
+  bufferlist u64(uint64_t v) {
+    bufferlist bl;
+    bl.append((char *)&v, sizeof(v));
+    return bl;
+  }
+
+  uint64_t read(KeyValueDB *store, const string &key) {
+    std::set<string> keys;
+    std::map<string, bufferlist> out;
+    keys.insert(key);
+    store->get(prefix, keys, &out);
+    if (out.empty())
+      return 0;
+    uint64_t v;
+    assert(out.begin()->second.length() == sizeof(v));
+    out.begin()->second.copy(0, sizeof(v), (char *)&v);
+    return v;
+  }
+
+  void Merge(KeyValueDB *store) {
+    KeyValueDB::Transaction tx = store->get_transaction();
+    tx->merge(prefix, "new", u64(1));
+    tx->set(prefix, "set", u64(10));
+    tx->merge(prefix, "set", u64(1));
+    tx->set(prefix, "reset", u64(5));
+    store->submit_transaction_sync(tx);
+    ASSERT_EQ(1u, read(store, "new"));
+    ASSERT_EQ(11u, read(store, "set"));
+
+    tx = store->get_transaction();
+    tx->merge(prefix, "new", u64(2));
+    tx->merge(prefix, "new", u64(3));
+    tx->rmkey(prefix, "reset");
+    tx->merge(prefix, "reset", u64(7));
+    tx->merge(prefix, "set", u64(1));
+    tx->rmkey(prefix, "set");
+    store->submit_transaction_sync(tx);
+    ASSERT_EQ(6u, read(store, "new"));
+    ASSERT_EQ(7u, read(store, "reset"));
+    std::set<string> keys;
+    std::map<string, bufferlist> out;
+    keys.insert("set");
+    store->get(prefix, keys, &out);
+    ASSERT_TRUE(out.empty());
+  }
+};
+
+TEST_F(MergeTest, MergeLevelDB)
+{
+  SCOPED_TRACE("LevelDB: Merge");
+  Merge(db.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(MergeTest, MergeMockDB)
+{
+  SCOPED_TRACE("MockDB: Merge");
+  Merge(mock.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
 int main(int argc, char *argv[])
 {
   vector<const char*> args;
@@ -1778,10 +1888,13 @@ int main(int argc, char *argv[])
 
   if (argc < 2) {
     std::cerr << "Usage: " << argv[0]
-	      << "[ceph_options] [gtest_options] <store_path>" << std::endl;
+	      << "[ceph_options] [gtest_options] <store_path> [store_type]"
+	      << std::endl;
     return 1;
   }
   store_path = string(argv[1]);
+  if (argc > 2)
+    store_type = string(argv[2]);
 
   return RUN_ALL_TESTS();
 }
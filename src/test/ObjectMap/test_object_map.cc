@@ -674,6 +674,51 @@ TEST_F(ObjectMapTest, CloneOneObject) {
   db->clear(hoid2);
 }
 
+TEST_F(ObjectMapTest, BatchedUpdates) {
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)), 300, 0);
+  ghobject_t hoid2(hobject_t(sobject_t("foo2", CEPH_NOSNAP)), 301, 0);
+  bufferlist bl;
+  bl.append("bar");
+  map<string, bufferlist> to_set;
+  to_set["foo"] = bl;
+  to_set["foo2"] = bl;
+  string result;
+
+  ObjectMap::Batch batch = db->start_batch();
+  ASSERT_TRUE(batch);
+  ASSERT_EQ(0, db->set_keys(hoid, to_set, 0, batch));
+  ASSERT_EQ(0, db->set_header(hoid, bl, 0, batch));
+  set<string> to_rm;
+  to_rm.insert("foo2");
+  ASSERT_EQ(0, db->rm_keys(hoid, to_rm, 0, batch));
+  ASSERT_EQ(0, db->submit_batch(batch));
+
+  ASSERT_EQ(1, tester.get_key(hoid, "foo", &result));
+  ASSERT_EQ("bar", result);
+  ASSERT_EQ(0, tester.get_key(hoid, "foo2", &result));
+  bufferlist header;
+  map<string, bufferlist> got;
+  db->get(hoid, &header, &got);
+  ASSERT_EQ(3U, header.length());
+
+  // rm_keys on a clone copies keys up from the parent
+  db->clone(hoid, hoid2);
+  to_rm.clear();
+  to_rm.insert("foo");
+  ASSERT_EQ(0, db->set_keys(hoid2, to_set, 0, batch));
+  ASSERT_EQ(0, db->rm_keys(hoid2, to_rm, 0, batch));
+  ASSERT_EQ(0, db->submit_batch(batch));
+  ASSERT_EQ(0, tester.get_key(hoid2, "foo", &result));
+  ASSERT_EQ(1, tester.get_key(hoid2, "foo2", &result));
+  ASSERT_EQ(1, tester.get_key(hoid, "foo", &result));
+  ASSERT_EQ(0, tester.get_key(hoid, "foo2", &result));
+
+  db->clear(hoid);
+  db->clear(hoid2);
+  ASSERT_EQ(0, tester.get_key(hoid, "foo", &result));
+  ASSERT_EQ(0, tester.get_key(hoid2, "foo2", &result));
+}
+
 TEST_F(ObjectMapTest, OddEvenClone) {
   ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
   ghobject_t hoid2(hobject_t(sobject_t("foo2", CEPH_NOSNAP)));
@@ -57,6 +57,33 @@ public:
   void start() { tp->start(); }
   void stop() { tp->stop(); }
 };
+class StealingWQWrapper : public Queueable {
+  class PassAlong : public StealingThreadPool::WorkQueue<unsigned> {
+    Queueable *next;
+    void _process(unsigned *item, ThreadPool::TPHandle &) {
+      next->queue(item);
+    }
+  public:
+    PassAlong(StealingThreadPool *tp, Queueable *next) :
+      StealingThreadPool::WorkQueue<unsigned>("TestQueue", 100, 100, tp),
+      next(next) {}
+  };
+  StealingThreadPool tp;
+  PassAlong wq;
+  unsigned num_hints;
+public:
+  StealingWQWrapper(CephContext *cct, const string &name, unsigned threads,
+		    unsigned num_hints, Queueable *next) :
+    tp(cct, name, threads), wq(&tp, next), num_hints(num_hints) {}
+  void queue(unsigned *item) {
+    if (num_hints)
+      wq.queue(item, *item % num_hints);
+    else
+      wq.queue(item);
+  }
+  void start() { tp.start(); }
+  void stop() { wq.drain(); tp.stop(); }
+};
 class FinisherWrapper : public Queueable {
   class CB : public Context {
     Queueable *next;
@@ -115,7 +142,10 @@ int main(int argc, char **argv)
     ("num-items", po::value<unsigned>()->default_value(3000000),
      "num items")
     ("layers", po::value<string>()->default_value(""),
-     "layer desc")
+     "layer desc: q (ThreadPool), s (work-stealing pool) or f (Finisher) "
+     "per layer")
+    ("num-hints", po::value<unsigned>()->default_value(0),
+     "distinct affinity hints for s layers; 0 to spread items evenly")
     ;
 
   po::variables_map vm;
@@ -172,6 +202,11 @@ int main(int argc, char **argv)
 	  new PassAlong(tp, wqs.back()),
 	  tp
 	  ));
+    } else if (*i == 's') {
+      wqs.push_back(
+	new StealingWQWrapper(
+	  g_ceph_context, ss.str(), vm["num-threads"].as<unsigned>(),
+	  vm["num-hints"].as<unsigned>(), wqs.back()));
     } else if (*i == 'f') {
       wqs.push_back(
 	new FinisherWrapper(
@@ -30,6 +30,8 @@
 #include "common/environment.h"
 #include "common/Clock.h"
 #include "common/safe_io.h"
+#include "common/Formatter.h"
+#include "common/Thread.h"
 
 #include "gtest/gtest.h"
 #include "stdlib.h"
@@ -173,6 +175,50 @@ TEST(BufferRaw, ostream) {
   EXPECT_GT(stream.str().size(), stream.str().find("len 1 nref 1)"));
 }
 
+class PoolAllocThread : public Thread {
+public:
+  std::vector<bufferptr> ptrs;
+  void *entry() {
+    for (unsigned i = 0; i < 10000; ++i) {
+      ptrs.push_back(bufferptr(buffer::create(i % 3000)));
+      memset(ptrs.back().c_str(), i, ptrs.back().length());
+    }
+    return NULL;
+  }
+};
+
+TEST(BufferRaw, pool) {
+  // every size, pooled or not, is usable and aligned
+  for (unsigned len = 0; len < 5000; len += 7) {
+    bufferptr ptr(buffer::create(len));
+    EXPECT_EQ(len, ptr.length());
+    EXPECT_EQ(0u, (unsigned long)ptr.c_str() % 16);
+    memset(ptr.c_str(), 0xff, len);
+    bufferptr c(ptr.clone());
+    EXPECT_EQ(0, memcmp(c.c_str(), ptr.c_str(), len));
+  }
+
+  // allocated on one thread, freed on another, then reused
+  for (int round = 0; round < 3; ++round) {
+    PoolAllocThread t;
+    t.create();
+    t.join();
+    for (unsigned i = 0; i < t.ptrs.size(); ++i) {
+      EXPECT_EQ(i % 3000, t.ptrs[i].length());
+      if (t.ptrs[i].length())
+	EXPECT_EQ((char)i, t.ptrs[i][t.ptrs[i].length() - 1]);
+    }
+  }
+
+  JSONFormatter f;
+  f.open_object_section("pool");
+  buffer::dump_pool(&f);
+  f.close_section();
+  std::ostringstream os;
+  f.flush(os);
+  EXPECT_NE(std::string::npos, os.str().find("\"block_size\":128"));
+}
+
 #ifdef CEPH_HAVE_SPLICE
 class TestRawPipe : public ::testing::Test {
 protected:
@@ -889,6 +935,82 @@ TEST(BufferListIterator, get_current_ptr) {
   }  
 }
 
+static void push_segments(bufferlist &bl, const char *s, unsigned seg)
+{
+  for (unsigned len = strlen(s); len; ) {
+    unsigned l = std::min(seg, len);
+    bl.push_back(buffer::copy(s, l));
+    s += l;
+    len -= l;
+  }
+}
+
+TEST(BufferListIterator, get_contiguous) {
+  bufferlist bl;
+  push_segments(bl, "ABCDEFGH", 3);
+  buffer::track_rebuilds(true);
+  int rebuilds = buffer::get_rebuilds();
+  bufferlist::iterator i = bl.begin();
+  bufferptr a = i.get_contiguous(2);
+  EXPECT_EQ(bl.buffers().front().get_raw(), a.get_raw());
+  EXPECT_EQ(0, memcmp(a.c_str(), "AB", 2));
+  EXPECT_EQ(rebuilds, buffer::get_rebuilds());
+  bufferptr b = i.get_contiguous(4);
+  EXPECT_EQ(0, memcmp(b.c_str(), "CDEF", 4));
+  EXPECT_EQ(rebuilds + 1, buffer::get_rebuilds());
+  EXPECT_EQ((unsigned)6, i.get_off());
+  bufferptr c = i.get_contiguous(0);
+  EXPECT_EQ((unsigned)0, c.length());
+  EXPECT_TRUE(c.have_raw());
+  EXPECT_THROW(i.get_contiguous(3), buffer::end_of_buffer);
+}
+
+TEST(BufferListIterator, get_ptr_and_advance) {
+  bufferlist bl;
+  push_segments(bl, "ABCDEFGH", 3);
+  bufferlist::iterator i(&bl, 1);
+  const char *data;
+  EXPECT_EQ((unsigned)2, i.get_ptr_and_advance(10, &data));
+  EXPECT_EQ(0, memcmp(data, "BC", 2));
+  EXPECT_EQ((unsigned)1, i.get_ptr_and_advance(1, &data));
+  EXPECT_EQ('D', *data);
+  EXPECT_EQ((unsigned)2, i.get_ptr_and_advance(10, &data));
+  EXPECT_EQ((unsigned)2, i.get_ptr_and_advance(10, &data));
+  EXPECT_EQ(0, memcmp(data, "GH", 2));
+  EXPECT_THROW(i.get_ptr_and_advance(1, &data), buffer::end_of_buffer);
+}
+
+TEST(BufferListIterator, crc32c) {
+  const char *s = "the quick brown fox jumps over the lazy dog";
+  unsigned len = strlen(s);
+  uint32_t expected = ceph_crc32c(0, (unsigned char *)s + 4, len - 4);
+  for (unsigned seg = 1; seg < len; seg += 5) {
+    bufferlist bl;
+    push_segments(bl, s, seg);
+    bufferlist::iterator i(&bl, 4);
+    EXPECT_EQ(expected, i.crc32c(len - 4, 0));
+    EXPECT_TRUE(i.end());
+  }
+}
+
+TEST(BufferListIterator, cmp) {
+  bufferlist bl;
+  push_segments(bl, "ABCDEFGH", 3);
+  {
+    bufferlist::iterator i(&bl, 1);
+    EXPECT_EQ(0, i.cmp(6, "BCDEFG"));
+    EXPECT_EQ((unsigned)7, i.get_off());
+  }
+  {
+    bufferlist::iterator i(&bl, 1);
+    EXPECT_GT(0, i.cmp(6, "BCDEFZ"));
+  }
+  {
+    bufferlist::iterator i(&bl);
+    EXPECT_THROW(i.cmp(9, "ABCDEFGHI"), buffer::end_of_buffer);
+  }
+}
+
 TEST(BufferListIterator, copy) {
   bufferlist bl;
   const char *expected = "ABC";
@@ -1122,6 +1244,35 @@ TEST(BufferList, contents_equal) {
   ASSERT_FALSE(bl1.contents_equal(bl3)); // same length different content
 }
 
+TEST(BufferList, contents_equal_buf) {
+  bufferlist bl;
+  EXPECT_TRUE(bl.contents_equal("", 0));
+  push_segments(bl, "ABCDEFGH", 3);
+  EXPECT_TRUE(bl.contents_equal("ABCDEFGH", 8));
+  EXPECT_FALSE(bl.contents_equal("ABCDEFGX", 8));
+  EXPECT_FALSE(bl.contents_equal("ABCDEFG", 7));
+}
+
+TEST(BufferList, find) {
+  bufferlist bl;
+  EXPECT_EQ(-1, bl.find("A", 1));
+  EXPECT_EQ(0, bl.find("", 0));
+  const char *s = "abcabdabcabe";
+  for (unsigned seg = 1; seg <= 12; ++seg) {
+    bufferlist bl;
+    push_segments(bl, s, seg);
+    EXPECT_EQ(0, bl.find("abc", 3));
+    EXPECT_EQ(6, bl.find("abc", 3, 1));
+    EXPECT_EQ(3, bl.find("abdab", 5));
+    EXPECT_EQ(9, bl.find("abe", 3));
+    EXPECT_EQ(-1, bl.find("abe", 3, 10));
+    EXPECT_EQ(-1, bl.find("abf", 3));
+    EXPECT_EQ(11, bl.find("e", 1));
+    EXPECT_EQ(-1, bl.find(s, 13));
+    EXPECT_EQ(0, bl.find(s, 12));
+  }
+}
+
 TEST(BufferList, is_page_aligned) {
   {
     bufferlist bl;
@@ -1284,6 +1435,18 @@ TEST(BufferList, is_contiguous) {
 }
 
 TEST(BufferList, rebuild) {
+  {
+    buffer::track_rebuilds(true);
+    int rebuilds = buffer::get_rebuilds();
+    int bytes = buffer::get_rebuild_bytes();
+    bufferlist bl;
+    push_segments(bl, "ABCDEFGH", 3);
+    bl.c_str();
+    EXPECT_EQ(rebuilds + 1, buffer::get_rebuilds());
+    EXPECT_EQ(bytes + 8, buffer::get_rebuild_bytes());
+    bl.c_str();
+    EXPECT_EQ(rebuilds + 1, buffer::get_rebuilds());
+  }
   {
     bufferlist bl;
     bufferptr ptr(buffer::create_page_aligned(2));
@@ -1840,6 +2003,44 @@ TEST(BufferList, crc32c_append) {
   ASSERT_EQ(bl1.crc32c(0), bl2.crc32c(0));
 }
 
+TEST(BufferList, crc32c_pieces) {
+  const unsigned len = 64 * 1024, block = 4096;
+  bufferptr p(len);
+  for (unsigned i = 0; i < len; ++i)
+    p[i] = rand();
+  uint32_t expected = ceph_crc32c(0, (unsigned char *)p.c_str(), len);
+  bufferlist bl;
+  bl.append(p);
+
+  // sum it block by block, the way a SloppyCRCMap would
+  for (unsigned o = 0; o < len; o += block) {
+    bufferlist t;
+    t.substr_of(bl, o, block);
+    t.crc32c(-1);
+  }
+  buffer::track_cached_crc(true);
+  int adjusted = buffer::get_cached_crc_adjusted();
+  EXPECT_EQ(expected, bl.crc32c(0));
+  EXPECT_EQ(adjusted + 1, buffer::get_cached_crc_adjusted());
+
+  // with only some blocks summed we reuse the leading ones
+  bufferlist bl2;
+  bl2.append(p.clone());
+  for (unsigned o = 0; o < len / 2; o += block) {
+    bufferlist t;
+    t.substr_of(bl2, o, block);
+    t.crc32c(o);
+  }
+  EXPECT_EQ(expected, bl2.crc32c(0));
+  EXPECT_EQ(expected, bl2.crc32c(0));
+
+  // writing through c_str() needs an explicit invalidate
+  bl2.c_str()[0] ^= 1;
+  bl2.invalidate_crc();
+  EXPECT_NE(expected, bl2.crc32c(0));
+  EXPECT_EQ(ceph_crc32c(0, (unsigned char *)bl2.c_str(), len), bl2.crc32c(0));
+}
+
 TEST(BufferList, crc32c_append_perf) {
   int len = 256 * 1024 * 1024;
   bufferptr a(len);
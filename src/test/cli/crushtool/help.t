@@ -6,7 +6,7 @@
                            specify output for for (de)compilation
      --build --num_osds N layer1 ...
                            build a new map, where each 'layer' is
-                             'name (uniform|straw|list|tree) size'
+                             'name (uniform|straw|straw2|list|tree) size'
      -i mapfn --test       test a range of inputs on the map
         [--min-x x] [--max-x x] [--x x]
         [--min-rule r] [--max-rule r] [--rule r]
@@ -17,6 +17,10 @@
         [--simulate]       simulate placements using a random
                            number generator in place of the CRUSH
                            algorithm
+        [--threads n]      spread the CRUSH mappings across n threads
+     -i mapfn --benchmark  time the mapping of a range of inputs and
+                           report mappings per second; takes the
+                           --test range and --threads options
      -i mapfn --add-item id weight name [--loc type name ...]
                            insert an item into the hierarchy at the
                            given location
@@ -4,6 +4,10 @@
      --export-crush <file>   write osdmap's crush map to <file>
      --import-crush <file>   replace osdmap's crush map with <file>
      --test-map-pgs [--pool <poolid>] map all pgs
+     --test-map-pgs-diff [--pool <poolid>] [--diff-map <file>] [--pgmap <file>]
+                             report the pgs and bytes that move from the map
+                             to --diff-map, or to the map with --import-crush
+     --threads <num>         threads mapping the pgs
      --mark-up-in            mark osds up and in (but do not persist)
      --clear-temp            clear pg_temp and primary_temp
      --test-random           do random placements
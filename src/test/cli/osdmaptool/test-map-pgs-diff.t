@@ -0,0 +1,41 @@
+  $ NUM_OSDS=100
+  $ POOL_COUNT=3 # data + metadata + rbd
+  $ SIZE=3
+  $ PG_BITS=4
+#
+# create an osdmap and two crushmaps that place the devices differently
+#
+  $ OSD_MAP="osdmap"
+  $ osdmaptool --osd_pool_default_size $SIZE --pg_bits $PG_BITS --createsimple $NUM_OSDS "$OSD_MAP" > /dev/null
+  osdmaptool: osdmap file 'osdmap'
+  $ CRUSH_MAP="crushmap"
+  $ CEPH_ARGS="--debug-crush 0" crushtool --outfn "$CRUSH_MAP" --build --num_osds $NUM_OSDS node straw 10 rack straw 10 root straw 0
+  $ osdmaptool --import-crush "$CRUSH_MAP" "$OSD_MAP" > /dev/null
+  osdmaptool: osdmap file 'osdmap'
+  $ NEW_CRUSH_MAP="crushmap.new"
+  $ CEPH_ARGS="--debug-crush 0" crushtool --outfn "$NEW_CRUSH_MAP" --build --num_osds $NUM_OSDS node straw 5 rack straw 4 root straw 0
+  $ OUT="$TESTDIR/out"
+  $ PG_NUM=$(($NUM_OSDS << $PG_BITS))
+  $ TOTAL=$((POOL_COUNT * $PG_NUM))
+#
+# nothing moves between a map and itself
+#
+  $ osdmaptool --mark-up-in --test-map-pgs-diff --diff-map "$OSD_MAP" --threads 3 "$OSD_MAP" > "$OUT"
+  osdmaptool: osdmap file 'osdmap'
+  $ grep "^ moved " "$OUT" || cat "$OUT"
+   moved 0/4800 pgs (0%) 0 shards
+#
+# a new crushmap moves pgs, and the map is left untouched
+#
+  $ cp "$OSD_MAP" "$OSD_MAP.orig"
+  $ osdmaptool --mark-up-in --import-crush "$NEW_CRUSH_MAP" --test-map-pgs-diff "$OSD_MAP" > "$OUT"
+  osdmaptool: osdmap file 'osdmap'
+  $ grep "^ moved 0/" "$OUT" && cat "$OUT"
+  [1]
+  $ grep -c "^osd\." "$OUT"
+  100
+  $ cmp "$OSD_MAP" "$OSD_MAP.orig"
+#
+# cleanup
+#
+  $ rm -f "$CRUSH_MAP" "$NEW_CRUSH_MAP" "$OSD_MAP" "$OSD_MAP.orig" "$OUT"
@@ -46,11 +46,18 @@
     lock list <image-name>                      show locks held on an image
     lock add <image-name> <id> [--shared <tag>] take a lock called id on an image
     lock remove <image-name> <id> <locker>      release a lock on an image
-    bench-write <image-name>                    simple write benchmark
-                   --io-size <bytes>              write size
-                   --io-threads <num>             ios in flight
-                   --io-total <bytes>             total bytes to write
-                   --io-pattern <seq|rand>        write pattern
+    bench <image-name>                          benchmark reads and/or writes
+                   --io-type <read|write|rw>      io type (default write)
+                   --io-size <bytes>              io size
+                   --io-threads <num>             independent io streams
+                   --io-depth <num>               ios in flight (default
+                                                  io-threads)
+                   --io-total <bytes>             total bytes to read/write
+                   --io-pattern <seq|rand|zipf>   io pattern
+                   --rw-mix-read <percent>        reads in a rw mix (default 50)
+                   --zipf-theta <theta>           zipf skew, 0 < theta < 1
+                                                  (default 0.99)
+    bench-write <image-name>                    bench --io-type write
   
   <image-name>, <snap-name> are [pool/]name[@snap], or you may specify
   individual pieces of names with -p/--pool, --image, and/or --snap.
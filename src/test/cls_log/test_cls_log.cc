@@ -332,3 +332,95 @@ TEST(cls_rgw, test_log_trim)
   }
   delete rop;
 }
+
+TEST(cls_rgw, test_log_add_batch)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  /* create pool */
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  string oid = "obj";
+
+  /* create object */
+  ASSERT_EQ(0, ioctx.create(oid, true));
+
+  /* one call, all the entries at the same time */
+  utime_t start_time = ceph_clock_now(g_ceph_context);
+  list<cls_log_entry> batch;
+  string section = "global";
+  for (int i = 0; i < 10; i++) {
+    bufferlist bl;
+    ::encode(i, bl);
+    cls_log_entry entry;
+    cls_log_add_prepare_entry(entry, start_time, section, get_name(i), bl);
+    batch.push_back(entry);
+  }
+  librados::ObjectWriteOperation *op = new_op();
+  cls_log_add(*op, batch);
+  ASSERT_EQ(0, ioctx.operate(oid, op));
+  delete op;
+
+  /* and one timestamped by the osd */
+  utime_t zero_time;
+  batch.clear();
+  {
+    bufferlist bl;
+    ::encode(10, bl);
+    cls_log_entry entry;
+    cls_log_add_prepare_entry(entry, zero_time, section, get_name(10), bl);
+    batch.push_back(entry);
+  }
+  op = new_op();
+  cls_log_add(*op, batch, true);
+  ASSERT_EQ(0, ioctx.operate(oid, op));
+  delete op;
+
+  librados::ObjectReadOperation *rop = new_rop();
+  list<cls_log_entry> entries;
+  bool truncated;
+  string marker;
+  utime_t to_time = get_time(start_time, 3600, true);
+  cls_log_list(*rop, start_time, to_time, marker, 0, entries, &marker, &truncated);
+  bufferlist obl;
+  ASSERT_EQ(0, ioctx.operate(oid, rop, &obl));
+  delete rop;
+
+  /* the batch entries did not overwrite each other and keep their order */
+  ASSERT_EQ(11, (int)entries.size());
+  int i = 0;
+  for (list<cls_log_entry>::iterator iter = entries.begin();
+       iter != entries.end(); ++iter, ++i) {
+    int num;
+    ASSERT_EQ(0, read_bl(iter->data, &num));
+    ASSERT_EQ(i, num);
+    if (i < 10)
+      check_entry(*iter, start_time, i, false);
+    else
+      ASSERT_TRUE(start_time <= iter->timestamp);
+  }
+
+  /* a bounded trim removes at most max_entries entries per call */
+  string start_marker, end_marker;
+  int calls = 0;
+  int r;
+  do {
+    op = new_op();
+    cls_log_trim(*op, zero_time, to_time, start_marker, end_marker, 4);
+    r = ioctx.operate(oid, op);
+    delete op;
+    ++calls;
+  } while (r == 0);
+  ASSERT_EQ(-ENODATA, r);
+  ASSERT_EQ(4, calls);
+
+  rop = new_rop();
+  marker.clear();
+  cls_log_list(*rop, start_time, to_time, marker, 0, entries, &marker, &truncated);
+  ASSERT_EQ(0, ioctx.operate(oid, rop, &obl));
+  ASSERT_EQ(0, (int)entries.size());
+  delete rop;
+}
@@ -5,6 +5,7 @@
 #include "include/encoding.h"
 #include "include/types.h"
 #include "include/rados/librados.h"
+#include "include/rbd_types.h"
 #include "cls/rbd/cls_rbd.h"
 #include "cls/rbd/cls_rbd_client.h"
 
@@ -47,6 +48,10 @@ using ::librbd::cls_client::set_protection_status;
 using ::librbd::cls_client::get_stripe_unit_count;
 using ::librbd::cls_client::set_stripe_unit_count;
 using ::librbd::cls_client::old_snapshot_add;
+using ::librbd::cls_client::object_map_load;
+using ::librbd::cls_client::object_map_save;
+using ::librbd::cls_client::object_map_resize;
+using ::librbd::cls_client::object_map_update;
 
 static char *random_buf(size_t len)
 {
@@ -917,3 +922,56 @@ TEST(cls_rbd, stripingv2)
   ioctx.close();
   ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
 }
+
+TEST(cls_rbd, object_map)
+{
+  librados::Rados rados;
+  librados::IoCtx ioctx;
+  string pool_name = get_temp_pool_name();
+
+  ASSERT_EQ("", create_one_pool_pp(pool_name, rados));
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), ioctx));
+
+  vector<bool> object_map;
+  ASSERT_EQ(-ENOENT, object_map_load(&ioctx, "foo", &object_map));
+  ASSERT_EQ(-ENOENT, object_map_update(&ioctx, "foo", 0, 1,
+				       RBD_OBJECT_EXISTS));
+
+  ASSERT_EQ(0, object_map_resize(&ioctx, "foo", 20));
+  ASSERT_EQ(0, object_map_load(&ioctx, "foo", &object_map));
+  ASSERT_EQ(vector<bool>(20, false), object_map);
+
+  ASSERT_EQ(0, object_map_update(&ioctx, "foo", 3, 4, RBD_OBJECT_EXISTS));
+  ASSERT_EQ(0, object_map_update(&ioctx, "foo", 7, 17, RBD_OBJECT_EXISTS));
+  ASSERT_EQ(0, object_map_update(&ioctx, "foo", 8, 10,
+				 RBD_OBJECT_NONEXISTENT));
+  ASSERT_EQ(-EINVAL, object_map_update(&ioctx, "foo", 19, 21,
+				       RBD_OBJECT_EXISTS));
+  ASSERT_EQ(-EINVAL, object_map_update(&ioctx, "foo", 0, 1, 7));
+  ASSERT_EQ(0, object_map_load(&ioctx, "foo", &object_map));
+  ASSERT_EQ(20u, object_map.size());
+  for (size_t i = 0; i < object_map.size(); ++i) {
+    bool exists = i == 3 || (i >= 7 && i < 17 && (i < 8 || i >= 10));
+    ASSERT_EQ(exists, object_map[i]) << "object " << i;
+  }
+
+  // shrinking drops the trailing objects, growing again adds
+  // nonexistent ones
+  ASSERT_EQ(0, object_map_resize(&ioctx, "foo", 13));
+  ASSERT_EQ(0, object_map_resize(&ioctx, "foo", 40));
+  ASSERT_EQ(0, object_map_load(&ioctx, "foo", &object_map));
+  ASSERT_EQ(40u, object_map.size());
+  for (size_t i = 0; i < object_map.size(); ++i) {
+    bool exists = i == 3 || (i >= 7 && i < 13 && (i < 8 || i >= 10));
+    ASSERT_EQ(exists, object_map[i]) << "object " << i;
+  }
+
+  vector<bool> saved(9, true);
+  saved[4] = false;
+  ASSERT_EQ(0, object_map_save(&ioctx, "bar", saved));
+  ASSERT_EQ(0, object_map_load(&ioctx, "bar", &object_map));
+  ASSERT_EQ(saved, object_map);
+
+  ioctx.close();
+  ASSERT_EQ(0, destroy_one_pool_pp(pool_name, rados));
+}
@@ -358,6 +358,118 @@ TEST(cls_rgw, index_suggest)
   test_stats(ioctx, bucket_oid, 0, num_objs / 2, total_size);
 }
 
+TEST(cls_rgw, index_list_multi)
+{
+  OpMgr mgr;
+
+  /* objects spread over a few index objects, as for a sharded bucket */
+  vector<string> oids;
+  for (int i = 0; i < 3; i++) {
+    string oid = str_int("bucket-multi", i);
+    ObjectWriteOperation *op = mgr.write_op();
+    cls_rgw_bucket_init(*op);
+    ASSERT_EQ(0, ioctx.operate(oid, op));
+    oids.push_back(oid);
+  }
+
+  int num_objs = 30;
+  for (int i = 0; i < num_objs; i++) {
+    string& oid = oids[i % oids.size()];
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+
+    index_prepare(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = 1024;
+    index_complete(mgr, ioctx, oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+  }
+
+  string marker;
+  string prefix;
+  vector<rgw_cls_list_ret> results;
+  string delimiter;
+  ASSERT_EQ(0, cls_rgw_list_op_multi(ioctx, oids, marker, prefix, delimiter, 4, results));
+  ASSERT_EQ(oids.size(), results.size());
+  for (size_t i = 0; i < results.size(); i++) {
+    ASSERT_EQ(4u, results[i].dir.m.size());
+    ASSERT_TRUE(results[i].is_truncated);
+  }
+
+  ASSERT_EQ(0, cls_rgw_list_op_multi(ioctx, oids, marker, prefix, delimiter, 100, results));
+  size_t total = 0;
+  for (size_t i = 0; i < results.size(); i++) {
+    ASSERT_FALSE(results[i].is_truncated);
+    map<string, rgw_bucket_dir_entry>::iterator iter;
+    for (iter = results[i].dir.m.begin(); iter != results[i].dir.m.end(); ++iter) {
+      ASSERT_EQ(oids[i], oids[atoi(iter->first.substr(4).c_str()) % oids.size()]);
+    }
+    total += results[i].dir.m.size();
+  }
+  ASSERT_EQ((size_t)num_objs, total);
+}
+
+TEST(cls_rgw, index_list_delimiter)
+{
+  string bucket_oid = str_int("bucket", 4);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  /* dir-0/obj-0 .. dir-9/obj-9, and top-0 .. top-9 */
+  vector<string> names;
+  for (int i = 0; i < 10; i++) {
+    for (int j = 0; j < 10; j++) {
+      names.push_back(str_int("dir", i) + "/" + str_int("obj", j));
+    }
+    names.push_back(str_int("top", i));
+  }
+
+  for (size_t i = 0; i < names.size(); i++) {
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, names[i], loc);
+
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = 1024;
+    index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, names[i], meta);
+  }
+
+  vector<string> oids;
+  oids.push_back(bucket_oid);
+  string marker;
+  string prefix;
+  string delimiter = "/";
+  vector<rgw_cls_list_ret> results;
+
+  ASSERT_EQ(0, cls_rgw_list_op_multi(ioctx, oids, marker, prefix, delimiter, 100, results));
+  ASSERT_FALSE(results[0].is_truncated);
+  ASSERT_EQ(10u, results[0].common_prefixes.size());
+  ASSERT_EQ(1u, results[0].common_prefixes.count("dir-0/"));
+  ASSERT_EQ(10u, results[0].dir.m.size());
+  ASSERT_EQ(1u, results[0].dir.m.count("top-0"));
+
+  /* a common prefix counts as one of the entries asked for */
+  ASSERT_EQ(0, cls_rgw_list_op_multi(ioctx, oids, marker, prefix, delimiter, 5, results));
+  ASSERT_TRUE(results[0].is_truncated);
+  ASSERT_EQ(5u, results[0].common_prefixes.size());
+  ASSERT_EQ(0u, results[0].dir.m.size());
+
+  /* below the delimiter, nothing is collapsed */
+  prefix = "dir-3/";
+  ASSERT_EQ(0, cls_rgw_list_op_multi(ioctx, oids, marker, prefix, delimiter, 100, results));
+  ASSERT_FALSE(results[0].is_truncated);
+  ASSERT_EQ(0u, results[0].common_prefixes.size());
+  ASSERT_EQ(10u, results[0].dir.m.size());
+}
+
 /* test garbage collection */
 static void create_obj(cls_rgw_obj& obj, int i, int j)
 {
@@ -26,6 +26,7 @@
 #include "common/Throttle.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
+#include "messages/MPing.h"
 #include <gtest/gtest.h>
 
 class ThrottleTest : public ::testing::Test {
@@ -200,6 +201,38 @@ TEST_F(ThrottleTest, wait) {
   } while(!waited);
 }
 
+TEST_F(ThrottleTest, fifo) {
+  int64_t throttle_max = 10;
+  Throttle throttle(g_ceph_context, "throttle", throttle_max);
+
+  ASSERT_FALSE(throttle.get(5));
+
+  // a large request queues up...
+  Thread_get t(throttle, throttle_max);
+  t.create();
+  useconds_t delay = 1;
+  while (throttle.get_or_fail(1)) {
+    throttle.put(1);
+    usleep(delay);
+    delay *= 2;
+  }
+
+  // ...and small ones that would fit now go behind it rather than
+  // past it
+  ASSERT_FALSE(throttle.get_or_fail(1));
+  Thread_get u(throttle, 1);
+  u.create();
+  usleep(delay);
+  ASSERT_EQ(throttle.get_current(), 5);
+
+  throttle.put(5);
+  t.join();
+  u.join();
+  ASSERT_TRUE(t.waited);
+  ASSERT_TRUE(u.waited);
+  ASSERT_EQ(throttle.get_current(), 0);
+}
+
 TEST_F(ThrottleTest, destructor) {
   Thread_get *t;
   {
@@ -238,6 +271,39 @@ TEST_F(ThrottleTest, destructor) {
   }
 }
 
+TEST_F(ThrottleTest, conn_throttle) {
+  ConnThrottle *ct = new ConnThrottle(g_ceph_context, "conn", 100, 2);
+  ASSERT_EQ(100, ct->bytes.get_max());
+  ASSERT_EQ(2, ct->messages.get_max());
+
+  // as a messenger reader would: take, then hand over to the message
+  Message *m = new MPing;
+  bufferlist bl;
+  bl.append("0123456789", 10);
+  m->set_data(bl);
+  ASSERT_FALSE(ct->messages.get());
+  ASSERT_FALSE(ct->bytes.get(10));
+  m->set_conn_throttle(ct);
+  ASSERT_EQ(1, ct->messages.get_current());
+  ASSERT_EQ(10, ct->bytes.get_current());
+
+  // data handed off by the message no longer counts against it
+  bufferlist out;
+  m->claim_data(out);
+  ASSERT_EQ(0, ct->bytes.get_current());
+  m->set_data(out);
+  ASSERT_EQ(10, ct->bytes.get_current());
+
+  // the message keeps the throttles alive and releases them when done
+  ct->put();
+  ASSERT_EQ(1, ct->messages.get_current());
+  ct->get();
+  m->put();
+  ASSERT_EQ(0, ct->messages.get_current());
+  ASSERT_EQ(0, ct->bytes.get_current());
+  ct->put();
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
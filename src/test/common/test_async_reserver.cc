@@ -0,0 +1,144 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/AsyncReserver.h"
+#include "common/Finisher.h"
+#include "global/global_context.h"
+#include "test/unit.h"
+
+struct C_Count : public Context {
+  int *count;
+  C_Count(int *c) : count(c) {}
+  void finish(int r) {
+    ++*count;
+  }
+};
+
+class AsyncReserverTest : public ::testing::Test {
+public:
+  Finisher f;
+  AsyncReserver<int> reserver;
+  int granted[4], preempted[4];
+
+  AsyncReserverTest() : f(g_ceph_context), reserver(&f, 2) {
+    for (int i = 0; i < 4; ++i)
+      granted[i] = preempted[i] = 0;
+  }
+  void SetUp() {
+    f.start();
+  }
+  void TearDown() {
+    f.wait_for_empty();
+    f.stop();
+  }
+
+  void request(int item, unsigned prio, bool preemptible) {
+    reserver.request_reservation(
+      item, new C_Count(&granted[item]), prio,
+      preemptible ? new C_Count(&preempted[item]) : NULL);
+  }
+};
+
+TEST_F(AsyncReserverTest, priority_order) {
+  request(0, 1, false);
+  request(1, 1, false);
+  request(2, 1, false);
+  request(3, 5, false);
+  f.wait_for_empty();
+  EXPECT_EQ(1, granted[0]);
+  EXPECT_EQ(1, granted[1]);
+  EXPECT_EQ(0, granted[2]);
+  EXPECT_EQ(0, granted[3]);
+
+  // the higher priority waiter goes first
+  reserver.cancel_reservation(0);
+  f.wait_for_empty();
+  EXPECT_EQ(0, granted[2]);
+  EXPECT_EQ(1, granted[3]);
+
+  reserver.cancel_reservation(1);
+  reserver.cancel_reservation(2);
+  reserver.cancel_reservation(3);
+}
+
+TEST_F(AsyncReserverTest, preempt_lowest) {
+  request(0, 1, true);
+  request(1, 2, true);
+  request(2, 1, true);   // equal priority does not preempt
+  f.wait_for_empty();
+  EXPECT_EQ(1, granted[0]);
+  EXPECT_EQ(1, granted[1]);
+  EXPECT_EQ(0, granted[2]);
+  EXPECT_EQ(0, preempted[0]);
+
+  request(3, 3, false);
+  f.wait_for_empty();
+  EXPECT_EQ(1, preempted[0]);
+  EXPECT_EQ(0, preempted[1]);
+  EXPECT_EQ(1, granted[3]);
+  EXPECT_EQ(0, granted[2]);
+
+  // the preempted item's slot is already gone; cancel is a no-op
+  reserver.cancel_reservation(0);
+  reserver.cancel_reservation(3);
+  f.wait_for_empty();
+  EXPECT_EQ(1, granted[2]);
+
+  reserver.cancel_reservation(1);
+  reserver.cancel_reservation(2);
+}
+
+TEST_F(AsyncReserverTest, not_preemptible) {
+  request(0, 1, false);
+  request(1, 1, false);
+  request(2, 3, true);
+  f.wait_for_empty();
+  EXPECT_EQ(0, granted[2]);
+  EXPECT_EQ(0, preempted[0]);
+  EXPECT_EQ(0, preempted[1]);
+
+  reserver.cancel_reservation(0);
+  f.wait_for_empty();
+  EXPECT_EQ(1, granted[2]);
+
+  // cancelling a preemptible grant drops its preempt callback
+  reserver.cancel_reservation(2);
+  request(3, 5, false);
+  f.wait_for_empty();
+  EXPECT_EQ(0, preempted[2]);
+  EXPECT_EQ(1, granted[3]);
+
+  reserver.cancel_reservation(1);
+  reserver.cancel_reservation(3);
+}
+
+TEST_F(AsyncReserverTest, lowered_max) {
+  request(0, 1, true);
+  request(1, 1, true);
+  f.wait_for_empty();
+  reserver.set_max(1);
+  request(2, 3, false);
+  f.wait_for_empty();
+  // over the new max; wait rather than preempt
+  EXPECT_EQ(0, preempted[0]);
+  EXPECT_EQ(0, preempted[1]);
+  EXPECT_EQ(0, granted[2]);
+
+  // back at the max, so the waiter may preempt
+  reserver.cancel_reservation(0);
+  f.wait_for_empty();
+  EXPECT_EQ(1, preempted[1]);
+  EXPECT_EQ(1, granted[2]);
+
+  reserver.cancel_reservation(1);
+  reserver.cancel_reservation(2);
+}
@@ -13,6 +13,7 @@
 
 #include "include/stringify.h"
 #include "common/bloom_filter.hpp"
+#include "include/ceph_hash.h"
 
 TEST(BloomFilter, Basic) {
   bloom_filter bf(10, .1, 1);
@@ -287,3 +288,71 @@ TEST(BloomFilter, SequenceDouble) {
 }
 
 #endif
+
+TEST(BlockedBloomFilter, Basic) {
+  blocked_bloom_filter bf(10, .1, 1);
+  bf.insert(123);
+  bf.insert(456);
+  ASSERT_TRUE(bf.contains(123));
+  ASSERT_TRUE(bf.contains(456));
+  ASSERT_EQ(2u, bf.element_count());
+
+  blocked_bloom_filter empty;
+  for (int i = 0; i < 100; ++i)
+    ASSERT_FALSE(empty.contains(i));
+}
+
+TEST(BlockedBloomFilter, Sweep) {
+  std::cout.setf(std::ios_base::fixed, std::ios_base::floatfield);
+  std::cout.precision(5);
+  std::cout << "# max\tfpp\tactual\tsize\tB/insert\tapprox_element_count" << std::endl;
+  for (int ex = 3; ex < 12; ex += 2) {
+    for (float fpp = .001; fpp < .5; fpp *= 4.0) {
+      int max = 2 << ex;
+      blocked_bloom_filter bf(max, fpp, 1);
+      for (int n = 0; n < max; n++)
+	bf.insert(ceph_str_hash_rjenkins((const char*)&n, sizeof(n)));
+
+      int test = max * 100;
+      int hit = 0;
+      for (int n = max; n < max + test; n++)
+	if (bf.contains(ceph_str_hash_rjenkins((const char*)&n, sizeof(n))))
+	  hit++;
+      double actual = (double)hit / (double)test;
+
+      bufferlist bl;
+      ::encode(bf, bl);
+      double byte_per_insert = (double)bl.length() / (double)max;
+
+      std::cout << max << "\t" << fpp << "\t" << actual << "\t"
+		<< bl.length() << "\t" << byte_per_insert << "\t"
+		<< bf.approx_unique_element_count() << std::endl;
+      // blocking costs a little accuracy; small filters suffer most
+      ASSERT_TRUE(actual < fpp * 10);
+    }
+  }
+}
+
+TEST(BlockedBloomFilter, InsertMany) {
+  std::vector<uint32_t> v;
+  for (uint32_t i = 0; i < 1000; ++i)
+    v.push_back(ceph_str_hash_rjenkins((const char*)&i, sizeof(i)));
+
+  blocked_bloom_filter a(1000, .01, 7), b(1000, .01, 7);
+  for (unsigned i = 0; i < v.size(); ++i)
+    a.insert(v[i]);
+  b.insert_many(&v[0], v.size());
+  ASSERT_EQ(a.element_count(), b.element_count());
+
+  bufferlist abl, bbl;
+  ::encode(a, abl);
+  ::encode(b, bbl);
+  ASSERT_TRUE(abl.contents_equal(bbl));
+
+  blocked_bloom_filter c;
+  bufferlist::iterator p = bbl.begin();
+  ::decode(c, p);
+  for (unsigned i = 0; i < v.size(); ++i)
+    ASSERT_TRUE(c.contains(v[i]));
+  ASSERT_EQ(1000u, c.element_count());
+}
@@ -0,0 +1,87 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "include/types.h"
+#include "include/buffer.h"
+#include "common/Compressor.h"
+
+#include "gtest/gtest.h"
+
+static void check_roundtrip(Compressor *c, bufferlist &in)
+{
+  bufferlist z, out;
+  ASSERT_EQ(0, c->compress(in, z));
+  ASSERT_EQ(0, c->decompress(z, out));
+  ASSERT_EQ(in.length(), out.length());
+  ASSERT_TRUE(out.contents_equal(in));
+}
+
+class CompressorTest : public ::testing::TestWithParam<const char*> {
+public:
+  Compressor *c;
+  void SetUp() {
+    c = Compressor::get(GetParam());
+    ASSERT_TRUE(c != NULL);
+  }
+};
+
+TEST(Compressor, Lookup) {
+  ASSERT_TRUE(Compressor::get("none") == NULL);
+  ASSERT_TRUE(Compressor::get("nonesuch") == NULL);
+  ASSERT_TRUE(Compressor::get(Compressor::COMP_ALG_NONE) == NULL);
+  ASSERT_EQ(Compressor::COMP_ALG_SNAPPY, Compressor::get("snappy")->get_type());
+  ASSERT_EQ(Compressor::COMP_ALG_ZLIB, Compressor::get("zlib")->get_type());
+  ASSERT_EQ(Compressor::get("zlib"), Compressor::get(Compressor::COMP_ALG_ZLIB));
+}
+
+TEST_P(CompressorTest, Empty) {
+  bufferlist in;
+  check_roundtrip(c, in);
+}
+
+TEST_P(CompressorTest, Small) {
+  bufferlist in;
+  in.append("foo bar baz");
+  check_roundtrip(c, in);
+}
+
+TEST_P(CompressorTest, Fragmented) {
+  // many small buffers, some empty
+  bufferlist in;
+  for (int i = 0; i < 1000; ++i) {
+    in.append(string(i % 37, 'a' + i % 26));
+    in.push_back(buffer::create(0));
+  }
+  check_roundtrip(c, in);
+}
+
+TEST_P(CompressorTest, Big) {
+  // larger than any internal chunk, both compressible and not
+  bufferptr bp = buffer::create(1 << 20);
+  for (unsigned i = 0; i < bp.length(); ++i)
+    bp[i] = i < bp.length() / 2 ? 'x' : rand();
+  bufferlist in;
+  in.append(bp);
+  check_roundtrip(c, in);
+
+  bufferlist z;
+  ASSERT_EQ(0, c->compress(in, z));
+  ASSERT_LT(z.length(), in.length());
+}
+
+TEST_P(CompressorTest, Corrupt) {
+  bufferlist in, z, out;
+  in.append(string(10000, 'x'));
+  ASSERT_EQ(0, c->compress(in, z));
+  bufferlist truncated;
+  truncated.substr_of(z, 0, z.length() / 2);
+  ASSERT_GT(0, c->decompress(truncated, out));
+}
+
+INSTANTIATE_TEST_CASE_P(
+  Compressor,
+  CompressorTest,
+  ::testing::Values("snappy", "zlib"));
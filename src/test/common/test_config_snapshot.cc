@@ -0,0 +1,60 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/config_snapshot.h"
+#include <pthread.h>
+#include <gtest/gtest.h>
+
+struct Limits {
+  int a, b, c, d;
+  Limits(int v = 0) : a(v), b(v), c(v), d(v) {}
+  bool consistent() const {
+    return a == b && b == c && c == d;
+  }
+};
+
+struct Shared {
+  ConfigSnapshot<Limits> snap;
+  volatile bool stop;
+  Shared() : stop(false) {}
+};
+
+static void *writer(void *arg)
+{
+  Shared *s = static_cast<Shared*>(arg);
+  for (int i = 1; !s->stop; ++i)
+    s->snap.set(Limits(i));
+  return NULL;
+}
+
+TEST(ConfigSnapshot, get_set) {
+  ConfigSnapshot<Limits> snap(Limits(3));
+  EXPECT_EQ(3, snap.get().a);
+  snap.set(Limits(4));
+  EXPECT_EQ(4, snap.get().d);
+}
+
+TEST(ConfigSnapshot, no_torn_reads) {
+  Shared s;
+  pthread_t w[2];
+  for (int i = 0; i < 2; ++i)
+    pthread_create(&w[i], NULL, writer, &s);
+  int torn = 0;
+  for (int i = 0; i < 1000000; ++i) {
+    if (!s.snap.get().consistent())
+      ++torn;
+  }
+  s.stop = true;
+  for (int i = 0; i < 2; ++i)
+    pthread_join(w[i], NULL);
+  EXPECT_EQ(0, torn);
+}
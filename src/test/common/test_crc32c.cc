@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include <iostream>
+#include <vector>
 #include <string.h>
 
 #include "include/types.h"
@@ -13,6 +14,41 @@
 
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
+#include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_pclmul.h"
+#include "common/crc32c_aarch64.h"
+#include "arch/intel.h"
+#include "arch/neon.h"
+
+struct crc32c_impl_t {
+  const char *name;
+  ceph_crc32c_func_t func;
+  bool slow;  ///< table driven
+};
+
+// the implementations this build and cpu can run
+static std::vector<crc32c_impl_t> get_impls()
+{
+  std::vector<crc32c_impl_t> v;
+  crc32c_impl_t sctp = { "sctp", ceph_crc32c_sctp, true };
+  v.push_back(sctp);
+  crc32c_impl_t baseline = { "intel baseline", ceph_crc32c_intel_baseline, true };
+  v.push_back(baseline);
+  if (ceph_arch_intel_sse42 && ceph_crc32c_intel_fast_exists()) {
+    crc32c_impl_t i = { "intel fast", ceph_crc32c_intel_fast, false };
+    v.push_back(i);
+  }
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists()) {
+    crc32c_impl_t i = { "intel pclmul", ceph_crc32c_intel_pclmul, false };
+    v.push_back(i);
+  }
+  if (ceph_arch_aarch64_crc32 && ceph_crc32c_aarch64_exists()) {
+    crc32c_impl_t i = { "aarch64", ceph_crc32c_aarch64, false };
+    v.push_back(i);
+  }
+  return v;
+}
 
 TEST(Crc32c, Small) {
   const char *a = "foo bar baz";
@@ -83,6 +119,54 @@ TEST(Crc32c, Performance) {
 
 }
 
+TEST(Crc32c, Implementations) {
+  std::vector<crc32c_impl_t> impls = get_impls();
+  unsigned len = 100000;
+  unsigned char *a = (unsigned char *)malloc(len + 8);
+  for (unsigned i = 0; i < len + 8; i++)
+    a[i] = rand();
+  unsigned lens[] = { 0, 1, 7, 8, 9, 255, 767, 768, 769, 4096,
+		      24575, 24576, 24577, 65536, len };
+  for (unsigned l = 0; l < sizeof(lens) / sizeof(lens[0]); ++l) {
+    for (unsigned off = 0; off < 8; ++off) {
+      uint32_t seed = rand();
+      uint32_t expected = ceph_crc32c_sctp(seed, a + off, lens[l]);
+      uint32_t expected_zero = ceph_crc32c_sctp(seed, NULL, lens[l]);
+      for (unsigned i = 0; i < impls.size(); ++i) {
+	ASSERT_EQ(expected, impls[i].func(seed, a + off, lens[l]))
+	  << impls[i].name << " len " << lens[l] << " off " << off;
+	ASSERT_EQ(expected_zero, impls[i].func(seed, NULL, lens[l]))
+	  << impls[i].name << " len " << lens[l];
+      }
+    }
+  }
+  free(a);
+}
+
+TEST(Crc32c, Benchmark) {
+  std::vector<crc32c_impl_t> impls = get_impls();
+  unsigned sizes[] = { 64, 4096, 65536, 4 << 20 };
+  unsigned total = 256 << 20;   // bytes per implementation and size
+  unsigned char *a = (unsigned char *)malloc(sizes[3]);
+  for (unsigned i = 0; i < sizes[3]; i++)
+    a[i] = i & 0xff;
+  for (unsigned i = 0; i < impls.size(); ++i) {
+    std::cout << impls[i].name << ":";
+    for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      // don't spend all day on the table versions
+      unsigned n = total / sizes[s] / (impls[i].slow ? 16 : 1);
+      uint32_t crc = 0;
+      utime_t start = ceph_clock_now(NULL);
+      for (unsigned j = 0; j < n; ++j)
+	crc = impls[i].func(crc, a, sizes[s]);
+      utime_t end = ceph_clock_now(NULL);
+      float rate = (float)n * sizes[s] / (float)(1024*1024) / (float)(end - start);
+      std::cout << " " << sizes[s] << "b " << rate << " MB/sec";
+    }
+    std::cout << std::endl;
+  }
+  free(a);
+}
 
 static uint32_t crc_check_table[] = {
 0xcfc75c75, 0x7aa1b1a7, 0xd761a4fe, 0xd699eeb6, 0x2a136fff, 0x9782190d, 0xb5017bb0, 0xcffb76a9,
@@ -253,3 +337,22 @@ TEST(Crc32c, RangeNull) {
     ASSERT_EQ(crc, *check);
   }
 }
+
+TEST(Crc32c, Zeros) {
+  for (unsigned len = 0; len < 100000; len = len * 3 + 1) {
+    for (uint32_t crc = 1; crc; crc <<= 7) {
+      ASSERT_EQ(ceph_crc32c(crc, NULL, len), ceph_crc32c_zeros(crc, len));
+    }
+  }
+}
+
+TEST(Crc32c, Combine) {
+  const char *s = "the quick brown fox jumps over the lazy dog";
+  unsigned len = strlen(s);
+  uint32_t whole = ceph_crc32c(-1, (unsigned char *)s, len);
+  for (unsigned split = 0; split <= len; ++split) {
+    uint32_t a = ceph_crc32c(-1, (unsigned char *)s, split);
+    uint32_t b = ceph_crc32c(0, (unsigned char *)s + split, len - split);
+    ASSERT_EQ(whole, ceph_crc32c_zeros(a, len - split) ^ b);
+  }
+}
@@ -0,0 +1,126 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/MClockQueue.h"
+#include <gtest/gtest.h>
+
+typedef MClockQueue<int, int> Queue;
+
+enum { A, B };
+
+// keep both classes backlogged for n dequeues, one every step seconds,
+// and count what each got
+static void run(Queue& q, int n, double step, int *got)
+{
+  utime_t now(1000, 0);
+  for (int i = 0; i < 10; ++i) {
+    q.enqueue(0, A, A, now);
+    q.enqueue(0, B, B, now);
+  }
+  got[A] = got[B] = 0;
+  for (int i = 0; i < n; ++i) {
+    int c = q.dequeue(now);
+    got[c]++;
+    q.enqueue(0, c, c, now);
+    now += step;
+  }
+}
+
+TEST(MClockQueue, strict_first) {
+  Queue q;
+  utime_t now(1000, 0);
+  q.enqueue(0, A, 1, now);
+  q.enqueue_strict(0, 10, 2);
+  q.enqueue_strict(0, 20, 3);
+  ASSERT_EQ(3u, q.length());
+  EXPECT_EQ(3, q.dequeue(now));
+  EXPECT_EQ(2, q.dequeue(now));
+  EXPECT_EQ(1, q.dequeue(now));
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(MClockQueue, weight) {
+  Queue q;
+  q.set_class_info(A, Queue::ClassInfo(0, 2, 0));
+  q.set_class_info(B, Queue::ClassInfo(0, 1, 0));
+  int got[2];
+  run(q, 300, .001, got);
+  EXPECT_NEAR(200, got[A], 2);
+  EXPECT_NEAR(100, got[B], 2);
+}
+
+TEST(MClockQueue, reservation) {
+  Queue q;
+  q.set_class_info(A, Queue::ClassInfo(0, 1000, 0));
+  q.set_class_info(B, Queue::ClassInfo(100, 1, 0));
+  int got[2];
+  // 1000 ops over one second: B gets its 100 despite the weights
+  run(q, 1000, .001, got);
+  EXPECT_GE(got[B], 100);
+  EXPECT_LE(got[B], 105);
+}
+
+TEST(MClockQueue, limit) {
+  Queue q;
+  q.set_class_info(A, Queue::ClassInfo(0, 1000, 50));
+  q.set_class_info(B, Queue::ClassInfo(0, 1, 0));
+  int got[2];
+  run(q, 1000, .001, got);
+  EXPECT_NEAR(50, got[A], 2);
+
+  // but it runs rather than leave the queue idle
+  Queue q2;
+  q2.set_class_info(A, Queue::ClassInfo(0, 1, 1));
+  utime_t now(1000, 0);
+  for (int i = 0; i < 3; ++i)
+    q2.enqueue(0, A, i, now);
+  for (int i = 0; i < 3; ++i)
+    EXPECT_EQ(i, q2.dequeue(now));
+}
+
+TEST(MClockQueue, idle_class_gets_no_credit) {
+  Queue q;
+  q.set_class_info(A, Queue::ClassInfo(0, 1, 0));
+  q.set_class_info(B, Queue::ClassInfo(0, 1, 0));
+  utime_t now(1000, 0);
+  for (int i = 0; i < 100; ++i) {
+    q.enqueue(0, A, A, now);
+    q.dequeue(now);
+  }
+  // A ran alone for a while; once B shows up they alternate
+  int got[2];
+  run(q, 100, .001, got);
+  EXPECT_NEAR(50, got[A], 2);
+  EXPECT_NEAR(50, got[B], 2);
+}
+
+struct IsOdd {
+  bool operator()(int i) { return i % 2; }
+};
+
+TEST(MClockQueue, remove) {
+  Queue q;
+  utime_t now(1000, 0);
+  for (int i = 0; i < 10; ++i)
+    q.enqueue(i % 3, i % 2, i, now);
+  q.enqueue_strict(1, 10, 11);
+  list<int> removed;
+  q.remove_by_filter(IsOdd(), &removed);
+  EXPECT_EQ(6u, removed.size());
+  EXPECT_EQ(5u, q.length());
+  removed.clear();
+  q.remove_by_class(0, &removed);
+  EXPECT_EQ(2u, removed.size());  // 0 and 6
+  EXPECT_EQ(3u, q.length());
+  while (!q.empty())
+    EXPECT_EQ(0, q.dequeue(now) % 2);
+}
@@ -0,0 +1,75 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/mempool.h"
+#include "common/Formatter.h"
+#include "include/buffer.h"
+#include <gtest/gtest.h>
+#include <list>
+#include <sstream>
+
+using namespace std;
+
+struct Obj {
+  MEMPOOL_CLASS_HELPERS()
+  char data[100];
+};
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(Obj, osd_obc)
+
+TEST(mempool, class_helpers) {
+  mempool::pool_t &pool = mempool::get_pool(mempool::mempool_osd_obc);
+  int64_t bytes = pool.allocated_bytes();
+  int64_t items = pool.allocated_items();
+  Obj *o = new Obj;
+  EXPECT_EQ(bytes + (int64_t)sizeof(Obj), pool.allocated_bytes());
+  EXPECT_EQ(items + 1, pool.allocated_items());
+  delete o;
+  EXPECT_EQ(bytes, pool.allocated_bytes());
+  EXPECT_EQ(items, pool.allocated_items());
+}
+
+TEST(mempool, allocator) {
+  typedef mempool::pool_allocator<mempool::mempool_osdmap, int> alloc_t;
+  mempool::pool_t &pool = mempool::get_pool(mempool::mempool_osdmap);
+  int64_t items = pool.allocated_items();
+  {
+    list<int, alloc_t> l;
+    for (int i = 0; i < 10; ++i)
+      l.push_back(i);
+    // one node per item, whatever a node's size
+    EXPECT_EQ(items + 10, pool.allocated_items());
+    EXPECT_LT((int64_t)(10 * sizeof(int)), pool.allocated_bytes());
+  }
+  EXPECT_EQ(items, pool.allocated_items());
+}
+
+TEST(mempool, buffers) {
+  mempool::pool_t &pool = mempool::get_pool(mempool::mempool_buffer_anon);
+  int64_t bytes = pool.allocated_bytes();
+  {
+    bufferptr p(1000);
+    EXPECT_LE(bytes + 1000, pool.allocated_bytes());
+  }
+  EXPECT_EQ(bytes, pool.allocated_bytes());
+}
+
+TEST(mempool, dump) {
+  JSONFormatter f;
+  f.open_object_section("mempools");
+  mempool::dump(&f);
+  f.close_section();
+  ostringstream ss;
+  f.flush(ss);
+  EXPECT_NE(string::npos, ss.str().find("\"buffer_anon\""));
+  EXPECT_NE(string::npos, ss.str().find("\"total\""));
+}
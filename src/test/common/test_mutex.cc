@@ -0,0 +1,68 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/Formatter.h"
+#include <gtest/gtest.h>
+#include <sstream>
+
+class Hammer : public Thread {
+  Mutex &lock;
+  int n;
+  int *count;
+public:
+  Hammer(Mutex &l, int n, int *c) : lock(l), n(n), count(c) {}
+  void *entry() {
+    for (int i = 0; i < n; ++i) {
+      Mutex::Locker l(lock);
+      ++*count;
+    }
+    return NULL;
+  }
+};
+
+static void hammer(Mutex &lock, int *count)
+{
+  Hammer a(lock, 100000, count), b(lock, 100000, count);
+  a.create();
+  b.create();
+  a.join();
+  b.join();
+}
+
+TEST(Mutex, spin) {
+  g_mutex_spin_max = 100;
+  Mutex lock("Mutex::spin::lock", false, false);
+  int count = 0;
+  hammer(lock, &count);
+  EXPECT_EQ(200000, count);
+  g_mutex_spin_max = 0;
+}
+
+TEST(Mutex, dump_lock_stats) {
+  g_mutex_profile = true;
+  Mutex lock("Mutex::dump_lock_stats::lock", false, false);
+  int count = 0;
+  hammer(lock, &count);
+  g_mutex_profile = false;
+  EXPECT_EQ(200000, count);
+
+  JSONFormatter f;
+  f.open_object_section("stats");
+  mutex_stats_dump(&f);
+  f.close_section();
+  ostringstream ss;
+  f.flush(ss);
+  EXPECT_NE(string::npos, ss.str().find("\"Mutex::dump_lock_stats::lock\""));
+  EXPECT_EQ(string::npos, ss.str().find("Mutex::spin::lock"));
+}
@@ -0,0 +1,73 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <sched.h>
+
+#include "common/Thread.h"
+#include "common/numa.h"
+
+#include "gtest/gtest.h"
+
+TEST(NUMA, ParseCpuList) {
+  std::set<int> cpus;
+  ASSERT_EQ(0, parse_cpu_list("", &cpus));
+  ASSERT_TRUE(cpus.empty());
+
+  ASSERT_EQ(0, parse_cpu_list("0-3,8, 10-11\n", &cpus));
+  int expected[] = { 0, 1, 2, 3, 8, 10, 11 };
+  ASSERT_TRUE(std::set<int>(expected, expected + 7) == cpus);
+
+  ASSERT_EQ(0, parse_cpu_list("5", &cpus));
+  ASSERT_EQ(1u, cpus.size());
+  ASSERT_EQ(5, *cpus.begin());
+
+  ASSERT_EQ(-EINVAL, parse_cpu_list("a", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_list("3-1", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_list("1-", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_list("-1", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_list("1x", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_list("0-100000", &cpus));
+}
+
+#if defined(__linux__)
+class AffinityThread : public Thread {
+public:
+  cpu_set_t set;
+  void *entry() {
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    return NULL;
+  }
+};
+
+TEST(NUMA, ThreadAffinity) {
+  cpu_set_t mine;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(mine), &mine));
+  int cpu = 0;
+  while (!CPU_ISSET(cpu, &mine))
+    ++cpu;
+
+  std::set<int> cpus;
+  cpus.insert(cpu);
+  AffinityThread t;
+  ASSERT_EQ(0, t.set_affinity(cpus));
+  t.create();
+  t.join();
+  ASSERT_EQ(1, CPU_COUNT(&t.set));
+  ASSERT_TRUE(CPU_ISSET(cpu, &t.set));
+
+  cpus.clear();
+  cpus.insert(-1);
+  ASSERT_EQ(-EINVAL, t.set_affinity(cpus));
+}
+
+TEST(NUMA, NodeCpus) {
+  std::set<int> cpus;
+  int r = get_numa_node_cpus(0, &cpus);
+  if (r == -ENOENT)
+    return;  // no numa topology exported
+  ASSERT_EQ(0, r);
+  ASSERT_FALSE(cpus.empty());
+}
+#endif
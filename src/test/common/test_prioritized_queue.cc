@@ -0,0 +1,101 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/types.h"
+#include "common/PrioritizedQueue.h"
+#include <gtest/gtest.h>
+
+typedef PrioritizedQueue<int, int> Queue;
+
+enum { A, B };
+
+TEST(PrioritizedQueue, strict_first) {
+  Queue q(1000, 10);
+  q.enqueue(0, 10, 10, 1);
+  q.enqueue_strict(0, 10, 2);
+  q.enqueue_strict(0, 20, 3);
+  q.enqueue_strict_front(0, 20, 4);
+  ASSERT_EQ(4u, q.length());
+  EXPECT_EQ(4, q.dequeue());
+  EXPECT_EQ(3, q.dequeue());
+  EXPECT_EQ(2, q.dequeue());
+  EXPECT_EQ(1, q.dequeue());
+  EXPECT_TRUE(q.empty());
+}
+
+TEST(PrioritizedQueue, fifo_per_class) {
+  Queue q(1000, 10);
+  for (int i = 0; i < 10; ++i)
+    q.enqueue(A, 10, 10, i);
+  q.enqueue_front(A, 10, 10, -1);
+  for (int i = -1; i < 10; ++i)
+    EXPECT_EQ(i, q.dequeue());
+}
+
+TEST(PrioritizedQueue, classes_share_by_cost) {
+  Queue q(1 << 20, 1000);
+  // A sends 4x bigger ops than B; both stay backlogged
+  for (int i = 0; i < 100; ++i) {
+    q.enqueue(A, 10, 4000, A);
+    q.enqueue(B, 10, 1000, B);
+  }
+  int got[2] = {0, 0};
+  for (int i = 0; i < 100; ++i)
+    got[q.dequeue()]++;
+  EXPECT_NEAR(20, got[A], 1);
+  EXPECT_NEAR(80, got[B], 1);
+}
+
+TEST(PrioritizedQueue, priorities_share_by_weight) {
+  Queue q(1 << 20, 1000);
+  for (int i = 0; i < 300; ++i) {
+    q.enqueue(0, 20, 1000, 20);
+    q.enqueue(0, 10, 1000, 10);
+  }
+  int got20 = 0, got10 = 0;
+  for (int i = 0; i < 300; ++i) {
+    if (q.dequeue() == 20)
+      got20++;
+    else
+      got10++;
+  }
+  EXPECT_NEAR(200, got20, 2);
+  EXPECT_NEAR(100, got10, 2);
+}
+
+TEST(PrioritizedQueue, large_cost_clamped) {
+  Queue q(10000, 100);
+  q.enqueue(A, 1, 1 << 30, 1);
+  EXPECT_EQ(1, q.dequeue());
+  EXPECT_TRUE(q.empty());
+}
+
+struct IsOdd {
+  bool operator()(int i) { return i % 2; }
+};
+
+TEST(PrioritizedQueue, remove) {
+  Queue q(1000, 10);
+  for (int i = 0; i < 10; ++i)
+    q.enqueue(i % 3, 1 + i % 2, 10, i);
+  q.enqueue_strict(1, 10, 11);
+  list<int> removed;
+  q.remove_by_filter(IsOdd(), &removed);
+  EXPECT_EQ(6u, removed.size());
+  EXPECT_EQ(5u, q.length());
+  removed.clear();
+  q.remove_by_class(0, &removed);
+  EXPECT_EQ(2u, removed.size());  // 0 and 6
+  EXPECT_EQ(3u, q.length());
+  while (!q.empty())
+    EXPECT_EQ(0, q.dequeue() % 2);
+}
@@ -0,0 +1,95 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/Readahead.h"
+#include "gtest/gtest.h"
+
+#define ASSERT_RA(expected_offset, expected_length, ra) \
+  do { \
+    Readahead::extent_t e = ra; \
+    ASSERT_EQ((uint64_t)expected_offset, e.first); \
+    ASSERT_EQ((uint64_t)expected_length, e.second); \
+  } while(0)
+
+TEST(Readahead, random_access) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  ASSERT_RA(0, 0, r.update(1000, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(1500, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(1300, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(1700, 100, 1000000));
+}
+
+TEST(Readahead, sequential) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  ASSERT_RA(0, 0, r.update(0, 100, 1000000));
+  // the window starts at the sequential bytes read
+  ASSERT_RA(200, 200, r.update(100, 100, 1000000));
+  // the reader got half way through it, so it doubles
+  ASSERT_RA(400, 300, r.update(200, 100, 1000000));
+  // nothing more until half of the new window has been read
+  ASSERT_RA(0, 0, r.update(300, 100, 1000000));
+  ASSERT_RA(700, 600, r.update(400, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(500, 100, 1000000));
+}
+
+TEST(Readahead, max_size) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_max_readahead_size(300);
+  ASSERT_RA(500, 300, r.update(0, 500, 1000000));
+  ASSERT_RA(1000, 300, r.update(500, 500, 1000000));
+}
+
+TEST(Readahead, min_size) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_min_readahead_size(1000);
+  ASSERT_RA(100, 1000, r.update(0, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(100, 100, 1000000));
+  ASSERT_RA(1100, 1500, r.update(200, 400, 1000000));
+}
+
+TEST(Readahead, disabled) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_max_readahead_size(0);
+  ASSERT_RA(0, 0, r.update(0, 500, 1000000));
+  ASSERT_RA(0, 0, r.update(500, 500, 1000000));
+}
+
+TEST(Readahead, alignment) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  r.set_alignment(4096);
+  // rounded up to the end of the object
+  ASSERT_RA(100, 3996, r.update(0, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(100, 100, 1000000));
+}
+
+TEST(Readahead, limit) {
+  Readahead r;
+  r.set_trigger_requests(1);
+  ASSERT_RA(500, 300, r.update(0, 500, 800));
+  ASSERT_RA(0, 0, r.update(500, 300, 800));
+}
+
+TEST(Readahead, reset) {
+  Readahead r;
+  r.set_trigger_requests(2);
+  ASSERT_RA(0, 0, r.update(0, 100, 1000000));
+  ASSERT_RA(200, 200, r.update(100, 100, 1000000));
+  // a random read starts detection over
+  ASSERT_RA(0, 0, r.update(5000, 100, 1000000));
+  ASSERT_RA(0, 0, r.update(5100, 100, 1000000));
+  ASSERT_RA(5300, 200, r.update(5200, 100, 1000000));
+}
+
+TEST(Readahead, pending) {
+  Readahead r;
+  r.inc_pending(2);
+  r.dec_pending();
+  r.dec_pending();
+  r.wait_for_pending();
+}
@@ -0,0 +1,147 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/shared_cache.hpp"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include <gtest/gtest.h>
+
+struct Counted {
+  static int alive;
+  int value;
+  Counted() : value(0) { alive++; }
+  ~Counted() { alive--; }
+};
+int Counted::alive = 0;
+
+typedef ShardedSharedLRU<int, Counted> Cache;
+
+TEST(ShardedSharedLRU, lookup_or_create) {
+  Cache cache(10, 4);
+  {
+    Cache::VPtr ptr = cache.lookup_or_create(1);
+    ptr->value = 2;
+  }
+  // still cached after the last user reference is gone
+  EXPECT_EQ(1, Counted::alive);
+  Cache::VPtr ptr = cache.lookup(1);
+  ASSERT_TRUE(ptr);
+  EXPECT_EQ(2, ptr->value);
+  EXPECT_FALSE(cache.lookup(2));
+  ptr.reset();
+  cache.clear();
+  EXPECT_EQ(0, Counted::alive);
+  EXPECT_TRUE(cache.empty());
+}
+
+TEST(ShardedSharedLRU, trim) {
+  Cache cache(8, 2);
+  for (int i = 0; i < 100; ++i)
+    cache.lookup_or_create(i);
+  EXPECT_EQ(8, Counted::alive);
+
+  // evicted values stay reachable while in use
+  Cache::VPtr held = cache.lookup(99);
+  ASSERT_TRUE(held);
+  for (int i = 100; i < 200; ++i)
+    cache.lookup_or_create(i);
+  EXPECT_EQ(held, cache.lookup(99));
+
+  cache.set_size(0);
+  EXPECT_EQ(1, Counted::alive);
+  held.reset();
+  EXPECT_EQ(0, Counted::alive);
+  EXPECT_TRUE(cache.empty());
+}
+
+TEST(ShardedSharedLRU, clock) {
+  Cache cache(4, 1);
+  for (int i = 0; i < 4; ++i)
+    cache.lookup_or_create(i);
+  // the entries that were looked up get a second chance
+  cache.lookup(0);
+  cache.lookup(2);
+  cache.lookup_or_create(4);
+  cache.lookup_or_create(5);
+  EXPECT_EQ(4, Counted::alive);
+  EXPECT_TRUE(cache.lookup(0));
+  EXPECT_TRUE(cache.lookup(2));
+  EXPECT_FALSE(cache.lookup(1));
+  EXPECT_FALSE(cache.lookup(3));
+  cache.clear();
+}
+
+TEST(ShardedSharedLRU, get_next) {
+  Cache cache(0, 4);
+  list<Cache::VPtr> refs;
+  for (int i = 0; i < 20; i += 2) {
+    refs.push_back(cache.lookup_or_create(i));
+    refs.back()->value = i;
+  }
+  pair<int, Cache::VPtr> next(-1, Cache::VPtr());
+  int expected = 0;
+  while (cache.get_next(next.first, &next)) {
+    EXPECT_EQ(expected, next.first);
+    EXPECT_EQ(expected, next.second->value);
+    expected += 2;
+  }
+  EXPECT_EQ(20, expected);
+  next.second.reset();
+  refs.clear();
+  EXPECT_TRUE(cache.empty());
+}
+
+TEST(ShardedSharedLRU, add_existed) {
+  Cache cache(4, 2);
+  bool existed = true;
+  Cache::VPtr first = cache.add(1, new Counted, &existed);
+  EXPECT_FALSE(existed);
+  // a racing creator gets the value already there, its own is dropped
+  Cache::VPtr second = cache.add(1, new Counted, &existed);
+  EXPECT_TRUE(existed);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(1, Counted::alive);
+  first.reset();
+  second.reset();
+  cache.clear();
+  EXPECT_TRUE(cache.empty());
+}
+
+TEST(ShardedSharedLRU, shard_stats) {
+  Cache cache(2, 1);
+  cache.lookup(0);
+  for (int i = 0; i < 3; ++i)
+    cache.lookup_or_create(i);
+  cache.lookup(2);
+  uint64_t hits, misses, evictions;
+  ASSERT_EQ(1u, cache.get_num_shards());
+  cache.get_shard_stats(0, &hits, &misses, &evictions);
+  EXPECT_EQ(1u, hits);
+  EXPECT_EQ(4u, misses);
+  EXPECT_EQ(1u, evictions);
+  cache.clear();
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_shared_cache && ./unittest_shared_cache # --gtest_filter=*.* --log-to-stderr=true"
+// End:
@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/Clock.h"
+#include "common/Mutex.h"
+#include "common/WheelTimer.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "include/Context.h"
+
+#include <gtest/gtest.h>
+
+// all of these run under the timer lock, which also guards the results
+struct Results {
+  int fired;
+  int deleted;
+  bool early;
+  std::vector<int> order;
+  Results() : fired(0), deleted(0), early(false) {}
+};
+
+class C_Record : public Context {
+  Results *r;
+  int id;
+  utime_t when;
+public:
+  C_Record(Results *r, int id, utime_t when) : r(r), id(id), when(when) {}
+  ~C_Record() {
+    r->deleted++;
+  }
+  void finish(int) {
+    if (ceph_clock_now(g_ceph_context) < when)
+      r->early = true;
+    r->fired++;
+    r->order.push_back(id);
+  }
+};
+
+class C_Rearm : public Context {
+  WheelTimer *timer;
+  Mutex *lock;
+  bool locked;
+  int *left;
+public:
+  C_Rearm(WheelTimer *t, Mutex *l, bool locked, int *left)
+    : timer(t), lock(l), locked(locked), left(left) {}
+  void finish(int) {
+    if (!locked)
+      lock->Lock();
+    if (--*left > 0)
+      timer->add_event_after(0, new C_Rearm(timer, lock, locked, left));
+    if (!locked)
+      lock->Unlock();
+  }
+};
+
+static void wait_for(Mutex &lock, Results &r, int n, int secs)
+{
+  for (int i = 0; i < secs * 100; ++i) {
+    lock.Lock();
+    bool done = r.fired >= n;
+    lock.Unlock();
+    if (done)
+      return;
+    usleep(10000);
+  }
+}
+
+TEST(WheelTimer, Order) {
+  Mutex lock("WheelTimer::Order");
+  // 10us ticks, so the second-scale events start out two levels up
+  WheelTimer timer(g_ceph_context, lock, true, .00001);
+  timer.init();
+
+  Results r;
+  const int n = 200;
+  std::vector<double> offset(n);
+  utime_t start = ceph_clock_now(g_ceph_context);
+  lock.Lock();
+  for (int i = 0; i < n; ++i) {
+    offset[i] = (double)(rand() % 1500) / 1000.0;
+    utime_t when = start;
+    when += offset[i];
+    timer.add_event_at(when, new C_Record(&r, i, when));
+  }
+  ASSERT_EQ((size_t)n, timer.size());
+  lock.Unlock();
+
+  wait_for(lock, r, n, 10);
+
+  lock.Lock();
+  ASSERT_EQ(n, r.fired);
+  ASSERT_EQ(n, r.deleted);
+  ASSERT_FALSE(r.early);
+  ASSERT_EQ(0u, timer.size());
+  for (int i = 1; i < n; ++i)
+    ASSERT_LE(offset[r.order[i-1]], offset[r.order[i]]);
+  timer.shutdown();
+  lock.Unlock();
+}
+
+TEST(WheelTimer, Cancel) {
+  Mutex lock("WheelTimer::Cancel");
+  WheelTimer timer(g_ceph_context, lock, true, .001);
+  timer.init();
+
+  Results r;
+  const int n = 100;
+  std::vector<Context*> c(n);
+  lock.Lock();
+  for (int i = 0; i < n; ++i) {
+    utime_t when = ceph_clock_now(g_ceph_context);
+    when += .1 + (double)i / 1000.0;
+    c[i] = new C_Record(&r, i, when);
+    timer.add_event_at(when, c[i]);
+  }
+  for (int i = 0; i < n; i += 2)
+    ASSERT_TRUE(timer.cancel_event(c[i]));
+  ASSERT_EQ(n / 2, r.deleted);
+  ASSERT_FALSE(timer.cancel_event(c[0]));
+  lock.Unlock();
+
+  wait_for(lock, r, n / 2, 10);
+
+  lock.Lock();
+  ASSERT_EQ(n / 2, r.fired);
+  for (int i = 0; i < n / 2; ++i)
+    ASSERT_EQ(2 * i + 1, r.order[i]);
+
+  // shutdown cancels whatever is left
+  for (int i = 0; i < n; ++i)
+    timer.add_event_after(1000 + i, new C_Record(&r, i, utime_t()));
+  timer.shutdown();
+  ASSERT_EQ(n / 2, r.fired);
+  ASSERT_EQ(n + n, r.deleted);
+  lock.Unlock();
+}
+
+TEST(WheelTimer, Rearm) {
+  for (int safe = 0; safe < 2; ++safe) {
+    Mutex lock("WheelTimer::Rearm");
+    WheelTimer timer(g_ceph_context, lock, safe, .001);
+    timer.init();
+
+    int left = 50;
+    lock.Lock();
+    timer.add_event_after(0, new C_Rearm(&timer, &lock, safe, &left));
+    lock.Unlock();
+    for (int i = 0; i < 1000; ++i) {
+      lock.Lock();
+      bool done = left == 0;
+      lock.Unlock();
+      if (done)
+	break;
+      usleep(10000);
+    }
+
+    lock.Lock();
+    ASSERT_EQ(0, left);
+    timer.shutdown();
+    lock.Unlock();
+  }
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
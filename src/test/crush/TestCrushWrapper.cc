@@ -540,6 +540,79 @@ TEST(CrushWrapper, dump_rules) {
   delete c;
 }
 
+TEST(CrushWrapper, straw2) {
+  CrushWrapper *c = new CrushWrapper;
+
+  const int ROOT_TYPE = 1;
+  c->set_type_name(ROOT_TYPE, "root");
+  const int OSD_TYPE = 0;
+  c->set_type_name(OSD_TYPE, "osd");
+
+  string root_name("default");
+  int rootno;
+  EXPECT_EQ(0, c->add_bucket(0, CRUSH_BUCKET_STRAW2, CRUSH_HASH_RJENKINS1,
+			     ROOT_TYPE, 0, NULL, NULL, &rootno));
+  c->set_item_name(rootno, root_name);
+  EXPECT_TRUE(c->has_v4_buckets());
+
+  const int num_osds = 10;
+  for (int item = 0; item < num_osds; ++item) {
+    map<string,string> loc;
+    loc["root"] = root_name;
+    EXPECT_EQ(0, c->insert_item(g_ceph_context, item, 1.0,
+				"osd." + stringify(item), loc));
+  }
+  int ruleset = c->add_simple_ruleset("rule", root_name, "osd",
+				      "firstn", pg_pool_t::TYPE_REPLICATED);
+  EXPECT_EQ(0, ruleset);
+  c->finalize();
+
+  vector<__u32> weight(num_osds, 0x10000);
+  const int num_x = 10000;
+  vector<int> before(num_x);
+  vector<int> count(num_osds, 0);
+  for (int x = 0; x < num_x; ++x) {
+    vector<int> out;
+    c->do_rule(ruleset, x, out, 1, weight);
+    ASSERT_EQ(1u, out.size());
+    before[x] = out[0];
+    count[out[0]]++;
+  }
+  for (int i = 0; i < num_osds; ++i) {
+    EXPECT_LT(num_x / num_osds / 2, count[i]);
+    EXPECT_GT(num_x / num_osds * 2, count[i]);
+  }
+
+  // the mappings survive encoding
+  bufferlist bl;
+  c->encode(bl);
+  CrushWrapper *d = new CrushWrapper;
+  bufferlist::iterator p = bl.begin();
+  d->decode(p);
+  for (int x = 0; x < num_x; ++x) {
+    vector<int> out;
+    d->do_rule(ruleset, x, out, 1, weight);
+    ASSERT_EQ(before[x], out[0]);
+  }
+  delete d;
+
+  // halving the weight of osd.3 only moves inputs away from it
+  EXPECT_EQ(1, c->adjust_item_weightf(g_ceph_context, 3, 0.5));
+  int moved = 0;
+  for (int x = 0; x < num_x; ++x) {
+    vector<int> out;
+    c->do_rule(ruleset, x, out, 1, weight);
+    if (out[0] != before[x]) {
+      EXPECT_EQ(3, before[x]);
+      moved++;
+    }
+  }
+  EXPECT_LT(0, moved);
+  EXPECT_GT(count[3], moved);
+
+  delete c;
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -3,6 +3,7 @@
 
 #include "include/types.h"
 #include "auth/Crypto.h"
+#include "common/Clock.h"
 #include "common/ceph_crypto.h"
 
 #include "test/unit.h"
@@ -146,3 +147,77 @@ TEST(AES, Loop) {
   err = memcmp(plaintext_s, orig_plaintext_s, sizeof(orig_plaintext_s));
   ASSERT_EQ(0, err);
 }
+
+TEST(AES, KeyHandler) {
+  CryptoHandler *h = g_ceph_context->get_crypto_handler(CEPH_CRYPTO_AES);
+  char secret_s[16];
+  ASSERT_EQ(0, get_random_bytes(secret_s, sizeof(secret_s)));
+  bufferptr secret(secret_s, sizeof(secret_s));
+
+  std::string error;
+  bufferptr short_secret(secret_s, 8);
+  ASSERT_EQ((CryptoKeyHandler*)NULL, h->get_key_handler(short_secret, error));
+  ASSERT_NE("", error);
+  error.clear();
+
+  CryptoKeyHandler *ckh = h->get_key_handler(secret, error);
+  ASSERT_TRUE(ckh != NULL);
+  ASSERT_EQ("", error);
+
+  for (unsigned len = 0; len < 100; len += 7) {
+    char plaintext_s[100];
+    ASSERT_EQ(0, get_random_bytes(plaintext_s, sizeof(plaintext_s)));
+    bufferlist plaintext;
+    plaintext.append(plaintext_s, len);
+
+    // same result as setting the key up for each call
+    bufferlist want, cipher;
+    h->encrypt(secret, plaintext, want, error);
+    ASSERT_EQ("", error);
+    ckh->encrypt(plaintext, cipher, error);
+    ASSERT_EQ("", error);
+    ASSERT_TRUE(want.contents_equal(cipher));
+
+    bufferlist out;
+    ckh->decrypt(cipher, out, error);
+    ASSERT_EQ("", error);
+    ASSERT_TRUE(plaintext.contents_equal(out));
+  }
+  delete ckh;
+}
+
+TEST(AES, SignatureBench) {
+  // what cephx message signing encrypts per message: struct_v, magic
+  // and four crcs as a bufferlist
+  CryptoHandler *h = g_ceph_context->get_crypto_handler(CEPH_CRYPTO_AES);
+  char secret_s[16];
+  ASSERT_EQ(0, get_random_bytes(secret_s, sizeof(secret_s)));
+  bufferptr secret(secret_s, sizeof(secret_s));
+  char plaintext_s[29];
+  ASSERT_EQ(0, get_random_bytes(plaintext_s, sizeof(plaintext_s)));
+  bufferlist plaintext;
+  plaintext.append(plaintext_s, sizeof(plaintext_s));
+
+  const int n = 100000;
+  std::string error;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < n; i++) {
+    bufferlist cipher;
+    h->encrypt(secret, plaintext, cipher, error);
+  }
+  utime_t per_call = ceph_clock_now(g_ceph_context) - start;
+
+  CryptoKeyHandler *ckh = h->get_key_handler(secret, error);
+  ASSERT_TRUE(ckh != NULL);
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < n; i++) {
+    bufferlist cipher;
+    ckh->encrypt(plaintext, cipher, error);
+  }
+  utime_t cached = ceph_clock_now(g_ceph_context) - start;
+  delete ckh;
+  ASSERT_EQ("", error);
+
+  std::cout << "signatures/sec: keyed per call " << (int)(n / (double)per_call)
+	    << ", cached key handler " << (int)(n / (double)cached) << std::endl;
+}
@@ -196,3 +196,51 @@ TEST(EncodingRoundTrip, MultimapConstructorCounter) {
   EXPECT_EQ(my_val_t::get_copy_ctor(), 10);
   EXPECT_EQ(my_val_t::get_assigns(), 0);
 }
+
+TEST(EncodingRoundTrip, BulkVector) {
+  std::vector<uint64_t> v;
+  for (int i = 0; i < 1000; ++i)
+    v.push_back((uint64_t)i << 33 | i);
+  bufferlist bl;
+  ::encode(v, bl);
+  ASSERT_EQ(sizeof(__u32) + v.size() * 8, bl.length());
+
+  // same bytes as the element-by-element encoding
+  bufferlist bl2;
+  ::encode((__u32)v.size(), bl2);
+  for (unsigned i = 0; i < v.size(); ++i)
+    ::encode(v[i], bl2);
+  ASSERT_TRUE(bl.contents_equal(bl2));
+
+  std::vector<uint64_t> w;
+  bufferlist::iterator p = bl.begin();
+  ::decode(w, p);
+  ASSERT_EQ(v, w);
+  ASSERT_TRUE(p.end());
+}
+
+TEST(EncodingRoundTrip, FixedSizeMap) {
+  std::map<int32_t, uint64_t> m;
+  for (int i = 0; i < 100; ++i)
+    m[i * 7] = i;
+  bufferlist bl;
+  ::encode(m, bl);
+  ASSERT_EQ(sizeof(__u32) + m.size() * 12, bl.length());
+  ASSERT_EQ(1u, bl.buffers().size());
+  std::map<int32_t, uint64_t> m2;
+  bufferlist::iterator p = bl.begin();
+  ::decode(m2, p);
+  ASSERT_EQ(m, m2);
+}
+
+TEST(EncodingRoundTrip, FixedSizeShort) {
+  // a count that the rest of the buffer cannot hold fails before
+  // anything is allocated for it
+  bufferlist bl;
+  ::encode((__u32)1000000000, bl);
+  ::encode((uint64_t)1, bl);
+  std::vector<uint64_t> v;
+  bufferlist::iterator p = bl.begin();
+  ASSERT_THROW(::decode(v, p), buffer::end_of_buffer);
+  ASSERT_TRUE(v.empty());
+}
@@ -0,0 +1,24 @@
+#!/bin/sh -e
+
+# time encode and decode of every generated test instance (or the
+# default-constructed object, for types without any) of each type, or
+# just of the types given after the iteration count.
+#
+#   bench.sh [iterations [type ...]]
+
+iterations=${1:-10000}
+[ $# -gt 0 ] && shift
+types="$*"
+[ -z "$types" ] && types=`./ceph-dencoder list_types`
+
+echo "type test bytes encode_ns decode_ns"
+for type in $types; do
+    num=`./ceph-dencoder type $type count_tests`
+    if [ "$num" -eq 0 ]; then
+	echo "$type - `./ceph-dencoder type $type bench $iterations`"
+	continue
+    fi
+    for n in `seq 1 1 $num`; do
+	echo "$type $n `./ceph-dencoder type $type select_test $n bench $iterations`"
+    done
+done
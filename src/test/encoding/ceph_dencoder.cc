@@ -6,6 +6,7 @@
 #include "common/ceph_argparse.h"
 #include "common/Formatter.h"
 #include "common/errno.h"
+#include "common/Clock.h"
 #include "msg/Message.h"
 #include "include/assert.h"
 
@@ -44,6 +45,9 @@ void usage(ostream &out)
   out << "\n";
   out << "  count_tests         print number of generated test objects (to stdout)\n";
   out << "  select_test <n>     select generated test object as in-memory object\n";
+  out << "\n";
+  out << "  bench <iterations>  time encode and decode of in-memory object; print\n"
+      << "                      encoded bytes, encode ns/op, decode ns/op (to stdout)\n";
 }
 struct Dencoder {
   virtual ~Dencoder() {}
@@ -386,6 +390,41 @@ int main(int argc, const char **argv)
       }
       int n = atoi(*i);
       err = den->select_generated(n);      
+    } else if (*i == string("bench")) {
+      if (!den) {
+	cerr << "must first select type with 'type <name>'" << std::endl;
+	usage(cerr);
+	exit(1);
+      }
+      ++i;
+      if (i == args.end()) {
+	usage(cerr);
+	exit(1);
+      }
+      int iterations = atoi(*i);
+      if (iterations <= 0) {
+	cerr << "iterations must be positive" << std::endl;
+	exit(1);
+      }
+      // warm up (and size) with one pass of each first
+      bufferlist bl;
+      den->encode(bl, features);
+      err = den->decode(bl);
+      if (!err.length()) {
+	utime_t start = ceph_clock_now(NULL);
+	for (int n = 0; n < iterations; ++n)
+	  den->encode(bl, features);
+	utime_t enc = ceph_clock_now(NULL) - start;
+	start = ceph_clock_now(NULL);
+	for (int n = 0; n < iterations && !err.length(); ++n)
+	  err = den->decode(bl);
+	utime_t dec = ceph_clock_now(NULL) - start;
+	if (!err.length())
+	  cout << bl.length()
+	       << " " << (uint64_t)((double)enc * 1000000000.0 / iterations)
+	       << " " << (uint64_t)((double)dec * 1000000000.0 / iterations)
+	       << std::endl;
+      }
     } else {
       cerr << "unknown option '" << *i << "'" << std::endl;
       usage(cerr);
@@ -7,6 +7,7 @@ TYPE(filepath)
 #include "common/bloom_filter.hpp"
 TYPE(bloom_filter)
 TYPE(compressible_bloom_filter)
+TYPE(blocked_bloom_filter)
 
 #include "common/snap_types.h"
 TYPE(SnapContext)
@@ -63,6 +64,8 @@ TYPE(pg_log_t)
 TYPE(pg_missing_t::item)
 TYPE(pg_missing_t)
 TYPE(pg_ls_response_t)
+TYPE(pg_ls_filter_t)
+TYPE(pg_ls_info_t)
 TYPE(object_copy_cursor_t)
 TYPE(object_copy_data_t)
 TYPE(pg_create_t)
@@ -95,6 +98,8 @@ TYPE(ECSubReadReply)
 TYPE(ExplicitHashHitSet)
 TYPE(ExplicitObjectHitSet)
 TYPE(BloomHitSet)
+TYPE(DecayBloomHitSet)
+TYPE(BlockedBloomHitSet)
 TYPE(HitSet)
 TYPE(HitSet::Params)
 
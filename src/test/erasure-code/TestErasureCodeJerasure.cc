@@ -20,10 +20,15 @@
 #include "include/stringify.h"
 #include "global/global_init.h"
 #include "erasure-code/jerasure/ErasureCodeJerasure.h"
+#include "erasure-code/jerasure/galois_simd.h"
 #include "common/ceph_argparse.h"
 #include "global/global_context.h"
 #include "gtest/gtest.h"
 
+extern "C" {
+#include "erasure-code/jerasure/galois.h"
+}
+
 template <typename T>
 class ErasureCodeTest : public ::testing::Test {
  public:
@@ -207,6 +212,60 @@ TYPED_TEST(ErasureCodeTest, minimum_to_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, encode_stripes)
+{
+  TypeParam jerasure;
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-k"] = "2";
+  parameters["erasure-code-m"] = "2";
+  parameters["erasure-code-w"] = "7";
+  parameters["erasure-code-packetsize"] = "8";
+  jerasure.init(parameters);
+
+  unsigned stripe_width = jerasure.get_alignment() * 2;
+  unsigned chunk_size = jerasure.get_chunk_size(stripe_width);
+  unsigned stripes = 5;
+  //
+  // The input is split over several buffers that do not match the
+  // stripe boundaries.
+  //
+  bufferlist in;
+  for (unsigned i = 0; i < stripes * stripe_width; i += 100) {
+    unsigned len = MIN(100, stripes * stripe_width - i);
+    string s;
+    for (unsigned j = 0; j < len; j++)
+      s.push_back('A' + (i + j) % 26);
+    in.append(s);
+  }
+  //
+  // Only some of the chunks are asked for, the others are computed
+  // in a scratch buffer.
+  //
+  set<int> want_to_encode;
+  want_to_encode.insert(1);
+  want_to_encode.insert(3);
+  map<int, bufferptr> encoded;
+  for (set<int>::iterator i = want_to_encode.begin();
+       i != want_to_encode.end();
+       ++i)
+    encoded[*i] = buffer::create_page_aligned(stripes * chunk_size);
+  EXPECT_EQ(0, jerasure.encode_stripes(want_to_encode, stripe_width, in,
+				       &encoded));
+  EXPECT_EQ(2u, encoded.size());
+  for (unsigned stripe = 0; stripe < stripes; stripe++) {
+    bufferlist bl;
+    bl.substr_of(in, stripe * stripe_width, stripe_width);
+    map<int, bufferlist> expected;
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, bl, &expected));
+    for (set<int>::iterator i = want_to_encode.begin();
+	 i != want_to_encode.end();
+	 ++i)
+      EXPECT_EQ(0, memcmp(expected[*i].c_str(),
+			  encoded[*i].c_str() + stripe * chunk_size,
+			  chunk_size));
+  }
+}
+
 TEST(ErasureCodeTest, encode)
 {
   ErasureCodeJerasureReedSolomonVandermonde jerasure;
@@ -259,6 +318,63 @@ TEST(ErasureCodeTest, encode)
   }
 }
 
+TEST(ErasureCodeTest, simd)
+{
+  const char *kernels[] = { "ssse3", "avx2", "neon" };
+  ASSERT_EQ(-ENOENT, galois_w08_simd_select("mmx"));
+
+  // region multiply: every multiplier, lengths with and without a tail
+  const int len = 1000;
+  unsigned char src[len], dst[len], ref[len];
+  for (int i = 0; i < len; ++i)
+    src[i] = rand();
+  for (unsigned k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    if (galois_w08_simd_select(kernels[k]) < 0) {
+      std::cout << kernels[k] << " not available" << std::endl;
+      continue;
+    }
+    for (int c = 0; c < 256; ++c) {
+      int nbytes = 8 * (1 + rand() % (len / 8));
+      for (int add = 0; add < 2; ++add) {
+	for (int i = 0; i < len; ++i)
+	  dst[i] = ref[i] = i;
+	ASSERT_EQ(0, galois_w08_simd_select("none"));
+	galois_w08_region_multiply((char*)src, c, nbytes, (char*)ref, add);
+	ASSERT_EQ(0, galois_w08_simd_select(kernels[k]));
+	galois_w08_region_multiply((char*)src, c, nbytes, (char*)dst, add);
+	ASSERT_EQ(0, memcmp(ref, dst, len)) << kernels[k] << " multby " << c
+					    << " nbytes " << nbytes
+					    << " add " << add;
+      }
+    }
+  }
+
+  // the encoded chunks do not depend on the kernel
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-k"] = "4";
+  parameters["erasure-code-m"] = "2";
+  parameters["erasure-code-w"] = "8";
+  ErasureCodeJerasureReedSolomonVandermonde jerasure;
+  jerasure.init(parameters);
+  bufferlist in;
+  for (int i = 0; i < 3 * (int)jerasure.get_alignment() + 100; ++i)
+    in.append((char)rand());
+  int want_to_encode[] = { 0, 1, 2, 3, 4, 5 };
+  set<int> want(want_to_encode, want_to_encode + 6);
+  map<int,bufferlist> ref_encoded;
+  ASSERT_EQ(0, galois_w08_simd_select("none"));
+  EXPECT_EQ(0, jerasure.encode(want, in, &ref_encoded));
+  for (unsigned k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+    if (galois_w08_simd_select(kernels[k]) < 0)
+      continue;
+    map<int,bufferlist> encoded;
+    EXPECT_EQ(0, jerasure.encode(want, in, &encoded));
+    for (int i = 0; i < 6; ++i)
+      EXPECT_TRUE(ref_encoded[i].contents_equal(encoded[i])) << kernels[k];
+  }
+  ASSERT_EQ(0, galois_w08_simd_select("auto"));
+}
+
 TEST(ErasureCodeTest, create_ruleset)
 {
   CrushWrapper *c = new CrushWrapper;
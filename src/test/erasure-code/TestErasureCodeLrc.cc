@@ -0,0 +1,238 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <errno.h>
+
+#include "include/stringify.h"
+#include "global/global_init.h"
+#include "erasure-code/ErasureCodePlugin.h"
+#include "erasure-code/lrc/ErasureCodeLrc.h"
+#include "common/ceph_argparse.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+static void init(ErasureCodeLrc &lrc, int k, int m, int l)
+{
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-directory"] = ".libs";
+  parameters["erasure-code-k"] = stringify(k);
+  parameters["erasure-code-m"] = stringify(m);
+  parameters["erasure-code-l"] = stringify(l);
+  ASSERT_EQ(0, lrc.init(parameters));
+}
+
+static set<int> all_but(int n, int a, int b = -1, int c = -1)
+{
+  set<int> s;
+  for (int i = 0; i < n; i++)
+    if (i != a && i != b && i != c)
+      s.insert(i);
+  return s;
+}
+
+TEST(ErasureCodeLrc, init)
+{
+  ErasureCodeLrc lrc;
+  init(lrc, 10, 4, 5);
+  EXPECT_EQ(16u, lrc.get_chunk_count());
+  EXPECT_EQ(10u, lrc.get_data_chunk_count());
+  EXPECT_EQ(2u, lrc.get_local_group_count());
+  EXPECT_EQ(lrc.global->get_chunk_size(4096), lrc.get_chunk_size(4096));
+  EXPECT_EQ(1, lrc.get_local_group(7));
+  EXPECT_EQ(-1, lrc.get_local_group(12));
+  EXPECT_EQ(1, lrc.get_local_group(15));
+
+  // the last group may be short
+  ErasureCodeLrc odd;
+  init(odd, 5, 2, 2);
+  EXPECT_EQ(10u, odd.get_chunk_count());
+  set<int> group;
+  odd.get_local_group_chunks(2, &group);
+  EXPECT_EQ(2u, group.size());
+  EXPECT_EQ(1u, group.count(4));
+  EXPECT_EQ(1u, group.count(9));
+
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-directory"] = ".libs";
+  parameters["erasure-code-k"] = "4";
+  parameters["erasure-code-l"] = "5";
+  ErasureCodeLrc bad;
+  EXPECT_EQ(-EINVAL, bad.init(parameters));
+}
+
+TEST(ErasureCodeLrc, minimum_to_decode)
+{
+  ErasureCodeLrc lrc;
+  init(lrc, 10, 4, 5);
+  int n = lrc.get_chunk_count();
+
+  // a lost data chunk is rebuilt from its local group
+  {
+    set<int> want, minimum;
+    want.insert(3);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all_but(n, 3), &minimum));
+    set<int> expected;
+    lrc.get_local_group_chunks(0, &expected);
+    expected.erase(3);
+    EXPECT_EQ(expected, minimum);
+  }
+  // and so is a lost local parity
+  {
+    set<int> want, minimum;
+    want.insert(15);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all_but(n, 15), &minimum));
+    EXPECT_EQ(5u, minimum.size());
+    EXPECT_EQ(0u, minimum.count(4));
+  }
+  // each of two groups repairs its own
+  {
+    set<int> want, minimum;
+    want.insert(1);
+    want.insert(8);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all_but(n, 1, 8), &minimum));
+    EXPECT_EQ(10u, minimum.size());
+    for (int i = 10; i < 14; i++)
+      EXPECT_EQ(0u, minimum.count(i));
+  }
+  // two lost in a group need the global code
+  {
+    set<int> want, minimum;
+    want.insert(1);
+    want.insert(2);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all_but(n, 1, 2), &minimum));
+    EXPECT_EQ(10u, minimum.size());
+    EXPECT_EQ(0u, minimum.count(1));
+    EXPECT_EQ(0u, minimum.count(2));
+  }
+  // and so does a global parity
+  {
+    set<int> want, minimum;
+    want.insert(11);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all_but(n, 11), &minimum));
+    EXPECT_EQ(10u, minimum.size());
+  }
+  // available chunks are read as they are
+  {
+    set<int> want, minimum;
+    want.insert(2);
+    want.insert(12);
+    EXPECT_EQ(0, lrc.minimum_to_decode(want, all_but(n, 3), &minimum));
+    EXPECT_EQ(want, minimum);
+  }
+  // not enough left
+  {
+    set<int> want, available, minimum;
+    want.insert(0);
+    for (int i = 5; i < 10; i++)
+      available.insert(i);
+    EXPECT_EQ(-EIO, lrc.minimum_to_decode(want, available, &minimum));
+  }
+}
+
+TEST(ErasureCodeLrc, encode_decode)
+{
+  ErasureCodeLrc lrc;
+  init(lrc, 4, 2, 2);
+  int n = lrc.get_chunk_count();
+  ASSERT_EQ(8, n);
+
+  bufferlist in;
+  for (int i = 0; i < 4 * 4096 + 17; i++)
+    in.append((char)rand());
+  set<int> want_to_encode = all_but(n, -1);
+  map<int, bufferlist> encoded;
+  ASSERT_EQ(0, lrc.encode(want_to_encode, in, &encoded));
+  ASSERT_EQ((unsigned)n, encoded.size());
+  unsigned length = encoded[0].length();
+  for (int i = 0; i < n; i++)
+    EXPECT_EQ(length, encoded[i].length());
+  bufferlist data;
+  for (int i = 0; i < 4; i++)
+    data.append(encoded[i]);
+  EXPECT_EQ(0, memcmp(data.c_str(), in.c_str(), in.length()));
+
+  // every single and double erasure, and the triple ones the groups
+  // bring down to two
+  int decoded_triples = 0;
+  for (int a = 0; a < n; a++) {
+    for (int b = a; b < n; b++) {
+      for (int c = b; c < n; c++) {
+	set<int> available = all_but(n, a, b, c);
+	set<int> want;
+	want.insert(a);
+	want.insert(b);
+	want.insert(c);
+	set<int> minimum;
+	int r = lrc.minimum_to_decode(want, available, &minimum);
+	if (a == b || b == c) {
+	  ASSERT_EQ(0, r) << a << " " << b << " " << c;
+	} else if (r) {
+	  continue;
+	} else {
+	  decoded_triples++;
+	}
+	map<int, bufferlist> chunks;
+	for (set<int>::iterator i = minimum.begin(); i != minimum.end(); ++i) {
+	  ASSERT_TRUE(available.count(*i));
+	  chunks[*i] = encoded[*i];
+	}
+	map<int, bufferlist> decoded;
+	ASSERT_EQ(0, lrc.decode(want, chunks, &decoded))
+	  << a << " " << b << " " << c;
+	for (set<int>::iterator i = want.begin(); i != want.end(); ++i)
+	  ASSERT_TRUE(decoded[*i].contents_equal(encoded[*i]))
+	    << *i << " lost " << a << " " << b << " " << c;
+      }
+    }
+  }
+  EXPECT_LT(0, decoded_triples);
+}
+
+TEST(ErasureCodeLrc, plugin)
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  map<std::string,std::string> parameters;
+  parameters["erasure-code-directory"] = ".libs";
+  parameters["erasure-code-k"] = "6";
+  parameters["erasure-code-m"] = "3";
+  parameters["erasure-code-l"] = "3";
+  ErasureCodeInterfaceRef erasure_code;
+  EXPECT_EQ(0, instance.factory("lrc", parameters, &erasure_code));
+  ASSERT_TRUE(erasure_code);
+  EXPECT_EQ(11u, erasure_code->get_chunk_count());
+
+  parameters["erasure-code-lrc-plugin"] = "nonexistent";
+  ErasureCodeInterfaceRef bad;
+  EXPECT_NE(0, instance.factory("lrc", parameters, &bad));
+  EXPECT_FALSE(bad);
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 &&
+ *   make unittest_erasure_code_lrc &&
+ *   valgrind --tool=memcheck ./unittest_erasure_code_lrc \
+ *      --gtest_filter=*.* --log-to-stderr=true --debug-osd=20"
+ * End:
+ */
@@ -31,6 +31,7 @@
 #include "common/Clock.h"
 #include "include/utime.h"
 #include "erasure-code/ErasureCodePlugin.h"
+#include "osd/ECUtil.h"
 
 namespace po = boost::program_options;
 
@@ -46,9 +47,18 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("plugin,p", po::value<string>()->default_value("jerasure"),
      "erasure code plugin name")
     ("workload,w", po::value<string>()->default_value("encode"),
-     "run either encode or decode")
+     "run encode, decode, minimum_to_decode, ecutil-encode or ecutil-decode")
     ("erasures,e", po::value<int>()->default_value(1),
      "number of erasures when decoding")
+    ("erasures-generation,E", po::value<string>()->default_value("random"),
+     "random: erase different chunks on every iteration, "
+     "data: erase the first data chunks, "
+     "exhaustive: time every combination of erased chunks separately")
+    ("erased", po::value<vector<int> >(),
+     "erase this chunk when decoding, may be repeated (overrides --erasures)")
+    ("stripe-width,S", po::value<int>()->default_value(0),
+     "stripe width of the ecutil workloads, "
+     "defaults to osd_pool_erasure_code_stripe_width")
     ("parameter,P", po::value<vector<string> >(),
      "parameters")
     ;
@@ -106,6 +116,12 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   plugin = vm["plugin"].as<string>();
   workload = vm["workload"].as<string>();
   erasures = vm["erasures"].as<int>();
+  erasures_generation = vm["erasures-generation"].as<string>();
+  if (vm.count("erased")) {
+    const vector<int> &e = vm["erased"].as< vector<int> >();
+    erased.insert(e.begin(), e.end());
+  }
+  stripe_width = vm["stripe-width"].as<int>();
 
   return 0;
 }
@@ -113,22 +129,132 @@ int ErasureCodeBench::setup(int argc, char** argv) {
 int ErasureCodeBench::run() {
   ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
   instance.disable_dlclose = true;
+  int code = instance.factory(plugin, parameters, &erasure_code);
+  if (code)
+    return code;
 
   if (workload == "encode")
     return encode();
-  else
+  else if (workload == "decode")
     return decode();
+  else if (workload == "minimum_to_decode")
+    return minimum_to_decode();
+  else if (workload == "ecutil-encode")
+    return ecutil_encode();
+  else if (workload == "ecutil-decode")
+    return ecutil_decode();
+  cerr << "unknown workload " << workload << std::endl;
+  return -EINVAL;
+}
+
+/*
+ * Print the elapsed seconds, the amount of work done and the rate,
+ * which is per core since everything runs in one thread. The amount
+ * is in KB and the rate in GB/s, except for minimum_to_decode where
+ * they are calls and calls per second. The erased chunks follow when
+ * they were the same for every iteration.
+ */
+void ErasureCodeBench::report(utime_t elapsed, uint64_t amount,
+			      const set<int> *pattern)
+{
+  double seconds = elapsed;
+  double rate;
+  if (workload == "minimum_to_decode") {
+    cout << elapsed << "\t" << amount;
+    rate = seconds > 0 ? amount / seconds : 0;
+  } else {
+    cout << elapsed << "\t" << (amount / 1024);
+    rate = seconds > 0 ? amount / seconds / 1000000000.0 : 0;
+  }
+  cout << "\t" << rate;
+  if (pattern) {
+    cout << "\t";
+    for (set<int>::const_iterator i = pattern->begin();
+	 i != pattern->end();
+	 ++i)
+      cout << (i == pattern->begin() ? "" : ",") << *i;
+  }
+  cout << endl;
+}
+
+void ErasureCodeBench::random_erasures(set<int> *pattern)
+{
+  int chunk_count = erasure_code->get_chunk_count();
+  pattern->clear();
+  while ((int)pattern->size() < erasures)
+    pattern->insert(rand() % chunk_count);
+}
+
+/*
+ * The erasures to time, each timed separately. An empty result means
+ * new random erasures for every iteration.
+ */
+int ErasureCodeBench::erasure_patterns(vector<set<int> > *patterns)
+{
+  int chunk_count = erasure_code->get_chunk_count();
+  int coding_count = chunk_count - erasure_code->get_data_chunk_count();
+
+  if (!erased.empty()) {
+    for (set<int>::iterator i = erased.begin(); i != erased.end(); ++i) {
+      if (*i < 0 || *i >= chunk_count) {
+	cerr << "--erased " << *i << " is not a chunk" << endl;
+	return -EINVAL;
+      }
+    }
+    patterns->push_back(erased);
+    return 0;
+  }
+  if (erasures < 0 || erasures > coding_count) {
+    cerr << "--erasures " << erasures << " must be between 0 and "
+	 << coding_count << endl;
+    return -EINVAL;
+  }
+  if (erasures_generation == "random") {
+    return 0;
+  } else if (erasures_generation == "data") {
+    // rebuilding data chunks is the expensive case for MDS codes
+    set<int> pattern;
+    for (int i = 0; i < erasures; i++)
+      pattern.insert(i);
+    patterns->push_back(pattern);
+    return 0;
+  } else if (erasures_generation == "exhaustive") {
+    // every combination the code can recover from (codes that are not
+    // MDS, such as lrc, cannot recover from all of them), in
+    // lexicographic order
+    set<int> all;
+    for (int i = 0; i < chunk_count; i++)
+      all.insert(i);
+    vector<int> c;
+    for (int i = 0; i < erasures; i++)
+      c.push_back(i);
+    while (true) {
+      set<int> pattern(c.begin(), c.end());
+      set<int> available, minimum;
+      for (int i = 0; i < chunk_count; i++)
+	if (!pattern.count(i))
+	  available.insert(i);
+      if (erasure_code->minimum_to_decode(all, available, &minimum) == 0)
+	patterns->push_back(pattern);
+      int i = erasures - 1;
+      while (i >= 0 && c[i] == chunk_count - erasures + i)
+	i--;
+      if (i < 0)
+	break;
+      c[i]++;
+      for (int j = i + 1; j < erasures; j++)
+	c[j] = c[j - 1] + 1;
+    }
+    return 0;
+  }
+  cerr << "unknown --erasures-generation " << erasures_generation << endl;
+  return -EINVAL;
 }
 
 int ErasureCodeBench::encode()
 {
-  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
-  ErasureCodeInterfaceRef erasure_code;
-  int code = instance.factory(plugin, parameters, &erasure_code);
-  if (code)
-    return code;
-  int k = atoi(parameters["erasure-code-k"].c_str());
-  int m = atoi(parameters["erasure-code-m"].c_str());
+  int k = erasure_code->get_data_chunk_count();
+  int m = erasure_code->get_chunk_count() - k;
 
   bufferlist in;
   in.append(string(in_size, 'X'));
@@ -139,24 +265,19 @@ int ErasureCodeBench::encode()
   utime_t begin_time = ceph_clock_now(g_ceph_context);
   for (int i = 0; i < max_iterations; i++) {
     map<int,bufferlist> encoded;
-    code = erasure_code->encode(want_to_encode, in, &encoded);
+    int code = erasure_code->encode(want_to_encode, in, &encoded);
     if (code)
       return code;
   }
   utime_t end_time = ceph_clock_now(g_ceph_context);
-  cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  report(end_time - begin_time, (uint64_t)max_iterations * in_size, NULL);
   return 0;
 }
 
 int ErasureCodeBench::decode()
 {
-  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
-  ErasureCodeInterfaceRef erasure_code;
-  int code = instance.factory(plugin, parameters, &erasure_code);
-  if (code)
-    return code;
-  int k = atoi(parameters["erasure-code-k"].c_str());
-  int m = atoi(parameters["erasure-code-m"].c_str());
+  int k = erasure_code->get_data_chunk_count();
+  int m = erasure_code->get_chunk_count() - k;
 
   bufferlist in;
   in.append(string(in_size, 'X'));
@@ -167,29 +288,167 @@ int ErasureCodeBench::decode()
   }
 
   map<int,bufferlist> encoded;
-  code = erasure_code->encode(want_to_encode, in, &encoded);
+  int code = erasure_code->encode(want_to_encode, in, &encoded);
   if (code)
     return code;
 
   set<int> want_to_read = want_to_encode;
 
+  vector<set<int> > patterns;
+  code = erasure_patterns(&patterns);
+  if (code)
+    return code;
+  bool random = patterns.empty();
+  if (random)
+    patterns.push_back(set<int>());
+
+  for (vector<set<int> >::iterator p = patterns.begin();
+       p != patterns.end();
+       ++p) {
+    utime_t begin_time = ceph_clock_now(g_ceph_context);
+    for (int i = 0; i < max_iterations; i++) {
+      if (random)
+	random_erasures(&*p);
+      map<int,bufferlist> chunks = encoded;
+      for (set<int>::iterator j = p->begin(); j != p->end(); ++j)
+	chunks.erase(*j);
+      map<int,bufferlist> decoded;
+      code = erasure_code->decode(want_to_read, chunks, &decoded);
+      if (code)
+	return code;
+    }
+    utime_t end_time = ceph_clock_now(g_ceph_context);
+    report(end_time - begin_time, (uint64_t)max_iterations * in_size,
+	   random ? NULL : &*p);
+  }
+  return 0;
+}
+
+int ErasureCodeBench::minimum_to_decode()
+{
+  int k = erasure_code->get_data_chunk_count();
+  int chunk_count = erasure_code->get_chunk_count();
+
+  // what a primary reading an object asks for
+  set<int> want_to_read;
+  for (int i = 0; i < k; i++)
+    want_to_read.insert(i);
+
+  vector<set<int> > patterns;
+  int code = erasure_patterns(&patterns);
+  if (code)
+    return code;
+  bool random = patterns.empty();
+  if (random)
+    patterns.push_back(set<int>());
+
+  for (vector<set<int> >::iterator p = patterns.begin();
+       p != patterns.end();
+       ++p) {
+    set<int> available;
+    utime_t begin_time = ceph_clock_now(g_ceph_context);
+    for (int i = 0; i < max_iterations; i++) {
+      if (random || i == 0) {
+	if (random)
+	  random_erasures(&*p);
+	available.clear();
+	for (int j = 0; j < chunk_count; j++)
+	  if (!p->count(j))
+	    available.insert(j);
+      }
+      set<int> minimum;
+      code = erasure_code->minimum_to_decode(want_to_read, available, &minimum);
+      if (code)
+	return code;
+    }
+    utime_t end_time = ceph_clock_now(g_ceph_context);
+    report(end_time - begin_time, max_iterations, random ? NULL : &*p);
+  }
+  return 0;
+}
+
+/*
+ * The ecutil workloads go through the ECUtil helpers the OSD uses,
+ * with the object cut in stripes of stripe_width bytes, so they also
+ * account for the per stripe overhead that encode and decode of the
+ * whole buffer at once do not show.
+ */
+static ECUtil::stripe_info_t make_stripe_info(ErasureCodeInterfaceRef &ec,
+					      int stripe_width)
+{
+  unsigned k = ec->get_data_chunk_count();
+  if (stripe_width <= 0)
+    stripe_width = g_conf->osd_pool_erasure_code_stripe_width;
+  // as OSDMonitor::prepare_pool_stripe_width does for a new pool
+  uint64_t width = k * ec->get_chunk_size(stripe_width);
+  return ECUtil::stripe_info_t(k, width);
+}
+
+int ErasureCodeBench::ecutil_encode()
+{
+  ECUtil::stripe_info_t sinfo = make_stripe_info(erasure_code, stripe_width);
+  uint64_t size = sinfo.logical_to_next_stripe_offset(in_size);
+
+  bufferlist in;
+  in.append(string(size, 'X'));
+  set<int> want;
+  for (unsigned i = 0; i < erasure_code->get_chunk_count(); i++)
+    want.insert(i);
+
   utime_t begin_time = ceph_clock_now(g_ceph_context);
   for (int i = 0; i < max_iterations; i++) {
-    map<int,bufferlist> chunks = encoded;
-    for (int j = 0; j < erasures; j++) {
-      int erasure;
-      do {
-	erasure = rand() % ( k + m );
-      } while(chunks.count(erasure) == 0);
-      chunks.erase(erasure);
-    }
-    map<int,bufferlist> decoded;
-    code = erasure_code->decode(want_to_read, chunks, &decoded);
+    map<int, bufferlist> encoded;
+    int code = ECUtil::encode(sinfo, erasure_code, in, want, &encoded);
     if (code)
       return code;
   }
   utime_t end_time = ceph_clock_now(g_ceph_context);
-  cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  report(end_time - begin_time, (uint64_t)max_iterations * size, NULL);
+  return 0;
+}
+
+int ErasureCodeBench::ecutil_decode()
+{
+  ECUtil::stripe_info_t sinfo = make_stripe_info(erasure_code, stripe_width);
+  uint64_t size = sinfo.logical_to_next_stripe_offset(in_size);
+
+  bufferlist in;
+  in.append(string(size, 'X'));
+  set<int> want;
+  for (unsigned i = 0; i < erasure_code->get_chunk_count(); i++)
+    want.insert(i);
+  map<int, bufferlist> encoded;
+  int code = ECUtil::encode(sinfo, erasure_code, in, want, &encoded);
+  if (code)
+    return code;
+
+  vector<set<int> > patterns;
+  code = erasure_patterns(&patterns);
+  if (code)
+    return code;
+  bool random = patterns.empty();
+  if (random)
+    patterns.push_back(set<int>());
+
+  for (vector<set<int> >::iterator p = patterns.begin();
+       p != patterns.end();
+       ++p) {
+    utime_t begin_time = ceph_clock_now(g_ceph_context);
+    for (int i = 0; i < max_iterations; i++) {
+      if (random)
+	random_erasures(&*p);
+      map<int, bufferlist> to_decode = encoded;
+      for (set<int>::iterator j = p->begin(); j != p->end(); ++j)
+	to_decode.erase(*j);
+      bufferlist out;
+      code = ECUtil::decode(sinfo, erasure_code, to_decode, &out);
+      if (code)
+	return code;
+    }
+    utime_t end_time = ceph_clock_now(g_ceph_context);
+    report(end_time - begin_time, (uint64_t)max_iterations * size,
+	   random ? NULL : &*p);
+  }
   return 0;
 }
 
@@ -18,6 +18,12 @@
 #define CEPH_ERASURE_CODE_BENCHMARK_H
 
 #include <string>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "include/utime.h"
+#include "erasure-code/ErasureCodeInterface.h"
 
 using namespace std;
 
@@ -26,13 +32,24 @@ class ErasureCodeBench {
   int max_iterations;
   string plugin;
   int erasures;
+  string erasures_generation;
+  set<int> erased;
+  int stripe_width;
   string workload;
   map<string,string> parameters;
+  ErasureCodeInterfaceRef erasure_code;
+
+  int erasure_patterns(vector<set<int> > *patterns);
+  void random_erasures(set<int> *pattern);
+  void report(utime_t elapsed, uint64_t amount, const set<int> *pattern);
 public:
   int setup(int argc, char** argv);
   int run();
   int decode();
   int encode();
+  int minimum_to_decode();
+  int ecutil_encode();
+  int ecutil_decode();
 };
 
 #endif
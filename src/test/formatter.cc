@@ -20,6 +20,13 @@
 
 using std::ostringstream;
 
+struct StringSink : public FormatterSink {
+  std::string out;
+  void write_formatted(const char *data, size_t len) {
+    out.append(data, len);
+  }
+};
+
 TEST(JsonFormatter, Simple1) {
   ostringstream oss;
   JSONFormatter fmt(false);
@@ -178,3 +185,40 @@ TEST(XmlFormatter, NamespaceTest) {
     "<foo xmlns=\"http://s3.amazonaws.com/doc/2006-03-01/\">"
     "<blah>hithere</blah><pi>3.14</pi></foo>");
 }
+
+TEST(JsonFormatter, Sink) {
+  StringSink sink;
+  JSONFormatter fmt(false);
+  fmt.set_sink(&sink, 8);
+
+  fmt.open_array_section("foo");
+  fmt.open_object_section("a");
+  fmt.dump_string("name", "first");
+  fmt.close_section();
+  ASSERT_EQ(sink.out, "[{\"name\":\"first\"}");
+  ASSERT_EQ(fmt.get_len(), 0);
+  fmt.dump_int("b", 1);
+  ASSERT_EQ(fmt.get_len(), 2);
+  fmt.close_section();
+
+  ostringstream oss;
+  fmt.flush(oss);
+  ASSERT_EQ(sink.out + oss.str(), "[{\"name\":\"first\"},1]");
+}
+
+TEST(XmlFormatter, Sink) {
+  StringSink sink;
+  XMLFormatter fmt(false);
+  fmt.set_sink(&sink, 1024);
+
+  fmt.open_array_section("foo");
+  fmt.dump_string("blah", "hithere");
+  fmt.close_section();
+  ASSERT_EQ(sink.out, "");
+
+  fmt.set_sink(&sink, 1);
+  fmt.open_array_section("bar");
+  fmt.close_section();
+  ASSERT_EQ(sink.out, "<foo><blah>hithere</blah></foo><bar></bar>");
+  ASSERT_EQ(fmt.get_len(), 0);
+}
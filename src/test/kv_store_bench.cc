@@ -26,6 +26,7 @@ KvStoreBench::KvStoreBench()
   key_size(5),
   val_size(7),
   max_ops_in_flight(8),
+  batch_size(0),
   clear_first(false),
   k(2),
   cache_size(10),
@@ -84,6 +85,9 @@ int KvStoreBench::setup(int argc, const char** argv) {
       << "                                                 (default " << max_ops_in_flight << ")\n"
       << "   --clients <number>                            tells this instance how many total clients are. Note that\n"
       << "                                                 changing this does not change the number of clients."
+      << "   --batch <number>                              instead of the workload, compare the throughput of\n"
+      << "                                                 single key sets and gets with set_many and get_many\n"
+      << "                                                 of this many keys\n"
       << "   -d <insert> <update> <delete> <read>          percent (1-100) of operations that should be of each type\n"
       << "                                                 (default 25 25 25 25)\n"
       << "   -r <number>                                   random seed to use (default time(0))\n"
@@ -115,6 +119,8 @@ int KvStoreBench::setup(int argc, const char** argv) {
 	cache_refresh = 100 / atoi(args[i+1]);
       } else if (strcmp(args[i], "-t") == 0) {
 	max_ops_in_flight = atoi(args[i+1]);
+      } else if (strcmp(args[i], "--batch") == 0) {
+	batch_size = atoi(args[i+1]);
       } else if (strcmp(args[i], "--clients") == 0) {
 	clients = atoi(args[i+1]);
       } else if (strcmp(args[i], "-d") == 0) {
@@ -525,6 +531,98 @@ int KvStoreBench::test_teuthology_sync(next_gen_t distr,
   return err;
 }
 
+static void print_throughput(const string &name, int ops, StopWatch &sw)
+{
+  double ms = sw.get_time();
+  cout << name << ": " << ops << " ops in " << ms << " ms, "
+       << (ms > 0 ? ops * 1000 / ms : 0) << " ops/s" << std::endl;
+}
+
+int KvStoreBench::test_batch() {
+  int err = test_random_insertions();
+  if (err < 0) {
+    return err;
+  }
+
+  //the same number of new keys and of existing keys for each pass
+  vector<map<string, bufferlist> > sets(2);
+  vector<std::set<string> > gets(2);
+  for (int pass = 0; pass < 2; pass++) {
+    while ((int)sets[pass].size() < ops) {
+      sets[pass].insert(rand_distr(true));
+    }
+    while ((int)gets[pass].size() < ops && gets[pass].size() < key_set.size()) {
+      gets[pass].insert(rand_distr(false).first);
+    }
+  }
+
+  StopWatch sw;
+  sw.start_time();
+  for (map<string, bufferlist>::iterator it = sets[0].begin();
+      it != sets[0].end(); ++it) {
+    err = kvs->set(it->first, it->second, true);
+    if (err < 0) {
+      cout << "Error setting " << it->first << ": " << err << std::endl;
+      return err;
+    }
+  }
+  sw.stop_time();
+  print_throughput("set", sets[0].size(), sw);
+
+  sw.clear();
+  sw.start_time();
+  map<string, bufferlist> batch;
+  for (map<string, bufferlist>::iterator it = sets[1].begin();
+      it != sets[1].end(); ++it) {
+    batch.insert(*it);
+    if ((int)batch.size() == batch_size || it == --sets[1].end()) {
+      err = kvs->set_many(batch);
+      if (err < 0) {
+	cout << "Error in set_many: " << err << std::endl;
+	return err;
+      }
+      batch.clear();
+    }
+  }
+  sw.stop_time();
+  print_throughput("set_many", sets[1].size(), sw);
+
+  sw.clear();
+  sw.start_time();
+  for (std::set<string>::iterator it = gets[0].begin();
+      it != gets[0].end(); ++it) {
+    bufferlist val;
+    err = kvs->get(*it, &val);
+    if (err < 0 && err != -61) {
+      cout << "Error getting " << *it << ": " << err << std::endl;
+      return err;
+    }
+  }
+  sw.stop_time();
+  print_throughput("get", gets[0].size(), sw);
+
+  sw.clear();
+  sw.start_time();
+  std::set<string> keys;
+  for (std::set<string>::iterator it = gets[1].begin();
+      it != gets[1].end(); ++it) {
+    keys.insert(*it);
+    if ((int)keys.size() == batch_size || it == --gets[1].end()) {
+      map<string, bufferlist> vals;
+      err = kvs->get_many(keys, &vals);
+      if (err < 0) {
+	cout << "Error in get_many: " << err << std::endl;
+	return err;
+      }
+      keys.clear();
+    }
+  }
+  sw.stop_time();
+  print_throughput("get_many", gets[1].size(), sw);
+
+  return 0;
+}
+
 void KvStoreBench::print_time_data() {
   cout << "========================================================\n";
   cout << "latency:" << std::endl;
@@ -538,7 +636,9 @@ void KvStoreBench::print_time_data() {
 
 int KvStoreBench::teuthology_tests() {
   int err = 0;
-  if (max_ops_in_flight > 1) {
+  if (batch_size > 1) {
+    err = test_batch();
+  } else if (max_ops_in_flight > 1) {
     test_teuthology_aio(&KvStoreBench::rand_distr, probs);
   } else {
     err = test_teuthology_sync(&KvStoreBench::rand_distr, probs);
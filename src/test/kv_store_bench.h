@@ -101,6 +101,7 @@ protected:
   int key_size;//number of characters in keys to write
   int val_size;//number of characters in values to write
   int max_ops_in_flight;
+  int batch_size;//if > 1, compare single key ops with batches of this size
   bool clear_first;//if true, remove all objects in pool before starting tests
 
   //variables passed to KeyValueStructure
@@ -171,6 +172,13 @@ public:
    */
   int test_teuthology_sync(next_gen_t distr, const map<int, char> &probs);
 
+  /**
+   * calls test_random_insertions, then sets ops new keys and gets ops
+   * existing keys one at a time, then again batch_size at a time with
+   * set_many and get_many, and prints the throughput of each.
+   */
+  int test_batch();
+
   /**
    * returns a key-value pair. If new_elem is true, the key is randomly
    * generated. If it is false, the key is selected from the keys currently in
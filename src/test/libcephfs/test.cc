@@ -879,6 +879,53 @@ TEST(LibCephFS, ReadEmptyFile) {
   ceph_shutdown(cmount);
 }
 
+TEST(LibCephFS, PreadvPwritev) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(ceph_create(&cmount, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(ceph_conf_read_file(cmount, NULL), 0);
+  ASSERT_EQ(ceph_mount(cmount, NULL), 0);
+
+  int mypid = getpid();
+  char testf[256];
+
+  sprintf(testf, "test_preadvpwritev%d", mypid);
+  int fd = ceph_open(cmount, testf, O_CREAT|O_TRUNC|O_RDWR, 0644);
+  ASSERT_GT(fd, 0);
+
+  char out0[] = "hello ";
+  char out1[] = "world";
+  struct iovec iov_out[2] = {
+    {out0, sizeof(out0) - 1},
+    {out1, sizeof(out1)},
+  };
+  ssize_t nwritten = iov_out[0].iov_len + iov_out[1].iov_len;
+  ASSERT_EQ(ceph_pwritev(cmount, fd, iov_out, 2, 0), nwritten);
+
+  char in0[3];
+  char in1[sizeof(out0) + sizeof(out1)];
+  struct iovec iov_in[2] = {
+    {in0, sizeof(in0)},
+    {in1, sizeof(in1)},
+  };
+  ASSERT_EQ(ceph_preadv(cmount, fd, iov_in, 2, 0), nwritten);
+  ASSERT_EQ(0, strncmp(in0, "hel", 3));
+  ASSERT_STREQ(in1, "lo world");
+
+  ceph_close(cmount, fd);
+
+  // O_DIRECT goes around the object cache but sees the same data
+  fd = ceph_open(cmount, testf, O_RDWR|O_DIRECT, 0);
+  ASSERT_GT(fd, 0);
+  ASSERT_EQ(ceph_write(cmount, fd, "W", 1, 6), 1);
+  char buf[32];
+  ASSERT_EQ(ceph_read(cmount, fd, buf, sizeof(buf), 0), nwritten);
+  ASSERT_STREQ(buf, "hello World");
+
+  ceph_close(cmount, fd);
+  ceph_shutdown(cmount);
+}
+
 TEST(LibCephFS, StripeUnitGran) {
   struct ceph_mount_info *cmount;
   ASSERT_EQ(ceph_create(&cmount, NULL), 0);
@@ -6,6 +6,7 @@
 #include "gtest/gtest.h"
 #include <errno.h>
 #include <semaphore.h>
+#include <set>
 #include <sstream>
 #include <string>
 #include <boost/scoped_ptr.hpp>
@@ -784,6 +785,88 @@ TEST(LibRadosAio, FlushAsyncPP) {
   delete flush_completion;
 }
 
+TEST(LibRadosAio, CompletionQueue) {
+  AioTestData test_data;
+  ASSERT_EQ("", test_data.init());
+  rados_completion_queue_t cq;
+  ASSERT_EQ(0, rados_aio_create_completion_queue(&cq));
+  rados_completion_t done[4];
+  ASSERT_EQ(0, rados_aio_completion_queue_poll(cq, done, 4));
+
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  rados_completion_t c[3];
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_EQ(0, rados_aio_create_queued_completion(cq, &c[i]));
+    ASSERT_EQ(0, rados_aio_write(test_data.m_ioctx, "foo",
+				 c[i], buf, sizeof(buf), i * sizeof(buf)));
+  }
+  std::set<rados_completion_t> reaped;
+  {
+    TestAlarm alarm;
+    while (reaped.size() < 3) {
+      int n = rados_aio_completion_queue_wait(cq, done, 4);
+      ASSERT_LT(0, n);
+      for (int i = 0; i < n; ++i) {
+	ASSERT_EQ(1, rados_aio_is_complete(done[i]));
+	ASSERT_EQ(0, rados_aio_get_return_value(done[i]));
+	ASSERT_TRUE(reaped.insert(done[i]).second);
+      }
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_EQ(1u, reaped.count(c[i]));
+    rados_aio_release(c[i]);
+  }
+  ASSERT_EQ(0, rados_aio_completion_queue_poll(cq, done, 4));
+
+  // released before it was reaped: never handed back
+  rados_completion_t dropped;
+  ASSERT_EQ(0, rados_aio_create_queued_completion(cq, &dropped));
+  ASSERT_EQ(0, rados_aio_write(test_data.m_ioctx, "foo",
+			       dropped, buf, sizeof(buf), 0));
+  rados_aio_release(dropped);
+  ASSERT_EQ(0, rados_aio_flush(test_data.m_ioctx));
+  ASSERT_EQ(0, rados_aio_completion_queue_poll(cq, done, 4));
+  rados_aio_completion_queue_release(cq);
+}
+
+TEST(LibRadosAio, CompletionQueuePP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+  AioCompletionQueue cq;
+  char buf[128];
+  memset(buf, 0xee, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  AioCompletion *write_completion = cq.create_completion();
+  ASSERT_EQ(0, test_data.m_ioctx.aio_write("foo", write_completion,
+					   bl1, sizeof(buf), 0));
+  std::list<AioCompletion*> ls;
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(1, cq.wait(&ls, 4));
+  }
+  ASSERT_EQ(write_completion, ls.front());
+  ASSERT_EQ(0, write_completion->get_return_value());
+  write_completion->release();
+
+  bufferlist bl2;
+  AioCompletion *read_completion = cq.create_completion();
+  ASSERT_EQ(0, test_data.m_ioctx.aio_read("foo", read_completion,
+					  &bl2, sizeof(buf), 0));
+  ls.clear();
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(1, cq.wait(&ls, 4));
+  }
+  ASSERT_EQ(read_completion, ls.front());
+  ASSERT_EQ((int)sizeof(buf), read_completion->get_return_value());
+  ASSERT_EQ(0, memcmp(buf, bl2.c_str(), sizeof(buf)));
+  read_completion->release();
+  ASSERT_EQ(0, cq.poll(&ls, 4));
+}
+
 TEST(LibRadosAio, RoundTripWriteFull) {
   AioTestData test_data;
   rados_completion_t my_completion, my_completion2, my_completion3;
@@ -870,6 +953,61 @@ TEST(LibRadosAio, RoundTripWriteFullPP) {
 }
 
 
+TEST(LibRadosAio, OperationBatchPP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl;
+  bl.append(buf, sizeof(buf));
+
+  const int num_objects = 16;
+  OperationBatch batch;
+  ObjectWriteOperation writes[num_objects];
+  for (int i = 0; i < num_objects; ++i) {
+    ostringstream oss;
+    oss << "foo" << i;
+    writes[i].write_full(bl);
+    batch.aio_operate(oss.str(), NULL, &writes[i], 0);
+  }
+  ASSERT_EQ((size_t)num_objects, batch.size());
+  AioCompletion *write_completion =
+    test_data.m_cluster.aio_create_completion(NULL, NULL, NULL);
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(&batch, write_completion));
+  ASSERT_EQ(0u, batch.size());
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, write_completion->wait_for_safe());
+  }
+  ASSERT_EQ(0, write_completion->get_return_value());
+  write_completion->release();
+
+  ObjectReadOperation reads[num_objects];
+  bufferlist read_bls[num_objects];
+  AioCompletion *read_completions[num_objects];
+  for (int i = 0; i < num_objects; ++i) {
+    ostringstream oss;
+    oss << "foo" << i;
+    reads[i].read(0, sizeof(buf), NULL, NULL);
+    read_completions[i] =
+      test_data.m_cluster.aio_create_completion(NULL, NULL, NULL);
+    batch.aio_operate(oss.str(), read_completions[i], &reads[i], 0,
+		      &read_bls[i]);
+  }
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(&batch, NULL));
+  for (int i = 0; i < num_objects; ++i) {
+    {
+      TestAlarm alarm;
+      ASSERT_EQ(0, read_completions[i]->wait_for_complete());
+    }
+    ASSERT_LE(0, read_completions[i]->get_return_value());
+    ASSERT_EQ(sizeof(buf), read_bls[i].length());
+    ASSERT_EQ(0, memcmp(read_bls[i].c_str(), buf, sizeof(buf)));
+    read_completions[i]->release();
+  }
+}
+
+
 TEST(LibRadosAio, SimpleStat) {
   AioTestData test_data;
   rados_completion_t my_completion;
@@ -47,6 +47,105 @@ TEST_F(LibRadosListPP, ListObjectsPP) {
   ASSERT_TRUE(foundit);
 }
 
+TEST_F(LibRadosList, ListObjectsShard) {
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  std::set<std::string> written;
+  for (int i = 0; i < 64; ++i) {
+    std::string oid = "foo" + stringify(i);
+    ASSERT_EQ((int)sizeof(buf), rados_write(ioctx, oid.c_str(), buf,
+					    sizeof(buf), 0));
+    written.insert(oid);
+  }
+
+  rados_list_ctx_t ctx;
+  ASSERT_EQ(-EINVAL, rados_objects_list_open_shard(ioctx, 4, 4, &ctx));
+
+  // every object is listed by exactly one shard
+  std::set<std::string> listed;
+  for (uint32_t shard = 0; shard < 4; ++shard) {
+    ASSERT_EQ(0, rados_objects_list_open_shard(ioctx, shard, 4, &ctx));
+    const char *entry;
+    while (rados_objects_list_next(ctx, &entry, NULL) != -ENOENT) {
+      ASSERT_TRUE(listed.insert(std::string(entry)).second);
+    }
+    rados_objects_list_close(ctx);
+  }
+  ASSERT_TRUE(written == listed);
+}
+
+TEST_F(LibRadosListPP, ListObjectsShardPP) {
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl1;
+  bl1.append(buf, sizeof(buf));
+  std::set<std::string> written;
+  for (int i = 0; i < 64; ++i) {
+    std::string oid = "foo" + stringify(i);
+    ASSERT_EQ((int)sizeof(buf), ioctx.write(oid, bl1, sizeof(buf), 0));
+    written.insert(oid);
+  }
+
+  std::set<std::string> listed;
+  for (uint32_t shard = 0; shard < 3; ++shard) {
+    ObjectIterator iter(ioctx.objects_begin_shard(shard, 3));
+    while (iter != ioctx.objects_end()) {
+      ASSERT_TRUE(listed.insert((*iter).first).second);
+      ++iter;
+    }
+  }
+  ASSERT_TRUE(written == listed);
+  ASSERT_TRUE(ioctx.objects_begin_shard(3, 3) == ioctx.objects_end());
+}
+
+TEST_F(LibRadosListPP, ListObjectsFilterPP) {
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  for (int i = 0; i < 8; ++i) {
+    bufferlist bl;
+    bl.append(buf, 16 * (i + 1));
+    ASSERT_EQ(0, ioctx.write_full("foo" + stringify(i), bl));
+    ASSERT_EQ(0, ioctx.write_full("bar" + stringify(i), bl));
+  }
+  bufferlist owner;
+  owner.append("me");
+  ASSERT_EQ(0, ioctx.setxattr("foo1", "owner", owner));
+  ASSERT_EQ(0, ioctx.setxattr("foo6", "owner", owner));
+  ASSERT_EQ(0, ioctx.setxattr("bar1", "owner", owner));
+
+  ObjectListFilter filter;
+  filter.prefix = "foo";
+  filter.min_size = 16 * 3;
+  filter.want_info = true;
+  std::set<std::string> listed;
+  for (ObjectIterator iter = ioctx.objects_begin(filter, 0, 1);
+       iter != ioctx.objects_end(); ++iter) {
+    uint64_t size;
+    time_t mtime;
+    ASSERT_EQ(0, iter.get_info(&size, &mtime));
+    ASSERT_EQ(0, iter->first.compare(0, 3, "foo"));
+    ASSERT_LE(16u * 3, size);
+    ASSERT_LT(0, mtime);
+    listed.insert(iter->first);
+  }
+  ASSERT_EQ(6u, listed.size());
+
+  filter = ObjectListFilter();
+  filter.prefix = "foo";
+  filter.xattr = "owner";
+  filter.xattr_value = owner;
+  listed.clear();
+  for (ObjectIterator iter = ioctx.objects_begin(filter, 0, 1);
+       iter != ioctx.objects_end(); ++iter) {
+    ASSERT_EQ(-ENODATA, iter.get_info(NULL, NULL));
+    listed.insert(iter->first);
+  }
+  std::set<std::string> expected;
+  expected.insert("foo1");
+  expected.insert("foo6");
+  ASSERT_TRUE(expected == listed);
+}
+
 static void check_list(std::set<std::string>& myset, rados_list_ctx_t& ctx)
 {
   const char *entry;
@@ -24,6 +24,7 @@
 
 #include "gtest/gtest.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -185,6 +186,48 @@ TEST(LibRBD, ResizeAndStat)
   ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
 }
 
+static int cancel_progress_cb(uint64_t offset, uint64_t total, void *arg)
+{
+  int *calls = (int *)arg;
+  ++*calls;
+  return -ECANCELED;
+}
+
+TEST(LibRBD, ResizeCancel)
+{
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+
+  rbd_image_info_t info;
+  rbd_image_t image;
+  int order = 22;
+  const char *name = "testimg";
+  uint64_t size = 8 << order;
+
+  ASSERT_EQ(0, create_image(ioctx, name, size, &order));
+  ASSERT_EQ(0, rbd_open(ioctx, name, &image, NULL));
+
+  // the progress callback cancels the shrink after the first object
+  int calls = 0;
+  ASSERT_EQ(-ECANCELED, rbd_resize_with_progress(image, 0, cancel_progress_cb,
+						 &calls));
+  ASSERT_EQ(1, calls);
+  ASSERT_EQ(0, rbd_stat(image, &info, sizeof(info)));
+  ASSERT_EQ(size, info.size);
+
+  ASSERT_EQ(0, rbd_resize(image, 0));
+  ASSERT_EQ(0, rbd_stat(image, &info, sizeof(info)));
+  ASSERT_EQ(0u, info.size);
+
+  ASSERT_EQ(0, rbd_close(image));
+
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
 TEST(LibRBD, ResizeAndStatPP)
 {
   librados::Rados rados;
@@ -752,6 +795,67 @@ TEST(LibRBD, TestIO)
   ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
 }
 
+TEST(LibRBD, TestIOVec)
+{
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  ASSERT_EQ(0, rados_conf_set(cluster, "rbd_disable_zero_copy_writes", "false"));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+
+  rbd_image_t image;
+  int order = 0;
+  const char *name = "testimg";
+  uint64_t size = 2 << 20;
+
+  ASSERT_EQ(0, create_image(ioctx, name, size, &order));
+  ASSERT_EQ(0, rbd_open(ioctx, name, &image, NULL));
+
+  char test_data[TEST_IO_SIZE * 3];
+  for (int i = 0; i < TEST_IO_SIZE * 3; ++i)
+    test_data[i] = (char) (rand() % (126 - 33) + 33);
+
+  // write uneven pieces across an object boundary
+  uint64_t off = (1 << order) - TEST_IO_SIZE;
+  struct iovec write_iov[3];
+  write_iov[0].iov_base = test_data;
+  write_iov[0].iov_len = 1;
+  write_iov[1].iov_base = test_data + 1;
+  write_iov[1].iov_len = TEST_IO_SIZE * 2 - 1;
+  write_iov[2].iov_base = test_data + TEST_IO_SIZE * 2;
+  write_iov[2].iov_len = TEST_IO_SIZE;
+
+  rbd_completion_t comp;
+  rbd_aio_create_completion(NULL, (rbd_callback_t) simple_write_cb, &comp);
+  ASSERT_EQ(0, rbd_aio_writev(image, write_iov, 3, off, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ(0, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+
+  read_test_data(image, test_data, off, TEST_IO_SIZE * 3);
+
+  char read_data[TEST_IO_SIZE * 3];
+  memset(read_data, 0, sizeof(read_data));
+  struct iovec read_iov[2];
+  read_iov[0].iov_base = read_data;
+  read_iov[0].iov_len = TEST_IO_SIZE + 7;
+  read_iov[1].iov_base = read_data + TEST_IO_SIZE + 7;
+  read_iov[1].iov_len = TEST_IO_SIZE * 2 - 7;
+
+  rbd_aio_create_completion(NULL, (rbd_callback_t) simple_read_cb, &comp);
+  ASSERT_EQ(0, rbd_aio_readv(image, read_iov, 2, off, comp));
+  ASSERT_EQ(0, rbd_aio_wait_for_complete(comp));
+  ASSERT_EQ(TEST_IO_SIZE * 3, rbd_aio_get_return_value(comp));
+  rbd_aio_release(comp);
+  ASSERT_EQ(0, memcmp(test_data, read_data, TEST_IO_SIZE * 3));
+
+  ASSERT_EQ(0, rbd_close(image));
+
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
 TEST(LibRBD, TestEmptyDiscard)
 {
   rados_t cluster;
@@ -1125,6 +1229,123 @@ TEST(LibRBD, TestClone)
   ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
 }
 
+TEST(LibRBD, TestCloneCopyOnRead)
+{
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  ASSERT_EQ(0, rados_conf_set(cluster, "rbd_clone_copy_on_read", "true"));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+
+  int features = RBD_FEATURE_LAYERING;
+  rbd_image_t parent, child;
+  int order = 0;
+
+  ASSERT_EQ(0, create_image_full(ioctx, "parent", 4<<20, &order, false, features));
+  ASSERT_EQ(0, rbd_open(ioctx, "parent", &parent, NULL));
+  char *data = (char *)"testdata";
+  ASSERT_EQ((ssize_t)strlen(data), rbd_write(parent, 0, strlen(data), data));
+  ASSERT_EQ(0, rbd_snap_create(parent, "parent_snap"));
+  ASSERT_EQ(0, rbd_snap_protect(parent, "parent_snap"));
+  ASSERT_EQ(0, rbd_clone(ioctx, "parent", "parent_snap", ioctx, "child",
+	    features, &order));
+
+  ASSERT_EQ(0, rbd_open(ioctx, "child", &child, NULL));
+  rbd_image_info_t cinfo;
+  ASSERT_EQ(0, rbd_stat(child, &cinfo, sizeof(cinfo)));
+  char oid[RBD_MAX_BLOCK_NAME_SIZE + 32];
+  snprintf(oid, sizeof(oid), "%s.%016llx", cinfo.block_name_prefix, 0ull);
+  uint64_t size;
+  time_t mtime;
+  ASSERT_EQ(-ENOENT, rados_stat(ioctx, oid, &size, &mtime));
+
+  // reading from the parent copies the object up in the background;
+  // closing waits for it
+  read_test_data(child, data, 0, strlen(data));
+  ASSERT_EQ(0, rbd_close(child));
+  ASSERT_EQ(0, rados_stat(ioctx, oid, &size, &mtime));
+
+  ASSERT_EQ(0, rbd_open(ioctx, "child", &child, NULL));
+  read_test_data(child, data, 0, strlen(data));
+  ASSERT_EQ(0, rbd_close(child));
+
+  ASSERT_EQ(0, rbd_remove(ioctx, "child"));
+  ASSERT_EQ(0, rbd_snap_unprotect(parent, "parent_snap"));
+  ASSERT_EQ(0, rbd_snap_remove(parent, "parent_snap"));
+  ASSERT_EQ(0, rbd_close(parent));
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
+static int count_dir_entries(const string &path)
+{
+  DIR *dir = opendir(path.c_str());
+  if (!dir)
+    return -errno;
+  int count = 0;
+  struct dirent *de;
+  while ((de = readdir(dir)) != NULL) {
+    if (de->d_name[0] != '.')
+      ++count;
+  }
+  closedir(dir);
+  return count;
+}
+
+TEST(LibRBD, TestPersistentCache)
+{
+  rados_t cluster;
+  rados_ioctx_t ioctx;
+  string pool_name = get_temp_pool_name();
+  ASSERT_EQ("", create_one_pool(pool_name, &cluster));
+  char cache_dir[] = "/tmp/rbd_persistent_cache.XXXXXX";
+  ASSERT_TRUE(mkdtemp(cache_dir) != NULL);
+  ASSERT_EQ(0, rados_conf_set(cluster, "rbd_persistent_cache_path", cache_dir));
+  rados_ioctx_create(cluster, pool_name.c_str(), &ioctx);
+
+  rbd_image_t image, snap_image;
+  int order = 0;
+  ASSERT_EQ(0, create_image(ioctx, "image", 4<<20, &order));
+  ASSERT_EQ(0, rbd_open(ioctx, "image", &image, NULL));
+  char *data = (char *)"testdata";
+  ASSERT_EQ((ssize_t)strlen(data), rbd_write(image, 0, strlen(data), data));
+  ASSERT_EQ(0, rbd_snap_create(image, "snap"));
+
+  rbd_image_info_t info;
+  ASSERT_EQ(0, rbd_stat(image, &info, sizeof(info)));
+  ostringstream image_dir;
+  image_dir << cache_dir << "/" << rados_ioctx_get_id(ioctx) << "."
+	    << info.block_name_prefix;
+
+  // the first read of an object at a snapshot caches it
+  ASSERT_EQ(0, rbd_open(ioctx, "image", &snap_image, "snap"));
+  read_test_data(snap_image, data, 0, strlen(data));
+  ASSERT_EQ(0, rbd_close(snap_image));
+  ASSERT_EQ(1, count_dir_entries(image_dir.str()));
+
+  // writes to the head don't affect it
+  char *new_data = (char *)"TESTDATA";
+  ASSERT_EQ((ssize_t)strlen(new_data),
+	    rbd_write(image, 0, strlen(new_data), new_data));
+  ASSERT_EQ(0, rbd_open(ioctx, "image", &snap_image, "snap"));
+  read_test_data(snap_image, data, 0, strlen(data));
+  ASSERT_EQ(0, rbd_close(snap_image));
+  read_test_data(image, new_data, 0, strlen(new_data));
+
+  // entries of removed snapshots go away when the image is refreshed
+  ASSERT_EQ(0, rbd_snap_remove(image, "snap"));
+  ASSERT_EQ(0, rbd_stat(image, &info, sizeof(info)));
+  ASSERT_EQ(0, rbd_close(image));
+  ASSERT_EQ(0, count_dir_entries(image_dir.str()));
+
+  ASSERT_EQ(0, rbd_remove(ioctx, "image"));
+  ASSERT_EQ(0, rmdir(image_dir.str().c_str()));
+  ASSERT_EQ(0, rmdir(cache_dir));
+  rados_ioctx_destroy(ioctx);
+  ASSERT_EQ(0, destroy_one_pool(pool_name, &cluster));
+}
+
 TEST(LibRBD, TestClone2)
 {
   rados_t cluster;
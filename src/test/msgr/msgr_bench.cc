@@ -0,0 +1,395 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Messenger benchmark.  Start a server with
+ *
+ *   ceph_test_msgr_bench --server --addr 127.0.0.1:6800
+ *
+ * and point clients at it:
+ *
+ *   ceph_test_msgr_bench --addr 127.0.0.1:6800 --connections 4 --depth 16
+ *
+ * Each client connection is its own Messenger, and keeps depth requests
+ * in flight; the server answers each one, after spending dispatch-cost
+ * microseconds on it.  The client reports messages and bytes per
+ * second, cpu time per message and a round trip latency histogram;
+ * the server reports its rate and cpu time per message periodically.
+ * Pass --ms-type to compare messenger implementations.
+ */
+
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <sys/resource.h>
+#include <iostream>
+
+#include "msg/Messenger.h"
+#include "messages/MPing.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "include/atomic.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+static const int NUM_BUCKETS = 32;  ///< latency buckets, by power of 2 usec
+
+struct Options {
+  bool osd_op;
+  unsigned size;
+  unsigned reply_size;
+  unsigned dispatch_cost;  ///< usec
+  bool fast_dispatch;
+};
+
+static utime_t cpu_time()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return utime_t(ru.ru_utime) + utime_t(ru.ru_stime);
+}
+
+static bufferlist payload(unsigned len)
+{
+  bufferptr bp(len);
+  bp.zero();
+  bufferlist bl;
+  bl.append(bp);
+  return bl;
+}
+
+class Server : public Dispatcher {
+  Messenger *msgr;
+  const Options& opt;
+  bufferlist reply_data;
+
+public:
+  atomic64_t received;
+
+  Server(Messenger *m, const Options& o)
+    : Dispatcher(g_ceph_context), msgr(m), opt(o),
+      reply_data(payload(o.reply_size)) {}
+
+  void handle(Message *m) {
+    if (opt.dispatch_cost) {
+      utime_t until = ceph_clock_now(g_ceph_context);
+      until += (double)opt.dispatch_cost / 1000000.0;
+      while (ceph_clock_now(g_ceph_context) < until) ;
+    }
+    Message *reply;
+    if (m->get_type() == CEPH_MSG_OSD_OP) {
+      MOSDOp *op = static_cast<MOSDOp*>(m);
+      reply = new MOSDOpReply(op, 0, op->get_map_epoch(),
+			      CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK, true);
+    } else {
+      reply = new MPing;
+      reply->set_tid(m->get_tid());
+    }
+    if (reply_data.length())
+      reply->set_data(reply_data);
+    msgr->send_message(reply, m->get_connection().get());
+    received.inc();
+    m->put();
+  }
+
+  bool ms_can_fast_dispatch_any() const { return opt.fast_dispatch; }
+  bool ms_can_fast_dispatch(Message *m) const { return opt.fast_dispatch; }
+  void ms_fast_dispatch(Message *m) { handle(m); }
+  bool ms_dispatch(Message *m) {
+    handle(m);
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) { return true; }
+  void ms_handle_remote_reset(Connection *con) {}
+};
+
+class Client : public Dispatcher {
+  Messenger *msgr;
+  const Options& opt;
+  ConnectionRef con;
+  entity_inst_t server;
+  bufferlist data;
+  object_t oid;
+  object_locator_t oloc;
+
+  Mutex lock;
+  Cond cond;
+  map<tid_t, utime_t> in_flight;
+  tid_t last_tid;
+  uint64_t to_send;
+
+public:
+  uint64_t hist[NUM_BUCKETS];
+  uint64_t done;
+
+  Client(Messenger *m, const Options& o, const entity_inst_t& s, int n)
+    : Dispatcher(g_ceph_context), msgr(m), opt(o), server(s),
+      data(payload(o.size)), oloc(0),
+      lock("Client::lock"), last_tid(0), to_send(0), done(0) {
+    memset(hist, 0, sizeof(hist));
+    char name[32];
+    snprintf(name, sizeof(name), "bench_%d", n);
+    oid = object_t(name);
+  }
+
+  /// call with lock held
+  void send_one() {
+    tid_t tid = ++last_tid;
+    Message *m;
+    if (opt.osd_op) {
+      MOSDOp *op = new MOSDOp(0, tid, oid, oloc, pg_t(0, 0), 1,
+			      CEPH_OSD_FLAG_WRITE | CEPH_OSD_FLAG_ONDISK);
+      bufferlist bl = data;
+      op->write(0, bl.length(), bl);
+      m = op;
+    } else {
+      m = new MPing;
+      m->set_tid(tid);
+      m->set_data(data);
+    }
+    in_flight[tid] = ceph_clock_now(g_ceph_context);
+    --to_send;
+    msgr->send_message(m, con.get());
+  }
+
+  void start(uint64_t count, unsigned depth) {
+    Mutex::Locker l(lock);
+    con = msgr->get_connection(server);
+    to_send = count;
+    while (to_send && in_flight.size() < depth)
+      send_one();
+  }
+
+  void wait() {
+    Mutex::Locker l(lock);
+    while (to_send || !in_flight.empty())
+      cond.Wait(lock);
+  }
+
+  void handle(Message *m) {
+    utime_t now = ceph_clock_now(g_ceph_context);
+    Mutex::Locker l(lock);
+    map<tid_t, utime_t>::iterator p = in_flight.find(m->get_tid());
+    if (p != in_flight.end()) {
+      uint64_t usec = (now - p->second).to_nsec() / 1000;
+      int b = 0;
+      while (usec > 1 && b < NUM_BUCKETS - 1) {
+	usec >>= 1;
+	++b;
+      }
+      hist[b]++;
+      done++;
+      in_flight.erase(p);
+      if (to_send)
+	send_one();
+      else if (in_flight.empty())
+	cond.Signal();
+    }
+    m->put();
+  }
+
+  bool ms_can_fast_dispatch_any() const { return opt.fast_dispatch; }
+  bool ms_can_fast_dispatch(Message *m) const { return opt.fast_dispatch; }
+  void ms_fast_dispatch(Message *m) { handle(m); }
+  bool ms_dispatch(Message *m) {
+    handle(m);
+    return true;
+  }
+  bool ms_handle_reset(Connection *con) {
+    Mutex::Locker l(lock);
+    if (!in_flight.empty()) {
+      cerr << "connection reset with " << in_flight.size()
+	   << " requests in flight" << std::endl;
+      assert(0);
+    }
+    return true;
+  }
+  void ms_handle_remote_reset(Connection *con) {}
+};
+
+static int run_server(const entity_addr_t& addr, const Options& opt,
+		      unsigned interval)
+{
+  // nonce 0, so that clients can find us by address alone
+  Messenger *msgr = Messenger::create(g_ceph_context, entity_name_t::OSD(0),
+				      "bench", 0);
+  msgr->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+  int r = msgr->bind(addr);
+  if (r < 0) {
+    cerr << "bind to " << addr << " failed" << std::endl;
+    return 1;
+  }
+  Server server(msgr, opt);
+  msgr->add_dispatcher_head(&server);
+  msgr->start();
+  cout << "listening on " << msgr->get_myaddr() << std::endl;
+
+  uint64_t last = 0;
+  utime_t last_cpu = cpu_time();
+  while (true) {
+    sleep(interval);
+    uint64_t now = server.received.read();
+    utime_t cpu = cpu_time();
+    if (now != last) {
+      cout << (now - last) / interval << " msgs/s, "
+	   << ((double)(cpu - last_cpu) * 1000000.0) / (now - last)
+	   << " cpu usec/msg" << std::endl;
+    }
+    last = now;
+    last_cpu = cpu;
+  }
+  return 0;
+}
+
+static int run_client(const entity_addr_t& addr, const Options& opt,
+		      unsigned connections, unsigned depth, uint64_t count)
+{
+  entity_inst_t server(entity_name_t::OSD(0), addr);
+  vector<Messenger*> msgrs;
+  vector<Client*> clients;
+  for (unsigned i = 0; i < connections; ++i) {
+    Messenger *msgr = Messenger::create(g_ceph_context,
+					entity_name_t::CLIENT(-1), "bench",
+					getpid() * 1000 + i);
+    msgr->set_default_policy(Messenger::Policy::lossy_client(0, 0));
+    Client *c = new Client(msgr, opt, server, i);
+    msgr->add_dispatcher_head(c);
+    msgr->start();
+    msgrs.push_back(msgr);
+    clients.push_back(c);
+  }
+
+  utime_t start = ceph_clock_now(g_ceph_context);
+  utime_t start_cpu = cpu_time();
+  for (unsigned i = 0; i < connections; ++i)
+    clients[i]->start(count, depth);
+  for (unsigned i = 0; i < connections; ++i)
+    clients[i]->wait();
+  double elapsed = ceph_clock_now(g_ceph_context) - start;
+  double cpu = cpu_time() - start_cpu;
+
+  uint64_t hist[NUM_BUCKETS];
+  memset(hist, 0, sizeof(hist));
+  uint64_t done = 0;
+  for (unsigned i = 0; i < connections; ++i) {
+    for (int b = 0; b < NUM_BUCKETS; ++b)
+      hist[b] += clients[i]->hist[b];
+    done += clients[i]->done;
+    msgrs[i]->shutdown();
+    msgrs[i]->wait();
+    delete msgrs[i];
+    delete clients[i];
+  }
+
+  cout << done << " round trips in " << elapsed << "s" << std::endl;
+  cout << "msgs/s\t" << done / elapsed << std::endl;
+  cout << "MB/s\t" << (double)done * (opt.size + opt.reply_size) / elapsed /
+    1048576.0 << std::endl;
+  cout << "cpu usec/msg\t" << cpu * 1000000.0 / done << std::endl;
+  cout << "latency (usec)\tcount" << std::endl;
+  for (int b = 0; b < NUM_BUCKETS; ++b) {
+    if (hist[b])
+      cout << "< " << (1ull << (b + 1)) << "\t" << hist[b] << std::endl;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("server", "run the server side")
+    ("addr", po::value<string>()->default_value("127.0.0.1:6800"),
+     "address the server binds to, and clients connect to")
+    ("type", po::value<string>()->default_value("ping"),
+     "message type: ping (with a data payload) or osd_op (a write)")
+    ("size", po::value<unsigned>()->default_value(4096),
+     "request payload size")
+    ("reply-size", po::value<unsigned>()->default_value(0),
+     "reply payload size")
+    ("connections", po::value<unsigned>()->default_value(1),
+     "client connections, each with its own messenger")
+    ("depth", po::value<unsigned>()->default_value(1),
+     "requests in flight per connection")
+    ("count", po::value<uint64_t>()->default_value(100000),
+     "requests per connection")
+    ("dispatch-cost", po::value<unsigned>()->default_value(0),
+     "usec the server spends on each request")
+    ("fast-dispatch", po::value<bool>()->default_value(false),
+     "handle messages in the reader threads")
+    ("interval", po::value<unsigned>()->default_value(5),
+     "seconds between server reports")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(parsed, vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  for (vector<string>::iterator i = ceph_option_strings.begin();
+       i != ceph_option_strings.end();
+       ++i) {
+    ceph_options.push_back(i->c_str());
+  }
+
+  global_init(&def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+	      CODE_ENVIRONMENT_UTILITY, CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  Options opt;
+  string type = vm["type"].as<string>();
+  if (type != "ping" && type != "osd_op") {
+    cerr << "unknown message type " << type << std::endl;
+    return 1;
+  }
+  opt.osd_op = (type == "osd_op");
+  opt.size = vm["size"].as<unsigned>();
+  opt.reply_size = vm["reply-size"].as<unsigned>();
+  opt.dispatch_cost = vm["dispatch-cost"].as<unsigned>();
+  opt.fast_dispatch = vm["fast-dispatch"].as<bool>();
+
+  entity_addr_t addr;
+  if (!addr.parse(vm["addr"].as<string>().c_str())) {
+    cerr << "could not parse address " << vm["addr"].as<string>() << std::endl;
+    return 1;
+  }
+
+  if (vm.count("server"))
+    return run_server(addr, opt, MAX(1u, vm["interval"].as<unsigned>()));
+
+  unsigned depth = vm["depth"].as<unsigned>();
+  uint64_t count = vm["count"].as<uint64_t>();
+  if (!depth || !count) {
+    cerr << "depth and count must be positive" << std::endl;
+    return 1;
+  }
+  return run_client(addr, opt, MAX(1u, vm["connections"].as<unsigned>()),
+		    depth, count);
+}
@@ -0,0 +1,147 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+#include "msg/async/Event.h"
+#include "common/Clock.h"
+#include "common/Thread.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include <gtest/gtest.h>
+
+class CountCallback : public EventCallback {
+ public:
+  std::vector<int> fired;
+  void do_request(int fd_or_id) {
+    fired.push_back(fd_or_id);
+  }
+};
+
+/// reads whatever is pending so a level-triggered fd stops firing
+class DrainCallback : public CountCallback {
+ public:
+  void do_request(int fd) {
+    char buf[16];
+    while (::read(fd, buf, sizeof(buf)) > 0) ;
+    CountCallback::do_request(fd);
+  }
+};
+
+class EventCenterTest : public ::testing::Test {
+ public:
+  EventCenter center;
+  int fds[2];
+
+  EventCenterTest() : center(g_ceph_context) {}
+
+  virtual void SetUp() {
+    ASSERT_EQ(0, center.init(100));
+    center.set_owner(pthread_self());
+    ASSERT_EQ(0, ::pipe(fds));
+    ASSERT_EQ(0, fcntl(fds[0], F_SETFL, O_NONBLOCK));
+  }
+
+  virtual void TearDown() {
+    ::close(fds[0]);
+    ::close(fds[1]);
+  }
+};
+
+TEST_F(EventCenterTest, FileEvent) {
+  DrainCallback *cb = new DrainCallback;
+  EventCallbackRef ref(cb);
+  ASSERT_EQ(0, center.create_file_event(fds[0], EVENT_READABLE, ref));
+
+  // nothing to read: the loop times out
+  center.process_events(1000);
+  ASSERT_TRUE(cb->fired.empty());
+
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  center.process_events(1000000);
+  ASSERT_EQ(1u, cb->fired.size());
+  ASSERT_EQ(fds[0], cb->fired[0]);
+
+  // once deleted, the event does not fire anymore
+  center.delete_file_event(fds[0], EVENT_READABLE);
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  center.process_events(1000);
+  ASSERT_EQ(1u, cb->fired.size());
+}
+
+TEST_F(EventCenterTest, TimeEvent) {
+  CountCallback *cb = new CountCallback;
+  EventCallbackRef ref(cb);
+  uint64_t late = center.create_time_event(20000, ref);
+  uint64_t early = center.create_time_event(1000, ref);
+  uint64_t cancelled = center.create_time_event(5000, ref);
+  center.delete_time_event(cancelled);
+
+  utime_t until = ceph_clock_now(g_ceph_context);
+  until += 5;
+  while (cb->fired.size() < 2 && ceph_clock_now(g_ceph_context) < until)
+    center.process_events(100000);
+
+  ASSERT_EQ(2u, cb->fired.size());
+  ASSERT_EQ(early, (uint64_t)cb->fired[0]);
+  ASSERT_EQ(late, (uint64_t)cb->fired[1]);
+}
+
+class ExternalThread : public Thread {
+  EventCenter *center;
+  EventCallbackRef cb;
+ public:
+  ExternalThread(EventCenter *c, EventCallbackRef e) : center(c), cb(e) {}
+  void *entry() {
+    center->dispatch_event_external(cb);
+    return 0;
+  }
+};
+
+TEST_F(EventCenterTest, ExternalEvent) {
+  CountCallback *cb = new CountCallback;
+  EventCallbackRef ref(cb);
+
+  // queued from the owner thread: runs on the next iteration
+  center.dispatch_event_external(ref);
+  center.process_events(1000000);
+  ASSERT_EQ(1u, cb->fired.size());
+
+  // queued from another thread: wakes up a blocked loop
+  ExternalThread t(&center, ref);
+  t.create();
+  utime_t start = ceph_clock_now(g_ceph_context);
+  while (cb->fired.size() < 2)
+    center.process_events(30000000);
+  t.join();
+  ASSERT_GT(10.0, (double)(ceph_clock_now(g_ceph_context) - start));
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make unittest_event && ./unittest_event"
+ * End:
+ */
@@ -0,0 +1,448 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+/*
+ * Runs a mix of osd-like transactions against an ObjectStore backend
+ * (osd_objectstore, osd_data, osd_journal) and reports, per kind of
+ * transaction, commit latency percentiles, plus the syscalls and bytes
+ * the process did meanwhile, for comparing backends.
+ *
+ * Each sequencer stands for a pg: it has its own collection, pg log
+ * object and rgw-style index object, and keeps up to queue-depth
+ * transactions in flight.
+ */
+
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "os/ObjectStore.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/errno.h"
+#include "include/stringify.h"
+
+namespace po = boost::program_options;
+using namespace std;
+
+typedef boost::mt11213b gen_type;
+
+enum {
+  OP_WRITE,
+  OP_CLONE,
+  OP_OMAP,
+  OP_REMOVE,
+  OP_MAX
+};
+static const char *op_names[] = { "write", "clone", "omap", "remove" };
+
+struct Config {
+  unsigned num_objects;
+  uint64_t object_size;
+  uint64_t io_size;
+  unsigned xattr_size;
+  unsigned log_entry_size;
+  unsigned omap_keys;
+  unsigned omap_value_size;
+  unsigned queue_depth;
+  unsigned ops;
+  double weight[OP_MAX];
+};
+
+/// what this process has done to the kernel so far, from /proc/self/io
+struct IoStats {
+  uint64_t syscr, syscw, read_bytes, write_bytes;
+  IoStats() : syscr(0), syscw(0), read_bytes(0), write_bytes(0) {}
+
+  bool read() {
+    ifstream f("/proc/self/io");
+    if (!f.good())
+      return false;
+    string k;
+    uint64_t v;
+    while (f >> k >> v) {
+      if (k == "syscr:")
+	syscr = v;
+      else if (k == "syscw:")
+	syscw = v;
+      else if (k == "read_bytes:")
+	read_bytes = v;
+      else if (k == "write_bytes:")
+	write_bytes = v;
+    }
+    return true;
+  }
+};
+
+class Worker : public Thread {
+  ObjectStore *store;
+  const Config& conf;
+  gen_type rng;
+  ObjectStore::Sequencer osr;
+  coll_t cid;
+  ghobject_t log_oid, index_oid;
+  vector<bool> exists, has_clone;
+  uint64_t log_version;
+  uint64_t index_key;
+
+  Mutex lock;
+  Cond cond;
+  unsigned in_flight;
+
+public:
+  vector<double> latency[OP_MAX];  ///< seconds, per op kind
+  uint64_t payload_bytes;          ///< data, xattrs and omap we asked for
+
+  Worker(ObjectStore *s, const Config& c, unsigned n, unsigned seed)
+    : store(s), conf(c), rng(seed), osr("bench." + stringify(n)),
+      cid("bench_" + stringify(n) + "_head"),
+      log_oid(hobject_t(sobject_t("pglog_" + stringify(n), CEPH_NOSNAP))),
+      index_oid(hobject_t(sobject_t("index_" + stringify(n), CEPH_NOSNAP))),
+      exists(c.num_objects), has_clone(c.num_objects),
+      log_version(0), index_key(0),
+      lock("Worker::lock"), in_flight(0), payload_bytes(0) {}
+
+  int setup() {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.touch(cid, log_oid);
+    t.touch(cid, index_oid);
+    return store->apply_transaction(&osr, t);
+  }
+
+  struct C_Committed : public Context {
+    Worker *w;
+    int op;
+    utime_t start;
+    C_Committed(Worker *w, int op, utime_t s) : w(w), op(op), start(s) {}
+    void finish(int r) {
+      double lat = ceph_clock_now(g_ceph_context) - start;
+      Mutex::Locker l(w->lock);
+      w->latency[op].push_back(lat);
+      w->in_flight--;
+      w->cond.Signal();
+    }
+  };
+
+  ghobject_t object(unsigned i, bool clone = false) {
+    return ghobject_t(hobject_t(sobject_t("obj_" + stringify(i),
+					  snapid_t(clone ? 1 : CEPH_NOSNAP))));
+  }
+
+  bufferlist random_bl(unsigned len) {
+    bufferptr bp(len);
+    boost::uniform_int<> c(0, 255);
+    for (unsigned i = 0; i < len; ++i)
+      bp[i] = c(rng);
+    bufferlist bl;
+    bl.append(bp);
+    payload_bytes += len;
+    return bl;
+  }
+
+  /// the pg log entry and object info every osd write carries
+  void add_pg_meta(ObjectStore::Transaction& t, const ghobject_t& oid) {
+    bufferlist oi = random_bl(conf.xattr_size);
+    t.setattr(cid, oid, "_", oi);
+    map<string,bufferlist> entry;
+    char key[40];
+    snprintf(key, sizeof(key), "%020llu", (unsigned long long)++log_version);
+    entry[key] = random_bl(conf.log_entry_size);
+    t.omap_setkeys(cid, log_oid, entry);
+  }
+
+  int pick_op() {
+    double total = 0;
+    for (int i = 0; i < OP_MAX; ++i)
+      total += conf.weight[i];
+    boost::uniform_real<> u(0, total);
+    double r = u(rng);
+    for (int i = 0; i < OP_MAX; ++i) {
+      if (r < conf.weight[i])
+	return i;
+      r -= conf.weight[i];
+    }
+    return OP_WRITE;
+  }
+
+  void build(ObjectStore::Transaction& t, int& op) {
+    boost::uniform_int<> o(0, conf.num_objects - 1);
+    unsigned i = o(rng);
+    ghobject_t oid = object(i);
+    if (!exists[i] && (op == OP_CLONE || op == OP_REMOVE))
+      op = OP_WRITE;
+
+    switch (op) {
+    case OP_CLONE:
+      if (has_clone[i])
+	t.remove(cid, object(i, true));
+      t.clone(cid, oid, object(i, true));
+      has_clone[i] = true;
+      // fall through: a write to a snapshotted object
+    case OP_WRITE:
+      {
+	boost::uniform_int<uint64_t> off(0, conf.object_size / conf.io_size - 1);
+	t.write(cid, oid, off(rng) * conf.io_size, conf.io_size,
+		random_bl(conf.io_size));
+	add_pg_meta(t, oid);
+	exists[i] = true;
+      }
+      break;
+    case OP_OMAP:
+      {
+	// bucket index update: add some entries, drop as many old ones
+	map<string,bufferlist> keys;
+	set<string> old;
+	for (unsigned k = 0; k < conf.omap_keys; ++k) {
+	  char key[40];
+	  snprintf(key, sizeof(key), "key_%016llu",
+		   (unsigned long long)index_key);
+	  keys[key] = random_bl(conf.omap_value_size);
+	  if (index_key >= conf.num_objects) {
+	    snprintf(key, sizeof(key), "key_%016llu",
+		     (unsigned long long)(index_key - conf.num_objects));
+	    old.insert(key);
+	  }
+	  ++index_key;
+	}
+	t.omap_setkeys(cid, index_oid, keys);
+	if (!old.empty())
+	  t.omap_rmkeys(cid, index_oid, old);
+	add_pg_meta(t, index_oid);
+      }
+      break;
+    case OP_REMOVE:
+      t.remove(cid, oid);
+      if (has_clone[i])
+	t.remove(cid, object(i, true));
+      exists[i] = has_clone[i] = false;
+      add_pg_meta(t, log_oid);
+      break;
+    }
+  }
+
+  void *entry() {
+    for (unsigned n = 0; n < conf.ops; ++n) {
+      {
+	Mutex::Locker l(lock);
+	while (in_flight >= conf.queue_depth)
+	  cond.Wait(lock);
+	in_flight++;
+      }
+      int op = pick_op();
+      ObjectStore::Transaction *t = new ObjectStore::Transaction;
+      build(*t, op);
+      utime_t start = ceph_clock_now(g_ceph_context);
+      store->queue_transaction(&osr, t,
+			       new ObjectStore::C_DeleteTransaction(t),
+			       new C_Committed(this, op, start));
+    }
+    Mutex::Locker l(lock);
+    while (in_flight)
+      cond.Wait(lock);
+    return NULL;
+  }
+};
+
+static double percentile(const vector<double>& v, double p)
+{
+  if (v.empty())
+    return 0;
+  size_t i = (size_t)(p * (v.size() - 1) + .5);
+  return v[i];
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("num-sequencers", po::value<unsigned>()->default_value(8),
+     "number of sequencers (pgs), each with its own thread")
+    ("queue-depth", po::value<unsigned>()->default_value(4),
+     "transactions in flight per sequencer")
+    ("ops", po::value<unsigned>()->default_value(10000),
+     "transactions per sequencer")
+    ("num-objects", po::value<unsigned>()->default_value(1000),
+     "objects per sequencer")
+    ("object-size", po::value<uint64_t>()->default_value(4 << 20),
+     "object size")
+    ("io-size", po::value<uint64_t>()->default_value(4 << 10),
+     "size of each write")
+    ("xattr-size", po::value<unsigned>()->default_value(250),
+     "size of the object info xattr set on each write")
+    ("log-entry-size", po::value<unsigned>()->default_value(180),
+     "size of the pg log omap entry added by each transaction")
+    ("omap-keys", po::value<unsigned>()->default_value(8),
+     "index keys added per omap transaction")
+    ("omap-value-size", po::value<unsigned>()->default_value(200),
+     "size of each index value")
+    ("write-weight", po::value<double>()->default_value(70),
+     "relative frequency of writes")
+    ("clone-weight", po::value<double>()->default_value(10),
+     "relative frequency of clone + write")
+    ("omap-weight", po::value<double>()->default_value(15),
+     "relative frequency of index updates")
+    ("remove-weight", po::value<double>()->default_value(5),
+     "relative frequency of removes")
+    ("seed", po::value<unsigned>()->default_value(0),
+     "random seed")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(parsed, vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  for (vector<string>::iterator i = ceph_option_strings.begin();
+       i != ceph_option_strings.end();
+       ++i) {
+    ceph_options.push_back(i->c_str());
+  }
+
+  global_init(&def_args, ceph_options, CEPH_ENTITY_TYPE_OSD,
+	      CODE_ENVIRONMENT_UTILITY, CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  Config conf;
+  conf.num_objects = vm["num-objects"].as<unsigned>();
+  conf.object_size = vm["object-size"].as<uint64_t>();
+  conf.io_size = vm["io-size"].as<uint64_t>();
+  conf.xattr_size = vm["xattr-size"].as<unsigned>();
+  conf.log_entry_size = vm["log-entry-size"].as<unsigned>();
+  conf.omap_keys = vm["omap-keys"].as<unsigned>();
+  conf.omap_value_size = vm["omap-value-size"].as<unsigned>();
+  conf.queue_depth = vm["queue-depth"].as<unsigned>();
+  conf.ops = vm["ops"].as<unsigned>();
+  conf.weight[OP_WRITE] = vm["write-weight"].as<double>();
+  conf.weight[OP_CLONE] = vm["clone-weight"].as<double>();
+  conf.weight[OP_OMAP] = vm["omap-weight"].as<double>();
+  conf.weight[OP_REMOVE] = vm["remove-weight"].as<double>();
+  if (!conf.num_objects || !conf.io_size || conf.io_size > conf.object_size ||
+      !conf.queue_depth) {
+    cerr << "num-objects, io-size and queue-depth must be positive, and "
+	 << "io-size no more than object-size" << std::endl;
+    return 1;
+  }
+
+  int r = ::mkdir(g_conf->osd_data.c_str(), 0755);
+  if (r < 0 && errno != EEXIST) {
+    cerr << "unable to create " << g_conf->osd_data << ": "
+	 << cpp_strerror(errno) << std::endl;
+    return 1;
+  }
+  boost::scoped_ptr<ObjectStore> store(
+    ObjectStore::create(g_ceph_context, g_conf->osd_objectstore,
+			g_conf->osd_data, g_conf->osd_journal));
+  if (!store) {
+    cerr << "unknown objectstore " << g_conf->osd_objectstore << std::endl;
+    return 1;
+  }
+  if ((r = store->mkfs()) < 0) {
+    cerr << "mkfs failed: " << cpp_strerror(r) << std::endl;
+    return 1;
+  }
+  if ((r = store->mount()) < 0) {
+    cerr << "mount failed: " << cpp_strerror(r) << std::endl;
+    return 1;
+  }
+
+  unsigned num = vm["num-sequencers"].as<unsigned>();
+  unsigned seed = vm["seed"].as<unsigned>();
+  vector<Worker*> workers;
+  for (unsigned i = 0; i < num; ++i) {
+    Worker *w = new Worker(store.get(), conf, i, seed + i);
+    if ((r = w->setup()) < 0) {
+      cerr << "setup failed: " << cpp_strerror(r) << std::endl;
+      return 1;
+    }
+    workers.push_back(w);
+  }
+  store->sync_and_flush();
+
+  IoStats before, after;
+  bool have_io = before.read();
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (unsigned i = 0; i < num; ++i)
+    workers[i]->create();
+  for (unsigned i = 0; i < num; ++i)
+    workers[i]->join();
+  utime_t elapsed = ceph_clock_now(g_ceph_context) - start;
+  store->sync_and_flush();
+  after.read();
+
+  vector<double> lat[OP_MAX];
+  uint64_t payload = 0;
+  for (unsigned i = 0; i < num; ++i) {
+    for (int op = 0; op < OP_MAX; ++op)
+      lat[op].insert(lat[op].end(), workers[i]->latency[op].begin(),
+		     workers[i]->latency[op].end());
+    payload += workers[i]->payload_bytes;
+    delete workers[i];
+  }
+
+  uint64_t total = 0;
+  cout << g_conf->osd_objectstore << ": " << elapsed << "s" << std::endl;
+  cout << "op\tcount\tp50_ms\tp90_ms\tp99_ms\tp999_ms\tmax_ms" << std::endl;
+  for (int op = 0; op < OP_MAX; ++op) {
+    sort(lat[op].begin(), lat[op].end());
+    total += lat[op].size();
+    cout << op_names[op] << "\t" << lat[op].size()
+	 << "\t" << percentile(lat[op], .5) * 1000
+	 << "\t" << percentile(lat[op], .9) * 1000
+	 << "\t" << percentile(lat[op], .99) * 1000
+	 << "\t" << percentile(lat[op], .999) * 1000
+	 << "\t" << (lat[op].empty() ? 0 : lat[op].back() * 1000)
+	 << std::endl;
+  }
+  cout << "transactions/s\t" << (double)total / (double)elapsed << std::endl;
+  cout << "payload_bytes\t" << payload << std::endl;
+  if (have_io) {
+    uint64_t written = after.write_bytes - before.write_bytes;
+    cout << "read_syscalls\t" << after.syscr - before.syscr << std::endl;
+    cout << "write_syscalls\t" << after.syscw - before.syscw << std::endl;
+    cout << "device_read_bytes\t" << after.read_bytes - before.read_bytes
+	 << std::endl;
+    cout << "device_write_bytes\t" << written << std::endl;
+    cout << "write_amplification\t"
+	 << (payload ? (double)written / (double)payload : 0) << std::endl;
+  } else {
+    cout << "(no /proc/self/io, syscall and device counts unavailable)"
+	 << std::endl;
+  }
+
+  store->umount();
+  return 0;
+}
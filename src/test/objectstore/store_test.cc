@@ -911,6 +911,50 @@ TEST_P(StoreTest, TwoHash) {
   ASSERT_EQ(r, 0);
 }
 
+TEST_P(StoreTest, CollectionHint) {
+  // pg 1.5 of an 8 pg pool, hinted big enough to be split two levels deep
+  coll_t cid(spg_t(pg_t(5, 1), ghobject_t::NO_SHARD));
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    bufferlist hint;
+    uint32_t pg_num = 8;
+    uint64_t num_objs = 8 * 320 * 64;
+    ::encode(pg_num, hint);
+    ::encode(num_objs, hint);
+    t.collection_hint(cid,
+		      ObjectStore::Transaction::COLL_HINT_EXPECTED_NUM_OBJECTS,
+		      hint);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  set<ghobject_t> created;
+  for (uint32_t i = 0; i < 200; ++i) {
+    ObjectStore::Transaction t;
+    stringstream objname;
+    objname << "obj" << i;
+    ghobject_t o(hobject_t(objname.str(), "", CEPH_NOSNAP,
+			   ((i * 0x9e3779b9) << 3) | 5, 1, ""));
+    t.touch(cid, o);
+    created.insert(o);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  vector<ghobject_t> objects;
+  r = store->collection_list(cid, objects);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(created, set<ghobject_t>(objects.begin(), objects.end()));
+  ObjectStore::Transaction t;
+  for (set<ghobject_t>::iterator i = created.begin(); i != created.end(); ++i) {
+    ASSERT_TRUE(store->exists(cid, *i));
+    t.remove(cid, *i);
+  }
+  t.remove_collection(cid);
+  r = store->apply_transaction(t);
+  ASSERT_EQ(r, 0);
+}
+
 TEST_P(StoreTest, MoveRename) {
   coll_t temp_cid("mytemp");
   hobject_t temp_oid("tmp_oid", "", CEPH_NOSNAP, 0, 0, "");
@@ -970,6 +1014,323 @@ TEST_P(StoreTest, MoveRename) {
   }
 }
 
+TEST_P(StoreTest, TruncateAppend) {
+  coll_t cid("truncate");
+  hobject_t oid("truncate_oid", "", CEPH_NOSNAP, 0, 0, "");
+  int r;
+  bufferlist first, second;
+  first.append(string(10000, 'a'));
+  second.append(string(3000, 'b'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.write(cid, oid, 0, first.length(), first);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // shrink into the middle of a strip, then append past the old end
+    ObjectStore::Transaction t;
+    t.truncate(cid, oid, 5000);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.truncate(cid, oid, 7000);
+    t.write(cid, oid, 7000, second.length(), second);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    bufferlist expected, newdata;
+    expected.append(string(5000, 'a'));
+    expected.append_zero(2000);
+    expected.append(second);
+    r = store->read(cid, oid, 0, 20000, newdata);
+    ASSERT_EQ(10000, r);
+    ASSERT_TRUE(newdata.contents_equal(expected));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, oid);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, FiemapHoles) {
+  coll_t cid("fiemap");
+  hobject_t oid("fiemap_oid", "", CEPH_NOSNAP, 0, 0, "");
+  const uint64_t far = 4 << 20;
+  int r;
+  bufferlist bl;
+  bl.append(string(4096, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.write(cid, oid, 0, bl.length(), bl);
+    t.write(cid, oid, far, bl.length(), bl);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // whether or not the store can see the hole, the data is mapped
+    bufferlist mbl;
+    r = store->fiemap(cid, oid, 0, far + bl.length(), mbl);
+    ASSERT_EQ(0, r);
+    map<uint64_t, uint64_t> m;
+    bufferlist::iterator p = mbl.begin();
+    ::decode(m, p);
+    ASSERT_FALSE(m.empty());
+    uint64_t want[] = { 0, far };
+    for (unsigned i = 0; i < 2; ++i) {
+      map<uint64_t, uint64_t>::iterator q = m.upper_bound(want[i]);
+      ASSERT_TRUE(q != m.begin());
+      --q;
+      ASSERT_GE(q->first + q->second, want[i] + bl.length());
+    }
+    uint64_t mapped = 0;
+    for (map<uint64_t, uint64_t>::iterator q = m.begin(); q != m.end(); ++q)
+      mapped += q->second;
+    ASSERT_LE(mapped, far + bl.length());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, oid);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, ShadowedOps) {
+  coll_t cid("shadowed");
+  hobject_t a("shadowed_a", "", CEPH_NOSNAP, 0, 0, "");
+  hobject_t b("shadowed_b", "", CEPH_NOSNAP, 0, 0, "");
+  int r;
+  bufferlist data, attr;
+  data.append(string(4096, 'a'));
+  attr.append("value");
+  {
+    // updates of a, all undone by its removal; a write to b past where
+    // it ends up truncated, which must still create it; adjacent
+    // setattrs on b
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.write(cid, a, 0, data.length(), data);
+    t.setattr(cid, a, "attr", attr);
+    map<string, bufferlist> keys;
+    keys["key"] = attr;
+    t.omap_setkeys(cid, a, keys);
+    t.remove(cid, a);
+    t.write(cid, b, 8192, data.length(), data);
+    t.truncate(cid, b, 100);
+    t.setattr(cid, b, "attr1", attr);
+    t.setattr(cid, b, "attr2", attr);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    struct stat st;
+    ASSERT_EQ(-ENOENT, store->stat(cid, a, &st));
+    ASSERT_EQ(0, store->stat(cid, b, &st));
+    ASSERT_EQ(100, st.st_size);
+    bufferptr bp;
+    ASSERT_GE(store->getattr(cid, b, "attr1", bp), 0);
+    ASSERT_GE(store->getattr(cid, b, "attr2", bp), 0);
+    ASSERT_EQ(5u, bp.length());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, b);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, RemoveCollectionRecursive) {
+  coll_t cid("rmcoll_recursive");
+  int r;
+  bufferlist data;
+  data.append(string(1000, 'a'));
+  map<string, bufferlist> keys;
+  keys["key"] = data;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    for (int i = 0; i < 100; ++i) {
+      char name[20];
+      snprintf(name, sizeof(name), "object_%d", i);
+      hobject_t oid(name, "", CEPH_NOSNAP, i, 0, "");
+      t.write(cid, oid, 0, data.length(), data);
+      t.omap_setkeys(cid, oid, keys);
+    }
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove_collection_recursive(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_FALSE(store->collection_exists(cid));
+  {
+    // the objects and their omaps are gone too
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    vector<ghobject_t> objects;
+    r = store->collection_list(cid, objects);
+    ASSERT_EQ(r, 0);
+    ASSERT_TRUE(objects.empty());
+    hobject_t oid("object_0", "", CEPH_NOSNAP, 0, 0, "");
+    map<string, bufferlist> out;
+    bufferlist header;
+    store->omap_get(cid, oid, &header, &out);
+    ASSERT_TRUE(out.empty());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, ListPartialAttr) {
+  coll_t cid("list_attr");
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    for (int i = 0; i < 50; ++i) {
+      char name[20];
+      snprintf(name, sizeof(name), "object_%d", i);
+      hobject_t oid(name, "", CEPH_NOSNAP, i, 0, "");
+      t.touch(cid, oid);
+      if (i % 5) {
+	// some too big for the first try, one with none at all
+	bufferlist bl;
+	bl.append(string(i * 20, 'a' + i % 26));
+	t.setattr(cid, oid, "attr", bl);
+      }
+    }
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  ghobject_t next;
+  int seen = 0;
+  while (!next.is_max()) {
+    vector<ghobject_t> ls;
+    vector<bufferptr> attrs;
+    r = store->collection_list_partial_attr(cid, next, 10, 20, 0, "attr",
+					    &ls, &attrs, &next);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(ls.size(), attrs.size());
+    for (unsigned i = 0; i < ls.size(); ++i, ++seen) {
+      bufferptr bp;
+      r = store->getattr(cid, ls[i], "attr", bp);
+      if (r == -ENODATA) {
+	ASSERT_EQ(0u, attrs[i].length());
+      } else {
+	ASSERT_GE(r, 0);
+	ASSERT_EQ(bp.length(), attrs[i].length());
+	ASSERT_EQ(0, memcmp(bp.c_str(), attrs[i].c_str(), bp.length()));
+      }
+    }
+  }
+  ASSERT_EQ(50, seen);
+  {
+    ObjectStore::Transaction t;
+    t.remove_collection_recursive(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTest, PackedXattrs) {
+  coll_t cid("packed");
+  hobject_t a("packed_a", "", CEPH_NOSNAP, 0, 0, "");
+  hobject_t b("packed_b", "", CEPH_NOSNAP, 0, 0, "");
+  hobject_t c("packed_c", "", CEPH_NOSNAP, 0, 0, "");
+  int r;
+  map<string, bufferlist> want;
+  want["one"].append("1");
+  want["two"].append("22");
+  want["big"].append(string(8192, 'b'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid);
+    t.touch(cid, a);
+    t.setattr(cid, a, "one", want["one"]);
+    t.setattr(cid, a, "big", want["big"]);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  // the next setattr converts a, the clone packs b
+  g_ceph_context->_conf->set_val("filestore_xattr_packed", "true");
+  {
+    ObjectStore::Transaction t;
+    t.setattr(cid, a, "two", want["two"]);
+    t.clone(cid, a, b);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  for (int i = 0; i < 2; ++i) {
+    const hobject_t &oid = i ? b : a;
+    map<string, bufferptr> got;
+    r = store->getattrs(cid, oid, got);
+    ASSERT_EQ(0, r);
+    ASSERT_EQ(want.size(), got.size());
+    for (map<string, bufferlist>::iterator p = want.begin();
+	 p != want.end();
+	 ++p) {
+      ASSERT_TRUE(got.count(p->first));
+      ASSERT_EQ(p->second.length(), got[p->first].length());
+      ASSERT_EQ(0, memcmp(p->second.c_str(), got[p->first].c_str(),
+			  p->second.length()));
+      bufferptr bp;
+      r = store->getattr(cid, oid, p->first.c_str(), bp);
+      ASSERT_EQ((int)p->second.length(), r);
+    }
+  }
+  {
+    ObjectStore::Transaction t;
+    t.rmattr(cid, a, "one");
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    bufferptr bp;
+    ASSERT_EQ(-ENODATA, store->getattr(cid, a, "one", bp));
+    ASSERT_EQ(2, store->getattr(cid, a, "two", bp));
+  }
+  // cloning with the option off unpacks again
+  g_ceph_context->_conf->set_val("filestore_xattr_packed", "false");
+  {
+    ObjectStore::Transaction t;
+    t.clone(cid, a, c);
+    t.rmattrs(cid, b);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    map<string, bufferptr> got;
+    ASSERT_EQ(0, store->getattrs(cid, c, got));
+    ASSERT_EQ(2u, got.size());
+    got.clear();
+    ASSERT_EQ(0, store->getattrs(cid, b, got));
+    ASSERT_TRUE(got.empty());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove_collection_recursive(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
 INSTANTIATE_TEST_CASE_P(
   ObjectStore,
   StoreTest,
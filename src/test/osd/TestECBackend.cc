@@ -58,3 +58,41 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+
+TEST(ECUtil, HashInfo_tail)
+{
+  ECUtil::HashInfo hinfo(3);
+  bufferlist chunk;
+  chunk.append_zero(16);
+  map<int, bufferlist> buffers;
+  for (int i = 0; i < 3; ++i)
+    buffers[i] = chunk;
+  hinfo.append(0, buffers);
+  bufferlist tail;
+  tail.append("not a full stripe");
+  hinfo.set_tail(tail);
+
+  bufferlist bl;
+  ::encode(hinfo, bl);
+  ECUtil::HashInfo decoded;
+  bufferlist::iterator p = bl.begin();
+  ::decode(decoded, p);
+  ASSERT_EQ(16u, decoded.get_total_chunk_size());
+  ASSERT_EQ(hinfo.get_chunk_hash(2), decoded.get_chunk_hash(2));
+  bufferlist decoded_tail = decoded.get_tail();
+  ASSERT_TRUE(decoded_tail.contents_equal(tail));
+
+  decoded.clear();
+  ASSERT_EQ(0u, decoded.get_tail().length());
+
+  // an attr written before the tail existed has none
+  bufferlist old;
+  ENCODE_START(1, 1, old);
+  ::encode((uint64_t)16, old);
+  ::encode(vector<uint32_t>(3, 0), old);
+  ENCODE_FINISH(old);
+  p = old.begin();
+  ::decode(hinfo, p);
+  ASSERT_EQ(16u, hinfo.get_total_chunk_size());
+  ASSERT_EQ(0u, hinfo.get_tail().length());
+}
@@ -346,3 +346,94 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
     osdmap.set_primary_affinity(1, 0x10000);
   }
 }
+
+TEST_F(OSDMapTest, MappingMatches) {
+  set_up_map();
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0, -1));
+  vector<int> up_osds, acting_osds;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+  OSDMap::Incremental pgtemp_map(osdmap.get_epoch() + 1);
+  pgtemp_map.new_pg_temp[pgid].push_back(acting_osds[1]);
+  pgtemp_map.new_pg_temp[pgid].push_back(acting_osds[0]);
+  osdmap.apply_incremental(pgtemp_map);
+
+  OSDMapMapping *mapping = new OSDMapMapping;
+  mapping->update(osdmap, 3);
+  ASSERT_EQ(osdmap.get_epoch(), mapping->get_epoch());
+
+  // the same sets, raw pgs included, with and without the mapping
+  vector<pg_t> pgs;
+  vector<vector<int> > ups, actings;
+  vector<int> up_ps, acting_ps;
+  const map<int64_t,pg_pool_t>& pools = osdmap.get_pools();
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
+       p != pools.end(); ++p) {
+    for (unsigned ps = 0; ps < p->second.get_pg_num() * 2; ++ps) {
+      pgs.push_back(pg_t(ps, p->first, -1));
+      ups.push_back(vector<int>());
+      actings.push_back(vector<int>());
+      up_ps.push_back(-1);
+      acting_ps.push_back(-1);
+      osdmap.pg_to_up_acting_osds(pgs.back(), &ups.back(), &up_ps.back(),
+                                  &actings.back(), &acting_ps.back());
+    }
+  }
+  osdmap.set_mapping(OSDMapMappingRef(mapping));
+  for (unsigned i = 0; i < pgs.size(); ++i) {
+    vector<int> up, acting;
+    int up_p, acting_p;
+    osdmap.pg_to_up_acting_osds(pgs[i], &up, &up_p, &acting, &acting_p);
+    ASSERT_EQ(ups[i], up);
+    ASSERT_EQ(up_ps[i], up_p);
+    ASSERT_EQ(actings[i], acting);
+    ASSERT_EQ(acting_ps[i], acting_p);
+  }
+
+  // a new epoch drops the mapping
+  OSDMap::Incremental next(osdmap.get_epoch() + 1);
+  osdmap.apply_incremental(next);
+  ASSERT_FALSE(osdmap.get_mapping());
+}
+
+TEST_F(OSDMapTest, ShallowCopy) {
+  set_up_map();
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0, -1));
+  vector<int> up_osds, acting_osds;
+  int up_primary, acting_primary;
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting_osds, &acting_primary);
+
+  OSDMap next;
+  next.shallow_copy_from(osdmap);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  inc.new_pg_temp[pgid].push_back(acting_osds[1]);
+  inc.new_pg_temp[pgid].push_back(acting_osds[0]);
+  entity_addr_t addr;
+  addr.nonce = 100;
+  inc.new_up_client[0] = addr;
+  inc.new_up_cluster[0] = addr;
+  inc.new_hb_back_up[0] = addr;
+  next.apply_incremental(inc);
+  next.set_primary_affinity(1, 0);
+
+  // the new epoch sees the changes...
+  vector<int> acting;
+  int acting_p;
+  next.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                            &acting, &acting_p);
+  ASSERT_EQ(inc.new_pg_temp[pgid], acting);
+  ASSERT_EQ(addr, next.get_addr(0));
+  ASSERT_EQ(0u, next.get_primary_affinity(1));
+
+  // ...and the one it was copied from does not
+  osdmap.pg_to_up_acting_osds(pgid, &up_osds, &up_primary,
+                              &acting, &acting_p);
+  ASSERT_EQ(acting_osds, acting);
+  ASSERT_NE(addr, osdmap.get_addr(0));
+  ASSERT_EQ(CEPH_OSD_DEFAULT_PRIMARY_AFFINITY, osdmap.get_primary_affinity(1));
+}
@@ -0,0 +1,87 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "gtest/gtest.h"
+#include "osd/ObjectInfoCache.h"
+
+static hobject_t obj(const char *name, snapid_t snap = CEPH_NOSNAP)
+{
+  return hobject_t(object_t(name), "", snap, 0x1234, 1, "");
+}
+
+static object_info_t oi(const hobject_t& o, uint64_t size)
+{
+  object_info_t ret(o);
+  ret.size = size;
+  return ret;
+}
+
+TEST(ObjectInfoCache, get_add) {
+  ObjectInfoCache c(1 << 20);
+  spg_t pgid(pg_t(0, 1));
+  object_info_t out;
+  EXPECT_FALSE(c.get_oi(pgid, obj("a"), &out));
+  c.add_oi(pgid, oi(obj("a"), 10), 100);
+  c.add_oi(pgid, oi(obj("a", 4), 5), 100);
+  ASSERT_TRUE(c.get_oi(pgid, obj("a"), &out));
+  EXPECT_EQ(10u, out.size);
+  ASSERT_TRUE(c.get_oi(pgid, obj("a", 4), &out));
+  EXPECT_EQ(5u, out.size);
+  EXPECT_FALSE(c.get_oi(pgid, obj("a", 3), &out));
+
+  // pgs don't see each other's entries
+  spg_t other(pg_t(1, 1));
+  EXPECT_FALSE(c.get_oi(other, obj("a"), &out));
+
+  SnapSet ss, ss_out;
+  ss.seq = 7;
+  EXPECT_FALSE(c.get_snapset(pgid, obj("a"), &ss_out));
+  c.add_snapset(pgid, obj("a"), ss, 50);
+  ASSERT_TRUE(c.get_snapset(pgid, obj("a"), &ss_out));
+  EXPECT_EQ(7u, ss_out.seq);
+}
+
+TEST(ObjectInfoCache, invalidate) {
+  ObjectInfoCache c(1 << 20);
+  spg_t pgid(pg_t(0, 1));
+  c.add_oi(pgid, oi(obj("a"), 10), 100);
+  c.add_oi(pgid, oi(obj("a", 4), 5), 100);
+  c.add_oi(pgid, oi(obj("b"), 1), 100);
+  c.add_snapset(pgid, obj("a"), SnapSet(), 50);
+
+  // a write to a clone drops the whole family
+  c.invalidate(pgid, obj("a", 4));
+  object_info_t out;
+  SnapSet ss;
+  EXPECT_FALSE(c.get_oi(pgid, obj("a"), &out));
+  EXPECT_FALSE(c.get_oi(pgid, obj("a", 4), &out));
+  EXPECT_FALSE(c.get_snapset(pgid, obj("a"), &ss));
+  EXPECT_TRUE(c.get_oi(pgid, obj("b"), &out));
+
+  c.clear_pg(pgid);
+  EXPECT_FALSE(c.get_oi(pgid, obj("b"), &out));
+  EXPECT_EQ(0u, c.get_bytes());
+}
+
+TEST(ObjectInfoCache, bounded) {
+  ObjectInfoCache c(10 * (sizeof(object_info_t) + 1000));
+  spg_t pgid(pg_t(0, 1));
+  char name[20];
+  for (int i = 0; i < 100; ++i) {
+    snprintf(name, sizeof(name), "obj%d", i);
+    c.add_oi(pgid, oi(obj(name), i), 1000);
+  }
+  EXPECT_LE(c.get_bytes(), 10 * (sizeof(object_info_t) + 1000));
+  object_info_t out;
+  EXPECT_FALSE(c.get_oi(pgid, obj("obj0"), &out));
+  EXPECT_TRUE(c.get_oi(pgid, obj("obj99"), &out));
+}
@@ -1642,6 +1642,38 @@ TEST_F(PGLogTest, proc_replica_log) {
 
 }
 
+TEST_F(PGLogTest, indexed_log_caller_ops) {
+  IndexedLog l;
+  osd_reqid_t reqid(entity_name_t::CLIENT(777), 8, 999);
+  pg_log_entry_t e(pg_log_entry_t::MODIFY, hobject_t(object_t("obj"), "key", 1, 2, 3, ""),
+		   eversion_t(1, 1), eversion_t(), 1, reqid, utime_t());
+  {
+    bufferlist bl;  // snaps get a page of their own when encoded
+    ::encode(vector<snapid_t>(1, snapid_t(4)), bl);
+    e.snaps = bl;
+  }
+  l.add(e);
+
+  // only indexed on the first lookup
+  EXPECT_TRUE(l.caller_ops.empty());
+  EXPECT_TRUE(l.logged_object(e.soid));
+  EXPECT_TRUE(l.logged_req(reqid));
+  EXPECT_EQ(&l.log.back(), l.get_request(reqid));
+  EXPECT_EQ(1u, l.caller_ops.size());
+
+  // and kept up to date from then on
+  pg_log_entry_t e2(e);
+  e2.version = eversion_t(1, 2);
+  e2.reqid = osd_reqid_t(entity_name_t::CLIENT(777), 8, 1000);
+  l.add(e2);
+  EXPECT_EQ(&l.log.back(), l.get_request(e2.reqid));
+  l.unindex(l.log.front());
+  EXPECT_FALSE(l.logged_req(reqid));
+
+  // the entry in the log does not pin the page
+  EXPECT_EQ(e.snaps.length(), l.log.front().snaps.buffers().front().raw_length());
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -195,3 +195,115 @@ TEST_F(ExplicitObjectHitSetTest, RejectsNoMatch) {
   }
   EXPECT_EQ(matches, 0);
 }
+
+class DecayBloomHitSetTest : public testing::Test, public HitSetTestStrap {
+public:
+
+  DecayBloomHitSetTest()
+    : HitSetTestStrap(new HitSet(new DecayBloomHitSet(100, .001, 1))) {}
+};
+
+TEST_F(DecayBloomHitSetTest, Construct) {
+  ASSERT_EQ(hitset->impl->get_type(), HitSet::TYPE_DECAY_BLOOM);
+  ASSERT_TRUE(hitset->is_cumulative());
+}
+
+TEST_F(DecayBloomHitSetTest, InsertsMatch) {
+  fill(50);
+  verify_fill(50);
+  EXPECT_FALSE(hitset->is_full());
+
+  char buf[50];
+  int matches = 0;
+  for (int i = 100; i < 200; ++i) {
+    sprintf(buf, "hitsettest_%d", i);
+    hobject_t obj(object_t(buf), "", 0, i, 0, "");
+    if (hitset->contains(obj))
+      ++matches;
+  }
+  EXPECT_LT(matches, 2);
+}
+
+TEST_F(DecayBloomHitSetTest, Decay) {
+  hobject_t once(object_t("once"), "", 0, 1, 0, "");
+  hobject_t hot(object_t("hot"), "", 0, 2, 0, "");
+  hitset->insert(once);
+  for (int i = 0; i < 4; ++i)
+    hitset->insert(hot);
+  EXPECT_EQ(0, hitset->get_age(once));
+  EXPECT_EQ(1u, hitset->get_temperature(once));
+  EXPECT_EQ(4u, hitset->get_temperature(hot));
+
+  hitset->seal();
+  hitset->decay();
+  EXPECT_EQ(0u, hitset->insert_count());
+  EXPECT_EQ(1, hitset->get_age(once));
+  EXPECT_EQ(2u, hitset->get_temperature(hot));
+
+  // a single hit is gone after log2(STEP) + 1 periods
+  for (int i = 1; i < 6; ++i)
+    hitset->impl->decay();
+  EXPECT_FALSE(hitset->contains(once));
+  EXPECT_EQ(-1, hitset->get_age(once));
+}
+
+TEST_F(DecayBloomHitSetTest, EncodeDecode) {
+  fill(10);
+  bufferlist bl;
+  ::encode(*hitset, bl);
+  // at most 100 of the 1438 counters are set, so we encode sparsely
+  EXPECT_LT(bl.length(), 1000u);
+
+  HitSet h;
+  bufferlist::iterator p = bl.begin();
+  ::decode(h, p);
+  ASSERT_EQ(h.impl->get_type(), HitSet::TYPE_DECAY_BLOOM);
+  HitSetTestStrap s(&h);
+  s.verify_fill(10);
+  EXPECT_EQ(10u, h.insert_count());
+}
+
+class BlockedBloomHitSetTest : public testing::Test, public HitSetTestStrap {
+public:
+
+  BlockedBloomHitSetTest()
+    : HitSetTestStrap(new HitSet(new BlockedBloomHitSet(100, .001, 1))) {}
+};
+
+TEST_F(BlockedBloomHitSetTest, Construct) {
+  ASSERT_EQ(hitset->impl->get_type(), HitSet::TYPE_BLOCKED_BLOOM);
+  ASSERT_FALSE(hitset->is_cumulative());
+}
+
+TEST_F(BlockedBloomHitSetTest, InsertsMatch) {
+  fill(50);
+  verify_fill(50);
+  EXPECT_FALSE(hitset->is_full());
+}
+
+TEST_F(BlockedBloomHitSetTest, InsertMany) {
+  vector<hobject_t> ls;
+  char buf[50];
+  for (unsigned i = 0; i < 100; ++i) {
+    sprintf(buf, "hitsettest_%d", i);
+    ls.push_back(hobject_t(object_t(buf), "", 0, i, 0, ""));
+  }
+  hitset->insert_many(ls);
+  EXPECT_EQ(100u, hitset->insert_count());
+  EXPECT_TRUE(hitset->is_full());
+  verify_fill(100);
+}
+
+TEST_F(BlockedBloomHitSetTest, EncodeDecode) {
+  fill(10);
+  bufferlist bl;
+  ::encode(*hitset, bl);
+
+  HitSet h;
+  bufferlist::iterator p = bl.begin();
+  ::decode(h, p);
+  ASSERT_EQ(h.impl->get_type(), HitSet::TYPE_BLOCKED_BLOOM);
+  HitSetTestStrap s(&h);
+  s.verify_fill(10);
+  EXPECT_EQ(10u, h.insert_count());
+}
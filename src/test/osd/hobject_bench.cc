@@ -0,0 +1,115 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Time the container operations PGs do keyed by hobject_t, such as the
+ * missing set, object waiters and backfill intervals:
+ *
+ *   ceph_test_hobject_bench [objects [rounds]]
+ *
+ * Reports ns per operation for a map with the member-by-member
+ * comparison hobject_t used to have ("legacy"), a map with the current
+ * comparison, and a ceph::unordered_map.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+
+#include "include/types.h"
+#include "include/unordered_map.h"
+#include "common/hobject.h"
+#include "include/ceph_hash.h"
+#include "common/Clock.h"
+
+using namespace std;
+
+struct LegacyLess {
+  bool operator()(const hobject_t& l, const hobject_t& r) const {
+    if (l.is_max() != r.is_max())
+      return r.is_max();
+    if (l.get_filestore_key() != r.get_filestore_key())
+      return l.get_filestore_key() < r.get_filestore_key();
+    if (l.nspace != r.nspace)
+      return l.nspace < r.nspace;
+    if (l.pool != r.pool)
+      return l.pool < r.pool;
+    if (l.get_effective_key() != r.get_effective_key())
+      return l.get_effective_key() < r.get_effective_key();
+    if (l.oid != r.oid)
+      return l.oid < r.oid;
+    return l.snap < r.snap;
+  }
+};
+
+static void report(const char *what, utime_t start, unsigned ops)
+{
+  utime_t t = ceph_clock_now(NULL) - start;
+  printf("%-28s %8.1f ns/op\n", what, (double)t.to_nsec() / ops);
+}
+
+template <typename M>
+static void bench(const char *name, const vector<hobject_t>& objs,
+		  unsigned rounds)
+{
+  char what[64];
+  M m;
+  utime_t start = ceph_clock_now(NULL);
+  for (unsigned i = 0; i < objs.size(); ++i)
+    m[objs[i]] = i;
+  snprintf(what, sizeof(what), "%s insert", name);
+  report(what, start, objs.size());
+
+  start = ceph_clock_now(NULL);
+  unsigned found = 0;
+  for (unsigned r = 0; r < rounds; ++r)
+    for (unsigned i = 0; i < objs.size(); ++i)
+      found += m.count(objs[i]);
+  snprintf(what, sizeof(what), "%s find", name);
+  report(what, start, rounds * objs.size());
+  if (found != rounds * objs.size())
+    printf("%s: found %u of %u\n", name, found,
+	   (unsigned)(rounds * objs.size()));
+}
+
+int main(int argc, char **argv)
+{
+  unsigned num = argc > 1 ? atoi(argv[1]) : 100000;
+  unsigned rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+  // rbd-style names: long, and sharing a long prefix
+  vector<hobject_t> objs;
+  for (unsigned i = 0; i < num; ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "rbd_data.1014b2ae8944a.%016x", i);
+    uint32_t hash = ceph_str_hash_rjenkins(name, strlen(name));
+    objs.push_back(hobject_t(object_t(name), "", CEPH_NOSNAP, hash, 3, ""));
+  }
+  random_shuffle(objs.begin(), objs.end());
+
+  printf("%u objects, %u lookup rounds\n", num, rounds);
+  bench<map<hobject_t, unsigned, LegacyLess> >("legacy map", objs, rounds);
+  bench<map<hobject_t, unsigned> >("map", objs, rounds);
+  bench<ceph::unordered_map<hobject_t, unsigned> >("unordered_map", objs,
+						   rounds);
+
+  vector<hobject_t> v(objs);
+  utime_t start = ceph_clock_now(NULL);
+  sort(v.begin(), v.end(), LegacyLess());
+  report("legacy sort", start, num);
+  random_shuffle(v.begin(), v.end());
+  start = ceph_clock_now(NULL);
+  sort(v.begin(), v.end());
+  report("sort", start, num);
+  return 0;
+}
@@ -118,6 +118,54 @@ TEST(hobject, prefixes5)
   ASSERT_EQ(prefixes_out, prefixes_correct);
 }
 
+// the order hobject_t's sorted in before cmp(); it must not change
+static bool legacy_lt(const hobject_t& l, const hobject_t& r)
+{
+  if (l.is_max() != r.is_max())
+    return r.is_max();
+  if (l.get_filestore_key() != r.get_filestore_key())
+    return l.get_filestore_key() < r.get_filestore_key();
+  if (l.nspace != r.nspace)
+    return l.nspace < r.nspace;
+  if (l.pool != r.pool)
+    return l.pool < r.pool;
+  if (l.get_effective_key() != r.get_effective_key())
+    return l.get_effective_key() < r.get_effective_key();
+  if (l.oid != r.oid)
+    return l.oid < r.oid;
+  return l.snap < r.snap;
+}
+
+TEST(hobject, cmp)
+{
+  vector<hobject_t> objs;
+  const char *names[] = { "a", "b", "ab" };
+  const char *keys[] = { "", "a", "z" };
+  for (unsigned n = 0; n < 3; ++n)
+    for (unsigned k = 0; k < 3; ++k)
+      for (uint32_t hash = 0; hash < 0x30; hash += 0x11)
+	for (int64_t pool = 1; pool < 3; ++pool)
+	  for (unsigned ns = 0; ns < 2; ++ns)
+	    for (snapid_t snap = 1; snap < 3; ++snap)
+	      objs.push_back(hobject_t(object_t(names[n]), keys[k], snap, hash,
+				       pool, ns ? "ns" : ""));
+  objs.push_back(hobject_t());
+  objs.push_back(hobject_t::get_max());
+
+  for (unsigned i = 0; i < objs.size(); ++i) {
+    for (unsigned j = 0; j < objs.size(); ++j) {
+      const hobject_t &l = objs[i], &r = objs[j];
+      ASSERT_EQ(legacy_lt(l, r), l < r) << l << " < " << r;
+      ASSERT_EQ(l == r, cmp(l, r) == 0) << l << " == " << r;
+      ASSERT_EQ(-cmp(r, l) > 0, cmp(l, r) > 0);
+      if (l == r) {
+	ASSERT_EQ(CEPH_HASH_NAMESPACE::hash<hobject_t>()(l),
+		  CEPH_HASH_NAMESPACE::hash<hobject_t>()(r));
+      }
+    }
+  }
+}
+
 TEST(pg_interval_t, check_new_interval)
 {
   //
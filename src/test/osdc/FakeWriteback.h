@@ -27,6 +27,13 @@ public:
 		      const bufferlist &bl, utime_t mtime, uint64_t trunc_size,
 		      __u32 trunc_seq, Context *oncommit);
 
+  virtual bool can_scattered_write() { return true; }
+  virtual tid_t write_vector(const object_t& oid, const object_locator_t& oloc,
+			     vector<pair<uint64_t, bufferlist> >& io_vec,
+			     const SnapContext& snapc, utime_t mtime,
+			     uint64_t trunc_size, __u32 trunc_seq,
+			     Context *oncommit);
+
   virtual bool may_copy_on_write(const object_t&, uint64_t, uint64_t, snapid_t);
 private:
   CephContext *m_cct;
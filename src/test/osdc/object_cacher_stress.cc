@@ -52,7 +52,8 @@ public:
 
 int stress_test(uint64_t num_ops, uint64_t num_objs,
 		uint64_t max_obj_size, uint64_t delay_ns,
-		uint64_t max_op_len, float percent_reads)
+		uint64_t max_op_len, float percent_reads,
+		uint64_t max_coalesced_write)
 {
   Mutex lock("object_cacher_stress::object_cacher");
   FakeWriteback writeback(g_ceph_context, &lock, delay_ns);
@@ -64,6 +65,7 @@ int stress_test(uint64_t num_ops, uint64_t num_objs,
 		   g_conf->client_oc_target_dirty,
 		   g_conf->client_oc_max_dirty_age,
 		   true);
+  obc.set_max_coalesced_write(max_coalesced_write);
   obc.start();
 
   atomic_t outstanding_reads;
@@ -183,6 +185,7 @@ int main(int argc, const char **argv)
   long long max_len = 128 << 10;
   long long num_objs = 10;
   float percent_reads = 0.90;
+  long long max_coalesced_write = 1 << 20;
   int seed = time(0) % 100000;
   std::ostringstream err;
   std::vector<const char*>::iterator i;
@@ -217,6 +220,11 @@ int main(int argc, const char **argv)
 	cerr << argv[0] << ": " << err.str() << std::endl;
 	return EXIT_FAILURE;
       }
+    } else if (ceph_argparse_withlonglong(args, i, &max_coalesced_write, &err, "--max-coalesced-write", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << argv[0] << ": " << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
     } else if (ceph_argparse_withint(args, i, &seed, &err, "--seed", (char*)NULL)) {
       if (!err.str().empty()) {
 	cerr << argv[0] << ": " << err.str() << std::endl;
@@ -229,5 +237,6 @@ int main(int argc, const char **argv)
   }
 
   srandom(seed);
-  return stress_test(num_ops, num_objs, obj_bytes, delay_ns, max_len, percent_reads);
+  return stress_test(num_ops, num_objs, obj_bytes, delay_ns, max_len, percent_reads,
+		     max_coalesced_write);
 }
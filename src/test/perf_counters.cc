@@ -22,6 +22,7 @@
 #include "common/config.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
+#include "common/Thread.h"
 
 #include "common/code_environment.h"
 #include "global/global_context.h"
@@ -163,3 +164,141 @@ TEST(PerfCounters, MultiplePerfCounters) {
   ASSERT_EQ("", client.do_request("{ \"prefix\": \"perfcounters_dump\", \"format\": \"json\" }", &msg));
   ASSERT_EQ("{}", msg);
 }
+
+TEST(PerfCounters, BatchedAverage) {
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfCounters* fake_pf = setup_test_perfcounters1(g_ceph_context);
+  coll->add(fake_pf);
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+
+  fake_pf->tinc(TEST_PERFCOUNTERS1_ELEMENT_3, utime_t(30, 0), 3);
+  fake_pf->tinc(TEST_PERFCOUNTERS1_ELEMENT_3, utime_t(10, 0));
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perfcounters_dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_1\":{\"element1\":0,\"element2\":0.000000000,"
+	    "\"element3\":{\"avgcount\":4,\"sum\":40.000000000}}}"), msg);
+  ASSERT_EQ(make_pair((uint64_t)4, (uint64_t)40000),
+	    fake_pf->get_tavg_ms(TEST_PERFCOUNTERS1_ELEMENT_3));
+  coll->clear();
+}
+
+class PerfCountersIncThread : public Thread {
+  PerfCounters *pc;
+public:
+  PerfCountersIncThread(PerfCounters *p) : pc(p) {}
+  void *entry() {
+    for (int i = 0; i < 100000; ++i) {
+      pc->inc(TEST_PERFCOUNTERS1_ELEMENT_1);
+      pc->tinc(TEST_PERFCOUNTERS1_ELEMENT_3, utime_t(0, 1000));
+    }
+    return NULL;
+  }
+};
+
+TEST(PerfCounters, ConcurrentUpdates) {
+  PerfCounters* fake_pf = setup_test_perfcounters1(g_ceph_context);
+  PerfCountersIncThread *threads[4];
+  for (int i = 0; i < 4; ++i) {
+    threads[i] = new PerfCountersIncThread(fake_pf);
+    threads[i]->create();
+  }
+  for (int i = 0; i < 4; ++i) {
+    threads[i]->join();
+    delete threads[i];
+  }
+  ASSERT_EQ(400000u, fake_pf->get(TEST_PERFCOUNTERS1_ELEMENT_1));
+  ASSERT_EQ(make_pair((uint64_t)400000, (uint64_t)400),
+	    fake_pf->get_tavg_ms(TEST_PERFCOUNTERS1_ELEMENT_3));
+  delete fake_pf;
+}
+
+TEST(PerfHistogram, Buckets) {
+  PerfHistogram::axis_config_d lin = {
+    "lin", PerfHistogram::SCALE_LINEAR, 10, 5, 5
+  };
+  ASSERT_EQ(0, PerfHistogram::get_bucket(-3, lin));
+  ASSERT_EQ(0, PerfHistogram::get_bucket(9, lin));
+  ASSERT_EQ(1, PerfHistogram::get_bucket(10, lin));
+  ASSERT_EQ(1, PerfHistogram::get_bucket(14, lin));
+  ASSERT_EQ(2, PerfHistogram::get_bucket(15, lin));
+  ASSERT_EQ(3, PerfHistogram::get_bucket(24, lin));
+  ASSERT_EQ(4, PerfHistogram::get_bucket(25, lin));
+  ASSERT_EQ(4, PerfHistogram::get_bucket(1000000, lin));
+
+  PerfHistogram::axis_config_d log = {
+    "log", PerfHistogram::SCALE_LOG2, 0, 10, 6
+  };
+  ASSERT_EQ(0, PerfHistogram::get_bucket(-1, log));
+  ASSERT_EQ(1, PerfHistogram::get_bucket(0, log));
+  ASSERT_EQ(1, PerfHistogram::get_bucket(9, log));
+  ASSERT_EQ(2, PerfHistogram::get_bucket(10, log));
+  ASSERT_EQ(2, PerfHistogram::get_bucket(19, log));
+  ASSERT_EQ(3, PerfHistogram::get_bucket(20, log));
+  ASSERT_EQ(3, PerfHistogram::get_bucket(39, log));
+  ASSERT_EQ(4, PerfHistogram::get_bucket(40, log));
+  ASSERT_EQ(4, PerfHistogram::get_bucket(79, log));
+  ASSERT_EQ(5, PerfHistogram::get_bucket(80, log));
+
+  // every value lands in the bucket whose range holds it
+  std::vector<std::pair<int64_t, int64_t> > r =
+    PerfHistogram::get_bucket_ranges(log);
+  ASSERT_EQ(6u, r.size());
+  for (int64_t v = -5; v < 200; ++v) {
+    int32_t b = PerfHistogram::get_bucket(v, log);
+    ASSERT_LE(r[b].first, v);
+    ASSERT_GE(r[b].second, v);
+  }
+}
+
+enum {
+  TEST_PERFCOUNTERS3_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS3_ELEMENT_COUNT,
+  TEST_PERFCOUNTERS3_ELEMENT_HIST,
+  TEST_PERFCOUNTERS3_ELEMENT_LAST,
+};
+
+TEST(PerfCounters, Histogram) {
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfHistogram::axis_config_d lat = {
+    "latency", PerfHistogram::SCALE_LOG2, 0, 1, 4
+  };
+  PerfHistogram::axis_config_d size = {
+    "size", PerfHistogram::SCALE_LINEAR, 0, 100, 3
+  };
+  PerfCountersBuilder bld(g_ceph_context, "test_perfcounter_3",
+	  TEST_PERFCOUNTERS3_ELEMENT_FIRST, TEST_PERFCOUNTERS3_ELEMENT_LAST);
+  bld.add_u64_counter(TEST_PERFCOUNTERS3_ELEMENT_COUNT, "count");
+  bld.add_histogram(TEST_PERFCOUNTERS3_ELEMENT_HIST, "hist", lat, size);
+  PerfCounters *fake_pf = bld.create_perf_counters();
+  coll->add(fake_pf);
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+
+  fake_pf->inc(TEST_PERFCOUNTERS3_ELEMENT_COUNT, 3);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 0, 50);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 1, 50);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 1, 150);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, 100, 1000);
+  fake_pf->hinc(TEST_PERFCOUNTERS3_ELEMENT_HIST, -1, -1);
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"count\":3,\"hist\":{\"values\":"
+	       "[[1,0,0],[0,1,0],[0,1,1],[0,0,1]]}}}"), msg);
+
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf schema\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"count\":{\"type\":10},"
+	       "\"hist\":{\"type\":16,\"axes\":["
+	       "{\"name\":\"latency\",\"scale_type\":\"log2\",\"min\":0,"
+	       "\"quant_size\":1,\"buckets\":4,\"ranges\":"
+	       "[{\"max\":-1},{\"min\":0,\"max\":0},{\"min\":1,\"max\":1},{\"min\":2}]},"
+	       "{\"name\":\"size\",\"scale_type\":\"linear\",\"min\":0,"
+	       "\"quant_size\":100,\"buckets\":3,\"ranges\":"
+	       "[{\"max\":-1},{\"min\":0,\"max\":99},{\"min\":100}]}]}}}"), msg);
+
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf reset\", \"var\": \"test_perfcounter_3\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"count\":0,\"hist\":{\"values\":"
+	       "[[0,0,0],[0,0,0],[0,0,0],[0,0,0]]}}}"), msg);
+  coll->clear();
+}
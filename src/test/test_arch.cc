@@ -14,6 +14,8 @@ int main(int argc, char **argv)
 
 	printf("ceph_arch_intel_sse42 = %d\n", ceph_arch_intel_sse42);
         printf("ceph_arch_intel_sse2 = %d\n", ceph_arch_intel_sse2);
+	printf("ceph_arch_intel_ssse3 = %d\n", ceph_arch_intel_ssse3);
+	printf("ceph_arch_intel_avx2 = %d\n", ceph_arch_intel_avx2);
 	printf("ceph_arch_neon = %d\n", ceph_arch_neon);
 
 	return 0;
@@ -366,6 +366,32 @@ public:
       cur = next.first;
     }
   }
+
+  void get_next_n() {
+    string cur;
+    unsigned max = 1 + random_num();
+    while (true) {
+      vector<pair<string, bufferlist> > got;
+      int r = cache->get_next_n(cur, max, &got);
+
+      map<string, bufferlist>::iterator i = truth.upper_bound(cur);
+      if (i == truth.end()) {
+	ASSERT_EQ(-ENOENT, r);
+	break;
+      }
+      ASSERT_EQ(0, r);
+      ASSERT_LE(got.size(), max);
+      for (vector<pair<string, bufferlist> >::iterator j = got.begin();
+	   j != got.end();
+	   ++j, ++i) {
+	ASSERT_TRUE(i != truth.end());
+	ASSERT_EQ(i->first, j->first);
+	assert_bl_eq(j->second, i->second);
+      }
+      ASSERT_TRUE(got.size() == max || i == truth.end());
+      cur = got.rbegin()->first;
+    }
+  }
   virtual void SetUp() {
     driver.reset(new PausyAsyncMap());
     cache.reset(new MapCacher::MapCacher<string, bufferlist>(driver.get()));
@@ -420,7 +446,7 @@ TEST_F(MapCacherTest, Random)
     if (!(i % 50)) {
       std::cout << "On iteration " << i << std::endl;
     }
-    switch (rand() % 4) {
+    switch (rand() % 5) {
     case 0:
       get();
       break;
@@ -433,6 +459,9 @@ TEST_F(MapCacherTest, Random)
     case 3:
       remove();
       break;
+    case 4:
+      get_next_n();
+      break;
     }
   }
 }
@@ -512,31 +541,47 @@ public:
       rand_choose(snap_to_hobject);
     set<hobject_t> hobjects = snap->second;
 
-    hobject_t hoid;
-    while (mapper->get_next_object_to_trim(snap->first, &hoid) == 0) {
-      assert(!hoid.is_max());
-      assert(hobjects.count(hoid));
-      hobjects.erase(hoid);
-
-      map<hobject_t, set<snapid_t> >::iterator j =
-	hobject_to_snap.find(hoid);
-      assert(j->second.count(snap->first));
-      set<snapid_t> old_snaps(j->second);
-      j->second.erase(snap->first);
-
-      {
-	PausyAsyncMap::Transaction t;
-	mapper->update_snaps(
-	  hoid,
-	  j->second,
-	  &old_snaps,
-	  &t);
-	driver->submit(&t);
+    // one at a time, or in batches as the snap trimmer does
+    unsigned batch = rand() % 8;
+    while (true) {
+      vector<hobject_t> hoids;
+      if (batch) {
+	if (mapper->get_next_objects_to_trim(snap->first, batch, &hoids) != 0)
+	  break;
+	assert(hoids.size() <= batch);
+      } else {
+	hobject_t hoid;
+	if (mapper->get_next_object_to_trim(snap->first, &hoid) != 0)
+	  break;
+	hoids.push_back(hoid);
       }
-      if (j->second.empty()) {
-	hobject_to_snap.erase(j);
+
+      for (vector<hobject_t>::iterator hoid = hoids.begin();
+	   hoid != hoids.end();
+	   ++hoid) {
+	assert(!hoid->is_max());
+	assert(hobjects.count(*hoid));
+	hobjects.erase(*hoid);
+
+	map<hobject_t, set<snapid_t> >::iterator j =
+	  hobject_to_snap.find(*hoid);
+	assert(j->second.count(snap->first));
+	set<snapid_t> old_snaps(j->second);
+	j->second.erase(snap->first);
+
+	{
+	  PausyAsyncMap::Transaction t;
+	  mapper->update_snaps(
+	    *hoid,
+	    j->second,
+	    &old_snaps,
+	    &t);
+	  driver->submit(&t);
+	}
+	if (j->second.empty()) {
+	  hobject_to_snap.erase(j);
+	}
       }
-      hoid = hobject_t::get_max();
     }
     assert(hobjects.empty());
 
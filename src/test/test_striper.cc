@@ -5,6 +5,7 @@
 #include "common/common_init.h"
 
 #include "osdc/Striper.h"
+#include "common/Clock.h"
 
 TEST(Striper, Stripe1)
 {
@@ -57,6 +58,74 @@ TEST(Striper, EmptyPartialResult)
   ASSERT_EQ(65536u, outbl.length());
 }
 
+TEST(Striper, SingleExtent)
+{
+  ceph_file_layout l;
+  memset(&l, 0, sizeof(l));
+
+  l.fl_object_size = 262144;
+  l.fl_stripe_unit = 4096;
+  l.fl_stripe_count = 3;
+
+  // ranges within a stripe unit take the short cut; they must come out
+  // as the general mapping would have them
+  unsigned seed = 1;
+  for (int i = 0; i < 10000; ++i) {
+    uint64_t off = rand_r(&seed) % (64 << 20);
+    uint64_t len = 1 + rand_r(&seed) % (l.fl_stripe_unit - off % l.fl_stripe_unit);
+    uint64_t trunc = rand_r(&seed) % (64 << 20);
+
+    vector<ObjectExtent> ex;
+    Striper::file_to_extents(g_ceph_context, "foo.%08llx", &l, off, len, trunc,
+			     ex, 100);
+    map<object_t, vector<ObjectExtent> > m;
+    Striper::file_to_extents(g_ceph_context, "foo.%08llx", &l, off, len, trunc,
+			     m, 100);
+    vector<ObjectExtent> slow;
+    Striper::assimilate_extents(m, slow);
+
+    ASSERT_EQ(1u, ex.size());
+    ASSERT_EQ(1u, slow.size());
+    ASSERT_EQ(slow[0].oid, ex[0].oid);
+    ASSERT_EQ(slow[0].objectno, ex[0].objectno);
+    ASSERT_EQ(slow[0].offset, ex[0].offset);
+    ASSERT_EQ(slow[0].length, ex[0].length);
+    ASSERT_EQ(slow[0].truncate_size, ex[0].truncate_size);
+    ASSERT_TRUE(slow[0].buffer_extents == ex[0].buffer_extents);
+  }
+}
+
+TEST(Striper, SingleExtentBench)
+{
+  ceph_file_layout l;
+  memset(&l, 0, sizeof(l));
+
+  l.fl_object_size = 4194304;
+  l.fl_stripe_unit = 4194304;
+  l.fl_stripe_count = 1;
+
+  const int n = 100000;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < n; ++i) {
+    vector<ObjectExtent> ex;
+    Striper::file_to_extents(g_ceph_context, "rbd_data.1234.%016llx", &l,
+			     (uint64_t)i * 4096, 4096, 0, ex);
+  }
+  utime_t fast = ceph_clock_now(g_ceph_context) - start;
+
+  start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < n; ++i) {
+    map<object_t, vector<ObjectExtent> > m;
+    Striper::file_to_extents(g_ceph_context, "rbd_data.1234.%016llx", &l,
+			     (uint64_t)i * 4096, 4096, 0, m);
+    vector<ObjectExtent> ex;
+    Striper::assimilate_extents(m, ex);
+  }
+  utime_t slow = ceph_clock_now(g_ceph_context) - start;
+
+  cout << n << " 4k mappings: " << fast << "s single extent, "
+       << slow << "s through the object map" << std::endl;
+}
 
 
 int main(int argc, char **argv)
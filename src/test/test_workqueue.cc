@@ -57,6 +57,210 @@ TEST(WorkQueue, Resize)
   tp.stop();
 }
 
+class ShardedTestWQ : public ShardedThreadPool::ShardedWQ<int> {
+  struct Shard {
+    Mutex lock;
+    Cond cond;
+    list<int> q;
+    list<int> processed;
+    Shard() : lock("ShardedTestWQ::Shard::lock") {}
+  };
+  vector<Shard*> shards;
+
+public:
+  ShardedTestWQ(uint32_t num_shards, ShardedThreadPool *tp)
+    : ShardedThreadPool::ShardedWQ<int>(10, 100, tp) {
+    for (uint32_t i = 0; i < num_shards; ++i)
+      shards.push_back(new Shard);
+  }
+  ~ShardedTestWQ() {
+    for (unsigned i = 0; i < shards.size(); ++i)
+      delete shards[i];
+  }
+
+  void _enqueue(int item) {
+    Shard *s = shards[item % shards.size()];
+    Mutex::Locker l(s->lock);
+    s->q.push_back(item);
+    s->cond.Signal();
+  }
+  void _enqueue_front(int item) {
+    Shard *s = shards[item % shards.size()];
+    Mutex::Locker l(s->lock);
+    s->q.push_front(item);
+    s->cond.Signal();
+  }
+  void _process(uint32_t thread_index, heartbeat_handle_d *hb) {
+    Shard *s = shards[thread_index % shards.size()];
+    Mutex::Locker l(s->lock);
+    if (s->q.empty())
+      s->cond.WaitInterval(g_ceph_context, s->lock, utime_t(0, 100000000));
+    if (s->q.empty())
+      return;
+    s->processed.push_back(s->q.front());
+    s->q.pop_front();
+  }
+  void return_waiting_threads() {
+    for (unsigned i = 0; i < shards.size(); ++i) {
+      Mutex::Locker l(shards[i]->lock);
+      shards[i]->cond.Signal();
+    }
+  }
+  bool is_shard_empty(uint32_t thread_index) {
+    Shard *s = shards[thread_index % shards.size()];
+    Mutex::Locker l(s->lock);
+    return s->q.empty();
+  }
+
+  list<int> get_processed(uint32_t shard) {
+    Mutex::Locker l(shards[shard]->lock);
+    return shards[shard]->processed;
+  }
+};
+
+TEST(ShardedWorkQueue, StartStop)
+{
+  ShardedThreadPool tp(g_ceph_context, "sharded_foo", 4);
+  ShardedTestWQ wq(4, &tp);
+
+  tp.start();
+  tp.pause();
+  tp.unpause();
+  tp.pause_new();
+  tp.unpause();
+  tp.drain();
+  tp.stop();
+}
+
+TEST(ShardedWorkQueue, PerShardOrdering)
+{
+  const uint32_t num_shards = 3;
+  ShardedThreadPool tp(g_ceph_context, "sharded_bar", num_shards);
+  ShardedTestWQ wq(num_shards, &tp);
+
+  tp.start();
+  for (int i = 0; i < 300; ++i)
+    wq.queue(i);
+  wq.drain();
+  tp.stop();
+
+  for (uint32_t shard = 0; shard < num_shards; ++shard) {
+    list<int> processed = wq.get_processed(shard);
+    ASSERT_EQ(100u, processed.size());
+    int expected = shard;
+    for (list<int>::iterator p = processed.begin(); p != processed.end(); ++p) {
+      ASSERT_EQ(expected, *p);
+      expected += num_shards;
+    }
+  }
+}
+
+
+class StealingTestWQ : public StealingThreadPool::WorkQueue<int> {
+  Mutex lock;
+  Cond cond;
+  bool blocked;
+
+  void _process(int *item, ThreadPool::TPHandle &) {
+    Mutex::Locker l(lock);
+    while (blocked && *item < 0)
+      cond.Wait(lock);
+    processed.insert(*item);
+  }
+  void _discard(int *item) {
+    Mutex::Locker l(lock);
+    discarded.insert(*item);
+  }
+
+public:
+  set<int> processed, discarded;
+
+  StealingTestWQ(StealingThreadPool *tp)
+    : StealingThreadPool::WorkQueue<int>("StealingTestWQ", 10, 100, tp),
+      lock("StealingTestWQ::lock"), blocked(false) {}
+
+  /// make negative items wait for unblock()
+  void block() {
+    Mutex::Locker l(lock);
+    blocked = true;
+  }
+  void unblock() {
+    Mutex::Locker l(lock);
+    blocked = false;
+    cond.SignalAll();
+  }
+  size_t num_processed() {
+    Mutex::Locker l(lock);
+    return processed.size();
+  }
+};
+
+TEST(StealingWorkQueue, StartStop)
+{
+  StealingThreadPool tp(g_ceph_context, "stealing_foo", 4);
+  StealingTestWQ wq(&tp);
+
+  tp.start();
+  tp.pause();
+  tp.unpause();
+  tp.pause_new();
+  tp.unpause();
+  tp.drain();
+  tp.stop();
+}
+
+TEST(StealingWorkQueue, Steal)
+{
+  StealingThreadPool tp(g_ceph_context, "stealing_bar", 3);
+  StealingTestWQ wq(&tp);
+  vector<int> items(301);
+  for (int i = 0; i < 300; ++i)
+    items[i] = i;
+  items[300] = -1;
+
+  tp.start();
+  // wedge worker 0, then give it everything; the others must take it
+  wq.block();
+  wq.queue(&items[300], 0);
+  for (int i = 0; i < 300; ++i)
+    wq.queue(&items[i], 0);
+  for (int n = 0; n < 500 && wq.num_processed() < 300; ++n)
+    usleep(10000);
+  ASSERT_EQ(300u, wq.num_processed());
+  wq.unblock();
+  wq.drain();
+  tp.stop();
+  ASSERT_EQ(301u, wq.processed.size());
+  ASSERT_TRUE(wq.discarded.empty());
+}
+
+TEST(StealingWorkQueue, PauseStop)
+{
+  StealingThreadPool tp(g_ceph_context, "stealing_baz", 2);
+  StealingTestWQ wq(&tp);
+  vector<int> items(100);
+  for (int i = 0; i < 100; ++i)
+    items[i] = i;
+
+  tp.start();
+  tp.pause();
+  for (int i = 0; i < 100; ++i)
+    wq.queue(&items[i]);
+  usleep(100000);
+  ASSERT_EQ(0u, wq.num_processed());
+  tp.stop();
+  ASSERT_EQ(100u, wq.discarded.size());
+  tp.unpause();
+
+  // and it can start over
+  tp.start();
+  for (int i = 0; i < 100; ++i)
+    wq.queue(&items[i]);
+  wq.drain();
+  tp.stop();
+  ASSERT_EQ(100u, wq.processed.size());
+}
+
 
 int main(int argc, char **argv)
 {
@@ -32,6 +32,10 @@
 #include "os/FileStore.h"
 #include "common/perf_counters.h"
 #include "common/errno.h"
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "common/Throttle.h"
 #include "osd/PGLog.h"
 #include "osd/OSD.h"
 
@@ -320,34 +324,72 @@ hobject_t biginfo_oid, log_oid;
 
 int file_fd = fd_none;
 bool debug = false;
+int num_threads = 4;
 super_header sh;
 
 template <typename T>
-int write_section(sectiontype_t type, const T& obj, int fd) {
-  bufferlist blhdr, bl, blftr;
+void encode_section(sectiontype_t type, const T& obj, bufferlist *out) {
+  bufferlist bl, blftr;
   obj.encode(bl);
   header hdr(type, bl.length());
-  hdr.encode(blhdr);
+  hdr.encode(*out);
   footer ft;
   ft.encode(blftr);
+  out->claim_append(bl);
+  out->claim_append(blftr);
+}
 
-  int ret = blhdr.write_fd(fd);
-  if (ret) return ret;
-  ret = bl.write_fd(fd);
-  if (ret) return ret;
-  ret = blftr.write_fd(fd);
-  return ret;
+void encode_simple(sectiontype_t type, bufferlist *out)
+{
+  header hdr(type, 0);
+  hdr.encode(*out);
+}
+
+template <typename T>
+int write_section(sectiontype_t type, const T& obj, int fd) {
+  bufferlist bl;
+  encode_section(type, obj, &bl);
+  return bl.write_fd(fd);
 }
 
 int write_simple(sectiontype_t type, int fd)
 {
   bufferlist hbl;
-
-  header hdr(type, 0);
-  hdr.encode(hbl);
+  encode_simple(type, &hbl);
   return hbl.write_fd(fd);
 }
 
+/*
+ * Objects and bytes moved so far, reported every few seconds and at
+ * the end.  Nothing is printed when the export goes to stdout.
+ */
+struct progress_t {
+  const char *what;
+  utime_t start, last;
+  uint64_t objects, bytes;
+
+  progress_t(const char *w)
+    : what(w), start(ceph_clock_now(NULL)), last(start),
+      objects(0), bytes(0) {}
+
+  void add(uint64_t b, bool final = false) {
+    if (!final) {
+      ++objects;
+      bytes += b;
+    }
+    utime_t now = ceph_clock_now(NULL);
+    if (file_fd == STDOUT_FILENO || (!final && now - last < utime_t(5, 0)))
+      return;
+    last = now;
+    double elapsed = now - start;
+    cout << what << " " << objects << " objects, "
+	 << (bytes >> 20) << " MB in " << (int)elapsed << "s";
+    if (elapsed > 0)
+      cout << ", " << (int)((bytes >> 20) / elapsed) << " MB/s";
+    cout << std::endl;
+  }
+};
+
 static void invalid_path(string &path)
 {
   cout << "Invalid path to osd store specified: " << path << "\n";
@@ -563,7 +605,8 @@ int write_pg(ObjectStore::Transaction &t, epoch_t epoch, pg_info_t &info,
   return 0;
 }
 
-int export_file(ObjectStore *store, coll_t cid, hobject_t &obj)
+int export_file(ObjectStore *store, coll_t cid, const hobject_t &obj,
+		bufferlist *out)
 {
   struct stat st;
   mysize_t total;
@@ -583,34 +626,52 @@ int export_file(ObjectStore *store, coll_t cid, hobject_t &obj)
     cout << "size=" << total << std::endl;
 
   object_begin objb(obj);
-  ret = write_section(TYPE_OBJECT_BEGIN, objb, file_fd);
-  if (ret < 0)
-    return ret;
-
-  uint64_t offset = 0;
-  bufferlist rawdatabl, databl;
-  while(total > 0) {
-    rawdatabl.clear();
-    databl.clear();
-    mysize_t len = max_read;
-    if (len > total)
-      len = total;
-
-    ret = store->read(cid, obj, offset, len, rawdatabl);
+  encode_section(TYPE_OBJECT_BEGIN, objb, out);
+
+  // export only the extents holding data; always include the last
+  // byte, so the object gets its full size on import
+  map<uint64_t, uint64_t> extents;
+  if (total > 0) {
+    bufferlist mbl;
+    ret = store->fiemap(cid, obj, 0, total, mbl);
     if (ret < 0)
       return ret;
-    if (ret == 0)
-      return -EINVAL;
-
-    data_section dblock(offset, len, rawdatabl);
-    total -= ret;
-    offset += ret;
-
-    if (debug && file_fd != STDOUT_FILENO)
-      cout << "data section offset=" << offset << " len=" << len << std::endl;
+    bufferlist::iterator mp = mbl.begin();
+    ::decode(extents, mp);
+    map<uint64_t, uint64_t>::reverse_iterator last = extents.rbegin();
+    if (last == extents.rend() ||
+	last->first + last->second < (uint64_t)total)
+      extents[total - 1] = 1;
+  }
 
-    ret = write_section(TYPE_DATA, dblock, file_fd);
-    if (ret) return ret;
+  bufferlist rawdatabl, databl;
+  for (map<uint64_t, uint64_t>::iterator p = extents.begin();
+       p != extents.end();
+       ++p) {
+    uint64_t offset = p->first;
+    uint64_t left = MIN(p->second, (uint64_t)total - offset);
+    while (left > 0) {
+      rawdatabl.clear();
+      databl.clear();
+      mysize_t len = max_read;
+      if ((uint64_t)len > left)
+	len = left;
+
+      ret = store->read(cid, obj, offset, len, rawdatabl);
+      if (ret < 0)
+	return ret;
+      if (ret == 0)
+	return -EINVAL;
+
+      data_section dblock(offset, len, rawdatabl);
+      left -= ret;
+      offset += ret;
+
+      if (debug && file_fd != STDOUT_FILENO)
+	cout << "data section offset=" << offset << " len=" << len << std::endl;
+
+      encode_section(TYPE_DATA, dblock, out);
+    }
   }
 
   //Handle attrs for this object
@@ -618,9 +679,7 @@ int export_file(ObjectStore *store, coll_t cid, hobject_t &obj)
   ret = store->getattrs(cid, obj, aset, false);
   if (ret) return ret;
   attr_section as(aset);
-  ret = write_section(TYPE_ATTRS, as, file_fd);
-  if (ret)
-    return ret;
+  encode_section(TYPE_ATTRS, as, out);
 
   if (debug && file_fd != STDOUT_FILENO) {
     cout << "attrs size " << aset.size() << std::endl;
@@ -629,52 +688,134 @@ int export_file(ObjectStore *store, coll_t cid, hobject_t &obj)
   //Handle omap information
   databl.clear();
   bufferlist hdrbuf;
-  map<string, bufferlist> out;
-  ret = store->omap_get(cid, obj, &hdrbuf, &out);
+  map<string, bufferlist> omap;
+  ret = store->omap_get(cid, obj, &hdrbuf, &omap);
   if (ret < 0)
     return ret;
 
   omap_hdr_section ohs(hdrbuf);
-  ret = write_section(TYPE_OMAP_HDR, ohs, file_fd);
-  if (ret)
-    return ret;
+  encode_section(TYPE_OMAP_HDR, ohs, out);
 
-  if (!out.empty()) {
-    omap_section oms(out);
-    ret = write_section(TYPE_OMAP, oms, file_fd);
-    if (ret)
-      return ret;
+  if (!omap.empty()) {
+    omap_section oms(omap);
+    encode_section(TYPE_OMAP, oms, out);
 
     if (debug && file_fd != STDOUT_FILENO)
-      cout << "omap map size " << out.size() << std::endl;
+      cout << "omap map size " << omap.size() << std::endl;
   }
 
-  ret = write_simple(TYPE_OBJECT_END, file_fd);
-  if (ret)
-    return ret;
-
+  encode_simple(TYPE_OBJECT_END, out);
   return 0;
 }
 
+/*
+ * Objects of a listing batch are read and encoded by num_threads
+ * threads at once, and written out in listing order, so the stream is
+ * the same as one thread would write.  Readers stay at most two
+ * objects per thread ahead of the writer, which bounds the memory
+ * held by encoded objects.
+ */
+struct export_batch_t {
+  ObjectStore *store;
+  coll_t coll;
+  const vector<ghobject_t> &objects;
+  vector<bufferlist> out;
+  vector<int> ret;
+  vector<bool> ready;
+  size_t next;      ///< next object to read
+  size_t written;   ///< next object to write
+  size_t window;
+  Mutex lock;
+  Cond cond;
+
+  export_batch_t(ObjectStore *s, coll_t c, const vector<ghobject_t> &o)
+    : store(s), coll(c), objects(o),
+      out(o.size()), ret(o.size(), 0), ready(o.size(), false),
+      next(0), written(0), window(2 * num_threads),
+      lock("export_batch_t::lock") {}
+};
+
+class ExportThread : public Thread {
+  export_batch_t *batch;
+public:
+  ExportThread(export_batch_t *b) : batch(b) {}
+  void *entry() {
+    Mutex::Locker l(batch->lock);
+    while (true) {
+      while (batch->next < batch->objects.size() &&
+	     batch->next >= batch->written + batch->window)
+	batch->cond.Wait(batch->lock);
+      if (batch->next >= batch->objects.size())
+	break;
+      size_t i = batch->next++;
+      batch->lock.Unlock();
+      bufferlist bl;
+      assert(batch->objects[i].generation == ghobject_t::NO_GEN);
+      int r = export_file(batch->store, batch->coll, batch->objects[i].hobj,
+			  &bl);
+      batch->lock.Lock();
+      batch->out[i].claim(bl);
+      batch->ret[i] = r;
+      batch->ready[i] = true;
+      batch->cond.Signal();
+    }
+    return NULL;
+  }
+};
+
 int export_files(ObjectStore *store, coll_t coll)
 {
   vector<ghobject_t> objects;
   ghobject_t next;
+  progress_t progress("Exported");
 
   while (!next.is_max()) {
     int r = store->collection_list_partial(coll, next, 200, 300, 0,
       &objects, &next);
     if (r < 0)
       return r;
-    for (vector<ghobject_t>::iterator i = objects.begin();
-	 i != objects.end();
-	 ++i) {
-      assert(i->generation == ghobject_t::NO_GEN);
-      r = export_file(store, coll, i->hobj);
-      if (r < 0)
-        return r;
+
+    export_batch_t batch(store, coll, objects);
+    vector<ExportThread*> threads;
+    for (int i = 0; i < num_threads && i < (int)objects.size(); ++i) {
+      threads.push_back(new ExportThread(&batch));
+      threads.back()->create();
+    }
+
+    batch.lock.Lock();
+    while (batch.written < objects.size()) {
+      size_t i = batch.written;
+      while (!batch.ready[i])
+	batch.cond.Wait(batch.lock);
+      bufferlist bl;
+      bl.claim(batch.out[i]);
+      r = batch.ret[i];
+      batch.lock.Unlock();
+      if (r >= 0)
+	r = bl.write_fd(file_fd);
+      batch.lock.Lock();
+      if (r < 0) {
+	// stop the readers; the stream is no good past an error anyway
+	batch.next = objects.size();
+	batch.cond.Signal();
+	break;
+      }
+      batch.written++;
+      batch.cond.Signal();
+      progress.add(bl.length());
     }
+    batch.lock.Unlock();
+
+    for (vector<ExportThread*>::iterator t = threads.begin();
+	 t != threads.end();
+	 ++t) {
+      (*t)->join();
+      delete *t;
+    }
+    if (r < 0)
+      return r;
   }
+  progress.add(0, true);
   return 0;
 }
 
@@ -718,7 +859,9 @@ int do_export(ObjectStore *fs, coll_t coll, pg_t pgid, pg_info_t &info,
   if (ret)
     return ret;
 
-  export_files(fs, coll);
+  ret = export_files(fs, coll);
+  if (ret)
+    return ret;
 
   metadata_section ms(struct_ver, map_epoch, info, log);
   ret = write_section(TYPE_PG_METADATA, ms, file_fd);
@@ -848,10 +991,9 @@ int get_omap(ObjectStore *store, coll_t coll, hobject_t hoid,
   return 0;
 }
 
-int get_object(ObjectStore *store, coll_t coll, bufferlist &bl)
+int get_object(ObjectStore *store, coll_t coll, bufferlist &bl,
+	       ObjectStore::Transaction *t)
 {
-  ObjectStore::Transaction tran;
-  ObjectStore::Transaction *t = &tran;
   bufferlist::iterator ebliter = bl.begin();
   object_begin ob;
   ob.decode(ebliter);
@@ -909,10 +1051,34 @@ int get_object(ObjectStore *store, coll_t coll, bufferlist &bl)
       return EFAULT;
     }
   }
-  store->apply_transaction(*t);
   return 0;
 }
 
+/*
+ * Imported objects are applied in batches of about
+ * journal_max_write_bytes, with up to num_threads batches queued
+ * behind one another on one sequencer, so the journal write of a
+ * batch overlaps applying the ones before it.
+ */
+struct C_ImportBatch : public Context {
+  ObjectStore::Transaction *t;
+  SimpleThrottle *throttle;
+  C_ImportBatch(ObjectStore::Transaction *_t, SimpleThrottle *_throttle)
+    : t(_t), throttle(_throttle) {
+    throttle->start_op();
+  }
+  void finish(int r) {
+    delete t;
+    throttle->end_op(r);
+  }
+};
+
+void queue_import_batch(ObjectStore *store, ObjectStore::Sequencer *osr,
+			ObjectStore::Transaction *t, SimpleThrottle *throttle)
+{
+  store->queue_transaction(osr, t, new C_ImportBatch(t, throttle));
+}
+
 int get_pg_metadata(ObjectStore *store, coll_t coll, bufferlist &bl)
 {
   ObjectStore::Transaction tran;
@@ -1014,12 +1180,18 @@ int do_import(ObjectStore *store, OSDSuperblock sb)
 
   cout << "Importing pgid " << pgid << std::endl;
 
+  ObjectStore::Sequencer osr("import");
+  SimpleThrottle throttle(num_threads, false);
+  uint64_t batch_bytes = g_conf->journal_max_write_bytes;
+  progress_t progress("Imported");
+  t = new ObjectStore::Transaction;
+
   bool done = false;
   bool found_metadata = false;
   while(!done) {
     ret = read_section(file_fd, &type, &ebl);
     if (ret)
-      return ret;
+      break;
 
     //cout << "do_import: Section type " << hex << type << dec << std::endl;
     if (type >= END_OF_TYPES) {
@@ -1028,21 +1200,46 @@ int do_import(ObjectStore *store, OSDSuperblock sb)
     }
     switch(type) {
     case TYPE_OBJECT_BEGIN:
-      ret = get_object(store, rmcoll, ebl);
-      if (ret) return ret;
+      {
+	uint64_t before = t->get_encoded_bytes();
+	ret = get_object(store, rmcoll, ebl, t);
+	if (ret)
+	  break;
+	progress.add(t->get_encoded_bytes() - before);
+	if (t->get_encoded_bytes() >= batch_bytes) {
+	  queue_import_batch(store, &osr, t, &throttle);
+	  t = new ObjectStore::Transaction;
+	}
+      }
       break;
     case TYPE_PG_METADATA:
+      // the objects must be in before the collection is renamed
+      queue_import_batch(store, &osr, t, &throttle);
+      t = new ObjectStore::Transaction;
+      ret = -throttle.wait_for_ret();
+      if (ret)
+	break;
       ret = get_pg_metadata(store, rmcoll, ebl);
-      if (ret) return ret;
+      if (ret)
+	break;
       found_metadata = true;
       break;
     case TYPE_PG_END:
       done = true;
       break;
     default:
-      return EFAULT;
+      ret = EFAULT;
     }
+    if (ret)
+      break;
   }
+  queue_import_batch(store, &osr, t, &throttle);
+  int r = throttle.wait_for_ret();
+  if (ret)
+    return ret;
+  if (r)
+    return -r;
+  progress.add(0, true);
 
   if (!found_metadata) {
     cout << "Missing metadata section" << std::endl;
@@ -1071,6 +1268,9 @@ int main(int argc, char **argv)
     ("file", po::value<string>(&file),
      "path of file to export or import")
     ("debug", "Enable diagnostic output to stderr")
+    ("threads", po::value<int>(&num_threads)->default_value(4),
+     "objects read at once on export, and transactions queued at once "
+     "on import")
     ;
 
   po::variables_map vm;
@@ -1090,6 +1290,11 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  if (num_threads < 1) {
+    cout << "--threads must be at least 1" << std::endl;
+    return 1;
+  }
+
   if (!vm.count("filestore-path")) {
     cout << "Must provide filestore-path" << std::endl
 	 << desc << std::endl;
@@ -91,7 +91,7 @@ void usage()
   cout << "                         specify output for for (de)compilation\n";
   cout << "   --build --num_osds N layer1 ...\n";
   cout << "                         build a new map, where each 'layer' is\n";
-  cout << "                           'name (uniform|straw|list|tree) size'\n";
+  cout << "                           'name (uniform|straw|straw2|list|tree) size'\n";
   cout << "   -i mapfn --test       test a range of inputs on the map\n";
   cout << "      [--min-x x] [--max-x x] [--x x]\n";
   cout << "      [--min-rule r] [--max-rule r] [--rule r]\n";
@@ -102,6 +102,10 @@ void usage()
   cout << "      [--simulate]       simulate placements using a random\n";
   cout << "                         number generator in place of the CRUSH\n";
   cout << "                         algorithm\n";
+  cout << "      [--threads n]      spread the CRUSH mappings across n threads\n";
+  cout << "   -i mapfn --benchmark  time the mapping of a range of inputs and\n";
+  cout << "                         report mappings per second; takes the\n";
+  cout << "                         --test range and --threads options\n";
   cout << "   -i mapfn --add-item id weight name [--loc type name ...]\n";
   cout << "                         insert an item into the hierarchy at the\n";
   cout << "                         given location\n";
@@ -147,6 +151,7 @@ struct bucket_types_t {
   { "uniform", CRUSH_BUCKET_UNIFORM },
   { "list", CRUSH_BUCKET_LIST },
   { "straw", CRUSH_BUCKET_STRAW },
+  { "straw2", CRUSH_BUCKET_STRAW2 },
   { "tree", CRUSH_BUCKET_TREE },
   { 0, 0 },
 };
@@ -167,6 +172,7 @@ int main(int argc, const char **argv)
   bool compile = false;
   bool decompile = false;
   bool test = false;
+  bool benchmark = false;
   bool display = false;
   bool write_to_file = false;
   int verbose = 0;
@@ -244,6 +250,8 @@ int main(int argc, const char **argv)
       compile = true;
     } else if (ceph_argparse_flag(args, i, "-t", "--test", (char*)NULL)) {
       test = true;
+    } else if (ceph_argparse_flag(args, i, "--benchmark", (char*)NULL)) {
+      benchmark = true;
     } else if (ceph_argparse_flag(args, i, "-s", "--simulate", (char*)NULL)) {
       tester.set_random_placement();
     } else if (ceph_argparse_flag(args, i, "--enable-unsafe-tunables", (char*)NULL)) {
@@ -390,6 +398,12 @@ int main(int argc, const char **argv)
 	exit(EXIT_FAILURE);
       }
       tester.set_batches(x);
+    } else if (ceph_argparse_withint(args, i, &x, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
+      tester.set_num_threads(x);
     } else if (ceph_argparse_withfloat(args, i, &y, &err, "--mark-down-ratio", (char*)NULL)) {
       if (!err.str().empty()) {
         cerr << err.str() << std::endl;
@@ -430,7 +444,8 @@ int main(int argc, const char **argv)
     cout << "cannot specify more than one of compile, decompile, and build" << std::endl;
     exit(EXIT_FAILURE);
   }
-  if (!compile && !decompile && !build && !test && !reweight && !adjust &&
+  if (!compile && !decompile && !build && !test && !benchmark &&
+      !reweight && !adjust &&
       add_item < 0 &&
       remove_name.empty() && reweight_name.empty()) {
     cout << "no action specified; -h for help" << std::endl;
@@ -741,6 +756,12 @@ int main(int argc, const char **argv)
       exit(1);
   }
 
+  if (benchmark) {
+    int r = tester.benchmark();
+    if (r < 0)
+      exit(1);
+  }
+
   return 0;
 }
 /*
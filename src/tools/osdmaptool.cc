@@ -26,6 +26,8 @@ using namespace std;
 #include "common/errno.h"
 #include "osd/OSDMap.h"
 #include "mon/MonMap.h"
+#include "mon/PGMap.h"
+#include "include/stringify.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
 
@@ -35,6 +37,10 @@ void usage()
   cout << "   --export-crush <file>   write osdmap's crush map to <file>" << std::endl;
   cout << "   --import-crush <file>   replace osdmap's crush map with <file>" << std::endl;
   cout << "   --test-map-pgs [--pool <poolid>] map all pgs" << std::endl;
+  cout << "   --test-map-pgs-diff [--pool <poolid>] [--diff-map <file>] [--pgmap <file>]" << std::endl;
+  cout << "                           report the pgs and bytes that move from the map" << std::endl;
+  cout << "                           to --diff-map, or to the map with --import-crush" << std::endl;
+  cout << "   --threads <num>         threads mapping the pgs" << std::endl;
   cout << "   --mark-up-in            mark osds up and in (but do not persist)" << std::endl;
   cout << "   --clear-temp            clear pg_temp and primary_temp" << std::endl;
   cout << "   --test-random           do random placements" << std::endl;
@@ -44,6 +50,211 @@ void usage()
   exit(1);
 }
 
+static void set_all_up_in(OSDMap &osdmap)
+{
+  int n = osdmap.get_max_osd();
+  for (int i=0; i<n; i++) {
+    osdmap.set_state(i, osdmap.get_state(i) | CEPH_OSD_UP);
+    osdmap.set_weight(i, CEPH_OSD_IN);
+    osdmap.crush->adjust_item_weightf(g_ceph_context, i, 1.0);
+  }
+}
+
+/// pgs and bytes moving onto and off an osd or a host
+struct pg_move_t {
+  uint64_t pgs_before, pgs_after;
+  uint64_t pgs_in, pgs_out;
+  uint64_t bytes_in, bytes_out;
+  pg_move_t()
+    : pgs_before(0), pgs_after(0), pgs_in(0), pgs_out(0),
+      bytes_in(0), bytes_out(0) {}
+  void add(const pg_move_t &o) {
+    pgs_before += o.pgs_before;
+    pgs_after += o.pgs_after;
+    pgs_in += o.pgs_in;
+    pgs_out += o.pgs_out;
+    bytes_in += o.bytes_in;
+    bytes_out += o.bytes_out;
+  }
+};
+
+static void print_pg_move(ostream &out, const string &name, const pg_move_t &m)
+{
+  out << name
+      << "\t" << m.pgs_before
+      << "\t" << m.pgs_after
+      << "\t" << m.pgs_in
+      << "\t" << m.pgs_out
+      << "\t" << m.bytes_in
+      << "\t" << m.bytes_out
+      << std::endl;
+}
+
+/// bytes each shard of a pg of the pool holds, per the pgmap
+static uint64_t pg_shard_bytes(const PGMap *pgmap, const pg_pool_t &pool,
+			       pg_t pgid, unsigned data_shards)
+{
+  if (!pgmap)
+    return 0;
+  int64_t bytes;
+  ceph::unordered_map<pg_t,pg_stat_t>::const_iterator s =
+    pgmap->pg_stat.find(pgid);
+  if (s != pgmap->pg_stat.end()) {
+    bytes = s->second.stats.sum.num_bytes;
+  } else {
+    // not reported (yet): assume the pool average
+    ceph::unordered_map<int,pool_stat_t>::const_iterator p =
+      pgmap->pg_pool_sum.find(pgid.pool());
+    if (p == pgmap->pg_pool_sum.end() || !pool.get_pg_num())
+      return 0;
+    bytes = p->second.stats.sum.num_bytes / pool.get_pg_num();
+  }
+  if (bytes <= 0)
+    return 0;
+  return bytes / data_shards;
+}
+
+/**
+ * compare the up sets of every pg under two maps
+ *
+ * Both maps get their mapping computed by @p threads threads
+ * (@see OSDMapMapping), the comparison then only reads the tables.
+ * A replica moves when an osd is no longer in the set; a shard of an
+ * erasure coded pg moves when the osd at its position changes.
+ */
+static void map_pgs_diff(const OSDMap &before, const OSDMap &after,
+			 const PGMap *pgmap, int pool, unsigned threads)
+{
+  utime_t start = ceph_clock_now(g_ceph_context);
+  OSDMapMapping *m = new OSDMapMapping;
+  m->update(before, threads);
+  before.set_mapping(OSDMapMappingRef(m));
+  m = new OSDMapMapping;
+  m->update(after, threads);
+  after.set_mapping(OSDMapMappingRef(m));
+  utime_t mapped = ceph_clock_now(g_ceph_context);
+
+  int n = MAX(before.get_max_osd(), after.get_max_osd());
+  vector<pg_move_t> osds(n);
+  uint64_t total_pgs = 0, moved_pgs = 0, moved_shards = 0, moved_bytes = 0;
+  vector<int> up_before, up_after;
+  int primary;
+  const map<int64_t,pg_pool_t>& pools = before.get_pools();
+  for (map<int64_t,pg_pool_t>::const_iterator p = pools.begin();
+       p != pools.end(); ++p) {
+    if (pool != -1 && p->first != pool)
+      continue;
+    if (!after.have_pg_pool(p->first)) {
+      cout << "pool " << p->first << " does not exist in the new map"
+	   << std::endl;
+      continue;
+    }
+    // pg_num may have changed; the new map's pgs are what moves
+    const pg_pool_t &pi = *after.get_pg_pool(p->first);
+    unsigned data_shards = 1;
+    if (pi.is_erasure()) {
+      map<string,string>::const_iterator k =
+	pi.properties.find("erasure-code-k");
+      if (k != pi.properties.end() && atoi(k->second.c_str()) > 0)
+	data_shards = atoi(k->second.c_str());
+    }
+    uint64_t pool_pgs = 0, pool_shards = 0, pool_bytes = 0;
+    for (unsigned ps = 0; ps < pi.get_pg_num(); ++ps) {
+      pg_t pgid(ps, p->first, -1);
+      before.pg_to_up_acting_osds(pgid, &up_before, &primary, NULL, NULL);
+      after.pg_to_up_acting_osds(pgid, &up_after, &primary, NULL, NULL);
+      for (unsigned i = 0; i < up_before.size(); ++i)
+	if (up_before[i] >= 0 && up_before[i] < n)
+	  osds[up_before[i]].pgs_before++;
+      for (unsigned i = 0; i < up_after.size(); ++i)
+	if (up_after[i] >= 0 && up_after[i] < n)
+	  osds[up_after[i]].pgs_after++;
+      if (up_before == up_after)
+	continue;
+
+      uint64_t bytes = pg_shard_bytes(pgmap, pi, pgid, data_shards);
+      unsigned shards = 0;
+      for (unsigned i = 0; i < up_after.size(); ++i) {
+	int o = up_after[i];
+	if (o < 0 || o >= n)
+	  continue;
+	bool moved;
+	if (pi.is_erasure())
+	  moved = i >= up_before.size() || up_before[i] != o;
+	else
+	  moved = find(up_before.begin(), up_before.end(), o) == up_before.end();
+	if (moved) {
+	  osds[o].pgs_in++;
+	  osds[o].bytes_in += bytes;
+	  shards++;
+	}
+      }
+      for (unsigned i = 0; i < up_before.size(); ++i) {
+	int o = up_before[i];
+	if (o < 0 || o >= n)
+	  continue;
+	bool moved;
+	if (pi.is_erasure())
+	  moved = i >= up_after.size() || up_after[i] != o;
+	else
+	  moved = find(up_after.begin(), up_after.end(), o) == up_after.end();
+	if (moved) {
+	  osds[o].pgs_out++;
+	  osds[o].bytes_out += bytes;
+	}
+      }
+      if (shards) {
+	pool_pgs++;
+	pool_shards += shards;
+	pool_bytes += shards * bytes;
+      }
+    }
+    cout << "pool " << p->first << " pg_num " << pi.get_pg_num()
+	 << " moved " << pool_pgs << " pgs " << pool_shards << " shards "
+	 << prettybyte_t(pool_bytes) << std::endl;
+    total_pgs += pi.get_pg_num();
+    moved_pgs += pool_pgs;
+    moved_shards += pool_shards;
+    moved_bytes += pool_bytes;
+  }
+  utime_t end = ceph_clock_now(g_ceph_context);
+
+  // the new map decides where an osd lives, unless it is gone from it
+  map<string,pg_move_t> hosts;
+  int host_type = after.crush->get_type_id("host");
+  cout << "#osd\tbefore\tafter\tin\tout\tbytes_in\tbytes_out\n";
+  for (int i = 0; i < n; ++i) {
+    const pg_move_t &o = osds[i];
+    if (!o.pgs_before && !o.pgs_after)
+      continue;
+    print_pg_move(cout, "osd." + stringify(i), o);
+    string host = "(none)";
+    if (host_type >= 0) {
+      CrushWrapper *crush = after.crush->item_exists(i) ?
+	after.crush.get() : before.crush.get();
+      map<string,string> loc = crush->get_full_location(i);
+      map<string,string>::iterator h = loc.find("host");
+      if (h != loc.end())
+	host = h->second;
+    }
+    hosts[host].add(o);
+  }
+  cout << "#host\tbefore\tafter\tin\tout\tbytes_in\tbytes_out\n";
+  for (map<string,pg_move_t>::iterator h = hosts.begin();
+       h != hosts.end(); ++h)
+    print_pg_move(cout, h->first, h->second);
+
+  cout << " moved " << moved_pgs << "/" << total_pgs << " pgs";
+  if (total_pgs)
+    cout << " (" << (100.0 * moved_pgs / total_pgs) << "%)";
+  cout << " " << moved_shards << " shards";
+  if (pgmap)
+    cout << " " << prettybyte_t(moved_bytes);
+  cout << std::endl;
+  cout << " mapped in " << (mapped - start) << "s with " << threads
+       << " threads, compared in " << (end - mapped) << "s" << std::endl;
+}
+
 int main(int argc, const char **argv)
 {
   vector<const char*> args;
@@ -75,6 +286,9 @@ int main(int argc, const char **argv)
   bool mark_up_in = false;
   bool clear_temp = false;
   bool test_map_pgs = false;
+  bool test_map_pgs_diff = false;
+  std::string diff_map, pgmap_fn;
+  int threads = g_conf->osd_map_mapping_threads;
   bool test_random = false;
 
   std::string val;
@@ -104,6 +318,17 @@ int main(int argc, const char **argv)
       clear_temp = true;
     } else if (ceph_argparse_flag(args, i, "--test-map-pgs", (char*)NULL)) {
       test_map_pgs = true;
+    } else if (ceph_argparse_flag(args, i, "--test-map-pgs-diff", (char*)NULL)) {
+      test_map_pgs_diff = true;
+    } else if (ceph_argparse_witharg(args, i, &val, "--diff-map", (char*)NULL)) {
+      diff_map = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--pgmap", (char*)NULL)) {
+      pgmap_fn = val;
+    } else if (ceph_argparse_withint(args, i, &threads, &err, "--threads", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	exit(EXIT_FAILURE);
+      }
     } else if (ceph_argparse_flag(args, i, "--test-random", (char*)NULL)) {
       test_random = true;
     } else if (ceph_argparse_flag(args, i, "--clobber", (char*)NULL)) {
@@ -217,18 +442,28 @@ int main(int argc, const char **argv)
     modified = true;
   }
 
+  // the map as read, with the non persistent changes: what
+  // --test-map-pgs-diff compares against
+  OSDMap before;
+  if (test_map_pgs_diff) {
+    if (createsimple || create_from_conf) {
+      cerr << me << ": --test-map-pgs-diff needs an existing map" << std::endl;
+      exit(1);
+    }
+    before.decode(bl);
+  }
+
   if (mark_up_in) {
     cout << "marking all OSDs up and in" << std::endl;
-    int n = osdmap.get_max_osd();
-    for (int i=0; i<n; i++) {
-      osdmap.set_state(i, osdmap.get_state(i) | CEPH_OSD_UP);
-      osdmap.set_weight(i, CEPH_OSD_IN);
-      osdmap.crush->adjust_item_weightf(g_ceph_context, i, 1.0);
-    }
+    set_all_up_in(osdmap);
+    if (test_map_pgs_diff)
+      set_all_up_in(before);
   }
   if (clear_temp) {
     cout << "clearing pg/primary temp" << std::endl;
     osdmap.clear_temp();
+    if (test_map_pgs_diff)
+      before.clear_temp();
   }
 
   if (!import_crush.empty()) {
@@ -418,6 +653,55 @@ int main(int argc, const char **argv)
       cout << "size " << i << "\t" << size[i] << std::endl;
     }
   }
+  if (test_map_pgs_diff) {
+    if (pool != -1 && !osdmap.have_pg_pool(pool)) {
+      cerr << "There is no pool " << pool << std::endl;
+      exit(1);
+    }
+    OSDMap other;
+    if (!diff_map.empty()) {
+      bufferlist obl;
+      std::string error;
+      r = obl.read_file(diff_map.c_str(), &error);
+      if (r < 0) {
+	cerr << me << ": couldn't open " << diff_map << ": " << error << std::endl;
+	exit(1);
+      }
+      try {
+	other.decode(obl);
+      }
+      catch (const buffer::error &e) {
+	cerr << me << ": error decoding osdmap '" << diff_map << "'" << std::endl;
+	exit(1);
+      }
+      if (mark_up_in)
+	set_all_up_in(other);
+      if (clear_temp)
+	other.clear_temp();
+    }
+    PGMap *pgmap = NULL;
+    if (!pgmap_fn.empty()) {
+      bufferlist pbl;
+      std::string error;
+      r = pbl.read_file(pgmap_fn.c_str(), &error);
+      if (r < 0) {
+	cerr << me << ": couldn't open " << pgmap_fn << ": " << error << std::endl;
+	exit(1);
+      }
+      pgmap = new PGMap;
+      try {
+	bufferlist::iterator p = pbl.begin();
+	pgmap->decode(p);
+      }
+      catch (const buffer::error &e) {
+	cerr << me << ": error decoding pgmap '" << pgmap_fn << "'" << std::endl;
+	exit(1);
+      }
+    }
+    map_pgs_diff(before, diff_map.empty() ? osdmap : other, pgmap,
+		 pool, MAX(threads, 1));
+    delete pgmap;
+  }
   if (test_crush) {
     int pass = 0;
     while (1) {
@@ -452,11 +736,15 @@ int main(int argc, const char **argv)
   if (!print && !print_json && !tree && !modified && 
       export_crush.empty() && import_crush.empty() && 
       test_map_pg.empty() && test_map_object.empty() &&
-      !test_map_pgs) {
+      !test_map_pgs && !test_map_pgs_diff) {
     cerr << me << ": no action specified?" << std::endl;
     usage();
   }
 
+  if (modified && test_map_pgs_diff) {
+    cout << me << ": not writing the map when comparing" << std::endl;
+    modified = false;
+  }
   if (modified)
     osdmap.inc_epoch();
 
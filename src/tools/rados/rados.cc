@@ -26,6 +26,8 @@ using namespace librados;
 #include "common/debug.h"
 #include "common/errno.h"
 #include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
 #include "common/obj_bencher.h"
 #include "mds/inode_backtrace.h"
 #include "auth/Crypto.h"
@@ -63,7 +65,10 @@ void usage(ostream& out)
 "   rmpool <pool-name> [<pool-name> --yes-i-really-really-mean-it]\n"
 "                                    remove pool <pool-name>'\n"
 "   df                               show per-pool and total usage\n"
-"   ls                               list objects in pool\n\n"
+"   ls                               list objects in pool\n"
+"       --num-shards N               split the pool into N shards and list\n"
+"                                    them in parallel\n"
+"       --shard I                    list only shard I of --num-shards\n\n"
 "   chown 123                        change the pool owner to auid 123\n"
 "\n"
 "OBJECT COMMANDS\n"
@@ -86,9 +91,9 @@ void usage(ostream& out)
 "   rollback <obj-name> <snap-name>  roll back object to snap <snap-name>\n"
 "\n"
 "   listsnaps <obj-name>             list the snapshots of this object\n"
-"   bench <seconds> write|seq|rand [-t concurrent_operations] [--no-cleanup]\n"
+"   bench <seconds> write|seq|rand|mix [-t concurrent_operations] [--no-cleanup]\n"
 "                                    default is 16 concurrent IOs and 4 MB ops\n"
-"                                    default is to clean up after write benchmark\n"
+"                                    default is to clean up after write and mix benchmarks\n"
 "   cleanup <prefix>                 clean up a previous benchmark operation\n"
 "   load-gen [options]               generate load on the cluster\n"
 "   listomapkeys <obj-name>          list the keys in the object map\n"
@@ -114,6 +119,14 @@ void usage(ostream& out)
 "                                    or directory.\n"
 "       --workers                    Number of worker threads to spawn \n"
 "                                    (default " STR(DEFAULT_NUM_RADOS_WORKER_THREADS) ")\n"
+"       --aio-window                 Number of reads or writes each worker\n"
+"                                    keeps in flight for one object\n"
+"                                    (default " STR(DEFAULT_RADOS_SYNC_AIO_WINDOW) ")\n"
+"       --progress-interval          Seconds between progress reports; 0 only\n"
+"                                    reports at the end\n"
+"                                    (default " STR(DEFAULT_RADOS_SYNC_PROGRESS_INTERVAL) ")\n"
+"       Objects or files that are already up to date are skipped, so an\n"
+"       interrupted import or export can simply be run again.\n"
 "\n"
 "ADVISORY LOCKS\n"
 "   lock list <obj-name>\n"
@@ -167,6 +180,14 @@ void usage(ostream& out)
 "        Set number of concurrent I/O operations\n"
 "   --show-time\n"
 "        prefix output with date/time\n"
+"   --format=json|xml\n"
+"        dump results, with latency percentiles, to stdout; progress goes to stderr\n"
+"   --read-percent=N\n"
+"        percent of mix operations that are reads (default 50)\n"
+"   --min-object-size=N, --max-object-size=N\n"
+"        size range of objects written by mix (default -b)\n"
+"   --target-iops=N\n"
+"        start mix operations at this rate rather than as others complete\n"
 "\n"
 "LOAD GEN OPTIONS:\n"
 "   --num-objects                    total number of objects\n"
@@ -1139,6 +1160,75 @@ static int do_cache_flush_evict_all(IoCtx& io_ctx, bool blocking)
   return errors ? -1 : 0;
 }
 
+static int do_ls_shard(IoCtx& io_ctx, uint32_t shard, uint32_t num_shards,
+		       ostream& out, Mutex& out_lock)
+{
+  try {
+    librados::ObjectIterator i = io_ctx.objects_begin_shard(shard, num_shards);
+    librados::ObjectIterator i_end = io_ctx.objects_end();
+    for (; i != i_end; ++i) {
+      Mutex::Locker l(out_lock);
+      if (i->second.size())
+	out << i->first << "\t" << i->second << std::endl;
+      else
+	out << i->first << std::endl;
+    }
+  }
+  catch (const std::runtime_error& e) {
+    Mutex::Locker l(out_lock);
+    cerr << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+class LsShardThread : public Thread {
+  IoCtx& io_ctx;
+  uint32_t shard, num_shards;
+  ostream& out;
+  Mutex& out_lock;
+public:
+  int ret;
+
+  LsShardThread(IoCtx& io_ctx_, uint32_t shard_, uint32_t num_shards_,
+		ostream& out_, Mutex& out_lock_)
+    : io_ctx(io_ctx_), shard(shard_), num_shards(num_shards_),
+      out(out_), out_lock(out_lock_), ret(0) {}
+
+  void *entry() {
+    ret = do_ls_shard(io_ctx, shard, num_shards, out, out_lock);
+    return NULL;
+  }
+};
+
+/**
+ * list a pool, or the shard of it we were asked for, listing the
+ * shards from a thread each when there are several
+ */
+static int do_ls(IoCtx& io_ctx, int shard, int num_shards, ostream& out)
+{
+  Mutex out_lock("rados::do_ls::out_lock");
+  if (shard >= 0)
+    return do_ls_shard(io_ctx, shard, num_shards, out, out_lock);
+
+  vector<LsShardThread*> threads;
+  for (int s = 0; s < num_shards; ++s) {
+    threads.push_back(new LsShardThread(io_ctx, s, num_shards, out,
+					out_lock));
+    threads.back()->create();
+  }
+  int ret = 0;
+  for (vector<LsShardThread*>::iterator p = threads.begin();
+       p != threads.end();
+       ++p) {
+    (*p)->join();
+    if ((*p)->ret < 0)
+      ret = (*p)->ret;
+    delete *p;
+  }
+  return ret;
+}
+
 /**********************************************
 
 **********************************************/
@@ -1165,12 +1255,16 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   uint64_t max_ops = 0;
   uint64_t max_backlog = 0;
   uint64_t target_throughput = 0;
+  int target_iops = 0;
   int64_t read_percent = -1;
   uint64_t num_objs = 0;
   int run_length = 0;
 
   bool show_time = false;
 
+  int shard = -1;
+  int num_shards = 1;
+
   Formatter *formatter = NULL;
   bool pretty_format = false;
 
@@ -1245,6 +1339,10 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   if (i != opts.end()) {
     target_throughput = strtoll(i->second.c_str(), NULL, 10);
   }
+  i = opts.find("target-iops");
+  if (i != opts.end()) {
+    target_iops = strtol(i->second.c_str(), NULL, 10);
+  }
   i = opts.find("read-percent");
   if (i != opts.end()) {
     read_percent = strtoll(i->second.c_str(), NULL, 10);
@@ -1285,6 +1383,16 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   if (i != opts.end()) {
     nspace = i->second;
   }
+  i = opts.find("shard");
+  if (i != opts.end()) {
+    shard = strtol(i->second.c_str(), NULL, 10);
+  }
+  i = opts.find("num-shards");
+  if (i != opts.end()) {
+    num_shards = strtol(i->second.c_str(), NULL, 10);
+    if (num_shards < 1)
+      num_shards = 1;
+  }
 
 
   // open rados
@@ -1497,25 +1605,16 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
     else
       outstream = new ofstream(nargs[1]);
 
-    {
-      try {
-	librados::ObjectIterator i = io_ctx.objects_begin();
-	librados::ObjectIterator i_end = io_ctx.objects_end();
-	for (; i != i_end; ++i) {
-	  if (i->second.size())
-	    *outstream << i->first << "\t" << i->second << std::endl;
-	  else
-	    *outstream << i->first << std::endl;
-	}
-      }
-      catch (const std::runtime_error& e) {
-	cerr << e.what() << std::endl;
-	ret = -1;
-	goto out;
-      }
+    if (shard >= num_shards) {
+      cerr << "--shard must be less than --num-shards" << std::endl;
+      ret = -EINVAL;
+      goto out;
     }
+    ret = do_ls(io_ctx, shard, num_shards, *outstream);
     if (!stdout)
       delete outstream;
+    if (ret < 0)
+      goto out;
   }
   else if (strcmp(nargs[0], "chown") == 0) {
     if (!pool_name || nargs.size() < 2)
@@ -2155,10 +2254,16 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       operation = OP_SEQ_READ;
     else if (strcmp(nargs[2], "rand") == 0)
       operation = OP_RAND_READ;
+    else if (strcmp(nargs[2], "mix") == 0)
+      operation = OP_MIX;
     else
       usage_exit();
     RadosBencher bencher(g_ceph_context, rados, io_ctx);
     bencher.set_show_time(show_time);
+    bencher.set_formatter(formatter);
+    bencher.set_mix(read_percent < 0 ? 50 : read_percent,
+		    min_obj_len, max_obj_len);
+    bencher.set_target_iops(target_iops);
     ret = bencher.aio_bench(operation, seconds, num_objs,
 			    concurrent_ios, op_size, cleanup);
     if (ret != 0)
@@ -2530,6 +2635,8 @@ int main(int argc, const char **argv)
       opts["max-backlog"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--target-throughput", (char*)NULL)) {
       opts["target-throughput"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--target-iops", (char*)NULL)) {
+      opts["target-iops"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--read-percent", (char*)NULL)) {
       opts["read-percent"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--num-objects", (char*)NULL)) {
@@ -2538,6 +2645,14 @@ int main(int argc, const char **argv)
       opts["run-length"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--workers", (char*)NULL)) {
       opts["workers"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--aio-window", (char*)NULL)) {
+      opts["aio-window"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--progress-interval", (char*)NULL)) {
+      opts["progress-interval"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--shard", (char*)NULL)) {
+      opts["shard"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--num-shards", (char*)NULL)) {
+      opts["num-shards"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--format", (char*)NULL)) {
       opts["format"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--lock-tag", (char*)NULL)) {
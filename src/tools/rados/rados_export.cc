@@ -38,10 +38,13 @@ using namespace librados;
 class ExportLocalFileWQ : public RadosSyncWQ {
 public:
   ExportLocalFileWQ(IoCtxDistributor *io_ctx_dist, time_t ti,
-		    ThreadPool *tp, ExportDir *export_dir, bool force)
+		    ThreadPool *tp, ExportDir *export_dir, bool force,
+		    int aio_window, RadosSyncStats *stats)
     : RadosSyncWQ(io_ctx_dist, ti, 0, tp),
       m_export_dir(export_dir),
-      m_force(force)
+      m_force(force),
+      m_aio_window(aio_window),
+      m_stats(stats)
   {
   }
 private:
@@ -63,6 +66,7 @@ private:
     std::string obj_path(sobj->get_fs_path(m_export_dir));
     if (m_force) {
       flags |= (CHANGED_CONTENTS | CHANGED_XATTRS);
+      sobj->get_xattrs(only_in_a);
     }
     else {
       ret = BackedUpObject::from_path(obj_path.c_str(), dobj);
@@ -77,14 +81,16 @@ private:
       }
       else {
 	sobj->xattr_diff(dobj.get(), only_in_a, only_in_b, diff);
-	if ((sobj->get_rados_size() == dobj->get_rados_size()) &&
-	    (sobj->get_mtime() == dobj->get_mtime())) {
+	// download() gives the file the object's mtime, so a file from an
+	// earlier (or interrupted) run that still matches is skipped
+	if ((sobj->get_rados_size() != dobj->get_rados_size()) ||
+	    (sobj->get_mtime() != dobj->get_mtime())) {
 	  flags |= CHANGED_CONTENTS;
 	}
       }
     }
     if (flags & CHANGED_CONTENTS) {
-      ret = sobj->download(io_ctx, obj_path.c_str());
+      ret = sobj->download(io_ctx, obj_path.c_str(), m_aio_window);
       if (ret) {
 	cerr << ERR_PREFIX << "download error: " << ret << std::endl;
 	_exit(ret);
@@ -128,9 +134,12 @@ private:
     else if (flags & CHANGED_XATTRS) {
       cout << "[xattr]        " << rados_name << std::endl;
     }
+    m_stats->add(flags, sobj->get_rados_size());
   }
   ExportDir *m_export_dir;
   bool m_force;
+  int m_aio_window;
+  RadosSyncStats *m_stats;
 };
 
 class ExportValidateExistingWQ : public RadosSyncWQ {
@@ -177,19 +186,17 @@ private:
 
 int do_rados_export(ThreadPool *tp, IoCtx& io_ctx,
       IoCtxDistributor *io_ctx_dist, const char *dir_name,
-      bool create, bool force, bool delete_after)
+      bool create, bool force, bool delete_after, int num_shards,
+      int aio_window, RadosSyncStats *stats)
 {
-  librados::ObjectIterator oi = io_ctx.objects_begin();
-  librados::ObjectIterator oi_end = io_ctx.objects_end();
   auto_ptr <ExportDir> export_dir;
   export_dir.reset(ExportDir::create_for_writing(dir_name, 1, create));
   if (!export_dir.get())
     return -EIO;
   ExportLocalFileWQ export_object_wq(io_ctx_dist, time(NULL),
-				     tp, export_dir.get(), force);
-  for (; oi != oi_end; ++oi) {
-    export_object_wq.queue(new std::string((*oi).first));
-  }
+				     tp, export_dir.get(), force,
+				     aio_window, stats);
+  ListShardThread::list_pool(io_ctx, num_shards, &export_object_wq);
   export_object_wq.drain();
 
   if (delete_after) {
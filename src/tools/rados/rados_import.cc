@@ -35,10 +35,13 @@ using std::auto_ptr;
 class ImportLocalFileWQ : public RadosSyncWQ {
 public:
   ImportLocalFileWQ(const char *dir_name, bool force,
-		    IoCtxDistributor *io_ctx_dist, time_t ti, ThreadPool *tp)
+		    IoCtxDistributor *io_ctx_dist, time_t ti, ThreadPool *tp,
+		    int aio_window, RadosSyncStats *stats)
     : RadosSyncWQ(io_ctx_dist, ti, 0, tp),
       m_dir_name(dir_name),
-      m_force(force)
+      m_force(force),
+      m_aio_window(aio_window),
+      m_stats(stats)
   {
   }
 private:
@@ -62,6 +65,7 @@ private:
     const char *rados_name(sobj->get_rados_name());
     if (m_force) {
       flags |= (CHANGED_CONTENTS | CHANGED_XATTRS);
+      sobj->get_xattrs(only_in_a);
     }
     else {
       ret = BackedUpObject::from_rados(io_ctx, rados_name, dobj);
@@ -76,38 +80,27 @@ private:
       }
       else {
 	sobj->xattr_diff(dobj.get(), only_in_a, only_in_b, diff);
-	if ((sobj->get_rados_size() == dobj->get_rados_size()) &&
-	    (sobj->get_mtime() == dobj->get_mtime())) {
+	// upload() gives the object the file's mtime, so an object from an
+	// earlier (or interrupted) run that still matches is skipped
+	if ((sobj->get_rados_size() != dobj->get_rados_size()) ||
+	    (sobj->get_mtime() != dobj->get_mtime())) {
 	  flags |= CHANGED_CONTENTS;
 	}
       }
     }
     if (flags & CHANGED_CONTENTS) {
-      ret = sobj->upload(io_ctx, local_name.c_str(), m_dir_name.c_str());
+      ret = sobj->upload(io_ctx, local_name.c_str(), m_dir_name.c_str(),
+			 m_aio_window);
       if (ret) {
 	cerr << ERR_PREFIX << "upload error: " << ret << std::endl;
 	_exit(ret);
       }
     }
-    for (std::list < std::string >::const_iterator x = only_in_a.begin();
-	 x != only_in_a.end(); ++x) {
-      flags |= CHANGED_XATTRS;
-      const Xattr *xattr = sobj->get_xattr(*x);
-      if (xattr == NULL) {
-	cerr << ERR_PREFIX << "internal error on line: " << __LINE__ << std::endl;
-	_exit(ret);
-      }
-      bufferlist bl;
-      bl.append(xattr->data, xattr->len);
-      ret = io_ctx.setxattr(rados_name, x->c_str(), bl);
-      if (ret < 0) {
-	ret = errno;
-	cerr << ERR_PREFIX << "io_ctx.setxattr(rados_name='" << rados_name
-	     << "', xattr_name='" << x->c_str() << "'): " << cpp_strerror(ret)
-	     << std::endl;
-	_exit(ret);
-      }
-    }
+    // apply all of the xattr changes in one op, keeping the file's mtime
+    ObjectWriteOperation xattr_op;
+    time_t mtime = sobj->get_mtime();
+    xattr_op.mtime(&mtime);
+    diff.splice(diff.begin(), only_in_a);
     for (std::list < std::string >::const_iterator x = diff.begin();
 	 x != diff.end(); ++x) {
       flags |= CHANGED_XATTRS;
@@ -118,28 +111,19 @@ private:
       }
       bufferlist bl;
       bl.append(xattr->data, xattr->len);
-      ret = io_ctx.rmxattr(rados_name, x->c_str());
-      if (ret < 0) {
-	cerr << ERR_PREFIX << "io_ctx.rmxattr error2: " << cpp_strerror(ret)
-	     << std::endl;
-	_exit(ret);
-      }
-      ret = io_ctx.setxattr(rados_name, x->c_str(), bl);
-      if (ret < 0) {
-	ret = errno;
-	cerr << ERR_PREFIX << "io_ctx.setxattr(rados_name='" << rados_name
-	     << "', xattr='" << x->c_str() << "'): " << cpp_strerror(ret) << std::endl;
-	_exit(ret);
-      }
+      xattr_op.setxattr(x->c_str(), bl);
     }
     for (std::list < std::string >::const_iterator x = only_in_b.begin();
 	 x != only_in_b.end(); ++x) {
       flags |= CHANGED_XATTRS;
-      ret = io_ctx.rmxattr(rados_name, x->c_str());
+      xattr_op.rmxattr(x->c_str());
+    }
+    if (!diff.empty() || !only_in_b.empty()) {
+      ret = io_ctx.operate(rados_name, &xattr_op);
       if (ret < 0) {
-	ret = errno;
-	cerr << ERR_PREFIX << "rmxattr error3: " << cpp_strerror(ret) << std::endl;
-	_exit(ret);
+	cerr << ERR_PREFIX << "xattr update of '" << rados_name << "' failed: "
+	     << cpp_strerror(ret) << std::endl;
+	_exit(-ret);
       }
     }
     if (m_force) {
@@ -151,9 +135,12 @@ private:
     else if (flags & CHANGED_XATTRS) {
       cout << "[xattr]        " << rados_name << std::endl;
     }
+    m_stats->add(flags, sobj->get_rados_size());
   }
   std::string m_dir_name;
   bool m_force;
+  int m_aio_window;
+  RadosSyncStats *m_stats;
 };
 
 class ImportValidateExistingWQ : public RadosSyncWQ {
@@ -197,7 +184,8 @@ private:
 };
 
 int do_rados_import(ThreadPool *tp, IoCtx &io_ctx, IoCtxDistributor* io_ctx_dist,
-	   const char *dir_name, bool force, bool delete_after)
+	   const char *dir_name, bool force, bool delete_after, int num_shards,
+	   int aio_window, RadosSyncStats *stats)
 {
   auto_ptr <ExportDir> export_dir;
   export_dir.reset(ExportDir::from_file_system(dir_name));
@@ -211,7 +199,8 @@ int do_rados_import(ThreadPool *tp, IoCtx &io_ctx, IoCtxDistributor* io_ctx_dist
     return ret;
   }
   ImportLocalFileWQ import_file_wq(dir_name, force,
-				   io_ctx_dist, time(NULL), tp);
+				   io_ctx_dist, time(NULL), tp,
+				   aio_window, stats);
   while (true) {
     struct dirent *de = readdir(dh.dp);
     if (!de)
@@ -227,11 +216,7 @@ int do_rados_import(ThreadPool *tp, IoCtx &io_ctx, IoCtxDistributor* io_ctx_dist
   if (delete_after) {
     ImportValidateExistingWQ import_val_wq(export_dir.get(), io_ctx_dist,
 					   time(NULL), tp);
-    librados::ObjectIterator oi = io_ctx.objects_begin();
-    librados::ObjectIterator oi_end = io_ctx.objects_end();
-    for (; oi != oi_end; ++oi) {
-      import_val_wq.queue(new std::string((*oi).first));
-    }
+    ListShardThread::list_pool(io_ctx, num_shards, &import_val_wq);
     import_val_wq.drain();
   }
   cout << "[done]" << std::endl;
@@ -13,6 +13,7 @@
  */
 #include "include/int_types.h"
 
+#include "common/Clock.h"
 #include "common/ceph_argparse.h"
 #include "common/config.h"
 #include "common/errno.h"
@@ -25,10 +26,13 @@
 
 #include "common/xattr.h"
 
+#include <algorithm>
 #include <dirent.h>
 #include <errno.h>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <list>
 #include <memory>
 #include <sstream>
 #include <stdlib.h>
@@ -37,6 +41,7 @@
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
+#include <utime.h>
 
 using namespace librados;
 using std::auto_ptr;
@@ -51,6 +56,38 @@ static const size_t USER_XATTR_PREFIX_LEN =
 const char RADOS_SYNC_TMP_SUFFIX[] = "$tmp";
 static const size_t RADOS_SYNC_TMP_SUFFIX_LEN =
   sizeof(RADOS_SYNC_TMP_SUFFIX) / sizeof(RADOS_SYNC_TMP_SUFFIX[0]) - 1;
+/* Objects are copied in pieces of this size, several at a time */
+static const uint64_t RADOS_SYNC_CHUNK_SZ = 1 << 20;
+
+/* One piece of an object being read or written with aio */
+struct ChunkIO {
+  explicit ChunkIO(uint64_t off_)
+    : off(off_), c(Rados::aio_create_completion())
+  {
+  }
+  ~ChunkIO() {
+    c->release();
+  }
+  int wait() {
+    c->wait_for_complete();
+    return c->get_return_value();
+  }
+
+  uint64_t off;
+  bufferlist bl;
+  ObjectWriteOperation op;
+  AioCompletion *c;
+};
+
+/* Wait for the oldest write in flight; returns its result */
+static int finish_oldest_write(std::list <ChunkIO*> &inflight)
+{
+  ChunkIO *io = inflight.front();
+  inflight.pop_front();
+  int ret = io->wait();
+  delete io;
+  return ret;
+}
 
 std::string get_user_xattr_name(const char *fs_xattr_name)
 {
@@ -336,6 +373,104 @@ void RadosSyncWQ::_clear() {
   m_items.clear();
 }
 
+ListShardThread::ListShardThread(IoCtx &io_ctx, uint32_t shard,
+				 uint32_t num_shards, RadosSyncWQ *wq)
+  : m_io_ctx(io_ctx), m_shard(shard), m_num_shards(num_shards), m_wq(wq)
+{
+}
+
+void ListShardThread::list_pool(IoCtx &io_ctx, int num_shards,
+				RadosSyncWQ *wq)
+{
+  std::vector <ListShardThread*> listers;
+  for (int i = 0; i < num_shards; ++i) {
+    listers.push_back(new ListShardThread(io_ctx, i, num_shards, wq));
+    listers.back()->create();
+  }
+  for (std::vector <ListShardThread*>::iterator l = listers.begin();
+       l != listers.end(); ++l) {
+    (*l)->join();
+    delete *l;
+  }
+}
+
+void *ListShardThread::entry()
+{
+  librados::ObjectIterator oi =
+    m_io_ctx.objects_begin_shard(m_shard, m_num_shards);
+  librados::ObjectIterator oi_end = m_io_ctx.objects_end();
+  for (; oi != oi_end; ++oi) {
+    m_wq->queue(new std::string((*oi).first));
+  }
+  return NULL;
+}
+
+RadosSyncStats::RadosSyncStats()
+  : m_interval(0),
+    m_lock("RadosSyncStats::m_lock"),
+    m_stopping(false),
+    m_reporter(this)
+{
+}
+
+RadosSyncStats::~RadosSyncStats()
+{
+}
+
+void RadosSyncStats::start(int interval)
+{
+  m_start = ceph_clock_now(g_ceph_context);
+  m_interval = interval;
+  if (m_interval > 0)
+    m_reporter.create();
+}
+
+void RadosSyncStats::stop()
+{
+  if (m_interval > 0) {
+    m_lock.Lock();
+    m_stopping = true;
+    m_cond.Signal();
+    m_lock.Unlock();
+    m_reporter.join();
+  }
+  report("[summary]      ");
+}
+
+void RadosSyncStats::add(int flags, uint64_t bytes)
+{
+  m_objects.inc();
+  if (!flags)
+    m_unchanged.inc();
+  if (flags & CHANGED_CONTENTS)
+    m_bytes.add(bytes);
+}
+
+void RadosSyncStats::report(const char *prefix)
+{
+  double elapsed = ceph_clock_now(g_ceph_context) - m_start;
+  double mb = (double)m_bytes.read() / (1 << 20);
+  std::ostringstream oss;
+  oss << prefix << m_objects.read() << " objects ("
+      << m_unchanged.read() << " unchanged), "
+      << std::fixed << std::setprecision(1) << mb << " MB copied in "
+      << elapsed << " s, " << (elapsed > 0 ? mb / elapsed : 0) << " MB/s";
+  cout << oss.str() << std::endl;
+}
+
+void *RadosSyncStats::Reporter::entry()
+{
+  stats->m_lock.Lock();
+  while (!stats->m_stopping) {
+    stats->m_cond.WaitInterval(g_ceph_context, stats->m_lock,
+			       utime_t(stats->m_interval, 0));
+    if (!stats->m_stopping)
+      stats->report("[progress]     ");
+  }
+  stats->m_lock.Unlock();
+  return NULL;
+}
+
 Xattr::Xattr(char *data_, ssize_t len_)
     : data(data_), len(len_)
 {
@@ -442,7 +577,13 @@ int BackedUpObject::from_rados(IoCtx& io_ctx, const char *rados_name_,
 {
   uint64_t rados_size_ = 0;
   time_t rados_time_ = 0;
-  int ret = io_ctx.stat(rados_name_, &rados_size_, &rados_time_);
+  map<std::string, bufferlist> attrset;
+  int stat_ret = 0, xattrs_ret = 0;
+  // one round trip for both
+  ObjectReadOperation op;
+  op.stat(&rados_size_, &rados_time_, &stat_ret);
+  op.getxattrs(&attrset, &xattrs_ret);
+  int ret = io_ctx.operate(rados_name_, &op, NULL);
   if (ret == -ENOENT) {
     // don't complain here about ENOENT
     return ret;
@@ -452,7 +593,7 @@ int BackedUpObject::from_rados(IoCtx& io_ctx, const char *rados_name_,
     return ret;
   }
   BackedUpObject *o = new BackedUpObject(rados_name_, rados_size_, rados_time_);
-  ret = o->read_xattrs_from_rados(io_ctx);
+  ret = o->read_xattrs_from_rados(attrset);
   if (ret) {
     cerr << ERR_PREFIX << "BackedUpObject::from_rados(rados_name_ = '"
 	  << rados_name_ << "'): read_xattrs_from_rados returned "
@@ -558,7 +699,7 @@ time_t BackedUpObject::get_mtime() const {
   return rados_time;
 }
 
-int BackedUpObject::download(IoCtx &io_ctx, const char *path)
+int BackedUpObject::download(IoCtx &io_ctx, const char *path, int aio_window)
 {
   char tmp_path[strlen(path) + RADOS_SYNC_TMP_SUFFIX_LEN + 1];
   snprintf(tmp_path, sizeof(tmp_path), "%s%s", path, RADOS_SYNC_TMP_SUFFIX);
@@ -570,31 +711,47 @@ int BackedUpObject::download(IoCtx &io_ctx, const char *path)
     return err;
   }
   int fd = fileno(fp);
+  // keep up to aio_window reads in flight, and write them out in order
+  std::list <ChunkIO*> inflight;
   uint64_t off = 0;
-  static const int CHUNK_SZ = 32765;
+  int ret = 0;
   while (true) {
-    bufferlist bl;
-    int rlen = io_ctx.read(rados_name, bl, CHUNK_SZ, off);
-    if (rlen < 0) {
-      cerr << ERR_PREFIX << "download: io_ctx.read(" << rados_name << ") returned "
-	   << rlen << std::endl;
-      fclose(fp);
-      return rlen;
-    }
-    if (rlen < CHUNK_SZ)
-      off = 0;
-    else
-      off += rlen;
-    size_t flen = fwrite(bl.c_str(), 1, rlen, fp);
-    if (flen != (size_t)rlen) {
-      int err = errno;
-      cerr << ERR_PREFIX << "download: fwrite(" << tmp_path << ") error: "
-	   << cpp_strerror(err) << std::endl;
-      fclose(fp);
-      return err;
+    while (!ret && off < rados_size && (int)inflight.size() < aio_window) {
+      uint64_t len = std::min(RADOS_SYNC_CHUNK_SZ, rados_size - off);
+      ChunkIO *io = new ChunkIO(off);
+      int r = io_ctx.aio_read(rados_name, io->c, &io->bl, len, off);
+      if (r < 0) {
+	cerr << ERR_PREFIX << "download: io_ctx.aio_read(" << rados_name
+	     << ") returned " << r << std::endl;
+	delete io;
+	ret = r;
+	break;
+      }
+      inflight.push_back(io);
+      off += len;
     }
-    if (off == 0)
+    if (inflight.empty())
       break;
+    ChunkIO *io = inflight.front();
+    inflight.pop_front();
+    int rlen = io->wait();
+    if (!ret && rlen < 0) {
+      cerr << ERR_PREFIX << "download: io_ctx.aio_read(" << rados_name << ") returned "
+	   << rlen << std::endl;
+      ret = rlen;
+    } else if (!ret) {
+      size_t flen = fwrite(io->bl.c_str(), 1, rlen, fp);
+      if (flen != (size_t)rlen) {
+	ret = errno;
+	cerr << ERR_PREFIX << "download: fwrite(" << tmp_path << ") error: "
+	     << cpp_strerror(ret) << std::endl;
+      }
+    }
+    delete io;
+  }
+  if (ret) {
+    fclose(fp);
+    return ret;
   }
   size_t attr_sz = strlen(rados_name) + 1;
   int res = ceph_os_fsetxattr(fd, XATTR_FULLNAME, rados_name, attr_sz);
@@ -611,6 +768,14 @@ int BackedUpObject::download(IoCtx &io_ctx, const char *path)
 	 << cpp_strerror(err) << std::endl;
     return err;
   }
+  struct utimbuf ut;
+  ut.actime = ut.modtime = rados_time;
+  if (utime(tmp_path, &ut)) {
+    int err = errno;
+    cerr << ERR_PREFIX << "download: utime(" << tmp_path << ") error: "
+	 << cpp_strerror(err) << std::endl;
+    return err;
+  }
   if (rename(tmp_path, path)) {
     int err = errno;
     cerr << ERR_PREFIX << "download: rename(" << tmp_path << ", "
@@ -620,7 +785,8 @@ int BackedUpObject::download(IoCtx &io_ctx, const char *path)
   return 0;
 }
 
-int BackedUpObject::upload(IoCtx &io_ctx, const char *file_name, const char *dir_name)
+int BackedUpObject::upload(IoCtx &io_ctx, const char *file_name, const char *dir_name,
+			   int aio_window)
 {
   char path[strlen(file_name) + strlen(dir_name) + 2];
   snprintf(path, sizeof(path), "%s/%s", dir_name, file_name);
@@ -631,51 +797,65 @@ int BackedUpObject::upload(IoCtx &io_ctx, const char *file_name, const char *dir
 	 << cpp_strerror(err) << std::endl;
     return err;
   }
-  // Need to truncate RADOS object to size 0, in case there is
-  // already something there.
-  int ret = io_ctx.trunc(rados_name, 0);
-  if (ret) {
-    cerr << ERR_PREFIX << "upload: trunc failed with error " << ret << std::endl;
-    fclose(fp);
-    return ret;
-  }
+  time_t mtime = rados_time;
+  std::list <ChunkIO*> inflight;
   uint64_t off = 0;
-  static const int CHUNK_SZ = 32765;
-  while (true) {
-    char buf[CHUNK_SZ];
-    int flen = fread(buf, 1, CHUNK_SZ, fp);
-    if (flen < 0) {
-      int err = errno;
-      cerr << ERR_PREFIX << "upload: fread(" << file_name << ") error: "
-	   << cpp_strerror(err) << std::endl;
-      fclose(fp);
-      return err;
-    }
-    if ((flen == 0) && (off != 0)) {
-      fclose(fp);
-      break;
-    }
-    // There must be a zero-copy way to do this?
-    bufferlist bl;
-    bl.append(buf, flen);
-    int rlen = io_ctx.write(rados_name, bl, flen, off);
-    if (rlen < 0) {
-      fclose(fp);
-      cerr << ERR_PREFIX << "upload: rados_write error: " << rlen << std::endl;
-      return rlen;
-    }
-    if (rlen != flen) {
-      fclose(fp);
-      cerr << ERR_PREFIX << "upload: rados_write error: short write" << std::endl;
-      return -EIO;
+  int ret = 0;
+  do {
+    uint64_t len = std::min(RADOS_SYNC_CHUNK_SZ, rados_size - off);
+    ChunkIO *io = new ChunkIO(off);
+    if (len) {
+      bufferptr bp = buffer::create(len);
+      size_t flen = fread(bp.c_str(), 1, len, fp);
+      if (flen != len) {
+	ret = ferror(fp) ? errno : EIO;
+	cerr << ERR_PREFIX << "upload: fread(" << file_name << ") error: "
+	     << (ferror(fp) ? cpp_strerror(ret) : "file changed size") << std::endl;
+	delete io;
+	break;
+      }
+      io->bl.append(bp);
     }
-    off += rlen;
-    if (flen < CHUNK_SZ) {
-      fclose(fp);
-      return 0;
+    io->op.mtime(&mtime);
+    // The first piece replaces whatever was there before, and only the
+    // last one gives the object its full size, so a copy that stops
+    // half way never looks complete to the next run.  Both wait for
+    // everything before them; the pieces in between go in parallel.
+    if (off == 0 || off + len >= rados_size) {
+      if (off == 0)
+	io->op.write_full(io->bl);
+      else
+	io->op.write(off, io->bl);
+      while (!inflight.empty()) {
+	int r = finish_oldest_write(inflight);
+	if (r < 0 && !ret)
+	  ret = r;
+      }
+      if (!ret)
+	ret = io_ctx.operate(rados_name, &io->op);
+      delete io;
+    } else {
+      io->op.write(off, io->bl);
+      ret = io_ctx.aio_operate(rados_name, io->c, &io->op);
+      if (ret < 0) {
+	delete io;
+	break;
+      }
+      inflight.push_back(io);
+      if ((int)inflight.size() >= aio_window)
+	ret = finish_oldest_write(inflight);
     }
+    off += len;
+  } while (!ret && off < rados_size);
+  while (!inflight.empty()) {
+    int r = finish_oldest_write(inflight);
+    if (r < 0 && !ret)
+      ret = r;
   }
-  return 0;
+  fclose(fp);
+  if (ret < 0)
+    cerr << ERR_PREFIX << "upload: rados_write error: " << ret << std::endl;
+  return ret;
 }
 
 BackedUpObject::BackedUpObject(const char *rados_name_,
@@ -752,15 +932,8 @@ int BackedUpObject::read_xattrs_from_file(int fd)
   return 0;
 }
 
-int BackedUpObject::read_xattrs_from_rados(IoCtx &io_ctx)
+int BackedUpObject::read_xattrs_from_rados(map<std::string, bufferlist> &attrset)
 {
-  map<std::string, bufferlist> attrset;
-  int ret = io_ctx.getxattrs(rados_name, attrset);
-  if (ret) {
-    cerr << ERR_PREFIX << "BackedUpObject::read_xattrs_from_rados: "
-	 << "getxattrs failed with error code " << ret << std::endl;
-    return ret;
-  }
   for (map<std::string, bufferlist>::iterator i = attrset.begin();
        i != attrset.end(); )
   {
@@ -780,6 +953,28 @@ int BackedUpObject::read_xattrs_from_rados(IoCtx &io_ctx)
   return 0;
 }
 
+/* Parse a numeric option; returns false after complaining if it is not an
+ * integer between min and max */
+static bool get_int_opt(const std::map < std::string, std::string > &opts,
+			const char *name, int min, int max, int *val)
+{
+  std::map < std::string, std::string >::const_iterator n = opts.find(name);
+  if (n == opts.end())
+    return true;
+  std::string err;
+  *val = strict_strtol(n->second.c_str(), 10, &err);
+  if (!err.empty()) {
+    cerr << "rados: can't parse --" << name << ": " << err << std::endl;
+    return false;
+  }
+  if ((*val < min) || (*val > max)) {
+    cerr << "rados: unreasonable value given for --" << name << ": "
+	 << *val << std::endl;
+    return false;
+  }
+  return true;
+}
+
 int rados_tool_sync(const std::map < std::string, std::string > &opts,
                              std::vector<const char*> &args)
 {
@@ -807,7 +1002,12 @@ int rados_tool_sync(const std::map < std::string, std::string > &opts,
       return 1;
     }
   }
-
+  int aio_window = DEFAULT_RADOS_SYNC_AIO_WINDOW;
+  if (!get_int_opt(opts, "aio-window", 1, 1024, &aio_window))
+    return 1;
+  int progress_interval = DEFAULT_RADOS_SYNC_PROGRESS_INTERVAL;
+  if (!get_int_opt(opts, "progress-interval", 0, 86400, &progress_interval))
+    return 1;
 
   std::string action, src, dst;
   std::vector<const char*>::iterator i = args.begin();
@@ -885,17 +1085,19 @@ int rados_tool_sync(const std::map < std::string, std::string > &opts,
 
   ThreadPool thread_pool(g_ceph_context, "rados_sync_threadpool", num_threads);
   thread_pool.start();
+  RadosSyncStats stats;
+  stats.start(progress_interval);
 
   if (action == "import") {
     ret = do_rados_import(&thread_pool, io_ctx, io_ctx_dist, src.c_str(),
-		     force, delete_after);
-    thread_pool.stop();
-    return ret;
+		     force, delete_after, num_threads, aio_window, &stats);
   }
   else {
     ret = do_rados_export(&thread_pool, io_ctx, io_ctx_dist, dst.c_str(),
-		     create, force, delete_after);
-    thread_pool.stop();
-    return ret;
+		     create, force, delete_after, num_threads, aio_window,
+		     &stats);
   }
+  thread_pool.stop();
+  stats.stop();
+  return ret;
 }
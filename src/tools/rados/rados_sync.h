@@ -17,6 +17,11 @@
 
 #include <stddef.h>
 #include "include/atomic.h"
+#include "include/buffer.h"
+#include "include/utime.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
 #include "common/WorkQueue.h"
 
 #include <string>
@@ -31,6 +36,8 @@ extern const char USER_XATTR_PREFIX[];
 extern const char RADOS_SYNC_TMP_SUFFIX[];
 #define ERR_PREFIX "[ERROR]        "
 #define DEFAULT_NUM_RADOS_WORKER_THREADS 5
+#define DEFAULT_RADOS_SYNC_AIO_WINDOW 8
+#define DEFAULT_RADOS_SYNC_PROGRESS_INTERVAL 10
 
 /* Linux seems to use ENODATA instead of ENOATTR when an extended attribute
  * is missing */
@@ -133,6 +140,62 @@ private:
   std::deque<std::string*> m_items;
 };
 
+/** Lists one shard of a pool into a RadosSyncWQ, so that listing a large
+ * pool is not limited to one thread.
+ */
+class ListShardThread : public Thread {
+public:
+  ListShardThread(librados::IoCtx &io_ctx, uint32_t shard, uint32_t num_shards,
+		  RadosSyncWQ *wq);
+  /* List all of io_ctx's objects into wq from num_shards threads */
+  static void list_pool(librados::IoCtx &io_ctx, int num_shards,
+			RadosSyncWQ *wq);
+private:
+  void *entry();
+
+  librados::IoCtx &m_io_ctx;
+  uint32_t m_shard;
+  uint32_t m_num_shards;
+  RadosSyncWQ *m_wq;
+};
+
+/** Counts what an import or export has done so far, and prints its
+ * progress and throughput every few seconds while it runs.
+ */
+class RadosSyncStats
+{
+public:
+  RadosSyncStats();
+  ~RadosSyncStats();
+  /* Start reporting every 'interval' seconds; 0 reports only at the end */
+  void start(int interval);
+  /* Stop reporting, and print a summary */
+  void stop();
+  /* Account for one object; 'flags' are the CHANGED_* bits that were
+   * copied, and 'bytes' the amount of object data */
+  void add(int flags, uint64_t bytes);
+private:
+  class Reporter : public Thread {
+  public:
+    explicit Reporter(RadosSyncStats *s) : stats(s) {}
+    void *entry();
+  private:
+    RadosSyncStats *stats;
+  };
+
+  friend class Reporter;
+  void report(const char *prefix);
+
+  ceph::atomic_t m_objects, m_unchanged;
+  ceph::atomic64_t m_bytes;
+  utime_t m_start;
+  int m_interval;
+  Mutex m_lock;
+  Cond m_cond;
+  bool m_stopping;
+  Reporter m_reporter;
+};
+
 /* Stores a length and a chunk of malloc()ed data */
 class Xattr {
 public:
@@ -185,16 +248,22 @@ public:
 
   time_t get_mtime() const;
 
-  int download(librados::IoCtx &io_ctx, const char *path);
+  /* Copy the object's data to path, with up to aio_window reads in flight.
+   * The file's mtime is set to the object's, so a later export can tell
+   * that it is up to date. */
+  int download(librados::IoCtx &io_ctx, const char *path, int aio_window);
 
-  int upload(librados::IoCtx &io_ctx, const char *file_name, const char *dir_name);
+  /* Copy the file's data to the object, with up to aio_window writes in
+   * flight.  The object's mtime is set to the file's. */
+  int upload(librados::IoCtx &io_ctx, const char *file_name, const char *dir_name,
+	     int aio_window);
 
 private:
   BackedUpObject(const char *rados_name_, uint64_t rados_size_, time_t rados_time_);
 
   int read_xattrs_from_file(int fd);
 
-  int read_xattrs_from_rados(librados::IoCtx &io_ctx);
+  int read_xattrs_from_rados(std::map<std::string, bufferlist> &attrset);
 
   // don't allow copying
   BackedUpObject &operator=(const BackedUpObject &rhs);
@@ -208,9 +277,11 @@ private:
 
 extern int do_rados_import(ThreadPool *tp, librados::IoCtx &io_ctx,
     IoCtxDistributor* io_ctx_dist, const char *dir_name,
-    bool force, bool delete_after);
+    bool force, bool delete_after, int num_shards, int aio_window,
+    RadosSyncStats *stats);
 extern int do_rados_export(ThreadPool *tp, librados::IoCtx& io_ctx,
     IoCtxDistributor *io_ctx_dist, const char *dir_name, 
-    bool create, bool force, bool delete_after);
+    bool create, bool force, bool delete_after, int num_shards,
+    int aio_window, RadosSyncStats *stats);
 
 #endif
@@ -0,0 +1,3 @@
+#define TRACEPOINT_CREATE_PROBES
+#define TRACEPOINT_DEFINE
+#include "tracing/msg.h"
@@ -0,0 +1,38 @@
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER ceph_msg
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "tracing/msg.h"
+
+#if !defined(TRACING_MSG_H) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define TRACING_MSG_H
+
+#include <lttng/tracepoint.h>
+
+/*
+ * A message has been read off the wire and decoded.  (src_type,
+ * src_num, tid) matches the reqid carried by the ceph_osd events.
+ */
+TRACEPOINT_EVENT(ceph_msg, read_message,
+    TP_ARGS(
+        uint8_t, src_type,
+        int64_t, src_num,
+        uint64_t, tid,
+        uint64_t, seq,
+        uint16_t, type,
+        uint32_t, front_len,
+        uint32_t, data_len),
+    TP_FIELDS(
+        ctf_integer(uint8_t, src_type, src_type)
+        ctf_integer(int64_t, src_num, src_num)
+        ctf_integer(uint64_t, tid, tid)
+        ctf_integer(uint64_t, seq, seq)
+        ctf_integer(uint16_t, type, type)
+        ctf_integer(uint32_t, front_len, front_len)
+        ctf_integer(uint32_t, data_len, data_len)
+    )
+)
+
+#endif /* TRACING_MSG_H */
+
+#include <lttng/tracepoint-event.h>
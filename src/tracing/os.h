@@ -0,0 +1,63 @@
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER ceph_os
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "tracing/os.h"
+
+#if !defined(TRACING_OS_H) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define TRACING_OS_H
+
+#include <lttng/tracepoint.h>
+
+/*
+ * op_seq is the OpTracker sequence number of the client op the
+ * transaction belongs to (0 if untracked); it matches op_seq in the
+ * ceph_osd events.
+ */
+TRACEPOINT_EVENT(ceph_os, journal_submit,
+    TP_ARGS(
+        uint64_t, op_seq,
+        uint64_t, jseq,
+        uint32_t, len),
+    TP_FIELDS(
+        ctf_integer(uint64_t, op_seq, op_seq)
+        ctf_integer(uint64_t, jseq, jseq)
+        ctf_integer(uint32_t, len, len)
+    )
+)
+
+TRACEPOINT_EVENT(ceph_os, journal_complete,
+    TP_ARGS(
+        uint64_t, op_seq,
+        uint64_t, jseq),
+    TP_FIELDS(
+        ctf_integer(uint64_t, op_seq, op_seq)
+        ctf_integer(uint64_t, jseq, jseq)
+    )
+)
+
+TRACEPOINT_EVENT(ceph_os, apply_start,
+    TP_ARGS(
+        uint64_t, op_seq,
+        uint64_t, apply_seq,
+        uint32_t, bytes),
+    TP_FIELDS(
+        ctf_integer(uint64_t, op_seq, op_seq)
+        ctf_integer(uint64_t, apply_seq, apply_seq)
+        ctf_integer(uint32_t, bytes, bytes)
+    )
+)
+
+TRACEPOINT_EVENT(ceph_os, apply_finish,
+    TP_ARGS(
+        uint64_t, op_seq,
+        uint64_t, apply_seq),
+    TP_FIELDS(
+        ctf_integer(uint64_t, op_seq, op_seq)
+        ctf_integer(uint64_t, apply_seq, apply_seq)
+    )
+)
+
+#endif /* TRACING_OS_H */
+
+#include <lttng/tracepoint-event.h>
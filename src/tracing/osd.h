@@ -0,0 +1,91 @@
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER ceph_osd
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "tracing/osd.h"
+
+#if !defined(TRACING_OSD_H) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define TRACING_OSD_H
+
+#include <lttng/tracepoint.h>
+
+/*
+ * Every event carries the client reqid (name_type, name_num, tid, inc)
+ * and the OpTracker sequence number of the op (op_seq), which joins
+ * these events with the ceph_os ones.
+ */
+TRACEPOINT_EVENT_CLASS(ceph_osd, op_class,
+    TP_ARGS(
+        uint8_t, name_type,
+        int64_t, name_num,
+        uint64_t, tid,
+        int32_t, inc,
+        uint64_t, op_seq),
+    TP_FIELDS(
+        ctf_integer(uint8_t, name_type, name_type)
+        ctf_integer(int64_t, name_num, name_num)
+        ctf_integer(uint64_t, tid, tid)
+        ctf_integer(int32_t, inc, inc)
+        ctf_integer(uint64_t, op_seq, op_seq)
+    )
+)
+
+TRACEPOINT_EVENT_INSTANCE(ceph_osd, op_class, opwq_enqueue,
+    TP_ARGS(
+        uint8_t, name_type,
+        int64_t, name_num,
+        uint64_t, tid,
+        int32_t, inc,
+        uint64_t, op_seq)
+)
+
+TRACEPOINT_EVENT_INSTANCE(ceph_osd, op_class, opwq_dequeue,
+    TP_ARGS(
+        uint8_t, name_type,
+        int64_t, name_num,
+        uint64_t, tid,
+        int32_t, inc,
+        uint64_t, op_seq)
+)
+
+TRACEPOINT_EVENT_INSTANCE(ceph_osd, op_class, do_op,
+    TP_ARGS(
+        uint8_t, name_type,
+        int64_t, name_num,
+        uint64_t, tid,
+        int32_t, inc,
+        uint64_t, op_seq)
+)
+
+TRACEPOINT_EVENT_INSTANCE(ceph_osd, op_class, op_commit,
+    TP_ARGS(
+        uint8_t, name_type,
+        int64_t, name_num,
+        uint64_t, tid,
+        int32_t, inc,
+        uint64_t, op_seq)
+)
+
+TRACEPOINT_EVENT(ceph_osd, op_reply,
+    TP_ARGS(
+        uint8_t, name_type,
+        int64_t, name_num,
+        uint64_t, tid,
+        int32_t, inc,
+        uint64_t, op_seq,
+        int32_t, result,
+        uint32_t, flags),
+    TP_FIELDS(
+        ctf_integer(uint8_t, name_type, name_type)
+        ctf_integer(int64_t, name_num, name_num)
+        ctf_integer(uint64_t, tid, tid)
+        ctf_integer(int32_t, inc, inc)
+        ctf_integer(uint64_t, op_seq, op_seq)
+        ctf_integer(int32_t, result, result)
+        ctf_integer_hex(uint32_t, flags, flags)
+    )
+)
+
+#endif /* TRACING_OSD_H */
+
+#include <lttng/tracepoint-event.h>